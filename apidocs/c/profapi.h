@@ -41,6 +41,13 @@ Themes are specified in ~/.local/share/profanity/plugin_themes
 */
 int prof_cons_show_themed(const char *const group, const char *const item, const char *const def, const char *const message);
 
+/**
+Show many messages in the console at once, the console is redrawn once for all of them.
+@param lines NULL terminated array of messages to print
+@return 1 on success, 0 on failure
+*/
+int prof_cons_show_lines(char **lines);
+
 /**
 Show a message indicating the command has been called incorrectly.
 @param cmd the command name with leading slash, e.g. "/say"
@@ -156,6 +163,13 @@ Retrieve nicknames of all occupants in a chat room, when in a chat room window.
 */
 char** prof_get_current_occupants(void);
 
+/**
+Retrieve nicknames of all occupants in a chat room.
+@param roomjid The room's Jabber ID
+@return nicknames of all occupants in the room or NULL if not in the room.
+*/
+char** prof_get_room_occupants(const char *roomjid);
+
 /**
 Retrieve current nickname used in chat room.
 @param barejid The room's Jabber ID
@@ -228,6 +242,23 @@ Themes are specified in ~/.local/share/profanity/plugin_themes
 */
 int prof_win_show_themed(PROF_WIN_TAG tag, char *group, char *key, char *def, char *message);
 
+/**
+Show many messages in the plugin window at once, the window is redrawn once for all of them.
+@param tag The {@link PROF_WIN_TAG} of the window to display the messages
+@param lines NULL terminated array of messages to print
+@return 1 on success, 0 on failure
+*/
+int prof_win_show_lines(PROF_WIN_TAG tag, char **lines);
+
+/**
+Add a message to the plugin window without waking up the user interface,
+for output nobody needs to see straight away such as logs.
+@param tag The {@link PROF_WIN_TAG} of the window to display the message
+@param message the message to add
+@return 1 on success, 0 on failure
+*/
+int prof_win_append(PROF_WIN_TAG tag, char *message);
+
 /**
 Send an XMPP stanza
 @param stanza an XMPP stanza
@@ -331,6 +362,13 @@ Settings must be specified in ~/.local/share/profanity/plugin_settings
 */
 void prof_settings_int_set(char *group, char *key, int value);
 
+/**
+Write changed settings to disk now
+Setting changes are written to ~/.local/share/profanity/plugin_settings a few seconds after they are made,
+plugins that need a change to survive a crash can write it straight away
+*/
+void prof_settings_flush(void);
+
 /**
 Trigger incoming message handling, this plugin will make profanity act as if the message has been received
 @param barejid Jabber ID of the sender of the message
@@ -218,3 +218,29 @@ Called when a chat room window is focused
 @param barejid Jabber ID of the room
 */
 void prof_on_room_win_focus(const char *const barejid);
+
+/**
+Table of message hooks for the version 2 hook ABI, declared in profhooks.h.
+A plugin that defines it is called through the table for every message hook instead of the prof_pre_* and prof_post_* message functions above,
+members left NULL are hooks the plugin does not implement. The other hooks are still looked up by name.
+Hooks get borrowed views of the message that are only valid during the call, and only allocate when they change the message:
+return PROF_HOOK_UNCHANGED to keep it, PROF_HOOK_REPLACED with a malloc'd string in *replacement that Profanity takes over,
+or PROF_HOOK_CANCEL from a send hook to not send the message.
+@code
+static PROF_HOOK_RESULT
+filter_display(const char *barejid, const char *resource, PROF_STR message, char **replacement)
+{
+    if (memchr(message.str, '\t', message.len) == NULL) {
+        return PROF_HOOK_UNCHANGED;
+    }
+    *replacement = expand_tabs(message.str, message.len);
+    return PROF_HOOK_REPLACED;
+}
+
+const PROF_HOOKS_V2 prof_hooks_v2 = {
+    .abi = PROF_HOOKS_ABI,
+    .pre_chat_message_display = filter_display,
+};
+@endcode
+*/
+extern const PROF_HOOKS_V2 prof_hooks_v2;
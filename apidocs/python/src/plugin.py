@@ -14,6 +14,14 @@ Examples:
     def prof_on_contact_presence(barejid, resource, presence, status, priority):
         notify_message = barejid + " is " + presence
         prof.notify(notify_message, 5, "Presence")
+
+A plugin may set ``prof_async_hooks = True`` at module level to have hooks that cannot change anything run on a separate thread, so that slow work in them does not block the user interface. These are the ``prof_post_*`` hooks, ``prof_on_room_history_message``, ``prof_on_contact_offline``, ``prof_on_contact_presence``, ``prof_on_chat_win_focus``, ``prof_on_room_win_focus`` and functions registered with ``prof.register_timed()``. They run in order, calls to the ``prof`` module from them wait until Profanity is idle.
+::
+    prof_async_hooks = True
+
+    def prof_post_chat_message_display(barejid, resource, message):
+        title = lookup_title(message) # may take a while
+        prof.cons_show(title)
 """
 
 def prof_init(version, status, account_name, fulljid):
@@ -49,6 +49,19 @@ def cons_show_themed(group, key, default, message):
     pass
 
 
+def cons_show_lines(lines):
+    """Show many messages in the console at once, the console is redrawn once for all of them
+
+    :param lines: the messages to print
+    :type lines: list of str or unicode
+
+    Example:
+    ::
+        prof.cons_show_lines(["First line", "Second line"])
+    """
+    pass
+
+
 def cons_bad_cmd_usage(command):
     """Show a message indicating the command has been called incorrectly.
 
@@ -280,6 +293,17 @@ def get_current_occupants():
     pass
 
 
+def get_room_occupants(roomjid):
+    """Retrieve nicknames of all occupants in a chat room, in one call.
+
+    :param roomjid: Jabber ID of the room
+    :type roomjid: str or unicode
+    :return: nicknames of all occupants in the room or an empty list if not in the room.
+    :rtype: list of str
+    """
+    pass
+
+
 def get_room_nick(barejid):
     """Retrieve current nickname used in chat room.
 
@@ -414,6 +438,37 @@ def win_show_themed(tag, group, key, default, message):
     pass
 
 
+def win_show_lines(tag, lines):
+    """Show many messages in the plugin window at once, the window is redrawn once for all of them
+
+    :param tag: The tag of the window to display the messages
+    :type tag: str or unicode
+    :param lines: the messages to print
+    :type lines: list of str or unicode
+
+    Example:
+    ::
+        prof.win_show_lines("My Plugin", ["First entry", "Second entry"])
+    """
+    pass
+
+
+def win_append(tag, message):
+    """Add a message to the plugin window without waking up the user interface,
+    for output nobody needs to see straight away such as logs
+
+    :param tag: The tag of the window to display the message
+    :type tag: str or unicode
+    :param message: the message to add
+    :type message: str or unicode
+
+    Example:
+    ::
+        prof.win_append("My Plugin", "Log entry")
+    """
+    pass
+
+
 def send_stanza(stanza):
     """Send an XMPP stanza
 
@@ -613,6 +668,18 @@ def settings_int_set(group, key, value):
     pass
 
 
+def settings_flush():
+    """Write changed settings to disk now\n
+    Setting changes are written to ``~/.local/share/profanity/plugin_settings`` a few seconds after they are made,
+    plugins that need a change to survive a crash can write it straight away
+
+    Example:
+    ::
+        prof.settings_flush()
+    """
+    pass
+
+
 def incoming_message(barejid, resource, message):
     """Trigger incoming message handling, this plugin will make profanity act as if the message has been received
 
@@ -41,6 +41,8 @@
 #include <assert.h>
 #include <libgen.h>
 #include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include "common.h"
 #include "config/preferences.h"
@@ -100,8 +102,11 @@ static char* _wintitle_autocomplete(ProfWin* window, const char* const input, gb
 static char* _inpblock_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _time_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _receipts_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _bandwidth_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _autoping_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _help_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _wins_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _xmlconsole_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _tls_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _titlebar_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _script_autocomplete(ProfWin* window, const char* const input, gboolean previous);
@@ -117,6 +122,7 @@ static char* _presence_autocomplete(ProfWin* window, const char* const input, gb
 static char* _rooms_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _statusbar_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _clear_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _collapse_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _invite_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _status_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _logging_autocomplete(ProfWin* window, const char* const input, gboolean previous);
@@ -130,10 +136,16 @@ static char* _executable_autocomplete(ProfWin* window, const char* const input,
 static char* _lastactivity_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _intype_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _mood_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _perf_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _search_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 
 static char* _script_autocomplete_func(const char* const prefix, gboolean previous, void* context);
 
 static char* _cmd_ac_complete_params(ProfWin* window, const char* const input, gboolean previous);
+static char* _boolean_choice_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _param_ac_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _contact_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static void _cmd_ac_funcs_init(void);
 
 static Autocomplete commands_ac;
 static Autocomplete who_room_ac;
@@ -163,6 +175,9 @@ static Autocomplete account_default_ac;
 static Autocomplete account_status_ac;
 static Autocomplete disco_ac;
 static Autocomplete wins_ac;
+static Autocomplete wins_hibernate_ac;
+static Autocomplete xmlconsole_ac;
+static Autocomplete xmlconsole_filter_ac;
 static Autocomplete roster_ac;
 static Autocomplete roster_show_ac;
 static Autocomplete roster_by_ac;
@@ -226,6 +241,8 @@ static Autocomplete time_format_ac;
 static Autocomplete resource_ac;
 static Autocomplete inpblock_ac;
 static Autocomplete receipts_ac;
+static Autocomplete bandwidth_ac;
+static Autocomplete perf_net_ac;
 #ifdef HAVE_LIBGPGME
 static Autocomplete pgp_ac;
 static Autocomplete pgp_log_ac;
@@ -248,6 +265,14 @@ static Autocomplete plugins_load_ac;
 static Autocomplete plugins_unload_ac;
 static Autocomplete plugins_reload_ac;
 static Autocomplete filepath_ac;
+// the directory filepath_ac was last listed from, and the directory mtime
+// the listing was taken at
+static char* filepath_dir = NULL;
+static unsigned int filepath_off = 0;
+static gboolean filepath_hidden = FALSE;
+static time_t filepath_mtime = 0;
+static ino_t filepath_ino = 0;
+static time_t filepath_listed = 0;
 static Autocomplete blocked_ac;
 static Autocomplete tray_ac;
 static Autocomplete presence_ac;
@@ -259,11 +284,14 @@ static Autocomplete statusbar_chat_ac;
 static Autocomplete statusbar_room_ac;
 static Autocomplete statusbar_show_ac;
 static Autocomplete clear_ac;
+static Autocomplete collapse_ac;
 static Autocomplete invite_ac;
 static Autocomplete status_ac;
 static Autocomplete status_state_ac;
 static Autocomplete logging_ac;
 static Autocomplete logging_group_ac;
+static Autocomplete logging_db_ac;
+static Autocomplete logging_db_mode_ac;
 static Autocomplete color_ac;
 static Autocomplete correction_ac;
 static Autocomplete avatar_ac;
@@ -272,6 +300,23 @@ static Autocomplete executable_ac;
 static Autocomplete intype_ac;
 static Autocomplete mood_ac;
 static Autocomplete mood_type_ac;
+static Autocomplete perf_ac;
+static Autocomplete perf_log_ac;
+static Autocomplete perf_trace_ac;
+static Autocomplete perf_profile_ac;
+static Autocomplete perf_record_ac;
+static Autocomplete perf_trim_ac;
+static Autocomplete search_ac;
+
+typedef char* (*ac_func_t)(ProfWin* window, const char* const input, gboolean previous);
+
+// the parameter completer of each command, looked up by the leading token
+static GHashTable* ac_funcs = NULL;
+// the commands whose parameters complete from one Autocomplete
+static GHashTable* param_acs = NULL;
+// the leading token of the input being completed, for the completers
+// shared by several commands
+static const char* ac_command = NULL;
 
 /*!
  * \brief Initialization of auto completion for commands.
@@ -389,6 +434,7 @@ cmd_ac_init(void)
     autocomplete_add(autoaway_ac, "time");
     autocomplete_add(autoaway_ac, "message");
     autocomplete_add(autoaway_ac, "check");
+    autocomplete_add(autoaway_ac, "csi");
 
     autoaway_mode_ac = autocomplete_new();
     autocomplete_add(autoaway_mode_ac, "away");
@@ -447,6 +493,7 @@ cmd_ac_init(void)
     autocomplete_add(account_set_ac, "tls");
     autocomplete_add(account_set_ac, "auth");
     autocomplete_add(account_set_ac, "theme");
+    autocomplete_add(account_set_ac, "uploads");
 
     account_clear_ac = autocomplete_new();
     autocomplete_add(account_clear_ac, "password");
@@ -477,6 +524,22 @@ cmd_ac_init(void)
     autocomplete_add(wins_ac, "attention");
     autocomplete_add(wins_ac, "prune");
     autocomplete_add(wins_ac, "swap");
+    autocomplete_add(wins_ac, "hibernate");
+
+    wins_hibernate_ac = autocomplete_new();
+    autocomplete_add(wins_hibernate_ac, "memory");
+    autocomplete_add(wins_hibernate_ac, "now");
+    autocomplete_add(wins_hibernate_ac, "off");
+
+    xmlconsole_ac = autocomplete_new();
+    autocomplete_add(xmlconsole_ac, "filter");
+    autocomplete_add(xmlconsole_ac, "pretty");
+
+    xmlconsole_filter_ac = autocomplete_new();
+    autocomplete_add(xmlconsole_filter_ac, "kind:");
+    autocomplete_add(xmlconsole_filter_ac, "ns:");
+    autocomplete_add(xmlconsole_filter_ac, "jid:");
+    autocomplete_add(xmlconsole_filter_ac, "off");
 
     roster_ac = autocomplete_new();
     autocomplete_add(roster_ac, "add");
@@ -691,6 +754,7 @@ cmd_ac_init(void)
     autocomplete_add(omemo_ac, "policy");
     autocomplete_add(omemo_ac, "trustmode");
     autocomplete_add(omemo_ac, "char");
+    autocomplete_add(omemo_ac, "fetchwindow");
 
     omemo_log_ac = autocomplete_new();
     autocomplete_add(omemo_log_ac, "on");
@@ -739,6 +803,8 @@ cmd_ac_init(void)
     autocomplete_add(room_ac, "accept");
     autocomplete_add(room_ac, "destroy");
     autocomplete_add(room_ac, "config");
+    autocomplete_add(room_ac, "slow");
+    autocomplete_add(room_ac, "collapse");
 
     rooms_all_ac = autocomplete_new();
     autocomplete_add(rooms_all_ac, "service");
@@ -802,6 +868,7 @@ cmd_ac_init(void)
     autocomplete_add(occupants_ac, "indent");
     autocomplete_add(occupants_ac, "header");
     autocomplete_add(occupants_ac, "wrap");
+    autocomplete_add(occupants_ac, "light");
     autocomplete_add(occupants_ac, "char");
     autocomplete_add(occupants_ac, "color");
 
@@ -850,6 +917,12 @@ cmd_ac_init(void)
     receipts_ac = autocomplete_new();
     autocomplete_add(receipts_ac, "send");
     autocomplete_add(receipts_ac, "request");
+    autocomplete_add(receipts_ac, "markers");
+
+    bandwidth_ac = autocomplete_new();
+    autocomplete_add(bandwidth_ac, "low");
+    autocomplete_add(bandwidth_ac, "compression");
+    autocomplete_add(bandwidth_ac, "terminal");
 
 #ifdef HAVE_LIBGPGME
     pgp_ac = autocomplete_new();
@@ -936,12 +1009,14 @@ cmd_ac_init(void)
     autoping_ac = autocomplete_new();
     autocomplete_add(autoping_ac, "set");
     autocomplete_add(autoping_ac, "timeout");
+    autocomplete_add(autoping_ac, "adaptive");
 
     plugins_ac = autocomplete_new();
     autocomplete_add(plugins_ac, "install");
     autocomplete_add(plugins_ac, "load");
     autocomplete_add(plugins_ac, "unload");
     autocomplete_add(plugins_ac, "reload");
+    autocomplete_add(plugins_ac, "lazy");
     autocomplete_add(plugins_ac, "python_version");
 
     filepath_ac = autocomplete_new();
@@ -955,6 +1030,10 @@ cmd_ac_init(void)
     clear_ac = autocomplete_new();
     autocomplete_add(clear_ac, "persist_history");
 
+    collapse_ac = autocomplete_new();
+    autocomplete_add(collapse_ac, "expand");
+    autocomplete_add(collapse_ac, "off");
+
     tray_ac = autocomplete_new();
     autocomplete_add(tray_ac, "on");
     autocomplete_add(tray_ac, "off");
@@ -1025,12 +1104,24 @@ cmd_ac_init(void)
     logging_ac = autocomplete_new();
     autocomplete_add(logging_ac, "chat");
     autocomplete_add(logging_ac, "group");
+    autocomplete_add(logging_ac, "flush");
+    autocomplete_add(logging_ac, "compress");
+    autocomplete_add(logging_ac, "db");
 
     logging_group_ac = autocomplete_new();
     autocomplete_add(logging_group_ac, "on");
     autocomplete_add(logging_group_ac, "off");
     autocomplete_add(logging_group_ac, "color");
 
+    logging_db_ac = autocomplete_new();
+    autocomplete_add(logging_db_ac, "mode");
+    autocomplete_add(logging_db_ac, "retain");
+    autocomplete_add(logging_db_ac, "import");
+
+    logging_db_mode_ac = autocomplete_new();
+    autocomplete_add(logging_db_mode_ac, "fast");
+    autocomplete_add(logging_db_mode_ac, "safe");
+
     color_ac = autocomplete_new();
     autocomplete_add(color_ac, "on");
     autocomplete_add(color_ac, "off");
@@ -1050,6 +1141,7 @@ cmd_ac_init(void)
     url_ac = autocomplete_new();
     autocomplete_add(url_ac, "open");
     autocomplete_add(url_ac, "save");
+    autocomplete_add(url_ac, "segmented");
 
     executable_ac = autocomplete_new();
     autocomplete_add(executable_ac, "avatar");
@@ -1064,6 +1156,48 @@ cmd_ac_init(void)
     mood_ac = autocomplete_new();
     autocomplete_add(mood_ac, "set");
     autocomplete_add(mood_ac, "clear");
+    perf_ac = autocomplete_new();
+    autocomplete_add(perf_ac, "on");
+    autocomplete_add(perf_ac, "off");
+    autocomplete_add(perf_ac, "reset");
+    autocomplete_add(perf_ac, "mem");
+    autocomplete_add(perf_ac, "net");
+    autocomplete_add(perf_ac, "log");
+    autocomplete_add(perf_ac, "trace");
+    autocomplete_add(perf_ac, "profile");
+    autocomplete_add(perf_ac, "record");
+    autocomplete_add(perf_ac, "trim");
+
+    perf_log_ac = autocomplete_new();
+    autocomplete_add(perf_log_ac, "off");
+
+    perf_net_ac = autocomplete_new();
+    autocomplete_add(perf_net_ac, "reset");
+
+    perf_trace_ac = autocomplete_new();
+    autocomplete_add(perf_trace_ac, "start");
+    autocomplete_add(perf_trace_ac, "stop");
+
+    perf_profile_ac = autocomplete_new();
+    autocomplete_add(perf_profile_ac, "start");
+    autocomplete_add(perf_profile_ac, "stop");
+    autocomplete_add(perf_profile_ac, "rate");
+
+    perf_record_ac = autocomplete_new();
+    autocomplete_add(perf_record_ac, "start");
+    autocomplete_add(perf_record_ac, "anonymous");
+    autocomplete_add(perf_record_ac, "stop");
+
+    perf_trim_ac = autocomplete_new();
+    autocomplete_add(perf_trim_ac, "now");
+    autocomplete_add(perf_trim_ac, "off");
+
+    search_ac = autocomplete_new();
+    autocomplete_add(search_ac, "next");
+    autocomplete_add(search_ac, "with:");
+    autocomplete_add(search_ac, "after:");
+    autocomplete_add(search_ac, "before:");
+
     mood_type_ac = autocomplete_new();
     autocomplete_add(mood_type_ac, "afraid");
     autocomplete_add(mood_type_ac, "amazed");
@@ -1145,6 +1279,8 @@ cmd_ac_init(void)
     autocomplete_add(mood_type_ac, "undefined");
     autocomplete_add(mood_type_ac, "weak");
     autocomplete_add(mood_type_ac, "worried");
+
+    _cmd_ac_funcs_init();
 }
 
 void
@@ -1304,6 +1440,10 @@ cmd_ac_reset(ProfWin* window)
         }
     }
 
+    if (window->type == WIN_CHAT || window->type == WIN_MUC || window->type == WIN_PRIVATE) {
+        url_ring_reset(window->urls);
+    }
+
     muc_invites_reset_ac();
     muc_confserver_reset_ac();
     accounts_reset_all_search();
@@ -1361,6 +1501,9 @@ cmd_ac_reset(ProfWin* window)
     autocomplete_reset(account_status_ac);
     autocomplete_reset(disco_ac);
     autocomplete_reset(wins_ac);
+    autocomplete_reset(wins_hibernate_ac);
+    autocomplete_reset(xmlconsole_ac);
+    autocomplete_reset(xmlconsole_filter_ac);
     autocomplete_reset(roster_ac);
     autocomplete_reset(roster_header_ac);
     autocomplete_reset(roster_contact_ac);
@@ -1425,6 +1568,8 @@ cmd_ac_reset(ProfWin* window)
     autocomplete_reset(resource_ac);
     autocomplete_reset(inpblock_ac);
     autocomplete_reset(receipts_ac);
+    autocomplete_reset(bandwidth_ac);
+    autocomplete_reset(perf_net_ac);
 #ifdef HAVE_LIBGPGME
     autocomplete_reset(pgp_ac);
     autocomplete_reset(pgp_log_ac);
@@ -1449,11 +1594,14 @@ cmd_ac_reset(ProfWin* window)
     autocomplete_reset(statusbar_room_ac);
     autocomplete_reset(statusbar_show_ac);
     autocomplete_reset(clear_ac);
+    autocomplete_reset(collapse_ac);
     autocomplete_reset(invite_ac);
     autocomplete_reset(status_ac);
     autocomplete_reset(status_state_ac);
     autocomplete_reset(logging_ac);
     autocomplete_reset(logging_group_ac);
+    autocomplete_reset(logging_db_ac);
+    autocomplete_reset(logging_db_mode_ac);
     autocomplete_reset(color_ac);
     autocomplete_reset(correction_ac);
     autocomplete_reset(avatar_ac);
@@ -1462,6 +1610,13 @@ cmd_ac_reset(ProfWin* window)
     autocomplete_reset(intype_ac);
     autocomplete_reset(mood_ac);
     autocomplete_reset(mood_type_ac);
+    autocomplete_reset(perf_ac);
+    autocomplete_reset(perf_log_ac);
+    autocomplete_reset(perf_trace_ac);
+    autocomplete_reset(perf_profile_ac);
+    autocomplete_reset(perf_record_ac);
+    autocomplete_reset(perf_trim_ac);
+    autocomplete_reset(search_ac);
 
     autocomplete_reset(script_ac);
     if (script_show_ac) {
@@ -1523,6 +1678,9 @@ cmd_ac_uninit(void)
     autocomplete_free(account_status_ac);
     autocomplete_free(disco_ac);
     autocomplete_free(wins_ac);
+    autocomplete_free(wins_hibernate_ac);
+    autocomplete_free(xmlconsole_ac);
+    autocomplete_free(xmlconsole_filter_ac);
     autocomplete_free(roster_ac);
     autocomplete_free(roster_header_ac);
     autocomplete_free(roster_contact_ac);
@@ -1585,6 +1743,8 @@ cmd_ac_uninit(void)
     autocomplete_free(resource_ac);
     autocomplete_free(inpblock_ac);
     autocomplete_free(receipts_ac);
+    autocomplete_free(bandwidth_ac);
+    autocomplete_free(perf_net_ac);
 #ifdef HAVE_LIBGPGME
     autocomplete_free(pgp_ac);
     autocomplete_free(pgp_log_ac);
@@ -1604,6 +1764,8 @@ cmd_ac_uninit(void)
     autocomplete_free(plugins_unload_ac);
     autocomplete_free(plugins_reload_ac);
     autocomplete_free(filepath_ac);
+    free(filepath_dir);
+    filepath_dir = NULL;
     autocomplete_free(blocked_ac);
     autocomplete_free(tray_ac);
     autocomplete_free(presence_ac);
@@ -1615,17 +1777,32 @@ cmd_ac_uninit(void)
     autocomplete_free(statusbar_room_ac);
     autocomplete_free(statusbar_show_ac);
     autocomplete_free(clear_ac);
+    autocomplete_free(collapse_ac);
     autocomplete_free(invite_ac);
     autocomplete_free(status_ac);
     autocomplete_free(status_state_ac);
     autocomplete_free(logging_ac);
     autocomplete_free(logging_group_ac);
+    autocomplete_free(logging_db_ac);
+    autocomplete_free(logging_db_mode_ac);
     autocomplete_free(color_ac);
     autocomplete_free(correction_ac);
     autocomplete_free(avatar_ac);
     autocomplete_free(url_ac);
     autocomplete_free(executable_ac);
     autocomplete_free(intype_ac);
+    autocomplete_free(perf_ac);
+    autocomplete_free(perf_log_ac);
+    autocomplete_free(perf_trace_ac);
+    autocomplete_free(perf_profile_ac);
+    autocomplete_free(perf_record_ac);
+    autocomplete_free(perf_trim_ac);
+    autocomplete_free(search_ac);
+
+    g_hash_table_destroy(ac_funcs);
+    ac_funcs = NULL;
+    g_hash_table_destroy(param_acs);
+    param_acs = NULL;
 }
 
 static void
@@ -1635,6 +1812,42 @@ _filepath_item_free(char** ptr)
     free(item);
 }
 
+// The listing is good while the directory mtime is the one it was taken
+// at, unless it changed within the second the listing was taken in
+static gboolean
+_filepath_cache_valid(const char* const directory, unsigned int output_off, gboolean hidden)
+{
+    if (g_strcmp0(directory, filepath_dir) != 0 || output_off != filepath_off || hidden != filepath_hidden) {
+        return FALSE;
+    }
+
+    struct stat st;
+    if (stat(directory, &st) != 0) {
+        return FALSE;
+    }
+
+    return st.st_ino == filepath_ino && st.st_mtime == filepath_mtime && filepath_mtime < filepath_listed;
+}
+
+static void
+_filepath_cache_set(const char* const directory, unsigned int output_off, gboolean hidden)
+{
+    free(filepath_dir);
+    filepath_dir = NULL;
+
+    struct stat st;
+    if (stat(directory, &st) != 0) {
+        return;
+    }
+
+    filepath_dir = strdup(directory);
+    filepath_off = output_off;
+    filepath_hidden = hidden;
+    filepath_mtime = st.st_mtime;
+    filepath_ino = st.st_ino;
+    filepath_listed = time(NULL);
+}
+
 char*
 cmd_ac_complete_filepath(const char* const input, char* const startstr, gboolean previous)
 {
@@ -1684,6 +1897,15 @@ cmd_ac_complete_filepath(const char* const input, char* const startstr, gboolean
     free(inpcp);
     free(inpcp2);
 
+    // cycling through the completions needn't read the directory again
+    gboolean hidden = *foofile == '.';
+    if (_filepath_cache_valid(directory, output_off, hidden)) {
+        free(directory);
+        free(foofile);
+        return autocomplete_param_with_ac(input, startstr, filepath_ac, TRUE, previous);
+    }
+    _filepath_cache_set(directory, output_off, hidden);
+
     GArray* files = g_array_new(TRUE, FALSE, sizeof(char*));
     g_array_set_clear_func(files, (GDestroyNotify)_filepath_item_free);
 
@@ -1696,7 +1918,7 @@ cmd_ac_complete_filepath(const char* const input, char* const startstr, gboolean
                 continue;
             } else if (strcmp(dir->d_name, "..") == 0) {
                 continue;
-            } else if (*(dir->d_name) == '.' && *foofile != '.') {
+            } else if (*(dir->d_name) == '.' && !hidden) {
                 // only show hidden files on explicit request
                 continue;
             }
@@ -1747,87 +1969,31 @@ cmd_ac_complete_filepath(const char* const input, char* const startstr, gboolean
     return autocomplete_param_with_ac(input, startstr, filepath_ac, TRUE, previous);
 }
 
-static char*
-_cmd_ac_complete_params(ProfWin* window, const char* const input, gboolean previous)
+static void
+_cmd_ac_funcs_init(void)
 {
-    char* result = NULL;
+    ac_funcs = g_hash_table_new(g_str_hash, g_str_equal);
 
-    jabber_conn_status_t conn_status = connection_get_status();
-
-    // autocomplete boolean settings
     gchar* boolean_choices[] = { "/beep", "/states", "/outtype", "/flash", "/splash",
                                  "/history", "/vercheck", "/privileges", "/wrap",
                                  "/carbons", "/os", "/slashguard", "/mam", "/silence" };
-
     for (int i = 0; i < ARRAY_SIZE(boolean_choices); i++) {
-        result = autocomplete_param_with_func(input, boolean_choices[i], prefs_autocomplete_boolean_choice, previous, NULL);
-        if (result) {
-            return result;
-        }
+        g_hash_table_insert(ac_funcs, boolean_choices[i], _boolean_choice_autocomplete);
     }
 
-    // autocomplete nickname in chat rooms
-    if (window->type == WIN_MUC) {
-        ProfMucWin* mucwin = (ProfMucWin*)window;
-        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
-        Autocomplete nick_ac = muc_roster_ac(mucwin->roomjid);
-        if (nick_ac) {
-            gchar* nick_choices[] = { "/msg", "/info", "/caps" };
-
-            // Remove quote character before and after names when doing autocomplete
-            char* unquoted = strip_arg_quotes(input);
-            for (int i = 0; i < ARRAY_SIZE(nick_choices); i++) {
-                result = autocomplete_param_with_ac(unquoted, nick_choices[i], nick_ac, TRUE, previous);
-                if (result) {
-                    free(unquoted);
-                    return result;
-                }
-            }
-            free(unquoted);
-        }
-
-        // otherwise autocomplete using roster
-    } else if (conn_status == JABBER_CONNECTED) {
-        gchar* contact_choices[] = { "/msg", "/info" };
-        // Remove quote character before and after names when doing autocomplete
-        char* unquoted = strip_arg_quotes(input);
-        for (int i = 0; i < ARRAY_SIZE(contact_choices); i++) {
-            result = autocomplete_param_with_func(unquoted, contact_choices[i], roster_contact_autocomplete, previous, NULL);
-            if (result) {
-                free(unquoted);
-                return result;
-            }
-        }
-        free(unquoted);
-
-        gchar* resource_choices[] = { "/caps", "/ping" };
-        for (int i = 0; i < ARRAY_SIZE(resource_choices); i++) {
-            result = autocomplete_param_with_func(input, resource_choices[i], roster_fulljid_autocomplete, previous, NULL);
-            if (result) {
-                return result;
-            }
-        }
+    gchar* contact_choices[] = { "/msg", "/info", "/caps", "/ping" };
+    for (int i = 0; i < ARRAY_SIZE(contact_choices); i++) {
+        g_hash_table_insert(ac_funcs, contact_choices[i], _contact_autocomplete);
     }
 
-    gchar* invite_choices[] = { "/join" };
-    for (int i = 0; i < ARRAY_SIZE(invite_choices); i++) {
-        result = autocomplete_param_with_func(input, invite_choices[i], muc_invites_find, previous, NULL);
-        if (result) {
-            return result;
-        }
-    }
-
-    gchar* cmds[] = { "/prefs", "/disco", "/room", "/autoping", "/mainwin", "/inputwin" };
-    Autocomplete completers[] = { prefs_ac, disco_ac, room_ac, autoping_ac, winpos_ac, winpos_ac };
-
+    param_acs = g_hash_table_new(g_str_hash, g_str_equal);
+    gchar* cmds[] = { "/prefs", "/disco", "/room", "/mainwin", "/inputwin" };
+    Autocomplete completers[] = { prefs_ac, disco_ac, room_ac, winpos_ac, winpos_ac };
     for (int i = 0; i < ARRAY_SIZE(cmds); i++) {
-        result = autocomplete_param_with_ac(input, cmds[i], completers[i], TRUE, previous);
-        if (result) {
-            return result;
-        }
+        g_hash_table_insert(param_acs, cmds[i], completers[i]);
+        g_hash_table_insert(ac_funcs, cmds[i], _param_ac_autocomplete);
     }
 
-    GHashTable* ac_funcs = g_hash_table_new(g_str_hash, g_str_equal);
     g_hash_table_insert(ac_funcs, "/help", _help_autocomplete);
     g_hash_table_insert(ac_funcs, "/who", _who_autocomplete);
     g_hash_table_insert(ac_funcs, "/sub", _sub_autocomplete);
@@ -1863,7 +2029,10 @@ _cmd_ac_complete_params(ProfWin* window, const char* const input, gboolean previ
     g_hash_table_insert(ac_funcs, "/inpblock", _inpblock_autocomplete);
     g_hash_table_insert(ac_funcs, "/time", _time_autocomplete);
     g_hash_table_insert(ac_funcs, "/receipts", _receipts_autocomplete);
+    g_hash_table_insert(ac_funcs, "/bandwidth", _bandwidth_autocomplete);
+    g_hash_table_insert(ac_funcs, "/autoping", _autoping_autocomplete);
     g_hash_table_insert(ac_funcs, "/wins", _wins_autocomplete);
+    g_hash_table_insert(ac_funcs, "/xmlconsole", _xmlconsole_autocomplete);
     g_hash_table_insert(ac_funcs, "/tls", _tls_autocomplete);
     g_hash_table_insert(ac_funcs, "/titlebar", _titlebar_autocomplete);
     g_hash_table_insert(ac_funcs, "/script", _script_autocomplete);
@@ -1879,6 +2048,7 @@ _cmd_ac_complete_params(ProfWin* window, const char* const input, gboolean previ
     g_hash_table_insert(ac_funcs, "/rooms", _rooms_autocomplete);
     g_hash_table_insert(ac_funcs, "/statusbar", _statusbar_autocomplete);
     g_hash_table_insert(ac_funcs, "/clear", _clear_autocomplete);
+    g_hash_table_insert(ac_funcs, "/collapse", _collapse_autocomplete);
     g_hash_table_insert(ac_funcs, "/invite", _invite_autocomplete);
     g_hash_table_insert(ac_funcs, "/status", _status_autocomplete);
     g_hash_table_insert(ac_funcs, "/logging", _logging_autocomplete);
@@ -1892,29 +2062,29 @@ _cmd_ac_complete_params(ProfWin* window, const char* const input, gboolean previ
     g_hash_table_insert(ac_funcs, "/lastactivity", _lastactivity_autocomplete);
     g_hash_table_insert(ac_funcs, "/intype", _intype_autocomplete);
     g_hash_table_insert(ac_funcs, "/mood", _mood_autocomplete);
+    g_hash_table_insert(ac_funcs, "/perf", _perf_autocomplete);
+    g_hash_table_insert(ac_funcs, "/search", _search_autocomplete);
+}
 
-    int len = strlen(input);
-    char parsed[len + 1];
-    int i = 0;
-    while (i < len) {
-        if (input[i] == ' ') {
-            break;
-        } else {
-            parsed[i] = input[i];
-        }
-        i++;
-    }
-    parsed[i] = '\0';
+static char*
+_cmd_ac_complete_params(ProfWin* window, const char* const input, gboolean previous)
+{
+    char* result = NULL;
 
-    char* (*ac_func)(ProfWin*, const char* const, gboolean) = g_hash_table_lookup(ac_funcs, parsed);
+    // only the completer of the leading command is tried
+    const char* space = strchr(input, ' ');
+    gchar* command = space ? g_strndup(input, space - input) : g_strdup(input);
+
+    ac_func_t ac_func = g_hash_table_lookup(ac_funcs, command);
     if (ac_func) {
+        ac_command = command;
         result = ac_func(window, input, previous);
-        if (result) {
-            g_hash_table_destroy(ac_funcs);
-            return result;
-        }
+        ac_command = NULL;
+    }
+    g_free(command);
+    if (result) {
+        return result;
     }
-    g_hash_table_destroy(ac_funcs);
 
     result = plugins_autocomplete(input, previous);
     if (result) {
@@ -1931,6 +2101,51 @@ _cmd_ac_complete_params(ProfWin* window, const char* const input, gboolean previ
     return NULL;
 }
 
+static char*
+_boolean_choice_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    return autocomplete_param_with_func(input, ac_command, prefs_autocomplete_boolean_choice, previous, NULL);
+}
+
+static char*
+_param_ac_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    return autocomplete_param_with_ac(input, ac_command, g_hash_table_lookup(param_acs, ac_command), TRUE, previous);
+}
+
+static char*
+_contact_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    char* result = NULL;
+    gboolean resource_cmd = g_strcmp0(ac_command, "/caps") == 0 || g_strcmp0(ac_command, "/ping") == 0;
+
+    // autocomplete nickname in chat rooms
+    if (window->type == WIN_MUC) {
+        ProfMucWin* mucwin = (ProfMucWin*)window;
+        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+        Autocomplete nick_ac = muc_roster_ac(mucwin->roomjid);
+        if (nick_ac && g_strcmp0(ac_command, "/ping") != 0) {
+            // Remove quote character before and after names when doing autocomplete
+            char* unquoted = strip_arg_quotes(input);
+            result = autocomplete_param_with_ac(unquoted, ac_command, nick_ac, TRUE, previous);
+            free(unquoted);
+        }
+
+        // otherwise autocomplete using roster
+    } else if (connection_get_status() == JABBER_CONNECTED) {
+        if (resource_cmd) {
+            result = autocomplete_param_with_func(input, ac_command, roster_fulljid_autocomplete, previous, NULL);
+        } else {
+            // Remove quote character before and after names when doing autocomplete
+            char* unquoted = strip_arg_quotes(input);
+            result = autocomplete_param_with_func(unquoted, ac_command, roster_contact_autocomplete, previous, NULL);
+            free(unquoted);
+        }
+    }
+
+    return result;
+}
+
 static char*
 _sub_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -2387,6 +2602,10 @@ _autoaway_autocomplete(ProfWin* window, const char* const input, gboolean previo
     if (result) {
         return result;
     }
+    result = autocomplete_param_with_func(input, "/autoaway csi", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
     result = autocomplete_param_with_ac(input, "/autoaway", autoaway_ac, TRUE, previous);
     if (result) {
         return result;
@@ -2761,6 +2980,37 @@ _plugins_autocomplete(ProfWin* window, const char* const input, gboolean previou
         }
     }
 
+    if (strncmp(input, "/plugins lazy ", 14) == 0) {
+        gboolean parsed = FALSE;
+        gchar** args = parse_args(input, 2, 3, &parsed);
+        if (parsed && g_strv_length(args) >= 2) {
+            GString* beginning = g_string_new("/plugins lazy ");
+            g_string_append(beginning, args[1]);
+            result = autocomplete_param_with_func(input, beginning->str, prefs_autocomplete_boolean_choice, previous, NULL);
+            g_string_free(beginning, TRUE);
+        }
+        g_strfreev(args);
+        if (result) {
+            return result;
+        }
+
+        // the names are the plugins that load at startup
+        if (plugins_reload_ac == NULL) {
+            plugins_reload_ac = autocomplete_new();
+            GList* plugins = plugins_loaded_list();
+            GList* curr = plugins;
+            while (curr) {
+                autocomplete_add(plugins_reload_ac, curr->data);
+                curr = g_list_next(curr);
+            }
+            g_list_free(plugins);
+        }
+        result = autocomplete_param_with_ac(input, "/plugins lazy", plugins_reload_ac, TRUE, previous);
+        if (result) {
+            return result;
+        }
+    }
+
     if (strncmp(input, "/plugins unload ", 16) == 0) {
         if (plugins_unload_ac == NULL) {
             plugins_unload_ac = autocomplete_new();
@@ -3317,11 +3567,36 @@ _wins_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
     char* result = NULL;
 
+    result = autocomplete_param_with_ac(input, "/wins hibernate", wins_hibernate_ac, TRUE, previous);
+    if (result) {
+        return result;
+    }
+
     result = autocomplete_param_with_ac(input, "/wins", wins_ac, TRUE, previous);
 
     return result;
 }
 
+static char*
+_xmlconsole_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    char* result = NULL;
+
+    result = autocomplete_param_with_func(input, "/xmlconsole pretty", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/xmlconsole filter", xmlconsole_filter_ac, TRUE, previous);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/xmlconsole", xmlconsole_ac, TRUE, previous);
+
+    return result;
+}
+
 static char*
 _tls_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -3367,6 +3642,38 @@ _titlebar_autocomplete(ProfWin* window, const char* const input, gboolean previo
     return result;
 }
 
+static char*
+_bandwidth_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    char* result = autocomplete_param_with_func(input, "/bandwidth low", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_func(input, "/bandwidth compression", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_func(input, "/bandwidth terminal", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
+
+    return autocomplete_param_with_ac(input, "/bandwidth", bandwidth_ac, TRUE, previous);
+}
+
+static char*
+_autoping_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    char* result = autocomplete_param_with_func(input, "/autoping adaptive", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
+
+    return autocomplete_param_with_ac(input, "/autoping", autoping_ac, TRUE, previous);
+}
+
 static char*
 _receipts_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -3382,6 +3689,11 @@ _receipts_autocomplete(ProfWin* window, const char* const input, gboolean previo
         return result;
     }
 
+    result = autocomplete_param_with_func(input, "/receipts markers", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
+
     result = autocomplete_param_with_ac(input, "/receipts", receipts_ac, TRUE, previous);
 
     return result;
@@ -3576,6 +3888,11 @@ _join_autocomplete(ProfWin* window, const char* const input, gboolean previous)
     char* found = NULL;
     gboolean result = FALSE;
 
+    found = autocomplete_param_with_func(input, "/join", muc_invites_find, previous, NULL);
+    if (found) {
+        return found;
+    }
+
     gchar** args = parse_args(input, 1, 5, &result);
 
     if (result) {
@@ -3974,6 +4291,12 @@ _clear_autocomplete(ProfWin* window, const char* const input, gboolean previous)
     return result;
 }
 
+static char*
+_collapse_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    return autocomplete_param_with_ac(input, "/collapse", collapse_ac, TRUE, previous);
+}
+
 static char*
 _invite_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -4067,6 +4390,21 @@ _logging_autocomplete(ProfWin* window, const char* const input, gboolean previou
     }
 
     result = autocomplete_param_with_ac(input, "/logging group", logging_group_ac, TRUE, previous);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_func(input, "/logging compress", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/logging db mode", logging_db_mode_ac, TRUE, previous);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/logging db", logging_db_ac, TRUE, previous);
     return result;
 }
 
@@ -4176,6 +4514,11 @@ _url_autocomplete(ProfWin* window, const char* const input, gboolean previous)
         return result;
     }
 
+    result = autocomplete_param_with_func(input, "/url segmented", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
+
     if (window->type == WIN_CHAT || window->type == WIN_MUC || window->type == WIN_PRIVATE) {
         result = autocomplete_param_with_func(input, "/url open", wins_get_url, previous, window);
         if (result) {
@@ -4256,3 +4599,72 @@ _mood_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 
     return result;
 }
+
+static char*
+_perf_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    if (strncmp(input, "/perf trace start ", 18) == 0) {
+        return cmd_ac_complete_filepath(input, "/perf trace start", previous);
+    }
+    if (strncmp(input, "/perf profile start ", 20) == 0) {
+        return cmd_ac_complete_filepath(input, "/perf profile start", previous);
+    }
+    if (strncmp(input, "/perf record start ", 19) == 0) {
+        return cmd_ac_complete_filepath(input, "/perf record start", previous);
+    }
+    if (strncmp(input, "/perf record anonymous ", 23) == 0) {
+        return cmd_ac_complete_filepath(input, "/perf record anonymous", previous);
+    }
+
+    char* result = autocomplete_param_with_ac(input, "/perf trace", perf_trace_ac, TRUE, previous);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/perf profile", perf_profile_ac, TRUE, previous);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/perf record", perf_record_ac, TRUE, previous);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/perf trim", perf_trim_ac, TRUE, previous);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/perf log", perf_log_ac, TRUE, previous);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/perf net", perf_net_ac, TRUE, previous);
+    if (result) {
+        return result;
+    }
+
+    return autocomplete_param_with_ac(input, "/perf", perf_ac, TRUE, previous);
+}
+
+static char*
+_search_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    // the contact of a leading with: filter
+    if (strncmp(input, "/search with:", 13) == 0 && !strchr(&input[13], ' ')) {
+        if (connection_get_status() != JABBER_CONNECTED) {
+            return NULL;
+        }
+        char* found = roster_barejid_autocomplete(&input[13], previous, NULL);
+        if (!found) {
+            return NULL;
+        }
+        char* result = g_strdup_printf("/search with:%s", found);
+        free(found);
+        return result;
+    }
+
+    return autocomplete_param_with_ac(input, "/search", search_ac, FALSE, previous);
+}
@@ -114,8 +114,6 @@
     }                     \
     }
 
-GHashTable* commands = NULL;
-
 static gboolean _cmd_has_tag(Command* pcmd, const char* const tag);
 
 /*
@@ -620,20 +618,28 @@ static struct cmd_t command_defs[] = {
     },
 
     { "/room",
-      parse_args, 1, 1, NULL,
+      parse_args, 1, 2, NULL,
       CMD_NOSUBFUNCS
       CMD_MAINFUNC(cmd_room)
       CMD_TAGS(
               CMD_TAG_GROUPCHAT)
       CMD_SYN(
-              "/room accept|destroy|config")
+              "/room accept|destroy|config",
+              "/room slow <ms>|off",
+              "/room collapse on|off")
       CMD_DESC(
-              "Chat room configuration.")
+              "Chat room configuration. "
+              "Slow mode keeps a busy room from drawing every message as it arrives.")
       CMD_ARGS(
               { "accept", "Accept default room configuration." },
               { "destroy", "Reject default room configuration, and destroy the room." },
-              { "config", "Edit room configuration." })
-      CMD_NOEXAMPLES
+              { "config", "Edit room configuration." },
+              { "slow <ms>", "Show the messages of this room together, at most every <ms> milliseconds, 50 to 60000." },
+              { "slow off", "Show each message as it arrives, the default." },
+              { "collapse on|off", "In slow mode, show identical consecutive messages from the same occupant once, with their count." })
+      CMD_EXAMPLES(
+              "/room slow 2000",
+              "/room collapse on")
     },
 
     { "/kick",
@@ -745,9 +751,12 @@ static struct cmd_t command_defs[] = {
               "/occupants size [<percent>]",
               "/occupants indent <indent>",
               "/occupants header char <char>|none",
-              "/occupants wrap on|off")
+              "/occupants wrap on|off",
+              "/occupants light <occupants>|off")
       CMD_DESC(
-              "Show or hide room occupants, and occupants panel display settings.")
+              "Show or hide room occupants, and occupants panel display settings. "
+              "Rooms reaching the presence-light size only keep the nick and role of their occupants, "
+              "jids and status messages are not shown for them.")
       CMD_ARGS(
               { "show", "Show the occupants panel in current room." },
               { "char <char>", "Prefix occupants with specified character." },
@@ -766,7 +775,9 @@ static struct cmd_t command_defs[] = {
               { "indent <indent>", "Indent contact line by <indent> spaces (0 to 10)." },
               { "header char <char>", "Prefix occupants headers with specified character." },
               { "header char none", "Remove occupants header character prefix." },
-              { "wrap on|off", "Enable or disable line wrapping in occupants panel." })
+              { "wrap on|off", "Enable or disable line wrapping in occupants panel." },
+              { "light <occupants>", "Switch rooms to presence-light mode once they have this many occupants (100-1000000)." },
+              { "light off", "Keep the full details of every occupant." })
       CMD_NOEXAMPLES
     },
 
@@ -806,10 +817,11 @@ static struct cmd_t command_defs[] = {
       CMD_DESC(
               "List the chat rooms available at the specified conference service. "
               "If no argument is supplied, the account preference 'muc.service' is used, 'conference.<domain-part>' by default. "
-              "The filter argument only shows rooms that contain the provided text, case insensitive.")
+              "The filter argument only shows rooms that contain the provided text, case insensitive. "
+              "Large lists are fetched and shown a page at a time.")
       CMD_ARGS(
               { "service <service>", "The conference service to query." },
-              { "filter <text>", "The text to filter results by." },
+              { "filter <text>", "The text to filter results by, a cached list is filtered without asking the service again." },
               { "cache on|off", "Enable or disable caching of rooms list response, enabled by default." },
               { "cache clear", "Clear the rooms response cache if enabled." })
       CMD_EXAMPLES(
@@ -895,14 +907,18 @@ static struct cmd_t command_defs[] = {
               CMD_TAG_CHAT,
               CMD_TAG_GROUPCHAT)
       CMD_SYN(
-              "/sendfile <file>")
+              "/sendfile <file> [<file>...]")
       CMD_DESC(
-              "Send a file using XEP-0363 HTTP file transfer.")
+              "Send files using XEP-0363 HTTP file transfer. "
+              "Several files or glob patterns may be given, quote paths containing spaces. "
+              "Upload slots for the next files are requested while earlier ones are transferring, "
+              "the number of files transferred at the same time is set per account, see /account set uploads.")
       CMD_ARGS(
-              { "<file>", "Path to the file." })
+              { "<file>", "Path to the file, or a glob pattern." })
       CMD_EXAMPLES(
               "/sendfile /etc/hosts",
-              "/sendfile ~/images/sweet_cat.jpg")
+              "/sendfile ~/images/sweet_cat.jpg",
+              "/sendfile ~/images/*.jpg \"~/notes/read me.txt\"")
     },
 
     { "/lastactivity",
@@ -956,6 +972,7 @@ static struct cmd_t command_defs[] = {
               "/win <roomjid>",
               "/win <roomoccupantjid>",
               "/win xmlconsole",
+              "/win search",
               "/win <plugin>")
       CMD_DESC(
               "Move to the specified window.")
@@ -967,6 +984,7 @@ static struct cmd_t command_defs[] = {
               { "<roomjid>", "Focus chat room window with roomjid if open." },
               { "<roomoccupantjid>", "Focus private chat roomoccupantjid if open." },
               { "xmlconsole", "Focus the XML Console window if open." },
+              { "search", "Focus the search results window if open." },
               { "<plugin>", "Focus the plugin window." })
       CMD_EXAMPLES(
               "/win console",
@@ -984,7 +1002,8 @@ static struct cmd_t command_defs[] = {
               { "unread", cmd_wins_unread },
               { "attention", cmd_wins_attention },
               { "prune", cmd_wins_prune },
-              { "swap", cmd_wins_swap })
+              { "swap", cmd_wins_swap },
+              { "hibernate", cmd_wins_hibernate })
       CMD_MAINFUNC(cmd_wins)
       CMD_TAGS(
               CMD_TAG_UI)
@@ -993,16 +1012,28 @@ static struct cmd_t command_defs[] = {
               "/wins unread",
               "/wins attention",
               "/wins prune",
-              "/wins swap <source> <target>")
+              "/wins swap <source> <target>",
+              "/wins hibernate",
+              "/wins hibernate <minutes>|off",
+              "/wins hibernate memory <mb>|off",
+              "/wins hibernate now")
       CMD_DESC(
               "Manage windows. "
-              "Passing no argument will list all currently active windows and information about their usage.")
+              "Passing no argument will list all currently active windows and information about their usage. "
+              "Windows in the background hibernate to save memory: their contents are packed away and drawn again when the window is shown. "
+              "By default this happens after 30 minutes.")
       CMD_ARGS(
               { "unread", "List windows with unread messages." },
               { "attention", "List windows that have been marked with the attention flag (alt+v). You can toggle between marked windows with alt+m." },
               { "prune", "Close all windows with no unread messages." },
-              { "swap <source> <target>", "Swap windows, target may be an empty position." })
-      CMD_NOEXAMPLES
+              { "swap <source> <target>", "Swap windows, target may be an empty position." },
+              { "hibernate", "Show the hibernation settings and how much memory windows use." },
+              { "hibernate <minutes>|off", "Hibernate windows not shown for <minutes>, or only for the memory budget." },
+              { "hibernate memory <mb>|off", "Hibernate the least recently shown windows while all windows together use more than <mb> megabytes." },
+              { "hibernate now", "Hibernate all windows in the background now." })
+      CMD_EXAMPLES(
+              "/wins hibernate 10",
+              "/wins hibernate memory 200")
     },
 
     { "/sub",
@@ -1082,6 +1113,7 @@ static struct cmd_t command_defs[] = {
               "/close <roomjid>",
               "/close <roomoccupantjid>",
               "/close xmlconsole",
+              "/close search",
               "/close all|read")
       CMD_DESC(
               "Close windows. "
@@ -1093,6 +1125,7 @@ static struct cmd_t command_defs[] = {
               { "<roomjid>", "Close chat room window with roomjid if open." },
               { "<roomoccupantjid>", "Close private chat roomoccupantjid if open." },
               { "xmlconsole", "Close the XML Console window if open." },
+              { "search", "Close the search results window if open." },
               { "all", "Close all windows." },
               { "read", "Close all windows that have no unread messages." })
       CMD_NOEXAMPLES
@@ -1255,6 +1288,27 @@ static struct cmd_t command_defs[] = {
       CMD_NOEXAMPLES
     },
 
+    { "/collapse",
+      parse_args, 1, 1, &cons_collapse_setting,
+      CMD_NOSUBFUNCS
+      CMD_MAINFUNC(cmd_collapse)
+      CMD_TAGS(
+              CMD_TAG_UI)
+      CMD_SYN(
+              "/collapse <lines>|off",
+              "/collapse expand")
+      CMD_DESC(
+              "Collapse very long messages. "
+              "A message taking more lines shows only its first ones followed by how many more there are.")
+      CMD_ARGS(
+              { "<lines>", "Collapse messages longer than this many lines, 10 to 10000." },
+              { "off", "Always show messages in full." },
+              { "expand", "Show the collapsed messages of the current window in full." })
+      CMD_EXAMPLES(
+              "/collapse 50",
+              "/collapse expand")
+    },
+
     { "/time",
       parse_args, 1, 3, &cons_time_setting,
       CMD_NOSUBFUNCS
@@ -1633,24 +1687,41 @@ static struct cmd_t command_defs[] = {
     },
 
     { "/logging",
-      parse_args, 2, 3, &cons_logging_setting,
+      parse_args, 0, 3, &cons_logging_setting,
       CMD_NOSUBFUNCS
       CMD_MAINFUNC(cmd_logging)
       CMD_TAGS(
               CMD_TAG_CHAT)
       CMD_SYN(
-              "/logging chat|group on|off")
+              "/logging",
+              "/logging chat|group on|off",
+              "/logging flush <seconds>",
+              "/logging compress on|off",
+              "/logging db mode fast|safe",
+              "/logging db retain <days>d|forever",
+              "/logging db import")
       CMD_DESC(
               "Configure chat logging. "
               "Switch logging on or off. "
               "Chat logging will be enabled if /history is set to on. "
               "When disabling this option, /history will also be disabled. ")
       CMD_ARGS(
+              { "", "Show chat logging settings and the number of messages waiting to be written to the history database." },
               { "chat on|off", "Enable/Disable regular chat logging." },
-              { "group on|off", "Enable/Disable groupchat (room) logging." })
+              { "group on|off", "Enable/Disable groupchat (room) logging." },
+              { "flush <seconds>", "How often buffered chat log writes are flushed to disk, default 1. A value of 0 flushes on every main loop iteration." },
+              { "compress on|off", "Gzip the chat logs of past days in the background, as they roll over and those already on disk. The legacy import reads them either way." },
+              { "db mode safe", "Sync the history database to disk on every commit, the default." },
+              { "db mode fast", "Write ahead log with fewer syncs, a larger cache and checkpoints while idle. A crash may lose the last few messages but never corrupts the database. Applies the next time the database is opened." },
+              { "db retain <days>d|forever", "Delete messages older than this many days from the history database, in the background. Freed space is given back on databases created with this version. Default forever." },
+              { "db import", "Copy the messages of the text chat logs of the connected account into the history database, in the background. Only messages older than the history the database had before the first import are taken. An interrupted import continues with the files not done yet. Run again to see the progress." })
       CMD_EXAMPLES(
               "/logging chat on",
-              "/logging group off")
+              "/logging group off",
+              "/logging flush 5",
+              "/logging db mode fast",
+              "/logging db retain 365d",
+              "/logging db import")
     },
 
     { "/states",
@@ -1914,15 +1985,39 @@ static struct cmd_t command_defs[] = {
               CMD_TAG_CHAT)
       CMD_SYN(
               "/receipts request on|off",
-              "/receipts send on|off")
+              "/receipts send on|off",
+              "/receipts markers on|off")
       CMD_DESC(
               "Enable or disable message delivery receipts. The interface will indicate when a message has been received.")
       CMD_ARGS(
               { "request on|off", "Whether or not to request a receipt upon sending a message." },
-              { "send on|off", "Whether or not to send a receipt if one has been requested with a received message." })
+              { "send on|off", "Whether or not to send a receipt if one has been requested with a received message." },
+              { "markers on|off", "Whether or not to use chat markers. Messages that can be marked are acknowledged with one displayed marker once shown, instead of a receipt each. A marker received acknowledges all earlier messages." })
       CMD_NOEXAMPLES
     },
 
+    { "/bandwidth",
+      parse_args, 2, 2, &cons_bandwidth_setting,
+      CMD_NOSUBFUNCS
+      CMD_MAINFUNC(cmd_bandwidth)
+      CMD_TAGS(
+              CMD_TAG_CONNECTION)
+      CMD_SYN(
+              "/bandwidth low on|off",
+              "/bandwidth compression on|off",
+              "/bandwidth terminal on|off")
+      CMD_DESC(
+              "Reduce traffic on metered links. "
+              "Use '/perf net' to see how much is sent and received, "
+              "and '/perf' for the bytes written to the terminal.")
+      CMD_ARGS(
+              { "low on|off", "Don't send chat states or delivery receipts, don't subscribe to avatars and only use capabilities already cached." },
+              { "compression on|off", "Ask the server for stream compression (XEP-0138) on the next connect, if libstrophe supports it." },
+              { "terminal on|off", "Write less to the terminal, for slow SSH sessions. New lines scroll the screen instead of repainting it and a resize does not clear it first. Some terminals flicker when scrolling." })
+      CMD_EXAMPLES(
+              "/bandwidth low on")
+    },
+
     { "/reconnect",
       parse_args, 1, 1, &cons_reconnect_setting,
       CMD_NOSUBFUNCS
@@ -1946,12 +2041,16 @@ static struct cmd_t command_defs[] = {
               CMD_TAG_CONNECTION)
       CMD_SYN(
               "/autoping set <seconds>",
-              "/autoping timeout <seconds>")
+              "/autoping timeout <seconds>",
+              "/autoping adaptive on|off")
       CMD_DESC(
               "Set the interval between sending ping requests to the server to ensure the connection is kept alive.")
       CMD_ARGS(
               { "set <seconds>", "Number of seconds between sending pings, a value of 0 disables autoping." },
-              { "timeout <seconds>", "Seconds to wait for autoping responses, after which the connection is considered broken." })
+              { "timeout <seconds>", "Seconds to wait for autoping responses, after which the connection is considered broken." },
+              { "adaptive on|off", "Skip the ping while the server is sending anything, and ping less often while the connection stays up. "
+                                   "A whitespace keepalive goes out instead, and the socket fails once it is unacknowledged for the timeout, "
+                                   "so a dead connection is still noticed as quickly." })
       CMD_NOEXAMPLES
     },
 
@@ -1981,7 +2080,8 @@ static struct cmd_t command_defs[] = {
               "/autoaway mode idle|away|off",
               "/autoaway time away|xa <minutes>",
               "/autoaway message away|xa <message>|off",
-              "/autoaway check on|off")
+              "/autoaway check on|off",
+              "/autoaway csi on|off")
       CMD_DESC(
               "Manage autoaway settings for idle time.")
       CMD_ARGS(
@@ -1994,14 +2094,17 @@ static struct cmd_t command_defs[] = {
               { "message xa <message>", "Optional message to send with the xa presence, default: off (disabled)." },
               { "message away off", "Send no message with away presence." },
               { "message xa off", "Send no message with xa presence." },
-              { "check on|off", "When enabled, checks for activity and sends online presence, default: on." })
+              { "check on|off", "When enabled, checks for activity and sends online presence, default: on." },
+              { "csi on|off", "Tell the server when idle so it can hold back presence updates until activity, default: off. "
+                              "Only enable when the server supports XEP-0352 Client State Indication." })
       CMD_EXAMPLES(
               "/autoaway mode away",
               "/autoaway time away 30",
               "/autoaway message away Away from computer for a while",
               "/autoaway time xa 120",
               "/autoaway message xa Away from computer for a very long time",
-              "/autoaway check off")
+              "/autoaway check off",
+              "/autoaway csi on")
     },
 
     { "/priority",
@@ -2066,6 +2169,7 @@ static struct cmd_t command_defs[] = {
               "/account set <account> tls force|allow|trust|legacy|disable",
               "/account set <account> auth default|legacy",
               "/account set <account> theme <theme>",
+              "/account set <account> uploads <count>",
               "/account clear <account> password",
               "/account clear <account> eval_password",
               "/account clear <account> server",
@@ -2110,6 +2214,7 @@ static struct cmd_t command_defs[] = {
               { "set <account> auth default", "Use default authentication process." },
               { "set <account> auth legacy", "Allow legacy authentication." },
               { "set <account> <theme>", "Set the UI theme for the account." },
+              { "set <account> uploads <count>", "Number of files of a /sendfile batch to transfer at the same time (1..16), defaults to 2." },
               { "clear <account> server", "Remove the server setting for this account." },
               { "clear <account> port", "Remove the port setting for this account." },
               { "clear <account> password", "Remove the password setting for this account." },
@@ -2142,6 +2247,7 @@ static struct cmd_t command_defs[] = {
               { "load", cmd_plugins_load },
               { "unload", cmd_plugins_unload },
               { "reload", cmd_plugins_reload },
+              { "lazy", cmd_plugins_lazy },
               { "python_version", cmd_plugins_python_version })
       CMD_MAINFUNC(cmd_plugins)
       CMD_NOTAGS
@@ -2153,9 +2259,10 @@ static struct cmd_t command_defs[] = {
               "/plugins unload [<plugin>]",
               "/plugins load [<plugin>]",
               "/plugins reload [<plugin>]",
+              "/plugins lazy <plugin> on|off",
               "/plugins python_version")
       CMD_DESC(
-              "Manage plugins. Passing no arguments lists currently loaded plugins and global plugins which are available for local installation. Global directory for Python plugins is " GLOBAL_PYTHON_PLUGINS_PATH " and for C Plugins is " GLOBAL_C_PLUGINS_PATH ".")
+              "Manage plugins. Passing no arguments lists currently loaded plugins with the time each took to load, and global plugins which are available for local installation. Global directory for Python plugins is " GLOBAL_PYTHON_PLUGINS_PATH " and for C Plugins is " GLOBAL_C_PLUGINS_PATH ".")
       CMD_ARGS(
               { "install [<path>]", "Install a plugin, or all plugins found in a directory (recursive). And loads it/them." },
               { "uninstall [<plugin>]", "Uninstall a plugin." },
@@ -2163,6 +2270,7 @@ static struct cmd_t command_defs[] = {
               { "load [<plugin>]", "Load a plugin that already exists in the plugin directory, passing no argument loads all found plugins. It will be loaded upon next start too unless unloaded." },
               { "unload [<plugin>]", "Unload a loaded plugin, passing no argument will unload all plugins." },
               { "reload [<plugin>]", "Reload a plugin, passing no argument will reload all plugins." },
+              { "lazy <plugin> on|off", "Load the plugin after startup instead of before the first screen, or as soon as a command is not known. Takes effect on next start." },
               { "python_version", "Show the Python interpreter version." })
       CMD_EXAMPLES(
               "/plugins install",
@@ -2171,7 +2279,8 @@ static struct cmd_t command_defs[] = {
               "/plugins uninstall browser.py",
               "/plugins load browser.py",
               "/plugins unload say.py",
-              "/plugins reload wikipedia.py")
+              "/plugins reload wikipedia.py",
+              "/plugins lazy wikipedia.py on")
     },
 
     { "/prefs",
@@ -2223,17 +2332,32 @@ static struct cmd_t command_defs[] = {
     },
 
     { "/xmlconsole",
-      parse_args, 0, 0, NULL,
+      parse_args, 0, 4, NULL,
       CMD_NOSUBFUNCS
       CMD_MAINFUNC(cmd_xmlconsole)
       CMD_TAGS(
               CMD_TAG_UI)
       CMD_SYN(
-              "/xmlconsole")
-      CMD_DESC(
-              "Open the XML console to view incoming and outgoing XMPP traffic.")
-      CMD_NOARGS
-      CMD_NOEXAMPLES
+              "/xmlconsole",
+              "/xmlconsole filter [kind:<element>] [ns:<namespace>] [jid:<jid>]",
+              "/xmlconsole filter off",
+              "/xmlconsole pretty on|off")
+      CMD_DESC(
+              "Open the XML console to view incoming and outgoing XMPP traffic. "
+              "Stanzas are kept while the console is in the background and drawn once it is shown. "
+              "A filter decides which stanzas are kept at all, every given term has to match.")
+      CMD_ARGS(
+              { "filter", "Show the current filter." },
+              { "filter kind:<element>", "Keep stanzas of that element only, e.g. message, presence or iq." },
+              { "filter ns:<namespace>", "Keep stanzas with an element of that namespace only." },
+              { "filter jid:<jid>", "Keep stanzas from or to that jid only, a bare jid matches all its resources." },
+              { "filter off", "Keep all stanzas." },
+              { "pretty on|off", "Indent stanzas by element when they are drawn." })
+      CMD_EXAMPLES(
+              "/xmlconsole filter kind:iq",
+              "/xmlconsole filter kind:message jid:room@conference.example.org",
+              "/xmlconsole filter ns:urn:xmpp:mam:2",
+              "/xmlconsole pretty on")
     },
 
     { "/script",
@@ -2307,7 +2431,8 @@ static struct cmd_t command_defs[] = {
             { "fingerprint", cmd_omemo_fingerprint },
             { "char", cmd_omemo_char },
             { "policy", cmd_omemo_policy },
-            { "clear_device_list", cmd_omemo_clear_device_list })
+            { "clear_device_list", cmd_omemo_clear_device_list },
+            { "fetchwindow", cmd_omemo_fetch_window })
         CMD_NOMAINFUNC
         CMD_TAGS(
             CMD_TAG_CHAT,
@@ -2322,7 +2447,8 @@ static struct cmd_t command_defs[] = {
             "/omemo char <char>",
             "/omemo trustmode manual|firstusage|blind",
             "/omemo policy manual|automatic|always",
-            "/omemo clear_device_list")
+            "/omemo clear_device_list",
+            "/omemo fetchwindow <requests>")
         CMD_DESC(
             "OMEMO commands to manage keys, and perform encryption during chat sessions.")
         CMD_ARGS(
@@ -2339,7 +2465,8 @@ static struct cmd_t command_defs[] = {
             { "policy manual",           "Set the global OMEMO policy to manual, OMEMO sessions must be started manually." },
             { "policy automatic",        "Set the global OMEMO policy to opportunistic, an OMEMO session will be attempted upon starting a conversation." },
             { "policy always",           "Set the global OMEMO policy to always, an error will be displayed if an OMEMO session cannot be initiated upon starting a conversation." },
-            { "clear_device_list",       "Clear your own device list on server side. Each client will reannounce itself when connected back."})
+            { "clear_device_list",       "Clear your own device list on server side. Each client will reannounce itself when connected back."},
+            { "fetchwindow <requests>",  "Number of device list and bundle requests sent at once, the rest wait for answers. Default is 8." })
         CMD_EXAMPLES(
             "/omemo gen",
             "/omemo start odin@valhalla.edda",
@@ -2382,7 +2509,8 @@ static struct cmd_t command_defs[] = {
       CMD_SYN(
               "/paste")
       CMD_DESC(
-              "Paste clipboard.")
+              "Paste the clipboard into the input line, to be edited or sent with enter. "
+              "The clipboard is asked without waiting for it, nothing is pasted if it does not answer within a few seconds.")
       CMD_NOARGS
       CMD_NOEXAMPLES
     },
@@ -2554,22 +2682,25 @@ static struct cmd_t command_defs[] = {
     },
 
     { "/url",
-      parse_args, 2, 3, NULL,
+      parse_args, 2, 3, &cons_url_setting,
       CMD_SUBFUNCS(
               { "open", cmd_url_open },
-              { "save", cmd_url_save })
+              { "save", cmd_url_save },
+              { "segmented", cmd_url_segmented })
       CMD_NOMAINFUNC
       CMD_TAGS(
               CMD_TAG_CHAT,
               CMD_TAG_GROUPCHAT)
       CMD_SYN(
               "/url open <url>",
-              "/url save <url> [<path>]")
+              "/url save <url> [<path>]",
+              "/url segmented on|off")
       CMD_DESC(
               "Deal with URLs")
       CMD_ARGS(
               { "open", "Open URL with predefined executable." },
-              { "save", "Save URL to optional path, default path is current directory" })
+              { "save", "Save URL to optional path, default path is current directory" },
+              { "segmented on|off", "Download large files in several parts at the same time if the server allows ranges, encrypted files are decrypted once complete." })
       CMD_EXAMPLES(
               "/url open https://profanity-im.github.io",
               "/url save https://profanity-im.github.io/guide/latest/userguide.html /home/user/Download/")
@@ -2698,14 +2829,110 @@ static struct cmd_t command_defs[] = {
               "/mood set amazed",
               "/mood clear")
     },
+
+    { "/perf",
+      parse_args_with_freetext, 0, 3, NULL,
+      CMD_NOSUBFUNCS
+      CMD_MAINFUNC(cmd_perf)
+      CMD_TAGS(
+              CMD_TAG_UI)
+      CMD_SYN(
+              "/perf",
+              "/perf on|off",
+              "/perf reset",
+              "/perf mem",
+              "/perf net [reset]",
+              "/perf log <seconds>|off",
+              "/perf trace start <file>",
+              "/perf trace stop",
+              "/perf profile start <file>",
+              "/perf profile stop",
+              "/perf profile rate <hz>",
+              "/perf record start|anonymous <file>",
+              "/perf record stop",
+              "/perf trim now",
+              "/perf trim <minutes>|off")
+      CMD_DESC(
+              "Show where time is spent at runtime. "
+              "Counts calls and latencies of event processing, screen updates, redraws, stanza handlers, "
+              "chat log writes and plugin hooks, how many config file saves were requested and written, "
+              "and how long background jobs such as file transfers waited for a worker and ran. "
+              "Counting is off by default and costs next to nothing while off.")
+      CMD_ARGS(
+              { "on|off", "Enable or disable the performance counters." },
+              { "reset", "Reset all counters." },
+              { "mem", "Show the largest holders of memory: windows, roster, rooms, capabilities, autocompleters, pending IQs, OMEMO sessions and SQLite. The sizes are estimates." },
+              { "net", "Show how many stanzas and bytes were sent and received, by kind, and how long each phase of the last connect took." },
+              { "net reset", "Reset the traffic counters." },
+              { "log <seconds>", "Write the counters to the log every <seconds> seconds." },
+              { "log off", "Stop writing the counters to the log." },
+              { "trace start <file>", "Record every span with its start and duration to <file> as Chrome trace JSON, for chrome://tracing or Perfetto." },
+              { "trace stop", "Stop recording and close the trace file." },
+              { "profile start <file>", "Sample the stack of the main loop while it uses the CPU, and write the samples to <file> as folded stacks for flamegraph.pl when stopped. Functions private to profanity show as the nearest exported one or as an offset addr2line resolves." },
+              { "profile stop", "Stop sampling and write the profile." },
+              { "profile rate <hz>", "Samples taken per second of CPU time, 1 to 1000, 99 by default." },
+              { "record start <file>", "Record every stanza received, with the time it arrived, to <file> for the replay benchmark. Start before connecting to include the login." },
+              { "record anonymous <file>", "As start, with addresses replaced by made up ones and message text by x's." },
+              { "record stop", "Stop recording and close the file." },
+              { "trim now", "Give memory back now: hidden windows hibernate, cached capabilities, JIDs, display names, nick colours and database pages are dropped, and freed heap is returned to the system." },
+              { "trim <minutes>", "Trim once nobody has typed for <minutes>, 10 by default." },
+              { "trim off", "Never trim when idle." })
+      CMD_EXAMPLES(
+              "/perf on",
+              "/perf",
+              "/perf log 60",
+              "/perf trace start ~/profanity.trace.json",
+              "/perf profile rate 499",
+              "/perf profile start ~/profanity.folded",
+              "/perf record anonymous ~/session.rec")
+    },
+    { "/search",
+      parse_args_as_one, 1, 1, NULL,
+      CMD_NOSUBFUNCS
+      CMD_MAINFUNC(cmd_search)
+      CMD_TAGS(
+              CMD_TAG_CHAT,
+              CMD_TAG_GROUPCHAT)
+      CMD_SYN(
+              "/search [with:<contact>] [after:<date>] [before:<date>] <words>",
+              "/search next")
+      CMD_DESC(
+              "Search the message history stored in the database. "
+              "Results are shown newest first in the search window, a page at a time. "
+              "Messages must contain all of the words, a word ending in '*' matches as a prefix. "
+              "Text typed into the search window starts a new search. "
+              "History stored before search was available is indexed in the background after the first connect.")
+      CMD_ARGS(
+              { "<words>", "The words to look for." },
+              { "with:<contact>", "Only messages with a contact, by JID or nickname, or in a room." },
+              { "after:<date>", "Only messages on or after the date, as YYYY-MM-DD." },
+              { "before:<date>", "Only messages before the date, as YYYY-MM-DD." },
+              { "next", "Show the next page of older results." })
+      CMD_EXAMPLES(
+              "/search holiday photos",
+              "/search with:odin@valhalla.edda runes",
+              "/search with:bigroom@conference.chat.org after:2023-01-01 before:2024-01-01 release*",
+              "/search next")
+    },
+
     // NEXT-COMMAND (search helper)
 };
 
 // clang-format on
 
-static GHashTable* search_index;
+// command_defs is sorted by name in cmd_init, lookups bisect it
+static gboolean commands_sorted = FALSE;
+
+// leading token to a CmdResolved, cleared when aliases or plugin commands
+// change, or when mistyped commands have filled it
+#define CMD_RESOLVE_MAX 256
+static GHashTable* resolved = NULL;
 
-char*
+// search_index[i] holds the folded words of command_defs[i], built on the
+// first /help search
+static char** search_index = NULL;
+
+static char*
 _cmd_index(Command* cmd)
 {
     GString* index_source = g_string_new("");
@@ -2747,61 +2974,64 @@ _cmd_index(Command* cmd)
     return res;
 }
 
-GList*
-cmd_search_index_any(char* term)
+static void
+_cmd_search_index_build(void)
 {
-    GList* results = NULL;
-
-    gchar** processed_terms = g_str_tokenize_and_fold(term, NULL, NULL);
-    int terms_len = g_strv_length(processed_terms);
-
-    for (int i = 0; i < terms_len; i++) {
-        GList* index_keys = g_hash_table_get_keys(search_index);
-        GList* curr = index_keys;
-        while (curr) {
-            char* index_entry = g_hash_table_lookup(search_index, curr->data);
-            if (g_str_match_string(processed_terms[i], index_entry, FALSE)) {
-                results = g_list_append(results, curr->data);
-            }
-            curr = g_list_next(curr);
-        }
-        g_list_free(index_keys);
+    if (search_index) {
+        return;
     }
 
-    g_strfreev(processed_terms);
-
-    return results;
+    search_index = g_new0(char*, ARRAY_SIZE(command_defs) + 1);
+    for (unsigned int i = 0; i < ARRAY_SIZE(command_defs); i++) {
+        search_index[i] = _cmd_index(command_defs + i);
+    }
 }
 
-GList*
-cmd_search_index_all(char* term)
+// returns the names of the commands matching at least one term when all is
+// FALSE, or every term when all is TRUE, in name order
+static GList*
+_cmd_search_index(char* term, gboolean all)
 {
     GList* results = NULL;
 
+    _cmd_search_index_build();
+
     gchar** terms = g_str_tokenize_and_fold(term, NULL, NULL);
     int terms_len = g_strv_length(terms);
 
-    GList* commands = g_hash_table_get_keys(search_index);
-    GList* curr = commands;
-    while (curr) {
-        char* command = curr->data;
+    for (unsigned int i = 0; i < ARRAY_SIZE(command_defs); i++) {
         int matches = 0;
-        for (int i = 0; i < terms_len; i++) {
-            char* command_index = g_hash_table_lookup(search_index, command);
-            if (g_str_match_string(terms[i], command_index, FALSE)) {
+        for (int j = 0; j < terms_len; j++) {
+            if (g_str_match_string(terms[j], search_index[i], FALSE)) {
                 matches++;
             }
         }
-        if (matches == terms_len) {
-            results = g_list_append(results, command);
+        if (all ? matches == terms_len : matches > 0) {
+            results = g_list_prepend(results, command_defs[i].cmd);
         }
-        curr = g_list_next(curr);
     }
 
-    g_list_free(commands);
     g_strfreev(terms);
 
-    return results;
+    return g_list_reverse(results);
+}
+
+GList*
+cmd_search_index_any(char* term)
+{
+    return _cmd_search_index(term, FALSE);
+}
+
+GList*
+cmd_search_index_all(char* term)
+{
+    return _cmd_search_index(term, TRUE);
+}
+
+static int
+_cmd_def_cmp(const void* a, const void* b)
+{
+    return strcmp(((const Command*)a)->cmd, ((const Command*)b)->cmd);
 }
 
 /*
@@ -2814,21 +3044,14 @@ cmd_init(void)
 
     cmd_ac_init();
 
-    search_index = g_hash_table_new_full(g_str_hash, g_str_equal, free, g_free);
+    if (!commands_sorted) {
+        qsort(command_defs, ARRAY_SIZE(command_defs), sizeof(Command), _cmd_def_cmp);
+        commands_sorted = TRUE;
+    }
 
-    // load command defs into hash table
-    commands = g_hash_table_new(g_str_hash, g_str_equal);
     for (unsigned int i = 0; i < ARRAY_SIZE(command_defs); i++) {
-        Command* pcmd = command_defs + i;
-
-        // add to hash
-        g_hash_table_insert(commands, pcmd->cmd, pcmd);
-
-        // add to search index
-        g_hash_table_insert(search_index, strdup(pcmd->cmd), _cmd_index(pcmd));
-
         // add to commands and help autocompleters
-        cmd_ac_add_cmd(pcmd);
+        cmd_ac_add_cmd(command_defs + i);
     }
 
     // load aliases
@@ -2845,8 +3068,10 @@ cmd_init(void)
 void
 cmd_uninit(void)
 {
+    cmd_resolve_invalidate();
     cmd_ac_uninit();
-    g_hash_table_destroy(search_index);
+    g_strfreev(search_index);
+    search_index = NULL;
 }
 
 gboolean
@@ -2858,11 +3083,58 @@ cmd_valid_tag(const char* const str)
 Command*
 cmd_get(const char* const command)
 {
-    if (commands) {
-        return g_hash_table_lookup(commands, command);
-    } else {
+    if (!commands_sorted || !command) {
         return NULL;
     }
+
+    Command key = { .cmd = (char*)command };
+    return bsearch(&key, command_defs, ARRAY_SIZE(command_defs), sizeof(Command), _cmd_def_cmp);
+}
+
+static void
+_cmd_resolved_free(CmdResolved* entry)
+{
+    g_free(entry->alias);
+    g_free(entry);
+}
+
+const CmdResolved*
+cmd_resolve(const char* const command)
+{
+    CmdResolved* entry = resolved ? g_hash_table_lookup(resolved, command) : NULL;
+    if (entry) {
+        return entry;
+    }
+
+    if (!resolved) {
+        resolved = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_cmd_resolved_free);
+    } else if (g_hash_table_size(resolved) >= CMD_RESOLVE_MAX) {
+        g_hash_table_remove_all(resolved);
+    }
+
+    entry = g_new0(CmdResolved, 1);
+    entry->cmd = cmd_get(command);
+    if (entry->cmd) {
+        entry->kind = CMD_RESOLVED_BUILTIN;
+    } else if (plugins_command_exists(command)) {
+        entry->kind = CMD_RESOLVED_PLUGIN;
+    } else if (command[0] == '/' && (entry->alias = prefs_get_alias(command + 1))) {
+        entry->kind = CMD_RESOLVED_ALIAS;
+    } else {
+        entry->kind = CMD_RESOLVED_UNKNOWN;
+    }
+    g_hash_table_insert(resolved, g_strdup(command), entry);
+
+    return entry;
+}
+
+void
+cmd_resolve_invalidate(void)
+{
+    if (resolved) {
+        g_hash_table_destroy(resolved);
+        resolved = NULL;
+    }
 }
 
 GList*
@@ -2870,23 +3142,15 @@ cmd_get_ordered(const char* const tag)
 {
     GList* ordered_commands = NULL;
 
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
-
-    g_hash_table_iter_init(&iter, commands);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        Command* pcmd = (Command*)value;
-        if (tag) {
-            if (_cmd_has_tag(pcmd, tag)) {
-                ordered_commands = g_list_insert_sorted(ordered_commands, pcmd->cmd, (GCompareFunc)g_strcmp0);
-            }
-        } else {
-            ordered_commands = g_list_insert_sorted(ordered_commands, pcmd->cmd, (GCompareFunc)g_strcmp0);
+    // command_defs is already in name order
+    for (unsigned int i = 0; i < ARRAY_SIZE(command_defs); i++) {
+        Command* pcmd = command_defs + i;
+        if (!tag || _cmd_has_tag(pcmd, tag)) {
+            ordered_commands = g_list_prepend(ordered_commands, pcmd->cmd);
         }
     }
 
-    return ordered_commands;
+    return g_list_reverse(ordered_commands);
 }
 
 static gboolean
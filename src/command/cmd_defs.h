@@ -45,6 +45,26 @@ void cmd_init(void);
 void cmd_uninit(void);
 
 Command* cmd_get(const char* const command);
+
+typedef enum {
+    CMD_RESOLVED_UNKNOWN,
+    CMD_RESOLVED_BUILTIN,
+    CMD_RESOLVED_PLUGIN,
+    CMD_RESOLVED_ALIAS
+} cmd_resolved_kind_t;
+
+typedef struct cmd_resolved_t
+{
+    cmd_resolved_kind_t kind;
+    // the built-in command, or the line an alias stands for
+    Command* cmd;
+    char* alias;
+} CmdResolved;
+
+// What the leading token of an input line names, cached until aliases
+// or plugin commands change
+const CmdResolved* cmd_resolve(const char* const command);
+void cmd_resolve_invalidate(void);
 GList* cmd_get_ordered(const char* const tag);
 
 gboolean cmd_valid_tag(const char* const str);
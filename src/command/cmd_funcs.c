@@ -51,6 +51,7 @@
 #include <unistd.h>
 #include <langinfo.h>
 #include <ctype.h>
+#include <glob.h>
 
 // fork / execl
 #include <sys/types.h>
@@ -61,6 +62,7 @@
 #include "profanity.h"
 #include "log.h"
 #include "common.h"
+#include "database.h"
 #include "command/cmd_funcs.h"
 #include "command/cmd_defs.h"
 #include "command/cmd_ac.h"
@@ -68,15 +70,25 @@
 #include "config/accounts.h"
 #include "config/account.h"
 #include "config/preferences.h"
+#include "config/persist.h"
 #include "config/theme.h"
 #include "config/tlscerts.h"
 #include "config/scripts.h"
 #include "event/client_events.h"
+#include "event/server_events.h"
 #include "tools/http_upload.h"
 #include "tools/http_download.h"
 #include "tools/autocomplete.h"
 #include "tools/parser.h"
 #include "tools/bookmark_ignore.h"
+#include "tools/intern.h"
+#include "tools/memusage.h"
+#include "tools/perf.h"
+#include "tools/profiler.h"
+#include "tools/memtrim.h"
+#include "tools/ratelimit.h"
+#include "tools/workers.h"
+#include "tools/external.h"
 #include "plugins/plugins.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
@@ -88,6 +100,7 @@
 #include "xmpp/muc.h"
 #include "xmpp/chat_session.h"
 #include "xmpp/avatar.h"
+#include "xmpp/recorder.h"
 
 #ifdef HAVE_LIBOTR
 #include "otr/otr.h"
@@ -121,7 +134,7 @@ static void _who_room(ProfWin* window, const char* const command, gchar** args);
 static void _who_roster(ProfWin* window, const char* const command, gchar** args);
 static gboolean _cmd_execute(ProfWin* window, const char* const command, const char* const inp);
 static gboolean _cmd_execute_default(ProfWin* window, const char* inp);
-static gboolean _cmd_execute_alias(ProfWin* window, const char* const inp, gboolean* ran);
+static gboolean _cmd_execute_builtin(ProfWin* window, Command* cmd, const char* const command, const char* const inp);
 
 /*
  * Take a line of input and process it, return TRUE if profanity is to
@@ -140,8 +153,7 @@ cmd_process_input(ProfWin* window, char* inp)
 
         // handle command if input starts with a '/'
     } else if (inp[0] == '/') {
-        char* inp_cpy = strdup(inp);
-        char* command = strtok(inp_cpy, " ");
+        char* command = g_strndup(inp, strcspn(inp, " "));
         char* question_mark = strchr(command, '?');
         if (question_mark) {
             *question_mark = '\0';
@@ -153,7 +165,7 @@ cmd_process_input(ProfWin* window, char* inp)
         } else {
             result = _cmd_execute(window, command, inp);
         }
-        free(inp_cpy);
+        g_free(command);
 
         // call a default handler if input didn't start with '/'
     } else {
@@ -665,6 +677,24 @@ _account_set_port(char* account_name, char* port)
     return TRUE;
 }
 
+gboolean
+_account_set_uploads(char* account_name, char* uploads)
+{
+    int uploadsi;
+    char* err_msg = NULL;
+    gboolean res = strtoi_range(uploads, &uploadsi, 1, 16, &err_msg);
+    if (!res) {
+        cons_show(err_msg);
+        cons_show("");
+        free(err_msg);
+    } else {
+        accounts_set_upload_concurrency(account_name, uploadsi);
+        cons_show("Updated concurrent uploads for account %s: %s", account_name, uploads);
+        cons_show("");
+    }
+    return TRUE;
+}
+
 gboolean
 _account_set_resource(char* account_name, char* resource)
 {
@@ -937,6 +967,8 @@ cmd_account_set(ProfWin* window, const char* const command, gchar** args)
         return _account_set_tls(account_name, value);
     if (strcmp(property, "auth") == 0)
         return _account_set_auth(account_name, value);
+    if (strcmp(property, "uploads") == 0)
+        return _account_set_uploads(account_name, value);
 
     if (valid_resource_presence_string(property)) {
         return _account_set_presence_priority(account_name, property, value);
@@ -1328,6 +1360,72 @@ cmd_wins_swap(ProfWin* window, const char* const command, gchar** args)
     return TRUE;
 }
 
+gboolean
+cmd_wins_hibernate(ProfWin* window, const char* const command, gchar** args)
+{
+    if (args[1] == NULL) {
+        int count, hibernated;
+        gsize memory;
+        wins_hibernate_stats(&count, &hibernated, &memory);
+
+        gint minutes = prefs_get_wins_hibernate();
+        if (minutes > 0) {
+            cons_show("Windows hibernate after %d minutes in the background.", minutes);
+        } else {
+            cons_show("Windows only hibernate to stay within the memory budget.");
+        }
+        gint budget = prefs_get_wins_memory();
+        if (budget > 0) {
+            cons_show("Memory budget for all windows: %d MB.", budget);
+        } else {
+            cons_show("No memory budget for windows.");
+        }
+        cons_show("%d of %d windows hibernated, windows use about %" G_GSIZE_FORMAT " KiB.", hibernated, count, memory / 1024);
+        return TRUE;
+    }
+
+    if (g_strcmp0(args[1], "now") == 0) {
+        int hibernated = wins_hibernate_idle(TRUE);
+        cons_show("Hibernated %d windows.", hibernated);
+        return TRUE;
+    }
+
+    gboolean memory = g_strcmp0(args[1], "memory") == 0;
+    const char* value = memory ? args[2] : args[1];
+    if (value == NULL) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    int intval = 0;
+    if (g_strcmp0(value, "off") != 0) {
+        char* err_msg = NULL;
+        if (!strtoi_range(value, &intval, 1, memory ? 65536 : 10080, &err_msg)) {
+            cons_show(err_msg);
+            free(err_msg);
+            return TRUE;
+        }
+    }
+
+    if (memory) {
+        prefs_set_wins_memory(intval);
+        if (intval == 0) {
+            cons_show("Memory budget for windows disabled.");
+        } else {
+            cons_show("Memory budget for windows set to %d MB.", intval);
+        }
+    } else {
+        prefs_set_wins_hibernate(intval);
+        if (intval == 0) {
+            cons_show("Windows no longer hibernate after a while in the background.");
+        } else {
+            cons_show("Windows hibernate after %d minutes in the background.", intval);
+        }
+    }
+
+    return TRUE;
+}
+
 gboolean
 cmd_wins(ProfWin* window, const char* const command, gchar** args)
 {
@@ -2138,7 +2236,7 @@ cmd_msg(ProfWin* window, const char* const command, gchar** args)
         Occupant* occupant = muc_roster_item(mucwin->roomjid, usr);
         if (occupant) {
             // in case of non-anon muc send regular chatmessage
-            if (muc_anonymity_type(mucwin->roomjid) == MUC_ANONYMITY_TYPE_NONANONYMOUS) {
+            if (muc_anonymity_type(mucwin->roomjid) == MUC_ANONYMITY_TYPE_NONANONYMOUS && occupant->jid) {
                 Jid* jidp = jid_create(occupant->jid);
 
                 _cmd_msg_chatwin(jidp->barejid, msg);
@@ -4317,6 +4415,37 @@ cmd_room(ProfWin* window, const char* const command, gchar** args)
             iq_request_room_config_form(mucwin->roomjid);
         }
         return TRUE;
+    } else if (g_strcmp0(args[0], "slow") == 0) {
+        if (g_strcmp0(args[1], "off") == 0) {
+            mucwin->slow_ms = 0;
+            sv_ev_room_slow_flush(mucwin->roomjid);
+            win_println(window, THEME_ROOMINFO, "!", "Slow mode disabled.");
+            return TRUE;
+        }
+
+        int intval = 0;
+        char* err_msg = NULL;
+        if (!args[1]) {
+            cons_bad_cmd_usage(command);
+        } else if (strtoi_range(args[1], &intval, 50, 60000, &err_msg)) {
+            mucwin->slow_ms = intval;
+            win_println(window, THEME_ROOMINFO, "!", "Slow mode enabled, messages are shown every %d ms.", intval);
+        } else {
+            cons_show(err_msg);
+            free(err_msg);
+        }
+        return TRUE;
+    } else if (g_strcmp0(args[0], "collapse") == 0) {
+        if (g_strcmp0(args[1], "on") == 0) {
+            mucwin->slow_collapse = TRUE;
+            win_println(window, THEME_ROOMINFO, "!", "Repeated lines are shown once in slow mode.");
+        } else if (g_strcmp0(args[1], "off") == 0) {
+            mucwin->slow_collapse = FALSE;
+            win_println(window, THEME_ROOMINFO, "!", "Repeated lines are shown each time in slow mode.");
+        } else {
+            cons_bad_cmd_usage(command);
+        }
+        return TRUE;
     } else {
         cons_bad_cmd_usage(command);
     }
@@ -4369,6 +4498,28 @@ cmd_occupants(ProfWin* window, const char* const command, gchar** args)
         }
     }
 
+    if (g_strcmp0(args[0], "light") == 0) {
+        if (!args[1]) {
+            cons_bad_cmd_usage(command);
+        } else if (g_strcmp0(args[1], "off") == 0) {
+            prefs_set_occupants_light(0);
+            muc_set_light_threshold(0);
+            cons_show("Presence-light mode disabled for rooms joined from now on.");
+        } else {
+            int intval = 0;
+            char* err_msg = NULL;
+            if (strtoi_range(args[1], &intval, 100, 1000000, &err_msg)) {
+                prefs_set_occupants_light(intval);
+                muc_set_light_threshold(intval);
+                cons_show("Rooms switch to presence-light mode at %d occupants.", intval);
+            } else {
+                cons_show(err_msg);
+                free(err_msg);
+            }
+        }
+        return TRUE;
+    }
+
     if (g_strcmp0(args[0], "wrap") == 0) {
         if (!args[1]) {
             cons_bad_cmd_usage(command);
@@ -4847,129 +4998,87 @@ cmd_disco(ProfWin* window, const char* const command, gchar** args)
     return TRUE;
 }
 
-// TODO: Move this into its own tools such as HTTPUpload or AESGCMDownload.
-#ifdef HAVE_OMEMO
-char*
-_add_omemo_stream(int* fd, FILE** fh, char** err)
-{
-    // Create temporary file for writing ciphertext.
-    int tmpfd;
-    char* tmpname = NULL;
-    if ((tmpfd = g_file_open_tmp("profanity.XXXXXX", &tmpname, NULL)) == -1) {
-        *err = "Unable to create temporary file for encrypted transfer.";
-        return NULL;
+// The files named by the /sendfile argument, a single path may contain
+// spaces unquoted, otherwise it is split into words, each expanded as a glob
+static GSList*
+_sendfile_paths(const char* const arg)
+{
+    gchar* path = get_expanded_path(arg);
+    if (access(path, F_OK) == 0) {
+        return g_slist_append(NULL, path);
     }
-    FILE* tmpfh = fdopen(tmpfd, "w+b");
-
-    // The temporary ciphertext file should be removed after it has
-    // been closed.
-    remove(tmpname);
-    free(tmpname);
+    g_free(path);
 
-    int crypt_res;
-    char* fragment;
-    fragment = omemo_encrypt_file(*fh, tmpfh, file_size(*fd), &crypt_res);
-    if (crypt_res != 0) {
-        fclose(tmpfh);
+    gchar** words = NULL;
+    if (!g_shell_parse_argv(arg, NULL, &words, NULL)) {
         return NULL;
     }
 
-    // Force flush as the upload will read from the same stream.
-    fflush(tmpfh);
-    rewind(tmpfh);
-
-    fclose(*fh); // Also closes descriptor.
-
-    // Switch original stream with temporary ciphertext stream.
-    *fd = tmpfd;
-    *fh = tmpfh;
+    GSList* paths = NULL;
+    for (int i = 0; words[i]; i++) {
+        path = get_expanded_path(words[i]);
+        glob_t matches;
+        // a pattern matching nothing is kept, to be reported as not found
+        if (glob(path, GLOB_NOCHECK, NULL, &matches) == 0) {
+            for (size_t j = 0; j < matches.gl_pathc; j++) {
+                paths = g_slist_append(paths, g_strdup(matches.gl_pathv[j]));
+            }
+            globfree(&matches);
+            g_free(path);
+        } else {
+            paths = g_slist_append(paths, path);
+        }
+    }
+    g_strfreev(words);
 
-    return fragment;
+    return paths;
 }
-#endif
 
-gboolean
-cmd_sendfile(ProfWin* window, const char* const command, gchar** args)
+static void
+_sendfile_queue(ProfWin* window, const char* const filename, gboolean omemo_enabled)
 {
-    jabber_conn_status_t conn_status = connection_get_status();
-    gchar* filename;
     char* alt_scheme = NULL;
     char* alt_fragment = NULL;
 
-    // expand ~ to $HOME
-    filename = get_expanded_path(args[0]);
-
     if (access(filename, R_OK) != 0) {
         cons_show_error("Uploading '%s' failed: File not found!", filename);
-        goto out;
+        return;
     }
 
     if (!is_regular_file(filename)) {
         cons_show_error("Uploading '%s' failed: Not a file!", filename);
-        goto out;
-    }
-
-    if (conn_status != JABBER_CONNECTED) {
-        cons_show("You are not currently connected.");
-        goto out;
-    }
-
-    if (window->type != WIN_CHAT && window->type != WIN_PRIVATE && window->type != WIN_MUC) {
-        cons_show_error("Unsupported window for file transmission.");
-        goto out;
+        return;
     }
 
     int fd;
     if ((fd = open(filename, O_RDONLY)) == -1) {
         cons_show_error("Unable to open file descriptor for '%s'.", filename);
-        goto out;
+        return;
     }
 
     FILE* fh = fdopen(fd, "rb");
 
-    gboolean omemo_enabled = FALSE;
-    gboolean sendfile_enabled = TRUE;
-
-    switch (window->type) {
-    case WIN_MUC:
-    {
-        ProfMucWin* mucwin = (ProfMucWin*)window;
-        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
-        omemo_enabled = mucwin->is_omemo == TRUE;
-        break;
-    }
-    case WIN_CHAT:
-    {
-        ProfChatWin* chatwin = (ProfChatWin*)window;
-        assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
-        omemo_enabled = chatwin->is_omemo == TRUE;
-        sendfile_enabled = !((chatwin->pgp_send == TRUE && !prefs_get_boolean(PREF_PGP_SENDFILE))
-                             || (chatwin->is_otr == TRUE && !prefs_get_boolean(PREF_OTR_SENDFILE)));
-        break;
-    }
-
-    case WIN_PRIVATE: // We don't support encryption in private MUC windows.
-    default:
-        cons_show_error("Unsupported window for file transmission.");
-        goto out;
-    }
+#ifdef HAVE_OMEMO
+    OmemoFileStream* omemo_stream = NULL;
+#endif
 
-    if (!sendfile_enabled) {
-        cons_show_error("Uploading unencrypted files disabled. See /otr sendfile or /pgp sendfile.");
-        win_println(window, THEME_ERROR, "-", "Sending encrypted files via http_upload is not possible yet.");
-        goto out;
-    }
+    off_t upload_size = file_size(fd);
 
     if (omemo_enabled) {
 #ifdef HAVE_OMEMO
-        char* err = NULL;
+        // The file is encrypted while it is being sent, the tag is
+        // appended after the ciphertext.
+        int crypt_res;
         alt_scheme = OMEMO_AESGCM_URL_SCHEME;
-        alt_fragment = _add_omemo_stream(&fd, &fh, &err);
-        if (err != NULL) {
+        alt_fragment = omemo_encrypt_file_stream(fh, upload_size, &omemo_stream, &crypt_res);
+        if (crypt_res != 0) {
+            char* err = "Unable to set up encryption for transfer.";
             cons_show_error(err);
             win_println(window, THEME_ERROR, "-", err);
-            goto out;
+            fclose(fh);
+            return;
         }
+        upload_size += OMEMO_AESGCM_TAG_LENGTH;
 #endif
     }
 
@@ -4978,8 +5087,25 @@ cmd_sendfile(ProfWin* window, const char* const command, gchar** args)
 
     upload->filename = strdup(filename);
     upload->filehandle = fh;
-    upload->filesize = file_size(fd);
+    upload->filesize = upload_size;
     upload->mime_type = file_mime_type(filename);
+    upload->get_url = NULL;
+    upload->put_url = NULL;
+    upload->authorization = NULL;
+    upload->cookie = NULL;
+    upload->expires = NULL;
+    upload->cert_path = NULL;
+    upload->err = NULL;
+    upload->read_func = NULL;
+    upload->read_data = NULL;
+    upload->read_data_free = NULL;
+#ifdef HAVE_OMEMO
+    if (omemo_stream) {
+        upload->read_func = omemo_file_stream_read;
+        upload->read_data = omemo_stream;
+        upload->read_data_free = omemo_file_stream_free;
+    }
+#endif
 
     if (alt_scheme != NULL) {
         upload->alt_scheme = strdup(alt_scheme);
@@ -4993,15 +5119,67 @@ cmd_sendfile(ProfWin* window, const char* const command, gchar** args)
         upload->alt_fragment = NULL;
     }
 
-    iq_http_upload_request(upload);
+    http_upload_queue_add(upload);
 
-out:
 #ifdef HAVE_OMEMO
     if (alt_fragment != NULL)
         omemo_free(alt_fragment);
 #endif
-    if (filename != NULL)
-        free(filename);
+}
+
+gboolean
+cmd_sendfile(ProfWin* window, const char* const command, gchar** args)
+{
+    jabber_conn_status_t conn_status = connection_get_status();
+
+    if (conn_status != JABBER_CONNECTED) {
+        cons_show("You are not currently connected.");
+        return TRUE;
+    }
+
+    gboolean omemo_enabled = FALSE;
+    gboolean sendfile_enabled = TRUE;
+
+    switch (window->type) {
+    case WIN_MUC:
+    {
+        ProfMucWin* mucwin = (ProfMucWin*)window;
+        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+        omemo_enabled = mucwin->is_omemo == TRUE;
+        break;
+    }
+    case WIN_CHAT:
+    {
+        ProfChatWin* chatwin = (ProfChatWin*)window;
+        assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
+        omemo_enabled = chatwin->is_omemo == TRUE;
+        sendfile_enabled = !((chatwin->pgp_send == TRUE && !prefs_get_boolean(PREF_PGP_SENDFILE))
+                             || (chatwin->is_otr == TRUE && !prefs_get_boolean(PREF_OTR_SENDFILE)));
+        break;
+    }
+
+    case WIN_PRIVATE: // We don't support encryption in private MUC windows.
+    default:
+        cons_show_error("Unsupported window for file transmission.");
+        return TRUE;
+    }
+
+    if (!sendfile_enabled) {
+        cons_show_error("Uploading unencrypted files disabled. See /otr sendfile or /pgp sendfile.");
+        win_println(window, THEME_ERROR, "-", "Sending encrypted files via http_upload is not possible yet.");
+        return TRUE;
+    }
+
+    GSList* paths = _sendfile_paths(args[0]);
+    if (!paths) {
+        cons_show_error("Uploading failed: Invalid file list '%s'.", args[0]);
+        return TRUE;
+    }
+
+    for (GSList* curr = paths; curr; curr = g_slist_next(curr)) {
+        _sendfile_queue(window, curr->data, omemo_enabled);
+    }
+    g_slist_free_full(paths, g_free);
 
     return TRUE;
 }
@@ -5107,6 +5285,7 @@ cmd_alias(ProfWin* window, const char* const command, gchar** args)
                 return TRUE;
             } else {
                 prefs_add_alias(alias_p, value);
+                cmd_resolve_invalidate();
                 cmd_ac_add(ac_value->str);
                 cmd_ac_add_alias_value(alias_p);
                 cons_show("Command alias added %s -> %s", ac_value->str, value);
@@ -5127,6 +5306,7 @@ cmd_alias(ProfWin* window, const char* const command, gchar** args)
             if (!removed) {
                 cons_show("No such command alias /%s", alias);
             } else {
+                cmd_resolve_invalidate();
                 GString* ac_value = g_string_new("/");
                 g_string_append(ac_value, alias);
                 cmd_ac_remove(ac_value->str);
@@ -5316,6 +5496,37 @@ cmd_wrap(ProfWin* window, const char* const command, gchar** args)
     return TRUE;
 }
 
+gboolean
+cmd_collapse(ProfWin* window, const char* const command, gchar** args)
+{
+    if (g_strcmp0(args[0], "expand") == 0) {
+        int expanded = win_expand(window);
+        if (expanded == 0) {
+            cons_show("No collapsed messages in this window.");
+        }
+        return TRUE;
+    }
+
+    if (g_strcmp0(args[0], "off") == 0) {
+        prefs_set_collapse_lines(0);
+        cons_show("Long messages will be shown in full.");
+    } else {
+        int intval = 0;
+        char* err_msg = NULL;
+        if (!strtoi_range(args[0], &intval, 10, 10000, &err_msg)) {
+            cons_show(err_msg);
+            free(err_msg);
+            return TRUE;
+        }
+        prefs_set_collapse_lines(intval);
+        cons_show("Messages longer than %d lines will be collapsed.", intval);
+    }
+
+    wins_resize_all();
+
+    return TRUE;
+}
+
 gboolean
 cmd_time(ProfWin* window, const char* const command, gchar** args)
 {
@@ -5839,6 +6050,7 @@ cmd_notify(ProfWin* window, const char* const command, gchar** args)
         } else {
             gint period = atoi(args[1]);
             prefs_set_notify_remind(period);
+            notify_remind_update();
             if (period == 0) {
                 cons_show("Message reminders disabled.");
             } else if (period == 1) {
@@ -6390,6 +6602,7 @@ cmd_log(ProfWin* window, const char* const command, gchar** args)
         gboolean res = strtoi_range(value, &intval, PREFS_MIN_LOG_SIZE, INT_MAX, &err_msg);
         if (res) {
             prefs_set_max_log_size(intval);
+            log_rotate_update();
             cons_show("Log maximum size set to %d bytes", intval);
         } else {
             cons_show(err_msg);
@@ -6404,6 +6617,7 @@ cmd_log(ProfWin* window, const char* const command, gchar** args)
             return TRUE;
         }
         _cmd_set_boolean_preference(value, command, "Log rotate", PREF_LOG_ROTATE);
+        log_rotate_update();
         return TRUE;
     }
 
@@ -6429,6 +6643,28 @@ cmd_log(ProfWin* window, const char* const command, gchar** args)
     return TRUE;
 }
 
+gboolean
+cmd_bandwidth(ProfWin* window, const char* const command, gchar** args)
+{
+    if (g_strcmp0(args[0], "low") == 0) {
+        _cmd_set_boolean_preference(args[1], command, "Low bandwidth profile", PREF_LOW_BANDWIDTH);
+    } else if (g_strcmp0(args[0], "compression") == 0) {
+        _cmd_set_boolean_preference(args[1], command, "Stream compression", PREF_COMPRESSION);
+#ifndef XMPP_CONN_FLAG_ENABLE_COMPRESSION
+        if (prefs_get_boolean(PREF_COMPRESSION)) {
+            cons_show("This build is missing libstrophe compression support, the setting has no effect.");
+        }
+#endif
+    } else if (g_strcmp0(args[0], "terminal") == 0) {
+        _cmd_set_boolean_preference(args[1], command, "Minimal terminal output", PREF_TERMINAL_MINIMAL);
+        ui_apply_terminal_output();
+    } else {
+        cons_bad_cmd_usage(command);
+    }
+
+    return TRUE;
+}
+
 gboolean
 cmd_reconnect(ProfWin* window, const char* const command, gchar** args)
 {
@@ -6488,12 +6724,17 @@ cmd_autoping(ProfWin* window, const char* const command, gchar** args)
             } else {
                 cons_show("Autoping timeout set to %d seconds.", intval);
             }
+            connection_update_keepalive();
         } else {
             cons_show(err_msg);
             cons_bad_cmd_usage(command);
             free(err_msg);
         }
 
+    } else if (g_strcmp0(cmd, "adaptive") == 0) {
+        _cmd_set_boolean_preference(value, command, "Adaptive autoping", PREF_AUTOPING_ADAPTIVE);
+        connection_update_keepalive();
+
     } else {
         cons_bad_cmd_usage(command);
     }
@@ -6534,8 +6775,8 @@ cmd_ping(ProfWin* window, const char* const command, gchar** args)
 gboolean
 cmd_autoaway(ProfWin* window, const char* const command, gchar** args)
 {
-    if ((g_strcmp0(args[0], "mode") != 0) && (g_strcmp0(args[0], "time") != 0) && (g_strcmp0(args[0], "message") != 0) && (g_strcmp0(args[0], "check") != 0)) {
-        cons_show("Setting must be one of 'mode', 'time', 'message' or 'check'");
+    if ((g_strcmp0(args[0], "mode") != 0) && (g_strcmp0(args[0], "time") != 0) && (g_strcmp0(args[0], "message") != 0) && (g_strcmp0(args[0], "check") != 0) && (g_strcmp0(args[0], "csi") != 0)) {
+        cons_show("Setting must be one of 'mode', 'time', 'message', 'check' or 'csi'");
         return TRUE;
     }
 
@@ -6550,6 +6791,11 @@ cmd_autoaway(ProfWin* window, const char* const command, gchar** args)
         return TRUE;
     }
 
+    if (g_strcmp0(args[0], "csi") == 0) {
+        _cmd_set_boolean_preference(args[1], command, "Client state indication", PREF_AUTOAWAY_CSI);
+        return TRUE;
+    }
+
     if ((g_strcmp0(args[0], "time") == 0) && (args[2] != NULL)) {
         if (g_strcmp0(args[1], "away") == 0) {
             int minutesval = 0;
@@ -6681,25 +6927,57 @@ cmd_vercheck(ProfWin* window, const char* const command, gchar** args)
 gboolean
 cmd_xmlconsole(ProfWin* window, const char* const command, gchar** args)
 {
-    ProfXMLWin* xmlwin = wins_get_xmlconsole();
-    if (xmlwin) {
-        ui_focus_win((ProfWin*)xmlwin);
-    } else {
-        ProfWin* window = wins_new_xmlconsole();
-        ui_focus_win(window);
+    if (g_strcmp0(args[0], "pretty") == 0) {
+        _cmd_set_boolean_preference(args[1], command, "XML console pretty printing", PREF_XMLCONSOLE_PRETTY);
+        return TRUE;
     }
 
-    return TRUE;
-}
+    if (args[0] && g_strcmp0(args[0], "filter") != 0) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
 
-gboolean
-cmd_flash(ProfWin* window, const char* const command, gchar** args)
-{
-    _cmd_set_boolean_preference(args[0], command, "Screen flash", PREF_FLASH);
-    return TRUE;
-}
+    ProfXMLWin* xmlwin = wins_get_xmlconsole();
+    if (!xmlwin) {
+        xmlwin = (ProfXMLWin*)wins_new_xmlconsole();
+    }
 
-gboolean
+    if (g_strcmp0(args[0], "filter") == 0) {
+        if (args[1] == NULL) {
+            char* filter = xmlwin_get_filter(xmlwin);
+            cons_show("XML console filter: %s", filter ? filter : "none");
+            g_free(filter);
+            return TRUE;
+        }
+
+        gboolean off = g_strcmp0(args[1], "off") == 0 && args[2] == NULL;
+        if (!xmlwin_set_filter(xmlwin, off ? NULL : &args[1])) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+
+        if (off) {
+            cons_show("XML console filter removed.");
+        } else {
+            char* filter = xmlwin_get_filter(xmlwin);
+            cons_show("XML console filter set to: %s", filter);
+            g_free(filter);
+        }
+    }
+
+    ui_focus_win((ProfWin*)xmlwin);
+
+    return TRUE;
+}
+
+gboolean
+cmd_flash(ProfWin* window, const char* const command, gchar** args)
+{
+    _cmd_set_boolean_preference(args[0], command, "Screen flash", PREF_FLASH);
+    return TRUE;
+}
+
+gboolean
 cmd_tray(ProfWin* window, const char* const command, gchar** args)
 {
 #ifdef HAVE_GTK
@@ -6833,6 +7111,78 @@ cmd_logging(ProfWin* window, const char* const command, gchar** args)
             _cmd_set_boolean_preference(args[1], command, "Groupchat logging", PREF_GRLOG);
             return TRUE;
         }
+    } else if (g_strcmp0(args[0], "flush") == 0 && args[1] != NULL) {
+        int intval = 0;
+        char* err_msg = NULL;
+        gboolean res = strtoi_range(args[1], &intval, 0, INT_MAX, &err_msg);
+        if (res) {
+            prefs_set_chlog_flush(intval);
+            chat_log_flush();
+            cons_show("Chat log flush interval set to %d seconds.", intval);
+        } else {
+            cons_show(err_msg);
+            free(err_msg);
+        }
+        return TRUE;
+    } else if (g_strcmp0(args[0], "compress") == 0 && args[1] != NULL) {
+        if (g_strcmp0(args[1], "on") == 0 || g_strcmp0(args[1], "off") == 0) {
+            _cmd_set_boolean_preference(args[1], command, "Chat log compression", PREF_CHLOG_COMPRESS);
+            chat_log_compress_sweep();
+            return TRUE;
+        }
+    } else if (g_strcmp0(args[0], "db") == 0 && g_strcmp0(args[1], "mode") == 0 && args[2] != NULL) {
+        if (g_strcmp0(args[2], "fast") == 0 || g_strcmp0(args[2], "safe") == 0) {
+            prefs_set_string(PREF_DB_MODE, args[2]);
+            cons_show("History database mode set to %s, applies the next time you connect.", args[2]);
+            return TRUE;
+        }
+    } else if (g_strcmp0(args[0], "db") == 0 && g_strcmp0(args[1], "retain") == 0 && args[2] != NULL) {
+        int days = log_database_retention_days(args[2]);
+        if (days < 0) {
+            cons_show("Retention must be a number of days like 365d, or forever.");
+            return TRUE;
+        }
+        if (days == 0) {
+            prefs_set_string(PREF_DB_RETAIN, "forever");
+            cons_show("History database keeps messages forever.");
+        } else {
+            gchar* retain = g_strdup_printf("%dd", days);
+            prefs_set_string(PREF_DB_RETAIN, retain);
+            g_free(retain);
+            cons_show("History database keeps messages for %d days, older ones are deleted in the background.", days);
+        }
+        log_database_maintain();
+        return TRUE;
+    } else if (g_strcmp0(args[0], "db") == 0 && g_strcmp0(args[1], "import") == 0 && args[2] == NULL) {
+        gboolean running;
+        int files_done, files_total, messages;
+        gint64 elapsed_us;
+        if (log_database_import_status(&running, &files_done, &files_total, &messages, &elapsed_us)) {
+            double secs = elapsed_us / (double)G_USEC_PER_SEC;
+            double rate = secs > 0 ? messages / secs : 0.0;
+            if (running) {
+                cons_show("Importing chat logs: %d of %d files, %d messages, %.0f messages/s.", files_done, files_total, messages, rate);
+                return TRUE;
+            }
+            if (files_done == files_total) {
+                cons_show("Chat logs imported: %d files, %d messages in %.1f seconds, %.0f messages/s.", files_total, messages, secs, rate);
+                return TRUE;
+            }
+        }
+
+        if (connection_get_status() != JABBER_CONNECTED) {
+            cons_show("You are not currently connected.");
+            return TRUE;
+        }
+
+        char* login = connection_get_barejid();
+        if (log_database_import_start(login)) {
+            cons_show("Importing the chat logs of %s into the history database in the background, /logging db import shows the progress.", login);
+        } else {
+            cons_show("Unable to import chat logs, the history database is not available.");
+        }
+        free(login);
+        return TRUE;
     }
 
     cons_bad_cmd_usage(command);
@@ -6892,6 +7242,14 @@ cmd_receipts(ProfWin* window, const char* const command, gchar** args)
         }
     } else if (g_strcmp0(args[0], "request") == 0) {
         _cmd_set_boolean_preference(args[1], command, "Request delivery receipts", PREF_RECEIPTS_REQUEST);
+    } else if (g_strcmp0(args[0], "markers") == 0) {
+        _cmd_set_boolean_preference(args[1], command, "Chat markers", PREF_RECEIPTS_MARKERS);
+        if (g_strcmp0(args[1], "on") == 0) {
+            caps_add_feature(XMPP_FEATURE_CHAT_MARKERS);
+        }
+        if (g_strcmp0(args[1], "off") == 0) {
+            caps_remove_feature(XMPP_FEATURE_CHAT_MARKERS);
+        }
     } else {
         cons_bad_cmd_usage(command);
     }
@@ -7126,6 +7484,25 @@ cmd_plugins_reload(ProfWin* window, const char* const command, gchar** args)
     return TRUE;
 }
 
+gboolean
+cmd_plugins_lazy(ProfWin* window, const char* const command, gchar** args)
+{
+    if (args[1] == NULL || (g_strcmp0(args[2], "on") != 0 && g_strcmp0(args[2], "off") != 0)) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    gboolean lazy = g_strcmp0(args[2], "on") == 0;
+    prefs_set_plugin_lazy(args[1], lazy);
+    if (lazy) {
+        cons_show("Plugin %s will load after startup.", args[1]);
+    } else {
+        cons_show("Plugin %s will load during startup.", args[1]);
+    }
+
+    return TRUE;
+}
+
 gboolean
 cmd_plugins_python_version(ProfWin* window, const char* const command, gchar** args)
 {
@@ -7179,18 +7556,21 @@ cmd_plugins(ProfWin* window, const char* const command, gchar** args)
     }
 
     GList* plugins = plugins_loaded_list();
-    if (plugins == NULL) {
+    GList* lazy = plugins_lazy_list();
+    if (plugins == NULL && lazy == NULL) {
         cons_show("No plugins installed.");
         return TRUE;
     }
 
-    GList* curr = plugins;
     cons_show("Installed plugins:");
-    while (curr) {
-        cons_show("  %s", curr->data);
-        curr = g_list_next(curr);
+    for (GList* curr = plugins; curr; curr = g_list_next(curr)) {
+        cons_show("  %-24s %8.1f ms", curr->data, plugins_load_time(curr->data) / 1000.0);
+    }
+    for (GList* curr = lazy; curr; curr = g_list_next(curr)) {
+        cons_show("  %-24s not loaded yet", curr->data);
     }
     g_list_free(plugins);
+    g_list_free(lazy);
 
     return TRUE;
 }
@@ -8252,45 +8632,65 @@ _cmd_execute(ProfWin* window, const char* const command, const char* const inp)
         return result;
     }
 
-    Command* cmd = cmd_get(command);
-    gboolean result = FALSE;
+    const CmdResolved* resolved = cmd_resolve(command);
+    if (resolved->kind == CMD_RESOLVED_UNKNOWN && plugins_load_lazy()) {
+        // the command may come from a lazy plugin not loaded until now
+        resolved = cmd_resolve(command);
+    }
 
-    if (cmd) {
-        gchar** args = cmd->parser(inp, cmd->min_args, cmd->max_args, &result);
-        if (result == FALSE) {
-            ui_invalid_command_usage(cmd->cmd, cmd->setting_func);
+    switch (resolved->kind) {
+    case CMD_RESOLVED_BUILTIN:
+        return _cmd_execute_builtin(window, resolved->cmd, command, inp);
+    case CMD_RESOLVED_PLUGIN:
+        if (plugins_run_command(inp)) {
             return TRUE;
         }
-        if (args[0] && cmd->sub_funcs[0][0]) {
-            int i = 0;
-            while (cmd->sub_funcs[i][0]) {
-                if (g_strcmp0(args[0], (char*)cmd->sub_funcs[i][0]) == 0) {
-                    gboolean (*func)(ProfWin * window, const char* const command, gchar** args) = cmd->sub_funcs[i][1];
-                    gboolean result = func(window, command, args);
-                    g_strfreev(args);
-                    return result;
-                }
-                i++;
-            }
-        }
-        if (!cmd->func) {
-            ui_invalid_command_usage(cmd->cmd, cmd->setting_func);
-            return TRUE;
+        break;
+    case CMD_RESOLVED_ALIAS:
+        // an alias stands for the whole line, it takes no arguments
+        if (strcmp(command, inp) == 0) {
+            // running it may change the aliases, and with them the cache
+            char* value = g_strdup(resolved->alias);
+            gboolean result = cmd_process_input(window, value);
+            g_free(value);
+            return result;
         }
-        gboolean result = cmd->func(window, command, args);
-        g_strfreev(args);
-        return result;
-    } else if (plugins_run_command(inp)) {
+        break;
+    default:
+        break;
+    }
+
+    return _cmd_execute_default(window, inp);
+}
+
+static gboolean
+_cmd_execute_builtin(ProfWin* window, Command* cmd, const char* const command, const char* const inp)
+{
+    gboolean result = FALSE;
+    gchar** args = cmd->parser(inp, cmd->min_args, cmd->max_args, &result);
+    if (result == FALSE) {
+        ui_invalid_command_usage(cmd->cmd, cmd->setting_func);
         return TRUE;
-    } else {
-        gboolean ran_alias = FALSE;
-        gboolean alias_result = _cmd_execute_alias(window, inp, &ran_alias);
-        if (!ran_alias) {
-            return _cmd_execute_default(window, inp);
-        } else {
-            return alias_result;
+    }
+    if (args[0] && cmd->sub_funcs[0][0]) {
+        int i = 0;
+        while (cmd->sub_funcs[i][0]) {
+            if (g_strcmp0(args[0], (char*)cmd->sub_funcs[i][0]) == 0) {
+                gboolean (*func)(ProfWin * window, const char* const command, gchar** args) = cmd->sub_funcs[i][1];
+                gboolean result = func(window, command, args);
+                g_strfreev(args);
+                return result;
+            }
+            i++;
         }
     }
+    if (!cmd->func) {
+        ui_invalid_command_usage(cmd->cmd, cmd->setting_func);
+        return TRUE;
+    }
+    result = cmd->func(window, command, args);
+    g_strfreev(args);
+    return result;
 }
 
 static gboolean
@@ -8308,7 +8708,7 @@ _cmd_execute_default(ProfWin* window, const char* inp)
     }
 
     // handle non commands in non chat or plugin windows
-    if (window->type != WIN_CHAT && window->type != WIN_MUC && window->type != WIN_PRIVATE && window->type != WIN_PLUGIN && window->type != WIN_XML) {
+    if (window->type != WIN_CHAT && window->type != WIN_MUC && window->type != WIN_PRIVATE && window->type != WIN_PLUGIN && window->type != WIN_XML && window->type != WIN_SEARCH) {
         cons_show("Unknown command: %s", inp);
         cons_alert(NULL);
         return TRUE;
@@ -8321,6 +8721,12 @@ _cmd_execute_default(ProfWin* window, const char* inp)
         return TRUE;
     }
 
+    // text in the search window starts a new search
+    if (window->type == WIN_SEARCH) {
+        gchar* search_args[] = { (gchar*)inp, NULL };
+        return cmd_search(window, "/search", search_args);
+    }
+
     jabber_conn_status_t status = connection_get_status();
     if (status != JABBER_CONNECTED) {
         win_println(window, THEME_DEFAULT, "-", "You are not currently connected.");
@@ -8361,28 +8767,6 @@ _cmd_execute_default(ProfWin* window, const char* inp)
     return TRUE;
 }
 
-static gboolean
-_cmd_execute_alias(ProfWin* window, const char* const inp, gboolean* ran)
-{
-    if (inp[0] != '/') {
-        *ran = FALSE;
-        return TRUE;
-    }
-
-    char* alias = strdup(inp + 1);
-    char* value = prefs_get_alias(alias);
-    free(alias);
-    if (value) {
-        *ran = TRUE;
-        gboolean result = cmd_process_input(window, value);
-        g_free(value);
-        return result;
-    }
-
-    *ran = FALSE;
-    return TRUE;
-}
-
 // helper function for status change commands
 static void
 _update_presence(const resource_presence_t resource_presence,
@@ -8594,6 +8978,28 @@ cmd_omemo_char(ProfWin* window, const char* const command, gchar** args)
     return TRUE;
 }
 
+gboolean
+cmd_omemo_fetch_window(ProfWin* window, const char* const command, gchar** args)
+{
+#ifdef HAVE_OMEMO
+    int intval = 0;
+    char* err_msg = NULL;
+    if (args[1] && strtoi_range(args[1], &intval, 1, 100, &err_msg)) {
+        prefs_set_omemo_fetch_window(intval);
+        cons_show("OMEMO fetch window set to %d requests.", intval);
+    } else {
+        if (err_msg) {
+            cons_show(err_msg);
+            free(err_msg);
+        }
+        cons_bad_cmd_usage(command);
+    }
+#else
+    cons_show("This version of Profanity has not been built with OMEMO support enabled");
+#endif
+    return TRUE;
+}
+
 gboolean
 cmd_omemo_log(ProfWin* window, const char* const command, gchar** args)
 {
@@ -8932,46 +9338,30 @@ cmd_reload(ProfWin* window, const char* const command, gchar** args)
     log_info("Reloading preferences");
     cons_show("Reloading preferences.");
     prefs_reload();
+    cmd_resolve_invalidate();
     return TRUE;
 }
 
+#ifdef HAVE_GTK
+static void
+_cmd_paste_received(const char* const text, void* userdata)
+{
+    if (text && text[0] != '\0') {
+        inp_insert_text(text);
+    } else {
+        cons_show("Nothing to paste, the clipboard is empty or did not answer in time.");
+    }
+}
+#endif
+
 gboolean
 cmd_paste(ProfWin* window, const char* const command, gchar** args)
 {
 #ifdef HAVE_GTK
-    char* clipboard_buffer = clipboard_get();
-
-    if (clipboard_buffer) {
-        switch (window->type) {
-        case WIN_MUC:
-        {
-            ProfMucWin* mucwin = (ProfMucWin*)window;
-            assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
-            cl_ev_send_muc_msg(mucwin, clipboard_buffer, NULL);
-            break;
-        }
-        case WIN_CHAT:
-        {
-            ProfChatWin* chatwin = (ProfChatWin*)window;
-            assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
-            cl_ev_send_msg(chatwin, clipboard_buffer, NULL);
-            break;
-        }
-        case WIN_PRIVATE:
-        {
-            ProfPrivateWin* privatewin = (ProfPrivateWin*)window;
-            assert(privatewin->memcheck == PROFPRIVATEWIN_MEMCHECK);
-            cl_ev_send_priv_msg(privatewin, clipboard_buffer, NULL);
-            break;
-        }
-        case WIN_CONSOLE:
-        case WIN_XML:
-        default:
-            cons_bad_cmd_usage(command);
-            break;
-        }
-
-        free(clipboard_buffer);
+    // the text goes into the input line once the clipboard owner answers,
+    // the window may have changed by then, so it is not sent from here
+    if (!clipboard_request_text(_cmd_paste_received, NULL)) {
+        cons_show("Still waiting for the clipboard.");
     }
 #else
     cons_show("This version of Profanity has not been built with GTK support enabled. It is needed for the clipboard feature to work.");
@@ -9162,9 +9552,10 @@ _url_aesgcm_method(ProfWin* window, const char* cmd_template, const char* url, c
     } else {
         download->cmd_template = NULL;
     }
+    download->cert_path = prefs_get_string(PREF_TLS_CERTPATH);
+    download->segmented = prefs_get_boolean(PREF_URL_SEGMENTED);
 
-    pthread_create(&(download->worker), NULL, &aesgcm_file_get, download);
-    aesgcm_download_add_download(download);
+    aesgcm_download_start(download);
 }
 #endif
 
@@ -9176,14 +9567,17 @@ _url_http_method(ProfWin* window, const char* cmd_template, const char* url, con
     download->window = window;
     download->url = strdup(url);
     download->filename = strdup(filename);
+    download->write_func = NULL;
+    download->write_data = NULL;
     if (cmd_template != NULL) {
         download->cmd_template = strdup(cmd_template);
     } else {
         download->cmd_template = NULL;
     }
+    download->cert_path = prefs_get_string(PREF_TLS_CERTPATH);
+    download->segmented = prefs_get_boolean(PREF_URL_SEGMENTED);
 
-    pthread_create(&(download->worker), NULL, &http_file_get, download);
-    http_download_add_download(download);
+    http_download_start(download);
 }
 
 void
@@ -9191,7 +9585,7 @@ _url_external_method(const char* cmd_template, const char* url, const char* file
 {
     gchar** argv = format_call_external_argv(cmd_template, url, filename);
 
-    if (!call_external(argv, NULL, NULL)) {
+    if (!external_run(argv, "Opening URL")) {
         cons_show_error("Unable to call external executable for url: check the logs for more information.");
     } else {
         cons_show("URL '%s' has been called with '%s'.", url, cmd_template);
@@ -9293,7 +9687,21 @@ cmd_url_save(ProfWin* window, const char* const command, gchar** args)
         goto out;
     }
 
-    filename = unique_filename_from_url(url, path);
+    cmd_template = prefs_get_string(PREF_URL_SAVE_CMD);
+    gboolean http_method = cmd_template == NULL && (g_strcmp0(scheme, "http") == 0 || g_strcmp0(scheme, "https") == 0);
+
+    if (http_method) {
+        // Continue an interrupted download of the same URL instead of
+        // starting over under a new name.
+        gchar* base = filename_from_url(url, path);
+        if (base) {
+            filename = http_download_resumable_filename(url, base);
+            g_free(base);
+        }
+    }
+    if (filename == NULL) {
+        filename = unique_filename_from_url(url, path);
+    }
     if (filename == NULL) {
         cons_show_error("Failed to generate unique filename"
                         "from URL '%s' for path '%s'",
@@ -9301,8 +9709,7 @@ cmd_url_save(ProfWin* window, const char* const command, gchar** args)
         goto out;
     }
 
-    cmd_template = prefs_get_string(PREF_URL_SAVE_CMD);
-    if (cmd_template == NULL && (g_strcmp0(scheme, "http") == 0 || g_strcmp0(scheme, "https") == 0)) {
+    if (http_method) {
         _url_http_method(window, cmd_template, url, filename);
 #ifdef HAVE_OMEMO
     } else if (g_strcmp0(scheme, "aesgcm") == 0) {
@@ -9325,6 +9732,14 @@ out:
     return TRUE;
 }
 
+gboolean
+cmd_url_segmented(ProfWin* window, const char* const command, gchar** args)
+{
+    _cmd_set_boolean_preference(args[1], command, "Segmented downloads", PREF_URL_SEGMENTED);
+
+    return TRUE;
+}
+
 gboolean
 cmd_executable_avatar(ProfWin* window, const char* const command, gchar** args)
 {
@@ -9664,3 +10079,516 @@ cmd_mood(ProfWin* window, const char* const command, gchar** args)
     }
     return TRUE;
 }
+
+static void
+_cmd_perf_show(void)
+{
+    if (perf_trace_path()) {
+        cons_show("Tracing to %s.", perf_trace_path());
+    }
+
+    if (!perf_is_enabled()) {
+        cons_show("Performance counters are disabled, use '/perf on' to enable them.");
+        return;
+    }
+
+    cons_show("Performance counters:");
+    cons_show("  %-10s %10s %10s %10s %10s %10s", "section", "calls", "per sec", "p50 us", "p99 us", "max us");
+    for (int i = 0; i < PERF_SECTION_COUNT; i++) {
+        PerfStats stats;
+        perf_get_stats(i, &stats);
+        cons_show("  %-10s %10" G_GUINT64_FORMAT " %10.1f %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT,
+                  perf_section_name(i), stats.count, stats.rate, stats.p50_us, stats.p99_us, stats.max_us);
+    }
+
+    guint64 frames, bytes, max_bytes;
+    perf_get_output(&frames, &bytes, &max_bytes);
+    if (frames > 0) {
+        cons_show("Terminal output: %" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT " bytes, %" G_GUINT64_FORMAT " per frame, largest %" G_GUINT64_FORMAT,
+                  frames, bytes, bytes / frames, max_bytes);
+    }
+
+    guint interval = perf_log_interval();
+    if (interval > 0) {
+        cons_show("Written to the log every %u seconds.", interval);
+    }
+
+    if (persist_files() > 0) {
+        cons_show("");
+        cons_show("File saves:");
+        cons_show("  %-16s %10s %10s", "file", "requested", "written");
+        for (guint i = 0; i < persist_files(); i++) {
+            const char* name;
+            guint64 requested, written;
+            persist_get_stats(i, &name, &requested, &written);
+            cons_show("  %-16s %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT, name, requested, written);
+        }
+    }
+
+    if (ratelimits() > 0) {
+        cons_show("");
+        cons_show("Flood limits:");
+        cons_show("  %-16s %10s %10s", "limit", "allowed", "dropped");
+        for (guint i = 0; i < ratelimits(); i++) {
+            const char* name;
+            guint64 allowed, dropped;
+            ratelimit_get_stats(i, &name, &allowed, &dropped);
+            cons_show("  %-16s %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT, name, allowed, dropped);
+        }
+    }
+
+    if (workers_classes() > 0) {
+        cons_show("");
+        cons_show("Background jobs:");
+        cons_show("  %-10s %8s %8s %8s %9s %12s %12s %12s", "class", "queued", "running", "done", "cancelled", "wait avg ms", "wait max ms", "run avg ms");
+        for (guint i = 0; i < workers_classes(); i++) {
+            WorkerStats stats;
+            workers_get_stats(i, &stats);
+            cons_show("  %-10s %8u %8u %8" G_GUINT64_FORMAT " %9" G_GUINT64_FORMAT " %12.1f %12.1f %12.1f",
+                      stats.name, stats.queued, stats.running, stats.done, stats.cancelled,
+                      stats.wait_avg_us / 1000.0, stats.wait_max_us / 1000.0, stats.run_avg_us / 1000.0);
+        }
+    }
+
+    IqPendingStats iq_stats;
+    iq_get_pending_stats(&iq_stats);
+    if (iq_stats.pending > 0 || iq_stats.expired > 0) {
+        cons_show("");
+        cons_show("IQs waiting for a reply: %u, oldest %" G_GINT64_FORMAT " ms, dropped unanswered: %" G_GUINT64_FORMAT,
+                  iq_stats.pending, iq_stats.oldest_ms, iq_stats.expired);
+        cons_show("  %10s %10s %10s", "< 10s", "< 60s", "older");
+        cons_show("  %10u %10u %10u", iq_stats.age_under_10s, iq_stats.age_under_60s, iq_stats.age_older);
+    }
+}
+
+static void
+_cmd_perf_net_phase(const char* const name, gint64 elapsed_us, const char* const note)
+{
+    if (elapsed_us < 0) {
+        cons_show("  %-10s %10s", name, "-");
+    } else if (note) {
+        cons_show("  %-10s %8.1f ms (%s)", name, elapsed_us / 1000.0, note);
+    } else {
+        cons_show("  %-10s %8.1f ms", name, elapsed_us / 1000.0);
+    }
+}
+
+static void
+_cmd_perf_net_show(void)
+{
+    cons_show("Traffic since start or reset:");
+    cons_show("  %-10s %10s %12s %10s %12s", "kind", "sent", "sent bytes", "received", "recv bytes");
+
+    TrafficStats total = { 0 };
+    for (int i = 0; i < TRAFFIC_KIND_COUNT; i++) {
+        TrafficStats stats;
+        connection_get_traffic(i, &stats);
+        cons_show("  %-10s %10" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT,
+                  connection_traffic_kind_name(i), stats.sent, stats.sent_bytes, stats.received, stats.received_bytes);
+        total.sent += stats.sent;
+        total.sent_bytes += stats.sent_bytes;
+        total.received += stats.received;
+        total.received_bytes += stats.received_bytes;
+    }
+    cons_show("  %-10s %10" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT,
+              "total", total.sent, total.sent_bytes, total.received, total.received_bytes);
+    cons_show("Bytes are of the XML before TLS and compression.");
+
+    ConnectStats connect;
+    connection_get_connect_stats(&connect);
+    if (connect.attempts == 0 && connect.resolve_us < 0) {
+        return;
+    }
+    cons_show("");
+    cons_show("Last connect:");
+    _cmd_perf_net_phase("resolve", connect.resolve_us, connect.resolve_cached ? "cached" : NULL);
+    _cmd_perf_net_phase("stream", connect.stream_us, NULL);
+    // libstrophe has no way to hand a TLS session to a new connection
+    _cmd_perf_net_phase("tls", connect.tls_us, "full handshake");
+    _cmd_perf_net_phase("login", connect.login_us, connect.stream_resumed ? "stream resumed" : NULL);
+    cons_show("  %u address%s tried", connect.attempts, connect.attempts == 1 ? "" : "es");
+}
+
+// how many of the largest consumers '/perf mem' lists
+#define PERF_MEM_TOP 15
+
+static void
+_cmd_perf_mem_add(GArray* report, const char* const name, gsize bytes, guint count)
+{
+    if (bytes > 0) {
+        memusage_report_add(report, name, bytes, count);
+    }
+}
+
+static void
+_cmd_perf_mem_show(void)
+{
+    GArray* report = memusage_report_new();
+    guint count = 0;
+
+    GList* nums = wins_get_nums();
+    for (GList* curr = nums; curr; curr = g_list_next(curr)) {
+        int num = GPOINTER_TO_INT(curr->data);
+        ProfWin* window = wins_get_by_num(num);
+        char* title = win_get_title(window);
+        gchar* name = g_strdup_printf("window %d: %s", num, title);
+        _cmd_perf_mem_add(report, name, win_memory(window), 0);
+        g_free(name);
+        free(title);
+    }
+    g_list_free(nums);
+
+    gsize bytes = roster_memory(&count);
+    _cmd_perf_mem_add(report, "roster contacts", bytes, count);
+    bytes = muc_memory(&count);
+    _cmd_perf_mem_add(report, "room occupants", bytes, count);
+    bytes = caps_memory(&count);
+    _cmd_perf_mem_add(report, "capabilities", bytes, count);
+    bytes = autocomplete_memory_all(&count);
+    _cmd_perf_mem_add(report, "autocompleters", bytes, count);
+    bytes = iq_memory(&count);
+    _cmd_perf_mem_add(report, "iq handlers", bytes, count);
+#ifdef HAVE_OMEMO
+    bytes = omemo_memory(&count);
+    _cmd_perf_mem_add(report, "omemo sessions", bytes, count);
+#endif
+    _cmd_perf_mem_add(report, "sqlite", log_database_memory(), 0);
+    _cmd_perf_mem_add(report, "interned strings", intern_memory(), intern_count());
+    MemPoolStats alloc_stats;
+    connection_get_alloc_stats(&alloc_stats);
+    _cmd_perf_mem_add(report, "libstrophe freed blocks", alloc_stats.cached_bytes, alloc_stats.cached);
+
+    memusage_report_sort(report);
+
+    cons_show("Memory held, rough estimates:");
+    cons_show("  %-32s %10s %10s", "consumer", "count", "KiB");
+    for (guint i = 0; i < report->len && i < PERF_MEM_TOP; i++) {
+        MemConsumer* consumer = &g_array_index(report, MemConsumer, i);
+        if (consumer->count > 0) {
+            cons_show("  %-32s %10u %10" G_GSIZE_FORMAT, consumer->name, consumer->count, consumer->bytes / 1024);
+        } else {
+            cons_show("  %-32s %10s %10" G_GSIZE_FORMAT, consumer->name, "", consumer->bytes / 1024);
+        }
+    }
+    if (report->len > PERF_MEM_TOP) {
+        cons_show("  %u smaller ones not shown", report->len - PERF_MEM_TOP);
+    }
+    cons_show("  %-32s %10s %10" G_GSIZE_FORMAT, "total", "", memusage_report_total(report) / 1024);
+
+    gsize resident = memusage_resident();
+    if (resident > 0) {
+        cons_show("Resident set of the process: %" G_GSIZE_FORMAT " KiB.", resident / 1024);
+    }
+    if (alloc_stats.allocs > 0) {
+        cons_show("libstrophe allocations: %" G_GUINT64_FORMAT ", %.1f%% reused a freed block, %" G_GUINT64_FORMAT " larger than 4 KiB.",
+                  alloc_stats.allocs, 100.0 * alloc_stats.reused / alloc_stats.allocs, alloc_stats.large);
+    }
+    cons_show("Autocompleters are counted on their own line, not with what they complete.");
+
+    memusage_report_free(report);
+}
+
+static void
+_cmd_perf_profile(const char* const command, gchar** args)
+{
+    if (!profiler_available()) {
+        cons_show("Profiling is not supported on this system.");
+    } else if (g_strcmp0(args[1], "start") == 0 && args[2]) {
+        if (profiler_path()) {
+            cons_show("Already profiling to %s.", profiler_path());
+            return;
+        }
+        gchar* path = get_expanded_path(args[2]);
+        if (profiler_start(path)) {
+            cons_show("Profiling at %u Hz to %s, use '/perf profile stop' to finish.", profiler_rate(), path);
+        } else {
+            cons_show_error("Could not open %s.", path);
+        }
+        g_free(path);
+    } else if (g_strcmp0(args[1], "stop") == 0) {
+        if (!profiler_path()) {
+            cons_show("Not profiling.");
+            return;
+        }
+        gchar* path = g_strdup(profiler_path());
+        guint64 dropped = profiler_dropped();
+        guint64 samples = profiler_stop();
+        cons_show("%" G_GUINT64_FORMAT " samples written to %s.", samples, path);
+        if (dropped > 0) {
+            cons_show("%" G_GUINT64_FORMAT " samples were dropped, try a lower rate.", dropped);
+        }
+        g_free(path);
+    } else if (g_strcmp0(args[1], "rate") == 0 && args[2]) {
+        int rate = 0;
+        char* err_msg = NULL;
+        if (!strtoi_range(args[2], &rate, 1, PROFILER_MAX_RATE, &err_msg)) {
+            cons_show(err_msg);
+            free(err_msg);
+            return;
+        }
+        profiler_set_rate(rate);
+        cons_show("Profiling samples %d times a second.", rate);
+    } else {
+        cons_bad_cmd_usage(command);
+    }
+}
+
+static void
+_cmd_perf_record(const char* const command, gchar** args)
+{
+    gboolean anonymous = g_strcmp0(args[1], "anonymous") == 0;
+    if ((g_strcmp0(args[1], "start") == 0 || anonymous) && args[2]) {
+        if (recorder_path()) {
+            cons_show("Already recording to %s.", recorder_path());
+            return;
+        }
+        gchar* path = get_expanded_path(args[2]);
+        if (recorder_start(path, anonymous)) {
+            cons_show("Recording stanzas to %s, use '/perf record stop' to finish.", path);
+        } else {
+            cons_show_error("Could not open %s.", path);
+        }
+        g_free(path);
+    } else if (g_strcmp0(args[1], "stop") == 0) {
+        if (!recorder_path()) {
+            cons_show("Not recording.");
+            return;
+        }
+        gchar* path = g_strdup(recorder_path());
+        guint64 stanzas = recorder_stop();
+        cons_show("%" G_GUINT64_FORMAT " stanzas written to %s.", stanzas, path);
+        g_free(path);
+    } else {
+        cons_bad_cmd_usage(command);
+    }
+}
+
+static void
+_cmd_perf_trim(const char* const command, gchar** args)
+{
+    if (args[1] == NULL) {
+        gint minutes = prefs_get_trim_idle();
+        if (minutes > 0) {
+            cons_show("Memory is trimmed after %d minutes idle.", minutes);
+        } else {
+            cons_show("Memory is not trimmed when idle.");
+        }
+    } else if (g_strcmp0(args[1], "now") == 0) {
+        gsize released = memtrim_run();
+        cons_show("Memory trimmed, %" G_GSIZE_FORMAT " KiB released.", released / 1024);
+    } else if (g_strcmp0(args[1], "off") == 0) {
+        prefs_set_trim_idle(0);
+        cons_show("Memory is not trimmed when idle.");
+    } else {
+        int minutes = 0;
+        char* err_msg = NULL;
+        if (!strtoi_range(args[1], &minutes, 1, 1440, &err_msg)) {
+            cons_show(err_msg);
+            free(err_msg);
+            return;
+        }
+        prefs_set_trim_idle(minutes);
+        cons_show("Memory is trimmed after %d minutes idle.", minutes);
+    }
+}
+
+gboolean
+cmd_perf(ProfWin* window, const char* const command, gchar** args)
+{
+    if (args[0] == NULL) {
+        _cmd_perf_show();
+    } else if (g_strcmp0(args[0], "mem") == 0) {
+        _cmd_perf_mem_show();
+    } else if (g_strcmp0(args[0], "net") == 0) {
+        if (args[1] == NULL) {
+            _cmd_perf_net_show();
+        } else if (g_strcmp0(args[1], "reset") == 0) {
+            connection_reset_traffic();
+            cons_show("Traffic counters reset.");
+        } else {
+            cons_bad_cmd_usage(command);
+        }
+    } else if (g_strcmp0(args[0], "on") == 0) {
+        perf_set_enabled(TRUE);
+        cons_show("Performance counters enabled.");
+    } else if (g_strcmp0(args[0], "off") == 0) {
+        perf_set_enabled(FALSE);
+        cons_show("Performance counters disabled.");
+    } else if (g_strcmp0(args[0], "reset") == 0) {
+        perf_reset();
+        cons_show("Performance counters reset.");
+    } else if (g_strcmp0(args[0], "trace") == 0) {
+        if (g_strcmp0(args[1], "start") == 0 && args[2]) {
+            if (perf_trace_path()) {
+                cons_show("Already tracing to %s.", perf_trace_path());
+                return TRUE;
+            }
+            gchar* path = get_expanded_path(args[2]);
+            if (perf_trace_start(path)) {
+                cons_show("Tracing to %s, use '/perf trace stop' to finish.", path);
+            } else {
+                cons_show_error("Could not open %s.", path);
+            }
+            g_free(path);
+        } else if (g_strcmp0(args[1], "stop") == 0) {
+            if (!perf_trace_path()) {
+                cons_show("Not tracing.");
+                return TRUE;
+            }
+            gchar* path = g_strdup(perf_trace_path());
+            perf_trace_stop();
+            cons_show("Trace written to %s.", path);
+            g_free(path);
+        } else {
+            cons_bad_cmd_usage(command);
+        }
+    } else if (g_strcmp0(args[0], "profile") == 0) {
+        _cmd_perf_profile(command, args);
+    } else if (g_strcmp0(args[0], "record") == 0) {
+        _cmd_perf_record(command, args);
+    } else if (g_strcmp0(args[0], "trim") == 0) {
+        _cmd_perf_trim(command, args);
+    } else if (g_strcmp0(args[0], "log") == 0) {
+        if (args[1] == NULL) {
+            cons_bad_cmd_usage(command);
+        } else if (g_strcmp0(args[1], "off") == 0) {
+            perf_log_every(0);
+            cons_show("Performance counters are no longer written to the log.");
+        } else {
+            int interval = 0;
+            char* err_msg = NULL;
+            if (!strtoi_range(args[1], &interval, 1, 86400, &err_msg)) {
+                cons_show(err_msg);
+                free(err_msg);
+                return TRUE;
+            }
+            perf_log_every(interval);
+            cons_show("Performance counters are written to the log every %d seconds.", interval);
+        }
+    } else {
+        cons_bad_cmd_usage(command);
+    }
+
+    return TRUE;
+}
+
+#define SEARCH_PAGE_SIZE 50
+
+// YYYY-MM-DD, compared against the stored ISO 8601 timestamps
+static gboolean
+_cmd_search_date(const char* const value)
+{
+    int year, month, day, len = 0;
+    if (sscanf(value, "%4d-%2d-%2d%n", &year, &month, &day, &len) != 3 || value[len] != '\0' || len != 10) {
+        return FALSE;
+    }
+
+    return g_date_valid_dmy(day, month, year);
+}
+
+static void
+_cmd_search_page(ProfSearchWin* searchwin)
+{
+    gint64 started = g_get_monotonic_time();
+    GSList* results = log_database_search(searchwin->query, searchwin->with, searchwin->after, searchwin->before, &searchwin->cursor, SEARCH_PAGE_SIZE);
+    gint64 elapsed_ms = (g_get_monotonic_time() - started) / 1000;
+
+    searchwin_show_results(searchwin, results, elapsed_ms, log_database_search_indexed());
+    g_slist_free_full(results, (GDestroyNotify)message_free);
+}
+
+gboolean
+cmd_search(ProfWin* window, const char* const command, gchar** args)
+{
+    jabber_conn_status_t conn_status = connection_get_status();
+    if (conn_status != JABBER_CONNECTED) {
+        cons_show("You are not currently connected.");
+        return TRUE;
+    }
+
+    if (!log_database_search_available()) {
+        cons_show("Message search is not available, SQLite was built without FTS5.");
+        return TRUE;
+    }
+
+    ProfSearchWin* searchwin = wins_get_search();
+
+    if (g_strcmp0(args[0], "next") == 0) {
+        if (!searchwin || !searchwin->query) {
+            cons_show("No search to continue.");
+        } else if (searchwin->cursor == 0) {
+            ui_focus_win((ProfWin*)searchwin);
+            win_println((ProfWin*)searchwin, THEME_DEFAULT, "-", "No more results for: %s", searchwin->query);
+        } else {
+            ui_focus_win((ProfWin*)searchwin);
+            _cmd_search_page(searchwin);
+        }
+        return TRUE;
+    }
+
+    gchar* with = NULL;
+    gchar* after = NULL;
+    gchar* before = NULL;
+    GString* query = g_string_new(NULL);
+    gchar** tokens = g_strsplit(args[0], " ", -1);
+
+    for (int i = 0; tokens[i]; i++) {
+        const char* token = tokens[i];
+        if (token[0] == '\0') {
+            continue;
+        }
+        if (g_str_has_prefix(token, "with:") && token[5] != '\0') {
+            char* barejid = roster_barejid_from_name(&token[5]);
+            g_free(with);
+            with = g_strdup(barejid ? barejid : &token[5]);
+        } else if (g_str_has_prefix(token, "after:") || g_str_has_prefix(token, "before:")) {
+            const char* date = strchr(token, ':') + 1;
+            if (!_cmd_search_date(date)) {
+                cons_show("Invalid date '%s', use YYYY-MM-DD.", date);
+                g_free(with);
+                g_free(after);
+                g_free(before);
+                g_string_free(query, TRUE);
+                g_strfreev(tokens);
+                return TRUE;
+            }
+            gchar** target = token[0] == 'a' ? &after : &before;
+            g_free(*target);
+            *target = g_strdup(date);
+        } else {
+            if (query->len > 0) {
+                g_string_append_c(query, ' ');
+            }
+            g_string_append(query, token);
+        }
+    }
+    g_strfreev(tokens);
+
+    if (query->len == 0) {
+        g_free(with);
+        g_free(after);
+        g_free(before);
+        g_string_free(query, TRUE);
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    if (!searchwin) {
+        searchwin = (ProfSearchWin*)wins_new_search();
+    }
+    g_free(searchwin->query);
+    g_free(searchwin->with);
+    g_free(searchwin->after);
+    g_free(searchwin->before);
+    searchwin->query = g_string_free(query, FALSE);
+    searchwin->with = with;
+    searchwin->after = after;
+    searchwin->before = before;
+    searchwin->cursor = G_MAXINT64;
+
+    ui_focus_win((ProfWin*)searchwin);
+    win_clear((ProfWin*)searchwin);
+    _cmd_search_page(searchwin);
+
+    return TRUE;
+}
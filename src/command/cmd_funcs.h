@@ -116,6 +116,7 @@ gboolean cmd_prefs(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_priority(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_quit(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_reconnect(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_bandwidth(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_room(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_rooms(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_bookmark(ProfWin* window, const char* const command, gchar** args);
@@ -145,6 +146,7 @@ gboolean cmd_role(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_privileges(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_presence(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_wrap(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_collapse(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_time(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_resource(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_inpblock(ProfWin* window, const char* const command, gchar** args);
@@ -168,6 +170,7 @@ gboolean cmd_plugins_update(ProfWin* window, const char* const command, gchar**
 gboolean cmd_plugins_uninstall(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_plugins_load(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_plugins_unload(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_plugins_lazy(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_plugins_reload(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_plugins_python_version(ProfWin* window, const char* const command, gchar** args);
 
@@ -212,6 +215,7 @@ gboolean cmd_wins_unread(ProfWin* window, const char* const command, gchar** arg
 gboolean cmd_wins_attention(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_wins_prune(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_wins_swap(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_wins_hibernate(ProfWin* window, const char* const command, gchar** args);
 
 gboolean cmd_form_field(ProfWin* window, char* tag, gchar** args);
 
@@ -225,6 +229,7 @@ gboolean cmd_omemo_trust(ProfWin* window, const char* const command, gchar** arg
 gboolean cmd_omemo_untrust(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_omemo_trust_mode(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_omemo_policy(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_omemo_fetch_window(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_omemo_clear_device_list(ProfWin* window, const char* const command, gchar** args);
 
 gboolean cmd_save(ProfWin* window, const char* const command, gchar** args);
@@ -240,6 +245,7 @@ gboolean cmd_slashguard(ProfWin* window, const char* const command, gchar** args
 gboolean cmd_serversoftware(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_url_open(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_url_save(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_url_segmented(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_executable_avatar(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_executable_urlopen(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_executable_urlsave(ProfWin* window, const char* const command, gchar** args);
@@ -250,5 +256,7 @@ gboolean cmd_correct_editor(ProfWin* window, const char* const command, gchar**
 gboolean cmd_silence(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_register(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_mood(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_perf(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_search(ProfWin* window, const char* const command, gchar** args);
 
 #endif
@@ -61,6 +61,7 @@
 
 #include "log.h"
 #include "common.h"
+#include "tools/width.h"
 
 struct curl_data_t
 {
@@ -193,23 +194,7 @@ strtoi_range(char* str, int* saveptr, int min, int max, char** err_msg)
 int
 utf8_display_len(const char* const str)
 {
-    if (!str) {
-        return 0;
-    }
-
-    int len = 0;
-    gchar* curr = g_utf8_offset_to_pointer(str, 0);
-    while (*curr != '\0') {
-        gunichar curru = g_utf8_get_char(curr);
-        if (g_unichar_iswide(curru)) {
-            len += 2;
-        } else {
-            len++;
-        }
-        curr = g_utf8_next_char(curr);
-    }
-
-    return len;
+    return width_str(str);
 }
 
 char*
@@ -346,41 +331,49 @@ is_notify_enabled(void)
     return notify_enabled;
 }
 
+// Character offsets of every match of needle, overlapping ones included.
+// Scans forward with strstr and counts characters only between matches,
+// so the haystack is walked once.
 GSList*
 prof_occurrences(const char* const needle, const char* const haystack, int offset, gboolean whole_word, GSList** result)
 {
-    if (needle == NULL || haystack == NULL) {
+    if (needle == NULL || haystack == NULL || needle[0] == '\0') {
         return *result;
     }
 
-    gchar* haystack_curr = g_utf8_offset_to_pointer(haystack, offset);
-    if (g_str_has_prefix(haystack_curr, needle)) {
+    size_t needle_len = strlen(needle);
+    GSList* found = NULL;
+
+    const gchar* counted = g_utf8_offset_to_pointer(haystack, offset);
+    const gchar* curr = strstr(counted, needle);
+    while (curr) {
+        offset += g_utf8_pointer_to_offset(counted, curr);
+        counted = curr;
+
+        gboolean matches = TRUE;
         if (whole_word) {
             gunichar before = 0;
-            gchar* haystack_before_ch = g_utf8_find_prev_char(haystack, haystack_curr);
-            if (haystack_before_ch) {
-                before = g_utf8_get_char(haystack_before_ch);
+            if (curr > haystack) {
+                before = g_utf8_get_char(g_utf8_find_prev_char(haystack, curr));
             }
 
             gunichar after = 0;
-            gchar* haystack_after_ch = haystack_curr + strlen(needle);
-            if (haystack_after_ch[0] != '\0') {
-                after = g_utf8_get_char(haystack_after_ch);
+            if (curr[needle_len] != '\0') {
+                after = g_utf8_get_char(curr + needle_len);
             }
 
-            if (!g_unichar_isalnum(before) && !g_unichar_isalnum(after)) {
-                *result = g_slist_append(*result, GINT_TO_POINTER(offset));
-            }
-        } else {
-            *result = g_slist_append(*result, GINT_TO_POINTER(offset));
+            matches = !g_unichar_isalnum(before) && !g_unichar_isalnum(after);
         }
-    }
 
-    offset++;
-    if (g_strcmp0(g_utf8_offset_to_pointer(haystack, offset), "\0") != 0) {
-        *result = prof_occurrences(needle, haystack, offset, whole_word, result);
+        if (matches) {
+            found = g_slist_prepend(found, GINT_TO_POINTER(offset));
+        }
+
+        curr = strstr(g_utf8_next_char(curr), needle);
     }
 
+    *result = g_slist_concat(*result, g_slist_reverse(found));
+
     return *result;
 }
 
@@ -593,7 +586,7 @@ get_expanded_path(const char* path)
 }
 
 gchar*
-unique_filename_from_url(const char* url, const char* path)
+filename_from_url(const char* url, const char* path)
 {
     gchar* realpath;
 
@@ -619,16 +612,18 @@ unique_filename_from_url(const char* url, const char* path)
         filename = g_build_filename(g_file_peek_path(target), NULL);
     }
 
-    gchar* unique_filename = _unique_filename(filename);
-    if (unique_filename == NULL) {
-        g_free(filename);
-        g_free(realpath);
-        return NULL;
-    }
-
     g_object_unref(target);
-    g_free(filename);
     g_free(realpath);
 
+    return filename;
+}
+
+gchar*
+unique_filename_from_url(const char* url, const char* path)
+{
+    gchar* filename = filename_from_url(url, path);
+    gchar* unique_filename = _unique_filename(filename);
+    g_free(filename);
+
     return unique_filename;
 }
@@ -107,6 +107,7 @@ char* get_random_string(int length);
 gboolean call_external(gchar** argv, gchar** std_out, gchar** std_err);
 gchar** format_call_external_argv(const char* template, const char* url, const char* filename);
 
+gchar* filename_from_url(const char* url, const char* path);
 gchar* unique_filename_from_url(const char* url, const char* path);
 gchar* get_expanded_path(const char* path);
 
@@ -46,6 +46,7 @@
 #include "common.h"
 #include "log.h"
 #include "config/files.h"
+#include "config/persist.h"
 #include "config/account.h"
 #include "config/conflists.h"
 #include "tools/autocomplete.h"
@@ -57,8 +58,11 @@ static GKeyFile* accounts;
 
 static Autocomplete all_ac;
 static Autocomplete enabled_ac;
+// counts the changes, for callers keeping values derived from accounts
+static guint accounts_generation = 1;
 
 static void _save_accounts(void);
+static void _accounts_write(void);
 
 void
 accounts_load(void)
@@ -92,6 +96,7 @@ accounts_load(void)
 void
 accounts_close(void)
 {
+    persist_flush(_accounts_write);
     autocomplete_free(all_ac);
     autocomplete_free(enabled_ac);
     g_key_file_free(accounts);
@@ -418,7 +423,8 @@ accounts_rename(const char* const account_name, const char* const new_name)
         "pgp.keyid",
         "last.activity",
         "script.start",
-        "tls.policy"
+        "tls.policy",
+        "upload.concurrency"
     };
 
     for (int i = 0; i < ARRAY_SIZE(string_keys); i++) {
@@ -490,6 +496,26 @@ accounts_set_port(const char* const account_name, const int value)
     }
 }
 
+void
+accounts_set_upload_concurrency(const char* const account_name, const gint value)
+{
+    if (accounts_account_exists(account_name)) {
+        g_key_file_set_integer(accounts, account_name, "upload.concurrency", value);
+        _save_accounts();
+    }
+}
+
+gint
+accounts_get_upload_concurrency(const char* const account_name)
+{
+    gint result = 0;
+    if (account_name && accounts_account_exists(account_name)) {
+        result = g_key_file_get_integer(accounts, account_name, "upload.concurrency", NULL);
+    }
+
+    return result > 0 ? result : ACCOUNT_UPLOAD_CONCURRENCY_DEFAULT;
+}
+
 void
 accounts_set_resource(const char* const account_name, const char* const value)
 {
@@ -959,8 +985,21 @@ accounts_get_login_status(const char* const account_name)
     return status;
 }
 
+guint
+accounts_get_generation(void)
+{
+    return accounts_generation;
+}
+
 static void
 _save_accounts(void)
+{
+    accounts_generation++;
+    persist_request("accounts", _accounts_write);
+}
+
+static void
+_accounts_write(void)
 {
     gsize g_data_size;
     gchar* g_accounts_data = g_key_file_to_data(accounts, &g_data_size, NULL);
@@ -41,8 +41,12 @@
 #include "common.h"
 #include "config/account.h"
 
+// Files of a /sendfile batch transferred at the same time if not set
+#define ACCOUNT_UPLOAD_CONCURRENCY_DEFAULT 2
+
 void accounts_load(void);
 void accounts_close(void);
+guint accounts_get_generation(void);
 
 char* accounts_find_all(const char* const prefix, gboolean previous, void* context);
 char* accounts_find_enabled(const char* const prefix, gboolean previous, void* context);
@@ -60,6 +64,8 @@ gboolean accounts_account_exists(const char* const account_name);
 void accounts_set_jid(const char* const account_name, const char* const value);
 void accounts_set_server(const char* const account_name, const char* const value);
 void accounts_set_port(const char* const account_name, const int value);
+void accounts_set_upload_concurrency(const char* const account_name, const gint value);
+gint accounts_get_upload_concurrency(const char* const account_name);
 void accounts_set_resource(const char* const account_name, const char* const value);
 void accounts_set_password(const char* const account_name, const char* const value);
 void accounts_set_eval_password(const char* const account_name, const char* const value);
@@ -59,11 +59,25 @@ static struct color_pair_cache
     struct
     {
         int16_t fg, bg;
+        // set for pairs only hashed strings use, those can be recycled
+        GList* lru_link;
     } * pairs;
     int size;
     int capacity;
+    // (fg, bg) to pair id + 1
+    GHashTable* index;
+    // ids of recyclable pairs, least recently used first
+    GQueue lru;
 } cache = { 0 };
 
+// counts the pairs given new colours, text already drawn with them changes
+static guint recycled = 0;
+
+// pairs of hashed strings per profile, so nicks are hashed once and not
+// on every draw, cleared when full
+#define COLOR_HASH_CACHE_MAX 4096
+static GHashTable* hash_cache[COLOR_PROFILE_BLUE_BLINDNESS + 1] = { NULL };
+
 /*
  * xterm default 256 colors
  * XXX: there are many duplicates... (eg blue3)
@@ -340,8 +354,16 @@ color_distance(const struct color_def* a, const struct color_def* b)
     return h * h + s * s + l * l;
 }
 
+// nearest palette entry per hue degree and per step of saturation and
+// lightness, each cell is filled on first use, 0 means not known yet
+#define COLOR_GRID_STEP  10
+#define COLOR_GRID_SL    (100 / COLOR_GRID_STEP + 1)
+static guint16* closest_grid = NULL;
+// lower case colour name to its first index in color_names plus one
+static GHashTable* color_index = NULL;
+
 static int
-find_closest_col(int h, int s, int l)
+_find_closest_col_scan(int h, int s, int l)
 {
     struct color_def a = { h, s, l };
     int min = 0;
@@ -357,6 +379,43 @@ find_closest_col(int h, int s, int l)
     return min;
 }
 
+static int
+find_closest_col(int h, int s, int l)
+{
+    h = ((h % 360) + 360) % 360;
+    int si = (CLAMP(s, 0, 100) + COLOR_GRID_STEP / 2) / COLOR_GRID_STEP;
+    int li = (CLAMP(l, 0, 100) + COLOR_GRID_STEP / 2) / COLOR_GRID_STEP;
+
+    if (!closest_grid) {
+        closest_grid = g_malloc0(sizeof(guint16) * 360 * COLOR_GRID_SL * COLOR_GRID_SL);
+    }
+
+    guint16* cell = &closest_grid[(h * COLOR_GRID_SL + si) * COLOR_GRID_SL + li];
+    if (*cell == 0) {
+        *cell = _find_closest_col_scan(h, si * COLOR_GRID_STEP, li * COLOR_GRID_STEP) + 1;
+    }
+
+    return *cell - 1;
+}
+
+static void
+_color_index_init(void)
+{
+    color_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (int i = 0; i < COLOR_NAME_SIZE; i++) {
+        if (color_names[i].name == NULL) {
+            continue;
+        }
+        gchar* key = g_ascii_strdown(color_names[i].name, -1);
+        if (g_hash_table_contains(color_index, key)) {
+            // duplicates resolve to the first entry
+            g_free(key);
+        } else {
+            g_hash_table_insert(color_index, key, GINT_TO_POINTER(i + 1));
+        }
+    }
+}
+
 static int
 find_col(const char* col_name, int n)
 {
@@ -375,17 +434,24 @@ find_col(const char* col_name, int n)
     }
     memcpy(name, col_name, n);
 
-    if (g_ascii_strcasecmp(name, "default") == 0) {
+    for (int i = 0; i < n; i++) {
+        name[i] = g_ascii_tolower(name[i]);
+    }
+
+    if (g_strcmp0(name, "default") == 0) {
         return -1;
     }
 
-    for (int i = 0; i < COLOR_NAME_SIZE; i++) {
-        if (g_ascii_strcasecmp(name, color_names[i].name) == 0) {
-            return i;
-        }
+    if (!color_index) {
+        _color_index_init();
     }
 
-    return COL_ERR;
+    int index = GPOINTER_TO_INT(g_hash_table_lookup(color_index, name));
+    if (index == 0) {
+        return COL_ERR;
+    }
+
+    return index - 1;
 }
 
 static int
@@ -428,11 +494,39 @@ out:
     return rc;
 }
 
+static gpointer
+_color_pair_key(int fg, int bg)
+{
+    return GINT_TO_POINTER(((fg + 1) << 16) | (bg + 1));
+}
+
+static void
+_color_hash_cache_clear(void)
+{
+    for (int i = 0; i < G_N_ELEMENTS(hash_cache); i++) {
+        if (hash_cache[i]) {
+            g_hash_table_destroy(hash_cache[i]);
+            hash_cache[i] = NULL;
+        }
+    }
+}
+
+void
+color_hash_cache_trim(void)
+{
+    _color_hash_cache_clear();
+}
+
 void
 color_pair_cache_reset(void)
 {
+    // the pair ids are reassigned
+    _color_hash_cache_clear();
+
     if (cache.pairs) {
         free(cache.pairs);
+        g_hash_table_destroy(cache.index);
+        g_queue_clear(&cache.lru);
         memset(&cache, 0, sizeof(cache));
     }
 
@@ -447,18 +541,64 @@ color_pair_cache_reset(void)
         cache.capacity = 8;
 
     cache.pairs = g_malloc0(sizeof(*cache.pairs) * cache.capacity);
+    cache.index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_queue_init(&cache.lru);
     if (cache.pairs) {
         /* default_default */
         cache.pairs[0].fg = -1;
         cache.pairs[0].bg = -1;
+        g_hash_table_insert(cache.index, _color_pair_key(-1, -1), GINT_TO_POINTER(1));
         cache.size = 1;
     } else {
         log_error("Color: unable to allocate memory");
     }
 }
 
+unsigned int
+color_pair_cache_recycled(void)
+{
+    return recycled;
+}
+
+static void
+_color_pair_touch(int i)
+{
+    GList* link = cache.pairs[i].lru_link;
+    if (link) {
+        g_queue_unlink(&cache.lru, link);
+        g_queue_push_tail_link(&cache.lru, link);
+    }
+}
+
+static gboolean
+_color_hash_uses_pair(gpointer key, gpointer value, gpointer pair)
+{
+    return value == pair;
+}
+
+// Takes the least recently used hashed pair away from the strings using it
+static int
+_color_pair_recycle(void)
+{
+    GList* link = g_queue_pop_head_link(&cache.lru);
+    int i = GPOINTER_TO_INT(link->data);
+    g_list_free_1(link);
+    cache.pairs[i].lru_link = NULL;
+
+    g_hash_table_remove(cache.index, _color_pair_key(cache.pairs[i].fg, cache.pairs[i].bg));
+    for (int profile = 0; profile < G_N_ELEMENTS(hash_cache); profile++) {
+        if (hash_cache[profile]) {
+            g_hash_table_foreach_remove(hash_cache[profile], _color_hash_uses_pair, GINT_TO_POINTER(i));
+        }
+    }
+
+    recycled++;
+
+    return i;
+}
+
 static int
-_color_pair_cache_get(int fg, int bg)
+_color_pair_cache_get(int fg, int bg, gboolean hashed)
 {
     if (COLORS < 256) {
         if (fg > 7 || bg > 7) {
@@ -467,29 +607,39 @@ _color_pair_cache_get(int fg, int bg)
         }
     }
 
-    /* try to find pair in cache */
-    for (int i = 0; i < cache.size; i++) {
-        if (fg == cache.pairs[i].fg && bg == cache.pairs[i].bg) {
-            return i;
+    int i = GPOINTER_TO_INT(g_hash_table_lookup(cache.index, _color_pair_key(fg, bg))) - 1;
+    if (i >= 0) {
+        if (!hashed && cache.pairs[i].lru_link) {
+            // the theme uses it as well, it must keep its colours
+            g_queue_delete_link(&cache.lru, cache.pairs[i].lru_link);
+            cache.pairs[i].lru_link = NULL;
         }
+        _color_pair_touch(i);
+        return i;
     }
 
     /* otherwise cache new pair */
 
-    if (cache.size >= cache.capacity) {
+    if (cache.size < cache.capacity) {
+        i = cache.size++;
+    } else if (hashed && cache.lru.length > 0) {
+        i = _color_pair_recycle();
+    } else {
         log_error("Color: reached ncurses color pair cache of %d (COLOR_PAIRS=%d)",
                   cache.capacity, COLOR_PAIRS);
         return -1;
     }
 
-    int i = cache.size;
     cache.pairs[i].fg = fg;
     cache.pairs[i].bg = bg;
+    g_hash_table_insert(cache.index, _color_pair_key(fg, bg), GINT_TO_POINTER(i + 1));
+    if (hashed) {
+        g_queue_push_tail(&cache.lru, GINT_TO_POINTER(i));
+        cache.pairs[i].lru_link = cache.lru.tail;
+    }
     /* (re-)define the new pair in curses */
     init_pair(i, fg, bg);
 
-    cache.size++;
-
     return i;
 }
 
@@ -505,6 +655,13 @@ _color_pair_cache_get(int fg, int bg)
 int
 color_pair_cache_hash_str(const char* str, color_profile profile)
 {
+    GHashTable* resolved = hash_cache[profile];
+    gpointer pair = NULL;
+    if (resolved && g_hash_table_lookup_extended(resolved, str, NULL, &pair)) {
+        _color_pair_touch(GPOINTER_TO_INT(pair));
+        return GPOINTER_TO_INT(pair);
+    }
+
     int fg = color_hash(str, profile);
     int bg = -1;
 
@@ -514,7 +671,20 @@ color_pair_cache_hash_str(const char* str, color_profile profile)
         free(bkgnd);
     }
 
-    return _color_pair_cache_get(fg, bg);
+    int res = _color_pair_cache_get(fg, bg, TRUE);
+    if (res < 0) {
+        return res;
+    }
+
+    if (!resolved) {
+        resolved = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        hash_cache[profile] = resolved;
+    } else if (g_hash_table_size(resolved) >= COLOR_HASH_CACHE_MAX) {
+        g_hash_table_remove_all(resolved);
+    }
+    g_hash_table_insert(resolved, g_strdup(str), GINT_TO_POINTER(res));
+
+    return res;
 }
 
 /**
@@ -542,5 +712,5 @@ color_pair_cache_get(const char* pair_name)
         return -1;
     }
 
-    return _color_pair_cache_get(fg, bg);
+    return _color_pair_cache_get(fg, bg, FALSE);
 }
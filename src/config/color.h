@@ -61,5 +61,9 @@ int color_pair_cache_hash_str(const char* str, color_profile profile);
 int color_pair_cache_get(const char* pair_name);
 /* clear cache */
 void color_pair_cache_reset(void);
+// Forgets the colours of hashed strings, they are hashed again when drawn
+void color_hash_cache_trim(void);
+/* changes whenever a nick colour pair was given to another nick */
+unsigned int color_pair_cache_recycled(void);
 
 #endif
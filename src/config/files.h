@@ -45,6 +45,9 @@
 #define FILE_PLUGIN_SETTINGS          "plugin_settings"
 #define FILE_PLUGIN_THEMES            "plugin_themes"
 #define FILE_CAPSCACHE                "capscache"
+#define FILE_ROSTERCACHE              "roster.cache"
+#define FILE_DISCOCACHE               "disco.cache"
+#define FILE_CAPSCACHE_BIN            "capscache.bin"
 #define FILE_PROFANITY_IDENTIFIER     "profident"
 #define FILE_BOOKMARK_AUTOJOIN_IGNORE "bookmark_ignore"
 
@@ -0,0 +1,232 @@
+/*
+ * persist.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "config/persist.h"
+#include "tools/scheduler.h"
+
+typedef struct persist_file_t
+{
+    const char* name;
+    persist_func write;
+    gboolean pending;
+    // monotonic time in microseconds at which the pending write is due
+    gint64 due;
+    guint64 requested;
+    guint64 written;
+} PersistFile;
+
+static GPtrArray* files = NULL;
+static SchedulerTask* flush_task = NULL;
+
+static PersistFile*
+_persist_find(persist_func write)
+{
+    if (!files) {
+        return NULL;
+    }
+
+    for (guint i = 0; i < files->len; i++) {
+        PersistFile* file = g_ptr_array_index(files, i);
+        if (file->write == write) {
+            return file;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+_persist_write(PersistFile* file)
+{
+    if (file->pending) {
+        file->pending = FALSE;
+        file->written++;
+        file->write();
+    }
+}
+
+// drops the flush task once nothing is waiting to be written
+static void
+_persist_idle(void)
+{
+    for (guint i = 0; i < files->len; i++) {
+        PersistFile* file = g_ptr_array_index(files, i);
+        if (file->pending) {
+            return;
+        }
+    }
+
+    scheduler_remove(flush_task);
+    flush_task = NULL;
+}
+
+// earliest due time of the pending writes, -1 if there is none
+static gint64
+_persist_next_due(void)
+{
+    gint64 next = -1;
+    for (guint i = 0; i < files->len; i++) {
+        PersistFile* file = g_ptr_array_index(files, i);
+        if (file->pending && (next < 0 || file->due < next)) {
+            next = file->due;
+        }
+    }
+
+    return next;
+}
+
+static guint
+_persist_delay_ms(gint64 due)
+{
+    gint64 remaining = due - g_get_monotonic_time();
+
+    return remaining > 0 ? (guint)((remaining + 999) / 1000) : 0;
+}
+
+static gboolean
+_persist_flush_task(void* data)
+{
+    gint64 now = g_get_monotonic_time();
+    for (guint i = 0; i < files->len; i++) {
+        PersistFile* file = g_ptr_array_index(files, i);
+        if (file->pending && file->due <= now) {
+            _persist_write(file);
+        }
+    }
+
+    gint64 next = _persist_next_due();
+    if (next < 0) {
+        flush_task = NULL;
+        return FALSE;
+    }
+
+    scheduler_set_interval(flush_task, _persist_delay_ms(next));
+    return TRUE;
+}
+
+static void
+_persist_schedule(const char* const name, persist_func write, guint delay_ms)
+{
+    PersistFile* file = _persist_find(write);
+    if (!file) {
+        if (!files) {
+            files = g_ptr_array_new_with_free_func(g_free);
+        }
+        file = g_new0(PersistFile, 1);
+        file->name = name;
+        file->write = write;
+        g_ptr_array_add(files, file);
+    }
+
+    // a later request never pushes back a write that is already due
+    gint64 due = g_get_monotonic_time() + (gint64)delay_ms * 1000;
+    if (!file->pending || due < file->due) {
+        file->due = due;
+    }
+    file->requested++;
+    file->pending = TRUE;
+
+    gint64 next = _persist_next_due();
+    if (!flush_task) {
+        flush_task = scheduler_add(_persist_delay_ms(next), _persist_flush_task, NULL, NULL);
+    } else if (file->due == next) {
+        scheduler_set_interval(flush_task, _persist_delay_ms(next));
+    }
+}
+
+void
+persist_request(const char* const name, persist_func write)
+{
+    _persist_schedule(name, write, 0);
+}
+
+void
+persist_request_delayed(const char* const name, persist_func write, guint delay_ms)
+{
+    _persist_schedule(name, write, delay_ms);
+}
+
+void
+persist_flush(persist_func write)
+{
+    PersistFile* file = _persist_find(write);
+    if (file) {
+        _persist_write(file);
+        _persist_idle();
+    }
+}
+
+void
+persist_flush_all(void)
+{
+    if (!files) {
+        return;
+    }
+
+    for (guint i = 0; i < files->len; i++) {
+        _persist_write(g_ptr_array_index(files, i));
+    }
+    _persist_idle();
+}
+
+guint
+persist_files(void)
+{
+    return files ? files->len : 0;
+}
+
+void
+persist_get_stats(guint index, const char** name, guint64* requested, guint64* written)
+{
+    PersistFile* file = g_ptr_array_index(files, index);
+    *name = file->name;
+    *requested = file->requested;
+    *written = file->written;
+}
+
+void
+persist_close(void)
+{
+    persist_flush_all();
+
+    if (files) {
+        g_ptr_array_free(files, TRUE);
+        files = NULL;
+    }
+}
@@ -0,0 +1,59 @@
+/*
+ * persist.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef CONFIG_PERSIST_H
+#define CONFIG_PERSIST_H
+
+#include <glib.h>
+
+// Writes one file, the GKeyFile it writes must outlive the request
+typedef void (*persist_func)(void);
+
+// Writes the file on the next main loop tick, requests until then are
+// written once
+void persist_request(const char* const name, persist_func write);
+// Writes the file once delay_ms have passed since the first request not yet
+// written, for files changed too often to rewrite every time
+void persist_request_delayed(const char* const name, persist_func write, guint delay_ms);
+// Writes the file now if a request is pending, for before its data is freed
+void persist_flush(persist_func write);
+void persist_flush_all(void);
+
+guint persist_files(void);
+void persist_get_stats(guint index, const char** name, guint64* requested, guint64* written);
+
+void persist_close(void);
+
+#endif
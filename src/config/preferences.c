@@ -47,7 +47,9 @@
 #include "log.h"
 #include "preferences.h"
 #include "tools/autocomplete.h"
+#include "tools/multimatch.h"
 #include "config/files.h"
+#include "config/persist.h"
 #include "config/conflists.h"
 
 // preference groups refer to the sections in .profrc or theme files
@@ -75,13 +77,51 @@ gint log_maxsize = 0;
 
 static Autocomplete boolean_choice_ac;
 static Autocomplete room_trigger_ac;
+// room.trigger.list as configured and compiled lower-cased for matching
+static gchar** room_triggers = NULL;
+static MultiMatch* room_trigger_matcher = NULL;
+
+static void _prefs_room_triggers_compile(void);
+
+// Resolved values of the preference_t settings, filled on first use and
+// dropped whenever the preferences change, so hot paths skip GKeyFile.
+typedef struct
+{
+    gboolean bool_valid;
+    gboolean bool_value;
+    gboolean string_valid;
+    gchar* string_value;
+} PrefCacheEntry;
+
+static PrefCacheEntry pref_cache[PREF_LAST];
+// counts the changes, for callers keeping values derived from preferences
+static guint prefs_generation = 1;
 
 static void _save_prefs(void);
+static void _prefs_write(void);
 static const char* _get_group(preference_t pref);
 static const char* _get_key(preference_t pref);
 static gboolean _get_default_boolean(preference_t pref);
 static char* _get_default_string(preference_t pref);
 
+static void
+_prefs_cache_clear(void)
+{
+    prefs_generation++;
+    for (int i = 0; i < PREF_LAST; i++) {
+        g_free(pref_cache[i].string_value);
+        pref_cache[i].string_value = NULL;
+        pref_cache[i].string_valid = FALSE;
+        pref_cache[i].bool_valid = FALSE;
+    }
+}
+
+guint
+prefs_get_generation(void)
+{
+    return prefs_generation;
+}
+
 static void
 _prefs_load(void)
 {
@@ -233,14 +273,23 @@ _prefs_load(void)
         autocomplete_add(room_trigger_ac, triggers[i]);
     }
     g_strfreev(triggers);
+    _prefs_room_triggers_compile();
+
+    _prefs_cache_clear();
 }
 
 /* Clean up after _prefs_load() */
 static void
 _prefs_close(void)
 {
+    persist_flush(_prefs_write);
+    _prefs_cache_clear();
     autocomplete_free(boolean_choice_ac);
     autocomplete_free(room_trigger_ac);
+    g_strfreev(room_triggers);
+    room_triggers = NULL;
+    multimatch_free(room_trigger_matcher);
+    room_trigger_matcher = NULL;
 }
 
 void
@@ -338,27 +387,96 @@ prefs_do_chat_notify(gboolean current_win)
     }
 }
 
+static void
+_prefs_room_triggers_compile(void)
+{
+    g_strfreev(room_triggers);
+    multimatch_free(room_trigger_matcher);
+
+    gsize len = 0;
+    room_triggers = g_key_file_get_string_list(prefs, PREF_GROUP_NOTIFICATIONS, "room.trigger.list", &len, NULL);
+
+    gchar** lower = g_new0(gchar*, len + 1);
+    for (gsize i = 0; i < len; i++) {
+        lower[i] = g_utf8_strdown(room_triggers[i], -1);
+    }
+    room_trigger_matcher = multimatch_new((const gchar* const*)lower, len);
+    g_strfreev(lower);
+}
+
+static gboolean
+_prefs_trigger_found(guint pattern, gsize start, gsize len, void* userdata)
+{
+    gboolean* found = userdata;
+    found[pattern] = TRUE;
+
+    return TRUE;
+}
+
 GList*
 prefs_message_get_triggers(const char* const message)
 {
-    GList* result = NULL;
+    guint count = multimatch_count(room_trigger_matcher);
+    if (count == 0) {
+        return NULL;
+    }
 
     char* message_lower = g_utf8_strdown(message, -1);
-    gsize len = 0;
-    gchar** triggers = g_key_file_get_string_list(prefs, PREF_GROUP_NOTIFICATIONS, "room.trigger.list", &len, NULL);
+    gboolean found[count];
+    memset(found, 0, sizeof(found));
+    multimatch_scan(room_trigger_matcher, message_lower, _prefs_trigger_found, found);
+    g_free(message_lower);
 
-    for (int i = 0; i < len; i++) {
-        char* trigger_lower = g_utf8_strdown(triggers[i], -1);
-        if (g_strrstr(message_lower, trigger_lower)) {
-            result = g_list_append(result, strdup(triggers[i]));
+    // in the configured order, like the list shows them
+    GList* result = NULL;
+    for (guint i = 0; i < count; i++) {
+        if (found[i]) {
+            result = g_list_prepend(result, strdup(room_triggers[i]));
         }
-        g_free(trigger_lower);
     }
 
-    g_strfreev(triggers);
+    return g_list_reverse(result);
+}
+
+typedef struct
+{
+    gsize start;
+    gsize len;
+} TriggerPosition;
+
+static gboolean
+_prefs_trigger_first(guint pattern, gsize start, gsize len, void* userdata)
+{
+    TriggerPosition* first = userdata;
+    if (first->len == 0 || start < first->start || (start == first->start && len > first->len)) {
+        first->start = start;
+        first->len = len;
+    }
+
+    return TRUE;
+}
+
+// The earliest trigger in the message, the longest one when several start
+// there. Positions are bytes of the lower-cased message.
+gboolean
+prefs_message_find_trigger(const char* const message, int* pos, int* len)
+{
+    if (multimatch_count(room_trigger_matcher) == 0) {
+        return FALSE;
+    }
+
+    char* message_lower = g_utf8_strdown(message, -1);
+    TriggerPosition first = { 0, 0 };
+    multimatch_scan(room_trigger_matcher, message_lower, _prefs_trigger_first, &first);
     g_free(message_lower);
 
-    return result;
+    if (first.len == 0) {
+        return FALSE;
+    }
+
+    *pos = first.start;
+    *len = first.len;
+    return TRUE;
 }
 
 gboolean
@@ -515,15 +633,22 @@ prefs_reset_room_notify(const char* const roomjid)
 gboolean
 prefs_get_boolean(preference_t pref)
 {
+    PrefCacheEntry* entry = &pref_cache[pref];
+    if (entry->bool_valid) {
+        return entry->bool_value;
+    }
+
     const char* group = _get_group(pref);
     const char* key = _get_key(pref);
-    gboolean def = _get_default_boolean(pref);
 
     if (!g_key_file_has_key(prefs, group, key, NULL)) {
-        return def;
+        entry->bool_value = _get_default_boolean(pref);
+    } else {
+        entry->bool_value = g_key_file_get_boolean(prefs, group, key, NULL);
     }
+    entry->bool_valid = TRUE;
 
-    return g_key_file_get_boolean(prefs, group, key, NULL);
+    return entry->bool_value;
 }
 
 void
@@ -532,26 +657,34 @@ prefs_set_boolean(preference_t pref, gboolean value)
     const char* group = _get_group(pref);
     const char* key = _get_key(pref);
     g_key_file_set_boolean(prefs, group, key, value);
+    _prefs_cache_clear();
 }
 
-char*
-prefs_get_string(preference_t pref)
+/* returned string is owned by the preferences and valid until the next change */
+const gchar*
+prefs_peek_string(preference_t pref)
 {
+    PrefCacheEntry* entry = &pref_cache[pref];
+    if (entry->string_valid) {
+        return entry->string_value;
+    }
+
     const char* group = _get_group(pref);
     const char* key = _get_key(pref);
-    char* def = _get_default_string(pref);
 
-    char* result = g_key_file_get_string(prefs, group, key, NULL);
-
-    if (result == NULL) {
-        if (def) {
-            return g_strdup(def);
-        } else {
-            return NULL;
-        }
-    } else {
-        return result;
+    entry->string_value = g_key_file_get_string(prefs, group, key, NULL);
+    if (entry->string_value == NULL) {
+        entry->string_value = g_strdup(_get_default_string(pref));
     }
+    entry->string_valid = TRUE;
+
+    return entry->string_value;
+}
+
+char*
+prefs_get_string(preference_t pref)
+{
+    return g_strdup(prefs_peek_string(pref));
 }
 
 char*
@@ -589,6 +722,7 @@ prefs_set_string(preference_t pref, char* value)
     } else {
         g_key_file_set_string(prefs, group, key, value);
     }
+    _prefs_cache_clear();
 }
 
 void
@@ -601,6 +735,7 @@ prefs_set_string_with_option(preference_t pref, char* option, char* value)
     } else {
         g_key_file_set_locale_string(prefs, group, key, option, value);
     }
+    _prefs_cache_clear();
 }
 
 void
@@ -625,6 +760,7 @@ prefs_set_string_list_with_option(preference_t pref, char* option, const gchar*
             g_key_file_set_locale_string_list(prefs, group, key, option, values, num_values);
         }
     }
+    _prefs_cache_clear();
 }
 
 char*
@@ -706,6 +842,22 @@ prefs_set_max_log_size(gint value)
     g_key_file_set_integer(prefs, PREF_GROUP_LOGGING, "maxsize", value);
 }
 
+gint
+prefs_get_chlog_flush(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_LOGGING, "flush", NULL)) {
+        return 1;
+    } else {
+        return g_key_file_get_integer(prefs, PREF_GROUP_LOGGING, "flush", NULL);
+    }
+}
+
+void
+prefs_set_chlog_flush(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_LOGGING, "flush", value);
+}
+
 gint
 prefs_get_inpblock(void)
 {
@@ -771,6 +923,22 @@ prefs_set_autoping_timeout(gint value)
     g_key_file_set_integer(prefs, PREF_GROUP_CONNECTION, "autoping.timeout", value);
 }
 
+gint
+prefs_get_omemo_fetch_window(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_OMEMO, "fetch.window", NULL)) {
+        return 8;
+    } else {
+        return g_key_file_get_integer(prefs, PREF_GROUP_OMEMO, "fetch.window", NULL);
+    }
+}
+
+void
+prefs_set_omemo_fetch_window(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_OMEMO, "fetch.window", value);
+}
+
 gint
 prefs_get_autoaway_time(void)
 {
@@ -851,6 +1019,53 @@ prefs_set_statusbartablen(gint value)
     g_key_file_set_integer(prefs, PREF_GROUP_UI, "statusbar.tablen", value);
 }
 
+// minutes a window is not shown before it hibernates, 0 never
+gint
+prefs_get_wins_hibernate(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_UI, "wins.hibernate", NULL)) {
+        return 30;
+    } else {
+        return g_key_file_get_integer(prefs, PREF_GROUP_UI, "wins.hibernate", NULL);
+    }
+}
+
+void
+prefs_set_wins_hibernate(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "wins.hibernate", value);
+}
+
+// MB all windows together may use before the least recently shown hibernate, 0 no limit
+gint
+prefs_get_wins_memory(void)
+{
+    return g_key_file_get_integer(prefs, PREF_GROUP_UI, "wins.memory", NULL);
+}
+
+void
+prefs_set_wins_memory(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "wins.memory", value);
+}
+
+// minutes without input before memory is given back, 0 never
+gint
+prefs_get_trim_idle(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_UI, "trim.idle", NULL)) {
+        return 10;
+    } else {
+        return g_key_file_get_integer(prefs, PREF_GROUP_UI, "trim.idle", NULL);
+    }
+}
+
+void
+prefs_set_trim_idle(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "trim.idle", value);
+}
+
 gchar**
 prefs_get_plugins(void)
 {
@@ -878,6 +1093,28 @@ prefs_remove_plugin(const char* const name)
     _save_prefs();
 }
 
+// Lazy plugins load after startup or when an unknown command is entered
+gboolean
+prefs_plugin_is_lazy(const char* const name)
+{
+    gchar** lazy = g_key_file_get_string_list(prefs, PREF_GROUP_PLUGINS, "lazy", NULL, NULL);
+    gboolean result = lazy && g_strv_contains((const gchar* const*)lazy, name);
+    g_strfreev(lazy);
+
+    return result;
+}
+
+void
+prefs_set_plugin_lazy(const char* const name, gboolean lazy)
+{
+    if (lazy) {
+        conf_string_list_add(prefs, PREF_GROUP_PLUGINS, "lazy", name);
+    } else {
+        conf_string_list_remove(prefs, PREF_GROUP_PLUGINS, "lazy", name);
+    }
+    _save_prefs();
+}
+
 void
 prefs_free_plugins(gchar** plugins)
 {
@@ -902,6 +1139,48 @@ prefs_get_occupants_size(void)
     }
 }
 
+void
+prefs_set_occupants_light(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "occupants.light", value);
+}
+
+// occupants at which a room switches to presence-light mode, 0 for never
+gint
+prefs_get_occupants_light(void)
+{
+    gint result = g_key_file_get_integer(prefs, PREF_GROUP_UI, "occupants.light", NULL);
+
+    if (result < 0) {
+        return 0;
+    } else {
+        return result;
+    }
+}
+
+void
+prefs_set_collapse_lines(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "collapse.lines", value);
+}
+
+// lines a message shows before it is collapsed, 0 for never
+gint
+prefs_get_collapse_lines(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_UI, "collapse.lines", NULL)) {
+        return 100;
+    }
+
+    gint result = g_key_file_get_integer(prefs, PREF_GROUP_UI, "collapse.lines", NULL);
+
+    if (result < 0) {
+        return 0;
+    } else {
+        return result;
+    }
+}
+
 char*
 prefs_get_occupants_char(void)
 {
@@ -1309,6 +1588,7 @@ prefs_add_room_notify_trigger(const char* const text)
 
     if (res) {
         autocomplete_add(room_trigger_ac, text);
+        _prefs_room_triggers_compile();
     }
 
     return res;
@@ -1322,6 +1602,7 @@ prefs_remove_room_notify_trigger(const char* const text)
 
     if (res) {
         autocomplete_remove(room_trigger_ac, text);
+        _prefs_room_triggers_compile();
     }
 
     return res;
@@ -1720,6 +2001,12 @@ prefs_free_aliases(GList* aliases)
 
 static void
 _save_prefs(void)
+{
+    persist_request("profrc", _prefs_write);
+}
+
+static void
+_prefs_write(void)
 {
     gsize g_data_size;
     gchar* g_prefs_data = g_key_file_to_data(prefs, &g_data_size, NULL);
@@ -1763,6 +2050,7 @@ _get_group(preference_t pref)
     case PREF_MUC_PRIVILEGES:
     case PREF_PRESENCE:
     case PREF_WRAP:
+    case PREF_XMLCONSOLE_PRETTY:
     case PREF_TIME_CONSOLE:
     case PREF_TIME_CHAT:
     case PREF_TIME_MUC:
@@ -1817,6 +2105,7 @@ _get_group(preference_t pref)
     case PREF_TITLEBAR_MUC_TITLE_NAME:
     case PREF_SLASH_GUARD:
     case PREF_COMPOSE_EDITOR:
+    case PREF_TERMINAL_MINIMAL:
         return PREF_GROUP_UI;
     case PREF_STATES:
     case PREF_OUTTYPE:
@@ -1841,6 +2130,9 @@ _get_group(preference_t pref)
         return PREF_GROUP_NOTIFICATIONS;
     case PREF_CHLOG:
     case PREF_GRLOG:
+    case PREF_CHLOG_COMPRESS:
+    case PREF_DB_MODE:
+    case PREF_DB_RETAIN:
     case PREF_LOG_ROTATE:
     case PREF_LOG_SHARED:
         return PREF_GROUP_LOGGING;
@@ -1849,6 +2141,7 @@ _get_group(preference_t pref)
     case PREF_URL_SAVE_CMD:
         return PREF_GROUP_EXECUTABLES;
     case PREF_AUTOAWAY_CHECK:
+    case PREF_AUTOAWAY_CSI:
     case PREF_AUTOAWAY_MODE:
     case PREF_AUTOAWAY_MESSAGE:
     case PREF_AUTOXA_MESSAGE:
@@ -1859,11 +2152,16 @@ _get_group(preference_t pref)
     case PREF_CARBONS:
     case PREF_RECEIPTS_SEND:
     case PREF_RECEIPTS_REQUEST:
+    case PREF_RECEIPTS_MARKERS:
     case PREF_REVEAL_OS:
     case PREF_TLS_CERTPATH:
     case PREF_CORRECTION_ALLOW:
     case PREF_MAM:
     case PREF_SILENCE_NON_ROSTER:
+    case PREF_COMPRESSION:
+    case PREF_LOW_BANDWIDTH:
+    case PREF_AUTOPING_ADAPTIVE:
+    case PREF_URL_SEGMENTED:
         return PREF_GROUP_CONNECTION;
     case PREF_OTR_LOG:
     case PREF_OTR_POLICY:
@@ -1924,6 +2222,10 @@ _get_key(preference_t pref)
         return "receipts.send";
     case PREF_RECEIPTS_REQUEST:
         return "receipts.request";
+    case PREF_RECEIPTS_MARKERS:
+        return "receipts.markers";
+    case PREF_URL_SEGMENTED:
+        return "url.segmented";
     case PREF_REVEAL_OS:
         return "reveal.os";
     case PREF_OCCUPANTS:
@@ -1980,8 +2282,16 @@ _get_key(preference_t pref)
         return "chlog";
     case PREF_GRLOG:
         return "grlog";
+    case PREF_CHLOG_COMPRESS:
+        return "compress";
+    case PREF_DB_MODE:
+        return "db.mode";
+    case PREF_DB_RETAIN:
+        return "db.retain";
     case PREF_AUTOAWAY_CHECK:
         return "autoaway.check";
+    case PREF_AUTOAWAY_CSI:
+        return "autoaway.csi";
     case PREF_AUTOAWAY_MODE:
         return "autoaway.mode";
     case PREF_AUTOAWAY_MESSAGE:
@@ -2144,6 +2454,16 @@ _get_key(preference_t pref)
         return "compose.editor";
     case PREF_SILENCE_NON_ROSTER:
         return "silence.incoming.nonroster";
+    case PREF_XMLCONSOLE_PRETTY:
+        return "xmlconsole.pretty";
+    case PREF_COMPRESSION:
+        return "compression";
+    case PREF_LOW_BANDWIDTH:
+        return "lowbandwidth";
+    case PREF_TERMINAL_MINIMAL:
+        return "terminal.minimal";
+    case PREF_AUTOPING_ADAPTIVE:
+        return "autoping.adaptive";
     default:
         return NULL;
     }
@@ -2273,6 +2593,10 @@ _get_default_string(preference_t pref)
         return "manual";
     case PREF_COLOR_NICK:
         return "false";
+    case PREF_DB_MODE:
+        return "safe";
+    case PREF_DB_RETAIN:
+        return "forever";
     case PREF_AVATAR_CMD:
         return "xdg-open";
     case PREF_URL_OPEN_CMD:
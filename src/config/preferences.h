@@ -64,6 +64,7 @@ typedef enum {
     PREF_CARBONS,
     PREF_RECEIPTS_SEND,
     PREF_RECEIPTS_REQUEST,
+    PREF_RECEIPTS_MARKERS,
     PREF_REVEAL_OS,
     PREF_OCCUPANTS,
     PREF_OCCUPANTS_SIZE,
@@ -127,7 +128,11 @@ typedef enum {
     PREF_NOTIFY_MENTION_WHOLE_WORD,
     PREF_CHLOG,
     PREF_GRLOG,
+    PREF_CHLOG_COMPRESS,
+    PREF_DB_MODE,
+    PREF_DB_RETAIN,
     PREF_AUTOAWAY_CHECK,
+    PREF_AUTOAWAY_CSI,
     PREF_AUTOAWAY_MODE,
     PREF_AUTOAWAY_MESSAGE,
     PREF_AUTOXA_MESSAGE,
@@ -174,8 +179,16 @@ typedef enum {
     PREF_MAM,
     PREF_URL_OPEN_CMD,
     PREF_URL_SAVE_CMD,
+    PREF_URL_SEGMENTED,
     PREF_COMPOSE_EDITOR,
     PREF_SILENCE_NON_ROSTER,
+    PREF_XMLCONSOLE_PRETTY,
+    PREF_COMPRESSION,
+    PREF_LOW_BANDWIDTH,
+    PREF_TERMINAL_MINIMAL,
+    PREF_AUTOPING_ADAPTIVE,
+    // not a preference, keep last
+    PREF_LAST
 } preference_t;
 
 typedef struct prof_alias_t
@@ -196,6 +209,7 @@ void prefs_load(char* config_file);
 void prefs_save(void);
 void prefs_close(void);
 void prefs_reload(void);
+guint prefs_get_generation(void);
 
 char* prefs_find_login(char* prefix);
 void prefs_reset_login_search(void);
@@ -214,11 +228,15 @@ gint prefs_get_notify_remind(void);
 
 void prefs_set_max_log_size(gint value);
 gint prefs_get_max_log_size(void);
+void prefs_set_chlog_flush(gint value);
+gint prefs_get_chlog_flush(void);
 gint prefs_get_priority(void);
 void prefs_set_reconnect(gint value);
 gint prefs_get_reconnect(void);
 void prefs_set_autoping(gint value);
 gint prefs_get_autoping(void);
+gint prefs_get_omemo_fetch_window(void);
+void prefs_set_omemo_fetch_window(gint value);
 void prefs_set_autoping_timeout(gint value);
 gint prefs_get_autoping_timeout(void);
 gint prefs_get_inpblock(void);
@@ -228,9 +246,19 @@ void prefs_set_statusbartabs(gint value);
 gint prefs_get_statusbartabs(void);
 void prefs_set_statusbartablen(gint value);
 gint prefs_get_statusbartablen(void);
+void prefs_set_wins_hibernate(gint value);
+gint prefs_get_wins_hibernate(void);
+void prefs_set_wins_memory(gint value);
+gint prefs_get_wins_memory(void);
+void prefs_set_trim_idle(gint value);
+gint prefs_get_trim_idle(void);
 
 void prefs_set_occupants_size(gint value);
 gint prefs_get_occupants_size(void);
+void prefs_set_occupants_light(gint value);
+gint prefs_get_occupants_light(void);
+void prefs_set_collapse_lines(gint value);
+gint prefs_get_collapse_lines(void);
 void prefs_set_roster_size(gint value);
 gint prefs_get_roster_size(void);
 
@@ -243,6 +271,8 @@ gchar** prefs_get_plugins(void);
 void prefs_free_plugins(gchar** plugins);
 void prefs_add_plugin(const char* const name);
 void prefs_remove_plugin(const char* const name);
+gboolean prefs_plugin_is_lazy(const char* const name);
+void prefs_set_plugin_lazy(const char* const name, gboolean lazy);
 
 char* prefs_get_otr_char(void);
 gboolean prefs_set_otr_char(char* ch);
@@ -323,6 +353,7 @@ void prefs_save_win_placement(ProfWinPlacement* placement);
 gboolean prefs_get_boolean(preference_t pref);
 void prefs_set_boolean(preference_t pref, gboolean value);
 char* prefs_get_string(preference_t pref);
+const gchar* prefs_peek_string(preference_t pref);
 char* prefs_get_string_with_option(preference_t pref, gchar* option);
 void prefs_set_string(preference_t pref, char* value);
 void prefs_set_string_with_option(preference_t pref, char* option, char* value);
@@ -335,6 +366,7 @@ gboolean prefs_do_room_notify(gboolean current_win, const char* const roomjid, c
                               const char* const theirnick, const char* const message, gboolean mention, gboolean trigger_found);
 gboolean prefs_do_room_notify_mention(const char* const roomjid, int unread, gboolean mention, gboolean trigger);
 GList* prefs_message_get_triggers(const char* const message);
+gboolean prefs_message_find_trigger(const char* const message, int* pos, int* len);
 
 void prefs_set_room_notify(const char* const roomjid, gboolean value);
 void prefs_set_room_notify_mention(const char* const roomjid, gboolean value);
@@ -130,6 +130,12 @@ scripts_read(const char* const script)
     return result;
 }
 
+// Runs the whole script as one batch before handing back to the main loop,
+// which then processes events and redraws once. Stanzas the commands send
+// wait in the send queue and go out together, and config changes are
+// written once as files are only saved on the next main loop tick. The
+// start script runs from a stanza handler so events must not be processed
+// here in any case.
 gboolean
 scripts_exec(const char* const script)
 {
@@ -151,17 +157,20 @@ scripts_exec(const char* const script)
     char* line = NULL;
     size_t len = 0;
     ssize_t read;
+    int lines = 0;
+    gint64 started = g_get_monotonic_time();
 
     while ((read = getline(&line, &len, scriptfile)) != -1) {
         ProfWin* win = wins_get_current();
         cmd_process_input(win, line);
-        session_process_events();
-        ui_update();
+        lines++;
     }
 
     fclose(scriptfile);
     if (line)
         free(line);
 
+    log_debug("Script %s ran %d lines in %" G_GINT64_FORMAT " us", script, lines, g_get_monotonic_time() - started);
+
     return TRUE;
 }
@@ -61,11 +61,36 @@ static GKeyFile* theme;
 static GHashTable* bold_items;
 static GHashTable* defaults;
 
+// every item resolved to its attributes once the colours are set up, built
+// again on first use after the colour pair cache is reset
+static int attrs_table[THEME_LAST];
+static gboolean attrs_built = FALSE;
+// counts the colour resets, for callers keeping resolved attributes
+static guint theme_generation = 1;
+
 static void _load_preferences(void);
 static void _theme_list_dir(const gchar* const dir, GSList** result);
 static GString* _theme_find(const char* const theme_name);
 static gboolean _theme_load_file(const char* const theme_name);
 
+static int _theme_resolve_attrs(theme_item_t attrs);
+
+static void
+_theme_attrs_table_reset(void)
+{
+    attrs_built = FALSE;
+    theme_generation++;
+}
+
+static void
+_theme_attrs_table_build(void)
+{
+    for (int i = 0; i < THEME_LAST; i++) {
+        attrs_table[i] = _theme_resolve_attrs(i);
+    }
+    attrs_built = TRUE;
+}
+
 void
 theme_init(const char* const theme_name)
 {
@@ -76,6 +101,7 @@ theme_init(const char* const theme_name)
             log_error("Theme initialisation failed.");
         }
     }
+    _theme_attrs_table_reset();
 
     defaults = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
 
@@ -185,6 +211,7 @@ gboolean
 theme_load(const char* const theme_name, gboolean load_theme_prefs)
 {
     color_pair_cache_reset();
+    _theme_attrs_table_reset();
 
     if (_theme_load_file(theme_name)) {
         if (load_theme_prefs) {
@@ -265,6 +292,7 @@ theme_close(void)
         g_hash_table_destroy(defaults);
         defaults = NULL;
     }
+    _theme_attrs_table_reset();
 }
 
 void
@@ -272,6 +300,8 @@ theme_init_colours(void)
 {
     assume_default_colors(-1, -1);
     color_pair_cache_reset();
+    theme_generation++;
+    _theme_attrs_table_build();
 }
 
 static void
@@ -563,76 +593,64 @@ _theme_find(const char* const theme_name)
     return path;
 }
 
-theme_item_t
-theme_roster_unread_presence_attrs(const char* const presence)
+// index into the presence item tables below
+static int
+_theme_presence_index(const char* const presence)
 {
     if (g_strcmp0(presence, "online") == 0) {
-        return THEME_ROSTER_ONLINE_UNREAD;
+        return 0;
     } else if (g_strcmp0(presence, "away") == 0) {
-        return THEME_ROSTER_AWAY_UNREAD;
+        return 1;
     } else if (g_strcmp0(presence, "chat") == 0) {
-        return THEME_ROSTER_CHAT_UNREAD;
+        return 2;
     } else if (g_strcmp0(presence, "dnd") == 0) {
-        return THEME_ROSTER_DND_UNREAD;
+        return 3;
     } else if (g_strcmp0(presence, "xa") == 0) {
-        return THEME_ROSTER_XA_UNREAD;
+        return 4;
     } else {
-        return THEME_ROSTER_OFFLINE_UNREAD;
+        return 5;
     }
 }
 
+static const theme_item_t roster_unread_presence_items[] = {
+    THEME_ROSTER_ONLINE_UNREAD, THEME_ROSTER_AWAY_UNREAD, THEME_ROSTER_CHAT_UNREAD,
+    THEME_ROSTER_DND_UNREAD, THEME_ROSTER_XA_UNREAD, THEME_ROSTER_OFFLINE_UNREAD
+};
+static const theme_item_t roster_active_presence_items[] = {
+    THEME_ROSTER_ONLINE_ACTIVE, THEME_ROSTER_AWAY_ACTIVE, THEME_ROSTER_CHAT_ACTIVE,
+    THEME_ROSTER_DND_ACTIVE, THEME_ROSTER_XA_ACTIVE, THEME_ROSTER_OFFLINE_ACTIVE
+};
+static const theme_item_t roster_presence_items[] = {
+    THEME_ROSTER_ONLINE, THEME_ROSTER_AWAY, THEME_ROSTER_CHAT,
+    THEME_ROSTER_DND, THEME_ROSTER_XA, THEME_ROSTER_OFFLINE
+};
+static const theme_item_t main_presence_items[] = {
+    THEME_ONLINE, THEME_AWAY, THEME_CHAT,
+    THEME_DND, THEME_XA, THEME_OFFLINE
+};
+
+theme_item_t
+theme_roster_unread_presence_attrs(const char* const presence)
+{
+    return roster_unread_presence_items[_theme_presence_index(presence)];
+}
+
 theme_item_t
 theme_roster_active_presence_attrs(const char* const presence)
 {
-    if (g_strcmp0(presence, "online") == 0) {
-        return THEME_ROSTER_ONLINE_ACTIVE;
-    } else if (g_strcmp0(presence, "away") == 0) {
-        return THEME_ROSTER_AWAY_ACTIVE;
-    } else if (g_strcmp0(presence, "chat") == 0) {
-        return THEME_ROSTER_CHAT_ACTIVE;
-    } else if (g_strcmp0(presence, "dnd") == 0) {
-        return THEME_ROSTER_DND_ACTIVE;
-    } else if (g_strcmp0(presence, "xa") == 0) {
-        return THEME_ROSTER_XA_ACTIVE;
-    } else {
-        return THEME_ROSTER_OFFLINE_ACTIVE;
-    }
+    return roster_active_presence_items[_theme_presence_index(presence)];
 }
 
 theme_item_t
 theme_roster_presence_attrs(const char* const presence)
 {
-    if (g_strcmp0(presence, "online") == 0) {
-        return THEME_ROSTER_ONLINE;
-    } else if (g_strcmp0(presence, "away") == 0) {
-        return THEME_ROSTER_AWAY;
-    } else if (g_strcmp0(presence, "chat") == 0) {
-        return THEME_ROSTER_CHAT;
-    } else if (g_strcmp0(presence, "dnd") == 0) {
-        return THEME_ROSTER_DND;
-    } else if (g_strcmp0(presence, "xa") == 0) {
-        return THEME_ROSTER_XA;
-    } else {
-        return THEME_ROSTER_OFFLINE;
-    }
+    return roster_presence_items[_theme_presence_index(presence)];
 }
 
 theme_item_t
 theme_main_presence_attrs(const char* const presence)
 {
-    if (g_strcmp0(presence, "online") == 0) {
-        return THEME_ONLINE;
-    } else if (g_strcmp0(presence, "away") == 0) {
-        return THEME_AWAY;
-    } else if (g_strcmp0(presence, "chat") == 0) {
-        return THEME_CHAT;
-    } else if (g_strcmp0(presence, "dnd") == 0) {
-        return THEME_DND;
-    } else if (g_strcmp0(presence, "xa") == 0) {
-        return THEME_XA;
-    } else {
-        return THEME_OFFLINE;
-    }
+    return main_presence_items[_theme_presence_index(presence)];
 }
 
 static void
@@ -698,18 +716,23 @@ theme_free_string(char* str)
     }
 }
 
+guint
+theme_get_generation(void)
+{
+    return theme_generation;
+}
+
 int
 theme_hash_attrs(const char* str)
 {
     color_profile profile = COLOR_PROFILE_DEFAULT;
 
-    char* color_pref = prefs_get_string(PREF_COLOR_NICK);
-    if (strcmp(color_pref, "redgreen") == 0) {
+    const gchar* color_pref = prefs_peek_string(PREF_COLOR_NICK);
+    if (g_strcmp0(color_pref, "redgreen") == 0) {
         profile = COLOR_PROFILE_REDGREEN_BLINDNESS;
-    } else if (strcmp(color_pref, "blue") == 0) {
+    } else if (g_strcmp0(color_pref, "blue") == 0) {
         profile = COLOR_PROFILE_BLUE_BLINDNESS;
     }
-    g_free(color_pref);
 
     return COLOR_PAIR(color_pair_cache_hash_str(str, profile));
 }
@@ -717,6 +740,19 @@ theme_hash_attrs(const char* str)
 /* returns the colours (fgnd and bknd) for a certain attribute ie main.text */
 int
 theme_attrs(theme_item_t attrs)
+{
+    if (!attrs_built) {
+        _theme_attrs_table_build();
+    }
+    if (attrs < THEME_LAST) {
+        return attrs_table[attrs];
+    }
+
+    return _theme_resolve_attrs(attrs);
+}
+
+static int
+_theme_resolve_attrs(theme_item_t attrs)
 {
     int result = 0;
 
@@ -1079,9 +1115,10 @@ theme_attrs(theme_item_t attrs)
 
     g_string_free(lookup_str, TRUE);
 
+    int attr = COLOR_PAIR(result);
     if (bold) {
-        return COLOR_PAIR(result) | A_BOLD;
-    } else {
-        return COLOR_PAIR(result);
+        attr |= A_BOLD;
     }
+
+    return attr;
 }
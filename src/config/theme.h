@@ -141,6 +141,8 @@ typedef enum {
     THEME_TEXT_HISTORY,
     THEME_CMD_WINS_UNREAD,
     THEME_TRACKBAR,
+    // not an item, keep last
+    THEME_LAST
 } theme_item_t;
 
 void theme_init(const char* const theme_name);
@@ -151,6 +153,7 @@ GSList* theme_list(void);
 void theme_close(void);
 int theme_hash_attrs(const char* str);
 int theme_attrs(theme_item_t attrs);
+guint theme_get_generation(void);
 char* theme_get_string(char* str);
 void theme_free_string(char* str);
 theme_item_t theme_main_presence_attrs(const char* const presence);
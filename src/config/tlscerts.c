@@ -44,6 +44,7 @@
 #include "log.h"
 #include "common.h"
 #include "config/files.h"
+#include "config/persist.h"
 #include "config/tlscerts.h"
 #include "tools/autocomplete.h"
 
@@ -51,6 +52,7 @@ static char* tlscerts_loc;
 static GKeyFile* tlscerts;
 
 static void _save_tlscerts(void);
+static void _tlscerts_write(void);
 
 static Autocomplete certs_ac;
 
@@ -419,6 +421,7 @@ tlscerts_free(TLSCertificate* cert)
 void
 tlscerts_close(void)
 {
+    persist_flush(_tlscerts_write);
     g_key_file_free(tlscerts);
     tlscerts = NULL;
 
@@ -430,6 +433,12 @@ tlscerts_close(void)
 
 static void
 _save_tlscerts(void)
+{
+    persist_request("tlscerts", _tlscerts_write);
+}
+
+static void
+_tlscerts_write(void)
 {
     gsize g_data_size;
     gchar* g_tlscerts_data = g_key_file_to_data(tlscerts, &g_data_size, NULL);
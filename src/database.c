@@ -38,20 +38,200 @@
 #include <sys/stat.h>
 #include <sqlite3.h>
 #include <glib.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include "log.h"
+#include "database.h"
 #include "common.h"
 #include "config/files.h"
+#include "config/preferences.h"
+#include "tools/chatlog_import.h"
+#include "tools/dedupe.h"
+#include "tools/logcompress.h"
+#include "tools/perf.h"
+#include "tools/timefmt.h"
+
+// maximum number of queued messages written in one transaction
+#define DB_WRITER_BATCH_SIZE 500
+// messages indexed for search per backfill step while the writer is idle
+#define DB_SEARCH_BACKFILL_CHUNK 5000
+
+// in fast mode the write ahead log is checkpointed once the writer was idle this long
+#define DB_CHECKPOINT_IDLE_SEC 2
+
+// messages deleted per step once they are older than /logging db retain
+#define DB_PRUNE_CHUNK 2000
+// gives up to 1000 free pages back to the file system per step
+#define DB_VACUUM_STEP "PRAGMA incremental_vacuum(1000)"
+
+// imported messages waiting for the writer before the log parsers pause
+#define DB_IMPORT_QUEUE_MAX 10000
+// imported messages written in one transaction
+#define DB_IMPORT_BATCH_SIZE 5000
+
+// current schema version stored in `DbVersion`
+#define DB_VERSION 5
 
 static sqlite3* g_chatlog_database;
 
+// statements prepared once and reused with bound parameters
+typedef enum {
+    DB_STMT_INSERT,
+    DB_STMT_PREVIOUS_CHAT,
+    DB_STMT_PREVIOUS_CHAT_BEFORE,
+    DB_STMT_RECENT_CHAT,
+    DB_STMT_LAST_ARCHIVED,
+    DB_STMT_LAST_MUC,
+    DB_STMT_PREVIOUS_MUC,
+    DB_STMT_RECENT_ARCHIVE_IDS,
+    DB_STMT_SEARCH,
+    DB_STMT_SEARCH_BACKFILL,
+    DB_STMT_SEARCH_BACKFILL_PROGRESS,
+    DB_STMT_PRUNE,
+    DB_STMT_IMPORT,
+    DB_STMT_IMPORT_DONE,
+    DB_STMT_LAST
+} db_stmt_t;
+
+static sqlite3_stmt* db_stmts[DB_STMT_LAST];
+
+static const char* const db_stmt_sql[DB_STMT_LAST] = {
+    [DB_STMT_INSERT] = "INSERT INTO `ChatLogs` (`from_jid`, `from_resource`, `to_jid`, `to_resource`, `message`, `timestamp`, `stanza_id`, `archive_id`, `replace_id`, `type`, `encryption`) SELECT ?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11 WHERE NOT EXISTS (SELECT 1 FROM `ChatLogs` WHERE `archive_id` = ?8 AND `archive_id` != '')",
+    [DB_STMT_PREVIOUS_CHAT] = "SELECT * FROM (SELECT `message`, `timestamp`, `from_jid`, `type`, `id` from `ChatLogsHistory` WHERE (`from_jid` = ?1 AND `to_jid` = ?2) OR (`from_jid` = ?2 AND `to_jid` = ?1) ORDER BY `timestamp` DESC, `id` DESC LIMIT ?3) ORDER BY `timestamp` ASC, `id` ASC",
+    [DB_STMT_PREVIOUS_CHAT_BEFORE] = "SELECT * FROM (SELECT `message`, `timestamp`, `from_jid`, `type`, `id` from `ChatLogsHistory` WHERE ((`from_jid` = ?1 AND `to_jid` = ?2) OR (`from_jid` = ?2 AND `to_jid` = ?1)) AND (`timestamp` < ?4 OR (`timestamp` = ?4 AND `id` < ?5)) ORDER BY `timestamp` DESC, `id` DESC LIMIT ?3) ORDER BY `timestamp` ASC, `id` ASC",
+    // DB_STMT_PREVIOUS_CHAT for the writer thread, which must not share a statement with the main thread
+    [DB_STMT_RECENT_CHAT] = "SELECT * FROM (SELECT `message`, `timestamp`, `from_jid`, `type`, `id` from `ChatLogsHistory` WHERE (`from_jid` = ?1 AND `to_jid` = ?2) OR (`from_jid` = ?2 AND `to_jid` = ?1) ORDER BY `timestamp` DESC, `id` DESC LIMIT ?3) ORDER BY `timestamp` ASC, `id` ASC",
+    [DB_STMT_LAST_ARCHIVED] = "SELECT `archive_id`, `timestamp` FROM `ChatLogs` WHERE `archive_id` != '' AND `type` != 'muc' ORDER BY `timestamp` DESC, `id` DESC LIMIT 1",
+    [DB_STMT_LAST_MUC] = "SELECT `timestamp` FROM `ChatLogs` WHERE `from_jid` = ?1 AND `type` = 'muc' ORDER BY `timestamp` DESC, `id` DESC LIMIT 1",
+    [DB_STMT_PREVIOUS_MUC] = "SELECT * FROM (SELECT `message`, `timestamp`, `from_jid`, `from_resource`, `id` FROM `ChatLogsHistory` WHERE `type` = 'muc' AND (`from_jid` = ?1 OR `to_jid` = ?1) ORDER BY `timestamp` DESC, `id` DESC LIMIT ?2) ORDER BY `timestamp` ASC, `id` ASC",
+    [DB_STMT_RECENT_ARCHIVE_IDS] = "SELECT `archive_id` FROM (SELECT `archive_id`, `id` FROM `ChatLogs` WHERE `archive_id` != '' ORDER BY `id` DESC LIMIT ?1) ORDER BY `id` ASC",
+    [DB_STMT_SEARCH] = "SELECT `ChatLogs`.`id`, `from_jid`, `from_resource`, `to_jid`, `ChatLogs`.`message`, `timestamp`, `type` FROM `ChatLogsSearch` JOIN `ChatLogs` ON `ChatLogs`.`id` = `ChatLogsSearch`.`rowid` WHERE `ChatLogsSearch` MATCH ?1 AND `ChatLogsSearch`.`rowid` < ?2 AND (?3 IS NULL OR `from_jid` = ?3 OR `to_jid` = ?3) AND (?4 IS NULL OR `timestamp` >= ?4) AND (?5 IS NULL OR `timestamp` < ?5) ORDER BY `ChatLogsSearch`.`rowid` DESC LIMIT ?6",
+    [DB_STMT_SEARCH_BACKFILL] = "INSERT INTO `ChatLogsSearch` (`rowid`, `message`) SELECT `id`, `message` FROM `ChatLogs` WHERE `id` <= ?1 AND `id` > ?2",
+    [DB_STMT_SEARCH_BACKFILL_PROGRESS] = "UPDATE `SearchBackfill` SET `next_id` = ?1",
+    [DB_STMT_PRUNE] = "DELETE FROM `ChatLogs` WHERE `id` IN (SELECT `id` FROM `ChatLogs` WHERE `timestamp` < ?1 LIMIT ?2)",
+    [DB_STMT_IMPORT] = "INSERT INTO `ChatLogs` (`from_jid`, `from_resource`, `to_jid`, `to_resource`, `message`, `timestamp`, `stanza_id`, `archive_id`, `replace_id`, `type`, `encryption`) SELECT ?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11 WHERE NOT EXISTS (SELECT 1 FROM `ChatLogs` WHERE `from_jid` = ?1 AND `to_jid` = ?3 AND `timestamp` = ?6 AND `message` = ?5)",
+    [DB_STMT_IMPORT_DONE] = "INSERT OR IGNORE INTO `LegacyImport` (`path`) VALUES (?1)",
+};
+
+// a history read queued behind the messages written before it was asked for
+typedef struct db_read_t
+{
+    gchar* contact_barejid;
+    gchar* my_barejid;
+    int count;
+    log_database_history_cb callback;
+    void* userdata;
+    GDestroyNotify free_userdata;
+    // the answer, filled in by the writer thread
+    GSList* history;
+    gchar* cursor_time;
+    gint64 cursor_id;
+} DbRead;
+
+// a copy of everything _add_to_db() needs, owned by the writer queue
+typedef struct db_entry_t
+{
+    gchar* from_jid;
+    gchar* from_resource;
+    gchar* to_jid;
+    gchar* to_resource;
+    gchar* message;
+    gchar* timestamp;
+    gchar* stanza_id;
+    gchar* archive_id;
+    gchar* replace_id;
+    const char* type;
+    const char* enc;
+    // from the text chat logs, skipped when the same message is stored already
+    gboolean imported;
+    // set on the entry that ends an imported log file, nothing else is written then
+    gchar* import_done;
+    // set on a history read, nothing is written then
+    DbRead* read;
+} DbEntry;
+
+// a /logging db import run
+typedef struct db_import_t
+{
+    pthread_t thread;
+    gchar* login;
+    gchar* dir;
+    // only what is older than the history the database had before the
+    // first import is taken, NULL for an empty database
+    GDateTime* before;
+    gint cancel;
+    // guarded by db_queue_lock
+    gint files_total;
+    gint64 started;
+    gint64 finished;
+} DbImport;
+
+static pthread_t db_writer;
+static gboolean db_writer_running = FALSE;
+static gboolean db_writer_busy = FALSE;
+static GQueue* db_queue = NULL;
+// entries at the head of db_queue the writer may take, the rest wait for a bulk commit
+static guint db_queue_ready = 0;
+static int db_bulk_depth = 0;
+static pthread_mutex_t db_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t db_queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t db_idle_cond = PTHREAD_COND_INITIALIZER;
+
+// FALSE when the SQLite library lacks FTS5
+// answered history reads waiting for log_database_reads_check(), guarded by
+// db_queue_lock. The count lets the main loop skip the lock when there are none.
+static GQueue db_reads_done = G_QUEUE_INIT;
+static gint db_reads_answered = 0;
+
+static gboolean db_search_available = FALSE;
+// messages stored before the search index existed are indexed newest first,
+// ids up to db_search_backfill_next are still missing. Guarded by db_queue_lock.
+static gint64 db_search_backfill_next = 0;
+static gint64 db_search_backfill_top = 0;
+
+// set by /logging db mode fast when the database was opened
+static gboolean db_fast = FALSE;
+// written since the last checkpoint, guarded by db_queue_lock
+static gboolean db_checkpoint_pending = FALSE;
+// messages older than this are deleted and the space reclaimed while the
+// writer is idle, NULL once done. Guarded by db_queue_lock.
+static gchar* db_prune_before = NULL;
+static gboolean db_vacuum_pending = FALSE;
+// the last import, its thread is joined by the next one or on close
+static DbImport* db_import = NULL;
+// guarded by db_queue_lock, the import holds back while a flush waits
+static gboolean db_import_running = FALSE;
+static guint db_flush_waiting = 0;
+// counted by the writer as it commits, updated atomically
+static gint db_import_files_done = 0;
+static gint db_import_messages = 0;
+
 static void _add_to_db(ProfMessage* message, char* type, const Jid* const from_jid, const Jid* const to_jid);
+static void _load_recent_archive_ids(void);
+static void _write_entry(DbEntry* entry);
+static void _free_entry(DbEntry* entry);
+static GSList* _get_previous_chat(db_stmt_t stmt_type, const gchar* const contact_barejid, const gchar* const my_barejid, char** cursor_time, gint64* cursor_id, int count);
+static void _read_answer(DbRead* read);
+static void _read_free(DbRead* read);
+static void* _db_writer_thread(void* data);
+static void _apply_mode(void);
+static void _search_init(void);
+static void _search_backfill_step(void);
+static gboolean _maintenance_pending(void);
+static void _maintenance_step(void);
+static void _import_stop(void);
+static void _import_file_done(DbEntry* entry);
+static gchar* _search_expression(const char* const words);
+static sqlite3_stmt* _get_stmt(db_stmt_t stmt);
+static gboolean _migrate(void);
 static char* _get_db_filename(ProfAccount* account);
 static prof_msg_type_t _get_message_type_type(const char* const type);
+static gint64 _db_time(const char* const date);
 
 static char*
 _get_db_filename(ProfAccount* account)
@@ -79,6 +259,14 @@ _get_db_filename(ProfAccount* account)
     return result;
 }
 
+// a failed init leaves no handle behind for the next one
+static void
+_close_database(void)
+{
+    sqlite3_close(g_chatlog_database);
+    g_chatlog_database = NULL;
+}
+
 gboolean
 log_database_init(ProfAccount* account)
 {
@@ -93,14 +281,20 @@ log_database_init(ProfAccount* account)
         return FALSE;
     }
 
-    ret = sqlite3_open(filename, &g_chatlog_database);
+    // the writer thread shares the connection with the main thread
+    ret = sqlite3_open_v2(filename, &g_chatlog_database, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL);
     if (ret != SQLITE_OK) {
         const char* err_msg = sqlite3_errmsg(g_chatlog_database);
         log_error("Error opening SQLite database: %s", err_msg);
+        _close_database();
         free(filename);
         return FALSE;
     }
 
+    _apply_mode();
+    // only takes effect on a new database, before its first table
+    sqlite3_exec(g_chatlog_database, "PRAGMA auto_vacuum=INCREMENTAL", NULL, 0, NULL);
+
     char* err_msg;
     // id is the ID of DB the entry
     // from_jid is the senders jid
@@ -115,6 +309,7 @@ log_database_init(ProfAccount* account)
     // replace_id is the ID from XEP-0308: Last Message Correction
     // encryption is to distinguish: none, omemo, otr, pgp
     // marked_read is 0/1 whether a message has been marked as read via XEP-0333: Chat Markers
+    // original_id and corrected_by link corrections and the message they correct, added by _migrate_to_v5()
     char* query = "CREATE TABLE IF NOT EXISTS `ChatLogs` ( `id` INTEGER PRIMARY KEY AUTOINCREMENT, `from_jid` TEXT NOT NULL, `to_jid` TEXT NOT NULL, `from_resource` TEXT, `to_resource` TEXT, `message` TEXT, `timestamp` TEXT, `type` TEXT, `stanza_id` TEXT, `archive_id` TEXT, `replace_id` TEXT, `encryption` TEXT, `marked_read` INTEGER)";
     if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
         goto out;
@@ -130,6 +325,23 @@ log_database_init(ProfAccount* account)
         goto out;
     }
 
+    if (!_migrate()) {
+        _close_database();
+        free(filename);
+        return FALSE;
+    }
+
+    _load_recent_archive_ids();
+    _search_init();
+
+    db_queue = g_queue_new();
+    log_database_maintain();
+    db_writer_running = TRUE;
+    if (pthread_create(&db_writer, NULL, _db_writer_thread, NULL) != 0) {
+        log_error("Unable to start database writer thread, writing synchronously");
+        db_writer_running = FALSE;
+    }
+
     log_debug("Initialized SQLite database: %s", filename);
     free(filename);
     return TRUE;
@@ -141,13 +353,133 @@ out:
     } else {
         log_error("Unknown SQLite error");
     }
+    _close_database();
     free(filename);
     return FALSE;
 }
 
+void
+log_database_flush(void)
+{
+    pthread_mutex_lock(&db_queue_lock);
+    if (db_queue) {
+        db_queue_ready = g_queue_get_length(db_queue);
+        pthread_cond_signal(&db_queue_cond);
+    }
+    db_flush_waiting++;
+    while (db_writer_running && (!g_queue_is_empty(db_queue) || db_writer_busy)) {
+        pthread_cond_wait(&db_idle_cond, &db_queue_lock);
+    }
+    db_flush_waiting--;
+    if (db_flush_waiting == 0) {
+        pthread_cond_broadcast(&db_idle_cond);
+    }
+    pthread_mutex_unlock(&db_queue_lock);
+}
+
+guint
+log_database_queue_depth(void)
+{
+    guint depth = 0;
+
+    pthread_mutex_lock(&db_queue_lock);
+    if (db_queue) {
+        depth = g_queue_get_length(db_queue);
+    }
+    pthread_mutex_unlock(&db_queue_lock);
+
+    return depth;
+}
+
+// while in bulk mode queued messages are held back until
+// log_database_bulk_commit(), which writes them in one transaction
+void
+log_database_bulk_begin(void)
+{
+    pthread_mutex_lock(&db_queue_lock);
+    db_bulk_depth++;
+    pthread_mutex_unlock(&db_queue_lock);
+}
+
+void
+log_database_bulk_commit(void)
+{
+    pthread_mutex_lock(&db_queue_lock);
+    if (db_queue) {
+        db_queue_ready = g_queue_get_length(db_queue);
+        pthread_cond_signal(&db_queue_cond);
+    }
+    pthread_mutex_unlock(&db_queue_lock);
+}
+
+void
+log_database_bulk_end(void)
+{
+    pthread_mutex_lock(&db_queue_lock);
+    if (db_bulk_depth > 0) {
+        db_bulk_depth--;
+    }
+    pthread_mutex_unlock(&db_queue_lock);
+
+    log_database_bulk_commit();
+}
+
+// Heap held by SQLite for every database of the process, its page caches
+// mostly
+gsize
+log_database_memory(void)
+{
+    return (gsize)sqlite3_memory_used();
+}
+
+// Gives back the page cache pages not in use, they are read again as needed
+void
+log_database_trim(void)
+{
+    if (g_chatlog_database) {
+        sqlite3_db_release_memory(g_chatlog_database);
+    }
+}
+
 void
 log_database_close(void)
 {
+    _import_stop();
+
+    if (db_writer_running) {
+        // the writer drains the queue before exiting
+        pthread_mutex_lock(&db_queue_lock);
+        db_writer_running = FALSE;
+        pthread_cond_signal(&db_queue_cond);
+        pthread_mutex_unlock(&db_queue_lock);
+        pthread_join(db_writer, NULL);
+    }
+    // windows waiting for their history get what was read
+    log_database_reads_check();
+
+    if (db_queue) {
+        g_queue_free_full(db_queue, (GDestroyNotify)_free_entry);
+        db_queue = NULL;
+    }
+    db_queue_ready = 0;
+    db_bulk_depth = 0;
+    db_search_available = FALSE;
+    db_search_backfill_next = 0;
+    db_search_backfill_top = 0;
+    db_checkpoint_pending = FALSE;
+    g_free(db_prune_before);
+    db_prune_before = NULL;
+    db_vacuum_pending = FALSE;
+
+    dedupe_close();
+
+    for (int i = 0; i < DB_STMT_LAST; i++) {
+        if (db_stmts[i]) {
+            sqlite3_finalize(db_stmts[i]);
+            db_stmts[i] = NULL;
+        }
+    }
+
     if (g_chatlog_database) {
         sqlite3_close(g_chatlog_database);
         sqlite3_shutdown();
@@ -178,7 +510,7 @@ _log_database_add_outgoing(char* type, const char* const id, const char* const b
     msg->from_jid = jid_create(barejid);
     msg->plain = message ? strdup(message) : NULL;
     msg->replace_id = replace_id ? strdup(replace_id) : NULL;
-    msg->timestamp = g_date_time_new_now_local(); // TODO: get from outside. best to have whole ProfMessage from outside
+    msg->timestamp = g_get_real_time(); // TODO: get from outside. best to have whole ProfMessage from outside
     msg->enc = enc;
 
     Jid* myjid = jid_create(connection_get_fulljid());
@@ -207,31 +539,115 @@ log_database_add_outgoing_muc_pm(const char* const id, const char* const barejid
     _log_database_add_outgoing("mucpm", id, barejid, message, replace_id, enc);
 }
 
+// Fetch up to count messages of the conversation older than the (cursor_time, cursor_id)
+// position, oldest first. A NULL *cursor_time starts at the newest message.
+// The cursor is moved to the oldest message returned.
 GSList*
-log_database_get_previous_chat(const gchar* const contact_barejid)
+log_database_get_previous_chat(const gchar* const contact_barejid, char** cursor_time, gint64* cursor_id, int count)
 {
-    sqlite3_stmt* stmt = NULL;
-    gchar* query;
     const char* jid = connection_get_fulljid();
     Jid* myjid = jid_create(jid);
     if (!myjid)
         return NULL;
 
-    query = sqlite3_mprintf("SELECT * FROM (SELECT `message`, `timestamp`, `from_jid`, `type` from `ChatLogs` WHERE (`from_jid` = '%q' AND `to_jid` = '%q') OR (`from_jid` = '%q' AND `to_jid` = '%q') ORDER BY `timestamp` DESC LIMIT 10) ORDER BY `timestamp` ASC;", contact_barejid, myjid->barejid, myjid->barejid, contact_barejid);
-    if (!query) {
-        log_error("log_database_get_previous_chat(): SQL query. could not allocate memory");
-        return NULL;
+    // make sure messages still queued for writing are part of the history
+    log_database_flush();
+
+    GSList* history = _get_previous_chat(*cursor_time ? DB_STMT_PREVIOUS_CHAT_BEFORE : DB_STMT_PREVIOUS_CHAT, contact_barejid, myjid->barejid, cursor_time, cursor_id, count);
+    jid_destroy(myjid);
+
+    return history;
+}
+
+// Reads the newest count messages of the conversation on the writer thread,
+// after the messages queued before, so the window opening does not wait on
+// the database. callback runs from log_database_reads_check() with the
+// history oldest first, NULL when there is none. Returns FALSE when the
+// history can not be read, callback is not called then.
+gboolean
+log_database_get_previous_chat_async(const gchar* const contact_barejid, int count, log_database_history_cb callback, void* userdata, GDestroyNotify free_userdata)
+{
+    if (!g_chatlog_database) {
+        return FALSE;
     }
 
+    const char* jid = connection_get_fulljid();
+    Jid* myjid = jid_create(jid);
+    if (!myjid) {
+        return FALSE;
+    }
+
+    DbRead* read = calloc(1, sizeof(DbRead));
+    read->contact_barejid = g_strdup(contact_barejid);
+    read->my_barejid = g_strdup(myjid->barejid);
+    read->count = count;
+    read->callback = callback;
+    read->userdata = userdata;
+    read->free_userdata = free_userdata;
     jid_destroy(myjid);
 
-    int rc = sqlite3_prepare_v2(g_chatlog_database, query, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        log_error("log_database_get_previous_chat(): unknown SQLite error");
+    DbEntry* entry = calloc(1, sizeof(DbEntry));
+    entry->read = read;
+
+    pthread_mutex_lock(&db_queue_lock);
+    if (db_writer_running) {
+        // held back messages are written first, they belong to the history
+        g_queue_push_tail(db_queue, entry);
+        db_queue_ready = g_queue_get_length(db_queue);
+        pthread_cond_signal(&db_queue_cond);
+        pthread_mutex_unlock(&db_queue_lock);
+        return TRUE;
+    }
+    pthread_mutex_unlock(&db_queue_lock);
+
+    // no writer thread available, answered right away
+    _write_entry(entry);
+    _free_entry(entry);
+
+    return TRUE;
+}
+
+// Hands the answered history reads to their callbacks, runs in the main loop
+void
+log_database_reads_check(void)
+{
+    if (g_atomic_int_get(&db_reads_answered) == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&db_queue_lock);
+    GList* answered = db_reads_done.head;
+    g_queue_init(&db_reads_done);
+    g_atomic_int_set(&db_reads_answered, 0);
+    pthread_mutex_unlock(&db_queue_lock);
+
+    for (GList* curr = answered; curr; curr = g_list_next(curr)) {
+        DbRead* read = curr->data;
+        read->callback(read->history, read->cursor_time, read->cursor_id, read->userdata);
+        _read_free(read);
+    }
+    g_list_free(answered);
+}
+
+static GSList*
+_get_previous_chat(db_stmt_t stmt_type, const gchar* const contact_barejid, const gchar* const my_barejid, char** cursor_time, gint64* cursor_id, int count)
+{
+    sqlite3_stmt* stmt = _get_stmt(stmt_type);
+    if (!stmt) {
         return NULL;
     }
 
+    sqlite3_bind_text(stmt, 1, contact_barejid, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, my_barejid, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, count);
+    if (*cursor_time) {
+        sqlite3_bind_text(stmt, 4, *cursor_time, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 5, *cursor_id);
+    }
+
     GSList* history = NULL;
+    char* oldest_time = NULL;
+    gint64 oldest_id = 0;
 
     while (sqlite3_step(stmt) == SQLITE_ROW) {
         // TODO: also save to jid. since now part of profmessage
@@ -240,21 +656,264 @@ log_database_get_previous_chat(const gchar* const contact_barejid)
         char* from = (char*)sqlite3_column_text(stmt, 2);
         char* type = (char*)sqlite3_column_text(stmt, 3);
 
+        // rows come oldest first, so the first one is the new cursor
+        if (!history) {
+            oldest_time = g_strdup(date);
+            oldest_id = sqlite3_column_int64(stmt, 4);
+        }
+
         ProfMessage* msg = message_init();
         msg->from_jid = jid_create(from);
         msg->plain = strdup(message);
-        msg->timestamp = g_date_time_new_from_iso8601(date, NULL);
+        msg->timestamp = _db_time(date);
         msg->type = _get_message_type_type(type);
         // TODO: later we can get more fields like 'enc'. then we can display the history like regular chats with all info the user enabled.
 
-        history = g_slist_append(history, msg);
+        history = g_slist_prepend(history, msg);
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    history = g_slist_reverse(history);
+
+    if (history) {
+        g_free(*cursor_time);
+        *cursor_time = oldest_time;
+        *cursor_id = oldest_id;
     }
-    sqlite3_finalize(stmt);
-    sqlite3_free(query);
 
     return history;
 }
 
+// runs inside the writer's transaction, which sees everything written before
+static void
+_read_answer(DbRead* read)
+{
+    read->history = _get_previous_chat(DB_STMT_RECENT_CHAT, read->contact_barejid, read->my_barejid, &read->cursor_time, &read->cursor_id, read->count);
+
+    pthread_mutex_lock(&db_queue_lock);
+    g_queue_push_tail(&db_reads_done, read);
+    g_atomic_int_inc(&db_reads_answered);
+    pthread_mutex_unlock(&db_queue_lock);
+}
+
+static void
+_read_free(DbRead* read)
+{
+    if (read) {
+        if (read->free_userdata) {
+            read->free_userdata(read->userdata);
+        }
+        g_slist_free_full(read->history, (GDestroyNotify)message_free);
+        g_free(read->cursor_time);
+        g_free(read->contact_barejid);
+        g_free(read->my_barejid);
+        free(read);
+    }
+}
+
+gboolean
+log_database_search_available(void)
+{
+    return db_search_available;
+}
+
+// How much of the history stored before the search index existed is
+// searchable, in percent
+int
+log_database_search_indexed(void)
+{
+    pthread_mutex_lock(&db_queue_lock);
+    gint64 next = db_search_backfill_next;
+    gint64 top = db_search_backfill_top;
+    pthread_mutex_unlock(&db_queue_lock);
+
+    if (next == 0 || top == 0) {
+        return 100;
+    }
+
+    return (int)((top - next) * 100 / top);
+}
+
+// Messages containing all of words, newest first, older than *cursor
+// (G_MAXINT64 for the newest). with restricts to one conversation, after and
+// before to a range of dates (YYYY-MM-DD). The cursor is moved to the oldest
+// message returned, or to 0 when there are no more.
+GSList*
+log_database_search(const char* const words, const char* const with, const char* const after, const char* const before, gint64* cursor, int count)
+{
+    if (!db_search_available) {
+        return NULL;
+    }
+
+    gchar* expr = _search_expression(words);
+    if (!expr) {
+        *cursor = 0;
+        return NULL;
+    }
+
+    // make sure messages still queued for writing are found too
+    log_database_flush();
+
+    sqlite3_stmt* stmt = _get_stmt(DB_STMT_SEARCH);
+    if (!stmt) {
+        g_free(expr);
+        return NULL;
+    }
+
+    sqlite3_bind_text(stmt, 1, expr, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, *cursor);
+    if (with) {
+        sqlite3_bind_text(stmt, 3, with, -1, SQLITE_STATIC);
+    }
+    if (after) {
+        sqlite3_bind_text(stmt, 4, after, -1, SQLITE_STATIC);
+    }
+    if (before) {
+        sqlite3_bind_text(stmt, 5, before, -1, SQLITE_STATIC);
+    }
+    sqlite3_bind_int(stmt, 6, count);
+
+    GSList* results = NULL;
+    int found = 0;
+    int rc;
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* from = (const char*)sqlite3_column_text(stmt, 1);
+        const char* from_resource = (const char*)sqlite3_column_text(stmt, 2);
+        const char* to = (const char*)sqlite3_column_text(stmt, 3);
+        const char* message = (const char*)sqlite3_column_text(stmt, 4);
+        const char* date = (const char*)sqlite3_column_text(stmt, 5);
+        const char* type = (const char*)sqlite3_column_text(stmt, 6);
+
+        *cursor = sqlite3_column_int64(stmt, 0);
+        found++;
+
+        ProfMessage* msg = message_init();
+        if (from_resource && from_resource[0] != '\0') {
+            msg->from_jid = jid_create_from_bare_and_resource(from, from_resource);
+        } else {
+            msg->from_jid = jid_create(from);
+        }
+        msg->to_jid = jid_create(to);
+        msg->plain = strdup(message ? message : "");
+        msg->timestamp = _db_time(date);
+        msg->type = _get_message_type_type(type);
+
+        results = g_slist_prepend(results, msg);
+    }
+    if (rc != SQLITE_DONE) {
+        log_error("SQLite error searching messages: %s", sqlite3_errmsg(g_chatlog_database));
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    g_free(expr);
+
+    if (found < count) {
+        *cursor = 0;
+    }
+
+    return g_slist_reverse(results);
+}
+
+// The newest one to one message that came with a MAM archive id, where a
+// catch-up with the server archive can continue from
+gboolean
+log_database_get_last_archived(char** archive_id, GDateTime** timestamp)
+{
+    log_database_flush();
+
+    sqlite3_stmt* stmt = _get_stmt(DB_STMT_LAST_ARCHIVED);
+    if (!stmt) {
+        return FALSE;
+    }
+
+    gboolean found = FALSE;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* id = (const char*)sqlite3_column_text(stmt, 0);
+        const char* date = (const char*)sqlite3_column_text(stmt, 1);
+        GDateTime* datetime = date ? g_date_time_new_from_iso8601(date, NULL) : NULL;
+        if (id && datetime) {
+            *archive_id = strdup(id);
+            *timestamp = datetime;
+            found = TRUE;
+        } else if (datetime) {
+            g_date_time_unref(datetime);
+        }
+    }
+    sqlite3_reset(stmt);
+
+    return found;
+}
+
+// The newest count messages of the room, oldest first, the ones received
+// come from the occupant's nick and our own from our jid
+GSList*
+log_database_get_previous_muc(const gchar* const room, int count)
+{
+    log_database_flush();
+
+    sqlite3_stmt* stmt = _get_stmt(DB_STMT_PREVIOUS_MUC);
+    if (!stmt) {
+        return NULL;
+    }
+
+    sqlite3_bind_text(stmt, 1, room, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, count);
+
+    GSList* history = NULL;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* message = (const char*)sqlite3_column_text(stmt, 0);
+        const char* date = (const char*)sqlite3_column_text(stmt, 1);
+        const char* from = (const char*)sqlite3_column_text(stmt, 2);
+        const char* from_resource = (const char*)sqlite3_column_text(stmt, 3);
+        gint64 timestamp = _db_time(date);
+        if (!message || !from || !timestamp) {
+            continue;
+        }
+
+        ProfMessage* msg = message_init();
+        if (g_strcmp0(from, room) == 0 && from_resource && from_resource[0] != '\0') {
+            msg->from_jid = jid_create_from_bare_and_resource(from, from_resource);
+        } else {
+            msg->from_jid = jid_create(from);
+        }
+        msg->plain = strdup(message);
+        msg->timestamp = timestamp;
+        msg->type = PROF_MSG_TYPE_MUC;
+
+        history = g_slist_prepend(history, msg);
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    return g_slist_reverse(history);
+}
+
+// The time of the newest message stored from the room, rejoining it asks
+// only for the history since
+GDateTime*
+log_database_get_last_muc(const char* const room)
+{
+    log_database_flush();
+
+    sqlite3_stmt* stmt = _get_stmt(DB_STMT_LAST_MUC);
+    if (!stmt) {
+        return NULL;
+    }
+
+    GDateTime* timestamp = NULL;
+    sqlite3_bind_text(stmt, 1, room, -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* date = (const char*)sqlite3_column_text(stmt, 0);
+        timestamp = date ? g_date_time_new_from_iso8601(date, NULL) : NULL;
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    return timestamp;
+}
+
 static const char*
 _get_message_type_str(prof_msg_type_t type)
 {
@@ -271,6 +930,18 @@ _get_message_type_str(prof_msg_type_t type)
     return NULL;
 }
 
+// The unix time in microseconds of a stored timestamp, 0 when there is none
+static gint64
+_db_time(const char* const date)
+{
+    gint64 time_us = 0;
+    if (!timefmt_parse_stamp(date, &time_us)) {
+        return 0;
+    }
+
+    return time_us;
+}
+
 static prof_msg_type_t
 _get_message_type_type(const char* const type)
 {
@@ -312,48 +983,1028 @@ _add_to_db(ProfMessage* message, char* type, const Jid* const from_jid, const Ji
         return;
     }
 
-    char* err_msg;
-    gchar* query;
-    gchar* date_fmt;
-
-    if (message->timestamp) {
-        date_fmt = g_date_time_format_iso8601(message->timestamp);
-    } else {
-        date_fmt = g_date_time_format_iso8601(g_date_time_new_now_local());
-    }
+    DbEntry* entry = malloc(sizeof(DbEntry));
 
-    const char* enc = _get_message_enc_str(message->enc);
+    char stamp[TIMEFMT_STAMP_MAX];
+    entry->timestamp = g_strdup(timefmt_stamp(message->timestamp ? message->timestamp : g_get_real_time(), stamp, sizeof(stamp)));
 
     if (!type) {
         type = (char*)_get_message_type_str(message->type);
     }
 
-    query = sqlite3_mprintf("INSERT INTO `ChatLogs` (`from_jid`, `from_resource`, `to_jid`, `to_resource`, `message`, `timestamp`, `stanza_id`, `archive_id`, `replace_id`, `type`, `encryption`) SELECT '%q', '%q', '%q', '%q', '%q', '%q', '%q', '%q', '%q', '%q', '%q' WHERE NOT EXISTS (SELECT 1 FROM `ChatLogs` WHERE `archive_id` = '%q' AND `archive_id` != '')",
-                            from_jid->barejid,
-                            from_jid->resourcepart ? from_jid->resourcepart : "",
-                            to_jid->barejid,
-                            to_jid->resourcepart ? to_jid->resourcepart : "",
-                            message->plain ? message->plain : "",
-                            date_fmt ? date_fmt : "",
-                            message->id ? message->id : "",
-                            message->stanzaid ? message->stanzaid : "",
-                            message->replace_id ? message->replace_id : "",
-                            type ? type : "",
-                            enc ? enc : "",
-                            message->stanzaid ? message->stanzaid : "");
-    if (!query) {
-        log_error("log_database_add(): SQL query. could not allocate memory");
-        return;
+    entry->from_jid = g_strdup(from_jid->barejid);
+    entry->from_resource = g_strdup(from_jid->resourcepart ? from_jid->resourcepart : "");
+    entry->to_jid = g_strdup(to_jid->barejid);
+    entry->to_resource = g_strdup(to_jid->resourcepart ? to_jid->resourcepart : "");
+    entry->message = g_strdup(message->plain ? message->plain : "");
+    entry->stanza_id = g_strdup(message->id ? message->id : "");
+    entry->archive_id = g_strdup(message->stanzaid ? message->stanzaid : "");
+    entry->replace_id = g_strdup(message->replace_id ? message->replace_id : "");
+    entry->type = type ? type : "";
+    entry->enc = _get_message_enc_str(message->enc);
+    entry->imported = FALSE;
+    entry->import_done = NULL;
+    entry->read = NULL;
+
+    // written in this session, drop it should it arrive again
+    if (message->stanzaid) {
+        dedupe_add(NULL, message->stanzaid);
     }
-    g_free(date_fmt);
 
-    if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
-        if (err_msg) {
-            log_error("SQLite error: %s", err_msg);
-            sqlite3_free(err_msg);
-        } else {
-            log_error("Unknown SQLite error");
+    pthread_mutex_lock(&db_queue_lock);
+    if (db_writer_running) {
+        g_queue_push_tail(db_queue, entry);
+        if (db_bulk_depth == 0) {
+            db_queue_ready++;
+            pthread_cond_signal(&db_queue_cond);
         }
+        pthread_mutex_unlock(&db_queue_lock);
+        return;
     }
-    sqlite3_free(query);
+    pthread_mutex_unlock(&db_queue_lock);
+
+    // no writer thread available
+    _write_entry(entry);
+    _free_entry(entry);
+}
+
+// the archive ids of the newest messages seed the duplicate filter, so an
+// archive catch-up skips what was stored in an earlier session
+static void
+_load_recent_archive_ids(void)
+{
+    sqlite3_stmt* stmt = _get_stmt(DB_STMT_RECENT_ARCHIVE_IDS);
+    if (!stmt) {
+        return;
+    }
+
+    sqlite3_bind_int(stmt, 1, DEDUPE_MAX_IDS);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        dedupe_add(NULL, (const char*)sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+}
+
+static void
+_write_entry(DbEntry* entry)
+{
+    if (entry->import_done) {
+        _import_file_done(entry);
+        return;
+    }
+    if (entry->read) {
+        _read_answer(entry->read);
+        entry->read = NULL;
+        return;
+    }
+
+    sqlite3_stmt* stmt = _get_stmt(entry->imported ? DB_STMT_IMPORT : DB_STMT_INSERT);
+    if (!stmt) {
+        return;
+    }
+
+    sqlite3_bind_text(stmt, 1, entry->from_jid, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, entry->from_resource, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, entry->to_jid, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, entry->to_resource, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, entry->message, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 6, entry->timestamp ? entry->timestamp : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 7, entry->stanza_id, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 8, entry->archive_id, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 9, entry->replace_id, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 10, entry->type, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 11, entry->enc, -1, SQLITE_STATIC);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        log_error("SQLite error: %s", sqlite3_errmsg(g_chatlog_database));
+    } else if (entry->imported) {
+        g_atomic_int_add(&db_import_messages, sqlite3_changes(g_chatlog_database));
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+}
+
+static void
+_free_entry(DbEntry* entry)
+{
+    if (entry) {
+        g_free(entry->from_jid);
+        g_free(entry->from_resource);
+        g_free(entry->to_jid);
+        g_free(entry->to_resource);
+        g_free(entry->message);
+        g_free(entry->timestamp);
+        g_free(entry->stanza_id);
+        g_free(entry->archive_id);
+        g_free(entry->replace_id);
+        g_free(entry->import_done);
+        _read_free(entry->read);
+        free(entry);
+    }
+}
+
+// The journal settings stay with the connection, WAL mode also stays with
+// the file so safe mode turns it off again
+static void
+_apply_mode(void)
+{
+    db_fast = g_strcmp0(prefs_peek_string(PREF_DB_MODE), "fast") == 0;
+
+    const char* pragmas;
+    if (db_fast) {
+        pragmas = "PRAGMA journal_mode=WAL;"
+                  "PRAGMA synchronous=NORMAL;"
+                  "PRAGMA cache_size=-16384;"
+                  "PRAGMA mmap_size=268435456;"
+                  "PRAGMA temp_store=MEMORY;";
+    } else {
+        pragmas = "PRAGMA journal_mode=DELETE;"
+                  "PRAGMA synchronous=FULL;";
+    }
+
+    char* err_msg = NULL;
+    if (SQLITE_OK != sqlite3_exec(g_chatlog_database, pragmas, NULL, 0, &err_msg)) {
+        log_error("SQLite error setting %s mode: %s", db_fast ? "fast" : "safe", err_msg ? err_msg : "unknown");
+        sqlite3_free(err_msg);
+    }
+}
+
+// Moves the write ahead log into the database without waiting on readers
+static void
+_checkpoint(void)
+{
+    int log_frames = 0;
+    int checkpointed = 0;
+    int ret = sqlite3_wal_checkpoint_v2(g_chatlog_database, NULL, SQLITE_CHECKPOINT_PASSIVE, &log_frames, &checkpointed);
+    if (ret == SQLITE_OK) {
+        log_debug("SQLite checkpoint: %d of %d frames", checkpointed, log_frames);
+    } else {
+        log_warning("SQLite checkpoint failed: %s", sqlite3_errmsg(g_chatlog_database));
+    }
+}
+
+// Waits for work, in fast mode a checkpoint runs once nothing came for a while
+static void
+_db_writer_wait(void)
+{
+    if (!db_checkpoint_pending) {
+        pthread_cond_wait(&db_queue_cond, &db_queue_lock);
+        return;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += DB_CHECKPOINT_IDLE_SEC;
+    if (pthread_cond_timedwait(&db_queue_cond, &db_queue_lock, &deadline) == ETIMEDOUT
+        && db_queue_ready == 0) {
+        db_checkpoint_pending = FALSE;
+        pthread_mutex_unlock(&db_queue_lock);
+        _checkpoint();
+        pthread_mutex_lock(&db_queue_lock);
+    }
+}
+
+// writes queued messages, grouping everything queued so far into one transaction
+static void*
+_db_writer_thread(void* data)
+{
+    // lets SQLite refresh the statistics of tables that changed a lot, off the main thread
+    sqlite3_exec(g_chatlog_database, "PRAGMA optimize=0x10002", NULL, 0, NULL);
+
+    pthread_mutex_lock(&db_queue_lock);
+    while (TRUE) {
+        while (db_writer_running && db_queue_ready == 0 && db_search_backfill_next == 0 && !_maintenance_pending()) {
+            _db_writer_wait();
+        }
+        if (!db_writer_running) {
+            // closing, whatever is still held back is written too
+            db_queue_ready = g_queue_get_length(db_queue);
+            if (db_queue_ready == 0) {
+                break;
+            }
+        }
+        if (db_queue_ready == 0) {
+            // idle, index a piece of the older history. New messages get a
+            // turn between the steps.
+            gboolean backfill = db_search_backfill_next > 0;
+            pthread_mutex_unlock(&db_queue_lock);
+            if (backfill) {
+                _search_backfill_step();
+            } else {
+                _maintenance_step();
+            }
+            pthread_mutex_lock(&db_queue_lock);
+            db_checkpoint_pending = db_fast;
+            continue;
+        }
+
+        GQueue* batch = g_queue_new();
+        guint batch_size = db_import_running ? DB_IMPORT_BATCH_SIZE : DB_WRITER_BATCH_SIZE;
+        while (db_queue_ready > 0 && g_queue_get_length(batch) < batch_size) {
+            g_queue_push_tail(batch, g_queue_pop_head(db_queue));
+            db_queue_ready--;
+        }
+        db_writer_busy = TRUE;
+        pthread_mutex_unlock(&db_queue_lock);
+
+        sqlite3_exec(g_chatlog_database, "BEGIN TRANSACTION", NULL, 0, NULL);
+        DbEntry* entry;
+        while ((entry = g_queue_pop_head(batch)) != NULL) {
+            gint64 started = perf_start();
+            _write_entry(entry);
+            perf_stop(PERF_DATABASE, started);
+            _free_entry(entry);
+        }
+        sqlite3_exec(g_chatlog_database, "COMMIT", NULL, 0, NULL);
+        g_queue_free(batch);
+
+        pthread_mutex_lock(&db_queue_lock);
+        db_writer_busy = FALSE;
+        db_checkpoint_pending = db_fast;
+        // an import waits for room in the queue as well
+        if (g_queue_is_empty(db_queue) || db_import_running) {
+            pthread_cond_broadcast(&db_idle_cond);
+        }
+    }
+    db_writer_busy = FALSE;
+    pthread_cond_broadcast(&db_idle_cond);
+    pthread_mutex_unlock(&db_queue_lock);
+
+    return NULL;
+}
+
+static sqlite3_stmt*
+_get_stmt(db_stmt_t stmt)
+{
+    if (db_stmts[stmt] == NULL) {
+        int rc = sqlite3_prepare_v3(g_chatlog_database, db_stmt_sql[stmt], -1, SQLITE_PREPARE_PERSISTENT, &db_stmts[stmt], NULL);
+        if (rc != SQLITE_OK) {
+            log_error("SQLite error preparing statement: %s", sqlite3_errmsg(g_chatlog_database));
+            db_stmts[stmt] = NULL;
+        }
+    }
+
+    return db_stmts[stmt];
+}
+
+// whether the migration to version was applied, a failed one is retried
+// while the later ones are applied already
+static gboolean
+_has_db_version(int version)
+{
+    gboolean found = FALSE;
+    sqlite3_stmt* stmt = NULL;
+
+    if (sqlite3_prepare_v2(g_chatlog_database, "SELECT 1 FROM `DbVersion` WHERE `version` = ?1", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, version);
+        found = sqlite3_step(stmt) == SQLITE_ROW;
+    }
+    sqlite3_finalize(stmt);
+
+    return found;
+}
+
+static int
+_get_db_version(void)
+{
+    int version = 0;
+    sqlite3_stmt* stmt = NULL;
+
+    if (sqlite3_prepare_v2(g_chatlog_database, "SELECT MAX(`version`) FROM `DbVersion`", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    return version;
+}
+
+// version 3: full text search index over the messages, kept up to date by a
+// trigger. What was stored before is indexed in the background, see
+// _search_backfill_step().
+static gboolean
+_migrate_to_v3(void)
+{
+    char* err_msg = NULL;
+    const char* query = "BEGIN TRANSACTION;"
+                        "CREATE VIRTUAL TABLE IF NOT EXISTS `ChatLogsSearch` USING fts5(`message`, content='ChatLogs', content_rowid='id', tokenize='unicode61 remove_diacritics 2');"
+                        "CREATE TRIGGER IF NOT EXISTS `ChatLogs_search_insert` AFTER INSERT ON `ChatLogs` BEGIN INSERT INTO `ChatLogsSearch` (`rowid`, `message`) VALUES (new.`id`, new.`message`); END;"
+                        "CREATE TABLE IF NOT EXISTS `SearchBackfill` ( `next_id` INTEGER NOT NULL, `top_id` INTEGER NOT NULL);"
+                        "INSERT INTO `SearchBackfill` (`next_id`, `top_id`) SELECT IFNULL(MAX(`id`), 0), IFNULL(MAX(`id`), 0) FROM `ChatLogs`;"
+                        "INSERT OR IGNORE INTO `DbVersion` (`version`) VALUES('3');"
+                        "COMMIT;";
+
+    if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
+        log_error("SQLite error migrating database to version 3: %s", err_msg ? err_msg : "unknown");
+        sqlite3_free(err_msg);
+        sqlite3_exec(g_chatlog_database, "ROLLBACK", NULL, 0, NULL);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// version 4: a timestamp index for retention, and deleted messages leave the
+// search index. Only rows the backfill already indexed are in there.
+static gboolean
+_migrate_to_v4(void)
+{
+    char* err_msg = NULL;
+    const char* query = "BEGIN TRANSACTION;"
+                        "CREATE INDEX IF NOT EXISTS `ChatLogs_timestamp` ON `ChatLogs` (`timestamp`);"
+                        "CREATE TRIGGER IF NOT EXISTS `ChatLogs_search_delete` AFTER DELETE ON `ChatLogs` WHEN old.`id` > (SELECT `next_id` FROM `SearchBackfill`) BEGIN INSERT INTO `ChatLogsSearch` (`ChatLogsSearch`, `rowid`, `message`) VALUES ('delete', old.`id`, old.`message`); END;"
+                        "INSERT OR IGNORE INTO `DbVersion` (`version`) VALUES('4');"
+                        "COMMIT;";
+
+    if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
+        log_error("SQLite error migrating database to version 4: %s", err_msg ? err_msg : "unknown");
+        sqlite3_free(err_msg);
+        sqlite3_exec(g_chatlog_database, "ROLLBACK", NULL, 0, NULL);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// version 5: a correction points at the message it corrects, that one at its
+// latest correction. `ChatLogsHistory` has each message once, at its place
+// and with its latest text. A correction of a correction counts for the
+// first message, the sender has to be the same.
+static gboolean
+_migrate_to_v5(void)
+{
+    char* err_msg = NULL;
+    const char* query = "BEGIN TRANSACTION;"
+                        "ALTER TABLE `ChatLogs` ADD COLUMN `original_id` INTEGER;"
+                        "ALTER TABLE `ChatLogs` ADD COLUMN `corrected_by` INTEGER;"
+                        "CREATE INDEX IF NOT EXISTS `ChatLogs_stanza_id` ON `ChatLogs` (`stanza_id`);"
+                        "CREATE INDEX IF NOT EXISTS `ChatLogs_original_id` ON `ChatLogs` (`original_id`) WHERE `original_id` IS NOT NULL;"
+                        "CREATE TRIGGER IF NOT EXISTS `ChatLogs_correction_insert` AFTER INSERT ON `ChatLogs` WHEN new.`replace_id` != '' BEGIN "
+                        "UPDATE `ChatLogs` SET `original_id` = (SELECT IFNULL(`corrected`.`original_id`, `corrected`.`id`) FROM `ChatLogs` AS `corrected` WHERE `corrected`.`stanza_id` = new.`replace_id` AND `corrected`.`from_jid` = new.`from_jid` AND (new.`type` != 'muc' OR `corrected`.`from_resource` = new.`from_resource`) AND `corrected`.`id` < new.`id` ORDER BY `corrected`.`id` DESC LIMIT 1) WHERE `id` = new.`id`;"
+                        "UPDATE `ChatLogs` SET `corrected_by` = new.`id` WHERE `id` = (SELECT `original_id` FROM `ChatLogs` WHERE `id` = new.`id`);"
+                        "END;"
+                        "CREATE TRIGGER IF NOT EXISTS `ChatLogs_correction_delete` AFTER DELETE ON `ChatLogs` WHEN old.`original_id` IS NULL AND old.`corrected_by` IS NOT NULL BEGIN DELETE FROM `ChatLogs` WHERE `original_id` = old.`id`; END;"
+                        "CREATE VIEW IF NOT EXISTS `ChatLogsHistory` AS SELECT `id`, `from_jid`, `to_jid`, `from_resource`, `to_resource`, IFNULL((SELECT `latest`.`message` FROM `ChatLogs` AS `latest` WHERE `latest`.`id` = `ChatLogs`.`corrected_by`), `message`) AS `message`, `timestamp`, `type`, `stanza_id`, `archive_id`, `encryption` FROM `ChatLogs` WHERE `original_id` IS NULL;";
+    if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
+        goto fail;
+    }
+
+    // the corrections stored before are resolved like the trigger does, in
+    // the order they came so a chain ends at its first message
+    sqlite3_stmt* corrections = NULL;
+    sqlite3_stmt* original = NULL;
+    sqlite3_stmt* latest = NULL;
+    gboolean prepared = sqlite3_prepare_v2(g_chatlog_database, "SELECT `id` FROM `ChatLogs` WHERE `replace_id` != '' ORDER BY `id`", -1, &corrections, NULL) == SQLITE_OK
+                        && sqlite3_prepare_v2(g_chatlog_database, "UPDATE `ChatLogs` SET `original_id` = (SELECT IFNULL(`corrected`.`original_id`, `corrected`.`id`) FROM `ChatLogs` AS `corrected`, `ChatLogs` AS `new` WHERE `new`.`id` = ?1 AND `corrected`.`stanza_id` = `new`.`replace_id` AND `corrected`.`from_jid` = `new`.`from_jid` AND (`new`.`type` != 'muc' OR `corrected`.`from_resource` = `new`.`from_resource`) AND `corrected`.`id` < ?1 ORDER BY `corrected`.`id` DESC LIMIT 1) WHERE `id` = ?1", -1, &original, NULL) == SQLITE_OK
+                        && sqlite3_prepare_v2(g_chatlog_database, "UPDATE `ChatLogs` SET `corrected_by` = ?1 WHERE `id` = (SELECT `original_id` FROM `ChatLogs` WHERE `id` = ?1)", -1, &latest, NULL) == SQLITE_OK;
+    gboolean resolved = prepared;
+    while (resolved && sqlite3_step(corrections) == SQLITE_ROW) {
+        gint64 id = sqlite3_column_int64(corrections, 0);
+        sqlite3_bind_int64(original, 1, id);
+        sqlite3_bind_int64(latest, 1, id);
+        resolved = sqlite3_step(original) == SQLITE_DONE && sqlite3_step(latest) == SQLITE_DONE;
+        sqlite3_reset(original);
+        sqlite3_reset(latest);
+    }
+    sqlite3_finalize(corrections);
+    sqlite3_finalize(original);
+    sqlite3_finalize(latest);
+    if (!resolved) {
+        goto fail;
+    }
+
+    query = "INSERT OR IGNORE INTO `DbVersion` (`version`) VALUES('5');"
+            "COMMIT;";
+    if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
+        goto fail;
+    }
+
+    return TRUE;
+
+fail:
+    log_error("SQLite error migrating database to version 5: %s", err_msg ? err_msg : sqlite3_errmsg(g_chatlog_database));
+    sqlite3_free(err_msg);
+    sqlite3_exec(g_chatlog_database, "ROLLBACK", NULL, 0, NULL);
+    return FALSE;
+}
+
+// version 2: indexes for the history lookup and the archive_id dedupe
+static gboolean
+_migrate_to_v2(void)
+{
+    char* err_msg = NULL;
+    const char* query = "BEGIN TRANSACTION;"
+                        "CREATE INDEX IF NOT EXISTS `ChatLogs_conversation` ON `ChatLogs` (`from_jid`, `to_jid`, `timestamp`);"
+                        "CREATE INDEX IF NOT EXISTS `ChatLogs_archive_id` ON `ChatLogs` (`archive_id`);"
+                        "INSERT OR IGNORE INTO `DbVersion` (`version`) VALUES('2');"
+                        "COMMIT;";
+
+    if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
+        log_error("SQLite error migrating database to version 2: %s", err_msg ? err_msg : "unknown");
+        sqlite3_free(err_msg);
+        sqlite3_exec(g_chatlog_database, "ROLLBACK", NULL, 0, NULL);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+_migrate(void)
+{
+    int version = _get_db_version();
+
+    if (version > DB_VERSION) {
+        log_warning("Database version %d is newer than supported version %d", version, DB_VERSION);
+        return TRUE;
+    }
+
+    if (!_has_db_version(2)) {
+        log_info("Migrating database to version 2");
+        if (!_migrate_to_v2()) {
+            return FALSE;
+        }
+    }
+
+    if (!_has_db_version(3)) {
+        log_info("Migrating database to version 3");
+        if (!_migrate_to_v3()) {
+            // most likely an SQLite without FTS5, the history works without
+            // search and the migration is tried again on the next start
+            log_warning("Message search is not available");
+        }
+    }
+
+    // the search index must exist first, messages are not deleted before
+    if (!_has_db_version(4) && _has_db_version(3)) {
+        log_info("Migrating database to version 4");
+        if (!_migrate_to_v4()) {
+            log_warning("Old messages will not be deleted");
+        }
+    }
+
+    // the history reads `ChatLogsHistory`, it does not wait for the search
+    if (!_has_db_version(5)) {
+        log_info("Migrating database to version 5");
+        if (!_migrate_to_v5()) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+_search_init(void)
+{
+    if (!_has_db_version(3)) {
+        return;
+    }
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(g_chatlog_database, "SELECT `next_id`, `top_id` FROM `SearchBackfill` LIMIT 1", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("SQLite error reading search index state: %s", sqlite3_errmsg(g_chatlog_database));
+        sqlite3_finalize(stmt);
+        return;
+    }
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        db_search_backfill_next = sqlite3_column_int64(stmt, 0);
+        db_search_backfill_top = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+
+    db_search_available = TRUE;
+    if (db_search_backfill_next > 0) {
+        log_info("Indexing message history for search, %" G_GINT64_FORMAT " messages left", db_search_backfill_next);
+    }
+}
+
+// runs on the writer thread
+static void
+_search_backfill_step(void)
+{
+    pthread_mutex_lock(&db_queue_lock);
+    gint64 next = db_search_backfill_next;
+    pthread_mutex_unlock(&db_queue_lock);
+
+    gint64 low = MAX(next - DB_SEARCH_BACKFILL_CHUNK, 0);
+    sqlite3_stmt* insert = _get_stmt(DB_STMT_SEARCH_BACKFILL);
+    sqlite3_stmt* progress = _get_stmt(DB_STMT_SEARCH_BACKFILL_PROGRESS);
+    gboolean done = FALSE;
+
+    if (insert && progress) {
+        sqlite3_exec(g_chatlog_database, "BEGIN TRANSACTION", NULL, 0, NULL);
+        sqlite3_bind_int64(insert, 1, next);
+        sqlite3_bind_int64(insert, 2, low);
+        sqlite3_bind_int64(progress, 1, low);
+        done = sqlite3_step(insert) == SQLITE_DONE && sqlite3_step(progress) == SQLITE_DONE;
+        if (done) {
+            sqlite3_exec(g_chatlog_database, "COMMIT", NULL, 0, NULL);
+        } else {
+            log_error("SQLite error indexing messages for search: %s", sqlite3_errmsg(g_chatlog_database));
+            sqlite3_exec(g_chatlog_database, "ROLLBACK", NULL, 0, NULL);
+        }
+        sqlite3_reset(insert);
+        sqlite3_clear_bindings(insert);
+        sqlite3_reset(progress);
+        sqlite3_clear_bindings(progress);
+    }
+
+    // on errors give up for this session, the next start continues
+    pthread_mutex_lock(&db_queue_lock);
+    db_search_backfill_next = done ? low : 0;
+    pthread_mutex_unlock(&db_queue_lock);
+
+    if (done && low == 0) {
+        log_info("Message history indexed for search");
+    }
+}
+
+int
+log_database_retention_days(const char* const retain)
+{
+    if (g_strcmp0(retain, "forever") == 0) {
+        return 0;
+    }
+
+    gchar* end = NULL;
+    guint64 days = g_ascii_strtoull(retain, &end, 10);
+    if (end == retain || (*end != '\0' && g_strcmp0(end, "d") != 0) || days > 36500) {
+        return -1;
+    }
+
+    return (int)days;
+}
+
+// Starts deleting messages older than /logging db retain and giving the
+// freed pages back, both run on the writer thread while it is idle
+void
+log_database_maintain(void)
+{
+    if (!g_chatlog_database || !_has_db_version(4)) {
+        return;
+    }
+
+    int days = log_database_retention_days(prefs_peek_string(PREF_DB_RETAIN));
+    gchar* before = NULL;
+    if (days > 0) {
+        GDateTime* now = g_date_time_new_now_local();
+        GDateTime* cutoff = g_date_time_add_days(now, -days);
+        before = g_date_time_format_iso8601(cutoff);
+        g_date_time_unref(cutoff);
+        g_date_time_unref(now);
+    }
+
+    pthread_mutex_lock(&db_queue_lock);
+    g_free(db_prune_before);
+    db_prune_before = before;
+    db_vacuum_pending = TRUE;
+    pthread_cond_signal(&db_queue_cond);
+    pthread_mutex_unlock(&db_queue_lock);
+}
+
+// called with db_queue_lock held
+static gboolean
+_maintenance_pending(void)
+{
+    return db_prune_before != NULL || db_vacuum_pending;
+}
+
+static int
+_pragma_int(const char* const pragma)
+{
+    int value = 0;
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(g_chatlog_database, pragma, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        value = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    return value;
+}
+
+// runs on the writer thread, one chunk per step so new messages get a turn
+static void
+_maintenance_step(void)
+{
+    pthread_mutex_lock(&db_queue_lock);
+    gchar* before = g_strdup(db_prune_before);
+    pthread_mutex_unlock(&db_queue_lock);
+
+    gboolean done = TRUE;
+    if (before) {
+        sqlite3_stmt* prune = _get_stmt(DB_STMT_PRUNE);
+        if (prune) {
+            sqlite3_bind_text(prune, 1, before, -1, SQLITE_STATIC);
+            sqlite3_bind_int(prune, 2, DB_PRUNE_CHUNK);
+            if (sqlite3_step(prune) == SQLITE_DONE) {
+                int deleted = sqlite3_changes(g_chatlog_database);
+                if (deleted > 0) {
+                    log_debug("Deleted %d messages from before %s", deleted, before);
+                }
+                done = deleted < DB_PRUNE_CHUNK;
+            } else {
+                log_error("SQLite error deleting old messages: %s", sqlite3_errmsg(g_chatlog_database));
+            }
+            sqlite3_reset(prune);
+            sqlite3_clear_bindings(prune);
+        }
+
+        pthread_mutex_lock(&db_queue_lock);
+        if (done && g_strcmp0(db_prune_before, before) == 0) {
+            g_free(db_prune_before);
+            db_prune_before = NULL;
+        }
+        pthread_mutex_unlock(&db_queue_lock);
+        g_free(before);
+        return;
+    }
+
+    // databases created before auto_vacuum was set need a manual VACUUM
+    if (_pragma_int("PRAGMA auto_vacuum") == 2 && _pragma_int("PRAGMA freelist_count") > 0) {
+        sqlite3_exec(g_chatlog_database, DB_VACUUM_STEP, NULL, 0, NULL);
+        done = _pragma_int("PRAGMA freelist_count") == 0;
+    }
+
+    if (done) {
+        pthread_mutex_lock(&db_queue_lock);
+        db_vacuum_pending = FALSE;
+        pthread_mutex_unlock(&db_queue_lock);
+    }
+}
+
+// Every word becomes a quoted FTS5 phrase, so operators and punctuation in
+// the input are taken literally. A trailing '*' keeps a prefix search.
+static gchar*
+_search_expression(const char* const words)
+{
+    gchar** tokens = g_strsplit_set(words, " \t", -1);
+    GString* expr = g_string_new(NULL);
+
+    for (int i = 0; tokens[i]; i++) {
+        char* token = tokens[i];
+        size_t len = strlen(token);
+        gboolean prefix = len > 1 && token[len - 1] == '*';
+        if (prefix) {
+            token[--len] = '\0';
+        }
+        if (len == 0) {
+            continue;
+        }
+
+        if (expr->len > 0) {
+            g_string_append_c(expr, ' ');
+        }
+        g_string_append_c(expr, '"');
+        for (const char* c = token; *c; c++) {
+            if (*c == '"') {
+                g_string_append_c(expr, '"');
+            }
+            g_string_append_c(expr, *c);
+        }
+        g_string_append_c(expr, '"');
+        if (prefix) {
+            g_string_append_c(expr, '*');
+        }
+    }
+    g_strfreev(tokens);
+
+    return g_string_free(expr, expr->len == 0);
+}
+
+// Adds the .log files below dir to files, relative to the account directory.
+// Compressed ones are added by the name they had before.
+static void
+_import_collect(const char* const dir, const char* const relpath, int depth, GHashTable* files)
+{
+    GDir* gdir = g_dir_open(dir, 0, NULL);
+    if (!gdir) {
+        return;
+    }
+
+    const char* name;
+    while ((name = g_dir_read_name(gdir)) != NULL) {
+        gchar* path = g_build_filename(dir, name, NULL);
+        gchar* rel = relpath ? g_strdup_printf("%s/%s", relpath, name) : g_strdup(name);
+        if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+            // rooms/<room>/ is the deepest level
+            if (depth < 2) {
+                _import_collect(path, rel, depth + 1, files);
+            }
+            g_free(rel);
+        } else if (g_str_has_suffix(name, ".log")) {
+            g_hash_table_add(files, rel);
+        } else if (g_str_has_suffix(name, ".log" LOGCOMPRESS_SUFFIX)) {
+            rel[strlen(rel) - strlen(LOGCOMPRESS_SUFFIX)] = '\0';
+            g_hash_table_add(files, rel);
+        } else {
+            g_free(rel);
+        }
+        g_free(path);
+    }
+    g_dir_close(gdir);
+}
+
+static DbEntry*
+_import_entry(DbImport* import, ChatlogFile* file, ChatlogLine* line)
+{
+    GDateTime* dt = g_date_time_new_local(file->year, file->month, file->day, line->hour, line->minute, line->second);
+    if (!dt) {
+        return NULL;
+    }
+    if (import->before && g_date_time_compare(dt, import->before) >= 0) {
+        g_date_time_unref(dt);
+        return NULL;
+    }
+
+    DbEntry* entry = malloc(sizeof(DbEntry));
+    entry->timestamp = g_date_time_format_iso8601(dt);
+    g_date_time_unref(dt);
+
+    const char* resource = file->resource ? file->resource : "";
+    if (file->room) {
+        entry->from_jid = g_strdup(file->contact);
+        entry->from_resource = g_strdup(line->name);
+        entry->to_jid = g_strdup(import->login);
+        entry->to_resource = g_strdup("");
+        entry->type = "muc";
+    } else {
+        if (g_strcmp0(line->name, "me") == 0) {
+            entry->from_jid = g_strdup(import->login);
+            entry->from_resource = g_strdup("");
+            entry->to_jid = g_strdup(file->contact);
+            entry->to_resource = g_strdup(resource);
+        } else {
+            entry->from_jid = g_strdup(file->contact);
+            entry->from_resource = g_strdup(resource);
+            entry->to_jid = g_strdup(import->login);
+            entry->to_resource = g_strdup("");
+        }
+        entry->type = file->resource ? "mucpm" : "chat";
+    }
+    entry->message = g_strdup(line->message);
+    entry->stanza_id = g_strdup("");
+    entry->archive_id = g_strdup("");
+    entry->replace_id = g_strdup("");
+    entry->enc = "none";
+    entry->imported = TRUE;
+    entry->import_done = NULL;
+    entry->read = NULL;
+
+    return entry;
+}
+
+// Hands the messages of one file to the writer at once, waiting while the
+// writer is behind or someone needs the history
+static void
+_import_queue(DbImport* import, GQueue* entries)
+{
+    pthread_mutex_lock(&db_queue_lock);
+    while (db_writer_running && !g_atomic_int_get(&import->cancel)
+           && (db_flush_waiting > 0 || g_queue_get_length(db_queue) > DB_IMPORT_QUEUE_MAX)) {
+        pthread_cond_wait(&db_idle_cond, &db_queue_lock);
+    }
+    if (!db_writer_running || g_atomic_int_get(&import->cancel)) {
+        pthread_mutex_unlock(&db_queue_lock);
+        g_queue_free_full(entries, (GDestroyNotify)_free_entry);
+        return;
+    }
+
+    guint count = g_queue_get_length(entries);
+    DbEntry* entry;
+    while ((entry = g_queue_pop_head(entries)) != NULL) {
+        g_queue_push_tail(db_queue, entry);
+    }
+    if (db_bulk_depth == 0) {
+        db_queue_ready += count;
+        pthread_cond_signal(&db_queue_cond);
+    }
+    pthread_mutex_unlock(&db_queue_lock);
+    g_queue_free(entries);
+}
+
+// runs on the parser pool, one log file per call
+static void
+_import_file(gpointer data, gpointer user_data)
+{
+    gchar* relpath = data;
+    DbImport* import = user_data;
+
+    if (g_atomic_int_get(&import->cancel)) {
+        g_free(relpath);
+        return;
+    }
+
+    GQueue* entries = g_queue_new();
+    ChatlogFile* file = chatlog_import_parse_path(relpath);
+    gchar* path = g_build_filename(import->dir, relpath, NULL);
+    gchar* contents = NULL;
+    if (file && logcompress_get_contents(path, &contents, NULL)) {
+        GSList* lines = chatlog_import_parse(contents);
+        for (GSList* curr = lines; curr; curr = g_slist_next(curr)) {
+            DbEntry* entry = _import_entry(import, file, curr->data);
+            if (entry) {
+                g_queue_push_tail(entries, entry);
+            }
+        }
+        g_slist_free_full(lines, (GDestroyNotify)chatlog_import_line_free);
+        g_free(contents);
+    } else if (file) {
+        log_warning("Unable to read chat log %s", path);
+    }
+    g_free(path);
+    chatlog_import_file_free(file);
+
+    // committed with the messages before it, a later run starts after it
+    DbEntry* done = calloc(1, sizeof(DbEntry));
+    done->import_done = relpath;
+    g_queue_push_tail(entries, done);
+
+    _import_queue(import, entries);
+}
+
+static void
+_import_file_done(DbEntry* entry)
+{
+    sqlite3_stmt* stmt = _get_stmt(DB_STMT_IMPORT_DONE);
+    if (stmt) {
+        sqlite3_bind_text(stmt, 1, entry->import_done, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            log_error("SQLite error: %s", sqlite3_errmsg(g_chatlog_database));
+        }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+
+    g_atomic_int_inc(&db_import_files_done);
+}
+
+static void*
+_import_thread(void* data)
+{
+    DbImport* import = data;
+
+    GHashTable* files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    _import_collect(import->dir, NULL, 0, files);
+
+    GHashTable* imported = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(g_chatlog_database, "SELECT `path` FROM `LegacyImport`", -1, &stmt, NULL) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            g_hash_table_add(imported, g_strdup((const char*)sqlite3_column_text(stmt, 0)));
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    pthread_mutex_lock(&db_queue_lock);
+    import->files_total = g_hash_table_size(files);
+    pthread_mutex_unlock(&db_queue_lock);
+
+    // parsing is spread over the cores, the single writer keeps the inserts in order per file
+    GThreadPool* pool = g_thread_pool_new(_import_file, import, g_get_num_processors(), TRUE, NULL);
+    GHashTableIter iter;
+    gpointer relpath;
+    g_hash_table_iter_init(&iter, files);
+    while (g_hash_table_iter_next(&iter, &relpath, NULL)) {
+        if (g_hash_table_contains(imported, relpath)) {
+            g_atomic_int_inc(&db_import_files_done);
+        } else {
+            g_thread_pool_push(pool, g_strdup(relpath), NULL);
+        }
+    }
+    g_thread_pool_free(pool, FALSE, TRUE);
+    g_hash_table_destroy(imported);
+    g_hash_table_destroy(files);
+
+    pthread_mutex_lock(&db_queue_lock);
+    while (db_writer_running && !g_atomic_int_get(&import->cancel)
+           && g_atomic_int_get(&db_import_files_done) < import->files_total) {
+        pthread_cond_wait(&db_idle_cond, &db_queue_lock);
+    }
+    import->finished = g_get_monotonic_time();
+    db_import_running = FALSE;
+    pthread_mutex_unlock(&db_queue_lock);
+
+    double secs = (import->finished - import->started) / (double)G_USEC_PER_SEC;
+    log_info("Imported %d messages from %d of %d chat log files in %.1f s (%.0f messages/s)%s",
+             g_atomic_int_get(&db_import_messages), g_atomic_int_get(&db_import_files_done), import->files_total,
+             secs, secs > 0 ? g_atomic_int_get(&db_import_messages) / secs : 0.0,
+             g_atomic_int_get(&import->cancel) ? ", stopped" : "");
+
+    return NULL;
+}
+
+static void
+_import_free(DbImport* import)
+{
+    g_free(import->login);
+    g_free(import->dir);
+    if (import->before) {
+        g_date_time_unref(import->before);
+    }
+    g_free(import);
+}
+
+static void
+_import_stop(void)
+{
+    if (!db_import) {
+        return;
+    }
+
+    pthread_mutex_lock(&db_queue_lock);
+    g_atomic_int_set(&db_import->cancel, 1);
+    pthread_cond_broadcast(&db_idle_cond);
+    pthread_mutex_unlock(&db_queue_lock);
+    pthread_join(db_import->thread, NULL);
+
+    _import_free(db_import);
+    db_import = NULL;
+}
+
+gboolean
+log_database_import_start(const char* const login)
+{
+    if (!g_chatlog_database || !login) {
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&db_queue_lock);
+    gboolean busy = db_import_running || !db_writer_running;
+    pthread_mutex_unlock(&db_queue_lock);
+    if (busy) {
+        return FALSE;
+    }
+    if (db_import) {
+        pthread_join(db_import->thread, NULL);
+        _import_free(db_import);
+        db_import = NULL;
+    }
+
+    // what the database held before the first import bounds every later one,
+    // so messages it already has from the server are not added twice
+    char* err_msg = NULL;
+    const char* query = "CREATE TABLE IF NOT EXISTS `LegacyImport` ( `path` TEXT PRIMARY KEY);"
+                        "CREATE TABLE IF NOT EXISTS `LegacyImportBefore` ( `timestamp` TEXT);"
+                        "INSERT INTO `LegacyImportBefore` (`timestamp`) SELECT MIN(`timestamp`) FROM `ChatLogs` WHERE NOT EXISTS (SELECT 1 FROM `LegacyImportBefore`);";
+    if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
+        log_error("SQLite error preparing the chat log import: %s", err_msg ? err_msg : "unknown");
+        sqlite3_free(err_msg);
+        return FALSE;
+    }
+
+    DbImport* import = g_new0(DbImport, 1);
+    import->login = g_strdup(login);
+    char* chatlogs_dir = files_get_data_path(DIR_CHATLOGS);
+    gchar* login_dir = str_replace(login, "@", "_at_");
+    import->dir = g_build_filename(chatlogs_dir, login_dir, NULL);
+    free(login_dir);
+    free(chatlogs_dir);
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(g_chatlog_database, "SELECT `timestamp` FROM `LegacyImportBefore`", -1, &stmt, NULL) == SQLITE_OK
+        && sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0)) {
+        import->before = g_date_time_new_from_iso8601((const char*)sqlite3_column_text(stmt, 0), NULL);
+    }
+    sqlite3_finalize(stmt);
+
+    g_atomic_int_set(&db_import_files_done, 0);
+    g_atomic_int_set(&db_import_messages, 0);
+    import->started = g_get_monotonic_time();
+    pthread_mutex_lock(&db_queue_lock);
+    db_import_running = TRUE;
+    pthread_mutex_unlock(&db_queue_lock);
+    if (pthread_create(&import->thread, NULL, _import_thread, import) != 0) {
+        log_error("Unable to start chat log import thread");
+        pthread_mutex_lock(&db_queue_lock);
+        db_import_running = FALSE;
+        pthread_mutex_unlock(&db_queue_lock);
+        _import_free(import);
+        return FALSE;
+    }
+    db_import = import;
+
+    return TRUE;
+}
+
+gboolean
+log_database_import_status(gboolean* running, int* files_done, int* files_total, int* messages, gint64* elapsed_us)
+{
+    if (!db_import) {
+        return FALSE;
+    }
+
+    pthread_mutex_lock(&db_queue_lock);
+    *running = db_import_running;
+    *files_total = db_import->files_total;
+    *elapsed_us = (db_import_running ? g_get_monotonic_time() : db_import->finished) - db_import->started;
+    pthread_mutex_unlock(&db_queue_lock);
+    *files_done = g_atomic_int_get(&db_import_files_done);
+    *messages = g_atomic_int_get(&db_import_messages);
+
+    return TRUE;
 }
@@ -45,7 +45,32 @@ void log_database_add_incoming(ProfMessage* message);
 void log_database_add_outgoing_chat(const char* const id, const char* const barejid, const char* const message, const char* const replace_id, prof_enc_t enc);
 void log_database_add_outgoing_muc(const char* const id, const char* const barejid, const char* const message, const char* const replace_id, prof_enc_t enc);
 void log_database_add_outgoing_muc_pm(const char* const id, const char* const barejid, const char* const message, const char* const replace_id, prof_enc_t enc);
-GSList* log_database_get_previous_chat(const gchar* const contact_barejid);
+GSList* log_database_get_previous_chat(const gchar* const contact_barejid, char** cursor_time, gint64* cursor_id, int count);
+// history is oldest first, it and cursor_time are freed once the callback returns
+typedef void (*log_database_history_cb)(GSList* history, const char* const cursor_time, gint64 cursor_id, void* userdata);
+gboolean log_database_get_previous_chat_async(const gchar* const contact_barejid, int count, log_database_history_cb callback, void* userdata, GDestroyNotify free_userdata);
+void log_database_reads_check(void);
+gboolean log_database_get_last_archived(char** archive_id, GDateTime** timestamp);
+GDateTime* log_database_get_last_muc(const char* const room);
+GSList* log_database_get_previous_muc(const gchar* const room, int count);
+gboolean log_database_search_available(void);
+int log_database_search_indexed(void);
+GSList* log_database_search(const char* const words, const char* const with, const char* const after, const char* const before, gint64* cursor, int count);
+void log_database_flush(void);
+void log_database_bulk_begin(void);
+void log_database_bulk_commit(void);
+void log_database_bulk_end(void);
+guint log_database_queue_depth(void);
+// days in a /logging db retain value, 0 for forever and -1 if it is invalid
+int log_database_retention_days(const char* const retain);
+void log_database_maintain(void);
+// Imports the text chat logs of login in the background, FALSE when the
+// database is not open or an import is running already
+gboolean log_database_import_start(const char* const login);
+// Progress of the last import, FALSE when none was started
+gboolean log_database_import_status(gboolean* running, int* files_done, int* files_total, int* messages, gint64* elapsed_us);
+gsize log_database_memory(void);
+void log_database_trim(void);
 void log_database_close(void);
 
 #endif // DATABASE_H
@@ -119,7 +119,7 @@ cl_ev_send_msg_correct(ProfChatWin* chatwin, const char* const msg, const char*
 {
     chat_state_active(chatwin->state);
 
-    gboolean request_receipt = prefs_get_boolean(PREF_RECEIPTS_REQUEST);
+    gboolean request_receipt = prefs_get_boolean(PREF_RECEIPTS_REQUEST) && !prefs_get_boolean(PREF_LOW_BANDWIDTH);
 
     char* plugin_msg = plugins_pre_chat_message_send(chatwin->barejid, msg);
     if (plugin_msg == NULL) {
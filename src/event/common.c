@@ -43,6 +43,7 @@
 #include "xmpp/xmpp.h"
 #include "database.h"
 #include "tools/bookmark_ignore.h"
+#include "event/server_events.h"
 
 #ifdef HAVE_LIBGPGME
 #include "pgp/gpg.h"
@@ -57,6 +58,10 @@ static gint _success_connections_counter = 0;
 void
 ev_disconnect_cleanup(void)
 {
+#ifdef HAVE_LIBGPGME
+    // show the messages still being decrypted while the roster is there
+    p_gpg_jobs_finish();
+#endif
     ui_disconnected();
     session_disconnect();
     roster_destroy();
@@ -73,6 +78,7 @@ ev_disconnect_cleanup(void)
 #endif
     log_database_close();
     bookmark_ignore_on_disconnect();
+    sv_ev_bookmark_autojoin_clear();
 }
 
 gboolean
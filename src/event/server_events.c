@@ -53,7 +53,10 @@
 #include "plugins/plugins.h"
 #include "ui/window_list.h"
 #include "tools/bookmark_ignore.h"
+#include "tools/perf.h"
+#include "tools/scheduler.h"
 #include "xmpp/xmpp.h"
+#include "xmpp/message.h"
 #include "xmpp/muc.h"
 #include "xmpp/chat_session.h"
 #include "xmpp/roster_list.h"
@@ -65,6 +68,7 @@
 
 #ifdef HAVE_LIBGPGME
 #include "pgp/gpg.h"
+#include "xmpp/ox.h"
 #endif
 
 #ifdef HAVE_OMEMO
@@ -73,8 +77,53 @@
 
 #include "ui/ui.h"
 
+// An incoming chat or room message goes through the stages classify,
+// decrypt, persist, plugin and render, each timed in /perf, the plugin hooks
+// as the plugins section. Duplicates were dropped in message.c by then. A
+// PGP message leaves for the PGP worker after classify and comes back
+// decrypted, what is persisted is written by the database thread and the
+// chat log flush, which batch it.
+typedef enum {
+    SV_EV_CHAT_DROP,
+    SV_EV_CHAT_PLAIN,
+    SV_EV_CHAT_PGP,
+    SV_EV_CHAT_PGP_FAILED,
+    SV_EV_CHAT_OX,
+    SV_EV_CHAT_OTR,
+    SV_EV_CHAT_OMEMO
+} sv_ev_chat_kind_t;
+
 static void _clean_incoming_message(ProfMessage* message);
-static void _sv_ev_incoming_plain(ProfChatWin* chatwin, gboolean new_win, ProfMessage* message, gboolean logit);
+static ProfChatWin* _sv_ev_chat_open(const char* const barejid, gboolean start_omemo);
+static void _sv_ev_chat_deliver(ProfChatWin* chatwin, gboolean new_win, ProfMessage* message, gboolean logit, gboolean otr);
+static sv_ev_chat_kind_t _sv_ev_chat_decrypt(ProfChatWin* chatwin, ProfMessage* message, gboolean otr);
+static void _sv_ev_chat_persist(ProfMessage* message, sv_ev_chat_kind_t kind, gboolean logit);
+static void _sv_ev_chat_release(ProfChatWin* chatwin, ProfMessage* message, sv_ev_chat_kind_t kind);
+static void _sv_ev_room_render(ProfMucWin* mucwin, ProfMessage* message, const char* const mynick);
+static gboolean _sv_ev_room_slow_timeout(void* data);
+static void _autojoin_finished(const char* const room, gboolean joined);
+
+#ifdef HAVE_LIBGPGME
+typedef void (*sv_ev_message_handler)(ProfMessage* message);
+
+// A message waiting for the PGP worker, either for its own text or for
+// earlier messages so that it is shown after them.
+typedef struct
+{
+    ProfMessage* message;
+    sv_ev_message_handler handler;
+} PGPDeferred;
+
+// the deferred message being handled again and its decrypted text
+static ProfMessage* pgp_deferred_message = NULL;
+static char* pgp_deferred_plain = NULL;
+
+static gboolean _sv_ev_is_pgp(ProfMessage* message);
+static gboolean _sv_ev_pgp_defer(ProfMessage* message, gboolean decrypt, sv_ev_message_handler handler);
+static void _sv_ev_pgp_deferred(char* plain, void* userdata);
+static void _sv_ev_pgp_deferred_free(PGPDeferred* deferred);
+static char* _sv_ev_pgp_decrypt(ProfMessage* message);
+#endif
 
 void
 sv_ev_login_account_success(char* account_name, gboolean secured)
@@ -99,7 +148,10 @@ sv_ev_login_account_success(char* account_name, gboolean secured)
 
     log_database_init(account);
 
-    avatar_pep_subscribe();
+    // avatar updates of every contact are pushed once subscribed
+    if (!prefs_get_boolean(PREF_LOW_BANDWIDTH)) {
+        avatar_pep_subscribe();
+    }
 
     ui_handle_login_account_success(account, secured);
 
@@ -162,6 +214,10 @@ sv_ev_roster_received(void)
         ui_show_roster();
     }
     account_free(account);
+
+    if (!prefs_get_boolean(PREF_LOW_BANDWIDTH)) {
+        ox_discover_roster_keys();
+    }
 #endif
 
     // send initial presence
@@ -200,6 +256,24 @@ sv_ev_connection_features_received(void)
 #ifdef HAVE_OMEMO
     omemo_publish_crypto_materials();
 #endif
+
+    if (prefs_get_boolean(PREF_MAM)) {
+        iq_mam_sync();
+    }
+}
+
+void
+sv_ev_stream_suspended(void)
+{
+    cons_show_error("Lost connection, trying to resume the session.");
+    ui_stream_suspended();
+}
+
+void
+sv_ev_stream_resumed(gboolean secured)
+{
+    cons_show("Session resumed.");
+    ui_stream_resumed(secured);
 }
 
 void
@@ -263,6 +337,10 @@ sv_ev_room_subject(const char* const room, const char* const nick, const char* c
 {
     muc_set_subject(room, subject);
     ProfMucWin* mucwin = wins_get_muc(room);
+    if (mucwin) {
+        // the subject follows the history when joining
+        mucwin_history_flush(mucwin);
+    }
     if (mucwin && muc_roster_complete(room) && ev_is_first_connect()) {
         mucwin_subject(mucwin, nick, subject);
     }
@@ -277,15 +355,14 @@ sv_ev_room_history(ProfMessage* message)
         if (ev_is_first_connect()) {
             // save timestamp of last received muc message
             // so we dont display, if there was no activity in channel, once we reconnect
-            if (mucwin->last_msg_timestamp) {
-                g_date_time_unref(mucwin->last_msg_timestamp);
-            }
-            mucwin->last_msg_timestamp = g_date_time_new_now_local();
+            mucwin->last_msg_timestamp = g_get_real_time();
         }
 
-        gboolean younger = g_date_time_compare(mucwin->last_msg_timestamp, message->timestamp) < 0 ? TRUE : FALSE;
-        if (ev_is_first_connect() || younger) {
-            mucwin_history(mucwin, message);
+        gboolean younger = mucwin->last_msg_timestamp < message->timestamp;
+        // what the room sends after the newest stored message is stored
+        // too, a rejoin asks only for the history since
+        if ((ev_is_first_connect() || younger) && mucwin_history(mucwin, message)) {
+            log_database_add_incoming(message);
         }
     }
 }
@@ -304,22 +381,103 @@ _log_muc(ProfMessage* message)
 void
 sv_ev_room_message(ProfMessage* message)
 {
+    gint64 started = perf_start();
     ProfMucWin* mucwin = wins_get_muc(message->from_jid->barejid);
     if (!mucwin) {
         return;
     }
 
     char* mynick = muc_nick(mucwin->roomjid);
-
     // only log message not coming from this client (but maybe same account, different client)
     // our messages are logged when outgoing
-    if (!(g_strcmp0(mynick, message->from_jid->resourcepart) == 0 && message_is_sent_by_us(message, TRUE))) {
+    gboolean ours = g_strcmp0(mynick, message->from_jid->resourcepart) == 0 && message_is_sent_by_us(message, TRUE);
+    perf_stop(PERF_MSG_CLASSIFY, started);
+
+    if (!ours) {
+        started = perf_start();
         _log_muc(message);
+        perf_stop(PERF_MSG_PERSIST, started);
     }
 
     char* old_plain = message->plain;
     message->plain = plugins_pre_room_message_display(message->from_jid->barejid, message->from_jid->resourcepart, message->plain);
 
+    // in slow mode the room is drawn when its batch is due
+    if (mucwin->slow_ms > 0) {
+        if (!mucwin->slow_pending) {
+            scheduler_add(mucwin->slow_ms, _sv_ev_room_slow_timeout, strdup(mucwin->roomjid), free);
+        }
+        mucwin->slow_pending = g_slist_prepend(mucwin->slow_pending, message_copy(message));
+        free(message->plain);
+        message->plain = old_plain;
+        return;
+    }
+
+    started = perf_start();
+    _sv_ev_room_render(mucwin, message, mynick);
+    rosterwin_roster();
+    perf_stop(PERF_MSG_RENDER, started);
+
+    plugins_post_room_message_display(message->from_jid->barejid, message->from_jid->resourcepart, message->plain);
+    free(message->plain);
+    message->plain = old_plain;
+}
+
+static gboolean
+_sv_ev_room_slow_timeout(void* data)
+{
+    sv_ev_room_slow_flush(data);
+
+    return FALSE;
+}
+
+// Draws the messages slow mode held back, with one roster redraw for all
+void
+sv_ev_room_slow_flush(const char* const roomjid)
+{
+    ProfMucWin* mucwin = wins_get_muc(roomjid);
+    if (!mucwin || !mucwin->slow_pending) {
+        return;
+    }
+
+    gint64 started = perf_start();
+    char* mynick = muc_nick(mucwin->roomjid);
+    GSList* pending = g_slist_reverse(mucwin->slow_pending);
+    mucwin->slow_pending = NULL;
+
+    for (GSList* curr = pending; curr; curr = g_slist_next(curr)) {
+        ProfMessage* message = curr->data;
+
+        int repeats = 1;
+        while (mucwin->slow_collapse && curr->next) {
+            ProfMessage* next = curr->next->data;
+            if (g_strcmp0(next->from_jid->resourcepart, message->from_jid->resourcepart) != 0 || g_strcmp0(next->plain, message->plain) != 0) {
+                break;
+            }
+            curr = g_slist_next(curr);
+            repeats++;
+        }
+        if (repeats > 1) {
+            char* plain = g_strdup_printf("%s [x%d]", message->plain, repeats);
+            free(message->plain);
+            message->plain = strdup(plain);
+            g_free(plain);
+        }
+
+        _sv_ev_room_render(mucwin, message, mynick);
+        plugins_post_room_message_display(message->from_jid->barejid, message->from_jid->resourcepart, message->plain);
+    }
+
+    g_slist_free_full(pending, (GDestroyNotify)message_free);
+    rosterwin_roster();
+    perf_stop(PERF_MSG_RENDER, started);
+}
+
+static void
+_sv_ev_room_render(ProfMucWin* mucwin, ProfMessage* message, const char* const mynick)
+{
+    mucwin_history_flush(mucwin);
+
     GSList* mentions = get_mentions(prefs_get_boolean(PREF_NOTIFY_MENTION_WHOLE_WORD), prefs_get_boolean(PREF_NOTIFY_MENTION_CASE_SENSITIVE), message->plain, mynick);
     gboolean mention = g_slist_length(mentions) > 0;
     GList* triggers = prefs_message_get_triggers(message->plain);
@@ -353,6 +511,7 @@ sv_ev_room_message(ProfMessage* message)
         cons_show_incoming_room_message(message->from_jid->resourcepart, mucwin->roomjid, num, mention, triggers, mucwin->unread, window);
 
         mucwin->unread++;
+        wins_unread_changed(window, 1);
 
         if (mention) {
             mucwin->unread_mentions = TRUE;
@@ -363,10 +522,7 @@ sv_ev_room_message(ProfMessage* message)
     }
 
     // save timestamp of last received muc message
-    if (mucwin->last_msg_timestamp) {
-        g_date_time_unref(mucwin->last_msg_timestamp);
-    }
-    mucwin->last_msg_timestamp = g_date_time_new_now_local();
+    mucwin->last_msg_timestamp = g_get_real_time();
 
     if (prefs_do_room_notify(is_current, mucwin->roomjid, mynick, message->from_jid->resourcepart, message->plain, mention, triggers != NULL)) {
         Jid* jidp = jid_create(mucwin->roomjid);
@@ -379,12 +535,6 @@ sv_ev_room_message(ProfMessage* message)
     if (triggers) {
         g_list_free_full(triggers, free);
     }
-
-    rosterwin_roster();
-
-    plugins_post_room_message_display(message->from_jid->barejid, message->from_jid->resourcepart, message->plain);
-    free(message->plain);
-    message->plain = old_plain;
 }
 
 void
@@ -436,6 +586,12 @@ sv_ev_delayed_private_message(ProfMessage* message)
 void
 sv_ev_outgoing_carbon(ProfMessage* message)
 {
+#ifdef HAVE_LIBGPGME
+    if (_sv_ev_pgp_defer(message, _sv_ev_is_pgp(message), sv_ev_outgoing_carbon)) {
+        return;
+    }
+#endif
+
     ProfChatWin* chatwin = wins_get_chat(message->to_jid->barejid);
     if (!chatwin) {
         chatwin = chatwin_new(message->to_jid->barejid);
@@ -447,7 +603,7 @@ sv_ev_outgoing_carbon(ProfMessage* message)
         chatwin_outgoing_carbon(chatwin, message);
     } else if (message->encrypted) {
 #ifdef HAVE_LIBGPGME
-        message->plain = p_gpg_decrypt(message->encrypted);
+        message->plain = _sv_ev_pgp_decrypt(message);
         if (message->plain) {
             message->enc = PROF_MSG_ENC_PGP;
             chatwin_outgoing_carbon(chatwin, message);
@@ -479,199 +635,241 @@ sv_ev_outgoing_carbon(ProfMessage* message)
     return;
 }
 
-static void
-_sv_ev_incoming_pgp(ProfChatWin* chatwin, gboolean new_win, ProfMessage* message, gboolean logit)
+void
+sv_ev_incoming_message(ProfMessage* message)
 {
-#ifdef HAVE_LIBGPGME
-    message->plain = p_gpg_decrypt(message->encrypted);
-    if (message->plain) {
-        message->enc = PROF_MSG_ENC_PGP;
-        _clean_incoming_message(message);
-        chatwin_incoming_msg(chatwin, message, new_win);
-        log_database_add_incoming(message);
-        if (logit) {
-            chat_log_pgp_msg_in(message);
-        }
-        chatwin->pgp_recv = TRUE;
-        p_gpg_free_decrypted(message->plain);
-        message->plain = NULL;
-    } else {
-        if (!message->body) {
-            log_error("Couldn't decrypt GPG message and body was empty");
-            return;
+    gint64 started = perf_start();
+    char* looking_for_jid = message->from_jid->barejid;
+
+    if (message->is_mam) {
+        char* mybarejid = connection_get_barejid();
+        if (g_strcmp0(mybarejid, message->from_jid->barejid) == 0) {
+            if (message->to_jid) {
+                looking_for_jid = message->to_jid->barejid;
+            }
         }
-        message->enc = PROF_MSG_ENC_NONE;
-        message->plain = strdup(message->body);
-        _clean_incoming_message(message);
-        chatwin_incoming_msg(chatwin, message, new_win);
-        log_database_add_incoming(message);
-        chat_log_msg_in(message);
-        chatwin->pgp_recv = FALSE;
+        free(mybarejid);
     }
-#endif
-}
 
-static void
-_sv_ev_incoming_ox(ProfChatWin* chatwin, gboolean new_win, ProfMessage* message, gboolean logit)
-{
+    ProfChatWin* chatwin = wins_get_chat(looking_for_jid);
+
 #ifdef HAVE_LIBGPGME
-    //_clean_incoming_message(message);
-    chatwin_incoming_msg(chatwin, message, new_win);
-    log_database_add_incoming(message);
-    if (logit) {
-        chat_log_pgp_msg_in(message);
+    // archived messages without a window and messages in OTR sessions are not decrypted
+    gboolean decrypt = _sv_ev_is_pgp(message) && (chatwin || !message->is_mam) && !(chatwin && chatwin->is_otr);
+    if (_sv_ev_pgp_defer(message, decrypt, sv_ev_incoming_message)) {
+        return;
     }
-    chatwin->pgp_recv = TRUE;
-    // p_gpg_free_decrypted(message->plain);
-    message->plain = NULL;
 #endif
-}
 
-static void
-_sv_ev_incoming_otr(ProfChatWin* chatwin, gboolean new_win, ProfMessage* message)
-{
-#ifdef HAVE_LIBOTR
-    gboolean decrypted = FALSE;
-    message->plain = otr_on_message_recv(message->from_jid->barejid, message->from_jid->resourcepart, message->body, &decrypted);
-    if (message->plain) {
-        if (decrypted) {
-            message->enc = PROF_MSG_ENC_OTR;
-            chatwin->pgp_send = FALSE;
-        } else {
-            message->enc = PROF_MSG_ENC_NONE;
+    // archived messages are only shown in windows already open, the rest is just logged
+    if (!chatwin && message->is_mam) {
+        perf_stop(PERF_MSG_CLASSIFY, started);
+        if (!message->plain && message->body) {
+            message->plain = strdup(message->body);
+        }
+        if (message->plain) {
+            started = perf_start();
+            log_database_add_incoming(message);
+            perf_stop(PERF_MSG_PERSIST, started);
         }
+        return;
+    }
 
-        _clean_incoming_message(message);
-        chatwin_incoming_msg(chatwin, message, new_win);
-        log_database_add_incoming(message);
+    gboolean new_win = FALSE;
+    if (!chatwin) {
+        chatwin = _sv_ev_chat_open(looking_for_jid, !message->is_mam);
+        new_win = TRUE;
+    }
+    perf_stop(PERF_MSG_CLASSIFY, started);
 
-        chat_log_otr_msg_in(message);
-        otr_free_message(message->plain);
-        message->plain = NULL;
-        chatwin->pgp_recv = FALSE;
+    _sv_ev_chat_deliver(chatwin, new_win, message, TRUE, TRUE);
+    rosterwin_roster();
+}
+
+void
+sv_ev_incoming_carbon(ProfMessage* message)
+{
+#ifdef HAVE_LIBGPGME
+    if (_sv_ev_pgp_defer(message, _sv_ev_is_pgp(message), sv_ev_incoming_carbon)) {
+        return;
     }
-#else
-    _sv_ev_incoming_plain(chatwin, new_win, message, TRUE);
 #endif
+
+    gint64 started = perf_start();
+    gboolean new_win = FALSE;
+    ProfChatWin* chatwin = wins_get_chat(message->from_jid->barejid);
+    if (!chatwin) {
+        chatwin = _sv_ev_chat_open(message->from_jid->barejid, TRUE);
+        new_win = TRUE;
+    }
+    perf_stop(PERF_MSG_CLASSIFY, started);
+
+    // MUC PMs are not written to the chat log, nick owners can change
+    _sv_ev_chat_deliver(chatwin, new_win, message, message->type != PROF_MSG_TYPE_MUCPM, FALSE);
+    rosterwin_roster();
 }
 
-static void
-_sv_ev_incoming_omemo(ProfChatWin* chatwin, gboolean new_win, ProfMessage* message, gboolean logit)
+static ProfChatWin*
+_sv_ev_chat_open(const char* const barejid, gboolean start_omemo)
 {
+    ProfChatWin* chatwin = (ProfChatWin*)wins_new_chat(barejid);
+
 #ifdef HAVE_OMEMO
-    _clean_incoming_message(message);
-    chatwin_incoming_msg(chatwin, message, new_win);
-    log_database_add_incoming(message);
-    if (logit) {
-        chat_log_omemo_msg_in(message);
+    if (start_omemo && omemo_automatic_start(barejid)) {
+        omemo_start_session(barejid);
+        chatwin->is_omemo = TRUE;
     }
-    chatwin->pgp_recv = FALSE;
 #endif
+
+    return chatwin;
 }
 
+// The stages after classify, otr when the message may be part of an OTR
+// session, which carbons are not.
 static void
-_sv_ev_incoming_plain(ProfChatWin* chatwin, gboolean new_win, ProfMessage* message, gboolean logit)
+_sv_ev_chat_deliver(ProfChatWin* chatwin, gboolean new_win, ProfMessage* message, gboolean logit, gboolean otr)
 {
-    if (message->body) {
-        message->enc = PROF_MSG_ENC_NONE;
-        message->plain = strdup(message->body);
+    gint64 started = perf_start();
+    sv_ev_chat_kind_t kind = _sv_ev_chat_decrypt(chatwin, message, otr);
+    perf_stop(PERF_MSG_DECRYPT, started);
+    if (kind == SV_EV_CHAT_DROP) {
+        return;
+    }
+    if (kind != SV_EV_CHAT_OX) {
         _clean_incoming_message(message);
-        chatwin_incoming_msg(chatwin, message, new_win);
-        log_database_add_incoming(message);
-        if (logit) {
-            chat_log_msg_in(message);
-        }
-        chatwin->pgp_recv = FALSE;
     }
-}
 
-void
-sv_ev_incoming_message(ProfMessage* message)
-{
-    gboolean new_win = FALSE;
-    ProfChatWin* chatwin;
-    char* looking_for_jid = message->from_jid->barejid;
+    started = perf_start();
+    _sv_ev_chat_persist(message, kind, logit);
+    perf_stop(PERF_MSG_PERSIST, started);
 
-    if (message->is_mam) {
-        char* mybarejid = connection_get_barejid();
-        if (g_strcmp0(mybarejid, message->from_jid->barejid) == 0) {
-            if (message->to_jid) {
-                looking_for_jid = message->to_jid->barejid;
-            }
-        }
-        free(mybarejid);
-    }
+    // the display hooks of the plugins run within chatwin_incoming_msg()
+    started = perf_start();
+    chatwin_incoming_msg(chatwin, message, new_win);
+    perf_stop(PERF_MSG_RENDER, started);
 
-    chatwin = wins_get_chat(looking_for_jid);
+    _sv_ev_chat_release(chatwin, message, kind);
+}
 
-    if (!chatwin) {
-        ProfWin* window = wins_new_chat(looking_for_jid);
-        chatwin = (ProfChatWin*)window;
-        new_win = TRUE;
+// Leaves the text to show in message->plain. OX and OMEMO messages were
+// decrypted when they were parsed.
+static sv_ev_chat_kind_t
+_sv_ev_chat_decrypt(ProfChatWin* chatwin, ProfMessage* message, gboolean otr)
+{
+    if (message->enc == PROF_MSG_ENC_OX) {
+#ifdef HAVE_LIBGPGME
+        return SV_EV_CHAT_OX;
+#else
+        return SV_EV_CHAT_DROP;
+#endif
+    }
 
+    if (message->enc == PROF_MSG_ENC_OMEMO) {
 #ifdef HAVE_OMEMO
-        if (!message->is_mam) {
-            if (omemo_automatic_start(message->from_jid->barejid)) {
-                omemo_start_session(message->from_jid->barejid);
-                chatwin->is_omemo = TRUE;
-            }
-        }
+        return SV_EV_CHAT_OMEMO;
+#else
+        return SV_EV_CHAT_DROP;
 #endif
     }
 
-    if (message->enc == PROF_MSG_ENC_OX) {
-        _sv_ev_incoming_ox(chatwin, new_win, message, TRUE);
-    } else if (message->enc == PROF_MSG_ENC_OMEMO) {
-        _sv_ev_incoming_omemo(chatwin, new_win, message, TRUE);
-    } else if (message->encrypted) {
-        if (chatwin->is_otr) {
+    if (message->encrypted) {
+        if (otr && chatwin->is_otr) {
             win_println((ProfWin*)chatwin, THEME_DEFAULT, "-", "PGP encrypted message received whilst in OTR session.");
+            return SV_EV_CHAT_DROP;
+        }
+#ifdef HAVE_LIBGPGME
+        message->plain = _sv_ev_pgp_decrypt(message);
+        if (message->plain) {
+            message->enc = PROF_MSG_ENC_PGP;
+            return SV_EV_CHAT_PGP;
+        }
+        if (!message->body) {
+            log_error("Couldn't decrypt GPG message and body was empty");
+            return SV_EV_CHAT_DROP;
+        }
+        message->enc = PROF_MSG_ENC_NONE;
+        message->plain = strdup(message->body);
+        return SV_EV_CHAT_PGP_FAILED;
+#else
+        return SV_EV_CHAT_DROP;
+#endif
+    }
+
+#ifdef HAVE_LIBOTR
+    if (otr) {
+        gboolean decrypted = FALSE;
+        message->plain = otr_on_message_recv(message->from_jid->barejid, message->from_jid->resourcepart, message->body, &decrypted);
+        if (!message->plain) {
+            return SV_EV_CHAT_DROP;
+        }
+        if (decrypted) {
+            message->enc = PROF_MSG_ENC_OTR;
+            chatwin->pgp_send = FALSE;
         } else {
-            _sv_ev_incoming_pgp(chatwin, new_win, message, TRUE);
+            message->enc = PROF_MSG_ENC_NONE;
         }
-    } else {
-        // otr or plain
-        _sv_ev_incoming_otr(chatwin, new_win, message);
+        return SV_EV_CHAT_OTR;
     }
+#endif
 
-    rosterwin_roster();
-    return;
+    if (!message->body) {
+        return SV_EV_CHAT_DROP;
+    }
+    message->enc = PROF_MSG_ENC_NONE;
+    message->plain = strdup(message->body);
+
+    return SV_EV_CHAT_PLAIN;
 }
 
-void
-sv_ev_incoming_carbon(ProfMessage* message)
+static void
+_sv_ev_chat_persist(ProfMessage* message, sv_ev_chat_kind_t kind, gboolean logit)
 {
-    gboolean new_win = FALSE;
-    ProfChatWin* chatwin = wins_get_chat(message->from_jid->barejid);
-    if (!chatwin) {
-        ProfWin* window = wins_new_chat(message->from_jid->barejid);
-        chatwin = (ProfChatWin*)window;
-        new_win = TRUE;
+    log_database_add_incoming(message);
 
-#ifdef HAVE_OMEMO
-        if (omemo_automatic_start(message->from_jid->barejid)) {
-            omemo_start_session(message->from_jid->barejid);
-            chatwin->is_omemo = TRUE;
+    switch (kind) {
+    case SV_EV_CHAT_PGP:
+    case SV_EV_CHAT_OX:
+        if (logit) {
+            chat_log_pgp_msg_in(message);
         }
-#endif
+        break;
+    case SV_EV_CHAT_OMEMO:
+        if (logit) {
+            chat_log_omemo_msg_in(message);
+        }
+        break;
+    case SV_EV_CHAT_OTR:
+        chat_log_otr_msg_in(message);
+        break;
+    case SV_EV_CHAT_PGP_FAILED:
+        chat_log_msg_in(message);
+        break;
+    default:
+        if (logit) {
+            chat_log_msg_in(message);
+        }
+        break;
     }
+}
 
-    gboolean logit = TRUE;
-    if (message->type == PROF_MSG_TYPE_MUCPM) {
-        logit = FALSE;
-    }
+static void
+_sv_ev_chat_release(ProfChatWin* chatwin, ProfMessage* message, sv_ev_chat_kind_t kind)
+{
+    chatwin->pgp_recv = kind == SV_EV_CHAT_PGP || kind == SV_EV_CHAT_OX;
 
-    if (message->enc == PROF_MSG_ENC_OX) {
-        _sv_ev_incoming_ox(chatwin, new_win, message, logit);
-    } else if (message->encrypted) {
-        _sv_ev_incoming_pgp(chatwin, new_win, message, logit);
-    } else if (message->enc == PROF_MSG_ENC_OMEMO) {
-        _sv_ev_incoming_omemo(chatwin, new_win, message, logit);
-    } else {
-        _sv_ev_incoming_plain(chatwin, new_win, message, logit);
+    if (kind == SV_EV_CHAT_PGP) {
+#ifdef HAVE_LIBGPGME
+        p_gpg_free_decrypted(message->plain);
+#endif
+        message->plain = NULL;
+    } else if (kind == SV_EV_CHAT_OTR) {
+#ifdef HAVE_LIBOTR
+        otr_free_message(message->plain);
+#endif
+        message->plain = NULL;
+    } else if (kind == SV_EV_CHAT_OX) {
+        message->plain = NULL;
     }
-    rosterwin_roster();
-    return;
 }
 
 void
@@ -684,6 +882,16 @@ sv_ev_message_receipt(const char* const barejid, const char* const id)
     chatwin_receipt_received(chatwin, id);
 }
 
+void
+sv_ev_message_marker(const char* const barejid, const char* const id)
+{
+    ProfChatWin* chatwin = wins_get_chat(barejid);
+    if (!chatwin)
+        return;
+
+    chatwin_marker_received(chatwin, id);
+}
+
 void
 sv_ev_typing(char* barejid, char* resource)
 {
@@ -791,7 +999,7 @@ sv_ev_contact_offline(char* barejid, char* resource, char* status)
     }
 #endif
 
-    rosterwin_roster();
+    ui_redraw_roster();
     chat_session_remove(barejid);
 }
 
@@ -812,7 +1020,7 @@ sv_ev_contact_online(char* barejid, Resource* resource, GDateTime* last_activity
     }
 #endif
 
-    rosterwin_roster();
+    ui_redraw_roster();
     chat_session_remove(barejid);
 }
 
@@ -872,8 +1080,8 @@ sv_ev_room_occupant_offline(const char* const room, const char* const nick,
         privwin_occupant_offline(privwin);
     }
 
-    occupantswin_occupants(room);
-    rosterwin_roster();
+    ui_redraw_occupants(room);
+    ui_redraw_roster();
 }
 
 void
@@ -893,8 +1101,8 @@ sv_ev_room_occupent_kicked(const char* const room, const char* const nick, const
         privwin_occupant_kicked(privwin, actor, reason);
     }
 
-    occupantswin_occupants(room);
-    rosterwin_roster();
+    ui_redraw_occupants(room);
+    ui_redraw_roster();
 }
 
 void
@@ -918,8 +1126,8 @@ sv_ev_room_occupent_banned(const char* const room, const char* const nick, const
         privwin_occupant_banned(privwin, actor, reason);
     }
 
-    occupantswin_occupants(room);
-    rosterwin_roster();
+    ui_redraw_occupants(room);
+    ui_redraw_roster();
 }
 
 void
@@ -927,7 +1135,7 @@ sv_ev_roster_update(const char* const barejid, const char* const name,
                     GSList* groups, const char* const subscription, gboolean pending_out)
 {
     roster_update(barejid, name, groups, subscription, pending_out);
-    rosterwin_roster();
+    ui_redraw_roster();
 }
 
 void
@@ -960,6 +1168,7 @@ sv_ev_muc_self_online(const char* const room, const char* const nick, gboolean c
 
         // handle roster complete
     } else if (!muc_roster_complete(room)) {
+        _autojoin_finished(room, TRUE);
         if (muc_autojoin(room)) {
             ui_room_join(room, FALSE);
         } else {
@@ -1013,7 +1222,7 @@ sv_ev_muc_self_online(const char* const room, const char* const nick, gboolean c
             }
         }
 
-        rosterwin_roster();
+        ui_redraw_roster();
 
         // check for change in role/affiliation
     } else {
@@ -1034,7 +1243,7 @@ sv_ev_muc_self_online(const char* const room, const char* const nick, gboolean c
         }
     }
 
-    occupantswin_occupants(room);
+    ui_redraw_occupants(room);
 }
 
 void
@@ -1072,8 +1281,8 @@ sv_ev_muc_occupant_online(const char* const room, const char* const nick, const
         }
         free(old_nick);
 
-        occupantswin_occupants(room);
-        rosterwin_roster();
+        ui_redraw_occupants(room);
+        ui_redraw_roster();
         return;
     }
 
@@ -1095,8 +1304,8 @@ sv_ev_muc_occupant_online(const char* const room, const char* const nick, const
             }
         }
 
-        occupantswin_occupants(room);
-        rosterwin_roster();
+        ui_redraw_occupants(room);
+        ui_redraw_roster();
         return;
     }
 
@@ -1108,7 +1317,7 @@ sv_ev_muc_occupant_online(const char* const room, const char* const nick, const
             mucwin_occupant_presence(mucwin, nick, show, status);
         }
         g_free(muc_status_pref);
-        occupantswin_occupants(room);
+        ui_redraw_occupants(room);
 
         // presence unchanged, check for role/affiliation change
     } else {
@@ -1127,10 +1336,10 @@ sv_ev_muc_occupant_online(const char* const room, const char* const nick, const
                 mucwin_occupant_affiliation_change(mucwin, nick, affiliation, actor, reason);
             }
         }
-        occupantswin_occupants(room);
+        ui_redraw_occupants(room);
     }
 
-    rosterwin_roster();
+    ui_redraw_roster();
 }
 
 int
@@ -1265,6 +1474,105 @@ sv_ev_lastactivity_response(const char* const from, const int seconds, const cha
     jid_destroy(jidp);
 }
 
+// rooms joined at once while autojoining bookmarks, and how long to wait for each
+#define AUTOJOIN_WINDOW     5
+#define AUTOJOIN_TIMEOUT_MS 30000
+
+typedef struct autojoin_room_t
+{
+    char* barejid;
+    char* nick;
+    char* password;
+} AutojoinRoom;
+
+static GQueue* autojoin_queue = NULL;
+static GHashTable* autojoin_inflight = NULL;
+static int autojoin_total = 0;
+static int autojoin_done = 0;
+static int autojoin_failed = 0;
+
+static void
+_autojoin_room_free(AutojoinRoom* room)
+{
+    if (room) {
+        free(room->barejid);
+        free(room->nick);
+        free(room->password);
+        free(room);
+    }
+}
+
+static void _autojoin_send(void);
+
+static void
+_autojoin_finished(const char* const room, gboolean joined)
+{
+    if (autojoin_inflight == NULL || !g_hash_table_remove(autojoin_inflight, room)) {
+        return;
+    }
+
+    autojoin_done++;
+    if (!joined) {
+        autojoin_failed++;
+    }
+
+    if (autojoin_done == autojoin_total) {
+        if (autojoin_failed > 0) {
+            cons_show("Joined %d of %d bookmarked rooms.", autojoin_done - autojoin_failed, autojoin_total);
+        } else {
+            cons_show("Joined %d bookmarked rooms.", autojoin_total);
+        }
+        autojoin_total = 0;
+        autojoin_done = 0;
+        autojoin_failed = 0;
+    } else if (autojoin_done % 10 == 0) {
+        cons_show("Joining bookmarked rooms: %d/%d", autojoin_done, autojoin_total);
+    }
+
+    _autojoin_send();
+}
+
+static gboolean
+_autojoin_timed_out(void* data)
+{
+    const char* room = data;
+    log_warning("Autojoin of %s timed out", room);
+    _autojoin_finished(room, FALSE);
+
+    return FALSE;
+}
+
+// keeps up to AUTOJOIN_WINDOW joins waiting for their self presence
+static void
+_autojoin_send(void)
+{
+    while (autojoin_queue && !g_queue_is_empty(autojoin_queue)
+           && g_hash_table_size(autojoin_inflight) < AUTOJOIN_WINDOW) {
+        AutojoinRoom* room = g_queue_pop_head(autojoin_queue);
+
+        if (muc_active(room->barejid)) {
+            autojoin_done++;
+        } else {
+            log_debug("Autojoin %s with nick=%s", room->barejid, room->nick);
+            SchedulerTask* timeout = scheduler_add(AUTOJOIN_TIMEOUT_MS, _autojoin_timed_out, strdup(room->barejid), free);
+            g_hash_table_insert(autojoin_inflight, strdup(room->barejid), timeout);
+
+            presence_join_room(room->barejid, room->nick, room->password);
+            muc_join(room->barejid, room->nick, room->password, TRUE);
+            iq_room_affiliation_list(room->barejid, "member", false);
+            iq_room_affiliation_list(room->barejid, "admin", false);
+            iq_room_affiliation_list(room->barejid, "owner", false);
+        }
+        _autojoin_room_free(room);
+    }
+
+    if (autojoin_total > 0 && autojoin_done == autojoin_total) {
+        autojoin_total = 0;
+        autojoin_done = 0;
+        autojoin_failed = 0;
+    }
+}
+
 void
 sv_ev_bookmark_autojoin(Bookmark* bookmark)
 {
@@ -1272,27 +1580,51 @@ sv_ev_bookmark_autojoin(Bookmark* bookmark)
         return;
     }
 
-    char* nick = NULL;
+    if (muc_active(bookmark->barejid)) {
+        return;
+    }
+
+    AutojoinRoom* room = malloc(sizeof(AutojoinRoom));
+    room->barejid = strdup(bookmark->barejid);
+    room->password = bookmark->password ? strdup(bookmark->password) : NULL;
 
     if (bookmark->nick) {
-        nick = strdup(bookmark->nick);
+        room->nick = strdup(bookmark->nick);
     } else {
         char* account_name = session_get_account_name();
         ProfAccount* account = accounts_get_account(account_name);
-        nick = strdup(account->muc_nick);
+        room->nick = strdup(account->muc_nick);
         account_free(account);
     }
 
-    log_debug("Autojoin %s with nick=%s", bookmark->barejid, nick);
-    if (!muc_active(bookmark->barejid)) {
-        presence_join_room(bookmark->barejid, nick, bookmark->password);
-        muc_join(bookmark->barejid, nick, bookmark->password, TRUE);
-        iq_room_affiliation_list(bookmark->barejid, "member", false);
-        iq_room_affiliation_list(bookmark->barejid, "admin", false);
-        iq_room_affiliation_list(bookmark->barejid, "owner", false);
+    if (autojoin_queue == NULL) {
+        autojoin_queue = g_queue_new();
+        autojoin_inflight = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)scheduler_remove);
     }
+    g_queue_push_tail(autojoin_queue, room);
+    autojoin_total++;
+
+    _autojoin_send();
+}
 
-    free(nick);
+void
+sv_ev_bookmark_autojoin_clear(void)
+{
+    if (autojoin_queue) {
+        g_queue_free_full(autojoin_queue, (GDestroyNotify)_autojoin_room_free);
+        g_hash_table_destroy(autojoin_inflight);
+        autojoin_queue = NULL;
+        autojoin_inflight = NULL;
+    }
+    autojoin_total = 0;
+    autojoin_done = 0;
+    autojoin_failed = 0;
+}
+
+void
+sv_ev_room_join_error(const char* const room)
+{
+    _autojoin_finished(room, FALSE);
 }
 
 static void
@@ -1312,3 +1644,65 @@ _clean_incoming_message(ProfMessage* message)
     _cut(message, "\u200E");
     _cut(message, "\u200F");
 }
+
+#ifdef HAVE_LIBGPGME
+static gboolean
+_sv_ev_is_pgp(ProfMessage* message)
+{
+    return message->encrypted && message->enc != PROF_MSG_ENC_OX && message->enc != PROF_MSG_ENC_OMEMO;
+}
+
+// Hand the message to the PGP worker and handle it when the worker is done,
+// FALSE if it can be handled now.
+static gboolean
+_sv_ev_pgp_defer(ProfMessage* message, gboolean decrypt, sv_ev_message_handler handler)
+{
+    if (message == pgp_deferred_message) {
+        return FALSE;
+    }
+    if (!decrypt && !p_gpg_jobs_pending()) {
+        return FALSE;
+    }
+
+    PGPDeferred* deferred = malloc(sizeof(PGPDeferred));
+    deferred->message = message_copy(message);
+    deferred->handler = handler;
+    p_gpg_decrypt_async(decrypt ? message->encrypted : NULL, _sv_ev_pgp_deferred, deferred, (GDestroyNotify)_sv_ev_pgp_deferred_free);
+
+    return TRUE;
+}
+
+static void
+_sv_ev_pgp_deferred(char* plain, void* userdata)
+{
+    PGPDeferred* deferred = userdata;
+
+    pgp_deferred_message = deferred->message;
+    pgp_deferred_plain = plain ? g_strdup(plain) : NULL;
+    deferred->handler(deferred->message);
+    pgp_deferred_message = NULL;
+
+    g_free(pgp_deferred_plain);
+    pgp_deferred_plain = NULL;
+}
+
+static void
+_sv_ev_pgp_deferred_free(PGPDeferred* deferred)
+{
+    message_free(deferred->message);
+    free(deferred);
+}
+
+// The text of a PGP message, decrypted by the worker for a deferred message.
+static char*
+_sv_ev_pgp_decrypt(ProfMessage* message)
+{
+    if (message == pgp_deferred_message) {
+        char* plain = pgp_deferred_plain;
+        pgp_deferred_plain = NULL;
+        return plain;
+    }
+
+    return p_gpg_decrypt(message->encrypted);
+}
+#endif
@@ -41,6 +41,8 @@
 
 void sv_ev_login_account_success(char* account_name, gboolean secured);
 void sv_ev_lost_connection(void);
+void sv_ev_stream_suspended(void);
+void sv_ev_stream_resumed(gboolean secured);
 void sv_ev_failed_login(void);
 void sv_ev_room_invite(jabber_invite_t invite_type,
                        const char* const invitor, const char* const room,
@@ -49,6 +51,7 @@ void sv_ev_room_broadcast(const char* const room_jid, const char* const message)
 void sv_ev_room_subject(const char* const room, const char* const nick, const char* const subject);
 void sv_ev_room_history(ProfMessage* message);
 void sv_ev_room_message(ProfMessage* message);
+void sv_ev_room_slow_flush(const char* const roomjid);
 void sv_ev_incoming_message(ProfMessage* message);
 void sv_ev_incoming_private_message(ProfMessage* message);
 void sv_ev_delayed_private_message(ProfMessage* message);
@@ -59,6 +62,7 @@ void sv_ev_activity(char* barejid, char* resource, gboolean send_states);
 void sv_ev_gone(const char* const barejid, const char* const resource);
 void sv_ev_subscription(const char* from, jabber_subscr_t type);
 void sv_ev_message_receipt(const char* const barejid, const char* const id);
+void sv_ev_message_marker(const char* const barejid, const char* const id);
 void sv_ev_contact_offline(char* contact, char* resource, char* status);
 void sv_ev_contact_online(char* contact, Resource* resource, GDateTime* last_activity, char* pgpkey);
 void sv_ev_leave_room(const char* const room);
@@ -89,5 +93,7 @@ void sv_ev_connection_features_received(void);
 int sv_ev_certfail(const char* const errormsg, TLSCertificate* cert);
 void sv_ev_lastactivity_response(const char* const from, const int seconds, const char* const msg);
 void sv_ev_bookmark_autojoin(Bookmark* bookmark);
+void sv_ev_bookmark_autojoin_clear(void);
+void sv_ev_room_join_error(const char* const room);
 
 #endif
@@ -39,9 +39,12 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "glib.h"
@@ -51,9 +54,18 @@
 #include "common.h"
 #include "config/files.h"
 #include "config/preferences.h"
+#include "tools/logcompress.h"
+#include "tools/logformat.h"
+#include "tools/timefmt.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/muc.h"
 
+// the functions behind the macros of log.h
+#undef log_debug
+#undef log_info
+#undef log_warning
+#undef log_error
+
 #define PROF "prof"
 
 static FILE* logp;
@@ -61,13 +73,49 @@ static gchar* mainlogfile = NULL;
 static gboolean user_provided_log = FALSE;
 
 static GTimeZone* tz;
-static GDateTime* dt;
 static log_level_t level_filter;
 
+// lines waiting for the log writer thread, log_msg blocks while the queue
+// is full so nothing is dropped
+#define LOG_QUEUE_MAX 4096
+
+static pthread_t log_writer;
+static gboolean log_writer_running = FALSE;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_lines_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t log_space_cond = PTHREAD_COND_INITIALIZER;
+static GQueue* log_lines = NULL;
+
+typedef struct log_entry_t
+{
+    gint64 time_us;
+    log_level_t level;
+    const char* area; // interned
+    gchar* msg;
+} LogEntry;
+
+// set when writing the binary format, only used by the writer
+static LogFormatEncoder* log_encoder = NULL;
+
+// raw size at which the binary log writes a frame, it also writes one when
+// no line came for a second
+#define LOG_FRAME_SIZE (64 * 1024)
+
+// the formatted time of the last line, reused within the same second
+static gint64 log_date_second = -1;
+static gchar log_date[32];
+
+// size at which the writer rotates the main log, 0 when rotation is off
+static gint log_rotate_size = 0;
+
 static GHashTable* logs;
 static GHashTable* groupchat_logs;
 static GDateTime* session_started;
 
+// compresses chat logs of past days off the main thread, see /logging compress
+static GThreadPool* compress_pool = NULL;
+static gint compress_stop = 0;
+
 static int stderr_inited;
 static log_level_t stderr_level;
 static int stderr_pipe[2];
@@ -79,36 +127,72 @@ enum {
     STDERR_RETRY_NR = 5,
 };
 
+// maximum number of chat log files kept open at the same time
+#define CHAT_LOG_MAX_OPEN 32
+// pending bytes of one chat log that are written out before the next flush
+#define CHAT_LOG_PENDING_MAX 65536
+
 struct dated_chat_log
 {
     gchar* filename;
     GDateTime* date;
+    FILE* fp;         // open append handle, NULL when closed or evicted
+    gint64 last_used; // monotonic time of last write, used for LRU eviction
+    GString* pending; // lines not yet written to the file
 };
 
+static int open_chat_logs = 0;
+static gint64 last_chat_log_flush = 0;
+
 static gboolean _log_roll_needed(struct dated_chat_log* dated_log);
 static struct dated_chat_log* _create_log(const char* const other, const char* const login);
 static struct dated_chat_log* _create_groupchat_log(const char* const room, const char* const login);
 static void _free_chat_log(struct dated_chat_log* dated_log);
+static FILE* _chat_log_file(struct dated_chat_log* dated_log);
+static void _chat_log_close_file(struct dated_chat_log* dated_log);
+static void _chat_log_written(struct dated_chat_log* dated_log);
+static gboolean _chat_log_deleted(struct dated_chat_log* dated_log);
+static void _chat_log_write_pending(struct dated_chat_log* dated_log);
 static gboolean _key_equals(void* key1, void* key2);
 static char* _get_log_filename(const char* const other, const char* const login, GDateTime* dt, gboolean create);
 static char* _get_groupchat_log_filename(const char* const room, const char* const login, GDateTime* dt,
                                          gboolean create);
 static void _rotate_log_file(void);
+static void _chat_log_compress(gchar* filename);
+static void* _log_writer_loop(void* data);
+static void _log_write_lines(GQueue* lines);
+static void _log_open_file(void);
+static void _log_write_frame(void);
 static char* _log_string_from_level(log_level_t level);
+static void _log_vmsg(log_level_t level, const char* const msg, va_list arg);
+static void _log_msg_take(log_level_t level, const char* const area, gchar* msg);
 static void _chat_log_chat(const char* const login, const char* const other, const gchar* const msg,
-                           chat_log_direction_t direction, GDateTime* timestamp, const char* const resourcepart);
+                           chat_log_direction_t direction, gint64 timestamp, const char* const resourcepart);
 static void _groupchat_log_chat(const gchar* const login, const gchar* const room, const gchar* const nick,
                                 const gchar* const msg);
 
+gboolean
+log_level_enabled(log_level_t level)
+{
+    return level >= level_filter;
+}
+
+static void
+_log_vmsg(log_level_t level, const char* const msg, va_list arg)
+{
+    if (level < level_filter) {
+        return;
+    }
+
+    _log_msg_take(level, PROF, g_strdup_vprintf(msg, arg));
+}
+
 void
 log_debug(const char* const msg, ...)
 {
     va_list arg;
     va_start(arg, msg);
-    GString* fmt_msg = g_string_new(NULL);
-    g_string_vprintf(fmt_msg, msg, arg);
-    log_msg(PROF_LEVEL_DEBUG, PROF, fmt_msg->str);
-    g_string_free(fmt_msg, TRUE);
+    _log_vmsg(PROF_LEVEL_DEBUG, msg, arg);
     va_end(arg);
 }
 
@@ -117,10 +201,7 @@ log_info(const char* const msg, ...)
 {
     va_list arg;
     va_start(arg, msg);
-    GString* fmt_msg = g_string_new(NULL);
-    g_string_vprintf(fmt_msg, msg, arg);
-    log_msg(PROF_LEVEL_INFO, PROF, fmt_msg->str);
-    g_string_free(fmt_msg, TRUE);
+    _log_vmsg(PROF_LEVEL_INFO, msg, arg);
     va_end(arg);
 }
 
@@ -129,10 +210,7 @@ log_warning(const char* const msg, ...)
 {
     va_list arg;
     va_start(arg, msg);
-    GString* fmt_msg = g_string_new(NULL);
-    g_string_vprintf(fmt_msg, msg, arg);
-    log_msg(PROF_LEVEL_WARN, PROF, fmt_msg->str);
-    g_string_free(fmt_msg, TRUE);
+    _log_vmsg(PROF_LEVEL_WARN, msg, arg);
     va_end(arg);
 }
 
@@ -141,15 +219,12 @@ log_error(const char* const msg, ...)
 {
     va_list arg;
     va_start(arg, msg);
-    GString* fmt_msg = g_string_new(NULL);
-    g_string_vprintf(fmt_msg, msg, arg);
-    log_msg(PROF_LEVEL_ERROR, PROF, fmt_msg->str);
-    g_string_free(fmt_msg, TRUE);
+    _log_vmsg(PROF_LEVEL_ERROR, msg, arg);
     va_end(arg);
 }
 
 void
-log_init(log_level_t filter, char* log_file)
+log_init(log_level_t filter, char* log_file, gboolean binary)
 {
     level_filter = filter;
     tz = g_time_zone_new_local();
@@ -159,12 +234,30 @@ log_init(log_level_t filter, char* log_file)
     }
 
     gchar* lf = files_get_log_file(log_file);
+    if (binary) {
+        log_encoder = logformat_encoder_new();
+        mainlogfile = user_provided_log ? g_strdup(lf) : g_strdup_printf("%s.bin", lf);
+    } else {
+        mainlogfile = g_strdup(lf);
+    }
+    g_free(lf);
 
-    logp = fopen(lf, "a");
-    g_chmod(lf, S_IRUSR | S_IWUSR);
-    mainlogfile = g_strdup(lf);
+    _log_open_file();
 
-    g_free(lf);
+    log_rotate_update();
+
+    log_lines = g_queue_new();
+    log_writer_running = logp && pthread_create(&log_writer, NULL, _log_writer_loop, NULL) == 0;
+}
+
+void
+log_rotate_update(void)
+{
+    gint size = 0;
+    if (prefs_get_boolean(PREF_LOG_ROTATE) && !user_provided_log) {
+        size = prefs_get_max_log_size();
+    }
+    g_atomic_int_set(&log_rotate_size, size);
 }
 
 const char*
@@ -182,37 +275,218 @@ log_get_filter(void)
 void
 log_close(void)
 {
+    // the writer drains the queue before it stops
+    pthread_mutex_lock(&log_lock);
+    gboolean running = log_writer_running;
+    log_writer_running = FALSE;
+    pthread_cond_broadcast(&log_lines_cond);
+    pthread_cond_broadcast(&log_space_cond);
+    pthread_mutex_unlock(&log_lock);
+    if (running) {
+        pthread_join(log_writer, NULL);
+    }
+
+    pthread_mutex_lock(&log_lock);
+    if (log_lines) {
+        _log_write_lines(log_lines);
+        g_queue_free(log_lines);
+        log_lines = NULL;
+    }
+    _log_write_frame();
+    if (logp) {
+        fclose(logp);
+        logp = NULL;
+    }
+    logformat_encoder_free(log_encoder);
+    log_encoder = NULL;
+    pthread_mutex_unlock(&log_lock);
+
     g_free(mainlogfile);
     mainlogfile = NULL;
     g_time_zone_unref(tz);
-    if (logp) {
-        fclose(logp);
+}
+
+static void
+_log_entry_free(LogEntry* entry)
+{
+    g_free(entry->msg);
+    g_free(entry);
+}
+
+static void
+_log_open_file(void)
+{
+    logp = fopen(mainlogfile, "a");
+    g_chmod(mainlogfile, S_IRUSR | S_IWUSR);
+
+    // a binary log starts with its magic, appending to one adds frames
+    if (logp && log_encoder) {
+        fseek(logp, 0, SEEK_END);
+        if (ftell(logp) == 0) {
+            fputs(LOGFORMAT_MAGIC, logp);
+            fflush(logp);
+        }
     }
 }
 
-void
-log_msg(log_level_t level, const char* const area, const char* const msg)
+// the functions below run on the writer thread, or under log_lock when
+// there is none
+
+static void
+_log_write_entry(LogEntry* entry)
+{
+    if (log_encoder) {
+        logformat_encoder_add(log_encoder, entry->time_us, entry->area, _log_string_from_level(entry->level), entry->msg);
+        return;
+    }
+
+    gint64 second = entry->time_us / G_USEC_PER_SEC;
+    if (second != log_date_second) {
+        GDateTime* utc = g_date_time_new_from_unix_utc(second);
+        GDateTime* local = g_date_time_to_timezone(utc, tz);
+        gchar* date_fmt = g_date_time_format(local, "%d/%m/%Y %H:%M:%S");
+        g_strlcpy(log_date, date_fmt, sizeof(log_date));
+        g_free(date_fmt);
+        g_date_time_unref(local);
+        g_date_time_unref(utc);
+        log_date_second = second;
+    }
+
+    fprintf(logp, "%s: %s: %s: %s\n", log_date, entry->area, _log_string_from_level(entry->level), entry->msg);
+}
+
+static void
+_log_write_frame(void)
 {
-    if (level >= level_filter && logp) {
-        dt = g_date_time_new_now(tz);
+    if (!log_encoder || !logp) {
+        return;
+    }
 
-        char* level_str = _log_string_from_level(level);
+    GBytes* frame = logformat_encoder_frame(log_encoder);
+    if (frame) {
+        gsize size;
+        gconstpointer data = g_bytes_get_data(frame, &size);
+        fwrite(data, 1, size, logp);
+        fflush(logp);
+        g_bytes_unref(frame);
+    }
+}
 
-        gchar* date_fmt = g_date_time_format(dt, "%d/%m/%Y %H:%M:%S");
+static void
+_log_rotate_check(void)
+{
+    gint rotate_size = g_atomic_int_get(&log_rotate_size);
+    if (logp && rotate_size > 0) {
+        long result = ftell(logp);
+        if (result != -1 && result >= rotate_size) {
+            _rotate_log_file();
+        }
+    }
+}
 
-        fprintf(logp, "%s: %s: %s: %s\n", date_fmt, area, level_str, msg);
-        g_date_time_unref(dt);
+static void
+_log_write_lines(GQueue* lines)
+{
+    LogEntry* entry;
+    while ((entry = g_queue_pop_head(lines))) {
+        if (logp) {
+            _log_write_entry(entry);
+        }
+        _log_entry_free(entry);
+    }
+    if (!logp) {
+        return;
+    }
 
+    if (!log_encoder) {
         fflush(logp);
-        g_free(date_fmt);
+    } else if (logformat_encoder_pending(log_encoder) >= LOG_FRAME_SIZE) {
+        _log_write_frame();
+    }
+    _log_rotate_check();
+}
 
-        if (prefs_get_boolean(PREF_LOG_ROTATE) && !user_provided_log) {
-            long result = ftell(logp);
-            if (result != -1 && result >= prefs_get_max_log_size()) {
-                _rotate_log_file();
+static void*
+_log_writer_loop(void* data)
+{
+    GQueue batch;
+
+    pthread_mutex_lock(&log_lock);
+    while (TRUE) {
+        while (log_writer_running && g_queue_is_empty(log_lines)) {
+            if (log_encoder && logformat_encoder_pending(log_encoder) > 0) {
+                // write out what is pending once the log has gone quiet
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_sec += 1;
+                if (pthread_cond_timedwait(&log_lines_cond, &log_lock, &deadline) == ETIMEDOUT) {
+                    pthread_mutex_unlock(&log_lock);
+                    _log_write_frame();
+                    _log_rotate_check();
+                    pthread_mutex_lock(&log_lock);
+                }
+            } else {
+                pthread_cond_wait(&log_lines_cond, &log_lock);
             }
         }
+        if (g_queue_is_empty(log_lines)) {
+            break;
+        }
+
+        // take everything queued so far and write it without the lock
+        batch = *log_lines;
+        g_queue_init(log_lines);
+        pthread_cond_broadcast(&log_space_cond);
+        pthread_mutex_unlock(&log_lock);
+
+        _log_write_lines(&batch);
+
+        pthread_mutex_lock(&log_lock);
     }
+    pthread_mutex_unlock(&log_lock);
+
+    return NULL;
+}
+
+void
+log_msg(log_level_t level, const char* const area, const char* const msg)
+{
+    if (level < level_filter) {
+        return;
+    }
+
+    _log_msg_take(level, area, g_strdup(msg));
+}
+
+// Queues msg for the writer, which frees it
+static void
+_log_msg_take(log_level_t level, const char* const area, gchar* msg)
+{
+    LogEntry* entry = g_new(LogEntry, 1);
+    entry->time_us = g_get_real_time();
+    entry->level = level;
+    entry->area = g_intern_string(area);
+    entry->msg = msg;
+
+    pthread_mutex_lock(&log_lock);
+    if (!log_lines) {
+        pthread_mutex_unlock(&log_lock);
+        _log_entry_free(entry);
+        return;
+    }
+
+    g_queue_push_tail(log_lines, entry);
+
+    if (log_writer_running) {
+        pthread_cond_signal(&log_lines_cond);
+        while (log_writer_running && log_lines->length >= LOG_QUEUE_MAX) {
+            pthread_cond_wait(&log_space_cond, &log_lock);
+        }
+    } else {
+        // no writer thread, write straight away
+        _log_write_lines(log_lines);
+    }
+    pthread_mutex_unlock(&log_lock);
 }
 
 log_level_t
@@ -232,29 +506,31 @@ log_level_from_string(char* log_level)
     }
 }
 
+// runs where the lines are written, it reopens logp under the same name
 static void
 _rotate_log_file(void)
 {
-    gchar* log_file = g_strdup(mainlogfile);
-    size_t len = strlen(log_file);
+    size_t len = strlen(mainlogfile);
     gchar* log_file_new = malloc(len + 4);
 
     // find an empty name. from .log -> log.01 -> log.99
     for (int i = 1; i < 100; i++) {
-        g_sprintf(log_file_new, "%s.%02d", log_file, i);
+        g_sprintf(log_file_new, "%s.%02d", mainlogfile, i);
         if (!g_file_test(log_file_new, G_FILE_TEST_EXISTS))
             break;
     }
 
-    log_close();
-
-    rename(log_file, log_file_new);
-
-    log_init(log_get_filter(), NULL);
+    fclose(logp);
+    rename(mainlogfile, log_file_new);
+    _log_open_file();
 
     free(log_file_new);
-    free(log_file);
-    log_info("Log has been rotated");
+
+    if (logp) {
+        LogEntry rotated = { g_get_real_time(), PROF_LEVEL_INFO, PROF, "Log has been rotated" };
+        _log_write_entry(&rotated);
+        fflush(logp);
+    }
 }
 
 void
@@ -264,6 +540,7 @@ chat_log_init(void)
     log_info("Initialising chat logs");
     logs = g_hash_table_new_full(g_str_hash, (GEqualFunc)_key_equals, free,
                                  (GDestroyNotify)_free_chat_log);
+    chat_log_compress_sweep();
 }
 
 void
@@ -279,7 +556,7 @@ chat_log_msg_out(const char* const barejid, const char* const msg, const char* c
 {
     if (prefs_get_boolean(PREF_CHLOG)) {
         char* mybarejid = connection_get_barejid();
-        _chat_log_chat(mybarejid, barejid, msg, PROF_OUT_LOG, NULL, resource);
+        _chat_log_chat(mybarejid, barejid, msg, PROF_OUT_LOG, 0, resource);
         free(mybarejid);
     }
 }
@@ -291,9 +568,9 @@ chat_log_otr_msg_out(const char* const barejid, const char* const msg, const cha
         char* mybarejid = connection_get_barejid();
         char* pref_otr_log = prefs_get_string(PREF_OTR_LOG);
         if (strcmp(pref_otr_log, "on") == 0) {
-            _chat_log_chat(mybarejid, barejid, msg, PROF_OUT_LOG, NULL, resource);
+            _chat_log_chat(mybarejid, barejid, msg, PROF_OUT_LOG, 0, resource);
         } else if (strcmp(pref_otr_log, "redact") == 0) {
-            _chat_log_chat(mybarejid, barejid, "[redacted]", PROF_OUT_LOG, NULL, resource);
+            _chat_log_chat(mybarejid, barejid, "[redacted]", PROF_OUT_LOG, 0, resource);
         }
         g_free(pref_otr_log);
         free(mybarejid);
@@ -307,9 +584,9 @@ chat_log_pgp_msg_out(const char* const barejid, const char* const msg, const cha
         char* mybarejid = connection_get_barejid();
         char* pref_pgp_log = prefs_get_string(PREF_PGP_LOG);
         if (strcmp(pref_pgp_log, "on") == 0) {
-            _chat_log_chat(mybarejid, barejid, msg, PROF_OUT_LOG, NULL, resource);
+            _chat_log_chat(mybarejid, barejid, msg, PROF_OUT_LOG, 0, resource);
         } else if (strcmp(pref_pgp_log, "redact") == 0) {
-            _chat_log_chat(mybarejid, barejid, "[redacted]", PROF_OUT_LOG, NULL, resource);
+            _chat_log_chat(mybarejid, barejid, "[redacted]", PROF_OUT_LOG, 0, resource);
         }
         g_free(pref_pgp_log);
         free(mybarejid);
@@ -323,9 +600,9 @@ chat_log_omemo_msg_out(const char* const barejid, const char* const msg, const c
         char* mybarejid = connection_get_barejid();
         char* pref_omemo_log = prefs_get_string(PREF_OMEMO_LOG);
         if (strcmp(pref_omemo_log, "on") == 0) {
-            _chat_log_chat(mybarejid, barejid, msg, PROF_OUT_LOG, NULL, resource);
+            _chat_log_chat(mybarejid, barejid, msg, PROF_OUT_LOG, 0, resource);
         } else if (strcmp(pref_omemo_log, "redact") == 0) {
-            _chat_log_chat(mybarejid, barejid, "[redacted]", PROF_OUT_LOG, NULL, resource);
+            _chat_log_chat(mybarejid, barejid, "[redacted]", PROF_OUT_LOG, 0, resource);
         }
         g_free(pref_omemo_log);
         free(mybarejid);
@@ -422,7 +699,7 @@ chat_log_msg_in(ProfMessage* message)
 
 static void
 _chat_log_chat(const char* const login, const char* const other, const char* const msg,
-               chat_log_direction_t direction, GDateTime* timestamp, const char* const resourcepart)
+               chat_log_direction_t direction, gint64 timestamp, const char* const resourcepart)
 {
     char* other_name;
     GString* other_str = NULL;
@@ -444,61 +721,46 @@ _chat_log_chat(const char* const login, const char* const other, const char* con
         dated_log = _create_log(other_name, login);
         g_hash_table_insert(logs, strdup(other_name), dated_log);
 
-        // log entry exists but file removed
-    } else if (!g_file_test(dated_log->filename, G_FILE_TEST_EXISTS)) {
-        dated_log = _create_log(other_name, login);
-        g_hash_table_replace(logs, strdup(other_name), dated_log);
-
         // log file needs rolling
     } else if (_log_roll_needed(dated_log)) {
+        gchar* rolled = g_strdup(dated_log->filename);
         dated_log = _create_log(other_name, login);
         g_hash_table_replace(logs, strdup(other_name), dated_log);
+        _chat_log_compress(rolled);
     }
 
     if (resourcepart) {
         g_string_free(other_str, TRUE);
     }
 
-    if (timestamp == NULL) {
-        timestamp = g_date_time_new_now_local();
-    } else {
-        g_date_time_ref(timestamp);
-    }
-
-    gchar* date_fmt = g_date_time_format(timestamp, "%H:%M:%S");
-    FILE* chatlogp = fopen(dated_log->filename, "a");
-    g_chmod(dated_log->filename, S_IRUSR | S_IWUSR);
-    if (chatlogp) {
-        if (direction == PROF_IN_LOG) {
-            if (strncmp(msg, "/me ", 4) == 0) {
-                if (resourcepart) {
-                    fprintf(chatlogp, "%s - *%s %s\n", date_fmt, resourcepart, msg + 4);
-                } else {
-                    fprintf(chatlogp, "%s - *%s %s\n", date_fmt, other, msg + 4);
-                }
+    GDateTime* time = timefmt_local(timestamp ? timestamp : g_get_real_time());
+    gchar* date_fmt = g_date_time_format(time, "%H:%M:%S");
+    g_date_time_unref(time);
+    GString* pending = dated_log->pending;
+    if (direction == PROF_IN_LOG) {
+        if (strncmp(msg, "/me ", 4) == 0) {
+            if (resourcepart) {
+                g_string_append_printf(pending, "%s - *%s %s\n", date_fmt, resourcepart, msg + 4);
             } else {
-                if (resourcepart) {
-                    fprintf(chatlogp, "%s - %s: %s\n", date_fmt, resourcepart, msg);
-                } else {
-                    fprintf(chatlogp, "%s - %s: %s\n", date_fmt, other, msg);
-                }
+                g_string_append_printf(pending, "%s - *%s %s\n", date_fmt, other, msg + 4);
             }
         } else {
-            if (strncmp(msg, "/me ", 4) == 0) {
-                fprintf(chatlogp, "%s - *me %s\n", date_fmt, msg + 4);
+            if (resourcepart) {
+                g_string_append_printf(pending, "%s - %s: %s\n", date_fmt, resourcepart, msg);
             } else {
-                fprintf(chatlogp, "%s - me: %s\n", date_fmt, msg);
+                g_string_append_printf(pending, "%s - %s: %s\n", date_fmt, other, msg);
             }
         }
-        fflush(chatlogp);
-        int result = fclose(chatlogp);
-        if (result == EOF) {
-            log_error("Error closing file %s, errno = %d", dated_log->filename, errno);
+    } else {
+        if (strncmp(msg, "/me ", 4) == 0) {
+            g_string_append_printf(pending, "%s - *me %s\n", date_fmt, msg + 4);
+        } else {
+            g_string_append_printf(pending, "%s - me: %s\n", date_fmt, msg);
         }
     }
+    _chat_log_written(dated_log);
 
     g_free(date_fmt);
-    g_date_time_unref(timestamp);
 }
 
 void
@@ -572,39 +834,135 @@ _groupchat_log_chat(const gchar* const login, const gchar* const room, const gch
 
         // log exists but needs rolling
     } else if (_log_roll_needed(dated_log)) {
+        gchar* rolled = g_strdup(dated_log->filename);
         dated_log = _create_groupchat_log(room, login);
-        g_hash_table_replace(logs, strdup(room), dated_log);
+        g_hash_table_replace(groupchat_logs, strdup(room), dated_log);
+        _chat_log_compress(rolled);
     }
 
     GDateTime* dt_tmp = g_date_time_new_now_local();
 
     gchar* date_fmt = g_date_time_format(dt_tmp, "%H:%M:%S");
 
-    FILE* grpchatlogp = fopen(dated_log->filename, "a");
-    g_chmod(dated_log->filename, S_IRUSR | S_IWUSR);
-    if (grpchatlogp) {
-        if (strncmp(msg, "/me ", 4) == 0) {
-            fprintf(grpchatlogp, "%s - *%s %s\n", date_fmt, nick, msg + 4);
-        } else {
-            fprintf(grpchatlogp, "%s - %s: %s\n", date_fmt, nick, msg);
+    if (strncmp(msg, "/me ", 4) == 0) {
+        g_string_append_printf(dated_log->pending, "%s - *%s %s\n", date_fmt, nick, msg + 4);
+    } else {
+        g_string_append_printf(dated_log->pending, "%s - %s: %s\n", date_fmt, nick, msg);
+    }
+    _chat_log_written(dated_log);
+
+    g_free(date_fmt);
+    g_date_time_unref(dt_tmp);
+}
+
+static void
+_chat_log_flush_entry(gpointer key, gpointer value, gpointer userdata)
+{
+    _chat_log_write_pending(value);
+}
+
+void
+chat_log_flush(void)
+{
+    if (logs) {
+        g_hash_table_foreach(logs, _chat_log_flush_entry, NULL);
+    }
+    if (groupchat_logs) {
+        g_hash_table_foreach(groupchat_logs, _chat_log_flush_entry, NULL);
+    }
+    last_chat_log_flush = g_get_monotonic_time();
+}
+
+void
+chat_log_flush_check(void)
+{
+    gint64 now = g_get_monotonic_time();
+    if (now - last_chat_log_flush >= prefs_get_chlog_flush() * G_TIME_SPAN_SECOND) {
+        chat_log_flush();
+    }
+}
+
+// the day files of chatlogs/<account>/<contact>/ and chatlogs/<account>/rooms/<room>/
+static void
+_chat_log_sweep(const char* const dir, int depth, const char* const before)
+{
+    GDir* gdir = g_dir_open(dir, 0, NULL);
+    if (!gdir) {
+        return;
+    }
+
+    const char* name;
+    while ((name = g_dir_read_name(gdir)) != NULL && !g_atomic_int_get(&compress_stop)) {
+        gchar* path = g_build_filename(dir, name, NULL);
+        if (depth < 3 && g_file_test(path, G_FILE_TEST_IS_DIR)) {
+            _chat_log_sweep(path, depth + 1, before);
+        } else if (depth >= 2 && strlen(name) == strlen(before) && g_str_has_suffix(name, ".log")
+                   && strcmp(name, before) < 0 && !logcompress_file(path)) {
+            log_warning("Unable to compress chat log %s", path);
         }
+        g_free(path);
+    }
+    g_dir_close(gdir);
+}
 
-        fflush(grpchatlogp);
-        int result = fclose(grpchatlogp);
-        if (result == EOF) {
-            log_error("Error closing file %s, errno = %d", dated_log->filename, errno);
+// a chat log that rolled over, or the chatlogs directory to look for all of them
+static void
+_chat_log_compress_task(gpointer data, gpointer user_data)
+{
+    gchar* path = data;
+
+    if (!g_atomic_int_get(&compress_stop)) {
+        if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+            // yesterday's logs may still be open until they roll, those are compressed then
+            GDateTime* now = g_date_time_new_now_local();
+            GDateTime* yesterday = g_date_time_add_days(now, -1);
+            gchar* before = g_date_time_format(yesterday, "%Y_%m_%d.log");
+            _chat_log_sweep(path, 0, before);
+            g_free(before);
+            g_date_time_unref(yesterday);
+            g_date_time_unref(now);
+        } else if (!logcompress_file(path)) {
+            log_warning("Unable to compress chat log %s", path);
         }
     }
+    g_free(path);
+}
 
-    g_free(date_fmt);
-    g_date_time_unref(dt_tmp);
+// takes filename
+static void
+_chat_log_compress(gchar* filename)
+{
+    if (!prefs_get_boolean(PREF_CHLOG_COMPRESS)) {
+        g_free(filename);
+        return;
+    }
+
+    if (!compress_pool) {
+        g_atomic_int_set(&compress_stop, 0);
+        compress_pool = g_thread_pool_new(_chat_log_compress_task, NULL, 1, FALSE, NULL);
+    }
+    g_thread_pool_push(compress_pool, filename, NULL);
+}
+
+void
+chat_log_compress_sweep(void)
+{
+    _chat_log_compress(files_get_data_path(DIR_CHATLOGS));
 }
 
 void
 chat_log_close(void)
 {
+    if (compress_pool) {
+        // what is left waits for the next start
+        g_atomic_int_set(&compress_stop, 1);
+        g_thread_pool_free(compress_pool, FALSE, TRUE);
+        compress_pool = NULL;
+    }
     g_hash_table_destroy(logs);
     g_hash_table_destroy(groupchat_logs);
+    logs = NULL;
+    groupchat_logs = NULL;
     g_date_time_unref(session_started);
 }
 
@@ -617,6 +975,9 @@ _create_log(const char* const other, const char* const login)
     struct dated_chat_log* new_log = malloc(sizeof(struct dated_chat_log));
     new_log->filename = strdup(filename);
     new_log->date = now;
+    new_log->fp = NULL;
+    new_log->last_used = 0;
+    new_log->pending = g_string_new(NULL);
 
     free(filename);
 
@@ -632,6 +993,9 @@ _create_groupchat_log(const char* const room, const char* const login)
     struct dated_chat_log* new_log = malloc(sizeof(struct dated_chat_log));
     new_log->filename = strdup(filename);
     new_log->date = now;
+    new_log->fp = NULL;
+    new_log->last_used = 0;
+    new_log->pending = g_string_new(NULL);
 
     free(filename);
 
@@ -651,10 +1015,130 @@ _log_roll_needed(struct dated_chat_log* dated_log)
     return result;
 }
 
+static void
+_find_lru_log(gpointer key, gpointer value, gpointer userdata)
+{
+    struct dated_chat_log* dated_log = value;
+    struct dated_chat_log** lru = userdata;
+
+    if (dated_log->fp && (*lru == NULL || dated_log->last_used < (*lru)->last_used)) {
+        *lru = dated_log;
+    }
+}
+
+// close the least recently written log file to stay within CHAT_LOG_MAX_OPEN
+static void
+_chat_log_evict(void)
+{
+    struct dated_chat_log* lru = NULL;
+    g_hash_table_foreach(logs, _find_lru_log, &lru);
+    g_hash_table_foreach(groupchat_logs, _find_lru_log, &lru);
+
+    if (lru) {
+        _chat_log_close_file(lru);
+    }
+}
+
+static FILE*
+_chat_log_file(struct dated_chat_log* dated_log)
+{
+    if (dated_log->fp) {
+        return dated_log->fp;
+    }
+
+    if (open_chat_logs >= CHAT_LOG_MAX_OPEN) {
+        _chat_log_evict();
+    }
+
+    // the directory may have been removed since the log was created
+    gchar* dir = g_path_get_dirname(dated_log->filename);
+    if (!mkdir_recursive(dir)) {
+        log_error("Error creating directory %s", dir);
+    }
+    g_free(dir);
+
+    dated_log->fp = fopen(dated_log->filename, "a");
+    if (dated_log->fp) {
+        g_chmod(dated_log->filename, S_IRUSR | S_IWUSR);
+        open_chat_logs++;
+    } else {
+        log_error("Error opening file %s, errno = %d", dated_log->filename, errno);
+    }
+
+    return dated_log->fp;
+}
+
+static void
+_chat_log_written(struct dated_chat_log* dated_log)
+{
+    dated_log->last_used = g_get_monotonic_time();
+    if (dated_log->pending->len >= CHAT_LOG_PENDING_MAX) {
+        _chat_log_write_pending(dated_log);
+    }
+}
+
+static void
+_chat_log_close_file(struct dated_chat_log* dated_log)
+{
+    if (dated_log->fp == NULL) {
+        return;
+    }
+
+    if (fclose(dated_log->fp) == EOF) {
+        log_error("Error closing file %s, errno = %d", dated_log->filename, errno);
+    }
+    dated_log->fp = NULL;
+    open_chat_logs--;
+}
+
+// check whether the file behind an open handle was removed or replaced
+static gboolean
+_chat_log_deleted(struct dated_chat_log* dated_log)
+{
+    struct stat path_st;
+    struct stat fd_st;
+
+    if (g_stat(dated_log->filename, &path_st) != 0) {
+        return TRUE;
+    }
+    if (fstat(fileno(dated_log->fp), &fd_st) != 0) {
+        return TRUE;
+    }
+
+    return path_st.st_dev != fd_st.st_dev || path_st.st_ino != fd_st.st_ino;
+}
+
+// write the pending lines, into a new file if the old one was removed or replaced
+static void
+_chat_log_write_pending(struct dated_chat_log* dated_log)
+{
+    if (dated_log->pending->len == 0) {
+        return;
+    }
+
+    if (dated_log->fp && _chat_log_deleted(dated_log)) {
+        _chat_log_close_file(dated_log);
+    }
+
+    // kept pending until the file can be opened again
+    FILE* fp = _chat_log_file(dated_log);
+    if (fp == NULL) {
+        return;
+    }
+
+    if (fwrite(dated_log->pending->str, 1, dated_log->pending->len, fp) != dated_log->pending->len || fflush(fp) == EOF) {
+        log_error("Error writing file %s, errno = %d", dated_log->filename, errno);
+    }
+    g_string_truncate(dated_log->pending, 0);
+}
+
 static void
 _free_chat_log(struct dated_chat_log* dated_log)
 {
     if (dated_log) {
+        _chat_log_write_pending(dated_log);
+        _chat_log_close_file(dated_log);
+        g_string_free(dated_log->pending, TRUE);
         if (dated_log->filename) {
             g_free(dated_log->filename);
             dated_log->filename = NULL;
@@ -793,6 +1277,12 @@ log_stderr_handler(void)
     }
 }
 
+int
+log_stderr_fd(void)
+{
+    return stderr_inited ? stderr_pipe[0] : -1;
+}
+
 static int
 log_stderr_nonblock_set(int fd)
 {
@@ -53,20 +53,31 @@ typedef enum {
     PROF_OUT_LOG
 } chat_log_direction_t;
 
-void log_init(log_level_t filter, char* log_file);
+void log_init(log_level_t filter, char* log_file, gboolean binary);
 log_level_t log_get_filter(void);
 void log_close(void);
+// re-reads the log rotation settings after they changed
+void log_rotate_update(void);
 const char* get_log_file_location(void);
+gboolean log_level_enabled(log_level_t level);
 void log_debug(const char* const msg, ...);
 void log_info(const char* const msg, ...);
 void log_warning(const char* const msg, ...);
 void log_error(const char* const msg, ...);
 void log_msg(log_level_t level, const char* const area, const char* const msg);
+
+// the level is checked before anything is formatted, the arguments of a
+// line that is filtered out are not evaluated
+#define log_debug(...)   (log_level_enabled(PROF_LEVEL_DEBUG) ? log_debug(__VA_ARGS__) : (void)0)
+#define log_info(...)    (log_level_enabled(PROF_LEVEL_INFO) ? log_info(__VA_ARGS__) : (void)0)
+#define log_warning(...) (log_level_enabled(PROF_LEVEL_WARN) ? log_warning(__VA_ARGS__) : (void)0)
+#define log_error(...)   (log_level_enabled(PROF_LEVEL_ERROR) ? log_error(__VA_ARGS__) : (void)0)
 log_level_t log_level_from_string(char* log_level);
 
 void log_stderr_init(log_level_t level);
 void log_stderr_close(void);
 void log_stderr_handler(void);
+int log_stderr_fd(void);
 
 void chat_log_init(void);
 
@@ -80,6 +91,10 @@ void chat_log_otr_msg_in(ProfMessage* message);
 void chat_log_pgp_msg_in(ProfMessage* message);
 void chat_log_omemo_msg_in(ProfMessage* message);
 
+void chat_log_flush(void);
+void chat_log_flush_check(void);
+// compresses the chat logs of past days in the background when /logging compress is on
+void chat_log_compress_sweep(void);
 void chat_log_close(void);
 
 void groupchat_log_init(void);
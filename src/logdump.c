@@ -0,0 +1,113 @@
+/*
+ * logdump.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "tools/logformat.h"
+
+// Prints binary profanity logs (profanity --logformat binary) as the text
+// log would have shown them
+
+static void
+_print_line(gint64 time_us, const char* area, const char* level, const char* msg, void* userdata)
+{
+    time_t secs = time_us / G_USEC_PER_SEC;
+    struct tm tm;
+    char date[32];
+
+    localtime_r(&secs, &tm);
+    strftime(date, sizeof(date), "%d/%m/%Y %H:%M:%S", &tm);
+    fprintf(stdout, "%s: %s: %s: %s\n", date, area, level, msg);
+}
+
+static gboolean
+_dump(const char* name, FILE* in)
+{
+    if (!logformat_read_magic(in)) {
+        fprintf(stderr, "profanity-logdump: %s is not a binary profanity log\n", name);
+        return FALSE;
+    }
+
+    long frame_start = ftell(in);
+    while (logformat_read_frame(in, _print_line, NULL)) {
+        frame_start = ftell(in);
+    }
+
+    // anything read past the last whole frame is a damaged or cut off frame
+    if (!feof(in) || ftell(in) != frame_start) {
+        fprintf(stderr, "profanity-logdump: %s has a damaged frame, stopped there\n", name);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 1 && (g_strcmp0(argv[1], "-h") == 0 || g_strcmp0(argv[1], "--help") == 0)) {
+        fprintf(stdout, "Usage: profanity-logdump [FILE]...\n");
+        fprintf(stdout, "Print binary profanity logs as text, read standard input when no FILE is given.\n");
+        return 0;
+    }
+
+    if (argc < 2) {
+        return _dump("standard input", stdin) ? 0 : 1;
+    }
+
+    int result = 0;
+    for (int i = 1; i < argc; i++) {
+        FILE* in = g_strcmp0(argv[i], "-") == 0 ? stdin : fopen(argv[i], "rb");
+        if (!in) {
+            fprintf(stderr, "profanity-logdump: cannot open %s\n", argv[i]);
+            result = 1;
+            continue;
+        }
+        if (!_dump(argv[i], in)) {
+            result = 1;
+        }
+        if (in != stdin) {
+            fclose(in);
+        }
+    }
+
+    return result;
+}
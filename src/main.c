@@ -62,9 +62,13 @@
 static gboolean version = FALSE;
 static char* log = NULL;
 static char* log_file = NULL;
+static char* log_format = NULL;
 static char* account_name = NULL;
 static char* config_file = NULL;
 static char* theme_name = NULL;
+static gboolean startup_profile = FALSE;
+static gboolean headless = FALSE;
+static gboolean relay = FALSE;
 
 int
 main(int argc, char** argv)
@@ -85,7 +89,11 @@ main(int argc, char** argv)
         { "log", 'l', 0, G_OPTION_ARG_STRING, &log, "Set logging levels, DEBUG, INFO, WARN (default), ERROR", "LEVEL" },
         { "config", 'c', 0, G_OPTION_ARG_STRING, &config_file, "Use an alternative configuration file", NULL },
         { "logfile", 'f', 0, G_OPTION_ARG_STRING, &log_file, "Specify log file", NULL },
+        { "logformat", 0, 0, G_OPTION_ARG_STRING, &log_format, "Log file format, text (default) or binary, read binary logs with profanity-logdump", "FORMAT" },
         { "theme", 't', 0, G_OPTION_ARG_STRING, &theme_name, "Specify theme name", NULL },
+        { "startup-profile", 0, 0, G_OPTION_ARG_NONE, &startup_profile, "Show how long each startup step took", NULL },
+        { "headless", 0, 0, G_OPTION_ARG_NONE, &headless, "Run without a terminal, reading commands from stdin", NULL },
+        { "relay", 0, 0, G_OPTION_ARG_NONE, &relay, "Run headless and let frontends attach over a socket", NULL },
         { NULL }
     };
 
@@ -103,6 +111,11 @@ main(int argc, char** argv)
 
     g_option_context_free(context);
 
+    if (log_format && g_strcmp0(log_format, "text") != 0 && g_strcmp0(log_format, "binary") != 0) {
+        g_print("Unknown log format %s, use text or binary\n", log_format);
+        return 1;
+    }
+
     if (version == TRUE) {
         if (strcmp(PACKAGE_STATUS, "development") == 0) {
 #ifdef HAVE_GIT_VERSION
@@ -176,14 +189,20 @@ main(int argc, char** argv)
         return 0;
     }
 
+    // the relay is for a core without a terminal of its own
+    if (relay) {
+        headless = TRUE;
+    }
+
     /* Default logging WARN */
-    prof_run(log ? log : "WARN", account_name, config_file, log_file, theme_name);
+    prof_run(log ? log : "WARN", account_name, config_file, log_file, g_strcmp0(log_format, "binary") == 0, theme_name, startup_profile, headless, relay);
 
     /* Free resources allocated by GOptionContext */
     g_free(log);
     g_free(account_name);
     g_free(config_file);
     g_free(log_file);
+    g_free(log_format);
     g_free(theme_name);
 
     return 0;
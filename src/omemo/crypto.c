@@ -42,9 +42,6 @@
 #include "omemo/omemo.h"
 #include "omemo/crypto.h"
 
-#define AES256_GCM_TAG_LENGTH  16
-#define AES256_GCM_BUFFER_SIZE 1024
-
 int
 omemo_crypto_init(void)
 {
@@ -378,92 +375,81 @@ out:
     return res;
 }
 
-gcry_error_t
-aes256gcm_crypt_file(FILE* in, FILE* out, off_t file_size,
-                     unsigned char key[], unsigned char nonce[], bool encrypt)
+struct aes256gcm_stream_t
 {
+    gcry_cipher_hd_t hd;
+    bool encrypt;
+};
 
+gcry_error_t
+aes256gcm_stream_new(AES256GCMStream** stream, unsigned char key[], unsigned char nonce[], bool encrypt)
+{
     if (!gcry_control(GCRYCTL_INITIALIZATION_FINISHED_P)) {
         fputs("libgcrypt has not been initialized\n", stderr);
         abort();
     }
 
-    if (!encrypt) {
-        file_size -= AES256_GCM_TAG_LENGTH;
-    }
-
     gcry_error_t res;
     gcry_cipher_hd_t hd;
 
     res = gcry_cipher_open(&hd, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_GCM,
                            GCRY_CIPHER_SECURE);
     if (res != GPG_ERR_NO_ERROR) {
-        goto out;
+        return res;
     }
 
     res = gcry_cipher_setkey(hd, key, OMEMO_AESGCM_KEY_LENGTH);
     if (res != GPG_ERR_NO_ERROR) {
-        goto out;
+        gcry_cipher_close(hd);
+        return res;
     }
 
     res = gcry_cipher_setiv(hd, nonce, OMEMO_AESGCM_NONCE_LENGTH);
     if (res != GPG_ERR_NO_ERROR) {
-        goto out;
+        gcry_cipher_close(hd);
+        return res;
     }
 
-    unsigned char buffer[AES256_GCM_BUFFER_SIZE];
+    *stream = malloc(sizeof(AES256GCMStream));
+    (*stream)->hd = hd;
+    (*stream)->encrypt = encrypt;
 
-    int bytes = 0;
-    off_t bytes_read = 0, bytes_available = 0, read_size = 0;
-    while (bytes_read < file_size) {
-        bytes_available = file_size - bytes_read;
-        if (!bytes_available || ferror(in) != 0) {
-            break;
-        }
-
-        if (bytes_available < AES256_GCM_BUFFER_SIZE) {
-            read_size = bytes_available;
-            gcry_cipher_final(hd); // Signal last round of bytes.
-        } else {
-            read_size = AES256_GCM_BUFFER_SIZE;
-        }
-
-        bytes = fread(buffer, 1, read_size, in);
-        bytes_read += bytes;
-
-        if (encrypt) {
-            res = gcry_cipher_encrypt(hd, buffer, bytes, NULL, 0);
-        } else {
-            res = gcry_cipher_decrypt(hd, buffer, bytes, NULL, 0);
-        }
-
-        if (res != GPG_ERR_NO_ERROR) {
-            goto out;
-        }
+    return GPG_ERR_NO_ERROR;
+}
 
-        fwrite(buffer, 1, bytes, out);
+gcry_error_t
+aes256gcm_stream_crypt(AES256GCMStream* stream, unsigned char* out, const unsigned char* in, size_t length, bool last)
+{
+    if (last) {
+        gcry_cipher_final(stream->hd); // Signal last round of bytes.
     }
 
-    unsigned char tag[AES256_GCM_TAG_LENGTH];
+    if (stream->encrypt) {
+        return gcry_cipher_encrypt(stream->hd, out, length, in, length);
+    } else {
+        return gcry_cipher_decrypt(stream->hd, out, length, in, length);
+    }
+}
 
-    if (encrypt) {
-        // Append authentication tag at the end of the file.
-        res = gcry_cipher_gettag(hd, tag, AES256_GCM_TAG_LENGTH);
-        if (res != GPG_ERR_NO_ERROR) {
-            goto out;
-        }
+gcry_error_t
+aes256gcm_stream_gettag(AES256GCMStream* stream, unsigned char tag[])
+{
+    return gcry_cipher_gettag(stream->hd, tag, AES256_GCM_TAG_LENGTH);
+}
 
-        fwrite(tag, 1, AES256_GCM_TAG_LENGTH, out);
+gcry_error_t
+aes256gcm_stream_checktag(AES256GCMStream* stream, const unsigned char tag[], size_t tag_len)
+{
+    return gcry_cipher_checktag(stream->hd, tag, tag_len);
+}
 
-    } else {
-        // Read and verify authentication tag stored at the end of the file.
-        bytes = fread(tag, 1, AES256_GCM_TAG_LENGTH, in);
-        res = gcry_cipher_checktag(hd, tag, bytes);
+void
+aes256gcm_stream_free(AES256GCMStream* stream)
+{
+    if (stream) {
+        gcry_cipher_close(stream->hd);
+        free(stream);
     }
-
-out:
-    gcry_cipher_close(hd);
-    return res;
 }
 
 char*
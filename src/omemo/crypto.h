@@ -41,6 +41,10 @@
 #define AES128_GCM_IV_LENGTH  12
 #define AES128_GCM_TAG_LENGTH 16
 
+#define AES256_GCM_TAG_LENGTH 16
+
+typedef struct aes256gcm_stream_t AES256GCMStream;
+
 int omemo_crypto_init(void);
 /**
  * Callback for a secure random number generator.
@@ -184,8 +188,16 @@ int aes128gcm_decrypt(unsigned char* plaintext,
                       size_t ciphertext_len, const unsigned char* const iv, size_t iv_len,
                       const unsigned char* const key, const unsigned char* const tag);
 
-gcry_error_t aes256gcm_crypt_file(FILE* in, FILE* out, off_t file_size,
-                                  unsigned char key[], unsigned char nonce[], bool encrypt);
+/**
+ * Incremental AES-256-GCM over a file transferred in chunks.
+ * Chunks passed to aes256gcm_stream_crypt() may have any length, set last
+ * for the final one when it is known.
+ */
+gcry_error_t aes256gcm_stream_new(AES256GCMStream** stream, unsigned char key[], unsigned char nonce[], bool encrypt);
+gcry_error_t aes256gcm_stream_crypt(AES256GCMStream* stream, unsigned char* out, const unsigned char* in, size_t length, bool last);
+gcry_error_t aes256gcm_stream_gettag(AES256GCMStream* stream, unsigned char tag[]);
+gcry_error_t aes256gcm_stream_checktag(AES256GCMStream* stream, const unsigned char tag[], size_t tag_len);
+void aes256gcm_stream_free(AES256GCMStream* stream);
 
 char* aes256gcm_create_secure_fragment(unsigned char* key,
                                        unsigned char* nonce);
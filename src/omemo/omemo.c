@@ -41,6 +41,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <pthread.h>
 #include <signal/key_helper.h>
 #include <signal/protocol.h>
@@ -55,6 +56,7 @@
 #include "omemo/crypto.h"
 #include "omemo/omemo.h"
 #include "omemo/store.h"
+#include "tools/scheduler.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
 #include "xmpp/connection.h"
@@ -66,13 +68,38 @@
 #define AESGCM_URL_NONCE_LEN (2 * OMEMO_AESGCM_NONCE_LENGTH)
 #define AESGCM_URL_KEY_LEN   (2 * OMEMO_AESGCM_KEY_LENGTH)
 
+#define OMEMO_FILE_STREAM_BUFFER_SIZE (64 * 1024)
+
+// seconds between writes of changed trust and known devices files
+#define OMEMO_KEYFILE_FLUSH_INTERVAL 5
+
+// pre keys offered in the bundle, more are made once fewer than the low
+// watermark are left
+#define OMEMO_PRE_KEYS_TARGET        100
+#define OMEMO_PRE_KEYS_LOW_WATERMARK 90
+#define OMEMO_PRE_KEY_ID_MAX         0xFFFFFF
+
+#define OMEMO_PRE_KEY_JOB_POLL_MS     100
+#define OMEMO_BUNDLE_PUBLISH_DELAY_MS 2000
+
+// pre keys made by a worker thread, stored by the main thread when done
+typedef struct
+{
+    pthread_t worker;
+    uint32_t start;
+    int count;
+    GList* ids;
+    GList* records;
+    gint done;
+} omemo_pre_key_job_t;
+
 static gboolean loaded;
 
 static void _generate_pre_keys(int count);
 static void _generate_signed_pre_key(void);
 static gboolean _load_identity(void);
 static void _load_trust(void);
-static void _load_sessions(void);
+static void _load_sessions(const char* const legacy_filename);
 static void _load_known_devices(void);
 static void _lock(void* user_data);
 static void _unlock(void* user_data);
@@ -85,6 +112,12 @@ static char* _omemo_unformat_fingerprint(const char* const fingerprint_formatted
 static void _cache_device_identity(const char* const jid, uint32_t device_id, ec_public_key* identity);
 static void _g_hash_table_free(GHashTable* hash_table);
 static void _acquire_sender_devices_list(void);
+static void _omemo_keyfiles_flush(void);
+static void* _pre_key_worker(void* data);
+static gboolean _pre_key_job_check(void* data);
+static void _pre_key_job_free(omemo_pre_key_job_t* job);
+static void _bundle_publish_later(void);
+static omemo_key_t* _omemo_encrypt_key(const char* const barejid, uint32_t device_id, const unsigned char* const key_tag);
 
 typedef gboolean (*OmemoDeviceListHandler)(const char* const jid, GList* device_list);
 
@@ -100,7 +133,7 @@ struct omemo_context_t
     uint32_t registration_id;
     uint32_t signed_pre_key_id;
     signal_protocol_store_context* store;
-    GHashTable* session_store;
+    session_store_t* session_store;
     GHashTable* pre_key_store;
     GHashTable* signed_pre_key_store;
     identity_key_store_t identity_key_store;
@@ -109,10 +142,16 @@ struct omemo_context_t
     GString* trust_filename;
     GKeyFile* trust_keyfile;
     GString* sessions_filename;
-    GKeyFile* sessions_keyfile;
     GHashTable* known_devices;
     GString* known_devices_filename;
     GKeyFile* known_devices_keyfile;
+    gboolean trust_dirty;
+    gboolean known_devices_dirty;
+    gint64 last_keyfile_flush;
+    gboolean identity_save_held;
+    omemo_pre_key_job_t* pre_key_job;
+    SchedulerTask* pre_key_job_task;
+    SchedulerTask* bundle_publish_task;
     GHashTable* fingerprint_ac;
 };
 
@@ -136,12 +175,26 @@ omemo_init(void)
 void
 omemo_close(void)
 {
+    _omemo_keyfiles_flush();
+
     if (omemo_ctx.fingerprint_ac) {
         g_hash_table_destroy(omemo_ctx.fingerprint_ac);
         omemo_ctx.fingerprint_ac = NULL;
     }
 }
 
+// Rough heap use of the OMEMO sessions held in memory
+gsize
+omemo_memory(guint* sessions)
+{
+    *sessions = 0;
+    if (!omemo_ctx.session_store) {
+        return 0;
+    }
+
+    return session_store_memory(omemo_ctx.session_store, sessions);
+}
+
 void
 omemo_on_connect(ProfAccount* account)
 {
@@ -238,7 +291,8 @@ omemo_on_connect(ProfAccount* account)
     omemo_ctx.trust_filename = g_string_new(omemo_dir);
     g_string_append(omemo_ctx.trust_filename, "/trust.txt");
     omemo_ctx.sessions_filename = g_string_new(omemo_dir);
-    g_string_append(omemo_ctx.sessions_filename, "/sessions.txt");
+    g_string_append(omemo_ctx.sessions_filename, "/sessions.db");
+    gchar* legacy_sessions_filename = g_strdup_printf("%s/sessions.txt", omemo_dir);
     omemo_ctx.known_devices_filename = g_string_new(omemo_dir);
     g_string_append(omemo_ctx.known_devices_filename, "/known_devices.txt");
 
@@ -259,7 +313,6 @@ omemo_on_connect(ProfAccount* account)
 
     omemo_ctx.identity_keyfile = g_key_file_new();
     omemo_ctx.trust_keyfile = g_key_file_new();
-    omemo_ctx.sessions_keyfile = g_key_file_new();
     omemo_ctx.known_devices_keyfile = g_key_file_new();
 
     if (g_key_file_load_from_file(omemo_ctx.identity_keyfile, omemo_ctx.identity_filename->str, G_KEY_FILE_KEEP_COMMENTS, &error)) {
@@ -283,16 +336,8 @@ omemo_on_connect(ProfAccount* account)
         g_error_free(error);
     }
 
-    error = NULL;
-    if (g_key_file_load_from_file(omemo_ctx.sessions_keyfile, omemo_ctx.sessions_filename->str, G_KEY_FILE_KEEP_COMMENTS, &error)) {
-        _load_sessions();
-    } else if (error->code != G_FILE_ERROR_NOENT) {
-        log_warning("[OMEMO] error loading sessions from: %s, %s", omemo_ctx.sessions_filename->str, error->message);
-        g_error_free(error);
-    } else {
-        log_warning("[OMEMO] no such file: %s", omemo_ctx.trust_filename->str);
-        g_error_free(error);
-    }
+    _load_sessions(legacy_sessions_filename);
+    g_free(legacy_sessions_filename);
 
     error = NULL;
     if (g_key_file_load_from_file(omemo_ctx.known_devices_keyfile, omemo_ctx.known_devices_filename->str, G_KEY_FILE_KEEP_COMMENTS, &error)) {
@@ -309,10 +354,24 @@ omemo_on_connect(ProfAccount* account)
 void
 omemo_on_disconnect(void)
 {
+    omemo_fetch_reset();
+
     if (!loaded) {
         return;
     }
 
+    scheduler_remove(omemo_ctx.bundle_publish_task);
+    omemo_ctx.bundle_publish_task = NULL;
+    if (omemo_ctx.pre_key_job) {
+        scheduler_remove(omemo_ctx.pre_key_job_task);
+        omemo_ctx.pre_key_job_task = NULL;
+        pthread_join(omemo_ctx.pre_key_job->worker, NULL);
+        _pre_key_job_free(omemo_ctx.pre_key_job);
+        omemo_ctx.pre_key_job = NULL;
+    }
+
+    _omemo_keyfiles_flush();
+
     _g_hash_table_free(omemo_ctx.signed_pre_key_store);
     _g_hash_table_free(omemo_ctx.pre_key_store);
     _g_hash_table_free(omemo_ctx.device_list_handler);
@@ -321,11 +380,13 @@ omemo_on_disconnect(void)
     g_key_file_free(omemo_ctx.identity_keyfile);
     g_string_free(omemo_ctx.trust_filename, TRUE);
     g_key_file_free(omemo_ctx.trust_keyfile);
+    omemo_ctx.trust_keyfile = NULL;
     g_string_free(omemo_ctx.sessions_filename, TRUE);
-    g_key_file_free(omemo_ctx.sessions_keyfile);
-    _g_hash_table_free(omemo_ctx.session_store);
+    session_store_free(omemo_ctx.session_store);
+    omemo_ctx.session_store = NULL;
     g_string_free(omemo_ctx.known_devices_filename, TRUE);
     g_key_file_free(omemo_ctx.known_devices_keyfile);
+    omemo_ctx.known_devices_keyfile = NULL;
 }
 
 void
@@ -361,7 +422,7 @@ omemo_generate_crypto_materials(ProfAccount* account)
     g_key_file_set_uint64(omemo_ctx.identity_keyfile, OMEMO_STORE_GROUP_IDENTITY, OMEMO_STORE_KEY_REGISTRATION_ID, omemo_ctx.registration_id);
 
     /* Pre keys */
-    _generate_pre_keys(100);
+    _generate_pre_keys(OMEMO_PRE_KEYS_TARGET);
 
     /* Signed pre key */
     _generate_signed_pre_key();
@@ -385,7 +446,19 @@ omemo_publish_crypto_materials(void)
         return;
     }
 
-    omemo_bundle_publish(true);
+    _bundle_publish_later();
+}
+
+// Called when the library used up one of our pre keys.
+void
+omemo_pre_key_removed(void)
+{
+    guint remaining = g_hash_table_size(omemo_ctx.pre_key_store);
+    if (remaining < OMEMO_PRE_KEYS_LOW_WATERMARK) {
+        _generate_pre_keys(OMEMO_PRE_KEYS_TARGET - remaining);
+    }
+
+    _bundle_publish_later();
 }
 
 static void
@@ -438,10 +511,7 @@ omemo_start_session(const char* const barejid)
             return;
         }
 
-        GList* device_id;
-        for (device_id = device_list; device_id != NULL; device_id = device_id->next) {
-            omemo_bundle_request(barejid, GPOINTER_TO_INT(device_id->data), omemo_start_device_session_handle_bundle, free, strdup(barejid));
-        }
+        omemo_bundles_request(barejid, device_list);
     }
 }
 
@@ -612,6 +682,10 @@ omemo_identity_keyfile_save(void)
 {
     GError* error = NULL;
 
+    if (omemo_ctx.identity_save_held) {
+        return;
+    }
+
     if (!g_key_file_save_to_file(omemo_ctx.identity_keyfile, omemo_ctx.identity_filename->str, &error)) {
         log_error("[OMEMO] error saving identity to: %s, %s", omemo_ctx.identity_filename->str, error->message);
     }
@@ -626,37 +700,57 @@ omemo_trust_keyfile(void)
 void
 omemo_trust_keyfile_save(void)
 {
-    GError* error = NULL;
-
-    if (!g_key_file_save_to_file(omemo_ctx.trust_keyfile, omemo_ctx.trust_filename->str, &error)) {
-        log_error("[OMEMO] error saving trust to: %s, %s", omemo_ctx.trust_filename->str, error->message);
-    }
+    omemo_ctx.trust_dirty = TRUE;
 }
 
-GKeyFile*
-omemo_sessions_keyfile(void)
+void
+omemo_known_devices_keyfile_save(void)
 {
-    return omemo_ctx.sessions_keyfile;
+    omemo_ctx.known_devices_dirty = TRUE;
 }
 
 void
-omemo_sessions_keyfile_save(void)
+omemo_keyfiles_flush_check(void)
 {
-    GError* error = NULL;
+    if (!omemo_ctx.trust_dirty && !omemo_ctx.known_devices_dirty) {
+        return;
+    }
 
-    if (!g_key_file_save_to_file(omemo_ctx.sessions_keyfile, omemo_ctx.sessions_filename->str, &error)) {
-        log_error("[OMEMO] error saving sessions to: %s, %s", omemo_ctx.sessions_filename->str, error->message);
+    gint64 now = g_get_monotonic_time();
+    if (now - omemo_ctx.last_keyfile_flush >= OMEMO_KEYFILE_FLUSH_INTERVAL * G_TIME_SPAN_SECOND) {
+        _omemo_keyfiles_flush();
     }
 }
 
-void
-omemo_known_devices_keyfile_save(void)
+static void
+_omemo_keyfile_write(GKeyFile* keyfile, GString* filename, const char* const name)
 {
     GError* error = NULL;
 
-    if (!g_key_file_save_to_file(omemo_ctx.known_devices_keyfile, omemo_ctx.known_devices_filename->str, &error)) {
-        log_error("[OMEMO] error saving known devices to: %s, %s", omemo_ctx.known_devices_filename->str, error->message);
+    // g_key_file_save_to_file() replaces the file atomically
+    if (!g_key_file_save_to_file(keyfile, filename->str, &error)) {
+        log_error("[OMEMO] error saving %s to: %s, %s", name, filename->str, error->message);
+        g_error_free(error);
+    }
+}
+
+static void
+_omemo_keyfiles_flush(void)
+{
+    pthread_mutex_lock(&omemo_ctx.lock);
+
+    if (omemo_ctx.trust_dirty && omemo_ctx.trust_keyfile) {
+        _omemo_keyfile_write(omemo_ctx.trust_keyfile, omemo_ctx.trust_filename, "trust");
     }
+    if (omemo_ctx.known_devices_dirty && omemo_ctx.known_devices_keyfile) {
+        _omemo_keyfile_write(omemo_ctx.known_devices_keyfile, omemo_ctx.known_devices_filename, "known devices");
+    }
+
+    omemo_ctx.trust_dirty = FALSE;
+    omemo_ctx.known_devices_dirty = FALSE;
+    omemo_ctx.last_keyfile_flush = g_get_monotonic_time();
+
+    pthread_mutex_unlock(&omemo_ctx.lock);
 }
 
 void
@@ -742,6 +836,42 @@ out:
     SIGNAL_UNREF(identity_key);
 }
 
+static omemo_key_t*
+_omemo_encrypt_key(const char* const barejid, uint32_t device_id, const unsigned char* const key_tag)
+{
+    ciphertext_message* ciphertext;
+    session_cipher* cipher;
+    signal_protocol_address address = {
+        .name = barejid,
+        .name_len = strlen(barejid),
+        .device_id = device_id
+    };
+
+    int res = session_cipher_create(&cipher, omemo_ctx.store, &address, omemo_ctx.signal);
+    if (res != SG_SUCCESS) {
+        log_error("[OMEMO][SEND] cannot create cipher for %s device id %d - code: %d", address.name, address.device_id, res);
+        return NULL;
+    }
+
+    res = session_cipher_encrypt(cipher, key_tag, AES128_GCM_KEY_LENGTH + AES128_GCM_TAG_LENGTH, &ciphertext);
+    session_cipher_free(cipher);
+    if (res != SG_SUCCESS) {
+        log_info("[OMEMO][SEND] cannot encrypt key for %s device id %d - code: %d", address.name, address.device_id, res);
+        return NULL;
+    }
+
+    signal_buffer* buffer = ciphertext_message_get_serialized(ciphertext);
+    omemo_key_t* key = malloc(sizeof(omemo_key_t));
+    key->length = signal_buffer_len(buffer);
+    key->data = malloc(key->length);
+    memcpy(key->data, signal_buffer_data(buffer), key->length);
+    key->device_id = device_id;
+    key->prekey = ciphertext_message_get_type(ciphertext) == CIPHERTEXT_PREKEY_TYPE;
+    SIGNAL_UNREF(ciphertext);
+
+    return key;
+}
+
 char*
 omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_receipt, gboolean muc, const char* const replace_id)
 {
@@ -781,12 +911,19 @@ omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_
         ProfMucWin* mucwin = (ProfMucWin*)win;
         assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
         GList* members = muc_members(mucwin->roomjid);
+        GHashTable* seen = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
         GList* iter;
         for (iter = members; iter != NULL; iter = iter->next) {
             Jid* jid = jid_create(iter->data);
-            recipients = g_list_append(recipients, strdup(jid->barejid));
+            // several occupants can share a barejid, encrypt for its devices once
+            if (!g_hash_table_contains(seen, jid->barejid)) {
+                g_hash_table_add(seen, strdup(jid->barejid));
+                recipients = g_list_prepend(recipients, strdup(jid->barejid));
+            }
             jid_destroy(jid);
         }
+        g_hash_table_destroy(seen);
+        recipients = g_list_reverse(recipients);
         g_list_free(members);
     } else {
         ProfChatWin* chatwin = (ProfChatWin*)win;
@@ -796,6 +933,10 @@ omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_
 
     GList* device_ids_iter;
 
+    // hold the signal context lock for the whole batch instead of once per
+    // device, session_cipher_encrypt() takes it recursively
+    _lock(&omemo_ctx);
+
     omemo_ctx.identity_key_store.recv = false;
 
     // Encrypt keys for the recipients
@@ -809,51 +950,23 @@ omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_
             continue;
         }
 
-        for (device_ids_iter = recipient_device_id; device_ids_iter != NULL; device_ids_iter = device_ids_iter->next) {
-            int res;
-            ciphertext_message* ciphertext;
-            session_cipher* cipher;
-            signal_protocol_address address = {
-                .name = recipients_iter->data,
-                .name_len = strlen(recipients_iter->data),
-                .device_id = GPOINTER_TO_INT(device_ids_iter->data)
-            };
+        // Don't encrypt for this device (according to
+        // <https://xmpp.org/extensions/xep-0384.html#encrypt>).
+        // Yourself as recipients in case of MUC
+        gboolean is_me = g_strcmp0(jid->barejid, recipients_iter->data) == 0;
 
-            // Don't encrypt for this device (according to
-            // <https://xmpp.org/extensions/xep-0384.html#encrypt>).
-            // Yourself as recipients in case of MUC
-            char* mybarejid = connection_get_barejid();
-            if (!g_strcmp0(mybarejid, recipients_iter->data)) {
-                if (GPOINTER_TO_INT(device_ids_iter->data) == omemo_ctx.device_id) {
-                    free(mybarejid);
-                    log_debug("[OMEMO][SEND] Skipping %d (my device) ", GPOINTER_TO_INT(device_ids_iter->data));
-                    continue;
-                }
-            }
-            free(mybarejid);
-
-            log_debug("[OMEMO][SEND] recipients with device id %d for %s", GPOINTER_TO_INT(device_ids_iter->data), recipients_iter->data);
-            res = session_cipher_create(&cipher, omemo_ctx.store, &address, omemo_ctx.signal);
-            if (res != SG_SUCCESS) {
-                log_error("[OMEMO][SEND] cannot create cipher for %s device id %d - code: %d", address.name, address.device_id, res);
+        for (device_ids_iter = recipient_device_id; device_ids_iter != NULL; device_ids_iter = device_ids_iter->next) {
+            uint32_t device_id = GPOINTER_TO_INT(device_ids_iter->data);
+            if (is_me && device_id == omemo_ctx.device_id) {
+                log_debug("[OMEMO][SEND] Skipping %d (my device) ", device_id);
                 continue;
             }
 
-            res = session_cipher_encrypt(cipher, key_tag, AES128_GCM_KEY_LENGTH + AES128_GCM_TAG_LENGTH, &ciphertext);
-            session_cipher_free(cipher);
-            if (res != SG_SUCCESS) {
-                log_info("[OMEMO][SEND] cannot encrypt key for %s device id %d - code: %d", address.name, address.device_id, res);
-                continue;
+            log_debug("[OMEMO][SEND] recipients with device id %d for %s", device_id, recipients_iter->data);
+            omemo_key_t* key = _omemo_encrypt_key(recipients_iter->data, device_id, key_tag);
+            if (key) {
+                keys = g_list_prepend(keys, key);
             }
-            signal_buffer* buffer = ciphertext_message_get_serialized(ciphertext);
-            omemo_key_t* key = malloc(sizeof(omemo_key_t));
-            key->length = signal_buffer_len(buffer);
-            key->data = malloc(key->length);
-            memcpy(key->data, signal_buffer_data(buffer), key->length);
-            key->device_id = GPOINTER_TO_INT(device_ids_iter->data);
-            key->prekey = ciphertext_message_get_type(ciphertext) == CIPHERTEXT_PREKEY_TYPE;
-            keys = g_list_append(keys, key);
-            SIGNAL_UNREF(ciphertext);
         }
     }
 
@@ -862,6 +975,7 @@ omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_
     // Don't send the message if no key could be encrypted.
     // (Since none of the recipients would be able to read the message.)
     if (keys == NULL) {
+        _unlock(&omemo_ctx);
         win_println(win, THEME_ERROR, "!", "This message cannot be decrypted for any recipient.\n"
                                            "You should trust your recipients' device fingerprint(s) using \"/omemo fingerprint trust FINGERPRINT\".\n"
                                            "It could also be that the key bundle of the recipient(s) have not been received. "
@@ -874,45 +988,24 @@ omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_
         GList* sender_device_id = g_hash_table_lookup(omemo_ctx.device_list, jid->barejid);
 
         for (device_ids_iter = sender_device_id; device_ids_iter != NULL; device_ids_iter = device_ids_iter->next) {
-            int res;
-            ciphertext_message* ciphertext;
-            session_cipher* cipher;
-            signal_protocol_address address = {
-                .name = jid->barejid,
-                .name_len = strlen(jid->barejid),
-                .device_id = GPOINTER_TO_INT(device_ids_iter->data)
-            };
-            log_debug("[OMEMO][SEND][Sender] Sending to device %d for %s ", address.device_id, address.name);
+            uint32_t device_id = GPOINTER_TO_INT(device_ids_iter->data);
+            log_debug("[OMEMO][SEND][Sender] Sending to device %d for %s ", device_id, jid->barejid);
             // Don't encrypt for this device (according to
             // <https://xmpp.org/extensions/xep-0384.html#encrypt>).
-            if (address.device_id == omemo_ctx.device_id) {
+            if (device_id == omemo_ctx.device_id) {
                 continue;
             }
 
-            res = session_cipher_create(&cipher, omemo_ctx.store, &address, omemo_ctx.signal);
-            if (res != 0) {
-                log_info("[OMEMO][SEND][Sender] cannot create cipher for %s device id %d", address.name, address.device_id);
-                continue;
+            omemo_key_t* key = _omemo_encrypt_key(jid->barejid, device_id, key_tag);
+            if (key) {
+                keys = g_list_prepend(keys, key);
             }
-
-            res = session_cipher_encrypt(cipher, key_tag, AES128_GCM_KEY_LENGTH + AES128_GCM_TAG_LENGTH, &ciphertext);
-            session_cipher_free(cipher);
-            if (res != 0) {
-                log_info("[OMEMO][SEND][Sender] cannot encrypt key for %s device id %d", address.name, address.device_id);
-                continue;
-            }
-            signal_buffer* buffer = ciphertext_message_get_serialized(ciphertext);
-            omemo_key_t* key = malloc(sizeof(omemo_key_t));
-            key->length = signal_buffer_len(buffer);
-            key->data = malloc(key->length);
-            memcpy(key->data, signal_buffer_data(buffer), key->length);
-            key->device_id = GPOINTER_TO_INT(device_ids_iter->data);
-            key->prekey = ciphertext_message_get_type(ciphertext) == CIPHERTEXT_PREKEY_TYPE;
-            keys = g_list_append(keys, key);
-            SIGNAL_UNREF(ciphertext);
         }
     }
 
+    _unlock(&omemo_ctx);
+    keys = g_list_reverse(keys);
+
     // Send the message
     if (muc) {
         ProfMucWin* mucwin = (ProfMucWin*)win;
@@ -1017,17 +1110,8 @@ omemo_on_message_recv(const char* const from_jid, uint32_t sid,
         *trusted = is_trusted_identity(&address, signal_buffer_data(identity_buffer),
                                        signal_buffer_len(identity_buffer), &omemo_ctx.identity_key_store);
 
-        /* Replace used pre_key in bundle */
-        uint32_t pre_key_id = pre_key_signal_message_get_pre_key_id(message);
-        ec_key_pair* ec_pair;
-        session_pre_key* new_pre_key;
-        curve_generate_key_pair(omemo_ctx.signal, &ec_pair);
-        session_pre_key_create(&new_pre_key, pre_key_id, ec_pair);
-        signal_protocol_pre_key_store_key(omemo_ctx.store, new_pre_key);
-        SIGNAL_UNREF(new_pre_key);
+        /* The used pre key is replaced through remove_pre_key() */
         SIGNAL_UNREF(message);
-        SIGNAL_UNREF(ec_pair);
-        omemo_bundle_publish(true);
 
         if (res == 0) {
             /* Start a new session */
@@ -1386,10 +1470,7 @@ _handle_own_device_list(const char* const jid, GList* device_list)
     }
 
     log_debug("[OMEMO] Request OMEMO Bundles for our devices");
-    GList* device_id;
-    for (device_id = device_list; device_id != NULL; device_id = device_id->next) {
-        omemo_bundle_request(jid, GPOINTER_TO_INT(device_id->data), omemo_start_device_session_handle_bundle, free, strdup(jid));
-    }
+    omemo_bundles_request(jid, device_list);
 
     return TRUE;
 }
@@ -1575,9 +1656,9 @@ _load_identity(void)
         g_strfreev(keys);
     }
 
-    /* Ensure we have at least 100 pre keys */
-    if (i < 100) {
-        _generate_pre_keys(100 - i);
+    /* Ensure we have enough pre keys */
+    if (i < OMEMO_PRE_KEYS_TARGET) {
+        _generate_pre_keys(OMEMO_PRE_KEYS_TARGET - i);
     }
 
     /* Signed pre keys */
@@ -1643,37 +1724,33 @@ _load_trust(void)
     }
 }
 
+// Sessions are read from the database when needed. Before it existed they
+// were kept in sessions.txt, which is imported once and kept renamed.
 static void
-_load_sessions(void)
+_load_sessions(const char* const legacy_filename)
 {
-    int i;
-    char** groups = g_key_file_get_groups(omemo_ctx.sessions_keyfile, NULL);
-    if (groups) {
-        for (i = 0; groups[i] != NULL; i++) {
-            int j;
-            GHashTable* device_store = NULL;
+    if (!session_store_open(omemo_ctx.session_store, omemo_ctx.sessions_filename->str)) {
+        cons_show_error("Could not open the OMEMO sessions database, see the log for details.");
+        return;
+    }
 
-            device_store = g_hash_table_lookup(omemo_ctx.session_store, groups[i]);
-            if (!device_store) {
-                device_store = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)signal_buffer_free);
-                g_hash_table_insert(omemo_ctx.session_store, strdup(groups[i]), device_store);
-            }
+    if (!g_file_test(legacy_filename, G_FILE_TEST_EXISTS)) {
+        return;
+    }
 
-            char** keys = g_key_file_get_keys(omemo_ctx.sessions_keyfile, groups[i], NULL, NULL);
-            for (j = 0; keys[j] != NULL; j++) {
-                uint32_t id = strtoul(keys[j], NULL, 10);
-                char* record_b64 = g_key_file_get_string(omemo_ctx.sessions_keyfile, groups[i], keys[j], NULL);
-                size_t record_len;
-                unsigned char* record = g_base64_decode(record_b64, &record_len);
-                g_free(record_b64);
-                signal_buffer* buffer = signal_buffer_create(record, record_len);
-                g_free(record);
-                g_hash_table_insert(device_store, GINT_TO_POINTER(id), buffer);
-            }
-            g_strfreev(keys);
+    GError* error = NULL;
+    GKeyFile* sessions = g_key_file_new();
+    if (!g_key_file_load_from_file(sessions, legacy_filename, G_KEY_FILE_NONE, &error)) {
+        log_warning("[OMEMO] error loading sessions from: %s, %s", legacy_filename, error->message);
+        g_error_free(error);
+    } else if (session_store_import(omemo_ctx.session_store, sessions)) {
+        gchar* imported = g_strdup_printf("%s.imported", legacy_filename);
+        if (g_rename(legacy_filename, imported) != 0) {
+            log_error("[OMEMO] error renaming %s to %s", legacy_filename, imported);
         }
-        g_strfreev(groups);
+        g_free(imported);
     }
+    g_key_file_free(sessions);
 }
 
 static void
@@ -1742,20 +1819,126 @@ _g_hash_table_free(GHashTable* hash_table)
     g_hash_table_unref(hash_table);
 }
 
+// Pre keys are made on a worker thread so connecting does not wait for
+// them, the bundle is published once they are stored.
 static void
 _generate_pre_keys(int count)
 {
-    unsigned int start;
-    gcry_randomize(&start, sizeof(unsigned int), GCRY_VERY_STRONG_RANDOM);
-    signal_protocol_key_helper_pre_key_list_node* pre_keys_head;
-    signal_protocol_key_helper_generate_pre_keys(&pre_keys_head, start, count, omemo_ctx.signal);
+    if (omemo_ctx.pre_key_job) {
+        // _pre_key_job_check() tops the pool up again when it is done
+        return;
+    }
+
+    omemo_pre_key_job_t* job = calloc(1, sizeof(omemo_pre_key_job_t));
+    gcry_randomize(&job->start, sizeof(job->start), GCRY_VERY_STRONG_RANDOM);
+    job->count = count;
+
+    if (pthread_create(&job->worker, NULL, _pre_key_worker, job) != 0) {
+        log_error("[OMEMO] could not start pre key worker");
+        free(job);
+        return;
+    }
+
+    log_debug("[OMEMO] generating %d pre keys", count);
+    omemo_ctx.pre_key_job = job;
+    omemo_ctx.pre_key_job_task = scheduler_add(OMEMO_PRE_KEY_JOB_POLL_MS, _pre_key_job_check, NULL, NULL);
+}
 
-    signal_protocol_key_helper_pre_key_list_node* p;
-    for (p = pre_keys_head; p != NULL; p = signal_protocol_key_helper_key_list_next(p)) {
-        session_pre_key* prekey = signal_protocol_key_helper_key_list_element(p);
-        signal_protocol_pre_key_store_key(omemo_ctx.store, prekey);
+static void*
+_pre_key_worker(void* data)
+{
+    omemo_pre_key_job_t* job = data;
+
+    for (int i = 0; i < job->count; i++) {
+        // the ids signal_protocol_key_helper_generate_pre_keys() would use
+        uint32_t id = ((job->start + i) % (OMEMO_PRE_KEY_ID_MAX - 1)) + 1;
+        ec_key_pair* ec_pair = NULL;
+        session_pre_key* pre_key = NULL;
+        signal_buffer* record = NULL;
+
+        if (curve_generate_key_pair(omemo_ctx.signal, &ec_pair) == 0
+            && session_pre_key_create(&pre_key, id, ec_pair) == 0
+            && session_pre_key_serialize(&record, pre_key) == 0) {
+            job->ids = g_list_prepend(job->ids, GUINT_TO_POINTER(id));
+            job->records = g_list_prepend(job->records, record);
+        }
+        SIGNAL_UNREF(pre_key);
+        SIGNAL_UNREF(ec_pair);
+    }
+
+    g_atomic_int_set(&job->done, 1);
+
+    return NULL;
+}
+
+static gboolean
+_pre_key_job_check(void* data)
+{
+    omemo_pre_key_job_t* job = omemo_ctx.pre_key_job;
+    if (!g_atomic_int_get(&job->done)) {
+        return TRUE;
+    }
+
+    pthread_join(job->worker, NULL);
+    omemo_ctx.pre_key_job = NULL;
+    omemo_ctx.pre_key_job_task = NULL;
+
+    // write the identity file once for the whole batch
+    omemo_ctx.identity_save_held = TRUE;
+    GList* id = job->ids;
+    GList* record = job->records;
+    while (id && record) {
+        signal_buffer* buffer = record->data;
+        store_pre_key(GPOINTER_TO_UINT(id->data), signal_buffer_data(buffer), signal_buffer_len(buffer), omemo_ctx.pre_key_store);
+        id = g_list_next(id);
+        record = g_list_next(record);
+    }
+    omemo_ctx.identity_save_held = FALSE;
+    omemo_identity_keyfile_save();
+
+    log_debug("[OMEMO] stored %d pre keys", g_list_length(job->ids));
+    _pre_key_job_free(job);
+
+    // keys used while the worker ran
+    guint size = g_hash_table_size(omemo_ctx.pre_key_store);
+    if (size < OMEMO_PRE_KEYS_LOW_WATERMARK) {
+        _generate_pre_keys(OMEMO_PRE_KEYS_TARGET - size);
+    }
+    _bundle_publish_later();
+
+    return FALSE;
+}
+
+static void
+_pre_key_job_free(omemo_pre_key_job_t* job)
+{
+    g_list_free(job->ids);
+    g_list_free_full(job->records, (GDestroyNotify)signal_buffer_free);
+    free(job);
+}
+
+static gboolean
+_bundle_publish_timed(void* data)
+{
+    omemo_ctx.bundle_publish_task = NULL;
+
+    // published when the pre keys being made are stored
+    if (omemo_ctx.pre_key_job) {
+        return FALSE;
+    }
+
+    omemo_bundle_publish(true);
+
+    return FALSE;
+}
+
+// Changes to the pre keys come in bursts, publish the bundle once after.
+static void
+_bundle_publish_later(void)
+{
+    if (omemo_ctx.bundle_publish_task == NULL) {
+        omemo_ctx.bundle_publish_task = scheduler_add(OMEMO_BUNDLE_PUBLISH_DELAY_MS, _bundle_publish_timed, NULL, NULL);
     }
-    signal_protocol_key_helper_key_list_free(pre_keys_head);
 }
 
 static void
@@ -1778,8 +1961,39 @@ omemo_free(void* a)
     gcry_free(a);
 }
 
+struct omemo_file_stream_t
+{
+    AES256GCMStream* cipher;
+    // plaintext source when encrypting, plaintext sink when decrypting
+    FILE* fh;
+    // plaintext bytes not yet read from fh when encrypting
+    off_t remaining;
+    // tag still to be sent when encrypting, ciphertext tail held back
+    // until the transfer ends (it may be the tag) when decrypting
+    unsigned char tail[AES256_GCM_TAG_LENGTH];
+    size_t tail_len;
+    gboolean tag_ready;
+    unsigned char* buffer;
+    gcry_error_t res;
+};
+
+static OmemoFileStream*
+_omemo_file_stream_new(AES256GCMStream* cipher, FILE* fh)
+{
+    OmemoFileStream* stream = malloc(sizeof(OmemoFileStream));
+    stream->cipher = cipher;
+    stream->fh = fh;
+    stream->remaining = 0;
+    stream->tail_len = 0;
+    stream->tag_ready = FALSE;
+    stream->buffer = NULL;
+    stream->res = GPG_ERR_NO_ERROR;
+
+    return stream;
+}
+
 char*
-omemo_encrypt_file(FILE* in, FILE* out, off_t file_size, int* gcry_res)
+omemo_encrypt_file_stream(FILE* in, off_t file_size, OmemoFileStream** stream, int* gcry_res)
 {
     unsigned char* key = gcry_random_bytes_secure(
         OMEMO_AESGCM_KEY_LENGTH,
@@ -1789,12 +2003,14 @@ omemo_encrypt_file(FILE* in, FILE* out, off_t file_size, int* gcry_res)
     unsigned char nonce[OMEMO_AESGCM_NONCE_LENGTH];
     gcry_create_nonce(nonce, OMEMO_AESGCM_NONCE_LENGTH);
 
-    char* fragment = aes256gcm_create_secure_fragment(key, nonce);
-    *gcry_res = aes256gcm_crypt_file(in, out, file_size, key, nonce, true);
+    AES256GCMStream* cipher = NULL;
+    char* fragment = NULL;
+    *gcry_res = aes256gcm_stream_new(&cipher, key, nonce, true);
 
-    if (*gcry_res != GPG_ERR_NO_ERROR) {
-        gcry_free(fragment);
-        fragment = NULL;
+    if (*gcry_res == GPG_ERR_NO_ERROR) {
+        fragment = aes256gcm_create_secure_fragment(key, nonce);
+        *stream = _omemo_file_stream_new(cipher, in);
+        (*stream)->remaining = file_size;
     }
 
     gcry_free(key);
@@ -1802,6 +2018,57 @@ omemo_encrypt_file(FILE* in, FILE* out, off_t file_size, int* gcry_res)
     return fragment;
 }
 
+size_t
+omemo_file_stream_read(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    OmemoFileStream* stream = userdata;
+    size_t length = size * nitems;
+    size_t total = 0;
+
+    if (stream->remaining > 0) {
+        size_t want = length;
+        gboolean last = FALSE;
+        if ((off_t)want >= stream->remaining) {
+            want = stream->remaining;
+            last = TRUE;
+        }
+
+        size_t bytes = fread(buffer, 1, want, stream->fh);
+        if (bytes != want) {
+            stream->res = gcry_error_from_errno(ferror(stream->fh) ? errno : EIO);
+            return CURL_READFUNC_ABORT;
+        }
+
+        // Encrypt in place, curl sends the buffer as it is once we return.
+        stream->res = aes256gcm_stream_crypt(stream->cipher, (unsigned char*)buffer, (unsigned char*)buffer, bytes, last);
+        if (stream->res != GPG_ERR_NO_ERROR) {
+            return CURL_READFUNC_ABORT;
+        }
+
+        stream->remaining -= bytes;
+        total = bytes;
+    }
+
+    if (stream->remaining == 0 && !stream->tag_ready) {
+        stream->res = aes256gcm_stream_gettag(stream->cipher, stream->tail);
+        if (stream->res != GPG_ERR_NO_ERROR) {
+            return CURL_READFUNC_ABORT;
+        }
+        stream->tail_len = AES256_GCM_TAG_LENGTH;
+        stream->tag_ready = TRUE;
+    }
+
+    // Append authentication tag after the ciphertext.
+    if (stream->tail_len > 0 && total < length) {
+        size_t bytes = MIN(length - total, stream->tail_len);
+        memcpy(&buffer[total], &stream->tail[AES256_GCM_TAG_LENGTH - stream->tail_len], bytes);
+        stream->tail_len -= bytes;
+        total += bytes;
+    }
+
+    return total;
+}
+
 void
 _bytes_from_hex(const char* hex, size_t hex_size,
                 unsigned char* bytes, size_t bytes_size)
@@ -1828,8 +2095,8 @@ _bytes_from_hex(const char* hex, size_t hex_size,
     }
 }
 
-gcry_error_t
-omemo_decrypt_file(FILE* in, FILE* out, off_t file_size, const char* fragment)
+OmemoFileStream*
+omemo_decrypt_file_stream(FILE* out, const char* fragment, gcry_error_t* gcry_res)
 {
     char nonce_hex[AESGCM_URL_NONCE_LEN];
     char key_hex[AESGCM_URL_KEY_LEN];
@@ -1848,12 +2115,103 @@ omemo_decrypt_file(FILE* in, FILE* out, off_t file_size, const char* fragment)
     _bytes_from_hex(key_hex, AESGCM_URL_KEY_LEN,
                     key, OMEMO_AESGCM_KEY_LENGTH);
 
-    gcry_error_t crypt_res;
-    crypt_res = aes256gcm_crypt_file(in, out, file_size, key, nonce, false);
+    AES256GCMStream* cipher = NULL;
+    OmemoFileStream* stream = NULL;
+    *gcry_res = aes256gcm_stream_new(&cipher, key, nonce, false);
+
+    if (*gcry_res == GPG_ERR_NO_ERROR) {
+        stream = _omemo_file_stream_new(cipher, out);
+        stream->buffer = malloc(OMEMO_FILE_STREAM_BUFFER_SIZE);
+    }
 
     gcry_free(key);
 
-    return crypt_res;
+    return stream;
+}
+
+static gboolean
+_omemo_file_stream_decrypt(OmemoFileStream* stream, const unsigned char* in, size_t length)
+{
+    while (length > 0) {
+        size_t bytes = MIN(length, OMEMO_FILE_STREAM_BUFFER_SIZE);
+
+        stream->res = aes256gcm_stream_crypt(stream->cipher, stream->buffer, in, bytes, false);
+        if (stream->res != GPG_ERR_NO_ERROR) {
+            return FALSE;
+        }
+
+        if (fwrite(stream->buffer, 1, bytes, stream->fh) != bytes) {
+            stream->res = gcry_error_from_errno(errno);
+            return FALSE;
+        }
+
+        in += bytes;
+        length -= bytes;
+    }
+
+    return TRUE;
+}
+
+size_t
+omemo_file_stream_write(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    OmemoFileStream* stream = userdata;
+    const unsigned char* data = (const unsigned char*)ptr;
+    size_t length = size * nmemb;
+    size_t held = stream->tail_len;
+
+    if (stream->res != GPG_ERR_NO_ERROR) {
+        return 0;
+    }
+
+    if (held + length <= AES256_GCM_TAG_LENGTH) {
+        memcpy(&stream->tail[held], data, length);
+        stream->tail_len += length;
+        return length;
+    }
+
+    // Everything but the last AES256_GCM_TAG_LENGTH bytes seen so far is
+    // ciphertext, held back bytes come first.
+    size_t ciphertext_len = held + length - AES256_GCM_TAG_LENGTH;
+    size_t from_tail = MIN(held, ciphertext_len);
+    if (!_omemo_file_stream_decrypt(stream, stream->tail, from_tail)) {
+        return 0;
+    }
+    memmove(stream->tail, &stream->tail[from_tail], held - from_tail);
+    held -= from_tail;
+
+    size_t from_data = ciphertext_len - from_tail;
+    if (!_omemo_file_stream_decrypt(stream, data, from_data)) {
+        return 0;
+    }
+    memcpy(&stream->tail[held], &data[from_data], length - from_data);
+    stream->tail_len = held + length - from_data;
+
+    return length;
+}
+
+gcry_error_t
+omemo_file_stream_finish(OmemoFileStream* stream)
+{
+    // Only decrypting streams have a buffer and a tag to verify.
+    if (stream->res != GPG_ERR_NO_ERROR || stream->buffer == NULL) {
+        return stream->res;
+    }
+
+    // Verify authentication tag stored at the end of the file.
+    return aes256gcm_stream_checktag(stream->cipher, stream->tail, stream->tail_len);
+}
+
+void
+omemo_file_stream_free(void* stream)
+{
+    OmemoFileStream* file_stream = stream;
+
+    if (file_stream) {
+        aes256gcm_stream_free(file_stream->cipher);
+        free(file_stream->buffer);
+        free(file_stream);
+    }
 }
 
 int
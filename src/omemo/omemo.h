@@ -43,6 +43,7 @@
 
 #define OMEMO_AESGCM_NONCE_LENGTH AES128_GCM_IV_LENGTH
 #define OMEMO_AESGCM_KEY_LENGTH   32
+#define OMEMO_AESGCM_TAG_LENGTH   16
 #define OMEMO_AESGCM_URL_SCHEME   "aesgcm"
 
 typedef enum {
@@ -52,6 +53,7 @@ typedef enum {
 } prof_omemopolicy_t;
 
 typedef struct omemo_context_t omemo_context;
+typedef struct omemo_file_stream_t OmemoFileStream;
 
 typedef struct omemo_key
 {
@@ -64,11 +66,13 @@ typedef struct omemo_key
 
 void omemo_init(void);
 void omemo_close(void);
+gsize omemo_memory(guint* sessions);
 void omemo_on_connect(ProfAccount* account);
 void omemo_on_disconnect(void);
 void omemo_generate_crypto_materials(ProfAccount* account);
 void omemo_key_free(omemo_key_t* key);
 void omemo_publish_crypto_materials(void);
+void omemo_pre_key_removed(void);
 
 uint32_t omemo_device_id(void);
 void omemo_identity_key(unsigned char** output, size_t* length);
@@ -80,8 +84,7 @@ GKeyFile* omemo_identity_keyfile(void);
 void omemo_identity_keyfile_save(void);
 GKeyFile* omemo_trust_keyfile(void);
 void omemo_trust_keyfile_save(void);
-GKeyFile* omemo_sessions_keyfile(void);
-void omemo_sessions_keyfile_save(void);
+void omemo_keyfiles_flush_check(void);
 char* omemo_format_fingerprint(const char* const fingerprint);
 char* omemo_own_fingerprint(gboolean formatted);
 void omemo_trust(const char* const jid, const char* const fingerprint);
@@ -101,7 +104,11 @@ gboolean omemo_loaded(void);
 char* omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_receipt, gboolean muc, const char* const replace_id);
 char* omemo_on_message_recv(const char* const from, uint32_t sid, const unsigned char* const iv, size_t iv_len, GList* keys, const unsigned char* const payload, size_t payload_len, gboolean muc, gboolean* trusted);
 
-char* omemo_encrypt_file(FILE* in, FILE* out, off_t file_size, int* gcry_res);
-gcry_error_t omemo_decrypt_file(FILE* in, FILE* out, off_t file_size, const char* fragment);
+char* omemo_encrypt_file_stream(FILE* in, off_t file_size, OmemoFileStream** stream, int* gcry_res);
+OmemoFileStream* omemo_decrypt_file_stream(FILE* out, const char* fragment, gcry_error_t* gcry_res);
+size_t omemo_file_stream_read(char* buffer, size_t size, size_t nitems, void* userdata);
+size_t omemo_file_stream_write(char* ptr, size_t size, size_t nmemb, void* userdata);
+gcry_error_t omemo_file_stream_finish(OmemoFileStream* stream);
+void omemo_file_stream_free(void* stream);
 void omemo_free(void* a);
 int omemo_parse_aesgcm_url(const char* aesgcm_url, char** https_url, char** fragment);
@@ -32,20 +32,178 @@
  * source files in the program, then also delete it here.
  *
  */
+#include <string.h>
 #include <glib.h>
+#include <sqlite3.h>
 #include <signal/signal_protocol.h>
 
 #include "config.h"
 #include "log.h"
 #include "omemo/omemo.h"
 #include "omemo/store.h"
+#include "tools/memusage.h"
+
+// decoded session records kept in memory
+#define SESSION_CACHE_SIZE 256
+
+typedef enum {
+    SESSION_STMT_LOAD,
+    SESSION_STMT_STORE,
+    SESSION_STMT_DELETE,
+    SESSION_STMT_DELETE_ALL,
+    SESSION_STMT_DEVICES,
+    SESSION_STMT_LAST
+} session_stmt_t;
+
+static const char* const session_stmt_sql[SESSION_STMT_LAST] = {
+    [SESSION_STMT_LOAD] = "SELECT `record` FROM `Sessions` WHERE `jid` = ?1 AND `device_id` = ?2",
+    [SESSION_STMT_STORE] = "INSERT OR REPLACE INTO `Sessions` (`jid`, `device_id`, `record`) VALUES (?1, ?2, ?3)",
+    [SESSION_STMT_DELETE] = "DELETE FROM `Sessions` WHERE `jid` = ?1 AND `device_id` = ?2",
+    [SESSION_STMT_DELETE_ALL] = "DELETE FROM `Sessions` WHERE `jid` = ?1",
+    [SESSION_STMT_DEVICES] = "SELECT `device_id` FROM `Sessions` WHERE `jid` = ?1 ORDER BY `device_id`",
+};
+
+// record is NULL when the database has no session for the device
+typedef struct
+{
+    char* key;
+    char* name;
+    uint32_t device_id;
+    signal_buffer* record;
+    GList* link;
+} cached_session_t;
+
+struct session_store_t
+{
+    sqlite3* db;
+    sqlite3_stmt* stmts[SESSION_STMT_LAST];
+    GHashTable* cache;
+    // most recently used first
+    GQueue* lru;
+};
+
+static sqlite3_stmt* _session_stmt(session_store_t* session_store, session_stmt_t stmt, const char* const name);
+static const signal_buffer* _session_get(session_store_t* session_store, const char* const name, uint32_t device_id);
+static void _session_cache_put(session_store_t* session_store, const char* const name, uint32_t device_id, const uint8_t* record, size_t record_len);
+static void _session_cache_free(cached_session_t* cached);
+static gboolean _identity_matches(identity_key_store_t* identity_key_store, const signal_protocol_address* address, const uint8_t* key_data, size_t key_len);
+
+session_store_t*
+session_store_new(void)
+{
+    session_store_t* session_store = calloc(1, sizeof(session_store_t));
+    session_store->cache = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)_session_cache_free);
+    session_store->lru = g_queue_new();
 
-static void _g_hash_table_free(GHashTable* hash_table);
+    return session_store;
+}
 
-GHashTable*
-session_store_new(void)
+gboolean
+session_store_open(session_store_t* session_store, const char* const filename)
+{
+    if (sqlite3_open(filename, &session_store->db) != SQLITE_OK) {
+        log_error("[OMEMO][STORE] Error opening sessions database %s: %s", filename, sqlite3_errmsg(session_store->db));
+        sqlite3_close(session_store->db);
+        session_store->db = NULL;
+        return FALSE;
+    }
+
+    // a session changes with every message, do not wait for the disk each time
+    char* err_msg = NULL;
+    const char* query = "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL; "
+                        "CREATE TABLE IF NOT EXISTS `Sessions` (`jid` TEXT NOT NULL, `device_id` INTEGER NOT NULL, `record` BLOB NOT NULL, PRIMARY KEY (`jid`, `device_id`))";
+    if (sqlite3_exec(session_store->db, query, NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("[OMEMO][STORE] Error creating sessions table: %s", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_close(session_store->db);
+        session_store->db = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Copy the sessions of the old sessions.txt key file into the database.
+gboolean
+session_store_import(session_store_t* session_store, GKeyFile* sessions)
+{
+    if (!session_store->db) {
+        return FALSE;
+    }
+
+    sqlite3_exec(session_store->db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+
+    int count = 0;
+    gboolean ok = TRUE;
+    char** groups = g_key_file_get_groups(sessions, NULL);
+    for (int i = 0; ok && groups[i] != NULL; i++) {
+        char** keys = g_key_file_get_keys(sessions, groups[i], NULL, NULL);
+        for (int j = 0; ok && keys && keys[j] != NULL; j++) {
+            char* record_b64 = g_key_file_get_string(sessions, groups[i], keys[j], NULL);
+            size_t record_len;
+            guchar* record = g_base64_decode(record_b64, &record_len);
+            g_free(record_b64);
+
+            sqlite3_stmt* stmt = _session_stmt(session_store, SESSION_STMT_STORE, groups[i]);
+            if (stmt) {
+                sqlite3_bind_int64(stmt, 2, strtoul(keys[j], NULL, 10));
+                sqlite3_bind_blob(stmt, 3, record, record_len, SQLITE_TRANSIENT);
+                ok = sqlite3_step(stmt) == SQLITE_DONE;
+                count++;
+            } else {
+                ok = FALSE;
+            }
+            g_free(record);
+        }
+        g_strfreev(keys);
+    }
+    g_strfreev(groups);
+
+    if (!ok) {
+        log_error("[OMEMO][STORE] Error importing sessions: %s", sqlite3_errmsg(session_store->db));
+        sqlite3_exec(session_store->db, "ROLLBACK", NULL, NULL, NULL);
+        return FALSE;
+    }
+
+    sqlite3_exec(session_store->db, "END TRANSACTION", NULL, NULL, NULL);
+    log_info("[OMEMO][STORE] Imported %d sessions", count);
+
+    return TRUE;
+}
+
+void
+session_store_free(session_store_t* session_store)
 {
-    return g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_g_hash_table_free);
+    if (!session_store) {
+        return;
+    }
+
+    for (int i = 0; i < SESSION_STMT_LAST; i++) {
+        sqlite3_finalize(session_store->stmts[i]);
+    }
+    sqlite3_close(session_store->db);
+    g_hash_table_destroy(session_store->cache);
+    g_queue_free(session_store->lru);
+    free(session_store);
+}
+
+// Rough heap use of the sessions cached in memory, SQLite keeps its own
+gsize
+session_store_memory(session_store_t* session_store, guint* sessions)
+{
+    *sessions = g_hash_table_size(session_store->cache);
+    gsize total = memusage_alloc(sizeof(session_store_t)) + memusage_hash_table(session_store->cache);
+    total += memusage_alloc(sizeof(GQueue)) + memusage_list(session_store->lru->head);
+
+    for (GList* curr = session_store->lru->head; curr; curr = g_list_next(curr)) {
+        cached_session_t* cached = curr->data;
+        total += memusage_alloc(sizeof(cached_session_t)) + memusage_string(cached->key) + memusage_string(cached->name);
+        if (cached->record) {
+            total += memusage_alloc(sizeof(size_t) + signal_buffer_len(cached->record));
+        }
+    }
+
+    return total;
 }
 
 GHashTable*
@@ -78,22 +236,13 @@ load_session(signal_buffer** record, signal_buffer** user_record,
              const signal_protocol_address* address, void* user_data)
 #endif
 {
-    GHashTable* session_store = (GHashTable*)user_data;
-    GHashTable* device_store = NULL;
-
-    log_debug("[OMEMO][STORE] Looking for %s in session_store", address->name);
-    device_store = g_hash_table_lookup(session_store, address->name);
-    if (!device_store) {
-        *record = NULL;
-        log_info("[OMEMO][STORE] No device store for %s found", address->name);
-        return 0;
-    }
+    session_store_t* session_store = (session_store_t*)user_data;
 
     log_debug("[OMEMO][STORE] Looking for device %d of %s ", address->device_id, address->name);
-    signal_buffer* original = g_hash_table_lookup(device_store, GINT_TO_POINTER(address->device_id));
+    const signal_buffer* original = _session_get(session_store, address->name, address->device_id);
     if (!original) {
         *record = NULL;
-        log_warning("[OMEMO][STORE] No device (%d) store for %s found", address->device_id, address->name);
+        log_info("[OMEMO][STORE] No session for device %d of %s found", address->device_id, address->name);
         return 0;
     }
     *record = signal_buffer_copy(original);
@@ -104,21 +253,16 @@ int
 get_sub_device_sessions(signal_int_list** sessions, const char* name,
                         size_t name_len, void* user_data)
 {
-    GHashTable* session_store = (GHashTable*)user_data;
-    GHashTable* device_store = NULL;
-    GHashTableIter iter;
-    gpointer key, value;
+    session_store_t* session_store = (session_store_t*)user_data;
+
+    *sessions = signal_int_list_alloc();
 
-    device_store = g_hash_table_lookup(session_store, name);
-    if (!device_store) {
-        log_debug("[OMEMO][STORE] What?");
+    sqlite3_stmt* stmt = _session_stmt(session_store, SESSION_STMT_DEVICES, name);
+    if (!stmt) {
         return SG_SUCCESS;
     }
-
-    *sessions = signal_int_list_alloc();
-    g_hash_table_iter_init(&iter, device_store);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        signal_int_list_push_back(*sessions, GPOINTER_TO_INT(key));
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        signal_int_list_push_back(*sessions, sqlite3_column_int64(stmt, 0));
     }
 
     return SG_SUCCESS;
@@ -136,26 +280,21 @@ store_session(const signal_protocol_address* address,
               void* user_data)
 #endif
 {
-    GHashTable* session_store = (GHashTable*)user_data;
-    GHashTable* device_store = NULL;
+    session_store_t* session_store = (session_store_t*)user_data;
 
     log_debug("[OMEMO][STORE] Store session for %s (%d)", address->name, address->device_id);
-    device_store = g_hash_table_lookup(session_store, (void*)address->name);
-    if (!device_store) {
-        device_store = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)signal_buffer_free);
-        g_hash_table_insert(session_store, strdup(address->name), device_store);
+    sqlite3_stmt* stmt = _session_stmt(session_store, SESSION_STMT_STORE, address->name);
+    if (!stmt) {
+        return SG_ERR_UNKNOWN;
+    }
+    sqlite3_bind_int64(stmt, 2, address->device_id);
+    sqlite3_bind_blob(stmt, 3, record, record_len, SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        log_error("[OMEMO][STORE] Error storing session for %s (%d): %s", address->name, address->device_id, sqlite3_errmsg(session_store->db));
+        return SG_ERR_UNKNOWN;
     }
 
-    signal_buffer* buffer = signal_buffer_create(record, record_len);
-    g_hash_table_insert(device_store, GINT_TO_POINTER(address->device_id), buffer);
-
-    char* record_b64 = g_base64_encode(record, record_len);
-    char* device_id = g_strdup_printf("%d", address->device_id);
-    g_key_file_set_string(omemo_sessions_keyfile(), address->name, device_id, record_b64);
-    free(device_id);
-    g_free(record_b64);
-
-    omemo_sessions_keyfile_save();
+    _session_cache_put(session_store, address->name, address->device_id, record, record_len);
 
     return SG_SUCCESS;
 }
@@ -163,16 +302,9 @@ store_session(const signal_protocol_address* address,
 int
 contains_session(const signal_protocol_address* address, void* user_data)
 {
-    GHashTable* session_store = (GHashTable*)user_data;
-    GHashTable* device_store = NULL;
-
-    device_store = g_hash_table_lookup(session_store, address->name);
-    if (!device_store) {
-        log_debug("[OMEMO][STORE] No Device");
-        return 0;
-    }
+    session_store_t* session_store = (session_store_t*)user_data;
 
-    if (!g_hash_table_lookup(device_store, GINT_TO_POINTER(address->device_id))) {
+    if (!_session_get(session_store, address->name, address->device_id)) {
         log_debug("[OMEMO][STORE] No Session for %d ", address->device_id);
         return 0;
     }
@@ -183,20 +315,19 @@ contains_session(const signal_protocol_address* address, void* user_data)
 int
 delete_session(const signal_protocol_address* address, void* user_data)
 {
-    GHashTable* session_store = (GHashTable*)user_data;
-    GHashTable* device_store = NULL;
+    session_store_t* session_store = (session_store_t*)user_data;
 
-    device_store = g_hash_table_lookup(session_store, address->name);
-    if (!device_store) {
+    sqlite3_stmt* stmt = _session_stmt(session_store, SESSION_STMT_DELETE, address->name);
+    if (!stmt) {
         return SG_SUCCESS;
     }
+    sqlite3_bind_int64(stmt, 2, address->device_id);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        log_error("[OMEMO][STORE] Error deleting session for %s (%d): %s", address->name, address->device_id, sqlite3_errmsg(session_store->db));
+        return SG_ERR_UNKNOWN;
+    }
 
-    g_hash_table_remove(device_store, GINT_TO_POINTER(address->device_id));
-
-    char* device_id_str = g_strdup_printf("%d", address->device_id);
-    g_key_file_remove_key(omemo_sessions_keyfile(), address->name, device_id_str, NULL);
-    g_free(device_id_str);
-    omemo_sessions_keyfile_save();
+    _session_cache_put(session_store, address->name, address->device_id, NULL, 0);
 
     return SG_SUCCESS;
 }
@@ -204,18 +335,29 @@ delete_session(const signal_protocol_address* address, void* user_data)
 int
 delete_all_sessions(const char* name, size_t name_len, void* user_data)
 {
-    GHashTable* session_store = (GHashTable*)user_data;
-    GHashTable* device_store = NULL;
+    session_store_t* session_store = (session_store_t*)user_data;
 
-    device_store = g_hash_table_lookup(session_store, name);
-    if (!device_store) {
-        log_debug("[OMEMO][STORE] No device => no delete");
+    sqlite3_stmt* stmt = _session_stmt(session_store, SESSION_STMT_DELETE_ALL, name);
+    if (!stmt) {
+        log_debug("[OMEMO][STORE] No database => no delete");
         return SG_SUCCESS;
     }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        log_error("[OMEMO][STORE] Error deleting sessions for %s: %s", name, sqlite3_errmsg(session_store->db));
+        return SG_ERR_UNKNOWN;
+    }
+
+    GList* curr = session_store->lru->head;
+    while (curr) {
+        cached_session_t* cached = curr->data;
+        curr = g_list_next(curr);
+        if (g_strcmp0(cached->name, name) == 0) {
+            g_queue_delete_link(session_store->lru, cached->link);
+            g_hash_table_remove(session_store->cache, cached->key);
+        }
+    }
 
-    guint len = g_hash_table_size(device_store);
-    g_hash_table_remove_all(device_store);
-    return len;
+    return sqlite3_changes(session_store->db);
 }
 
 int
@@ -278,6 +420,7 @@ remove_pre_key(uint32_t pre_key_id, void* user_data)
     omemo_identity_keyfile_save();
 
     if (ret > 0) {
+        omemo_pre_key_removed();
         return SG_SUCCESS;
     } else {
         log_error("[OMEMO][STORE] SG_ERR_INVALID_KEY_ID");
@@ -389,6 +532,12 @@ save_identity(const signal_protocol_address* address, uint8_t* key_data,
         }
     }
 
+    // libsignal saves the identity after every message it encrypts, the
+    // keyfile is only touched when the key changes
+    if (_identity_matches(identity_key_store, address, key_data, key_len)) {
+        return SG_SUCCESS;
+    }
+
     signal_buffer* buffer = signal_buffer_create(key_data, key_len);
 
     GHashTable* trusted = g_hash_table_lookup(identity_key_store->trusted, address->name);
@@ -414,37 +563,18 @@ int
 is_trusted_identity(const signal_protocol_address* address, uint8_t* key_data,
                     size_t key_len, void* user_data)
 {
-    int ret;
     identity_key_store_t* identity_key_store = (identity_key_store_t*)user_data;
-    log_debug("[OMEMO][STORE] Checking trust %s (%d)", address->name, address->device_id);
-    GHashTable* trusted = g_hash_table_lookup(identity_key_store->trusted, address->name);
-    if (!trusted) {
-        if (identity_key_store->recv) {
-            log_debug("[OMEMO][STORE] identity_key_store->recv");
-            return 1;
-        } else {
-            log_debug("[OMEMO][STORE] !identity_key_store->recv");
-            return 0;
-        }
-    }
-
-    signal_buffer* buffer = signal_buffer_create(key_data, key_len);
-    signal_buffer* original = g_hash_table_lookup(trusted, GINT_TO_POINTER(address->device_id));
-
-    if (!original) {
-        log_debug("[OMEMO][STORE] original not found %s (%d)", address->name, address->device_id);
-    }
-    ret = original != NULL && signal_buffer_compare(buffer, original) == 0;
-
-    signal_buffer_free(buffer);
 
     if (identity_key_store->recv) {
-        log_debug("[OMEMO][STORE] 1 identity_key_store->recv");
         return 1;
-    } else {
-        log_debug("[OMEMO][STORE] Checking trust %s (%d): %d", address->name, address->device_id, ret);
-        return ret;
     }
+
+    int ret = _identity_matches(identity_key_store, address, key_data, key_len);
+    if (!ret) {
+        log_debug("[OMEMO][STORE] Not trusted %s (%d)", address->name, address->device_id);
+    }
+
+    return ret;
 }
 
 int
@@ -463,9 +593,114 @@ load_sender_key(signal_buffer** record, signal_buffer** user_record,
     return SG_SUCCESS;
 }
 
+// The prepared statement reset and with the jid bound, NULL without a database.
+static sqlite3_stmt*
+_session_stmt(session_store_t* session_store, session_stmt_t stmt, const char* const name)
+{
+    if (!session_store->db) {
+        return NULL;
+    }
+
+    if (!session_store->stmts[stmt]) {
+        if (sqlite3_prepare_v2(session_store->db, session_stmt_sql[stmt], -1, &session_store->stmts[stmt], NULL) != SQLITE_OK) {
+            log_error("[OMEMO][STORE] SQLite error in _session_stmt(): %s", sqlite3_errmsg(session_store->db));
+            session_store->stmts[stmt] = NULL;
+            return NULL;
+        }
+    } else {
+        sqlite3_reset(session_store->stmts[stmt]);
+        sqlite3_clear_bindings(session_store->stmts[stmt]);
+    }
+
+    sqlite3_bind_text(session_store->stmts[stmt], 1, name, -1, SQLITE_TRANSIENT);
+
+    return session_store->stmts[stmt];
+}
+
+static const signal_buffer*
+_session_get(session_store_t* session_store, const char* const name, uint32_t device_id)
+{
+    char* key = g_strdup_printf("%u:%s", device_id, name);
+    cached_session_t* cached = g_hash_table_lookup(session_store->cache, key);
+    g_free(key);
+
+    if (cached) {
+        g_queue_unlink(session_store->lru, cached->link);
+        g_queue_push_head_link(session_store->lru, cached->link);
+        return cached->record;
+    }
+
+    sqlite3_stmt* stmt = _session_stmt(session_store, SESSION_STMT_LOAD, name);
+    if (!stmt) {
+        return NULL;
+    }
+    sqlite3_bind_int64(stmt, 2, device_id);
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        _session_cache_put(session_store, name, device_id, sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0));
+    } else {
+        _session_cache_put(session_store, name, device_id, NULL, 0);
+    }
+    sqlite3_reset(stmt);
+
+    cached = g_queue_peek_head(session_store->lru);
+    return cached->record;
+}
+
 static void
-_g_hash_table_free(GHashTable* hash_table)
+_session_cache_put(session_store_t* session_store, const char* const name, uint32_t device_id, const uint8_t* record, size_t record_len)
 {
-    g_hash_table_remove_all(hash_table);
-    g_hash_table_unref(hash_table);
+    char* key = g_strdup_printf("%u:%s", device_id, name);
+    cached_session_t* cached = g_hash_table_lookup(session_store->cache, key);
+
+    if (cached) {
+        g_free(key);
+        signal_buffer_free(cached->record);
+        g_queue_unlink(session_store->lru, cached->link);
+    } else {
+        cached = calloc(1, sizeof(cached_session_t));
+        cached->key = key;
+        cached->name = strdup(name);
+        cached->device_id = device_id;
+        cached->link = g_list_alloc();
+        cached->link->data = cached;
+        g_hash_table_insert(session_store->cache, cached->key, cached);
+    }
+    cached->record = record ? signal_buffer_create(record, record_len) : NULL;
+    g_queue_push_head_link(session_store->lru, cached->link);
+
+    if (g_queue_get_length(session_store->lru) > SESSION_CACHE_SIZE) {
+        GList* oldest = g_queue_pop_tail_link(session_store->lru);
+        cached_session_t* evicted = oldest->data;
+        g_list_free_1(oldest);
+        g_hash_table_remove(session_store->cache, evicted->key);
+    }
+}
+
+// the link belongs to the LRU queue and is freed with it
+static void
+_session_cache_free(cached_session_t* cached)
+{
+    free(cached->name);
+    g_free(cached->key);
+    signal_buffer_free(cached->record);
+    free(cached);
+}
+
+// Compares against the trusted key of the device in place, this runs for
+// every device a message is encrypted or decrypted for
+static gboolean
+_identity_matches(identity_key_store_t* identity_key_store, const signal_protocol_address* address, const uint8_t* key_data, size_t key_len)
+{
+    GHashTable* trusted = g_hash_table_lookup(identity_key_store->trusted, address->name);
+    if (!trusted) {
+        return FALSE;
+    }
+
+    signal_buffer* original = g_hash_table_lookup(trusted, GINT_TO_POINTER(address->device_id));
+    if (!original) {
+        return FALSE;
+    }
+
+    return signal_buffer_len(original) == key_len && memcmp(signal_buffer_const_data(original), key_data, key_len) == 0;
 }
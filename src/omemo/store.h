@@ -44,6 +44,10 @@
 #define OMEMO_STORE_KEY_IDENTITY_KEY_PUBLIC  "identity_key_public"
 #define OMEMO_STORE_KEY_IDENTITY_KEY_PRIVATE "identity_key_private"
 
+// Sessions live in an SQLite database and are read when first needed, the
+// most recently used records are kept decoded in memory.
+typedef struct session_store_t session_store_t;
+
 typedef struct
 {
     signal_buffer* public;
@@ -53,7 +57,11 @@ typedef struct
     bool recv;
 } identity_key_store_t;
 
-GHashTable* session_store_new(void);
+session_store_t* session_store_new(void);
+gboolean session_store_open(session_store_t* session_store, const char* const filename);
+gboolean session_store_import(session_store_t* session_store, GKeyFile* sessions);
+void session_store_free(session_store_t* session_store);
+gsize session_store_memory(session_store_t* session_store, guint* sessions);
 GHashTable* pre_key_store_new(void);
 GHashTable* signed_pre_key_store_new(void);
 void identity_key_store_new(identity_key_store_t* identity_key_store);
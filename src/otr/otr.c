@@ -47,6 +47,7 @@
 #include "config/files.h"
 #include "otr/otr.h"
 #include "otr/otrlib.h"
+#include "tools/scheduler.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
 #include "xmpp/chat_session.h"
@@ -58,11 +59,18 @@
 #define PRESENCE_OFFLINE 0
 #define PRESENCE_UNKNOWN -1
 
+// fingerprint changes come in bursts during AKE, write them once
+#define OTR_FINGERPRINTS_SAVE_DELAY_MS 2000
+
 static OtrlUserState user_state;
 static OtrlMessageAppOps ops;
 static char* jid;
 static gboolean data_loaded;
 static GHashTable* smp_initiators;
+static SchedulerTask* fingerprints_task;
+
+static void _otr_fingerprints_flush(void);
+static prof_otrpolicy_t _otr_window_policy(ProfChatWin* chatwin);
 
 OtrlUserState
 otr_userstate(void)
@@ -125,9 +133,11 @@ cb_inject_message(void* opdata, const char* accountname,
     free(id);
 }
 
-static void
-cb_write_fingerprints(void* opdata)
+static gboolean
+_otr_fingerprints_save(void* data)
 {
+    fingerprints_task = NULL;
+
     gcry_error_t err = 0;
     gchar* otr_dir = files_get_account_data_path(DIR_OTR, jid);
 
@@ -142,6 +152,26 @@ cb_write_fingerprints(void* opdata)
 
     g_free(otr_dir);
     g_string_free(fpsfilename, TRUE);
+
+    return FALSE;
+}
+
+static void
+cb_write_fingerprints(void* opdata)
+{
+    if (!fingerprints_task) {
+        fingerprints_task = scheduler_add(OTR_FINGERPRINTS_SAVE_DELAY_MS, _otr_fingerprints_save, NULL, NULL);
+    }
+}
+
+// write pending fingerprint changes now, before the user state goes away
+static void
+_otr_fingerprints_flush(void)
+{
+    if (fingerprints_task) {
+        scheduler_remove(fingerprints_task);
+        _otr_fingerprints_save(NULL);
+    }
 }
 
 static void
@@ -184,6 +214,7 @@ otr_init(void)
     otrlib_init_ops(&ops);
     otrlib_init_timer();
     smp_initiators = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    fingerprints_task = NULL;
 
     data_loaded = FALSE;
 }
@@ -191,6 +222,8 @@ otr_init(void)
 void
 otr_shutdown(void)
 {
+    _otr_fingerprints_flush();
+
     if (jid) {
         free(jid);
         jid = NULL;
@@ -206,6 +239,9 @@ otr_poll(void)
 void
 otr_on_connect(ProfAccount* account)
 {
+    // belongs to the previous account
+    _otr_fingerprints_flush();
+
     if (jid) {
         free(jid);
     }
@@ -289,9 +325,22 @@ otr_on_connect(ProfAccount* account)
 char*
 otr_on_message_recv(const char* const barejid, const char* const resource, const char* const message, gboolean* decrypted)
 {
-    prof_otrpolicy_t policy = otr_get_policy(barejid);
+    ProfChatWin* chatwin = wins_get_chat(barejid);
+    prof_otrpolicy_t policy = chatwin ? _otr_window_policy(chatwin) : otr_get_policy(barejid);
+
     char* whitespace_base = strstr(message, OTRL_MESSAGE_TAG_BASE);
 
+    // with the manual policy and no session only OTR data or a whitespace tag
+    // concerns libotr, which would otherwise look up the context and parse
+    // every message
+    if (policy == PROF_OTRPOLICY_MANUAL && !strstr(message, "?OTR") && !whitespace_base) {
+        ConnContext* context = otrlib_context_find(user_state, barejid, jid);
+        if (!context || context->msgstate == OTRL_MSGSTATE_PLAINTEXT) {
+            *decrypted = FALSE;
+            return strdup(message);
+        }
+    }
+
     // check for OTR whitespace (opportunistic or always)
     if (policy == PROF_OTRPOLICY_OPPORTUNISTIC || policy == PROF_OTRPOLICY_ALWAYS) {
         if (whitespace_base) {
@@ -330,7 +379,7 @@ gboolean
 otr_on_message_send(ProfChatWin* chatwin, const char* const message, gboolean request_receipt, const char* const replace_id)
 {
     char* id = NULL;
-    prof_otrpolicy_t policy = otr_get_policy(chatwin->barejid);
+    prof_otrpolicy_t policy = _otr_window_policy(chatwin);
 
     // Send encrypted message
     if (otr_is_secure(chatwin->barejid)) {
@@ -720,6 +769,21 @@ otr_encrypt_message(const char* const to, const char* const message)
     }
 }
 
+// otr_get_policy() reads the account each time, a window keeps the result
+// until the accounts or the preferences change
+static prof_otrpolicy_t
+_otr_window_policy(ProfChatWin* chatwin)
+{
+    // both counters only grow, so their sum changes with either
+    guint generation = accounts_get_generation() + prefs_get_generation();
+    if (chatwin->otr_policy_generation != generation) {
+        chatwin->otr_policy = otr_get_policy(chatwin->barejid);
+        chatwin->otr_policy_generation = generation;
+    }
+
+    return chatwin->otr_policy;
+}
+
 static void
 _otr_tlv_free(OtrlTLV* tlvs)
 {
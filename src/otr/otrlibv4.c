@@ -42,11 +42,12 @@
 #include "log.h"
 #include "otr/otr.h"
 #include "otr/otrlib.h"
+#include "tools/scheduler.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
 
-static GTimer* timer;
-static unsigned int current_interval;
+// runs otrl_message_poll() while libotr asks for it through timer_control
+static SchedulerTask* poll_task;
 
 OtrlPolicy
 otrlib_policy(void)
@@ -57,22 +58,17 @@ otrlib_policy(void)
 void
 otrlib_init_timer(void)
 {
-    OtrlUserState user_state = otr_userstate();
-    timer = g_timer_new();
-    current_interval = otrl_message_poll_get_default_interval(user_state);
+    poll_task = NULL;
 }
 
-void
-otrlib_poll(void)
+static gboolean
+_otrlib_poll(void* data)
 {
-    gdouble elapsed = g_timer_elapsed(timer, NULL);
+    OtrlUserState user_state = otr_userstate();
+    OtrlMessageAppOps* ops = otr_messageops();
+    otrl_message_poll(user_state, ops, NULL);
 
-    if (current_interval != 0 && elapsed > current_interval) {
-        OtrlUserState user_state = otr_userstate();
-        OtrlMessageAppOps* ops = otr_messageops();
-        otrl_message_poll(user_state, ops, NULL);
-        g_timer_start(timer);
-    }
+    return TRUE;
 }
 
 char*
@@ -107,7 +103,14 @@ cb_otr_error_message_free(void* opdata, const char* err_msg)
 static void
 cb_timer_control(void* opdata, unsigned int interval)
 {
-    current_interval = interval;
+    if (interval == 0) {
+        scheduler_remove(poll_task);
+        poll_task = NULL;
+    } else if (poll_task) {
+        scheduler_set_interval(poll_task, interval * 1000);
+    } else {
+        poll_task = scheduler_add(interval * 1000, _otrlib_poll, NULL, NULL);
+    }
 }
 
 static void
@@ -39,6 +39,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
 #include <glib.h>
@@ -49,14 +50,43 @@
 #include "common.h"
 #include "pgp/gpg.h"
 #include "config/files.h"
+#include "config/persist.h"
 #include "tools/autocomplete.h"
+#include "tools/scheduler.h"
 #include "ui/ui.h"
+#include "xmpp/xmpp.h"
 
 #define PGP_SIGNATURE_HEADER "-----BEGIN PGP SIGNATURE-----"
 #define PGP_SIGNATURE_FOOTER "-----END PGP SIGNATURE-----"
 #define PGP_MESSAGE_HEADER   "-----BEGIN PGP MESSAGE-----"
 #define PGP_MESSAGE_FOOTER   "-----END PGP MESSAGE-----"
 
+#define PGP_JOB_POLL_MS 50
+
+typedef enum {
+    PGP_JOB_DECRYPT,
+    PGP_JOB_VERIFY,
+    // runs nothing, keeps a callback in line behind earlier jobs
+    PGP_JOB_NONE
+} pgp_job_t;
+
+// Work for the crypto thread. Jobs finish in the order they were added and
+// their callbacks run on the main thread in that order.
+typedef struct
+{
+    pgp_job_t type;
+    char* barejid;
+    char* input;
+    char* passphrase;
+    ProfPGPDecryptCallback func;
+    void* userdata;
+    GDestroyNotify free_func;
+    // set by the worker
+    char* output;
+    gboolean need_passphrase;
+    gboolean done;
+} ProfPGPJob;
+
 static const char* libversion = NULL;
 static GHashTable* pubkeys;
 
@@ -68,12 +98,52 @@ static char* passphrase_attempt;
 
 static Autocomplete key_ac;
 
+// every key in the keyring by name, listed again when the keyring changes
+static GHashTable* key_index = NULL;
+// the keys of key_index by key id and by fingerprint
+static GHashTable* key_index_ids = NULL;
+static gint64 key_index_stamp = 0;
+static gchar* keyring_dir = NULL;
+
+// long lived contexts for the main thread, see _p_gpg_ctx() and _ox_ctx()
+static gpgme_ctx_t pgp_ctx = NULL;
+static gpgme_ctx_t ox_ctx = NULL;
+
+// barejid prefixed with "s:" or "p:" for secret and public keys -> gpgme_key_t
+static GHashTable* ox_keys = NULL;
+
+static pthread_t pgp_worker;
+static gboolean pgp_worker_running = FALSE;
+static GQueue* pgp_jobs = NULL;
+// jobs not yet taken by the worker, the tail of pgp_jobs
+static guint pgp_jobs_waiting = 0;
+static pthread_mutex_t pgp_jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pgp_jobs_cond = PTHREAD_COND_INITIALIZER;
+static SchedulerTask* pgp_jobs_task = NULL;
+
 static char* _remove_header_footer(char* str, const char* const footer);
 static char* _add_header_footer(const char* const str, const char* const header, const char* const footer);
 static void _save_pubkeys(void);
+static void _pubkeys_write(void);
 
 static gpgme_key_t _ox_key_lookup(const char* const barejid, gboolean secret_only);
 static gboolean _ox_key_is_usable(gpgme_key_t key, const char* const barejid, gboolean secret);
+static gpgme_ctx_t _p_gpg_ctx(void);
+static gpgme_ctx_t _ox_ctx(void);
+static void _ox_keys_clear(void);
+static ProfPGPKey* _p_gpg_key_copy(ProfPGPKey* key);
+static gint64 _p_gpg_keyring_stamp(void);
+static gboolean _p_gpg_key_index_load(void);
+static ProfPGPKey* _p_gpg_key_index_lookup(const char* const keyid);
+static void _p_gpg_key_index_clear(void);
+static char* _p_gpg_verify(gpgme_ctx_t ctx, const char* const sign, gpgme_error_t* error);
+static void _p_gpg_verified(ProfPGPJob* job);
+static char* _p_gpg_decrypt(gpgme_ctx_t ctx, const char* const cipher, GString* recipients, gpgme_error_t* error);
+
+static void _p_gpg_job_add(ProfPGPJob* job);
+static void* _p_gpg_worker(void* data);
+static gboolean _p_gpg_jobs_check(void* data);
+static void _p_gpg_job_free(ProfPGPJob* job);
 
 void
 _p_gpg_free_pubkeyid(ProfPGPPubKeyId* pubkeyid)
@@ -121,8 +191,7 @@ p_gpg_init(void)
     pubkeys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_p_gpg_free_pubkeyid);
 
     key_ac = autocomplete_new();
-    GHashTable* keys = p_gpg_list_keys();
-    p_gpg_free_keys(keys);
+    _p_gpg_key_index_load();
 
     passphrase = NULL;
     passphrase_attempt = NULL;
@@ -131,6 +200,33 @@ p_gpg_init(void)
 void
 p_gpg_close(void)
 {
+    // too late to deliver anything, the windows are gone
+    if (pgp_worker_running) {
+        pthread_mutex_lock(&pgp_jobs_lock);
+        pgp_worker_running = FALSE;
+        pthread_cond_broadcast(&pgp_jobs_cond);
+        pthread_mutex_unlock(&pgp_jobs_lock);
+        pthread_join(pgp_worker, NULL);
+    }
+    if (pgp_jobs) {
+        g_queue_free_full(pgp_jobs, (GDestroyNotify)_p_gpg_job_free);
+        pgp_jobs = NULL;
+        pgp_jobs_waiting = 0;
+    }
+    scheduler_remove(pgp_jobs_task);
+    pgp_jobs_task = NULL;
+
+    _ox_keys_clear();
+    if (pgp_ctx) {
+        gpgme_release(pgp_ctx);
+        pgp_ctx = NULL;
+    }
+    if (ox_ctx) {
+        gpgme_release(ox_ctx);
+        ox_ctx = NULL;
+    }
+
+    persist_flush(_pubkeys_write);
     if (pubkeys) {
         g_hash_table_destroy(pubkeys);
         pubkeys = NULL;
@@ -144,6 +240,10 @@ p_gpg_close(void)
     free(pubsloc);
     pubsloc = NULL;
 
+    _p_gpg_key_index_clear();
+    g_free(keyring_dir);
+    keyring_dir = NULL;
+
     autocomplete_free(key_ac);
     key_ac = NULL;
 
@@ -211,11 +311,14 @@ p_gpg_on_connect(const char* const barejid)
             g_error_free(gerr);
             g_free(keyid);
         } else {
-            gpgme_key_t key = NULL;
-            error = gpgme_get_key(ctx, keyid, &key, 0);
-            if (error || key == NULL) {
-                log_warning("GPG: Failed to get key for %s: %s %s", jid, gpgme_strsource(error), gpgme_strerror(error));
-                continue;
+            if (!_p_gpg_key_index_lookup(keyid)) {
+                gpgme_key_t key = NULL;
+                error = gpgme_get_key(ctx, keyid, &key, 0);
+                if (error || key == NULL) {
+                    log_warning("GPG: Failed to get key for %s: %s %s", jid, gpgme_strsource(error), gpgme_strerror(error));
+                    continue;
+                }
+                gpgme_key_unref(key);
             }
 
             ProfPGPPubKeyId* pubkeyid = malloc(sizeof(ProfPGPPubKeyId));
@@ -223,7 +326,6 @@ p_gpg_on_connect(const char* const barejid)
             pubkeyid->received = FALSE;
             g_hash_table_replace(pubkeys, strdup(jid), pubkeyid);
             g_free(keyid);
-            gpgme_key_unref(key);
         }
     }
 
@@ -236,6 +338,10 @@ p_gpg_on_connect(const char* const barejid)
 void
 p_gpg_on_disconnect(void)
 {
+    p_gpg_jobs_finish();
+    _ox_keys_clear();
+    persist_flush(_pubkeys_write);
+
     if (pubkeys) {
         g_hash_table_destroy(pubkeys);
         pubkeys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_p_gpg_free_pubkeyid);
@@ -323,90 +429,19 @@ _p_gpg_free_key(ProfPGPKey* key)
 GHashTable*
 p_gpg_list_keys(void)
 {
-    gpgme_error_t error;
-    GHashTable* result = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_p_gpg_free_key);
-
-    gpgme_ctx_t ctx;
-    error = gpgme_new(&ctx);
-
-    if (error) {
-        log_error("GPG: Could not list keys. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+    if (!_p_gpg_key_index_load()) {
         return NULL;
     }
 
-    error = gpgme_op_keylist_start(ctx, NULL, 0);
-    if (error == GPG_ERR_NO_ERROR) {
-        gpgme_key_t key;
-        error = gpgme_op_keylist_next(ctx, &key);
-        while (!error) {
-            gpgme_subkey_t sub = key->subkeys;
-
-            ProfPGPKey* p_pgpkey = _p_gpg_key_new();
-            p_pgpkey->id = strdup(sub->keyid);
-            p_pgpkey->name = strdup(key->uids->uid);
-            p_pgpkey->fp = strdup(sub->fpr);
-            if (sub->can_encrypt)
-                p_pgpkey->encrypt = TRUE;
-            if (sub->can_authenticate)
-                p_pgpkey->authenticate = TRUE;
-            if (sub->can_certify)
-                p_pgpkey->certify = TRUE;
-            if (sub->can_sign)
-                p_pgpkey->sign = TRUE;
-
-            sub = sub->next;
-            while (sub) {
-                if (sub->can_encrypt)
-                    p_pgpkey->encrypt = TRUE;
-                if (sub->can_authenticate)
-                    p_pgpkey->authenticate = TRUE;
-                if (sub->can_certify)
-                    p_pgpkey->certify = TRUE;
-                if (sub->can_sign)
-                    p_pgpkey->sign = TRUE;
-
-                sub = sub->next;
-            }
-
-            g_hash_table_insert(result, strdup(p_pgpkey->name), p_pgpkey);
-
-            gpgme_key_unref(key);
-            error = gpgme_op_keylist_next(ctx, &key);
-        }
-    }
-
-    error = gpgme_op_keylist_start(ctx, NULL, 1);
-    if (error == GPG_ERR_NO_ERROR) {
-        gpgme_key_t key;
-        error = gpgme_op_keylist_next(ctx, &key);
-        while (!error) {
-            gpgme_subkey_t sub = key->subkeys;
-            while (sub) {
-                if (sub->secret) {
-                    ProfPGPKey* p_pgpkey = g_hash_table_lookup(result, key->uids->uid);
-                    if (p_pgpkey) {
-                        p_pgpkey->secret = TRUE;
-                    }
-                }
-                sub = sub->next;
-            }
-
-            gpgme_key_unref(key);
-            error = gpgme_op_keylist_next(ctx, &key);
-        }
-    }
-
-    gpgme_release(ctx);
+    GHashTable* result = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_p_gpg_free_key);
 
-    autocomplete_clear(key_ac);
-    GList* ids = g_hash_table_get_keys(result);
-    GList* curr = ids;
-    while (curr) {
-        ProfPGPKey* key = g_hash_table_lookup(result, curr->data);
-        autocomplete_add(key_ac, key->id);
-        curr = curr->next;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, key_index);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        ProfPGPKey* p_pgpkey = _p_gpg_key_copy(value);
+        g_hash_table_insert(result, strdup(p_pgpkey->name), p_pgpkey);
     }
-    g_list_free(ids);
 
     return result;
 }
@@ -435,6 +470,12 @@ p_gpg_libver(void)
 gboolean
 p_gpg_valid_key(const char* const keyid, char** err_str)
 {
+    ProfPGPKey* indexed = _p_gpg_key_index_lookup(keyid);
+    if (indexed && indexed->secret) {
+        return TRUE;
+    }
+
+    // not a secret key we know, let GnuPG say why
     gpgme_ctx_t ctx;
     gpgme_error_t error = gpgme_new(&ctx);
     if (error) {
@@ -478,14 +519,18 @@ p_gpg_verify(const char* const barejid, const char* const sign)
         return;
     }
 
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
-
-    if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        return;
-    }
+    // a contact's presence is signed, verifying all of them on login is slow
+    ProfPGPJob* job = calloc(1, sizeof(ProfPGPJob));
+    job->type = PGP_JOB_VERIFY;
+    job->barejid = strdup(barejid);
+    job->input = strdup(sign);
+    _p_gpg_job_add(job);
+}
 
+// Key id of the key that made the signature, NULL if it is not known.
+static char*
+_p_gpg_verify(gpgme_ctx_t ctx, const char* const sign, gpgme_error_t* error)
+{
     char* sign_with_header_footer = _add_header_footer(sign, PGP_SIGNATURE_HEADER, PGP_SIGNATURE_FOOTER);
     gpgme_data_t sign_data;
     gpgme_data_new_from_mem(&sign_data, sign_with_header_footer, strlen(sign_with_header_footer), 1);
@@ -494,56 +539,55 @@ p_gpg_verify(const char* const barejid, const char* const sign)
     gpgme_data_t plain_data;
     gpgme_data_new(&plain_data);
 
-    error = gpgme_op_verify(ctx, sign_data, NULL, plain_data);
+    *error = gpgme_op_verify(ctx, sign_data, NULL, plain_data);
     gpgme_data_release(sign_data);
     gpgme_data_release(plain_data);
 
-    if (error) {
-        log_error("GPG: Failed to verify. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        gpgme_release(ctx);
-        return;
+    if (*error) {
+        return NULL;
     }
 
+    char* keyid = NULL;
     gpgme_verify_result_t result = gpgme_op_verify_result(ctx);
-    if (result) {
-        if (result->signatures) {
-            gpgme_key_t key = NULL;
-            error = gpgme_get_key(ctx, result->signatures->fpr, &key, 0);
-            if (error) {
-                log_debug("Could not find PGP key with ID %s for %s", result->signatures->fpr, barejid);
-            } else {
-                log_debug("Fingerprint found for %s: %s ", barejid, key->subkeys->fpr);
-                ProfPGPPubKeyId* pubkeyid = malloc(sizeof(ProfPGPPubKeyId));
-                pubkeyid->id = strdup(key->subkeys->keyid);
-                pubkeyid->received = TRUE;
-                g_hash_table_replace(pubkeys, strdup(barejid), pubkeyid);
-            }
-
-            gpgme_key_unref(key);
+    if (result && result->signatures) {
+        gpgme_key_t key = NULL;
+        if (gpgme_get_key(ctx, result->signatures->fpr, &key, 0) == GPG_ERR_NO_ERROR && key) {
+            keyid = g_strdup(key->subkeys->keyid);
         }
+        gpgme_key_unref(key);
     }
 
-    gpgme_release(ctx);
+    return keyid;
+}
+
+static void
+_p_gpg_verified(ProfPGPJob* job)
+{
+    if (!job->output) {
+        log_debug("Could not verify PGP signature of %s", job->barejid);
+        return;
+    }
+
+    log_debug("Key ID found for %s: %s ", job->barejid, job->output);
+    ProfPGPPubKeyId* pubkeyid = malloc(sizeof(ProfPGPPubKeyId));
+    pubkeyid->id = strdup(job->output);
+    pubkeyid->received = TRUE;
+    g_hash_table_replace(pubkeys, strdup(job->barejid), pubkeyid);
 }
 
 char*
 p_gpg_sign(const char* const str, const char* const fp)
 {
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
-    if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+    gpgme_ctx_t ctx = _p_gpg_ctx();
+    if (!ctx) {
         return NULL;
     }
 
-    gpgme_set_passphrase_cb(ctx, (gpgme_passphrase_cb_t)_p_gpg_passphrase_cb, NULL);
-
     gpgme_key_t key = NULL;
-    error = gpgme_get_key(ctx, fp, &key, 1);
+    gpgme_error_t error = gpgme_get_key(ctx, fp, &key, 1);
 
     if (error || key == NULL) {
         log_error("GPG: Failed to get key. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        gpgme_release(ctx);
         return NULL;
     }
 
@@ -553,7 +597,6 @@ p_gpg_sign(const char* const str, const char* const fp)
 
     if (error) {
         log_error("GPG: Failed to load signer. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        gpgme_release(ctx);
         return NULL;
     }
 
@@ -573,7 +616,7 @@ p_gpg_sign(const char* const str, const char* const fp)
     gpgme_set_armor(ctx, 1);
     error = gpgme_op_sign(ctx, str_data, signed_data, GPGME_SIG_MODE_DETACH);
     gpgme_data_release(str_data);
-    gpgme_release(ctx);
+    gpgme_signers_clear(ctx);
 
     if (error) {
         log_error("GPG: Failed to sign string. %s %s", gpgme_strsource(error), gpgme_strerror(error));
@@ -617,18 +660,15 @@ p_gpg_encrypt(const char* const barejid, const char* const message, const char*
     keys[1] = NULL;
     keys[2] = NULL;
 
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
-    if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+    gpgme_ctx_t ctx = _p_gpg_ctx();
+    if (!ctx) {
         return NULL;
     }
 
     gpgme_key_t receiver_key;
-    error = gpgme_get_key(ctx, pubkeyid->id, &receiver_key, 0);
+    gpgme_error_t error = gpgme_get_key(ctx, pubkeyid->id, &receiver_key, 0);
     if (error || receiver_key == NULL) {
         log_error("GPG: Failed to get receiver_key. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        gpgme_release(ctx);
         return NULL;
     }
     keys[0] = receiver_key;
@@ -637,7 +677,7 @@ p_gpg_encrypt(const char* const barejid, const char* const message, const char*
     error = gpgme_get_key(ctx, fp, &sender_key, 0);
     if (error || sender_key == NULL) {
         log_error("GPG: Failed to get sender_key. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        gpgme_release(ctx);
+        gpgme_key_unref(receiver_key);
         return NULL;
     }
     keys[1] = sender_key;
@@ -651,7 +691,6 @@ p_gpg_encrypt(const char* const barejid, const char* const message, const char*
     gpgme_set_armor(ctx, 1);
     error = gpgme_op_encrypt(ctx, keys, GPGME_ENCRYPT_ALWAYS_TRUST, plain, cipher);
     gpgme_data_release(plain);
-    gpgme_release(ctx);
     gpgme_key_unref(receiver_key);
     gpgme_key_unref(sender_key);
 
@@ -678,16 +717,33 @@ p_gpg_encrypt(const char* const barejid, const char* const message, const char*
 char*
 p_gpg_decrypt(const char* const cipher)
 {
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
+    gpgme_ctx_t ctx = _p_gpg_ctx();
+    if (!ctx) {
+        return NULL;
+    }
 
+    gpgme_error_t error;
+    GString* recipients = g_string_new("");
+    char* result = _p_gpg_decrypt(ctx, cipher, recipients, &error);
     if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        return NULL;
+        log_error("GPG: Failed to decrypt message. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+    } else {
+        log_debug("GPG: Decrypted message for recipients: %s", recipients->str);
     }
+    g_string_free(recipients, TRUE);
 
-    gpgme_set_passphrase_cb(ctx, (gpgme_passphrase_cb_t)_p_gpg_passphrase_cb, NULL);
+    if (result && passphrase_attempt) {
+        free(passphrase);
+        passphrase = strdup(passphrase_attempt);
+    }
+
+    return result;
+}
 
+// Shared by the main thread and the worker, so it does not log.
+static char*
+_p_gpg_decrypt(gpgme_ctx_t ctx, const char* const cipher, GString* recipients, gpgme_error_t* error)
+{
     char* cipher_with_headers = _add_header_footer(cipher, PGP_MESSAGE_HEADER, PGP_MESSAGE_FOOTER);
     gpgme_data_t cipher_data;
     gpgme_data_new_from_mem(&cipher_data, cipher_with_headers, strlen(cipher_with_headers), 1);
@@ -696,58 +752,76 @@ p_gpg_decrypt(const char* const cipher)
     gpgme_data_t plain_data;
     gpgme_data_new(&plain_data);
 
-    error = gpgme_op_decrypt(ctx, cipher_data, plain_data);
+    *error = gpgme_op_decrypt(ctx, cipher_data, plain_data);
     gpgme_data_release(cipher_data);
 
-    if (error) {
-        log_error("GPG: Failed to encrypt message. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+    if (*error) {
         gpgme_data_release(plain_data);
-        gpgme_release(ctx);
         return NULL;
     }
 
     gpgme_decrypt_result_t res = gpgme_op_decrypt_result(ctx);
     if (res) {
-        GString* recipients_str = g_string_new("");
         gpgme_recipient_t recipient = res->recipients;
         while (recipient) {
             gpgme_key_t key;
-            error = gpgme_get_key(ctx, recipient->keyid, &key, 1);
+            gpgme_error_t key_error = gpgme_get_key(ctx, recipient->keyid, &key, 1);
 
-            if (!error && key) {
+            if (!key_error && key) {
                 const char* addr = gpgme_key_get_string_attr(key, GPGME_ATTR_EMAIL, NULL, 0);
                 if (addr) {
-                    g_string_append(recipients_str, addr);
+                    g_string_append(recipients, addr);
                 }
                 gpgme_key_unref(key);
             }
 
             if (recipient->next) {
-                g_string_append(recipients_str, ", ");
+                g_string_append(recipients, ", ");
             }
 
             recipient = recipient->next;
         }
-
-        log_debug("GPG: Decrypted message for recipients: %s", recipients_str->str);
-        g_string_free(recipients_str, TRUE);
     }
-    gpgme_release(ctx);
 
     size_t len = 0;
     char* plain_str = gpgme_data_release_and_get_mem(plain_data, &len);
     char* result = NULL;
     if (plain_str) {
-        plain_str[len] = 0;
-        result = g_strdup(plain_str);
+        result = g_strndup(plain_str, len);
     }
     gpgme_free(plain_str);
 
-    if (passphrase_attempt) {
-        passphrase = strdup(passphrase_attempt);
+    return result;
+}
+
+void
+p_gpg_decrypt_async(const char* const cipher, ProfPGPDecryptCallback func, void* userdata, GDestroyNotify free_func)
+{
+    ProfPGPJob* job = calloc(1, sizeof(ProfPGPJob));
+    job->type = cipher ? PGP_JOB_DECRYPT : PGP_JOB_NONE;
+    job->input = cipher ? strdup(cipher) : NULL;
+    job->passphrase = passphrase ? strdup(passphrase) : NULL;
+    job->func = func;
+    job->userdata = userdata;
+    job->free_func = free_func;
+    _p_gpg_job_add(job);
+}
+
+// TRUE while a callback is waiting, a message handled now would overtake it.
+gboolean
+p_gpg_jobs_pending(void)
+{
+    gboolean pending = FALSE;
+
+    pthread_mutex_lock(&pgp_jobs_lock);
+    if (pgp_jobs) {
+        for (GList* curr = pgp_jobs->head; curr && !pending; curr = g_list_next(curr)) {
+            pending = ((ProfPGPJob*)curr->data)->func != NULL;
+        }
     }
+    pthread_mutex_unlock(&pgp_jobs_lock);
 
-    return result;
+    return pending;
 }
 
 void
@@ -759,6 +833,7 @@ p_gpg_free_decrypted(char* decrypted)
 char*
 p_gpg_autocomplete_key(const char* const search_str, gboolean previous, void* context)
 {
+    _p_gpg_key_index_load();
     return autocomplete_complete(key_ac, search_str, TRUE, previous);
 }
 
@@ -887,29 +962,11 @@ ox_gpg_public_keys(void)
 char*
 p_ox_gpg_signcrypt(const char* const sender_barejid, const char* const recipient_barejid, const char* const message)
 {
-    setlocale(LC_ALL, "");
-    gpgme_check_version(NULL);
-    gpgme_set_locale(NULL, LC_CTYPE, setlocale(LC_CTYPE, NULL));
-    gpgme_ctx_t ctx;
-
-    gpgme_error_t error = gpgme_new(&ctx);
-    if (GPG_ERR_NO_ERROR != error) {
-        printf("gpgme_new: %d\n", error);
+    gpgme_ctx_t ctx = _ox_ctx();
+    if (!ctx) {
         return NULL;
     }
-
-    error = gpgme_set_protocol(ctx, GPGME_PROTOCOL_OPENPGP);
-    if (error != 0) {
-        log_error("GpgME Error: %s", gpgme_strerror(error));
-    }
-
-    gpgme_set_armor(ctx, 0);
-    gpgme_set_textmode(ctx, 0);
-    gpgme_set_offline(ctx, 1);
-    gpgme_set_keylist_mode(ctx, GPGME_KEYLIST_MODE_LOCAL);
-    if (error != 0) {
-        log_error("GpgME Error: %s", gpgme_strerror(error));
-    }
+    gpgme_error_t error = GPG_ERR_NO_ERROR;
 
     gpgme_key_t recp[3];
     recp[0] = NULL,
@@ -979,9 +1036,10 @@ p_ox_gpg_signcrypt(const char* const sender_barejid, const char* const recipient
     size_t len;
     char* cipher_str = gpgme_data_release_and_get_mem(cipher, &len);
     char* result = g_base64_encode((unsigned char*)cipher_str, len);
+    gpgme_free(cipher_str);
+    gpgme_signers_clear(ctx);
     gpgme_key_release(recp[0]);
     gpgme_key_release(recp[1]);
-    gpgme_release(ctx);
     return result;
 }
 
@@ -1060,6 +1118,12 @@ _add_header_footer(const char* const str, const char* const header, const char*
 
 static void
 _save_pubkeys(void)
+{
+    persist_request("gpg pubkeys", _pubkeys_write);
+}
+
+static void
+_pubkeys_write(void)
 {
     gsize g_data_size;
     gchar* g_pubkeys_data = g_key_file_to_data(pubkeyfile, &g_data_size, NULL);
@@ -1072,15 +1136,25 @@ static gpgme_key_t
 _ox_key_lookup(const char* const barejid, gboolean secret_only)
 {
     g_assert(barejid);
+
+    // a lookup lists every key in the keyring, remember the ones found
+    if (!ox_keys) {
+        ox_keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)gpgme_key_unref);
+    }
+    gchar* cache_key = g_strdup_printf("%s:%s", secret_only ? "s" : "p", barejid);
+    gpgme_key_t key = g_hash_table_lookup(ox_keys, cache_key);
+    if (key) {
+        g_free(cache_key);
+        gpgme_key_ref(key);
+        return key;
+    }
+
     log_debug("Looking for %s key: %s", secret_only == TRUE ? "Private" : "Public", barejid);
-    gpgme_key_t key = NULL;
     gpgme_error_t error;
 
-    gpgme_ctx_t ctx;
-    error = gpgme_new(&ctx);
-
-    if (error) {
-        log_error("OX - gpgme_new failed: %s %s", gpgme_strsource(error), gpgme_strerror(error));
+    gpgme_ctx_t ctx = _ox_ctx();
+    if (!ctx) {
+        g_free(cache_key);
         return NULL;
     }
 
@@ -1089,6 +1163,8 @@ _ox_key_lookup(const char* const barejid, gboolean secret_only)
         error = gpgme_op_keylist_next(ctx, &key);
         if (error != GPG_ERR_EOF && error != GPG_ERR_NO_ERROR) {
             log_error("OX: gpgme_op_keylist_next %s %s", gpgme_strsource(error), gpgme_strerror(error));
+            gpgme_op_keylist_end(ctx);
+            g_free(cache_key);
             return NULL;
         }
 
@@ -1102,19 +1178,25 @@ _ox_key_lookup(const char* const barejid, gboolean secret_only)
             while (uid) {
                 if (uid->name && strlen(uid->name) >= 10) {
                     if (g_strcmp0(uid->name, xmppuri->str) == 0) {
-                        gpgme_release(ctx);
+                        gpgme_op_keylist_end(ctx);
+                        g_string_free(xmppuri, TRUE);
+                        gpgme_key_ref(key);
+                        g_hash_table_replace(ox_keys, cache_key, key);
                         return key;
                     }
                 }
                 uid = uid->next;
             }
             gpgme_key_unref(key);
+            key = NULL;
             error = gpgme_op_keylist_next(ctx, &key);
         }
+        g_string_free(xmppuri, TRUE);
     }
-    gpgme_release(ctx);
+    gpgme_op_keylist_end(ctx);
+    g_free(cache_key);
 
-    return key;
+    return NULL;
 }
 
 static gboolean
@@ -1143,32 +1225,18 @@ p_ox_gpg_decrypt(char* base64)
 {
     // if there is no private key avaibale,
     // we don't try do decrypt
-    if (!ox_is_private_key_available(connection_get_barejid())) {
+    char* mybarejid = connection_get_barejid();
+    gboolean available = ox_is_private_key_available(mybarejid);
+    free(mybarejid);
+    if (!available) {
         return NULL;
     }
-    setlocale(LC_ALL, "");
-    gpgme_check_version(NULL);
-    gpgme_set_locale(NULL, LC_CTYPE, setlocale(LC_CTYPE, NULL));
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
 
-    if (GPG_ERR_NO_ERROR != error) {
-        printf("gpgme_new: %d\n", error);
+    gpgme_ctx_t ctx = _ox_ctx();
+    if (!ctx) {
         return NULL;
     }
-
-    error = gpgme_set_protocol(ctx, GPGME_PROTOCOL_OPENPGP);
-    if (error != 0) {
-        log_error("GpgME Error: %s", gpgme_strerror(error));
-    }
-
-    gpgme_set_armor(ctx, 0);
-    gpgme_set_textmode(ctx, 0);
-    gpgme_set_offline(ctx, 1);
-    gpgme_set_keylist_mode(ctx, GPGME_KEYLIST_MODE_LOCAL);
-    if (error != 0) {
-        log_error("GpgME Error: %s", gpgme_strerror(error));
-    }
+    gpgme_error_t error;
 
     gpgme_data_t plain = NULL;
     gpgme_data_t cipher = NULL;
@@ -1349,5 +1417,467 @@ p_ox_gpg_import(char* base64_public_key)
         log_error("Failed to import key");
     }
 
+    // the new key may belong to a jid looked up before
+    _ox_keys_clear();
+    _p_gpg_key_index_clear();
+
+    return TRUE;
+}
+
+// Whether the keyring has the public key with the given fingerprint
+gboolean
+p_ox_gpg_has_key(const char* const fingerprint)
+{
+    gpgme_ctx_t ctx = _ox_ctx();
+    if (!ctx) {
+        return FALSE;
+    }
+
+    gpgme_key_t key = NULL;
+    gpgme_error_t error = gpgme_get_key(ctx, fingerprint, &key, 0);
+    if (error != GPG_ERR_NO_ERROR || !key) {
+        return FALSE;
+    }
+
+    gpgme_key_unref(key);
+
+    return TRUE;
+}
+
+// The context for PGP (XEP-0027) operations on the main thread, created once.
+// Operations leave it with no signers.
+static gpgme_ctx_t
+_p_gpg_ctx(void)
+{
+    if (pgp_ctx) {
+        return pgp_ctx;
+    }
+
+    gpgme_error_t error = gpgme_new(&pgp_ctx);
+    if (error) {
+        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+        pgp_ctx = NULL;
+        return NULL;
+    }
+    gpgme_set_passphrase_cb(pgp_ctx, (gpgme_passphrase_cb_t)_p_gpg_passphrase_cb, NULL);
+
+    return pgp_ctx;
+}
+
+// The context for OX (XEP-0373) operations on the main thread, created once.
+static gpgme_ctx_t
+_ox_ctx(void)
+{
+    if (ox_ctx) {
+        return ox_ctx;
+    }
+
+    gpgme_set_locale(NULL, LC_CTYPE, setlocale(LC_CTYPE, NULL));
+    gpgme_error_t error = gpgme_new(&ox_ctx);
+    if (error) {
+        log_error("OX - gpgme_new failed: %s %s", gpgme_strsource(error), gpgme_strerror(error));
+        ox_ctx = NULL;
+        return NULL;
+    }
+
+    error = gpgme_set_protocol(ox_ctx, GPGME_PROTOCOL_OPENPGP);
+    if (error != 0) {
+        log_error("GpgME Error: %s", gpgme_strerror(error));
+    }
+
+    gpgme_set_armor(ox_ctx, 0);
+    gpgme_set_textmode(ox_ctx, 0);
+    gpgme_set_offline(ox_ctx, 1);
+    gpgme_set_keylist_mode(ox_ctx, GPGME_KEYLIST_MODE_LOCAL);
+
+    return ox_ctx;
+}
+
+static void
+_ox_keys_clear(void)
+{
+    if (ox_keys) {
+        g_hash_table_remove_all(ox_keys);
+    }
+}
+
+static void
+_p_gpg_job_add(ProfPGPJob* job)
+{
+    pthread_mutex_lock(&pgp_jobs_lock);
+    if (!pgp_jobs) {
+        pgp_jobs = g_queue_new();
+    }
+    if (!pgp_worker_running) {
+        pgp_worker_running = TRUE;
+        if (pthread_create(&pgp_worker, NULL, _p_gpg_worker, NULL) != 0) {
+            log_error("GPG: Failed to start the crypto thread");
+            pgp_worker_running = FALSE;
+        }
+    }
+    g_queue_push_tail(pgp_jobs, job);
+    pgp_jobs_waiting++;
+    pthread_cond_signal(&pgp_jobs_cond);
+    gboolean running = pgp_worker_running;
+    pthread_mutex_unlock(&pgp_jobs_lock);
+
+    if (!running) {
+        // no thread, do it now
+        p_gpg_jobs_finish();
+        return;
+    }
+
+    if (!pgp_jobs_task) {
+        pgp_jobs_task = scheduler_add(PGP_JOB_POLL_MS, _p_gpg_jobs_check, NULL, NULL);
+    }
+}
+
+static gpgme_error_t
+_p_gpg_worker_passphrase_cb(void* hook, const char* uid_hint, const char* passphrase_info, int prev_was_bad, int fd)
+{
+    ProfPGPJob* job = hook;
+
+    // only the main thread may ask, see _p_gpg_job_deliver()
+    if (!job->passphrase || prev_was_bad) {
+        job->need_passphrase = TRUE;
+        return gpg_error(GPG_ERR_CANCELED);
+    }
+
+    gpgme_io_write(fd, job->passphrase, strlen(job->passphrase));
+
+    return 0;
+}
+
+static void
+_p_gpg_job_run(gpgme_ctx_t ctx, ProfPGPJob* job)
+{
+    gpgme_error_t error = GPG_ERR_NO_ERROR;
+
+    switch (job->type) {
+    case PGP_JOB_DECRYPT:
+    {
+        GString* recipients = g_string_new("");
+        gpgme_set_passphrase_cb(ctx, (gpgme_passphrase_cb_t)_p_gpg_worker_passphrase_cb, job);
+        job->output = _p_gpg_decrypt(ctx, job->input, recipients, &error);
+        g_string_free(recipients, TRUE);
+        break;
+    }
+    case PGP_JOB_VERIFY:
+        job->output = _p_gpg_verify(ctx, job->input, &error);
+        break;
+    case PGP_JOB_NONE:
+        break;
+    }
+}
+
+// Takes the jobs in order, with its own context since one may not be shared
+// between threads.
+static void*
+_p_gpg_worker(void* data)
+{
+    gpgme_ctx_t ctx = NULL;
+    if (gpgme_new(&ctx) != GPG_ERR_NO_ERROR) {
+        ctx = NULL;
+    }
+
+    pthread_mutex_lock(&pgp_jobs_lock);
+    while (pgp_worker_running) {
+        if (pgp_jobs_waiting == 0) {
+            pthread_cond_wait(&pgp_jobs_cond, &pgp_jobs_lock);
+            continue;
+        }
+
+        ProfPGPJob* job = g_queue_peek_nth(pgp_jobs, g_queue_get_length(pgp_jobs) - pgp_jobs_waiting);
+        pgp_jobs_waiting--;
+        pthread_mutex_unlock(&pgp_jobs_lock);
+
+        if (ctx) {
+            _p_gpg_job_run(ctx, job);
+        }
+
+        pthread_mutex_lock(&pgp_jobs_lock);
+        job->done = TRUE;
+        pthread_cond_broadcast(&pgp_jobs_cond);
+    }
+    pthread_mutex_unlock(&pgp_jobs_lock);
+
+    if (ctx) {
+        gpgme_release(ctx);
+    }
+
+    return NULL;
+}
+
+static void
+_p_gpg_job_deliver(ProfPGPJob* job)
+{
+    switch (job->type) {
+    case PGP_JOB_DECRYPT:
+        if (!job->output && job->need_passphrase) {
+            // needs a passphrase we do not have yet, ask for it here
+            job->output = p_gpg_decrypt(job->input);
+        } else if (!job->output) {
+            log_error("GPG: Failed to decrypt message");
+        }
+        break;
+    case PGP_JOB_VERIFY:
+        _p_gpg_verified(job);
+        break;
+    case PGP_JOB_NONE:
+        break;
+    }
+
+    if (job->func) {
+        job->func(job->output, job->userdata);
+    }
+}
+
+// Run the callbacks of the jobs done so far, stopping at the first one that
+// is not so that they are delivered in order.
+static gboolean
+_p_gpg_jobs_check(void* data)
+{
+    while (TRUE) {
+        pthread_mutex_lock(&pgp_jobs_lock);
+        ProfPGPJob* job = pgp_jobs ? g_queue_peek_head(pgp_jobs) : NULL;
+        if (!job || !job->done) {
+            if (!job) {
+                pgp_jobs_task = NULL;
+            }
+            pthread_mutex_unlock(&pgp_jobs_lock);
+            return job != NULL;
+        }
+        g_queue_pop_head(pgp_jobs);
+        pthread_mutex_unlock(&pgp_jobs_lock);
+
+        _p_gpg_job_deliver(job);
+        _p_gpg_job_free(job);
+    }
+}
+
+// Wait for the outstanding jobs and run their callbacks.
+void
+p_gpg_jobs_finish(void)
+{
+    if (!pgp_jobs) {
+        return;
+    }
+
+    pthread_mutex_lock(&pgp_jobs_lock);
+    if (!pgp_worker_running) {
+        // nothing will take them, run them here
+        for (GList* curr = pgp_jobs->head; curr; curr = g_list_next(curr)) {
+            ProfPGPJob* job = curr->data;
+            if (!job->done) {
+                gpgme_ctx_t ctx = _p_gpg_ctx();
+                if (ctx) {
+                    _p_gpg_job_run(ctx, job);
+                    gpgme_set_passphrase_cb(ctx, (gpgme_passphrase_cb_t)_p_gpg_passphrase_cb, NULL);
+                }
+                job->done = TRUE;
+            }
+        }
+        pgp_jobs_waiting = 0;
+    }
+    while (pgp_worker_running && !g_queue_is_empty(pgp_jobs) && !((ProfPGPJob*)g_queue_peek_tail(pgp_jobs))->done) {
+        pthread_cond_wait(&pgp_jobs_cond, &pgp_jobs_lock);
+    }
+    pthread_mutex_unlock(&pgp_jobs_lock);
+
+    scheduler_remove(pgp_jobs_task);
+    pgp_jobs_task = NULL;
+    _p_gpg_jobs_check(NULL);
+}
+
+static void
+_p_gpg_job_free(ProfPGPJob* job)
+{
+    if (job->free_func && job->userdata) {
+        job->free_func(job->userdata);
+    }
+    free(job->barejid);
+    free(job->input);
+    free(job->passphrase);
+    g_free(job->output);
+    free(job);
+}
+
+static ProfPGPKey*
+_p_gpg_key_copy(ProfPGPKey* key)
+{
+    ProfPGPKey* copy = _p_gpg_key_new();
+    copy->id = strdup(key->id);
+    copy->name = strdup(key->name);
+    copy->fp = strdup(key->fp);
+    copy->encrypt = key->encrypt;
+    copy->sign = key->sign;
+    copy->certify = key->certify;
+    copy->authenticate = key->authenticate;
+    copy->secret = key->secret;
+
+    return copy;
+}
+
+// Changes when GnuPG writes the keyring, it replaces the files when it does.
+static gint64
+_p_gpg_keyring_stamp(void)
+{
+    static const char* const files[] = { "pubring.kbx", "pubring.gpg", "secring.gpg", "private-keys-v1.d" };
+
+    if (!keyring_dir) {
+        gpgme_engine_info_t info = NULL;
+        if (gpgme_get_engine_info(&info) == GPG_ERR_NO_ERROR) {
+            for (; info; info = info->next) {
+                if (info->protocol == GPGME_PROTOCOL_OPENPGP && info->home_dir) {
+                    keyring_dir = g_strdup(info->home_dir);
+                    break;
+                }
+            }
+        }
+        if (!keyring_dir) {
+            const char* gnupghome = g_getenv("GNUPGHOME");
+            keyring_dir = gnupghome ? g_strdup(gnupghome) : g_build_filename(g_get_home_dir(), ".gnupg", NULL);
+        }
+    }
+
+    gint64 stamp = 0;
+    for (int i = 0; i < G_N_ELEMENTS(files); i++) {
+        gchar* path = g_build_filename(keyring_dir, files[i], NULL);
+        struct stat st;
+        if (g_stat(path, &st) == 0) {
+            stamp = stamp * 31 + st.st_mtime;
+            stamp = stamp * 31 + st.st_size;
+            stamp = stamp * 31 + st.st_ino;
+        }
+        g_free(path);
+    }
+
+    return stamp;
+}
+
+// Lists the keyring into key_index unless it is unchanged since the last
+// listing.
+static gboolean
+_p_gpg_key_index_load(void)
+{
+    gint64 stamp = _p_gpg_keyring_stamp();
+    if (key_index && stamp == key_index_stamp) {
+        return TRUE;
+    }
+
+    gpgme_ctx_t ctx;
+    gpgme_error_t error = gpgme_new(&ctx);
+
+    if (error) {
+        log_error("GPG: Could not list keys. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+        return key_index != NULL;
+    }
+
+    _p_gpg_key_index_clear();
+    key_index = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_p_gpg_free_key);
+    key_index_ids = g_hash_table_new(g_str_hash, g_str_equal);
+    key_index_stamp = stamp;
+
+    error = gpgme_op_keylist_start(ctx, NULL, 0);
+    if (error == GPG_ERR_NO_ERROR) {
+        gpgme_key_t key;
+        error = gpgme_op_keylist_next(ctx, &key);
+        while (!error) {
+            gpgme_subkey_t sub = key->subkeys;
+
+            ProfPGPKey* p_pgpkey = _p_gpg_key_new();
+            p_pgpkey->id = strdup(sub->keyid);
+            p_pgpkey->name = strdup(key->uids->uid);
+            p_pgpkey->fp = strdup(sub->fpr);
+            if (sub->can_encrypt)
+                p_pgpkey->encrypt = TRUE;
+            if (sub->can_authenticate)
+                p_pgpkey->authenticate = TRUE;
+            if (sub->can_certify)
+                p_pgpkey->certify = TRUE;
+            if (sub->can_sign)
+                p_pgpkey->sign = TRUE;
+
+            sub = sub->next;
+            while (sub) {
+                if (sub->can_encrypt)
+                    p_pgpkey->encrypt = TRUE;
+                if (sub->can_authenticate)
+                    p_pgpkey->authenticate = TRUE;
+                if (sub->can_certify)
+                    p_pgpkey->certify = TRUE;
+                if (sub->can_sign)
+                    p_pgpkey->sign = TRUE;
+
+                sub = sub->next;
+            }
+
+            g_hash_table_insert(key_index, strdup(p_pgpkey->name), p_pgpkey);
+
+            gpgme_key_unref(key);
+            error = gpgme_op_keylist_next(ctx, &key);
+        }
+    }
+
+    error = gpgme_op_keylist_start(ctx, NULL, 1);
+    if (error == GPG_ERR_NO_ERROR) {
+        gpgme_key_t key;
+        error = gpgme_op_keylist_next(ctx, &key);
+        while (!error) {
+            gpgme_subkey_t sub = key->subkeys;
+            while (sub) {
+                if (sub->secret) {
+                    ProfPGPKey* p_pgpkey = g_hash_table_lookup(key_index, key->uids->uid);
+                    if (p_pgpkey) {
+                        p_pgpkey->secret = TRUE;
+                    }
+                }
+                sub = sub->next;
+            }
+
+            gpgme_key_unref(key);
+            error = gpgme_op_keylist_next(ctx, &key);
+        }
+    }
+
+    gpgme_release(ctx);
+
+    // keys with the same name replaced each other above, index what is left
+    autocomplete_clear(key_ac);
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, key_index);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        ProfPGPKey* p_pgpkey = value;
+        g_hash_table_insert(key_index_ids, p_pgpkey->id, p_pgpkey);
+        g_hash_table_insert(key_index_ids, p_pgpkey->fp, p_pgpkey);
+        autocomplete_add(key_ac, p_pgpkey->id);
+    }
+
     return TRUE;
 }
+
+// A key by its key id or fingerprint, NULL for anything the index does not
+// know and for other ways of naming a key.
+static ProfPGPKey*
+_p_gpg_key_index_lookup(const char* const keyid)
+{
+    if (!keyid || !_p_gpg_key_index_load()) {
+        return NULL;
+    }
+
+    return g_hash_table_lookup(key_index_ids, keyid);
+}
+
+static void
+_p_gpg_key_index_clear(void)
+{
+    if (key_index_ids) {
+        g_hash_table_destroy(key_index_ids);
+        key_index_ids = NULL;
+    }
+    if (key_index) {
+        g_hash_table_destroy(key_index);
+        key_index = NULL;
+    }
+}
@@ -54,6 +54,10 @@ typedef struct pgp_pubkeyid_t
     gboolean received;
 } ProfPGPPubKeyId;
 
+// Called on the main thread with the decrypted text, or NULL if the message
+// could not be decrypted. The text is freed after the callback returns.
+typedef void (*ProfPGPDecryptCallback)(char* plain, void* userdata);
+
 void p_gpg_init(void);
 void p_gpg_close(void);
 void p_gpg_on_connect(const char* const barejid);
@@ -69,6 +73,9 @@ char* p_gpg_sign(const char* const str, const char* const fp);
 void p_gpg_verify(const char* const barejid, const char* const sign);
 char* p_gpg_encrypt(const char* const barejid, const char* const message, const char* const fp);
 char* p_gpg_decrypt(const char* const cipher);
+void p_gpg_decrypt_async(const char* const cipher, ProfPGPDecryptCallback func, void* userdata, GDestroyNotify free_func);
+gboolean p_gpg_jobs_pending(void);
+void p_gpg_jobs_finish(void);
 void p_gpg_free_decrypted(char* decrypted);
 char* p_gpg_autocomplete_key(const char* const search_str, gboolean previous, void* context);
 void p_gpg_autocomplete_key_reset(void);
@@ -80,6 +87,7 @@ char* p_ox_gpg_decrypt(char* base64);
 
 void p_ox_gpg_readkey(const char* const filename, char** key, char** fp);
 gboolean p_ox_gpg_import(char* base64_public_key);
+gboolean p_ox_gpg_has_key(const char* const fingerprint);
 
 /*!
  * \brief List of public keys with xmpp-URI.
@@ -96,6 +96,27 @@ api_cons_show_themed(const char* const group, const char* const key, const char*
     return 1;
 }
 
+int
+api_cons_show_lines(char** lines)
+{
+    if (lines == NULL) {
+        log_warning("%s", "prof_cons_show_lines failed, lines is NULL");
+        return 0;
+    }
+
+    GPtrArray* parsed = g_ptr_array_new_with_free_func(free);
+    for (int i = 0; lines[i]; i++) {
+        g_ptr_array_add(parsed, str_replace(lines[i], "\r\n", "\n"));
+    }
+    g_ptr_array_add(parsed, NULL);
+
+    win_println_lines(wins_get_console(), THEME_DEFAULT, "-", (gchar**)parsed->pdata);
+    inp_nonblocking(TRUE);
+    g_ptr_array_free(parsed, TRUE);
+
+    return 1;
+}
+
 int
 api_cons_bad_cmd_usage(const char* const cmd)
 {
@@ -159,7 +180,7 @@ api_register_timed(const char* const plugin_name, void* callback, int interval_s
     timed_function->callback_exec = callback_exec;
     timed_function->callback_destroy = callback_destroy;
     timed_function->interval_seconds = interval_seconds;
-    timed_function->timer = g_timer_new();
+    timed_function->task = NULL;
 
     callbacks_add_timed(plugin_name, timed_function);
 }
@@ -252,6 +273,31 @@ api_get_barejid_from_roster(const char* name)
     return roster_barejid_from_name(name);
 }
 
+char**
+api_get_room_occupants(const char* roomjid)
+{
+    if (roomjid == NULL) {
+        return NULL;
+    }
+
+    GSequence* occupants = muc_roster_view(roomjid);
+    if (occupants == NULL) {
+        return NULL;
+    }
+
+    char** result = malloc((g_sequence_get_length(occupants) + 1) * sizeof(char*));
+    int i = 0;
+    GSequenceIter* curr = g_sequence_get_begin_iter(occupants);
+    while (!g_sequence_iter_is_end(curr)) {
+        Occupant* occupant = g_sequence_get(curr);
+        result[i++] = strdup(occupant->nick);
+        curr = g_sequence_iter_next(curr);
+    }
+    result[i] = NULL;
+
+    return result;
+}
+
 char**
 api_get_current_occupants(void)
 {
@@ -259,17 +305,7 @@ api_get_current_occupants(void)
     if (current->type == WIN_MUC) {
         ProfMucWin* mucwin = (ProfMucWin*)current;
         assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
-        GList* occupants_list = muc_roster(mucwin->roomjid);
-        char** result = malloc((g_list_length(occupants_list) + 1) * sizeof(char*));
-        GList* curr = occupants_list;
-        int i = 0;
-        while (curr) {
-            Occupant* occupant = curr->data;
-            result[i++] = strdup(occupant->nick);
-            curr = g_list_next(curr);
-        }
-        result[i] = NULL;
-        return result;
+        return api_get_room_occupants(mucwin->roomjid);
     } else {
         return NULL;
     }
@@ -420,6 +456,55 @@ api_win_show_themed(const char* tag, const char* const group, const char* const
     return 1;
 }
 
+int
+api_win_show_lines(const char* tag, char** lines)
+{
+    if (tag == NULL) {
+        log_warning("%s", "prof_win_show_lines failed, tag is NULL");
+        return 0;
+    }
+    if (lines == NULL) {
+        log_warning("%s", "prof_win_show_lines failed, lines is NULL");
+        return 0;
+    }
+
+    ProfPluginWin* pluginwin = wins_get_plugin(tag);
+    if (pluginwin == NULL) {
+        log_warning("prof_win_show_lines failed, no window with tag: %s", tag);
+        return 0;
+    }
+
+    win_println_lines((ProfWin*)pluginwin, THEME_DEFAULT, "!", lines);
+    inp_nonblocking(TRUE);
+
+    return 1;
+}
+
+int
+api_win_append(const char* tag, const char* line)
+{
+    if (tag == NULL) {
+        log_warning("%s", "prof_win_append failed, tag is NULL");
+        return 0;
+    }
+    if (line == NULL) {
+        log_warning("%s", "prof_win_append failed, line is NULL");
+        return 0;
+    }
+
+    ProfPluginWin* pluginwin = wins_get_plugin(tag);
+    if (pluginwin == NULL) {
+        log_warning("prof_win_append failed, no window with tag: %s", tag);
+        return 0;
+    }
+
+    // the line waits in the buffer, the input loop is not woken for it
+    char* lines[] = { (char*)line, NULL };
+    win_println_lines((ProfWin*)pluginwin, THEME_DEFAULT, "!", lines);
+
+    return 1;
+}
+
 int
 api_send_stanza(const char* const stanza)
 {
@@ -486,6 +571,12 @@ api_settings_int_set(const char* const group, const char* const key, int value)
     plugin_settings_int_set(group, key, value);
 }
 
+void
+api_settings_flush(void)
+{
+    plugin_settings_flush();
+}
+
 void
 api_incoming_message(const char* const barejid, const char* const resource, const char* const plain)
 {
@@ -41,6 +41,7 @@
 void api_cons_alert(void);
 int api_cons_show(const char* const message);
 int api_cons_show_themed(const char* const group, const char* const item, const char* const def, const char* const message);
+int api_cons_show_lines(char** lines);
 int api_cons_bad_cmd_usage(const char* const cmd);
 void api_notify(const char* message, const char* category, int timeout_ms);
 void api_send_line(char* line);
@@ -52,6 +53,7 @@ char* api_get_current_nick(void);
 char* api_get_name_from_roster(const char* barejid);
 char* api_get_barejid_from_roster(const char* name);
 char** api_get_current_occupants(void);
+char** api_get_room_occupants(const char* roomjid);
 
 char* api_get_room_nick(const char* barejid);
 
@@ -81,6 +83,8 @@ void api_win_create(
 int api_win_focus(const char* tag);
 int api_win_show(const char* tag, const char* line);
 int api_win_show_themed(const char* tag, const char* const group, const char* const key, const char* const def, const char* line);
+int api_win_show_lines(const char* tag, char** lines);
+int api_win_append(const char* tag, const char* line);
 
 int api_send_stanza(const char* const stanza);
 
@@ -94,6 +98,7 @@ char** api_settings_string_list_get(const char* const group, const char* const k
 void api_settings_string_list_add(const char* const group, const char* const key, const char* const value);
 int api_settings_string_list_remove(const char* const group, const char* const key, const char* const value);
 int api_settings_string_list_clear(const char* const group, const char* const key);
+void api_settings_flush(void);
 
 void api_incoming_message(const char* const barejid, const char* const resource, const char* const message);
 
@@ -45,6 +45,11 @@
 static GHashTable* plugin_to_acs;
 static GHashTable* plugin_to_filepath_acs;
 
+// merged across plugins so completion looks up the words of the input
+// instead of trying every key of every plugin
+static GHashTable* key_to_acs;
+static GHashTable* filepath_prefix_counts;
+
 static void
 _free_autocompleters(GHashTable* key_to_ac)
 {
@@ -62,6 +67,58 @@ autocompleters_init(void)
 {
     plugin_to_acs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_free_autocompleters);
     plugin_to_filepath_acs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_free_filepath_autocompleters);
+    key_to_acs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_list_free);
+    filepath_prefix_counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+}
+
+static void
+_index_ac(const char* const key, Autocomplete ac)
+{
+    GList* acs = g_hash_table_lookup(key_to_acs, key);
+    if (acs) {
+        acs = g_list_append(acs, ac);
+    } else {
+        g_hash_table_insert(key_to_acs, strdup(key), g_list_append(NULL, ac));
+    }
+}
+
+static void
+_unindex_ac(const char* const key, Autocomplete ac)
+{
+    GList* acs = g_hash_table_lookup(key_to_acs, key);
+    if (!acs) {
+        return;
+    }
+
+    // the list head may change, swap it in without freeing the old one
+    gpointer orig_key = NULL;
+    g_hash_table_lookup_extended(key_to_acs, key, &orig_key, NULL);
+    g_hash_table_steal(key_to_acs, key);
+
+    GList* remaining = g_list_remove(acs, ac);
+    if (remaining) {
+        g_hash_table_insert(key_to_acs, orig_key, remaining);
+    } else {
+        g_free(orig_key);
+    }
+}
+
+static void
+_index_prefix(const char* const prefix)
+{
+    guint count = GPOINTER_TO_UINT(g_hash_table_lookup(filepath_prefix_counts, prefix));
+    g_hash_table_insert(filepath_prefix_counts, strdup(prefix), GUINT_TO_POINTER(count + 1));
+}
+
+static void
+_unindex_prefix(const char* const prefix)
+{
+    guint count = GPOINTER_TO_UINT(g_hash_table_lookup(filepath_prefix_counts, prefix));
+    if (count <= 1) {
+        g_hash_table_remove(filepath_prefix_counts, prefix);
+    } else {
+        g_hash_table_insert(filepath_prefix_counts, strdup(prefix), GUINT_TO_POINTER(count - 1));
+    }
 }
 
 void
@@ -76,6 +133,7 @@ autocompleters_add(const char* const plugin_name, const char* key, char** items)
             Autocomplete new_ac = autocomplete_new();
             autocomplete_add_all(new_ac, items);
             g_hash_table_insert(key_to_ac, strdup(key), new_ac);
+            _index_ac(key, new_ac);
         }
     } else {
         key_to_ac = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)autocomplete_free);
@@ -83,6 +141,7 @@ autocompleters_add(const char* const plugin_name, const char* key, char** items)
         autocomplete_add_all(new_ac, items);
         g_hash_table_insert(key_to_ac, strdup(key), new_ac);
         g_hash_table_insert(plugin_to_acs, strdup(plugin_name), key_to_ac);
+        _index_ac(key, new_ac);
     }
 }
 
@@ -123,67 +182,93 @@ autocompleters_filepath_add(const char* const plugin_name, const char* prefix)
 {
     GHashTable* prefixes = g_hash_table_lookup(plugin_to_filepath_acs, plugin_name);
     if (prefixes) {
-        g_hash_table_add(prefixes, strdup(prefix));
+        if (!g_hash_table_contains(prefixes, prefix)) {
+            g_hash_table_add(prefixes, strdup(prefix));
+            _index_prefix(prefix);
+        }
     } else {
         prefixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
         g_hash_table_add(prefixes, strdup(prefix));
         g_hash_table_insert(plugin_to_filepath_acs, strdup(plugin_name), prefixes);
+        _index_prefix(prefix);
+    }
+}
+
+void
+autocompleters_remove_plugin(const char* const plugin_name)
+{
+    GHashTable* key_to_ac = g_hash_table_lookup(plugin_to_acs, plugin_name);
+    if (key_to_ac) {
+        GHashTableIter iter;
+        gpointer key, ac;
+        g_hash_table_iter_init(&iter, key_to_ac);
+        while (g_hash_table_iter_next(&iter, &key, &ac)) {
+            _unindex_ac(key, ac);
+        }
+        g_hash_table_remove(plugin_to_acs, plugin_name);
+    }
+
+    GHashTable* prefixes = g_hash_table_lookup(plugin_to_filepath_acs, plugin_name);
+    if (prefixes) {
+        GHashTableIter iter;
+        gpointer prefix;
+        g_hash_table_iter_init(&iter, prefixes);
+        while (g_hash_table_iter_next(&iter, &prefix, NULL)) {
+            _unindex_prefix(prefix);
+        }
+        g_hash_table_remove(plugin_to_filepath_acs, plugin_name);
     }
 }
 
+static char*
+_complete_filepath(const char* const input, size_t prefix_len, gboolean previous)
+{
+    char* result = NULL;
+    char* prefix = g_strndup(input, prefix_len);
+    if (g_hash_table_contains(filepath_prefix_counts, prefix)) {
+        result = cmd_ac_complete_filepath(input, prefix, previous);
+    }
+    g_free(prefix);
+
+    return result;
+}
+
+// Keys and prefixes only ever end at a word of the input, so every space
+// marks one candidate, tried from the longest
 char*
 autocompleters_complete(const char* const input, gboolean previous)
 {
     char* result = NULL;
+    size_t len = strlen(input);
 
-    GList* ac_hashes = g_hash_table_get_values(plugin_to_acs);
-    GList* curr_hash = ac_hashes;
-    while (curr_hash) {
-        GHashTable* key_to_ac = curr_hash->data;
-
-        GList* keys = g_hash_table_get_keys(key_to_ac);
-        GList* curr = keys;
-        while (curr) {
-            result = autocomplete_param_with_ac(input, curr->data, g_hash_table_lookup(key_to_ac, curr->data), TRUE, previous);
-            if (result) {
-                g_list_free(ac_hashes);
-                g_list_free(keys);
-                return result;
-            }
+    for (size_t i = len; i > 0 && !result; i--) {
+        if (input[i - 1] != ' ') {
+            continue;
+        }
+        char* key = g_strndup(input, i - 1);
+        GList* curr = g_hash_table_lookup(key_to_acs, key);
+        while (curr && !result) {
+            result = autocomplete_param_with_ac(input, key, curr->data, TRUE, previous);
             curr = g_list_next(curr);
         }
-        g_list_free(keys);
-
-        curr_hash = g_list_next(curr_hash);
+        g_free(key);
+    }
+    if (result) {
+        return result;
     }
-    g_list_free(ac_hashes);
 
-    GList* filepath_hashes = g_hash_table_get_values(plugin_to_filepath_acs);
-    curr_hash = filepath_hashes;
-    while (curr_hash) {
-        GHashTable* prefixes_hash = curr_hash->data;
-        GList* prefixes = g_hash_table_get_keys(prefixes_hash);
-        GList* curr_prefix = prefixes;
-        while (curr_prefix) {
-            char* prefix = curr_prefix->data;
-            if (g_str_has_prefix(input, prefix)) {
-                result = cmd_ac_complete_filepath(input, prefix, previous);
-                if (result) {
-                    g_list_free(filepath_hashes);
-                    g_list_free(prefixes);
-                    return result;
-                }
-            }
-
-            curr_prefix = g_list_next(curr_prefix);
+    for (size_t i = len; i > 0 && !result; i--) {
+        if (input[i - 1] != ' ') {
+            continue;
+        }
+        // the prefix may be registered with or without its trailing space
+        result = _complete_filepath(input, i, previous);
+        if (!result && i > 1) {
+            result = _complete_filepath(input, i - 1, previous);
         }
-        g_list_free(prefixes);
-
-        curr_hash = g_list_next(curr_hash);
     }
-    g_list_free(filepath_hashes);
 
-    return NULL;
+    return result;
 }
 
 void
@@ -209,8 +294,12 @@ autocompleters_reset(void)
 void
 autocompleters_destroy(void)
 {
+    g_hash_table_destroy(key_to_acs);
+    g_hash_table_destroy(filepath_prefix_counts);
     g_hash_table_destroy(plugin_to_acs);
     g_hash_table_destroy(plugin_to_filepath_acs);
+    key_to_acs = NULL;
+    filepath_prefix_counts = NULL;
     plugin_to_acs = NULL;
     plugin_to_filepath_acs = NULL;
 }
@@ -43,6 +43,7 @@ void autocompleters_add(const char* const plugin_name, const char* key, char** i
 void autocompleters_remove(const char* const plugin_name, const char* key, char** items);
 void autocompleters_clear(const char* const plugin_name, const char* key);
 void autocompleters_filepath_add(const char* const plugin_name, const char* prefix);
+void autocompleters_remove_plugin(const char* const plugin_name);
 char* autocompleters_complete(const char* const input, gboolean previous);
 void autocompleters_reset(void);
 void autocompleters_destroy(void);
@@ -80,6 +80,12 @@ c_api_cons_show_themed(const char* const group, const char* const item, const ch
     return api_cons_show_themed(group, item, def, message);
 }
 
+static int
+c_api_cons_show_lines(char** lines)
+{
+    return api_cons_show_lines(lines);
+}
+
 static int
 c_api_cons_bad_cmd_usage(const char* const cmd)
 {
@@ -213,6 +219,12 @@ c_api_get_current_occupants(void)
     return api_get_current_occupants();
 }
 
+static char**
+c_api_get_room_occupants(const char* roomjid)
+{
+    return api_get_room_occupants(roomjid);
+}
+
 static char*
 c_api_get_room_nick(const char* barejid)
 {
@@ -279,6 +291,18 @@ c_api_win_show_themed(char* tag, char* group, char* key, char* def, char* line)
     return api_win_show_themed(tag, group, key, def, line);
 }
 
+static int
+c_api_win_show_lines(char* tag, char** lines)
+{
+    return api_win_show_lines(tag, lines);
+}
+
+static int
+c_api_win_append(char* tag, char* line)
+{
+    return api_win_append(tag, line);
+}
+
 static int
 c_api_send_stanza(char* stanza)
 {
@@ -345,6 +369,12 @@ c_api_settings_int_set(char* group, char* key, int value)
     api_settings_int_set(group, key, value);
 }
 
+static void
+c_api_settings_flush(void)
+{
+    api_settings_flush();
+}
+
 static void
 c_api_incoming_message(char* barejid, char* resource, char* message)
 {
@@ -481,6 +511,7 @@ c_api_init(void)
     prof_cons_alert = c_api_cons_alert;
     prof_cons_show = c_api_cons_show;
     prof_cons_show_themed = c_api_cons_show_themed;
+    prof_cons_show_lines = c_api_cons_show_lines;
     prof_cons_bad_cmd_usage = c_api_cons_bad_cmd_usage;
     _prof_register_command = c_api_register_command;
     _prof_register_timed = c_api_register_timed;
@@ -498,6 +529,7 @@ c_api_init(void)
     prof_get_name_from_roster = c_api_get_name_from_roster;
     prof_get_barejid_from_roster = c_api_get_barejid_from_roster;
     prof_get_current_occupants = c_api_get_current_occupants;
+    prof_get_room_occupants = c_api_get_room_occupants;
     prof_get_room_nick = c_api_get_room_nick;
     prof_log_debug = c_api_log_debug;
     prof_log_info = c_api_log_info;
@@ -507,6 +539,8 @@ c_api_init(void)
     prof_win_focus = c_api_win_focus;
     prof_win_show = c_api_win_show;
     prof_win_show_themed = c_api_win_show_themed;
+    prof_win_show_lines = c_api_win_show_lines;
+    prof_win_append = c_api_win_append;
     prof_send_stanza = c_api_send_stanza;
     prof_settings_boolean_get = c_api_settings_boolean_get;
     prof_settings_boolean_set = c_api_settings_boolean_set;
@@ -518,6 +552,7 @@ c_api_init(void)
     prof_settings_string_list_add = c_api_settings_string_list_add;
     prof_settings_string_list_remove = c_api_settings_string_list_remove;
     prof_settings_string_list_clear = c_api_settings_string_list_clear;
+    prof_settings_flush = c_api_settings_flush;
     prof_incoming_message = c_api_incoming_message;
     _prof_disco_add_feature = c_api_disco_add_feature;
     prof_encryption_reset = c_api_encryption_reset;
@@ -36,6 +36,7 @@
 #include "config.h"
 
 #include <dlfcn.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
@@ -51,8 +52,54 @@
 #include "plugins/plugins.h"
 #include "plugins/c_plugins.h"
 #include "plugins/c_api.h"
+#include "plugins/profhooks.h"
 #include "ui/ui.h"
 
+// hooks a v2 plugin declares in its table instead of by name
+static const struct
+{
+    const char* name;
+    size_t offset;
+} hooks_v2[] = {
+    { "prof_pre_chat_message_display", offsetof(PROF_HOOKS_V2, pre_chat_message_display) },
+    { "prof_post_chat_message_display", offsetof(PROF_HOOKS_V2, post_chat_message_display) },
+    { "prof_pre_chat_message_send", offsetof(PROF_HOOKS_V2, pre_chat_message_send) },
+    { "prof_post_chat_message_send", offsetof(PROF_HOOKS_V2, post_chat_message_send) },
+    { "prof_pre_room_message_display", offsetof(PROF_HOOKS_V2, pre_room_message_display) },
+    { "prof_post_room_message_display", offsetof(PROF_HOOKS_V2, post_room_message_display) },
+    { "prof_pre_room_message_send", offsetof(PROF_HOOKS_V2, pre_room_message_send) },
+    { "prof_post_room_message_send", offsetof(PROF_HOOKS_V2, post_room_message_send) },
+    { "prof_pre_priv_message_display", offsetof(PROF_HOOKS_V2, pre_priv_message_display) },
+    { "prof_post_priv_message_display", offsetof(PROF_HOOKS_V2, post_priv_message_display) },
+    { "prof_pre_priv_message_send", offsetof(PROF_HOOKS_V2, pre_priv_message_send) },
+    { "prof_post_priv_message_send", offsetof(PROF_HOOKS_V2, post_priv_message_send) },
+};
+
+static PROF_STR
+_c_str(const char* const str)
+{
+    PROF_STR view = { str, str ? strlen(str) : 0 };
+
+    return view;
+}
+
+// Maps the result of a v2 pre hook onto the hook contract of plugins.c, the
+// send hooks return the message itself when it is unchanged as NULL cancels
+static char*
+_c_hook_result(PROF_HOOK_RESULT result, const char* message, char* replacement, gboolean send)
+{
+    if (result == PROF_HOOK_REPLACED && replacement) {
+        return replacement;
+    }
+    free(replacement);
+
+    if (send) {
+        return result == PROF_HOOK_CANCEL ? NULL : (char*)message;
+    }
+
+    return NULL;
+}
+
 void
 c_env_init(void)
 {
@@ -79,10 +126,19 @@ c_plugin_create(const char* const filename)
         return NULL;
     }
 
+    const PROF_HOOKS_V2* hooks = dlsym(handle, "prof_hooks_v2");
+    if (hooks && hooks->abi != PROF_HOOKS_ABI) {
+        log_warning("`%s' has hooks for ABI %d, expected %d", filename, hooks->abi, PROF_HOOKS_ABI);
+        dlclose(handle);
+        g_string_free(path, TRUE);
+        return NULL;
+    }
+
     plugin = malloc(sizeof(ProfPlugin));
     plugin->name = strdup(filename);
     plugin->lang = LANG_C;
     plugin->module = handle;
+    plugin->hooks = hooks;
     plugin->init_func = c_init_hook;
     plugin->contains_hook = c_contains_hook;
     plugin->on_start_func = c_on_start_hook;
@@ -143,6 +199,14 @@ c_init_hook(ProfPlugin* plugin, const char* const version, const char* const sta
 gboolean
 c_contains_hook(ProfPlugin* plugin, const char* const hook)
 {
+    if (plugin->hooks) {
+        for (size_t i = 0; i < G_N_ELEMENTS(hooks_v2); i++) {
+            if (strcmp(hooks_v2[i].name, hook) == 0) {
+                return *(void**)((char*)plugin->hooks + hooks_v2[i].offset) != NULL;
+            }
+        }
+    }
+
     if (dlsym(plugin->module, hook)) {
         return TRUE;
     } else {
@@ -227,6 +291,13 @@ c_pre_chat_message_display_hook(ProfPlugin* plugin, const char* const barejid, c
     char* (*func)(const char* const __barejid, const char* const __resource, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        char* replacement = NULL;
+        PROF_HOOK_RESULT result = hooks->pre_chat_message_display(barejid, resource, _c_str(message), &replacement);
+        return _c_hook_result(result, message, replacement, FALSE);
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_pre_chat_message_display")))
         return NULL;
 
@@ -241,6 +312,12 @@ c_post_chat_message_display_hook(ProfPlugin* plugin, const char* const barejid,
     void (*func)(const char* const __barejid, const char* const __resource, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        hooks->post_chat_message_display(barejid, resource, _c_str(message));
+        return;
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_post_chat_message_display")))
         return;
 
@@ -255,6 +332,13 @@ c_pre_chat_message_send_hook(ProfPlugin* plugin, const char* const barejid, cons
     char* (*func)(const char* const __barejid, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        char* replacement = NULL;
+        PROF_HOOK_RESULT result = hooks->pre_chat_message_send(barejid, _c_str(message), &replacement);
+        return _c_hook_result(result, message, replacement, TRUE);
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_pre_chat_message_send")))
         return NULL;
 
@@ -269,6 +353,12 @@ c_post_chat_message_send_hook(ProfPlugin* plugin, const char* const barejid, con
     void (*func)(const char* const __barejid, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        hooks->post_chat_message_send(barejid, _c_str(message));
+        return;
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_post_chat_message_send")))
         return;
 
@@ -283,6 +373,13 @@ c_pre_room_message_display_hook(ProfPlugin* plugin, const char* const barejid, c
     char* (*func)(const char* const __barejid, const char* const __nick, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        char* replacement = NULL;
+        PROF_HOOK_RESULT result = hooks->pre_room_message_display(barejid, nick, _c_str(message), &replacement);
+        return _c_hook_result(result, message, replacement, FALSE);
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_pre_room_message_display")))
         return NULL;
 
@@ -298,6 +395,12 @@ c_post_room_message_display_hook(ProfPlugin* plugin, const char* const barejid,
     void (*func)(const char* const __barejid, const char* const __nick, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        hooks->post_room_message_display(barejid, nick, _c_str(message));
+        return;
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_post_room_message_display")))
         return;
 
@@ -312,6 +415,13 @@ c_pre_room_message_send_hook(ProfPlugin* plugin, const char* const barejid, cons
     char* (*func)(const char* const __barejid, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        char* replacement = NULL;
+        PROF_HOOK_RESULT result = hooks->pre_room_message_send(barejid, _c_str(message), &replacement);
+        return _c_hook_result(result, message, replacement, TRUE);
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_pre_room_message_send")))
         return NULL;
 
@@ -326,6 +436,12 @@ c_post_room_message_send_hook(ProfPlugin* plugin, const char* const barejid, con
     void (*func)(const char* const __barejid, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        hooks->post_room_message_send(barejid, _c_str(message));
+        return;
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_post_room_message_send")))
         return;
 
@@ -356,6 +472,13 @@ c_pre_priv_message_display_hook(ProfPlugin* plugin, const char* const barejid, c
     char* (*func)(const char* const __barejid, const char* const __nick, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        char* replacement = NULL;
+        PROF_HOOK_RESULT result = hooks->pre_priv_message_display(barejid, nick, _c_str(message), &replacement);
+        return _c_hook_result(result, message, replacement, FALSE);
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_pre_priv_message_display")))
         return NULL;
 
@@ -371,6 +494,12 @@ c_post_priv_message_display_hook(ProfPlugin* plugin, const char* const barejid,
     void (*func)(const char* const __barejid, const char* const __nick, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        hooks->post_priv_message_display(barejid, nick, _c_str(message));
+        return;
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_post_priv_message_display")))
         return;
 
@@ -385,6 +514,13 @@ c_pre_priv_message_send_hook(ProfPlugin* plugin, const char* const barejid, cons
     char* (*func)(const char* const __barejid, const char* const __nick, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        char* replacement = NULL;
+        PROF_HOOK_RESULT result = hooks->pre_priv_message_send(barejid, nick, _c_str(message), &replacement);
+        return _c_hook_result(result, message, replacement, TRUE);
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_pre_priv_message_send")))
         return NULL;
 
@@ -399,6 +535,12 @@ c_post_priv_message_send_hook(ProfPlugin* plugin, const char* const barejid, con
     void (*func)(const char* const __barejid, const char* const __nick, const char* __message);
     assert(plugin && plugin->module);
 
+    const PROF_HOOKS_V2* hooks = plugin->hooks;
+    if (hooks) {
+        hooks->post_priv_message_send(barejid, nick, _c_str(message));
+        return;
+    }
+
     if (NULL == (f = dlsym(plugin->module, "prof_post_priv_message_send")))
         return;
 
@@ -48,6 +48,8 @@
 #include "ui/window_list.h"
 
 static GHashTable* p_commands = NULL;
+// command name to the PluginCommand of whichever plugin registered it, not owning
+static GHashTable* p_command_index = NULL;
 static GHashTable* p_timed_functions = NULL;
 static GHashTable* p_window_callbacks = NULL;
 
@@ -122,7 +124,7 @@ _free_timed_function(PluginTimedFunction* timed_function)
         timed_function->callback_destroy(timed_function->callback);
     }
 
-    g_timer_destroy(timed_function->timer);
+    scheduler_remove(timed_function->task);
 
     free(timed_function);
 }
@@ -133,10 +135,31 @@ _free_timed_function_list(GList* timed_functions)
     g_list_free_full(timed_functions, (GDestroyNotify)_free_timed_function);
 }
 
+// Points commands a removed plugin shadowed back at another plugin's registration
+static void
+_reindex_commands(void)
+{
+    GHashTableIter plugin_iter;
+    gpointer command_hash;
+    g_hash_table_iter_init(&plugin_iter, p_commands);
+    while (g_hash_table_iter_next(&plugin_iter, NULL, &command_hash)) {
+        GHashTableIter command_iter;
+        gpointer command;
+        g_hash_table_iter_init(&command_iter, command_hash);
+        while (g_hash_table_iter_next(&command_iter, NULL, &command)) {
+            PluginCommand* plugin_command = command;
+            if (!g_hash_table_contains(p_command_index, plugin_command->command_name)) {
+                g_hash_table_insert(p_command_index, plugin_command->command_name, plugin_command);
+            }
+        }
+    }
+}
+
 void
 callbacks_init(void)
 {
     p_commands = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_free_command_hash);
+    p_command_index = g_hash_table_new(g_str_hash, g_str_equal);
     p_timed_functions = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_free_timed_function_list);
     p_window_callbacks = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_free_window_callbacks);
 }
@@ -150,6 +173,9 @@ callbacks_remove(const char* const plugin_name)
         GList* curr = commands;
         while (curr) {
             char* command = curr->data;
+            if (g_hash_table_lookup(p_command_index, command) == g_hash_table_lookup(command_hash, command)) {
+                g_hash_table_remove(p_command_index, command);
+            }
             cmd_ac_remove(command);
             cmd_ac_remove_help(&command[1]);
             curr = g_list_next(curr);
@@ -158,6 +184,8 @@ callbacks_remove(const char* const plugin_name)
     }
 
     g_hash_table_remove(p_commands, plugin_name);
+    _reindex_commands();
+    cmd_resolve_invalidate();
     g_hash_table_remove(p_timed_functions, plugin_name);
 
     GHashTable* tag_to_win_cb_hash = g_hash_table_lookup(p_window_callbacks, plugin_name);
@@ -177,6 +205,7 @@ callbacks_remove(const char* const plugin_name)
 void
 callbacks_close(void)
 {
+    g_hash_table_destroy(p_command_index);
     g_hash_table_destroy(p_commands);
     g_hash_table_destroy(p_timed_functions);
     g_hash_table_destroy(p_window_callbacks);
@@ -193,13 +222,30 @@ callbacks_add_command(const char* const plugin_name, PluginCommand* command)
         g_hash_table_insert(command_hash, strdup(command->command_name), command);
         g_hash_table_insert(p_commands, strdup(plugin_name), command_hash);
     }
+    g_hash_table_replace(p_command_index, command->command_name, command);
+    cmd_resolve_invalidate();
     cmd_ac_add(command->command_name);
     cmd_ac_add_help(&command->command_name[1]);
 }
 
+static gboolean
+_run_timed_function(void* data)
+{
+    PluginTimedFunction* timed_function = data;
+    timed_function->callback_exec(timed_function);
+
+    return TRUE;
+}
+
 void
 callbacks_add_timed(const char* const plugin_name, PluginTimedFunction* timed_function)
 {
+    // a non positive interval never fires
+    timed_function->task = NULL;
+    if (timed_function->interval_seconds > 0) {
+        timed_function->task = scheduler_add(timed_function->interval_seconds * 1000, _run_timed_function, timed_function, NULL);
+    }
+
     GList* timed_function_list = g_hash_table_lookup(p_timed_functions, plugin_name);
     if (timed_function_list) {
         // we assign this so we dont get: -Werror=unused-result
@@ -270,112 +316,47 @@ callbacks_get_window_handler(const char* tag)
     }
 }
 
+gboolean
+plugins_command_exists(const char* const name)
+{
+    return p_command_index && g_hash_table_contains(p_command_index, name);
+}
+
 gboolean
 plugins_run_command(const char* const input)
 {
-    gchar** split = g_strsplit(input, " ", -1);
-
-    GList* command_hashes = g_hash_table_get_values(p_commands);
-    GList* curr_hash = command_hashes;
-    while (curr_hash) {
-        GHashTable* command_hash = curr_hash->data;
-
-        PluginCommand* command = g_hash_table_lookup(command_hash, split[0]);
-        if (command) {
-            gboolean result;
-            gchar** args = parse_args_with_freetext(input, command->min_args, command->max_args, &result);
-            if (result == FALSE) {
-                ui_invalid_command_usage(command->command_name, NULL);
-                g_strfreev(split);
-                g_list_free(command_hashes);
-                return TRUE;
-            } else {
-                command->callback_exec(command, args);
-                g_strfreev(split);
-                g_strfreev(args);
-                g_list_free(command_hashes);
-                return TRUE;
-            }
-        }
+    char* name = g_strndup(input, strcspn(input, " "));
+    PluginCommand* command = g_hash_table_lookup(p_command_index, name);
+    g_free(name);
+    if (!command) {
+        return FALSE;
+    }
 
-        curr_hash = g_list_next(curr_hash);
+    gboolean result;
+    gchar** args = parse_args_with_freetext(input, command->min_args, command->max_args, &result);
+    if (result == FALSE) {
+        ui_invalid_command_usage(command->command_name, NULL);
+    } else {
+        command->callback_exec(command, args);
     }
+    g_strfreev(args);
 
-    g_list_free(command_hashes);
-    g_strfreev(split);
-    return FALSE;
+    return TRUE;
 }
 
 CommandHelp*
 plugins_get_help(const char* const cmd)
 {
-    GList* command_hashes = g_hash_table_get_values(p_commands);
-    GList* curr_hash = command_hashes;
-    while (curr_hash) {
-        GHashTable* command_hash = curr_hash->data;
-
-        PluginCommand* command = g_hash_table_lookup(command_hash, cmd);
-        if (command) {
-            g_list_free(command_hashes);
-            return command->help;
-        }
-
-        curr_hash = g_list_next(curr_hash);
+    PluginCommand* command = g_hash_table_lookup(p_command_index, cmd);
+    if (command) {
+        return command->help;
     }
 
-    g_list_free(command_hashes);
-
     return NULL;
 }
 
-void
-plugins_run_timed(void)
-{
-    GList* timed_functions_lists = g_hash_table_get_values(p_timed_functions);
-
-    GList* curr_list = timed_functions_lists;
-    while (curr_list) {
-        GList* timed_function_list = curr_list->data;
-        GList* curr = timed_function_list;
-        while (curr) {
-            PluginTimedFunction* timed_function = curr->data;
-
-            gdouble elapsed = g_timer_elapsed(timed_function->timer, NULL);
-
-            if (timed_function->interval_seconds > 0 && elapsed >= timed_function->interval_seconds) {
-                timed_function->callback_exec(timed_function);
-                g_timer_start(timed_function->timer);
-            }
-
-            curr = g_list_next(curr);
-        }
-        curr_list = g_list_next(curr_list);
-    }
-
-    g_list_free(timed_functions_lists);
-}
-
 GList*
 plugins_get_command_names(void)
 {
-    GList* result = NULL;
-
-    GList* command_hashes = g_hash_table_get_values(p_commands);
-    GList* curr_hash = command_hashes;
-    while (curr_hash) {
-        GHashTable* command_hash = curr_hash->data;
-        GList* commands = g_hash_table_get_keys(command_hash);
-        GList* curr = commands;
-        while (curr) {
-            char* command = curr->data;
-            result = g_list_append(result, command);
-            curr = g_list_next(curr);
-        }
-        g_list_free(commands);
-        curr_hash = g_list_next(curr_hash);
-    }
-
-    g_list_free(command_hashes);
-
-    return result;
+    return g_hash_table_get_keys(p_command_index);
 }
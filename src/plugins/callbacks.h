@@ -39,6 +39,7 @@
 #include <glib.h>
 
 #include "command/cmd_defs.h"
+#include "tools/scheduler.h"
 
 typedef struct p_command
 {
@@ -57,7 +58,7 @@ typedef struct p_timed_function
     void (*callback_exec)(struct p_timed_function* timed_function);
     void (*callback_destroy)(void* callback);
     int interval_seconds;
-    GTimer* timer;
+    SchedulerTask* task;
 } PluginTimedFunction;
 
 typedef struct p_window_input_callback
@@ -50,6 +50,8 @@
 #include "plugins/themes.h"
 #include "plugins/settings.h"
 #include "plugins/disco.h"
+#include "tools/perf.h"
+#include "tools/scheduler.h"
 #include "ui/ui.h"
 #include "xmpp/xmpp.h"
 
@@ -65,10 +67,169 @@
 
 static GHashTable* plugins;
 
+static const char* const hook_names[PLUGIN_HOOK_COUNT] = {
+    [PLUGIN_HOOK_ON_START] = "prof_on_start",
+    [PLUGIN_HOOK_ON_SHUTDOWN] = "prof_on_shutdown",
+    [PLUGIN_HOOK_ON_CONNECT] = "prof_on_connect",
+    [PLUGIN_HOOK_ON_DISCONNECT] = "prof_on_disconnect",
+    [PLUGIN_HOOK_PRE_CHAT_MESSAGE_DISPLAY] = "prof_pre_chat_message_display",
+    [PLUGIN_HOOK_POST_CHAT_MESSAGE_DISPLAY] = "prof_post_chat_message_display",
+    [PLUGIN_HOOK_PRE_CHAT_MESSAGE_SEND] = "prof_pre_chat_message_send",
+    [PLUGIN_HOOK_POST_CHAT_MESSAGE_SEND] = "prof_post_chat_message_send",
+    [PLUGIN_HOOK_PRE_ROOM_MESSAGE_DISPLAY] = "prof_pre_room_message_display",
+    [PLUGIN_HOOK_POST_ROOM_MESSAGE_DISPLAY] = "prof_post_room_message_display",
+    [PLUGIN_HOOK_PRE_ROOM_MESSAGE_SEND] = "prof_pre_room_message_send",
+    [PLUGIN_HOOK_POST_ROOM_MESSAGE_SEND] = "prof_post_room_message_send",
+    [PLUGIN_HOOK_ON_ROOM_HISTORY_MESSAGE] = "prof_on_room_history_message",
+    [PLUGIN_HOOK_PRE_PRIV_MESSAGE_DISPLAY] = "prof_pre_priv_message_display",
+    [PLUGIN_HOOK_POST_PRIV_MESSAGE_DISPLAY] = "prof_post_priv_message_display",
+    [PLUGIN_HOOK_PRE_PRIV_MESSAGE_SEND] = "prof_pre_priv_message_send",
+    [PLUGIN_HOOK_POST_PRIV_MESSAGE_SEND] = "prof_post_priv_message_send",
+    [PLUGIN_HOOK_ON_MESSAGE_STANZA_SEND] = "prof_on_message_stanza_send",
+    [PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE] = "prof_on_message_stanza_receive",
+    [PLUGIN_HOOK_ON_PRESENCE_STANZA_SEND] = "prof_on_presence_stanza_send",
+    [PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE] = "prof_on_presence_stanza_receive",
+    [PLUGIN_HOOK_ON_IQ_STANZA_SEND] = "prof_on_iq_stanza_send",
+    [PLUGIN_HOOK_ON_IQ_STANZA_RECEIVE] = "prof_on_iq_stanza_receive",
+    [PLUGIN_HOOK_ON_CONTACT_OFFLINE] = "prof_on_contact_offline",
+    [PLUGIN_HOOK_ON_CONTACT_PRESENCE] = "prof_on_contact_presence",
+    [PLUGIN_HOOK_ON_CHAT_WIN_FOCUS] = "prof_on_chat_win_focus",
+    [PLUGIN_HOOK_ON_ROOM_WIN_FOCUS] = "prof_on_room_win_focus",
+};
+
+// Loaded plugins that define each hook, in load order
+static GPtrArray* hook_plugins[PLUGIN_HOOK_COUNT];
+
+#define PLUGINS_LAZY_INTERVAL_MS 100
+
+// names of the lazy plugins still to load, in config order
+static GQueue lazy_pending = G_QUEUE_INIT;
+static SchedulerTask* lazy_task = NULL;
+static gboolean plugins_started = FALSE;
+
+static void
+_plugins_register(const char* const name, ProfPlugin* plugin)
+{
+    for (int i = 0; i < PLUGIN_HOOK_COUNT; i++) {
+        if (plugin->contains_hook(plugin, hook_names[i])) {
+            g_ptr_array_add(hook_plugins[i], plugin);
+        }
+    }
+
+    g_hash_table_insert(plugins, strdup(name), plugin);
+}
+
+static void
+_plugins_unregister(ProfPlugin* plugin)
+{
+    for (int i = 0; i < PLUGIN_HOOK_COUNT; i++) {
+        g_ptr_array_remove(hook_plugins[i], plugin);
+    }
+    autocompleters_remove_plugin(plugin->name);
+}
+
+// Creates, registers and initialises a plugin, timing how long it takes
+static ProfPlugin*
+_plugins_start(const char* const name, GString* error_message)
+{
+    gint64 started = g_get_monotonic_time();
+    ProfPlugin* plugin = NULL;
+
+    if (g_str_has_suffix(name, ".py")) {
+#ifdef HAVE_PYTHON
+        plugin = python_plugin_create(name);
+#else
+        if (error_message) {
+            g_string_assign(error_message, "Python plugins support is disabled.");
+        }
+#endif
+    }
+
+    if (g_str_has_suffix(name, ".so")) {
+#ifdef HAVE_C
+        plugin = c_plugin_create(name);
+#else
+        if (error_message) {
+            g_string_assign(error_message, "C plugins support is disabled.");
+        }
+#endif
+    }
+
+    if (!plugin) {
+        log_info("Failed to load plugin: %s", name);
+        return NULL;
+    }
+
+    _plugins_register(name, plugin);
+    if (connection_get_status() == JABBER_CONNECTED) {
+        const char* account_name = session_get_account_name();
+        const char* fulljid = connection_get_fulljid();
+        plugin->init_func(plugin, PACKAGE_VERSION, PACKAGE_STATUS, account_name, fulljid);
+    } else {
+        plugin->init_func(plugin, PACKAGE_VERSION, PACKAGE_STATUS, NULL, NULL);
+    }
+    plugin->load_us = g_get_monotonic_time() - started;
+    log_info("Loaded plugin: %s in %" G_GINT64_FORMAT " ms", name, plugin->load_us / 1000);
+
+    return plugin;
+}
+
+// A lazy plugin loads after startup, so it misses the start hook otherwise
+static gboolean
+_plugins_start_lazy(const char* const name)
+{
+    ProfPlugin* plugin = _plugins_start(name, NULL);
+    if (!plugin) {
+        return FALSE;
+    }
+    if (plugin->contains_hook(plugin, hook_names[PLUGIN_HOOK_ON_START])) {
+        plugin->on_start_func(plugin);
+    }
+
+    return TRUE;
+}
+
+static gboolean
+_plugins_lazy_forget(const char* const name)
+{
+    GList* link = g_queue_find_custom(&lazy_pending, name, (GCompareFunc)g_strcmp0);
+    if (!link) {
+        return FALSE;
+    }
+    g_free(link->data);
+    g_queue_delete_link(&lazy_pending, link);
+
+    return TRUE;
+}
+
+// One lazy plugin per run once startup is over, input is handled in between
+static gboolean
+_plugins_lazy_step(void* data)
+{
+    if (!plugins_started) {
+        return TRUE;
+    }
+
+    gchar* name = g_queue_pop_head(&lazy_pending);
+    if (name) {
+        _plugins_start_lazy(name);
+        g_free(name);
+    }
+    if (g_queue_is_empty(&lazy_pending)) {
+        lazy_task = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 void
 plugins_init(void)
 {
     plugins = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    for (int i = 0; i < PLUGIN_HOOK_COUNT; i++) {
+        hook_plugins[i] = g_ptr_array_new();
+    }
     callbacks_init();
     autocompleters_init();
     plugin_themes_init();
@@ -81,46 +242,20 @@ plugins_init(void)
     c_env_init();
 #endif
 
-    // load plugins
+    // load plugins, the lazy ones wait for the main loop
     gchar** plugins_pref = prefs_get_plugins();
     if (plugins_pref) {
         for (int i = 0; i < g_strv_length(plugins_pref); i++) {
-            gboolean loaded = FALSE;
             gchar* filename = plugins_pref[i];
-#ifdef HAVE_PYTHON
-            if (g_str_has_suffix(filename, ".py")) {
-                ProfPlugin* plugin = python_plugin_create(filename);
-                if (plugin) {
-                    g_hash_table_insert(plugins, strdup(filename), plugin);
-                    loaded = TRUE;
-                }
-            }
-#endif
-#ifdef HAVE_C
-            if (g_str_has_suffix(filename, ".so")) {
-                ProfPlugin* plugin = c_plugin_create(filename);
-                if (plugin) {
-                    g_hash_table_insert(plugins, strdup(filename), plugin);
-                    loaded = TRUE;
-                }
-            }
-#endif
-            if (loaded) {
-                log_info("Loaded plugin: %s", filename);
+            if (prefs_plugin_is_lazy(filename)) {
+                g_queue_push_tail(&lazy_pending, g_strdup(filename));
             } else {
-                log_info("Failed to load plugin: %s", filename);
+                _plugins_start(filename, NULL);
             }
         }
-
-        // initialise plugins
-        GList* values = g_hash_table_get_values(plugins);
-        GList* curr = values;
-        while (curr) {
-            ProfPlugin* plugin = curr->data;
-            plugin->init_func(plugin, PACKAGE_VERSION, PACKAGE_STATUS, NULL, NULL);
-            curr = g_list_next(curr);
-        }
-        g_list_free(values);
+    }
+    if (!g_queue_is_empty(&lazy_pending)) {
+        lazy_task = scheduler_add(PLUGINS_LAZY_INTERVAL_MS, _plugins_lazy_step, NULL, NULL);
     }
 
     prefs_free_plugins(plugins_pref);
@@ -239,37 +374,32 @@ plugins_load(const char* const name, GString* error_message)
         return FALSE;
     }
 
-    if (g_str_has_suffix(name, ".py")) {
-#ifdef HAVE_PYTHON
-        plugin = python_plugin_create(name);
-#else
-        g_string_assign(error_message, "Python plugins support is disabled.");
-#endif
+    // loading it now, it no longer waits
+    _plugins_lazy_forget(name);
+    if (!_plugins_start(name, error_message)) {
+        return FALSE;
     }
+    prefs_add_plugin(name);
 
-    if (g_str_has_suffix(name, ".so")) {
-#ifdef HAVE_C
-        plugin = c_plugin_create(name);
-#else
-        g_string_assign(error_message, "C plugins support is disabled.");
-#endif
+    return TRUE;
+}
+
+// Loads the lazy plugins still waiting, TRUE when any was loaded
+gboolean
+plugins_load_lazy(void)
+{
+    gboolean loaded = FALSE;
+    gchar* name;
+    while ((name = g_queue_pop_head(&lazy_pending))) {
+        loaded = _plugins_start_lazy(name) || loaded;
+        g_free(name);
     }
-    if (plugin) {
-        g_hash_table_insert(plugins, strdup(name), plugin);
-        if (connection_get_status() == JABBER_CONNECTED) {
-            const char* account_name = session_get_account_name();
-            const char* fulljid = connection_get_fulljid();
-            plugin->init_func(plugin, PACKAGE_VERSION, PACKAGE_STATUS, account_name, fulljid);
-        } else {
-            plugin->init_func(plugin, PACKAGE_VERSION, PACKAGE_STATUS, NULL, NULL);
-        }
-        log_info("Loaded plugin: %s", name);
-        prefs_add_plugin(name);
-        return TRUE;
-    } else {
-        log_info("Failed to load plugin: %s", name);
-        return FALSE;
+    if (lazy_task) {
+        scheduler_remove(lazy_task);
+        lazy_task = NULL;
     }
+
+    return loaded;
 }
 
 gboolean
@@ -304,6 +434,7 @@ plugins_unload(const char* const name)
     ProfPlugin* plugin = g_hash_table_lookup(plugins, name);
     if (plugin) {
         plugin->on_unload_func(plugin);
+        _plugins_unregister(plugin);
 #ifdef HAVE_PYTHON
         if (plugin->lang == LANG_PYTHON) {
             python_plugin_destroy(plugin);
@@ -326,6 +457,13 @@ plugins_unload(const char* const name)
         }
         return TRUE;
     }
+
+    // a lazy plugin not loaded yet is only forgotten
+    if (_plugins_lazy_forget(name)) {
+        prefs_remove_plugin(name);
+        return TRUE;
+    }
+
     return FALSE;
 }
 
@@ -400,6 +538,22 @@ plugins_loaded_list(void)
     return g_hash_table_get_keys(plugins);
 }
 
+// Lazy plugins still to load, the names are owned by the plugins module
+GList*
+plugins_lazy_list(void)
+{
+    return g_list_copy(lazy_pending.head);
+}
+
+// Microseconds a loaded plugin took to load, -1 when it is not loaded
+gint64
+plugins_load_time(const char* const name)
+{
+    ProfPlugin* plugin = g_hash_table_lookup(plugins, name);
+
+    return plugin ? plugin->load_us : -1;
+}
+
 char*
 plugins_autocomplete(const char* const input, gboolean previous)
 {
@@ -430,232 +584,222 @@ plugins_close_win(const char* const plugin_name, const char* const tag)
 void
 plugins_on_start(void)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    plugins_started = TRUE;
+
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_START];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->on_start_func(plugin);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_START], plugin->name);
     }
-    g_list_free(values);
 }
 
 void
 plugins_on_shutdown(void)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_SHUTDOWN];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->on_shutdown_func(plugin);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_SHUTDOWN], plugin->name);
     }
-    g_list_free(values);
 }
 
 void
 plugins_on_connect(const char* const account_name, const char* const fulljid)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_CONNECT];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->on_connect_func(plugin, account_name, fulljid);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_CONNECT], plugin->name);
     }
-    g_list_free(values);
 }
 
 void
 plugins_on_disconnect(const char* const account_name, const char* const fulljid)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_DISCONNECT];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->on_disconnect_func(plugin, account_name, fulljid);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_DISCONNECT], plugin->name);
     }
-    g_list_free(values);
 }
 
 char*
 plugins_pre_chat_message_display(const char* const barejid, const char* const resource, const char* message)
 {
     char* new_message = NULL;
-    char* curr_message = strdup(message);
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        new_message = plugin->pre_chat_message_display(plugin, barejid, resource, curr_message);
-        if (new_message) {
+    // plugins share the original until one of them changes it
+    char* curr_message = NULL;
+
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_PRE_CHAT_MESSAGE_DISPLAY];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
+        const char* input = curr_message ? curr_message : message;
+        new_message = plugin->pre_chat_message_display(plugin, barejid, resource, input);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_PRE_CHAT_MESSAGE_DISPLAY], plugin->name);
+        if (new_message && new_message != input) {
             free(curr_message);
-            curr_message = strdup(new_message);
-            free(new_message);
+            curr_message = new_message;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
-    return curr_message;
+    return curr_message ? curr_message : strdup(message);
 }
 
 void
 plugins_post_chat_message_display(const char* const barejid, const char* const resource, const char* message)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_POST_CHAT_MESSAGE_DISPLAY];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->post_chat_message_display(plugin, barejid, resource, message);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_POST_CHAT_MESSAGE_DISPLAY], plugin->name);
     }
-    g_list_free(values);
 }
 
 char*
 plugins_pre_chat_message_send(const char* const barejid, const char* message)
 {
     char* new_message = NULL;
-    char* curr_message = strdup(message);
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        if (plugin->contains_hook(plugin, "prof_pre_chat_message_send")) {
-            new_message = plugin->pre_chat_message_send(plugin, barejid, curr_message);
-            if (new_message) {
-                free(curr_message);
-                curr_message = strdup(new_message);
-                free(new_message);
-            } else {
-                free(curr_message);
-                g_list_free(values);
+    // plugins share the original until one of them changes it
+    char* curr_message = NULL;
+
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_PRE_CHAT_MESSAGE_SEND];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
+        const char* input = curr_message ? curr_message : message;
+        new_message = plugin->pre_chat_message_send(plugin, barejid, input);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_PRE_CHAT_MESSAGE_SEND], plugin->name);
+        if (new_message == NULL) {
+            free(curr_message);
 
-                return NULL;
-            }
+            return NULL;
+        } else if (new_message != input) {
+            free(curr_message);
+            curr_message = new_message;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
-    return curr_message;
+    return curr_message ? curr_message : strdup(message);
 }
 
 void
 plugins_post_chat_message_send(const char* const barejid, const char* message)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_POST_CHAT_MESSAGE_SEND];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->post_chat_message_send(plugin, barejid, message);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_POST_CHAT_MESSAGE_SEND], plugin->name);
     }
-    g_list_free(values);
 }
 
 char*
 plugins_pre_room_message_display(const char* const barejid, const char* const nick, const char* message)
 {
     char* new_message = NULL;
-    char* curr_message = strdup(message);
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        new_message = plugin->pre_room_message_display(plugin, barejid, nick, curr_message);
-        if (new_message) {
+    // plugins share the original until one of them changes it
+    char* curr_message = NULL;
+
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_PRE_ROOM_MESSAGE_DISPLAY];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
+        const char* input = curr_message ? curr_message : message;
+        new_message = plugin->pre_room_message_display(plugin, barejid, nick, input);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_PRE_ROOM_MESSAGE_DISPLAY], plugin->name);
+        if (new_message && new_message != input) {
             free(curr_message);
-            curr_message = strdup(new_message);
-            free(new_message);
+            curr_message = new_message;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
-    return curr_message;
+    return curr_message ? curr_message : strdup(message);
 }
 
 void
 plugins_post_room_message_display(const char* const barejid, const char* const nick, const char* message)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_POST_ROOM_MESSAGE_DISPLAY];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->post_room_message_display(plugin, barejid, nick, message);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_POST_ROOM_MESSAGE_DISPLAY], plugin->name);
     }
-    g_list_free(values);
 }
 
 char*
 plugins_pre_room_message_send(const char* const barejid, const char* message)
 {
     char* new_message = NULL;
-    char* curr_message = strdup(message);
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        if (plugin->contains_hook(plugin, "prof_pre_room_message_send")) {
-            new_message = plugin->pre_room_message_send(plugin, barejid, curr_message);
-            if (new_message) {
-                free(curr_message);
-                curr_message = strdup(new_message);
-                free(new_message);
-            } else {
-                free(curr_message);
-                g_list_free(values);
+    // plugins share the original until one of them changes it
+    char* curr_message = NULL;
+
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_PRE_ROOM_MESSAGE_SEND];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
+        const char* input = curr_message ? curr_message : message;
+        new_message = plugin->pre_room_message_send(plugin, barejid, input);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_PRE_ROOM_MESSAGE_SEND], plugin->name);
+        if (new_message == NULL) {
+            free(curr_message);
 
-                return NULL;
-            }
+            return NULL;
+        } else if (new_message != input) {
+            free(curr_message);
+            curr_message = new_message;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
-    return curr_message;
+    return curr_message ? curr_message : strdup(message);
 }
 
 void
 plugins_post_room_message_send(const char* const barejid, const char* message)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_POST_ROOM_MESSAGE_SEND];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->post_room_message_send(plugin, barejid, message);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_POST_ROOM_MESSAGE_SEND], plugin->name);
     }
-    g_list_free(values);
 }
 
 void
 plugins_on_room_history_message(const char* const barejid, const char* const nick, const char* const message,
-                                GDateTime* timestamp)
+                                gint64 timestamp)
 {
+    if (!plugins_hook_in_use(PLUGIN_HOOK_ON_ROOM_HISTORY_MESSAGE)) {
+        return;
+    }
+
     char* timestamp_str = NULL;
-    GTimeVal timestamp_tv;
-    gboolean res = g_date_time_to_timeval(timestamp, &timestamp_tv);
-    if (res) {
+    if (timestamp) {
+        GTimeVal timestamp_tv = { timestamp / G_USEC_PER_SEC, timestamp % G_USEC_PER_SEC };
         timestamp_str = g_time_val_to_iso8601(&timestamp_tv);
     }
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_ROOM_HISTORY_MESSAGE];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->on_room_history_message(plugin, barejid, nick, message, timestamp_str);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_ROOM_HISTORY_MESSAGE], plugin->name);
     }
-    g_list_free(values);
 
     free(timestamp_str);
 }
@@ -665,24 +809,24 @@ plugins_pre_priv_message_display(const char* const fulljid, const char* message)
 {
     Jid* jidp = jid_create(fulljid);
     char* new_message = NULL;
-    char* curr_message = strdup(message);
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        new_message = plugin->pre_priv_message_display(plugin, jidp->barejid, jidp->resourcepart, curr_message);
-        if (new_message) {
+    // plugins share the original until one of them changes it
+    char* curr_message = NULL;
+
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_PRE_PRIV_MESSAGE_DISPLAY];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
+        const char* input = curr_message ? curr_message : message;
+        new_message = plugin->pre_priv_message_display(plugin, jidp->barejid, jidp->resourcepart, input);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_PRE_PRIV_MESSAGE_DISPLAY], plugin->name);
+        if (new_message && new_message != input) {
             free(curr_message);
-            curr_message = strdup(new_message);
-            free(new_message);
+            curr_message = new_message;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
     jid_destroy(jidp);
-    return curr_message;
+    return curr_message ? curr_message : strdup(message);
 }
 
 void
@@ -690,14 +834,13 @@ plugins_post_priv_message_display(const char* const fulljid, const char* message
 {
     Jid* jidp = jid_create(fulljid);
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_POST_PRIV_MESSAGE_DISPLAY];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->post_priv_message_display(plugin, jidp->barejid, jidp->resourcepart, message);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_POST_PRIV_MESSAGE_DISPLAY], plugin->name);
     }
-    g_list_free(values);
 
     jid_destroy(jidp);
 }
@@ -707,32 +850,29 @@ plugins_pre_priv_message_send(const char* const fulljid, const char* const messa
 {
     Jid* jidp = jid_create(fulljid);
     char* new_message = NULL;
-    char* curr_message = strdup(message);
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        if (plugin->contains_hook(plugin, "prof_pre_priv_message_send")) {
-            new_message = plugin->pre_priv_message_send(plugin, jidp->barejid, jidp->resourcepart, curr_message);
-            if (new_message) {
-                free(curr_message);
-                curr_message = strdup(new_message);
-                free(new_message);
-            } else {
-                free(curr_message);
-                g_list_free(values);
-                jid_destroy(jidp);
+    // plugins share the original until one of them changes it
+    char* curr_message = NULL;
+
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_PRE_PRIV_MESSAGE_SEND];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
+        const char* input = curr_message ? curr_message : message;
+        new_message = plugin->pre_priv_message_send(plugin, jidp->barejid, jidp->resourcepart, input);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_PRE_PRIV_MESSAGE_SEND], plugin->name);
+        if (new_message == NULL) {
+            free(curr_message);
+            jid_destroy(jidp);
 
-                return NULL;
-            }
+            return NULL;
+        } else if (new_message != input) {
+            free(curr_message);
+            curr_message = new_message;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
     jid_destroy(jidp);
-    return curr_message;
+    return curr_message ? curr_message : strdup(message);
 }
 
 void
@@ -740,37 +880,40 @@ plugins_post_priv_message_send(const char* const fulljid, const char* const mess
 {
     Jid* jidp = jid_create(fulljid);
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_POST_PRIV_MESSAGE_SEND];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->post_priv_message_send(plugin, jidp->barejid, jidp->resourcepart, message);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_POST_PRIV_MESSAGE_SEND], plugin->name);
     }
-    g_list_free(values);
 
     jid_destroy(jidp);
 }
 
+gboolean
+plugins_hook_in_use(plugin_hook_t hook)
+{
+    return hook_plugins[hook]->len > 0;
+}
+
 char*
 plugins_on_message_stanza_send(const char* const text)
 {
     char* new_stanza = NULL;
-    char* curr_stanza = strdup(text);
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        new_stanza = plugin->on_message_stanza_send(plugin, curr_stanza);
+    char* curr_stanza = NULL;
+
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_MESSAGE_STANZA_SEND];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
+        new_stanza = plugin->on_message_stanza_send(plugin, curr_stanza ? curr_stanza : text);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_MESSAGE_STANZA_SEND], plugin->name);
         if (new_stanza) {
             free(curr_stanza);
-            curr_stanza = strdup(new_stanza);
-            free(new_stanza);
+            curr_stanza = new_stanza;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
     return curr_stanza;
 }
@@ -780,17 +923,16 @@ plugins_on_message_stanza_receive(const char* const text)
 {
     gboolean cont = TRUE;
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         gboolean res = plugin->on_message_stanza_receive(plugin, text);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE], plugin->name);
         if (res == FALSE) {
             cont = FALSE;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
     return cont;
 }
@@ -799,21 +941,19 @@ char*
 plugins_on_presence_stanza_send(const char* const text)
 {
     char* new_stanza = NULL;
-    char* curr_stanza = strdup(text);
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        new_stanza = plugin->on_presence_stanza_send(plugin, curr_stanza);
+    char* curr_stanza = NULL;
+
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_PRESENCE_STANZA_SEND];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
+        new_stanza = plugin->on_presence_stanza_send(plugin, curr_stanza ? curr_stanza : text);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_PRESENCE_STANZA_SEND], plugin->name);
         if (new_stanza) {
             free(curr_stanza);
-            curr_stanza = strdup(new_stanza);
-            free(new_stanza);
+            curr_stanza = new_stanza;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
     return curr_stanza;
 }
@@ -823,17 +963,16 @@ plugins_on_presence_stanza_receive(const char* const text)
 {
     gboolean cont = TRUE;
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         gboolean res = plugin->on_presence_stanza_receive(plugin, text);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE], plugin->name);
         if (res == FALSE) {
             cont = FALSE;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
     return cont;
 }
@@ -842,21 +981,19 @@ char*
 plugins_on_iq_stanza_send(const char* const text)
 {
     char* new_stanza = NULL;
-    char* curr_stanza = strdup(text);
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        new_stanza = plugin->on_iq_stanza_send(plugin, curr_stanza);
+    char* curr_stanza = NULL;
+
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_IQ_STANZA_SEND];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
+        new_stanza = plugin->on_iq_stanza_send(plugin, curr_stanza ? curr_stanza : text);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_IQ_STANZA_SEND], plugin->name);
         if (new_stanza) {
             free(curr_stanza);
-            curr_stanza = strdup(new_stanza);
-            free(new_stanza);
+            curr_stanza = new_stanza;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
     return curr_stanza;
 }
@@ -866,17 +1003,16 @@ plugins_on_iq_stanza_receive(const char* const text)
 {
     gboolean cont = TRUE;
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_IQ_STANZA_RECEIVE];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         gboolean res = plugin->on_iq_stanza_receive(plugin, text);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_IQ_STANZA_RECEIVE], plugin->name);
         if (res == FALSE) {
             cont = FALSE;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
 
     return cont;
 }
@@ -884,53 +1020,49 @@ plugins_on_iq_stanza_receive(const char* const text)
 void
 plugins_on_contact_offline(const char* const barejid, const char* const resource, const char* const status)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_CONTACT_OFFLINE];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->on_contact_offline(plugin, barejid, resource, status);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_CONTACT_OFFLINE], plugin->name);
     }
-    g_list_free(values);
 }
 
 void
 plugins_on_contact_presence(const char* const barejid, const char* const resource, const char* const presence, const char* const status, const int priority)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_CONTACT_PRESENCE];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->on_contact_presence(plugin, barejid, resource, presence, status, priority);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_CONTACT_PRESENCE], plugin->name);
     }
-    g_list_free(values);
 }
 
 void
 plugins_on_chat_win_focus(const char* const barejid)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_CHAT_WIN_FOCUS];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->on_chat_win_focus(plugin, barejid);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_CHAT_WIN_FOCUS], plugin->name);
     }
-    g_list_free(values);
 }
 
 void
 plugins_on_room_win_focus(const char* const barejid)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* hooked = hook_plugins[PLUGIN_HOOK_ON_ROOM_WIN_FOCUS];
+    for (guint i = 0; i < hooked->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(hooked, i);
+        gint64 started = perf_start();
         plugin->on_room_win_focus(plugin, barejid);
-        curr = g_list_next(curr);
+        perf_stop_named(PERF_PLUGINS, started, hook_names[PLUGIN_HOOK_ON_ROOM_WIN_FOCUS], plugin->name);
     }
-    g_list_free(values);
 }
 
 GList*
@@ -942,6 +1074,13 @@ plugins_get_disco_features(void)
 void
 plugins_shutdown(void)
 {
+    if (lazy_task) {
+        scheduler_remove(lazy_task);
+        lazy_task = NULL;
+    }
+    g_queue_clear_full(&lazy_pending, g_free);
+    plugins_started = FALSE;
+
     GList* values = g_hash_table_get_values(plugins);
     GList* curr = values;
 
@@ -974,4 +1113,8 @@ plugins_shutdown(void)
     disco_close();
     g_hash_table_destroy(plugins);
     plugins = NULL;
+    for (int i = 0; i < PLUGIN_HOOK_COUNT; i++) {
+        g_ptr_array_free(hook_plugins[i], TRUE);
+        hook_plugins[i] = NULL;
+    }
 }
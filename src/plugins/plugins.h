@@ -43,6 +43,38 @@ typedef enum {
     LANG_C
 } lang_t;
 
+// Hooks a plugin may define, looked up once when it is loaded
+typedef enum {
+    PLUGIN_HOOK_ON_START,
+    PLUGIN_HOOK_ON_SHUTDOWN,
+    PLUGIN_HOOK_ON_CONNECT,
+    PLUGIN_HOOK_ON_DISCONNECT,
+    PLUGIN_HOOK_PRE_CHAT_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_POST_CHAT_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_PRE_CHAT_MESSAGE_SEND,
+    PLUGIN_HOOK_POST_CHAT_MESSAGE_SEND,
+    PLUGIN_HOOK_PRE_ROOM_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_POST_ROOM_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_PRE_ROOM_MESSAGE_SEND,
+    PLUGIN_HOOK_POST_ROOM_MESSAGE_SEND,
+    PLUGIN_HOOK_ON_ROOM_HISTORY_MESSAGE,
+    PLUGIN_HOOK_PRE_PRIV_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_POST_PRIV_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_PRE_PRIV_MESSAGE_SEND,
+    PLUGIN_HOOK_POST_PRIV_MESSAGE_SEND,
+    PLUGIN_HOOK_ON_MESSAGE_STANZA_SEND,
+    PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE,
+    PLUGIN_HOOK_ON_PRESENCE_STANZA_SEND,
+    PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE,
+    PLUGIN_HOOK_ON_IQ_STANZA_SEND,
+    PLUGIN_HOOK_ON_IQ_STANZA_RECEIVE,
+    PLUGIN_HOOK_ON_CONTACT_OFFLINE,
+    PLUGIN_HOOK_ON_CONTACT_PRESENCE,
+    PLUGIN_HOOK_ON_CHAT_WIN_FOCUS,
+    PLUGIN_HOOK_ON_ROOM_WIN_FOCUS,
+    PLUGIN_HOOK_COUNT
+} plugin_hook_t;
+
 typedef struct prof_plugins_install_t
 {
     GSList* installed;
@@ -54,6 +86,10 @@ typedef struct prof_plugin_t
     char* name;
     lang_t lang;
     void* module;
+    // table of message hooks for C plugins using the v2 ABI, NULL otherwise
+    const void* hooks;
+    // time taken to load and initialise, in microseconds
+    gint64 load_us;
     void (*init_func)(struct prof_plugin_t* plugin, const char* const version,
                       const char* const status, const char* const account_name, const char* const fulljid);
 
@@ -111,6 +147,9 @@ typedef struct prof_plugin_t
 void plugins_init(void);
 GSList* plugins_unloaded_list(void);
 GList* plugins_loaded_list(void);
+GList* plugins_lazy_list(void);
+gint64 plugins_load_time(const char* const name);
+gboolean plugins_load_lazy(void);
 char* plugins_autocomplete(const char* const input, gboolean previous);
 void plugins_reset_autocomplete(void);
 void plugins_shutdown(void);
@@ -144,7 +183,7 @@ void plugins_post_room_message_display(const char* const barejid, const char* co
 char* plugins_pre_room_message_send(const char* const barejid, const char* message);
 void plugins_post_room_message_send(const char* const barejid, const char* message);
 void plugins_on_room_history_message(const char* const barejid, const char* const nick, const char* const message,
-                                     GDateTime* timestamp);
+                                     gint64 timestamp);
 
 char* plugins_pre_priv_message_display(const char* const fulljid, const char* message);
 void plugins_post_priv_message_display(const char* const fulljid, const char* message);
@@ -154,6 +193,10 @@ void plugins_post_priv_message_send(const char* const fulljid, const char* const
 void plugins_win_process_line(char* win, const char* const line);
 void plugins_close_win(const char* const plugin_name, const char* const tag);
 
+gboolean plugins_hook_in_use(plugin_hook_t hook);
+
+// The *_stanza_send functions return the stanza as changed by the plugins,
+// or NULL if no plugin changed it.
 char* plugins_on_message_stanza_send(const char* const text);
 gboolean plugins_on_message_stanza_receive(const char* const text);
 
@@ -171,7 +214,7 @@ void plugins_on_chat_win_focus(const char* const barejid);
 void plugins_on_room_win_focus(const char* const barejid);
 
 gboolean plugins_run_command(const char* const cmd);
-void plugins_run_timed(void);
+gboolean plugins_command_exists(const char* const name);
 GList* plugins_get_command_names(void);
 gchar* plugins_get_dir(void);
 CommandHelp* plugins_get_help(const char* const cmd);
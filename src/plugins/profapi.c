@@ -43,6 +43,7 @@
 void (*prof_cons_alert)(void) = NULL;
 int (*prof_cons_show)(const char * const message) = NULL;
 int (*prof_cons_show_themed)(const char *const group, const char *const item, const char *const def, const char *const message) = NULL;
+int (*prof_cons_show_lines)(char **lines) = NULL;
 int (*prof_cons_bad_cmd_usage)(const char *const cmd) = NULL;
 
 void (*_prof_register_command)(const char *filename, const char *command_name, int min_args, int max_args,
@@ -67,6 +68,7 @@ char* (*prof_get_current_nick)(void) = NULL;
 char* (*prof_get_name_from_roster)(const char *barejid) = NULL;
 char* (*prof_get_barejid_from_roster)(const char *name) = NULL;
 char** (*prof_get_current_occupants)(void) = NULL;
+char** (*prof_get_room_occupants)(const char *roomjid) = NULL;
 
 char* (*prof_get_room_nick)(const char *barejid) = NULL;
 
@@ -80,6 +82,8 @@ int (*prof_win_exists)(PROF_WIN_TAG win) = NULL;
 int (*prof_win_focus)(PROF_WIN_TAG win) = NULL;
 int (*prof_win_show)(PROF_WIN_TAG win, char *line) = NULL;
 int (*prof_win_show_themed)(PROF_WIN_TAG tag, char *group, char *key, char *def, char *line) = NULL;
+int (*prof_win_show_lines)(PROF_WIN_TAG tag, char **lines) = NULL;
+int (*prof_win_append)(PROF_WIN_TAG tag, char *line) = NULL;
 
 int (*prof_send_stanza)(char *stanza) = NULL;
 
@@ -93,6 +97,7 @@ char** (*prof_settings_string_list_get)(char *group, char *key) = NULL;
 void (*prof_settings_string_list_add)(char *group, char *key, char *value) = NULL;
 int (*prof_settings_string_list_remove)(char *group, char *key, char *value) = NULL;
 int (*prof_settings_string_list_clear)(char *group, char *key) = NULL;
+void (*prof_settings_flush)(void) = NULL;
 
 void (*prof_incoming_message)(char *barejid, char *resource, char *message) = NULL;
 
@@ -53,6 +53,7 @@ typedef void(*WINDOW_CB)(PROF_WIN_TAG win, char *line);
 void (*prof_cons_alert)(void);
 int (*prof_cons_show)(const char * const message);
 int (*prof_cons_show_themed)(const char *const group, const char *const item, const char *const def, const char *const message);
+int (*prof_cons_show_lines)(char **lines);
 int (*prof_cons_bad_cmd_usage)(const char *const cmd);
 
 void (*_prof_register_command)(const char *filename, const char *command_name, int min_args, int max_args,
@@ -77,6 +78,7 @@ char* (*prof_get_current_nick)(void);
 char* (*prof_get_name_from_roster)(const char *barejid);
 char* (*prof_get_barejid_from_roster)(const char *name);
 char** (*prof_get_current_occupants)(void);
+char** (*prof_get_room_occupants)(const char *roomjid);
 
 char* (*prof_get_room_nick)(const char *barejid);
 
@@ -90,6 +92,8 @@ int (*prof_win_exists)(PROF_WIN_TAG win);
 int (*prof_win_focus)(PROF_WIN_TAG win);
 int (*prof_win_show)(PROF_WIN_TAG win, char *line);
 int (*prof_win_show_themed)(PROF_WIN_TAG tag, char *group, char *key, char *def, char *line);
+int (*prof_win_show_lines)(PROF_WIN_TAG tag, char **lines);
+int (*prof_win_append)(PROF_WIN_TAG tag, char *line);
 
 int (*prof_send_stanza)(char *stanza);
 
@@ -103,6 +107,7 @@ char** (*prof_settings_string_list_get)(char *group, char *key);
 void (*prof_settings_string_list_add)(char *group, char *key, char *value);
 int (*prof_settings_string_list_remove)(char *group, char *key, char *value);
 int (*prof_settings_string_list_clear)(char *group, char *key);
+void (*prof_settings_flush)(void);
 
 void (*prof_incoming_message)(char *barejid, char *resource, char *message);
 
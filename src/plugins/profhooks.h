@@ -0,0 +1,87 @@
+/*
+ * profhooks.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef PLUGINS_PROF_HOOKS_H
+#define PLUGINS_PROF_HOOKS_H
+
+#include <stddef.h>
+
+// Version of the hook table below, a plugin whose table has another version
+// is not loaded
+#define PROF_HOOKS_ABI 2
+
+// A borrowed view of a string, valid only for the duration of the hook.
+// str is NUL terminated at len.
+typedef struct prof_str_t
+{
+    const char* str;
+    size_t len;
+} PROF_STR;
+
+typedef enum {
+    // the message is used as it is
+    PROF_HOOK_UNCHANGED,
+    // the message is replaced by *replacement, a malloc'd string that
+    // Profanity takes over
+    PROF_HOOK_REPLACED,
+    // the message is not sent, only for the *_send hooks
+    PROF_HOOK_CANCEL
+} PROF_HOOK_RESULT;
+
+// C plugins may define a table of message hooks named prof_hooks_v2 instead
+// of the prof_pre_* and prof_post_* message functions, hooks left NULL are
+// not called. Other hooks are looked up by name as before.
+typedef struct prof_hooks_v2_t
+{
+    int abi;
+
+    PROF_HOOK_RESULT (*pre_chat_message_display)(const char* barejid, const char* resource, PROF_STR message, char** replacement);
+    void (*post_chat_message_display)(const char* barejid, const char* resource, PROF_STR message);
+    PROF_HOOK_RESULT (*pre_chat_message_send)(const char* barejid, PROF_STR message, char** replacement);
+    void (*post_chat_message_send)(const char* barejid, PROF_STR message);
+
+    PROF_HOOK_RESULT (*pre_room_message_display)(const char* barejid, const char* nick, PROF_STR message, char** replacement);
+    void (*post_room_message_display)(const char* barejid, const char* nick, PROF_STR message);
+    PROF_HOOK_RESULT (*pre_room_message_send)(const char* barejid, PROF_STR message, char** replacement);
+    void (*post_room_message_send)(const char* barejid, PROF_STR message);
+
+    PROF_HOOK_RESULT (*pre_priv_message_display)(const char* barejid, const char* nick, PROF_STR message, char** replacement);
+    void (*post_priv_message_display)(const char* barejid, const char* nick, PROF_STR message);
+    PROF_HOOK_RESULT (*pre_priv_message_send)(const char* barejid, const char* nick, PROF_STR message, char** replacement);
+    void (*post_priv_message_send)(const char* barejid, const char* nick, PROF_STR message);
+} PROF_HOOKS_V2;
+
+#endif
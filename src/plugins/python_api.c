@@ -50,12 +50,81 @@
 
 static char* _python_plugin_name(void);
 
+// Python strings for the values the API hands out again and again such as
+// jids and nicks, dropped all at once when the cache grows too large
+#define PYTHON_STR_CACHE_MAX 1024
+
+static GHashTable* str_cache = NULL;
+
+static void
+_python_str_unref(void* pystr)
+{
+    Py_XDECREF((PyObject*)pystr);
+}
+
+// a new reference to the interned Python string for str, None for NULL,
+// the GIL must be held
+static PyObject*
+_python_str(const char* const str)
+{
+    if (str == NULL) {
+        Py_RETURN_NONE;
+    }
+
+    if (!str_cache) {
+        str_cache = g_hash_table_new_full(g_str_hash, g_str_equal, free, _python_str_unref);
+    }
+
+    PyObject* pystr = g_hash_table_lookup(str_cache, str);
+    if (pystr == NULL) {
+        if (g_hash_table_size(str_cache) >= PYTHON_STR_CACHE_MAX) {
+            g_hash_table_remove_all(str_cache);
+        }
+#if PY_MAJOR_VERSION >= 3
+        pystr = PyUnicode_InternFromString(str);
+#else
+        pystr = PyString_InternFromString(str);
+#endif
+        if (pystr == NULL) {
+            return NULL;
+        }
+        g_hash_table_insert(str_cache, strdup(str), pystr);
+    }
+
+    Py_INCREF(pystr);
+    return pystr;
+}
+
+// list of the strings in strv which is freed, an empty list for NULL
+static PyObject*
+_python_strv_to_list(char** strv)
+{
+    Py_ssize_t len = strv ? g_strv_length(strv) : 0;
+    PyObject* result = PyList_New(len);
+    for (Py_ssize_t i = 0; i < len; i++) {
+        // the list takes over the reference
+        PyList_SET_ITEM(result, i, _python_str(strv[i]));
+    }
+    g_strfreev(strv);
+
+    return result;
+}
+
+void
+python_api_close(void)
+{
+    if (str_cache) {
+        g_hash_table_destroy(str_cache);
+        str_cache = NULL;
+    }
+}
+
 static PyObject*
 python_api_cons_alert(PyObject* self, PyObject* args)
 {
-    allow_python_threads();
+    python_api_begin();
     api_cons_alert();
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -70,10 +139,10 @@ python_api_cons_show(PyObject* self, PyObject* args)
 
     char* message_str = python_str_or_unicode_to_string(message);
 
-    allow_python_threads();
+    python_api_begin();
     api_cons_show(message_str);
     free(message_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -94,13 +163,63 @@ python_api_cons_show_themed(PyObject* self, PyObject* args)
     char* def_str = python_str_or_unicode_to_string(def);
     char* message_str = python_str_or_unicode_to_string(message);
 
-    allow_python_threads();
+    python_api_begin();
     api_cons_show_themed(group_str, key_str, def_str, message_str);
     free(group_str);
     free(key_str);
     free(def_str);
     free(message_str);
-    disable_python_threads();
+    python_api_end();
+
+    Py_RETURN_NONE;
+}
+
+// NULL terminated copy of a list of strings, NULL if lines is not a list
+static char**
+_python_list_to_lines(PyObject* lines)
+{
+    if (!PyList_Check(lines)) {
+        return NULL;
+    }
+
+    Py_ssize_t len = PyList_Size(lines);
+    char** c_lines = calloc(len + 1, sizeof(char*));
+    Py_ssize_t count = 0;
+    for (Py_ssize_t i = 0; i < len; i++) {
+        char* c_line = python_str_or_unicode_to_string(PyList_GetItem(lines, i));
+        if (c_line) {
+            c_lines[count++] = c_line;
+        }
+    }
+
+    return c_lines;
+}
+
+static void
+_python_lines_free(char** lines)
+{
+    if (lines) {
+        for (int i = 0; lines[i]; i++) {
+            free(lines[i]);
+        }
+        free(lines);
+    }
+}
+
+static PyObject*
+python_api_cons_show_lines(PyObject* self, PyObject* args)
+{
+    PyObject* lines = NULL;
+    if (!PyArg_ParseTuple(args, "O", &lines)) {
+        Py_RETURN_NONE;
+    }
+
+    char** c_lines = _python_list_to_lines(lines);
+
+    python_api_begin();
+    api_cons_show_lines(c_lines);
+    _python_lines_free(c_lines);
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -115,10 +234,10 @@ python_api_cons_bad_cmd_usage(PyObject* self, PyObject* args)
 
     char* cmd_str = python_str_or_unicode_to_string(cmd);
 
-    allow_python_threads();
+    python_api_begin();
     api_cons_bad_cmd_usage(cmd_str);
     free(cmd_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -186,7 +305,7 @@ python_api_register_command(PyObject* self, PyObject* args)
         }
         c_examples[len] = NULL;
 
-        allow_python_threads();
+        python_api_begin();
         api_register_command(plugin_name, command_name_str, min_args, max_args, c_synopsis,
                              description_str, c_arguments, c_examples, p_callback, python_command_callback, NULL);
         free(command_name_str);
@@ -205,7 +324,7 @@ python_api_register_command(PyObject* self, PyObject* args)
         while (c_examples[i] != NULL) {
             free(c_examples[i++]);
         }
-        disable_python_threads();
+        python_api_end();
     }
 
     free(plugin_name);
@@ -227,9 +346,9 @@ python_api_register_timed(PyObject* self, PyObject* args)
     log_debug("Register timed for %s", plugin_name);
 
     if (p_callback && PyCallable_Check(p_callback)) {
-        allow_python_threads();
+        python_api_begin();
         api_register_timed(plugin_name, p_callback, interval_seconds, python_timed_callback, NULL);
-        disable_python_threads();
+        python_api_end();
     }
 
     free(plugin_name);
@@ -263,14 +382,14 @@ python_api_completer_add(PyObject* self, PyObject* args)
     }
     c_items[len] = NULL;
 
-    allow_python_threads();
+    python_api_begin();
     api_completer_add(plugin_name, key_str, c_items);
     free(key_str);
     i = 0;
     while (c_items[i] != NULL) {
         free(c_items[i++]);
     }
-    disable_python_threads();
+    python_api_end();
 
     free(plugin_name);
 
@@ -303,10 +422,10 @@ python_api_completer_remove(PyObject* self, PyObject* args)
     }
     c_items[len] = NULL;
 
-    allow_python_threads();
+    python_api_begin();
     api_completer_remove(plugin_name, key_str, c_items);
     free(key_str);
-    disable_python_threads();
+    python_api_end();
 
     free(plugin_name);
 
@@ -327,10 +446,10 @@ python_api_completer_clear(PyObject* self, PyObject* args)
     char* plugin_name = _python_plugin_name();
     log_debug("Autocomplete clear %s for %s", key_str, plugin_name);
 
-    allow_python_threads();
+    python_api_begin();
     api_completer_clear(plugin_name, key_str);
     free(key_str);
-    disable_python_threads();
+    python_api_end();
 
     free(plugin_name);
 
@@ -351,10 +470,10 @@ python_api_filepath_completer_add(PyObject* self, PyObject* args)
     char* plugin_name = _python_plugin_name();
     log_debug("Filepath autocomplete added '%s' for %s", prefix_str, plugin_name);
 
-    allow_python_threads();
+    python_api_begin();
     api_filepath_completer_add(plugin_name, prefix_str);
     free(prefix_str);
-    disable_python_threads();
+    python_api_end();
 
     free(plugin_name);
 
@@ -375,11 +494,11 @@ python_api_notify(PyObject* self, PyObject* args)
     char* message_str = python_str_or_unicode_to_string(message);
     char* category_str = python_str_or_unicode_to_string(category);
 
-    allow_python_threads();
+    python_api_begin();
     api_notify(message_str, category_str, timeout_ms);
     free(message_str);
     free(category_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -394,10 +513,10 @@ python_api_send_line(PyObject* self, PyObject* args)
 
     char* line_str = python_str_or_unicode_to_string(line);
 
-    allow_python_threads();
+    python_api_begin();
     api_send_line(line_str);
     free(line_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -405,40 +524,28 @@ python_api_send_line(PyObject* self, PyObject* args)
 static PyObject*
 python_api_get_current_recipient(PyObject* self, PyObject* args)
 {
-    allow_python_threads();
+    python_api_begin();
     char* recipient = api_get_current_recipient();
-    disable_python_threads();
-    if (recipient) {
-        return Py_BuildValue("s", recipient);
-    } else {
-        Py_RETURN_NONE;
-    }
+    python_api_end();
+    return _python_str(recipient);
 }
 
 static PyObject*
 python_api_get_current_muc(PyObject* self, PyObject* args)
 {
-    allow_python_threads();
+    python_api_begin();
     char* room = api_get_current_muc();
-    disable_python_threads();
-    if (room) {
-        return Py_BuildValue("s", room);
-    } else {
-        Py_RETURN_NONE;
-    }
+    python_api_end();
+    return _python_str(room);
 }
 
 static PyObject*
 python_api_get_current_nick(PyObject* self, PyObject* args)
 {
-    allow_python_threads();
+    python_api_begin();
     char* nick = api_get_current_nick();
-    disable_python_threads();
-    if (nick) {
-        return Py_BuildValue("s", nick);
-    } else {
-        Py_RETURN_NONE;
-    }
+    python_api_end();
+    return _python_str(nick);
 }
 
 static PyObject*
@@ -451,15 +558,14 @@ python_api_get_name_from_roster(PyObject* self, PyObject* args)
 
     char* barejid_str = python_str_or_unicode_to_string(barejid);
 
-    allow_python_threads();
+    python_api_begin();
     char* name = roster_get_display_name(barejid_str);
     free(barejid_str);
-    disable_python_threads();
-    if (name) {
-        return Py_BuildValue("s", name);
-    } else {
-        Py_RETURN_NONE;
-    }
+    python_api_end();
+
+    PyObject* result = _python_str(name);
+    free(name);
+    return result;
 }
 
 static PyObject*
@@ -472,42 +578,47 @@ python_api_get_barejid_from_roster(PyObject* self, PyObject* args)
 
     char* name_str = python_str_or_unicode_to_string(name);
 
-    allow_python_threads();
+    python_api_begin();
     char* barejid = roster_barejid_from_name(name_str);
     free(name_str);
-    disable_python_threads();
-    if (barejid) {
-        return Py_BuildValue("s", barejid);
-    } else {
-        Py_RETURN_NONE;
-    }
+    python_api_end();
+    return _python_str(barejid);
 }
 
 static PyObject*
 python_api_get_current_occupants(PyObject* self, PyObject* args)
 {
-    allow_python_threads();
+    python_api_begin();
     char** occupants = api_get_current_occupants();
-    disable_python_threads();
-    PyObject* result = PyList_New(0);
-    if (occupants) {
-        int len = g_strv_length(occupants);
-        int i = 0;
-        for (i = 0; i < len; i++) {
-            PyList_Append(result, Py_BuildValue("s", occupants[i]));
-        }
-        return result;
-    } else {
-        return result;
+    python_api_end();
+
+    return _python_strv_to_list(occupants);
+}
+
+static PyObject*
+python_api_get_room_occupants(PyObject* self, PyObject* args)
+{
+    PyObject* roomjid = NULL;
+    if (!PyArg_ParseTuple(args, "O", &roomjid)) {
+        Py_RETURN_NONE;
     }
+
+    char* roomjid_str = python_str_or_unicode_to_string(roomjid);
+
+    python_api_begin();
+    char** occupants = api_get_room_occupants(roomjid_str);
+    free(roomjid_str);
+    python_api_end();
+
+    return _python_strv_to_list(occupants);
 }
 
 static PyObject*
 python_api_current_win_is_console(PyObject* self, PyObject* args)
 {
-    allow_python_threads();
+    python_api_begin();
     int res = api_current_win_is_console();
-    disable_python_threads();
+    python_api_end();
     if (res) {
         return Py_BuildValue("O", Py_True);
     } else {
@@ -525,15 +636,11 @@ python_api_get_room_nick(PyObject* self, PyObject* args)
 
     char* barejid_str = python_str_or_unicode_to_string(barejid);
 
-    allow_python_threads();
+    python_api_begin();
     char* nick = api_get_room_nick(barejid_str);
     free(barejid_str);
-    disable_python_threads();
-    if (nick) {
-        return Py_BuildValue("s", nick);
-    } else {
-        Py_RETURN_NONE;
-    }
+    python_api_end();
+    return _python_str(nick);
 }
 
 static PyObject*
@@ -546,10 +653,10 @@ python_api_log_debug(PyObject* self, PyObject* args)
 
     char* message_str = python_str_or_unicode_to_string(message);
 
-    allow_python_threads();
+    python_api_begin();
     api_log_debug(message_str);
     free(message_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -564,10 +671,10 @@ python_api_log_info(PyObject* self, PyObject* args)
 
     char* message_str = python_str_or_unicode_to_string(message);
 
-    allow_python_threads();
+    python_api_begin();
     api_log_info(message_str);
     free(message_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -582,10 +689,10 @@ python_api_log_warning(PyObject* self, PyObject* args)
 
     char* message_str = python_str_or_unicode_to_string(message);
 
-    allow_python_threads();
+    python_api_begin();
     api_log_warning(message_str);
     free(message_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -600,10 +707,10 @@ python_api_log_error(PyObject* self, PyObject* args)
 
     char* message_str = python_str_or_unicode_to_string(message);
 
-    allow_python_threads();
+    python_api_begin();
     api_log_error(message_str);
     free(message_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -618,10 +725,10 @@ python_api_win_exists(PyObject* self, PyObject* args)
 
     char* tag_str = python_str_or_unicode_to_string(tag);
 
-    allow_python_threads();
+    python_api_begin();
     gboolean exists = api_win_exists(tag_str);
     free(tag_str);
-    disable_python_threads();
+    python_api_end();
 
     if (exists) {
         return Py_BuildValue("O", Py_True);
@@ -645,10 +752,10 @@ python_api_win_create(PyObject* self, PyObject* args)
     char* plugin_name = _python_plugin_name();
 
     if (p_callback && PyCallable_Check(p_callback)) {
-        allow_python_threads();
+        python_api_begin();
         api_win_create(plugin_name, tag_str, p_callback, python_window_callback, NULL);
         free(tag_str);
-        disable_python_threads();
+        python_api_end();
     }
 
     free(plugin_name);
@@ -667,10 +774,10 @@ python_api_win_focus(PyObject* self, PyObject* args)
 
     char* tag_str = python_str_or_unicode_to_string(tag);
 
-    allow_python_threads();
+    python_api_begin();
     api_win_focus(tag_str);
     free(tag_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -688,11 +795,11 @@ python_api_win_show(PyObject* self, PyObject* args)
     char* tag_str = python_str_or_unicode_to_string(tag);
     char* line_str = python_str_or_unicode_to_string(line);
 
-    allow_python_threads();
+    python_api_begin();
     api_win_show(tag_str, line_str);
     free(tag_str);
     free(line_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -717,14 +824,60 @@ python_api_win_show_themed(PyObject* self, PyObject* args)
     char* def_str = python_str_or_unicode_to_string(def);
     char* line_str = python_str_or_unicode_to_string(line);
 
-    allow_python_threads();
+    python_api_begin();
     api_win_show_themed(tag_str, group_str, key_str, def_str, line_str);
     free(tag_str);
     free(group_str);
     free(key_str);
     free(def_str);
     free(line_str);
-    disable_python_threads();
+    python_api_end();
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+python_api_win_show_lines(PyObject* self, PyObject* args)
+{
+    PyObject* tag = NULL;
+    PyObject* lines = NULL;
+
+    if (!PyArg_ParseTuple(args, "OO", &tag, &lines)) {
+        python_check_error();
+        Py_RETURN_NONE;
+    }
+
+    char* tag_str = python_str_or_unicode_to_string(tag);
+    char** c_lines = _python_list_to_lines(lines);
+
+    python_api_begin();
+    api_win_show_lines(tag_str, c_lines);
+    free(tag_str);
+    _python_lines_free(c_lines);
+    python_api_end();
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+python_api_win_append(PyObject* self, PyObject* args)
+{
+    PyObject* tag = NULL;
+    PyObject* line = NULL;
+
+    if (!PyArg_ParseTuple(args, "OO", &tag, &line)) {
+        python_check_error();
+        Py_RETURN_NONE;
+    }
+
+    char* tag_str = python_str_or_unicode_to_string(tag);
+    char* line_str = python_str_or_unicode_to_string(line);
+
+    python_api_begin();
+    api_win_append(tag_str, line_str);
+    free(tag_str);
+    free(line_str);
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -739,10 +892,10 @@ python_api_send_stanza(PyObject* self, PyObject* args)
 
     char* stanza_str = python_str_or_unicode_to_string(stanza);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_send_stanza(stanza_str);
     free(stanza_str);
-    disable_python_threads();
+    python_api_end();
     if (res) {
         return Py_BuildValue("O", Py_True);
     } else {
@@ -765,11 +918,11 @@ python_api_settings_boolean_get(PyObject* self, PyObject* args)
     char* key_str = python_str_or_unicode_to_string(key);
     int def = PyObject_IsTrue(defobj);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_settings_boolean_get(group_str, key_str, def);
     free(group_str);
     free(key_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -793,11 +946,11 @@ python_api_settings_boolean_set(PyObject* self, PyObject* args)
     char* key_str = python_str_or_unicode_to_string(key);
     int val = PyObject_IsTrue(valobj);
 
-    allow_python_threads();
+    python_api_begin();
     api_settings_boolean_set(group_str, key_str, val);
     free(group_str);
     free(key_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -817,12 +970,12 @@ python_api_settings_string_get(PyObject* self, PyObject* args)
     char* key_str = python_str_or_unicode_to_string(key);
     char* def_str = python_str_or_unicode_to_string(def);
 
-    allow_python_threads();
+    python_api_begin();
     char* res = api_settings_string_get(group_str, key_str, def_str);
     free(group_str);
     free(key_str);
     free(def_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         PyObject* pyres = Py_BuildValue("s", res);
@@ -848,12 +1001,12 @@ python_api_settings_string_set(PyObject* self, PyObject* args)
     char* key_str = python_str_or_unicode_to_string(key);
     char* val_str = python_str_or_unicode_to_string(val);
 
-    allow_python_threads();
+    python_api_begin();
     api_settings_string_set(group_str, key_str, val_str);
     free(group_str);
     free(key_str);
     free(val_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -872,11 +1025,11 @@ python_api_settings_int_get(PyObject* self, PyObject* args)
     char* group_str = python_str_or_unicode_to_string(group);
     char* key_str = python_str_or_unicode_to_string(key);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_settings_int_get(group_str, key_str, def);
     free(group_str);
     free(key_str);
-    disable_python_threads();
+    python_api_end();
 
     return Py_BuildValue("i", res);
 }
@@ -895,11 +1048,21 @@ python_api_settings_int_set(PyObject* self, PyObject* args)
     char* group_str = python_str_or_unicode_to_string(group);
     char* key_str = python_str_or_unicode_to_string(key);
 
-    allow_python_threads();
+    python_api_begin();
     api_settings_int_set(group_str, key_str, val);
     free(group_str);
     free(key_str);
-    disable_python_threads();
+    python_api_end();
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+python_api_settings_flush(PyObject* self, PyObject* args)
+{
+    python_api_begin();
+    api_settings_flush();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -917,11 +1080,11 @@ python_api_settings_string_list_get(PyObject* self, PyObject* args)
     char* group_str = python_str_or_unicode_to_string(group);
     char* key_str = python_str_or_unicode_to_string(key);
 
-    allow_python_threads();
+    python_api_begin();
     char** c_list = api_settings_string_list_get(group_str, key_str);
     free(group_str);
     free(key_str);
-    disable_python_threads();
+    python_api_end();
 
     if (!c_list) {
         Py_RETURN_NONE;
@@ -959,12 +1122,12 @@ python_api_settings_string_list_add(PyObject* self, PyObject* args)
     char* key_str = python_str_or_unicode_to_string(key);
     char* val_str = python_str_or_unicode_to_string(val);
 
-    allow_python_threads();
+    python_api_begin();
     api_settings_string_list_add(group_str, key_str, val_str);
     free(group_str);
     free(key_str);
     free(val_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -984,12 +1147,12 @@ python_api_settings_string_list_remove(PyObject* self, PyObject* args)
     char* key_str = python_str_or_unicode_to_string(key);
     char* val_str = python_str_or_unicode_to_string(val);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_settings_string_list_remove(group_str, key_str, val_str);
     free(group_str);
     free(key_str);
     free(val_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1011,11 +1174,11 @@ python_api_settings_string_list_clear(PyObject* self, PyObject* args)
     char* group_str = python_str_or_unicode_to_string(group);
     char* key_str = python_str_or_unicode_to_string(key);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_settings_string_list_clear(group_str, key_str);
     free(group_str);
     free(key_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1039,12 +1202,12 @@ python_api_incoming_message(PyObject* self, PyObject* args)
     char* resource_str = python_str_or_unicode_to_string(resource);
     char* message_str = python_str_or_unicode_to_string(message);
 
-    allow_python_threads();
+    python_api_begin();
     api_incoming_message(barejid_str, resource_str, message_str);
     free(barejid_str);
     free(resource_str);
     free(message_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -1060,10 +1223,10 @@ python_api_disco_add_feature(PyObject* self, PyObject* args)
     char* feature_str = python_str_or_unicode_to_string(feature);
     char* plugin_name = _python_plugin_name();
 
-    allow_python_threads();
+    python_api_begin();
     api_disco_add_feature(plugin_name, feature_str);
     free(feature_str);
-    disable_python_threads();
+    python_api_end();
 
     free(plugin_name);
 
@@ -1080,10 +1243,10 @@ python_api_encryption_reset(PyObject* self, PyObject* args)
 
     char* barejid_str = python_str_or_unicode_to_string(barejid);
 
-    allow_python_threads();
+    python_api_begin();
     api_encryption_reset(barejid_str);
     free(barejid_str);
-    disable_python_threads();
+    python_api_end();
 
     Py_RETURN_NONE;
 }
@@ -1100,11 +1263,11 @@ python_api_chat_set_titlebar_enctext(PyObject* self, PyObject* args)
     char* barejid_str = python_str_or_unicode_to_string(barejid);
     char* enctext_str = python_str_or_unicode_to_string(enctext);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_chat_set_titlebar_enctext(barejid_str, enctext_str);
     free(barejid_str);
     free(enctext_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1123,10 +1286,10 @@ python_api_chat_unset_titlebar_enctext(PyObject* self, PyObject* args)
 
     char* barejid_str = python_str_or_unicode_to_string(barejid);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_chat_unset_titlebar_enctext(barejid_str);
     free(barejid_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1147,11 +1310,11 @@ python_api_chat_set_incoming_char(PyObject* self, PyObject* args)
     char* barejid_str = python_str_or_unicode_to_string(barejid);
     char* ch_str = python_str_or_unicode_to_string(ch);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_chat_set_incoming_char(barejid_str, ch_str);
     free(barejid_str);
     free(ch_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1170,10 +1333,10 @@ python_api_chat_unset_incoming_char(PyObject* self, PyObject* args)
 
     char* barejid_str = python_str_or_unicode_to_string(barejid);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_chat_unset_incoming_char(barejid_str);
     free(barejid_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1194,11 +1357,11 @@ python_api_chat_set_outgoing_char(PyObject* self, PyObject* args)
     char* barejid_str = python_str_or_unicode_to_string(barejid);
     char* ch_str = python_str_or_unicode_to_string(ch);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_chat_set_outgoing_char(barejid_str, ch_str);
     free(barejid_str);
     free(ch_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1217,10 +1380,10 @@ python_api_chat_unset_outgoing_char(PyObject* self, PyObject* args)
 
     char* barejid_str = python_str_or_unicode_to_string(barejid);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_chat_unset_outgoing_char(barejid_str);
     free(barejid_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1241,11 +1404,11 @@ python_api_room_set_titlebar_enctext(PyObject* self, PyObject* args)
     char* roomjid_str = python_str_or_unicode_to_string(roomjid);
     char* enctext_str = python_str_or_unicode_to_string(enctext);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_room_set_titlebar_enctext(roomjid_str, enctext_str);
     free(roomjid_str);
     free(enctext_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1264,10 +1427,10 @@ python_api_room_unset_titlebar_enctext(PyObject* self, PyObject* args)
 
     char* roomjid_str = python_str_or_unicode_to_string(roomjid);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_room_unset_titlebar_enctext(roomjid_str);
     free(roomjid_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1288,11 +1451,11 @@ python_api_room_set_message_char(PyObject* self, PyObject* args)
     char* roomjid_str = python_str_or_unicode_to_string(roomjid);
     char* ch_str = python_str_or_unicode_to_string(ch);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_room_set_message_char(roomjid_str, ch_str);
     free(roomjid_str);
     free(ch_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1311,10 +1474,10 @@ python_api_room_unset_message_char(PyObject* self, PyObject* args)
 
     char* roomjid_str = python_str_or_unicode_to_string(roomjid);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_room_unset_message_char(roomjid_str);
     free(roomjid_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1335,11 +1498,11 @@ python_api_chat_show(PyObject* self, PyObject* args)
     char* barejid_str = python_str_or_unicode_to_string(barejid);
     char* message_str = python_str_or_unicode_to_string(message);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_chat_show(barejid_str, message_str);
     free(barejid_str);
     free(message_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1368,7 +1531,7 @@ python_api_chat_show_themed(PyObject* self, PyObject* args)
     char* ch_str = python_str_or_unicode_to_string(ch);
     char* message_str = python_str_or_unicode_to_string(message);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_chat_show_themed(barejid_str, group_str, key_str, def_str, ch_str, message_str);
     free(barejid_str);
     free(group_str);
@@ -1376,7 +1539,7 @@ python_api_chat_show_themed(PyObject* self, PyObject* args)
     free(def_str);
     free(ch_str);
     free(message_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1397,11 +1560,11 @@ python_api_room_show(PyObject* self, PyObject* args)
     char* roomjid_str = python_str_or_unicode_to_string(roomjid);
     char* message_str = python_str_or_unicode_to_string(message);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_room_show(roomjid_str, message_str);
     free(roomjid_str);
     free(message_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1430,7 +1593,7 @@ python_api_room_show_themed(PyObject* self, PyObject* args)
     char* ch_str = python_str_or_unicode_to_string(ch);
     char* message_str = python_str_or_unicode_to_string(message);
 
-    allow_python_threads();
+    python_api_begin();
     int res = api_room_show_themed(roomjid_str, group_str, key_str, def_str, ch_str, message_str);
     free(roomjid_str);
     free(group_str);
@@ -1438,7 +1601,7 @@ python_api_room_show_themed(PyObject* self, PyObject* args)
     free(def_str);
     free(ch_str);
     free(message_str);
-    disable_python_threads();
+    python_api_end();
 
     if (res) {
         return Py_BuildValue("O", Py_True);
@@ -1494,7 +1657,9 @@ void
 python_timed_callback(PluginTimedFunction* timed_function)
 {
     disable_python_threads();
-    PyObject_CallObject(timed_function->callback, NULL);
+    if (!python_queue_callable(timed_function->callback)) {
+        PyObject_CallObject(timed_function->callback, NULL);
+    }
     allow_python_threads();
 }
 
@@ -1518,6 +1683,7 @@ static PyMethodDef apiMethods[] = {
     { "cons_alert", python_api_cons_alert, METH_NOARGS, "Highlight the console window in the status bar." },
     { "cons_show", python_api_cons_show, METH_VARARGS, "Print a line to the console." },
     { "cons_show_themed", python_api_cons_show_themed, METH_VARARGS, "Print a themed line to the console" },
+    { "cons_show_lines", python_api_cons_show_lines, METH_VARARGS, "Print many lines to the console at once." },
     { "cons_bad_cmd_usage", python_api_cons_bad_cmd_usage, METH_VARARGS, "Show invalid command message in console" },
     { "register_command", python_api_register_command, METH_VARARGS, "Register a command." },
     { "register_timed", python_api_register_timed, METH_VARARGS, "Register a timed function." },
@@ -1534,6 +1700,7 @@ static PyMethodDef apiMethods[] = {
     { "get_barejid_from_roster", python_api_get_barejid_from_roster, METH_VARARGS, "Return nickname in roster of barejid." },
     { "get_current_occupants", python_api_get_current_occupants, METH_VARARGS, "Return list of occupants in current room." },
     { "current_win_is_console", python_api_current_win_is_console, METH_VARARGS, "Returns whether the current window is the console." },
+    { "get_room_occupants", python_api_get_room_occupants, METH_VARARGS, "Return list of occupants in the specified room." },
     { "get_room_nick", python_api_get_room_nick, METH_VARARGS, "Return the nickname used in the specified room, or None if not in the room." },
     { "log_debug", python_api_log_debug, METH_VARARGS, "Log a debug message" },
     { "log_info", python_api_log_info, METH_VARARGS, "Log an info message" },
@@ -1544,6 +1711,8 @@ static PyMethodDef apiMethods[] = {
     { "win_focus", python_api_win_focus, METH_VARARGS, "Focus a window." },
     { "win_show", python_api_win_show, METH_VARARGS, "Show text in the window." },
     { "win_show_themed", python_api_win_show_themed, METH_VARARGS, "Show themed text in the window." },
+    { "win_show_lines", python_api_win_show_lines, METH_VARARGS, "Show many lines in the window at once." },
+    { "win_append", python_api_win_append, METH_VARARGS, "Add text to the window without waking the UI." },
     { "send_stanza", python_api_send_stanza, METH_VARARGS, "Send an XMPP stanza." },
     { "settings_boolean_get", python_api_settings_boolean_get, METH_VARARGS, "Get a boolean setting." },
     { "settings_boolean_set", python_api_settings_boolean_set, METH_VARARGS, "Set a boolean setting." },
@@ -1555,6 +1724,7 @@ static PyMethodDef apiMethods[] = {
     { "settings_string_list_add", python_api_settings_string_list_add, METH_VARARGS, "Add item to string list setting." },
     { "settings_string_list_remove", python_api_settings_string_list_remove, METH_VARARGS, "Remove item from string list setting." },
     { "settings_string_list_clear", python_api_settings_string_list_clear, METH_VARARGS, "Remove all items from string list setting." },
+    { "settings_flush", python_api_settings_flush, METH_NOARGS, "Write changed settings to disk now." },
     { "incoming_message", python_api_incoming_message, METH_VARARGS, "Show an incoming message." },
     { "disco_add_feature", python_api_disco_add_feature, METH_VARARGS, "Add a feature to disco info response." },
     { "encryption_reset", python_api_encryption_reset, METH_VARARGS, "End encrypted chat session with barejid, if one exists" },
@@ -1642,10 +1812,9 @@ python_str_or_unicode_to_string(void* obj)
 
 #if PY_MAJOR_VERSION >= 3
     if (PyUnicode_Check(pyobj)) {
-        PyObject* utf8_str = PyUnicode_AsUTF8String(pyobj);
-        char* result = strdup(PyBytes_AS_STRING(utf8_str));
-        Py_XDECREF(utf8_str);
-        return result;
+        // the UTF-8 form is cached in the object, no bytes object is made
+        const char* utf8_str = PyUnicode_AsUTF8(pyobj);
+        return utf8_str ? strdup(utf8_str) : NULL;
     } else {
         return strdup(PyBytes_AS_STRING(pyobj));
     }
@@ -39,6 +39,7 @@
 void python_env_init(void);
 void python_init_prof(void);
 void python_shutdown(void);
+void python_api_close(void);
 
 void python_command_callback(PluginCommand* command, gchar** args);
 void python_timed_callback(PluginTimedFunction* timed_function);
@@ -36,8 +36,11 @@
 #undef _XOPEN_SOURCE
 #include <Python.h>
 
+#include <pthread.h>
+
 #include "log.h"
 #include "config.h"
+#include "profanity.h"
 #include "config/preferences.h"
 #include "config/files.h"
 #include "plugins/api.h"
@@ -48,9 +51,25 @@
 #include "plugins/python_plugins.h"
 #include "ui/ui.h"
 
-static PyThreadState* thread_state;
+// per thread, as the worker thread releases the GIL around API calls too
+static __thread PyThreadState* thread_state;
+static __thread gboolean on_python_worker = FALSE;
 static GHashTable* loaded_modules;
 
+// Hook or timed function of a plugin with prof_async_hooks set, run on
+// the worker thread
+typedef struct python_job_t
+{
+    // module the hook is looked up in, or the callable itself
+    PyObject* target;
+    char* hook;
+    PyObject* args;
+} PythonJob;
+
+static GAsyncQueue* python_jobs = NULL;
+static pthread_t python_worker;
+static PythonJob python_worker_stop;
+
 static void _python_undefined_error(ProfPlugin* plugin, char* hook, char* type);
 static void _python_type_error(ProfPlugin* plugin, char* hook, char* type);
 
@@ -69,6 +88,129 @@ disable_python_threads()
     PyEval_RestoreThread(thread_state);
 }
 
+// Wraps calls from plugin code into the API, on the worker thread they
+// wait for the main loop to be idle, as the UI is not thread safe
+void
+python_api_begin(void)
+{
+    allow_python_threads();
+    if (on_python_worker) {
+        pthread_mutex_lock(&lock);
+    }
+}
+
+void
+python_api_end(void)
+{
+    if (on_python_worker) {
+        pthread_mutex_unlock(&lock);
+    }
+    disable_python_threads();
+}
+
+static void*
+_python_worker_run(void* data)
+{
+    on_python_worker = TRUE;
+
+    while (TRUE) {
+        PythonJob* job = g_async_queue_pop(python_jobs);
+        if (job == &python_worker_stop) {
+            break;
+        }
+
+        PyGILState_STATE gil_state = PyGILState_Ensure();
+        PyObject* p_function = job->target;
+        if (job->hook) {
+            p_function = PyObject_GetAttrString(job->target, job->hook);
+            python_check_error();
+        } else {
+            Py_INCREF(p_function);
+        }
+        if (p_function && PyCallable_Check(p_function)) {
+            PyObject* result = PyObject_CallObject(p_function, job->args);
+            python_check_error();
+            Py_XDECREF(result);
+        }
+        Py_XDECREF(p_function);
+        Py_XDECREF(job->target);
+        Py_XDECREF(job->args);
+        PyGILState_Release(gil_state);
+
+        free(job->hook);
+        free(job);
+    }
+
+    return NULL;
+}
+
+static gboolean
+_python_module_is_async(PyObject* module)
+{
+    if (python_jobs == NULL || module == NULL || !PyObject_HasAttrString(module, "prof_async_hooks")) {
+        return FALSE;
+    }
+
+    PyObject* async = PyObject_GetAttrString(module, "prof_async_hooks");
+    gboolean res = async && PyObject_IsTrue(async) == 1;
+    Py_XDECREF(async);
+    python_check_error();
+
+    return res;
+}
+
+static void
+_python_queue_job(PyObject* target, const char* const hook, PyObject* args)
+{
+    PythonJob* job = malloc(sizeof(PythonJob));
+    Py_INCREF(target);
+    Py_XINCREF(args);
+    job->target = target;
+    job->hook = hook ? strdup(hook) : NULL;
+    job->args = args;
+
+    g_async_queue_push(python_jobs, job);
+}
+
+// Queues the hook for the worker thread if the plugin asked for it, must
+// hold the GIL
+static gboolean
+_python_queue_hook(PyObject* module, const char* const hook, PyObject* args)
+{
+    if (!_python_module_is_async(module) || !PyObject_HasAttrString(module, hook)) {
+        return FALSE;
+    }
+
+    _python_queue_job(module, hook, args);
+    return TRUE;
+}
+
+// Queues a timed function for the worker thread if its plugin asked for
+// it, must hold the GIL
+gboolean
+python_queue_callable(void* callable)
+{
+    if (python_jobs == NULL) {
+        return FALSE;
+    }
+
+    PyObject* module_name = PyObject_GetAttrString(callable, "__module__");
+    PyErr_Clear();
+    if (module_name == NULL) {
+        return FALSE;
+    }
+
+    // borrowed reference
+    PyObject* module = PyDict_GetItem(PyImport_GetModuleDict(), module_name);
+    Py_DECREF(module_name);
+    if (!_python_module_is_async(module)) {
+        return FALSE;
+    }
+
+    _python_queue_job(callable, NULL, NULL);
+    return TRUE;
+}
+
 static void
 _unref_module(PyObject* module)
 {
@@ -112,6 +254,13 @@ python_env_init(void)
     g_free(plugins_dir);
 
     allow_python_threads();
+
+    python_jobs = g_async_queue_new();
+    if (pthread_create(&python_worker, NULL, _python_worker_run, NULL) != 0) {
+        log_error("Failed to start Python worker thread, running all hooks synchronously");
+        g_async_queue_unref(python_jobs);
+        python_jobs = NULL;
+    }
 }
 
 ProfPlugin*
@@ -137,6 +286,7 @@ python_plugin_create(const char* const filename)
         plugin->name = strdup(filename);
         plugin->lang = LANG_PYTHON;
         plugin->module = p_module;
+        plugin->hooks = NULL;
         plugin->init_func = python_init_hook;
         plugin->contains_hook = python_contains_hook;
         plugin->on_start_func = python_on_start_hook;
@@ -346,7 +496,9 @@ python_post_chat_message_display_hook(ProfPlugin* plugin, const char* const bare
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
-    if (PyObject_HasAttrString(p_module, "prof_post_chat_message_display")) {
+    if (_python_queue_hook(p_module, "prof_post_chat_message_display", p_args)) {
+        // runs on the worker thread
+    } else if (PyObject_HasAttrString(p_module, "prof_post_chat_message_display")) {
         p_function = PyObject_GetAttrString(p_module, "prof_post_chat_message_display");
         python_check_error();
         if (p_function && PyCallable_Check(p_function)) {
@@ -391,7 +543,9 @@ python_post_chat_message_send_hook(ProfPlugin* plugin, const char* const barejid
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
-    if (PyObject_HasAttrString(p_module, "prof_post_chat_message_send")) {
+    if (_python_queue_hook(p_module, "prof_post_chat_message_send", p_args)) {
+        // runs on the worker thread
+    } else if (PyObject_HasAttrString(p_module, "prof_post_chat_message_send")) {
         p_function = PyObject_GetAttrString(p_module, "prof_post_chat_message_send");
         python_check_error();
         if (p_function && PyCallable_Check(p_function)) {
@@ -437,7 +591,9 @@ python_post_room_message_display_hook(ProfPlugin* plugin, const char* const bare
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
-    if (PyObject_HasAttrString(p_module, "prof_post_room_message_display")) {
+    if (_python_queue_hook(p_module, "prof_post_room_message_display", p_args)) {
+        // runs on the worker thread
+    } else if (PyObject_HasAttrString(p_module, "prof_post_room_message_display")) {
         p_function = PyObject_GetAttrString(p_module, "prof_post_room_message_display");
         python_check_error();
         if (p_function && PyCallable_Check(p_function)) {
@@ -482,7 +638,9 @@ python_post_room_message_send_hook(ProfPlugin* plugin, const char* const barejid
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
-    if (PyObject_HasAttrString(p_module, "prof_post_room_message_send")) {
+    if (_python_queue_hook(p_module, "prof_post_room_message_send", p_args)) {
+        // runs on the worker thread
+    } else if (PyObject_HasAttrString(p_module, "prof_post_room_message_send")) {
         p_function = PyObject_GetAttrString(p_module, "prof_post_room_message_send");
         python_check_error();
         if (p_function && PyCallable_Check(p_function)) {
@@ -504,7 +662,9 @@ python_on_room_history_message_hook(ProfPlugin* plugin, const char* const bareji
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
-    if (PyObject_HasAttrString(p_module, "prof_on_room_history_message")) {
+    if (_python_queue_hook(p_module, "prof_on_room_history_message", p_args)) {
+        // runs on the worker thread
+    } else if (PyObject_HasAttrString(p_module, "prof_on_room_history_message")) {
         p_function = PyObject_GetAttrString(p_module, "prof_on_room_history_message");
         python_check_error();
         if (p_function && PyCallable_Check(p_function)) {
@@ -551,7 +711,9 @@ python_post_priv_message_display_hook(ProfPlugin* plugin, const char* const bare
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
-    if (PyObject_HasAttrString(p_module, "prof_post_priv_message_display")) {
+    if (_python_queue_hook(p_module, "prof_post_priv_message_display", p_args)) {
+        // runs on the worker thread
+    } else if (PyObject_HasAttrString(p_module, "prof_post_priv_message_display")) {
         p_function = PyObject_GetAttrString(p_module, "prof_post_priv_message_display");
         python_check_error();
         if (p_function && PyCallable_Check(p_function)) {
@@ -598,7 +760,9 @@ python_post_priv_message_send_hook(ProfPlugin* plugin, const char* const barejid
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
-    if (PyObject_HasAttrString(p_module, "prof_post_priv_message_send")) {
+    if (_python_queue_hook(p_module, "prof_post_priv_message_send", p_args)) {
+        // runs on the worker thread
+    } else if (PyObject_HasAttrString(p_module, "prof_post_priv_message_send")) {
         p_function = PyObject_GetAttrString(p_module, "prof_post_priv_message_send");
         python_check_error();
         if (p_function && PyCallable_Check(p_function)) {
@@ -764,7 +928,9 @@ python_on_contact_offline_hook(ProfPlugin* plugin, const char* const barejid, co
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
-    if (PyObject_HasAttrString(p_module, "prof_on_contact_offline")) {
+    if (_python_queue_hook(p_module, "prof_on_contact_offline", p_args)) {
+        // runs on the worker thread
+    } else if (PyObject_HasAttrString(p_module, "prof_on_contact_offline")) {
         p_function = PyObject_GetAttrString(p_module, "prof_on_contact_offline");
         python_check_error();
         if (p_function && PyCallable_Check(p_function)) {
@@ -786,7 +952,9 @@ python_on_contact_presence_hook(ProfPlugin* plugin, const char* const barejid, c
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
-    if (PyObject_HasAttrString(p_module, "prof_on_contact_presence")) {
+    if (_python_queue_hook(p_module, "prof_on_contact_presence", p_args)) {
+        // runs on the worker thread
+    } else if (PyObject_HasAttrString(p_module, "prof_on_contact_presence")) {
         p_function = PyObject_GetAttrString(p_module, "prof_on_contact_presence");
         python_check_error();
         if (p_function && PyCallable_Check(p_function)) {
@@ -807,7 +975,9 @@ python_on_chat_win_focus_hook(ProfPlugin* plugin, const char* const barejid)
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
-    if (PyObject_HasAttrString(p_module, "prof_on_chat_win_focus")) {
+    if (_python_queue_hook(p_module, "prof_on_chat_win_focus", p_args)) {
+        // runs on the worker thread
+    } else if (PyObject_HasAttrString(p_module, "prof_on_chat_win_focus")) {
         p_function = PyObject_GetAttrString(p_module, "prof_on_chat_win_focus");
         python_check_error();
         if (p_function && PyCallable_Check(p_function)) {
@@ -828,7 +998,9 @@ python_on_room_win_focus_hook(ProfPlugin* plugin, const char* const barejid)
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
-    if (PyObject_HasAttrString(p_module, "prof_on_room_win_focus")) {
+    if (_python_queue_hook(p_module, "prof_on_room_win_focus", p_args)) {
+        // runs on the worker thread
+    } else if (PyObject_HasAttrString(p_module, "prof_on_room_win_focus")) {
         p_function = PyObject_GetAttrString(p_module, "prof_on_room_win_focus");
         python_check_error();
         if (p_function && PyCallable_Check(p_function)) {
@@ -865,8 +1037,19 @@ python_plugin_destroy(ProfPlugin* plugin)
 void
 python_shutdown(void)
 {
+    if (python_jobs) {
+        // let queued jobs finish, they may need the lock for API calls
+        g_async_queue_push(python_jobs, &python_worker_stop);
+        pthread_mutex_unlock(&lock);
+        pthread_join(python_worker, NULL);
+        pthread_mutex_lock(&lock);
+        g_async_queue_unref(python_jobs);
+        python_jobs = NULL;
+    }
+
     disable_python_threads();
     g_hash_table_destroy(loaded_modules);
+    python_api_close();
     Py_Finalize();
 }
 
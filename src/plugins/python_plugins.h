@@ -43,6 +43,9 @@ void python_plugin_destroy(ProfPlugin* plugin);
 void python_check_error(void);
 void allow_python_threads();
 void disable_python_threads();
+void python_api_begin(void);
+void python_api_end(void);
+gboolean python_queue_callable(void* callable);
 
 const char* python_get_version_string(void);
 gchar* python_get_version_number(void);
@@ -45,10 +45,34 @@
 #include "config/theme.h"
 #include "config/files.h"
 #include "config/conflists.h"
+#include "config/persist.h"
+
+// plugins may change settings per message, writes are batched this long
+#define PLUGIN_SETTINGS_FLUSH_MS 5000
+
+typedef enum {
+    SETTING_MISSING,
+    SETTING_BOOLEAN,
+    SETTING_INT,
+    SETTING_STRING,
+    SETTING_STRING_LIST
+} setting_type_t;
+
+typedef struct setting_value_t
+{
+    setting_type_t type;
+    gboolean boolean;
+    int integer;
+    char* string;
+    gchar** list;
+} SettingValue;
 
 static GKeyFile* settings;
+// parsed values by "group\nkey", dropped when the key changes
+static GHashTable* cache;
 
 static void _save_settings(void);
+static void _settings_changed(const char* const group, const char* const key);
 
 void
 plugin_settings_init(void)
@@ -73,32 +97,106 @@ plugin_settings_init(void)
 void
 plugin_settings_close(void)
 {
+    persist_flush(_save_settings);
+    if (cache) {
+        g_hash_table_destroy(cache);
+        cache = NULL;
+    }
     g_key_file_free(settings);
     settings = NULL;
 }
 
+void
+plugin_settings_flush(void)
+{
+    persist_flush(_save_settings);
+}
+
+static void
+_setting_value_free(SettingValue* value)
+{
+    free(value->string);
+    g_strfreev(value->list);
+    g_free(value);
+}
+
+static char*
+_setting_cache_key(const char* const group, const char* const key)
+{
+    return g_strdup_printf("%s\n%s", group, key);
+}
+
+// the cached value of group/key, read from the keyfile if it is not cached
+// as type yet
+static SettingValue*
+_setting_lookup(const char* const group, const char* const key, setting_type_t type)
+{
+    if (!cache) {
+        cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_setting_value_free);
+    }
+
+    char* cache_key = _setting_cache_key(group, key);
+    SettingValue* value = g_hash_table_lookup(cache, cache_key);
+    if (value && (value->type == type || value->type == SETTING_MISSING)) {
+        g_free(cache_key);
+        return value;
+    }
+
+    value = g_new0(SettingValue, 1);
+    if (!g_key_file_has_key(settings, group, key, NULL)) {
+        value->type = SETTING_MISSING;
+    } else {
+        value->type = type;
+        switch (type) {
+        case SETTING_BOOLEAN:
+            value->boolean = g_key_file_get_boolean(settings, group, key, NULL);
+            break;
+        case SETTING_INT:
+            value->integer = g_key_file_get_integer(settings, group, key, NULL);
+            break;
+        case SETTING_STRING:
+            value->string = g_key_file_get_string(settings, group, key, NULL);
+            break;
+        case SETTING_STRING_LIST:
+            value->list = g_key_file_get_string_list(settings, group, key, NULL, NULL);
+            break;
+        default:
+            break;
+        }
+    }
+    g_hash_table_replace(cache, cache_key, value);
+
+    return value;
+}
+
 gboolean
 plugin_settings_boolean_get(const char* const group, const char* const key, gboolean def)
 {
-    if (group && key && g_key_file_has_key(settings, group, key, NULL)) {
-        return g_key_file_get_boolean(settings, group, key, NULL);
-    } else {
+    if (!group || !key) {
         return def;
     }
+
+    SettingValue* value = _setting_lookup(group, key, SETTING_BOOLEAN);
+    return value->type == SETTING_MISSING ? def : value->boolean;
 }
 
 void
 plugin_settings_boolean_set(const char* const group, const char* const key, gboolean value)
 {
     g_key_file_set_boolean(settings, group, key, value);
-    _save_settings();
+    _settings_changed(group, key);
 }
 
 char*
 plugin_settings_string_get(const char* const group, const char* const key, const char* const def)
 {
-    if (group && key && g_key_file_has_key(settings, group, key, NULL)) {
-        return g_key_file_get_string(settings, group, key, NULL);
+    SettingValue* value = NULL;
+    if (group && key) {
+        value = _setting_lookup(group, key, SETTING_STRING);
+    }
+
+    if (value && value->type != SETTING_MISSING) {
+        return value->string ? strdup(value->string) : NULL;
     } else if (def) {
         return strdup(def);
     } else {
@@ -110,41 +208,40 @@ void
 plugin_settings_string_set(const char* const group, const char* const key, const char* const value)
 {
     g_key_file_set_string(settings, group, key, value);
-    _save_settings();
+    _settings_changed(group, key);
 }
 
 int
 plugin_settings_int_get(const char* const group, const char* const key, int def)
 {
-    if (group && key && g_key_file_has_key(settings, group, key, NULL)) {
-        return g_key_file_get_integer(settings, group, key, NULL);
-    } else {
+    if (!group || !key) {
         return def;
     }
+
+    SettingValue* value = _setting_lookup(group, key, SETTING_INT);
+    return value->type == SETTING_MISSING ? def : value->integer;
 }
 
 void
 plugin_settings_int_set(const char* const group, const char* const key, int value)
 {
     g_key_file_set_integer(settings, group, key, value);
-    _save_settings();
+    _settings_changed(group, key);
 }
 
 gchar**
 plugin_settings_string_list_get(const char* const group, const char* const key)
 {
-    if (!g_key_file_has_key(settings, group, key, NULL)) {
-        return NULL;
-    }
+    SettingValue* value = _setting_lookup(group, key, SETTING_STRING_LIST);
 
-    return g_key_file_get_string_list(settings, group, key, NULL, NULL);
+    return value->type == SETTING_MISSING ? NULL : g_strdupv(value->list);
 }
 
 int
 plugin_settings_string_list_add(const char* const group, const char* const key, const char* const value)
 {
     int res = conf_string_list_add(settings, group, key, value);
-    _save_settings();
+    _settings_changed(group, key);
 
     return res;
 }
@@ -153,7 +250,7 @@ int
 plugin_settings_string_list_remove(const char* const group, const char* const key, const char* const value)
 {
     int res = conf_string_list_remove(settings, group, key, value);
-    _save_settings();
+    _settings_changed(group, key);
 
     return res;
 }
@@ -166,11 +263,23 @@ plugin_settings_string_list_clear(const char* const group, const char* const key
     }
 
     g_key_file_remove_key(settings, group, key, NULL);
-    _save_settings();
+    _settings_changed(group, key);
 
     return 1;
 }
 
+static void
+_settings_changed(const char* const group, const char* const key)
+{
+    if (cache) {
+        char* cache_key = _setting_cache_key(group, key);
+        g_hash_table_remove(cache, cache_key);
+        g_free(cache_key);
+    }
+
+    persist_request_delayed("plugin_settings", _save_settings, PLUGIN_SETTINGS_FLUSH_MS);
+}
+
 static void
 _save_settings(void)
 {
@@ -49,5 +49,6 @@ char** plugin_settings_string_list_get(const char* const group, const char* cons
 void plugin_settings_string_list_add(const char* const group, const char* const key, const char* const value);
 int plugin_settings_string_list_remove(const char* const group, const char* const key, const char* const value);
 int plugin_settings_string_list_clear(const char* const group, const char* const key);
+void plugin_settings_flush(void);
 
 #endif
@@ -53,18 +53,31 @@
 #include "profanity.h"
 #include "common.h"
 #include "log.h"
+#include "database.h"
 #include "config/files.h"
 #include "config/tlscerts.h"
 #include "config/accounts.h"
 #include "config/preferences.h"
+#include "config/persist.h"
 #include "config/theme.h"
 #include "config/tlscerts.h"
 #include "config/scripts.h"
 #include "command/cmd_defs.h"
 #include "plugins/plugins.h"
+#include "tools/external.h"
+#include "tools/http_common.h"
+#include "tools/http_transfer.h"
+#include "tools/http_upload.h"
+#include "tools/memtrim.h"
+#include "tools/perf.h"
+#include "tools/profiler.h"
+#include "tools/ratelimit.h"
+#include "tools/scheduler.h"
+#include "tools/workers.h"
 #include "event/client_events.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
+#include "ui/relay.h"
 #include "xmpp/resource.h"
 #include "xmpp/session.h"
 #include "xmpp/xmpp.h"
@@ -73,6 +86,8 @@
 #include "xmpp/chat_state.h"
 #include "xmpp/contact.h"
 #include "xmpp/roster_list.h"
+#include "xmpp/avatar.h"
+#include "xmpp/recorder.h"
 
 #ifdef HAVE_LIBOTR
 #include "otr/otr.h"
@@ -86,21 +101,57 @@
 #include "omemo/omemo.h"
 #endif
 
-static void _init(char* log_level, char* config_file, char* log_file, char* theme_name);
+static void _init(char* log_level, char* config_file, char* log_file, gboolean binary_log, char* theme_name);
+static void _init_deferred(void);
+static gint64 _startup_step(const char* const name, gint64 started);
+static gint64 _deferred_step(const char* const name, gint64 started);
+static void _startup_report(void);
 static void _shutdown(void);
 static void _connect_default(const char* const account);
 
 pthread_mutex_t lock;
 static gboolean force_quit = FALSE;
 
+typedef struct startup_step_t
+{
+    const char* name;
+    gint64 elapsed_us;
+} StartupStep;
+
+static GArray* startup_steps = NULL;
+static gboolean startup_profile = FALSE;
+
 void
-prof_run(char* log_level, char* account_name, char* config_file, char* log_file, char* theme_name)
+prof_run(char* log_level, char* account_name, char* config_file, char* log_file, gboolean binary_log, char* theme_name, gboolean profile, gboolean headless, gboolean relay)
 {
     gboolean cont = TRUE;
 
-    _init(log_level, config_file, log_file, theme_name);
-    plugins_on_start();
+    startup_profile = profile;
+    ui_set_headless(headless);
+    startup_steps = g_array_new(FALSE, FALSE, sizeof(StartupStep));
+
+    _init(log_level, config_file, log_file, binary_log, theme_name);
+
+    // draw the first frame before starting the optional subsystems
+    gint64 step = g_get_monotonic_time();
+    ui_update();
+    _startup_step("first frame", step);
+
+    // the connection resolves and connects while the rest starts up, it
+    // can not log in before the main loop handles its events, by when
+    // everything the login needs is in place
+    step = g_get_monotonic_time();
     _connect_default(account_name);
+    _startup_step("connect", step);
+
+    _init_deferred();
+    if (relay && !relay_start()) {
+        log_error("Relay could not be started");
+    }
+    step = g_get_monotonic_time();
+    plugins_on_start();
+    _startup_step("plugins start", step);
+    _startup_report();
 
     ui_update();
 
@@ -111,29 +162,29 @@ prof_run(char* log_level, char* account_name, char* config_file, char* log_file,
     char* line = NULL;
     while (cont && !force_quit) {
         log_stderr_handler();
-        session_check_autoaway();
 
         line = inp_readline();
         if (line) {
             ProfWin* window = wins_get_current();
+            gint64 started = perf_start();
             cont = cmd_process_input(window, line);
+            perf_stop(PERF_INPUT, started);
             free(line);
             line = NULL;
         } else {
             cont = TRUE;
         }
 
-#ifdef HAVE_LIBOTR
-        otr_poll();
+        scheduler_run();
+        http_upload_queue_check();
+        http_progress_check();
+        chat_log_flush_check();
+        log_database_reads_check();
+#ifdef HAVE_OMEMO
+        omemo_keyfiles_flush_check();
 #endif
-        plugins_run_timed();
-        notify_remind();
         session_process_events();
-        iq_autoping_check();
         ui_update();
-#ifdef HAVE_GTK
-        tray_update();
-#endif
     }
 }
 
@@ -159,7 +210,7 @@ _connect_default(const char* const account)
 }
 
 static void
-_init(char* log_level, char* config_file, char* log_file, char* theme_name)
+_init(char* log_level, char* config_file, char* log_file, gboolean binary_log, char* theme_name)
 {
     setlocale(LC_ALL, "");
     // ignore SIGPIPE
@@ -171,13 +222,16 @@ _init(char* log_level, char* config_file, char* log_file, char* theme_name)
         log_error("Mutex init failed");
         exit(1);
     }
+    scheduler_init();
 
     pthread_mutex_lock(&lock);
+    gint64 step = g_get_monotonic_time();
     files_create_directories();
     log_level_t prof_log_level = log_level_from_string(log_level);
     prefs_load(config_file);
-    log_init(prof_log_level, log_file);
+    log_init(prof_log_level, log_file, binary_log);
     log_stderr_init(PROF_LEVEL_ERROR);
+    step = _startup_step("prefs", step);
 
     if (strcmp(PACKAGE_STATUS, "development") == 0) {
 #ifdef HAVE_GIT_VERSION
@@ -192,6 +246,7 @@ _init(char* log_level, char* config_file, char* log_file, char* theme_name)
     chat_log_init();
     groupchat_log_init();
     accounts_load();
+    step = _startup_step("accounts", step);
 
     if (theme_name) {
         theme_init(theme_name);
@@ -200,30 +255,94 @@ _init(char* log_level, char* config_file, char* log_file, char* theme_name)
         theme_init(theme);
         g_free(theme);
     }
+    step = _startup_step("theme", step);
 
     ui_init();
     session_init();
+    step = _startup_step("ui", step);
     cmd_init();
+    step = _startup_step("commands", step);
     log_info("Initialising contact list");
     muc_init();
+    muc_set_light_threshold(prefs_get_occupants_light());
     tlscerts_init();
+    http_transfer_init();
     scripts_init();
+    step = _startup_step("tlscerts, scripts", step);
+    atexit(_shutdown);
+    inp_nonblocking(TRUE);
+    ui_resize();
+    _startup_step("resize", step);
+}
+
+// Starts the subsystems the first frame does not need, they are all in
+// place before the connection logs in or a command runs
+static void
+_init_deferred(void)
+{
+    gint64 step = g_get_monotonic_time();
 #ifdef HAVE_LIBOTR
     otr_init();
+    step = _deferred_step("otr", step);
 #endif
 #ifdef HAVE_LIBGPGME
     p_gpg_init();
+    step = _deferred_step("pgp", step);
 #endif
 #ifdef HAVE_OMEMO
     omemo_init();
+    step = _deferred_step("omemo", step);
 #endif
-    atexit(_shutdown);
     plugins_init();
+    step = _deferred_step("plugins", step);
+    memtrim_init();
 #ifdef HAVE_GTK
     tray_init();
+    step = _deferred_step("tray", step);
 #endif
-    inp_nonblocking(TRUE);
-    ui_resize();
+}
+
+// Runs the due tasks between the deferred steps, so a resolved address is
+// handed to the connection without waiting for the main loop
+static gint64
+_deferred_step(const char* const name, gint64 started)
+{
+    scheduler_run();
+
+    return _startup_step(name, started);
+}
+
+static gint64
+_startup_step(const char* const name, gint64 started)
+{
+    gint64 now = g_get_monotonic_time();
+    StartupStep entry = { name, now - started };
+    g_array_append_val(startup_steps, entry);
+
+    return now;
+}
+
+static void
+_startup_report(void)
+{
+    gint64 total = 0;
+    for (guint i = 0; i < startup_steps->len; i++) {
+        total += g_array_index(startup_steps, StartupStep, i).elapsed_us;
+    }
+    log_info("Started in %" G_GINT64_FORMAT " ms", total / 1000);
+
+    if (startup_profile) {
+        cons_show("Startup profile:");
+        for (guint i = 0; i < startup_steps->len; i++) {
+            StartupStep* entry = &g_array_index(startup_steps, StartupStep, i);
+            log_info("Startup %s: %" G_GINT64_FORMAT " us", entry->name, entry->elapsed_us);
+            cons_show("  %-18s %8.1f ms", entry->name, entry->elapsed_us / 1000.0);
+        }
+        cons_show("  %-18s %8.1f ms", "total", total / 1000.0);
+    }
+
+    g_array_free(startup_steps, TRUE);
+    startup_steps = NULL;
 }
 
 static void
@@ -246,8 +365,13 @@ _shutdown(void)
 #endif
     session_shutdown();
     plugins_on_shutdown();
+    http_transfer_close();
+    workers_close();
+    external_close();
+    relay_stop();
     muc_close();
     caps_close();
+    avatar_close();
 #ifdef HAVE_LIBOTR
     otr_shutdown();
 #endif
@@ -267,4 +391,11 @@ _shutdown(void)
     cmd_uninit();
     ui_close();
     prefs_close();
+    persist_close();
+    recorder_stop();
+    profiler_close();
+    perf_close();
+    memtrim_close();
+    ratelimit_close();
+    scheduler_close();
 }
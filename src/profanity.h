@@ -40,7 +40,7 @@
 #include <pthread.h>
 #include <glib.h>
 
-void prof_run(char* log_level, char* account_name, char* config_file, char* log_file, char* theme_name);
+void prof_run(char* log_level, char* account_name, char* config_file, char* log_file, gboolean binary_log, char* theme_name, gboolean profile, gboolean headless, gboolean relay);
 void prof_set_quit(void);
 
 extern pthread_mutex_t lock;
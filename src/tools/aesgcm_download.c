@@ -51,6 +51,7 @@
 #include "event/client_events.h"
 #include "tools/http_common.h"
 #include "tools/aesgcm_download.h"
+#include "tools/scheduler.h"
 #include "omemo/omemo.h"
 #include "config/preferences.h"
 #include "ui/ui.h"
@@ -59,6 +60,37 @@
 
 #define FALLBACK_MSG ""
 
+#define AESGCM_DECRYPT_BUFFER_SIZE (64 * 1024)
+
+// The wrapped download is registered for cancelling on the main loop,
+// before its own events
+static void
+_aesgcm_download_add(void* data)
+{
+    http_download_add_download(data);
+}
+
+// Passes a downloaded ciphertext through the decrypting stream, a missing or
+// incomplete file fails the stream on finishing as its tag does not match
+static void
+_aesgcm_decrypt_file(const char* const path, OmemoFileStream* stream)
+{
+    FILE* infh = fopen(path, "rb");
+    if (infh == NULL) {
+        return;
+    }
+
+    char buffer[AESGCM_DECRYPT_BUFFER_SIZE];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), infh)) > 0) {
+        if (omemo_file_stream_write(buffer, 1, length, stream) != length) {
+            break;
+        }
+    }
+
+    fclose(infh);
+}
+
 void*
 aesgcm_file_get(void* userdata)
 {
@@ -70,80 +102,84 @@ aesgcm_file_get(void* userdata)
     // Convert the aesgcm:// URL to a https:// URL and extract the encoded key
     // and tag stored in the URL fragment.
     if (omemo_parse_aesgcm_url(aesgcm_dl->url, &https_url, &fragment) != 0) {
-        cons_show_error("Download failed: Cannot parse URL '%s'.", aesgcm_dl->url);
-        http_print_transfer_update(aesgcm_dl->window, aesgcm_dl->url,
-                                   "Download failed: Cannot parse URL '%s'.",
-                                   aesgcm_dl->url);
-        return NULL;
-    }
-
-    // Create a temporary file used for storing the ciphertext that is to be
-    // retrieved from the https:// URL.
-    gchar* tmpname = NULL;
-    gint tmpfd;
-    if ((tmpfd = g_file_open_tmp("profanity.XXXXXX", &tmpname, NULL)) == -1) {
-        http_print_transfer_update(aesgcm_dl->window, aesgcm_dl->url,
-                                   "Downloading '%s' failed: Unable to create "
-                                   "temporary ciphertext file for writing "
-                                   "(%s).",
-                                   https_url, g_strerror(errno));
+        http_post_error("Download failed: Cannot parse URL '%s'.", aesgcm_dl->url);
+        http_post_transfer_update(aesgcm_dl->window, aesgcm_dl->url,
+                                  "Download failed: Cannot parse URL '%s'.",
+                                  aesgcm_dl->url);
         return NULL;
     }
 
     // Open the target file for storing the cleartext.
     FILE* outfh = fopen(aesgcm_dl->filename, "wb");
     if (outfh == NULL) {
-        http_print_transfer_update(aesgcm_dl->window, aesgcm_dl->url,
-                                   "Downloading '%s' failed: Unable to open "
-                                   "output file at '%s' for writing (%s).",
-                                   https_url, aesgcm_dl->filename,
-                                   g_strerror(errno));
+        http_post_transfer_update(aesgcm_dl->window, aesgcm_dl->url,
+                                  "Downloading '%s' failed: Unable to open "
+                                  "output file at '%s' for writing (%s).",
+                                  https_url, aesgcm_dl->filename,
+                                  g_strerror(errno));
         return NULL;
     }
 
+    // The ciphertext is decrypted as it arrives and only the cleartext is
+    // written to the target file.
+    gcry_error_t crypt_res;
+    OmemoFileStream* stream = omemo_decrypt_file_stream(outfh, fragment, &crypt_res);
+    if (stream == NULL) {
+        http_post_transfer_update(aesgcm_dl->window, aesgcm_dl->url,
+                                  "Downloading '%s' failed: Failed to set up "
+                                  "decryption (%s).",
+                                  https_url, gcry_strerror(crypt_res));
+        fclose(outfh);
+        return NULL;
+    }
+
+    // A segmented download writes the parts of the ciphertext at their
+    // places in a file of its own, which is decrypted once complete.
+    gchar* cipher_path = aesgcm_dl->segmented ? g_strdup_printf("%s.part", aesgcm_dl->filename) : NULL;
+
     // We wrap the HTTPDownload tool and use it for retrieving the ciphertext
-    // and storing it in the temporary file previously opened.
+    // and passing it through the decrypting stream.
     HTTPDownload* http_dl = malloc(sizeof(HTTPDownload));
     http_dl->window = aesgcm_dl->window;
-    http_dl->worker = aesgcm_dl->worker;
     http_dl->url = strdup(https_url);
-    http_dl->filename = strdup(tmpname);
     http_dl->cmd_template = NULL;
+    http_dl->cert_path = g_strdup(aesgcm_dl->cert_path);
+    http_dl->segmented = aesgcm_dl->segmented;
+    if (cipher_path) {
+        http_dl->filename = strdup(cipher_path);
+        http_dl->write_func = NULL;
+        http_dl->write_data = NULL;
+    } else {
+        http_dl->filename = strdup(aesgcm_dl->filename);
+        http_dl->write_func = omemo_file_stream_write;
+        http_dl->write_data = stream;
+    }
     aesgcm_dl->http_dl = http_dl;
+    scheduler_post(_aesgcm_download_add, http_dl);
 
     http_file_get(http_dl); // TODO(wstrm): Verify result.
 
-    FILE* tmpfh = fopen(tmpname, "rb");
-    if (tmpfh == NULL) {
-        http_print_transfer_update(aesgcm_dl->window, aesgcm_dl->url,
-                                   "Downloading '%s' failed: Unable to open "
-                                   "temporary file at '%s' for reading (%s).",
-                                   aesgcm_dl->url, tmpname,
-                                   g_strerror(errno));
-        return NULL;
+    if (cipher_path) {
+        _aesgcm_decrypt_file(cipher_path, stream);
     }
 
-    gcry_error_t crypt_res;
-    crypt_res = omemo_decrypt_file(tmpfh, outfh,
-                                   http_dl->bytes_received, fragment);
+    crypt_res = omemo_file_stream_finish(stream);
+    omemo_file_stream_free(stream);
 
-    if (fclose(tmpfh) == EOF) {
-        cons_show_error(g_strerror(errno));
+    if (cipher_path) {
+        remove(cipher_path);
+        g_free(cipher_path);
     }
 
-    close(tmpfd);
-    remove(tmpname);
-    g_free(tmpname);
-
     if (crypt_res != GPG_ERR_NO_ERROR) {
-        http_print_transfer_update(aesgcm_dl->window, aesgcm_dl->url,
-                                   "Downloading '%s' failed: Failed to decrypt "
-                                   "file (%s).",
-                                   https_url, gcry_strerror(crypt_res));
+        http_post_transfer_update(aesgcm_dl->window, aesgcm_dl->url,
+                                  "Downloading '%s' failed: Failed to decrypt "
+                                  "file (%s).",
+                                  https_url, gcry_strerror(crypt_res));
     }
 
     if (fclose(outfh) == EOF) {
-        cons_show_error(g_strerror(errno));
+        http_post_error("%s", g_strerror(errno));
     }
 
     free(https_url);
@@ -156,13 +192,13 @@ aesgcm_file_get(void* userdata)
 
         // TODO: Log the error.
         if (!call_external(argv, NULL, NULL)) {
-            http_print_transfer_update(aesgcm_dl->window, aesgcm_dl->url,
-                                       "Downloading '%s' failed: Unable to call "
-                                       "command '%s' with file at '%s' (%s).",
-                                       aesgcm_dl->url,
-                                       aesgcm_dl->cmd_template,
-                                       aesgcm_dl->filename,
-                                       "TODO: Log the error");
+            http_post_transfer_update(aesgcm_dl->window, aesgcm_dl->url,
+                                      "Downloading '%s' failed: Unable to call "
+                                      "command '%s' with file at '%s' (%s).",
+                                      aesgcm_dl->url,
+                                      aesgcm_dl->cmd_template,
+                                      aesgcm_dl->filename,
+                                      "TODO: Log the error");
         }
 
         g_strfreev(argv);
@@ -171,19 +207,26 @@ aesgcm_file_get(void* userdata)
 
     free(aesgcm_dl->filename);
     free(aesgcm_dl->url);
+    g_free(aesgcm_dl->cert_path);
     free(aesgcm_dl);
 
     return NULL;
 }
 
+static void
+_aesgcm_download_job(WorkerJob* job, void* data)
+{
+    aesgcm_file_get(data);
+}
+
 void
-aesgcm_download_cancel_processes(ProfWin* window)
+aesgcm_download_start(AESGCMDownload* aesgcm_dl)
 {
-    http_download_cancel_processes(window);
+    workers_submit(http_download_workers(), NULL, _aesgcm_download_job, aesgcm_dl);
 }
 
 void
-aesgcm_download_add_download(AESGCMDownload* aesgcm_dl)
+aesgcm_download_cancel_processes(ProfWin* window)
 {
-    http_download_add_download(aesgcm_dl->http_dl);
+    http_download_cancel_processes(window);
 }
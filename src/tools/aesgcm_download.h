@@ -54,13 +54,16 @@ typedef struct aesgcm_download_t
     char* filename;
     char* cmd_template;
     ProfWin* window;
-    pthread_t worker;
+    // preferences as they were when the download was requested
+    char* cert_path;
+    gboolean segmented;
     HTTPDownload* http_dl;
 } AESGCMDownload;
 
 void* aesgcm_file_get(void* userdata);
+// Queues the download for a pool thread
+void aesgcm_download_start(AESGCMDownload* download);
 
 void aesgcm_download_cancel_processes(ProfWin* window);
-void aesgcm_download_add_download(AESGCMDownload* download);
 
 #endif
@@ -0,0 +1,172 @@
+/*
+ * arena.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/arena.h"
+
+#define ARENA_ALIGN sizeof(void*)
+
+typedef struct arena_block_t
+{
+    struct arena_block_t* next;
+    gsize size;
+    gsize used;
+    char data[];
+} ArenaBlock;
+
+struct arena_t
+{
+    // the block being filled, older ones follow its next pointer
+    ArenaBlock* blocks;
+    gsize block_size;
+    gsize used;
+};
+
+static ArenaBlock*
+_arena_block_new(gsize size)
+{
+    ArenaBlock* block = g_malloc(sizeof(ArenaBlock) + size);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+Arena*
+arena_new(gsize block_size)
+{
+    Arena* arena = g_new0(Arena, 1);
+    arena->block_size = block_size;
+    arena->blocks = _arena_block_new(block_size);
+
+    return arena;
+}
+
+void*
+arena_alloc(Arena* arena, gsize size)
+{
+    gsize aligned = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    ArenaBlock* block = arena->blocks;
+
+    if (block->used + aligned > block->size) {
+        // oversized requests get a block of their own behind the current one
+        if (aligned > arena->block_size / 4) {
+            ArenaBlock* large = _arena_block_new(aligned);
+            large->used = aligned;
+            large->next = block->next;
+            block->next = large;
+            arena->used += aligned;
+            return large->data;
+        }
+
+        block = _arena_block_new(arena->block_size);
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    void* result = block->data + block->used;
+    block->used += aligned;
+    arena->used += aligned;
+
+    return result;
+}
+
+char*
+arena_strdup(Arena* arena, const char* const str)
+{
+    if (str == NULL) {
+        return NULL;
+    }
+
+    gsize len = strlen(str) + 1;
+    char* result = arena_alloc(arena, len);
+    memcpy(result, str, len);
+
+    return result;
+}
+
+gsize
+arena_used(Arena* arena)
+{
+    return arena->used;
+}
+
+// keeps one block of the regular size so the next round needs no malloc
+void
+arena_reset(Arena* arena)
+{
+    ArenaBlock* keep = NULL;
+    ArenaBlock* block = arena->blocks;
+    while (block) {
+        ArenaBlock* next = block->next;
+        if (keep == NULL && block->size == arena->block_size) {
+            keep = block;
+        } else {
+            g_free(block);
+        }
+        block = next;
+    }
+
+    if (keep == NULL) {
+        keep = _arena_block_new(arena->block_size);
+    }
+    keep->next = NULL;
+    keep->used = 0;
+    arena->blocks = keep;
+    arena->used = 0;
+}
+
+void
+arena_free(Arena* arena)
+{
+    if (arena == NULL) {
+        return;
+    }
+
+    ArenaBlock* block = arena->blocks;
+    while (block) {
+        ArenaBlock* next = block->next;
+        g_free(block);
+        block = next;
+    }
+    g_free(arena);
+}
@@ -42,6 +42,7 @@
 
 #include "common.h"
 #include "tools/autocomplete.h"
+#include "tools/memusage.h"
 #include "tools/parser.h"
 #include "ui/ui.h"
 
@@ -50,23 +51,118 @@ typedef enum {
     NEXT
 } search_direction;
 
+// an item together with its ASCII-folded, lowercased key, folded once on add
+typedef struct ac_item_t
+{
+    gchar* value;
+    gchar* key;
+} AcItem;
+
 struct autocomplete_t
 {
-    GList* items;
-    GList* last_found;
+    // AcItem in completion order, sorted by value unless added with _reverse
+    GSequence* items;
+    // value -> GSequenceIter* in items, NULL while the item is pending
+    GHashTable* index;
+    // AcItem added unsorted, not in items until _ac_flush()
+    GPtrArray* pending;
+    GSequenceIter* last_found;
     gchar* search_str;
+    // every autocompleter alive, for the memory report
+    Autocomplete prev;
+    Autocomplete next;
 };
 
-static gchar* _search(Autocomplete ac, GList* curr, gboolean quote, search_direction direction);
+static Autocomplete instances = NULL;
+
+static gchar* _search(Autocomplete ac, GSequenceIter* curr, gboolean quote, search_direction direction);
+
+static gchar*
+_autocomplete_fold(const char* const str)
+{
+    gchar* str_ascii = g_str_to_ascii(str, NULL);
+    gchar* str_lower = g_ascii_strdown(str_ascii, -1);
+    g_free(str_ascii);
+
+    return str_lower;
+}
+
+static AcItem*
+_ac_item_new(const char* const value)
+{
+    AcItem* item = g_new(AcItem, 1);
+    item->value = g_strdup(value);
+    item->key = _autocomplete_fold(value);
+
+    return item;
+}
+
+static void
+_ac_item_free(AcItem* item)
+{
+    if (item) {
+        g_free(item->value);
+        g_free(item->key);
+        g_free(item);
+    }
+}
+
+static gint
+_ac_item_cmp(gconstpointer a, gconstpointer b, gpointer data)
+{
+    return strcmp(((const AcItem*)a)->value, ((const AcItem*)b)->value);
+}
+
+static gint
+_ac_pending_cmp(gconstpointer a, gconstpointer b)
+{
+    return _ac_item_cmp(*(AcItem* const*)a, *(AcItem* const*)b, NULL);
+}
+
+// Moves the pending items into the sequence, sorted once and appended when
+// they are all there is
+static void
+_ac_flush(Autocomplete ac)
+{
+    if (!ac->pending) {
+        return;
+    }
+
+    GPtrArray* pending = ac->pending;
+    ac->pending = NULL;
+
+    if (g_sequence_is_empty(ac->items)) {
+        g_ptr_array_sort(pending, _ac_pending_cmp);
+        for (guint i = 0; i < pending->len; i++) {
+            AcItem* item = g_ptr_array_index(pending, i);
+            g_hash_table_insert(ac->index, item->value, g_sequence_append(ac->items, item));
+        }
+    } else {
+        for (guint i = 0; i < pending->len; i++) {
+            AcItem* item = g_ptr_array_index(pending, i);
+            g_hash_table_insert(ac->index, item->value, g_sequence_insert_sorted(ac->items, item, _ac_item_cmp, NULL));
+        }
+    }
+    g_ptr_array_free(pending, TRUE);
+}
 
 Autocomplete
 autocomplete_new(void)
 {
     Autocomplete new = malloc(sizeof(struct autocomplete_t));
-    new->items = NULL;
+    new->items = g_sequence_new((GDestroyNotify)_ac_item_free);
+    new->index = g_hash_table_new(g_str_hash, g_str_equal);
+    new->pending = NULL;
     new->last_found = NULL;
     new->search_str = NULL;
 
+    new->prev = NULL;
+    new->next = instances;
+    if (instances) {
+        instances->prev = new;
+    }
+    instances = new;
+
     return new;
 }
 
@@ -74,10 +170,13 @@ void
 autocomplete_clear(Autocomplete ac)
 {
     if (ac) {
-        if (ac->items) {
-            g_list_free_full(ac->items, free);
-            ac->items = NULL;
+        g_hash_table_remove_all(ac->index);
+        if (ac->pending) {
+            g_ptr_array_foreach(ac->pending, (GFunc)_ac_item_free, NULL);
+            g_ptr_array_free(ac->pending, TRUE);
+            ac->pending = NULL;
         }
+        g_sequence_remove_range(g_sequence_get_begin_iter(ac->items), g_sequence_get_end_iter(ac->items));
 
         autocomplete_reset(ac);
     }
@@ -95,19 +194,60 @@ autocomplete_free(Autocomplete ac)
 {
     if (ac) {
         autocomplete_clear(ac);
+        g_hash_table_destroy(ac->index);
+        g_sequence_free(ac->items);
+
+        if (ac->prev) {
+            ac->prev->next = ac->next;
+        } else {
+            instances = ac->next;
+        }
+        if (ac->next) {
+            ac->next->prev = ac->prev;
+        }
         free(ac);
     }
 }
 
+// Rough heap use of an autocompleter with its items
+gsize
+autocomplete_memory(Autocomplete ac)
+{
+    _ac_flush(ac);
+
+    gsize total = memusage_alloc(sizeof(struct autocomplete_t));
+    total += memusage_sequence(ac->items) + memusage_hash_table(ac->index) + memusage_string(ac->search_str);
+
+    GSequenceIter* curr = g_sequence_get_begin_iter(ac->items);
+    while (!g_sequence_iter_is_end(curr)) {
+        AcItem* item = g_sequence_get(curr);
+        total += memusage_alloc(sizeof(AcItem)) + memusage_string(item->value) + memusage_string(item->key);
+        curr = g_sequence_iter_next(curr);
+    }
+
+    return total;
+}
+
+gsize
+autocomplete_memory_all(guint* count)
+{
+    gsize total = 0;
+    *count = 0;
+    for (Autocomplete ac = instances; ac; ac = ac->next) {
+        total += autocomplete_memory(ac);
+        (*count)++;
+    }
+
+    return total;
+}
+
 gint
 autocomplete_length(Autocomplete ac)
 {
     if (!ac) {
         return 0;
-    } else if (!ac->items) {
-        return 0;
     } else {
-        return g_list_length(ac->items);
+        return g_hash_table_size(ac->index);
     }
 }
 
@@ -117,8 +257,9 @@ autocomplete_update(Autocomplete ac, char** items)
     gchar* last_found = NULL;
     gchar* search_str = NULL;
 
+    _ac_flush(ac);
     if (ac->last_found) {
-        last_found = strdup(ac->last_found->data);
+        last_found = strdup(((AcItem*)g_sequence_get(ac->last_found))->value);
     }
 
     if (ac->search_str) {
@@ -130,7 +271,7 @@ autocomplete_update(Autocomplete ac, char** items)
 
     if (last_found) {
         // NULL if last_found was removed on update.
-        ac->last_found = g_list_find_custom(ac->items, last_found, (GCompareFunc)strcmp);
+        ac->last_found = g_hash_table_lookup(ac->index, last_found);
         free(last_found);
     }
 
@@ -144,16 +285,15 @@ void
 autocomplete_add_reverse(Autocomplete ac, const char* item)
 {
     if (ac) {
-        char* item_cpy;
-        GList* curr = g_list_find_custom(ac->items, item, (GCompareFunc)strcmp);
-
         // if item already exists
-        if (curr) {
+        if (g_hash_table_contains(ac->index, item)) {
             return;
         }
+        _ac_flush(ac);
 
-        item_cpy = strdup(item);
-        ac->items = g_list_prepend(ac->items, item_cpy);
+        AcItem* new_item = _ac_item_new(item);
+        GSequenceIter* iter = g_sequence_prepend(ac->items, new_item);
+        g_hash_table_insert(ac->index, new_item->value, iter);
     }
 }
 
@@ -161,16 +301,40 @@ void
 autocomplete_add(Autocomplete ac, const char* item)
 {
     if (ac) {
-        char* item_cpy;
-        GList* curr = g_list_find_custom(ac->items, item, (GCompareFunc)strcmp);
+        // if item already exists
+        if (g_hash_table_contains(ac->index, item)) {
+            return;
+        }
 
+        AcItem* new_item = _ac_item_new(item);
+        GSequenceIter* iter = g_sequence_insert_sorted(ac->items, new_item, _ac_item_cmp, NULL);
+        g_hash_table_insert(ac->index, new_item->value, iter);
+    }
+}
+
+void
+autocomplete_add_unsorted(Autocomplete ac, const char* item)
+{
+    if (ac) {
         // if item already exists
-        if (curr) {
+        if (g_hash_table_contains(ac->index, item)) {
             return;
         }
 
-        item_cpy = strdup(item);
-        ac->items = g_list_insert_sorted(ac->items, item_cpy, (GCompareFunc)strcmp);
+        if (!ac->pending) {
+            ac->pending = g_ptr_array_new();
+        }
+        AcItem* new_item = _ac_item_new(item);
+        g_ptr_array_add(ac->pending, new_item);
+        g_hash_table_insert(ac->index, new_item->value, NULL);
+    }
+}
+
+void
+autocomplete_sort(Autocomplete ac)
+{
+    if (ac) {
+        _ac_flush(ac);
     }
 }
 
@@ -186,7 +350,8 @@ void
 autocomplete_remove(Autocomplete ac, const char* const item)
 {
     if (ac) {
-        GList* curr = g_list_find_custom(ac->items, item, (GCompareFunc)strcmp);
+        _ac_flush(ac);
+        GSequenceIter* curr = g_hash_table_lookup(ac->index, item);
 
         if (!curr) {
             return;
@@ -197,8 +362,8 @@ autocomplete_remove(Autocomplete ac, const char* const item)
             ac->last_found = NULL;
         }
 
-        free(curr->data);
-        ac->items = g_list_delete_link(ac->items, curr);
+        g_hash_table_remove(ac->index, item);
+        g_sequence_remove(curr);
     }
 
     return;
@@ -215,30 +380,23 @@ autocomplete_remove_all(Autocomplete ac, char** items)
 GList*
 autocomplete_create_list(Autocomplete ac)
 {
+    _ac_flush(ac);
+
     GList* copy = NULL;
-    GList* curr = ac->items;
+    GSequenceIter* curr = g_sequence_get_begin_iter(ac->items);
 
-    while (curr) {
-        copy = g_list_append(copy, strdup(curr->data));
-        curr = g_list_next(curr);
+    while (!g_sequence_iter_is_end(curr)) {
+        copy = g_list_prepend(copy, strdup(((AcItem*)g_sequence_get(curr))->value));
+        curr = g_sequence_iter_next(curr);
     }
 
-    return copy;
+    return g_list_reverse(copy);
 }
 
 gboolean
 autocomplete_contains(Autocomplete ac, const char* value)
 {
-    GList* curr = ac->items;
-
-    while (curr) {
-        if (strcmp(curr->data, value) == 0) {
-            return TRUE;
-        }
-        curr = g_list_next(curr);
-    }
-
-    return FALSE;
+    return g_hash_table_contains(ac->index, value);
 }
 
 gchar*
@@ -250,9 +408,10 @@ autocomplete_complete(Autocomplete ac, const gchar* search_str, gboolean quote,
     if (!ac) {
         return NULL;
     }
+    _ac_flush(ac);
 
     // no items to search
-    if (!ac->items) {
+    if (g_sequence_is_empty(ac->items)) {
         return NULL;
     }
 
@@ -263,7 +422,7 @@ autocomplete_complete(Autocomplete ac, const gchar* search_str, gboolean quote,
         }
 
         ac->search_str = strdup(search_str);
-        found = _search(ac, ac->items, quote, NEXT);
+        found = _search(ac, g_sequence_get_begin_iter(ac->items), quote, NEXT);
 
         return found;
 
@@ -271,13 +430,15 @@ autocomplete_complete(Autocomplete ac, const gchar* search_str, gboolean quote,
     } else {
         if (previous) {
             // search from here-1 to beginning
-            found = _search(ac, g_list_previous(ac->last_found), quote, PREVIOUS);
-            if (found) {
-                return found;
+            if (!g_sequence_iter_is_begin(ac->last_found)) {
+                found = _search(ac, g_sequence_iter_prev(ac->last_found), quote, PREVIOUS);
+                if (found) {
+                    return found;
+                }
             }
         } else {
             // search from here+1 to end
-            found = _search(ac, g_list_next(ac->last_found), quote, NEXT);
+            found = _search(ac, g_sequence_iter_next(ac->last_found), quote, NEXT);
             if (found) {
                 return found;
             }
@@ -285,13 +446,13 @@ autocomplete_complete(Autocomplete ac, const gchar* search_str, gboolean quote,
 
         if (previous) {
             // search from end
-            found = _search(ac, g_list_last(ac->items), quote, PREVIOUS);
+            found = _search(ac, g_sequence_iter_prev(g_sequence_get_end_iter(ac->items)), quote, PREVIOUS);
             if (found) {
                 return found;
             }
         } else {
             // search from beginning
-            found = _search(ac, ac->items, quote, NEXT);
+            found = _search(ac, g_sequence_get_begin_iter(ac->items), quote, NEXT);
             if (found) {
                 return found;
             }
@@ -407,59 +568,56 @@ void
 autocomplete_remove_older_than_max_reverse(Autocomplete ac, int maxsize)
 {
     if (autocomplete_length(ac) > maxsize) {
-        GList* last = g_list_last(ac->items);
-        if (last) {
-            free(last->data);
-            ac->items = g_list_delete_link(ac->items, last);
+        _ac_flush(ac);
+        GSequenceIter* last = g_sequence_iter_prev(g_sequence_get_end_iter(ac->items));
+        if (ac->last_found == last) {
+            ac->last_found = NULL;
         }
+        g_hash_table_remove(ac->index, ((AcItem*)g_sequence_get(last))->value);
+        g_sequence_remove(last);
     }
 }
 
 static gchar*
-_search(Autocomplete ac, GList* curr, gboolean quote, search_direction direction)
+_search(Autocomplete ac, GSequenceIter* curr, gboolean quote, search_direction direction)
 {
-    gchar* search_str_ascii = g_str_to_ascii(ac->search_str, NULL);
-    gchar* search_str_lower = g_ascii_strdown(search_str_ascii, -1);
-    g_free(search_str_ascii);
+    gchar* search_str_lower = _autocomplete_fold(ac->search_str);
+    size_t search_len = strlen(search_str_lower);
 
-    while (curr) {
-        gchar* curr_ascii = g_str_to_ascii(curr->data, NULL);
-        gchar* curr_lower = g_ascii_strdown(curr_ascii, -1);
-        g_free(curr_ascii);
+    while (!g_sequence_iter_is_end(curr)) {
+        AcItem* item = g_sequence_get(curr);
 
         // match found
-        if (strncmp(curr_lower, search_str_lower, strlen(search_str_lower)) == 0) {
+        if (strncmp(item->key, search_str_lower, search_len) == 0) {
+            g_free(search_str_lower);
 
             // set pointer to last found
             ac->last_found = curr;
 
             // if contains space, quote before returning
-            if (quote && g_strrstr(curr->data, " ")) {
+            if (quote && g_strrstr(item->value, " ")) {
                 GString* quoted = g_string_new("\"");
-                g_string_append(quoted, curr->data);
+                g_string_append(quoted, item->value);
                 g_string_append(quoted, "\"");
 
                 gchar* result = quoted->str;
                 g_string_free(quoted, FALSE);
 
-                g_free(search_str_lower);
-                g_free(curr_lower);
                 return result;
 
                 // otherwise just return the string
             } else {
-                g_free(search_str_lower);
-                g_free(curr_lower);
-                return strdup(curr->data);
+                return strdup(item->value);
             }
         }
 
-        g_free(curr_lower);
-
         if (direction == PREVIOUS) {
-            curr = g_list_previous(curr);
+            if (g_sequence_iter_is_begin(curr)) {
+                break;
+            }
+            curr = g_sequence_iter_prev(curr);
         } else {
-            curr = g_list_next(curr);
+            curr = g_sequence_iter_next(curr);
         }
     }
 
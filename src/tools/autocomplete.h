@@ -50,6 +50,10 @@ void autocomplete_clear(Autocomplete ac);
 // free all memory used by the autocompleter
 void autocomplete_free(Autocomplete ac);
 
+// rough heap use of one and of all autocompleters alive, count is how many
+gsize autocomplete_memory(Autocomplete ac);
+gsize autocomplete_memory_all(guint* count);
+
 void autocomplete_add(Autocomplete ac, const char* item);
 void autocomplete_add_all(Autocomplete ac, char** items);
 void autocomplete_update(Autocomplete ac, char** items);
@@ -57,6 +61,11 @@ void autocomplete_remove(Autocomplete ac, const char* const item);
 void autocomplete_remove_all(Autocomplete ac, char** items);
 void autocomplete_add_reverse(Autocomplete ac, const char* item);
 
+// Add without keeping the order, for loading many items at once. They are
+// sorted in one go by autocomplete_sort(), or else by the next lookup.
+void autocomplete_add_unsorted(Autocomplete ac, const char* item);
+void autocomplete_sort(Autocomplete ac);
+
 // find the next item prefixed with search string
 gchar* autocomplete_complete(Autocomplete ac, const gchar* search_str, gboolean quote, gboolean previous);
 
@@ -40,6 +40,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "config/files.h"
+#include "config/persist.h"
 #include "config/preferences.h"
 
 #include "log.h"
@@ -65,7 +66,7 @@ _bookmark_ignore_load()
 }
 
 static void
-_bookmark_save()
+_bookmark_write(void)
 {
     gsize g_data_size;
     gchar* g_bookmark_ignore_data = g_key_file_to_data(bookmark_ignore_keyfile, &g_data_size, NULL);
@@ -80,6 +81,12 @@ _bookmark_save()
     g_free(g_bookmark_ignore_data);
 }
 
+static void
+_bookmark_save()
+{
+    persist_request("bookmark_ignore", _bookmark_write);
+}
+
 void
 bookmark_ignore_on_connect(const char* const barejid)
 {
@@ -92,6 +99,7 @@ bookmark_ignore_on_connect(const char* const barejid)
 void
 bookmark_ignore_on_disconnect()
 {
+    persist_flush(_bookmark_write);
     g_key_file_free(bookmark_ignore_keyfile);
     bookmark_ignore_keyfile = NULL;
     g_free(account_jid);
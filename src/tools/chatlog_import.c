@@ -0,0 +1,244 @@
+/*
+ * chatlog_import.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/chatlog_import.h"
+
+// "HH:MM:SS - " in front of every logged message
+#define CHATLOG_PREFIX_LEN 11
+
+static gboolean
+_parse_date(const char* const name, ChatlogFile* file)
+{
+    if (strlen(name) != strlen("2020_01_31.log") || !g_str_has_suffix(name, ".log")) {
+        return FALSE;
+    }
+    for (int i = 0; i < 10; i++) {
+        if ((i == 4 || i == 7) ? name[i] != '_' : !g_ascii_isdigit(name[i])) {
+            return FALSE;
+        }
+    }
+
+    file->year = atoi(name);
+    file->month = atoi(name + 5);
+    file->day = atoi(name + 8);
+
+    return file->month >= 1 && file->month <= 12 && file->day >= 1 && file->day <= 31;
+}
+
+ChatlogFile*
+chatlog_import_parse_path(const char* const relpath)
+{
+    gchar** parts = g_strsplit(relpath, "/", 0);
+    guint count = g_strv_length(parts);
+    gboolean room = count == 3 && g_strcmp0(parts[0], "rooms") == 0;
+    if (count != 2 && !room) {
+        g_strfreev(parts);
+        return NULL;
+    }
+
+    ChatlogFile* file = g_new0(ChatlogFile, 1);
+    file->room = room;
+    if (!_parse_date(parts[count - 1], file)) {
+        g_strfreev(parts);
+        chatlog_import_file_free(file);
+        return NULL;
+    }
+
+    // the directory is the jid with "@" written as "_at_", private chats
+    // in a room have "_<nick>" after it
+    const char* dir = parts[count - 2];
+    const char* at = strstr(dir, "_at_");
+    const char* domain = at ? at + strlen("_at_") : dir;
+    gchar* domainpart;
+    const char* underscore = room ? NULL : strchr(domain, '_');
+    if (underscore) {
+        domainpart = g_strndup(domain, underscore - domain);
+        if (underscore[1] != '\0') {
+            file->resource = g_strdup(underscore + 1);
+        }
+    } else {
+        domainpart = g_strdup(domain);
+    }
+
+    if (domainpart[0] == '\0' || (at && at == dir)) {
+        g_free(domainpart);
+        g_strfreev(parts);
+        chatlog_import_file_free(file);
+        return NULL;
+    }
+
+    if (at) {
+        gchar* localpart = g_strndup(dir, at - dir);
+        file->contact = g_strdup_printf("%s@%s", localpart, domainpart);
+        g_free(localpart);
+        g_free(domainpart);
+    } else {
+        file->contact = domainpart;
+    }
+
+    g_strfreev(parts);
+    return file;
+}
+
+void
+chatlog_import_file_free(ChatlogFile* file)
+{
+    if (file) {
+        g_free(file->contact);
+        g_free(file->resource);
+        g_free(file);
+    }
+}
+
+static gboolean
+_has_prefix(const char* const line)
+{
+    if (strlen(line) < CHATLOG_PREFIX_LEN) {
+        return FALSE;
+    }
+    for (int i = 0; i < 8; i++) {
+        if ((i == 2 || i == 5) ? line[i] != ':' : !g_ascii_isdigit(line[i])) {
+            return FALSE;
+        }
+    }
+
+    return strncmp(line + 8, " - ", 3) == 0;
+}
+
+// "*name action" or "name: message", NULL when it is neither
+static ChatlogLine*
+_parse_message(const char* const line)
+{
+    const char* text = line + CHATLOG_PREFIX_LEN;
+    gchar* name;
+    gchar* message;
+
+    if (text[0] == '*') {
+        const char* space = strchr(text, ' ');
+        if (space) {
+            name = g_strndup(text + 1, space - text - 1);
+            message = g_strdup_printf("/me %s", space + 1);
+        } else {
+            name = g_strdup(text + 1);
+            message = g_strdup("/me ");
+        }
+    } else {
+        const char* sep = strstr(text, ": ");
+        if (sep) {
+            name = g_strndup(text, sep - text);
+            message = g_strdup(sep + 2);
+        } else if (g_str_has_suffix(text, ":")) {
+            name = g_strndup(text, strlen(text) - 1);
+            message = g_strdup("");
+        } else {
+            return NULL;
+        }
+    }
+
+    if (name[0] == '\0') {
+        g_free(name);
+        g_free(message);
+        return NULL;
+    }
+
+    ChatlogLine* result = g_new0(ChatlogLine, 1);
+    result->hour = atoi(line);
+    result->minute = atoi(line + 3);
+    result->second = atoi(line + 6);
+    result->name = name;
+    result->message = message;
+
+    return result;
+}
+
+GSList*
+chatlog_import_parse(const char* const text)
+{
+    GSList* result = NULL;
+    ChatlogLine* current = NULL;
+    GString* message = NULL;
+
+    gchar** lines = g_strsplit(text, "\n", 0);
+    guint count = g_strv_length(lines);
+    for (guint i = 0; i < count; i++) {
+        gchar* line = lines[i];
+        gsize len = strlen(line);
+        if (len > 0 && line[len - 1] == '\r') {
+            line[len - 1] = '\0';
+        }
+        // the newline ending the file
+        if (i == count - 1 && line[0] == '\0') {
+            break;
+        }
+
+        ChatlogLine* parsed = _has_prefix(line) ? _parse_message(line) : NULL;
+        if (parsed) {
+            if (current) {
+                g_free(current->message);
+                current->message = g_string_free(message, FALSE);
+            }
+            current = parsed;
+            message = g_string_new(parsed->message);
+            result = g_slist_prepend(result, current);
+        } else if (current) {
+            g_string_append_c(message, '\n');
+            g_string_append(message, line);
+        }
+    }
+    if (current) {
+        g_free(current->message);
+        current->message = g_string_free(message, FALSE);
+    }
+    g_strfreev(lines);
+
+    return g_slist_reverse(result);
+}
+
+void
+chatlog_import_line_free(ChatlogLine* line)
+{
+    if (line) {
+        g_free(line->name);
+        g_free(line->message);
+        g_free(line);
+    }
+}
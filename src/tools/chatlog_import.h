@@ -0,0 +1,71 @@
+/*
+ * chatlog_import.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef TOOLS_CHATLOG_IMPORT_H
+#define TOOLS_CHATLOG_IMPORT_H
+
+#include <glib.h>
+
+// What the path of a text chat log below the account directory says about it
+typedef struct chatlog_file_t
+{
+    gchar* contact;  // barejid of the contact or room
+    gchar* resource; // occupant nick of a room private chat, or NULL
+    gboolean room;
+    int year;
+    int month;
+    int day;
+} ChatlogFile;
+
+typedef struct chatlog_line_t
+{
+    int hour;
+    int minute;
+    int second;
+    gchar* name;    // nick or jid as logged, "me" for own chat messages
+    gchar* message; // actions are turned back into "/me ..."
+} ChatlogLine;
+
+// Parses "contact_at_domain/2020_01_31.log" or "rooms/room_at_domain/2020_01_31.log",
+// NULL when the path is neither
+ChatlogFile* chatlog_import_parse_path(const char* const relpath);
+void chatlog_import_file_free(ChatlogFile* file);
+
+// Splits the text of a log file into messages, lines without a timestamp
+// continue the message before. Returns a list of ChatlogLine.
+GSList* chatlog_import_parse(const char* const text);
+void chatlog_import_line_free(ChatlogLine* line);
+
+#endif
@@ -41,32 +41,91 @@
 #include <stdlib.h>
 
 #include "log.h"
+#include "tools/clipboard.h"
+#include "tools/scheduler.h"
 
-/*
-For now we rely on tray_init(void)
+// GTK runs the answer from its events, which are handled this often while
+// a request waits
+#define CLIPBOARD_POLL_MS 20
+
+typedef struct clipboard_request_t
+{
+    clipboard_text_func func;
+    void* userdata;
+    gint64 deadline;
+    // answered or given up, the request is freed once GTK is done with it
+    gboolean done;
+} ClipboardRequest;
 
-void clipboard_init(int argc, char **argv) {
-    gtk_init(&argc, &argv);
+static ClipboardRequest* pending = NULL;
+static SchedulerTask* poll_task = NULL;
+
+static void
+_clipboard_finish(ClipboardRequest* request, const char* const text)
+{
+    request->done = TRUE;
+    if (request == pending) {
+        pending = NULL;
+    }
+    request->func(text, request->userdata);
 }
-*/
 
-char*
-clipboard_get(void)
+static void
+_clipboard_received(GtkClipboard* clipboard, const gchar* text, gpointer data)
 {
-    gchar* clip;
+    ClipboardRequest* request = data;
+    if (!request->done) {
+        _clipboard_finish(request, text);
+    }
+    g_free(request);
+}
 
-    GtkClipboard* cl = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
-    gtk_clipboard_clear(cl);
+static gboolean
+_clipboard_poll(void* data)
+{
+    while (pending && gtk_events_pending()) {
+        gtk_main_iteration_do(FALSE);
+    }
 
+    if (pending && g_get_monotonic_time() >= pending->deadline) {
+        log_warning("Clipboard owner did not answer within %d ms", CLIPBOARD_TIMEOUT_MS);
+        _clipboard_finish(pending, NULL);
+    }
+    if (pending) {
+        return TRUE;
+    }
+
+    poll_task = NULL;
+    return FALSE;
+}
+
+gboolean
+clipboard_request_text(clipboard_text_func func, void* userdata)
+{
+    if (pending) {
+        return FALSE;
+    }
+
+    GtkClipboard* cl = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
     if (cl == NULL) {
         log_error("Could not get clipboard");
-        return NULL;
+        func(NULL, userdata);
+        return TRUE;
     }
 
-    // while(!gtk_clipboard_wait_is_text_available(cld)) {}
+    ClipboardRequest* request = g_new0(ClipboardRequest, 1);
+    request->func = func;
+    request->userdata = userdata;
+    request->deadline = g_get_monotonic_time() + (gint64)CLIPBOARD_TIMEOUT_MS * 1000;
+    pending = request;
+
+    // GTK answers at once when the text is its own
+    gtk_clipboard_request_text(cl, _clipboard_received, request);
+    if (pending && !poll_task) {
+        poll_task = scheduler_add(CLIPBOARD_POLL_MS, _clipboard_poll, NULL, NULL);
+    }
 
-    clip = gtk_clipboard_wait_for_text(cl);
-    return clip;
+    return TRUE;
 }
 
 #endif
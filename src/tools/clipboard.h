@@ -37,7 +37,15 @@
 #define UI_CLIPBOARD_H
 
 #ifdef HAVE_GTK
-char* clipboard_get(void);
+#define CLIPBOARD_TIMEOUT_MS 3000
+
+typedef void (*clipboard_text_func)(const char* const text, void* userdata);
+
+// Asks the owner of the clipboard for its text without waiting for it,
+// func is called from the main loop with the text, or with NULL when
+// there is none or no answer came within CLIPBOARD_TIMEOUT_MS. FALSE if
+// an earlier request is still waiting, func is then not called.
+gboolean clipboard_request_text(clipboard_text_func func, void* userdata);
 #endif
 
 #endif
@@ -0,0 +1,194 @@
+/*
+ * dedupe.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/dedupe.h"
+
+// a bloom filter answers most lookups for ids never seen, the LRU set
+// behind it confirms hits and bounds memory
+#define DEDUPE_BLOOM_BITS   (1 << 16)
+#define DEDUPE_BLOOM_HASHES 3
+
+static guint8* bloom = NULL;
+// key to its link in lru_order, oldest first
+static GHashTable* lru_index = NULL;
+static GQueue* lru_order = NULL;
+// evicted ids still set bits in the filter, it is rebuilt after this many
+static guint evicted = 0;
+
+static void
+_dedupe_init(void)
+{
+    bloom = g_malloc0(DEDUPE_BLOOM_BITS / 8);
+    lru_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    lru_order = g_queue_new();
+    evicted = 0;
+}
+
+static gchar*
+_dedupe_key(const char* const scope, const char* const id)
+{
+    return g_strconcat(scope ? scope : "", "\n", id, NULL);
+}
+
+// FNV-1a, independent of g_str_hash for double hashing
+static guint32
+_fnv_hash(const char* key)
+{
+    guint32 hash = 2166136261u;
+    for (const guchar* c = (const guchar*)key; *c; c++) {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void
+_bloom_bits(const char* const key, guint32 bits[DEDUPE_BLOOM_HASHES])
+{
+    guint32 h1 = g_str_hash(key);
+    guint32 h2 = _fnv_hash(key) | 1;
+    for (int i = 0; i < DEDUPE_BLOOM_HASHES; i++) {
+        bits[i] = (h1 + i * h2) % DEDUPE_BLOOM_BITS;
+    }
+}
+
+static void
+_bloom_set(const char* const key)
+{
+    guint32 bits[DEDUPE_BLOOM_HASHES];
+    _bloom_bits(key, bits);
+    for (int i = 0; i < DEDUPE_BLOOM_HASHES; i++) {
+        bloom[bits[i] / 8] |= 1 << (bits[i] % 8);
+    }
+}
+
+static gboolean
+_bloom_test(const char* const key)
+{
+    guint32 bits[DEDUPE_BLOOM_HASHES];
+    _bloom_bits(key, bits);
+    for (int i = 0; i < DEDUPE_BLOOM_HASHES; i++) {
+        if ((bloom[bits[i] / 8] & (1 << (bits[i] % 8))) == 0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void
+_bloom_rebuild(void)
+{
+    memset(bloom, 0, DEDUPE_BLOOM_BITS / 8);
+    for (GList* curr = lru_order->head; curr; curr = g_list_next(curr)) {
+        _bloom_set(curr->data);
+    }
+    evicted = 0;
+}
+
+gboolean
+dedupe_seen(const char* const scope, const char* const id)
+{
+    if (id == NULL || bloom == NULL) {
+        return FALSE;
+    }
+
+    gchar* key = _dedupe_key(scope, id);
+    gboolean seen = _bloom_test(key) && g_hash_table_contains(lru_index, key);
+    g_free(key);
+
+    return seen;
+}
+
+void
+dedupe_add(const char* const scope, const char* const id)
+{
+    if (id == NULL) {
+        return;
+    }
+    if (bloom == NULL) {
+        _dedupe_init();
+    }
+
+    gchar* key = _dedupe_key(scope, id);
+    GList* link = g_hash_table_lookup(lru_index, key);
+    if (link) {
+        // seen again, now the most recent
+        g_queue_unlink(lru_order, link);
+        g_queue_push_tail_link(lru_order, link);
+        g_free(key);
+        return;
+    }
+
+    g_queue_push_tail(lru_order, key);
+    g_hash_table_insert(lru_index, key, lru_order->tail);
+    _bloom_set(key);
+
+    if (g_queue_get_length(lru_order) > DEDUPE_MAX_IDS) {
+        gchar* oldest = g_queue_pop_head(lru_order);
+        g_hash_table_remove(lru_index, oldest);
+        evicted++;
+        if (evicted >= DEDUPE_MAX_IDS) {
+            _bloom_rebuild();
+        }
+    }
+}
+
+guint
+dedupe_size(void)
+{
+    return lru_order ? g_queue_get_length(lru_order) : 0;
+}
+
+void
+dedupe_close(void)
+{
+    if (lru_index) {
+        // the index owns the keys the queue points at
+        g_queue_free(lru_order);
+        g_hash_table_destroy(lru_index);
+        lru_order = NULL;
+        lru_index = NULL;
+    }
+    g_free(bloom);
+    bloom = NULL;
+    evicted = 0;
+}
@@ -0,0 +1,299 @@
+/*
+ * external.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "log.h"
+#include "tools/external.h"
+#include "tools/scheduler.h"
+#include "ui/ui.h"
+
+// how often running commands are checked on, the main loop has no child
+// watch of its own
+#define EXTERNAL_POLL_MS 100
+// output kept for the failure message, the rest is read and dropped
+#define EXTERNAL_OUTPUT_MAX (16 * 1024)
+
+typedef struct external_job_t
+{
+    gchar** argv;
+    gchar* what;
+    GPid pid;
+    int out_fd;
+    int err_fd;
+    GString* output;
+} ExternalJob;
+
+static GList* running = NULL;
+static GQueue* waiting = NULL;
+static SchedulerTask* poll_task = NULL;
+
+static gboolean _external_poll(void* data);
+
+static void
+_external_job_free(ExternalJob* job)
+{
+    if (job->out_fd >= 0) {
+        close(job->out_fd);
+    }
+    if (job->err_fd >= 0) {
+        close(job->err_fd);
+    }
+    g_strfreev(job->argv);
+    g_free(job->what);
+    g_string_free(job->output, TRUE);
+    g_free(job);
+}
+
+static guint
+_external_running_count(const char* const command)
+{
+    guint count = 0;
+    for (GList* curr = running; curr; curr = g_list_next(curr)) {
+        ExternalJob* job = curr->data;
+        if (g_strcmp0(job->argv[0], command) == 0) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static gboolean
+_external_start(ExternalJob* job)
+{
+    GError* error = NULL;
+    int in_fd = -1;
+    gboolean spawned = g_spawn_async_with_pipes(NULL, job->argv, NULL,
+                                                G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                                                NULL, NULL, &job->pid,
+                                                &in_fd, &job->out_fd, &job->err_fd, &error);
+    if (!spawned) {
+        gchar* cmd = g_strjoinv(" ", job->argv);
+        log_error("Spawning '%s' failed with '%s'.", cmd, error->message);
+        g_free(cmd);
+        g_error_free(error);
+        job->out_fd = -1;
+        job->err_fd = -1;
+        return FALSE;
+    }
+
+    // the terminal's input is ours, the command reads nothing
+    close(in_fd);
+    g_unix_set_fd_nonblocking(job->out_fd, TRUE, NULL);
+    g_unix_set_fd_nonblocking(job->err_fd, TRUE, NULL);
+
+    running = g_list_prepend(running, job);
+    if (!poll_task) {
+        poll_task = scheduler_add(EXTERNAL_POLL_MS, _external_poll, NULL, NULL);
+    }
+
+    return TRUE;
+}
+
+gboolean
+external_run(gchar** argv, const char* const what)
+{
+    if (!argv || !argv[0]) {
+        return FALSE;
+    }
+
+    ExternalJob* job = g_new0(ExternalJob, 1);
+    job->argv = g_strdupv(argv);
+    job->what = g_strdup(what);
+    job->out_fd = -1;
+    job->err_fd = -1;
+    job->output = g_string_new(NULL);
+
+    if (_external_running_count(argv[0]) >= EXTERNAL_MAX_PER_COMMAND) {
+        log_debug("Too many '%s' running, starting it later.", argv[0]);
+        if (!waiting) {
+            waiting = g_queue_new();
+        }
+        g_queue_push_tail(waiting, job);
+        return TRUE;
+    }
+
+    if (!_external_start(job)) {
+        _external_job_free(job);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+guint
+external_running(void)
+{
+    return g_list_length(running);
+}
+
+// Reads what is there without blocking, closes the pipe at its end
+static void
+_external_drain(ExternalJob* job, int* fd)
+{
+    char buf[4096];
+    while (*fd >= 0) {
+        ssize_t len = read(*fd, buf, sizeof(buf));
+        if (len > 0) {
+            if (job->output->len < EXTERNAL_OUTPUT_MAX) {
+                g_string_append_len(job->output, buf, MIN((gsize)len, EXTERNAL_OUTPUT_MAX - job->output->len));
+            }
+        } else if (len < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return;
+        } else {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+static void
+_external_finish(ExternalJob* job, int wait_status)
+{
+    _external_drain(job, &job->out_fd);
+    _external_drain(job, &job->err_fd);
+    g_spawn_close_pid(job->pid);
+
+    GError* error = NULL;
+    if (!g_spawn_check_exit_status(wait_status, &error)) {
+        gchar* cmd = g_strjoinv(" ", job->argv);
+        log_error("'%s' failed with '%s'.", cmd, error->message);
+        g_free(cmd);
+
+        cons_show_error("%s failed: %s", job->what, error->message);
+        g_strchomp(job->output->str);
+        if (job->output->str[0]) {
+            cons_show("%s", job->output->str);
+        }
+        g_error_free(error);
+    } else if (job->output->len > 0) {
+        log_debug("%s: %s", job->what, job->output->str);
+    }
+}
+
+static void
+_external_start_waiting(const char* const command)
+{
+    if (!waiting) {
+        return;
+    }
+
+    GList* curr = g_queue_peek_head_link(waiting);
+    while (curr) {
+        GList* next = g_list_next(curr);
+        ExternalJob* job = curr->data;
+        if (g_strcmp0(job->argv[0], command) == 0) {
+            g_queue_delete_link(waiting, curr);
+            if (_external_start(job)) {
+                return;
+            }
+            cons_show_error("%s failed: could not start %s.", job->what, job->argv[0]);
+            _external_job_free(job);
+        }
+        curr = next;
+    }
+}
+
+static gboolean
+_external_poll(void* data)
+{
+    GList* curr = running;
+    while (curr) {
+        GList* next = g_list_next(curr);
+        ExternalJob* job = curr->data;
+
+        // keep the pipes from filling up, the command would block on them
+        _external_drain(job, &job->out_fd);
+        _external_drain(job, &job->err_fd);
+
+        int wait_status = 0;
+        pid_t res = waitpid(job->pid, &wait_status, WNOHANG);
+        if (res != 0) {
+            running = g_list_delete_link(running, curr);
+            if (res < 0) {
+                // reaped elsewhere, nothing is known about how it went
+                g_spawn_close_pid(job->pid);
+            } else {
+                _external_finish(job, wait_status);
+            }
+            gchar* command = g_strdup(job->argv[0]);
+            _external_job_free(job);
+            _external_start_waiting(command);
+            g_free(command);
+        }
+
+        curr = next;
+    }
+
+    if (!running) {
+        poll_task = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Running commands are left to finish on their own, a browser started to
+// open a URL stays open
+void
+external_close(void)
+{
+    scheduler_remove(poll_task);
+    poll_task = NULL;
+
+    for (GList* curr = running; curr; curr = g_list_next(curr)) {
+        ExternalJob* job = curr->data;
+        g_spawn_close_pid(job->pid);
+        _external_job_free(job);
+    }
+    g_list_free(running);
+    running = NULL;
+
+    if (waiting) {
+        g_queue_free_full(waiting, (GDestroyNotify)_external_job_free);
+        waiting = NULL;
+    }
+}
@@ -41,8 +41,79 @@
 #include <gio/gio.h>
 
 #include "tools/http_common.h"
+#include "tools/scheduler.h"
+#include "ui/ui.h"
+#include "ui/window.h"
+#include "ui/window_list.h"
 
 #define FALLBACK_MSG ""
+// how often the main loop renders the transfer progress
+#define HTTP_PROGRESS_RENDER_MS 300
+
+typedef enum {
+    HTTP_EVENT_PRINT,
+    HTTP_EVENT_UPDATE,
+    HTTP_EVENT_DONE,
+    HTTP_EVENT_ERROR
+} http_event_t;
+
+// Output of a transfer thread, shown by the main loop
+typedef struct http_event_msg_t
+{
+    http_event_t type;
+    ProfWin* window;
+    char* url;
+    gchar* message;
+} HTTPEvent;
+
+static GSList* progresses = NULL;
+static gint64 progress_rendered = 0;
+
+// A window closed during the transfer gets none of its output
+static gboolean
+_http_window_open(ProfWin* window)
+{
+    return wins_get_num(window) != -1;
+}
+
+static void
+_http_event_show(void* data)
+{
+    HTTPEvent* event = data;
+
+    if (event->type == HTTP_EVENT_ERROR) {
+        cons_show_error("%s", event->message);
+    } else if (_http_window_open(event->window)) {
+        switch (event->type) {
+        case HTTP_EVENT_PRINT:
+            win_print_http_transfer(event->window, event->message, event->url);
+            break;
+        case HTTP_EVENT_DONE:
+            win_update_entry_message(event->window, event->url, event->message);
+            win_mark_received(event->window, event->url);
+            break;
+        default:
+            win_update_entry_message(event->window, event->url, event->message);
+            break;
+        }
+    }
+
+    g_free(event->url);
+    g_free(event->message);
+    g_free(event);
+}
+
+static void
+_http_event_post(http_event_t type, ProfWin* window, const char* const url, const char* fmt, va_list args)
+{
+    HTTPEvent* event = g_new0(HTTPEvent, 1);
+    event->type = type;
+    event->window = window;
+    event->url = g_strdup(url);
+    event->message = g_strdup_vprintf(fmt, args);
+
+    scheduler_post(_http_event_show, event);
+}
 
 void
 http_print_transfer_update(ProfWin* window, char* url, const char* fmt, ...)
@@ -73,3 +144,88 @@ http_print_transfer(ProfWin* window, char* url, const char* fmt, ...)
 
     g_string_free(msg, TRUE);
 }
+
+void
+http_post_transfer(ProfWin* window, const char* const url, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    _http_event_post(HTTP_EVENT_PRINT, window, url, fmt, args);
+    va_end(args);
+}
+
+void
+http_post_transfer_update(ProfWin* window, const char* const url, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    _http_event_post(HTTP_EVENT_UPDATE, window, url, fmt, args);
+    va_end(args);
+}
+
+void
+http_post_transfer_done(ProfWin* window, const char* const url, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    _http_event_post(HTTP_EVENT_DONE, window, url, fmt, args);
+    va_end(args);
+}
+
+void
+http_post_error(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    _http_event_post(HTTP_EVENT_ERROR, NULL, NULL, fmt, args);
+    va_end(args);
+}
+
+void
+http_progress_add(HTTPProgress* progress)
+{
+    progress->percent = 0;
+    progress->shown = 0;
+    progresses = g_slist_prepend(progresses, progress);
+}
+
+void
+http_progress_remove(HTTPProgress* progress)
+{
+    progresses = g_slist_remove(progresses, progress);
+}
+
+void
+http_progress_set(HTTPProgress* progress, curl_off_t now, curl_off_t total)
+{
+    gint percent = 0;
+    if (total > 0) {
+        percent = (gint)((100 * now) / total);
+    }
+    g_atomic_int_set(&progress->percent, percent);
+}
+
+void
+http_progress_check(void)
+{
+    if (!progresses) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    if (now - progress_rendered < HTTP_PROGRESS_RENDER_MS * 1000) {
+        return;
+    }
+    progress_rendered = now;
+
+    for (GSList* curr = progresses; curr; curr = g_slist_next(curr)) {
+        HTTPProgress* progress = curr->data;
+        int percent = g_atomic_int_get(&progress->percent);
+        if (percent == progress->shown || !_http_window_open(progress->window)) {
+            continue;
+        }
+        progress->shown = percent;
+        http_print_transfer_update(progress->window, progress->url,
+                                   "%s '%s': %d%%", progress->verb, progress->name, percent);
+    }
+}
@@ -36,9 +36,40 @@
 #ifndef TOOLS_HTTP_COMMON_H
 #define TOOLS_HTTP_COMMON_H
 
-#include "ui/window.h"
+#include <curl/curl.h>
+
+#include "ui/win_types.h"
+
+// Progress of a transfer shown in its window entry. The transfer thread
+// only publishes the percentage, the main loop renders it.
+typedef struct http_progress_t
+{
+    ProfWin* window;
+    char* url;        // id of the window entry
+    const char* verb; // "Downloading", "Uploading"
+    const char* name; // what is transferred
+    gint percent;     // atomic, set by the transfer thread
+    int shown;
+} HTTPProgress;
 
 void http_print_transfer(ProfWin* window, char* url, const char* fmt, ...);
 void http_print_transfer_update(ProfWin* window, char* url, const char* fmt, ...);
 
+// Same from a transfer thread, shown by the main loop in the order posted,
+// unless the window was closed meanwhile. _done also marks the entry
+// received, http_post_error() goes to the console.
+void http_post_transfer(ProfWin* window, const char* const url, const char* fmt, ...);
+void http_post_transfer_update(ProfWin* window, const char* const url, const char* fmt, ...);
+void http_post_transfer_done(ProfWin* window, const char* const url, const char* fmt, ...);
+void http_post_error(const char* fmt, ...);
+
+// Registers the progress of a transfer whose entry shows 0%, and drops it
+// before the entry gets the result, both on the main loop
+void http_progress_add(HTTPProgress* progress);
+void http_progress_remove(HTTPProgress* progress);
+// Called from the transfer thread, takes no lock
+void http_progress_set(HTTPProgress* progress, curl_off_t now, curl_off_t total);
+// Renders the percentages that changed, at most every few hundred ms
+void http_progress_check(void);
+
 #endif
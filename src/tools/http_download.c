@@ -43,105 +43,419 @@
 #include <sys/types.h>
 #include <curl/curl.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <pthread.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "profanity.h"
 #include "event/client_events.h"
 #include "tools/http_download.h"
+#include "tools/http_transfer.h"
+#include "tools/scheduler.h"
+#include "tools/workers.h"
 #include "config/preferences.h"
 #include "ui/ui.h"
 #include "ui/window.h"
+#include "ui/window_list.h"
 #include "common.h"
+#include "log.h"
+
+#define DOWNLOAD_BUFFER_SIZE (512 * 1024)
+
+// parts of a segmented download and the size each of them needs at least,
+// smaller files are not worth the additional requests
+#define DOWNLOAD_SEGMENTS         4
+#define DOWNLOAD_SEGMENT_MIN_SIZE (2 * 1024 * 1024)
+
+#define DOWNLOAD_STATE_GROUP "download"
+
+// downloads running at the same time, further ones wait for a worker
+#define DOWNLOAD_PARALLEL 4
 
 GSList* download_processes = NULL;
 
-static int
-_xferinfo(void* userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+// shared with the encrypted downloads, which wrap one of these
+static WorkerClass* download_workers = NULL;
+
+// Tracks a download written straight to a file so that it can be resumed
+// later, see _download_state_path().
+typedef struct download_resume_t
 {
-    HTTPDownload* download = (HTTPDownload*)userdata;
+    CURL* curl;
+    FILE* fh;
+    const char* url;
+    gchar* state_path;
+    // bytes already on disk when the request was made
+    curl_off_t offset;
+    gchar* etag;
+    gchar* last_modified;
+    long http_code;
+    gboolean started;
+    gboolean accept_ranges;
+} DownloadResume;
+
+// One part of a segmented download, written at its place in the file
+typedef struct download_segment_t
+{
+    CURL* curl;
+    int fd;
+    // next byte to be written and last byte of the segment
+    curl_off_t pos;
+    curl_off_t last;
+    long http_code;
+    gboolean started;
+} DownloadSegment;
+
+// "dir/name" -> "dir/.name.download", kept next to the file until it
+// has been completely received
+static gchar*
+_download_state_path(const char* const filename)
+{
+    gchar* dirname = g_path_get_dirname(filename);
+    gchar* basename = g_path_get_basename(filename);
+    gchar* statename = g_strdup_printf(".%s.download", basename);
+    gchar* path = g_build_filename(dirname, statename, NULL);
 
-    pthread_mutex_lock(&lock);
+    g_free(statename);
+    g_free(basename);
+    g_free(dirname);
 
-    if (download->cancel) {
-        pthread_mutex_unlock(&lock);
-        return 1;
+    return path;
+}
+
+static GKeyFile*
+_download_state_load(const char* const state_path, const char* const url)
+{
+    GKeyFile* state = g_key_file_new();
+
+    if (!g_key_file_load_from_file(state, state_path, G_KEY_FILE_NONE, NULL)) {
+        g_key_file_free(state);
+        return NULL;
     }
 
-    if (download->bytes_received == dlnow) {
-        pthread_mutex_unlock(&lock);
-        return 0;
-    } else {
-        download->bytes_received = dlnow;
+    gchar* state_url = g_key_file_get_string(state, DOWNLOAD_STATE_GROUP, "url", NULL);
+    gboolean same_url = g_strcmp0(state_url, url) == 0;
+    g_free(state_url);
+
+    if (!same_url) {
+        g_key_file_free(state);
+        return NULL;
+    }
+
+    return state;
+}
+
+static void
+_download_state_save(DownloadResume* resume)
+{
+    GKeyFile* state = g_key_file_new();
+
+    g_key_file_set_string(state, DOWNLOAD_STATE_GROUP, "url", resume->url);
+    if (resume->etag) {
+        g_key_file_set_string(state, DOWNLOAD_STATE_GROUP, "etag", resume->etag);
+    }
+    if (resume->last_modified) {
+        g_key_file_set_string(state, DOWNLOAD_STATE_GROUP, "last_modified", resume->last_modified);
     }
 
-    unsigned int dlperc = 0;
-    if (dltotal != 0) {
-        dlperc = (100 * dlnow) / dltotal;
+    GError* error = NULL;
+    if (!g_key_file_save_to_file(state, resume->state_path, &error)) {
+        log_warning("[HTTP] Unable to save download state to %s: %s", resume->state_path, error->message);
+        g_error_free(error);
     }
 
-    http_print_transfer_update(download->window, download->url,
-                               "Downloading '%s': %d%%", download->url, dlperc);
+    g_key_file_free(state);
+}
 
-    pthread_mutex_unlock(&lock);
+static size_t
+_header_callback(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    DownloadResume* resume = (DownloadResume*)userdata;
+    size_t length = size * nitems;
+    gchar* line = g_strndup(buffer, length);
+    g_strstrip(line);
+
+    if (g_str_has_prefix(line, "HTTP/")) {
+        // new response, e.g. after a redirect
+        FREE_SET_NULL(resume->etag);
+        FREE_SET_NULL(resume->last_modified);
+        resume->accept_ranges = FALSE;
+    } else if (g_ascii_strncasecmp(line, "ETag:", 5) == 0) {
+        g_free(resume->etag);
+        resume->etag = g_strdup(g_strstrip(&line[5]));
+    } else if (g_ascii_strncasecmp(line, "Last-Modified:", 14) == 0) {
+        g_free(resume->last_modified);
+        resume->last_modified = g_strdup(g_strstrip(&line[14]));
+    } else if (g_ascii_strncasecmp(line, "Accept-Ranges:", 14) == 0) {
+        resume->accept_ranges = g_ascii_strcasecmp(g_strstrip(&line[14]), "bytes") == 0;
+    }
 
-    return 0;
+    g_free(line);
+
+    return length;
+}
+
+static size_t
+_write_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    DownloadResume* resume = (DownloadResume*)userdata;
+
+    if (!resume->started) {
+        resume->started = TRUE;
+        curl_easy_getinfo(resume->curl, CURLINFO_RESPONSE_CODE, &resume->http_code);
+
+        // The server ignored the range or the file changed (If-Range did not
+        // match), the whole file follows.
+        if (resume->http_code == 200 && resume->offset > 0) {
+            if (ftruncate(fileno(resume->fh), 0) != 0 || fseeko(resume->fh, 0, SEEK_SET) != 0) {
+                return 0;
+            }
+            resume->offset = 0;
+        }
+
+        if (resume->http_code < 300) {
+            _download_state_save(resume);
+        }
+    }
+
+    // Don't store error pages in the file that is being resumed.
+    if (resume->http_code >= 400) {
+        return size * nmemb;
+    }
+
+    return fwrite(ptr, size, nmemb, resume->fh) * size;
+}
+
+gchar*
+http_download_resumable_filename(const char* const url, const char* const filename)
+{
+    // Same candidates, in the same order, as unique_filename_from_url().
+    gchar* candidate = g_strdup(filename);
+    unsigned int i = 0;
+
+    while (g_file_test(candidate, G_FILE_TEST_EXISTS) && i <= 1000) {
+        gchar* state_path = _download_state_path(candidate);
+        GKeyFile* state = _download_state_load(state_path, url);
+        g_free(state_path);
+
+        if (state) {
+            g_key_file_free(state);
+            return candidate;
+        }
+
+        g_free(candidate);
+        candidate = g_strdup_printf("%s.%u", filename, i);
+        i++;
+    }
+
+    g_free(candidate);
+    return NULL;
 }
 
-#if LIBCURL_VERSION_NUM < 0x072000
 static int
-_older_progress(void* p, double dltotal, double dlnow, double ultotal, double ulnow)
+_xferinfo(void* userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
 {
-    return _xferinfo(p, (curl_off_t)dltotal, (curl_off_t)dlnow, (curl_off_t)ultotal, (curl_off_t)ulnow);
+    HTTPDownload* download = (HTTPDownload*)userdata;
+
+    if (g_atomic_int_get(&download->cancel)) {
+        return 1;
+    }
+
+    http_progress_set(&download->progress, dlnow, dltotal);
+
+    return 0;
+}
+
+static size_t
+_segment_write_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    DownloadSegment* segment = (DownloadSegment*)userdata;
+    size_t length = size * nmemb;
+
+    if (!segment->started) {
+        segment->started = TRUE;
+        curl_easy_getinfo(segment->curl, CURLINFO_RESPONSE_CODE, &segment->http_code);
+    }
+
+    // Anything but the requested range, e.g. the whole file because it
+    // changed since the probe, ends the segment.
+    if (segment->http_code != 206 || segment->pos + (curl_off_t)length > segment->last + 1) {
+        return 0;
+    }
+
+    size_t written = 0;
+    while (written < length) {
+        ssize_t res = pwrite(segment->fd, ptr + written, length - written, segment->pos);
+        if (res < 0) {
+            return 0;
+        }
+        written += res;
+        segment->pos += res;
+    }
+
+    return length;
 }
+
+static CURL*
+_download_curl_new(const char* const url, const char* const cert_path)
+{
+    CURL* curl = curl_easy_init();
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+#if LIBCURL_VERSION_NUM >= 0x073500
+    curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, (long)DOWNLOAD_BUFFER_SIZE);
 #endif
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "profanity");
+    if (cert_path) {
+        curl_easy_setopt(curl, CURLOPT_CAPATH, cert_path);
+    }
 
-void*
-http_file_get(void* userdata)
+    return curl;
+}
+
+// Downloads the file in parts at the same time, each written at its place
+// in the preallocated file. FALSE if the server does not allow ranges or the
+// file is too small, in which case nothing has been written yet.
+static gboolean
+_download_segmented(HTTPDownload* download, DownloadResume* resume, const char* const cert_path, char** err)
 {
-    HTTPDownload* download = (HTTPDownload*)userdata;
+    // Ask for the size and whether ranges are allowed first.
+    CURL* probe = _download_curl_new(download->url, cert_path);
+    curl_easy_setopt(probe, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(probe, CURLOPT_HEADERFUNCTION, _header_callback);
+    curl_easy_setopt(probe, CURLOPT_HEADERDATA, resume);
+
+    curl_off_t size = -1;
+    long http_code = 0;
+    CURLcode res = http_transfer_perform(probe, NULL, NULL);
+    if (res == CURLE_OK) {
+        curl_easy_getinfo(probe, CURLINFO_RESPONSE_CODE, &http_code);
+        curl_easy_getinfo(probe, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+    }
+    curl_easy_cleanup(probe);
 
-    char* err = NULL;
+    int count = MIN(DOWNLOAD_SEGMENTS, size / DOWNLOAD_SEGMENT_MIN_SIZE);
+    if (res != CURLE_OK || http_code != 200 || !resume->accept_ranges || count < 2) {
+        log_debug("[HTTP] Downloading %s in a single request", download->url);
+        resume->accept_ranges = FALSE;
+        return FALSE;
+    }
 
-    CURL* curl;
-    CURLcode res;
+    // the parts leave holes until complete, which a resumed download would
+    // take for received data
+    g_remove(resume->state_path);
 
-    download->cancel = 0;
-    download->bytes_received = 0;
-
-    pthread_mutex_lock(&lock);
-    http_print_transfer(download->window, download->url,
-                        "Downloading '%s': 0%%", download->url);
-
-    FILE* outfh = fopen(download->filename, "wb");
-    if (outfh == NULL) {
-        http_print_transfer_update(download->window, download->url,
-                                   "Downloading '%s' failed: Unable to open "
-                                   "output file at '%s' for writing (%s).",
-                                   download->url, download->filename,
-                                   g_strerror(errno));
-        goto out;
+    int fd = fileno(resume->fh);
+    if (posix_fallocate(fd, 0, size) != 0 && ftruncate(fd, size) != 0) {
+        *err = strdup(g_strerror(errno));
+        return TRUE;
     }
 
-    char* cert_path = prefs_get_string(PREF_TLS_CERTPATH);
-    pthread_mutex_unlock(&lock);
+    log_debug("[HTTP] Downloading %s in %d segments", download->url, count);
+
+    // If the file changes meanwhile a part is answered with all of it
+    // instead, which fails the download.
+    gchar* validator = resume->etag ? resume->etag : resume->last_modified;
+    gchar* if_range = validator ? g_strdup_printf("If-Range: %s", validator) : NULL;
+    struct curl_slist* headers = if_range ? curl_slist_append(NULL, if_range) : NULL;
+
+    DownloadSegment* segments = g_new0(DownloadSegment, count);
+    CURL** curls = g_new0(CURL*, count);
+    CURLcode* results = g_new0(CURLcode, count);
+    curl_off_t length = size / count;
+
+    for (int i = 0; i < count; i++) {
+        DownloadSegment* segment = &segments[i];
+        segment->fd = fd;
+        segment->pos = i * length;
+        segment->last = i == count - 1 ? size - 1 : (i + 1) * length - 1;
+
+        gchar* range = g_strdup_printf("%" CURL_FORMAT_CURL_OFF_T "-%" CURL_FORMAT_CURL_OFF_T, segment->pos, segment->last);
+        segment->curl = curls[i] = _download_curl_new(download->url, cert_path);
+        curl_easy_setopt(segment->curl, CURLOPT_RANGE, range);
+        curl_easy_setopt(segment->curl, CURLOPT_WRITEFUNCTION, _segment_write_callback);
+        curl_easy_setopt(segment->curl, CURLOPT_WRITEDATA, segment);
+        if (headers) {
+            curl_easy_setopt(segment->curl, CURLOPT_HTTPHEADER, headers);
+        }
+        g_free(range);
+    }
+
+    http_transfer_perform_all(curls, results, count, _xferinfo, download);
+
+    for (int i = 0; i < count && !*err; i++) {
+        DownloadSegment* segment = &segments[i];
+        if (results[i] != CURLE_OK && !(results[i] == CURLE_WRITE_ERROR && segment->http_code != 206)) {
+            *err = strdup(curl_easy_strerror(results[i]));
+        } else if (segment->http_code != 206) {
+            *err = g_strdup_printf("Server returned %ld for a part", segment->http_code);
+        } else if (segment->pos != segment->last + 1) {
+            *err = g_strdup_printf("Part %d incomplete", i + 1);
+        }
+    }
+
+    // a failed download is not resumed, nothing of it is kept
+    if (*err && ftruncate(fd, 0) != 0) {
+        log_warning("[HTTP] Unable to truncate %s: %s", download->filename, g_strerror(errno));
+    }
+
+    for (int i = 0; i < count; i++) {
+        curl_easy_cleanup(curls[i]);
+    }
+    curl_slist_free_all(headers);
+    g_free(if_range);
+    g_free(results);
+    g_free(curls);
+    g_free(segments);
+
+    return TRUE;
+}
+
+static char*
+_download_whole(HTTPDownload* download, DownloadResume* resume, GKeyFile* state, const char* const cert_path)
+{
+    char* err = NULL;
+    CURL* curl;
+    CURLcode res;
 
-    curl_global_init(CURL_GLOBAL_ALL);
     curl = curl_easy_init();
 
     curl_easy_setopt(curl, CURLOPT_URL, download->url);
 
-#if LIBCURL_VERSION_NUM >= 0x072000
-    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, _xferinfo);
-    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, download);
-#else
-    curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, _older_progress);
-    curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, download);
+    struct curl_slist* headers = NULL;
+    if (download->write_func) {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, download->write_func);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, download->write_data);
+    } else {
+        resume->curl = curl;
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _write_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, resume);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, _header_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, resume);
+
+        if (resume->offset > 0) {
+            // Only resume if the file did not change since, a complete and
+            // unchanged file is answered with 416.
+            gchar* validator = g_key_file_get_string(state, DOWNLOAD_STATE_GROUP, "etag", NULL);
+            if (!validator) {
+                validator = g_key_file_get_string(state, DOWNLOAD_STATE_GROUP, "last_modified", NULL);
+            }
+            if (validator) {
+                gchar* if_range = g_strdup_printf("If-Range: %s", validator);
+                headers = curl_slist_append(headers, if_range);
+                g_free(if_range);
+                g_free(validator);
+                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+            }
+            curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, resume->offset);
+        }
+    }
+#if LIBCURL_VERSION_NUM >= 0x073500
+    curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, (long)DOWNLOAD_BUFFER_SIZE);
 #endif
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)outfh);
 
     curl_easy_setopt(curl, CURLOPT_USERAGENT, "profanity");
 
@@ -149,37 +463,135 @@ http_file_get(void* userdata)
         curl_easy_setopt(curl, CURLOPT_CAPATH, cert_path);
     }
 
-    if ((res = curl_easy_perform(curl)) != CURLE_OK) {
+    res = http_transfer_perform(curl, _xferinfo, download);
+    if (res == CURLE_OK && download->write_func == NULL) {
+        if (!resume->started) {
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &resume->http_code);
+        }
+
+        // 416 on a resumed download means the range starts at the end, the
+        // file is already complete.
+        if (resume->http_code >= 400 && !(resume->http_code == 416 && resume->offset > 0)) {
+            err = g_strdup_printf("Server returned %ld", resume->http_code);
+        } else {
+            g_remove(resume->state_path);
+        }
+    } else if (res != CURLE_OK) {
         err = strdup(curl_easy_strerror(res));
     }
 
     curl_easy_cleanup(curl);
-    curl_global_cleanup();
+    curl_slist_free_all(headers);
+
+    return err;
+}
 
-    if (fclose(outfh) == EOF) {
+// Runs on the main loop, the transfer thread posts these in order
+static void
+_download_started(void* data)
+{
+    HTTPDownload* download = data;
+
+    if (wins_get_num(download->window) != -1) {
+        http_print_transfer(download->window, download->url,
+                            "Downloading '%s': 0%%", download->url);
+    }
+    download->progress.window = download->window;
+    download->progress.url = download->url;
+    download->progress.verb = "Downloading";
+    download->progress.name = download->url;
+    http_progress_add(&download->progress);
+}
+
+static void
+_download_stopped(void* data)
+{
+    HTTPDownload* download = data;
+
+    http_progress_remove(&download->progress);
+}
+
+static void
+_download_free(void* data)
+{
+    HTTPDownload* download = data;
+
+    download_processes = g_slist_remove(download_processes, download);
+
+    free(download->url);
+    free(download->filename);
+    free(download->cmd_template);
+    g_free(download->cert_path);
+    free(download);
+}
+
+void*
+http_file_get(void* userdata)
+{
+    HTTPDownload* download = (HTTPDownload*)userdata;
+
+    char* err = NULL;
+
+    download->cancel = 0;
+    scheduler_post(_download_started, download);
+
+    // Downloads written straight to a file continue where an earlier attempt
+    // for the same URL stopped.
+    DownloadResume resume = { 0 };
+    GKeyFile* state = NULL;
+    FILE* outfh = NULL;
+    if (download->write_func == NULL) {
+        resume.url = download->url;
+        resume.state_path = _download_state_path(download->filename);
+        state = _download_state_load(resume.state_path, download->url);
+        if (state && (outfh = fopen(download->filename, "r+b")) != NULL) {
+            fseeko(outfh, 0, SEEK_END);
+            resume.offset = ftello(outfh);
+        } else {
+            outfh = fopen(download->filename, "wb");
+        }
+        resume.fh = outfh;
+    }
+    if (download->write_func == NULL && outfh == NULL) {
+        scheduler_post(_download_stopped, download);
+        http_post_transfer_update(download->window, download->url,
+                                  "Downloading '%s' failed: Unable to open "
+                                  "output file at '%s' for writing (%s).",
+                                  download->url, download->filename,
+                                  g_strerror(errno));
+        goto out;
+    }
+
+    // Large files from servers allowing ranges come in parts at the same
+    // time, anything else in a single request
+    if (!download->segmented || download->write_func || resume.offset > 0
+        || !_download_segmented(download, &resume, download->cert_path, &err)) {
+        err = _download_whole(download, &resume, state, download->cert_path);
+    }
+
+    if (outfh && fclose(outfh) == EOF) {
         err = strdup(g_strerror(errno));
     }
 
-    pthread_mutex_lock(&lock);
-    g_free(cert_path);
+    // no progress is shown over the result
+    scheduler_post(_download_stopped, download);
     if (err) {
         if (download->cancel) {
-            http_print_transfer_update(download->window, download->url,
-                                       "Downloading '%s' failed: "
-                                       "Download was canceled",
-                                       download->url);
+            http_post_transfer_update(download->window, download->url,
+                                      "Downloading '%s' failed: "
+                                      "Download was canceled",
+                                      download->url);
         } else {
-            http_print_transfer_update(download->window, download->url,
-                                       "Downloading '%s' failed: %s",
-                                       download->url, err);
+            http_post_transfer_update(download->window, download->url,
+                                      "Downloading '%s' failed: %s",
+                                      download->url, err);
         }
         free(err);
     } else {
         if (!download->cancel) {
-            http_print_transfer_update(download->window, download->url,
-                                       "Downloading '%s': done",
-                                       download->url);
-            win_mark_received(download->window, download->url);
+            http_post_transfer_done(download->window, download->url,
+                                    "Downloading '%s': done",
+                                    download->url);
         }
     }
 
@@ -190,27 +602,29 @@ http_file_get(void* userdata)
 
         // TODO: Log the error.
         if (!call_external(argv, NULL, NULL)) {
-            http_print_transfer_update(download->window, download->url,
-                                       "Downloading '%s' failed: Unable to call "
-                                       "command '%s' with file at '%s' (%s).",
-                                       download->url,
-                                       download->cmd_template,
-                                       download->filename,
-                                       "TODO: Log the error");
+            http_post_transfer_update(download->window, download->url,
+                                      "Downloading '%s' failed: Unable to call "
+                                      "command '%s' with file at '%s' (%s).",
+                                      download->url,
+                                      download->cmd_template,
+                                      download->filename,
+                                      "TODO: Log the error");
         }
 
         g_strfreev(argv);
-        free(download->cmd_template);
     }
 
 out:
 
-    download_processes = g_slist_remove(download_processes, download);
-    pthread_mutex_unlock(&lock);
+    if (state) {
+        g_key_file_free(state);
+    }
+    g_free(resume.state_path);
+    g_free(resume.etag);
+    g_free(resume.last_modified);
 
-    free(download->url);
-    free(download->filename);
-    free(download);
+    // the download is not touched here any more
+    scheduler_post(_download_free, download);
 
     return NULL;
 }
@@ -222,13 +636,37 @@ http_download_cancel_processes(ProfWin* window)
     while (download_process) {
         HTTPDownload* download = download_process->data;
         if (download->window == window) {
-            download->cancel = 1;
+            g_atomic_int_set(&download->cancel, 1);
             break;
         }
         download_process = g_slist_next(download_process);
     }
 }
 
+static void
+_http_download_job(WorkerJob* job, void* data)
+{
+    http_file_get(data);
+}
+
+WorkerClass*
+http_download_workers(void)
+{
+    if (!download_workers) {
+        download_workers = workers_class_new("download", DOWNLOAD_PARALLEL, 0);
+    }
+
+    return download_workers;
+}
+
+void
+http_download_start(HTTPDownload* download)
+{
+    // a download goes on once its window is closed
+    workers_submit(http_download_workers(), NULL, _http_download_job, download);
+    http_download_add_download(download);
+}
+
 void
 http_download_add_download(HTTPDownload* download)
 {
@@ -46,21 +46,37 @@
 
 #include "ui/win_types.h"
 #include "tools/http_common.h"
+#include "tools/workers.h"
 
 typedef struct http_download_t
 {
     char* url;
     char* filename;
     char* cmd_template;
-    curl_off_t bytes_received;
+    // Optional sink for the received data in place of writing it to
+    // filename directly, e.g. to decrypt it on the fly (NULL to store as is)
+    curl_write_callback write_func;
+    void* write_data;
     ProfWin* window;
-    pthread_t worker;
+    // preferences as they were when the download was requested
+    char* cert_path;
+    gboolean segmented;
     int cancel;
+    HTTPProgress progress;
 } HTTPDownload;
 
+// Runs on a pool thread, the UI is only touched through events for the
+// main loop, which also frees the download
 void* http_file_get(void* userdata);
+// Queues the download for a pool thread
+void http_download_start(HTTPDownload* download);
+WorkerClass* http_download_workers(void);
 
 void http_download_cancel_processes(ProfWin* window);
 void http_download_add_download(HTTPDownload* download);
 
+// Existing file among filename, filename.0, filename.1, ... that holds an
+// interrupted download of url, NULL if there is none
+gchar* http_download_resumable_filename(const char* const url, const char* const filename);
+
 #endif
@@ -0,0 +1,319 @@
+/*
+ * http_transfer.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include <glib.h>
+
+#include "log.h"
+#include "tools/http_transfer.h"
+#include "tools/perf.h"
+
+// transfers running at the same time, further ones wait in the queue
+#define HTTP_TRANSFER_MAX_PARALLEL 4
+// how often a waiting caller is given the transfer progress
+#define HTTP_TRANSFER_PROGRESS_MS 250
+
+typedef struct http_transfer_t
+{
+    CURL* curl;
+    // progress as last reported by curl on the worker thread
+    curl_off_t dltotal;
+    curl_off_t dlnow;
+    curl_off_t ultotal;
+    curl_off_t ulnow;
+    gboolean cancel;
+    gboolean done;
+    CURLcode result;
+} HTTPTransfer;
+
+// All HTTP transfers share one multi handle driven by a single worker
+// thread, so connections, TLS sessions and HTTP/2 multiplexing are reused
+// between uploads and downloads to the same server.
+static CURLM* multi = NULL;
+static pthread_t worker;
+static pthread_mutex_t transfers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t transfers_cond = PTHREAD_COND_INITIALIZER;
+static GQueue* queued = NULL;
+static GList* active = NULL;
+static gboolean running = FALSE;
+static int wakeup_pipe[2] = { -1, -1 };
+
+static void
+_http_transfer_wakeup(void)
+{
+    char c = 0;
+    if (write(wakeup_pipe[1], &c, 1) == -1) {
+        // pipe full, the worker is going to wake up anyway
+    }
+}
+
+static int
+_http_transfer_xferinfo(void* userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    HTTPTransfer* transfer = userdata;
+
+    pthread_mutex_lock(&transfers_lock);
+    transfer->dltotal = dltotal;
+    transfer->dlnow = dlnow;
+    transfer->ultotal = ultotal;
+    transfer->ulnow = ulnow;
+    int cancel = transfer->cancel;
+    pthread_mutex_unlock(&transfers_lock);
+
+    return cancel;
+}
+
+static void
+_http_transfer_finish(HTTPTransfer* transfer, CURLcode result)
+{
+    pthread_mutex_lock(&transfers_lock);
+    transfer->result = result;
+    transfer->done = TRUE;
+    pthread_cond_broadcast(&transfers_cond);
+    pthread_mutex_unlock(&transfers_lock);
+}
+
+static void*
+_http_transfer_worker(void* data)
+{
+    while (TRUE) {
+        pthread_mutex_lock(&transfers_lock);
+        if (!running) {
+            pthread_mutex_unlock(&transfers_lock);
+            break;
+        }
+        while (g_list_length(active) < HTTP_TRANSFER_MAX_PARALLEL && !g_queue_is_empty(queued)) {
+            HTTPTransfer* transfer = g_queue_pop_head(queued);
+            curl_multi_add_handle(multi, transfer->curl);
+            active = g_list_prepend(active, transfer);
+        }
+        pthread_mutex_unlock(&transfers_lock);
+
+        int still_running = 0;
+        gint64 started = perf_start();
+        curl_multi_perform(multi, &still_running);
+        perf_stop(PERF_TRANSFER, started);
+
+        CURLMsg* msg;
+        int msgs_left = 0;
+        while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            HTTPTransfer* transfer = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&transfer);
+            CURLcode result = msg->data.result;
+            curl_multi_remove_handle(multi, msg->easy_handle);
+
+            pthread_mutex_lock(&transfers_lock);
+            active = g_list_remove(active, transfer);
+            pthread_mutex_unlock(&transfers_lock);
+
+            _http_transfer_finish(transfer, result);
+        }
+
+        struct curl_waitfd wakeup = {
+            .fd = wakeup_pipe[0],
+            .events = CURL_WAIT_POLLIN,
+            .revents = 0
+        };
+        curl_multi_wait(multi, &wakeup, 1, 1000, NULL);
+        if (wakeup.revents) {
+            char buf[64];
+            while (read(wakeup_pipe[0], buf, sizeof(buf)) > 0) {
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void
+http_transfer_init(void)
+{
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    if (pipe(wakeup_pipe) == -1) {
+        log_error("[HTTP] unable to create transfer wakeup pipe");
+        return;
+    }
+    fcntl(wakeup_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakeup_pipe[1], F_SETFL, O_NONBLOCK);
+
+    multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    queued = g_queue_new();
+    running = TRUE;
+    if (pthread_create(&worker, NULL, _http_transfer_worker, NULL) != 0) {
+        log_error("[HTTP] unable to start transfer worker");
+        running = FALSE;
+    }
+}
+
+void
+http_transfer_close(void)
+{
+    pthread_mutex_lock(&transfers_lock);
+    gboolean was_running = running;
+    running = FALSE;
+    pthread_mutex_unlock(&transfers_lock);
+
+    if (was_running) {
+        _http_transfer_wakeup();
+        pthread_join(worker, NULL);
+    }
+
+    if (multi) {
+        // let every caller still waiting return
+        HTTPTransfer* transfer;
+        while ((transfer = g_queue_pop_head(queued))) {
+            _http_transfer_finish(transfer, CURLE_ABORTED_BY_CALLBACK);
+        }
+        while (active) {
+            transfer = active->data;
+            active = g_list_delete_link(active, active);
+            curl_multi_remove_handle(multi, transfer->curl);
+            _http_transfer_finish(transfer, CURLE_ABORTED_BY_CALLBACK);
+        }
+        g_queue_free(queued);
+        queued = NULL;
+
+        curl_multi_cleanup(multi);
+        multi = NULL;
+        close(wakeup_pipe[0]);
+        close(wakeup_pipe[1]);
+    }
+
+    curl_global_cleanup();
+}
+
+CURLcode
+http_transfer_perform(CURL* curl, http_transfer_progress_func progress, void* userdata)
+{
+    CURLcode result;
+    http_transfer_perform_all(&curl, &result, 1, progress, userdata);
+
+    return result;
+}
+
+void
+http_transfer_perform_all(CURL** curls, CURLcode* results, int count, http_transfer_progress_func progress, void* userdata)
+{
+    HTTPTransfer* transfers = g_new0(HTTPTransfer, count);
+
+    for (int i = 0; i < count; i++) {
+        transfers[i].curl = curls[i];
+        transfers[i].result = CURLE_OK;
+        curl_easy_setopt(curls[i], CURLOPT_PRIVATE, &transfers[i]);
+        curl_easy_setopt(curls[i], CURLOPT_XFERINFOFUNCTION, _http_transfer_xferinfo);
+        curl_easy_setopt(curls[i], CURLOPT_XFERINFODATA, &transfers[i]);
+        curl_easy_setopt(curls[i], CURLOPT_NOPROGRESS, 0L);
+        // wait for an HTTP/2 connection to the same host instead of opening
+        // a second one
+        curl_easy_setopt(curls[i], CURLOPT_PIPEWAIT, 1L);
+    }
+
+    pthread_mutex_lock(&transfers_lock);
+    if (!running) {
+        pthread_mutex_unlock(&transfers_lock);
+        for (int i = 0; i < count; i++) {
+            results[i] = curl_easy_perform(curls[i]);
+        }
+        g_free(transfers);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        g_queue_push_tail(queued, &transfers[i]);
+    }
+    pthread_mutex_unlock(&transfers_lock);
+    _http_transfer_wakeup();
+
+    pthread_mutex_lock(&transfers_lock);
+    int done = 0;
+    while (done < count) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += HTTP_TRANSFER_PROGRESS_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&transfers_cond, &transfers_lock, &deadline);
+
+        // the caller is given the progress of all of them as one
+        curl_off_t dltotal = 0;
+        curl_off_t dlnow = 0;
+        curl_off_t ultotal = 0;
+        curl_off_t ulnow = 0;
+        done = 0;
+        for (int i = 0; i < count; i++) {
+            done += transfers[i].done ? 1 : 0;
+            dltotal += transfers[i].dltotal;
+            dlnow += transfers[i].dlnow;
+            ultotal += transfers[i].ultotal;
+            ulnow += transfers[i].ulnow;
+        }
+        if (done == count || !progress) {
+            continue;
+        }
+        pthread_mutex_unlock(&transfers_lock);
+
+        // the callback may take the global lock, never hold ours meanwhile
+        int cancel = progress(userdata, dltotal, dlnow, ultotal, ulnow);
+
+        pthread_mutex_lock(&transfers_lock);
+        if (cancel) {
+            for (int i = 0; i < count; i++) {
+                transfers[i].cancel = TRUE;
+            }
+        }
+    }
+    pthread_mutex_unlock(&transfers_lock);
+
+    for (int i = 0; i < count; i++) {
+        results[i] = transfers[i].result;
+    }
+    g_free(transfers);
+}
@@ -0,0 +1,54 @@
+/*
+ * http_transfer.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef TOOLS_HTTP_TRANSFER_H
+#define TOOLS_HTTP_TRANSFER_H
+
+#include <curl/curl.h>
+
+// Same semantics as CURLOPT_XFERINFOFUNCTION, but called on the thread
+// waiting in http_transfer_perform(), return non-zero to cancel
+typedef int (*http_transfer_progress_func)(void* userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+
+void http_transfer_init(void);
+void http_transfer_close(void);
+
+CURLcode http_transfer_perform(CURL* curl, http_transfer_progress_func progress, void* userdata);
+// Performs the transfers at the same time and returns once all of them are
+// done, progress is given their sum, results[i] is the result of curls[i]
+void http_transfer_perform_all(CURL** curls, CURLcode* results, int count, http_transfer_progress_func progress, void* userdata);
+
+#endif
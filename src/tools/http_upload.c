@@ -48,15 +48,21 @@
 #include "profanity.h"
 #include "event/client_events.h"
 #include "tools/http_upload.h"
+#include "tools/http_transfer.h"
+#include "tools/scheduler.h"
+#include "tools/workers.h"
+#include "config/accounts.h"
 #include "config/preferences.h"
 #include "ui/ui.h"
 #include "ui/window.h"
+#include "xmpp/xmpp.h"
 #include "common.h"
 
 #define FALLBACK_MIMETYPE           "application/octet-stream"
 #define FALLBACK_CONTENTTYPE_HEADER "Content-Type: application/octet-stream"
 #define FALLBACK_MSG                ""
 #define FILE_HEADER_BYTES           512
+#define UPLOAD_BUFFER_SIZE          (512 * 1024)
 
 struct curl_data_t
 {
@@ -66,50 +72,45 @@ struct curl_data_t
 
 GSList* upload_processes = NULL;
 
-static int
-_xferinfo(void* userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+// The queued uploads of /sendfile batches: waiting to request their slot,
+// waiting for the slot, and holding a slot until a transfer is free
+static GQueue upload_pending = G_QUEUE_INIT;
+static GSList* upload_requests = NULL;
+static GQueue upload_ready = G_QUEUE_INIT;
+static gboolean upload_queue_due = FALSE;
+
+// Totals of the uploads since the queue was last empty
+typedef struct upload_batch_t
 {
-    HTTPUpload* upload = (HTTPUpload*)userdata;
+    gint64 started;
+    guint64 bytes;
+    int sent;
+    int failed;
+} UploadBatch;
 
-    pthread_mutex_lock(&lock);
+static UploadBatch upload_batch = { 0, 0, 0, 0 };
 
-    if (upload->cancel) {
-        pthread_mutex_unlock(&lock);
-        return 1;
-    }
+// the queue above keeps to the account's limit, the pool needn't
+static WorkerClass* upload_workers = NULL;
 
-    if (upload->bytes_sent == ulnow) {
-        pthread_mutex_unlock(&lock);
-        return 0;
-    } else {
-        upload->bytes_sent = ulnow;
-    }
+static void _http_upload_free(HTTPUpload* upload);
+static void _http_upload_finished(void* data);
+static void _http_upload_discard(HTTPUpload* upload);
 
-    unsigned int ulperc = 0;
-    if (ultotal != 0) {
-        ulperc = (100 * ulnow) / ultotal;
-    }
+static int
+_xferinfo(void* userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    HTTPUpload* upload = (HTTPUpload*)userdata;
 
-    gchar* msg = g_strdup_printf("Uploading '%s': %d%%", upload->filename, ulperc);
-    if (!msg) {
-        msg = g_strdup(FALLBACK_MSG);
+    if (g_atomic_int_get(&upload->cancel) || workers_job_cancelled(upload->job)) {
+        return 1;
     }
-    win_update_entry_message(upload->window, upload->put_url, msg);
-    g_free(msg);
 
-    pthread_mutex_unlock(&lock);
+    http_progress_set(&upload->progress, ulnow, ultotal);
 
     return 0;
 }
 
-#if LIBCURL_VERSION_NUM < 0x072000
-static int
-_older_progress(void* p, double dltotal, double dlnow, double ultotal, double ulnow)
-{
-    return _xferinfo(p, (curl_off_t)dltotal, (curl_off_t)dlnow, (curl_off_t)ultotal, (curl_off_t)ulnow);
-}
-#endif
-
 static size_t
 _data_callback(void* ptr, size_t size, size_t nmemb, void* data)
 {
@@ -155,6 +156,103 @@ out:
     return ret;
 }
 
+// Runs on the main loop once the transfer thread is done with the upload
+static void
+_http_upload_finished(void* data)
+{
+    HTTPUpload* upload = data;
+    char* err = upload->err;
+
+    http_progress_remove(&upload->progress);
+
+    if (err || upload->cancel) {
+        upload_batch.failed++;
+    } else {
+        upload_batch.sent++;
+        upload_batch.bytes += upload->filesize;
+    }
+    upload_queue_due = TRUE;
+
+    if (err) {
+        gchar* msg;
+        if (upload->cancel) {
+            msg = g_strdup_printf("Uploading '%s' failed: Upload was canceled", upload->filename);
+            if (!msg) {
+                msg = g_strdup(FALLBACK_MSG);
+            }
+        } else {
+            msg = g_strdup_printf("Uploading '%s' failed: %s", upload->filename, err);
+            if (!msg) {
+                msg = g_strdup(FALLBACK_MSG);
+            }
+            win_update_entry_message(upload->window, upload->put_url, msg);
+        }
+        cons_show_error(msg);
+        g_free(msg);
+        free(err);
+    } else {
+        if (!upload->cancel) {
+            gchar* msg = g_strdup_printf("Uploading '%s': 100%%", upload->filename);
+            if (!msg) {
+                msg = g_strdup(FALLBACK_MSG);
+            }
+            win_update_entry_message(upload->window, upload->put_url, msg);
+            win_mark_received(upload->window, upload->put_url);
+            g_free(msg);
+
+            char* url = NULL;
+            if (format_alt_url(upload->get_url, upload->alt_scheme, upload->alt_fragment, &url) != 0) {
+                gchar* msg = g_strdup_printf("Uploading '%s' failed: Bad URL ('%s')", upload->filename, upload->get_url);
+                if (!msg) {
+                    msg = g_strdup(FALLBACK_MSG);
+                }
+                cons_show_error(msg);
+                g_free(msg);
+            } else {
+                switch (upload->window->type) {
+                case WIN_CHAT:
+                {
+                    ProfChatWin* chatwin = (ProfChatWin*)(upload->window);
+                    assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
+                    cl_ev_send_msg(chatwin, url, url);
+                    break;
+                }
+                case WIN_PRIVATE:
+                {
+                    ProfPrivateWin* privatewin = (ProfPrivateWin*)(upload->window);
+                    assert(privatewin->memcheck == PROFPRIVATEWIN_MEMCHECK);
+                    cl_ev_send_priv_msg(privatewin, url, url);
+                    break;
+                }
+                case WIN_MUC:
+                {
+                    ProfMucWin* mucwin = (ProfMucWin*)(upload->window);
+                    assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+                    cl_ev_send_muc_msg(mucwin, url, url);
+                    break;
+                }
+                default:
+                    break;
+                }
+
+                curl_free(url);
+            }
+        }
+    }
+
+    upload_processes = g_slist_remove(upload_processes, upload);
+    _http_upload_free(upload);
+}
+
+static void
+_http_upload_job(WorkerJob* job, void* data)
+{
+    HTTPUpload* upload = data;
+    upload->job = job;
+
+    http_file_put(upload);
+}
+
 void*
 http_file_put(void* userdata)
 {
@@ -172,21 +270,6 @@ http_file_put(void* userdata)
     CURL* curl;
     CURLcode res;
 
-    upload->cancel = 0;
-    upload->bytes_sent = 0;
-
-    pthread_mutex_lock(&lock);
-    gchar* msg = g_strdup_printf("Uploading '%s': 0%%", upload->filename);
-    if (!msg) {
-        msg = g_strdup(FALLBACK_MSG);
-    }
-    win_print_http_transfer(upload->window, msg, upload->put_url);
-    g_free(msg);
-
-    char* cert_path = prefs_get_string(PREF_TLS_CERTPATH);
-    pthread_mutex_unlock(&lock);
-
-    curl_global_init(CURL_GLOBAL_ALL);
     curl = curl_easy_init();
 
     curl_easy_setopt(curl, CURLOPT_URL, upload->put_url);
@@ -225,15 +308,6 @@ http_file_put(void* userdata)
 
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
-#if LIBCURL_VERSION_NUM >= 0x072000
-    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, _xferinfo);
-    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, upload);
-#else
-    curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, _older_progress);
-    curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, upload);
-#endif
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-
     struct curl_data_t output;
     output.buffer = NULL;
     output.size = 0;
@@ -244,15 +318,23 @@ http_file_put(void* userdata)
 
     fh = upload->filehandle;
 
-    if (cert_path) {
-        curl_easy_setopt(curl, CURLOPT_CAPATH, cert_path);
+    if (upload->cert_path) {
+        curl_easy_setopt(curl, CURLOPT_CAPATH, upload->cert_path);
     }
 
-    curl_easy_setopt(curl, CURLOPT_READDATA, fh);
+    if (upload->read_func) {
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, upload->read_func);
+        curl_easy_setopt(curl, CURLOPT_READDATA, upload->read_data);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_READDATA, fh);
+    }
     curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)(upload->filesize));
     curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+#if LIBCURL_VERSION_NUM >= 0x073e00
+    curl_easy_setopt(curl, CURLOPT_UPLOAD_BUFFERSIZE, (long)UPLOAD_BUFFER_SIZE);
+#endif
 
-    if ((res = curl_easy_perform(curl)) != CURLE_OK) {
+    if ((res = http_transfer_perform(curl, _xferinfo, upload)) != CURLE_OK) {
         err = strdup(curl_easy_strerror(res));
     } else {
         long http_code = 0;
@@ -275,91 +357,33 @@ http_file_put(void* userdata)
     }
 
     curl_easy_cleanup(curl);
-    curl_global_cleanup();
     curl_slist_free_all(headers);
 
     if (fh) {
         fclose(fh);
     }
+    if (upload->read_data_free) {
+        upload->read_data_free(upload->read_data);
+    }
     free(output.buffer);
     g_free(content_type_header);
     g_free(auth_header);
     g_free(cookie_header);
     g_free(expires_header);
 
-    pthread_mutex_lock(&lock);
-    g_free(cert_path);
-
-    if (err) {
-        gchar* msg;
-        if (upload->cancel) {
-            msg = g_strdup_printf("Uploading '%s' failed: Upload was canceled", upload->filename);
-            if (!msg) {
-                msg = g_strdup(FALLBACK_MSG);
-            }
-        } else {
-            msg = g_strdup_printf("Uploading '%s' failed: %s", upload->filename, err);
-            if (!msg) {
-                msg = g_strdup(FALLBACK_MSG);
-            }
-            win_update_entry_message(upload->window, upload->put_url, msg);
-        }
-        cons_show_error(msg);
-        g_free(msg);
-        free(err);
-    } else {
-        if (!upload->cancel) {
-            msg = g_strdup_printf("Uploading '%s': 100%%", upload->filename);
-            if (!msg) {
-                msg = g_strdup(FALLBACK_MSG);
-            }
-            win_update_entry_message(upload->window, upload->put_url, msg);
-            win_mark_received(upload->window, upload->put_url);
-            g_free(msg);
-
-            char* url = NULL;
-            if (format_alt_url(upload->get_url, upload->alt_scheme, upload->alt_fragment, &url) != 0) {
-                gchar* msg = g_strdup_printf("Uploading '%s' failed: Bad URL ('%s')", upload->filename, upload->get_url);
-                if (!msg) {
-                    msg = g_strdup(FALLBACK_MSG);
-                }
-                cons_show_error(msg);
-                g_free(msg);
-            } else {
-                switch (upload->window->type) {
-                case WIN_CHAT:
-                {
-                    ProfChatWin* chatwin = (ProfChatWin*)(upload->window);
-                    assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
-                    cl_ev_send_msg(chatwin, url, url);
-                    break;
-                }
-                case WIN_PRIVATE:
-                {
-                    ProfPrivateWin* privatewin = (ProfPrivateWin*)(upload->window);
-                    assert(privatewin->memcheck == PROFPRIVATEWIN_MEMCHECK);
-                    cl_ev_send_priv_msg(privatewin, url, url);
-                    break;
-                }
-                case WIN_MUC:
-                {
-                    ProfMucWin* mucwin = (ProfMucWin*)(upload->window);
-                    assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
-                    cl_ev_send_muc_msg(mucwin, url, url);
-                    break;
-                }
-                default:
-                    break;
-                }
-
-                curl_free(url);
-            }
-        }
+    upload->err = err;
+    // closing the window cancelled the transfer
+    if (workers_job_cancelled(upload->job)) {
+        g_atomic_int_set(&upload->cancel, 1);
     }
+    scheduler_post(_http_upload_finished, upload);
 
-    upload_processes = g_slist_remove(upload_processes, upload);
-    pthread_mutex_unlock(&lock);
+    return NULL;
+}
 
+static void
+_http_upload_free(HTTPUpload* upload)
+{
     free(upload->filename);
     free(upload->mime_type);
     free(upload->get_url);
@@ -369,9 +393,21 @@ http_file_put(void* userdata)
     free(upload->authorization);
     free(upload->cookie);
     free(upload->expires);
+    g_free(upload->cert_path);
     free(upload);
+}
 
-    return NULL;
+// Frees an upload which never got to its transfer
+static void
+_http_upload_discard(HTTPUpload* upload)
+{
+    if (upload->filehandle) {
+        fclose(upload->filehandle);
+    }
+    if (upload->read_data_free) {
+        upload->read_data_free(upload->read_data);
+    }
+    _http_upload_free(upload);
 }
 
 char*
@@ -406,18 +442,34 @@ file_size(int filedes)
     return st.st_size;
 }
 
+static void
+_http_upload_queue_drop_window(GQueue* queue, ProfWin* window)
+{
+    GList* curr = queue->head;
+    while (curr) {
+        GList* next = g_list_next(curr);
+        HTTPUpload* upload = curr->data;
+        if (upload->window == window) {
+            g_queue_delete_link(queue, curr);
+            _http_upload_discard(upload);
+        }
+        curr = next;
+    }
+}
+
 void
 http_upload_cancel_processes(ProfWin* window)
 {
-    GSList* upload_process = upload_processes;
-    while (upload_process) {
-        HTTPUpload* upload = upload_process->data;
+    // the transfers in progress are cancelled with their window by the
+    // worker pool, these are still waiting for their slot
+    for (GSList* curr = upload_requests; curr; curr = g_slist_next(curr)) {
+        HTTPUpload* upload = curr->data;
         if (upload->window == window) {
             upload->cancel = 1;
-            break;
         }
-        upload_process = g_slist_next(upload_process);
     }
+    _http_upload_queue_drop_window(&upload_pending, window);
+    _http_upload_queue_drop_window(&upload_ready, window);
 }
 
 void
@@ -425,3 +477,137 @@ http_upload_add_upload(HTTPUpload* upload)
 {
     upload_processes = g_slist_append(upload_processes, upload);
 }
+
+// Shows the upload in its window, the transfer thread does not touch the UI
+static void
+_http_upload_start(HTTPUpload* upload)
+{
+    gchar* msg = g_strdup_printf("Uploading '%s': 0%%", upload->filename);
+    if (!msg) {
+        msg = g_strdup(FALLBACK_MSG);
+    }
+    win_print_http_transfer(upload->window, msg, upload->put_url);
+    g_free(msg);
+
+    upload->progress.window = upload->window;
+    upload->progress.url = upload->put_url;
+    upload->progress.verb = "Uploading";
+    upload->progress.name = upload->filename;
+    http_progress_add(&upload->progress);
+
+    upload->cert_path = prefs_get_string(PREF_TLS_CERTPATH);
+}
+
+static void
+_http_upload_queue_run(void)
+{
+    guint limit = accounts_get_upload_concurrency(session_get_account_name());
+
+    while (!g_queue_is_empty(&upload_ready) && g_slist_length(upload_processes) < limit) {
+        HTTPUpload* upload = g_queue_pop_head(&upload_ready);
+        _http_upload_start(upload);
+        if (!upload_workers) {
+            upload_workers = workers_class_new("upload", WORKERS_MAX_THREADS, 1);
+        }
+        workers_submit(upload_workers, upload->window, _http_upload_job, upload);
+        http_upload_add_upload(upload);
+    }
+
+    // the slots of the next files are requested while these are transferring
+    while (!g_queue_is_empty(&upload_pending)
+           && g_slist_length(upload_requests) + g_queue_get_length(&upload_ready) < limit) {
+        HTTPUpload* upload = g_queue_pop_head(&upload_pending);
+        upload_requests = g_slist_prepend(upload_requests, upload);
+        iq_http_upload_request(upload);
+    }
+}
+
+static void
+_http_upload_queue_report(void)
+{
+    int total = upload_batch.sent + upload_batch.failed;
+    gint64 elapsed_us = MAX(g_get_monotonic_time() - upload_batch.started, 1);
+
+    // a single file shows its own progress only
+    if (total > 1) {
+        gchar* size = g_format_size(upload_batch.bytes);
+        gchar* rate = g_format_size(upload_batch.bytes * G_USEC_PER_SEC / elapsed_us);
+        cons_show("Uploaded %d of %d files, %s in %.1f s (%s/s).", upload_batch.sent, total, size,
+                  (double)elapsed_us / G_USEC_PER_SEC, rate);
+        g_free(size);
+        g_free(rate);
+    }
+
+    upload_batch = (UploadBatch){ 0, 0, 0, 0 };
+}
+
+void
+http_upload_queue_add(HTTPUpload* upload)
+{
+    if (upload_batch.started == 0) {
+        upload_batch.started = g_get_monotonic_time();
+    }
+    upload->cancel = 0;
+    g_queue_push_tail(&upload_pending, upload);
+    upload_queue_due = TRUE;
+}
+
+void
+http_upload_queue_slot_received(HTTPUpload* upload)
+{
+    upload_requests = g_slist_remove(upload_requests, upload);
+    upload_queue_due = TRUE;
+
+    // the window was closed while its slot was requested
+    if (upload->cancel) {
+        upload_batch.failed++;
+        _http_upload_discard(upload);
+        return;
+    }
+
+    g_queue_push_tail(&upload_ready, upload);
+}
+
+void
+http_upload_queue_slot_failed(HTTPUpload* upload)
+{
+    upload_requests = g_slist_remove(upload_requests, upload);
+    upload_queue_due = TRUE;
+    upload_batch.failed++;
+    _http_upload_discard(upload);
+}
+
+void
+http_upload_queue_check(void)
+{
+    if (!upload_queue_due) {
+        return;
+    }
+    upload_queue_due = FALSE;
+
+    _http_upload_queue_run();
+
+    if (upload_batch.started != 0 && g_queue_is_empty(&upload_pending) && !upload_requests
+        && g_queue_is_empty(&upload_ready) && !upload_processes) {
+        _http_upload_queue_report();
+    }
+}
+
+void
+http_upload_queue_clear(void)
+{
+    HTTPUpload* upload;
+    while ((upload = g_queue_pop_head(&upload_pending))) {
+        _http_upload_discard(upload);
+    }
+    while ((upload = g_queue_pop_head(&upload_ready))) {
+        _http_upload_discard(upload);
+    }
+    g_slist_free_full(upload_requests, (GDestroyNotify)_http_upload_discard);
+    upload_requests = NULL;
+
+    // the transfers in progress still finish and report
+    if (!upload_processes) {
+        upload_batch = (UploadBatch){ 0, 0, 0, 0 };
+    }
+}
@@ -44,21 +44,31 @@
 #include <curl/curl.h>
 
 #include "ui/win_types.h"
+#include "tools/http_common.h"
+#include "tools/workers.h"
 
 typedef struct http_upload_t
 {
     char* filename;
     FILE* filehandle;
     off_t filesize;
-    curl_off_t bytes_sent;
     char* mime_type;
     char* get_url;
     char* put_url;
     char* alt_scheme;
     char* alt_fragment;
+    // Optional source of the request body in place of reading filehandle
+    // directly, e.g. to encrypt the file on the fly (NULL to send it as is)
+    curl_read_callback read_func;
+    void* read_data;
+    void (*read_data_free)(void* read_data);
     ProfWin* window;
-    pthread_t worker;
+    WorkerJob* job;
     int cancel;
+    HTTPProgress progress;
+    // set when the transfer starts and by its thread, see http_file_put()
+    char* cert_path;
+    char* err;
     // Additional headers
     // (NULL if they shouldn't be send in the PUT)
     char* authorization;
@@ -66,6 +76,8 @@ typedef struct http_upload_t
     char* expires;
 } HTTPUpload;
 
+// Runs on a pool thread and touches neither the UI nor the session, the
+// main loop shows the result, sends the URL and frees the upload
 void* http_file_put(void* userdata);
 
 char* file_mime_type(const char* const filename);
@@ -74,4 +86,14 @@ off_t file_size(int filedes);
 void http_upload_cancel_processes(ProfWin* window);
 void http_upload_add_upload(HTTPUpload* upload);
 
+// Queues the upload of a /sendfile batch, its slot is requested once fewer
+// than the account's concurrent uploads are waiting for one or transferring
+void http_upload_queue_add(HTTPUpload* upload);
+void http_upload_queue_slot_received(HTTPUpload* upload);
+void http_upload_queue_slot_failed(HTTPUpload* upload);
+// Starts the uploads whose slots arrived and reports a finished batch
+void http_upload_queue_check(void);
+// Drops the queued uploads, their slot requests went with the connection
+void http_upload_queue_clear(void);
+
 #endif
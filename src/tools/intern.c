@@ -0,0 +1,140 @@
+/*
+ * intern.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/intern.h"
+#include "tools/memusage.h"
+
+typedef struct intern_entry_t
+{
+    guint refs;
+    char str[];
+} InternEntry;
+
+// the key is the entry's own string
+static GHashTable* strings = NULL;
+static gsize strings_bytes = 0;
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static InternEntry*
+_intern_entry(const char* const interned)
+{
+    return (InternEntry*)(interned - offsetof(InternEntry, str));
+}
+
+const char*
+intern(const char* const str)
+{
+    if (str == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&intern_lock);
+    if (!strings) {
+        strings = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+
+    InternEntry* entry = g_hash_table_lookup(strings, str);
+    if (entry) {
+        entry->refs++;
+    } else {
+        gsize size = strlen(str) + 1;
+        entry = g_malloc(sizeof(InternEntry) + size);
+        entry->refs = 1;
+        memcpy(entry->str, str, size);
+        g_hash_table_insert(strings, entry->str, entry);
+        strings_bytes += memusage_alloc(sizeof(InternEntry) + size);
+    }
+    pthread_mutex_unlock(&intern_lock);
+
+    return entry->str;
+}
+
+const char*
+intern_ref(const char* const interned)
+{
+    if (interned) {
+        pthread_mutex_lock(&intern_lock);
+        _intern_entry(interned)->refs++;
+        pthread_mutex_unlock(&intern_lock);
+    }
+
+    return interned;
+}
+
+void
+intern_unref(const char* const interned)
+{
+    if (interned == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&intern_lock);
+    InternEntry* entry = _intern_entry(interned);
+    if (--entry->refs == 0) {
+        g_hash_table_remove(strings, entry->str);
+        strings_bytes -= memusage_alloc(sizeof(InternEntry) + strlen(entry->str) + 1);
+        g_free(entry);
+    }
+    pthread_mutex_unlock(&intern_lock);
+}
+
+guint
+intern_count(void)
+{
+    pthread_mutex_lock(&intern_lock);
+    guint count = strings ? g_hash_table_size(strings) : 0;
+    pthread_mutex_unlock(&intern_lock);
+
+    return count;
+}
+
+gsize
+intern_memory(void)
+{
+    pthread_mutex_lock(&intern_lock);
+    gsize total = strings ? strings_bytes + memusage_hash_table(strings) : 0;
+    pthread_mutex_unlock(&intern_lock);
+
+    return total;
+}
@@ -0,0 +1,55 @@
+/*
+ * intern.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef TOOLS_INTERN_H
+#define TOOLS_INTERN_H
+
+#include <glib.h>
+
+// Shared read only copies of strings that repeat across modules, such as
+// jids, nicks and group names. Equal strings interned share one copy, so
+// two interned strings are equal exactly if their pointers are. Each
+// intern() or intern_ref() is undone by one intern_unref(), the copy is
+// freed with its last reference. Safe to use from any thread.
+const char* intern(const char* const str);
+const char* intern_ref(const char* const interned);
+void intern_unref(const char* const interned);
+
+guint intern_count(void);
+// heap held by the copies and the table
+gsize intern_memory(void);
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * logcompress.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "tools/logcompress.h"
+
+// runs all of the input through the converter, appending to out
+static gboolean
+_convert(GConverter* converter, const gchar* in, gsize in_len, GByteArray* out)
+{
+    guint8 buf[16384];
+    GConverterResult res;
+
+    do {
+        gsize read = 0, written = 0;
+        GError* error = NULL;
+        res = g_converter_convert(converter, in, in_len, buf, sizeof(buf), G_CONVERTER_INPUT_AT_END, &read, &written, &error);
+        if (res == G_CONVERTER_ERROR) {
+            g_error_free(error);
+            return FALSE;
+        }
+        g_byte_array_append(out, buf, written);
+        in += read;
+        in_len -= read;
+    } while (res != G_CONVERTER_FINISHED);
+
+    return TRUE;
+}
+
+static gboolean
+_read_gz(const char* const gzpath, GByteArray* out)
+{
+    gchar* contents = NULL;
+    gsize length = 0;
+    if (!g_file_get_contents(gzpath, &contents, &length, NULL)) {
+        return FALSE;
+    }
+
+    GZlibDecompressor* decompressor = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+    gboolean ok = _convert(G_CONVERTER(decompressor), contents, length, out);
+    g_object_unref(decompressor);
+    g_free(contents);
+
+    return ok;
+}
+
+gboolean
+logcompress_file(const char* const path)
+{
+    gchar* contents = NULL;
+    gsize length = 0;
+    if (!g_file_get_contents(path, &contents, &length, NULL)) {
+        return FALSE;
+    }
+
+    gchar* gzpath = g_strdup_printf("%s%s", path, LOGCOMPRESS_SUFFIX);
+    GByteArray* plain = g_byte_array_new();
+    if (g_file_test(gzpath, G_FILE_TEST_EXISTS) && !_read_gz(gzpath, plain)) {
+        // leave a damaged copy alone rather than lose what it still has
+        g_byte_array_unref(plain);
+        g_free(contents);
+        g_free(gzpath);
+        return FALSE;
+    }
+    g_byte_array_append(plain, (guint8*)contents, length);
+    g_free(contents);
+
+    GByteArray* compressed = g_byte_array_new();
+    GZlibCompressor* compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+    gboolean ok = _convert(G_CONVERTER(compressor), (gchar*)plain->data, plain->len, compressed);
+    g_object_unref(compressor);
+    g_byte_array_unref(plain);
+
+    // written next to it and renamed, the original goes only once the copy is complete
+    ok = ok && g_file_set_contents(gzpath, (gchar*)compressed->data, compressed->len, NULL);
+    if (ok) {
+        g_chmod(gzpath, S_IRUSR | S_IWUSR);
+        ok = g_unlink(path) == 0;
+    }
+    g_byte_array_unref(compressed);
+    g_free(gzpath);
+
+    return ok;
+}
+
+gboolean
+logcompress_get_contents(const char* const path, gchar** contents, gsize* length)
+{
+    gchar* gzpath = g_strdup_printf("%s%s", path, LOGCOMPRESS_SUFFIX);
+    GByteArray* out = g_byte_array_new();
+    gboolean found = g_file_test(gzpath, G_FILE_TEST_EXISTS);
+    gboolean ok = !found || _read_gz(gzpath, out);
+    g_free(gzpath);
+
+    gchar* plain = NULL;
+    gsize plain_len = 0;
+    if (ok && g_file_get_contents(path, &plain, &plain_len, NULL)) {
+        g_byte_array_append(out, (guint8*)plain, plain_len);
+        g_free(plain);
+        found = TRUE;
+    }
+
+    if (!ok || !found) {
+        g_byte_array_unref(out);
+        return FALSE;
+    }
+
+    if (length) {
+        *length = out->len;
+    }
+    // callers read it as text
+    g_byte_array_append(out, (guint8*)"", 1);
+    *contents = (gchar*)g_byte_array_free(out, FALSE);
+
+    return TRUE;
+}
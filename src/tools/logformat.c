@@ -0,0 +1,330 @@
+/*
+ * logformat.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "tools/logformat.h"
+
+/*
+ * A frame is a little endian uint32 with the raw size, another with the
+ * compressed size, then the raw deflate data. The raw data is a sequence of
+ * records starting with a type byte:
+ *
+ * string: varint length, bytes       - gets the next string id of the frame
+ * line:   varint time delta in us,   - delta to the previous line, the first
+ *         varint area id,              line of a frame is since the epoch
+ *         varint level id,
+ *         varint length, bytes
+ *
+ * String ids and times start over in every frame so each can be decoded
+ * alone, e.g. when several processes append to a shared log.
+ */
+
+#define RECORD_STRING 0
+#define RECORD_LINE   1
+
+// frames larger than this are taken to be damaged
+#define FRAME_MAX (64 * 1024 * 1024)
+
+struct logformat_encoder_t
+{
+    GByteArray* raw;
+    GHashTable* strings; // interned string -> id + 1
+    guint next_id;
+    gint64 last_time;
+};
+
+static void
+_put_varint(GByteArray* out, guint64 value)
+{
+    guint8 byte;
+    do {
+        byte = value & 0x7f;
+        value >>= 7;
+        if (value) {
+            byte |= 0x80;
+        }
+        g_byte_array_append(out, &byte, 1);
+    } while (value);
+}
+
+static gboolean
+_get_varint(const guint8** pos, const guint8* end, guint64* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64 && *pos < end; shift += 7) {
+        guint8 byte = *(*pos)++;
+        *value |= (guint64)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+_put_bytes(GByteArray* out, const char* str)
+{
+    gsize len = strlen(str);
+    _put_varint(out, len);
+    g_byte_array_append(out, (const guint8*)str, len);
+}
+
+static guint
+_string_id(LogFormatEncoder* encoder, const char* str)
+{
+    const char* interned = g_intern_string(str);
+    guint id = GPOINTER_TO_UINT(g_hash_table_lookup(encoder->strings, interned));
+    if (id) {
+        return id - 1;
+    }
+
+    guint8 type = RECORD_STRING;
+    g_byte_array_append(encoder->raw, &type, 1);
+    _put_bytes(encoder->raw, str);
+
+    id = encoder->next_id++;
+    g_hash_table_insert(encoder->strings, (gpointer)interned, GUINT_TO_POINTER(id + 1));
+
+    return id;
+}
+
+static void
+_set_uint32(guint8* bytes, guint32 value)
+{
+    bytes[0] = value & 0xff;
+    bytes[1] = (value >> 8) & 0xff;
+    bytes[2] = (value >> 16) & 0xff;
+    bytes[3] = (value >> 24) & 0xff;
+}
+
+static guint32
+_get_uint32(const guint8* bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((guint32)bytes[3] << 24);
+}
+
+// runs all of the input through the converter, appending to out
+static gboolean
+_convert(GConverter* converter, const guint8* in, gsize in_len, GByteArray* out)
+{
+    gsize start = out->len;
+    gsize room = MAX(in_len, 1024);
+    GConverterResult res;
+
+    do {
+        gsize read = 0, written = 0;
+        g_byte_array_set_size(out, start + room);
+        res = g_converter_convert(converter, in, in_len, out->data + start, room,
+                                  G_CONVERTER_INPUT_AT_END, &read, &written, NULL);
+        in += read;
+        in_len -= read;
+        start += written;
+        if (res == G_CONVERTER_ERROR) {
+            // the output did not fit, give it more room
+            room *= 2;
+        }
+    } while (res != G_CONVERTER_FINISHED && room <= FRAME_MAX);
+
+    g_byte_array_set_size(out, start);
+
+    return res == G_CONVERTER_FINISHED;
+}
+
+LogFormatEncoder*
+logformat_encoder_new(void)
+{
+    LogFormatEncoder* encoder = g_new0(LogFormatEncoder, 1);
+    encoder->raw = g_byte_array_new();
+    encoder->strings = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    return encoder;
+}
+
+void
+logformat_encoder_add(LogFormatEncoder* encoder, gint64 time_us, const char* area, const char* level, const char* msg)
+{
+    guint area_id = _string_id(encoder, area);
+    guint level_id = _string_id(encoder, level);
+
+    guint8 type = RECORD_LINE;
+    g_byte_array_append(encoder->raw, &type, 1);
+    _put_varint(encoder->raw, time_us > encoder->last_time ? time_us - encoder->last_time : 0);
+    _put_varint(encoder->raw, area_id);
+    _put_varint(encoder->raw, level_id);
+    _put_bytes(encoder->raw, msg);
+
+    encoder->last_time = MAX(time_us, encoder->last_time);
+}
+
+gsize
+logformat_encoder_pending(LogFormatEncoder* encoder)
+{
+    return encoder->raw->len;
+}
+
+GBytes*
+logformat_encoder_frame(LogFormatEncoder* encoder)
+{
+    if (encoder->raw->len == 0) {
+        return NULL;
+    }
+
+    GByteArray* frame = g_byte_array_sized_new(encoder->raw->len / 4 + 64);
+    g_byte_array_set_size(frame, 8);
+
+    GZlibCompressor* compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW, -1);
+    gboolean ok = _convert(G_CONVERTER(compressor), encoder->raw->data, encoder->raw->len, frame);
+    g_object_unref(compressor);
+
+    guint32 compressed = frame->len - 8;
+    if (!ok) {
+        // store the records as they are, a compressed size of 0 says so
+        g_byte_array_set_size(frame, 8);
+        g_byte_array_append(frame, encoder->raw->data, encoder->raw->len);
+        compressed = 0;
+    }
+    _set_uint32(frame->data, encoder->raw->len);
+    _set_uint32(frame->data + 4, compressed);
+
+    g_byte_array_set_size(encoder->raw, 0);
+    g_hash_table_remove_all(encoder->strings);
+    encoder->next_id = 0;
+    encoder->last_time = 0;
+
+    return g_byte_array_free_to_bytes(frame);
+}
+
+void
+logformat_encoder_free(LogFormatEncoder* encoder)
+{
+    if (encoder) {
+        g_byte_array_free(encoder->raw, TRUE);
+        g_hash_table_destroy(encoder->strings);
+        g_free(encoder);
+    }
+}
+
+gboolean
+logformat_read_magic(FILE* in)
+{
+    char magic[LOGFORMAT_MAGIC_LEN];
+    return fread(magic, 1, LOGFORMAT_MAGIC_LEN, in) == LOGFORMAT_MAGIC_LEN
+           && memcmp(magic, LOGFORMAT_MAGIC, LOGFORMAT_MAGIC_LEN) == 0;
+}
+
+static gboolean
+_decode_records(const guint8* pos, const guint8* end, logformat_line_func func, void* userdata)
+{
+    GPtrArray* strings = g_ptr_array_new_with_free_func(g_free);
+    gint64 time_us = 0;
+    gboolean ok = TRUE;
+
+    while (ok && pos < end) {
+        guint8 type = *pos++;
+        guint64 len, delta, area, level;
+
+        if (type == RECORD_STRING) {
+            ok = _get_varint(&pos, end, &len) && len <= (guint64)(end - pos);
+            if (ok) {
+                g_ptr_array_add(strings, g_strndup((const char*)pos, len));
+                pos += len;
+            }
+        } else if (type == RECORD_LINE) {
+            ok = _get_varint(&pos, end, &delta) && _get_varint(&pos, end, &area)
+                 && _get_varint(&pos, end, &level) && _get_varint(&pos, end, &len)
+                 && area < strings->len && level < strings->len && len <= (guint64)(end - pos);
+            if (ok) {
+                time_us += delta;
+                gchar* msg = g_strndup((const char*)pos, len);
+                func(time_us, g_ptr_array_index(strings, area), g_ptr_array_index(strings, level), msg, userdata);
+                g_free(msg);
+                pos += len;
+            }
+        } else {
+            ok = FALSE;
+        }
+    }
+
+    g_ptr_array_free(strings, TRUE);
+
+    return ok;
+}
+
+gboolean
+logformat_read_frame(FILE* in, logformat_line_func func, void* userdata)
+{
+    guint8 header[8];
+    if (fread(header, 1, 8, in) != 8) {
+        return FALSE;
+    }
+
+    guint32 raw_len = _get_uint32(header);
+    guint32 stored_len = _get_uint32(header + 4);
+    gsize read_len = stored_len ? stored_len : raw_len;
+    if (raw_len > FRAME_MAX || read_len > FRAME_MAX) {
+        return FALSE;
+    }
+
+    guint8* stored = g_malloc(read_len);
+    if (fread(stored, 1, read_len, in) != read_len) {
+        g_free(stored);
+        return FALSE;
+    }
+
+    GByteArray* raw = g_byte_array_new();
+    gboolean ok = TRUE;
+    if (stored_len) {
+        GZlibDecompressor* decompressor = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW);
+        ok = _convert(G_CONVERTER(decompressor), stored, stored_len, raw) && raw->len == raw_len;
+        g_object_unref(decompressor);
+    } else {
+        g_byte_array_append(raw, stored, raw_len);
+    }
+    g_free(stored);
+
+    if (ok) {
+        ok = _decode_records(raw->data, raw->data + raw->len, func, userdata);
+    }
+    g_byte_array_free(raw, TRUE);
+
+    return ok;
+}
@@ -0,0 +1,64 @@
+/*
+ * logformat.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef TOOLS_LOGFORMAT_H
+#define TOOLS_LOGFORMAT_H
+
+#include <stdio.h>
+#include <glib.h>
+
+// Binary log files start with this, followed by compressed frames
+#define LOGFORMAT_MAGIC     "PRFLOG1\n"
+#define LOGFORMAT_MAGIC_LEN 8
+
+typedef struct logformat_encoder_t LogFormatEncoder;
+
+// Called for each line of a frame, time is in microseconds since the epoch
+typedef void (*logformat_line_func)(gint64 time_us, const char* area, const char* level, const char* msg, void* userdata);
+
+LogFormatEncoder* logformat_encoder_new(void);
+void logformat_encoder_add(LogFormatEncoder* encoder, gint64 time_us, const char* area, const char* level, const char* msg);
+gsize logformat_encoder_pending(LogFormatEncoder* encoder);
+// Compresses the lines added so far into one self contained frame, NULL
+// when there were none
+GBytes* logformat_encoder_frame(LogFormatEncoder* encoder);
+void logformat_encoder_free(LogFormatEncoder* encoder);
+
+gboolean logformat_read_magic(FILE* in);
+// Reads the next frame and calls func for each line in it, returns FALSE at
+// the end of the file or when the frame is damaged
+gboolean logformat_read_frame(FILE* in, logformat_line_func func, void* userdata);
+
+#endif
@@ -0,0 +1,232 @@
+/*
+ * mempool.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_MALLOC_USABLE_SIZE
+#include <malloc.h>
+#endif
+
+#include <glib.h>
+
+#include "tools/mempool.h"
+
+// classes of 16 to 4096 bytes, each keeping up to 64 KiB of freed blocks
+#define MEM_POOL_MIN_CLASS   4
+#define MEM_POOL_CLASSES     9
+#define MEM_POOL_MAX_SIZE    ((gsize)1 << (MEM_POOL_MIN_CLASS + MEM_POOL_CLASSES - 1))
+#define MEM_POOL_CLASS_CACHE (64 * 1024)
+
+typedef struct mem_pool_free_t
+{
+    struct mem_pool_free_t* next;
+} MemPoolFree;
+
+struct mem_pool_t
+{
+    pthread_mutex_t lock;
+    MemPoolFree* free_lists[MEM_POOL_CLASSES];
+    guint free_counts[MEM_POOL_CLASSES];
+    MemPoolStats stats;
+};
+
+static gsize
+_mem_pool_class_size(int class)
+{
+    return (gsize)1 << (class + MEM_POOL_MIN_CLASS);
+}
+
+// The smallest class size holds, -1 for what goes to malloc as it is
+static int
+_mem_pool_class_for_alloc(gsize size)
+{
+    if (size > MEM_POOL_MAX_SIZE) {
+        return -1;
+    }
+
+    int class = 0;
+    while (_mem_pool_class_size(class) < size) {
+        class++;
+    }
+
+    return class;
+}
+
+// The largest class a block being freed can serve, -1 if it is no use.
+// Without malloc_usable_size() the size of a block is unknown, nothing is
+// cached then.
+static int
+_mem_pool_class_for_block(void* ptr)
+{
+#ifdef HAVE_MALLOC_USABLE_SIZE
+    gsize usable = malloc_usable_size(ptr);
+    if (usable < _mem_pool_class_size(0)) {
+        return -1;
+    }
+
+    int class = MEM_POOL_CLASSES - 1;
+    while (_mem_pool_class_size(class) > usable) {
+        class--;
+    }
+
+    return class;
+#else
+    return -1;
+#endif
+}
+
+MemPool*
+mem_pool_new(void)
+{
+    MemPool* pool = g_new0(MemPool, 1);
+    pthread_mutex_init(&pool->lock, NULL);
+
+    return pool;
+}
+
+void*
+mem_pool_alloc(MemPool* pool, gsize size)
+{
+    int class = _mem_pool_class_for_alloc(size);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.allocs++;
+    if (class < 0) {
+        pool->stats.large++;
+        pthread_mutex_unlock(&pool->lock);
+        return malloc(size);
+    }
+
+    MemPoolFree* block = pool->free_lists[class];
+    if (block) {
+        pool->free_lists[class] = block->next;
+        pool->free_counts[class]--;
+        pool->stats.reused++;
+        pool->stats.cached--;
+        pool->stats.cached_bytes -= _mem_pool_class_size(class);
+        pthread_mutex_unlock(&pool->lock);
+        return block;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return malloc(_mem_pool_class_size(class));
+}
+
+void*
+mem_pool_realloc(MemPool* pool, void* ptr, gsize size)
+{
+    if (ptr == NULL) {
+        return mem_pool_alloc(pool, size);
+    }
+
+#ifdef HAVE_MALLOC_USABLE_SIZE
+    // text buffers grow in small steps, most fit the block already
+    if (size <= malloc_usable_size(ptr)) {
+        return ptr;
+    }
+#endif
+
+    return realloc(ptr, size);
+}
+
+void
+mem_pool_release(MemPool* pool, void* ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    int class = _mem_pool_class_for_block(ptr);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.frees++;
+    if (class >= 0 && (pool->free_counts[class] + 1) * _mem_pool_class_size(class) <= MEM_POOL_CLASS_CACHE) {
+        MemPoolFree* block = ptr;
+        block->next = pool->free_lists[class];
+        pool->free_lists[class] = block;
+        pool->free_counts[class]++;
+        pool->stats.cached++;
+        pool->stats.cached_bytes += _mem_pool_class_size(class);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    free(ptr);
+}
+
+void
+mem_pool_trim(MemPool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    for (int class = 0; class < MEM_POOL_CLASSES; class++) {
+        MemPoolFree* block = pool->free_lists[class];
+        while (block) {
+            MemPoolFree* next = block->next;
+            free(block);
+            block = next;
+        }
+        pool->free_lists[class] = NULL;
+        pool->free_counts[class] = 0;
+    }
+    pool->stats.cached = 0;
+    pool->stats.cached_bytes = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void
+mem_pool_get_stats(MemPool* pool, MemPoolStats* stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void
+mem_pool_free(MemPool* pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    mem_pool_trim(pool);
+    pthread_mutex_destroy(&pool->lock);
+    g_free(pool);
+}
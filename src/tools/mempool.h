@@ -0,0 +1,67 @@
+/*
+ * mempool.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef TOOLS_MEMPOOL_H
+#define TOOLS_MEMPOOL_H
+
+#include <glib.h>
+
+typedef struct mem_pool_t MemPool;
+
+typedef struct mem_pool_stats_t
+{
+    guint64 allocs;
+    // of allocs, those served by a block freed before
+    guint64 reused;
+    guint64 frees;
+    guint64 large;
+    guint cached;
+    gsize cached_bytes;
+} MemPoolStats;
+
+// Size classes of freed blocks kept for the next allocation of their size.
+// The blocks are plain malloc blocks: one handed out by the pool may be
+// freed with free(), and the pool takes back any malloc block.
+MemPool* mem_pool_new(void);
+void* mem_pool_alloc(MemPool* pool, gsize size);
+void* mem_pool_realloc(MemPool* pool, void* ptr, gsize size);
+void mem_pool_release(MemPool* pool, void* ptr);
+// gives the cached blocks back to malloc
+void mem_pool_trim(MemPool* pool);
+void mem_pool_get_stats(MemPool* pool, MemPoolStats* stats);
+void mem_pool_free(MemPool* pool);
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * memtrim.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_MALLOC_TRIM
+#include <malloc.h>
+#endif
+
+#include <glib.h>
+
+#include "log.h"
+#include "database.h"
+#include "config/color.h"
+#include "config/preferences.h"
+#include "tools/memtrim.h"
+#include "tools/memusage.h"
+#include "tools/scheduler.h"
+#include "ui/ui.h"
+#include "ui/window_list.h"
+#include "xmpp/jid.h"
+#include "xmpp/roster_list.h"
+#include "xmpp/xmpp.h"
+
+#define MEMTRIM_CHECK_MS 60000
+
+static SchedulerTask* check_task = NULL;
+// trimmed during this idle time, nothing is freed again until the next input
+static gboolean trimmed = FALSE;
+
+static gboolean
+_memtrim_check(void* data)
+{
+    gint idle_min = prefs_get_trim_idle();
+    if (idle_min <= 0 || ui_get_idle_time() < (unsigned long)idle_min * 60000) {
+        trimmed = FALSE;
+    } else if (!trimmed) {
+        memtrim_run();
+        trimmed = TRUE;
+    }
+
+    return TRUE;
+}
+
+void
+memtrim_init(void)
+{
+    if (!check_task) {
+        check_task = scheduler_add(MEMTRIM_CHECK_MS, _memtrim_check, NULL, NULL);
+    }
+}
+
+gsize
+memtrim_run(void)
+{
+    gint64 started = g_get_monotonic_time();
+    gsize before = memusage_resident();
+
+    // the pads of hidden windows shrink to a line, their wrapped lines go
+    wins_hibernate_idle(TRUE);
+    rosterwin_clear_cache();
+    caps_trim();
+    roster_trim();
+    jid_cache_clear();
+    color_hash_cache_trim();
+    log_database_trim();
+    connection_trim_alloc();
+#ifdef HAVE_MALLOC_TRIM
+    malloc_trim(0);
+#endif
+
+    gsize after = memusage_resident();
+    gsize released = before > after ? before - after : 0;
+    log_info("Trimmed memory in %" G_GINT64_FORMAT " ms, resident set %" G_GSIZE_FORMAT " KiB, %" G_GSIZE_FORMAT " KiB released",
+             (g_get_monotonic_time() - started) / 1000, after / 1024, released / 1024);
+
+    return released;
+}
+
+void
+memtrim_close(void)
+{
+    scheduler_remove(check_task);
+    check_task = NULL;
+    trimmed = FALSE;
+}
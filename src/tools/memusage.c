@@ -0,0 +1,178 @@
+/*
+ * memusage.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "tools/memusage.h"
+
+gsize
+memusage_alloc(gsize size)
+{
+    return size + MEMUSAGE_OVERHEAD;
+}
+
+gsize
+memusage_string(const char* const str)
+{
+    return str ? memusage_alloc(strlen(str) + 1) : 0;
+}
+
+gsize
+memusage_hash_table(GHashTable* table)
+{
+    if (!table) {
+        return 0;
+    }
+
+    // glib keeps a power of two slots of hash, key and value, at most 3/4 used
+    guint size = g_hash_table_size(table);
+    gsize slots = 8;
+    while (slots * 3 / 4 < size) {
+        slots *= 2;
+    }
+
+    return memusage_alloc(96) + 3 * memusage_alloc(slots * sizeof(gpointer));
+}
+
+gsize
+memusage_list(GList* list)
+{
+    return g_list_length(list) * sizeof(GList);
+}
+
+gsize
+memusage_slist(GSList* list)
+{
+    return g_slist_length(list) * sizeof(GSList);
+}
+
+gsize
+memusage_sequence(GSequence* seq)
+{
+    if (!seq) {
+        return 0;
+    }
+
+    // a tree node per item plus the end node, five words each
+    return memusage_alloc(3 * sizeof(gpointer)) + (g_sequence_get_length(seq) + 1) * 5 * sizeof(gpointer);
+}
+
+gsize
+memusage_date_time(GDateTime* datetime)
+{
+    // the time zone is shared
+    return datetime ? 32 : 0;
+}
+
+gsize
+memusage_resident(void)
+{
+#ifdef __linux__
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return 0;
+    }
+
+    unsigned long size = 0, resident = 0;
+    int fields = fscanf(statm, "%lu %lu", &size, &resident);
+    fclose(statm);
+
+    return fields == 2 ? (gsize)resident * sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+static void
+_consumer_clear(MemConsumer* consumer)
+{
+    g_free(consumer->name);
+}
+
+GArray*
+memusage_report_new(void)
+{
+    GArray* report = g_array_new(FALSE, FALSE, sizeof(MemConsumer));
+    g_array_set_clear_func(report, (GDestroyNotify)_consumer_clear);
+
+    return report;
+}
+
+void
+memusage_report_add(GArray* report, const char* const name, gsize bytes, guint count)
+{
+    MemConsumer consumer = { g_strdup(name), bytes, count };
+    g_array_append_val(report, consumer);
+}
+
+static gint
+_cmp_consumers(gconstpointer a, gconstpointer b)
+{
+    const MemConsumer* ca = a;
+    const MemConsumer* cb = b;
+    if (ca->bytes != cb->bytes) {
+        return ca->bytes > cb->bytes ? -1 : 1;
+    }
+
+    return g_strcmp0(ca->name, cb->name);
+}
+
+void
+memusage_report_sort(GArray* report)
+{
+    g_array_sort(report, _cmp_consumers);
+}
+
+gsize
+memusage_report_total(GArray* report)
+{
+    gsize total = 0;
+    for (guint i = 0; i < report->len; i++) {
+        total += g_array_index(report, MemConsumer, i).bytes;
+    }
+
+    return total;
+}
+
+void
+memusage_report_free(GArray* report)
+{
+    g_array_free(report, TRUE);
+}
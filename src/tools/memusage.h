@@ -0,0 +1,73 @@
+/*
+ * memusage.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef TOOLS_MEMUSAGE_H
+#define TOOLS_MEMUSAGE_H
+
+#include <glib.h>
+
+// Rough heap use of the structures modules keep, for '/perf mem'. Every
+// allocation is counted with the usual malloc overhead, memory a structure
+// shares with others (interned strings, autocompleters) is left out.
+#define MEMUSAGE_OVERHEAD 16
+
+gsize memusage_alloc(gsize size);
+gsize memusage_string(const char* const str);
+// the table and its slots, not the keys and values
+gsize memusage_hash_table(GHashTable* table);
+gsize memusage_list(GList* list);
+gsize memusage_slist(GSList* list);
+gsize memusage_sequence(GSequence* seq);
+gsize memusage_date_time(GDateTime* datetime);
+
+// resident set size of the process, 0 where the system does not tell
+gsize memusage_resident(void);
+
+typedef struct mem_consumer_t
+{
+    gchar* name;
+    gsize bytes;
+    // what count means depends on the consumer, 0 if it has none
+    guint count;
+} MemConsumer;
+
+// Consumers of memory, largest first once sorted
+GArray* memusage_report_new(void);
+void memusage_report_add(GArray* report, const char* const name, gsize bytes, guint count);
+void memusage_report_sort(GArray* report);
+gsize memusage_report_total(GArray* report);
+void memusage_report_free(GArray* report);
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * multimatch.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/multimatch.h"
+
+#define MULTIMATCH_ROOT 0
+
+typedef struct multimatch_node_t
+{
+    // pattern ending here, or -1
+    gint pattern;
+    // longest proper suffix that is also a pattern prefix
+    guint fail;
+    // nearest node along the fail links where a pattern ends, root if none
+    guint output;
+} MultiMatchNode;
+
+struct multimatch_t
+{
+    guint count;
+    gsize* lengths;
+    // bytes not in any pattern share class 0 and lead back to the root
+    guint16 byte_class[256];
+    guint classes;
+    GArray* nodes;
+    // the complete transition table, nodes x classes
+    GArray* delta;
+};
+
+static guint
+_multimatch_node_new(MultiMatch* matcher)
+{
+    MultiMatchNode node = { -1, MULTIMATCH_ROOT, MULTIMATCH_ROOT };
+    g_array_append_val(matcher->nodes, node);
+
+    gint none = -1;
+    for (guint c = 0; c < matcher->classes; c++) {
+        g_array_append_val(matcher->delta, none);
+    }
+
+    return matcher->nodes->len - 1;
+}
+
+static gint*
+_multimatch_edge(const MultiMatch* const matcher, guint node, guint byte_class)
+{
+    return &g_array_index(matcher->delta, gint, node * matcher->classes + byte_class);
+}
+
+static MultiMatchNode*
+_multimatch_node(const MultiMatch* const matcher, guint node)
+{
+    return &g_array_index(matcher->nodes, MultiMatchNode, node);
+}
+
+MultiMatch*
+multimatch_new(const gchar* const* patterns, guint count)
+{
+    MultiMatch* matcher = g_new0(MultiMatch, 1);
+    matcher->count = count;
+    matcher->lengths = g_new0(gsize, count);
+
+    matcher->classes = 1;
+    for (guint i = 0; i < count; i++) {
+        matcher->lengths[i] = strlen(patterns[i]);
+        for (const guchar* b = (const guchar*)patterns[i]; *b; b++) {
+            if (matcher->byte_class[*b] == 0) {
+                matcher->byte_class[*b] = matcher->classes++;
+            }
+        }
+    }
+
+    matcher->nodes = g_array_new(FALSE, FALSE, sizeof(MultiMatchNode));
+    matcher->delta = g_array_new(FALSE, FALSE, sizeof(gint));
+    _multimatch_node_new(matcher);
+
+    // the trie, a repeated pattern keeps its first index
+    for (guint i = 0; i < count; i++) {
+        if (matcher->lengths[i] == 0) {
+            continue;
+        }
+
+        guint node = MULTIMATCH_ROOT;
+        for (const guchar* b = (const guchar*)patterns[i]; *b; b++) {
+            gint* edge = _multimatch_edge(matcher, node, matcher->byte_class[*b]);
+            if (*edge == -1) {
+                guint child = _multimatch_node_new(matcher);
+                // the array may have moved
+                edge = _multimatch_edge(matcher, node, matcher->byte_class[*b]);
+                *edge = child;
+            }
+            node = *edge;
+        }
+
+        MultiMatchNode* end = _multimatch_node(matcher, node);
+        if (end->pattern == -1) {
+            end->pattern = i;
+        }
+    }
+
+    // breadth first, turning the trie into a full automaton
+    GQueue* queue = g_queue_new();
+    for (guint c = 0; c < matcher->classes; c++) {
+        gint* edge = _multimatch_edge(matcher, MULTIMATCH_ROOT, c);
+        if (*edge == -1) {
+            *edge = MULTIMATCH_ROOT;
+        } else {
+            g_queue_push_tail(queue, GUINT_TO_POINTER(*edge));
+        }
+    }
+
+    while (!g_queue_is_empty(queue)) {
+        guint node = GPOINTER_TO_UINT(g_queue_pop_head(queue));
+        guint fail = _multimatch_node(matcher, node)->fail;
+
+        for (guint c = 0; c < matcher->classes; c++) {
+            gint* edge = _multimatch_edge(matcher, node, c);
+            gint fail_next = *_multimatch_edge(matcher, fail, c);
+            if (*edge == -1) {
+                *edge = fail_next;
+                continue;
+            }
+
+            MultiMatchNode* child = _multimatch_node(matcher, *edge);
+            MultiMatchNode* child_fail = _multimatch_node(matcher, fail_next);
+            child->fail = fail_next;
+            child->output = child_fail->pattern != -1 ? (guint)fail_next : child_fail->output;
+            g_queue_push_tail(queue, GINT_TO_POINTER(*edge));
+        }
+    }
+    g_queue_free(queue);
+
+    return matcher;
+}
+
+void
+multimatch_scan(const MultiMatch* const matcher, const char* const text, MultiMatchFunc func, void* userdata)
+{
+    if (matcher == NULL || text == NULL) {
+        return;
+    }
+
+    guint state = MULTIMATCH_ROOT;
+    for (gsize i = 0; text[i] != '\0'; i++) {
+        state = *_multimatch_edge(matcher, state, matcher->byte_class[(guchar)text[i]]);
+
+        guint node = state;
+        while (node != MULTIMATCH_ROOT) {
+            MultiMatchNode* curr = _multimatch_node(matcher, node);
+            if (curr->pattern != -1) {
+                gsize len = matcher->lengths[curr->pattern];
+                if (!func(curr->pattern, i + 1 - len, len, userdata)) {
+                    return;
+                }
+            }
+            node = curr->output;
+        }
+    }
+}
+
+guint
+multimatch_count(const MultiMatch* const matcher)
+{
+    return matcher ? matcher->count : 0;
+}
+
+void
+multimatch_free(MultiMatch* matcher)
+{
+    if (matcher == NULL) {
+        return;
+    }
+
+    g_free(matcher->lengths);
+    g_array_free(matcher->nodes, TRUE);
+    g_array_free(matcher->delta, TRUE);
+    g_free(matcher);
+}
@@ -0,0 +1,55 @@
+/*
+ * multimatch.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef TOOLS_MULTIMATCH_H
+#define TOOLS_MULTIMATCH_H
+
+#include <glib.h>
+
+typedef struct multimatch_t MultiMatch;
+
+// called for each occurrence with the index of the pattern and its byte
+// offset in the text, return FALSE to stop the scan
+typedef gboolean (*MultiMatchFunc)(guint pattern, gsize start, gsize len, void* userdata);
+
+// An Aho-Corasick automaton over the given patterns, matching bytes exactly.
+// Empty patterns never match.
+MultiMatch* multimatch_new(const gchar* const* patterns, guint count);
+void multimatch_scan(const MultiMatch* const matcher, const char* const text, MultiMatchFunc func, void* userdata);
+guint multimatch_count(const MultiMatch* const matcher);
+void multimatch_free(MultiMatch* matcher);
+
+#endif
@@ -42,6 +42,24 @@
 
 #include "common.h"
 
+// Copies one unquoted token, quotes inside it are dropped
+static gchar*
+_parse_plain_token(const char* start, const char* end)
+{
+    gchar* token = g_malloc(end - start + 1);
+    gchar* out = token;
+    for (const char* p = start; p < end; p++) {
+        if (*p != '"') {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+
+    return token;
+}
+
+// Splits the input in one pass over its bytes, the separators (space and
+// double quote) are ASCII so UTF-8 sequences never need decoding
 static gchar**
 _parse_args_helper(const char* const inp, int min, int max, gboolean* result, gboolean with_freetext)
 {
@@ -50,117 +68,62 @@ _parse_args_helper(const char* const inp, int min, int max, gboolean* result, gb
         return NULL;
     }
 
-    // copy and strip input of leading/trailing whitespace
-    char* copy = strdup(inp);
-    g_strstrip(copy);
+    // ignore leading/trailing whitespace
+    const char* start = inp;
+    while (g_ascii_isspace(*start)) {
+        start++;
+    }
+    const char* end = start + strlen(start);
+    while (end > start && g_ascii_isspace(end[-1])) {
+        end--;
+    }
 
-    int inp_size = g_utf8_strlen(copy, -1);
-    gboolean in_token = FALSE;
-    gboolean in_freetext = FALSE;
-    gboolean in_quotes = FALSE;
-    char* token_start = &copy[0];
-    int token_size = 0;
-    int num_tokens = 0;
-    GSList* tokens = NULL;
-
-    // add tokens to GSList
-    for (int i = 0; i < inp_size; i++) {
-        gchar* curr_ch = g_utf8_offset_to_pointer(copy, i);
-        gunichar curr_uni = g_utf8_get_char(curr_ch);
-
-        if (!in_token) {
-            if (curr_uni == ' ') {
-                continue;
-            } else {
-                in_token = TRUE;
-                if (with_freetext) {
-                    num_tokens++;
-                }
-                if (with_freetext && (num_tokens == max + 1) && (curr_uni != '"')) {
-                    in_freetext = TRUE;
-                } else if (curr_uni == '"') {
-                    in_quotes = TRUE;
-                    i++;
-                    gchar* next_ch = g_utf8_next_char(curr_ch);
-                    gunichar next_uni = g_utf8_get_char(next_ch);
-                    token_start = next_ch;
-                    token_size += g_unichar_to_utf8(next_uni, NULL);
-                }
-                if (curr_uni == '"') {
-                    gchar* next_ch = g_utf8_next_char(curr_ch);
-                    token_start = next_ch;
-                } else {
-                    token_start = curr_ch;
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
-                }
-            }
+    // the command itself is the first token
+    GPtrArray* tokens = g_ptr_array_new();
+    const char* curr = start;
+    while (curr < end) {
+        if (*curr == ' ') {
+            curr++;
+            continue;
+        }
+
+        if (with_freetext && tokens->len == max && *curr != '"') {
+            g_ptr_array_add(tokens, g_strndup(curr, end - curr));
+            break;
+        }
+
+        if (*curr == '"') {
+            const char* close = memchr(curr + 1, '"', end - curr - 1);
+            const char* token_end = close ? close : end;
+            g_ptr_array_add(tokens, g_strndup(curr + 1, token_end - curr - 1));
+            curr = close ? close + 1 : end;
         } else {
-            if (in_quotes) {
-                if (curr_uni == '"') {
-                    tokens = g_slist_append(tokens, g_strndup(token_start,
-                                                              token_size));
-                    token_size = 0;
-                    in_token = FALSE;
-                    in_quotes = FALSE;
-                } else {
-                    if (curr_uni != '"') {
-                        token_size += g_unichar_to_utf8(curr_uni, NULL);
-                    }
-                }
-            } else {
-                if (with_freetext && in_freetext) {
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
-                } else if (curr_uni == ' ') {
-                    tokens = g_slist_append(tokens, g_strndup(token_start,
-                                                              token_size));
-                    token_size = 0;
-                    in_token = FALSE;
-                } else if (curr_uni != '"') {
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
-                }
+            const char* token_end = memchr(curr, ' ', end - curr);
+            if (!token_end) {
+                token_end = end;
             }
+            g_ptr_array_add(tokens, _parse_plain_token(curr, token_end));
+            curr = token_end;
         }
     }
 
-    if (in_token) {
-        tokens = g_slist_append(tokens, g_strndup(token_start, token_size));
-    }
-
-    free(copy);
-
-    int num = g_slist_length(tokens) - 1;
+    int num = (int)tokens->len - 1;
 
     // if num args not valid return NULL
     if ((num < min) || (num > max)) {
-        g_slist_free_full(tokens, free);
+        g_ptr_array_set_free_func(tokens, g_free);
+        g_ptr_array_free(tokens, TRUE);
         *result = FALSE;
         return NULL;
+    }
 
-        // if min allowed is 0 and 0 found, return empty char* array
-    } else if (min == 0 && num == 0) {
-        g_slist_free_full(tokens, free);
-        gchar** args = g_malloc((num + 1) * sizeof(*args));
-        args[0] = NULL;
-        *result = TRUE;
-        return args;
+    // hand the arguments over without copying them
+    g_free(g_ptr_array_index(tokens, 0));
+    g_ptr_array_remove_index(tokens, 0);
+    g_ptr_array_add(tokens, NULL);
+    *result = TRUE;
 
-        // otherwise return args array
-    } else {
-        gchar** args = g_malloc((num + 1) * sizeof(*args));
-        GSList* token = tokens;
-        token = g_slist_next(token);
-        int arg_count = 0;
-
-        while (token) {
-            args[arg_count++] = strdup(token->data);
-            token = g_slist_next(token);
-        }
-
-        args[arg_count] = NULL;
-        g_slist_free_full(tokens, free);
-        *result = TRUE;
-        return args;
-    }
+    return (gchar**)g_ptr_array_free(tokens, FALSE);
 }
 
 /*
@@ -253,27 +216,18 @@ parse_args_as_one(const char* const inp, int min, int max, gboolean* result)
 int
 count_tokens(const char* const string)
 {
-    int length = g_utf8_strlen(string, -1);
     gboolean in_quotes = FALSE;
-    int num_tokens = 0;
 
     // include first token
-    num_tokens++;
+    int num_tokens = 1;
 
-    for (int i = 0; i < length; i++) {
-        gchar* curr_ch = g_utf8_offset_to_pointer(string, i);
-        gunichar curr_uni = g_utf8_get_char(curr_ch);
-
-        if (curr_uni == ' ') {
+    for (const char* curr = string; *curr; curr++) {
+        if (*curr == ' ') {
             if (!in_quotes) {
                 num_tokens++;
             }
-        } else if (curr_uni == '"') {
-            if (in_quotes) {
-                in_quotes = FALSE;
-            } else {
-                in_quotes = TRUE;
-            }
+        } else if (*curr == '"') {
+            in_quotes = !in_quotes;
         }
     }
 
@@ -283,102 +237,44 @@ count_tokens(const char* const string)
 char*
 get_start(const char* const string, int tokens)
 {
-    GString* result = g_string_new("");
-    int length = g_utf8_strlen(string, -1);
     gboolean in_quotes = FALSE;
-    char* result_str = NULL;
-    int num_tokens = 0;
 
     // include first token
-    num_tokens++;
-
-    for (int i = 0; i < length; i++) {
-        gchar* curr_ch = g_utf8_offset_to_pointer(string, i);
-        gunichar curr_uni = g_utf8_get_char(curr_ch);
-
-        if (num_tokens < tokens) {
-            gchar* uni_char = g_malloc(7);
-            int len = g_unichar_to_utf8(curr_uni, uni_char);
-            uni_char[len] = '\0';
-            g_string_append(result, uni_char);
-            g_free(uni_char);
-        }
-        if (curr_uni == ' ') {
+    int num_tokens = 1;
+
+    const char* curr = string;
+    for (; *curr && num_tokens < tokens; curr++) {
+        if (*curr == ' ') {
             if (!in_quotes) {
                 num_tokens++;
             }
-        } else if (curr_uni == '"') {
-            if (in_quotes) {
-                in_quotes = FALSE;
-            } else {
-                in_quotes = TRUE;
-            }
+        } else if (*curr == '"') {
+            in_quotes = !in_quotes;
         }
     }
 
-    result_str = result->str;
-    g_string_free(result, FALSE);
-
-    return result_str;
+    return g_strndup(string, curr - string);
 }
 
 GHashTable*
 parse_options(gchar** args, gchar** opt_keys, gboolean* res)
 {
-    GList* keys = NULL;
-    for (int i = 0; i < g_strv_length(opt_keys); i++) {
-        keys = g_list_append(keys, opt_keys[i]);
-    }
-
-    GHashTable* options = NULL;
-
-    // no options found, success
-    if (args[0] == NULL) {
-        options = g_hash_table_new(g_str_hash, g_str_equal);
-        *res = TRUE;
-        g_list_free(keys);
-        return options;
-    }
-
-    // validate options
-    GList* found_keys = NULL;
-    for (int curr = 0; curr < g_strv_length(args); curr += 2) {
-        // check if option valid
-        if (g_list_find_custom(keys, args[curr], (GCompareFunc)g_strcmp0) == NULL) {
+    GHashTable* options = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (int curr = 0; args[curr] != NULL; curr += 2) {
+        // the option must be known, not given before and have a value
+        if (!g_strv_contains((const gchar* const*)opt_keys, args[curr])
+            || g_hash_table_contains(options, args[curr])
+            || args[curr + 1] == NULL) {
+            g_hash_table_destroy(options);
             *res = FALSE;
-            g_list_free(found_keys);
-            g_list_free(keys);
-            return options;
+            return NULL;
         }
 
-        // check if duplicate
-        if (g_list_find_custom(found_keys, args[curr], (GCompareFunc)g_strcmp0)) {
-            *res = FALSE;
-            g_list_free(found_keys);
-            g_list_free(keys);
-            return options;
-        }
-
-        // check value given
-        if (args[curr + 1] == NULL) {
-            *res = FALSE;
-            g_list_free(found_keys);
-            g_list_free(keys);
-            return options;
-        }
-
-        found_keys = g_list_append(found_keys, args[curr]);
-    }
-    g_list_free(found_keys);
-    g_list_free(keys);
-
-    // create map
-    options = g_hash_table_new(g_str_hash, g_str_equal);
-    *res = TRUE;
-    for (int curr = 0; curr < g_strv_length(args); curr += 2) {
         g_hash_table_insert(options, args[curr], args[curr + 1]);
     }
 
+    *res = TRUE;
     return options;
 }
 
@@ -0,0 +1,499 @@
+/*
+ * perf.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "log.h"
+#include "tools/perf.h"
+#include "tools/scheduler.h"
+
+// latencies go into log-linear buckets, four per power of two, so
+// percentiles are within 25% of the real value without keeping samples
+#define PERF_SUB_BUCKETS 4
+#define PERF_BUCKETS     120
+
+// trace events are written out once this much is buffered
+#define PERF_TRACE_BUFFER (64 * 1024)
+
+#define PERF_ACTIVE_COUNT 1
+#define PERF_ACTIVE_TRACE 2
+
+typedef struct perf_section_stats_t
+{
+    guint64 count;
+    gint64 total_us;
+    gint64 max_us;
+    guint64 buckets[PERF_BUCKETS];
+} PerfSectionStats;
+
+static const char* const section_names[PERF_SECTION_COUNT] = {
+    [PERF_EVENTS] = "events",
+    [PERF_UI_UPDATE] = "ui_update",
+    [PERF_DOUPDATE] = "doupdate",
+    [PERF_REDRAW] = "redraw",
+    [PERF_MESSAGE] = "message",
+    [PERF_PRESENCE] = "presence",
+    [PERF_IQ] = "iq",
+    [PERF_DATABASE] = "database",
+    [PERF_PLUGINS] = "plugins",
+    [PERF_INPUT] = "input",
+    [PERF_TRANSFER] = "transfer",
+    [PERF_MSG_CLASSIFY] = "msg_classify",
+    [PERF_MSG_DECRYPT] = "msg_decrypt",
+    [PERF_MSG_DEDUPE] = "msg_dedupe",
+    [PERF_MSG_PERSIST] = "msg_persist",
+    [PERF_MSG_RENDER] = "msg_render",
+};
+
+static gint active = 0;
+// the database and transfer sections are recorded from worker threads
+static GMutex lock;
+static PerfSectionStats sections[PERF_SECTION_COUNT];
+static gint64 since = 0;
+
+// terminal output, only counted from the main thread
+static guint64 output_frames = 0;
+static guint64 output_bytes = 0;
+static guint64 output_max = 0;
+
+static SchedulerTask* log_task = NULL;
+static guint log_interval = 0;
+
+static FILE* trace_file = NULL;
+static char* trace_path = NULL;
+static GString* trace_buffer = NULL;
+static guint64 trace_events = 0;
+static GPrivate trace_tid = G_PRIVATE_INIT(NULL);
+static gint trace_next_tid = 0;
+
+static guint
+_perf_bucket(gint64 us)
+{
+    if (us < PERF_SUB_BUCKETS) {
+        return us < 0 ? 0 : (guint)us;
+    }
+
+    guint exp = g_bit_nth_msf((gulong)us, -1);
+    guint sub = (us >> (exp - 2)) & (PERF_SUB_BUCKETS - 1);
+    guint bucket = (exp - 1) * PERF_SUB_BUCKETS + sub;
+
+    return MIN(bucket, PERF_BUCKETS - 1);
+}
+
+static gint64
+_perf_bucket_upper(guint bucket)
+{
+    if (bucket < PERF_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    guint exp = bucket / PERF_SUB_BUCKETS + 1;
+    guint sub = bucket % PERF_SUB_BUCKETS;
+
+    return ((gint64)(PERF_SUB_BUCKETS + sub + 1) << (exp - 2)) - 1;
+}
+
+static gint64
+_perf_percentile(const PerfSectionStats* const stats, double fraction)
+{
+    if (stats->count == 0) {
+        return 0;
+    }
+
+    guint64 rank = (guint64)(fraction * stats->count);
+    if (rank >= stats->count) {
+        rank = stats->count - 1;
+    }
+
+    guint64 seen = 0;
+    for (guint i = 0; i < PERF_BUCKETS; i++) {
+        seen += stats->buckets[i];
+        if (seen > rank) {
+            return MIN(_perf_bucket_upper(i), stats->max_us);
+        }
+    }
+
+    return stats->max_us;
+}
+
+static void
+_perf_json_append(GString* json, const char* const str)
+{
+    for (const char* c = str; *c; c++) {
+        switch (*c) {
+        case '"':
+            g_string_append(json, "\\\"");
+            break;
+        case '\\':
+            g_string_append(json, "\\\\");
+            break;
+        default:
+            if ((guchar)*c < 0x20) {
+                g_string_append_printf(json, "\\u%04x", (guchar)*c);
+            } else {
+                g_string_append_c(json, *c);
+            }
+            break;
+        }
+    }
+}
+
+static void
+_perf_trace_flush(void)
+{
+    if (trace_buffer->len > 0) {
+        fwrite(trace_buffer->str, 1, trace_buffer->len, trace_file);
+        g_string_truncate(trace_buffer, 0);
+    }
+}
+
+static void
+_perf_trace_event(perf_section_t section, gint64 started, gint64 elapsed_us, const char* const name, const char* const detail)
+{
+    gint tid = GPOINTER_TO_INT(g_private_get(&trace_tid));
+    if (tid == 0) {
+        tid = g_atomic_int_add(&trace_next_tid, 1) + 1;
+        g_private_set(&trace_tid, GINT_TO_POINTER(tid));
+    }
+
+    g_mutex_lock(&lock);
+    if (trace_file) {
+        if (trace_events++ > 0) {
+            g_string_append(trace_buffer, ",\n");
+        }
+        g_string_append(trace_buffer, "{\"name\":\"");
+        _perf_json_append(trace_buffer, name ? name : section_names[section]);
+        g_string_append_printf(trace_buffer,
+                               "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%d",
+                               section_names[section], started, elapsed_us, (int)getpid(), tid);
+        if (detail) {
+            g_string_append(trace_buffer, ",\"args\":{\"detail\":\"");
+            _perf_json_append(trace_buffer, detail);
+            g_string_append(trace_buffer, "\"}");
+        }
+        g_string_append_c(trace_buffer, '}');
+
+        if (trace_buffer->len >= PERF_TRACE_BUFFER) {
+            _perf_trace_flush();
+        }
+    }
+    g_mutex_unlock(&lock);
+}
+
+void
+perf_set_enabled(gboolean enable)
+{
+    if (enable && !perf_is_enabled()) {
+        perf_reset();
+        g_atomic_int_or(&active, PERF_ACTIVE_COUNT);
+    } else if (!enable) {
+        g_atomic_int_and(&active, ~PERF_ACTIVE_COUNT);
+    }
+}
+
+gboolean
+perf_is_enabled(void)
+{
+    return (g_atomic_int_get(&active) & PERF_ACTIVE_COUNT) != 0;
+}
+
+gint64
+perf_start(void)
+{
+    if (g_atomic_int_get(&active) == 0) {
+        return 0;
+    }
+
+    return g_get_monotonic_time();
+}
+
+void
+perf_stop(perf_section_t section, gint64 started)
+{
+    perf_stop_named(section, started, NULL, NULL);
+}
+
+void
+perf_stop_named(perf_section_t section, gint64 started, const char* const name, const char* const detail)
+{
+    if (started == 0) {
+        return;
+    }
+
+    gint64 elapsed = g_get_monotonic_time() - started;
+    gint flags = g_atomic_int_get(&active);
+    if (flags & PERF_ACTIVE_COUNT) {
+        perf_record(section, elapsed);
+    }
+    if (flags & PERF_ACTIVE_TRACE) {
+        _perf_trace_event(section, started, elapsed, name, detail);
+    }
+}
+
+void
+perf_record(perf_section_t section, gint64 elapsed_us)
+{
+    if (!perf_is_enabled()) {
+        return;
+    }
+
+    g_mutex_lock(&lock);
+    PerfSectionStats* stats = &sections[section];
+    stats->count++;
+    stats->total_us += elapsed_us;
+    if (elapsed_us > stats->max_us) {
+        stats->max_us = elapsed_us;
+    }
+    stats->buckets[_perf_bucket(elapsed_us)]++;
+    g_mutex_unlock(&lock);
+}
+
+const char*
+perf_section_name(perf_section_t section)
+{
+    return section_names[section];
+}
+
+void
+perf_get_stats(perf_section_t section, PerfStats* stats)
+{
+    g_mutex_lock(&lock);
+    const PerfSectionStats* const section_stats = &sections[section];
+    stats->count = section_stats->count;
+    stats->total_us = section_stats->total_us;
+    stats->max_us = section_stats->max_us;
+    stats->p50_us = _perf_percentile(section_stats, 0.50);
+    stats->p99_us = _perf_percentile(section_stats, 0.99);
+    gint64 elapsed = g_get_monotonic_time() - since;
+    stats->rate = elapsed > 0 ? section_stats->count * (double)G_USEC_PER_SEC / elapsed : 0.0;
+    g_mutex_unlock(&lock);
+}
+
+// what this thread wrote so far according to /proc, -1 if unknown
+static gint64
+_perf_thread_written(void)
+{
+#ifdef __linux__
+    FILE* io = fopen("/proc/thread-self/io", "r");
+    if (!io) {
+        return -1;
+    }
+
+    gint64 written = -1;
+    char line[64];
+    while (fgets(line, sizeof(line), io)) {
+        if (strncmp(line, "wchar: ", 7) == 0) {
+            written = g_ascii_strtoll(line + 7, NULL, 10);
+            break;
+        }
+    }
+    fclose(io);
+
+    return written;
+#else
+    return -1;
+#endif
+}
+
+gint64
+perf_output_start(void)
+{
+    if (!perf_is_enabled()) {
+        return -1;
+    }
+
+    return _perf_thread_written();
+}
+
+void
+perf_output_stop(gint64 started)
+{
+    if (started < 0) {
+        return;
+    }
+
+    gint64 written = _perf_thread_written();
+    if (written < started) {
+        return;
+    }
+
+    guint64 bytes = written - started;
+    g_mutex_lock(&lock);
+    output_frames++;
+    output_bytes += bytes;
+    output_max = MAX(output_max, bytes);
+    g_mutex_unlock(&lock);
+}
+
+void
+perf_get_output(guint64* frames, guint64* bytes, guint64* max_bytes)
+{
+    g_mutex_lock(&lock);
+    *frames = output_frames;
+    *bytes = output_bytes;
+    *max_bytes = output_max;
+    g_mutex_unlock(&lock);
+}
+
+void
+perf_reset(void)
+{
+    g_mutex_lock(&lock);
+    memset(sections, 0, sizeof(sections));
+    output_frames = 0;
+    output_bytes = 0;
+    output_max = 0;
+    since = g_get_monotonic_time();
+    g_mutex_unlock(&lock);
+}
+
+void
+perf_log_stats(void)
+{
+    for (int i = 0; i < PERF_SECTION_COUNT; i++) {
+        PerfStats stats;
+        perf_get_stats(i, &stats);
+        if (stats.count > 0) {
+            log_info("perf: %s count=%" G_GUINT64_FORMAT " rate=%.1f/s p50=%" G_GINT64_FORMAT "us p99=%" G_GINT64_FORMAT "us max=%" G_GINT64_FORMAT "us",
+                     section_names[i], stats.count, stats.rate, stats.p50_us, stats.p99_us, stats.max_us);
+        }
+    }
+
+    guint64 frames, bytes, max_bytes;
+    perf_get_output(&frames, &bytes, &max_bytes);
+    if (frames > 0) {
+        log_info("perf: terminal frames=%" G_GUINT64_FORMAT " bytes=%" G_GUINT64_FORMAT " max=%" G_GUINT64_FORMAT,
+                 frames, bytes, max_bytes);
+    }
+}
+
+static gboolean
+_perf_log_task(void* data)
+{
+    if (perf_is_enabled()) {
+        perf_log_stats();
+    }
+
+    return TRUE;
+}
+
+void
+perf_log_every(guint interval_sec)
+{
+    log_interval = interval_sec;
+
+    if (interval_sec == 0) {
+        scheduler_remove(log_task);
+        log_task = NULL;
+    } else if (log_task) {
+        scheduler_set_interval(log_task, interval_sec * 1000);
+    } else {
+        log_task = scheduler_add(interval_sec * 1000, _perf_log_task, NULL, NULL);
+    }
+}
+
+guint
+perf_log_interval(void)
+{
+    return log_interval;
+}
+
+gboolean
+perf_trace_start(const char* const path)
+{
+    if (trace_file) {
+        return FALSE;
+    }
+
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        log_error("perf: could not open trace file %s", path);
+        return FALSE;
+    }
+
+    g_mutex_lock(&lock);
+    trace_file = file;
+    trace_path = g_strdup(path);
+    trace_buffer = g_string_sized_new(PERF_TRACE_BUFFER);
+    trace_events = 0;
+    g_string_append(trace_buffer, "[\n");
+    g_mutex_unlock(&lock);
+
+    g_atomic_int_or(&active, PERF_ACTIVE_TRACE);
+    log_info("perf: tracing to %s", path);
+
+    return TRUE;
+}
+
+void
+perf_trace_stop(void)
+{
+    g_atomic_int_and(&active, ~PERF_ACTIVE_TRACE);
+
+    g_mutex_lock(&lock);
+    if (trace_file) {
+        g_string_append(trace_buffer, "\n]\n");
+        _perf_trace_flush();
+        fclose(trace_file);
+        log_info("perf: wrote %" G_GUINT64_FORMAT " trace events to %s", trace_events, trace_path);
+        trace_file = NULL;
+        g_string_free(trace_buffer, TRUE);
+        trace_buffer = NULL;
+        g_free(trace_path);
+        trace_path = NULL;
+    }
+    g_mutex_unlock(&lock);
+}
+
+const char*
+perf_trace_path(void)
+{
+    return trace_path;
+}
+
+void
+perf_close(void)
+{
+    perf_log_every(0);
+    perf_trace_stop();
+    perf_set_enabled(FALSE);
+    perf_reset();
+}
@@ -0,0 +1,105 @@
+/*
+ * perf.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef TOOLS_PERF_H
+#define TOOLS_PERF_H
+
+#include <glib.h>
+
+typedef enum {
+    PERF_EVENTS,
+    PERF_UI_UPDATE,
+    PERF_DOUPDATE,
+    PERF_REDRAW,
+    PERF_MESSAGE,
+    PERF_PRESENCE,
+    PERF_IQ,
+    PERF_DATABASE,
+    PERF_PLUGINS,
+    PERF_INPUT,
+    PERF_TRANSFER,
+    PERF_MSG_CLASSIFY,
+    PERF_MSG_DECRYPT,
+    PERF_MSG_DEDUPE,
+    PERF_MSG_PERSIST,
+    PERF_MSG_RENDER,
+    PERF_SECTION_COUNT
+} perf_section_t;
+
+typedef struct perf_stats_t
+{
+    guint64 count;
+    gint64 total_us;
+    gint64 max_us;
+    gint64 p50_us;
+    gint64 p99_us;
+    double rate;
+} PerfStats;
+
+void perf_set_enabled(gboolean enable);
+gboolean perf_is_enabled(void);
+
+// Returns 0 while neither counting nor tracing, perf_stop() then does nothing
+gint64 perf_start(void);
+void perf_stop(perf_section_t section, gint64 started);
+// As perf_stop(), a trace shows the span as name (the section if NULL) with detail
+void perf_stop_named(perf_section_t section, gint64 started, const char* const name, const char* const detail);
+void perf_record(perf_section_t section, gint64 elapsed_us);
+
+// Bytes the calling thread wrote between the two calls count as one frame
+// of terminal output. Start returns -1 while disabled or where the system
+// does not tell, stop then does nothing.
+gint64 perf_output_start(void);
+void perf_output_stop(gint64 started);
+void perf_get_output(guint64* frames, guint64* bytes, guint64* max_bytes);
+
+const char* perf_section_name(perf_section_t section);
+void perf_get_stats(perf_section_t section, PerfStats* stats);
+void perf_reset(void);
+
+// Write a summary to the log every interval_sec seconds, 0 stops it
+void perf_log_every(guint interval_sec);
+guint perf_log_interval(void);
+void perf_log_stats(void);
+
+// Write every span to path as Chrome trace JSON until perf_trace_stop()
+gboolean perf_trace_start(const char* const path);
+void perf_trace_stop(void);
+const char* perf_trace_path(void);
+
+void perf_close(void);
+
+#endif
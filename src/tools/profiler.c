@@ -0,0 +1,369 @@
+/*
+ * profiler.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#ifdef HAVE_EXECINFO_H
+#include <execinfo.h>
+#endif
+
+#include <glib.h>
+
+#include "log.h"
+#include "tools/profiler.h"
+#include "tools/scheduler.h"
+
+static guint sample_rate = PROFILER_DEFAULT_RATE;
+
+#ifdef HAVE_EXECINFO_H
+
+// frames kept per sample, deeper stacks lose their outermost frames
+#define PROFILER_DEPTH 64
+// samples the handler can queue between two drains
+#define PROFILER_RING 4096
+// the handler's own frame and the signal trampoline
+#define PROFILER_SKIP     2
+#define PROFILER_DRAIN_MS 250
+
+typedef struct profiler_sample_t
+{
+    int depth;
+    void* frames[PROFILER_DEPTH];
+} ProfilerSample;
+
+// the handler only ever runs on the main thread, as does the drain, so the
+// ring needs no lock: the handler fills the slot at head, the drain empties
+// slots up to it and a full ring drops the sample
+static ProfilerSample* ring = NULL;
+static volatile sig_atomic_t ring_head = 0;
+static volatile sig_atomic_t ring_tail = 0;
+static volatile sig_atomic_t ring_dropped = 0;
+static pthread_t main_thread;
+
+static FILE* profile_file = NULL;
+static char* profile_path = NULL;
+static GHashTable* stacks = NULL;
+static GHashTable* symbols = NULL;
+static guint64 samples = 0;
+static SchedulerTask* drain_task = NULL;
+
+static void
+_profiler_signal(int sig)
+{
+    int saved_errno = errno;
+
+    if (!pthread_equal(pthread_self(), main_thread)) {
+        // the timer counts the CPU time of all threads, the stack wanted is
+        // the main loop's
+        pthread_kill(main_thread, SIGPROF);
+    } else if (ring) {
+        int next = (ring_head + 1) % PROFILER_RING;
+        if (next == ring_tail) {
+            ring_dropped++;
+        } else {
+            ring[ring_head].depth = backtrace(ring[ring_head].frames, PROFILER_DEPTH);
+            ring_head = next;
+        }
+    }
+
+    errno = saved_errno;
+}
+
+static char*
+_profiler_symbol(void* frame)
+{
+    char* name = g_hash_table_lookup(symbols, frame);
+    if (!name) {
+        char** symbol = backtrace_symbols(&frame, 1);
+        name = profiler_frame_name(symbol ? symbol[0] : "");
+        free(symbol);
+        g_hash_table_insert(symbols, frame, name);
+    }
+
+    return name;
+}
+
+static void
+_profiler_drain(void)
+{
+    char* names[PROFILER_DEPTH];
+
+    while (ring_tail != ring_head) {
+        ProfilerSample* sample = &ring[ring_tail];
+        int depth = 0;
+        for (int i = PROFILER_SKIP; i < sample->depth; i++) {
+            names[depth++] = _profiler_symbol(sample->frames[i]);
+        }
+        profiler_count_stack(stacks, names, depth);
+        samples++;
+        ring_tail = (ring_tail + 1) % PROFILER_RING;
+    }
+}
+
+static gboolean
+_profiler_drain_task(void* data)
+{
+    _profiler_drain();
+
+    return TRUE;
+}
+
+static void
+_profiler_timer(guint rate)
+{
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    if (rate > 0) {
+        long interval_us = 1000000 / rate;
+        timer.it_interval.tv_sec = interval_us / 1000000;
+        timer.it_interval.tv_usec = interval_us % 1000000;
+        timer.it_value = timer.it_interval;
+    }
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+#endif
+
+gboolean
+profiler_available(void)
+{
+#ifdef HAVE_EXECINFO_H
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+void
+profiler_set_rate(guint rate)
+{
+    sample_rate = CLAMP(rate, 1, PROFILER_MAX_RATE);
+#ifdef HAVE_EXECINFO_H
+    if (profile_file) {
+        _profiler_timer(sample_rate);
+    }
+#endif
+}
+
+guint
+profiler_rate(void)
+{
+    return sample_rate;
+}
+
+gboolean
+profiler_start(const char* const path)
+{
+#ifdef HAVE_EXECINFO_H
+    if (profile_file) {
+        return FALSE;
+    }
+
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        log_error("profiler: could not open profile file %s", path);
+        return FALSE;
+    }
+
+    // the first backtrace() loads the unwinder, which must not happen in
+    // the handler
+    void* frame;
+    backtrace(&frame, 1);
+
+    profile_file = file;
+    profile_path = g_strdup(path);
+    stacks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    symbols = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    samples = 0;
+    ring_head = 0;
+    ring_tail = 0;
+    ring_dropped = 0;
+    ring = g_new0(ProfilerSample, PROFILER_RING);
+    main_thread = pthread_self();
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = _profiler_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+    _profiler_timer(sample_rate);
+
+    drain_task = scheduler_add(PROFILER_DRAIN_MS, _profiler_drain_task, NULL, NULL);
+    log_info("profiler: sampling %u times a second to %s", sample_rate, path);
+
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+guint64
+profiler_stop(void)
+{
+#ifdef HAVE_EXECINFO_H
+    if (!profile_file) {
+        return 0;
+    }
+
+    // a signal still on its way from another thread must not end the
+    // process once the handler is gone
+    _profiler_timer(0);
+    signal(SIGPROF, SIG_IGN);
+    scheduler_remove(drain_task);
+    drain_task = NULL;
+    _profiler_drain();
+
+    GList* keys = g_list_sort(g_hash_table_get_keys(stacks), (GCompareFunc)g_strcmp0);
+    for (GList* curr = keys; curr; curr = g_list_next(curr)) {
+        fprintf(profile_file, "%s %u\n", (char*)curr->data, GPOINTER_TO_UINT(g_hash_table_lookup(stacks, curr->data)));
+    }
+    g_list_free(keys);
+    fclose(profile_file);
+    log_info("profiler: wrote %" G_GUINT64_FORMAT " samples to %s, %d dropped", samples, profile_path, (int)ring_dropped);
+
+    profile_file = NULL;
+    g_free(profile_path);
+    profile_path = NULL;
+    g_free(ring);
+    ring = NULL;
+    g_hash_table_destroy(stacks);
+    stacks = NULL;
+    g_hash_table_destroy(symbols);
+    symbols = NULL;
+
+    return samples;
+#else
+    return 0;
+#endif
+}
+
+const char*
+profiler_path(void)
+{
+#ifdef HAVE_EXECINFO_H
+    return profile_path;
+#else
+    return NULL;
+#endif
+}
+
+guint64
+profiler_dropped(void)
+{
+#ifdef HAVE_EXECINFO_H
+    return ring_dropped;
+#else
+    return 0;
+#endif
+}
+
+static void
+_profiler_append_name(GString* name, const char* const start, gsize len)
+{
+    for (gsize i = 0; i < len; i++) {
+        char c = start[i];
+        g_string_append_c(name, c == ';' || g_ascii_isspace(c) ? '_' : c);
+    }
+}
+
+char*
+profiler_frame_name(const char* const symbol)
+{
+    GString* name = g_string_new("");
+
+    // glibc writes "object(function+offset) [address]", with an empty
+    // function where the object does not export one
+    const char* open = strchr(symbol, '(');
+    const char* close = open ? strchr(open, ')') : NULL;
+    if (close) {
+        const char* plus = memchr(open, '+', close - open);
+        const char* end = plus ? plus : close;
+        if (end > open + 1) {
+            _profiler_append_name(name, open + 1, end - open - 1);
+        } else {
+            // addr2line resolves the object and offset
+            gchar* object = g_strndup(symbol, open - symbol);
+            gchar* base = g_path_get_basename(object);
+            _profiler_append_name(name, base, strlen(base));
+            _profiler_append_name(name, end, close - end);
+            g_free(base);
+            g_free(object);
+        }
+    } else {
+        gchar* stripped = g_strstrip(g_strdup(symbol));
+        _profiler_append_name(name, stripped, strlen(stripped));
+        g_free(stripped);
+    }
+
+    if (name->len == 0) {
+        g_string_append(name, "[unknown]");
+    }
+
+    return g_string_free(name, FALSE);
+}
+
+void
+profiler_count_stack(GHashTable* table, char** frames, int depth)
+{
+    GString* stack = g_string_new("");
+    for (int i = depth - 1; i >= 0; i--) {
+        g_string_append(stack, frames[i]);
+        if (i > 0) {
+            g_string_append_c(stack, ';');
+        }
+    }
+    if (stack->len == 0) {
+        g_string_append(stack, "[unknown]");
+    }
+
+    guint count = GPOINTER_TO_UINT(g_hash_table_lookup(table, stack->str));
+    g_hash_table_insert(table, g_string_free(stack, FALSE), GUINT_TO_POINTER(count + 1));
+}
+
+void
+profiler_close(void)
+{
+    profiler_stop();
+}
@@ -0,0 +1,68 @@
+/*
+ * profiler.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef TOOLS_PROFILER_H
+#define TOOLS_PROFILER_H
+
+#include <glib.h>
+
+#define PROFILER_DEFAULT_RATE 99
+#define PROFILER_MAX_RATE     1000
+
+// FALSE where the system can not take stack traces
+gboolean profiler_available(void);
+
+// Samples taken per second of CPU time, a running profile switches at once
+void profiler_set_rate(guint rate);
+guint profiler_rate(void);
+
+// Sample the main thread's stack until profiler_stop() writes them to path
+// as folded stacks, one "a;b;c count" line per stack as flamegraph.pl reads
+gboolean profiler_start(const char* const path);
+// Returns the number of samples written
+guint64 profiler_stop(void);
+const char* profiler_path(void);
+guint64 profiler_dropped(void);
+
+// The function name in a line of backtrace_symbols(), or the object and
+// offset where there is none, with the characters folded stacks use replaced
+char* profiler_frame_name(const char* const symbol);
+// Count one sample of frames, innermost first, in table keyed by folded stack
+void profiler_count_stack(GHashTable* table, char** frames, int depth);
+
+void profiler_close(void);
+
+#endif
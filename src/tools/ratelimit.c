@@ -0,0 +1,196 @@
+/*
+ * ratelimit.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "tools/ratelimit.h"
+#include "tools/scheduler.h"
+
+typedef struct ratelimit_bucket_t
+{
+    double tokens;
+    gint64 updated;
+    guint dropped;
+} RateLimitBucket;
+
+struct ratelimit_t
+{
+    char* name;
+    double burst;
+    // tokens added per microsecond
+    double refill;
+    ratelimit_report_func report;
+    GHashTable* buckets;
+    SchedulerTask* task;
+    guint64 allowed;
+    guint64 dropped;
+};
+
+static GPtrArray* limits = NULL;
+
+static void
+_ratelimit_free(RateLimit* limit)
+{
+    scheduler_remove(limit->task);
+    g_hash_table_destroy(limit->buckets);
+    g_free(limit->name);
+    g_free(limit);
+}
+
+static void
+_ratelimit_refill(RateLimit* limit, RateLimitBucket* bucket, gint64 now)
+{
+    bucket->tokens = MIN(limit->burst, bucket->tokens + (now - bucket->updated) * limit->refill);
+    bucket->updated = now;
+}
+
+static gboolean
+_ratelimit_report_task(void* data)
+{
+    RateLimit* limit = data;
+    ratelimit_report(limit);
+
+    if (g_hash_table_size(limit->buckets) > 0) {
+        return TRUE;
+    }
+
+    limit->task = NULL;
+    return FALSE;
+}
+
+RateLimit*
+ratelimit_new(const char* const name, guint burst, guint per_minute, ratelimit_report_func report)
+{
+    if (limits == NULL) {
+        limits = g_ptr_array_new_with_free_func((GDestroyNotify)_ratelimit_free);
+    }
+
+    RateLimit* limit = g_new0(RateLimit, 1);
+    limit->name = g_strdup(name);
+    limit->burst = MAX(burst, 1);
+    limit->refill = per_minute / (60.0 * G_USEC_PER_SEC);
+    limit->report = report;
+    limit->buckets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    g_ptr_array_add(limits, limit);
+
+    return limit;
+}
+
+gboolean
+ratelimit_allow(RateLimit* limit, const char* const key)
+{
+    gint64 now = g_get_monotonic_time();
+    RateLimitBucket* bucket = g_hash_table_lookup(limit->buckets, key);
+    if (bucket) {
+        _ratelimit_refill(limit, bucket, now);
+    } else {
+        bucket = g_new0(RateLimitBucket, 1);
+        bucket->tokens = limit->burst;
+        bucket->updated = now;
+        g_hash_table_insert(limit->buckets, g_strdup(key), bucket);
+    }
+
+    // the report task also forgets idle buckets, so it runs while any exist
+    if (limit->task == NULL) {
+        limit->task = scheduler_add(RATELIMIT_REPORT_MS, _ratelimit_report_task, limit, NULL);
+    }
+
+    if (bucket->tokens >= 1.0) {
+        bucket->tokens -= 1.0;
+        limit->allowed++;
+        return TRUE;
+    }
+
+    bucket->dropped++;
+    limit->dropped++;
+    return FALSE;
+}
+
+// Hands the drops per key to the report function and forgets keys whose
+// bucket has filled up again
+void
+ratelimit_report(RateLimit* limit)
+{
+    gint64 now = g_get_monotonic_time();
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, limit->buckets);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        RateLimitBucket* bucket = value;
+        if (bucket->dropped > 0) {
+            if (limit->report) {
+                limit->report(key, bucket->dropped);
+            }
+            bucket->dropped = 0;
+        }
+
+        _ratelimit_refill(limit, bucket, now);
+        if (bucket->tokens >= limit->burst) {
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+}
+
+guint
+ratelimit_keys(RateLimit* limit)
+{
+    return g_hash_table_size(limit->buckets);
+}
+
+guint
+ratelimits(void)
+{
+    return limits ? limits->len : 0;
+}
+
+void
+ratelimit_get_stats(guint index, const char** name, guint64* allowed, guint64* dropped)
+{
+    RateLimit* limit = g_ptr_array_index(limits, index);
+    *name = limit->name;
+    *allowed = limit->allowed;
+    *dropped = limit->dropped;
+}
+
+void
+ratelimit_close(void)
+{
+    if (limits) {
+        g_ptr_array_free(limits, TRUE);
+        limits = NULL;
+    }
+}
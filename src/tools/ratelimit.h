@@ -0,0 +1,61 @@
+/*
+ * ratelimit.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef TOOLS_RATELIMIT_H
+#define TOOLS_RATELIMIT_H
+
+#include <glib.h>
+
+// how long dropped events are collected before they are summarised
+#define RATELIMIT_REPORT_MS 5000
+
+typedef struct ratelimit_t RateLimit;
+
+// Called once per key with the number of events dropped since the last report
+typedef void (*ratelimit_report_func)(const char* const key, guint dropped);
+
+// Every key may have burst events at once, refilled at per_minute
+RateLimit* ratelimit_new(const char* const name, guint burst, guint per_minute, ratelimit_report_func report);
+gboolean ratelimit_allow(RateLimit* limit, const char* const key);
+void ratelimit_report(RateLimit* limit);
+guint ratelimit_keys(RateLimit* limit);
+
+guint ratelimits(void);
+void ratelimit_get_stats(guint index, const char** name, guint64* allowed, guint64* dropped);
+
+void ratelimit_close(void);
+
+#endif
@@ -0,0 +1,381 @@
+/*
+ * scheduler.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "tools/scheduler.h"
+
+struct scheduler_task_t
+{
+    // monotonic time in microseconds at which the task fires next
+    gint64 deadline;
+    guint interval_ms;
+    scheduler_func func;
+    void* data;
+    GDestroyNotify data_free;
+    // position in the heap, -1 while it is taken out to run
+    gint index;
+    gboolean removed;
+};
+
+typedef struct scheduler_event_t
+{
+    scheduler_event_func func;
+    void* data;
+    struct scheduler_event_t* next;
+} SchedulerEvent;
+
+// binary min-heap of tasks ordered by deadline
+static GPtrArray* heap = NULL;
+
+// Events posted by other threads, newest first. Threads push with a
+// compare-and-swap, the main loop takes the whole list at once.
+static SchedulerEvent* inbox = NULL;
+static int wakeup_pipe[2] = { -1, -1 };
+
+static void
+_task_free(SchedulerTask* task)
+{
+    if (task->data_free) {
+        task->data_free(task->data);
+    }
+    g_free(task);
+}
+
+static void
+_heap_set(guint index, SchedulerTask* task)
+{
+    g_ptr_array_index(heap, index) = task;
+    task->index = index;
+}
+
+static void
+_heap_sift_up(guint index)
+{
+    SchedulerTask* task = g_ptr_array_index(heap, index);
+    while (index > 0) {
+        guint parent = (index - 1) / 2;
+        SchedulerTask* parent_task = g_ptr_array_index(heap, parent);
+        if (parent_task->deadline <= task->deadline) {
+            break;
+        }
+        _heap_set(index, parent_task);
+        index = parent;
+    }
+    _heap_set(index, task);
+}
+
+static void
+_heap_sift_down(guint index)
+{
+    SchedulerTask* task = g_ptr_array_index(heap, index);
+    while (TRUE) {
+        guint child = 2 * index + 1;
+        if (child >= heap->len) {
+            break;
+        }
+        if (child + 1 < heap->len && ((SchedulerTask*)g_ptr_array_index(heap, child + 1))->deadline < ((SchedulerTask*)g_ptr_array_index(heap, child))->deadline) {
+            child++;
+        }
+        SchedulerTask* child_task = g_ptr_array_index(heap, child);
+        if (task->deadline <= child_task->deadline) {
+            break;
+        }
+        _heap_set(index, child_task);
+        index = child;
+    }
+    _heap_set(index, task);
+}
+
+static void
+_heap_push(SchedulerTask* task)
+{
+    if (heap == NULL) {
+        heap = g_ptr_array_new();
+    }
+    g_ptr_array_add(heap, task);
+    _heap_sift_up(heap->len - 1);
+}
+
+static void
+_heap_remove(SchedulerTask* task)
+{
+    guint index = task->index;
+    SchedulerTask* last = g_ptr_array_remove_index(heap, heap->len - 1);
+    task->index = -1;
+
+    if (last != task) {
+        _heap_set(index, last);
+        _heap_sift_down(index);
+        _heap_sift_up(last->index);
+    }
+}
+
+SchedulerTask*
+scheduler_add(guint interval_ms, scheduler_func func, void* data, GDestroyNotify data_free)
+{
+    SchedulerTask* task = g_new0(SchedulerTask, 1);
+    task->interval_ms = interval_ms;
+    task->deadline = g_get_monotonic_time() + (gint64)interval_ms * 1000;
+    task->func = func;
+    task->data = data;
+    task->data_free = data_free;
+
+    _heap_push(task);
+
+    return task;
+}
+
+void
+scheduler_remove(SchedulerTask* task)
+{
+    if (task == NULL) {
+        return;
+    }
+
+    // removed from within a callback while taken out to run, freed once
+    // scheduler_run() is done with it
+    if (task->index < 0) {
+        task->removed = TRUE;
+        return;
+    }
+
+    _heap_remove(task);
+    _task_free(task);
+}
+
+// Starts counting the interval again from now
+void
+scheduler_set_interval(SchedulerTask* task, guint interval_ms)
+{
+    task->interval_ms = interval_ms;
+    task->deadline = g_get_monotonic_time() + (gint64)interval_ms * 1000;
+
+    if (task->index >= 0) {
+        _heap_sift_down(task->index);
+        _heap_sift_up(task->index);
+    }
+}
+
+void
+scheduler_init(void)
+{
+    if (pipe(wakeup_pipe) == -1) {
+        wakeup_pipe[0] = -1;
+        wakeup_pipe[1] = -1;
+        return;
+    }
+    fcntl(wakeup_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakeup_pipe[1], F_SETFL, O_NONBLOCK);
+}
+
+int
+scheduler_wakeup_fd(void)
+{
+    return wakeup_pipe[0];
+}
+
+void
+scheduler_post(scheduler_event_func func, void* data)
+{
+    SchedulerEvent* event = g_new(SchedulerEvent, 1);
+    event->func = func;
+    event->data = data;
+
+    SchedulerEvent* head;
+    do {
+        head = g_atomic_pointer_get(&inbox);
+        event->next = head;
+    } while (!g_atomic_pointer_compare_and_exchange(&inbox, head, event));
+
+    // the main loop is woken up once until it takes the events
+    if (head == NULL && wakeup_pipe[1] >= 0) {
+        char c = 0;
+        if (write(wakeup_pipe[1], &c, 1) == -1) {
+            // pipe full, the main loop is going to wake up anyway
+        }
+    }
+}
+
+static SchedulerEvent*
+_inbox_take(void)
+{
+    // emptied before taking the events, a post after that wakes up again
+    if (wakeup_pipe[0] >= 0) {
+        char buf[64];
+        while (read(wakeup_pipe[0], buf, sizeof(buf)) > 0) {
+        }
+    }
+
+    SchedulerEvent* head;
+    do {
+        head = g_atomic_pointer_get(&inbox);
+    } while (head && !g_atomic_pointer_compare_and_exchange(&inbox, head, NULL));
+
+    // oldest first
+    SchedulerEvent* events = NULL;
+    while (head) {
+        SchedulerEvent* next = head->next;
+        head->next = events;
+        events = head;
+        head = next;
+    }
+
+    return events;
+}
+
+static void
+_events_run(void)
+{
+    if (g_atomic_pointer_get(&inbox) == NULL) {
+        return;
+    }
+
+    // events posted meanwhile run on the next call
+    SchedulerEvent* event = _inbox_take();
+    while (event) {
+        SchedulerEvent* next = event->next;
+        event->func(event->data);
+        g_free(event);
+        event = next;
+    }
+}
+
+void
+scheduler_run(void)
+{
+    _events_run();
+
+    if (heap == NULL) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+
+    // tasks due again straight away run on the next call, not in this loop
+    GSList* again = NULL;
+
+    while (heap->len > 0) {
+        SchedulerTask* task = g_ptr_array_index(heap, 0);
+        if (task->deadline > now) {
+            break;
+        }
+
+        _heap_remove(task);
+        gint64 deadline = task->deadline;
+        gboolean keep = task->func(task->data);
+
+        // the callback may have rescheduled the task itself
+        if (!keep || task->removed) {
+            _task_free(task);
+        } else {
+            if (task->deadline == deadline) {
+                task->deadline = g_get_monotonic_time() + (gint64)task->interval_ms * 1000;
+            }
+            again = g_slist_prepend(again, task);
+        }
+    }
+
+    GSList* curr = again;
+    while (curr) {
+        SchedulerTask* task = curr->data;
+        if (task->removed) {
+            _task_free(task);
+        } else {
+            _heap_push(task);
+        }
+        curr = g_slist_next(curr);
+    }
+    g_slist_free(again);
+}
+
+// Milliseconds until the next task is due, -1 if there is none
+gint
+scheduler_next_timeout(void)
+{
+    if (g_atomic_pointer_get(&inbox) != NULL) {
+        return 0;
+    }
+
+    if (heap == NULL || heap->len == 0) {
+        return -1;
+    }
+
+    SchedulerTask* task = g_ptr_array_index(heap, 0);
+    gint64 remaining = task->deadline - g_get_monotonic_time();
+    if (remaining <= 0) {
+        return 0;
+    }
+
+    // round up so the task is due once the wait is over
+    gint64 remaining_ms = (remaining + 999) / 1000;
+
+    return remaining_ms > G_MAXINT ? G_MAXINT : (gint)remaining_ms;
+}
+
+void
+scheduler_close(void)
+{
+    // whatever the events were meant for is gone by now
+    SchedulerEvent* event = _inbox_take();
+    while (event) {
+        SchedulerEvent* next = event->next;
+        g_free(event);
+        event = next;
+    }
+    if (wakeup_pipe[0] >= 0) {
+        close(wakeup_pipe[0]);
+        close(wakeup_pipe[1]);
+        wakeup_pipe[0] = -1;
+        wakeup_pipe[1] = -1;
+    }
+
+    if (heap == NULL) {
+        return;
+    }
+
+    while (heap->len > 0) {
+        SchedulerTask* task = g_ptr_array_index(heap, heap->len - 1);
+        _heap_remove(task);
+        _task_free(task);
+    }
+    g_ptr_array_free(heap, TRUE);
+    heap = NULL;
+}
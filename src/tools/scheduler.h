@@ -0,0 +1,63 @@
+/*
+ * scheduler.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef TOOLS_SCHEDULER_H
+#define TOOLS_SCHEDULER_H
+
+#include <glib.h>
+
+typedef struct scheduler_task_t SchedulerTask;
+
+// Called when the task is due, return FALSE to remove the task
+typedef gboolean (*scheduler_func)(void* data);
+// Called once on the main loop for an event posted from another thread
+typedef void (*scheduler_event_func)(void* data);
+
+SchedulerTask* scheduler_add(guint interval_ms, scheduler_func func, void* data, GDestroyNotify data_free);
+void scheduler_remove(SchedulerTask* task);
+void scheduler_set_interval(SchedulerTask* task, guint interval_ms);
+
+void scheduler_init(void);
+// Callable from any thread, the events run in the order they were posted
+void scheduler_post(scheduler_event_func func, void* data);
+// Readable once an event was posted, for the main loop to wait on
+int scheduler_wakeup_fd(void);
+
+void scheduler_run(void);
+gint scheduler_next_timeout(void);
+void scheduler_close(void);
+
+#endif
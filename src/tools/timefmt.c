@@ -0,0 +1,311 @@
+/*
+ * timefmt.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/timefmt.h"
+
+#define TIMEFMT_SLOTS 64
+
+typedef struct timefmt_slot_t
+{
+    const char* format; // interned, NULL when unused
+    gint64 key;
+    char text[TIMEFMT_MAX];
+} TimeFmtSlot;
+
+static TimeFmtSlot slots[TIMEFMT_SLOTS];
+
+// Seconds one formatted text stays valid for, 0 when it changes within a second
+static gint64
+_resolution(const char* const format)
+{
+    gint64 resolution = 60;
+
+    for (const char* c = format; *c; c++) {
+        if (*c != '%') {
+            continue;
+        }
+        c++;
+        while (*c && strchr("-_0OE:", *c)) {
+            c++;
+        }
+        if (*c == '\0') {
+            break;
+        }
+        if (*c == 'f') {
+            return 0;
+        }
+        if (strchr("crsSTX", *c)) {
+            resolution = 1;
+        }
+    }
+
+    return resolution;
+}
+
+const char*
+timefmt_format(GDateTime* time, const char* const format, char* buf, gsize size)
+{
+    buf[0] = '\0';
+
+    gint64 resolution = _resolution(format);
+    TimeFmtSlot* slot = NULL;
+    const char* interned = NULL;
+    gint64 key = 0;
+    if (resolution > 0) {
+        // by local time, so a change of the offset gives a new key
+        gint64 local = g_date_time_to_unix(time) + g_date_time_get_utc_offset(time) / G_TIME_SPAN_SECOND;
+        key = local >= 0 ? local / resolution : (local - resolution + 1) / resolution;
+        interned = g_intern_string(format);
+        slot = &slots[(guint)(key ^ GPOINTER_TO_UINT(interned)) % TIMEFMT_SLOTS];
+        if (slot->format == interned && slot->key == key) {
+            g_strlcpy(buf, slot->text, size);
+            return buf;
+        }
+    }
+
+    gchar* text = g_date_time_format(time, format);
+    if (!text) {
+        return buf;
+    }
+    g_strlcpy(buf, text, size);
+    if (slot) {
+        slot->format = interned;
+        slot->key = key;
+        g_strlcpy(slot->text, text, sizeof(slot->text));
+    }
+    g_free(text);
+
+    return buf;
+}
+
+// Reads n digits at p and moves past them
+static gboolean
+_digits(const char** p, int n, int* value)
+{
+    int result = 0;
+    for (int i = 0; i < n; i++) {
+        char c = (*p)[i];
+        if (c < '0' || c > '9') {
+            return FALSE;
+        }
+        result = result * 10 + (c - '0');
+    }
+    *p += n;
+    *value = result;
+
+    return TRUE;
+}
+
+static gboolean
+_expect(const char** p, char c)
+{
+    if (**p != c) {
+        return FALSE;
+    }
+    (*p)++;
+
+    return TRUE;
+}
+
+static int
+_month_days(int year, int month)
+{
+    static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    gboolean leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+
+    return month == 2 && leap ? 29 : days[month - 1];
+}
+
+// Days since 1970-01-01 of a date in the proleptic gregorian calendar
+static gint64
+_days_from_civil(int year, int month, int day)
+{
+    year -= month <= 2;
+    gint64 era = (year >= 0 ? year : year - 399) / 400;
+    gint64 yoe = year - era * 400;
+    gint64 doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    gint64 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+static void
+_civil_from_days(gint64 days, int* year, int* month, int* day)
+{
+    days += 719468;
+    gint64 era = (days >= 0 ? days : days - 146096) / 146097;
+    gint64 doe = days - era * 146097;
+    gint64 yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    gint64 doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    gint64 mp = (5 * doy + 2) / 153;
+
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+// CCYY-MM-DDThh:mm:ss[.sss]TZD, or CCYYMMDDThh:mm:ss[.sss][TZD] which is UTC
+static gboolean
+_parse_fixed(const char* p, gint64* time_us)
+{
+    int year, month, day, hour, minute, second;
+
+    if (!_digits(&p, 4, &year)) {
+        return FALSE;
+    }
+    gboolean legacy = !_expect(&p, '-');
+    if (!_digits(&p, 2, &month) || (!legacy && !_expect(&p, '-')) || !_digits(&p, 2, &day)) {
+        return FALSE;
+    }
+    if (!_expect(&p, 'T') || !_digits(&p, 2, &hour) || !_expect(&p, ':') || !_digits(&p, 2, &minute) || !_expect(&p, ':') || !_digits(&p, 2, &second)) {
+        return FALSE;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > _month_days(year, month) || hour > 23 || minute > 59 || second > 59) {
+        return FALSE;
+    }
+
+    gint64 fraction = 0;
+    if (_expect(&p, '.')) {
+        if (*p < '0' || *p > '9') {
+            return FALSE;
+        }
+        // digits past the microseconds are dropped
+        for (gint64 scale = G_USEC_PER_SEC / 10; *p >= '0' && *p <= '9'; p++, scale /= 10) {
+            fraction += (*p - '0') * scale;
+        }
+    }
+
+    gint64 offset = 0;
+    if (*p == '+' || *p == '-') {
+        int sign = *p == '-' ? -1 : 1;
+        int offset_hour;
+        int offset_minute = 0;
+        p++;
+        // glib leaves out the minutes of whole hours
+        if (!_digits(&p, 2, &offset_hour) || (_expect(&p, ':') && !_digits(&p, 2, &offset_minute))) {
+            return FALSE;
+        }
+        if (offset_hour > 23 || offset_minute > 59) {
+            return FALSE;
+        }
+        offset = sign * (offset_hour * 3600 + offset_minute * 60);
+    } else if (!_expect(&p, 'Z') && !legacy) {
+        return FALSE;
+    }
+    if (*p != '\0') {
+        return FALSE;
+    }
+
+    gint64 seconds = _days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - offset;
+    *time_us = seconds * G_USEC_PER_SEC + fraction;
+
+    return TRUE;
+}
+
+gboolean
+timefmt_parse_stamp(const char* const stamp, gint64* time_us)
+{
+    if (!stamp) {
+        return FALSE;
+    }
+    if (_parse_fixed(stamp, time_us)) {
+        return TRUE;
+    }
+
+    GDateTime* time = g_date_time_new_from_iso8601(stamp, NULL);
+    if (!time) {
+        return FALSE;
+    }
+    *time_us = g_date_time_to_unix(time) * G_USEC_PER_SEC + g_date_time_get_microsecond(time);
+    g_date_time_unref(time);
+
+    return TRUE;
+}
+
+const char*
+timefmt_stamp(gint64 time_us, char* buf, gsize size)
+{
+    gint64 seconds = time_us >= 0 ? time_us / G_USEC_PER_SEC : (time_us - G_USEC_PER_SEC + 1) / G_USEC_PER_SEC;
+    int usec = time_us - seconds * G_USEC_PER_SEC;
+
+    GTimeZone* tz = g_time_zone_new_local();
+    int interval = g_time_zone_find_interval(tz, G_TIME_TYPE_UNIVERSAL, seconds);
+    int offset = interval >= 0 ? g_time_zone_get_offset(tz, interval) : 0;
+    g_time_zone_unref(tz);
+
+    gint64 local = seconds + offset;
+    gint64 days = local >= 0 ? local / 86400 : (local - 86399) / 86400;
+    int rest = local - days * 86400;
+    int year, month, day;
+    _civil_from_days(days, &year, &month, &day);
+
+    char text[TIMEFMT_STAMP_MAX];
+    int len = snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d", year, month, day, rest / 3600, rest / 60 % 60, rest % 60);
+    if (usec != 0) {
+        len += snprintf(text + len, sizeof(text) - len, ".%06d", usec);
+    }
+    if (offset == 0) {
+        snprintf(text + len, sizeof(text) - len, "Z");
+    } else {
+        int span = ABS(offset);
+        len += snprintf(text + len, sizeof(text) - len, "%c%02d", offset < 0 ? '-' : '+', span / 3600);
+        if (span % 3600 != 0) {
+            len += snprintf(text + len, sizeof(text) - len, ":%02d", span / 60 % 60);
+        }
+        if (span % 60 != 0) {
+            snprintf(text + len, sizeof(text) - len, ":%02d", span % 60);
+        }
+    }
+    g_strlcpy(buf, text, size);
+
+    return buf;
+}
+
+GDateTime*
+timefmt_local(gint64 time_us)
+{
+    GDateTime* local = g_date_time_new_from_unix_local(time_us / G_USEC_PER_SEC);
+    GDateTime* time = g_date_time_add(local, time_us % G_USEC_PER_SEC);
+    g_date_time_unref(local);
+
+    return time;
+}
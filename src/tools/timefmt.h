@@ -0,0 +1,64 @@
+/*
+ * timefmt.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef TOOLS_TIMEFMT_H
+#define TOOLS_TIMEFMT_H
+
+#include <glib.h>
+
+// room for any time a /time format produces
+#define TIMEFMT_MAX 128
+
+// Formats time like g_date_time_format() into buf. Lines printed within the
+// same second, or minute when the format shows no seconds, share the work.
+// Returns buf, which is empty when the format is invalid.
+const char* timefmt_format(GDateTime* time, const char* const format, char* buf, gsize size);
+
+// room for a stamp timefmt_stamp() writes
+#define TIMEFMT_STAMP_MAX 40
+
+// Parses an XEP-0082 DateTime, or the XEP-0091 CCYYMMDDThh:mm:ss in UTC, into
+// unix time in microseconds. Other ISO 8601 forms go through glib. Returns
+// FALSE when stamp is no time.
+gboolean timefmt_parse_stamp(const char* const stamp, gint64* time_us);
+
+// Writes unix time in microseconds in local time like
+// g_date_time_format_iso8601() does, returns buf
+const char* timefmt_stamp(gint64 time_us, char* buf, gsize size);
+
+// The local time of unix time in microseconds, to be unreffed by the caller
+GDateTime* timefmt_local(gint64 time_us);
+
+#endif
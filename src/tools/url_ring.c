@@ -0,0 +1,228 @@
+/*
+ * url_ring.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/url_ring.h"
+
+struct url_ring_t
+{
+    gchar* urls[URL_RING_MAX]; // urls[(newest + age) % URL_RING_MAX]
+    guint newest;
+    guint count;
+
+    gchar* search_str;
+    gint last_found; // age of the last completion, -1 when not completing
+};
+
+static const char* const schemes[] = { "https", "http", "aesgcm" };
+
+UrlRing*
+url_ring_new(void)
+{
+    UrlRing* ring = g_new0(UrlRing, 1);
+    ring->last_found = -1;
+
+    return ring;
+}
+
+void
+url_ring_free(UrlRing* ring)
+{
+    if (!ring) {
+        return;
+    }
+
+    for (guint i = 0; i < URL_RING_MAX; i++) {
+        g_free(ring->urls[i]);
+    }
+    g_free(ring->search_str);
+    g_free(ring);
+}
+
+static const gchar*
+_url_ring_get(const UrlRing* const ring, guint age)
+{
+    return ring->urls[(ring->newest + age) % URL_RING_MAX];
+}
+
+static gboolean
+_url_ring_contains(const UrlRing* const ring, const char* const url, gsize len)
+{
+    for (guint age = 0; age < ring->count; age++) {
+        const gchar* curr = _url_ring_get(ring, age);
+        if (strncmp(curr, url, len) == 0 && curr[len] == '\0') {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+_url_ring_add(UrlRing* ring, const char* const url, gsize len)
+{
+    if (_url_ring_contains(ring, url, len)) {
+        return;
+    }
+
+    ring->newest = (ring->newest + URL_RING_MAX - 1) % URL_RING_MAX;
+    g_free(ring->urls[ring->newest]);
+    ring->urls[ring->newest] = g_strndup(url, len);
+    if (ring->count < URL_RING_MAX) {
+        ring->count++;
+    }
+
+    // the completed URL is one older now, unless it was dropped
+    if (ring->last_found >= 0) {
+        ring->last_found++;
+        if ((guint)ring->last_found >= ring->count) {
+            ring->last_found = -1;
+        }
+    }
+}
+
+// Start of the scheme in front of the "://" at sep, NULL when there is none
+static const char*
+_url_ring_scheme_start(const char* const text, const char* const sep)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(schemes); i++) {
+        size_t len = strlen(schemes[i]);
+        if ((size_t)(sep - text) >= len && strncmp(sep - len, schemes[i], len) == 0) {
+            return sep - len;
+        }
+    }
+
+    return NULL;
+}
+
+void
+url_ring_add_from(UrlRing* ring, const char* const text)
+{
+    if (!ring || !text) {
+        return;
+    }
+
+    // a URL runs from its scheme up to the next white space
+    const char* curr = text;
+    const char* sep;
+    while ((sep = strstr(curr, "://")) != NULL) {
+        const char* rest = sep + 3;
+        const char* end = rest;
+        while (*end && !g_ascii_isspace(*end)) {
+            end++;
+        }
+
+        const char* start = _url_ring_scheme_start(text, sep);
+        if (start && end > rest) {
+            _url_ring_add(ring, start, end - start);
+            curr = end;
+        } else {
+            curr = rest;
+        }
+    }
+}
+
+guint
+url_ring_length(const UrlRing* const ring)
+{
+    return ring ? ring->count : 0;
+}
+
+static char*
+_url_ring_search(UrlRing* ring, gint from, gint to, gint step)
+{
+    size_t search_len = strlen(ring->search_str);
+    for (gint age = from; age != to; age += step) {
+        const gchar* url = _url_ring_get(ring, age);
+        if (g_ascii_strncasecmp(url, ring->search_str, search_len) == 0) {
+            ring->last_found = age;
+            return g_strdup(url);
+        }
+    }
+
+    return NULL;
+}
+
+char*
+url_ring_complete(UrlRing* ring, const char* const search_str, gboolean previous)
+{
+    if (!ring || ring->count == 0) {
+        return NULL;
+    }
+
+    gint count = ring->count;
+
+    // first search attempt
+    if (ring->last_found < 0) {
+        g_free(ring->search_str);
+        ring->search_str = g_strdup(search_str);
+        return _url_ring_search(ring, 0, count, 1);
+    }
+
+    // subsequent attempts go on from the last one and wrap around
+    gint last = ring->last_found;
+    char* found;
+    if (previous) {
+        found = _url_ring_search(ring, last - 1, -1, -1);
+        if (!found) {
+            found = _url_ring_search(ring, count - 1, last - 1, -1);
+        }
+    } else {
+        found = _url_ring_search(ring, last + 1, count, 1);
+        if (!found) {
+            found = _url_ring_search(ring, 0, last + 1, 1);
+        }
+    }
+
+    return found;
+}
+
+void
+url_ring_reset(UrlRing* ring)
+{
+    if (!ring) {
+        return;
+    }
+
+    ring->last_found = -1;
+    g_free(ring->search_str);
+    ring->search_str = NULL;
+}
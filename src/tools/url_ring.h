@@ -0,0 +1,60 @@
+/*
+ * url_ring.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef TOOLS_URL_RING_H
+#define TOOLS_URL_RING_H
+
+#include <glib.h>
+
+// how many URLs a window remembers for /url completion
+#define URL_RING_MAX 20
+
+typedef struct url_ring_t UrlRing;
+
+UrlRing* url_ring_new(void);
+void url_ring_free(UrlRing* ring);
+
+// Adds the http, https and aesgcm URLs found in text, newest first. URLs
+// already in the ring keep their place, the oldest go when it is full.
+void url_ring_add_from(UrlRing* ring, const char* const text);
+guint url_ring_length(const UrlRing* const ring);
+
+// Cycles through the URLs starting with search_str, ignoring case, until
+// url_ring_reset(). The result is to be freed by the caller.
+char* url_ring_complete(UrlRing* ring, const char* const search_str, gboolean previous);
+void url_ring_reset(UrlRing* ring);
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * width.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/width.h"
+
+// Code points are looked up in pages of 256 filled from glib on first
+// use. Pages where every character has the same width share one copy.
+#define WIDTH_PAGE_BITS  8
+#define WIDTH_PAGE_SIZE  (1 << WIDTH_PAGE_BITS)
+#define WIDTH_PAGE_COUNT ((0x10FFFF >> WIDTH_PAGE_BITS) + 1)
+
+#define WIDTH_ASCII_MASK G_GUINT64_CONSTANT(0x8080808080808080)
+
+static const guint8* width_pages[WIDTH_PAGE_COUNT];
+static guint8 width_uniform[3][WIDTH_PAGE_SIZE];
+
+static const guint8* _width_page(guint page);
+
+static int
+_width_codepoint(gunichar c)
+{
+    if (c > 0x10FFFF) {
+        return 1;
+    }
+
+    const guint8* page = width_pages[c >> WIDTH_PAGE_BITS];
+    if (page == NULL) {
+        page = _width_page(c >> WIDTH_PAGE_BITS);
+    }
+
+    return page[c & (WIDTH_PAGE_SIZE - 1)];
+}
+
+// Width of the character at ch and its length in bytes, -1 for a byte that
+// does not start a valid sequence.
+int
+width_char(const char* const ch, int* bytes)
+{
+    if ((guchar)*ch < 0x80) {
+        *bytes = 1;
+        return 1;
+    }
+
+    gunichar c = g_utf8_get_char_validated(ch, -1);
+    if (c == (gunichar)-1 || c == (gunichar)-2) {
+        *bytes = 1;
+        return -1;
+    }
+
+    *bytes = g_utf8_next_char(ch) - ch;
+    return _width_codepoint(c);
+}
+
+int
+width_strn(const char* const str, gsize len)
+{
+    if (!str) {
+        return 0;
+    }
+
+    int width = 0;
+    gsize i = 0;
+    while (i < len) {
+        // runs of ASCII are a column a byte, check them eight at a time
+        while (i + 8 <= len) {
+            guint64 block;
+            memcpy(&block, str + i, sizeof(block));
+            if (block & WIDTH_ASCII_MASK) {
+                break;
+            }
+            width += 8;
+            i += 8;
+        }
+        if (i >= len) {
+            break;
+        }
+
+        int bytes;
+        int cols = width_char(str + i, &bytes);
+        width += cols < 0 ? 1 : cols;
+        i += bytes;
+    }
+
+    return width;
+}
+
+int
+width_str(const char* const str)
+{
+    if (!str) {
+        return 0;
+    }
+
+    return width_strn(str, strlen(str));
+}
+
+static const guint8*
+_width_page(guint page)
+{
+    guint8 widths[WIDTH_PAGE_SIZE];
+    gunichar first = page << WIDTH_PAGE_BITS;
+    gboolean uniform = TRUE;
+
+    for (int i = 0; i < WIDTH_PAGE_SIZE; i++) {
+        gunichar c = first + i;
+        if (g_unichar_iszerowidth(c)) {
+            widths[i] = 0;
+        } else if (g_unichar_iswide(c)) {
+            widths[i] = 2;
+        } else {
+            widths[i] = 1;
+        }
+        uniform = uniform && widths[i] == widths[0];
+    }
+
+    guint8* filled;
+    if (uniform) {
+        filled = width_uniform[widths[0]];
+        memset(filled, widths[0], WIDTH_PAGE_SIZE);
+    } else {
+        filled = g_malloc(WIDTH_PAGE_SIZE);
+        memcpy(filled, widths, WIDTH_PAGE_SIZE);
+    }
+    width_pages[page] = filled;
+
+    return filled;
+}
@@ -0,0 +1,258 @@
+/*
+ * workers.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <pthread.h>
+#include <glib.h>
+
+#include "log.h"
+#include "tools/workers.h"
+
+struct worker_class_t
+{
+    char* name;
+    guint limit;
+    gint priority;
+    GQueue queued;
+    guint running;
+    guint64 done;
+    guint64 cancelled;
+    gint64 wait_total_us;
+    gint64 wait_max_us;
+    gint64 run_total_us;
+};
+
+struct worker_job_t
+{
+    WorkerClass* worker_class;
+    ProfWin* window;
+    worker_func func;
+    void* data;
+    gint64 submitted;
+    gint cancelled;
+};
+
+static pthread_mutex_t workers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workers_cond = PTHREAD_COND_INITIALIZER;
+// by priority, highest first
+static GPtrArray* classes = NULL;
+static GList* running = NULL;
+static guint threads = 0;
+static guint idle = 0;
+static gboolean stopping = FALSE;
+
+static WorkerJob*
+_workers_next_job(void)
+{
+    for (guint i = 0; i < classes->len; i++) {
+        WorkerClass* worker_class = g_ptr_array_index(classes, i);
+        if (worker_class->running < worker_class->limit && !g_queue_is_empty(&worker_class->queued)) {
+            return g_queue_pop_head(&worker_class->queued);
+        }
+    }
+
+    return NULL;
+}
+
+static void*
+_workers_thread(void* data)
+{
+    pthread_mutex_lock(&workers_lock);
+    while (!stopping) {
+        WorkerJob* job = _workers_next_job();
+        if (!job) {
+            idle++;
+            pthread_cond_wait(&workers_cond, &workers_lock);
+            idle--;
+            continue;
+        }
+
+        WorkerClass* worker_class = job->worker_class;
+        gint64 started = g_get_monotonic_time();
+        gint64 waited = started - job->submitted;
+        worker_class->running++;
+        worker_class->wait_total_us += waited;
+        worker_class->wait_max_us = MAX(worker_class->wait_max_us, waited);
+        running = g_list_prepend(running, job);
+        pthread_mutex_unlock(&workers_lock);
+
+        job->func(job, job->data);
+
+        pthread_mutex_lock(&workers_lock);
+        running = g_list_remove(running, job);
+        worker_class->running--;
+        worker_class->done++;
+        if (g_atomic_int_get(&job->cancelled)) {
+            worker_class->cancelled++;
+        }
+        worker_class->run_total_us += g_get_monotonic_time() - started;
+        g_free(job);
+    }
+    threads--;
+    pthread_mutex_unlock(&workers_lock);
+
+    return NULL;
+}
+
+static gint
+_workers_class_cmp(gconstpointer a, gconstpointer b)
+{
+    const WorkerClass* class_a = *(WorkerClass* const*)a;
+    const WorkerClass* class_b = *(WorkerClass* const*)b;
+
+    return class_b->priority - class_a->priority;
+}
+
+WorkerClass*
+workers_class_new(const char* const name, guint limit, gint priority)
+{
+    WorkerClass* worker_class = g_new0(WorkerClass, 1);
+    worker_class->name = g_strdup(name);
+    worker_class->limit = MAX(limit, 1);
+    worker_class->priority = priority;
+    g_queue_init(&worker_class->queued);
+
+    pthread_mutex_lock(&workers_lock);
+    if (!classes) {
+        classes = g_ptr_array_new();
+    }
+    g_ptr_array_add(classes, worker_class);
+    g_ptr_array_sort(classes, _workers_class_cmp);
+    pthread_mutex_unlock(&workers_lock);
+
+    return worker_class;
+}
+
+void
+workers_submit(WorkerClass* worker_class, ProfWin* window, worker_func func, void* data)
+{
+    WorkerJob* job = g_new0(WorkerJob, 1);
+    job->worker_class = worker_class;
+    job->window = window;
+    job->func = func;
+    job->data = data;
+    job->submitted = g_get_monotonic_time();
+
+    pthread_mutex_lock(&workers_lock);
+    g_queue_push_tail(&worker_class->queued, job);
+
+    if (idle > 0) {
+        pthread_cond_signal(&workers_cond);
+    } else if (threads < WORKERS_MAX_THREADS) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, _workers_thread, NULL) == 0) {
+            pthread_detach(thread);
+            threads++;
+        } else if (threads == 0) {
+            log_error("Unable to start a worker thread for %s", worker_class->name);
+        }
+    }
+    pthread_mutex_unlock(&workers_lock);
+}
+
+gboolean
+workers_job_cancelled(WorkerJob* job)
+{
+    return g_atomic_int_get(&job->cancelled) != 0;
+}
+
+void
+workers_cancel_window(ProfWin* window)
+{
+    if (!window) {
+        return;
+    }
+
+    pthread_mutex_lock(&workers_lock);
+    for (GList* curr = running; curr; curr = g_list_next(curr)) {
+        WorkerJob* job = curr->data;
+        if (job->window == window) {
+            g_atomic_int_set(&job->cancelled, 1);
+        }
+    }
+    for (guint i = 0; classes && i < classes->len; i++) {
+        WorkerClass* worker_class = g_ptr_array_index(classes, i);
+        for (GList* curr = worker_class->queued.head; curr; curr = g_list_next(curr)) {
+            WorkerJob* job = curr->data;
+            if (job->window == window) {
+                g_atomic_int_set(&job->cancelled, 1);
+            }
+        }
+    }
+    pthread_mutex_unlock(&workers_lock);
+}
+
+guint
+workers_classes(void)
+{
+    pthread_mutex_lock(&workers_lock);
+    guint count = classes ? classes->len : 0;
+    pthread_mutex_unlock(&workers_lock);
+
+    return count;
+}
+
+void
+workers_get_stats(guint index, WorkerStats* stats)
+{
+    pthread_mutex_lock(&workers_lock);
+    WorkerClass* worker_class = g_ptr_array_index(classes, index);
+    stats->name = worker_class->name;
+    stats->queued = g_queue_get_length(&worker_class->queued);
+    stats->running = worker_class->running;
+    stats->done = worker_class->done;
+    stats->cancelled = worker_class->cancelled;
+    guint64 started = worker_class->done + worker_class->running;
+    stats->wait_avg_us = started > 0 ? worker_class->wait_total_us / (gint64)started : 0;
+    stats->wait_max_us = worker_class->wait_max_us;
+    stats->run_avg_us = worker_class->done > 0 ? worker_class->run_total_us / (gint64)worker_class->done : 0;
+    pthread_mutex_unlock(&workers_lock);
+}
+
+void
+workers_close(void)
+{
+    pthread_mutex_lock(&workers_lock);
+    stopping = TRUE;
+    for (guint i = 0; classes && i < classes->len; i++) {
+        WorkerClass* worker_class = g_ptr_array_index(classes, i);
+        g_queue_foreach(&worker_class->queued, (GFunc)g_free, NULL);
+        g_queue_clear(&worker_class->queued);
+    }
+    pthread_cond_broadcast(&workers_cond);
+    pthread_mutex_unlock(&workers_lock);
+}
@@ -0,0 +1,82 @@
+/*
+ * workers.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef TOOLS_WORKERS_H
+#define TOOLS_WORKERS_H
+
+#include <glib.h>
+
+#include "ui/win_types.h"
+
+#define WORKERS_MAX_THREADS 16
+
+typedef struct worker_class_t WorkerClass;
+typedef struct worker_job_t WorkerJob;
+
+// Runs on a pool thread, a long job returns early once it is cancelled
+typedef void (*worker_func)(WorkerJob* job, void* data);
+
+typedef struct worker_stats_t
+{
+    const char* name;
+    guint queued;
+    guint running;
+    guint64 done;
+    guint64 cancelled;
+    // from submitting to starting, and from starting to finishing
+    gint64 wait_avg_us;
+    gint64 wait_max_us;
+    gint64 run_avg_us;
+} WorkerStats;
+
+// At most limit jobs of the class run at a time. A free thread takes the
+// oldest job of the class with the highest priority that may start.
+WorkerClass* workers_class_new(const char* const name, guint limit, gint priority);
+
+// The job is cancelled once window is closed, NULL ties it to none
+void workers_submit(WorkerClass* worker_class, ProfWin* window, worker_func func, void* data);
+gboolean workers_job_cancelled(WorkerJob* job);
+// A job cancelled before it started still runs, to release what it holds
+void workers_cancel_window(ProfWin* window);
+
+guint workers_classes(void);
+void workers_get_stats(guint index, WorkerStats* stats);
+
+// Jobs not started yet are dropped, running ones are left to finish
+// while the process exits
+void workers_close(void);
+
+#endif
@@ -50,130 +50,375 @@
 #include <curses.h>
 #endif
 
+#include "tools/intern.h"
 #include "ui/window.h"
 #include "ui/buffer.h"
 
 #define BUFF_SIZE 1200
 
+// Entries live in a circular array so indexed access is constant time,
+// message ids are indexed to find entries for receipts and corrections.
 struct prof_buff_t
 {
-    GSList* entries;
+    ProfBuffEntry** entries;
+    // slot of the oldest entry
+    int head;
+    int size;
+    // id -> oldest entry carrying that id
+    GHashTable* ids;
+    // set once two entries shared an id, lookups then have to fall back to scanning
+    gboolean dup_ids;
 };
 
 static void _free_entry(ProfBuffEntry* entry);
 
+static int
+_slot(ProfBuff buffer, int index)
+{
+    return (buffer->head + index) % BUFF_SIZE;
+}
+
+// point the index for id at the oldest entry carrying it, ignoring skip
+static void
+_index_rescan(ProfBuff buffer, const char* const id, ProfBuffEntry* skip)
+{
+    for (int i = 0; i < buffer->size; i++) {
+        ProfBuffEntry* e = buffer->entries[_slot(buffer, i)];
+        if (e != skip && g_strcmp0(e->id, id) == 0) {
+            g_hash_table_replace(buffer->ids, (gpointer)e->id, e);
+            return;
+        }
+    }
+    g_hash_table_remove(buffer->ids, id);
+}
+
+static void
+_index_add(ProfBuff buffer, ProfBuffEntry* entry, gboolean oldest)
+{
+    if (!entry->id) {
+        return;
+    }
+
+    if (!g_hash_table_contains(buffer->ids, entry->id)) {
+        g_hash_table_replace(buffer->ids, (gpointer)entry->id, entry);
+    } else {
+        buffer->dup_ids = TRUE;
+        if (oldest) {
+            g_hash_table_replace(buffer->ids, (gpointer)entry->id, entry);
+        }
+    }
+}
+
+static void
+_index_remove(ProfBuff buffer, ProfBuffEntry* entry)
+{
+    if (!entry->id || g_hash_table_lookup(buffer->ids, entry->id) != entry) {
+        return;
+    }
+
+    if (buffer->dup_ids) {
+        _index_rescan(buffer, entry->id, entry);
+    } else {
+        g_hash_table_remove(buffer->ids, entry->id);
+    }
+}
+
 ProfBuff
 buffer_create(void)
 {
     ProfBuff new_buff = malloc(sizeof(struct prof_buff_t));
-    new_buff->entries = NULL;
+    new_buff->entries = malloc(BUFF_SIZE * sizeof(ProfBuffEntry*));
+    new_buff->head = 0;
+    new_buff->size = 0;
+    new_buff->ids = g_hash_table_new(g_str_hash, g_str_equal);
+    new_buff->dup_ids = FALSE;
     return new_buff;
 }
 
 int
 buffer_size(ProfBuff buffer)
 {
-    return g_slist_length(buffer->entries);
+    return buffer->size;
 }
 
 void
 buffer_free(ProfBuff buffer)
 {
-    g_slist_free_full(buffer->entries, (GDestroyNotify)_free_entry);
+    for (int i = 0; i < buffer->size; i++) {
+        _free_entry(buffer->entries[_slot(buffer, i)]);
+    }
+    g_hash_table_destroy(buffer->ids);
+    free(buffer->entries);
     free(buffer);
 }
 
-void
-buffer_append(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, DeliveryReceipt* receipt, const char* const id)
+// Nicks, jids and show chars repeat across most lines of a window, they
+// are interned instead of copied per line. The few show chars stay for the
+// lifetime of the process, nicks and jids go with their last line.
+static ProfBuffEntry*
+_create_entry(const char* show_char, int pad_indent, gint64 time, gint32 utc_offset, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, gboolean receipt, const char* const id)
 {
-    ProfBuffEntry* e = malloc(sizeof(struct prof_buff_entry_t));
-    e->show_char = strdup(show_char);
+    size_t message_size = strlen(message) + 1;
+    size_t id_size = id ? strlen(id) + 1 : 0;
+
+    ProfBuffEntry* e = malloc(sizeof(ProfBuffEntry) + message_size + id_size);
+    e->time = time;
+    e->utc_offset = utc_offset;
     e->pad_indent = pad_indent;
     e->flags = flags;
     e->theme_item = theme_item;
-    e->time = g_date_time_ref(time);
-    e->display_from = display_from ? strdup(display_from) : NULL;
-    e->from_jid = from_jid ? strdup(from_jid) : NULL;
-    e->message = strdup(message);
-    e->receipt = receipt;
+    e->receipt = receipt ? 1 : 0;
+    e->received = 0;
+    e->lines = 0;
+    e->lines_width = -1;
+    e->wrap = NULL;
+    e->show_char = g_intern_string(show_char);
+    e->display_from = intern(display_from);
+    e->from_jid = intern(from_jid);
+
+    memcpy(e->data, message, message_size);
+    e->message = e->data;
     if (id) {
-        e->id = strdup(id);
+        memcpy(e->data + message_size, id, id_size);
+        e->id = e->data + message_size;
     } else {
         e->id = NULL;
     }
 
-    if (g_slist_length(buffer->entries) == BUFF_SIZE) {
-        _free_entry(buffer->entries->data);
-        buffer->entries = g_slist_delete_link(buffer->entries, buffer->entries);
+    return e;
+}
+
+static ProfBuffEntry*
+_create_entry_at(const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, gboolean receipt, const char* const id)
+{
+    gint64 time_us = g_date_time_to_unix(time) * G_USEC_PER_SEC + g_date_time_get_microsecond(time);
+    gint32 utc_offset = g_date_time_get_utc_offset(time) / G_USEC_PER_SEC;
+
+    return _create_entry(show_char, pad_indent, time_us, utc_offset, flags, theme_item, display_from, from_jid, message, receipt, id);
+}
+
+void
+buffer_append(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, gboolean receipt, const char* const id)
+{
+    ProfBuffEntry* e = _create_entry_at(show_char, pad_indent, time, flags, theme_item, display_from, from_jid, message, receipt, id);
+
+    if (buffer->size == BUFF_SIZE) {
+        ProfBuffEntry* oldest = buffer->entries[buffer->head];
+        _index_remove(buffer, oldest);
+        _free_entry(oldest);
+        buffer->head = _slot(buffer, 1);
+        buffer->size--;
     }
 
-    buffer->entries = g_slist_append(buffer->entries, e);
+    buffer->entries[_slot(buffer, buffer->size)] = e;
+    buffer->size++;
+    _index_add(buffer, e, FALSE);
+}
+
+// Insert an older entry at the start of the buffer. Once the buffer is full
+// the newest entry makes room, TRUE is returned when one was dropped.
+gboolean
+buffer_prepend(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, gboolean receipt, const char* const id)
+{
+    gboolean dropped = FALSE;
+    if (buffer->size == BUFF_SIZE) {
+        ProfBuffEntry* newest = buffer->entries[_slot(buffer, buffer->size - 1)];
+        _index_remove(buffer, newest);
+        _free_entry(newest);
+        buffer->size--;
+        dropped = TRUE;
+    }
+
+    ProfBuffEntry* e = _create_entry_at(show_char, pad_indent, time, flags, theme_item, display_from, from_jid, message, receipt, id);
+
+    buffer->head = (buffer->head + BUFF_SIZE - 1) % BUFF_SIZE;
+    buffer->entries[buffer->head] = e;
+    buffer->size++;
+    _index_add(buffer, e, TRUE);
+
+    return dropped;
+}
+
+static int
+_index_of(ProfBuff buffer, ProfBuffEntry* entry)
+{
+    int i = 0;
+    while (buffer->entries[_slot(buffer, i)] != entry) {
+        i++;
+    }
+    return i;
 }
 
 void
 buffer_remove_entry_by_id(ProfBuff buffer, const char* const id)
 {
-    GSList* entries = buffer->entries;
-    while (entries) {
-        ProfBuffEntry* entry = entries->data;
-        if (entry->id && (g_strcmp0(entry->id, id) == 0)) {
-            _free_entry(entry);
-            buffer->entries = g_slist_delete_link(buffer->entries, entries);
-            break;
-        }
-        entries = g_slist_next(entries);
+    ProfBuffEntry* entry = buffer_get_entry_by_id(buffer, id);
+    if (!entry) {
+        return;
+    }
+
+    int i = _index_of(buffer, entry);
+
+    _index_remove(buffer, entry);
+    _free_entry(entry);
+
+    // close the gap
+    for (; i < buffer->size - 1; i++) {
+        buffer->entries[_slot(buffer, i)] = buffer->entries[_slot(buffer, i + 1)];
+    }
+    buffer->size--;
+}
+
+// Entries are a single allocation, changing the message means replacing the
+// entry. entry is freed, the replacement is returned.
+ProfBuffEntry*
+buffer_update_entry(ProfBuff buffer, ProfBuffEntry* entry, const char* const show_char, const char* const message, const char* const id)
+{
+    ProfBuffEntry* updated = _create_entry(show_char, entry->pad_indent, entry->time, entry->utc_offset, entry->flags, entry->theme_item, entry->display_from, entry->from_jid, message, entry->receipt, id);
+    updated->received = entry->received;
+
+    _index_remove(buffer, entry);
+    buffer->entries[_slot(buffer, _index_of(buffer, entry))] = updated;
+    _free_entry(entry);
+
+    if (updated->id && g_hash_table_contains(buffer->ids, updated->id)) {
+        buffer->dup_ids = TRUE;
+        _index_rescan(buffer, updated->id, NULL);
+    } else {
+        _index_add(buffer, updated, FALSE);
     }
+
+    return updated;
 }
 
 gboolean
 buffer_mark_received(ProfBuff buffer, const char* const id)
 {
-    GSList* entries = buffer->entries;
-    while (entries) {
-        ProfBuffEntry* entry = entries->data;
+    if (!buffer->dup_ids) {
+        ProfBuffEntry* entry = buffer_get_entry_by_id(buffer, id);
+        if (entry && entry->receipt && !entry->received) {
+            entry->received = 1;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    for (int i = 0; i < buffer->size; i++) {
+        ProfBuffEntry* entry = buffer->entries[_slot(buffer, i)];
         if (entry->receipt && g_strcmp0(entry->id, id) == 0) {
-            if (!entry->receipt->received) {
-                entry->receipt->received = TRUE;
+            if (!entry->received) {
+                entry->received = 1;
                 return TRUE;
             }
         }
-        entries = g_slist_next(entries);
     }
 
     return FALSE;
 }
 
+// A chat marker acknowledges the message it names and every one before it,
+// marks them all and returns whether any was still waiting.
+gboolean
+buffer_mark_received_upto(ProfBuff buffer, const char* const id)
+{
+    int last = -1;
+    for (int i = buffer->size - 1; i >= 0 && last < 0; i--) {
+        ProfBuffEntry* entry = buffer->entries[_slot(buffer, i)];
+        if (entry->receipt && g_strcmp0(entry->id, id) == 0) {
+            last = i;
+        }
+    }
+
+    gboolean marked = FALSE;
+    for (int i = 0; i <= last; i++) {
+        ProfBuffEntry* entry = buffer->entries[_slot(buffer, i)];
+        if (entry->receipt && !entry->received) {
+            entry->received = 1;
+            marked = TRUE;
+        }
+    }
+
+    return marked;
+}
+
 ProfBuffEntry*
 buffer_get_entry(ProfBuff buffer, int entry)
 {
-    GSList* node = g_slist_nth(buffer->entries, entry);
-    return node->data;
+    return buffer->entries[_slot(buffer, entry)];
+}
+
+gboolean
+buffer_contains_id(ProfBuff buffer, const char* const id)
+{
+    return id && g_hash_table_contains(buffer->ids, id);
 }
 
 ProfBuffEntry*
 buffer_get_entry_by_id(ProfBuff buffer, const char* const id)
 {
-    GSList* entries = buffer->entries;
-    while (entries) {
-        ProfBuffEntry* entry = entries->data;
-        if (g_strcmp0(entry->id, id) == 0) {
-            return entry;
-        }
-        entries = g_slist_next(entries);
+    if (!id) {
+        return NULL;
+    }
+
+    return g_hash_table_lookup(buffer->ids, id);
+}
+
+// The time of an entry as it was given, to be unreffed by the caller
+GDateTime*
+buffer_entry_time(ProfBuffEntry* entry)
+{
+    GDateTime* local = g_date_time_new_from_unix_local(entry->time / G_USEC_PER_SEC);
+    GDateTime* time = g_date_time_add(local, entry->time % G_USEC_PER_SEC);
+    g_date_time_unref(local);
+
+    if (g_date_time_get_utc_offset(time) / G_USEC_PER_SEC != entry->utc_offset) {
+        GTimeZone* tz = g_time_zone_new_offset(entry->utc_offset);
+        GDateTime* other = g_date_time_to_timezone(time, tz);
+        g_time_zone_unref(tz);
+        g_date_time_unref(time);
+        time = other;
     }
 
-    return NULL;
+    return time;
 }
 
 static void
 _free_entry(ProfBuffEntry* entry)
 {
-    free(entry->show_char);
-    free(entry->message);
-    free(entry->display_from);
-    free(entry->from_jid);
-    free(entry->id);
-    free(entry->receipt);
-    g_date_time_unref(entry->time);
+    wrap_free(entry->wrap);
+    intern_unref(entry->display_from);
+    intern_unref(entry->from_jid);
     free(entry);
 }
+
+// Drop the cached line breaks, they are built again on the next redraw
+void
+buffer_hibernate(ProfBuff buffer)
+{
+    for (int i = 0; i < buffer->size; i++) {
+        ProfBuffEntry* e = buffer->entries[_slot(buffer, i)];
+        wrap_free(e->wrap);
+        e->wrap = NULL;
+    }
+}
+
+// Rough heap use of the entries, for the window memory budget
+gsize
+buffer_memory(ProfBuff buffer)
+{
+    gsize total = sizeof(struct prof_buff_t) + BUFF_SIZE * sizeof(ProfBuffEntry*);
+
+    for (int i = 0; i < buffer->size; i++) {
+        ProfBuffEntry* e = buffer->entries[_slot(buffer, i)];
+        // plus the usual malloc overhead
+        total += sizeof(ProfBuffEntry) + 16 + strlen(e->message) + 1;
+        total += e->id ? strlen(e->id) + 1 : 0;
+        if (e->wrap) {
+            int runs = 0;
+            wrap_runs(e->wrap, &runs);
+            total += 64 + runs * sizeof(WrapRun);
+        }
+    }
+
+    return total;
+}
@@ -41,39 +41,53 @@
 
 #include "config.h"
 #include "config/theme.h"
+#include "ui/wrap.h"
 
-typedef struct delivery_receipt_t
-{
-    gboolean received;
-} DeliveryReceipt;
-
+// One allocation per line: message and id are stored right after the
+// struct, the strings repeated across lines are interned.
 typedef struct prof_buff_entry_t
 {
-    // pointer because it could be a unicode symbol as well
-    char* show_char;
+    // unix time in microseconds and the offset it was shown in, in seconds
+    gint64 time;
+    gint32 utc_offset;
     int pad_indent;
-    GDateTime* time;
     int flags;
     theme_item_t theme_item;
-    // from as it is displayed
-    // might be nick, jid..
-    char* display_from;
-    char* from_jid;
-    char* message;
-    DeliveryReceipt* receipt;
+    // waiting for a delivery receipt, and whether it arrived
+    guint receipt : 1;
+    guint received : 1;
+    // rows taken when last rendered, valid while the pad is lines_width wide
+    int lines;
+    int lines_width;
+    // line breaks of the message when last wrapped
+    Wrap* wrap;
+    // interned, a unicode symbol as well
+    const char* show_char;
+    // from as it is displayed, might be nick, jid.. (interned)
+    const char* display_from;
+    const char* from_jid;
+    const char* message;
     // message id, in case we have it
-    char* id;
+    const char* id;
+    char data[];
 } ProfBuffEntry;
 
 typedef struct prof_buff_t* ProfBuff;
 
 ProfBuff buffer_create();
 void buffer_free(ProfBuff buffer);
-void buffer_append(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const barejid, const char* const message, DeliveryReceipt* receipt, const char* const id);
+void buffer_append(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const barejid, const char* const message, gboolean receipt, const char* const id);
+gboolean buffer_prepend(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const barejid, const char* const message, gboolean receipt, const char* const id);
 void buffer_remove_entry_by_id(ProfBuff buffer, const char* const id);
+ProfBuffEntry* buffer_update_entry(ProfBuff buffer, ProfBuffEntry* entry, const char* const show_char, const char* const message, const char* const id);
 int buffer_size(ProfBuff buffer);
 ProfBuffEntry* buffer_get_entry(ProfBuff buffer, int entry);
 ProfBuffEntry* buffer_get_entry_by_id(ProfBuff buffer, const char* const id);
+GDateTime* buffer_entry_time(ProfBuffEntry* entry);
+gboolean buffer_contains_id(ProfBuff buffer, const char* const id);
 gboolean buffer_mark_received(ProfBuff buffer, const char* const id);
+gboolean buffer_mark_received_upto(ProfBuff buffer, const char* const id);
+void buffer_hibernate(ProfBuff buffer);
+gsize buffer_memory(ProfBuff buffer);
 
 #endif
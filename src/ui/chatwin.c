@@ -50,6 +50,7 @@
 #include "ui/window.h"
 #include "ui/titlebar.h"
 #include "plugins/plugins.h"
+#include "tools/scheduler.h"
 #ifdef HAVE_LIBOTR
 #include "otr/otr.h"
 #endif
@@ -57,7 +58,20 @@
 #include "omemo/omemo.h"
 #endif
 
+// number of messages fetched from the history database per page
+#define CHATWIN_HISTORY_PAGE 50
+// id of the line shown while the first page is read
+#define CHATWIN_HISTORY_LOADING_ID "history-loading"
+
+// displayed markers sent per window at most this often, a burst shown
+// over several frames is marked once
+#define CHATWIN_DISPLAYED_INTERVAL_MS 1000
+
+static SchedulerTask* displayed_task = NULL;
+
 static void _chatwin_history(ProfChatWin* chatwin, const char* const contact_barejid);
+static void _chatwin_history_loaded(GSList* history, const char* const cursor_time, gint64 cursor_id, void* userdata);
+static gboolean _chatwin_displayed_due(void* data);
 static void _chatwin_set_last_message(ProfChatWin* chatwin, const char* const id, const char* const message);
 
 ProfChatWin*
@@ -113,6 +127,53 @@ chatwin_receipt_received(ProfChatWin* chatwin, const char* const id)
     win_mark_received(win, id);
 }
 
+void
+chatwin_marker_received(ProfChatWin* chatwin, const char* const id)
+{
+    assert(chatwin != NULL);
+
+    win_mark_received_upto((ProfWin*)chatwin, id);
+}
+
+// Called while the end of the window is on screen, sends a displayed marker
+// for the latest markable message shown
+void
+chatwin_displayed(ProfChatWin* chatwin)
+{
+    assert(chatwin != NULL);
+
+    if (!chatwin->marker_id || displayed_task || connection_get_status() != JABBER_CONNECTED) {
+        return;
+    }
+
+    gint64 wait_ms = (chatwin->marker_sent - g_get_monotonic_time()) / 1000 + CHATWIN_DISPLAYED_INTERVAL_MS;
+    if (chatwin->marker_sent && wait_ms > 0) {
+        displayed_task = scheduler_add(wait_ms, _chatwin_displayed_due, NULL, NULL);
+        return;
+    }
+
+    message_send_displayed(chatwin->marker_jid, chatwin->marker_id);
+    free(chatwin->marker_id);
+    free(chatwin->marker_jid);
+    chatwin->marker_id = NULL;
+    chatwin->marker_jid = NULL;
+    chatwin->marker_sent = g_get_monotonic_time();
+}
+
+static gboolean
+_chatwin_displayed_due(void* data)
+{
+    displayed_task = NULL;
+
+    // whichever chat is shown by now
+    ProfWin* current = wins_get_current();
+    if (current && current->type == WIN_CHAT && current->layout->paged == 0) {
+        chatwin_displayed((ProfChatWin*)current);
+    }
+
+    return FALSE;
+}
+
 #ifdef HAVE_LIBOTR
 void
 chatwin_otr_secured(ProfChatWin* chatwin, gboolean trusted)
@@ -269,10 +330,10 @@ chatwin_incoming_msg(ProfChatWin* chatwin, ProfMessage* message, gboolean win_cr
     ProfWin* window = (ProfWin*)chatwin;
     int num = wins_get_num(window);
 
-    char* display_name;
+    const char* display_name;
     char* mybarejid = connection_get_barejid();
     if (g_strcmp0(mybarejid, message->from_jid->barejid) == 0) {
-        display_name = strdup("me");
+        display_name = "me";
     } else {
         display_name = roster_get_msg_display_name(message->from_jid->barejid, message->from_jid->resourcepart);
     }
@@ -281,6 +342,13 @@ chatwin_incoming_msg(ProfChatWin* chatwin, ProfMessage* message, gboolean win_cr
     gboolean is_current = wins_is_current(window);
     gboolean notify = prefs_do_chat_notify(is_current);
 
+    if (message->markable && message->id) {
+        free(chatwin->marker_id);
+        free(chatwin->marker_jid);
+        chatwin->marker_id = strdup(message->id);
+        chatwin->marker_jid = strdup(message->from_jid->fulljid);
+    }
+
     // currently viewing chat window with sender
     if (wins_is_current(window)) {
         win_print_incoming(window, display_name, message);
@@ -297,6 +365,7 @@ chatwin_incoming_msg(ProfChatWin* chatwin, ProfMessage* message, gboolean win_cr
         }
 
         chatwin->unread++;
+        wins_unread_changed(window, 1);
 
         // TODO: so far we don't ask for MAM when incoming message occurs.
         // Need to figure out:
@@ -332,8 +401,6 @@ chatwin_incoming_msg(ProfChatWin* chatwin, ProfMessage* message, gboolean win_cr
         notify_message(display_name, num, message->plain);
     }
 
-    free(display_name);
-
     plugins_post_chat_message_display(message->from_jid->barejid, message->from_jid->resourcepart, message->plain);
 
     free(message->plain);
@@ -510,27 +577,118 @@ chatwin_unset_outgoing_char(ProfChatWin* chatwin)
     }
 }
 
+static void
+_chatwin_history_display(GSList* history)
+{
+    GSList* curr = history;
+
+    while (curr) {
+        ProfMessage* msg = curr->data;
+        char* msg_plain = msg->plain;
+        msg->plain = plugins_pre_chat_message_display(msg->from_jid->barejid, msg->from_jid->resourcepart, msg->plain);
+        // This is dirty workaround for memory leak. We reassign msg->plain above so have to free previous object
+        // TODO: Make a better solution, for example, pass msg object to the function and it will replace msg->plain properly if needed.
+        free(msg_plain);
+        curr = g_slist_next(curr);
+    }
+}
+
+// The first page is read on the database thread, a placeholder holds its
+// place and the messages arriving meanwhile are printed below it
 static void
 _chatwin_history(ProfChatWin* chatwin, const char* const contact_barejid)
 {
-    if (!chatwin->history_shown) {
-        GSList* history = log_database_get_previous_chat(contact_barejid);
-        GSList* curr = history;
-
-        while (curr) {
-            ProfMessage* msg = curr->data;
-            char* msg_plain = msg->plain;
-            msg->plain = plugins_pre_chat_message_display(msg->from_jid->barejid, msg->from_jid->resourcepart, msg->plain);
-            // This is dirty workaround for memory leak. We reassign msg->plain above so have to free previous object
-            // TODO: Make a better solution, for example, pass msg object to the function and it will replace msg->plain properly if needed.
-            free(msg_plain);
-            win_print_history((ProfWin*)chatwin, msg);
-            curr = g_slist_next(curr);
-        }
+    if (chatwin->history_shown || chatwin->history_loading) {
+        return;
+    }
+
+    if (log_database_get_previous_chat_async(contact_barejid, CHATWIN_HISTORY_PAGE, _chatwin_history_loaded, strdup(contact_barejid), free)) {
+        chatwin->history_loading = TRUE;
+        win_print_placeholder((ProfWin*)chatwin, CHATWIN_HISTORY_LOADING_ID, "Loading history...");
+    } else {
         chatwin->history_shown = TRUE;
+        chatwin->history_complete = TRUE;
+    }
+}
+
+static void
+_chatwin_history_loaded(GSList* history, const char* const cursor_time, gint64 cursor_id, void* userdata)
+{
+    // the window may have been closed in the meantime
+    ProfChatWin* chatwin = wins_get_chat(userdata);
+    if (!chatwin || !chatwin->history_loading) {
+        return;
+    }
+
+    win_remove_entry_message((ProfWin*)chatwin, CHATWIN_HISTORY_LOADING_ID);
+    _chatwin_history_display(history);
+
+    // older than anything printed since the window opened
+    if (win_prepend_history((ProfWin*)chatwin, history) > 0) {
+        chatwin->history_truncated = TRUE;
+    }
+
+    g_free(chatwin->history_cursor_time);
+    chatwin->history_cursor_time = g_strdup(cursor_time);
+    chatwin->history_cursor_id = cursor_id;
+    chatwin->history_loading = FALSE;
+    chatwin->history_shown = TRUE;
+    chatwin->history_complete = g_slist_length(history) < CHATWIN_HISTORY_PAGE;
+}
+
+gboolean
+chatwin_older_history(ProfChatWin* chatwin)
+{
+    assert(chatwin != NULL);
+
+    if (!chatwin->history_shown || chatwin->history_complete) {
+        return FALSE;
+    }
+
+    GSList* history = log_database_get_previous_chat(chatwin->barejid, &chatwin->history_cursor_time, &chatwin->history_cursor_id, CHATWIN_HISTORY_PAGE);
+    _chatwin_history_display(history);
 
-        g_slist_free_full(history, (GDestroyNotify)message_free);
+    // the newest lines make room once the buffer is full
+    if (win_prepend_history((ProfWin*)chatwin, history) > 0) {
+        chatwin->history_truncated = TRUE;
     }
+
+    // stop paging once the database has no more
+    int length = g_slist_length(history);
+    if (length < CHATWIN_HISTORY_PAGE) {
+        chatwin->history_complete = TRUE;
+    }
+
+    g_slist_free_full(history, (GDestroyNotify)message_free);
+
+    return length > 0;
+}
+
+// Page down reached the end of the buffer after its newest lines were
+// dropped, reload the newest page from the database
+gboolean
+chatwin_newer_history(ProfChatWin* chatwin)
+{
+    assert(chatwin != NULL);
+
+    if (!chatwin->history_truncated) {
+        return FALSE;
+    }
+
+    g_free(chatwin->history_cursor_time);
+    chatwin->history_cursor_time = NULL;
+    chatwin->history_cursor_id = 0;
+
+    GSList* history = log_database_get_previous_chat(chatwin->barejid, &chatwin->history_cursor_time, &chatwin->history_cursor_id, CHATWIN_HISTORY_PAGE);
+    _chatwin_history_display(history);
+    win_reload_history((ProfWin*)chatwin, history);
+
+    chatwin->history_truncated = FALSE;
+    chatwin->history_complete = g_slist_length(history) < CHATWIN_HISTORY_PAGE;
+
+    g_slist_free_full(history, (GDestroyNotify)message_free);
+
+    return TRUE;
 }
 
 static void
@@ -291,17 +291,25 @@ _confwin_form_field(ProfWin* window, char* tag, FormField* field)
     case FIELD_LIST_MULTI:
         if (curr_value) {
             win_newline(window);
+            // a set of the selected values, lists may have thousands of options
+            GHashTable* selected = g_hash_table_new(g_str_hash, g_str_equal);
+            for (GSList* v = curr_value; v; v = g_slist_next(v)) {
+                if (v->data) {
+                    g_hash_table_add(selected, v->data);
+                }
+            }
             GSList* options = field->options;
             GSList* curr_option = options;
             while (curr_option) {
                 FormOption* option = curr_option->data;
-                if (g_slist_find_custom(curr_value, option->value, (GCompareFunc)g_strcmp0)) {
+                if (option->value && g_hash_table_contains(selected, option->value)) {
                     win_println(window, THEME_ONLINE, "-", "  [%s] %s", option->value, option->label);
                 } else {
                     win_println(window, THEME_OFFLINE, "-", "  [%s] %s", option->value, option->label);
                 }
                 curr_option = g_slist_next(curr_option);
             }
+            g_hash_table_destroy(selected);
         }
         break;
     case FIELD_JID_SINGLE:
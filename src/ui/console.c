@@ -50,6 +50,7 @@
 
 #include "common.h"
 #include "log.h"
+#include "database.h"
 #include "config/preferences.h"
 #include "config/theme.h"
 #include "command/cmd_defs.h"
@@ -1199,6 +1200,16 @@ cons_wrap_setting(void)
         cons_show("Word wrap (/wrap)                   : OFF");
 }
 
+void
+cons_collapse_setting(void)
+{
+    int lines = prefs_get_collapse_lines();
+    if (lines > 0)
+        cons_show("Collapse messages (/collapse)       : %d lines", lines);
+    else
+        cons_show("Collapse messages (/collapse)       : OFF");
+}
+
 void
 cons_titlebar_setting(void)
 {
@@ -1354,6 +1365,13 @@ cons_occupants_setting(void)
     int size = prefs_get_occupants_size();
     cons_show("Occupants size (/occupants)         : %d", size);
 
+    int light = prefs_get_occupants_light();
+    if (light > 0) {
+        cons_show("Occupants light (/occupants)        : %d occupants", light);
+    } else {
+        cons_show("Occupants light (/occupants)        : OFF");
+    }
+
     char* header_ch = prefs_get_occupants_header_char();
     if (header_ch) {
         cons_show("Occupants header char (/occupants)  : %s", header_ch);
@@ -1668,6 +1686,7 @@ cons_show_ui_prefs(void)
     cons_splash_setting();
     cons_winpos_setting();
     cons_wrap_setting();
+    cons_collapse_setting();
     cons_time_setting();
     cons_resource_setting();
     cons_vercheck_setting();
@@ -1858,6 +1877,11 @@ cons_receipts_setting(void)
         cons_show("Send receipts (/receipts)     : ON");
     else
         cons_show("Send receipts (/receipts)     : OFF");
+
+    if (prefs_get_boolean(PREF_RECEIPTS_MARKERS))
+        cons_show("Chat markers (/receipts)      : ON");
+    else
+        cons_show("Chat markers (/receipts)      : OFF");
 }
 
 void
@@ -1973,6 +1997,22 @@ cons_logging_setting(void)
         cons_show("Groupchat logging (/logging group)          : ON");
     else
         cons_show("Groupchat logging (/logging group)          : OFF");
+
+    cons_show("Chat log flush (/logging flush)             : %d seconds", prefs_get_chlog_flush());
+    if (prefs_get_boolean(PREF_CHLOG_COMPRESS))
+        cons_show("Chat log compression (/logging compress)    : ON");
+    else
+        cons_show("Chat log compression (/logging compress)    : OFF");
+    cons_show("History database mode (/logging db mode)    : %s", prefs_peek_string(PREF_DB_MODE));
+    cons_show("History retention (/logging db retain)      : %s", prefs_peek_string(PREF_DB_RETAIN));
+    cons_show("History database write queue                : %u messages", log_database_queue_depth());
+
+    gboolean running;
+    int files_done, files_total, messages;
+    gint64 elapsed_us;
+    if (log_database_import_status(&running, &files_done, &files_total, &messages, &elapsed_us)) {
+        cons_show("Chat log import (/logging db import)        : %s, %d of %d files, %d messages", running ? "running" : (files_done == files_total ? "done" : "stopped"), files_done, files_total, messages);
+    }
 }
 
 void
@@ -2034,6 +2074,12 @@ cons_autoaway_setting(void)
     } else {
         cons_show("Autoaway check (/autoaway check)          : OFF");
     }
+
+    if (prefs_get_boolean(PREF_AUTOAWAY_CSI)) {
+        cons_show("Autoaway CSI (/autoaway csi)              : ON");
+    } else {
+        cons_show("Autoaway CSI (/autoaway csi)              : OFF");
+    }
 }
 
 void
@@ -2065,6 +2111,26 @@ cons_reconnect_setting(void)
     }
 }
 
+void
+cons_bandwidth_setting(void)
+{
+    if (prefs_get_boolean(PREF_LOW_BANDWIDTH)) {
+        cons_show("Low bandwidth (/bandwidth)      : ON");
+    } else {
+        cons_show("Low bandwidth (/bandwidth)      : OFF");
+    }
+    if (prefs_get_boolean(PREF_COMPRESSION)) {
+        cons_show("Compression (/bandwidth)        : ON");
+    } else {
+        cons_show("Compression (/bandwidth)        : OFF");
+    }
+    if (prefs_get_boolean(PREF_TERMINAL_MINIMAL)) {
+        cons_show("Terminal output (/bandwidth)    : minimal");
+    } else {
+        cons_show("Terminal output (/bandwidth)    : full");
+    }
+}
+
 void
 cons_autoping_setting(void)
 {
@@ -2085,6 +2151,12 @@ cons_autoping_setting(void)
     } else {
         cons_show("Autoping timeout (/autoping)    : %d seconds", autoping_timeout);
     }
+
+    if (prefs_get_boolean(PREF_AUTOPING_ADAPTIVE)) {
+        cons_show("Autoping adaptive (/autoping)   : ON");
+    } else {
+        cons_show("Autoping adaptive (/autoping)   : OFF");
+    }
 }
 
 void
@@ -2197,6 +2269,16 @@ cons_mam_setting(void)
     }
 }
 
+void
+cons_url_setting(void)
+{
+    if (prefs_get_boolean(PREF_URL_SEGMENTED)) {
+        cons_show("Segmented downloads (/url segmented)    : ON");
+    } else {
+        cons_show("Segmented downloads (/url segmented)    : OFF");
+    }
+}
+
 void
 cons_silence_setting(void)
 {
@@ -2214,8 +2296,10 @@ cons_show_connection_prefs(void)
     cons_show("");
     cons_reconnect_setting();
     cons_autoping_setting();
+    cons_bandwidth_setting();
     cons_autoconnect_setting();
     cons_rooms_cache_setting();
+    cons_url_setting();
 
     cons_alert(NULL);
 }
@@ -2306,6 +2390,8 @@ cons_show_omemo_prefs(void)
     cons_show("OMEMO char (/omemo char)     : %s", ch);
     free(ch);
 
+    cons_show("OMEMO fetch window (/omemo fetchwindow) : %d", prefs_get_omemo_fetch_window());
+
     cons_alert(NULL);
 }
 
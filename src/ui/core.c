@@ -39,6 +39,7 @@
 #include "gitversion.h"
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -63,8 +64,10 @@
 #include "common.h"
 #include "command/cmd_defs.h"
 #include "command/cmd_ac.h"
+#include "config/color.h"
 #include "config/preferences.h"
 #include "config/theme.h"
+#include "tools/perf.h"
 #include "ui/ui.h"
 #include "ui/titlebar.h"
 #include "ui/statusbar.h"
@@ -84,23 +87,62 @@
 
 static int inp_size;
 static gboolean perform_resize = FALSE;
+static ui_dirty_t ui_dirty = UI_DIRTY_ALL;
+static gboolean roster_redraw_pending = FALSE;
+static unsigned int colors_recycled = 0;
+static GHashTable* occupants_redraw_pending = NULL;
+static gchar* term_title = NULL;
 static GTimer* ui_idle_time;
 
+// without a terminal ncurses draws to /dev/null on a screen of this size,
+// nothing is rendered and windows only keep their buffers
+#define HEADLESS_TERM  "dumb"
+#define HEADLESS_LINES 24
+#define HEADLESS_COLS  80
+static gboolean headless = FALSE;
+static SCREEN* headless_screen = NULL;
+static FILE* headless_out = NULL;
+static FILE* headless_in = NULL;
+
 #ifdef HAVE_LIBXSS
 static Display* display;
+static XScreenSaverInfo* xss_info = NULL;
+// a query is a round trip to the X server, a sample is reused for a second
+#define XSS_SAMPLE_US G_USEC_PER_SEC
+static gint64 xss_sampled_at = -1;
+static unsigned long xss_idle_ms = 0;
 #endif
 
 static void _ui_draw_term_title(void);
+static void _ui_redraw_panels(void);
+static void _ui_init_headless_screen(void);
+
+void
+ui_set_headless(gboolean enabled)
+{
+    headless = enabled;
+}
+
+gboolean
+ui_is_headless(void)
+{
+    return headless;
+}
 
 void
 ui_init(void)
 {
     log_info("Initialising UI");
-    initscr();
+    if (headless) {
+        _ui_init_headless_screen();
+    } else {
+        initscr();
+    }
     nonl();
     cbreak();
     noecho();
     keypad(stdscr, TRUE);
+    ui_apply_terminal_output();
     ui_load_colours();
     refresh();
     create_title_bar();
@@ -111,7 +153,7 @@ ui_init(void)
     notifier_initialise();
     cons_about();
 #ifdef HAVE_LIBXSS
-    display = XOpenDisplay(0);
+    display = headless ? NULL : XOpenDisplay(0);
 #endif
     ui_idle_time = g_timer_new();
     inp_size = 0;
@@ -125,23 +167,87 @@ ui_sigwinch_handler(int sig)
     perform_resize = TRUE;
 }
 
+void
+ui_mark_dirty(ui_dirty_t parts)
+{
+    ui_dirty |= parts;
+}
+
+void
+ui_redraw_roster(void)
+{
+    roster_redraw_pending = TRUE;
+}
+
+void
+ui_redraw_occupants(const char* const roomjid)
+{
+    if (occupants_redraw_pending == NULL) {
+        occupants_redraw_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    g_hash_table_add(occupants_redraw_pending, g_strdup(roomjid));
+}
+
 void
 ui_update(void)
 {
-    ProfWin* current = wins_get_current();
-    if (current->layout->paged == 0) {
-        win_move_to_end(current);
+    if (headless) {
+        ui_dirty = 0;
+        return;
     }
 
-    win_update_virtual(current);
+    gint64 started = perf_start();
+
+    _ui_redraw_panels();
 
-    if (prefs_get_boolean(PREF_WINTITLE_SHOW)) {
-        _ui_draw_term_title();
+    // a recycled nick colour pair also recolours text drawn with it before
+    unsigned int recycled = color_pair_cache_recycled();
+    if (recycled != colors_recycled) {
+        colors_recycled = recycled;
+        wins_mark_stale();
+        ui_dirty |= UI_DIRTY_WINDOW;
+    }
+
+    // the clock and the typing notice are the only things that change on their own
+    if (status_bar_clock_changed()) {
+        ui_dirty |= UI_DIRTY_STATUSBAR;
+    }
+    if (title_bar_typing_expired()) {
+        ui_dirty |= UI_DIRTY_TITLEBAR;
+    }
+
+    if (ui_dirty) {
+        ProfWin* current = wins_get_current();
+        if (ui_dirty & UI_DIRTY_WINDOW) {
+            if (current->layout->paged == 0) {
+                win_move_to_end(current);
+                if (current->type == WIN_CHAT) {
+                    chatwin_displayed((ProfChatWin*)current);
+                }
+            }
+            win_update_virtual(current);
+        }
+
+        // the title bar shows state of the current window
+        if (ui_dirty & (UI_DIRTY_WINDOW | UI_DIRTY_TITLEBAR)) {
+            if (prefs_get_boolean(PREF_WINTITLE_SHOW)) {
+                _ui_draw_term_title();
+            }
+            title_bar_update_virtual();
+        }
+        if (ui_dirty & UI_DIRTY_STATUSBAR) {
+            status_bar_draw();
+        }
+
+        // always last so the cursor ends up in the input line
+        inp_put_back();
+        ui_dirty = 0;
+        gint64 update_started = perf_start();
+        gint64 output_started = perf_output_start();
+        doupdate();
+        perf_output_stop(output_started);
+        perf_stop(PERF_DOUPDATE, update_started);
     }
-    title_bar_update_virtual();
-    status_bar_draw();
-    inp_put_back();
-    doupdate();
 
     if (perform_resize) {
         signal(SIGWINCH, SIG_IGN);
@@ -149,6 +255,8 @@ ui_update(void)
         perform_resize = FALSE;
         signal(SIGWINCH, ui_sigwinch_handler);
     }
+
+    perf_stop(PERF_UI_UPDATE, started);
 }
 
 unsigned long
@@ -156,15 +264,17 @@ ui_get_idle_time(void)
 {
 // if compiled with libxss, get the x sessions idle time
 #ifdef HAVE_LIBXSS
-    XScreenSaverInfo* info = XScreenSaverAllocInfo();
-    if (info && display) {
-        XScreenSaverQueryInfo(display, DefaultRootWindow(display), info);
-        unsigned long result = info->idle;
-        XFree(info);
-        return result;
-    }
-    if (info) {
-        XFree(info);
+    if (display && !xss_info) {
+        xss_info = XScreenSaverAllocInfo();
+    }
+    if (xss_info) {
+        gint64 now = g_get_monotonic_time();
+        if (xss_sampled_at < 0 || now - xss_sampled_at >= XSS_SAMPLE_US) {
+            XScreenSaverQueryInfo(display, DefaultRootWindow(display), xss_info);
+            xss_idle_ms = xss_info->idle;
+            xss_sampled_at = now;
+        }
+        return xss_idle_ms + (now - xss_sampled_at) / 1000;
     }
 // if no libxss or xss idle time failed, use profanity idle time
 #endif
@@ -177,6 +287,11 @@ void
 ui_reset_idle_time(void)
 {
     g_timer_start(ui_idle_time);
+#ifdef HAVE_LIBXSS
+    // typing here is activity the X server saw too
+    xss_idle_ms = 0;
+    xss_sampled_at = g_get_monotonic_time();
+#endif
 }
 
 void
@@ -184,30 +299,76 @@ ui_close(void)
 {
     notifier_uninit();
     cons_clear_alerts();
+    rosterwin_clear_cache();
     wins_destroy();
     inp_close();
     status_bar_close();
     endwin();
+    if (headless_screen) {
+        delscreen(headless_screen);
+        headless_screen = NULL;
+        fclose(headless_out);
+        fclose(headless_in);
+    }
+
+    g_free(term_title);
+    term_title = NULL;
+
+#ifdef HAVE_LIBXSS
+    if (xss_info) {
+        XFree(xss_info);
+        xss_info = NULL;
+    }
+    xss_sampled_at = -1;
+#endif
+
+    roster_redraw_pending = FALSE;
+    if (occupants_redraw_pending) {
+        g_hash_table_destroy(occupants_redraw_pending);
+        occupants_redraw_pending = NULL;
+    }
 }
 
 void
 ui_resize(void)
 {
+    if (headless) {
+        return;
+    }
+
     struct winsize w;
     ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-    erase();
+    // clearing repaints the whole screen, without it only what moved is sent
+    if (!prefs_get_boolean(PREF_TERMINAL_MINIMAL)) {
+        erase();
+    }
     resizeterm(w.ws_row, w.ws_col);
-    refresh();
+    if (!prefs_get_boolean(PREF_TERMINAL_MINIMAL)) {
+        refresh();
+    }
 
     log_debug("Resizing UI");
     title_bar_resize();
     wins_resize_all();
     status_bar_resize();
     inp_win_resize();
+    ui_dirty = UI_DIRTY_ALL;
     ProfWin* window = wins_get_current();
     win_update_virtual(window);
 }
 
+// With minimal output ncurses may scroll the terminal for new lines and
+// only paint those, instead of repainting every line that moved
+void
+ui_apply_terminal_output(void)
+{
+    if (headless) {
+        return;
+    }
+
+    idlok(stdscr, prefs_get_boolean(PREF_TERMINAL_MINIMAL));
+}
+
 void
 ui_redraw(void)
 {
@@ -215,6 +376,7 @@ ui_redraw(void)
     wins_resize_all();
     status_bar_resize();
     inp_win_resize();
+    ui_dirty = UI_DIRTY_ALL;
 }
 
 void
@@ -335,6 +497,7 @@ void
 ui_roster_remove(const char* const barejid)
 {
     cons_show("Roster item removed: %s", barejid);
+    rosterwin_clear_cache();
     rosterwin_roster();
 }
 
@@ -480,6 +643,24 @@ ui_invalid_command_usage(const char* const cmd, void (*setting_func)(void))
     g_string_free(msg, TRUE);
 }
 
+// the connection is gone but the stream may still be resumed, so
+// contacts and rooms are kept
+void
+ui_stream_suspended(void)
+{
+    wins_lost_connection();
+    title_bar_set_connected(FALSE);
+    title_bar_set_tls(FALSE);
+}
+
+void
+ui_stream_resumed(gboolean secured)
+{
+    title_bar_set_connected(TRUE);
+    title_bar_set_tls(secured);
+    wins_reestablished_connection();
+}
+
 void
 ui_disconnected(void)
 {
@@ -489,6 +670,7 @@ ui_disconnected(void)
     title_bar_set_presence(CONTACT_OFFLINE);
     status_bar_clear_fulljid();
     ui_hide_roster();
+    rosterwin_clear_cache();
 }
 
 void
@@ -1099,6 +1281,9 @@ ui_contact_offline(char* barejid, char* resource, char* status)
 void
 ui_clear_win_title(void)
 {
+    if (headless) {
+        return;
+    }
     fputs("\e]0;\a", stdout);
     fflush(stdout);
 }
@@ -1106,27 +1291,60 @@ ui_clear_win_title(void)
 void
 ui_goodbye_title(void)
 {
+    if (headless) {
+        return;
+    }
     fputs("\e]0;Thanks for using Profanity\a", stdout);
     fflush(stdout);
 }
 
+static void
+_ui_init_headless_screen(void)
+{
+    headless_out = fopen("/dev/null", "w");
+    headless_in = fopen("/dev/null", "r");
+    if (headless_out && headless_in) {
+        use_env(FALSE);
+        headless_screen = newterm(HEADLESS_TERM, headless_out, headless_in);
+    }
+    if (!headless_screen) {
+        log_error("Unable to create a screen for headless mode");
+        fprintf(stderr, "Unable to start in headless mode, terminfo for %s is missing\n", HEADLESS_TERM);
+        exit(1);
+    }
+
+    set_term(headless_screen);
+    resizeterm(HEADLESS_LINES, HEADLESS_COLS);
+}
+
 static void
 _ui_draw_term_title(void)
 {
     jabber_conn_status_t status = connection_get_status();
+    gchar* title = NULL;
 
     if (status == JABBER_CONNECTED) {
         const char* const jid = connection_get_fulljid();
         gint unread = wins_get_total_unread();
 
         if (unread != 0) {
-            fprintf(stdout, "\e]0;Profanity (%d) - %s\a", unread, jid);
+            title = g_strdup_printf("Profanity (%d) - %s", unread, jid);
         } else {
-            fprintf(stdout, "\e]0;Profanity - %s\a", jid);
+            title = g_strdup_printf("Profanity - %s", jid);
         }
     } else {
-        fputs("\e]0;Profanity\a", stdout);
+        title = g_strdup("Profanity");
     }
+
+    // only talk to the terminal when the title changed
+    if (g_strcmp0(title, term_title) == 0) {
+        g_free(title);
+        return;
+    }
+    g_free(term_title);
+    term_title = title;
+
+    fprintf(stdout, "\e]0;%s\a", term_title);
     fflush(stdout);
 }
 
@@ -1319,3 +1537,23 @@ ui_show_software_version(const char* const jid, const char* const presence,
         win_println(window, THEME_DEFAULT, "-", "OS      : %s", os);
     }
 }
+
+// render the side panels requested since the last update, once each
+static void
+_ui_redraw_panels(void)
+{
+    if (occupants_redraw_pending && g_hash_table_size(occupants_redraw_pending) > 0) {
+        GHashTableIter iter;
+        gpointer roomjid;
+        g_hash_table_iter_init(&iter, occupants_redraw_pending);
+        while (g_hash_table_iter_next(&iter, &roomjid, NULL)) {
+            occupantswin_occupants(roomjid);
+        }
+        g_hash_table_remove_all(occupants_redraw_pending);
+    }
+
+    if (roster_redraw_pending) {
+        roster_redraw_pending = FALSE;
+        rosterwin_roster();
+    }
+}
@@ -44,6 +44,7 @@
 #include <sys/time.h>
 #include <errno.h>
 #include <pthread.h>
+#include <unistd.h>
 
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -64,10 +65,14 @@
 #include "config/accounts.h"
 #include "config/preferences.h"
 #include "config/theme.h"
+#include "tools/perf.h"
+#include "tools/scheduler.h"
+#include "tools/width.h"
 #include "ui/ui.h"
 #include "ui/screen.h"
 #include "ui/statusbar.h"
 #include "ui/inputwin.h"
+#include "ui/relay.h"
 #include "ui/window.h"
 #include "ui/window_list.h"
 #include "xmpp/xmpp.h"
@@ -75,8 +80,17 @@
 #include "xmpp/roster_list.h"
 #include "xmpp/chat_state.h"
 
+// sent by the terminal around pasted text once bracketed paste is enabled
+#define INP_PASTE_ENABLE  "\e[?2004h"
+#define INP_PASTE_DISABLE "\e[?2004l"
+#define INP_PASTE_END     "\e[201~"
+
 static WINDOW* inp_win;
 static int pad_start = 0;
+// the line as the pad shows it, and the column each of its bytes starts
+// at with its width at the end, kept up to date from the first change on
+static GString* inp_shown = NULL;
+static GArray* inp_cols = NULL;
 
 static struct timeval p_rl_timeout;
 /* Timeout in ms. Shows how long select() may block. */
@@ -89,11 +103,20 @@ static int r;
 static char* inp_line = NULL;
 static gboolean get_password = FALSE;
 
+// headless input is read a line at a time from stdin, without readline
+static GString* headless_input = NULL;
+static gboolean headless_eof = FALSE;
+
 static void _inp_win_update_virtual(void);
 static int _inp_edited(const wint_t ch);
 static void _inp_win_handle_scroll(void);
-static int _inp_offset_to_col(char* str, int offset);
 static void _inp_write(char* line, int offset);
+static void _inp_forget(void);
+static gsize _inp_unchanged(const char* const line, gsize len);
+static void _inp_cols_update(const char* const line, gsize from, gsize len);
+static void _inp_headless_read(int fd);
+static char* _inp_headless_line(void);
+static void _inp_insert(const char* const text, gsize len);
 
 static void _inp_rl_addfuncs(void);
 static int _inp_rl_getc(FILE* stream);
@@ -133,6 +156,7 @@ static int _inp_rl_subwin_pageup_handler(int count, int key);
 static int _inp_rl_subwin_pagedown_handler(int count, int key);
 static int _inp_rl_startup_hook(void);
 static int _inp_rl_down_arrow_handler(int count, int key);
+static int _inp_rl_paste_handler(int count, int key);
 
 void
 create_input_window(void)
@@ -143,6 +167,17 @@ create_input_window(void)
     ESCDELAY = 25;
 #endif
     discard = fopen("/dev/null", "a");
+    inp_shown = g_string_new(NULL);
+    inp_cols = g_array_new(FALSE, TRUE, sizeof(int));
+    g_array_set_size(inp_cols, 1);
+
+    if (ui_is_headless()) {
+        headless_input = g_string_new(NULL);
+        headless_eof = FALSE;
+        inp_win = newpad(1, INP_WIN_MAX);
+        return;
+    }
+
     rl_outstream = discard;
     rl_readline_name = "profanity";
     _inp_rl_addfuncs();
@@ -156,6 +191,9 @@ create_input_window(void)
     keypad(inp_win, TRUE);
     wmove(inp_win, 0, 0);
 
+    fprintf(stdout, INP_PASTE_ENABLE);
+    fflush(stdout);
+
     _inp_win_update_virtual();
 }
 
@@ -164,13 +202,51 @@ inp_readline(void)
 {
     free(inp_line);
     inp_line = NULL;
-    p_rl_timeout.tv_sec = inp_timeout / 1000;
-    p_rl_timeout.tv_usec = inp_timeout % 1000 * 1000;
+    // a line already read in headless mode needn't wait either
+    gboolean line_pending = headless_input && (memchr(headless_input->str, '\n', headless_input->len) || relay_has_line());
+    // TLS may hold more than libstrophe took, read on while it takes some
+    gboolean net_pending = connection_has_pending();
+    gint timeout = net_pending || line_pending ? 0 : inp_timeout;
+    // don't sleep past the next scheduled task
+    gint next_task = scheduler_next_timeout();
+    if (next_task >= 0 && next_task < timeout) {
+        timeout = next_task;
+    }
+    p_rl_timeout.tv_sec = timeout / 1000;
+    p_rl_timeout.tv_usec = timeout % 1000 * 1000;
+
+    // wake up for the server and stderr too, so they needn't be polled
+    int in_fd = fileno(rl_instream);
+    int xmpp_fd = connection_get_fd();
+    int stderr_fd = log_stderr_fd();
+    int wakeup_fd = scheduler_wakeup_fd();
+    int max_fd = in_fd;
     FD_ZERO(&fds);
-    FD_SET(fileno(rl_instream), &fds);
+    if (headless_input && headless_eof) {
+        max_fd = -1;
+    } else {
+        FD_SET(in_fd, &fds);
+    }
+    if (xmpp_fd >= 0) {
+        FD_SET(xmpp_fd, &fds);
+        max_fd = MAX(max_fd, xmpp_fd);
+    }
+    if (stderr_fd >= 0) {
+        FD_SET(stderr_fd, &fds);
+        max_fd = MAX(max_fd, stderr_fd);
+    }
+    // events posted by other threads, run by scheduler_run()
+    if (wakeup_fd >= 0) {
+        FD_SET(wakeup_fd, &fds);
+        max_fd = MAX(max_fd, wakeup_fd);
+    }
+    if (headless_input) {
+        max_fd = relay_set_fds(&fds, max_fd);
+    }
+
     errno = 0;
     pthread_mutex_unlock(&lock);
-    r = select(FD_SETSIZE, &fds, NULL, NULL, &p_rl_timeout);
+    r = select(max_fd + 1, &fds, NULL, NULL, &p_rl_timeout);
     pthread_mutex_lock(&lock);
     if (r < 0) {
         if (errno != EINTR) {
@@ -180,7 +256,22 @@ inp_readline(void)
         return NULL;
     }
 
-    if (FD_ISSET(fileno(rl_instream), &fds)) {
+    // anything from the server or the keyboard may change what is shown
+    if (net_pending || (xmpp_fd >= 0 && FD_ISSET(xmpp_fd, &fds))) {
+        ui_mark_dirty(UI_DIRTY_ALL);
+    }
+
+    if (headless_input) {
+        if (!headless_eof && FD_ISSET(in_fd, &fds)) {
+            _inp_headless_read(in_fd);
+        }
+        inp_line = _inp_headless_line();
+        if (!inp_line) {
+            inp_line = relay_read(&fds);
+        }
+        inp_nonblocking(inp_line != NULL);
+    } else if (FD_ISSET(in_fd, &fds)) {
+        ui_mark_dirty(UI_DIRTY_ALL);
         rl_callback_read_char();
 
         if (rl_line_buffer && rl_line_buffer[0] != '/' && rl_line_buffer[0] != '\0' && rl_line_buffer[0] != '\n') {
@@ -194,7 +285,6 @@ inp_readline(void)
         inp_nonblocking(TRUE);
     } else {
         inp_nonblocking(FALSE);
-        chat_state_idle();
     }
 
     if (inp_line) {
@@ -232,6 +322,13 @@ inp_win_resize(void)
     _inp_win_update_virtual();
 }
 
+// what readline reads from, not necessarily stdin
+int
+inp_fd(void)
+{
+    return fileno(rl_instream);
+}
+
 void
 inp_nonblocking(gboolean reset)
 {
@@ -261,6 +358,21 @@ inp_nonblocking(gboolean reset)
 void
 inp_close(void)
 {
+    g_string_free(inp_shown, TRUE);
+    inp_shown = NULL;
+    g_array_free(inp_cols, TRUE);
+    inp_cols = NULL;
+
+    if (headless_input) {
+        g_string_free(headless_input, TRUE);
+        headless_input = NULL;
+        fclose(discard);
+        return;
+    }
+
+    fprintf(stdout, INP_PASTE_DISABLE);
+    fflush(stdout);
+
     rl_callback_handler_remove();
     fclose(discard);
 }
@@ -269,6 +381,7 @@ char*
 inp_get_line(void)
 {
     werase(inp_win);
+    _inp_forget();
     wmove(inp_win, 0, 0);
     _inp_win_update_virtual();
     doupdate();
@@ -285,6 +398,7 @@ char*
 inp_get_password(void)
 {
     werase(inp_win);
+    _inp_forget();
     wmove(inp_win, 0, 0);
     _inp_win_update_virtual();
     doupdate();
@@ -305,27 +419,135 @@ inp_put_back(void)
     _inp_win_update_virtual();
 }
 
+void
+inp_insert_text(const char* const text)
+{
+    _inp_insert(text, strlen(text));
+    _inp_win_update_virtual();
+}
+
+// Takes what stdin has, at the end of input it is no longer waited on
+static void
+_inp_headless_read(int fd)
+{
+    char buf[1024];
+    ssize_t len = read(fd, buf, sizeof(buf));
+    if (len > 0) {
+        g_string_append_len(headless_input, buf, len);
+    } else if (len == 0 || (errno != EINTR && errno != EAGAIN)) {
+        log_info("End of headless input");
+        headless_eof = TRUE;
+    }
+}
+
+// The first complete line read, the rest waits for the next call
+static char*
+_inp_headless_line(void)
+{
+    char* newline = memchr(headless_input->str, '\n', headless_input->len);
+    if (!newline) {
+        return NULL;
+    }
+
+    gsize line_len = newline - headless_input->str;
+    char* line = strndup(headless_input->str, line_len);
+    g_string_erase(headless_input, 0, line_len + 1);
+    ui_reset_idle_time();
+
+    return line;
+}
+
 static void
 _inp_win_update_virtual(void)
 {
     int wcols = getmaxx(stdscr);
     int row = screen_inputwin_row();
     if (inp_win != NULL) {
+        ui_mark_dirty(UI_DIRTY_INPUT);
         pnoutrefresh(inp_win, 0, pad_start, row, 0, row, wcols - 1);
     }
 }
 
+// Only what changed since the last write is put to the pad again, from
+// the first byte that differs on, moving the cursor alone writes nothing
 static void
 _inp_write(char* line, int offset)
 {
-    int col = _inp_offset_to_col(line, offset);
-    werase(inp_win);
-    waddstr(inp_win, line);
+    gsize len = strlen(line);
+    gsize same = _inp_unchanged(line, len);
+
+    if (same < inp_shown->len || same < len) {
+        _inp_cols_update(line, same, len);
+        wmove(inp_win, 0, g_array_index(inp_cols, int, same));
+
+        // pasted text may hold newlines, they take a marked column so the
+        // input stays on one row
+        const char* curr = line + same;
+        const char* newline;
+        while ((newline = strchr(curr, '\n')) != NULL) {
+            waddnstr(inp_win, curr, newline - curr);
+            waddch(inp_win, ' ' | A_REVERSE);
+            curr = newline + 1;
+        }
+        waddstr(inp_win, curr);
+        wclrtoeol(inp_win);
+
+        g_string_truncate(inp_shown, same);
+        g_string_append_len(inp_shown, line + same, len - same);
+    }
+
+    int col = g_array_index(inp_cols, int, MIN((gsize)offset, len));
     wmove(inp_win, 0, col);
     _inp_win_handle_scroll();
 
     _inp_win_update_virtual();
+    gint64 output_started = perf_output_start();
     doupdate();
+    perf_output_stop(output_started);
+}
+
+// the pad was cleared, the next write puts the whole line
+static void
+_inp_forget(void)
+{
+    g_string_truncate(inp_shown, 0);
+    g_array_set_size(inp_cols, 1);
+}
+
+// Length of what line has in common with the pad, up to a character start
+static gsize
+_inp_unchanged(const char* const line, gsize len)
+{
+    gsize same = 0;
+    gsize shown = inp_shown->len;
+    while (same < len && same < shown && line[same] == inp_shown->str[same]) {
+        same++;
+    }
+    while (same > 0 && same < len && ((guchar)line[same] & 0xC0) == 0x80) {
+        same--;
+    }
+
+    return same;
+}
+
+// Columns of line from byte from on, those before it are still right
+static void
+_inp_cols_update(const char* const line, gsize from, gsize len)
+{
+    g_array_set_size(inp_cols, len + 1);
+    int* cols = (int*)inp_cols->data;
+
+    int col = cols[from];
+    gsize i = from;
+    while (i < len) {
+        int bytes;
+        int width = width_char(line + i, &bytes);
+        for (int j = 0; j < bytes && i < len; j++, i++) {
+            cols[i] = col;
+        }
+        col += width < 0 ? 1 : width;
+    }
+    cols[len] = col;
 }
 
 static int
@@ -362,25 +584,6 @@ _inp_edited(const wint_t ch)
     return g_unichar_isprint(unichar);
 }
 
-static int
-_inp_offset_to_col(char* str, int offset)
-{
-    int i = 0;
-    int col = 0;
-
-    while (i < offset && str[i] != '\0') {
-        gunichar uni = g_utf8_get_char(&str[i]);
-        size_t ch_len = mbrlen(&str[i], MB_CUR_MAX, NULL);
-        i += ch_len;
-        col++;
-        if (g_unichar_iswide(uni)) {
-            col++;
-        }
-    }
-
-    return col;
-}
-
 static void
 _inp_win_handle_scroll(void)
 {
@@ -503,6 +706,10 @@ _inp_rl_startup_hook(void)
 
     rl_bind_keyseq("\\e[1;5B", _inp_rl_down_arrow_handler); // ctrl+arrow down
 
+    // handled here rather than by readline, see _inp_rl_paste_handler()
+    rl_variable_bind("enable-bracketed-paste", "off");
+    rl_bind_keyseq("\\e[200~", _inp_rl_paste_handler);
+
     // unbind unwanted mappings
     rl_bind_keyseq("\\e=", NULL);
 
@@ -558,6 +765,63 @@ _inp_rl_getc(FILE* stream)
     return ch;
 }
 
+// Everything up to the end of a bracketed paste goes into the line at once.
+// The characters skip the key handling, nothing is autocompleted or sent
+// until the paste is complete, and the line is drawn once.
+static int
+_inp_rl_paste_handler(int count, int key)
+{
+    const char* end = INP_PASTE_END;
+    size_t end_len = strlen(end);
+    size_t matched = 0;
+    GString* paste = g_string_new(NULL);
+
+    while (matched < end_len) {
+        int ch = rl_getc(rl_instream);
+        if (ch == EOF) {
+            break;
+        }
+
+        if (ch == end[matched]) {
+            matched++;
+            continue;
+        }
+
+        // it was not the end marker after all
+        if (matched > 0) {
+            g_string_append_len(paste, end, matched);
+            matched = 0;
+            if (ch == end[0]) {
+                matched = 1;
+                continue;
+            }
+        }
+
+        g_string_append_c(paste, ch == '\r' ? '\n' : ch);
+    }
+
+    _inp_insert(paste->str, paste->len);
+    g_string_free(paste, TRUE);
+
+    return 0;
+}
+
+// Pasted text goes in where the cursor is, the line is sent with enter as
+// usual, not by a copied line break
+static void
+_inp_insert(const char* const text, gsize len)
+{
+    while (len > 0 && text[len - 1] == '\n') {
+        len--;
+    }
+
+    char* insert = g_strndup(text, len);
+    rl_insert_text(insert);
+    g_free(insert);
+
+    cmd_ac_reset(wins_get_current());
+}
+
 static int
 _inp_rl_win_clear_handler(int count, int key)
 {
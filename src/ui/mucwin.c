@@ -43,16 +43,28 @@
 #include <stdlib.h>
 
 #include "log.h"
+#include "database.h"
 #include "config/preferences.h"
 #include "plugins/plugins.h"
+#include "tools/scheduler.h"
+#include "tools/timefmt.h"
 #include "ui/window.h"
 #include "ui/win_types.h"
 #include "ui/window_list.h"
+#include "xmpp/message.h"
 #ifdef HAVE_OMEMO
 #include "omemo/omemo.h"
 #endif
 
+// history is drawn with the room subject, or after this long if none comes
+#define MUCWIN_HISTORY_FLUSH_MS 2000
+// stored messages shown when the window opens
+#define MUCWIN_HISTORY_PAGE 50
+
 static void _mucwin_set_last_message(ProfMucWin* mucwin, const char* const id, const char* const message);
+static char* _mucwin_message_char(ProfMucWin* mucwin, const ProfMessage* const message);
+static void _mucwin_local_history(ProfMucWin* mucwin);
+static gboolean _mucwin_local_history_due(void* data);
 
 ProfMucWin*
 mucwin_new(const char* const barejid)
@@ -60,7 +72,11 @@ mucwin_new(const char* const barejid)
     ProfWin* window = wins_new_muc(barejid);
     ProfMucWin* mucwin = (ProfMucWin*)window;
 
-    mucwin->last_msg_timestamp = NULL;
+    mucwin->last_msg_timestamp = 0;
+
+    // the stored history is drawn right after the window, before the
+    // room answers the join
+    scheduler_add(0, _mucwin_local_history_due, strdup(barejid), free);
 
 #ifdef HAVE_OMEMO
     if (muc_anonymity_type(mucwin->roomjid) == MUC_ANONYMITY_TYPE_NONANONYMOUS && omemo_automatic_start(barejid)) {
@@ -362,22 +378,133 @@ mucwin_nick_change(ProfMucWin* mucwin, const char* const nick)
     win_println(window, THEME_ME, "!", "** You are now known as %s", nick);
 }
 
-void
+static gboolean
+_mucwin_local_history_due(void* data)
+{
+    ProfMucWin* mucwin = wins_get_muc(data);
+    if (mucwin) {
+        _mucwin_local_history(mucwin);
+    }
+
+    return FALSE;
+}
+
+// Draws the newest stored messages of the room, the history the room sends
+// on joining only fills the gap after them
+static void
+_mucwin_local_history(ProfMucWin* mucwin)
+{
+    if (mucwin->history_local) {
+        return;
+    }
+    mucwin->history_local = TRUE;
+
+    GSList* history = NULL;
+    if (prefs_get_boolean(PREF_GRLOG) && prefs_get_boolean(PREF_HISTORY)) {
+        history = log_database_get_previous_muc(mucwin->roomjid, MUCWIN_HISTORY_PAGE);
+    }
+
+    ProfWin* window = (ProfWin*)mucwin;
+    for (GSList* curr = history; curr; curr = g_slist_next(curr)) {
+        win_print_history(window, curr->data);
+    }
+
+    GSList* newest = g_slist_last(history);
+    if (newest) {
+        ProfMessage* message = newest->data;
+        mucwin->history_since = timefmt_local(message->timestamp);
+        mucwin->history_since_text = strdup(message->plain);
+    } else {
+        mucwin->history_since = log_database_get_last_muc(mucwin->roomjid);
+    }
+
+    g_slist_free_full(history, (GDestroyNotify)message_free);
+}
+
+// The room's history starts at the newest stored message, anything older
+// and that message itself were stored already
+static gboolean
+_mucwin_history_stored(ProfMucWin* mucwin, const ProfMessage* const message)
+{
+    if (!mucwin->history_since || !message->timestamp) {
+        return FALSE;
+    }
+
+    gint64 since = g_date_time_to_unix(mucwin->history_since);
+    gint64 sent = message->timestamp / G_USEC_PER_SEC;
+    if (sent != since) {
+        return sent < since;
+    }
+
+    return !mucwin->history_since_text || g_strcmp0(mucwin->history_since_text, message->plain) == 0;
+}
+
+static gboolean
+_mucwin_history_timeout(void* data)
+{
+    ProfMucWin* mucwin = wins_get_muc(data);
+    if (mucwin) {
+        mucwin_history_flush(mucwin);
+    }
+
+    return FALSE;
+}
+
+// Room history arrives as a burst of messages when joining, they are kept
+// until the subject or the first live message and then drawn together.
+// FALSE for a message stored already, which is dropped.
+gboolean
 mucwin_history(ProfMucWin* mucwin, const ProfMessage* const message)
 {
     assert(mucwin != NULL);
 
-    char* nick = message->from_jid->resourcepart;
-    char* mynick = muc_nick(mucwin->roomjid);
-    GSList* mentions = get_mentions(prefs_get_boolean(PREF_NOTIFY_MENTION_WHOLE_WORD), prefs_get_boolean(PREF_NOTIFY_MENTION_CASE_SENSITIVE), message->plain, mynick);
-    GList* triggers = prefs_message_get_triggers(message->plain);
+    _mucwin_local_history(mucwin);
+    if (_mucwin_history_stored(mucwin, message)) {
+        return FALSE;
+    }
+
+    if (!mucwin->history) {
+        scheduler_add(MUCWIN_HISTORY_FLUSH_MS, _mucwin_history_timeout, strdup(mucwin->roomjid), free);
+    }
+    mucwin->history = g_slist_prepend(mucwin->history, message_copy(message));
+
+    return TRUE;
+}
+
+// History is not scanned for mentions and triggers, it does not notify and
+// is drawn plainly with a single redraw of the window
+void
+mucwin_history_flush(ProfMucWin* mucwin)
+{
+    assert(mucwin != NULL);
+
+    _mucwin_local_history(mucwin);
+    if (!mucwin->history) {
+        return;
+    }
+
+    ProfWin* window = (ProfWin*)mucwin;
+    GSList* history = g_slist_reverse(mucwin->history);
+    mucwin->history = NULL;
+
+    win_insert_last_read_position_marker(window, mucwin->roomjid);
+
+    for (GSList* curr = history; curr; curr = g_slist_next(curr)) {
+        ProfMessage* message = curr->data;
+        int flags = message->trusted ? 0 : UNTRUSTED;
+        char* ch = _mucwin_message_char(mucwin, message);
 
-    mucwin_incoming_msg(mucwin, message, mentions, triggers, FALSE);
+        wins_add_urls_ac(window, message);
+        win_append_incoming_muc_msg(window, ch, flags, message);
+        free(ch);
 
-    g_slist_free(mentions);
-    g_list_free_full(triggers, free);
+        plugins_on_room_history_message(mucwin->roomjid, message->from_jid->resourcepart, message->plain, message->timestamp);
+    }
+
+    g_slist_free_full(history, (GDestroyNotify)message_free);
 
-    plugins_on_room_history_message(mucwin->roomjid, nick, message->plain, message->timestamp);
+    win_redraw(window);
+    inp_nonblocking(TRUE);
 }
 
 static void
@@ -425,62 +552,15 @@ _mucwin_print_mention(ProfWin* window, const char* const message, const char* co
     }
 }
 
-gint
-_cmp_trigger_weight(gconstpointer a, gconstpointer b)
-{
-    int alen = strlen((char*)a);
-    int blen = strlen((char*)b);
-
-    if (alen > blen)
-        return -1;
-    if (alen < blen)
-        return 1;
-
-    return 0;
-}
-
 static void
-_mucwin_print_triggers(ProfWin* window, const char* const message, GList* triggers)
+_mucwin_print_triggers(ProfWin* window, const char* const message)
 {
-    GList* weighted_triggers = NULL;
-    GList* curr = triggers;
-    while (curr) {
-        weighted_triggers = g_list_insert_sorted(weighted_triggers, curr->data, (GCompareFunc)_cmp_trigger_weight);
-        curr = g_list_next(curr);
-    }
-
-    char* message_lower = g_utf8_strdown(message, -1);
-
     // find earliest trigger in message
     int first_trigger_pos = -1;
     int first_trigger_len = -1;
-    curr = weighted_triggers;
-    while (curr) {
-        char* trigger_lower = g_utf8_strdown(curr->data, -1);
-        char* trigger_ptr = g_strstr_len(message_lower, -1, trigger_lower);
-
-        // not found, try next
-        if (trigger_ptr == NULL) {
-            curr = g_list_next(curr);
-            continue;
-        }
-
-        // found, replace vars if earlier than previous
-        int trigger_pos = trigger_ptr - message_lower;
-        if (first_trigger_pos == -1 || trigger_pos < first_trigger_pos) {
-            first_trigger_pos = trigger_pos;
-            first_trigger_len = strlen(trigger_lower);
-        }
-
-        g_free(trigger_lower);
-        curr = g_list_next(curr);
-    }
-
-    g_free(message_lower);
-    g_list_free(weighted_triggers);
 
     // no triggers found
-    if (first_trigger_pos == -1) {
+    if (!prefs_message_find_trigger(message, &first_trigger_pos, &first_trigger_len)) {
         win_appendln_highlight(window, THEME_ROOMTRIGGER, "%s", message);
     } else {
         if (first_trigger_pos > 0) {
@@ -503,7 +583,7 @@ _mucwin_print_triggers(ProfWin* window, const char* const message, GList* trigge
 
         if (first_trigger_pos + first_trigger_len < strlen(message)) {
             win_append_highlight(window, THEME_ROOMTRIGGER_TERM, "%s", trigger_section);
-            _mucwin_print_triggers(window, &message[first_trigger_pos + first_trigger_len], triggers);
+            _mucwin_print_triggers(window, &message[first_trigger_pos + first_trigger_len]);
         } else {
             win_appendln_highlight(window, THEME_ROOMTRIGGER_TERM, "%s", trigger_section);
         }
@@ -561,18 +641,7 @@ mucwin_incoming_msg(ProfMucWin* mucwin, const ProfMessage* const message, GSList
     ProfWin* window = (ProfWin*)mucwin;
     char* mynick = muc_nick(mucwin->roomjid);
 
-    char* ch;
-    if (mucwin->message_char) {
-        ch = strdup(mucwin->message_char);
-    } else if (message->enc == PROF_MSG_ENC_OTR) {
-        ch = prefs_get_otr_char();
-    } else if (message->enc == PROF_MSG_ENC_PGP) {
-        ch = prefs_get_pgp_char();
-    } else if (message->enc == PROF_MSG_ENC_OMEMO) {
-        ch = prefs_get_omemo_char();
-    } else {
-        ch = strdup("-");
-    }
+    char* ch = _mucwin_message_char(mucwin, message);
 
     win_insert_last_read_position_marker((ProfWin*)mucwin, mucwin->roomjid);
     wins_add_urls_ac(window, message);
@@ -581,7 +650,7 @@ mucwin_incoming_msg(ProfMucWin* mucwin, const ProfMessage* const message, GSList
         _mucwin_print_mention(window, message->plain, message->from_jid->resourcepart, mynick, mentions, ch, flags);
     } else if (triggers) {
         win_print_them(window, THEME_ROOMTRIGGER, ch, flags, message->from_jid->resourcepart);
-        _mucwin_print_triggers(window, message->plain, triggers);
+        _mucwin_print_triggers(window, message->plain);
     } else {
         win_println_incoming_muc_msg(window, ch, flags, message);
     }
@@ -589,6 +658,22 @@ mucwin_incoming_msg(ProfMucWin* mucwin, const ProfMessage* const message, GSList
     free(ch);
 }
 
+static char*
+_mucwin_message_char(ProfMucWin* mucwin, const ProfMessage* const message)
+{
+    if (mucwin->message_char) {
+        return strdup(mucwin->message_char);
+    } else if (message->enc == PROF_MSG_ENC_OTR) {
+        return prefs_get_otr_char();
+    } else if (message->enc == PROF_MSG_ENC_PGP) {
+        return prefs_get_pgp_char();
+    } else if (message->enc == PROF_MSG_ENC_OMEMO) {
+        return prefs_get_omemo_char();
+    } else {
+        return strdup("-");
+    }
+}
+
 void
 mucwin_requires_config(ProfMucWin* mucwin)
 {
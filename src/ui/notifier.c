@@ -37,6 +37,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include <glib.h>
 
@@ -54,24 +55,77 @@
 #include "ui/window_list.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/muc.h"
+#include "tools/scheduler.h"
 
-static GTimer* remind_timer;
+static SchedulerTask* remind_task = NULL;
+
+// Notifications are shown by a worker thread, a slow notification daemon
+// or command would otherwise stall the client. Notifications for a window
+// that are still waiting are merged into one, and the oldest is dropped
+// when too many are waiting.
+#define NOTIFY_QUEUE_MAX 32
+
+typedef struct notification_t
+{
+    gchar* key; // window the notification is for, NULL when not merged
+    gchar* header;
+    gchar* text;
+    int count;
+    int timeout;
+    gchar* category;
+} Notification;
+
+static pthread_t notify_worker;
+static gboolean notify_worker_running = FALSE;
+static pthread_mutex_t notify_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notify_cond = PTHREAD_COND_INITIALIZER;
+static GQueue* notifications = NULL;
+
+static gboolean _notify_remind(void* data);
+static void* _notify_worker_loop(void* data);
+static void _notify_queue(const char* const key, const char* const header, const char* const text, int timeout,
+                          const char* const category);
+static void _notify_show(const char* const message, int timeout, const char* const category);
+static void _notification_free(Notification* notification);
 
 void
 notifier_initialise(void)
 {
-    remind_timer = g_timer_new();
+    notifications = g_queue_new();
+    notify_worker_running = pthread_create(&notify_worker, NULL, _notify_worker_loop, NULL) == 0;
+    if (!notify_worker_running) {
+        log_error("Could not start notification thread, notifications will be shown directly.");
+    }
+
+    notify_remind_update();
 }
 
 void
 notifier_uninit(void)
 {
+    scheduler_remove(remind_task);
+    remind_task = NULL;
+
+    // notifications still waiting are of no use once the client quits
+    pthread_mutex_lock(&notify_lock);
+    gboolean running = notify_worker_running;
+    notify_worker_running = FALSE;
+    pthread_cond_signal(&notify_cond);
+    pthread_mutex_unlock(&notify_lock);
+    if (running) {
+        pthread_join(notify_worker, NULL);
+    }
+
+    if (notifications) {
+        g_queue_free_full(notifications, (GDestroyNotify)_notification_free);
+        notifications = NULL;
+    }
+
 #ifdef HAVE_LIBNOTIFY
     if (notify_is_initted()) {
         notify_uninit();
     }
 #endif
-    g_timer_destroy(remind_timer);
 }
 
 void
@@ -106,14 +160,14 @@ notify_message(const char* const name, int num, const char* const text)
         ui_index = 0;
     }
 
-    GString* message = g_string_new("");
-    g_string_append_printf(message, "%s (win %d)", name, ui_index);
-    if (text && prefs_get_boolean(PREF_NOTIFY_CHAT_TEXT)) {
-        g_string_append_printf(message, "\n%s", text);
-    }
+    gchar* key = g_strdup_printf("%d", ui_index);
+    gchar* header = g_strdup_printf("%s (win %d)", name, ui_index);
+    const char* shown = prefs_get_boolean(PREF_NOTIFY_CHAT_TEXT) ? text : NULL;
 
-    notify(message->str, 10000, "incoming message");
-    g_string_free(message, TRUE);
+    _notify_queue(key, header, shown, 10000, "incoming message");
+
+    g_free(header);
+    g_free(key);
 }
 
 void
@@ -124,15 +178,14 @@ notify_room_message(const char* const nick, const char* const room, int num, con
         ui_index = 0;
     }
 
-    GString* message = g_string_new("");
-    g_string_append_printf(message, "%s in %s (win %d)", nick, room, ui_index);
-    if (text && prefs_get_boolean(PREF_NOTIFY_ROOM_TEXT)) {
-        g_string_append_printf(message, "\n%s", text);
-    }
+    gchar* key = g_strdup_printf("%d", ui_index);
+    gchar* header = g_strdup_printf("%s in %s (win %d)", nick, room, ui_index);
+    const char* shown = prefs_get_boolean(PREF_NOTIFY_ROOM_TEXT) ? text : NULL;
 
-    notify(message->str, 10000, "incoming message");
+    _notify_queue(key, header, shown, 10000, "incoming message");
 
-    g_string_free(message, TRUE);
+    g_free(header);
+    g_free(key);
 }
 
 void
@@ -144,59 +197,178 @@ notify_subscription(const char* const from)
     g_string_free(message, TRUE);
 }
 
+// Re-arms the reminder after the period was changed, a period of 0 disables it
 void
-notify_remind(void)
+notify_remind_update(void)
 {
-    gdouble elapsed = g_timer_elapsed(remind_timer, NULL);
+    scheduler_remove(remind_task);
+    remind_task = NULL;
+
     gint remind_period = prefs_get_notify_remind();
-    if (remind_period > 0 && elapsed >= remind_period) {
-        gboolean donotify = wins_do_notify_remind();
-        gint unread = wins_get_total_unread();
-        gint open = muc_invites_count();
-        gint subs = presence_sub_request_count();
-
-        GString* text = g_string_new("");
-
-        if (donotify && unread > 0) {
-            if (unread == 1) {
-                g_string_append(text, "1 unread message");
-            } else {
-                g_string_append_printf(text, "%d unread messages", unread);
-            }
+    if (remind_period > 0) {
+        remind_task = scheduler_add(remind_period * 1000, _notify_remind, NULL, NULL);
+    }
+}
+
+static gboolean
+_notify_remind(void* data)
+{
+    gboolean donotify = wins_do_notify_remind();
+    gint unread = wins_get_total_unread();
+    gint open = muc_invites_count();
+    gint subs = presence_sub_request_count();
+
+    GString* text = g_string_new("");
+
+    if (donotify && unread > 0) {
+        if (unread == 1) {
+            g_string_append(text, "1 unread message");
+        } else {
+            g_string_append_printf(text, "%d unread messages", unread);
         }
-        if (open > 0) {
-            if (unread > 0) {
-                g_string_append(text, "\n");
-            }
-            if (open == 1) {
-                g_string_append(text, "1 room invite");
-            } else {
-                g_string_append_printf(text, "%d room invites", open);
-            }
+    }
+    if (open > 0) {
+        if (unread > 0) {
+            g_string_append(text, "\n");
         }
-        if (subs > 0) {
-            if ((unread > 0) || (open > 0)) {
-                g_string_append(text, "\n");
-            }
-            if (subs == 1) {
-                g_string_append(text, "1 subscription request");
-            } else {
-                g_string_append_printf(text, "%d subscription requests", subs);
-            }
+        if (open == 1) {
+            g_string_append(text, "1 room invite");
+        } else {
+            g_string_append_printf(text, "%d room invites", open);
         }
-
-        if ((donotify && unread > 0) || (open > 0) || (subs > 0)) {
-            notify(text->str, 5000, "Incoming message");
+    }
+    if (subs > 0) {
+        if ((unread > 0) || (open > 0)) {
+            g_string_append(text, "\n");
         }
+        if (subs == 1) {
+            g_string_append(text, "1 subscription request");
+        } else {
+            g_string_append_printf(text, "%d subscription requests", subs);
+        }
+    }
 
-        g_string_free(text, TRUE);
-
-        g_timer_start(remind_timer);
+    if ((donotify && unread > 0) || (open > 0) || (subs > 0)) {
+        notify(text->str, 5000, "Incoming message");
     }
+
+    g_string_free(text, TRUE);
+
+    return TRUE;
 }
 
 void
 notify(const char* const message, int timeout, const char* const category)
+{
+    _notify_queue(NULL, message, NULL, timeout, category);
+}
+
+static void
+_notification_free(Notification* notification)
+{
+    g_free(notification->key);
+    g_free(notification->header);
+    g_free(notification->text);
+    g_free(notification->category);
+    g_free(notification);
+}
+
+static gchar*
+_notification_message(Notification* notification)
+{
+    GString* message = g_string_new(notification->header);
+    if (notification->count > 1) {
+        g_string_append_printf(message, "\n%d new messages", notification->count);
+    }
+    if (notification->text) {
+        g_string_append_printf(message, "\n%s", notification->text);
+    }
+
+    return g_string_free(message, FALSE);
+}
+
+static Notification*
+_notify_find_waiting(const char* const key)
+{
+    for (GList* curr = g_queue_peek_head_link(notifications); curr; curr = g_list_next(curr)) {
+        Notification* notification = curr->data;
+        if (g_strcmp0(notification->key, key) == 0) {
+            return notification;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+_notify_queue(const char* const key, const char* const header, const char* const text, int timeout,
+              const char* const category)
+{
+    pthread_mutex_lock(&notify_lock);
+
+    if (!notify_worker_running) {
+        pthread_mutex_unlock(&notify_lock);
+        Notification direct = { NULL, (gchar*)header, (gchar*)text, 1, timeout, (gchar*)category };
+        gchar* message = _notification_message(&direct);
+        _notify_show(message, timeout, category);
+        g_free(message);
+        return;
+    }
+
+    Notification* waiting = key ? _notify_find_waiting(key) : NULL;
+    if (waiting) {
+        // the latest header and text stand for all the merged messages
+        g_free(waiting->header);
+        waiting->header = g_strdup(header);
+        g_free(waiting->text);
+        waiting->text = g_strdup(text);
+        waiting->count++;
+    } else {
+        if (g_queue_get_length(notifications) >= NOTIFY_QUEUE_MAX) {
+            _notification_free(g_queue_pop_head(notifications));
+        }
+
+        Notification* notification = g_new(Notification, 1);
+        notification->key = g_strdup(key);
+        notification->header = g_strdup(header);
+        notification->text = g_strdup(text);
+        notification->count = 1;
+        notification->timeout = timeout;
+        notification->category = g_strdup(category);
+        g_queue_push_tail(notifications, notification);
+        pthread_cond_signal(&notify_cond);
+    }
+
+    pthread_mutex_unlock(&notify_lock);
+}
+
+static void*
+_notify_worker_loop(void* data)
+{
+    pthread_mutex_lock(&notify_lock);
+    while (notify_worker_running) {
+        Notification* notification = g_queue_pop_head(notifications);
+        if (!notification) {
+            pthread_cond_wait(&notify_cond, &notify_lock);
+            continue;
+        }
+        pthread_mutex_unlock(&notify_lock);
+
+        gchar* message = _notification_message(notification);
+        _notify_show(message, notification->timeout, notification->category);
+        g_free(message);
+        _notification_free(notification);
+
+        pthread_mutex_lock(&notify_lock);
+    }
+    pthread_mutex_unlock(&notify_lock);
+
+    return NULL;
+}
+
+// Runs on the worker thread unless it could not be started
+static void
+_notify_show(const char* const message, int timeout, const char* const category)
 {
 #ifdef HAVE_LIBNOTIFY
     log_debug("Attempting notification: %s", message);
@@ -40,15 +40,24 @@
 
 #include "config/preferences.h"
 #include "ui/ui.h"
+#include "ui/screen.h"
 #include "ui/window.h"
 #include "ui/window_list.h"
 
+// rows of the panel in view, entries outside it are only counted when their height is known
+typedef struct occupants_view_t
+{
+    gboolean virtual;
+    int first_row;
+    int last_row;
+} OccupantsView;
+
 static void
-_occuptantswin_occupant(ProfLayoutSplit* layout, GList* item, gboolean showjid, gboolean isoffline)
+_occuptantswin_occupant(ProfLayoutSplit* layout, gpointer item, gboolean showjid, gboolean isoffline)
 {
     int colour = 0;                                     // init to workaround compiler warning
     theme_item_t presence_colour = THEME_ROSTER_ONLINE; // init to workaround compiler warning
-    Occupant* occupant = item->data;
+    Occupant* occupant = item;
 
     if (isoffline) {
         wattron(layout->subwin, theme_attrs(THEME_ROSTER_OFFLINE));
@@ -86,7 +95,7 @@ _occuptantswin_occupant(ProfLayoutSplit* layout, GList* item, gboolean showjid,
     gboolean wrap = prefs_get_boolean(PREF_OCCUPANTS_WRAP);
 
     if (isoffline) {
-        Jid* jid = jid_create(item->data);
+        Jid* jid = jid_create(item);
         g_string_append(msg, jid->barejid);
         jid_destroy(jid);
     } else {
@@ -117,17 +126,83 @@ _occuptantswin_occupant(ProfLayoutSplit* layout, GList* item, gboolean showjid,
     }
 }
 
+// skips the entry if it would be drawn outside the view, returns TRUE if skipped
+static gboolean
+_occupantswin_skip(ProfLayoutSplit* layout, OccupantsView* view, int rows)
+{
+    if (!view->virtual) {
+        return FALSE;
+    }
+
+    int start = getcury(layout->subwin);
+    if (getcurx(layout->subwin) > 0) {
+        start++;
+    }
+    int end = start + rows - 1;
+    if (end < view->first_row || start > view->last_row) {
+        // leave the cursor past the line start as drawing would
+        win_pad_reserve(layout->subwin, end - getcury(layout->subwin) + 1);
+        wmove(layout->subwin, end, 1);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void
+_occupantswin_header(ProfLayoutSplit* layout, GString* prefix, const char* const title)
+{
+    GString* role = g_string_new(prefix->str);
+    g_string_append(role, title);
+
+    wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
+    win_sub_newline_lazy(layout->subwin);
+    win_sub_print(layout->subwin, role->str, TRUE, FALSE, 0);
+    wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
+    g_string_free(role, TRUE);
+}
+
+static void
+_occupantswin_occupants_list(ProfLayoutSplit* layout, OccupantsView* view, GSequence* occupants, gboolean showjid,
+                             GHashTable* online_barejids)
+{
+    GSequenceIter* curr = g_sequence_get_begin_iter(occupants);
+    while (!g_sequence_iter_is_end(curr)) {
+        Occupant* occupant = g_sequence_get(curr);
+        if (online_barejids && occupant->jid) {
+            Jid* jidp = jid_create(occupant->jid);
+            if (jidp && jidp->barejid) {
+                g_hash_table_add(online_barejids, g_strdup(jidp->barejid));
+            }
+            jid_destroy(jidp);
+        }
+
+        int rows = (showjid && occupant->jid) ? 2 : 1;
+        if (!_occupantswin_skip(layout, view, rows)) {
+            _occuptantswin_occupant(layout, occupant, showjid, false);
+        }
+        curr = g_sequence_iter_next(curr);
+    }
+}
+
 void
 occupantswin_occupants(const char* const roomjid)
 {
     ProfMucWin* mucwin = wins_get_muc(roomjid);
     if (mucwin) {
-        GList* occupants = muc_roster(roomjid);
-        if (occupants) {
+        GSequence* occupants = muc_roster_view(roomjid);
+        if (occupants && !g_sequence_is_empty(occupants)) {
             ProfLayoutSplit* layout = (ProfLayoutSplit*)mucwin->window.layout;
             assert(layout->memcheck == LAYOUT_SPLIT_MEMCHECK);
 
             werase(layout->subwin);
+            ui_mark_dirty(UI_DIRTY_WINDOW);
+
+            // without wrapping every occupant takes a known number of rows
+            OccupantsView view;
+            view.virtual = !prefs_get_boolean(PREF_OCCUPANTS_WRAP);
+            view.first_row = layout->sub_y_pos;
+            view.last_row = view.first_row + screen_mainwin_row_end() - screen_mainwin_row_start();
 
             GString* prefix = g_string_new(" ");
 
@@ -138,122 +213,53 @@ occupantswin_occupants(const char* const roomjid)
             }
 
             if (prefs_get_boolean(PREF_MUC_PRIVILEGES)) {
+                // barejids of online occupants, so members on several devices are not listed offline
+                GHashTable* online_barejids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
-                GList* online_occupants = { NULL };
-
-                GString* role = g_string_new(prefix->str);
-                g_string_append(role, "Moderators");
-
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_sub_newline_lazy(layout->subwin);
-                win_sub_print(layout->subwin, role->str, TRUE, FALSE, 0);
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                g_string_free(role, TRUE);
-                GList* roster_curr = occupants;
-                while (roster_curr) {
-                    Occupant* occupant = roster_curr->data;
-                    if (occupant->role == MUC_ROLE_MODERATOR) {
-                        _occuptantswin_occupant(layout, roster_curr, mucwin->showjid, false);
-                    }
-                    roster_curr = g_list_next(roster_curr);
-                    online_occupants = g_list_append(online_occupants, occupant->jid);
-                }
+                _occupantswin_header(layout, prefix, "Moderators");
+                _occupantswin_occupants_list(layout, &view, muc_roster_view_by_role(roomjid, MUC_ROLE_MODERATOR),
+                                             mucwin->showjid, online_barejids);
 
-                role = g_string_new(prefix->str);
-                g_string_append(role, "Participants");
-
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_sub_newline_lazy(layout->subwin);
-                win_sub_print(layout->subwin, role->str, TRUE, FALSE, 0);
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                g_string_free(role, TRUE);
-                roster_curr = occupants;
-                while (roster_curr) {
-                    Occupant* occupant = roster_curr->data;
-                    if (occupant->role == MUC_ROLE_PARTICIPANT) {
-                        _occuptantswin_occupant(layout, roster_curr, mucwin->showjid, false);
-                    }
-                    roster_curr = g_list_next(roster_curr);
-                    online_occupants = g_list_append(online_occupants, occupant->jid);
-                }
+                _occupantswin_header(layout, prefix, "Participants");
+                _occupantswin_occupants_list(layout, &view, muc_roster_view_by_role(roomjid, MUC_ROLE_PARTICIPANT),
+                                             mucwin->showjid, online_barejids);
 
-                role = g_string_new(prefix->str);
-                g_string_append(role, "Visitors");
-
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_sub_newline_lazy(layout->subwin);
-                win_sub_print(layout->subwin, role->str, TRUE, FALSE, 0);
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                g_string_free(role, TRUE);
-                roster_curr = occupants;
-                while (roster_curr) {
-                    Occupant* occupant = roster_curr->data;
-                    if (occupant->role == MUC_ROLE_VISITOR) {
-                        _occuptantswin_occupant(layout, roster_curr, mucwin->showjid, false);
-                    }
-                    roster_curr = g_list_next(roster_curr);
-                    online_occupants = g_list_append(online_occupants, occupant->jid);
-                }
+                _occupantswin_header(layout, prefix, "Visitors");
+                _occupantswin_occupants_list(layout, &view, muc_roster_view_by_role(roomjid, MUC_ROLE_VISITOR),
+                                             mucwin->showjid, online_barejids);
 
                 if (mucwin->showoffline) {
                     GList* members = muc_members(roomjid);
                     // offline_occupants is used to display the same account on multiple devices once
-                    GList* offline_occupants = { NULL };
-
-                    role = g_string_new(prefix->str);
-                    g_string_append(role, "Offline");
+                    GHashTable* offline_occupants = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
-                    wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                    win_sub_newline_lazy(layout->subwin);
-                    win_sub_print(layout->subwin, role->str, TRUE, FALSE, 0);
-                    wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                    g_string_free(role, TRUE);
-                    roster_curr = members;
+                    _occupantswin_header(layout, prefix, "Offline");
+                    GList* roster_curr = members;
                     while (roster_curr) {
                         Jid* jid = jid_create(roster_curr->data);
-                        gboolean found = false;
-                        GList* iter = online_occupants;
-                        for (; iter != NULL; iter = iter->next) {
-                            if (strstr(iter->data, jid->barejid)) {
-                                found = true;
-                                break;
+                        if (!g_hash_table_contains(online_barejids, jid->barejid)
+                            && !g_hash_table_contains(offline_occupants, jid->barejid)) {
+                            if (!_occupantswin_skip(layout, &view, 1)) {
+                                _occuptantswin_occupant(layout, roster_curr->data, mucwin->showjid, true);
                             }
-                        }
-
-                        if (!found && g_list_index(offline_occupants, jid->barejid) == -1) {
-                            _occuptantswin_occupant(layout, roster_curr, mucwin->showjid, true);
-                            offline_occupants = g_list_append(offline_occupants, jid->barejid);
+                            g_hash_table_add(offline_occupants, g_strdup(jid->barejid));
                         }
 
                         jid_destroy(jid);
                         roster_curr = g_list_next(roster_curr);
                     }
                     g_list_free(members);
-                    g_list_free(offline_occupants);
+                    g_hash_table_destroy(offline_occupants);
                 }
-                g_list_free(online_occupants);
+                g_hash_table_destroy(online_barejids);
 
             } else {
-                GString* role = g_string_new(prefix->str);
-                g_string_append(role, "Occupants\n");
-
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_sub_newline_lazy(layout->subwin);
-                win_sub_print(layout->subwin, role->str, TRUE, FALSE, 0);
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                g_string_free(role, TRUE);
-
-                GList* roster_curr = occupants;
-                while (roster_curr) {
-                    _occuptantswin_occupant(layout, roster_curr, mucwin->showjid, false);
-                    roster_curr = g_list_next(roster_curr);
-                }
+                _occupantswin_header(layout, prefix, "Occupants\n");
+                _occupantswin_occupants_list(layout, &view, occupants, mucwin->showjid, NULL);
             }
 
             g_string_free(prefix, TRUE);
         }
-
-        g_list_free(occupants);
     }
 }
 
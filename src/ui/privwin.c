@@ -75,6 +75,7 @@ privwin_incoming_msg(ProfPrivateWin* privatewin, ProfMessage* message)
         win_print_incoming(window, jidp->resourcepart, message);
 
         privatewin->unread++;
+        wins_unread_changed(window, 1);
 
         if (prefs_get_boolean(PREF_FLASH)) {
             flash();
@@ -0,0 +1,423 @@
+/*
+ * relay.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "log.h"
+#include "config/files.h"
+#include "ui/ui.h"
+#include "ui/buffer.h"
+#include "ui/relay.h"
+#include "ui/window.h"
+#include "ui/window_list.h"
+
+#define FILE_RELAY_SOCKET "relay.sock"
+// a frontend this far behind is dropped
+#define RELAY_OUT_MAX (1024 * 1024)
+#define RELAY_IN_MAX  (64 * 1024)
+
+typedef struct relay_client_t
+{
+    int fd;
+    GString* in;
+    GString* out;
+    // window numbers the frontend has been told about
+    GHashTable* wins;
+    gboolean closed;
+} RelayClient;
+
+static int listen_fd = -1;
+static gchar* socket_path = NULL;
+static GList* clients = NULL;
+
+static void _relay_snapshot(RelayClient* client);
+
+static void
+_relay_client_free(RelayClient* client)
+{
+    close(client->fd);
+    g_string_free(client->in, TRUE);
+    g_string_free(client->out, TRUE);
+    g_hash_table_destroy(client->wins);
+    g_free(client);
+}
+
+// A socket nothing listens on was left behind by a core that did not exit
+// cleanly and is removed, one that still accepts belongs to a running core.
+static gboolean
+_relay_path_free(struct sockaddr_un* addr)
+{
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        log_error("Unable to create relay socket: %s", strerror(errno));
+        return FALSE;
+    }
+
+    int connected = connect(probe, (struct sockaddr*)addr, sizeof(*addr));
+    int err = errno;
+    close(probe);
+
+    if (connected == 0) {
+        log_error("Relay socket %s is in use by another instance", socket_path);
+        return FALSE;
+    }
+    if (err == ENOENT) {
+        return TRUE;
+    }
+    if (err == ECONNREFUSED) {
+        unlink(socket_path);
+        return TRUE;
+    }
+
+    log_error("Unable to check relay socket %s: %s", socket_path, strerror(err));
+    return FALSE;
+}
+
+gboolean
+relay_start(void)
+{
+    socket_path = files_get_data_path(FILE_RELAY_SOCKET);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        log_error("Relay socket path too long: %s", socket_path);
+        g_free(socket_path);
+        socket_path = NULL;
+        return FALSE;
+    }
+    g_strlcpy(addr.sun_path, socket_path, sizeof(addr.sun_path));
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        log_error("Unable to create relay socket: %s", strerror(errno));
+        g_free(socket_path);
+        socket_path = NULL;
+        return FALSE;
+    }
+
+    if (!_relay_path_free(&addr)) {
+        close(listen_fd);
+        listen_fd = -1;
+        g_free(socket_path);
+        socket_path = NULL;
+        return FALSE;
+    }
+    mode_t mask = umask(S_IRWXG | S_IRWXO);
+    int bound = bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+    if (bound < 0 || listen(listen_fd, 4) < 0) {
+        log_error("Unable to listen on relay socket %s: %s", socket_path, strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        g_free(socket_path);
+        socket_path = NULL;
+        return FALSE;
+    }
+    g_unix_set_fd_nonblocking(listen_fd, TRUE, NULL);
+
+    log_info("Relay listening on %s", socket_path);
+    return TRUE;
+}
+
+void
+relay_stop(void)
+{
+    g_list_free_full(clients, (GDestroyNotify)_relay_client_free);
+    clients = NULL;
+
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path);
+    }
+    g_free(socket_path);
+    socket_path = NULL;
+}
+
+int
+relay_clients(void)
+{
+    return g_list_length(clients);
+}
+
+static void
+_relay_flush(RelayClient* client)
+{
+    while (!client->closed && client->out->len > 0) {
+        ssize_t len = write(client->fd, client->out->str, client->out->len);
+        if (len > 0) {
+            g_string_erase(client->out, 0, len);
+        } else if (len < 0 && (errno == EAGAIN || errno == EINTR)) {
+            break;
+        } else {
+            client->closed = TRUE;
+        }
+    }
+
+    if (client->out->len > RELAY_OUT_MAX) {
+        log_warning("Relay frontend too far behind, dropping it");
+        client->closed = TRUE;
+    }
+}
+
+static void
+_relay_escape(GString* out, const char* text)
+{
+    for (const char* curr = text; curr && *curr; curr++) {
+        switch (*curr) {
+        case '\\':
+            g_string_append(out, "\\\\");
+            break;
+        case '\n':
+            g_string_append(out, "\\n");
+            break;
+        case '\t':
+            g_string_append(out, "\\t");
+            break;
+        default:
+            g_string_append_c(out, *curr);
+            break;
+        }
+    }
+}
+
+static void
+_relay_send_window(RelayClient* client, ProfWin* window, int num)
+{
+    if (g_hash_table_contains(client->wins, GINT_TO_POINTER(num))) {
+        return;
+    }
+    g_hash_table_add(client->wins, GINT_TO_POINTER(num));
+
+    char* title = win_get_title(window);
+    g_string_append_printf(client->out, "N %d ", num);
+    _relay_escape(client->out, title);
+    g_string_append_c(client->out, '\n');
+    free(title);
+}
+
+static void
+_relay_send_line(RelayClient* client, int num, gint64 unix_time, int flags, const char* const from, const char* const message)
+{
+    g_string_append_printf(client->out, "%c %d %" G_GINT64_FORMAT "\t", flags & NO_EOL ? 'P' : 'W', num, unix_time);
+    _relay_escape(client->out, from);
+    g_string_append_c(client->out, '\t');
+    _relay_escape(client->out, message);
+    g_string_append_c(client->out, '\n');
+}
+
+static gint
+_relay_cmp_num(gconstpointer a, gconstpointer b)
+{
+    return GPOINTER_TO_INT(a) - GPOINTER_TO_INT(b);
+}
+
+static void
+_relay_snapshot(RelayClient* client)
+{
+    GList* nums = g_list_sort(wins_get_nums(), _relay_cmp_num);
+    for (GList* curr = nums; curr; curr = g_list_next(curr)) {
+        int num = GPOINTER_TO_INT(curr->data);
+        ProfWin* window = wins_get_by_num(num);
+        if (!window) {
+            continue;
+        }
+        _relay_send_window(client, window, num);
+
+        ProfBuff buffer = window->layout->buffer;
+        int size = buffer_size(buffer);
+        for (int i = MAX(0, size - RELAY_SNAPSHOT_LINES); i < size; i++) {
+            ProfBuffEntry* e = buffer_get_entry(buffer, i);
+            _relay_send_line(client, num, e->time / G_USEC_PER_SEC, e->flags, e->display_from, e->message);
+        }
+    }
+    g_list_free(nums);
+
+    g_string_append(client->out, "S\n");
+    _relay_flush(client);
+}
+
+static void
+_relay_accept(void)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    g_unix_set_fd_nonblocking(fd, TRUE, NULL);
+
+    RelayClient* client = g_new0(RelayClient, 1);
+    client->fd = fd;
+    client->in = g_string_new(NULL);
+    client->out = g_string_new(NULL);
+    client->wins = g_hash_table_new(g_direct_hash, g_direct_equal);
+    clients = g_list_append(clients, client);
+
+    log_info("Relay frontend attached, %d attached", relay_clients());
+    _relay_snapshot(client);
+}
+
+static void
+_relay_receive(RelayClient* client)
+{
+    char buf[4096];
+    ssize_t len = read(client->fd, buf, sizeof(buf));
+    if (len > 0) {
+        g_string_append_len(client->in, buf, len);
+        if (client->in->len > RELAY_IN_MAX) {
+            log_warning("Relay frontend sent an overlong line, dropping it");
+            client->closed = TRUE;
+        }
+    } else if (len == 0 || (errno != EAGAIN && errno != EINTR)) {
+        client->closed = TRUE;
+    }
+}
+
+// Closed frontends are only freed here, never while their lines are sent
+static void
+_relay_reap(void)
+{
+    GList* curr = clients;
+    while (curr) {
+        GList* next = g_list_next(curr);
+        RelayClient* client = curr->data;
+        if (client->closed) {
+            clients = g_list_delete_link(clients, curr);
+            _relay_client_free(client);
+            log_info("Relay frontend detached, %d attached", relay_clients());
+        }
+        curr = next;
+    }
+}
+
+int
+relay_set_fds(fd_set* fds, int max_fd)
+{
+    if (listen_fd < 0) {
+        return max_fd;
+    }
+
+    FD_SET(listen_fd, fds);
+    max_fd = MAX(max_fd, listen_fd);
+    for (GList* curr = clients; curr; curr = g_list_next(curr)) {
+        RelayClient* client = curr->data;
+        FD_SET(client->fd, fds);
+        max_fd = MAX(max_fd, client->fd);
+    }
+
+    return max_fd;
+}
+
+gboolean
+relay_has_line(void)
+{
+    for (GList* curr = clients; curr; curr = g_list_next(curr)) {
+        RelayClient* client = curr->data;
+        if (memchr(client->in->str, '\n', client->in->len)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// Reads what the frontends sent and returns the first complete line, or NULL
+char*
+relay_read(fd_set* fds)
+{
+    if (listen_fd < 0) {
+        return NULL;
+    }
+
+    for (GList* curr = clients; curr; curr = g_list_next(curr)) {
+        RelayClient* client = curr->data;
+        if (FD_ISSET(client->fd, fds)) {
+            _relay_receive(client);
+        }
+        // what did not fit the socket before
+        _relay_flush(client);
+    }
+    if (FD_ISSET(listen_fd, fds)) {
+        _relay_accept();
+    }
+    _relay_reap();
+
+    for (GList* curr = clients; curr; curr = g_list_next(curr)) {
+        RelayClient* client = curr->data;
+        char* newline = memchr(client->in->str, '\n', client->in->len);
+        if (newline) {
+            gsize line_len = newline - client->in->str;
+            char* line = strndup(client->in->str, line_len);
+            g_string_erase(client->in, 0, line_len + 1);
+            return line;
+        }
+    }
+
+    return NULL;
+}
+
+void
+relay_window_line(ProfWin* window, GDateTime* time, int flags, const char* const from, const char* const message)
+{
+    if (!clients) {
+        return;
+    }
+
+    int num = wins_get_num(window);
+    gint64 unix_time = time ? g_date_time_to_unix(time) : g_get_real_time() / G_USEC_PER_SEC;
+    for (GList* curr = clients; curr; curr = g_list_next(curr)) {
+        RelayClient* client = curr->data;
+        if (client->closed) {
+            continue;
+        }
+        _relay_send_window(client, window, num);
+        _relay_send_line(client, num, unix_time, flags, from, message);
+        _relay_flush(client);
+    }
+}
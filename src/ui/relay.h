@@ -0,0 +1,68 @@
+/*
+ * relay.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef UI_RELAY_H
+#define UI_RELAY_H
+
+#include <sys/select.h>
+
+#include <glib.h>
+
+#include "ui/win_types.h"
+
+// lines of each window a frontend gets when it attaches
+#define RELAY_SNAPSHOT_LINES 100
+
+// Frontends attached to a headless core over a UNIX socket. Each gets the
+// recent lines of every window once, then every new line as it is printed.
+// Lines they send are run as commands in the current window.
+//
+// Records sent, one per line, with \ \n and \t escaped:
+//   N <win> <title>                      window seen for the first time
+//   W <win> <unix time>\t<from>\t<text>  a line of a window
+//   P <win> <unix time>\t<from>\t<text>  part of a line, more follows
+//   S                                    snapshot done, new lines follow
+gboolean relay_start(void);
+void relay_stop(void);
+int relay_clients(void);
+
+int relay_set_fds(fd_set* fds, int max_fd);
+gboolean relay_has_line(void);
+char* relay_read(fd_set* fds);
+
+void relay_window_line(ProfWin* window, GDateTime* time, int flags, const char* const from, const char* const message);
+
+#endif
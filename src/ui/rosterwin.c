@@ -40,8 +40,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "config/color.h"
 #include "config/preferences.h"
 #include "ui/ui.h"
+#include "ui/screen.h"
 #include "ui/window.h"
 #include "ui/window_list.h"
 #include "xmpp/roster_list.h"
@@ -53,6 +55,44 @@ typedef enum {
     ROSTER_CONTACT_UNREAD
 } roster_contact_theme_t;
 
+// preferences deciding how many rows a contact takes up
+typedef struct roster_row_prefs_t
+{
+    gboolean resource;
+    gboolean resource_join;
+    gboolean presence;
+    gboolean status;
+    gboolean by_presence;
+    int presence_indent;
+} RosterRowPrefs;
+
+// one print of a contact, the attributes already resolved from the theme
+typedef struct roster_row_part_t
+{
+    gboolean newline;
+    int attrs;
+    int indent;
+    char* text;
+} RosterRowPart;
+
+// what a contact draws, kept while the contact, its unread count (-1
+// without a chat window), the preferences, the theme and the nick colour
+// pairs stay the same
+typedef struct roster_row_t
+{
+    guint contact_revision;
+    guint prefs_generation;
+    guint theme_generation;
+    unsigned int pairs_recycled;
+    int unread;
+    GArray* parts;
+} RosterRow;
+
+// barejid to RosterRow
+static GHashTable* row_cache = NULL;
+
+static void _rosterwin_row_free(RosterRow* row);
+
 static void _rosterwin_contacts_all(ProfLayoutSplit* layout);
 static void _rosterwin_contacts_by_presence(ProfLayoutSplit* layout, const char* const presence, char* title);
 static void _rosterwin_contacts_by_group(ProfLayoutSplit* layout, char* group);
@@ -60,11 +100,15 @@ static void _rosteriwin_unsubscribed(ProfLayoutSplit* layout);
 static void _rosterwin_contacts_header(ProfLayoutSplit* layout, const char* title, GSList* contacts);
 static void _rosterwin_unsubscribed_header(ProfLayoutSplit* layout, GList* wins);
 
+static void _rosterwin_contacts(ProfLayoutSplit* layout, GSList* contacts);
 static void _rosterwin_contact(ProfLayoutSplit* layout, PContact contact);
+static int _rosterwin_contact_rows(RosterRowPrefs* prefs, PContact contact);
+static int _rosterwin_presence_rows(RosterRowPrefs* prefs, const char* presence, const char* status);
 static void _rosterwin_unsubscribed_item(ProfLayoutSplit* layout, ProfChatWin* chatwin);
-static void _rosterwin_presence(ProfLayoutSplit* layout, const char* presence, const char* status,
+static void _rosterwin_contact_parts(GArray* parts, PContact contact, int unread);
+static void _rosterwin_presence(GArray* parts, const char* presence, const char* status,
                                 int current_indent);
-static void _rosterwin_resources(ProfLayoutSplit* layout, PContact contact, int current_indent,
+static void _rosterwin_resources(GArray* parts, PContact contact, int current_indent,
                                  roster_contact_theme_t theme_type, int unread);
 
 static void _rosterwin_rooms(ProfLayoutSplit* layout, char* title, GList* rooms);
@@ -76,7 +120,7 @@ static void _rosterwin_print_rooms(ProfLayoutSplit* layout);
 static void _rosterwin_private_chats(ProfLayoutSplit* layout, GList* orphaned_privchats);
 static void _rosterwin_private_header(ProfLayoutSplit* layout, GList* privs);
 
-static GSList* _filter_contacts(GSList* contacts);
+static GSList* _filter_contacts(GSequence* contacts);
 static GSList* _filter_contacts_with_presence(GSList* contacts, const char* const presence);
 static theme_item_t _get_roster_theme(roster_contact_theme_t theme_type, const char* presence);
 static int _compare_rooms_name(ProfMucWin* a, ProfMucWin* b);
@@ -100,6 +144,7 @@ rosterwin_roster(void)
 
     if (layout->subwin != NULL) {
         werase(layout->subwin);
+        ui_mark_dirty(UI_DIRTY_WINDOW);
     }
 
     char* roomspos = prefs_get_string(PREF_ROSTER_ROOMS_POS);
@@ -186,29 +231,21 @@ rosterwin_roster(void)
 static void
 _rosterwin_contacts_all(ProfLayoutSplit* layout)
 {
-    GSList* contacts = NULL;
+    GSequence* contacts = NULL;
 
     char* order = prefs_get_string(PREF_ROSTER_ORDER);
     if (g_strcmp0(order, "presence") == 0) {
-        contacts = roster_get_contacts(ROSTER_ORD_PRESENCE);
+        contacts = roster_get_contacts_view(ROSTER_ORD_PRESENCE);
     } else {
-        contacts = roster_get_contacts(ROSTER_ORD_NAME);
+        contacts = roster_get_contacts_view(ROSTER_ORD_NAME);
     }
     g_free(order);
 
     GSList* filtered_contacts = _filter_contacts(contacts);
-    g_slist_free(contacts);
 
     _rosterwin_contacts_header(layout, "Roster", filtered_contacts);
 
-    if (filtered_contacts) {
-        GSList* curr_contact = filtered_contacts;
-        while (curr_contact) {
-            PContact contact = curr_contact->data;
-            _rosterwin_contact(layout, contact);
-            curr_contact = g_slist_next(curr_contact);
-        }
-    }
+    _rosterwin_contacts(layout, filtered_contacts);
     g_slist_free(filtered_contacts);
 }
 
@@ -242,32 +279,24 @@ _rosterwin_contacts_by_presence(ProfLayoutSplit* layout, const char* const prese
         _rosterwin_contacts_header(layout, title, filtered_contacts);
     }
 
-    if (filtered_contacts) {
-        GSList* curr_contact = filtered_contacts;
-        while (curr_contact) {
-            PContact contact = curr_contact->data;
-            _rosterwin_contact(layout, contact);
-            curr_contact = g_slist_next(curr_contact);
-        }
-    }
+    _rosterwin_contacts(layout, filtered_contacts);
     g_slist_free(filtered_contacts);
 }
 
 static void
 _rosterwin_contacts_by_group(ProfLayoutSplit* layout, char* group)
 {
-    GSList* contacts = NULL;
+    GSequence* contacts = NULL;
 
     char* order = prefs_get_string(PREF_ROSTER_ORDER);
     if (g_strcmp0(order, "presence") == 0) {
-        contacts = roster_get_group(group, ROSTER_ORD_PRESENCE);
+        contacts = roster_get_group_view(group, ROSTER_ORD_PRESENCE);
     } else {
-        contacts = roster_get_group(group, ROSTER_ORD_NAME);
+        contacts = roster_get_group_view(group, ROSTER_ORD_NAME);
     }
     g_free(order);
 
     GSList* filtered_contacts = _filter_contacts(contacts);
-    g_slist_free(contacts);
 
     if (filtered_contacts || prefs_get_boolean(PREF_ROSTER_EMPTY)) {
         if (group) {
@@ -276,12 +305,7 @@ _rosterwin_contacts_by_group(ProfLayoutSplit* layout, char* group)
             _rosterwin_contacts_header(layout, "no group", filtered_contacts);
         }
 
-        GSList* curr_contact = filtered_contacts;
-        while (curr_contact) {
-            PContact contact = curr_contact->data;
-            _rosterwin_contact(layout, contact);
-            curr_contact = g_slist_next(curr_contact);
-        }
+        _rosterwin_contacts(layout, filtered_contacts);
     }
     g_slist_free(filtered_contacts);
 }
@@ -338,33 +362,195 @@ _rosterwin_unsubscribed_item(ProfLayoutSplit* layout, ProfChatWin* chatwin)
     wattroff(layout->subwin, theme_attrs(presence_colour));
 }
 
+static void
+_rosterwin_contacts(ProfLayoutSplit* layout, GSList* contacts)
+{
+    // without wrapping the height of each contact is known up front, so
+    // contacts outside the visible part of the panel only move the cursor
+    gboolean virtual = !prefs_get_boolean(PREF_ROSTER_WRAP) && layout->subwin;
+    int first_row = layout->sub_y_pos;
+    int last_row = first_row + screen_mainwin_row_end() - screen_mainwin_row_start();
+
+    char* by = prefs_get_string(PREF_ROSTER_BY);
+    RosterRowPrefs prefs = {
+        .resource = prefs_get_boolean(PREF_ROSTER_RESOURCE),
+        .resource_join = prefs_get_boolean(PREF_ROSTER_RESOURCE_JOIN),
+        .presence = prefs_get_boolean(PREF_ROSTER_PRESENCE),
+        .status = prefs_get_boolean(PREF_ROSTER_STATUS),
+        .by_presence = g_strcmp0(by, "presence") == 0,
+        .presence_indent = prefs_get_roster_presence_indent()
+    };
+    g_free(by);
+
+    GSList* curr = contacts;
+    while (curr) {
+        PContact contact = curr->data;
+        if (virtual) {
+            int start = getcury(layout->subwin);
+            if (getcurx(layout->subwin) > 0) {
+                start++;
+            }
+            int end = start + _rosterwin_contact_rows(&prefs, contact) - 1;
+            if (end < first_row || start > last_row) {
+                // leave the cursor past the line start as drawing would
+                wmove(layout->subwin, end, 1);
+                curr = g_slist_next(curr);
+                continue;
+            }
+        }
+        _rosterwin_contact(layout, contact);
+        curr = g_slist_next(curr);
+    }
+}
+
+// rows drawn by _rosterwin_contact when wrapping is off
+static int
+_rosterwin_contact_rows(RosterRowPrefs* prefs, PContact contact)
+{
+    int rows = 1;
+
+    if (prefs->resource) {
+        GList* resources = p_contact_get_available_resources(contact);
+        if (resources && prefs->resource_join && (g_list_length(resources) == 1)) {
+            Resource* resource = resources->data;
+            const char* resource_presence = string_from_resource_presence(resource->presence);
+            if (prefs->presence || prefs->status) {
+                rows += _rosterwin_presence_rows(prefs, resource_presence, resource->status);
+            }
+        } else if (resources) {
+            GList* curr = resources;
+            while (curr) {
+                Resource* resource = curr->data;
+                const char* resource_presence = string_from_resource_presence(resource->presence);
+                rows++;
+                if (prefs->presence || prefs->status) {
+                    rows += _rosterwin_presence_rows(prefs, resource_presence, resource->status);
+                }
+                curr = g_list_next(curr);
+            }
+        } else if (prefs->presence || prefs->status) {
+            rows += _rosterwin_presence_rows(prefs, p_contact_presence(contact), p_contact_status(contact));
+        }
+        g_list_free(resources);
+    } else if (prefs->presence || prefs->status) {
+        rows += _rosterwin_presence_rows(prefs, p_contact_presence(contact), p_contact_status(contact));
+    }
+
+    return rows;
+}
+
+// rows drawn by _rosterwin_presence, which only adds a line when not indented inline
+static int
+_rosterwin_presence_rows(RosterRowPrefs* prefs, const char* presence, const char* status)
+{
+    if (g_strcmp0(presence, "offline") == 0 || prefs->presence_indent == -1) {
+        return 0;
+    }
+
+    gboolean show_status = status && prefs->status;
+    if (prefs->by_presence) {
+        return show_status ? 1 : 0;
+    }
+
+    return (prefs->presence || show_status) ? 1 : 0;
+}
+
 static void
 _rosterwin_contact(ProfLayoutSplit* layout, PContact contact)
+{
+    const char* barejid = p_contact_barejid(contact);
+    ProfChatWin* chatwin = wins_get_chat(barejid);
+    int unread = chatwin ? chatwin->unread : -1;
+
+    RosterRow* row = row_cache ? g_hash_table_lookup(row_cache, barejid) : NULL;
+    if (!row || row->contact_revision != p_contact_revision(contact) || row->unread != unread
+        || row->prefs_generation != prefs_get_generation() || row->theme_generation != theme_get_generation()
+        || row->pairs_recycled != color_pair_cache_recycled()) {
+        row = g_new0(RosterRow, 1);
+        row->contact_revision = p_contact_revision(contact);
+        row->prefs_generation = prefs_get_generation();
+        row->theme_generation = theme_get_generation();
+        row->pairs_recycled = color_pair_cache_recycled();
+        row->unread = unread;
+        row->parts = g_array_new(FALSE, FALSE, sizeof(RosterRowPart));
+        _rosterwin_contact_parts(row->parts, contact, unread);
+
+        if (!row_cache) {
+            row_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_rosterwin_row_free);
+        }
+        g_hash_table_replace(row_cache, g_strdup(barejid), row);
+    }
+
+    gboolean wrap = prefs_get_boolean(PREF_ROSTER_WRAP);
+    for (guint i = 0; i < row->parts->len; i++) {
+        RosterRowPart* part = &g_array_index(row->parts, RosterRowPart, i);
+        if (part->newline) {
+            win_sub_newline_lazy(layout->subwin);
+        }
+        wattron(layout->subwin, part->attrs);
+        win_sub_print(layout->subwin, part->text, FALSE, wrap, part->indent);
+        wattroff(layout->subwin, part->attrs);
+    }
+}
+
+void
+rosterwin_clear_cache(void)
+{
+    if (row_cache) {
+        g_hash_table_destroy(row_cache);
+        row_cache = NULL;
+    }
+}
+
+static void
+_rosterwin_row_free(RosterRow* row)
+{
+    for (guint i = 0; i < row->parts->len; i++) {
+        g_free(g_array_index(row->parts, RosterRowPart, i).text);
+    }
+    g_array_free(row->parts, TRUE);
+    g_free(row);
+}
+
+// newline moves to the start of the next line first, unless already there
+static void
+_rosterwin_row_add(GArray* parts, gboolean newline, int attrs, const char* const text, int indent)
+{
+    RosterRowPart part = { newline, attrs, indent, g_strdup(text) };
+    g_array_append_val(parts, part);
+}
+
+static void
+_rosterwin_row_add_unread(GArray* parts, int attrs, int unread, int indent)
+{
+    gchar* unreadmsg = g_strdup_printf(" (%d)", unread);
+    _rosterwin_row_add(parts, FALSE, attrs, unreadmsg, indent);
+    g_free(unreadmsg);
+}
+
+// unread is -1 without a chat window for the contact
+static void
+_rosterwin_contact_parts(GArray* parts, PContact contact, int unread)
 {
     const char* name = p_contact_name_or_jid(contact);
     const char* presence = p_contact_presence(contact);
     const char* status = p_contact_status(contact);
-    const char* barejid = p_contact_barejid(contact);
-    int unread = 0;
 
     roster_contact_theme_t theme_type = ROSTER_CONTACT;
-    ProfChatWin* chatwin = wins_get_chat(barejid);
-    if (chatwin) {
-        if (chatwin->unread > 0) {
-            theme_type = ROSTER_CONTACT_UNREAD;
-            unread = chatwin->unread;
-        } else {
-            theme_type = ROSTER_CONTACT_ACTIVE;
-        }
+    if (unread > 0) {
+        theme_type = ROSTER_CONTACT_UNREAD;
+    } else if (unread == 0) {
+        theme_type = ROSTER_CONTACT_ACTIVE;
+    } else {
+        unread = 0;
     }
 
     theme_item_t presence_colour = _get_roster_theme(theme_type, presence);
-    int colour = 0;
+    int attrs;
     if (prefs_get_boolean(PREF_ROSTER_COLOR_NICK)) {
-        colour = theme_hash_attrs(name);
-        wattron(layout->subwin, colour);
+        attrs = theme_hash_attrs(name);
     } else {
-        wattron(layout->subwin, theme_attrs(presence_colour));
+        attrs = theme_attrs(presence_colour);
     }
 
     GString* msg = g_string_new(" ");
@@ -399,36 +585,22 @@ _rosterwin_contact(ProfLayoutSplit* layout, PContact contact)
     }
     g_free(unreadpos);
 
-    win_sub_newline_lazy(layout->subwin);
-    gboolean wrap = prefs_get_boolean(PREF_ROSTER_WRAP);
-    win_sub_print(layout->subwin, msg->str, FALSE, wrap, current_indent);
+    _rosterwin_row_add(parts, TRUE, attrs, msg->str, current_indent);
     g_string_free(msg, TRUE);
 
-    if (prefs_get_boolean(PREF_ROSTER_COLOR_NICK)) {
-        wattroff(layout->subwin, colour);
-    } else {
-        wattroff(layout->subwin, theme_attrs(presence_colour));
-    }
-
     if (prefs_get_boolean(PREF_ROSTER_RESOURCE)) {
-        _rosterwin_resources(layout, contact, current_indent, theme_type, unread);
+        _rosterwin_resources(parts, contact, current_indent, theme_type, unread);
     } else if (prefs_get_boolean(PREF_ROSTER_PRESENCE) || prefs_get_boolean(PREF_ROSTER_STATUS)) {
         if (unread > 0) {
-            GString* unreadmsg = g_string_new("");
-            g_string_append_printf(unreadmsg, " (%d)", unread);
-
-            wattron(layout->subwin, theme_attrs(presence_colour));
-            win_sub_print(layout->subwin, unreadmsg->str, FALSE, wrap, current_indent);
-            g_string_free(unreadmsg, TRUE);
-            wattroff(layout->subwin, theme_attrs(presence_colour));
+            _rosterwin_row_add_unread(parts, theme_attrs(presence_colour), unread, current_indent);
         }
 
-        _rosterwin_presence(layout, presence, status, current_indent);
+        _rosterwin_presence(parts, presence, status, current_indent);
     }
 }
 
 static void
-_rosterwin_presence(ProfLayoutSplit* layout, const char* presence, const char* status,
+_rosterwin_presence(GArray* parts, const char* presence, const char* status,
                     int current_indent)
 {
     // don't show presence for offline contacts
@@ -446,20 +618,16 @@ _rosterwin_presence(ProfLayoutSplit* layout, const char* presence, const char* s
         current_indent += presence_indent;
     }
 
-    gboolean wrap = prefs_get_boolean(PREF_ROSTER_WRAP);
-    theme_item_t colour = _get_roster_theme(ROSTER_CONTACT, presence);
+    int attrs = theme_attrs(_get_roster_theme(ROSTER_CONTACT, presence));
 
     // show only status when grouped by presence
     if (by_presence) {
         if (status && prefs_get_boolean(PREF_ROSTER_STATUS)) {
-
-            wattron(layout->subwin, theme_attrs(colour));
             if (presence_indent == -1) {
                 GString* msg = g_string_new("");
                 g_string_append_printf(msg, ": \"%s\"", status);
-                win_sub_print(layout->subwin, msg->str, FALSE, wrap, current_indent);
+                _rosterwin_row_add(parts, FALSE, attrs, msg->str, current_indent);
                 g_string_free(msg, TRUE);
-                wattroff(layout->subwin, theme_attrs(colour));
             } else {
                 GString* msg = g_string_new(" ");
                 while (current_indent > 0) {
@@ -467,16 +635,13 @@ _rosterwin_presence(ProfLayoutSplit* layout, const char* presence, const char* s
                     current_indent--;
                 }
                 g_string_append_printf(msg, "\"%s\"", status);
-                win_sub_newline_lazy(layout->subwin);
-                win_sub_print(layout->subwin, msg->str, FALSE, wrap, current_indent);
+                _rosterwin_row_add(parts, TRUE, attrs, msg->str, current_indent);
                 g_string_free(msg, TRUE);
-                wattroff(layout->subwin, theme_attrs(colour));
             }
         }
 
         // show both presence and status when not grouped by presence
     } else if (prefs_get_boolean(PREF_ROSTER_PRESENCE) || (status && prefs_get_boolean(PREF_ROSTER_STATUS))) {
-        wattron(layout->subwin, theme_attrs(colour));
         if (presence_indent == -1) {
             GString* msg = g_string_new("");
             if (prefs_get_boolean(PREF_ROSTER_PRESENCE)) {
@@ -487,9 +652,8 @@ _rosterwin_presence(ProfLayoutSplit* layout, const char* presence, const char* s
             } else if (status && prefs_get_boolean(PREF_ROSTER_STATUS)) {
                 g_string_append_printf(msg, ": \"%s\"", status);
             }
-            win_sub_print(layout->subwin, msg->str, FALSE, wrap, current_indent);
+            _rosterwin_row_add(parts, FALSE, attrs, msg->str, current_indent);
             g_string_free(msg, TRUE);
-            wattroff(layout->subwin, theme_attrs(colour));
         } else {
             GString* msg = g_string_new(" ");
             while (current_indent > 0) {
@@ -504,16 +668,14 @@ _rosterwin_presence(ProfLayoutSplit* layout, const char* presence, const char* s
             } else if (status && prefs_get_boolean(PREF_ROSTER_STATUS)) {
                 g_string_append_printf(msg, "\"%s\"", status);
             }
-            win_sub_newline_lazy(layout->subwin);
-            win_sub_print(layout->subwin, msg->str, FALSE, wrap, current_indent);
+            _rosterwin_row_add(parts, TRUE, attrs, msg->str, current_indent);
             g_string_free(msg, TRUE);
-            wattroff(layout->subwin, theme_attrs(colour));
         }
     }
 }
 
 static void
-_rosterwin_resources(ProfLayoutSplit* layout, PContact contact, int current_indent, roster_contact_theme_t theme_type,
+_rosterwin_resources(GArray* parts, PContact contact, int current_indent, roster_contact_theme_t theme_type,
                      int unread)
 {
     gboolean join = prefs_get_boolean(PREF_ROSTER_RESOURCE_JOIN);
@@ -527,7 +689,6 @@ _rosterwin_resources(ProfLayoutSplit* layout, PContact contact, int current_inde
             const char* resource_presence = string_from_resource_presence(resource->presence);
             theme_item_t resource_presence_colour = _get_roster_theme(theme_type, resource_presence);
 
-            wattron(layout->subwin, theme_attrs(resource_presence_colour));
             GString* msg = g_string_new("");
             char* ch = prefs_get_roster_resource_char();
             if (ch) {
@@ -547,31 +708,20 @@ _rosterwin_resources(ProfLayoutSplit* layout, PContact contact, int current_inde
             }
             g_free(unreadpos);
 
-            gboolean wrap = prefs_get_boolean(PREF_ROSTER_WRAP);
-            win_sub_print(layout->subwin, msg->str, FALSE, wrap, 0);
+            _rosterwin_row_add(parts, FALSE, theme_attrs(resource_presence_colour), msg->str, 0);
             g_string_free(msg, TRUE);
-            wattroff(layout->subwin, theme_attrs(resource_presence_colour));
 
             if (prefs_get_boolean(PREF_ROSTER_PRESENCE) || prefs_get_boolean(PREF_ROSTER_STATUS)) {
-                _rosterwin_presence(layout, resource_presence, resource->status, current_indent);
+                _rosterwin_presence(parts, resource_presence, resource->status, current_indent);
             }
 
             // resource(s) on new lines
         } else {
-            gboolean wrap = prefs_get_boolean(PREF_ROSTER_WRAP);
-
             char* unreadpos = prefs_get_string(PREF_ROSTER_UNREAD);
             if ((g_strcmp0(unreadpos, "after") == 0) && unread > 0) {
-                GString* unreadmsg = g_string_new("");
-                g_string_append_printf(unreadmsg, " (%d)", unread);
-
                 const char* presence = p_contact_presence(contact);
                 theme_item_t presence_colour = _get_roster_theme(theme_type, presence);
-
-                wattron(layout->subwin, theme_attrs(presence_colour));
-                win_sub_print(layout->subwin, unreadmsg->str, FALSE, wrap, current_indent);
-                g_string_free(unreadmsg, TRUE);
-                wattroff(layout->subwin, theme_attrs(presence_colour));
+                _rosterwin_row_add_unread(parts, theme_attrs(presence_colour), unread, current_indent);
             }
             g_free(unreadpos);
 
@@ -586,7 +736,6 @@ _rosterwin_resources(ProfLayoutSplit* layout, PContact contact, int current_inde
                 const char* resource_presence = string_from_resource_presence(resource->presence);
                 theme_item_t resource_presence_colour = _get_roster_theme(ROSTER_CONTACT, resource_presence);
 
-                wattron(layout->subwin, theme_attrs(resource_presence_colour));
                 GString* msg = g_string_new(" ");
                 int this_indent = current_indent;
                 while (this_indent > 0) {
@@ -602,13 +751,11 @@ _rosterwin_resources(ProfLayoutSplit* layout, PContact contact, int current_inde
                 if (prefs_get_boolean(PREF_ROSTER_PRIORITY)) {
                     g_string_append_printf(msg, " %d", resource->priority);
                 }
-                win_sub_newline_lazy(layout->subwin);
-                win_sub_print(layout->subwin, msg->str, FALSE, wrap, current_indent);
+                _rosterwin_row_add(parts, TRUE, theme_attrs(resource_presence_colour), msg->str, current_indent);
                 g_string_free(msg, TRUE);
-                wattroff(layout->subwin, theme_attrs(resource_presence_colour));
 
                 if (prefs_get_boolean(PREF_ROSTER_PRESENCE) || prefs_get_boolean(PREF_ROSTER_STATUS)) {
-                    _rosterwin_presence(layout, resource_presence, resource->status, current_indent);
+                    _rosterwin_presence(parts, resource_presence, resource->status, current_indent);
                 }
 
                 curr_resource = g_list_next(curr_resource);
@@ -618,34 +765,19 @@ _rosterwin_resources(ProfLayoutSplit* layout, PContact contact, int current_inde
         const char* presence = p_contact_presence(contact);
         const char* status = p_contact_status(contact);
         theme_item_t presence_colour = _get_roster_theme(theme_type, presence);
-        gboolean wrap = prefs_get_boolean(PREF_ROSTER_WRAP);
 
         char* unreadpos = prefs_get_string(PREF_ROSTER_UNREAD);
         if ((g_strcmp0(unreadpos, "after") == 0) && unread > 0) {
-            GString* unreadmsg = g_string_new("");
-            g_string_append_printf(unreadmsg, " (%d)", unread);
-
-            wattron(layout->subwin, theme_attrs(presence_colour));
-            win_sub_print(layout->subwin, unreadmsg->str, FALSE, wrap, current_indent);
-            g_string_free(unreadmsg, TRUE);
-            wattroff(layout->subwin, theme_attrs(presence_colour));
+            _rosterwin_row_add_unread(parts, theme_attrs(presence_colour), unread, current_indent);
         }
         g_free(unreadpos);
-        _rosterwin_presence(layout, presence, status, current_indent);
+        _rosterwin_presence(parts, presence, status, current_indent);
     } else {
-        gboolean wrap = prefs_get_boolean(PREF_ROSTER_WRAP);
-
         char* unreadpos = prefs_get_string(PREF_ROSTER_UNREAD);
         if ((g_strcmp0(unreadpos, "after") == 0) && unread > 0) {
-            GString* unreadmsg = g_string_new("");
-            g_string_append_printf(unreadmsg, " (%d)", unread);
             const char* presence = p_contact_presence(contact);
             theme_item_t presence_colour = _get_roster_theme(theme_type, presence);
-
-            wattron(layout->subwin, theme_attrs(presence_colour));
-            win_sub_print(layout->subwin, unreadmsg->str, FALSE, wrap, current_indent);
-            g_string_free(unreadmsg, TRUE);
-            wattroff(layout->subwin, theme_attrs(presence_colour));
+            _rosterwin_row_add_unread(parts, theme_attrs(presence_colour), unread, current_indent);
         }
         g_free(unreadpos);
     }
@@ -1239,40 +1371,37 @@ _rosterwin_private_header(ProfLayoutSplit* layout, GList* privs)
 }
 
 static GSList*
-_filter_contacts(GSList* contacts)
+_filter_contacts(GSequence* contacts)
 {
     GSList* filtered_contacts = NULL;
+    if (contacts == NULL) {
+        return NULL;
+    }
 
-    // if show offline, include all contacts
-    if (prefs_get_boolean(PREF_ROSTER_OFFLINE)) {
-        GSList* curr = contacts;
-        while (curr) {
-            filtered_contacts = g_slist_append(filtered_contacts, curr->data);
-            curr = g_slist_next(curr);
-        }
-        // if dont show offline
-    } else {
-        GSList* curr = contacts;
-        while (curr) {
-            PContact contact = curr->data;
-            const char* presence = p_contact_presence(contact);
+    gboolean show_offline = prefs_get_boolean(PREF_ROSTER_OFFLINE);
+    GSequenceIter* curr = g_sequence_get_begin_iter(contacts);
+    while (!g_sequence_iter_is_end(curr)) {
+        PContact contact = g_sequence_get(curr);
 
-            // include if offline and unread messages
-            if (g_strcmp0(presence, "offline") == 0) {
-                ProfChatWin* chatwin = wins_get_chat(p_contact_barejid(contact));
-                if (chatwin && chatwin->unread > 0) {
-                    filtered_contacts = g_slist_append(filtered_contacts, contact);
-                }
+        // if show offline, include all contacts
+        if (show_offline) {
+            filtered_contacts = g_slist_prepend(filtered_contacts, contact);
 
-                // include if not offline
-            } else {
-                filtered_contacts = g_slist_append(filtered_contacts, contact);
+            // include if offline and unread messages
+        } else if (g_strcmp0(p_contact_presence(contact), "offline") == 0) {
+            ProfChatWin* chatwin = wins_get_chat(p_contact_barejid(contact));
+            if (chatwin && chatwin->unread > 0) {
+                filtered_contacts = g_slist_prepend(filtered_contacts, contact);
             }
-            curr = g_slist_next(curr);
+
+            // include if not offline
+        } else {
+            filtered_contacts = g_slist_prepend(filtered_contacts, contact);
         }
+        curr = g_sequence_iter_next(curr);
     }
 
-    return filtered_contacts;
+    return g_slist_reverse(filtered_contacts);
 }
 
 static GSList*
@@ -0,0 +1,84 @@
+/*
+ * searchwin.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "ui/win_types.h"
+#include "ui/window.h"
+#include "ui/window_list.h"
+
+// Results come newest first, each page below the previous one
+void
+searchwin_show_results(ProfSearchWin* searchwin, GSList* results, gint64 elapsed_ms, int indexed)
+{
+    assert(searchwin != NULL);
+
+    ProfWin* window = (ProfWin*)searchwin;
+    GSList* curr = results;
+    while (curr) {
+        win_print_search_result(window, curr->data);
+        curr = g_slist_next(curr);
+    }
+
+    guint count = g_slist_length(results);
+    if (count == 0) {
+        win_println(window, THEME_DEFAULT, "-", "No messages found for: %s", searchwin->query);
+    } else {
+        win_println(window, THEME_DEFAULT, "-", "%u result%s in %" G_GINT64_FORMAT " ms.", count, count == 1 ? "" : "s", elapsed_ms);
+    }
+    if (count > 0 && searchwin->cursor != 0) {
+        win_println(window, THEME_DEFAULT, "-", "Type '/search next' for older results.");
+    }
+    if (indexed < 100) {
+        win_println(window, THEME_DEFAULT, "!", "History is still being indexed (%d%% done), older messages may be missing.", indexed);
+    }
+    win_println(window, THEME_DEFAULT, "-", "");
+}
+
+char*
+searchwin_get_string(ProfSearchWin* searchwin)
+{
+    assert(searchwin != NULL);
+
+    if (searchwin->query) {
+        return g_strdup_printf("Search: %s", searchwin->query);
+    }
+
+    return strdup("Search");
+}
@@ -36,7 +36,6 @@
 
 #include "config.h"
 
-#include <assert.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -50,6 +49,7 @@
 
 #include "config/theme.h"
 #include "config/preferences.h"
+#include "tools/timefmt.h"
 #include "ui/ui.h"
 #include "ui/statusbar.h"
 #include "ui/inputwin.h"
@@ -63,11 +63,15 @@ typedef struct _status_bar_tab_t
     char* identifier;
     gboolean highlight;
     char* display_name;
+    // name as drawn and its width, NULL until first needed
+    char* label;
+    int label_width;
 } StatusBarTab;
 
 typedef struct _status_bar_t
 {
-    gchar* time;
+    // the clock as last drawn, empty before
+    char time[TIMEFMT_MAX];
     char* prompt;
     char* fulljid;
     GHashTable* tabs;
@@ -75,8 +79,12 @@ typedef struct _status_bar_t
 } StatusBar;
 
 static GTimeZone* tz;
+// second the clock was last checked in
+static gint64 clock_second = 0;
 static StatusBar* statusbar;
 static WINDOW* statusbar_win;
+// something besides the clock changed since the last draw
+static gboolean changed = TRUE;
 
 static int _status_bar_draw_time(int pos);
 static void _status_bar_draw_maintext(int pos);
@@ -86,6 +94,7 @@ static int _status_bar_draw_tab(StatusBarTab* tab, int pos, int num);
 static void _destroy_tab(StatusBarTab* tab);
 static int _tabs_width(void);
 static char* _display_name(StatusBarTab* tab);
+static const char* _tab_label(StatusBarTab* tab);
 static gboolean _extended_new(void);
 
 void
@@ -94,7 +103,7 @@ status_bar_init(void)
     tz = g_time_zone_new_local();
 
     statusbar = malloc(sizeof(StatusBar));
-    statusbar->time = NULL;
+    statusbar->time[0] = '\0';
     statusbar->prompt = NULL;
     statusbar->fulljid = NULL;
     statusbar->tabs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)_destroy_tab);
@@ -102,6 +111,8 @@ status_bar_init(void)
     console->window_type = WIN_CONSOLE;
     console->identifier = strdup("console");
     console->display_name = NULL;
+    console->label = NULL;
+    console->label_width = 0;
     g_hash_table_insert(statusbar->tabs, GINT_TO_POINTER(1), console);
     statusbar->current_tab = 1;
 
@@ -119,9 +130,6 @@ status_bar_close(void)
         g_time_zone_unref(tz);
     }
     if (statusbar) {
-        if (statusbar->time) {
-            g_free(statusbar->time);
-        }
         if (statusbar->prompt) {
             free(statusbar->prompt);
         }
@@ -135,9 +143,29 @@ status_bar_close(void)
     }
 }
 
+// The tabs are drawn with the next ui_update()
+static void
+_status_bar_changed(void)
+{
+    changed = TRUE;
+    ui_mark_dirty(UI_DIRTY_STATUSBAR);
+}
+
+static void
+_clear_label(gpointer key, gpointer value, gpointer user_data)
+{
+    StatusBarTab* tab = value;
+    free(tab->label);
+    tab->label = NULL;
+}
+
+// Also called after the statusbar preferences changed, the labels are made again
 void
 status_bar_resize(void)
 {
+    g_hash_table_foreach(statusbar->tabs, _clear_label, NULL);
+    changed = TRUE;
+
     int cols = getmaxx(stdscr);
     werase(statusbar_win);
     int row = screen_statusbar_row();
@@ -151,6 +179,7 @@ void
 status_bar_set_all_inactive(void)
 {
     g_hash_table_remove_all(statusbar->tabs);
+    _status_bar_changed();
 }
 
 void
@@ -162,7 +191,7 @@ status_bar_current(int i)
         statusbar->current_tab = i;
     }
 
-    status_bar_draw();
+    _status_bar_changed();
 }
 
 void
@@ -175,7 +204,7 @@ status_bar_inactive(const int win)
 
     g_hash_table_remove(statusbar->tabs, GINT_TO_POINTER(true_win));
 
-    status_bar_draw();
+    _status_bar_changed();
 }
 
 void
@@ -186,11 +215,19 @@ _create_tab(const int win, win_type_t wintype, char* identifier, gboolean highli
         true_win = 10;
     }
 
+    // called for most messages, usually nothing changes
+    StatusBarTab* existing = g_hash_table_lookup(statusbar->tabs, GINT_TO_POINTER(true_win));
+    if (existing && existing->window_type == wintype && existing->highlight == highlight && g_strcmp0(existing->identifier, identifier) == 0) {
+        return;
+    }
+
     StatusBarTab* tab = malloc(sizeof(StatusBarTab));
     tab->identifier = strdup(identifier);
     tab->highlight = highlight;
     tab->window_type = wintype;
     tab->display_name = NULL;
+    tab->label = NULL;
+    tab->label_width = 0;
 
     if (tab->window_type == WIN_CHAT) {
         PContact contact = NULL;
@@ -218,7 +255,7 @@ _create_tab(const int win, win_type_t wintype, char* identifier, gboolean highli
 
     g_hash_table_replace(statusbar->tabs, GINT_TO_POINTER(true_win), tab);
 
-    status_bar_draw();
+    _status_bar_changed();
 }
 
 void
@@ -242,6 +279,8 @@ status_bar_set_prompt(const char* const prompt)
     }
     statusbar->prompt = strdup(prompt);
 
+    // drawn straight away, the password prompt blocks
+    changed = TRUE;
     status_bar_draw();
 }
 
@@ -253,6 +292,7 @@ status_bar_clear_prompt(void)
         statusbar->prompt = NULL;
     }
 
+    changed = TRUE;
     status_bar_draw();
 }
 
@@ -265,7 +305,7 @@ status_bar_set_fulljid(const char* const fulljid)
     }
     statusbar->fulljid = strdup(fulljid);
 
-    status_bar_draw();
+    _status_bar_changed();
 }
 
 void
@@ -276,12 +316,58 @@ status_bar_clear_fulljid(void)
         statusbar->fulljid = NULL;
     }
 
-    status_bar_draw();
+    _status_bar_changed();
+}
+
+// TRUE when the displayed time is out of date, checked at most once a second
+gboolean
+status_bar_clock_changed(void)
+{
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    if (now == clock_second) {
+        return FALSE;
+    }
+    clock_second = now;
+
+    const gchar* time_pref = prefs_peek_string(PREF_TIME_STATUSBAR);
+    if (g_strcmp0(time_pref, "off") == 0) {
+        return FALSE;
+    }
+
+    char time[TIMEFMT_MAX];
+    GDateTime* datetime = g_date_time_new_now(tz);
+    timefmt_format(datetime, time_pref, time, sizeof(time));
+    g_date_time_unref(datetime);
+
+    return strcmp(time, statusbar->time) != 0;
+}
+
+// Only the clock is drawn again when nothing else changed and it keeps its width
+static gboolean
+_status_bar_redraw_time(void)
+{
+    if (changed || statusbar->time[0] == '\0') {
+        return FALSE;
+    }
+
+    size_t len = strlen(statusbar->time);
+    _status_bar_draw_time(1);
+
+    return strlen(statusbar->time) == len;
 }
 
 void
 status_bar_draw(void)
 {
+    ui_mark_dirty(UI_DIRTY_STATUSBAR);
+
+    if (_status_bar_redraw_time()) {
+        wnoutrefresh(statusbar_win);
+        inp_put_back();
+        return;
+    }
+    changed = FALSE;
+
     werase(statusbar_win);
     wbkgd(statusbar_win, theme_attrs(THEME_STATUS_TEXT));
 
@@ -397,10 +483,8 @@ _status_bar_draw_tab(StatusBarTab* tab, int pos, int num)
         pos++;
     }
     if (show_name) {
-        char* display_name = _display_name(tab);
-        mvwprintw(statusbar_win, 0, pos, "%s", display_name);
-        pos += utf8_display_len(display_name);
-        free(display_name);
+        mvwprintw(statusbar_win, 0, pos, "%s", _tab_label(tab));
+        pos += tab->label_width;
     }
     wattroff(statusbar_win, status_attrs);
 
@@ -428,20 +512,13 @@ _status_bar_draw_bracket(gboolean current, int pos, char* ch)
 static int
 _status_bar_draw_time(int pos)
 {
-    char* time_pref = prefs_get_string(PREF_TIME_STATUSBAR);
+    const gchar* time_pref = prefs_peek_string(PREF_TIME_STATUSBAR);
     if (g_strcmp0(time_pref, "off") == 0) {
-        g_free(time_pref);
         return pos;
     }
 
-    if (statusbar->time) {
-        g_free(statusbar->time);
-        statusbar->time = NULL;
-    }
-
     GDateTime* datetime = g_date_time_new_now(tz);
-    statusbar->time = g_date_time_format(datetime, time_pref);
-    assert(statusbar->time != NULL);
+    timefmt_format(datetime, time_pref, statusbar->time, sizeof(statusbar->time));
     g_date_time_unref(datetime);
 
     int bracket_attrs = theme_attrs(THEME_STATUS_BRACKET);
@@ -461,8 +538,6 @@ _status_bar_draw_time(int pos)
     wattroff(statusbar_win, bracket_attrs);
     pos += 2;
 
-    g_free(time_pref);
-
     return pos;
 }
 
@@ -511,6 +586,7 @@ _destroy_tab(StatusBarTab* tab)
         if (tab->display_name) {
             free(tab->display_name);
         }
+        free(tab->label);
         free(tab);
     }
 }
@@ -533,10 +609,9 @@ _tabs_width(void)
                 if (!show_read && !is_current && !tab->highlight)
                     continue;
 
-                char* display_name = _display_name(tab);
-                width += utf8_display_len(display_name);
+                _tab_label(tab);
+                width += tab->label_width;
                 width += 4;
-                free(display_name);
             }
         }
         return width;
@@ -552,10 +627,9 @@ _tabs_width(void)
                 if (!show_read && !is_current && !tab->highlight)
                     continue;
 
-                char* display_name = _display_name(tab);
-                width += utf8_display_len(display_name);
+                _tab_label(tab);
+                width += tab->label_width;
                 width += 2;
-                free(display_name);
             }
         }
         return width;
@@ -567,6 +641,17 @@ _tabs_width(void)
     return g_hash_table_size(statusbar->tabs) * 3 + (g_hash_table_size(statusbar->tabs) > max_tabs ? 4 : 1);
 }
 
+static const char*
+_tab_label(StatusBarTab* tab)
+{
+    if (!tab->label) {
+        tab->label = _display_name(tab);
+        tab->label_width = utf8_display_len(tab->label);
+    }
+
+    return tab->label;
+}
+
 static char*
 _display_name(StatusBarTab* tab)
 {
@@ -576,6 +661,8 @@ _display_name(StatusBarTab* tab)
         fullname = strdup("console");
     } else if (tab->window_type == WIN_XML) {
         fullname = strdup("xmlconsole");
+    } else if (tab->window_type == WIN_SEARCH) {
+        fullname = strdup("search");
     } else if (tab->window_type == WIN_PLUGIN) {
         fullname = strdup(tab->identifier);
     } else if (tab->window_type == WIN_CHAT) {
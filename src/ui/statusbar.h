@@ -38,6 +38,7 @@
 
 void status_bar_init(void);
 void status_bar_draw(void);
+gboolean status_bar_clock_changed(void);
 void status_bar_close(void);
 void status_bar_resize(void);
 void status_bar_set_prompt(const char* const prompt);
@@ -87,6 +87,13 @@ create_title_bar(void)
 
 void
 title_bar_update_virtual(void)
+{
+    _title_bar_draw();
+}
+
+// drop the typing notice after 10 seconds, TRUE when the title bar needs a redraw
+gboolean
+title_bar_typing_expired(void)
 {
     ProfWin* window = wins_get_current();
     if (window->type != WIN_CONSOLE) {
@@ -98,10 +105,12 @@ title_bar_update_virtual(void)
 
                 g_timer_destroy(typing_elapsed);
                 typing_elapsed = NULL;
+                return TRUE;
             }
         }
     }
-    _title_bar_draw();
+
+    return FALSE;
 }
 
 void
@@ -189,6 +198,7 @@ _title_bar_draw(void)
     int maxrightpos;
     ProfWin* current = wins_get_current();
 
+    ui_mark_dirty(UI_DIRTY_TITLEBAR);
     werase(win);
     wmove(win, 0, 0);
     for (int i = 0; i < 45; i++) {
@@ -44,16 +44,19 @@
 #include "log.h"
 #include "config/preferences.h"
 #include "config/files.h"
+#include "tools/scheduler.h"
 #include "ui/tray.h"
 #include "ui/window_list.h"
 
+// how often pending GTK events are handled, the main loop has no GTK sources
+#define TRAY_EVENTS_MS 250
+
 static gboolean gtk_ready = FALSE;
 static GtkStatusIcon* prof_tray = NULL;
 static GString* icon_filename = NULL;
 static GString* icon_msg_filename = NULL;
-static gint unread_messages;
-static gboolean shutting_down;
-static guint timer;
+static gboolean tray_enabled = FALSE;
+static SchedulerTask* events_task = NULL;
 
 /*
  * Get icons from installation share folder or (if defined) .locale user's folder
@@ -118,21 +121,16 @@ _get_icons(void)
 }
 
 /*
- * Callback for the timer
- *
- * This is the callback that the timer is calling in order to check if messages are there.
- *
+ * Show the icon for whether there are unread messages
  */
-gboolean
-_tray_change_icon(gpointer data)
+static void
+_tray_change_icon(void)
 {
-    if (shutting_down) {
-        return FALSE;
+    if (!tray_enabled) {
+        return;
     }
 
-    unread_messages = wins_get_total_unread();
-
-    if (unread_messages) {
+    if (wins_get_total_unread()) {
         if (!prof_tray) {
             prof_tray = gtk_status_icon_new_from_file(icon_msg_filename->str);
         } else {
@@ -150,7 +148,20 @@ _tray_change_icon(gpointer data)
             prof_tray = NULL;
         }
     }
+}
+
+static void
+_tray_handle_events(void)
+{
+    while (gtk_events_pending()) {
+        gtk_main_iteration_do(FALSE);
+    }
+}
 
+static gboolean
+_tray_events_task(void* data)
+{
+    _tray_handle_events();
     return TRUE;
 }
 
@@ -169,20 +180,26 @@ tray_init(void)
         tray_enable();
     }
 
-    gtk_main_iteration_do(FALSE);
+    _tray_handle_events();
+    events_task = scheduler_add(TRAY_EVENTS_MS, _tray_events_task, NULL, NULL);
 }
 
+// Called by the window list when the total unread count becomes zero or
+// stops being zero
 void
-tray_update(void)
+tray_unread_changed(void)
 {
     if (gtk_ready) {
-        gtk_main_iteration_do(FALSE);
+        _tray_change_icon();
+        _tray_handle_events();
     }
 }
 
 void
 tray_shutdown(void)
 {
+    scheduler_remove(events_task);
+    events_task = NULL;
     if (gtk_ready && prefs_get_boolean(PREF_TRAY)) {
         tray_disable();
     }
@@ -190,35 +207,29 @@ tray_shutdown(void)
     g_string_free(icon_msg_filename, TRUE);
 }
 
+// The icon follows unread changes as they happen, nothing is polled any
+// more, so a new interval only refreshes the icon
 void
 tray_set_timer(int interval)
 {
-    g_source_remove(timer);
-    _tray_change_icon(NULL);
-    timer = g_timeout_add(interval * 1000, _tray_change_icon, NULL);
+    _tray_change_icon();
 }
 
 /*
  * Create tray icon
- *
- * This will initialize the timer that will be called in order to change the icons
- * and will search the icons in the defaults paths
  */
 void
 tray_enable(void)
 {
     prof_tray = gtk_status_icon_new_from_file(icon_filename->str);
-    shutting_down = FALSE;
-    _tray_change_icon(NULL);
-    int interval = prefs_get_tray_timer() * 1000;
-    timer = g_timeout_add(interval, _tray_change_icon, NULL);
+    tray_enabled = TRUE;
+    _tray_change_icon();
 }
 
 void
 tray_disable(void)
 {
-    shutting_down = TRUE;
-    g_source_remove(timer);
+    tray_enabled = FALSE;
     if (prof_tray) {
         g_clear_object(&prof_tray);
         prof_tray = NULL;
@@ -38,7 +38,7 @@
 
 #ifdef HAVE_GTK
 void tray_init(void);
-void tray_update(void);
+void tray_unread_changed(void);
 void tray_shutdown(void);
 
 void tray_enable(void);
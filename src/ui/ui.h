@@ -56,14 +56,31 @@
 #define NO_COLOUR_FROM 8
 #define NO_COLOUR_DATE 16
 #define UNTRUSTED      32
+#define EXPANDED       64
+
+// parts of the screen ui_update() has to refresh
+typedef enum {
+    UI_DIRTY_WINDOW = 1 << 0,
+    UI_DIRTY_TITLEBAR = 1 << 1,
+    UI_DIRTY_STATUSBAR = 1 << 2,
+    UI_DIRTY_INPUT = 1 << 3,
+    UI_DIRTY_ALL = UI_DIRTY_WINDOW | UI_DIRTY_TITLEBAR | UI_DIRTY_STATUSBAR | UI_DIRTY_INPUT
+} ui_dirty_t;
 
 // core UI
 void ui_init(void);
+void ui_set_headless(gboolean enabled);
+gboolean ui_is_headless(void);
 void ui_load_colours(void);
 void ui_update(void);
+void ui_mark_dirty(ui_dirty_t parts);
+void ui_redraw_roster(void);
+void ui_redraw_occupants(const char* const roomjid);
 void ui_close(void);
 void ui_redraw(void);
 void ui_resize(void);
+// applies /bandwidth terminal
+void ui_apply_terminal_output(void);
 void ui_focus_win(ProfWin* window);
 void ui_sigwinch_handler(int sig);
 void ui_handle_otr_error(const char* const barejid, const char* const message);
@@ -84,6 +101,8 @@ char* ui_ask_pgp_passphrase(const char* hint, int prev_fail);
 void ui_contact_online(char* barejid, Resource* resource, GDateTime* last_activity);
 void ui_contact_typing(const char* const barejid, const char* const resource);
 void ui_disconnected(void);
+void ui_stream_suspended(void);
+void ui_stream_resumed(gboolean secured);
 void ui_room_join(const char* const roomjid, gboolean focus);
 void ui_switch_to_room(const char* const roomjid);
 void ui_room_destroy(const char* const roomjid);
@@ -126,6 +145,8 @@ gboolean ui_win_has_unsaved_form(int num);
 ProfChatWin* chatwin_new(const char* const barejid);
 void chatwin_incoming_msg(ProfChatWin* chatwin, ProfMessage* message, gboolean win_created);
 void chatwin_receipt_received(ProfChatWin* chatwin, const char* const id);
+void chatwin_marker_received(ProfChatWin* chatwin, const char* const id);
+void chatwin_displayed(ProfChatWin* chatwin);
 void chatwin_recipient_gone(ProfChatWin* chatwin);
 void chatwin_outgoing_msg(ProfChatWin* chatwin, const char* const message, char* id, prof_enc_t enc_mode, gboolean request_receipt, const char* const replace_id);
 void chatwin_outgoing_carbon(ProfChatWin* chatwin, ProfMessage* message);
@@ -145,6 +166,8 @@ void chatwin_set_incoming_char(ProfChatWin* chatwin, const char* const ch);
 void chatwin_unset_incoming_char(ProfChatWin* chatwin);
 void chatwin_set_outgoing_char(ProfChatWin* chatwin, const char* const ch);
 void chatwin_unset_outgoing_char(ProfChatWin* chatwin);
+gboolean chatwin_older_history(ProfChatWin* chatwin);
+gboolean chatwin_newer_history(ProfChatWin* chatwin);
 
 // MUC window
 ProfMucWin* mucwin_new(const char* const barejid);
@@ -160,7 +183,8 @@ void mucwin_occupant_affiliation_change(ProfMucWin* mucwin, const char* const ni
 void mucwin_occupant_role_and_affiliation_change(ProfMucWin* mucwin, const char* const nick,
                                                  const char* const role, const char* const affiliation, const char* const actor, const char* const reason);
 void mucwin_roster(ProfMucWin* mucwin, GList* occupants, const char* const presence);
-void mucwin_history(ProfMucWin* mucwin, const ProfMessage* const message);
+gboolean mucwin_history(ProfMucWin* mucwin, const ProfMessage* const message);
+void mucwin_history_flush(ProfMucWin* mucwin);
 void mucwin_outgoing_msg(ProfMucWin* mucwin, const char* const message, const char* const id, prof_enc_t enc_mode, const char* const replace_id);
 void mucwin_incoming_msg(ProfMucWin* mucwin, const ProfMessage* const message, GSList* mentions, GList* triggers, gboolean filter_reflection);
 void mucwin_subject(ProfMucWin* mucwin, const char* const nick, const char* const subject);
@@ -228,11 +252,20 @@ char* confwin_get_string(ProfConfWin* confwin);
 
 // xml console
 void xmlwin_show(ProfXMLWin* xmlwin, const char* const msg);
+void xmlwin_refresh(ProfXMLWin* xmlwin);
+gboolean xmlwin_set_filter(ProfXMLWin* xmlwin, gchar** terms);
+char* xmlwin_get_filter(ProfXMLWin* xmlwin);
 char* xmlwin_get_string(ProfXMLWin* xmlwin);
 
+// search results
+void searchwin_show_results(ProfSearchWin* searchwin, GSList* results, gint64 elapsed_ms, int indexed);
+char* searchwin_get_string(ProfSearchWin* searchwin);
+
 // Input window
 char* inp_readline(void);
 void inp_nonblocking(gboolean reset);
+int inp_fd(void);
+void inp_insert_text(const char* const text);
 
 // Console window
 void cons_show(const char* const msg, ...);
@@ -301,6 +334,7 @@ void cons_occupants_setting(void);
 void cons_roster_setting(void);
 void cons_presence_setting(void);
 void cons_wrap_setting(void);
+void cons_collapse_setting(void);
 void cons_time_setting(void);
 void cons_wintitle_setting(void);
 void cons_notify_setting(void);
@@ -316,6 +350,7 @@ void cons_log_setting(void);
 void cons_logging_setting(void);
 void cons_autoaway_setting(void);
 void cons_reconnect_setting(void);
+void cons_bandwidth_setting(void);
 void cons_autoping_setting(void);
 void cons_autoconnect_setting(void);
 void cons_room_cache_setting(void);
@@ -328,6 +363,7 @@ void cons_correction_setting(void);
 void cons_executable_setting(void);
 void cons_slashguard_setting(void);
 void cons_mam_setting(void);
+void cons_url_setting(void);
 void cons_silence_setting(void);
 void cons_show_contact_online(PContact contact, Resource* resource, GDateTime* last_activity);
 void cons_show_contact_offline(PContact contact, char* resource, char* status);
@@ -352,6 +388,7 @@ void status_bar_set_all_inactive(void);
 
 // roster window
 void rosterwin_roster(void);
+void rosterwin_clear_cache(void);
 
 // occupants window
 void occupantswin_occupants(const char* const room);
@@ -360,6 +397,7 @@ void occupantswin_occupants_all(void);
 // window interface
 ProfWin* win_create_console(void);
 ProfWin* win_create_xmlconsole(void);
+ProfWin* win_create_search(void);
 ProfWin* win_create_chat(const char* const barejid);
 ProfWin* win_create_muc(const char* const roomjid);
 ProfWin* win_create_config(const char* const title, DataForm* form, ProfConfWinCallback submit, ProfConfWinCallback cancel, const void* userdata);
@@ -370,6 +408,9 @@ void win_free(ProfWin* window);
 gboolean win_notify_remind(ProfWin* window);
 int win_unread(ProfWin* window);
 void win_resize(ProfWin* window);
+void win_hibernate(ProfWin* window);
+void win_wake(ProfWin* window);
+gsize win_memory(ProfWin* window);
 void win_hide_subwin(ProfWin* window);
 void win_show_subwin(ProfWin* window);
 void win_refresh_without_subwin(ProfWin* window);
@@ -378,6 +419,7 @@ void win_refresh_with_subwin(ProfWin* window);
 void win_print(ProfWin* window, theme_item_t theme_item, const char* show_char, const char* const message, ...);
 void win_println(ProfWin* window, theme_item_t theme_item, const char* show_char, const char* const message, ...);
 void win_println_indent(ProfWin* window, int pad, const char* const message, ...);
+void win_println_lines(ProfWin* window, theme_item_t theme_item, const char* show_char, gchar** lines);
 
 void win_append(ProfWin* window, theme_item_t theme_item, const char* const message, ...);
 void win_appendln(ProfWin* window, theme_item_t theme_item, const char* const message, ...);
@@ -406,7 +448,7 @@ void notifier_uninit(void);
 void notify_typing(const char* const name);
 void notify_message(const char* const name, int win, const char* const text);
 void notify_room_message(const char* const nick, const char* const room, int win, const char* const text);
-void notify_remind(void);
+void notify_remind_update(void);
 void notify_invite(const char* const from, const char* const room, const char* const reason);
 void notify(const char* const message, int timeout, const char* const category);
 void notify_subscription(const char* const from);
@@ -50,6 +50,7 @@
 #endif
 
 #include "tools/autocomplete.h"
+#include "tools/url_ring.h"
 #include "ui/buffer.h"
 #include "xmpp/chat_state.h"
 
@@ -60,6 +61,7 @@
 #define PROFCONFWIN_MEMCHECK    64334685
 #define PROFXMLWIN_MEMCHECK     87333463
 #define PROFPLUGINWIN_MEMCHECK  43434777
+#define PROFSEARCHWIN_MEMCHECK  63521874
 
 typedef enum {
     FIELD_HIDDEN,
@@ -91,6 +93,8 @@ typedef struct form_field_t
     gboolean required;
     GSList* values;
     GSList* options;
+    // option value -> FormOption, built on first lookup
+    GHashTable* option_index;
     Autocomplete value_ac;
 } FormField;
 
@@ -102,6 +106,8 @@ typedef struct data_form_t
     GSList* fields;
     GHashTable* var_to_tag;
     GHashTable* tag_to_var;
+    // tag -> FormField, built on first lookup
+    GHashTable* tag_to_field;
     Autocomplete tag_ac;
     gboolean modified;
 } DataForm;
@@ -118,6 +124,14 @@ typedef struct prof_layout_t
     ProfBuff buffer;
     int y_pos;
     int paged;
+    // only the newest buffer entries are rendered on the pad
+    gboolean partial;
+    // resized while not shown, redraw before it is next displayed
+    gboolean stale;
+    // pads shrunk and buffer packed while not shown, see win_hibernate()
+    gboolean hibernated;
+    // monotonic time the window was last the current one
+    gint64 last_shown;
 } ProfLayout;
 
 typedef struct prof_layout_simple_t
@@ -140,14 +154,15 @@ typedef enum {
     WIN_CONFIG,
     WIN_PRIVATE,
     WIN_XML,
-    WIN_PLUGIN
+    WIN_PLUGIN,
+    WIN_SEARCH
 } win_type_t;
 
 typedef struct prof_win_t
 {
     win_type_t type;
     ProfLayout* layout;
-    Autocomplete urls_ac;
+    UrlRing* urls;
 } ProfWin;
 
 typedef struct prof_console_win_t
@@ -167,8 +182,19 @@ typedef struct prof_chat_win_t
     gboolean pgp_recv;
     gboolean is_omemo;
     gboolean is_ox; // XEP-0373: OpenPGP for XMPP
+    // the OTR policy for barejid, resolved for the settings generation
+    int otr_policy;
+    guint otr_policy_generation;
     char* resource_override;
     gboolean history_shown;
+    // position of the oldest message loaded from the history database
+    char* history_cursor_time;
+    gint64 history_cursor_id;
+    gboolean history_complete;
+    // newest lines were dropped from the buffer to make room for older ones
+    gboolean history_truncated;
+    // the first page is being read by the database thread
+    gboolean history_loading;
     unsigned long memcheck;
     char* enctext;
     char* incoming_char;
@@ -177,6 +203,10 @@ typedef struct prof_chat_win_t
     char* last_message;
     char* last_msg_id;
     gboolean has_attention;
+    // XEP-0333, the latest markable message not marked displayed yet
+    char* marker_id;
+    char* marker_jid;
+    gint64 marker_sent;
 } ProfChatWin;
 
 typedef struct prof_muc_win_t
@@ -193,11 +223,25 @@ typedef struct prof_muc_win_t
     unsigned long memcheck;
     char* enctext;
     char* message_char;
-    GDateTime* last_msg_timestamp;
+    // unix time in microseconds
+    gint64 last_msg_timestamp;
     // For LMC
     char* last_message;
     char* last_msg_id;
     gboolean has_attention;
+    // room history received since joining, oldest last, drawn in one go
+    // by mucwin_history_flush()
+    GSList* history;
+    // the stored history shown on opening the window, the room's history
+    // up to the newest stored message is already known
+    gboolean history_local;
+    GDateTime* history_since;
+    char* history_since_text;
+    // slow mode, live messages wait up to slow_ms and are drawn together,
+    // oldest last, identical consecutive ones once when slow_collapse
+    int slow_ms;
+    gboolean slow_collapse;
+    GSList* slow_pending;
 } ProfMucWin;
 
 typedef struct prof_conf_win_t ProfConfWin;
@@ -227,9 +271,31 @@ typedef struct prof_private_win_t
 typedef struct prof_xml_win_t
 {
     ProfWin window;
+    // raw stanzas, oldest first, of bytes in total
+    GQueue* stanzas;
+    gsize bytes;
+    // newest stanzas not drawn yet, the console was not shown
+    guint unshown;
+    // stanzas not matching are not kept
+    char* filter_kind;
+    char* filter_ns;
+    char* filter_jid;
     unsigned long memcheck;
 } ProfXMLWin;
 
+typedef struct prof_search_win_t
+{
+    ProfWin window;
+    // the running search, kept for /search next
+    char* query;
+    char* with;
+    char* after;
+    char* before;
+    // id of the oldest result shown, 0 once there are no more
+    gint64 cursor;
+    unsigned long memcheck;
+} ProfSearchWin;
+
 typedef struct prof_plugin_win_t
 {
     ProfWin window;
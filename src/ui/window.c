@@ -55,22 +55,34 @@
 #include "log.h"
 #include "config/theme.h"
 #include "config/preferences.h"
+#include "tools/perf.h"
+#include "tools/timefmt.h"
 #include "ui/ui.h"
 #include "ui/window.h"
 #include "ui/screen.h"
+#include "ui/relay.h"
+#include "ui/window_list.h"
 #include "xmpp/xmpp.h"
+#include "xmpp/message.h"
 #include "xmpp/roster_list.h"
 
 #define CONS_WIN_TITLE "Profanity. Type /help for help information."
 #define XML_WIN_TITLE  "XML Console"
+#define SEARCH_WIN_TITLE "Search"
+
+// search results span years, so they always show the date
+#define SEARCH_WIN_TIME_FORMAT "%Y-%m-%d %H:%M"
 
 #define CEILING(X) (X - (int)(X) > 0 ? (int)(X + 1) : (int)(X))
 
 static void
 _win_printf(ProfWin* window, const char* show_char, int pad_indent, GDateTime* timestamp, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message_id, const char* const message, ...);
+static void _win_redraw_all(ProfWin* window);
 static void _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDateTime* time,
-                                int flags, theme_item_t theme_item, const char* const from, const char* const message, DeliveryReceipt* receipt);
-static void _win_print_wrapped(WINDOW* win, const char* const message, size_t indent, int pad_indent);
+                                int flags, theme_item_t theme_item, const char* const from, const char* const message, gboolean receipt_pending, Wrap** wrap);
+static void _win_print_wrapped(WINDOW* win, const char* const message, size_t indent, int pad_indent, int max_lines, Wrap** cache);
+static void _win_print_collapsed(WINDOW* win, const char* const message, int max_lines);
+static void _win_print_hidden(WINDOW* win, int hidden, int indent);
 
 int
 win_roster_cols(void)
@@ -88,6 +100,54 @@ win_occpuants_cols(void)
     return CEILING((((double)cols) / 100) * occupants_win_percent);
 }
 
+// headless windows start hibernated and stay so, their pads are never drawn
+static int
+_win_pad_rows(void)
+{
+    return ui_is_headless() ? 1 : PAD_MIN_SIZE;
+}
+
+// The rows a pad keeps when resized, what it grew to stays
+static int
+_win_pad_kept_rows(WINDOW* pad)
+{
+    return MAX(getmaxy(pad), PAD_MIN_SIZE);
+}
+
+// Grows the pad so lines more fit below the cursor without scrolling, once
+// at PAD_SIZE the oldest lines scroll out as before
+void
+win_pad_reserve(WINDOW* pad, int lines)
+{
+    int rows = getmaxy(pad);
+    int needed = getcury(pad) + lines + 1;
+    if (rows >= PAD_SIZE || needed <= rows) {
+        return;
+    }
+
+    while (rows < needed && rows < PAD_SIZE) {
+        rows *= 2;
+    }
+    wresize(pad, MIN(rows, PAD_SIZE), getmaxx(pad));
+}
+
+// Most lines a message prints: every line of it wraps at half the width at
+// the least, the rest of the row goes to the time and the sender
+static int
+_win_message_lines(WINDOW* pad, const char* const message)
+{
+    if (!message) {
+        return 1;
+    }
+
+    int lines = 2;
+    for (const char* c = strchr(message, '\n'); c; c = strchr(c + 1, '\n')) {
+        lines++;
+    }
+
+    return lines + strlen(message) / MAX(getmaxx(pad) / 2, 1);
+}
+
 static ProfLayout*
 _win_create_simple_layout(void)
 {
@@ -95,11 +155,15 @@ _win_create_simple_layout(void)
 
     ProfLayoutSimple* layout = malloc(sizeof(ProfLayoutSimple));
     layout->base.type = LAYOUT_SIMPLE;
-    layout->base.win = newpad(PAD_SIZE, cols);
+    layout->base.win = newpad(_win_pad_rows(), cols);
     wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
     layout->base.buffer = buffer_create();
     layout->base.y_pos = 0;
     layout->base.paged = 0;
+    layout->base.partial = FALSE;
+    layout->base.stale = FALSE;
+    layout->base.hibernated = ui_is_headless();
+    layout->base.last_shown = g_get_monotonic_time();
     scrollok(layout->base.win, TRUE);
 
     return &layout->base;
@@ -112,11 +176,15 @@ _win_create_split_layout(void)
 
     ProfLayoutSplit* layout = malloc(sizeof(ProfLayoutSplit));
     layout->base.type = LAYOUT_SPLIT;
-    layout->base.win = newpad(PAD_SIZE, cols);
+    layout->base.win = newpad(_win_pad_rows(), cols);
     wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
     layout->base.buffer = buffer_create();
     layout->base.y_pos = 0;
     layout->base.paged = 0;
+    layout->base.partial = FALSE;
+    layout->base.stale = FALSE;
+    layout->base.hibernated = ui_is_headless();
+    layout->base.last_shown = g_get_monotonic_time();
     scrollok(layout->base.win, TRUE);
     layout->subwin = NULL;
     layout->sub_y_pos = 0;
@@ -145,12 +213,21 @@ win_create_chat(const char* const barejid)
     new_win->barejid = strdup(barejid);
     new_win->resource_override = NULL;
     new_win->is_otr = FALSE;
+    new_win->otr_policy_generation = 0;
+    new_win->marker_id = NULL;
+    new_win->marker_jid = NULL;
+    new_win->marker_sent = 0;
     new_win->otr_is_trusted = FALSE;
     new_win->pgp_recv = FALSE;
     new_win->pgp_send = FALSE;
     new_win->is_omemo = FALSE;
     new_win->is_ox = FALSE;
     new_win->history_shown = FALSE;
+    new_win->history_cursor_time = NULL;
+    new_win->history_cursor_id = 0;
+    new_win->history_complete = FALSE;
+    new_win->history_truncated = FALSE;
+    new_win->history_loading = FALSE;
     new_win->unread = 0;
     new_win->state = chat_state_new();
     new_win->enctext = NULL;
@@ -176,12 +253,12 @@ win_create_muc(const char* const roomjid)
 
     if (prefs_get_boolean(PREF_OCCUPANTS)) {
         int subwin_cols = win_occpuants_cols();
-        layout->base.win = newpad(PAD_SIZE, cols - subwin_cols);
+        layout->base.win = newpad(_win_pad_rows(), cols - subwin_cols);
         wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
-        layout->subwin = newpad(PAD_SIZE, subwin_cols);
+        layout->subwin = newpad(_win_pad_rows(), subwin_cols);
         wbkgd(layout->subwin, theme_attrs(THEME_TEXT));
     } else {
-        layout->base.win = newpad(PAD_SIZE, (cols));
+        layout->base.win = newpad(_win_pad_rows(), (cols));
         wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
         layout->subwin = NULL;
     }
@@ -190,6 +267,10 @@ win_create_muc(const char* const roomjid)
     layout->base.buffer = buffer_create();
     layout->base.y_pos = 0;
     layout->base.paged = 0;
+    layout->base.partial = FALSE;
+    layout->base.stale = FALSE;
+    layout->base.hibernated = ui_is_headless();
+    layout->base.last_shown = g_get_monotonic_time();
     scrollok(layout->base.win, TRUE);
     new_win->window.layout = (ProfLayout*)layout;
 
@@ -214,6 +295,13 @@ win_create_muc(const char* const roomjid)
     new_win->last_message = NULL;
     new_win->last_msg_id = NULL;
     new_win->has_attention = FALSE;
+    new_win->history = NULL;
+    new_win->history_local = FALSE;
+    new_win->history_since = NULL;
+    new_win->history_since_text = NULL;
+    new_win->slow_ms = 0;
+    new_win->slow_collapse = FALSE;
+    new_win->slow_pending = NULL;
 
     new_win->memcheck = PROFMUCWIN_MEMCHECK;
 
@@ -259,12 +347,36 @@ win_create_xmlconsole(void)
     ProfXMLWin* new_win = malloc(sizeof(ProfXMLWin));
     new_win->window.type = WIN_XML;
     new_win->window.layout = _win_create_simple_layout();
+    new_win->stanzas = g_queue_new();
+    new_win->bytes = 0;
+    new_win->unshown = 0;
+    new_win->filter_kind = NULL;
+    new_win->filter_ns = NULL;
+    new_win->filter_jid = NULL;
 
     new_win->memcheck = PROFXMLWIN_MEMCHECK;
 
     return &new_win->window;
 }
 
+ProfWin*
+win_create_search(void)
+{
+    ProfSearchWin* new_win = malloc(sizeof(ProfSearchWin));
+    new_win->window.type = WIN_SEARCH;
+    new_win->window.layout = _win_create_simple_layout();
+
+    new_win->query = NULL;
+    new_win->with = NULL;
+    new_win->after = NULL;
+    new_win->before = NULL;
+    new_win->cursor = 0;
+
+    new_win->memcheck = PROFSEARCHWIN_MEMCHECK;
+
+    return &new_win->window;
+}
+
 ProfWin*
 win_create_plugin(const char* const plugin_name, const char* const tag)
 {
@@ -345,6 +457,9 @@ win_get_title(ProfWin* window)
     if (window->type == WIN_XML) {
         return strdup(XML_WIN_TITLE);
     }
+    if (window->type == WIN_SEARCH) {
+        return strdup(SEARCH_WIN_TITLE);
+    }
     if (window->type == WIN_PLUGIN) {
         ProfPluginWin* pluginwin = (ProfPluginWin*)window;
         assert(pluginwin->memcheck == PROFPLUGINWIN_MEMCHECK);
@@ -393,6 +508,10 @@ win_get_tab_identifier(ProfWin* window)
     {
         return strdup("xmlconsole");
     }
+    case WIN_SEARCH:
+    {
+        return strdup("search");
+    }
     default:
         return strdup("UNKNOWN");
     }
@@ -472,6 +591,11 @@ win_to_string(ProfWin* window)
         g_string_free(gstring, FALSE);
         return res;
     }
+    case WIN_SEARCH:
+    {
+        ProfSearchWin* searchwin = (ProfSearchWin*)window;
+        return searchwin_get_string(searchwin);
+    }
     default:
         return NULL;
     }
@@ -488,11 +612,11 @@ win_hide_subwin(ProfWin* window)
         layout->subwin = NULL;
         layout->sub_y_pos = 0;
         int cols = getmaxx(stdscr);
-        wresize(layout->base.win, PAD_SIZE, cols);
+        wresize(layout->base.win, _win_pad_kept_rows(layout->base.win), cols);
         win_redraw(window);
     } else {
         int cols = getmaxx(stdscr);
-        wresize(window->layout->win, PAD_SIZE, cols);
+        wresize(window->layout->win, _win_pad_kept_rows(window->layout->win), cols);
         win_redraw(window);
     }
 }
@@ -514,9 +638,9 @@ win_show_subwin(ProfWin* window)
     }
 
     ProfLayoutSplit* layout = (ProfLayoutSplit*)window->layout;
-    layout->subwin = newpad(PAD_SIZE, subwin_cols);
+    layout->subwin = newpad(_win_pad_rows(), subwin_cols);
     wbkgd(layout->subwin, theme_attrs(THEME_TEXT));
-    wresize(layout->base.win, PAD_SIZE, cols - subwin_cols);
+    wresize(layout->base.win, _win_pad_kept_rows(layout->base.win), cols - subwin_cols);
     win_redraw(window);
 }
 
@@ -542,11 +666,14 @@ win_free(ProfWin* window)
         ProfChatWin* chatwin = (ProfChatWin*)window;
         free(chatwin->barejid);
         free(chatwin->resource_override);
+        g_free(chatwin->history_cursor_time);
         free(chatwin->enctext);
         free(chatwin->incoming_char);
         free(chatwin->outgoing_char);
         free(chatwin->last_message);
         free(chatwin->last_msg_id);
+        free(chatwin->marker_id);
+        free(chatwin->marker_jid);
         chat_state_free(chatwin->state);
         break;
     }
@@ -559,6 +686,13 @@ win_free(ProfWin* window)
         free(mucwin->message_char);
         free(mucwin->last_message);
         free(mucwin->last_msg_id);
+        g_slist_free_full(mucwin->history, (GDestroyNotify)message_free);
+        if (mucwin->history_since) {
+            g_date_time_unref(mucwin->history_since);
+        }
+        free(mucwin->history_since_text);
+        // logged already, only their drawing is lost
+        g_slist_free_full(mucwin->slow_pending, (GDestroyNotify)message_free);
         break;
     }
     case WIN_CONFIG:
@@ -581,6 +715,24 @@ win_free(ProfWin* window)
         free(pluginwin->plugin_name);
         break;
     }
+    case WIN_XML:
+    {
+        ProfXMLWin* xmlwin = (ProfXMLWin*)window;
+        g_queue_free_full(xmlwin->stanzas, free);
+        free(xmlwin->filter_kind);
+        free(xmlwin->filter_ns);
+        free(xmlwin->filter_jid);
+        break;
+    }
+    case WIN_SEARCH:
+    {
+        ProfSearchWin* searchwin = (ProfSearchWin*)window;
+        g_free(searchwin->query);
+        g_free(searchwin->with);
+        g_free(searchwin->after);
+        g_free(searchwin->before);
+        break;
+    }
     default:
         break;
     }
@@ -598,6 +750,23 @@ win_page_up(ProfWin* window)
 
     *page_start -= page_space;
 
+    // reached the top of what is rendered, render the older buffer entries
+    if (*page_start < 0 && window->layout->partial) {
+        _win_redraw_all(window);
+        int new_y = getcury(window->layout->win);
+        *page_start += new_y - y;
+        y = new_y;
+    }
+
+    // reached the top of a chat, pull the next page from the history database
+    if (*page_start < 0 && window->type == WIN_CHAT) {
+        if (chatwin_older_history((ProfChatWin*)window)) {
+            int new_y = getcury(window->layout->win);
+            *page_start += new_y - y;
+            y = new_y;
+        }
+    }
+
     // went past beginning, show first page
     if (*page_start < 0)
         *page_start = 0;
@@ -629,6 +798,14 @@ win_page_down(ProfWin* window)
     else if (*page_start >= y)
         *page_start = y - page_space - 1;
 
+    // reached the end of a chat that dropped its newest lines, reload them
+    if (*page_start >= y - page_space - 1 && window->type == WIN_CHAT) {
+        if (chatwin_newer_history((ProfChatWin*)window)) {
+            y = getcury(window->layout->win);
+            *page_start = y - page_space;
+        }
+    }
+
     window->layout->paged = 1;
     win_update_virtual(window);
 
@@ -658,6 +835,13 @@ win_sub_page_down(ProfWin* window)
         else if (*sub_y_pos >= sub_y)
             *sub_y_pos = sub_y - page_space - 1;
 
+        // the side panels only draw the rows in view
+        if (window->type == WIN_CONSOLE) {
+            ui_redraw_roster();
+        } else if (window->type == WIN_MUC) {
+            ui_redraw_occupants(((ProfMucWin*)window)->roomjid);
+        }
+
         win_update_virtual(window);
     }
 }
@@ -677,6 +861,13 @@ win_sub_page_up(ProfWin* window)
         if (*sub_y_pos < 0)
             *sub_y_pos = 0;
 
+        // the side panels only draw the rows in view
+        if (window->type == WIN_CONSOLE) {
+            ui_redraw_roster();
+        } else if (window->type == WIN_MUC) {
+            ui_redraw_occupants(((ProfMucWin*)window)->roomjid);
+        }
+
         win_update_virtual(window);
     }
 }
@@ -685,7 +876,11 @@ void
 win_clear(ProfWin* window)
 {
     if (!prefs_get_boolean(PREF_CLEAR_PERSIST_HISTORY)) {
+        ui_mark_dirty(UI_DIRTY_WINDOW);
         werase(window->layout->win);
+        if (!window->layout->hibernated) {
+            wresize(window->layout->win, PAD_MIN_SIZE, getmaxx(window->layout->win));
+        }
         buffer_free(window->layout->buffer);
         window->layout->buffer = buffer_create();
         return;
@@ -701,6 +896,12 @@ win_clear(ProfWin* window)
 void
 win_resize(ProfWin* window)
 {
+    // sized when woken up
+    if (window->layout->hibernated) {
+        window->layout->stale = TRUE;
+        return;
+    }
+
     int cols = getmaxx(stdscr);
 
     if (window->layout->type == LAYOUT_SPLIT) {
@@ -713,9 +914,9 @@ win_resize(ProfWin* window)
                 subwin_cols = win_occpuants_cols();
             }
             wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
-            wresize(layout->base.win, PAD_SIZE, cols - subwin_cols);
+            wresize(layout->base.win, _win_pad_kept_rows(layout->base.win), cols - subwin_cols);
             wbkgd(layout->subwin, theme_attrs(THEME_TEXT));
-            wresize(layout->subwin, PAD_SIZE, subwin_cols);
+            wresize(layout->subwin, _win_pad_kept_rows(layout->subwin), subwin_cols);
             if (window->type == WIN_CONSOLE) {
                 rosterwin_roster();
             } else if (window->type == WIN_MUC) {
@@ -725,21 +926,109 @@ win_resize(ProfWin* window)
             }
         } else {
             wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
-            wresize(layout->base.win, PAD_SIZE, cols);
+            wresize(layout->base.win, _win_pad_kept_rows(layout->base.win), cols);
         }
     } else {
         wbkgd(window->layout->win, theme_attrs(THEME_TEXT));
-        wresize(window->layout->win, PAD_SIZE, cols);
+        wresize(window->layout->win, _win_pad_kept_rows(window->layout->win), cols);
     }
 
-    win_redraw(window);
+    // windows in the background are redrawn once they are shown again
+    if (wins_is_current(window)) {
+        win_redraw(window);
+    } else {
+        window->layout->stale = TRUE;
+    }
+}
+
+static gsize
+_win_pad_memory(WINDOW* pad)
+{
+    if (pad == NULL) {
+        return 0;
+    }
+
+#if NCURSES_WIDECHAR
+    return (gsize)getmaxy(pad) * getmaxx(pad) * sizeof(cchar_t);
+#else
+    return (gsize)getmaxy(pad) * getmaxx(pad) * sizeof(chtype);
+#endif
+}
+
+// Estimated memory held by the pads and the buffer of a window
+gsize
+win_memory(ProfWin* window)
+{
+    gsize total = buffer_memory(window->layout->buffer) + _win_pad_memory(window->layout->win);
+
+    if (window->layout->type == LAYOUT_SPLIT) {
+        ProfLayoutSplit* layout = (ProfLayoutSplit*)window->layout;
+        total += _win_pad_memory(layout->subwin);
+    }
+
+    return total;
+}
+
+// Free most of the memory of a window that is not shown: the pads shrink to a
+// single line and the buffer drops its line breaks. Printing keeps going to
+// the buffer only, win_wake() draws the window again.
+void
+win_hibernate(ProfWin* window)
+{
+    ProfLayout* layout = window->layout;
+    if (layout->hibernated || (wins_is_current(window) && !ui_is_headless())) {
+        return;
+    }
+
+    buffer_hibernate(layout->buffer);
+
+    werase(layout->win);
+    wresize(layout->win, 1, getmaxx(layout->win));
+    if (layout->type == LAYOUT_SPLIT) {
+        ProfLayoutSplit* split = (ProfLayoutSplit*)layout;
+        if (split->subwin) {
+            werase(split->subwin);
+            wresize(split->subwin, 1, getmaxx(split->subwin));
+        }
+    }
+
+    layout->hibernated = TRUE;
+    layout->stale = TRUE;
+}
+
+void
+win_wake(ProfWin* window)
+{
+    if (!window->layout->hibernated) {
+        return;
+    }
+
+    window->layout->hibernated = FALSE;
+    // restores the pad sizes, redraws the occupants or roster and the
+    // window itself once it is shown
+    win_resize(window);
 }
 
 void
 win_update_virtual(ProfWin* window)
 {
+    if (ui_is_headless()) {
+        return;
+    }
+
+    win_wake(window);
+
     int cols = getmaxx(stdscr);
 
+    ui_mark_dirty(UI_DIRTY_WINDOW);
+
+    if (window->layout->stale) {
+        win_redraw(window);
+        if (window->layout->paged == 0) {
+            win_move_to_end(window);
+        }
+    }
+
     int row_start = screen_mainwin_row_start();
     int row_end = screen_mainwin_row_end();
     if (window->layout->type == LAYOUT_SPLIT) {
@@ -766,6 +1055,8 @@ win_refresh_without_subwin(ProfWin* window)
 {
     int cols = getmaxx(stdscr);
 
+    ui_mark_dirty(UI_DIRTY_WINDOW);
+
     if ((window->type == WIN_MUC) || (window->type == WIN_CONSOLE)) {
         int row_start = screen_mainwin_row_start();
         int row_end = screen_mainwin_row_end();
@@ -791,6 +1082,7 @@ win_refresh_with_subwin(ProfWin* window)
         return;
     }
 
+    ui_mark_dirty(UI_DIRTY_WINDOW);
     pnoutrefresh(layout->base.win, layout->base.y_pos, 0, row_start, 0, row_end, (cols - subwin_cols) - 1);
     pnoutrefresh(layout->subwin, layout->sub_y_pos, 0, row_start, (cols - subwin_cols), row_end, cols - 1);
 }
@@ -1100,15 +1392,10 @@ win_show_status_string(ProfWin* window, const char* const from,
         win_append(window, presence_colour, " is %s", default_show);
 
     if (last_activity) {
-        gchar* date_fmt = NULL;
-        char* time_pref = prefs_get_string(PREF_TIME_LASTACTIVITY);
-        date_fmt = g_date_time_format(last_activity, time_pref);
-        g_free(time_pref);
-        assert(date_fmt != NULL);
+        char date_fmt[TIMEFMT_MAX];
+        timefmt_format(last_activity, prefs_peek_string(PREF_TIME_LASTACTIVITY), date_fmt, sizeof(date_fmt));
 
         win_append(window, presence_colour, ", last activity: %s", date_fmt);
-
-        g_free(date_fmt);
     }
 
     if (status)
@@ -1117,46 +1404,46 @@ win_show_status_string(ProfWin* window, const char* const from,
     win_appendln(window, presence_colour, "");
 }
 
-static void
-_win_correct(ProfWin* window, const char* const message, const char* const id, const char* const replace_id, const char* const from_jid)
+// Replace the message in the buffer only, TRUE when the window needs a redraw
+static gboolean
+_win_correct_entry(ProfWin* window, const char* const message, const char* const id, const char* const replace_id, const char* const from_jid)
 {
     ProfBuffEntry* entry = buffer_get_entry_by_id(window->layout->buffer, replace_id);
     if (!entry) {
         log_debug("Replace ID %s could not be found in buffer. Message: %s", replace_id, message);
-        return;
+        return FALSE;
     }
 
     if (g_strcmp0(entry->from_jid, from_jid) != 0) {
         log_debug("Illicit LMC attempt from %s for message from %s with: %s", from_jid, entry->from_jid, message);
         cons_show("Illicit LMC attempt from %s for message from %s", from_jid, entry->from_jid);
-        return;
+        return FALSE;
     }
 
     /*TODO: set date?
-    if (entry->date) {
-        if (entry->date->timestamp) {
-            g_date_time_unref(entry->date->timestamp);
-        }
-        free(entry->date);
-    }
-
-    entry->date = buffer_date_new_now();
+    entry->time = g_get_real_time();
     */
 
-    free(entry->show_char);
-    entry->show_char = prefs_get_correction_char();
+    char* correction_char = prefs_get_correction_char();
+    buffer_update_entry(window->layout->buffer, entry, correction_char, message, id);
+    free(correction_char);
 
-    if (entry->message) {
-        free(entry->message);
-    }
-    entry->message = strdup(message);
+    return TRUE;
+}
 
-    if (entry->id) {
-        free(entry->id);
+static void
+_win_correct(ProfWin* window, const char* const message, const char* const id, const char* const replace_id, const char* const from_jid)
+{
+    if (_win_correct_entry(window, message, id, replace_id, from_jid)) {
+        win_redraw(window);
     }
-    entry->id = strdup(id);
+}
 
-    win_redraw(window);
+// The local time of a message to display, now when it has none
+static GDateTime*
+_win_message_time(const ProfMessage* const message)
+{
+    return timefmt_local(message->timestamp ? message->timestamp : g_get_real_time());
 }
 
 void
@@ -1168,6 +1455,8 @@ win_print_incoming(ProfWin* window, const char* const display_name_from, ProfMes
         flags |= UNTRUSTED;
     }
 
+    GDateTime* timestamp = _win_message_time(message);
+
     switch (window->type) {
     case WIN_CHAT:
     {
@@ -1191,19 +1480,21 @@ win_print_incoming(ProfWin* window, const char* const display_name_from, ProfMes
         if (prefs_get_boolean(PREF_CORRECTION_ALLOW) && message->replace_id) {
             _win_correct(window, message->plain, message->id, message->replace_id, message->from_jid->barejid);
         } else {
-            _win_printf(window, enc_char, 0, message->timestamp, flags, THEME_TEXT_THEM, display_name_from, message->from_jid->barejid, message->id, "%s", message->plain);
+            _win_printf(window, enc_char, 0, timestamp, flags, THEME_TEXT_THEM, display_name_from, message->from_jid->barejid, message->id, "%s", message->plain);
         }
 
         free(enc_char);
         break;
     }
     case WIN_PRIVATE:
-        _win_printf(window, "-", 0, message->timestamp, flags, THEME_TEXT_THEM, display_name_from, message->from_jid->barejid, message->id, "%s", message->plain);
+        _win_printf(window, "-", 0, timestamp, flags, THEME_TEXT_THEM, display_name_from, message->from_jid->barejid, message->id, "%s", message->plain);
         break;
     default:
         assert(FALSE);
         break;
     }
+
+    g_date_time_unref(timestamp);
 }
 
 void
@@ -1218,12 +1509,29 @@ win_println_incoming_muc_msg(ProfWin* window, char* show_char, int flags, const
     if (prefs_get_boolean(PREF_CORRECTION_ALLOW) && message->replace_id) {
         _win_correct(window, message->plain, message->id, message->replace_id, message->from_jid->fulljid);
     } else {
-        _win_printf(window, show_char, 0, message->timestamp, flags | NO_ME, THEME_TEXT_THEM, message->from_jid->resourcepart, message->from_jid->fulljid, message->id, "%s", message->plain);
+        GDateTime* timestamp = _win_message_time(message);
+        _win_printf(window, show_char, 0, timestamp, flags | NO_ME, THEME_TEXT_THEM, message->from_jid->resourcepart, message->from_jid->fulljid, message->id, "%s", message->plain);
+        g_date_time_unref(timestamp);
     }
 
     inp_nonblocking(TRUE);
 }
 
+// Like win_println_incoming_muc_msg() but the message only goes to the buffer,
+// the caller redraws the window once for a whole batch
+void
+win_append_incoming_muc_msg(ProfWin* window, char* show_char, int flags, const ProfMessage* const message)
+{
+    if (prefs_get_boolean(PREF_CORRECTION_ALLOW) && message->replace_id) {
+        _win_correct_entry(window, message->plain, message->id, message->replace_id, message->from_jid->fulljid);
+        return;
+    }
+
+    GDateTime* timestamp = _win_message_time(message);
+    buffer_append(window->layout->buffer, show_char, 0, timestamp, flags | NO_ME, THEME_TEXT_THEM, message->from_jid->resourcepart, message->from_jid->fulljid, message->plain, FALSE, message->id);
+    g_date_time_unref(timestamp);
+}
+
 void
 win_print_outgoing_muc_msg(ProfWin* window, char* show_char, const char* const me, const char* const id, const char* const replace_id, const char* const message)
 {
@@ -1255,31 +1563,118 @@ win_print_outgoing(ProfWin* window, const char* show_char, const char* const id,
     g_date_time_unref(timestamp);
 }
 
-void
-win_print_history(ProfWin* window, const ProfMessage* const message)
+// the name is shared, see roster_get_msg_display_name()
+static const char*
+_win_history_display_name(const ProfMessage* const message)
 {
-    g_date_time_ref(message->timestamp);
-
-    char* display_name;
-    int flags = 0;
+    const char* display_name;
     const char* jid = connection_get_fulljid();
     Jid* jidp = jid_create(jid);
 
     if (g_strcmp0(jidp->barejid, message->from_jid->barejid) == 0) {
-        display_name = strdup("me");
+        display_name = "me";
     } else {
         display_name = roster_get_msg_display_name(message->from_jid->barejid, message->from_jid->resourcepart);
     }
 
     jid_destroy(jidp);
 
-    buffer_append(window->layout->buffer, "-", 0, message->timestamp, flags, THEME_TEXT_HISTORY, display_name, NULL, message->plain, NULL, NULL);
-    _win_print_internal(window, "-", 0, message->timestamp, flags, THEME_TEXT_HISTORY, display_name, message->plain, NULL);
+    return display_name;
+}
+
+void
+win_print_history(ProfWin* window, const ProfMessage* const message)
+{
+    GDateTime* timestamp = _win_message_time(message);
+
+    int flags = 0;
+    const char* display_name;
+    // the room is the window, the occupant's nick is enough
+    if (window->type == WIN_MUC && message->from_jid->resourcepart) {
+        display_name = message->from_jid->resourcepart;
+    } else {
+        display_name = _win_history_display_name(message);
+    }
 
-    free(display_name);
+    buffer_append(window->layout->buffer, "-", 0, timestamp, flags, THEME_TEXT_HISTORY, display_name, NULL, message->plain, FALSE, NULL);
+    _win_print_internal(window, "-", 0, timestamp, flags, THEME_TEXT_HISTORY, display_name, message->plain, FALSE, NULL);
 
     inp_nonblocking(TRUE);
-    g_date_time_unref(message->timestamp);
+    g_date_time_unref(timestamp);
+}
+
+// A search hit, with the other side of the conversation for own messages
+void
+win_print_search_result(ProfWin* window, const ProfMessage* const message)
+{
+    const char* sender = _win_history_display_name(message);
+    char* display_name = NULL;
+    if (g_strcmp0(sender, "me") == 0 && message->to_jid) {
+        display_name = g_strdup_printf("me -> %s", message->to_jid->barejid);
+    } else {
+        display_name = g_strdup(sender);
+    }
+
+    GDateTime* timestamp = _win_message_time(message);
+    _win_printf(window, "-", 0, timestamp, 0, THEME_TEXT_HISTORY, display_name, NULL, NULL, "%s", message->plain);
+    g_date_time_unref(timestamp);
+
+    g_free(display_name);
+}
+
+// Insert older history (oldest first) above the window contents and redraw.
+// Returns the number of newest lines dropped to make room.
+int
+win_prepend_history(ProfWin* window, GSList* history)
+{
+    int dropped = 0;
+    // walk newest to oldest so each one lands above the previous
+    GSList* reversed = g_slist_reverse(g_slist_copy(history));
+    GSList* curr = reversed;
+
+    while (curr) {
+        ProfMessage* message = curr->data;
+        const char* display_name = _win_history_display_name(message);
+        GDateTime* timestamp = _win_message_time(message);
+        if (buffer_prepend(window->layout->buffer, "-", 0, timestamp, 0, THEME_TEXT_HISTORY, display_name, NULL, message->plain, FALSE, NULL)) {
+            dropped++;
+        }
+        g_date_time_unref(timestamp);
+        curr = g_slist_next(curr);
+    }
+    g_slist_free(reversed);
+
+    if (history) {
+        _win_redraw_all(window);
+    }
+
+    return dropped;
+}
+
+// Replace the window contents with history (oldest first), used to bring
+// back the newest lines once they were dropped for older ones
+void
+win_reload_history(ProfWin* window, GSList* history)
+{
+    buffer_free(window->layout->buffer);
+    window->layout->buffer = buffer_create();
+    win_prepend_history(window, history);
+    if (!history) {
+        _win_redraw_all(window);
+    }
+}
+
+// A line standing in for what is still being loaded, it goes again with
+// win_remove_entry_message() and its id
+void
+win_print_placeholder(ProfWin* window, const char* const id, const char* const message)
+{
+    GDateTime* timestamp = g_date_time_new_now_local();
+
+    buffer_append(window->layout->buffer, "-", 0, timestamp, 0, THEME_TEXT_HISTORY, "", NULL, message, FALSE, id);
+    _win_print_internal(window, "-", 0, timestamp, 0, THEME_TEXT_HISTORY, "", message, FALSE, NULL);
+
+    g_date_time_unref(timestamp);
 }
 
 void
@@ -1292,8 +1687,8 @@ win_print(ProfWin* window, theme_item_t theme_item, const char* show_char, const
     GString* fmt_msg = g_string_new(NULL);
     g_string_vprintf(fmt_msg, message, arg);
 
-    buffer_append(window->layout->buffer, show_char, 0, timestamp, NO_EOL, theme_item, "", NULL, fmt_msg->str, NULL, NULL);
-    _win_print_internal(window, show_char, 0, timestamp, NO_EOL, theme_item, "", fmt_msg->str, NULL);
+    buffer_append(window->layout->buffer, show_char, 0, timestamp, NO_EOL, theme_item, "", NULL, fmt_msg->str, FALSE, NULL);
+    _win_print_internal(window, show_char, 0, timestamp, NO_EOL, theme_item, "", fmt_msg->str, FALSE, NULL);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(timestamp);
@@ -1312,8 +1707,8 @@ win_println(ProfWin* window, theme_item_t theme_item, const char* show_char, con
     GString* fmt_msg = g_string_new(NULL);
     g_string_vprintf(fmt_msg, message, arg);
 
-    buffer_append(window->layout->buffer, show_char, 0, timestamp, 0, theme_item, "", NULL, fmt_msg->str, NULL, NULL);
-    _win_print_internal(window, show_char, 0, timestamp, 0, theme_item, "", fmt_msg->str, NULL);
+    buffer_append(window->layout->buffer, show_char, 0, timestamp, 0, theme_item, "", NULL, fmt_msg->str, FALSE, NULL);
+    _win_print_internal(window, show_char, 0, timestamp, 0, theme_item, "", fmt_msg->str, FALSE, NULL);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(timestamp);
@@ -1322,6 +1717,33 @@ win_println(ProfWin* window, theme_item_t theme_item, const char* show_char, con
     va_end(arg);
 }
 
+// Prints many lines with a single redraw, a window in the background is only
+// redrawn once it is shown. Unlike win_println() the input loop is not woken,
+// the caller does that when the lines are worth waking up for
+void
+win_println_lines(ProfWin* window, theme_item_t theme_item, const char* show_char, gchar** lines)
+{
+    if (!lines || !lines[0]) {
+        return;
+    }
+
+    GDateTime* timestamp = g_date_time_new_now_local();
+    for (int i = 0; lines[i]; i++) {
+        buffer_append(window->layout->buffer, show_char, 0, timestamp, 0, theme_item, "", NULL, lines[i], FALSE, NULL);
+        // hibernated windows only hand the line to the log and the relay
+        if (window->layout->hibernated) {
+            _win_print_internal(window, show_char, 0, timestamp, 0, theme_item, "", lines[i], FALSE, NULL);
+        }
+    }
+    g_date_time_unref(timestamp);
+
+    if (wins_is_current(window)) {
+        win_redraw(window);
+    } else {
+        window->layout->stale = TRUE;
+    }
+}
+
 void
 win_println_indent(ProfWin* window, int pad, const char* const message, ...)
 {
@@ -1332,8 +1754,8 @@ win_println_indent(ProfWin* window, int pad, const char* const message, ...)
     GString* fmt_msg = g_string_new(NULL);
     g_string_vprintf(fmt_msg, message, arg);
 
-    buffer_append(window->layout->buffer, "-", pad, timestamp, 0, THEME_DEFAULT, "", NULL, fmt_msg->str, NULL, NULL);
-    _win_print_internal(window, "-", pad, timestamp, 0, THEME_DEFAULT, "", fmt_msg->str, NULL);
+    buffer_append(window->layout->buffer, "-", pad, timestamp, 0, THEME_DEFAULT, "", NULL, fmt_msg->str, FALSE, NULL);
+    _win_print_internal(window, "-", pad, timestamp, 0, THEME_DEFAULT, "", fmt_msg->str, FALSE, NULL);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(timestamp);
@@ -1352,8 +1774,8 @@ win_append(ProfWin* window, theme_item_t theme_item, const char* const message,
     GString* fmt_msg = g_string_new(NULL);
     g_string_vprintf(fmt_msg, message, arg);
 
-    buffer_append(window->layout->buffer, "-", 0, timestamp, NO_DATE | NO_EOL, theme_item, "", NULL, fmt_msg->str, NULL, NULL);
-    _win_print_internal(window, "-", 0, timestamp, NO_DATE | NO_EOL, theme_item, "", fmt_msg->str, NULL);
+    buffer_append(window->layout->buffer, "-", 0, timestamp, NO_DATE | NO_EOL, theme_item, "", NULL, fmt_msg->str, FALSE, NULL);
+    _win_print_internal(window, "-", 0, timestamp, NO_DATE | NO_EOL, theme_item, "", fmt_msg->str, FALSE, NULL);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(timestamp);
@@ -1372,8 +1794,8 @@ win_appendln(ProfWin* window, theme_item_t theme_item, const char* const message
     GString* fmt_msg = g_string_new(NULL);
     g_string_vprintf(fmt_msg, message, arg);
 
-    buffer_append(window->layout->buffer, "-", 0, timestamp, NO_DATE, theme_item, "", NULL, fmt_msg->str, NULL, NULL);
-    _win_print_internal(window, "-", 0, timestamp, NO_DATE, theme_item, "", fmt_msg->str, NULL);
+    buffer_append(window->layout->buffer, "-", 0, timestamp, NO_DATE, theme_item, "", NULL, fmt_msg->str, FALSE, NULL);
+    _win_print_internal(window, "-", 0, timestamp, NO_DATE, theme_item, "", fmt_msg->str, FALSE, NULL);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(timestamp);
@@ -1392,8 +1814,8 @@ win_append_highlight(ProfWin* window, theme_item_t theme_item, const char* const
     GString* fmt_msg = g_string_new(NULL);
     g_string_vprintf(fmt_msg, message, arg);
 
-    buffer_append(window->layout->buffer, "-", 0, timestamp, NO_DATE | NO_ME | NO_EOL, theme_item, "", NULL, fmt_msg->str, NULL, NULL);
-    _win_print_internal(window, "-", 0, timestamp, NO_DATE | NO_ME | NO_EOL, theme_item, "", fmt_msg->str, NULL);
+    buffer_append(window->layout->buffer, "-", 0, timestamp, NO_DATE | NO_ME | NO_EOL, theme_item, "", NULL, fmt_msg->str, FALSE, NULL);
+    _win_print_internal(window, "-", 0, timestamp, NO_DATE | NO_ME | NO_EOL, theme_item, "", fmt_msg->str, FALSE, NULL);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(timestamp);
@@ -1412,8 +1834,8 @@ win_appendln_highlight(ProfWin* window, theme_item_t theme_item, const char* con
     GString* fmt_msg = g_string_new(NULL);
     g_string_vprintf(fmt_msg, message, arg);
 
-    buffer_append(window->layout->buffer, "-", 0, timestamp, NO_DATE | NO_ME, theme_item, "", NULL, fmt_msg->str, NULL, NULL);
-    _win_print_internal(window, "-", 0, timestamp, NO_DATE | NO_ME, theme_item, "", fmt_msg->str, NULL);
+    buffer_append(window->layout->buffer, "-", 0, timestamp, NO_DATE | NO_ME, theme_item, "", NULL, fmt_msg->str, FALSE, NULL);
+    _win_print_internal(window, "-", 0, timestamp, NO_DATE | NO_ME, theme_item, "", fmt_msg->str, FALSE, NULL);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(timestamp);
@@ -1433,16 +1855,12 @@ win_print_outgoing_with_receipt(ProfWin* window, const char* show_char, const ch
 {
     GDateTime* time = g_date_time_new_now_local();
 
-    DeliveryReceipt* receipt = malloc(sizeof(struct delivery_receipt_t));
-    receipt->received = FALSE;
-
     const char* myjid = connection_get_fulljid();
     if (replace_id) {
         _win_correct(window, message, id, replace_id, myjid);
-        free(receipt); // TODO: probably we should use this in _win_correct()
     } else {
-        buffer_append(window->layout->buffer, show_char, 0, time, 0, THEME_TEXT_ME, from, myjid, message, receipt, id);
-        _win_print_internal(window, show_char, 0, time, 0, THEME_TEXT_ME, from, message, receipt);
+        buffer_append(window->layout->buffer, show_char, 0, time, 0, THEME_TEXT_ME, from, myjid, message, TRUE, id);
+        _win_print_internal(window, show_char, 0, time, 0, THEME_TEXT_ME, from, message, TRUE, NULL);
     }
 
     // TODO: cross-reference.. this should be replaced by a real event-based system
@@ -1459,13 +1877,21 @@ win_mark_received(ProfWin* window, const char* const id)
     }
 }
 
+void
+win_mark_received_upto(ProfWin* window, const char* const id)
+{
+    gboolean received = buffer_mark_received_upto(window->layout->buffer, id);
+    if (received) {
+        win_redraw(window);
+    }
+}
+
 void
 win_update_entry_message(ProfWin* window, const char* const id, const char* const message)
 {
     ProfBuffEntry* entry = buffer_get_entry_by_id(window->layout->buffer, id);
     if (entry) {
-        free(entry->message);
-        entry->message = strdup(message);
+        buffer_update_entry(window->layout->buffer, entry, entry->show_char, message, entry->id);
         win_redraw(window);
     }
 }
@@ -1497,9 +1923,9 @@ _win_printf(ProfWin* window, const char* show_char, int pad_indent, GDateTime* t
     GString* fmt_msg = g_string_new(NULL);
     g_string_vprintf(fmt_msg, message, arg);
 
-    buffer_append(window->layout->buffer, show_char, pad_indent, timestamp, flags, theme_item, display_from, from_jid, fmt_msg->str, NULL, message_id);
+    buffer_append(window->layout->buffer, show_char, pad_indent, timestamp, flags, theme_item, display_from, from_jid, fmt_msg->str, FALSE, message_id);
 
-    _win_print_internal(window, show_char, pad_indent, timestamp, flags, theme_item, display_from, fmt_msg->str, NULL);
+    _win_print_internal(window, show_char, pad_indent, timestamp, flags, theme_item, display_from, fmt_msg->str, FALSE, NULL);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(timestamp);
@@ -1510,7 +1936,7 @@ _win_printf(ProfWin* window, const char* show_char, int pad_indent, GDateTime* t
 
 static void
 _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDateTime* time,
-                    int flags, theme_item_t theme_item, const char* const from, const char* const message, DeliveryReceipt* receipt)
+                    int flags, theme_item_t theme_item, const char* const from, const char* const message, gboolean receipt_pending, Wrap** wrap)
 {
     // flags : 1st bit =  0/1 - me/not me. define: NO_ME
     //         2nd bit =  0/1 - date/no date. define: NO_DATE
@@ -1518,48 +1944,71 @@ _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDat
     //         4th bit =  0/1 - color from/no color from. define: NO_COLOUR_FROM
     //         5th bit =  0/1 - color date/no date. define: NO_COLOUR_DATE
     //         6th bit =  0/1 - trusted/untrusted. define: UNTRUSTED
+    //         7th bit =  0/1 - collapsed/expanded. define: EXPANDED
+    // the buffer has it, it's drawn when the window wakes up
+    if (window->layout->hibernated) {
+        // nobody sees the console without a terminal, the log stands in,
+        // attached frontends get every line
+        if (ui_is_headless()) {
+            if (window->type == WIN_CONSOLE) {
+                log_info("[CONSOLE] %s", message);
+            }
+            relay_window_line(window, time, flags, from, message);
+        }
+        return;
+    }
+
+    // oversized messages show their first lines until expanded
+    int max_lines = (flags & EXPANDED) ? 0 : prefs_get_collapse_lines();
+    int lines = _win_message_lines(window->layout->win, message);
+    if (max_lines > 0) {
+        lines = MIN(lines, max_lines + 2);
+    }
+    win_pad_reserve(window->layout->win, lines);
+
     gboolean me_message = FALSE;
     int offset = 0;
     int colour = theme_attrs(THEME_ME);
     size_t indent = 0;
 
-    char* time_pref = NULL;
+    ui_mark_dirty(UI_DIRTY_WINDOW);
+
+    const gchar* time_pref = NULL;
     switch (window->type) {
     case WIN_CHAT:
-        time_pref = prefs_get_string(PREF_TIME_CHAT);
+        time_pref = prefs_peek_string(PREF_TIME_CHAT);
         break;
     case WIN_MUC:
-        time_pref = prefs_get_string(PREF_TIME_MUC);
+        time_pref = prefs_peek_string(PREF_TIME_MUC);
         break;
     case WIN_CONFIG:
-        time_pref = prefs_get_string(PREF_TIME_CONFIG);
+        time_pref = prefs_peek_string(PREF_TIME_CONFIG);
         break;
     case WIN_PRIVATE:
-        time_pref = prefs_get_string(PREF_TIME_PRIVATE);
+        time_pref = prefs_peek_string(PREF_TIME_PRIVATE);
         break;
     case WIN_XML:
-        time_pref = prefs_get_string(PREF_TIME_XMLCONSOLE);
+        time_pref = prefs_peek_string(PREF_TIME_XMLCONSOLE);
+        break;
+    case WIN_SEARCH:
+        time_pref = SEARCH_WIN_TIME_FORMAT;
         break;
     default:
-        time_pref = prefs_get_string(PREF_TIME_CONSOLE);
+        time_pref = prefs_peek_string(PREF_TIME_CONSOLE);
         break;
     }
 
-    gchar* date_fmt = NULL;
-    if (g_strcmp0(time_pref, "off") == 0 || time == NULL) {
-        date_fmt = g_strdup("");
-    } else {
-        date_fmt = g_date_time_format(time, time_pref);
+    char date_fmt[TIMEFMT_MAX] = "";
+    if (g_strcmp0(time_pref, "off") != 0 && time != NULL) {
+        timefmt_format(time, time_pref, date_fmt, sizeof(date_fmt));
     }
-    g_free(time_pref);
-    assert(date_fmt != NULL);
 
     if (strlen(date_fmt) != 0) {
         indent = 3 + strlen(date_fmt);
     }
 
     if ((flags & NO_DATE) == 0) {
-        if (date_fmt && strlen(date_fmt)) {
+        if (strlen(date_fmt)) {
             if ((flags & NO_COLOUR_DATE) == 0) {
                 wbkgdset(window->layout->win, theme_attrs(THEME_TIME));
                 wattron(window->layout->win, theme_attrs(THEME_TIME));
@@ -1576,19 +2025,18 @@ _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDat
             colour = theme_attrs(THEME_THEM);
         }
 
-        char* color_pref = prefs_get_string(PREF_COLOR_NICK);
+        const gchar* color_pref = prefs_peek_string(PREF_COLOR_NICK);
         if (color_pref != NULL && (strcmp(color_pref, "false") != 0)) {
             if (flags & NO_ME || (!(flags & NO_ME) && prefs_get_boolean(PREF_COLOR_NICK_OWN))) {
                 colour = theme_hash_attrs(from);
             }
         }
-        g_free(color_pref);
 
         if (flags & NO_COLOUR_FROM) {
             colour = 0;
         }
 
-        if (receipt && !receipt->received) {
+        if (receipt_pending) {
             colour = theme_attrs(THEME_RECEIPT_SENT);
         }
 
@@ -1605,7 +2053,7 @@ _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDat
     }
 
     if (!me_message) {
-        if (receipt && !receipt->received) {
+        if (receipt_pending) {
             wbkgdset(window->layout->win, theme_attrs(THEME_RECEIPT_SENT));
             wattron(window->layout->win, theme_attrs(THEME_RECEIPT_SENT));
         } else if (flags & UNTRUSTED) {
@@ -1618,7 +2066,9 @@ _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDat
     }
 
     if (prefs_get_boolean(PREF_WRAP)) {
-        _win_print_wrapped(window->layout->win, message + offset, indent, pad_indent);
+        _win_print_wrapped(window->layout->win, message + offset, indent, pad_indent, max_lines, wrap);
+    } else if (max_lines > 0) {
+        _win_print_collapsed(window->layout->win, message + offset, max_lines);
     } else {
         wprintw(window->layout->win, "%s", message + offset);
     }
@@ -1633,14 +2083,12 @@ _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDat
     if (me_message) {
         wattroff(window->layout->win, colour);
     } else {
-        if (receipt && !receipt->received) {
+        if (receipt_pending) {
             wattroff(window->layout->win, theme_attrs(THEME_RECEIPT_SENT));
         } else {
             wattroff(window->layout->win, theme_attrs(theme_item));
         }
     }
-
-    g_free(date_fmt);
 }
 
 static void
@@ -1651,120 +2099,90 @@ _win_indent(WINDOW* win, int size)
     }
 }
 
+// Line breaks are worked out once for a width and kept in cache when one
+// is given, printing then replays them in as few curses calls as it can.
+// Past max_lines the rest is neither laid out nor printed.
 static void
-_win_print_wrapped(WINDOW* win, const char* const message, size_t indent, int pad_indent)
+_win_print_wrapped(WINDOW* win, const char* const message, size_t indent, int pad_indent, int max_lines, Wrap** cache)
 {
-    int starty = getcury(win);
-    int wordi = 0;
-    char* word = malloc(strlen(message) + 1);
-
-    gchar* curr_ch = g_utf8_offset_to_pointer(message, 0);
-
-    while (*curr_ch != '\0') {
+    int startx = getcurx(win);
+    int width = getmaxx(win);
 
-        // handle space
-        if (*curr_ch == ' ') {
-            waddch(win, ' ');
-            curr_ch = g_utf8_next_char(curr_ch);
+    Wrap* wrap = cache ? *cache : NULL;
+    if (!wrap_matches(wrap, startx, width, indent, pad_indent, max_lines)) {
+        wrap_free(wrap);
+        wrap = wrap_layout(message, startx, width, indent, pad_indent, max_lines);
+        if (cache) {
+            *cache = wrap;
+        }
+    }
 
-            // handle newline
-        } else if (*curr_ch == '\n') {
+    int count;
+    const WrapRun* runs = wrap_runs(wrap, &count);
+    for (int i = 0; i < count; i++) {
+        switch (runs[i].type) {
+        case WRAP_TEXT:
+            waddnstr(win, message + runs[i].start, runs[i].len);
+            break;
+        case WRAP_INDENT:
+            _win_indent(win, runs[i].len);
+            break;
+        case WRAP_NEWLINE:
             waddch(win, '\n');
-            _win_indent(win, indent + pad_indent);
-            curr_ch = g_utf8_next_char(curr_ch);
+            break;
+        }
+    }
 
-            // handle word
-        } else {
-            wordi = 0;
-            int wordlen = 0;
-            while (*curr_ch != ' ' && *curr_ch != '\n' && *curr_ch != '\0') {
-                size_t ch_len = mbrlen(curr_ch, MB_CUR_MAX, NULL);
-                if ((ch_len == (size_t)-2) || (ch_len == (size_t)-1)) {
-                    curr_ch++;
-                    continue;
-                }
-                int offset = 0;
-                while (offset < ch_len) {
-                    word[wordi++] = curr_ch[offset++];
-                }
-                curr_ch = g_utf8_next_char(curr_ch);
-            }
-            word[wordi] = '\0';
-            wordlen = utf8_display_len(word);
-
-            int curx = getcurx(win);
-            int cury;
-            int maxx = getmaxx(win);
-
-            // wrap required
-            if (curx + wordlen > maxx) {
-                int linelen = maxx - (indent + pad_indent);
-
-                // word larger than line
-                if (wordlen > linelen) {
-                    gchar* word_ch = g_utf8_offset_to_pointer(word, 0);
-                    while (*word_ch != '\0') {
-                        curx = getcurx(win);
-                        cury = getcury(win);
-                        gboolean firstline = cury == starty;
-
-                        if (firstline && curx < indent) {
-                            _win_indent(win, indent);
-                        }
-                        if (!firstline && curx < (indent + pad_indent)) {
-                            _win_indent(win, indent + pad_indent);
-                        }
-
-                        gchar copy[wordi + 1];
-                        g_utf8_strncpy(copy, word_ch, 1);
-                        waddstr(win, copy);
-
-                        word_ch = g_utf8_next_char(word_ch);
-                    }
+    _win_print_hidden(win, wrap_hidden(wrap), indent + pad_indent);
 
-                    // newline and print word
-                } else {
-                    waddch(win, '\n');
-                    curx = getcurx(win);
-                    cury = getcury(win);
-                    gboolean firstline = cury == starty;
+    if (!cache) {
+        wrap_free(wrap);
+    }
+}
 
-                    if (firstline && curx < indent) {
-                        _win_indent(win, indent);
-                    }
-                    if (!firstline && curx < (indent + pad_indent)) {
-                        _win_indent(win, indent + pad_indent);
-                    }
-                    waddstr(win, word);
-                }
+// Unwrapped, lines are only counted at the newlines of the message
+static void
+_win_print_collapsed(WINDOW* win, const char* const message, int max_lines)
+{
+    const char* end = message;
+    for (int i = 0; i < max_lines && end; i++) {
+        end = strchr(end, '\n');
+        if (end) {
+            end++;
+        }
+    }
 
-                // no wrap required
-            } else {
-                curx = getcurx(win);
-                cury = getcury(win);
-                gboolean firstline = cury == starty;
+    if (!end || *end == '\0') {
+        wprintw(win, "%s", message);
+        return;
+    }
 
-                if (firstline && curx < indent) {
-                    _win_indent(win, indent);
-                }
-                if (!firstline && curx < (indent + pad_indent)) {
-                    _win_indent(win, indent + pad_indent);
-                }
-                waddstr(win, word);
-            }
+    int hidden = 1;
+    for (const char* c = strchr(end, '\n'); c; c = strchr(c + 1, '\n')) {
+        if (c[1] != '\0') {
+            hidden++;
         }
+    }
 
-        // consume first space of next line
-        int curx = getcurx(win);
-        int cury = getcury(win);
-        gboolean firstline = (cury == starty);
+    waddnstr(win, message, end - message);
+    _win_print_hidden(win, hidden, 0);
+}
 
-        if (!firstline && curx == 0 && *curr_ch == ' ') {
-            curr_ch = g_utf8_next_char(curr_ch);
-        }
+static void
+_win_print_hidden(WINDOW* win, int hidden, int indent)
+{
+    if (hidden <= 0) {
+        return;
     }
 
-    free(word);
+    // the layout may have stopped at the indent of the next line already
+    int curx = getcurx(win);
+    if (curx > indent) {
+        waddch(win, '\n');
+        curx = 0;
+    }
+    _win_indent(win, indent - curx);
+    wprintw(win, "[+%d lines]", hidden);
 }
 
 void
@@ -1772,6 +2190,9 @@ win_print_trackbar(ProfWin* window)
 {
     int cols = getmaxx(window->layout->win);
 
+    ui_mark_dirty(UI_DIRTY_WINDOW);
+    win_pad_reserve(window->layout->win, 2);
+
     wbkgdset(window->layout->win, theme_attrs(THEME_TRACKBAR));
     wattron(window->layout->win, theme_attrs(THEME_TRACKBAR));
 
@@ -1782,24 +2203,147 @@ win_print_trackbar(ProfWin* window)
     wattroff(window->layout->win, theme_attrs(THEME_TRACKBAR));
 }
 
-void
-win_redraw(ProfWin* window)
+static void
+_win_render_entry(ProfWin* window, ProfBuffEntry* e)
+{
+    int before = getcury(window->layout->win);
+
+    if (e->display_from == NULL && e->message && e->message[0] == '-') {
+        // just an indicator to print the trackbar/separator not the actual message
+        win_print_trackbar(window);
+    } else {
+        // regular thing to print
+        GDateTime* time = buffer_entry_time(e);
+        _win_print_internal(window, e->show_char, e->pad_indent, time, e->flags, e->theme_item, e->display_from, e->message, e->receipt && !e->received, &e->wrap);
+        g_date_time_unref(time);
+    }
+
+    // once the pad scrolls the cursor no longer tells how much was printed
+    int after = getcury(window->layout->win);
+    if (after < getmaxy(window->layout->win) - 1) {
+        e->lines = after - before;
+        e->lines_width = getmaxx(window->layout->win);
+    } else {
+        e->lines_width = -1;
+    }
+}
+
+static void
+_win_redraw_all(ProfWin* window)
 {
     int size;
     werase(window->layout->win);
     size = buffer_size(window->layout->buffer);
 
     for (int i = 0; i < size; i++) {
-        ProfBuffEntry* e = buffer_get_entry(window->layout->buffer, i);
+        _win_render_entry(window, buffer_get_entry(window->layout->buffer, i));
+    }
+
+    window->layout->partial = FALSE;
+    window->layout->stale = FALSE;
+}
+
+// Render only the newest entries needed to fill the screen. Heights cached
+// at the current width are used to find the first one, unknown heights
+// count as the least they can be so the screen is always covered.
+static gboolean
+_win_redraw_viewport(ProfWin* window)
+{
+    ProfBuff buffer = window->layout->buffer;
+    int size = buffer_size(buffer);
+    int cols = getmaxx(window->layout->win);
+    int page = getmaxy(stdscr) - 3;
+    int lines = 0;
+    int first = size;
+
+    while (first > 0 && lines < page) {
+        first--;
+        ProfBuffEntry* e = buffer_get_entry(buffer, first);
+        if (e->lines_width == cols) {
+            lines += e->lines;
+        } else if ((e->flags & NO_EOL) == 0) {
+            lines++;
+        }
+    }
+
+    // the whole buffer is needed anyway
+    if (first == 0) {
+        return FALSE;
+    }
+
+    werase(window->layout->win);
+    for (int i = first; i < size; i++) {
+        _win_render_entry(window, buffer_get_entry(buffer, i));
+    }
+
+    if (getcury(window->layout->win) < page) {
+        return FALSE;
+    }
+
+    window->layout->partial = TRUE;
+    window->layout->stale = FALSE;
+
+    return TRUE;
+}
+
+void
+win_redraw(ProfWin* window)
+{
+    if (window->layout->hibernated) {
+        window->layout->stale = TRUE;
+        return;
+    }
+
+    gint64 started = perf_start();
+
+    // keep the scroll position intact when the user paged up
+    if (window->layout->paged || !_win_redraw_viewport(window)) {
+        _win_redraw_all(window);
+    }
+
+    perf_stop(PERF_REDRAW, started);
+}
+
+// Expands the collapsed messages of the window, returns how many there were
+int
+win_expand(ProfWin* window)
+{
+    int max_lines = prefs_get_collapse_lines();
+    if (max_lines == 0) {
+        return 0;
+    }
+
+    int expanded = 0;
+    ProfBuff buffer = window->layout->buffer;
+    int size = buffer_size(buffer);
+    for (int i = 0; i < size; i++) {
+        ProfBuffEntry* e = buffer_get_entry(buffer, i);
+        if (e->flags & EXPANDED) {
+            continue;
+        }
 
-        if (e->display_from == NULL && e->message && e->message[0] == '-') {
-            // just an indicator to print the trackbar/separator not the actual message
-            win_print_trackbar(window);
+        // not laid out since it was printed, it may have been collapsed
+        gboolean collapsed;
+        if (e->wrap) {
+            collapsed = wrap_hidden(e->wrap) > 0;
         } else {
-            // regular thing to print
-            _win_print_internal(window, e->show_char, e->pad_indent, e->time, e->flags, e->theme_item, e->display_from, e->message, e->receipt);
+            collapsed = _win_message_lines(window->layout->win, e->message) > max_lines;
+        }
+
+        if (collapsed) {
+            e->flags |= EXPANDED;
+            wrap_free(e->wrap);
+            e->wrap = NULL;
+            e->lines_width = -1;
+            expanded++;
         }
     }
+
+    if (expanded > 0) {
+        win_redraw(window);
+    }
+
+    return expanded;
 }
 
 gboolean
@@ -1893,11 +2437,13 @@ win_toggle_attention(ProfWin* window)
         ProfChatWin* chatwin = (ProfChatWin*)window;
         assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
         chatwin->has_attention = !chatwin->has_attention;
+        wins_attention_changed(window);
         return chatwin->has_attention;
     } else if (window->type == WIN_MUC) {
         ProfMucWin* mucwin = (ProfMucWin*)window;
         assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
         mucwin->has_attention = !mucwin->has_attention;
+        wins_attention_changed(window);
         return mucwin->has_attention;
     }
     return FALSE;
@@ -1910,8 +2456,11 @@ win_sub_print(WINDOW* win, char* msg, gboolean newline, gboolean wrap, int inden
     int curx = getcurx(win);
     int cury = getcury(win);
 
+    ui_mark_dirty(UI_DIRTY_WINDOW);
+    win_pad_reserve(win, wrap ? (int)(strlen(msg) / MAX(maxx / 2, 1)) + 2 : 2);
+
     if (wrap) {
-        _win_print_wrapped(win, msg, 1, indent);
+        _win_print_wrapped(win, msg, 1, indent, 0, NULL);
     } else {
         waddnstr(win, msg, maxx - curx);
     }
@@ -1931,6 +2480,7 @@ win_sub_newline_lazy(WINDOW* win)
     }
     curx = getcurx(win);
     if (curx > 0) {
+        win_pad_reserve(win, 1);
         int cury = getcury(win);
         wmove(win, cury + 1, 0);
     }
@@ -1996,18 +2546,9 @@ win_handle_command_exec_result_note(ProfWin* window, const char* const type, con
 void
 win_insert_last_read_position_marker(ProfWin* window, char* id)
 {
-    int size;
-    size = buffer_size(window->layout->buffer);
-
-    // TODO: this is somewhat costly. We should improve this later.
-    // check if we already have a separator present
-    for (int i = 0; i < size; i++) {
-        ProfBuffEntry* e = buffer_get_entry(window->layout->buffer, i);
-
-        // if yes, don't print a new one
-        if (e->id && (g_strcmp0(e->id, id) == 0)) {
-            return;
-        }
+    // check if we already have a separator present, if yes, don't print a new one
+    if (buffer_contains_id(window->layout->buffer, id)) {
+        return;
     }
 
     GDateTime* time = g_date_time_new_now_local();
@@ -2015,7 +2556,7 @@ win_insert_last_read_position_marker(ProfWin* window, char* id)
     // the trackbar/separator will actually be print in win_redraw().
     // this only puts it in the buffer and win_redraw() will interpret it.
     // so that we have the correct length even when resizing.
-    buffer_append(window->layout->buffer, " ", 0, time, 0, THEME_TEXT, NULL, NULL, "-", NULL, id);
+    buffer_append(window->layout->buffer, " ", 0, time, 0, THEME_TEXT, NULL, NULL, "-", FALSE, id);
     win_redraw(window);
 
     g_date_time_unref(time);
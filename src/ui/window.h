@@ -56,7 +56,9 @@
 #include "xmpp/contact.h"
 #include "xmpp/muc.h"
 
-#define PAD_SIZE 1000
+// pads start at PAD_MIN_SIZE rows and double as they fill, up to PAD_SIZE
+#define PAD_SIZE     1000
+#define PAD_MIN_SIZE 64
 
 void win_move_to_end(ProfWin* window);
 void win_show_status_string(ProfWin* window, const char* const from,
@@ -69,18 +71,26 @@ void win_print_incoming(ProfWin* window, const char* const from, ProfMessage* me
 void win_print_outgoing(ProfWin* window, const char* show_char, const char* const id, const char* const replace_id, const char* const message);
 void win_print_outgoing_with_receipt(ProfWin* window, const char* show_char, const char* const from, const char* const message, char* id, const char* const replace_id);
 void win_println_incoming_muc_msg(ProfWin* window, char* show_char, int flags, const ProfMessage* const message);
+void win_append_incoming_muc_msg(ProfWin* window, char* show_char, int flags, const ProfMessage* const message);
 void win_print_outgoing_muc_msg(ProfWin* window, char* show_char, const char* const me, const char* const id, const char* const replace_id, const char* const message);
 void win_print_history(ProfWin* window, const ProfMessage* const message);
+int win_prepend_history(ProfWin* window, GSList* history);
+void win_reload_history(ProfWin* window, GSList* history);
+void win_print_placeholder(ProfWin* window, const char* const id, const char* const message);
+void win_print_search_result(ProfWin* window, const ProfMessage* const message);
 
 void win_print_http_transfer(ProfWin* window, const char* const message, char* url);
 
 void win_newline(ProfWin* window);
 void win_redraw(ProfWin* window);
+int win_expand(ProfWin* window);
 int win_roster_cols(void);
 int win_occpuants_cols(void);
 void win_sub_print(WINDOW* win, char* msg, gboolean newline, gboolean wrap, int indent);
 void win_sub_newline_lazy(WINDOW* win);
+void win_pad_reserve(WINDOW* pad, int lines);
 void win_mark_received(ProfWin* window, const char* const id);
+void win_mark_received_upto(ProfWin* window, const char* const id);
 void win_update_entry_message(ProfWin* window, const char* const id, const char* const message);
 
 gboolean win_has_active_subwin(ProfWin* window);
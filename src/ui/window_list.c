@@ -43,14 +43,18 @@
 #include <glib.h>
 
 #include "common.h"
+#include "log.h"
 #include "config/preferences.h"
 #include "config/theme.h"
 #include "plugins/plugins.h"
 #include "ui/ui.h"
+#include "ui/tray.h"
 #include "ui/window_list.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/roster_list.h"
 #include "tools/http_upload.h"
+#include "tools/scheduler.h"
+#include "tools/workers.h"
 
 #ifdef HAVE_OMEMO
 #include "omemo/omemo.h"
@@ -58,16 +62,46 @@
 
 static GHashTable* windows;
 static int current;
+// lookup indexes by jid or tag, values are borrowed from windows
+static GHashTable* chat_index;
+static GHashTable* muc_index;
+static GHashTable* conf_index;
+static GHashTable* private_index;
+static GHashTable* plugin_index;
 static Autocomplete wins_ac;
 static Autocomplete wins_close_ac;
+static SchedulerTask* hibernate_task;
+// sum of the unread counts of all windows
+static int total_unread = 0;
+// windows with unread messages, most recent activity first, and the ones
+// marked for attention, most recently marked first. The tables map each
+// window to its link, so it moves or leaves without a search.
+static GQueue unread_queue = G_QUEUE_INIT;
+static GHashTable* unread_links;
+static GQueue attention_queue = G_QUEUE_INIT;
+static GHashTable* attention_links;
+
+#define WINS_HIBERNATE_CHECK_MS 60000
 
 static int _wins_cmp_num(gconstpointer a, gconstpointer b);
 static int _wins_get_next_available_num(GList* used);
+static void _wins_index_add(GHashTable* index, const char* const key, ProfWin* window);
+static void _wins_index_remove(GHashTable* index, const char* const key, ProfWin* window);
+static gboolean _wins_hibernate_check(void* data);
+static void _wins_activity_touch(GQueue* queue, GHashTable* links, ProfWin* window);
+static void _wins_activity_drop(GQueue* queue, GHashTable* links, ProfWin* window);
 
 void
 wins_init(void)
 {
     windows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)win_free);
+    chat_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    muc_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    conf_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    private_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    plugin_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    unread_links = g_hash_table_new(g_direct_hash, g_direct_equal);
+    attention_links = g_hash_table_new(g_direct_hash, g_direct_equal);
 
     ProfWin* console = win_create_console();
     g_hash_table_insert(windows, GINT_TO_POINTER(1), console);
@@ -80,6 +114,8 @@ wins_init(void)
     wins_close_ac = autocomplete_new();
     autocomplete_add(wins_close_ac, "all");
     autocomplete_add(wins_close_ac, "read");
+
+    hibernate_task = scheduler_add(WINS_HIBERNATE_CHECK_MS, _wins_hibernate_check, NULL, NULL);
 }
 
 ProfWin*
@@ -98,23 +134,11 @@ wins_chat_exists(const char* const barejid)
 ProfChatWin*
 wins_get_chat(const char* const barejid)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (window->type == WIN_CHAT) {
-            ProfChatWin* chatwin = (ProfChatWin*)window;
-            if (g_strcmp0(chatwin->barejid, barejid) == 0) {
-                g_list_free(values);
-                return chatwin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (barejid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(chat_index, barejid);
 }
 
 static gint
@@ -149,89 +173,41 @@ wins_get_chat_unsubscribed(void)
 ProfConfWin*
 wins_get_conf(const char* const roomjid)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (window->type == WIN_CONFIG) {
-            ProfConfWin* confwin = (ProfConfWin*)window;
-            if (g_strcmp0(confwin->roomjid, roomjid) == 0) {
-                g_list_free(values);
-                return confwin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (roomjid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(conf_index, roomjid);
 }
 
 ProfMucWin*
 wins_get_muc(const char* const roomjid)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (window->type == WIN_MUC) {
-            ProfMucWin* mucwin = (ProfMucWin*)window;
-            if (g_strcmp0(mucwin->roomjid, roomjid) == 0) {
-                g_list_free(values);
-                return mucwin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (roomjid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(muc_index, roomjid);
 }
 
 ProfPrivateWin*
 wins_get_private(const char* const fulljid)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (window->type == WIN_PRIVATE) {
-            ProfPrivateWin* privatewin = (ProfPrivateWin*)window;
-            if (g_strcmp0(privatewin->fulljid, fulljid) == 0) {
-                g_list_free(values);
-                return privatewin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (fulljid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(private_index, fulljid);
 }
 
 ProfPluginWin*
 wins_get_plugin(const char* const tag)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (window->type == WIN_PLUGIN) {
-            ProfPluginWin* pluginwin = (ProfPluginWin*)window;
-            if (g_strcmp0(pluginwin->tag, tag) == 0) {
-                g_list_free(values);
-                return pluginwin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (tag == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(plugin_index, tag);
 }
 
 void
@@ -280,10 +256,12 @@ wins_private_nick_change(const char* const roomjid, const char* const oldnick, c
 
     ProfPrivateWin* privwin = wins_get_private(oldjid->fulljid);
     if (privwin) {
+        _wins_index_remove(private_index, privwin->fulljid, (ProfWin*)privwin);
         free(privwin->fulljid);
 
         Jid* newjid = jid_create_from_bare_and_resource(roomjid, newnick);
         privwin->fulljid = strdup(newjid->fulljid);
+        _wins_index_add(private_index, privwin->fulljid, (ProfWin*)privwin);
         win_println((ProfWin*)privwin, THEME_THEM, "!", "** %s is now known as %s.", oldjid->resourcepart, newjid->resourcepart);
 
         autocomplete_remove(wins_ac, oldjid->fulljid);
@@ -344,7 +322,15 @@ wins_set_current_by_num(int i)
 {
     ProfWin* window = g_hash_table_lookup(windows, GINT_TO_POINTER(i));
     if (window) {
+        ProfWin* previous = g_hash_table_lookup(windows, GINT_TO_POINTER(current));
+        if (previous) {
+            previous->layout->last_shown = g_get_monotonic_time();
+        }
         current = i;
+        window->layout->last_shown = g_get_monotonic_time();
+        win_wake(window);
+        ui_mark_dirty(UI_DIRTY_ALL);
+        int unread = win_unread(window);
         if (window->type == WIN_CHAT) {
             ProfChatWin* chatwin = (ProfChatWin*)window;
             assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
@@ -360,7 +346,10 @@ wins_set_current_by_num(int i)
         } else if (window->type == WIN_PRIVATE) {
             ProfPrivateWin* privatewin = (ProfPrivateWin*)window;
             privatewin->unread = 0;
+        } else if (window->type == WIN_XML) {
+            xmlwin_refresh((ProfXMLWin*)window);
         }
+        wins_unread_changed(window, -unread);
 
         // if we switched to console
         if (current == 0) {
@@ -398,6 +387,11 @@ wins_get_by_string(const char* str)
         return (ProfWin*)xmlwin;
     }
 
+    if (g_strcmp0(str, "search") == 0) {
+        ProfSearchWin* searchwin = wins_get_search();
+        return (ProfWin*)searchwin;
+    }
+
     ProfChatWin* chatwin = wins_get_chat(str);
     if (chatwin) {
         return (ProfWin*)chatwin;
@@ -532,13 +526,18 @@ wins_close_by_num(int i)
 
         ProfWin* window = wins_get_by_num(i);
         if (window) {
-            // cancel upload processes of this window
+            wins_unread_changed(window, -win_unread(window));
+            _wins_activity_drop(&attention_queue, attention_links, window);
+
+            // cancel the background jobs and the queued uploads of this window
+            workers_cancel_window(window);
             http_upload_cancel_processes(window);
 
             switch (window->type) {
             case WIN_CHAT:
             {
                 ProfChatWin* chatwin = (ProfChatWin*)window;
+                _wins_index_remove(chat_index, chatwin->barejid, window);
                 autocomplete_remove(wins_ac, chatwin->barejid);
                 autocomplete_remove(wins_close_ac, chatwin->barejid);
 
@@ -553,27 +552,26 @@ wins_close_by_num(int i)
                         }
                     }
                 }
-                autocomplete_free(window->urls_ac);
+                url_ring_free(window->urls);
                 break;
             }
             case WIN_MUC:
             {
                 ProfMucWin* mucwin = (ProfMucWin*)window;
+                _wins_index_remove(muc_index, mucwin->roomjid, window);
                 autocomplete_remove(wins_ac, mucwin->roomjid);
                 autocomplete_remove(wins_close_ac, mucwin->roomjid);
 
-                if (mucwin->last_msg_timestamp) {
-                    g_date_time_unref(mucwin->last_msg_timestamp);
-                }
-                autocomplete_free(window->urls_ac);
+                url_ring_free(window->urls);
                 break;
             }
             case WIN_PRIVATE:
             {
                 ProfPrivateWin* privwin = (ProfPrivateWin*)window;
+                _wins_index_remove(private_index, privwin->fulljid, window);
                 autocomplete_remove(wins_ac, privwin->fulljid);
                 autocomplete_remove(wins_close_ac, privwin->fulljid);
-                autocomplete_free(window->urls_ac);
+                url_ring_free(window->urls);
                 break;
             }
             case WIN_XML:
@@ -582,15 +580,27 @@ wins_close_by_num(int i)
                 autocomplete_remove(wins_close_ac, "xmlconsole");
                 break;
             }
+            case WIN_SEARCH:
+            {
+                autocomplete_remove(wins_ac, "search");
+                autocomplete_remove(wins_close_ac, "search");
+                break;
+            }
             case WIN_PLUGIN:
             {
                 ProfPluginWin* pluginwin = (ProfPluginWin*)window;
+                _wins_index_remove(plugin_index, pluginwin->tag, window);
                 plugins_close_win(pluginwin->plugin_name, pluginwin->tag);
                 autocomplete_remove(wins_ac, pluginwin->tag);
                 autocomplete_remove(wins_close_ac, pluginwin->tag);
                 break;
             }
             case WIN_CONFIG:
+            {
+                ProfConfWin* confwin = (ProfConfWin*)window;
+                _wins_index_remove(conf_index, confwin->roomjid, window);
+                break;
+            }
             default:
                 break;
             }
@@ -626,6 +636,19 @@ wins_new_xmlconsole(void)
     return newwin;
 }
 
+ProfWin*
+wins_new_search(void)
+{
+    GList* keys = g_hash_table_get_keys(windows);
+    int result = _wins_get_next_available_num(keys);
+    g_list_free(keys);
+    ProfWin* newwin = win_create_search();
+    g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    autocomplete_add(wins_ac, "search");
+    autocomplete_add(wins_close_ac, "search");
+    return newwin;
+}
+
 ProfWin*
 wins_new_chat(const char* const barejid)
 {
@@ -634,6 +657,7 @@ wins_new_chat(const char* const barejid)
     g_list_free(keys);
     ProfWin* newwin = win_create_chat(barejid);
     g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_index_add(chat_index, barejid, newwin);
 
     autocomplete_add(wins_ac, barejid);
     autocomplete_add(wins_close_ac, barejid);
@@ -645,7 +669,7 @@ wins_new_chat(const char* const barejid)
             autocomplete_add(wins_close_ac, nick);
         }
     }
-    newwin->urls_ac = autocomplete_new();
+    newwin->urls = url_ring_new();
 
     return newwin;
 }
@@ -658,9 +682,10 @@ wins_new_muc(const char* const roomjid)
     g_list_free(keys);
     ProfWin* newwin = win_create_muc(roomjid);
     g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_index_add(muc_index, roomjid, newwin);
     autocomplete_add(wins_ac, roomjid);
     autocomplete_add(wins_close_ac, roomjid);
-    newwin->urls_ac = autocomplete_new();
+    newwin->urls = url_ring_new();
 
     return newwin;
 }
@@ -673,6 +698,7 @@ wins_new_config(const char* const roomjid, DataForm* form, ProfConfWinCallback s
     g_list_free(keys);
     ProfWin* newwin = win_create_config(roomjid, form, submit, cancel, userdata);
     g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_index_add(conf_index, roomjid, newwin);
 
     return newwin;
 }
@@ -685,9 +711,10 @@ wins_new_private(const char* const fulljid)
     g_list_free(keys);
     ProfWin* newwin = win_create_private(fulljid);
     g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_index_add(private_index, fulljid, newwin);
     autocomplete_add(wins_ac, fulljid);
     autocomplete_add(wins_close_ac, fulljid);
-    newwin->urls_ac = autocomplete_new();
+    newwin->urls = url_ring_new();
 
     return newwin;
 }
@@ -700,43 +727,63 @@ wins_new_plugin(const char* const plugin_name, const char* const tag)
     g_list_free(keys);
     ProfWin* newwin = win_create_plugin(plugin_name, tag);
     g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_index_add(plugin_index, tag, newwin);
     autocomplete_add(wins_ac, tag);
     autocomplete_add(wins_close_ac, tag);
     return newwin;
 }
 
+// only windows with unread messages have anything to remind of
 gboolean
 wins_do_notify_remind(void)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (win_notify_remind(window)) {
-            g_list_free(values);
+    for (GList* curr = unread_queue.head; curr; curr = g_list_next(curr)) {
+        if (win_notify_remind(curr->data)) {
             return TRUE;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
+
     return FALSE;
 }
 
 int
 wins_get_total_unread(void)
 {
-    int result = 0;
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
+    return total_unread;
+}
 
-    while (curr) {
-        ProfWin* window = curr->data;
-        result += win_unread(window);
-        curr = g_list_next(curr);
+// Windows report every change to their unread count so the total needn't
+// be summed up over all windows, a rise is activity, a fall means read
+void
+wins_unread_changed(ProfWin* window, int delta)
+{
+    if (delta == 0) {
+        return;
+    }
+
+    if (delta > 0) {
+        _wins_activity_touch(&unread_queue, unread_links, window);
+    } else {
+        _wins_activity_drop(&unread_queue, unread_links, window);
+    }
+
+    gboolean had_unread = total_unread > 0;
+    total_unread += delta;
+    if (had_unread != (total_unread > 0)) {
+#ifdef HAVE_GTK
+        tray_unread_changed();
+#endif
+    }
+}
+
+void
+wins_attention_changed(ProfWin* window)
+{
+    if (win_has_attention(window)) {
+        _wins_activity_touch(&attention_queue, attention_links, window);
+    } else {
+        _wins_activity_drop(&attention_queue, attention_links, window);
     }
-    g_list_free(values);
-    return result;
 }
 
 void
@@ -755,6 +802,18 @@ wins_resize_all(void)
     win_update_virtual(current_win);
 }
 
+// Every window is redrawn the next time it is shown
+void
+wins_mark_stale(void)
+{
+    GList* values = g_hash_table_get_values(windows);
+    for (GList* curr = values; curr; curr = g_list_next(curr)) {
+        ProfWin* window = curr->data;
+        window->layout->stale = TRUE;
+    }
+    g_list_free(values);
+}
+
 void
 wins_hide_subwin(ProfWin* window)
 {
@@ -799,6 +858,27 @@ wins_get_xmlconsole(void)
     return NULL;
 }
 
+ProfSearchWin*
+wins_get_search(void)
+{
+    GList* values = g_hash_table_get_values(windows);
+    GList* curr = values;
+
+    while (curr) {
+        ProfWin* window = curr->data;
+        if (window->type == WIN_SEARCH) {
+            ProfSearchWin* searchwin = (ProfSearchWin*)window;
+            assert(searchwin->memcheck == PROFSEARCHWIN_MEMCHECK);
+            g_list_free(values);
+            return searchwin;
+        }
+        curr = g_list_next(curr);
+    }
+
+    g_list_free(values);
+    return NULL;
+}
+
 GSList*
 wins_get_chat_recipients(void)
 {
@@ -949,6 +1029,62 @@ wins_swap(int source_win, int target_win)
     }
 }
 
+static GHashTable*
+_wins_index_for(ProfWin* window, const char** key)
+{
+    switch (window->type) {
+    case WIN_CHAT:
+        *key = ((ProfChatWin*)window)->barejid;
+        return chat_index;
+    case WIN_MUC:
+        *key = ((ProfMucWin*)window)->roomjid;
+        return muc_index;
+    case WIN_CONFIG:
+        *key = ((ProfConfWin*)window)->roomjid;
+        return conf_index;
+    case WIN_PRIVATE:
+        *key = ((ProfPrivateWin*)window)->fulljid;
+        return private_index;
+    case WIN_PLUGIN:
+        *key = ((ProfPluginWin*)window)->tag;
+        return plugin_index;
+    default:
+        *key = NULL;
+        return NULL;
+    }
+}
+
+static void
+_wins_index_add(GHashTable* index, const char* const key, ProfWin* window)
+{
+    if (key) {
+        g_hash_table_insert(index, g_strdup(key), window);
+    }
+}
+
+static void
+_wins_index_remove(GHashTable* index, const char* const key, ProfWin* window)
+{
+    if (key == NULL || g_hash_table_lookup(index, key) != window) {
+        return;
+    }
+
+    g_hash_table_remove(index, key);
+
+    // another window may have been opened for the same jid, keep it reachable
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, windows);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        ProfWin* other = value;
+        const char* other_key = NULL;
+        if (other != window && _wins_index_for(other, &other_key) == index && g_strcmp0(other_key, key) == 0) {
+            _wins_index_add(index, key, other);
+            return;
+        }
+    }
+}
+
 static int
 _wins_cmp_num(gconstpointer a, gconstpointer b)
 {
@@ -1099,7 +1235,7 @@ wins_create_summary(gboolean unread)
 
     while (curr) {
         ProfWin* window = g_hash_table_lookup(windows, curr->data);
-        if (!unread || (unread && win_unread(window) > 0)) {
+        if (!unread || g_hash_table_contains(unread_links, window)) {
             GString* line = g_string_new("");
 
             int ui_index = GPOINTER_TO_INT(curr->data);
@@ -1128,6 +1264,9 @@ GSList*
 wins_create_summary_attention()
 {
     GSList* result = NULL;
+    if (g_queue_is_empty(&attention_queue)) {
+        return NULL;
+    }
 
     GList* keys = g_hash_table_get_keys(windows);
     keys = g_list_sort(keys, _wins_cmp_num);
@@ -1135,17 +1274,7 @@ wins_create_summary_attention()
 
     while (curr) {
         ProfWin* window = g_hash_table_lookup(windows, curr->data);
-        gboolean has_attention = FALSE;
-        if (window->type == WIN_CHAT) {
-            ProfChatWin* chatwin = (ProfChatWin*)window;
-            assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
-            has_attention = chatwin->has_attention;
-        } else if (window->type == WIN_MUC) {
-            ProfMucWin* mucwin = (ProfMucWin*)window;
-            assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
-            has_attention = mucwin->has_attention;
-        }
-        if (has_attention) {
+        if (g_hash_table_contains(attention_links, window)) {
             GString* line = g_string_new("");
 
             int ui_index = GPOINTER_TO_INT(curr->data);
@@ -1196,113 +1325,176 @@ win_close_reset_search_attempts(void)
 void
 wins_destroy(void)
 {
+    scheduler_remove(hibernate_task);
+    hibernate_task = NULL;
+    g_hash_table_destroy(chat_index);
+    g_hash_table_destroy(muc_index);
+    g_hash_table_destroy(conf_index);
+    g_hash_table_destroy(private_index);
+    g_hash_table_destroy(plugin_index);
     g_hash_table_destroy(windows);
     autocomplete_free(wins_ac);
     autocomplete_free(wins_close_ac);
+    total_unread = 0;
+    g_queue_clear(&unread_queue);
+    g_hash_table_destroy(unread_links);
+    g_queue_clear(&attention_queue);
+    g_hash_table_destroy(attention_links);
 }
 
+// the window with the most recent unread activity
 ProfWin*
 wins_get_next_unread(void)
 {
-    // get and sort win nums
-    GList* values = g_hash_table_get_keys(windows);
-    values = g_list_sort(values, _wins_cmp_num);
-    GList* curr = values;
+    return unread_queue.head ? unread_queue.head->data : NULL;
+}
 
-    while (curr) {
-        int curr_win_num = GPOINTER_TO_INT(curr->data);
-        ProfWin* window = wins_get_by_num(curr_win_num);
+// The window marked after the current one, or the most recently marked
+// one, NULL when the current one is the only one
+ProfWin*
+wins_get_next_attention(void)
+{
+    if (g_queue_is_empty(&attention_queue)) {
+        return NULL;
+    }
 
-        // test if window has unread messages
-        if (win_unread(window) > 0) {
-            g_list_free(values);
-            return window;
-        }
+    GList* link = g_hash_table_lookup(attention_links, wins_get_current());
+    if (!link) {
+        return attention_queue.head->data;
+    }
+    if (link->next) {
+        return link->next->data;
+    }
 
-        curr = g_list_next(curr);
+    return attention_queue.head != link ? attention_queue.head->data : NULL;
+}
+
+static void
+_wins_activity_touch(GQueue* queue, GHashTable* links, ProfWin* window)
+{
+    GList* link = g_hash_table_lookup(links, window);
+    if (link) {
+        g_queue_unlink(queue, link);
+    } else {
+        link = g_list_alloc();
+        link->data = window;
+        g_hash_table_insert(links, window, link);
     }
+    g_queue_push_head_link(queue, link);
+}
 
-    g_list_free(values);
-    return NULL;
+static void
+_wins_activity_drop(GQueue* queue, GHashTable* links, ProfWin* window)
+{
+    GList* link = g_hash_table_lookup(links, window);
+    if (link) {
+        g_queue_delete_link(queue, link);
+        g_hash_table_remove(links, window);
+    }
 }
 
-ProfWin*
-wins_get_next_attention(void)
+void
+wins_add_urls_ac(const ProfWin* const win, const ProfMessage* const message)
 {
-    // get and sort win nums
-    GList* values = g_hash_table_get_values(windows);
-    values = g_list_sort(values, _wins_cmp_num);
-    GList* curr = values;
+    url_ring_add_from(win->urls, message->plain);
+}
 
-    ProfWin* current_window = wins_get_by_num(current);
+char*
+wins_get_url(const char* const search_str, gboolean previous, void* context)
+{
+    ProfWin* win = (ProfWin*)context;
 
-    // search the current window
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (current_window == window) {
-            current_window = window;
-            curr = g_list_next(curr);
-            break;
-        }
-        curr = g_list_next(curr);
+    return url_ring_complete(win->urls, search_str, previous);
+}
+
+static gint
+_wins_cmp_last_shown(gconstpointer a, gconstpointer b)
+{
+    const ProfWin* first = a;
+    const ProfWin* second = b;
+
+    if (first->layout->last_shown < second->layout->last_shown) {
+        return -1;
     }
 
-    // Start from current window
-    while (current_window && curr) {
+    return first->layout->last_shown > second->layout->last_shown ? 1 : 0;
+}
+
+// Windows not shown for the hibernate time hibernate, then the least recently
+// shown ones until all windows fit the memory budget. The console and the
+// current window are never hibernated. Returns how many were hibernated.
+int
+wins_hibernate_idle(gboolean all)
+{
+    gint64 idle_us = (gint64)prefs_get_wins_hibernate() * 60 * G_USEC_PER_SEC;
+    gsize budget = (gsize)prefs_get_wins_memory() * 1024 * 1024;
+    gint64 now = g_get_monotonic_time();
+    GList* awake = NULL;
+    gsize used = 0;
+    int hibernated = 0;
+
+    GList* values = g_hash_table_get_values(windows);
+    for (GList* curr = values; curr; curr = g_list_next(curr)) {
         ProfWin* window = curr->data;
-        if (win_has_attention(window)) {
-            g_list_free(values);
-            return window;
+        if (window->type != WIN_CONSOLE && !wins_is_current(window) && !window->layout->hibernated) {
+            if (all || (idle_us > 0 && now - window->layout->last_shown >= idle_us)) {
+                win_hibernate(window);
+                hibernated++;
+            } else {
+                awake = g_list_prepend(awake, window);
+            }
         }
-        curr = g_list_next(curr);
+        used += win_memory(window);
     }
-    // Start from begin
-    curr = values;
-    while (current_window && curr) {
-        ProfWin* window = curr->data;
-        if (current_window == window) {
-            // we are at current again
-            break;
-        }
-        if (win_has_attention(window)) {
-            g_list_free(values);
-            return window;
+    g_list_free(values);
+
+    if (budget > 0 && used > budget) {
+        awake = g_list_sort(awake, _wins_cmp_last_shown);
+        for (GList* curr = awake; curr && used > budget; curr = g_list_next(curr)) {
+            ProfWin* window = curr->data;
+            gsize before = win_memory(window);
+            win_hibernate(window);
+            hibernated++;
+            gsize after = win_memory(window);
+            gsize saved = before > after ? before - after : 0;
+            used = used > saved ? used - saved : 0;
         }
-        curr = g_list_next(curr);
     }
+    g_list_free(awake);
 
-    g_list_free(values);
-    return NULL;
+    if (hibernated > 0) {
+        log_debug("Hibernated %d windows, about %" G_GSIZE_FORMAT " KiB in use by windows", hibernated, used / 1024);
+    }
+
+    return hibernated;
 }
 
+// Number of windows and of hibernated ones, with the memory they use
 void
-wins_add_urls_ac(const ProfWin* const win, const ProfMessage* const message)
+wins_hibernate_stats(int* count, int* hibernated, gsize* memory)
 {
-    GRegex* regex;
-    GMatchInfo* match_info;
-
-    regex = g_regex_new("(https?|aesgcm)://\\S+", 0, 0, NULL);
-    g_regex_match(regex, message->plain, 0, &match_info);
+    *count = 0;
+    *hibernated = 0;
+    *memory = 0;
 
-    while (g_match_info_matches(match_info)) {
-        gchar* word = g_match_info_fetch(match_info, 0);
-
-        autocomplete_add_reverse(win->urls_ac, word);
-        // for people who run profanity a long time, we don't want to waste a lot of memory
-        autocomplete_remove_older_than_max_reverse(win->urls_ac, 20);
-
-        g_free(word);
-        g_match_info_next(match_info, NULL);
+    GList* values = g_hash_table_get_values(windows);
+    for (GList* curr = values; curr; curr = g_list_next(curr)) {
+        ProfWin* window = curr->data;
+        (*count)++;
+        if (window->layout->hibernated) {
+            (*hibernated)++;
+        }
+        *memory += win_memory(window);
     }
-
-    g_match_info_free(match_info);
-    g_regex_unref(regex);
+    g_list_free(values);
 }
 
-char*
-wins_get_url(const char* const search_str, gboolean previous, void* context)
+static gboolean
+_wins_hibernate_check(void* data)
 {
-    ProfWin* win = (ProfWin*)context;
+    if (prefs_get_wins_hibernate() > 0 || prefs_get_wins_memory() > 0) {
+        wins_hibernate_idle(FALSE);
+    }
 
-    return autocomplete_complete(win->urls_ac, search_str, FALSE, previous);
+    return TRUE;
 }
@@ -41,6 +41,7 @@
 void wins_init(void);
 
 ProfWin* wins_new_xmlconsole(void);
+ProfWin* wins_new_search(void);
 ProfWin* wins_new_chat(const char* const barejid);
 ProfWin* wins_new_muc(const char* const roomjid);
 ProfWin* wins_new_config(const char* const roomjid, DataForm* form, ProfConfWinCallback submit, ProfConfWinCallback cancel, const void* userdata);
@@ -61,6 +62,7 @@ ProfConfWin* wins_get_conf(const char* const roomjid);
 ProfPrivateWin* wins_get_private(const char* const fulljid);
 ProfPluginWin* wins_get_plugin(const char* const tag);
 ProfXMLWin* wins_get_xmlconsole(void);
+ProfSearchWin* wins_get_search(void);
 
 void wins_close_plugin(char* tag);
 
@@ -81,11 +83,16 @@ void wins_close_by_num(int i);
 gboolean wins_is_current(ProfWin* window);
 gboolean wins_do_notify_remind(void);
 int wins_get_total_unread(void);
+void wins_unread_changed(ProfWin* window, int delta);
+void wins_attention_changed(ProfWin* window);
 void wins_resize_all(void);
+void wins_mark_stale(void);
 GSList* wins_get_chat_recipients(void);
 GSList* wins_get_prune_wins(void);
 void wins_lost_connection(void);
 void wins_reestablished_connection(void);
+int wins_hibernate_idle(gboolean all);
+void wins_hibernate_stats(int* count, int* hibernated, gsize* memory);
 gboolean wins_tidy(void);
 GSList* wins_create_summary(gboolean unread);
 GSList* wins_create_summary_attention();
@@ -0,0 +1,272 @@
+/*
+ * wrap.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "tools/width.h"
+#include "ui/wrap.h"
+
+struct wrap_t
+{
+    int startx;
+    int width;
+    int indent;
+    int pad_indent;
+    int max_lines;
+    // lines of the message left out once max_lines were laid out
+    int hidden;
+    GArray* runs;
+};
+
+// cursor of the window the message will be printed to, lines are counted
+// from the one printing starts on
+typedef struct
+{
+    Wrap* wrap;
+    int x;
+    int y;
+} WrapCursor;
+
+static void _wrap_put(WrapCursor* cursor, int start, int len, int cols);
+static void _wrap_indent(WrapCursor* cursor, int size);
+static void _wrap_newline(WrapCursor* cursor);
+static void _wrap_line_indent(WrapCursor* cursor);
+static gboolean _wrap_full(WrapCursor* cursor);
+static int _wrap_count_lines(const char* rest);
+
+Wrap*
+wrap_layout(const char* const message, int startx, int width, int indent, int pad_indent, int max_lines)
+{
+    Wrap* wrap = g_new0(Wrap, 1);
+    wrap->startx = startx;
+    wrap->width = width;
+    wrap->indent = indent;
+    wrap->pad_indent = pad_indent;
+    wrap->max_lines = max_lines;
+    wrap->runs = g_array_new(FALSE, FALSE, sizeof(WrapRun));
+
+    WrapCursor cursor = { wrap, startx, 0 };
+    int linelen = width - (indent + pad_indent);
+    const char* curr = message;
+
+    while (*curr != '\0' && !_wrap_full(&cursor)) {
+        if (*curr == ' ') {
+            _wrap_put(&cursor, curr - message, 1, 1);
+            curr++;
+        } else if (*curr == '\n') {
+            _wrap_newline(&cursor);
+            _wrap_indent(&cursor, indent + pad_indent);
+            curr++;
+        } else {
+            // measure the word first to know if it fits
+            const char* word = curr;
+            int wordlen = 0;
+            while (*curr != ' ' && *curr != '\n' && *curr != '\0') {
+                int bytes;
+                int cols = width_char(curr, &bytes);
+                if (cols > 0) {
+                    wordlen += cols;
+                }
+                curr += bytes;
+            }
+
+            // a word larger than the line may break anywhere
+            gboolean split = FALSE;
+            if (cursor.x + wordlen > width) {
+                if (wordlen > linelen) {
+                    split = TRUE;
+                } else {
+                    _wrap_newline(&cursor);
+                }
+            }
+            if (!split) {
+                _wrap_line_indent(&cursor);
+            }
+
+            const char* ch = word;
+            while (ch < curr && !_wrap_full(&cursor)) {
+                int bytes;
+                int cols = width_char(ch, &bytes);
+                if (cols >= 0) {
+                    if (split) {
+                        _wrap_line_indent(&cursor);
+                    }
+                    _wrap_put(&cursor, ch - message, bytes, cols);
+                }
+                ch += bytes;
+            }
+            curr = ch;
+        }
+
+        // consume first space of next line
+        if (cursor.y > 0 && cursor.x == 0 && *curr == ' ') {
+            curr++;
+        }
+    }
+
+    if (*curr != '\0') {
+        wrap->hidden = _wrap_count_lines(curr);
+    }
+
+    return wrap;
+}
+
+gboolean
+wrap_matches(const Wrap* const wrap, int startx, int width, int indent, int pad_indent, int max_lines)
+{
+    return wrap && wrap->startx == startx && wrap->width == width && wrap->indent == indent && wrap->pad_indent == pad_indent && wrap->max_lines == max_lines;
+}
+
+int
+wrap_hidden(const Wrap* const wrap)
+{
+    return wrap->hidden;
+}
+
+const WrapRun*
+wrap_runs(const Wrap* const wrap, int* count)
+{
+    *count = wrap->runs->len;
+    return (const WrapRun*)wrap->runs->data;
+}
+
+void
+wrap_free(Wrap* wrap)
+{
+    if (wrap == NULL) {
+        return;
+    }
+
+    g_array_free(wrap->runs, TRUE);
+    g_free(wrap);
+}
+
+// Text is appended to the previous run when it follows on in the message,
+// so a line prints with as few calls as possible.
+static void
+_wrap_put(WrapCursor* cursor, int start, int len, int cols)
+{
+    GArray* runs = cursor->wrap->runs;
+    WrapRun* last = runs->len ? &g_array_index(runs, WrapRun, runs->len - 1) : NULL;
+    if (last && last->type == WRAP_TEXT && last->start + last->len == start) {
+        last->len += len;
+    } else {
+        WrapRun run = { WRAP_TEXT, start, len };
+        g_array_append_val(runs, run);
+    }
+
+    // like curses, a wide character that does not fit moves to the next line
+    // and filling the last column wraps the cursor
+    int width = cursor->wrap->width;
+    if (cursor->x + cols > width) {
+        cursor->x = 0;
+        cursor->y++;
+    }
+    cursor->x += cols;
+    if (cursor->x >= width) {
+        cursor->x = 0;
+        cursor->y++;
+    }
+}
+
+static void
+_wrap_indent(WrapCursor* cursor, int size)
+{
+    if (size <= 0) {
+        return;
+    }
+
+    WrapRun run = { WRAP_INDENT, 0, size };
+    g_array_append_val(cursor->wrap->runs, run);
+
+    int width = cursor->wrap->width;
+    cursor->x += size;
+    while (cursor->x >= width) {
+        cursor->x -= width;
+        cursor->y++;
+    }
+}
+
+static void
+_wrap_newline(WrapCursor* cursor)
+{
+    WrapRun run = { WRAP_NEWLINE, 0, 0 };
+    g_array_append_val(cursor->wrap->runs, run);
+
+    cursor->x = 0;
+    cursor->y++;
+}
+
+static void
+_wrap_line_indent(WrapCursor* cursor)
+{
+    int indent = cursor->wrap->indent;
+    if (cursor->y == 0 && cursor->x < indent) {
+        _wrap_indent(cursor, indent);
+    }
+    if (cursor->y > 0 && cursor->x < indent + cursor->wrap->pad_indent) {
+        _wrap_indent(cursor, indent + cursor->wrap->pad_indent);
+    }
+}
+
+static gboolean
+_wrap_full(WrapCursor* cursor)
+{
+    return cursor->wrap->max_lines > 0 && cursor->y >= cursor->wrap->max_lines;
+}
+
+// Lines of the message from rest on, without wrapping them, a newline
+// rest starts with ends the last line laid out
+static int
+_wrap_count_lines(const char* rest)
+{
+    if (*rest == '\n') {
+        rest++;
+    }
+
+    int lines = *rest != '\0' ? 1 : 0;
+    for (const char* c = strchr(rest, '\n'); c; c = strchr(c + 1, '\n')) {
+        if (c[1] != '\0') {
+            lines++;
+        }
+    }
+
+    return lines;
+}
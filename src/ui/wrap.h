@@ -0,0 +1,68 @@
+/*
+ * wrap.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef UI_WRAP_H
+#define UI_WRAP_H
+
+#include <glib.h>
+
+typedef enum {
+    WRAP_TEXT,
+    WRAP_INDENT,
+    WRAP_NEWLINE
+} wrap_run_t;
+
+// TEXT prints len bytes of the message from start, INDENT prints len spaces
+typedef struct wrap_run_s
+{
+    wrap_run_t type;
+    int start;
+    int len;
+} WrapRun;
+
+typedef struct wrap_t Wrap;
+
+// Word wrap a message printed from column startx of a width columns wide
+// window, continuation lines indented by indent + pad_indent. With
+// max_lines above 0 the layout stops once that many lines are filled.
+Wrap* wrap_layout(const char* const message, int startx, int width, int indent, int pad_indent, int max_lines);
+gboolean wrap_matches(const Wrap* const wrap, int startx, int width, int indent, int pad_indent, int max_lines);
+const WrapRun* wrap_runs(const Wrap* const wrap, int* count);
+// lines of the message max_lines left out, 0 when it all fit
+int wrap_hidden(const Wrap* const wrap);
+void wrap_free(Wrap* wrap);
+
+#endif
@@ -37,27 +37,319 @@
 
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
 
+#include "config/preferences.h"
 #include "ui/win_types.h"
 #include "ui/window_list.h"
 
+// bytes of raw stanzas kept by the console, the oldest go first
+#define XMLWIN_MAX_BYTES (2 * 1024 * 1024)
+// stanzas drawn when the console is shown after collecting in the background,
+// more would not fit the window buffer anyway
+#define XMLWIN_RENDER_MAX 300
+
+typedef struct xml_stanza_t
+{
+    gboolean sent;
+    gsize size;
+    char xml[];
+} XmlStanza;
+
+// name of the first element, without attributes
+static gboolean
+_xmlwin_match_kind(const char* const xml, const char* const kind)
+{
+    const char* name = strchr(xml, '<');
+    if (!name) {
+        return FALSE;
+    }
+    name++;
+
+    size_t len = strcspn(name, " \t\r\n/>");
+    return strlen(kind) == len && strncmp(name, kind, len) == 0;
+}
+
+// any element of the stanza declaring the namespace
+static gboolean
+_xmlwin_match_ns(const char* const xml, const char* const ns)
+{
+    size_t len = strlen(ns);
+    const char* curr = xml;
+
+    while ((curr = strstr(curr, "xmlns=")) != NULL) {
+        curr += strlen("xmlns=");
+        char quote = curr[0];
+        if ((quote == '\'' || quote == '"') && strncmp(curr + 1, ns, len) == 0 && curr[len + 1] == quote) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+_xmlwin_match_attr_jid(const char* const tag, size_t tag_len, const char* const attr, const char* const jid)
+{
+    size_t attr_len = strlen(attr);
+    size_t jid_len = strlen(jid);
+
+    for (size_t i = 0; i + attr_len + 1 < tag_len; i++) {
+        if (strncmp(tag + i, attr, attr_len) != 0 || (i > 0 && tag[i - 1] != ' ')) {
+            continue;
+        }
+        const char* value = tag + i + attr_len;
+        char quote = value[0];
+        if (quote != '\'' && quote != '"') {
+            continue;
+        }
+        // a bare jid matches any of its resources
+        if (strncmp(value + 1, jid, jid_len) == 0 && (value[jid_len + 1] == quote || value[jid_len + 1] == '/')) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// from or to of the first element
+static gboolean
+_xmlwin_match_jid(const char* const xml, const char* const jid)
+{
+    const char* tag = strchr(xml, '<');
+    if (!tag) {
+        return FALSE;
+    }
+
+    const char* end = strchr(tag, '>');
+    size_t tag_len = end ? (size_t)(end - tag) : strlen(tag);
+
+    return _xmlwin_match_attr_jid(tag, tag_len, "from=", jid) || _xmlwin_match_attr_jid(tag, tag_len, "to=", jid);
+}
+
+static gboolean
+_xmlwin_filter_match(ProfXMLWin* xmlwin, const char* const xml)
+{
+    if (xmlwin->filter_kind && !_xmlwin_match_kind(xml, xmlwin->filter_kind)) {
+        return FALSE;
+    }
+    if (xmlwin->filter_ns && !_xmlwin_match_ns(xml, xmlwin->filter_ns)) {
+        return FALSE;
+    }
+    if (xmlwin->filter_jid && !_xmlwin_match_jid(xml, xmlwin->filter_jid)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// Put each element on a line of its own, indented by depth. Text content
+// stays next to its element.
+static gchar*
+_xmlwin_pretty(const char* const xml)
+{
+    GString* pretty = g_string_sized_new(strlen(xml) * 5 / 4);
+    int depth = 0;
+    gboolean text = FALSE;
+
+    const char* p = xml;
+    while (*p) {
+        if (*p != '<') {
+            size_t len = strcspn(p, "<");
+            // whitespace between elements is dropped
+            if (strspn(p, " \t\r\n") < len) {
+                g_string_append_len(pretty, p, len);
+                text = TRUE;
+            }
+            p += len;
+            continue;
+        }
+
+        const char* end = strchr(p, '>');
+        gboolean closing = p[1] == '/';
+        gboolean empty = end && *(end - 1) == '/';
+        gboolean declaration = p[1] == '?' || p[1] == '!';
+
+        if (closing && depth > 0) {
+            depth--;
+        }
+        if (!(closing && text) && pretty->len > 0) {
+            g_string_append_c(pretty, '\n');
+            for (int i = 0; i < depth; i++) {
+                g_string_append(pretty, "  ");
+            }
+        }
+        if (!closing && !empty && !declaration) {
+            depth++;
+        }
+        text = FALSE;
+
+        if (!end) {
+            g_string_append(pretty, p);
+            break;
+        }
+        g_string_append_len(pretty, p, end - p + 1);
+        p = end + 1;
+    }
+
+    return g_string_free(pretty, FALSE);
+}
+
+static void
+_xmlwin_print(ProfXMLWin* xmlwin, XmlStanza* stanza)
+{
+    ProfWin* window = (ProfWin*)xmlwin;
+    theme_item_t theme_item = stanza->sent ? THEME_ONLINE : THEME_AWAY;
+
+    win_println(window, THEME_DEFAULT, "-", stanza->sent ? "SENT:" : "RECV:");
+    if (prefs_get_boolean(PREF_XMLCONSOLE_PRETTY)) {
+        gchar* pretty = _xmlwin_pretty(stanza->xml);
+        win_println(window, theme_item, "-", "%s", pretty);
+        g_free(pretty);
+    } else {
+        win_println(window, theme_item, "-", "%s", stanza->xml);
+    }
+    win_println(window, theme_item, "-", "");
+}
+
+// Stanzas are kept raw and only drawn while the console is shown
 void
 xmlwin_show(ProfXMLWin* xmlwin, const char* const msg)
 {
     assert(xmlwin != NULL);
 
-    ProfWin* window = (ProfWin*)xmlwin;
+    gboolean sent;
     if (g_str_has_prefix(msg, "SENT:")) {
-        win_println(window, THEME_DEFAULT, "-", "SENT:");
-        win_println(window, THEME_ONLINE, "-", "%s", &msg[6]);
-        win_println(window, THEME_ONLINE, "-", "");
+        sent = TRUE;
     } else if (g_str_has_prefix(msg, "RECV:")) {
-        win_println(window, THEME_DEFAULT, "-", "RECV:");
-        win_println(window, THEME_AWAY, "-", "%s", &msg[6]);
-        win_println(window, THEME_AWAY, "-", "");
+        sent = FALSE;
+    } else {
+        return;
+    }
+
+    const char* xml = &msg[6];
+    if (!_xmlwin_filter_match(xmlwin, xml)) {
+        return;
+    }
+
+    gsize size = strlen(xml) + 1;
+    XmlStanza* stanza = malloc(sizeof(XmlStanza) + size);
+    stanza->sent = sent;
+    stanza->size = size;
+    memcpy(stanza->xml, xml, size);
+
+    g_queue_push_tail(xmlwin->stanzas, stanza);
+    xmlwin->bytes += size;
+    while (xmlwin->bytes > XMLWIN_MAX_BYTES && g_queue_get_length(xmlwin->stanzas) > 1) {
+        XmlStanza* oldest = g_queue_pop_head(xmlwin->stanzas);
+        xmlwin->bytes -= oldest->size;
+        free(oldest);
+    }
+
+    if (wins_is_current((ProfWin*)xmlwin)) {
+        _xmlwin_print(xmlwin, stanza);
+    } else {
+        xmlwin->unshown = MIN(xmlwin->unshown + 1, g_queue_get_length(xmlwin->stanzas));
     }
 }
 
+// Draw the stanzas stored while the console was in the background
+void
+xmlwin_refresh(ProfXMLWin* xmlwin)
+{
+    assert(xmlwin != NULL);
+
+    if (xmlwin->unshown == 0) {
+        return;
+    }
+
+    guint skipped = 0;
+    if (xmlwin->unshown > XMLWIN_RENDER_MAX) {
+        skipped = xmlwin->unshown - XMLWIN_RENDER_MAX;
+        xmlwin->unshown = XMLWIN_RENDER_MAX;
+    }
+
+    ProfWin* window = (ProfWin*)xmlwin;
+    if (skipped > 0) {
+        win_println(window, THEME_DEFAULT, "-", "... %u older stanzas not shown", skipped);
+    }
+
+    guint length = g_queue_get_length(xmlwin->stanzas);
+    for (GList* curr = g_queue_peek_nth_link(xmlwin->stanzas, length - xmlwin->unshown); curr; curr = g_list_next(curr)) {
+        _xmlwin_print(xmlwin, curr->data);
+    }
+    xmlwin->unshown = 0;
+}
+
+// Terms are kind:<element>, ns:<namespace> and jid:<jid>, all have to match.
+// NULL clears the filter.
+gboolean
+xmlwin_set_filter(ProfXMLWin* xmlwin, gchar** terms)
+{
+    assert(xmlwin != NULL);
+
+    char* kind = NULL;
+    char* ns = NULL;
+    char* jid = NULL;
+
+    for (int i = 0; terms && terms[i]; i++) {
+        const char* term = terms[i];
+        char** field = NULL;
+        const char* value = NULL;
+        if (g_str_has_prefix(term, "kind:")) {
+            field = &kind;
+            value = term + strlen("kind:");
+        } else if (g_str_has_prefix(term, "ns:")) {
+            field = &ns;
+            value = term + strlen("ns:");
+        } else if (g_str_has_prefix(term, "jid:")) {
+            field = &jid;
+            value = term + strlen("jid:");
+        }
+
+        if (!field || *field || value[0] == '\0') {
+            free(kind);
+            free(ns);
+            free(jid);
+            return FALSE;
+        }
+        *field = strdup(value);
+    }
+
+    free(xmlwin->filter_kind);
+    free(xmlwin->filter_ns);
+    free(xmlwin->filter_jid);
+    xmlwin->filter_kind = kind;
+    xmlwin->filter_ns = ns;
+    xmlwin->filter_jid = jid;
+
+    return TRUE;
+}
+
+char*
+xmlwin_get_filter(ProfXMLWin* xmlwin)
+{
+    assert(xmlwin != NULL);
+
+    GString* filter = g_string_new(NULL);
+    if (xmlwin->filter_kind) {
+        g_string_append_printf(filter, "kind:%s ", xmlwin->filter_kind);
+    }
+    if (xmlwin->filter_ns) {
+        g_string_append_printf(filter, "ns:%s ", xmlwin->filter_ns);
+    }
+    if (xmlwin->filter_jid) {
+        g_string_append_printf(filter, "jid:%s ", xmlwin->filter_jid);
+    }
+    if (filter->len == 0) {
+        g_string_free(filter, TRUE);
+        return NULL;
+    }
+    g_string_truncate(filter, filter->len - 1);
+
+    return g_string_free(filter, FALSE);
+}
+
 char*
 xmlwin_get_string(ProfXMLWin* xmlwin)
 {
@@ -36,10 +36,12 @@
 #include "config.h"
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
 #include "log.h"
@@ -50,6 +52,13 @@
 #include "ui/ui.h"
 #include "config/files.h"
 #include "config/preferences.h"
+#include "tools/external.h"
+#include "tools/scheduler.h"
+
+// how often finished avatars are checked for while some are being written
+#define AVATAR_JOB_POLL_MS 100
+// base64 is decoded in pieces of this size, a multiple of 4
+#define AVATAR_DECODE_CHUNK (64 * 1024)
 
 typedef struct avatar_metadata
 {
@@ -57,22 +66,66 @@ typedef struct avatar_metadata
     char* id;
 } avatar_metadata;
 
+typedef struct avatar_job_t
+{
+    char* jid;
+    char* id;
+    char* data; // base64, freed by the worker once written
+    char* filename;
+    gboolean open;
+    gboolean verified; // data matches the id (SHA-1 of the image)
+    char* error;
+} AvatarJob;
+
 static GHashTable* looking_for = NULL; // contains nicks/barejids from who we want to get the avatar
 static GHashTable* shall_open = NULL;  // contains a list of nicks that shall not just downloaded but also opened
 
+// avatars are decoded and written by a worker thread, the main thread
+// reports them
+static pthread_t avatar_worker;
+static gboolean avatar_worker_running = FALSE;
+static pthread_mutex_t avatar_jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t avatar_jobs_cond = PTHREAD_COND_INITIALIZER;
+static GQueue* avatar_jobs = NULL;
+static GList* avatar_jobs_done = NULL;
+static guint avatar_jobs_pending = 0;
+static SchedulerTask* avatar_jobs_task = NULL;
+
+// jid to the id and file of its last saved avatar
+static GKeyFile* avatar_ids = NULL;
+
 static void _avatar_request_item_by_id(const char* jid, avatar_metadata* data);
 static int _avatar_metadata_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _avatar_request_item_result_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static gboolean _avatar_from_cache(const char* const jid, const char* const id);
+static void _avatar_job_add(AvatarJob* job);
+static gboolean _avatar_jobs_check(void* data);
+static void _avatar_job_deliver(AvatarJob* job);
+static void _avatar_open(const char* const filename);
 
 static void
 _free_avatar_data(avatar_metadata* data)
 {
     if (data) {
         free(data->type);
+        free(data->id);
         free(data);
     }
 }
 
+static void
+_avatar_job_free(AvatarJob* job)
+{
+    if (job) {
+        free(job->jid);
+        free(job->id);
+        free(job->data);
+        g_free(job->filename);
+        g_free(job->error);
+        free(job);
+    }
+}
+
 void
 avatar_pep_subscribe(void)
 {
@@ -111,6 +164,33 @@ avatar_get_by_nick(const char* nick, gboolean open)
     return TRUE;
 }
 
+void
+avatar_close(void)
+{
+    // too late to report anything, the windows are gone
+    if (avatar_worker_running) {
+        pthread_mutex_lock(&avatar_jobs_lock);
+        avatar_worker_running = FALSE;
+        pthread_cond_broadcast(&avatar_jobs_cond);
+        pthread_mutex_unlock(&avatar_jobs_lock);
+        pthread_join(avatar_worker, NULL);
+    }
+    if (avatar_jobs) {
+        g_queue_free_full(avatar_jobs, (GDestroyNotify)_avatar_job_free);
+        avatar_jobs = NULL;
+    }
+    g_list_free_full(avatar_jobs_done, (GDestroyNotify)_avatar_job_free);
+    avatar_jobs_done = NULL;
+    avatar_jobs_pending = 0;
+    scheduler_remove(avatar_jobs_task);
+    avatar_jobs_task = NULL;
+
+    if (avatar_ids) {
+        g_key_file_free(avatar_ids);
+        avatar_ids = NULL;
+    }
+}
+
 static int
 _avatar_metadata_handler(xmpp_stanza_t* const stanza, void* const userdata)
 {
@@ -157,6 +237,11 @@ _avatar_metadata_handler(xmpp_stanza_t* const stanza, void* const userdata)
                 if (id && type) {
                     log_debug("Avatar ID for %s is: %s", from, id);
 
+                    // the same image as last time, no need to fetch it
+                    if (_avatar_from_cache(from, id)) {
+                        return 1;
+                    }
+
                     avatar_metadata* data = malloc(sizeof(avatar_metadata));
                     if (data) {
                         data->type = strdup(type);
@@ -191,6 +276,122 @@ _avatar_request_item_by_id(const char* jid, avatar_metadata* data)
     xmpp_stanza_release(iq);
 }
 
+static gchar*
+_avatar_ids_filename(void)
+{
+    gchar* path = files_get_data_path("");
+    gchar* filename = g_strdup_printf("%savatars/ids.txt", path);
+    g_free(path);
+
+    return filename;
+}
+
+static void
+_avatar_ids_load(void)
+{
+    if (avatar_ids) {
+        return;
+    }
+
+    avatar_ids = g_key_file_new();
+    gchar* filename = _avatar_ids_filename();
+    g_key_file_load_from_file(avatar_ids, filename, G_KEY_FILE_KEEP_COMMENTS, NULL);
+    g_free(filename);
+}
+
+static void
+_avatar_ids_store(const char* const jid, const char* const id, const char* const file)
+{
+    _avatar_ids_load();
+    g_key_file_set_string(avatar_ids, jid, "id", id);
+    g_key_file_set_string(avatar_ids, jid, "file", file);
+
+    gchar* filename = _avatar_ids_filename();
+    GError* err = NULL;
+    if (!g_key_file_save_to_file(avatar_ids, filename, &err)) {
+        log_error("Avatar: unable to save %s: %s", filename, err->message);
+        g_error_free(err);
+    }
+    g_free(filename);
+}
+
+static gboolean
+_avatar_from_cache(const char* const jid, const char* const id)
+{
+    _avatar_ids_load();
+
+    gchar* cached_id = g_key_file_get_string(avatar_ids, jid, "id", NULL);
+    gchar* file = g_key_file_get_string(avatar_ids, jid, "file", NULL);
+    gboolean found = cached_id && file && g_strcmp0(cached_id, id) == 0 && g_file_test(file, G_FILE_TEST_IS_REGULAR);
+
+    if (found) {
+        log_debug("Avatar: %s is unchanged, using %s", jid, file);
+        caps_remove_feature(XMPP_FEATURE_USER_AVATAR_METADATA_NOTIFY);
+        g_hash_table_remove(looking_for, jid);
+
+        cons_show("Avatar saved as %s", file);
+        if (g_hash_table_contains(shall_open, jid)) {
+            _avatar_open(file);
+            g_hash_table_remove(shall_open, jid);
+        }
+    }
+
+    g_free(cached_id);
+    g_free(file);
+
+    return found;
+}
+
+static gchar*
+_avatar_filename(const char* const jid, const char* const type)
+{
+    char* path = files_get_data_path("");
+    GString* filename = g_string_new(path);
+    free(path);
+
+    g_string_append(filename, "avatars/");
+
+    errno = 0;
+    int res = g_mkdir_with_parents(filename->str, S_IRWXU);
+    if (res == -1) {
+        const char* errmsg = strerror(errno);
+        if (errmsg) {
+            log_error("Avatar: error creating directory: %s, %s", filename->str, errmsg);
+        } else {
+            log_error("Avatar: creating directory: %s", filename->str);
+        }
+    }
+
+    gchar* from = str_replace(jid, "@", "_at_");
+    g_string_append(filename, from);
+    free(from);
+
+    // check a few image types ourselves
+    // if none matches we won't add an extension but linux will
+    // be able to open it anyways
+    // TODO: we could use /etc/mime-types
+    if (g_strcmp0(type, "image/png") == 0) {
+        g_string_append(filename, ".png");
+    } else if (g_strcmp0(type, "image/jpeg") == 0) {
+        g_string_append(filename, ".jpeg");
+    } else if (g_strcmp0(type, "image/webp") == 0) {
+        g_string_append(filename, ".webp");
+    }
+
+    return g_string_free(filename, FALSE);
+}
+
+static void
+_avatar_open(const char* const filename)
+{
+    gchar* cmd = prefs_get_string(PREF_AVATAR_CMD);
+    gchar* argv[] = { cmd, (gchar*)filename, NULL };
+    if (!external_run(argv, "Displaying avatar")) {
+        cons_show_error("Unable to display avatar: check the logs for more information.");
+    }
+    g_free(cmd);
+}
+
 static int
 _avatar_request_item_result_handler(xmpp_stanza_t* const stanza, void* const userdata)
 {
@@ -230,66 +431,164 @@ _avatar_request_item_result_handler(xmpp_stanza_t* const stanza, void* const use
         return 1;
     }
 
-    gsize size;
-    gchar* de = (gchar*)g_base64_decode(buf, &size);
-    free(buf);
+    avatar_metadata* data = (avatar_metadata*)userdata;
 
-    char* path = files_get_data_path("");
-    GString* filename = g_string_new(path);
-    free(path);
+    AvatarJob* job = calloc(1, sizeof(AvatarJob));
+    job->jid = strdup(from_attr);
+    job->id = strdup(data->id);
+    job->data = buf;
+    job->filename = _avatar_filename(from_attr, data->type);
+    job->open = g_hash_table_contains(shall_open, from_attr);
+    g_hash_table_remove(shall_open, from_attr);
 
-    g_string_append(filename, "avatars/");
+    _avatar_job_add(job);
 
-    errno = 0;
-    int res = g_mkdir_with_parents(filename->str, S_IRWXU);
-    if (res == -1) {
-        const char* errmsg = strerror(errno);
-        if (errmsg) {
-            log_error("Avatar: error creating directory: %s, %s", filename->str, errmsg);
-        } else {
-            log_error("Avatar: creating directory: %s", filename->str);
+    return 1;
+}
+
+// Decodes the base64 piece by piece straight into the file, hashing the
+// image on the way to check it against its id.
+static void
+_avatar_job_run(AvatarJob* job)
+{
+    gchar* partial = g_strdup_printf("%s.part", job->filename);
+    FILE* file = g_fopen(partial, "wb");
+    if (!file) {
+        job->error = g_strdup(strerror(errno));
+        g_free(partial);
+        return;
+    }
+
+    GChecksum* sha1 = g_checksum_new(G_CHECKSUM_SHA1);
+    guchar* out = g_malloc(AVATAR_DECODE_CHUNK / 4 * 3 + 3);
+    gint state = 0;
+    guint save = 0;
+    size_t len = strlen(job->data);
+    gboolean written = TRUE;
+
+    for (size_t offset = 0; offset < len && written; offset += AVATAR_DECODE_CHUNK) {
+        gsize decoded = g_base64_decode_step(job->data + offset, MIN(AVATAR_DECODE_CHUNK, len - offset), out, &state, &save);
+        g_checksum_update(sha1, out, decoded);
+        written = fwrite(out, 1, decoded, file) == decoded;
+    }
+
+    free(job->data);
+    job->data = NULL;
+    g_free(out);
+
+    if (fclose(file) != 0) {
+        written = FALSE;
+    }
+
+    if (!written) {
+        job->error = g_strdup(strerror(errno));
+        g_unlink(partial);
+    } else if (g_rename(partial, job->filename) != 0) {
+        job->error = g_strdup(strerror(errno));
+        g_unlink(partial);
+    } else {
+        job->verified = g_ascii_strcasecmp(g_checksum_get_string(sha1), job->id) == 0;
+    }
+
+    g_checksum_free(sha1);
+    g_free(partial);
+}
+
+static void*
+_avatar_worker(void* data)
+{
+    pthread_mutex_lock(&avatar_jobs_lock);
+    while (avatar_worker_running) {
+        AvatarJob* job = g_queue_pop_head(avatar_jobs);
+        if (!job) {
+            pthread_cond_wait(&avatar_jobs_cond, &avatar_jobs_lock);
+            continue;
         }
+        pthread_mutex_unlock(&avatar_jobs_lock);
+
+        _avatar_job_run(job);
+
+        pthread_mutex_lock(&avatar_jobs_lock);
+        avatar_jobs_done = g_list_append(avatar_jobs_done, job);
     }
+    pthread_mutex_unlock(&avatar_jobs_lock);
 
-    gchar* from = str_replace(from_attr, "@", "_at_");
-    g_string_append(filename, from);
+    return NULL;
+}
 
-    avatar_metadata* data = (avatar_metadata*)userdata;
+static void
+_avatar_job_add(AvatarJob* job)
+{
+    pthread_mutex_lock(&avatar_jobs_lock);
+    if (!avatar_jobs) {
+        avatar_jobs = g_queue_new();
+    }
+    if (!avatar_worker_running) {
+        avatar_worker_running = TRUE;
+        if (pthread_create(&avatar_worker, NULL, _avatar_worker, NULL) != 0) {
+            log_error("Avatar: failed to start the worker thread");
+            avatar_worker_running = FALSE;
+        }
+    }
+    gboolean running = avatar_worker_running;
+    if (running) {
+        g_queue_push_tail(avatar_jobs, job);
+        avatar_jobs_pending++;
+        pthread_cond_signal(&avatar_jobs_cond);
+    }
+    pthread_mutex_unlock(&avatar_jobs_lock);
+
+    if (!running) {
+        // no thread, write it now
+        _avatar_job_run(job);
+        _avatar_job_deliver(job);
+        _avatar_job_free(job);
+        return;
+    }
 
-    // check a few image types ourselves
-    // if none matches we won't add an extension but linux will
-    // be able to open it anyways
-    // TODO: we could use /etc/mime-types
-    if (g_strcmp0(data->type, "image/png") == 0) {
-        g_string_append(filename, ".png");
-    } else if (g_strcmp0(data->type, "image/jpeg") == 0) {
-        g_string_append(filename, ".jpeg");
-    } else if (g_strcmp0(data->type, "image/webp") == 0) {
-        g_string_append(filename, ".webp");
+    if (!avatar_jobs_task) {
+        avatar_jobs_task = scheduler_add(AVATAR_JOB_POLL_MS, _avatar_jobs_check, NULL, NULL);
     }
+}
 
-    free(from);
+static void
+_avatar_job_deliver(AvatarJob* job)
+{
+    if (job->error) {
+        log_error("Unable to save picture: %s", job->error);
+        cons_show("Unable to save picture %s", job->error);
+        return;
+    }
 
-    GError* err = NULL;
-    if (g_file_set_contents(filename->str, de, size, &err) == FALSE) {
-        log_error("Unable to save picture: %s", err->message);
-        cons_show("Unable to save picture %s", err->message);
-        g_error_free(err);
+    cons_show("Avatar saved as %s", job->filename);
+    if (job->verified) {
+        _avatar_ids_store(job->jid, job->id, job->filename);
     } else {
-        cons_show("Avatar saved as %s", filename->str);
+        log_warning("Avatar: data of %s does not match its id %s", job->jid, job->id);
     }
 
-    // if we shall open it
-    if (g_hash_table_contains(shall_open, from_attr)) {
-        gchar* argv[] = { prefs_get_string(PREF_AVATAR_CMD), filename->str, NULL };
-        if (!call_external(argv, NULL, NULL)) {
-            cons_show_error("Unable to display avatar: check the logs for more information.");
-        }
-        g_hash_table_remove(shall_open, from_attr);
+    if (job->open) {
+        _avatar_open(job->filename);
     }
+}
 
-    g_string_free(filename, TRUE);
-    free(de);
+static gboolean
+_avatar_jobs_check(void* data)
+{
+    pthread_mutex_lock(&avatar_jobs_lock);
+    GList* done = avatar_jobs_done;
+    avatar_jobs_done = NULL;
+    avatar_jobs_pending -= g_list_length(done);
+    gboolean pending = avatar_jobs_pending > 0;
+    if (!pending) {
+        avatar_jobs_task = NULL;
+    }
+    pthread_mutex_unlock(&avatar_jobs_lock);
 
-    return 1;
+    for (GList* curr = done; curr; curr = g_list_next(curr)) {
+        _avatar_job_deliver(curr->data);
+    }
+    g_list_free_full(done, (GDestroyNotify)_avatar_job_free);
+
+    return pending;
 }
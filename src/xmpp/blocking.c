@@ -56,6 +56,35 @@ static int _block_remove_result_handler(xmpp_stanza_t* const stanza, void* const
 
 static GList* blocked;
 static Autocomplete blocked_ac;
+// the blocked jids lower cased, for matching incoming stanzas
+static GHashTable* blocked_set;
+
+static void
+_blocked_set_add(const char* const jid)
+{
+    if (!blocked_set) {
+        blocked_set = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    g_hash_table_add(blocked_set, g_utf8_strdown(jid, -1));
+}
+
+static void
+_blocked_set_remove(const char* const jid)
+{
+    if (blocked_set) {
+        gchar* lower = g_utf8_strdown(jid, -1);
+        g_hash_table_remove(blocked_set, lower);
+        g_free(lower);
+    }
+}
+
+static void
+_blocked_set_clear(void)
+{
+    if (blocked_set) {
+        g_hash_table_remove_all(blocked_set);
+    }
+}
 
 void
 blocking_request(void)
@@ -64,6 +93,7 @@ blocking_request(void)
         g_list_free_full(blocked, free);
         blocked = NULL;
     }
+    _blocked_set_clear();
 
     if (blocked_ac) {
         autocomplete_free(blocked_ac);
@@ -88,6 +118,48 @@ blocked_list(void)
     return blocked;
 }
 
+/*
+ * Whether a stanza from jid is covered by a block, either of the jid itself,
+ * its bare jid, its domain with or without the resource, or a parent domain
+ */
+gboolean
+blocked_matches(const char* const jid)
+{
+    if (!jid || !blocked_set || g_hash_table_size(blocked_set) == 0) {
+        return FALSE;
+    }
+
+    char buf[256];
+    char* alloced;
+    char* folded = jid_fold(jid, buf, sizeof(buf), &alloced);
+    gboolean found = g_hash_table_contains(blocked_set, folded);
+
+    char* at = strchr(folded, '@');
+    char* domain = at ? at + 1 : folded;
+    if (!found && at) {
+        found = g_hash_table_contains(blocked_set, domain);
+    }
+
+    char* slash = strchr(domain, '/');
+    if (slash) {
+        *slash = '\0';
+    }
+    if (!found && slash) {
+        found = g_hash_table_contains(blocked_set, folded);
+    }
+
+    while (!found && domain) {
+        found = g_hash_table_contains(blocked_set, domain);
+        domain = strchr(domain, '.');
+        if (domain) {
+            domain++;
+        }
+    }
+    g_free(alloced);
+
+    return found;
+}
+
 char*
 blocked_ac_find(const char* const search_str, gboolean previous, void* context)
 {
@@ -212,6 +284,7 @@ blocked_set_handler(xmpp_stanza_t* stanza)
                 if (jid) {
                     blocked = g_list_append(blocked, strdup(jid));
                     autocomplete_add(blocked_ac, jid);
+                    _blocked_set_add(jid);
                 }
             }
 
@@ -226,6 +299,7 @@ blocked_set_handler(xmpp_stanza_t* stanza)
             g_list_free_full(blocked, free);
             blocked = NULL;
             autocomplete_clear(blocked_ac);
+            _blocked_set_clear();
         } else {
             while (child) {
                 if (g_strcmp0(xmpp_stanza_get_name(child), STANZA_NAME_ITEM) == 0) {
@@ -236,6 +310,7 @@ blocked_set_handler(xmpp_stanza_t* stanza)
                             blocked = g_list_remove_link(blocked, found);
                             g_list_free_full(found, free);
                             autocomplete_remove(blocked_ac, jid);
+                            _blocked_set_remove(jid);
                         }
                     }
                 }
@@ -311,6 +386,7 @@ _blocklist_result_handler(xmpp_stanza_t* const stanza, void* const userdata)
         g_list_free_full(blocked, free);
         blocked = NULL;
     }
+    _blocked_set_clear();
 
     xmpp_stanza_t* items = xmpp_stanza_get_children(blocklist);
     if (!items) {
@@ -326,6 +402,7 @@ _blocklist_result_handler(xmpp_stanza_t* const stanza, void* const userdata)
             if (jid) {
                 blocked = g_list_append(blocked, strdup(jid));
                 autocomplete_add(blocked_ac, jid);
+                _blocked_set_add(jid);
             }
         }
         curr = xmpp_stanza_get_next(curr);
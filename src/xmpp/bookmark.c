@@ -48,8 +48,10 @@
 #include "event/server_events.h"
 #include "plugins/plugins.h"
 #include "ui/ui.h"
+#include "xmpp/capabilities.h"
 #include "xmpp/connection.h"
 #include "xmpp/iq.h"
+#include "xmpp/message.h"
 #include "xmpp/stanza.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/bookmark.h"
@@ -59,11 +61,19 @@
 
 static Autocomplete bookmark_ac;
 static GHashTable* bookmarks;
+// XEP-0402, each bookmark is its own PEP item instead of one private XML list
+static gboolean pep_bookmarks = FALSE;
 
 // id handlers
+static int _bookmark_disco_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _bookmark_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static int _bookmark_pep_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static int _bookmark_pep_event_handler(xmpp_stanza_t* const stanza, void* const userdata);
 
 static void _bookmark_destroy(Bookmark* bookmark);
+static void _bookmark_storage_request(void);
+static void _bookmark_save(Bookmark* bookmark);
+static void _bookmark_retract(const char* const barejid);
 static void _send_bookmarks(void);
 
 void
@@ -76,7 +86,24 @@ bookmark_request(void)
 
     autocomplete_free(bookmark_ac);
     bookmark_ac = autocomplete_new();
+    pep_bookmarks = FALSE;
 
+    // the account advertises whether PEP bookmarks are kept in sync with private storage
+    char* id = "bookmark_disco_request";
+    iq_id_handler_add(id, _bookmark_disco_id_handler, NULL, NULL);
+
+    xmpp_ctx_t* ctx = connection_get_ctx();
+    char* barejid = connection_get_barejid();
+    xmpp_stanza_t* iq = stanza_create_disco_info_iq(ctx, id, barejid, NULL);
+    free(barejid);
+
+    iq_send_stanza(iq);
+    xmpp_stanza_release(iq);
+}
+
+static void
+_bookmark_storage_request(void)
+{
     char* id = "bookmark_init_request";
     iq_id_handler_add(id, _bookmark_result_id_handler, free, NULL);
 
@@ -131,7 +158,7 @@ bookmark_add(const char* jid, const char* nick, const char* password, const char
     g_hash_table_insert(bookmarks, strdup(jid), bookmark);
     autocomplete_add(bookmark_ac, jid);
 
-    _send_bookmarks();
+    _bookmark_save(bookmark);
 
     return TRUE;
 }
@@ -166,7 +193,7 @@ bookmark_update(const char* jid, const char* nick, const char* password, const c
         }
     }
 
-    _send_bookmarks();
+    _bookmark_save(bookmark);
     return TRUE;
 }
 
@@ -211,10 +238,16 @@ bookmark_remove(const char* jid)
         return FALSE;
     }
 
+    if (pep_bookmarks) {
+        _bookmark_retract(jid);
+    }
+
     g_hash_table_remove(bookmarks, jid);
     autocomplete_remove(bookmark_ac, jid);
 
-    _send_bookmarks();
+    if (!pep_bookmarks) {
+        _send_bookmarks();
+    }
 
     return TRUE;
 }
@@ -252,6 +285,107 @@ bookmark_exists(const char* const room)
     return g_hash_table_contains(bookmarks, room);
 }
 
+// Takes nick and password, replaces an existing bookmark for barejid
+static void
+_bookmark_store(const char* const barejid, const char* const room_name, char* nick, char* password, gboolean autojoin, int minimize)
+{
+    log_debug("Handle bookmark for %s", barejid);
+
+    Bookmark* existing = g_hash_table_lookup(bookmarks, barejid);
+    gboolean join = autojoin && (existing == NULL || !existing->autojoin);
+
+    autocomplete_add(bookmark_ac, barejid);
+    Bookmark* bookmark = malloc(sizeof(Bookmark));
+    bookmark->barejid = strdup(barejid);
+    bookmark->nick = nick;
+    bookmark->password = password;
+    bookmark->name = room_name ? strdup(room_name) : NULL;
+    bookmark->autojoin = autojoin;
+    bookmark->ext_gajim_minimize = minimize;
+    g_hash_table_replace(bookmarks, strdup(barejid), bookmark);
+
+    if (join) {
+        sv_ev_bookmark_autojoin(bookmark);
+    }
+
+    Jid* jidp = jid_create(barejid);
+    if (jidp->domainpart) {
+        muc_confserver_add(jidp->domainpart);
+    }
+    jid_destroy(jidp);
+}
+
+static gboolean
+_bookmark_parse_autojoin(const char* const autojoin)
+{
+    return autojoin && (strcmp(autojoin, "1") == 0 || strcmp(autojoin, "true") == 0);
+}
+
+// we save minimize, which is not standard, so that we don't remove it if it was set by gajim
+static int
+_bookmark_parse_minimize(xmpp_stanza_t* const parent)
+{
+    int minimize = 0;
+    xmpp_stanza_t* minimize_st = xmpp_stanza_get_child_by_name_and_ns(parent, STANZA_NAME_MINIMIZE, STANZA_NS_EXT_GAJIM_BOOKMARKS);
+    if (minimize_st) {
+        char* min_str = xmpp_stanza_get_text(minimize_st);
+        if (g_strcmp0(min_str, "true") == 0) {
+            minimize = 1;
+        } else if (g_strcmp0(min_str, "false") == 0) {
+            minimize = 2;
+        }
+        free(min_str);
+    }
+
+    return minimize;
+}
+
+static char*
+_bookmark_child_text(xmpp_stanza_t* const parent, const char* const name)
+{
+    xmpp_stanza_t* child = xmpp_stanza_get_child_by_name(parent, name);
+    return child ? stanza_text_strdup(child) : NULL;
+}
+
+static int
+_bookmark_disco_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
+{
+    gboolean compat = FALSE;
+
+    const char* type = xmpp_stanza_get_type(stanza);
+    xmpp_stanza_t* query = xmpp_stanza_get_child_by_ns(stanza, XMPP_NS_DISCO_INFO);
+    if (g_strcmp0(type, STANZA_TYPE_RESULT) == 0 && query) {
+        xmpp_stanza_t* child = xmpp_stanza_get_children(query);
+        while (child && !compat) {
+            const char* name = xmpp_stanza_get_name(child);
+            if (g_strcmp0(name, STANZA_NAME_FEATURE) == 0) {
+                compat = g_strcmp0(xmpp_stanza_get_attribute(child, STANZA_ATTR_VAR), XMPP_FEATURE_BOOKMARKS_COMPAT) == 0;
+            }
+            child = xmpp_stanza_get_next(child);
+        }
+    }
+
+    if (!compat) {
+        _bookmark_storage_request();
+        return 0;
+    }
+
+    log_debug("Using PEP native bookmarks");
+    pep_bookmarks = TRUE;
+    message_pubsub_event_handler_add(STANZA_NS_BOOKMARKS, _bookmark_pep_event_handler, NULL, NULL);
+    caps_add_feature(STANZA_NS_BOOKMARKS_NOTIFY);
+
+    char* id = "bookmark_pep_request";
+    iq_id_handler_add(id, _bookmark_pep_result_id_handler, NULL, NULL);
+
+    xmpp_ctx_t* ctx = connection_get_ctx();
+    xmpp_stanza_t* iq = stanza_create_bookmarks_pep_request(ctx, id);
+    iq_send_stanza(iq);
+    xmpp_stanza_release(iq);
+
+    return 0;
+}
+
 static int
 _bookmark_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
 {
@@ -286,65 +420,106 @@ _bookmark_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
             continue;
         }
 
-        log_debug("Handle bookmark for %s", barejid);
+        _bookmark_store(barejid,
+                        xmpp_stanza_get_attribute(child, STANZA_ATTR_NAME),
+                        _bookmark_child_text(child, STANZA_NAME_NICK),
+                        _bookmark_child_text(child, STANZA_NAME_PASSWORD),
+                        _bookmark_parse_autojoin(xmpp_stanza_get_attribute(child, STANZA_ATTR_AUTOJOIN)),
+                        _bookmark_parse_minimize(child));
 
-        const char* room_name = xmpp_stanza_get_attribute(child, "name");
+        child = xmpp_stanza_get_next(child);
+    }
 
-        char* nick = NULL;
-        xmpp_stanza_t* nick_st = xmpp_stanza_get_child_by_name(child, "nick");
-        if (nick_st) {
-            nick = stanza_text_strdup(nick_st);
-        }
+    return 0;
+}
 
-        char* password = NULL;
-        xmpp_stanza_t* password_st = xmpp_stanza_get_child_by_name(child, "password");
-        if (password_st) {
-            password = stanza_text_strdup(password_st);
-        }
+// An item of the PEP bookmarks node, the item id is the room jid
+static void
+_bookmark_pep_item(xmpp_stanza_t* const item)
+{
+    const char* barejid = xmpp_stanza_get_id(item);
+    xmpp_stanza_t* conference = xmpp_stanza_get_child_by_name_and_ns(item, STANZA_NAME_CONFERENCE, STANZA_NS_BOOKMARKS);
+    if (!barejid || !conference) {
+        return;
+    }
 
-        const char* autojoin = xmpp_stanza_get_attribute(child, "autojoin");
-        gboolean autojoin_val = FALSE;
-        if (autojoin && (strcmp(autojoin, "1") == 0 || strcmp(autojoin, "true") == 0)) {
-            autojoin_val = TRUE;
-        }
+    int minimize = 0;
+    xmpp_stanza_t* extensions = xmpp_stanza_get_child_by_name(conference, STANZA_NAME_EXTENSIONS);
+    if (extensions) {
+        minimize = _bookmark_parse_minimize(extensions);
+    }
 
-        // we save minimize, which is not standard, so that we don't remove it if it was set by gajim
-        int minimize = 0;
-        xmpp_stanza_t* minimize_st = xmpp_stanza_get_child_by_name_and_ns(child, STANZA_NAME_MINIMIZE, STANZA_NS_EXT_GAJIM_BOOKMARKS);
-        if (minimize_st) {
-            char* min_str = xmpp_stanza_get_text(minimize_st);
-            if (strcmp(min_str, "true") == 0) {
-                minimize = 1;
-            } else if (strcmp(min_str, "false") == 0) {
-                minimize = 2;
-            }
-            free(min_str);
-        }
+    _bookmark_store(barejid,
+                    xmpp_stanza_get_attribute(conference, STANZA_ATTR_NAME),
+                    _bookmark_child_text(conference, STANZA_NAME_NICK),
+                    _bookmark_child_text(conference, STANZA_NAME_PASSWORD),
+                    _bookmark_parse_autojoin(xmpp_stanza_get_attribute(conference, STANZA_ATTR_AUTOJOIN)),
+                    minimize);
+}
+
+static int
+_bookmark_pep_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
+{
+    // an empty node is reported as item-not-found, there is nothing to load then
+    xmpp_stanza_t* pubsub = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_PUBSUB);
+    xmpp_stanza_t* items = pubsub ? xmpp_stanza_get_child_by_name(pubsub, STANZA_NAME_ITEMS) : NULL;
+    if (g_strcmp0(xmpp_stanza_get_type(stanza), STANZA_TYPE_RESULT) != 0 || !items) {
+        return 0;
+    }
 
-        autocomplete_add(bookmark_ac, barejid);
-        Bookmark* bookmark = malloc(sizeof(Bookmark));
-        bookmark->barejid = strdup(barejid);
-        bookmark->nick = nick;
-        bookmark->password = password;
-        bookmark->name = room_name ? strdup(room_name) : NULL;
-        bookmark->autojoin = autojoin_val;
-        bookmark->ext_gajim_minimize = minimize;
-        g_hash_table_insert(bookmarks, strdup(barejid), bookmark);
-
-        if (autojoin_val) {
-            sv_ev_bookmark_autojoin(bookmark);
+    xmpp_stanza_t* item = xmpp_stanza_get_children(items);
+    while (item) {
+        if (g_strcmp0(xmpp_stanza_get_name(item), STANZA_NAME_ITEM) == 0) {
+            _bookmark_pep_item(item);
         }
+        item = xmpp_stanza_get_next(item);
+    }
+
+    return 0;
+}
 
-        Jid* jidp = jid_create(barejid);
-        if (jidp->domainpart) {
-            muc_confserver_add(jidp->domainpart);
+// Applies published and retracted items one at a time
+static int
+_bookmark_pep_event_handler(xmpp_stanza_t* const stanza, void* const userdata)
+{
+    if (!pep_bookmarks) {
+        return TRUE;
+    }
+
+    const char* from = xmpp_stanza_get_from(stanza);
+    if (from) {
+        Jid* from_jid = jid_create(from);
+        char* barejid = connection_get_barejid();
+        gboolean own = from_jid && g_strcmp0(from_jid->barejid, barejid) == 0;
+        free(barejid);
+        jid_destroy(from_jid);
+        if (!own) {
+            return TRUE;
         }
-        jid_destroy(jidp);
+    }
+
+    xmpp_stanza_t* event = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_EVENT, STANZA_NS_PUBSUB_EVENT);
+    xmpp_stanza_t* items = event ? xmpp_stanza_get_child_by_name(event, STANZA_NAME_ITEMS) : NULL;
+    if (!items) {
+        return TRUE;
+    }
 
+    xmpp_stanza_t* child = xmpp_stanza_get_children(items);
+    while (child) {
+        const char* name = xmpp_stanza_get_name(child);
+        if (g_strcmp0(name, STANZA_NAME_ITEM) == 0) {
+            _bookmark_pep_item(child);
+        } else if (g_strcmp0(name, STANZA_NAME_RETRACT) == 0) {
+            const char* barejid = xmpp_stanza_get_id(child);
+            if (barejid) {
+                autocomplete_remove(bookmark_ac, barejid);
+                g_hash_table_remove(bookmarks, barejid);
+            }
+        }
         child = xmpp_stanza_get_next(child);
     }
 
-    return 0;
+    return TRUE;
 }
 
 static void
@@ -461,3 +636,88 @@ _send_bookmarks(void)
     iq_send_stanza(iq);
     xmpp_stanza_release(iq);
 }
+
+static void
+_bookmark_text_child(xmpp_ctx_t* ctx, xmpp_stanza_t* const parent, const char* const name, const char* const text)
+{
+    xmpp_stanza_t* child = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(child, name);
+    xmpp_stanza_t* child_text = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_text(child_text, text);
+    xmpp_stanza_add_child(child, child_text);
+    xmpp_stanza_add_child(parent, child);
+
+    xmpp_stanza_release(child_text);
+    xmpp_stanza_release(child);
+}
+
+// Publishes just this bookmark, or the whole list without PEP bookmarks
+static void
+_bookmark_save(Bookmark* bookmark)
+{
+    if (!pep_bookmarks) {
+        _send_bookmarks();
+        return;
+    }
+
+    xmpp_ctx_t* ctx = connection_get_ctx();
+
+    xmpp_stanza_t* conference = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(conference, STANZA_NAME_CONFERENCE);
+    xmpp_stanza_set_ns(conference, STANZA_NS_BOOKMARKS);
+    if (bookmark->name) {
+        xmpp_stanza_set_attribute(conference, STANZA_ATTR_NAME, bookmark->name);
+    }
+    xmpp_stanza_set_attribute(conference, STANZA_ATTR_AUTOJOIN, bookmark->autojoin ? "true" : "false");
+
+    if (bookmark->nick) {
+        _bookmark_text_child(ctx, conference, STANZA_NAME_NICK, bookmark->nick);
+    }
+    if (bookmark->password) {
+        _bookmark_text_child(ctx, conference, STANZA_NAME_PASSWORD, bookmark->password);
+    }
+
+    if (bookmark->ext_gajim_minimize == 1 || bookmark->ext_gajim_minimize == 2) {
+        xmpp_stanza_t* extensions = xmpp_stanza_new(ctx);
+        xmpp_stanza_set_name(extensions, STANZA_NAME_EXTENSIONS);
+        xmpp_stanza_t* minimize_st = xmpp_stanza_new(ctx);
+        xmpp_stanza_set_name(minimize_st, STANZA_NAME_MINIMIZE);
+        xmpp_stanza_set_ns(minimize_st, STANZA_NS_EXT_GAJIM_BOOKMARKS);
+        xmpp_stanza_t* minimize_text = xmpp_stanza_new(ctx);
+        xmpp_stanza_set_text(minimize_text, bookmark->ext_gajim_minimize == 1 ? "true" : "false");
+        xmpp_stanza_add_child(minimize_st, minimize_text);
+        xmpp_stanza_add_child(extensions, minimize_st);
+        xmpp_stanza_add_child(conference, extensions);
+
+        xmpp_stanza_release(minimize_text);
+        xmpp_stanza_release(minimize_st);
+        xmpp_stanza_release(extensions);
+    }
+
+    char* id = connection_create_stanza_id();
+    xmpp_stanza_t* iq = stanza_create_bookmarks_pep_publish(ctx, id, bookmark->barejid, conference);
+    free(id);
+    xmpp_stanza_release(conference);
+
+    stanza_attach_publish_options_va(ctx, iq,
+                                     6, // 2 * number of key-value pairs
+                                     "pubsub#persist_items", "true",
+                                     "pubsub#max_items", "max",
+                                     "pubsub#access_model", "whitelist");
+
+    iq_send_stanza(iq);
+    xmpp_stanza_release(iq);
+}
+
+static void
+_bookmark_retract(const char* const barejid)
+{
+    xmpp_ctx_t* ctx = connection_get_ctx();
+
+    char* id = connection_create_stanza_id();
+    xmpp_stanza_t* iq = stanza_create_bookmarks_pep_retract(ctx, id, barejid);
+    free(id);
+
+    iq_send_stanza(iq);
+    xmpp_stanza_release(iq);
+}
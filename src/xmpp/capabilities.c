@@ -53,13 +53,33 @@
 #include "plugins/plugins.h"
 #include "config/files.h"
 #include "config/preferences.h"
+#include "tools/intern.h"
+#include "tools/memusage.h"
+#include "tools/scheduler.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/stanza.h"
 #include "xmpp/form.h"
 #include "xmpp/capabilities.h"
+#include "xmpp/caps_cache.h"
+#include "xmpp/feature_atoms.h"
+
+// how long new cache entries wait before the cache file is rewritten
+#define CAPS_SAVE_DELAY_MS 5000
+
+// capabilities parsed from the cache, with their features as a set,
+// the ones profanity checks for also as bits
+typedef struct caps_entry_t
+{
+    EntityCapabilities* caps;
+    GHashTable* features;
+    FeatureSet known;
+} CapsEntry;
 
 static char* cache_loc;
-static GKeyFile* cache;
+static SchedulerTask* cache_save_task = NULL;
+
+// verification string to CapsEntry, filled from the cache on first lookup
+static GHashTable* ver_to_caps;
 
 static GHashTable* jid_to_ver;
 static GHashTable* jid_to_caps;
@@ -68,6 +88,11 @@ static GHashTable* prof_features;
 static char* my_sha1;
 
 static void _save_cache(void);
+static void _caps_migrate_keyfile(void);
+static EntityCapabilities* _caps_from_keyfile(GKeyFile* keyfile, const char* const ver);
+static void _save_cache_later(void);
+static CapsEntry* _caps_entry(const char* const ver);
+static void _caps_entry_free(CapsEntry* entry);
 static EntityCapabilities* _caps_by_ver(const char* const ver);
 static EntityCapabilities* _caps_by_jid(const char* const jid);
 static EntityCapabilities* _caps_copy(EntityCapabilities* caps);
@@ -76,17 +101,20 @@ void
 caps_init(void)
 {
     log_info("Loading capabilities cache");
-    cache_loc = files_get_data_path(FILE_CAPSCACHE);
+    cache_loc = files_get_data_path(FILE_CAPSCACHE_BIN);
 
     if (g_file_test(cache_loc, G_FILE_TEST_EXISTS)) {
         g_chmod(cache_loc, S_IRUSR | S_IWUSR);
     }
 
-    cache = g_key_file_new();
-    g_key_file_load_from_file(cache, cache_loc, G_KEY_FILE_KEEP_COMMENTS, NULL);
+    if (!capscache_open(cache_loc)) {
+        _caps_migrate_keyfile();
+    }
 
-    jid_to_ver = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
-    jid_to_caps = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)caps_destroy);
+    // many jids share a ver, jids and vers are interned
+    jid_to_ver = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)intern_unref, (GDestroyNotify)intern_unref);
+    jid_to_caps = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)intern_unref, (GDestroyNotify)caps_destroy);
+    ver_to_caps = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_caps_entry_free);
 
     prof_features = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
     g_hash_table_add(prof_features, strdup(STANZA_NS_CAPS));
@@ -103,6 +131,10 @@ caps_init(void)
         g_hash_table_add(prof_features, strdup(STANZA_NS_RECEIPTS));
     }
 
+    if (prefs_get_boolean(PREF_RECEIPTS_MARKERS)) {
+        g_hash_table_add(prof_features, strdup(STANZA_NS_CHAT_MARKERS));
+    }
+
     if (prefs_get_boolean(PREF_LASTACTIVITY)) {
         g_hash_table_add(prof_features, strdup(STANZA_NS_LASTACTIVITY));
     }
@@ -221,71 +253,30 @@ caps_add_by_ver(const char* const ver, EntityCapabilities* caps)
         return;
     }
 
-    gboolean cached = g_key_file_has_group(cache, ver);
-    if (cached) {
+    if (capscache_contains(ver)) {
         return;
     }
 
-    if (caps->identity) {
-        DiscoIdentity* identity = caps->identity;
-        if (identity->name) {
-            g_key_file_set_string(cache, ver, "name", identity->name);
-        }
-        if (identity->category) {
-            g_key_file_set_string(cache, ver, "category", identity->category);
-        }
-        if (identity->type) {
-            g_key_file_set_string(cache, ver, "type", identity->type);
-        }
-    }
-
-    if (caps->software_version) {
-        SoftwareVersion* software_version = caps->software_version;
-        if (software_version->software) {
-            g_key_file_set_string(cache, ver, "software", software_version->software);
-        }
-        if (software_version->software_version) {
-            g_key_file_set_string(cache, ver, "software_version", software_version->software_version);
-        }
-        if (software_version->os) {
-            g_key_file_set_string(cache, ver, "os", software_version->os);
-        }
-        if (software_version->os_version) {
-            g_key_file_set_string(cache, ver, "os_version", software_version->os_version);
-        }
-    }
-
-    if (caps->features) {
-        GSList* curr_feature = caps->features;
-        int num = g_slist_length(caps->features);
-        const gchar* features_list[num];
-        int curr = 0;
-        while (curr_feature) {
-            features_list[curr++] = curr_feature->data;
-            curr_feature = g_slist_next(curr_feature);
-        }
-        g_key_file_set_string_list(cache, ver, "features", features_list, num);
-    }
-
-    _save_cache();
+    capscache_add(ver, _caps_copy(caps));
+    _save_cache_later();
 }
 
 void
 caps_add_by_jid(const char* const jid, EntityCapabilities* caps)
 {
-    g_hash_table_insert(jid_to_caps, strdup(jid), caps);
+    g_hash_table_insert(jid_to_caps, (gpointer)intern(jid), caps);
 }
 
 void
 caps_map_jid_to_ver(const char* const jid, const char* const ver)
 {
-    g_hash_table_insert(jid_to_ver, strdup(jid), strdup(ver));
+    g_hash_table_insert(jid_to_ver, (gpointer)intern(jid), (gpointer)intern(ver));
 }
 
 gboolean
 caps_cache_contains(const char* const ver)
 {
-    return (g_key_file_has_group(cache, ver));
+    return capscache_contains(ver);
 }
 
 EntityCapabilities*
@@ -293,10 +284,10 @@ caps_lookup(const char* const jid)
 {
     char* ver = g_hash_table_lookup(jid_to_ver, jid);
     if (ver) {
-        EntityCapabilities* caps = _caps_by_ver(ver);
-        if (caps) {
+        CapsEntry* entry = _caps_entry(ver);
+        if (entry) {
             log_debug("Capabilities lookup %s, found by verification string %s.", jid, ver);
-            return caps;
+            return _caps_copy(entry->caps);
         }
     } else {
         EntityCapabilities* caps = _caps_by_jid(jid);
@@ -313,18 +304,26 @@ caps_lookup(const char* const jid)
 gboolean
 caps_jid_has_feature(const char* const jid, const char* const feature)
 {
-    EntityCapabilities* caps = caps_lookup(jid);
+    char* ver = g_hash_table_lookup(jid_to_ver, jid);
+    if (ver) {
+        CapsEntry* entry = _caps_entry(ver);
+        if (entry == NULL) {
+            return FALSE;
+        }
 
+        int atom = feature_atom(feature);
+        if (atom >= 0) {
+            return feature_set_has(entry->known, atom);
+        }
+        return g_hash_table_contains(entry->features, feature);
+    }
+
+    EntityCapabilities* caps = _caps_by_jid(jid);
     if (caps == NULL) {
         return FALSE;
     }
 
-    GSList* found = g_slist_find_custom(caps->features, feature, (GCompareFunc)g_strcmp0);
-    gboolean result = found != NULL;
-
-    caps_destroy(caps);
-
-    return result;
+    return g_slist_find_custom(caps->features, feature, (GCompareFunc)g_strcmp0) != NULL;
 }
 
 char*
@@ -351,10 +350,18 @@ caps_reset_ver(void)
 void
 caps_close(void)
 {
-    g_key_file_free(cache);
-    cache = NULL;
+    scheduler_remove(cache_save_task);
+    cache_save_task = NULL;
+    if (capscache_changed()) {
+        _save_cache();
+    }
+    capscache_close();
+    g_hash_table_destroy(ver_to_caps);
+    ver_to_caps = NULL;
     g_hash_table_destroy(jid_to_ver);
+    jid_to_ver = NULL;
     g_hash_table_destroy(jid_to_caps);
+    jid_to_caps = NULL;
     free(cache_loc);
     cache_loc = NULL;
     g_hash_table_destroy(prof_features);
@@ -363,6 +370,12 @@ caps_close(void)
 
 static EntityCapabilities*
 _caps_by_ver(const char* const ver)
+{
+    return capscache_get(ver);
+}
+
+static EntityCapabilities*
+_caps_from_keyfile(GKeyFile* cache, const char* const ver)
 {
     if (!g_key_file_has_group(cache, ver)) {
         return NULL;
@@ -406,6 +419,44 @@ _caps_by_ver(const char* const ver)
     return result;
 }
 
+static CapsEntry*
+_caps_entry(const char* const ver)
+{
+    CapsEntry* entry = g_hash_table_lookup(ver_to_caps, ver);
+    if (entry) {
+        return entry;
+    }
+
+    EntityCapabilities* caps = _caps_by_ver(ver);
+    if (caps == NULL) {
+        return NULL;
+    }
+
+    entry = malloc(sizeof(CapsEntry));
+    entry->caps = caps;
+    entry->features = g_hash_table_new(g_str_hash, g_str_equal);
+    entry->known = FEATURE_SET_EMPTY;
+    GSList* curr = caps->features;
+    while (curr) {
+        g_hash_table_add(entry->features, curr->data);
+        entry->known = feature_set_add(entry->known, curr->data);
+        curr = g_slist_next(curr);
+    }
+    g_hash_table_insert(ver_to_caps, strdup(ver), entry);
+
+    return entry;
+}
+
+static void
+_caps_entry_free(CapsEntry* entry)
+{
+    if (entry) {
+        g_hash_table_destroy(entry->features);
+        caps_destroy(entry->caps);
+        free(entry);
+    }
+}
+
 static EntityCapabilities*
 _caps_by_jid(const char* const jid)
 {
@@ -454,6 +505,80 @@ _software_version_destroy(SoftwareVersion* software_version)
     }
 }
 
+static gsize
+_caps_memory(EntityCapabilities* caps)
+{
+    if (!caps) {
+        return 0;
+    }
+
+    gsize total = memusage_alloc(sizeof(EntityCapabilities));
+    if (caps->identity) {
+        total += memusage_alloc(sizeof(DiscoIdentity)) + memusage_string(caps->identity->category);
+        total += memusage_string(caps->identity->name) + memusage_string(caps->identity->type);
+    }
+    if (caps->software_version) {
+        SoftwareVersion* version = caps->software_version;
+        total += memusage_alloc(sizeof(SoftwareVersion)) + memusage_string(version->software);
+        total += memusage_string(version->software_version) + memusage_string(version->os) + memusage_string(version->os_version);
+    }
+    total += memusage_slist(caps->features);
+    for (GSList* curr = caps->features; curr; curr = g_slist_next(curr)) {
+        total += memusage_string(curr->data);
+    }
+
+    return total;
+}
+
+// Rough heap use of the capabilities known by jid and by verification
+// string, entries is how many of both
+gsize
+caps_memory(guint* entries)
+{
+    *entries = 0;
+    if (!jid_to_caps) {
+        return 0;
+    }
+
+    gsize total = memusage_hash_table(jid_to_caps) + memusage_hash_table(ver_to_caps) + memusage_hash_table(jid_to_ver);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    *entries = g_hash_table_size(jid_to_caps) + g_hash_table_size(ver_to_caps);
+    // the interned jids and vers are counted with the interned strings
+    g_hash_table_iter_init(&iter, jid_to_caps);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        total += _caps_memory(value);
+    }
+
+    g_hash_table_iter_init(&iter, ver_to_caps);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        CapsEntry* entry = value;
+        // the feature set points at the strings of the capabilities
+        total += memusage_string(key) + memusage_alloc(sizeof(CapsEntry));
+        total += _caps_memory(entry->caps) + memusage_hash_table(entry->features);
+    }
+
+    return total;
+}
+
+// Entries waiting for the cache file are written now and the parsed ones
+// dropped, they are parsed again when next looked up
+void
+caps_trim(void)
+{
+    if (!ver_to_caps) {
+        return;
+    }
+
+    if (capscache_changed()) {
+        scheduler_remove(cache_save_task);
+        cache_save_task = NULL;
+        _save_cache();
+    }
+    g_hash_table_remove_all(ver_to_caps);
+}
+
 void
 caps_destroy(EntityCapabilities* caps)
 {
@@ -470,9 +595,53 @@ caps_destroy(EntityCapabilities* caps)
 static void
 _save_cache(void)
 {
-    gsize g_data_size;
-    gchar* g_cache_data = g_key_file_to_data(cache, &g_data_size, NULL);
-    g_file_set_contents(cache_loc, g_cache_data, g_data_size, NULL);
-    g_chmod(cache_loc, S_IRUSR | S_IWUSR);
-    g_free(g_cache_data);
+    capscache_save();
+}
+
+// moves the entries of the old keyfile cache into the binary one, once
+static void
+_caps_migrate_keyfile(void)
+{
+    gchar* legacy_loc = files_get_data_path(FILE_CAPSCACHE);
+
+    if (g_file_test(legacy_loc, G_FILE_TEST_EXISTS)) {
+        GKeyFile* legacy = g_key_file_new();
+        if (g_key_file_load_from_file(legacy, legacy_loc, G_KEY_FILE_NONE, NULL)) {
+            gsize count = 0;
+            gchar** vers = g_key_file_get_groups(legacy, &count);
+            for (gsize i = 0; i < count; i++) {
+                EntityCapabilities* caps = _caps_from_keyfile(legacy, vers[i]);
+                if (caps) {
+                    capscache_add(vers[i], caps);
+                }
+            }
+            g_strfreev(vers);
+
+            log_info("Migrating %" G_GSIZE_FORMAT " entries to the binary capabilities cache", count);
+            if (capscache_save()) {
+                g_remove(legacy_loc);
+            }
+        }
+        g_key_file_free(legacy);
+    }
+
+    g_free(legacy_loc);
+}
+
+static gboolean
+_save_cache_timed(void* data)
+{
+    cache_save_task = NULL;
+    _save_cache();
+
+    return FALSE;
+}
+
+// batches the rewrites of the cache file while a burst of presences brings in new entries
+static void
+_save_cache_later(void)
+{
+    if (cache_save_task == NULL) {
+        cache_save_task = scheduler_add(CAPS_SAVE_DELAY_MS, _save_cache_timed, NULL, NULL);
+    }
 }
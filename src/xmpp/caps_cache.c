@@ -0,0 +1,518 @@
+/*
+ * caps_cache.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+/*
+ * On disk capabilities cache, mapped into memory and read in place.
+ *
+ * Layout, all numbers are native guint32:
+ *   header
+ *   string offsets, one per string, into the string data
+ *   string data, NUL terminated strings, padded to 4 bytes
+ *   records, sorted by verification string
+ *   features, string indexes referenced by the records
+ *
+ * Entities seen during the session are kept in memory until the next save,
+ * which writes a new file with both and drops the least recently used
+ * entities past CAPSCACHE_MAX_ENTRIES.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "log.h"
+#include "xmpp/xmpp.h"
+#include "xmpp/capabilities.h"
+#include "xmpp/caps_cache.h"
+
+#define CAPSCACHE_MAGIC   "PCC\1"
+#define CAPSCACHE_VERSION 1
+#define CAPSCACHE_NONE    G_MAXUINT32
+
+enum {
+    FIELD_CATEGORY,
+    FIELD_TYPE,
+    FIELD_NAME,
+    FIELD_SOFTWARE,
+    FIELD_SOFTWARE_VERSION,
+    FIELD_OS,
+    FIELD_OS_VERSION,
+    FIELD_COUNT
+};
+
+typedef struct capscache_header_t
+{
+    char magic[4];
+    guint32 version;
+    guint32 size;
+    guint32 string_count;
+    guint32 strings_offset;
+    guint32 string_data_offset;
+    guint32 string_data_len;
+    guint32 record_count;
+    guint32 records_offset;
+    guint32 feature_count;
+    guint32 features_offset;
+} CapsCacheHeader;
+
+typedef struct capscache_record_t
+{
+    guint32 ver;
+    guint32 fields[FIELD_COUNT];
+    guint32 features_start;
+    guint32 features_count;
+    guint32 last_used;
+} CapsCacheRecord;
+
+typedef struct capscache_item_t
+{
+    const char* ver;
+    EntityCapabilities* caps;
+    guint32 last_used;
+} CapsCacheItem;
+
+static char* cache_path = NULL;
+static GMappedFile* mapped = NULL;
+static const CapsCacheHeader* header = NULL;
+static const guint32* string_offsets = NULL;
+static const char* string_data = NULL;
+static const CapsCacheRecord* records = NULL;
+static const guint32* features = NULL;
+
+// entities added since the last save, ver to EntityCapabilities
+static GHashTable* added = NULL;
+// entities looked up since the last save, ver to time last used
+static GHashTable* touched = NULL;
+
+static void
+_unmap(void)
+{
+    if (mapped) {
+        g_mapped_file_unref(mapped);
+    }
+    mapped = NULL;
+    header = NULL;
+    string_offsets = NULL;
+    string_data = NULL;
+    records = NULL;
+    features = NULL;
+}
+
+static gboolean
+_section_valid(guint32 offset, guint32 count, gsize item_size, gsize size)
+{
+    return offset % sizeof(guint32) == 0 && offset <= size && count <= (size - offset) / item_size;
+}
+
+// checks the sections fit the file, strings are checked when read
+static gboolean
+_map(const char* const path)
+{
+    GError* error = NULL;
+    mapped = g_mapped_file_new(path, FALSE, &error);
+    if (mapped == NULL) {
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            log_warning("Could not map capabilities cache %s: %s", path, error->message);
+        }
+        g_error_free(error);
+        return FALSE;
+    }
+
+    gsize size = g_mapped_file_get_length(mapped);
+    const char* contents = g_mapped_file_get_contents(mapped);
+    const CapsCacheHeader* head = (const CapsCacheHeader*)contents;
+
+    if (size < sizeof(CapsCacheHeader) || memcmp(head->magic, CAPSCACHE_MAGIC, 4) != 0
+        || head->version != CAPSCACHE_VERSION || head->size != size
+        || !_section_valid(head->strings_offset, head->string_count, sizeof(guint32), size)
+        || !_section_valid(head->string_data_offset, head->string_data_len, 1, size)
+        || !_section_valid(head->records_offset, head->record_count, sizeof(CapsCacheRecord), size)
+        || !_section_valid(head->features_offset, head->feature_count, sizeof(guint32), size)
+        || head->string_data_len == 0 || contents[head->string_data_offset + head->string_data_len - 1] != '\0') {
+        log_warning("Ignoring invalid capabilities cache %s", path);
+        _unmap();
+        return FALSE;
+    }
+
+    header = head;
+    string_offsets = (const guint32*)(contents + head->strings_offset);
+    string_data = contents + head->string_data_offset;
+    records = (const CapsCacheRecord*)(contents + head->records_offset);
+    features = (const guint32*)(contents + head->features_offset);
+
+    return TRUE;
+}
+
+static const char*
+_string(guint32 index)
+{
+    if (index == CAPSCACHE_NONE || index >= header->string_count) {
+        return NULL;
+    }
+    guint32 offset = string_offsets[index];
+    if (offset >= header->string_data_len) {
+        return NULL;
+    }
+
+    return string_data + offset;
+}
+
+static const CapsCacheRecord*
+_find_record(const char* const ver)
+{
+    if (header == NULL) {
+        return NULL;
+    }
+
+    guint32 low = 0;
+    guint32 high = header->record_count;
+    while (low < high) {
+        guint32 mid = low + (high - low) / 2;
+        int cmp = g_strcmp0(_string(records[mid].ver), ver);
+        if (cmp == 0) {
+            return &records[mid];
+        } else if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return NULL;
+}
+
+static EntityCapabilities*
+_record_to_caps(const CapsCacheRecord* record)
+{
+    GSList* feature_list = NULL;
+    if (record->features_start <= header->feature_count
+        && record->features_count <= header->feature_count - record->features_start) {
+        for (guint32 i = record->features_count; i > 0; i--) {
+            const char* feature = _string(features[record->features_start + i - 1]);
+            if (feature) {
+                feature_list = g_slist_prepend(feature_list, (char*)feature);
+            }
+        }
+    }
+
+    EntityCapabilities* caps = caps_create(
+        _string(record->fields[FIELD_CATEGORY]), _string(record->fields[FIELD_TYPE]), _string(record->fields[FIELD_NAME]),
+        _string(record->fields[FIELD_SOFTWARE]), _string(record->fields[FIELD_SOFTWARE_VERSION]),
+        _string(record->fields[FIELD_OS]), _string(record->fields[FIELD_OS_VERSION]),
+        feature_list);
+    g_slist_free(feature_list);
+
+    return caps;
+}
+
+gboolean
+capscache_open(const char* const path)
+{
+    capscache_close();
+
+    cache_path = strdup(path);
+    added = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)caps_destroy);
+    touched = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+
+    return _map(path);
+}
+
+gboolean
+capscache_contains(const char* const ver)
+{
+    if (added && g_hash_table_contains(added, ver)) {
+        return TRUE;
+    }
+
+    return _find_record(ver) != NULL;
+}
+
+// new capabilities the caller must free, NULL when not cached
+EntityCapabilities*
+capscache_get(const char* const ver)
+{
+    EntityCapabilities* caps = NULL;
+
+    EntityCapabilities* new_caps = added ? g_hash_table_lookup(added, ver) : NULL;
+    if (new_caps) {
+        caps = caps_create(
+            new_caps->identity ? new_caps->identity->category : NULL,
+            new_caps->identity ? new_caps->identity->type : NULL,
+            new_caps->identity ? new_caps->identity->name : NULL,
+            new_caps->software_version ? new_caps->software_version->software : NULL,
+            new_caps->software_version ? new_caps->software_version->software_version : NULL,
+            new_caps->software_version ? new_caps->software_version->os : NULL,
+            new_caps->software_version ? new_caps->software_version->os_version : NULL,
+            new_caps->features);
+    } else {
+        const CapsCacheRecord* record = _find_record(ver);
+        if (record) {
+            caps = _record_to_caps(record);
+        }
+    }
+
+    if (caps && touched) {
+        g_hash_table_replace(touched, strdup(ver), GUINT_TO_POINTER((guint32)(g_get_real_time() / G_USEC_PER_SEC)));
+    }
+
+    return caps;
+}
+
+// takes ownership of caps
+void
+capscache_add(const char* const ver, EntityCapabilities* caps)
+{
+    if (added == NULL || capscache_contains(ver)) {
+        caps_destroy(caps);
+        return;
+    }
+
+    g_hash_table_insert(added, strdup(ver), caps);
+    g_hash_table_replace(touched, strdup(ver), GUINT_TO_POINTER((guint32)(g_get_real_time() / G_USEC_PER_SEC)));
+}
+
+gboolean
+capscache_changed(void)
+{
+    return touched && g_hash_table_size(touched) > 0;
+}
+
+static gint
+_compare_items_last_used(gconstpointer a, gconstpointer b)
+{
+    const CapsCacheItem* item_a = a;
+    const CapsCacheItem* item_b = b;
+
+    if (item_a->last_used == item_b->last_used) {
+        return 0;
+    }
+    return item_a->last_used > item_b->last_used ? -1 : 1;
+}
+
+static gint
+_compare_items_ver(gconstpointer a, gconstpointer b)
+{
+    return g_strcmp0(((const CapsCacheItem*)a)->ver, ((const CapsCacheItem*)b)->ver);
+}
+
+static guint32
+_intern(GHashTable* strings, GByteArray* data, GArray* offsets, const char* const str)
+{
+    if (str == NULL) {
+        return CAPSCACHE_NONE;
+    }
+
+    gpointer index;
+    if (g_hash_table_lookup_extended(strings, str, NULL, &index)) {
+        return GPOINTER_TO_UINT(index);
+    }
+
+    guint32 offset = data->len;
+    g_byte_array_append(data, (const guint8*)str, strlen(str) + 1);
+    g_array_append_val(offsets, offset);
+    guint32 new_index = offsets->len - 1;
+    g_hash_table_insert(strings, (gpointer)str, GUINT_TO_POINTER(new_index));
+
+    return new_index;
+}
+
+static void
+_pad(GByteArray* data)
+{
+    static const guint8 zeros[sizeof(guint32)] = { 0 };
+    if (data->len % sizeof(guint32)) {
+        g_byte_array_append(data, zeros, sizeof(guint32) - data->len % sizeof(guint32));
+    }
+}
+
+gboolean
+capscache_save(void)
+{
+    if (cache_path == NULL) {
+        return FALSE;
+    }
+
+    // everything currently known, whether mapped or added this session
+    GArray* items = g_array_new(FALSE, FALSE, sizeof(CapsCacheItem));
+    if (header) {
+        for (guint32 i = 0; i < header->record_count; i++) {
+            CapsCacheItem item;
+            item.ver = _string(records[i].ver);
+            if (item.ver == NULL || g_hash_table_contains(added, item.ver)) {
+                continue;
+            }
+            item.caps = NULL;
+            item.last_used = records[i].last_used;
+            g_array_append_val(items, item);
+        }
+    }
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, added);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        CapsCacheItem item = { key, value, 0 };
+        g_array_append_val(items, item);
+    }
+    for (guint i = 0; i < items->len; i++) {
+        CapsCacheItem* item = &g_array_index(items, CapsCacheItem, i);
+        gpointer last_used;
+        if (g_hash_table_lookup_extended(touched, item->ver, NULL, &last_used)) {
+            item->last_used = GPOINTER_TO_UINT(last_used);
+        }
+    }
+
+    // drop the least recently used past the limit, then order for lookups
+    if (items->len > CAPSCACHE_MAX_ENTRIES) {
+        g_array_sort(items, _compare_items_last_used);
+        g_array_set_size(items, CAPSCACHE_MAX_ENTRIES);
+    }
+    g_array_sort(items, _compare_items_ver);
+
+    GHashTable* strings = g_hash_table_new(g_str_hash, g_str_equal);
+    GByteArray* data = g_byte_array_new();
+    GArray* offsets = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GArray* recs = g_array_sized_new(FALSE, FALSE, sizeof(CapsCacheRecord), items->len);
+    GArray* feats = g_array_new(FALSE, FALSE, sizeof(guint32));
+    GSList* materialized = NULL;
+
+    for (guint i = 0; i < items->len; i++) {
+        CapsCacheItem* item = &g_array_index(items, CapsCacheItem, i);
+        EntityCapabilities* caps = item->caps;
+        if (caps == NULL) {
+            caps = _record_to_caps(_find_record(item->ver));
+            materialized = g_slist_prepend(materialized, caps);
+        }
+
+        DiscoIdentity* identity = caps->identity;
+        SoftwareVersion* software = caps->software_version;
+
+        CapsCacheRecord rec;
+        rec.ver = _intern(strings, data, offsets, item->ver);
+        rec.fields[FIELD_CATEGORY] = _intern(strings, data, offsets, identity ? identity->category : NULL);
+        rec.fields[FIELD_TYPE] = _intern(strings, data, offsets, identity ? identity->type : NULL);
+        rec.fields[FIELD_NAME] = _intern(strings, data, offsets, identity ? identity->name : NULL);
+        rec.fields[FIELD_SOFTWARE] = _intern(strings, data, offsets, software ? software->software : NULL);
+        rec.fields[FIELD_SOFTWARE_VERSION] = _intern(strings, data, offsets, software ? software->software_version : NULL);
+        rec.fields[FIELD_OS] = _intern(strings, data, offsets, software ? software->os : NULL);
+        rec.fields[FIELD_OS_VERSION] = _intern(strings, data, offsets, software ? software->os_version : NULL);
+        rec.features_start = feats->len;
+        GSList* curr = caps->features;
+        while (curr) {
+            guint32 feature = _intern(strings, data, offsets, curr->data);
+            g_array_append_val(feats, feature);
+            curr = g_slist_next(curr);
+        }
+        rec.features_count = feats->len - rec.features_start;
+        rec.last_used = item->last_used;
+        g_array_append_val(recs, rec);
+    }
+
+    // an empty string keeps the string data non empty
+    if (data->len == 0) {
+        g_byte_array_append(data, (const guint8*)"", 1);
+    }
+
+    CapsCacheHeader head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, CAPSCACHE_MAGIC, 4);
+    head.version = CAPSCACHE_VERSION;
+    head.string_count = offsets->len;
+    head.strings_offset = sizeof(CapsCacheHeader);
+    head.string_data_offset = head.strings_offset + offsets->len * sizeof(guint32);
+    head.string_data_len = data->len;
+    _pad(data);
+    head.record_count = recs->len;
+    head.records_offset = head.string_data_offset + data->len;
+    head.feature_count = feats->len;
+    head.features_offset = head.records_offset + recs->len * sizeof(CapsCacheRecord);
+    head.size = head.features_offset + feats->len * sizeof(guint32);
+
+    GByteArray* out = g_byte_array_sized_new(head.size);
+    g_byte_array_append(out, (const guint8*)&head, sizeof(head));
+    g_byte_array_append(out, (const guint8*)offsets->data, offsets->len * sizeof(guint32));
+    g_byte_array_append(out, data->data, data->len);
+    g_byte_array_append(out, (const guint8*)recs->data, recs->len * sizeof(CapsCacheRecord));
+    g_byte_array_append(out, (const guint8*)feats->data, feats->len * sizeof(guint32));
+
+    // strings are borrowed from the items, so write before freeing them
+    GError* error = NULL;
+    gboolean saved = g_file_set_contents(cache_path, (const gchar*)out->data, out->len, &error);
+    if (saved) {
+        g_chmod(cache_path, S_IRUSR | S_IWUSR);
+    } else {
+        log_error("Could not save capabilities cache %s: %s", cache_path, error->message);
+        g_error_free(error);
+    }
+
+    g_byte_array_free(out, TRUE);
+    g_slist_free_full(materialized, (GDestroyNotify)caps_destroy);
+    g_array_free(feats, TRUE);
+    g_array_free(recs, TRUE);
+    g_array_free(offsets, TRUE);
+    g_byte_array_free(data, TRUE);
+    g_hash_table_destroy(strings);
+    g_array_free(items, TRUE);
+
+    // the renamed file replaces the mapping, what was added now lives there
+    if (saved) {
+        _unmap();
+        g_hash_table_remove_all(added);
+        g_hash_table_remove_all(touched);
+        _map(cache_path);
+    }
+
+    return saved;
+}
+
+void
+capscache_close(void)
+{
+    _unmap();
+    if (added) {
+        g_hash_table_destroy(added);
+        added = NULL;
+    }
+    if (touched) {
+        g_hash_table_destroy(touched);
+        touched = NULL;
+    }
+    free(cache_path);
+    cache_path = NULL;
+}
@@ -0,0 +1,55 @@
+/*
+ * caps_cache.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef XMPP_CAPS_CACHE_H
+#define XMPP_CAPS_CACHE_H
+
+#include <glib.h>
+
+#include "xmpp/xmpp.h"
+
+// most entities kept on disk, the least recently seen are dropped first
+#define CAPSCACHE_MAX_ENTRIES 2000
+
+gboolean capscache_open(const char* const path);
+gboolean capscache_contains(const char* const ver);
+EntityCapabilities* capscache_get(const char* const ver);
+void capscache_add(const char* const ver, EntityCapabilities* caps);
+gboolean capscache_changed(void);
+gboolean capscache_save(void);
+void capscache_close(void);
+
+#endif
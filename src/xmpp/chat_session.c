@@ -43,11 +43,14 @@
 
 #include "log.h"
 #include "config/preferences.h"
+#include "tools/intern.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/stanza.h"
 #include "xmpp/chat_session.h"
 
 static GHashTable* sessions;
+// bumped whenever a session is added, changed or removed
+static guint generation = 0;
 
 static void
 _chat_session_new(const char* const barejid, const char* const resource, gboolean resource_override,
@@ -57,20 +60,21 @@ _chat_session_new(const char* const barejid, const char* const resource, gboolea
     assert(resource != NULL);
 
     ChatSession* new_session = malloc(sizeof(struct chat_session_t));
-    new_session->barejid = strdup(barejid);
-    new_session->resource = strdup(resource);
+    new_session->barejid = intern(barejid);
+    new_session->resource = intern(resource);
     new_session->resource_override = resource_override;
     new_session->send_states = send_states;
 
-    g_hash_table_replace(sessions, strdup(barejid), new_session);
+    g_hash_table_replace(sessions, (gpointer)intern_ref(new_session->barejid), new_session);
+    generation++;
 }
 
 static void
 _chat_session_free(ChatSession* session)
 {
     if (session) {
-        free(session->barejid);
-        free(session->resource);
+        intern_unref(session->barejid);
+        intern_unref(session->resource);
         free(session);
     }
 }
@@ -82,7 +86,8 @@ chat_sessions_init(void)
         g_hash_table_destroy(sessions);
     }
 
-    sessions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_chat_session_free);
+    sessions = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)intern_unref, (GDestroyNotify)_chat_session_free);
+    generation++;
 }
 
 void
@@ -90,6 +95,7 @@ chat_sessions_clear(void)
 {
     if (sessions)
         g_hash_table_remove_all(sessions);
+    generation++;
 }
 
 void
@@ -104,6 +110,13 @@ chat_session_get(const char* const barejid)
     return g_hash_table_lookup(sessions, barejid);
 }
 
+// Lets callers keep what they looked up until the sessions change
+guint
+chat_session_generation(void)
+{
+    return generation;
+}
+
 char*
 chat_session_get_jid(const char* const barejid)
 {
@@ -181,7 +194,10 @@ chat_session_recipient_active(const char* const barejid, const char* const resou
     if (session) {
         // session exists with resource, update chat_states
         if (g_strcmp0(session->resource, resource) == 0) {
-            session->send_states = send_states;
+            if (session->send_states != send_states) {
+                session->send_states = send_states;
+                generation++;
+            }
             // session exists with different resource and no override, replace
         } else if (!session->resource_override) {
             _chat_session_new(barejid, resource, FALSE, send_states);
@@ -197,4 +213,5 @@ void
 chat_session_remove(const char* const barejid)
 {
     g_hash_table_remove(sessions, barejid);
+    generation++;
 }
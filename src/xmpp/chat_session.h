@@ -40,8 +40,9 @@
 
 typedef struct chat_session_t
 {
-    char* barejid;
-    char* resource;
+    // interned
+    const char* barejid;
+    const char* resource;
     gboolean resource_override;
     gboolean send_states;
 
@@ -52,6 +53,7 @@ void chat_sessions_clear(void);
 
 void chat_session_resource_override(const char* const barejid, const char* const resource);
 ChatSession* chat_session_get(const char* const barejid);
+guint chat_session_generation(void);
 
 void chat_session_recipient_active(const char* const barejid, const char* const resource, gboolean send_states);
 void chat_session_recipient_typing(const char* const barejid, const char* const resource);
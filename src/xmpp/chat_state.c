@@ -41,23 +41,33 @@
 #include <glib.h>
 
 #include "config/preferences.h"
+#include "tools/scheduler.h"
 #include "ui/window_list.h"
 #include "ui/win_types.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/chat_state.h"
 #include "xmpp/chat_session.h"
 
-#define PAUSED_TIMEOUT   10.0
-#define INACTIVE_TIMEOUT 30.0
+// seconds
+#define PAUSED_TIMEOUT   10
+#define INACTIVE_TIMEOUT 30
 
-static void _send_if_supported(const char* const barejid, void (*send_func)(const char* const));
+// runs when the next chat state is due to change on its own
+static SchedulerTask* idle_task = NULL;
+static gint64 idle_deadline = 0;
+
+static void _send_if_supported(const char* const barejid, ChatState* state, void (*send_func)(const char* const));
+static void _chat_state_set(ChatState* state, chat_state_type_t type);
 
 ChatState*
 chat_state_new(void)
 {
     ChatState* new_state = malloc(sizeof(struct prof_chat_state_t));
     new_state->type = CHAT_STATE_GONE;
-    new_state->timer = g_timer_new();
+    new_state->since = g_get_monotonic_time();
+    new_state->cached = FALSE;
+    new_state->session_generation = 0;
+    new_state->jid = NULL;
 
     return new_state;
 }
@@ -65,57 +75,142 @@ chat_state_new(void)
 void
 chat_state_free(ChatState* state)
 {
-    if (state && state->timer != NULL) {
-        g_timer_destroy(state->timer);
+    if (state) {
+        g_free(state->jid);
     }
     free(state);
 }
 
+// monotonic time after which the state changes without typing, 0 for never
+static gint64
+_chat_state_deadline(ChatState* state)
+{
+    switch (state->type) {
+    case CHAT_STATE_COMPOSING:
+        return state->since + (gint64)PAUSED_TIMEOUT * G_USEC_PER_SEC;
+    case CHAT_STATE_PAUSED:
+    case CHAT_STATE_ACTIVE:
+        return state->since + (gint64)INACTIVE_TIMEOUT * G_USEC_PER_SEC;
+    case CHAT_STATE_INACTIVE:
+        if (prefs_get_gone() == 0) {
+            return 0;
+        }
+        return state->since + (gint64)prefs_get_gone() * 60 * G_USEC_PER_SEC;
+    default:
+        return 0;
+    }
+}
+
+static guint
+_ms_until(gint64 deadline)
+{
+    gint64 remaining = deadline - g_get_monotonic_time();
+
+    // the states change once their timeout has passed, not on it
+    return remaining > 0 ? remaining / 1000 + 1 : 1;
+}
+
+static gboolean
+_chat_state_idle_task(void* data)
+{
+    gboolean connected = connection_get_status() == JABBER_CONNECTED;
+    gint64 next = 0;
+
+    GSList* recipients = wins_get_chat_recipients();
+    for (GSList* curr = recipients; curr; curr = g_slist_next(curr)) {
+        ProfChatWin* chatwin = wins_get_chat(curr->data);
+        if (connected) {
+            chat_state_handle_idle(chatwin->barejid, chatwin->state);
+        }
+        gint64 deadline = _chat_state_deadline(chatwin->state);
+        if (deadline != 0 && (next == 0 || deadline < next)) {
+            next = deadline;
+        }
+    }
+    g_slist_free(recipients);
+
+    if (next == 0) {
+        idle_task = NULL;
+        return FALSE;
+    }
+
+    // nothing is sent while disconnected, look again later
+    if (!connected) {
+        next = MAX(next, g_get_monotonic_time() + (gint64)INACTIVE_TIMEOUT * G_USEC_PER_SEC);
+    }
+
+    idle_deadline = next;
+    scheduler_set_interval(idle_task, _ms_until(next));
+
+    return TRUE;
+}
+
+static void
+_chat_state_schedule(ChatState* state)
+{
+    gint64 deadline = _chat_state_deadline(state);
+    if (deadline == 0) {
+        return;
+    }
+
+    if (idle_task == NULL) {
+        idle_task = scheduler_add(_ms_until(deadline), _chat_state_idle_task, NULL, NULL);
+        idle_deadline = deadline;
+    } else if (deadline < idle_deadline) {
+        scheduler_set_interval(idle_task, _ms_until(deadline));
+        idle_deadline = deadline;
+    }
+}
+
+static void
+_chat_state_set(ChatState* state, chat_state_type_t type)
+{
+    state->type = type;
+    state->since = g_get_monotonic_time();
+    _chat_state_schedule(state);
+}
+
 void
 chat_state_handle_idle(const char* const barejid, ChatState* state)
 {
-    gdouble elapsed = g_timer_elapsed(state->timer, NULL);
+    gint64 elapsed = g_get_monotonic_time() - state->since;
 
     // TYPING -> PAUSED
-    if (state->type == CHAT_STATE_COMPOSING && elapsed > PAUSED_TIMEOUT) {
-        state->type = CHAT_STATE_PAUSED;
-        g_timer_start(state->timer);
+    if (state->type == CHAT_STATE_COMPOSING && elapsed > (gint64)PAUSED_TIMEOUT * G_USEC_PER_SEC) {
+        _chat_state_set(state, CHAT_STATE_PAUSED);
         if (prefs_get_boolean(PREF_STATES) && prefs_get_boolean(PREF_OUTTYPE)) {
-            _send_if_supported(barejid, message_send_paused);
+            _send_if_supported(barejid, state, message_send_paused);
         }
         return;
     }
 
     // PAUSED|ACTIVE -> INACTIVE
-    if ((state->type == CHAT_STATE_PAUSED || state->type == CHAT_STATE_ACTIVE) && elapsed > INACTIVE_TIMEOUT) {
-        state->type = CHAT_STATE_INACTIVE;
-        g_timer_start(state->timer);
+    if ((state->type == CHAT_STATE_PAUSED || state->type == CHAT_STATE_ACTIVE) && elapsed > (gint64)INACTIVE_TIMEOUT * G_USEC_PER_SEC) {
+        _chat_state_set(state, CHAT_STATE_INACTIVE);
         if (prefs_get_boolean(PREF_STATES)) {
-            _send_if_supported(barejid, message_send_inactive);
+            _send_if_supported(barejid, state, message_send_inactive);
         }
         return;
     }
 
     // INACTIVE -> GONE
     if (state->type == CHAT_STATE_INACTIVE) {
-        if (prefs_get_gone() != 0 && (elapsed > (prefs_get_gone() * 60.0))) {
+        if (prefs_get_gone() != 0 && (elapsed > (gint64)prefs_get_gone() * 60 * G_USEC_PER_SEC)) {
             ChatSession* session = chat_session_get(barejid);
             if (session) {
                 // never move to GONE when resource override
                 if (!session->resource_override) {
                     if (prefs_get_boolean(PREF_STATES)) {
-                        _send_if_supported(barejid, message_send_gone);
+                        _send_if_supported(barejid, state, message_send_gone);
                     }
                     chat_session_remove(barejid);
-                    state->type = CHAT_STATE_GONE;
-                    g_timer_start(state->timer);
+                    _chat_state_set(state, CHAT_STATE_GONE);
                 }
             } else {
                 if (prefs_get_boolean(PREF_STATES)) {
                     message_send_gone(barejid);
                 }
-                state->type = CHAT_STATE_GONE;
-                g_timer_start(state->timer);
+                _chat_state_set(state, CHAT_STATE_GONE);
             }
             return;
         }
@@ -127,10 +222,9 @@ chat_state_handle_typing(const char* const barejid, ChatState* state)
 {
     // ACTIVE|INACTIVE|PAUSED|GONE -> COMPOSING
     if (state->type != CHAT_STATE_COMPOSING) {
-        state->type = CHAT_STATE_COMPOSING;
-        g_timer_start(state->timer);
+        _chat_state_set(state, CHAT_STATE_COMPOSING);
         if (prefs_get_boolean(PREF_STATES) && prefs_get_boolean(PREF_OUTTYPE)) {
-            _send_if_supported(barejid, message_send_composing);
+            _send_if_supported(barejid, state, message_send_composing);
         }
     }
 }
@@ -138,8 +232,7 @@ chat_state_handle_typing(const char* const barejid, ChatState* state)
 void
 chat_state_active(ChatState* state)
 {
-    state->type = CHAT_STATE_ACTIVE;
-    g_timer_start(state->timer);
+    _chat_state_set(state, CHAT_STATE_ACTIVE);
 }
 
 void
@@ -147,41 +240,19 @@ chat_state_gone(const char* const barejid, ChatState* state)
 {
     if (state->type != CHAT_STATE_GONE) {
         if (prefs_get_boolean(PREF_STATES)) {
-            _send_if_supported(barejid, message_send_gone);
-        }
-        state->type = CHAT_STATE_GONE;
-        g_timer_start(state->timer);
-    }
-}
-
-void
-chat_state_idle(void)
-{
-    jabber_conn_status_t status = connection_get_status();
-    if (status == JABBER_CONNECTED) {
-        GSList* recipients = wins_get_chat_recipients();
-        GSList* curr = recipients;
-
-        while (curr) {
-            char* barejid = curr->data;
-            ProfChatWin* chatwin = wins_get_chat(barejid);
-            chat_state_handle_idle(chatwin->barejid, chatwin->state);
-            curr = g_slist_next(curr);
-        }
-
-        if (recipients) {
-            g_slist_free(recipients);
+            _send_if_supported(barejid, state, message_send_gone);
         }
+        _chat_state_set(state, CHAT_STATE_GONE);
     }
 }
 
+// Called for every key typed, only a change to COMPOSING does any work
 void
 chat_state_activity(void)
 {
-    jabber_conn_status_t status = connection_get_status();
     ProfWin* current = wins_get_current();
 
-    if ((status == JABBER_CONNECTED) && (current->type == WIN_CHAT)) {
+    if (current->type == WIN_CHAT && connection_get_status() == JABBER_CONNECTED) {
         ProfChatWin* chatwin = (ProfChatWin*)current;
         assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
         chat_state_handle_typing(chatwin->barejid, chatwin->state);
@@ -189,23 +260,25 @@ chat_state_activity(void)
 }
 
 static void
-_send_if_supported(const char* const barejid, void (*send_func)(const char* const))
+_send_if_supported(const char* const barejid, ChatState* state, void (*send_func)(const char* const))
 {
-    gboolean send = TRUE;
-    GString* jid = g_string_new(barejid);
-    ChatSession* session = chat_session_get(barejid);
-    if (session) {
-        if (session->send_states) {
-            g_string_append(jid, "/");
-            g_string_append(jid, session->resource);
-        } else {
-            send = FALSE;
+    // the session is only looked up again once it may have changed
+    guint generation = chat_session_generation();
+    if (!state->cached || state->session_generation != generation) {
+        g_free(state->jid);
+        state->jid = NULL;
+
+        ChatSession* session = chat_session_get(barejid);
+        if (!session) {
+            state->jid = g_strdup(barejid);
+        } else if (session->send_states) {
+            state->jid = g_strdup_printf("%s/%s", barejid, session->resource);
         }
+        state->cached = TRUE;
+        state->session_generation = generation;
     }
 
-    if (send) {
-        send_func(jid->str);
+    if (state->jid) {
+        send_func(state->jid);
     }
-
-    g_string_free(jid, TRUE);
 }
@@ -49,13 +49,18 @@ typedef enum {
 typedef struct prof_chat_state_t
 {
     chat_state_type_t type;
-    GTimer* timer;
+    // monotonic time of the last change, in microseconds
+    gint64 since;
+    // jid the states go to, NULL when the contact does not want them.
+    // Valid while the chat sessions are still at session_generation.
+    gboolean cached;
+    guint session_generation;
+    char* jid;
 } ChatState;
 
 ChatState* chat_state_new(void);
 void chat_state_free(ChatState* state);
 
-void chat_state_idle(void);
 void chat_state_activity(void);
 
 void chat_state_handle_idle(const char* const barejid, ChatState* state);
@@ -39,6 +39,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -54,6 +59,12 @@
 #include "xmpp/session.h"
 #include "xmpp/stanza.h"
 #include "xmpp/iq.h"
+#include "xmpp/iq_future.h"
+#include "xmpp/feature_atoms.h"
+#include "xmpp/recorder.h"
+#include "xmpp/resolver.h"
+#include "tools/mempool.h"
+#include "tools/scheduler.h"
 #include "ui/ui.h"
 
 typedef struct prof_conn_t
@@ -61,6 +72,8 @@ typedef struct prof_conn_t
     xmpp_log_t* xmpp_log;
     xmpp_ctx_t* xmpp_ctx;
     xmpp_conn_t* xmpp_conn;
+    // socket of the current connection, handed over by libstrophe
+    int xmpp_fd;
     gboolean xmpp_in_event_loop;
     jabber_conn_status_t conn_status;
     xmpp_conn_event_t conn_last_event;
@@ -69,7 +82,29 @@ typedef struct prof_conn_t
     char* domain;
     GHashTable* available_resources;
     GHashTable* features_by_jid;
+    // known features offered by any entity in features_by_jid
+    FeatureSet features_known;
     GHashTable* requested_features;
+    // entities whose disco#info came in on this connection, others may be
+    // known from the disco cache only
+    GHashTable* features_fresh;
+    // caps hash of the server's disco#info in the cache
+    char* cached_ver;
+    gboolean features_announced;
+#ifdef HAVE_LIBSTROPHE_SM
+    // XEP-0198 state of the lost stream, handed to the next connect to resume it
+    xmpp_sm_state_t* sm_state;
+#endif
+    // the state was handed to the current connect
+    gboolean resume_requested;
+    gboolean stream_resumed;
+    // where the current connect goes, with the resolved addresses not tried yet
+    char* connect_domain;
+    char* connect_host;
+    int connect_port;
+    gboolean connect_direct_tls;
+    GList* connect_addresses;
+    SchedulerTask* connect_retry;
 } ProfConnection;
 
 typedef struct
@@ -78,59 +113,301 @@ typedef struct
     const char* password;
 } prof_reg_t;
 
+// how long a burst from the server is read before the main loop gets back
+// to the screen, unless a key is pressed earlier
+#define CONNECTION_DRAIN_MS 10
+
+// disco#info requests sent together are given up together, an item not
+// answering by then keeps what was cached of it
+#define CONNECTION_DISCO_TIMEOUT_MS (15 * 1000)
+
 static ProfConnection conn;
+// libstrophe allocates every stanza node, attribute and text buffer of a
+// parse through it, the blocks a released stanza frees serve the next one
+static MemPool* xmpp_pool = NULL;
+static xmpp_mem_t xmpp_mem;
 static gchar* profanity_instance_id = NULL;
 static gchar* prof_identifier = NULL;
 
+// Stanza ids are a unique prefix of CON_RAND_ID_LEN characters followed by
+// the hex SHA-1 HMAC of it keyed with the identifier, so our own messages
+// can be recognised. The prefix is random per connection with a counter at
+// its end, the HMAC is keyed once and copied for each id.
+#define STANZA_ID_COUNTER_LEN 6
+#define STANZA_ID_HMAC_LEN    40
+static GHmac* stanza_id_hmac = NULL;
+static char stanza_id_prefix[CON_RAND_ID_LEN + 1];
+static guint64 stanza_id_counter;
+static TrafficStats traffic[TRAFFIC_KIND_COUNT];
+static ConnectStats connect_stats = { -1, FALSE, -1, -1, -1, 0, FALSE };
+// while a connect is timed, 0 otherwise
+static gint64 connect_started = 0;
+static gint64 last_received = 0;
+// stanzas handed to libstrophe since its last round wrote its queue
+static guint stanzas_queued = 0;
+// bytes of received stanzas and libstrophe allocations, a round that moved
+// either read from the socket or the TLS buffer and there may be more
+static guint64 received_bytes = 0;
+static guint64 xmpp_allocs = 0;
+static gboolean round_progress = FALSE;
+static const char stanza_id_alphabet[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
 static xmpp_log_t* _xmpp_get_file_logger(void);
+static void* _xmpp_alloc(const size_t size, void* const userdata);
+static void _xmpp_free(void* ptr, void* const userdata);
+static void* _xmpp_realloc(void* ptr, const size_t size, void* const userdata);
+static gboolean _connection_drain_more(int fd);
+static void _connection_run_once(unsigned long timeout);
 static void _xmpp_file_logger(void* const userdata, const xmpp_log_level_t level, const char* const area, const char* const msg);
+static void _connection_count_traffic(const char* const msg);
+static void _connection_sm_received(const char* const xml);
 
 static void _connection_handler(xmpp_conn_t* const xmpp_conn, const xmpp_conn_event_t status, const int error,
                                 xmpp_stream_error_t* const stream_error, void* const userdata);
 
 TLSCertificate* _xmppcert_to_profcert(const xmpp_tlscert_t* xmpptlscert);
 static int _connection_certfail_cb(const xmpp_tlscert_t* xmpptlscert, const char* errormsg);
+static int _connection_sockopt_cb(xmpp_conn_t* xmpp_conn, void* sock);
 
+static xmpp_ctx_t* _connection_get_ctx(void);
 static void _random_bytes_init(void);
 static void _random_bytes_close(void);
 static void _compute_identifier(const char* barejid);
+static void _connection_features_recount(void);
+static void _connection_disco_cache_load(void);
+static void _connection_disco_cache_save(const char* const ver);
+static void _connection_disco_burst(GList* infos);
+static void _connection_disco_burst_settled(IqFuture* burst, void* userdata);
+static void _connection_features_answered(const char* const jid);
+static void _stanza_id_hmac(const char* const prefix, char* hex);
+static void _connection_resolved(GList* addresses, void* userdata);
+static gboolean _connection_next_address(void);
+static void _connection_connect_reset(void);
 
 void
 connection_init(void)
 {
     xmpp_initialize();
     conn.xmpp_conn = NULL;
+    conn.xmpp_log = NULL;
     conn.xmpp_ctx = NULL;
+    conn.xmpp_fd = -1;
     conn.xmpp_in_event_loop = FALSE;
     conn.conn_status = JABBER_DISCONNECTED;
     conn.conn_last_event = XMPP_CONN_DISCONNECT;
     conn.presence_message = NULL;
     conn.domain = NULL;
     conn.features_by_jid = NULL;
+    conn.features_known = FEATURE_SET_EMPTY;
+#ifdef HAVE_LIBSTROPHE_SM
+    conn.sm_state = NULL;
+#endif
+    conn.resume_requested = FALSE;
+    conn.stream_resumed = FALSE;
     conn.available_resources = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)resource_destroy);
     conn.requested_features = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    conn.features_fresh = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    conn.cached_ver = NULL;
+    conn.features_announced = FALSE;
+    conn.connect_domain = NULL;
+    conn.connect_host = NULL;
+    conn.connect_port = 0;
+    conn.connect_direct_tls = FALSE;
+    conn.connect_addresses = NULL;
+    conn.connect_retry = NULL;
 
     _random_bytes_init();
 }
 
+// One libstrophe context lives for the whole process, each connect and
+// reconnect only creates a new connection on it
+static xmpp_ctx_t*
+_connection_get_ctx(void)
+{
+    if (!conn.xmpp_ctx) {
+        if (!conn.xmpp_log) {
+            conn.xmpp_log = _xmpp_get_file_logger();
+        }
+        if (!xmpp_pool) {
+            xmpp_pool = mem_pool_new();
+            xmpp_mem.alloc = _xmpp_alloc;
+            xmpp_mem.free = _xmpp_free;
+            xmpp_mem.realloc = _xmpp_realloc;
+            xmpp_mem.userdata = xmpp_pool;
+        }
+        conn.xmpp_ctx = xmpp_ctx_new(&xmpp_mem, conn.xmpp_log);
+    }
+
+    return conn.xmpp_ctx;
+}
+
+static void*
+_xmpp_alloc(const size_t size, void* const userdata)
+{
+    xmpp_allocs++;
+    return mem_pool_alloc(userdata, size);
+}
+
+static void
+_xmpp_free(void* ptr, void* const userdata)
+{
+    mem_pool_release(userdata, ptr);
+}
+
+static void*
+_xmpp_realloc(void* ptr, const size_t size, void* const userdata)
+{
+    xmpp_allocs++;
+    return mem_pool_realloc(userdata, ptr, size);
+}
+
+void
+connection_trim_alloc(void)
+{
+    if (xmpp_pool) {
+        mem_pool_trim(xmpp_pool);
+    }
+}
+
+void
+connection_get_alloc_stats(MemPoolStats* stats)
+{
+    if (xmpp_pool) {
+        mem_pool_get_stats(xmpp_pool, stats);
+    } else {
+        memset(stats, 0, sizeof(MemPoolStats));
+    }
+}
+
 void
 connection_check_events(void)
 {
+    if (!conn.xmpp_ctx) {
+        return;
+    }
+
+    // once the socket is known the input loop already waited on it
+    int timeout = connection_get_fd() >= 0 ? 0 : 10;
+
     conn.xmpp_in_event_loop = TRUE;
-    xmpp_run_once(conn.xmpp_ctx, 10);
+    _connection_run_once(timeout);
+
+    // each round reads one buffer, more of a burst is read before redrawing
+    int fd = connection_get_fd();
+    if (fd >= 0) {
+        gint64 deadline = g_get_monotonic_time() + CONNECTION_DRAIN_MS * 1000;
+        while (conn.xmpp_ctx && connection_get_fd() == fd && _connection_drain_more(fd)
+               && g_get_monotonic_time() < deadline) {
+            _connection_run_once(0);
+        }
+    }
     conn.xmpp_in_event_loop = FALSE;
 }
 
+void
+connection_stanza_queued(void)
+{
+    stanzas_queued++;
+}
+
+// libstrophe writes each queued stanza on its own at the start of a round,
+// with more than one queued the socket is corked for the round so they
+// leave in full segments, and uncorked after it to push out the rest
+static void
+_connection_run_once(unsigned long timeout)
+{
+#ifdef TCP_CORK
+    int fd = conn.xmpp_fd;
+    int corked = stanzas_queued > 1 && fd >= 0 ? 1 : 0;
+    if (corked) {
+        setsockopt(fd, IPPROTO_TCP, TCP_CORK, &corked, sizeof(corked));
+    }
+#endif
+    stanzas_queued = 0;
+
+    guint64 received = received_bytes;
+    guint64 allocs = xmpp_allocs;
+    xmpp_run_once(conn.xmpp_ctx, timeout);
+    // the parser allocates as it takes a chunk of an incomplete stanza
+    round_progress = received_bytes != received || xmpp_allocs != allocs;
+
+#ifdef TCP_CORK
+    // a lost connection closed the socket within the round
+    if (corked && conn.xmpp_fd == fd) {
+        int uncork = 0;
+        setsockopt(fd, IPPROTO_TCP, TCP_CORK, &uncork, sizeof(uncork));
+    }
+#endif
+}
+
+// More from the server may be waiting, in the socket or decrypted in the
+// TLS buffer while the last round made progress, and nothing from the keyboard
+static gboolean
+_connection_drain_more(int fd)
+{
+    struct pollfd fds[2] = {
+        { .fd = fd, .events = POLLIN, .revents = 0 },
+        { .fd = inp_fd(), .events = POLLIN, .revents = 0 },
+    };
+    if (poll(fds, 2, 0) < 0) {
+        return FALSE;
+    }
+    if (fds[1].revents & POLLIN) {
+        return FALSE;
+    }
+
+    return round_progress || (fds[0].revents & POLLIN);
+}
+
+// TLS keeps what it decrypted beyond the chunk libstrophe takes per round,
+// the socket shows nothing more while the last round still made progress
+gboolean
+connection_has_pending(void)
+{
+    return conn.xmpp_ctx && connection_get_fd() >= 0 && round_progress;
+}
+
+int
+connection_get_fd(void)
+{
+    // while connecting libstrophe waits for the socket to become writable,
+    // leave that to its own polling
+    switch (conn.conn_status) {
+    case JABBER_CONNECTED:
+    case JABBER_RAW_CONNECTED:
+    case JABBER_DISCONNECTING:
+        return conn.xmpp_fd;
+    default:
+        return -1;
+    }
+}
+
 void
 connection_shutdown(void)
 {
+    connection_sm_discard();
     connection_clear_data();
+    _connection_connect_reset();
+    resolver_close();
+
+    if (conn.xmpp_conn) {
+        xmpp_conn_release(conn.xmpp_conn);
+        conn.xmpp_conn = NULL;
+    }
+    if (conn.xmpp_ctx) {
+        xmpp_ctx_free(conn.xmpp_ctx);
+        conn.xmpp_ctx = NULL;
+    }
     xmpp_shutdown();
+    // what libstrophe handed out are malloc blocks, any still held stay valid
+    mem_pool_free(xmpp_pool);
+    xmpp_pool = NULL;
 
     free(conn.xmpp_log);
     conn.xmpp_log = NULL;
 
     _random_bytes_close();
+    feature_atoms_close();
 }
 
 jabber_conn_status_t
@@ -150,23 +427,19 @@ connection_connect(const char* const jid, const char* const passwd, const char*
     }
 
     _compute_identifier(jidp->barejid);
+    _connection_connect_reset();
+    conn.connect_domain = strdup(jidp->domainpart);
+    connect_started = g_get_monotonic_time();
+    connect_stats = (ConnectStats){ -1, FALSE, -1, -1, -1, 0, FALSE };
     jid_destroy(jidp);
 
     log_info("Connecting as %s", jid);
 
-    if (conn.xmpp_log) {
-        free(conn.xmpp_log);
-    }
-    conn.xmpp_log = _xmpp_get_file_logger();
-
     if (conn.xmpp_conn) {
         xmpp_conn_release(conn.xmpp_conn);
+        conn.xmpp_conn = NULL;
     }
-    if (conn.xmpp_ctx) {
-        xmpp_ctx_free(conn.xmpp_ctx);
-    }
-    conn.xmpp_ctx = xmpp_ctx_new(NULL, conn.xmpp_log);
-    if (conn.xmpp_ctx == NULL) {
+    if (!_connection_get_ctx()) {
         log_warning("Failed to get libstrophe ctx during connect");
         return JABBER_DISCONNECTED;
     }
@@ -175,6 +448,24 @@ connection_connect(const char* const jid, const char* const passwd, const char*
         log_warning("Failed to get libstrophe conn during connect");
         return JABBER_DISCONNECTED;
     }
+    conn.xmpp_fd = -1;
+    conn.resume_requested = FALSE;
+    conn.stream_resumed = FALSE;
+    xmpp_conn_set_sockopt_callback(conn.xmpp_conn, _connection_sockopt_cb);
+
+#ifdef HAVE_LIBSTROPHE_SM
+    if (conn.sm_state) {
+        // libstrophe owns the state once it is set
+        if (xmpp_conn_set_sm_state(conn.xmpp_conn, conn.sm_state) == XMPP_EOK) {
+            conn.resume_requested = TRUE;
+            log_info("Trying to resume the previous stream");
+        } else {
+            log_warning("Unable to hand the stream management state to the new connection");
+            xmpp_free_sm_state(conn.sm_state);
+        }
+        conn.sm_state = NULL;
+    }
+#endif
     xmpp_conn_set_jid(conn.xmpp_conn, jid);
     xmpp_conn_set_pass(conn.xmpp_conn, passwd);
 
@@ -195,6 +486,13 @@ connection_connect(const char* const jid, const char* const passwd, const char*
         flags |= XMPP_CONN_FLAG_LEGACY_AUTH;
     }
 
+#ifdef XMPP_CONN_FLAG_ENABLE_COMPRESSION
+    // XEP-0138, libstrophe falls back to none if the server has no zlib
+    if (prefs_get_boolean(PREF_COMPRESSION)) {
+        flags |= XMPP_CONN_FLAG_ENABLE_COMPRESSION;
+    }
+#endif
+
     xmpp_conn_set_flags(conn.xmpp_conn, flags);
 
     /* Print debug logs that can help when users share the logs */
@@ -209,6 +507,9 @@ connection_connect(const char* const jid, const char* const passwd, const char*
         LOG_FLAG_IF_SET(XMPP_CONN_FLAG_DISABLE_TLS);
         LOG_FLAG_IF_SET(XMPP_CONN_FLAG_LEGACY_SSL);
         LOG_FLAG_IF_SET(XMPP_CONN_FLAG_LEGACY_AUTH);
+#ifdef XMPP_CONN_FLAG_ENABLE_COMPRESSION
+        LOG_FLAG_IF_SET(XMPP_CONN_FLAG_ENABLE_COMPRESSION);
+#endif
 #undef LOG_FLAG_IF_SET
     }
 
@@ -220,22 +521,106 @@ connection_connect(const char* const jid, const char* const passwd, const char*
 
     xmpp_conn_set_certfail_handler(conn.xmpp_conn, _connection_certfail_cb);
 
-    int connect_status = xmpp_connect_client(
-        conn.xmpp_conn,
-        altdomain,
-        port,
-        _connection_handler,
-        conn.xmpp_ctx);
+    conn.connect_host = altdomain ? strdup(altdomain) : NULL;
+    conn.connect_port = port;
+    conn.connect_direct_tls = (flags & XMPP_CONN_FLAG_LEGACY_SSL) != 0;
 
-    if (connect_status == 0) {
-        conn.conn_status = JABBER_CONNECTING;
-    } else {
-        conn.conn_status = JABBER_DISCONNECTED;
+    // libstrophe resolves on the calling thread, so it only ever gets
+    // numeric addresses, resolved on a worker thread and cached
+    if (altdomain && g_hostname_is_ip_address(altdomain)) {
+        connect_stats.resolve_us = 0;
+        conn.connect_addresses = g_list_append(NULL, NULL);
+        conn.conn_status = _connection_next_address() ? JABBER_CONNECTING : JABBER_DISCONNECTED;
+        return conn.conn_status;
+    }
+
+    conn.conn_status = JABBER_CONNECTING;
+    GList* cached = resolver_lookup(conn.connect_domain, altdomain, port, conn.connect_direct_tls, _connection_resolved, NULL);
+    if (cached) {
+        connect_stats.resolve_us = g_get_monotonic_time() - connect_started;
+        connect_stats.resolve_cached = TRUE;
+        conn.connect_addresses = cached;
+        if (!_connection_next_address()) {
+            resolver_forget(conn.connect_domain, conn.connect_host, conn.connect_port, conn.connect_direct_tls);
+            conn.conn_status = JABBER_DISCONNECTED;
+        }
     }
 
     return conn.conn_status;
 }
 
+static void
+_connection_connect_reset(void)
+{
+    resolver_cancel();
+    scheduler_remove(conn.connect_retry);
+    conn.connect_retry = NULL;
+    resolver_addresses_free(conn.connect_addresses);
+    conn.connect_addresses = NULL;
+    FREE_SET_NULL(conn.connect_domain);
+    FREE_SET_NULL(conn.connect_host);
+}
+
+// Hands libstrophe the next address, a NULL entry stands for the host as
+// given, resolved by libstrophe itself
+static gboolean
+_connection_next_address(void)
+{
+    while (conn.connect_addresses) {
+        GList* next = conn.connect_addresses;
+        conn.connect_addresses = g_list_remove_link(conn.connect_addresses, next);
+
+        ResolvedAddress* address = next->data;
+        const char* host = address ? address->host : conn.connect_host;
+        int port = address ? address->port : conn.connect_port;
+        log_debug("Connecting to %s port %d", host ? host : conn.connect_domain, port);
+        connect_stats.attempts++;
+        int connect_status = xmpp_connect_client(conn.xmpp_conn, host, port, _connection_handler, conn.xmpp_ctx);
+        resolver_addresses_free(next);
+        if (connect_status == 0) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+_connection_connect_failed(void)
+{
+    resolver_forget(conn.connect_domain, conn.connect_host, conn.connect_port, conn.connect_direct_tls);
+    conn.conn_status = JABBER_DISCONNECTED;
+    session_login_failed();
+}
+
+static void
+_connection_resolved(GList* addresses, void* userdata)
+{
+    if (conn.conn_status != JABBER_CONNECTING || !conn.xmpp_conn) {
+        resolver_addresses_free(addresses);
+        return;
+    }
+
+    connect_stats.resolve_us = g_get_monotonic_time() - connect_started;
+
+    // nothing resolved here, leave it to libstrophe as before
+    conn.connect_addresses = addresses ? addresses : g_list_append(NULL, NULL);
+    if (!_connection_next_address()) {
+        _connection_connect_failed();
+    }
+}
+
+static gboolean
+_connection_retry(void* data)
+{
+    conn.connect_retry = NULL;
+    if (conn.conn_status == JABBER_CONNECTING && conn.xmpp_conn && !_connection_next_address()) {
+        _connection_connect_failed();
+    }
+
+    return FALSE;
+}
+
 static int
 iq_reg2_cb(xmpp_conn_t* xmpp_conn, xmpp_stanza_t* stanza, void* userdata)
 {
@@ -476,19 +861,11 @@ connection_register(const char* const altdomain, int port, const char* const tls
     _compute_identifier(jidp->barejid);
     jid_destroy(jidp);
 
-    if (conn.xmpp_log) {
-        free(conn.xmpp_log);
-    }
-    conn.xmpp_log = _xmpp_get_file_logger();
-
     if (conn.xmpp_conn) {
         xmpp_conn_release(conn.xmpp_conn);
+        conn.xmpp_conn = NULL;
     }
-    if (conn.xmpp_ctx) {
-        xmpp_ctx_free(conn.xmpp_ctx);
-    }
-    conn.xmpp_ctx = xmpp_ctx_new(NULL, conn.xmpp_log);
-    if (conn.xmpp_ctx == NULL) {
+    if (!_connection_get_ctx()) {
         log_warning("Failed to get libstrophe ctx during connect");
         return JABBER_DISCONNECTED;
     }
@@ -497,6 +874,8 @@ connection_register(const char* const altdomain, int port, const char* const tls
         log_warning("Failed to get libstrophe conn during connect");
         return JABBER_DISCONNECTED;
     }
+    conn.xmpp_fd = -1;
+    xmpp_conn_set_sockopt_callback(conn.xmpp_conn, _connection_sockopt_cb);
     xmpp_conn_set_jid(conn.xmpp_conn, altdomain);
 
     flags = xmpp_conn_get_flags(conn.xmpp_conn);
@@ -576,24 +955,23 @@ connection_disconnect(void)
             session_process_events();
         }
     } else {
+        _connection_connect_reset();
         conn.conn_status = JABBER_DISCONNECTED;
     }
 
-    // can't free libstrophe objects while we're in the event loop
-    if (!conn.xmpp_in_event_loop) {
-        if (conn.xmpp_conn) {
-            xmpp_conn_release(conn.xmpp_conn);
-            conn.xmpp_conn = NULL;
-        }
-
-        if (conn.xmpp_ctx) {
-            xmpp_ctx_free(conn.xmpp_ctx);
-            conn.xmpp_ctx = NULL;
-        }
+    // can't free libstrophe objects while we're in the event loop, the
+    // context itself stays for the next connection
+    if (!conn.xmpp_in_event_loop && conn.xmpp_conn) {
+        xmpp_conn_release(conn.xmpp_conn);
+        conn.xmpp_conn = NULL;
     }
 
     free(prof_identifier);
     prof_identifier = NULL;
+    if (stanza_id_hmac) {
+        g_hmac_unref(stanza_id_hmac);
+        stanza_id_hmac = NULL;
+    }
 }
 
 void
@@ -611,6 +989,7 @@ connection_clear_data(void)
         g_hash_table_destroy(conn.features_by_jid);
         conn.features_by_jid = NULL;
     }
+    conn.features_known = FEATURE_SET_EMPTY;
 
     if (conn.available_resources) {
         g_hash_table_remove_all(conn.available_resources);
@@ -619,6 +998,11 @@ connection_clear_data(void)
     if (conn.requested_features) {
         g_hash_table_remove_all(conn.requested_features);
     }
+    if (conn.features_fresh) {
+        g_hash_table_remove_all(conn.features_fresh);
+    }
+    FREE_SET_NULL(conn.cached_ver);
+    conn.features_announced = FALSE;
 }
 
 TLSCertificate*
@@ -648,6 +1032,7 @@ connection_send_stanza(const char* const stanza)
         return FALSE;
     } else {
         xmpp_send_raw_string(conn.xmpp_conn, "%s", stanza);
+        connection_stanza_queued();
         return TRUE;
     }
 }
@@ -655,6 +1040,14 @@ connection_send_stanza(const char* const stanza)
 gboolean
 connection_supports(const char* const feature)
 {
+    int atom = feature_atom(feature);
+    if (atom >= 0) {
+        return feature_set_has(conn.features_known, atom);
+    }
+    if (conn.features_by_jid == NULL) {
+        return FALSE;
+    }
+
     gboolean ret = FALSE;
     GList* jids = g_hash_table_get_keys(conn.features_by_jid);
 
@@ -701,28 +1094,105 @@ connection_jid_for_feature(const char* const feature)
     return NULL;
 }
 
+// The features of the last connection answer connection_supports() right
+// away, and the items known from it are asked for their disco#info in the
+// same burst as the server, before its disco#items reply is in.
 void
 connection_request_features(void)
 {
+    _connection_disco_cache_load();
+
     /* We don't record it as a requested feature to avoid triggering th
      * sv_ev_connection_features_received too soon */
-    iq_disco_info_request_onconnect(conn.domain);
+    GList* infos = g_list_prepend(NULL, iq_disco_info_request_onconnect(conn.domain));
+
+    if (conn.features_by_jid) {
+        GList* jids = g_hash_table_get_keys(conn.features_by_jid);
+        for (GList* curr = jids; curr; curr = g_list_next(curr)) {
+            if (g_strcmp0(curr->data, conn.domain) != 0) {
+                g_hash_table_add(conn.requested_features, strdup(curr->data));
+                infos = g_list_prepend(infos, iq_disco_info_request_onconnect(curr->data));
+            }
+        }
+        g_list_free(jids);
+    }
+
+    _connection_disco_burst(infos);
+}
+
+static void
+_connection_disco_burst(GList* infos)
+{
+    if (!infos) {
+        return;
+    }
+
+    IqFuture* burst = iq_future_all(infos);
+    g_list_free(infos);
+    iq_future_set_deadline(burst, CONNECTION_DISCO_TIMEOUT_MS);
+    iq_future_then(burst, _connection_disco_burst_settled, NULL, NULL);
+}
+
+static void
+_connection_disco_burst_settled(IqFuture* burst, void* userdata)
+{
+    log_debug("[CONNECTION] %u of %u disco#info replies in after %" G_GINT64_FORMAT " ms",
+              iq_future_count(burst, IQ_FUTURE_RESULT), g_list_length(iq_future_children(burst)),
+              iq_future_elapsed_ms(burst));
+}
+
+static void
+_connection_features_complete(void)
+{
+    if (!conn.features_announced) {
+        conn.features_announced = TRUE;
+        sv_ev_connection_features_received();
+    }
 }
 
 void
 connection_set_disco_items(GSList* items)
 {
+    GHashTable* listed = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_add(listed, conn.domain);
+    GList* infos = NULL;
+
     GSList* curr = items;
     while (curr) {
         DiscoItem* item = curr->data;
-        g_hash_table_insert(conn.requested_features, strdup(item->jid), NULL);
-        g_hash_table_insert(conn.features_by_jid, strdup(item->jid),
-                            g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL));
+        g_hash_table_add(listed, item->jid);
 
-        iq_disco_info_request_onconnect(item->jid);
+        // already asked for with the cached items
+        if (!g_hash_table_contains(conn.requested_features, item->jid)
+            && !g_hash_table_contains(conn.features_fresh, item->jid)) {
+            g_hash_table_add(conn.requested_features, strdup(item->jid));
+            g_hash_table_insert(conn.features_by_jid, strdup(item->jid),
+                                g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL));
+
+            infos = g_list_prepend(infos, iq_disco_info_request_onconnect(item->jid));
+        }
 
         curr = g_slist_next(curr);
     }
+
+    // cached items the server no longer lists are gone
+    GHashTableIter iter;
+    gpointer jid;
+    g_hash_table_iter_init(&iter, conn.features_by_jid);
+    while (g_hash_table_iter_next(&iter, &jid, NULL)) {
+        if (!g_hash_table_contains(listed, jid)) {
+            g_hash_table_remove(conn.requested_features, jid);
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+    g_hash_table_destroy(listed);
+    _connection_disco_burst(infos);
+
+    _connection_features_recount();
+    if (g_hash_table_size(conn.requested_features) == 0) {
+        _connection_disco_cache_save(conn.cached_ver);
+        _connection_features_complete();
+    }
 }
 
 jabber_conn_status_t
@@ -780,13 +1250,193 @@ connection_get_user(void)
     return result;
 }
 
+// ver is the caps hash of the server's disco#info, NULL for other entities
 void
-connection_features_received(const char* const jid)
+connection_features_received(const char* const jid, const char* const ver)
 {
     log_info("[CONNECTION] connection_features_received %s", jid);
+
+    if (jid) {
+        g_hash_table_add(conn.features_fresh, strdup(jid));
+    }
+
+    if (ver) {
+        if (conn.cached_ver && g_strcmp0(ver, conn.cached_ver) == 0) {
+            // nothing changed on the server, services are announced now
+            // rather than once every item has answered again
+            log_debug("Server features unchanged since the last connection");
+            _connection_features_recount();
+            _connection_features_complete();
+        } else if (conn.cached_ver) {
+            // what the cache says about items not yet answered may be stale
+            GHashTableIter iter;
+            gpointer item;
+            gpointer features;
+            g_hash_table_iter_init(&iter, conn.features_by_jid);
+            while (g_hash_table_iter_next(&iter, &item, &features)) {
+                if (!g_hash_table_contains(conn.features_fresh, item)) {
+                    g_hash_table_remove_all(features);
+                }
+            }
+        }
+        free(conn.cached_ver);
+        conn.cached_ver = strdup(ver);
+    }
+
+    _connection_features_recount();
+    _connection_features_answered(jid);
+}
+
+// An item that gave an error or no answer keeps what was cached of it
+void
+connection_features_failed(const char* const jid)
+{
+    _connection_features_answered(jid);
+}
+
+static void
+_connection_features_answered(const char* const jid)
+{
     if (g_hash_table_remove(conn.requested_features, jid) && g_hash_table_size(conn.requested_features) == 0) {
-        sv_ev_connection_features_received();
+        _connection_disco_cache_save(conn.cached_ver);
+        _connection_features_complete();
+    }
+}
+
+static void
+_connection_features_recount(void)
+{
+    conn.features_known = FEATURE_SET_EMPTY;
+    if (!conn.features_by_jid) {
+        return;
+    }
+
+    GHashTableIter jids;
+    gpointer features;
+    g_hash_table_iter_init(&jids, conn.features_by_jid);
+    while (g_hash_table_iter_next(&jids, NULL, &features)) {
+        GHashTableIter iter;
+        gpointer feature;
+        g_hash_table_iter_init(&iter, features);
+        while (g_hash_table_iter_next(&iter, &feature, NULL)) {
+            conn.features_known = feature_set_add(conn.features_known, feature);
+        }
+    }
+}
+
+static gchar*
+_connection_disco_cache_path(void)
+{
+    char* barejid = connection_get_barejid();
+    gchar* dir = files_get_account_data_path(DIR_DATABASE, barejid);
+    free(barejid);
+    if (g_mkdir_with_parents(dir, S_IRWXU) == -1) {
+        log_error("Unable to create disco cache directory: %s", dir);
+        g_free(dir);
+        return NULL;
+    }
+    gchar* path = g_strdup_printf("%s/%s", dir, FILE_DISCOCACHE);
+    g_free(dir);
+
+    return path;
+}
+
+#define DISCO_CACHE_SERVER "server"
+#define DISCO_CACHE_ENTITY "entity "
+
+static void
+_connection_disco_cache_load(void)
+{
+    if (!conn.features_by_jid) {
+        return;
+    }
+
+    gchar* path = _connection_disco_cache_path();
+    if (!path) {
+        return;
+    }
+
+    GKeyFile* cache = g_key_file_new();
+    if (g_key_file_load_from_file(cache, path, G_KEY_FILE_NONE, NULL)) {
+        FREE_SET_NULL(conn.cached_ver);
+        gchar* ver = g_key_file_get_string(cache, DISCO_CACHE_SERVER, "ver", NULL);
+        if (ver) {
+            conn.cached_ver = strdup(ver);
+            g_free(ver);
+        }
+
+        gchar** groups = g_key_file_get_groups(cache, NULL);
+        for (int i = 0; groups && groups[i]; i++) {
+            if (!g_str_has_prefix(groups[i], DISCO_CACHE_ENTITY)) {
+                continue;
+            }
+
+            const char* jid = groups[i] + strlen(DISCO_CACHE_ENTITY);
+            GHashTable* features = g_hash_table_lookup(conn.features_by_jid, jid);
+            if (!features) {
+                features = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+                g_hash_table_insert(conn.features_by_jid, strdup(jid), features);
+            }
+
+            gchar** vars = g_key_file_get_string_list(cache, groups[i], "features", NULL, NULL);
+            for (int j = 0; vars && vars[j]; j++) {
+                g_hash_table_add(features, strdup(vars[j]));
+            }
+            g_strfreev(vars);
+        }
+        g_strfreev(groups);
+
+        _connection_features_recount();
+        log_debug("Loaded features of %u entities from the disco cache", g_hash_table_size(conn.features_by_jid));
     }
+
+    g_key_file_free(cache);
+    g_free(path);
+}
+
+static void
+_connection_disco_cache_save(const char* const ver)
+{
+    if (!ver || !conn.features_by_jid) {
+        return;
+    }
+
+    gchar* path = _connection_disco_cache_path();
+    if (!path) {
+        return;
+    }
+
+    GKeyFile* cache = g_key_file_new();
+    g_key_file_set_string(cache, DISCO_CACHE_SERVER, "ver", ver);
+
+    GHashTableIter jids;
+    gpointer jid;
+    gpointer features;
+    g_hash_table_iter_init(&jids, conn.features_by_jid);
+    while (g_hash_table_iter_next(&jids, &jid, &features)) {
+        guint count = g_hash_table_size(features);
+        const gchar** vars = g_new0(const gchar*, count + 1);
+        guint n = 0;
+        GHashTableIter iter;
+        gpointer feature;
+        g_hash_table_iter_init(&iter, features);
+        while (g_hash_table_iter_next(&iter, &feature, NULL)) {
+            vars[n++] = feature;
+        }
+
+        gchar* group = g_strconcat(DISCO_CACHE_ENTITY, (char*)jid, NULL);
+        g_key_file_set_string_list(cache, group, "features", vars, count);
+        g_free(group);
+        g_free(vars);
+    }
+
+    GError* error = NULL;
+    if (!g_key_file_save_to_file(cache, path, &error)) {
+        log_error("Unable to save disco cache: %s", error->message);
+        g_error_free(error);
+    }
+    g_key_file_free(cache);
+    g_free(path);
 }
 
 GHashTable*
@@ -830,21 +1480,62 @@ connection_free_uuid(char* uuid)
 char*
 connection_create_stanza_id(void)
 {
-    char* rndid = get_random_string(CON_RAND_ID_LEN);
-    assert(rndid != NULL);
+    assert(stanza_id_hmac != NULL);
 
-    gchar* hmac = g_compute_hmac_for_string(G_CHECKSUM_SHA1,
-                                            (guchar*)prof_identifier, strlen(prof_identifier),
-                                            rndid, strlen(rndid));
-
-    char* ret = g_strdup_printf("%s%s", rndid, hmac);
+    guint64 counter = stanza_id_counter++;
+    for (int i = CON_RAND_ID_LEN - 1; i >= CON_RAND_ID_LEN - STANZA_ID_COUNTER_LEN; i--) {
+        stanza_id_prefix[i] = stanza_id_alphabet[counter % (sizeof(stanza_id_alphabet) - 1)];
+        counter /= sizeof(stanza_id_alphabet) - 1;
+    }
 
-    free(rndid);
-    g_free(hmac);
+    char* ret = g_malloc(CON_RAND_ID_LEN + STANZA_ID_HMAC_LEN + 1);
+    memcpy(ret, stanza_id_prefix, CON_RAND_ID_LEN);
+    _stanza_id_hmac(stanza_id_prefix, &ret[CON_RAND_ID_LEN]);
 
     return ret;
 }
 
+gboolean
+connection_is_own_stanza_id(const char* const id)
+{
+    if (!id || !stanza_id_hmac) {
+        return FALSE;
+    }
+
+    if (strnlen(id, CON_RAND_ID_LEN + STANZA_ID_HMAC_LEN + 1) != CON_RAND_ID_LEN + STANZA_ID_HMAC_LEN) {
+        return FALSE;
+    }
+
+    char prefix[CON_RAND_ID_LEN + 1];
+    memcpy(prefix, id, CON_RAND_ID_LEN);
+    prefix[CON_RAND_ID_LEN] = '\0';
+
+    char hex[STANZA_ID_HMAC_LEN + 1];
+    _stanza_id_hmac(prefix, hex);
+
+    return memcmp(&id[CON_RAND_ID_LEN], hex, STANZA_ID_HMAC_LEN) == 0;
+}
+
+// Writes the lower case hex HMAC of prefix and a terminating nul to hex
+static void
+_stanza_id_hmac(const char* const prefix, char* hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    guint8 digest[STANZA_ID_HMAC_LEN / 2];
+    gsize digest_len = sizeof(digest);
+
+    GHmac* hmac = g_hmac_copy(stanza_id_hmac);
+    g_hmac_update(hmac, (const guchar*)prefix, CON_RAND_ID_LEN);
+    g_hmac_get_digest(hmac, digest, &digest_len);
+    g_hmac_unref(hmac);
+
+    for (gsize i = 0; i < digest_len; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0xf];
+    }
+    hex[digest_len * 2] = '\0';
+}
+
 char*
 connection_get_domain(void)
 {
@@ -1000,9 +1691,25 @@ _connection_handler(xmpp_conn_t* const xmpp_conn, const xmpp_conn_event_t status
     // login success
     case XMPP_CONN_CONNECT:
         log_debug("Connection handler: XMPP_CONN_CONNECT");
+
+        if (connect_started) {
+            connect_stats.login_us = g_get_monotonic_time() - connect_started;
+            connect_stats.stream_resumed = conn.stream_resumed;
+            connect_started = 0;
+        }
+
+        // a resumed stream keeps the domain and features of the lost one
+        if (conn.stream_resumed) {
+            conn.conn_status = JABBER_CONNECTED;
+            session_login_success(connection_is_secured());
+            break;
+        }
+
+        session_resume_failed();
         conn.conn_status = JABBER_CONNECTED;
 
         Jid* my_jid = jid_create(xmpp_conn_get_jid(conn.xmpp_conn));
+        FREE_SET_NULL(conn.domain);
         conn.domain = strdup(my_jid->domainpart);
         jid_destroy(my_jid);
 
@@ -1037,6 +1744,9 @@ _connection_handler(xmpp_conn_t* const xmpp_conn, const xmpp_conn_event_t status
         // lost connection for unknown reason
         if (conn.conn_status == JABBER_CONNECTED) {
             log_debug("Connection handler: Lost connection for unknown reason");
+#ifdef HAVE_LIBSTROPHE_SM
+            conn.sm_state = xmpp_conn_get_sm_state(conn.xmpp_conn);
+#endif
             session_lost_connection();
 
             // login attempt failed
@@ -1049,6 +1759,16 @@ _connection_handler(xmpp_conn_t* const xmpp_conn, const xmpp_conn_event_t status
                 conn.conn_status = JABBER_RECONNECT;
                 return;
             }
+            // the socket failed, libstrophe can not reconnect from within its own handler
+            if (error && !stream_error && conn.connect_addresses) {
+                log_debug("Connection handler: Connecting failed (%d), trying the next address", error);
+                conn.conn_status = JABBER_CONNECTING;
+                conn.connect_retry = scheduler_add(0, _connection_retry, NULL, NULL);
+                return;
+            }
+            if (error && !stream_error) {
+                resolver_forget(conn.connect_domain, conn.connect_host, conn.connect_port, conn.connect_direct_tls);
+            }
             log_debug("Connection handler: Login failed");
             session_login_failed();
         }
@@ -1070,6 +1790,48 @@ _connection_handler(xmpp_conn_t* const xmpp_conn, const xmpp_conn_event_t status
     }
 }
 
+gboolean
+connection_sm_resumable(void)
+{
+#ifdef HAVE_LIBSTROPHE_SM
+    return conn.sm_state != NULL;
+#else
+    return FALSE;
+#endif
+}
+
+gboolean
+connection_stream_resumed(void)
+{
+    return conn.stream_resumed;
+}
+
+void
+connection_sm_discard(void)
+{
+#ifdef HAVE_LIBSTROPHE_SM
+    if (conn.sm_state) {
+        xmpp_free_sm_state(conn.sm_state);
+        conn.sm_state = NULL;
+    }
+#endif
+    conn.resume_requested = FALSE;
+    conn.stream_resumed = FALSE;
+}
+
+// libstrophe answers <resumed/> itself and raises XMPP_CONN_CONNECT before
+// any handler of ours runs, the stanza is only seen as it is logged
+static void
+_connection_sm_received(const char* const xml)
+{
+    if (!conn.resume_requested || !g_str_has_prefix(xml, "<" STANZA_NAME_RESUMED) || !strstr(xml, STANZA_NS_SM)) {
+        return;
+    }
+
+    log_info("Stream resumed");
+    conn.stream_resumed = TRUE;
+}
+
 static int
 _connection_certfail_cb(const xmpp_tlscert_t* xmpptlscert, const char* errormsg)
 {
@@ -1081,6 +1843,49 @@ _connection_certfail_cb(const xmpp_tlscert_t* xmpptlscert, const char* errormsg)
     return res;
 }
 
+static int
+_connection_sockopt_cb(xmpp_conn_t* xmpp_conn, void* sock)
+{
+    conn.xmpp_fd = *(int*)sock;
+    connection_update_keepalive();
+
+    return 0;
+}
+
+// Adaptive autoping leans on TCP: keepalive probes while the link is idle,
+// and a socket that fails once sent data stays unacknowledged for the
+// autoping timeout, which a skipped ping's whitespace keepalive relies on
+void
+connection_update_keepalive(void)
+{
+    if (conn.xmpp_fd < 0) {
+        return;
+    }
+
+    int adaptive = prefs_get_boolean(PREF_AUTOPING_ADAPTIVE) ? 1 : 0;
+    setsockopt(conn.xmpp_fd, SOL_SOCKET, SO_KEEPALIVE, &adaptive, sizeof(adaptive));
+#ifdef TCP_KEEPIDLE
+    int interval = prefs_get_autoping();
+    if (adaptive && interval > 0) {
+        int probe_interval = MAX(interval / 3, 1);
+        int probes = 3;
+        setsockopt(conn.xmpp_fd, IPPROTO_TCP, TCP_KEEPIDLE, &interval, sizeof(interval));
+        setsockopt(conn.xmpp_fd, IPPROTO_TCP, TCP_KEEPINTVL, &probe_interval, sizeof(probe_interval));
+        setsockopt(conn.xmpp_fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+    }
+#endif
+#ifdef TCP_USER_TIMEOUT
+    unsigned int timeout_ms = adaptive ? prefs_get_autoping_timeout() * 1000 : 0;
+    setsockopt(conn.xmpp_fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout_ms, sizeof(timeout_ms));
+#endif
+}
+
+gint64
+connection_get_last_received(void)
+{
+    return last_received;
+}
+
 TLSCertificate*
 _xmppcert_to_profcert(const xmpp_tlscert_t* xmpptlscert)
 {
@@ -1126,6 +1931,110 @@ _xmpp_get_file_logger(void)
     return file_log;
 }
 
+// libstrophe logs everything it sends and receives as "SENT: " or
+// "RECV: " followed by the XML, whatever the log level
+static void
+_connection_count_traffic(const char* const msg)
+{
+    gboolean sent;
+    if (g_str_has_prefix(msg, "SENT: ")) {
+        sent = TRUE;
+    } else if (g_str_has_prefix(msg, "RECV: ")) {
+        sent = FALSE;
+    } else {
+        return;
+    }
+
+    const char* xml = msg + 6;
+    traffic_kind_t kind = TRAFFIC_OTHER;
+    if (g_str_has_prefix(xml, "<message")) {
+        kind = TRAFFIC_MESSAGE;
+    } else if (g_str_has_prefix(xml, "<presence")) {
+        kind = TRAFFIC_PRESENCE;
+    } else if (g_str_has_prefix(xml, "<iq")) {
+        kind = TRAFFIC_IQ;
+    }
+
+    if (connect_started) {
+        gint64 elapsed = g_get_monotonic_time() - connect_started;
+        if (!sent && connect_stats.stream_us < 0) {
+            connect_stats.stream_us = elapsed;
+        }
+        if (connect_stats.stream_us >= 0 && connect_stats.tls_us < 0 && conn.xmpp_conn && xmpp_conn_is_secured(conn.xmpp_conn)) {
+            connect_stats.tls_us = elapsed - connect_stats.stream_us;
+        }
+    }
+
+    if (!sent) {
+        last_received = g_get_monotonic_time();
+        recorder_received(xml);
+        _connection_sm_received(xml);
+    }
+
+    guint64 bytes = strlen(xml);
+    if (sent) {
+        traffic[kind].sent++;
+        traffic[kind].sent_bytes += bytes;
+    } else {
+        traffic[kind].received++;
+        traffic[kind].received_bytes += bytes;
+        received_bytes += bytes;
+    }
+}
+
+const char*
+connection_traffic_kind_name(traffic_kind_t kind)
+{
+    switch (kind) {
+    case TRAFFIC_MESSAGE:
+        return "message";
+    case TRAFFIC_PRESENCE:
+        return "presence";
+    case TRAFFIC_IQ:
+        return "iq";
+    default:
+        return "other";
+    }
+}
+
+void
+connection_get_traffic(traffic_kind_t kind, TrafficStats* stats)
+{
+    *stats = traffic[kind];
+}
+
+void
+connection_get_connect_stats(ConnectStats* stats)
+{
+    *stats = connect_stats;
+}
+
+void
+connection_reset_traffic(void)
+{
+    memset(traffic, 0, sizeof(traffic));
+}
+
+void
+connection_replay_open(const char* const fulljid)
+{
+    if (conn.xmpp_conn) {
+        xmpp_conn_release(conn.xmpp_conn);
+    }
+    conn.xmpp_conn = xmpp_conn_new(_connection_get_ctx());
+    xmpp_conn_set_jid(conn.xmpp_conn, fulljid);
+
+    Jid* my_jid = jid_create(fulljid);
+    FREE_SET_NULL(conn.domain);
+    conn.domain = strdup(my_jid->domainpart);
+    jid_destroy(my_jid);
+
+    if (!conn.features_by_jid) {
+        conn.features_by_jid = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)g_hash_table_destroy);
+        g_hash_table_insert(conn.features_by_jid, strdup(conn.domain), g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL));
+    }
+}
+
 static void
 _xmpp_file_logger(void* const userdata, const xmpp_log_level_t xmpp_level, const char* const area, const char* const msg)
 {
@@ -1149,6 +2058,7 @@ _xmpp_file_logger(void* const userdata, const xmpp_log_level_t xmpp_level, const
     log_msg(prof_level, area, msg);
 
     if ((g_strcmp0(area, "xmpp") == 0) || (g_strcmp0(area, "conn")) == 0) {
+        _connection_count_traffic(msg);
         sv_ev_xmpp_stanza(msg);
     }
 }
@@ -1205,6 +2115,17 @@ _compute_identifier(const char* barejid)
     prof_identifier = g_compute_hmac_for_string(G_CHECKSUM_SHA256,
                                                 (guchar*)profanity_instance_id, strlen(profanity_instance_id),
                                                 barejid, strlen(barejid));
+
+    if (stanza_id_hmac) {
+        g_hmac_unref(stanza_id_hmac);
+    }
+    stanza_id_hmac = g_hmac_new(G_CHECKSUM_SHA1, (guchar*)prof_identifier, strlen(prof_identifier));
+
+    char* random = get_random_string(CON_RAND_ID_LEN - STANZA_ID_COUNTER_LEN);
+    memcpy(stanza_id_prefix, random, CON_RAND_ID_LEN - STANZA_ID_COUNTER_LEN);
+    stanza_id_prefix[CON_RAND_ID_LEN] = '\0';
+    free(random);
+    stanza_id_counter = g_random_int();
 }
 
 const char*
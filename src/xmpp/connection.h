@@ -43,6 +43,7 @@
 void connection_init(void);
 void connection_shutdown(void);
 void connection_check_events(void);
+void connection_stanza_queued(void);
 
 jabber_conn_status_t connection_connect(const char* const fulljid, const char* const passwd, const char* const altdomain, int port,
                                         const char* const tls_policy, const char* const auth_policy);
@@ -59,14 +60,24 @@ xmpp_conn_t* connection_get_conn(void);
 xmpp_ctx_t* connection_get_ctx(void);
 char* connection_get_domain(void);
 void connection_request_features(void);
-void connection_features_received(const char* const jid);
+void connection_features_received(const char* const jid, const char* const ver);
+void connection_features_failed(const char* const jid);
 GHashTable* connection_get_features(const char* const jid);
 
 void connection_clear_data(void);
 
+gint64 connection_get_last_received(void);
+gboolean connection_sm_resumable(void);
+gboolean connection_stream_resumed(void);
+void connection_sm_discard(void);
+
 void connection_add_available_resource(Resource* resource);
 void connection_remove_available_resource(const char* const resource);
 
 char* connection_create_stanza_id(void);
+gboolean connection_is_own_stanza_id(const char* const id);
+
+// A connection as fulljid that is never opened, for replaying a recording
+void connection_replay_open(const char* const fulljid);
 
 #endif
@@ -43,6 +43,7 @@
 
 #include "common.h"
 #include "tools/autocomplete.h"
+#include "tools/memusage.h"
 #include "xmpp/resource.h"
 #include "xmpp/contact.h"
 
@@ -58,9 +59,17 @@ struct p_contact_t
     gboolean pending_out;
     GDateTime* last_activity;
     GHashTable* available_resources;
+    // picked from available_resources whenever they change, NULL if none
+    Resource* most_available;
+    // changes with the name or presence, unique across all contacts
+    guint revision;
     Autocomplete resource_ac;
 };
 
+static void _update_most_available_resource(PContact contact);
+
+static guint contact_revisions = 0;
+
 PContact
 p_contact_new(const char* const barejid, const char* const name,
               GSList* groups, const char* const subscription,
@@ -95,6 +104,8 @@ p_contact_new(const char* const barejid, const char* const name,
 
     contact->available_resources = g_hash_table_new_full(g_str_hash, g_str_equal, free,
                                                          (GDestroyNotify)resource_destroy);
+    contact->most_available = NULL;
+    contact->revision = ++contact_revisions;
 
     contact->resource_ac = autocomplete_new();
 
@@ -110,6 +121,7 @@ p_contact_set_name(const PContact contact, const char* const name)
         contact->name = strdup(name);
         contact->name_collate_key = g_utf8_collate_key(contact->name, -1);
     }
+    contact->revision = ++contact_revisions;
 }
 
 void
@@ -148,6 +160,10 @@ p_contact_remove_resource(PContact contact, const char* const resource)
 {
     gboolean result = g_hash_table_remove(contact->available_resources, resource);
     autocomplete_remove(contact->resource_ac, resource);
+    if (result) {
+        _update_most_available_resource(contact);
+        contact->revision = ++contact_revisions;
+    }
 
     return result;
 }
@@ -177,6 +193,41 @@ p_contact_free(PContact contact)
     }
 }
 
+// Rough heap use of a contact and its resources, the resource autocompleter
+// is counted with the others
+gsize
+p_contact_memory(PContact contact)
+{
+    gsize total = memusage_alloc(sizeof(struct p_contact_t));
+    total += memusage_string(contact->barejid) + memusage_string(contact->barejid_collate_key);
+    total += memusage_string(contact->name) + memusage_string(contact->name_collate_key);
+    total += memusage_string(contact->subscription) + memusage_string(contact->offline_message);
+    total += memusage_date_time(contact->last_activity);
+
+    total += memusage_slist(contact->groups);
+    for (GSList* curr = contact->groups; curr; curr = g_slist_next(curr)) {
+        total += memusage_string(curr->data);
+    }
+
+    total += memusage_hash_table(contact->available_resources);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, contact->available_resources);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        Resource* resource = value;
+        total += memusage_string(key) + memusage_alloc(sizeof(Resource));
+        total += memusage_string(resource->name) + memusage_string(resource->status);
+    }
+
+    return total;
+}
+
+guint
+p_contact_revision(const PContact contact)
+{
+    return contact->revision;
+}
+
 const char*
 p_contact_barejid(const PContact contact)
 {
@@ -257,8 +308,8 @@ _highest_presence(Resource* first, Resource* second)
     }
 }
 
-Resource*
-_get_most_available_resource(PContact contact)
+static void
+_update_most_available_resource(PContact contact)
 {
     // find resource with highest priority, if more than one,
     // use highest availability, in the following order:
@@ -267,28 +318,27 @@ _get_most_available_resource(PContact contact)
     //      away
     //      xa
     //      dnd
-    GList* resources = g_hash_table_get_values(contact->available_resources);
-    GList* curr = resources;
-    Resource* current = curr->data;
-    Resource* highest = current;
-    curr = g_list_next(curr);
-    while (curr) {
-        current = curr->data;
-
-        // priority is same as current highest, choose presence
-        if (current->priority == highest->priority) {
+    Resource* highest = NULL;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, contact->available_resources);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Resource* current = value;
+
+        if (highest == NULL) {
+            highest = current;
+
+            // priority is same as current highest, choose presence
+        } else if (current->priority == highest->priority) {
             highest = _highest_presence(highest, current);
 
             // priority higher than current highest, set new presence
         } else if (current->priority > highest->priority) {
             highest = current;
         }
-
-        curr = g_list_next(curr);
     }
-    g_list_free(resources);
 
-    return highest;
+    contact->most_available = highest;
 }
 
 const char*
@@ -297,12 +347,11 @@ p_contact_presence(const PContact contact)
     assert(contact != NULL);
 
     // no available resources, offline
-    if (g_hash_table_size(contact->available_resources) == 0) {
+    Resource* resource = contact->most_available;
+    if (resource == NULL) {
         return "offline";
     }
 
-    Resource* resource = _get_most_available_resource(contact);
-
     return string_from_resource_presence(resource->presence);
 }
 
@@ -312,12 +361,11 @@ p_contact_status(const PContact contact)
     assert(contact != NULL);
 
     // no available resources, use offline message
-    if (g_hash_table_size(contact->available_resources) == 0) {
+    Resource* resource = contact->most_available;
+    if (resource == NULL) {
         return contact->offline_message;
     }
 
-    Resource* resource = _get_most_available_resource(contact);
-
     return resource->status;
 }
 
@@ -382,12 +430,12 @@ gboolean
 p_contact_is_available(const PContact contact)
 {
     // no available resources, unavailable
-    if (g_hash_table_size(contact->available_resources) == 0) {
+    Resource* most_available = contact->most_available;
+    if (most_available == NULL) {
         return FALSE;
     }
 
     // if most available resource is CHAT or ONLINE, available
-    Resource* most_available = _get_most_available_resource(contact);
     if ((most_available->presence == RESOURCE_ONLINE) || (most_available->presence == RESOURCE_CHAT)) {
         return TRUE;
     } else {
@@ -406,6 +454,8 @@ p_contact_set_presence(const PContact contact, Resource* resource)
 {
     g_hash_table_replace(contact->available_resources, strdup(resource->name), resource);
     autocomplete_add(contact->resource_ac, resource->name);
+    _update_most_available_resource(contact);
+    contact->revision = ++contact_revisions;
 }
 
 void
@@ -0,0 +1,115 @@
+/*
+ * feature_atoms.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include <glib.h>
+
+#include "xmpp/xmpp.h"
+#include "xmpp/stanza.h"
+#include "xmpp/feature_atoms.h"
+
+// indexed by feature_atom_t, no more than fit in a FeatureSet
+static const char* const atom_names[FEATURE_ATOM_COUNT] = {
+    XMPP_FEATURE_PING,
+    XMPP_FEATURE_BLOCKING,
+    XMPP_FEATURE_RECEIPTS,
+    XMPP_FEATURE_LASTACTIVITY,
+    XMPP_FEATURE_MUC,
+    XMPP_FEATURE_COMMANDS,
+    XMPP_FEATURE_OMEMO_DEVICELIST_NOTIFY,
+    XMPP_FEATURE_PUBSUB,
+    XMPP_FEATURE_PUBSUB_PUBLISH_OPTIONS,
+    XMPP_FEATURE_USER_AVATAR_METADATA_NOTIFY,
+    XMPP_FEATURE_LAST_MESSAGE_CORRECTION,
+    XMPP_FEATURE_MAM2,
+    XMPP_FEATURE_SPAM_REPORTING,
+    STANZA_NS_CHATSTATES,
+    STANZA_NS_CARBONS
+};
+
+// feature namespace to atom + 1, so a missing key reads as 0
+static GHashTable* atoms = NULL;
+
+static void
+_feature_atoms_init(void)
+{
+    atoms = g_hash_table_new(g_str_hash, g_str_equal);
+    for (int i = 0; i < FEATURE_ATOM_COUNT; i++) {
+        g_hash_table_insert(atoms, (gpointer)atom_names[i], GINT_TO_POINTER(i + 1));
+    }
+}
+
+int
+feature_atom(const char* const feature)
+{
+    if (feature == NULL) {
+        return -1;
+    }
+    if (atoms == NULL) {
+        _feature_atoms_init();
+    }
+
+    return GPOINTER_TO_INT(g_hash_table_lookup(atoms, feature)) - 1;
+}
+
+FeatureSet
+feature_set_add(FeatureSet set, const char* const feature)
+{
+    int atom = feature_atom(feature);
+    if (atom < 0) {
+        return set;
+    }
+
+    return set | ((FeatureSet)1 << atom);
+}
+
+gboolean
+feature_set_has(FeatureSet set, int atom)
+{
+    if (atom < 0 || atom >= FEATURE_ATOM_COUNT) {
+        return FALSE;
+    }
+
+    return (set & ((FeatureSet)1 << atom)) != 0;
+}
+
+void
+feature_atoms_close(void)
+{
+    if (atoms) {
+        g_hash_table_destroy(atoms);
+        atoms = NULL;
+    }
+}
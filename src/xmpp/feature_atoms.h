@@ -0,0 +1,71 @@
+/*
+ * feature_atoms.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef XMPP_FEATURE_ATOMS_H
+#define XMPP_FEATURE_ATOMS_H
+
+#include <glib.h>
+
+// the disco features profanity asks about, each one a bit in a FeatureSet
+typedef enum {
+    FEATURE_ATOM_PING,
+    FEATURE_ATOM_BLOCKING,
+    FEATURE_ATOM_RECEIPTS,
+    FEATURE_ATOM_LASTACTIVITY,
+    FEATURE_ATOM_MUC,
+    FEATURE_ATOM_COMMANDS,
+    FEATURE_ATOM_OMEMO_DEVICELIST_NOTIFY,
+    FEATURE_ATOM_PUBSUB,
+    FEATURE_ATOM_PUBSUB_PUBLISH_OPTIONS,
+    FEATURE_ATOM_USER_AVATAR_METADATA_NOTIFY,
+    FEATURE_ATOM_LAST_MESSAGE_CORRECTION,
+    FEATURE_ATOM_MAM2,
+    FEATURE_ATOM_SPAM_REPORTING,
+    FEATURE_ATOM_CHATSTATES,
+    FEATURE_ATOM_CARBONS,
+    FEATURE_ATOM_COUNT
+} feature_atom_t;
+
+typedef guint32 FeatureSet;
+
+#define FEATURE_SET_EMPTY ((FeatureSet)0)
+
+int feature_atom(const char* const feature);
+FeatureSet feature_set_add(FeatureSet set, const char* const feature);
+gboolean feature_set_has(FeatureSet set, int atom);
+void feature_atoms_close(void);
+
+#endif
@@ -220,7 +220,7 @@ form_create(xmpp_stanza_t* const form_stanza)
                 if (g_strcmp0(child_name, "value") == 0) {
                     char* value = xmpp_stanza_get_text(field_child);
                     if (value) {
-                        field->values = g_slist_append(field->values, strdup(value));
+                        field->values = g_slist_prepend(field->values, strdup(value));
 
                         if (field->type_t == FIELD_TEXT_MULTI) {
                             GString* ac_val = g_string_new("");
@@ -245,17 +245,21 @@ form_create(xmpp_stanza_t* const form_stanza)
                         autocomplete_add(field->value_ac, option->value);
                     }
 
-                    field->options = g_slist_append(field->options, option);
+                    field->options = g_slist_prepend(field->options, option);
                 }
 
                 field_child = xmpp_stanza_get_next(field_child);
             }
 
-            form->fields = g_slist_append(form->fields, field);
+            // built in reverse, appending to long lists of options is quadratic
+            field->values = g_slist_reverse(field->values);
+            field->options = g_slist_reverse(field->options);
+            form->fields = g_slist_prepend(form->fields, field);
         }
 
         form_child = xmpp_stanza_get_next(form_child);
     }
+    form->fields = g_slist_reverse(form->fields);
 
     return form;
 }
@@ -361,6 +365,9 @@ _free_field(FormField* field)
         free(field->description);
         g_slist_free_full(field->values, free);
         g_slist_free_full(field->options, (GDestroyNotify)_free_option);
+        if (field->option_index) {
+            g_hash_table_destroy(field->option_index);
+        }
         autocomplete_free(field->value_ac);
         free(field);
     }
@@ -376,11 +383,63 @@ form_destroy(DataForm* form)
         g_slist_free_full(form->fields, (GDestroyNotify)_free_field);
         g_hash_table_destroy(form->var_to_tag);
         g_hash_table_destroy(form->tag_to_var);
+        if (form->tag_to_field) {
+            g_hash_table_destroy(form->tag_to_field);
+        }
         autocomplete_free(form->tag_ac);
         free(form);
     }
 }
 
+// Fields and options are looked up by tag and value for every /field edit,
+// forms of ad-hoc commands may have thousands of them. The indexes are built
+// on first use, the fields and options of a form do not change after that.
+static FormField*
+_field_by_tag(DataForm* form, const char* const tag)
+{
+    if (!form->tag_to_field) {
+        // the first field with a var, as tags are given
+        GHashTable* by_var = g_hash_table_new(g_str_hash, g_str_equal);
+        for (GSList* curr = form->fields; curr; curr = g_slist_next(curr)) {
+            FormField* field = curr->data;
+            if (field->var && !g_hash_table_contains(by_var, field->var)) {
+                g_hash_table_insert(by_var, field->var, field);
+            }
+        }
+
+        // keys are those of tag_to_var
+        form->tag_to_field = g_hash_table_new(g_str_hash, g_str_equal);
+        GHashTableIter iter;
+        gpointer tag_key, var;
+        g_hash_table_iter_init(&iter, form->tag_to_var);
+        while (g_hash_table_iter_next(&iter, &tag_key, &var)) {
+            FormField* field = g_hash_table_lookup(by_var, var);
+            if (field) {
+                g_hash_table_insert(form->tag_to_field, tag_key, field);
+            }
+        }
+        g_hash_table_destroy(by_var);
+    }
+
+    return g_hash_table_lookup(form->tag_to_field, tag);
+}
+
+static FormOption*
+_option_by_value(FormField* field, const char* const value)
+{
+    if (!field->option_index) {
+        field->option_index = g_hash_table_new(g_str_hash, g_str_equal);
+        for (GSList* curr = field->options; curr; curr = g_slist_next(curr)) {
+            FormOption* option = curr->data;
+            if (option->value && !g_hash_table_contains(field->option_index, option->value)) {
+                g_hash_table_insert(field->option_index, option->value, option);
+            }
+        }
+    }
+
+    return value ? g_hash_table_lookup(field->option_index, value) : NULL;
+}
+
 static int
 _field_compare_by_var(FormField* a, FormField* b)
 {
@@ -437,259 +496,153 @@ form_get_form_type_field(DataForm* form)
 gboolean
 form_tag_exists(DataForm* form, const char* const tag)
 {
-    GList* tags = g_hash_table_get_keys(form->tag_to_var);
-    GList* curr = tags;
-    while (curr) {
-        if (g_strcmp0(curr->data, tag) == 0) {
-            g_list_free(tags);
-            return TRUE;
-        }
-        curr = g_list_next(curr);
-    }
-
-    g_list_free(tags);
-    return FALSE;
+    return g_hash_table_contains(form->tag_to_var, tag);
 }
 
 form_field_type_t
 form_get_field_type(DataForm* form, const char* const tag)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                return field->type_t;
-            }
-            curr = g_slist_next(curr);
-        }
-    }
-    return FIELD_UNKNOWN;
+    FormField* field = _field_by_tag(form, tag);
+    return field ? field->type_t : FIELD_UNKNOWN;
 }
 
 void
 form_set_value(DataForm* form, const char* const tag, char* value)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                if (g_slist_length(field->values) == 0) {
-                    field->values = g_slist_append(field->values, strdup(value));
-                    form->modified = TRUE;
-                    return;
-                } else if (g_slist_length(field->values) == 1) {
-                    free(field->values->data);
-                    field->values->data = strdup(value);
-                    form->modified = TRUE;
-                    return;
-                }
-            }
-            curr = g_slist_next(curr);
-        }
+    FormField* field = _field_by_tag(form, tag);
+    if (!field) {
+        return;
+    }
+
+    if (field->values == NULL) {
+        field->values = g_slist_append(field->values, strdup(value));
+        form->modified = TRUE;
+    } else if (field->values->next == NULL) {
+        free(field->values->data);
+        field->values->data = strdup(value);
+        form->modified = TRUE;
     }
 }
 
 void
 form_add_value(DataForm* form, const char* const tag, char* value)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                field->values = g_slist_append(field->values, strdup(value));
-                if (field->type_t == FIELD_TEXT_MULTI) {
-                    int total = g_slist_length(field->values);
-                    GString* value_index = g_string_new("");
-                    g_string_printf(value_index, "val%d", total);
-                    autocomplete_add(field->value_ac, value_index->str);
-                    g_string_free(value_index, TRUE);
-                }
-                form->modified = TRUE;
-                return;
-            }
-            curr = g_slist_next(curr);
-        }
+    FormField* field = _field_by_tag(form, tag);
+    if (!field) {
+        return;
     }
+
+    field->values = g_slist_append(field->values, strdup(value));
+    if (field->type_t == FIELD_TEXT_MULTI) {
+        int total = g_slist_length(field->values);
+        GString* value_index = g_string_new("");
+        g_string_printf(value_index, "val%d", total);
+        autocomplete_add(field->value_ac, value_index->str);
+        g_string_free(value_index, TRUE);
+    }
+    form->modified = TRUE;
 }
 
 gboolean
 form_add_unique_value(DataForm* form, const char* const tag, char* value)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList* curr_value = field->values;
-                while (curr_value) {
-                    if (g_strcmp0(curr_value->data, value) == 0) {
-                        return FALSE;
-                    }
-                    curr_value = g_slist_next(curr_value);
-                }
+    FormField* field = _field_by_tag(form, tag);
+    if (!field) {
+        return FALSE;
+    }
 
-                field->values = g_slist_append(field->values, strdup(value));
-                if (field->type_t == FIELD_JID_MULTI) {
-                    autocomplete_add(field->value_ac, value);
-                }
-                form->modified = TRUE;
-                return TRUE;
-            }
-            curr = g_slist_next(curr);
-        }
+    if (g_slist_find_custom(field->values, value, (GCompareFunc)g_strcmp0)) {
+        return FALSE;
     }
 
-    return FALSE;
+    field->values = g_slist_append(field->values, strdup(value));
+    if (field->type_t == FIELD_JID_MULTI) {
+        autocomplete_add(field->value_ac, value);
+    }
+    form->modified = TRUE;
+    return TRUE;
 }
 
 gboolean
 form_remove_value(DataForm* form, const char* const tag, char* value)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList* found = g_slist_find_custom(field->values, value, (GCompareFunc)g_strcmp0);
-                if (found) {
-                    free(found->data);
-                    found->data = NULL;
-                    field->values = g_slist_delete_link(field->values, found);
-                    if (field->type_t == FIELD_JID_MULTI) {
-                        autocomplete_remove(field->value_ac, value);
-                    }
-                    form->modified = TRUE;
-                    return TRUE;
-                } else {
-                    return FALSE;
-                }
-            }
-            curr = g_slist_next(curr);
-        }
+    FormField* field = _field_by_tag(form, tag);
+    if (!field) {
+        return FALSE;
     }
 
-    return FALSE;
+    GSList* found = g_slist_find_custom(field->values, value, (GCompareFunc)g_strcmp0);
+    if (!found) {
+        return FALSE;
+    }
+
+    free(found->data);
+    found->data = NULL;
+    field->values = g_slist_delete_link(field->values, found);
+    if (field->type_t == FIELD_JID_MULTI) {
+        autocomplete_remove(field->value_ac, value);
+    }
+    form->modified = TRUE;
+    return TRUE;
 }
 
 gboolean
 form_remove_text_multi_value(DataForm* form, const char* const tag, int index)
 {
     index--;
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList* item = g_slist_nth(field->values, index);
-                if (item) {
-                    free(item->data);
-                    item->data = NULL;
-                    field->values = g_slist_delete_link(field->values, item);
-                    GString* value_index = g_string_new("");
-                    g_string_printf(value_index, "val%d", index + 1);
-                    autocomplete_remove(field->value_ac, value_index->str);
-                    g_string_free(value_index, TRUE);
-                    form->modified = TRUE;
-                    return TRUE;
-                } else {
-                    return FALSE;
-                }
-            }
-            curr = g_slist_next(curr);
-        }
+    FormField* field = _field_by_tag(form, tag);
+    if (!field) {
+        return FALSE;
+    }
+
+    GSList* item = g_slist_nth(field->values, index);
+    if (!item) {
+        return FALSE;
     }
 
-    return FALSE;
+    free(item->data);
+    item->data = NULL;
+    field->values = g_slist_delete_link(field->values, item);
+    GString* value_index = g_string_new("");
+    g_string_printf(value_index, "val%d", index + 1);
+    autocomplete_remove(field->value_ac, value_index->str);
+    g_string_free(value_index, TRUE);
+    form->modified = TRUE;
+    return TRUE;
 }
 
 int
 form_get_value_count(DataForm* form, const char* const tag)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                if ((g_slist_length(field->values) == 1) && (field->values->data == NULL)) {
-                    return 0;
-                } else {
-                    return g_slist_length(field->values);
-                }
-            }
-            curr = g_slist_next(curr);
-        }
+    FormField* field = _field_by_tag(form, tag);
+    if (!field) {
+        return 0;
     }
 
-    return 0;
+    if (field->values && field->values->next == NULL && field->values->data == NULL) {
+        return 0;
+    }
+    return g_slist_length(field->values);
 }
 
 gboolean
 form_field_contains_option(DataForm* form, const char* const tag, char* value)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList* curr_option = field->options;
-                while (curr_option) {
-                    FormOption* option = curr_option->data;
-                    if (g_strcmp0(option->value, value) == 0) {
-                        return TRUE;
-                    }
-                    curr_option = g_slist_next(curr_option);
-                }
-            }
-            curr = g_slist_next(curr);
-        }
-    }
-
-    return FALSE;
+    FormField* field = _field_by_tag(form, tag);
+    return field && _option_by_value(field, value) != NULL;
 }
 
 FormField*
 form_get_field_by_tag(DataForm* form, const char* const tag)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                return field;
-            }
-            curr = g_slist_next(curr);
-        }
-    }
-    return NULL;
+    return _field_by_tag(form, tag);
 }
 
 Autocomplete
 form_get_value_ac(DataForm* form, const char* const tag)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                return field->value_ac;
-            }
-            curr = g_slist_next(curr);
-        }
-    }
-    return NULL;
+    FormField* field = _field_by_tag(form, tag);
+    return field ? field->value_ac : NULL;
 }
 
 void
@@ -42,22 +42,29 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <netinet/tcp.h>
 #include <glib.h>
 
 #include <strophe.h>
 
 #include "profanity.h"
 #include "log.h"
+#include "database.h"
 #include "config/preferences.h"
 #include "event/server_events.h"
 #include "plugins/plugins.h"
 #include "tools/http_upload.h"
+#include "tools/memusage.h"
+#include "tools/perf.h"
+#include "tools/scheduler.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/connection.h"
 #include "xmpp/session.h"
 #include "xmpp/iq.h"
+#include "xmpp/iq_future.h"
+#include "xmpp/message.h"
 #include "xmpp/capabilities.h"
 #include "xmpp/blocking.h"
 #include "xmpp/session.h"
@@ -81,9 +88,19 @@ typedef struct p_iq_handle_t
 {
     ProfIqCallback func;
     ProfIqFreeCallback free_func;
+    ProfIqTimeoutCallback timeout_func;
     void* userdata;
+    gint64 added;     // monotonic
+    gint64 deadline;  // monotonic seconds
+    GList* wheel_link; // in expiry_wheel[deadline % IQ_WHEEL_SLOTS], data is the id
 } ProfIqHandler;
 
+typedef struct p_ping_data_t
+{
+    GDateTime* sent;
+    char* target;
+} ProfPingData;
+
 typedef struct privilege_set_t
 {
     char* item;
@@ -108,7 +125,53 @@ typedef struct mam_rsm_userdata
     char* datestr;
 } MamRsmUserdata;
 
+// MAM catch-up after connecting: the time since the newest archived message
+// is split into windows, each paged through on its own, all in flight at once
+#define MAM_SYNC_WINDOWS       4
+#define MAM_SYNC_MIN_WINDOW_S  (60 * 60)
+#define MAM_SYNC_DEFAULT_DAYS  7
+#define MAM_SYNC_PAGE_SIZE     100
+
+typedef struct mam_sync_window_t
+{
+    char* queryid;
+    char* start;
+    char* end;
+    char* after;
+    int pages;
+} MamSyncWindow;
+
+// a caps ver asked for waits this long before the next JID is asked
+#define CAPS_REQUEST_TIMEOUT_SEC 30
+
+// one disco#info in flight for each uncached ver, the other JIDs announcing
+// it are mapped to it once answered
+typedef struct caps_request_t
+{
+    char* ver;
+    char* node;
+    GQueue* parked;
+} ProfCapsRequest;
+
+// room lists are asked for a page at a time, each shown as it arrives
+#define ROOM_LIST_PAGE_SIZE 250
+
+// held by the handler of each page in flight
+typedef struct room_list_request_t
+{
+    int refs;
+    char* service;
+    char* filter;
+    GPatternSpec* glob;
+    // DiscoItem, cached once the list is complete
+    GPtrArray* rooms;
+    char* after;
+    int matched;
+    int pages;
+} ProfRoomListRequest;
+
 static int _iq_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
+static int _iq_handle(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
 
 static void _error_handler(xmpp_stanza_t* const stanza);
 static void _disco_info_get_handler(xmpp_stanza_t* const stanza);
@@ -120,8 +183,9 @@ static void _ping_get_handler(xmpp_stanza_t* const stanza);
 
 static int _version_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _disco_info_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
-static int _disco_info_response_id_handler_onconnect(xmpp_stanza_t* const stanza, void* const userdata);
+static void _disco_info_onconnect_settled(IqFuture* future, void* userdata);
 static int _http_upload_response_id_handler(xmpp_stanza_t* const stanza, void* const upload_ctx);
+static void _http_upload_timeout(void* userdata);
 static int _last_activity_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _room_info_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _destroy_room_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
@@ -135,20 +199,39 @@ static int _room_kick_result_id_handler(xmpp_stanza_t* const stanza, void* const
 static int _enable_carbons_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _disable_carbons_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _manual_pong_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static void _manual_ping_timeout(void* userdata);
+static void _iq_free_ping_data(ProfPingData* ping);
 static int _caps_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static void _caps_request_timeout(void* userdata);
+static void _caps_request_send(ProfCapsRequest* request, const char* const to, const char* const id);
+static void _caps_request_next(ProfCapsRequest* request);
+static void _caps_request_free(ProfCapsRequest* request);
 static int _caps_response_for_jid_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _caps_response_legacy_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _auto_pong_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _room_list_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static ProfRoomListRequest* _room_list_request_new(const char* const service, const char* const filter);
+static ProfRoomListRequest* _room_list_request_ref(ProfRoomListRequest* request);
+static void _room_list_request_unref(ProfRoomListRequest* request);
+static void _room_list_send(ProfRoomListRequest* request);
+static void _room_list_show(ProfRoomListRequest* request, DiscoItem* room);
+static void _room_list_done(ProfRoomListRequest* request);
+static void _room_list_free(GPtrArray* rooms);
 static int _command_list_result_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _command_exec_response_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _mam_rsm_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static int _mam_sync_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _register_change_password_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 
 static void _iq_free_room_data(ProfRoomInfoData* roominfo);
 static void _iq_free_affiliation_set(ProfPrivilegeSet* affiliation_set);
 static void _iq_free_affiliation_list(ProfAffiliationList* affiliation_list);
 static void _iq_id_handler_free(ProfIqHandler* handler);
+static gboolean _iq_expiry_task(void* data);
+static void _mam_sync_send(MamSyncWindow* window);
+static void _mam_sync_window_done(MamSyncWindow* window);
+static void _mam_sync_window_free(MamSyncWindow* window);
+static void _mam_sync_reset(void);
 
 // scheduled
 static int _autoping_timed_send(xmpp_conn_t* const conn, void* const userdata);
@@ -157,24 +240,64 @@ static void _identity_destroy(DiscoIdentity* identity);
 static void _item_destroy(DiscoItem* item);
 
 static gboolean autoping_wait = FALSE;
-static GTimer* autoping_time = NULL;
+static SchedulerTask* autoping_timeout_task = NULL;
+
+// adaptive autoping: anything from the server proves the link as well as a
+// pong, and each pong doubles the gap to the next ping, up to this many
+// intervals. Without a TCP user timeout a dead link would only be noticed by
+// the next ping, so the gap stays at one interval.
+#ifdef TCP_USER_TIMEOUT
+#define AUTOPING_BACKOFF_MAX 8
+#else
+#define AUTOPING_BACKOFF_MAX 1
+#endif
+static guint autoping_backoff = 1;
+static gint64 autoping_last_sent = 0;
 static GHashTable* id_handlers;
+
+// Handlers wait for their reply in a timer wheel with a slot per second of
+// their deadline, a deadline further off than the wheel goes round stays in
+// its slot until its round comes.
+#define IQ_WHEEL_SLOTS         512
+#define IQ_PING_TIMEOUT_SEC    30
+static GList* expiry_wheel[IQ_WHEEL_SLOTS];
+static gint64 expiry_checked = 0;
+static SchedulerTask* expiry_task = NULL;
+static guint64 expired_total = 0;
+// service to its GPtrArray of DiscoItem
 static GHashTable* rooms_cache = NULL;
+// ver to ProfCapsRequest
+static GHashTable* caps_requests = NULL;
+static GList* mam_sync_windows = NULL;
+static int mam_sync_total = 0;
+static int mam_sync_pages = 0;
 
 static int
 _iq_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
+{
+    gint64 started = perf_start();
+    int res = _iq_handle(conn, stanza, userdata);
+    perf_stop_named(PERF_IQ, started, NULL, xmpp_stanza_get_from(stanza));
+
+    return res;
+}
+
+static int
+_iq_handle(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
 {
     log_debug("iq stanza handler fired");
 
     iq_autoping_timer_cancel(); // reset the autoping timer
 
-    char* text;
-    size_t text_size;
-    xmpp_stanza_to_text(stanza, &text, &text_size);
-    gboolean cont = plugins_on_iq_stanza_receive(text);
-    xmpp_free(connection_get_ctx(), text);
-    if (!cont) {
-        return 1;
+    if (plugins_hook_in_use(PLUGIN_HOOK_ON_IQ_STANZA_RECEIVE)) {
+        char* text;
+        size_t text_size;
+        xmpp_stanza_to_text(stanza, &text, &text_size);
+        gboolean cont = plugins_on_iq_stanza_receive(text);
+        xmpp_free(connection_get_ctx(), text);
+        if (!cont) {
+            return 1;
+        }
     }
 
     const char* type = xmpp_stanza_get_type(stanza);
@@ -233,36 +356,93 @@ _iq_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const us
                 g_hash_table_remove(id_handlers, id);
             }
         }
+        // a handler kept for more replies keeps its deadline
     }
 
     return 1;
 }
 
+// register with the current connection, pending id handlers stay
 void
-iq_handlers_init(void)
+iq_handlers_attach(void)
 {
     xmpp_conn_t* const conn = connection_get_conn();
     xmpp_ctx_t* const ctx = connection_get_ctx();
     xmpp_handler_add(conn, _iq_handler, NULL, STANZA_NAME_IQ, NULL, ctx);
 
+    autoping_backoff = 1;
+    autoping_last_sent = 0;
     if (prefs_get_autoping() != 0) {
         int millis = prefs_get_autoping() * 1000;
         xmpp_timed_handler_add(conn, _autoping_timed_send, millis, ctx);
     }
+}
+
+void
+iq_replay(xmpp_stanza_t* const stanza)
+{
+    _iq_handler(connection_get_conn(), stanza, connection_get_ctx());
+}
+
+void
+iq_handlers_init(void)
+{
+    iq_handlers_attach();
 
     iq_handlers_clear();
 
     id_handlers = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_iq_id_handler_free);
-    rooms_cache = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)xmpp_stanza_release);
+    if (!rooms_cache) {
+        rooms_cache = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_room_list_free);
+    }
 }
 
 void
 iq_handlers_clear()
 {
+    _mam_sync_reset();
+    http_upload_queue_clear();
+
+    // taken out first, freeing a handler may settle an IqFuture whose
+    // callback asks for another one, which is then not waited for
     if (id_handlers) {
-        g_hash_table_remove_all(id_handlers);
-        g_hash_table_destroy(id_handlers);
+        GHashTable* handlers = id_handlers;
         id_handlers = NULL;
+        g_hash_table_remove_all(handlers);
+        g_hash_table_destroy(handlers);
+    }
+
+    if (caps_requests) {
+        g_hash_table_destroy(caps_requests);
+        caps_requests = NULL;
+    }
+
+    scheduler_remove(expiry_task);
+    expiry_task = NULL;
+}
+
+static void
+_iq_wheel_remove(ProfIqHandler* handler)
+{
+    if (handler->wheel_link) {
+        int slot = handler->deadline % IQ_WHEEL_SLOTS;
+        g_free(handler->wheel_link->data);
+        expiry_wheel[slot] = g_list_delete_link(expiry_wheel[slot], handler->wheel_link);
+        handler->wheel_link = NULL;
+    }
+}
+
+static void
+_iq_wheel_insert(ProfIqHandler* handler, const char* const id, int timeout_sec)
+{
+    handler->deadline = g_get_monotonic_time() / G_USEC_PER_SEC + MAX(timeout_sec, 1);
+    int slot = handler->deadline % IQ_WHEEL_SLOTS;
+    expiry_wheel[slot] = g_list_prepend(expiry_wheel[slot], g_strdup(id));
+    handler->wheel_link = expiry_wheel[slot];
+
+    if (!expiry_task) {
+        expiry_checked = g_get_monotonic_time() / G_USEC_PER_SEC;
+        expiry_task = scheduler_add(1000, _iq_expiry_task, NULL, NULL);
     }
 }
 
@@ -272,61 +452,172 @@ _iq_id_handler_free(ProfIqHandler* handler)
     if (handler == NULL) {
         return;
     }
+    _iq_wheel_remove(handler);
     if (handler->free_func && handler->userdata) {
         handler->free_func(handler->userdata);
     }
     free(handler);
 }
 
-void
+gboolean
 iq_id_handler_add(const char* const id, ProfIqCallback func, ProfIqFreeCallback free_func, void* userdata)
 {
+    if (!id_handlers) {
+        return FALSE;
+    }
+
     ProfIqHandler* handler = malloc(sizeof(ProfIqHandler));
     if (handler) {
         handler->func = func;
         handler->free_func = free_func;
+        handler->timeout_func = NULL;
         handler->userdata = userdata;
+        handler->added = g_get_monotonic_time();
+        handler->wheel_link = NULL;
 
+        // replaces a handler for the same id, which leaves the wheel first
         g_hash_table_insert(id_handlers, strdup(id), handler);
+        _iq_wheel_insert(handler, id, IQ_HANDLER_TIMEOUT_SEC);
     }
+
+    return TRUE;
 }
 
 void
-iq_autoping_timer_cancel(void)
+iq_id_handler_set_timeout(const char* const id, int timeout_sec, ProfIqTimeoutCallback func)
 {
-    autoping_wait = FALSE;
-    if (autoping_time) {
-        g_timer_destroy(autoping_time);
-        autoping_time = NULL;
+    ProfIqHandler* handler = id_handlers ? g_hash_table_lookup(id_handlers, id) : NULL;
+    if (handler) {
+        _iq_wheel_remove(handler);
+        _iq_wheel_insert(handler, id, timeout_sec);
+        handler->timeout_func = func;
     }
 }
 
 void
-iq_autoping_check(void)
+iq_id_handler_remove(const char* const id)
 {
-    if (connection_get_status() != JABBER_CONNECTED) {
-        return;
+    if (id_handlers) {
+        g_hash_table_remove(id_handlers, id);
     }
+}
 
-    if (autoping_wait == FALSE) {
-        return;
+static gboolean
+_iq_expiry_task(void* data)
+{
+    if (!id_handlers || g_hash_table_size(id_handlers) == 0) {
+        expiry_task = NULL;
+        return FALSE;
+    }
+
+    // the ids are collected first, a timeout callback may add handlers
+    gint64 now = g_get_monotonic_time() / G_USEC_PER_SEC;
+    gint64 from = MAX(expiry_checked + 1, now - IQ_WHEEL_SLOTS + 1);
+    GSList* expired = NULL;
+    for (gint64 sec = from; sec <= now; sec++) {
+        for (GList* curr = expiry_wheel[sec % IQ_WHEEL_SLOTS]; curr; curr = g_list_next(curr)) {
+            ProfIqHandler* handler = g_hash_table_lookup(id_handlers, curr->data);
+            if (handler && handler->deadline <= now) {
+                expired = g_slist_prepend(expired, g_strdup(curr->data));
+            }
+        }
     }
+    expiry_checked = now;
 
-    if (autoping_time == NULL) {
+    for (GSList* curr = expired; curr; curr = g_slist_next(curr)) {
+        ProfIqHandler* handler = g_hash_table_lookup(id_handlers, curr->data);
+        if (!handler) {
+            continue;
+        }
+        log_debug("No reply to IQ %s after %" G_GINT64_FORMAT "s, dropping its handler.",
+                  (char*)curr->data, (g_get_monotonic_time() - handler->added) / G_USEC_PER_SEC);
+        if (handler->timeout_func) {
+            handler->timeout_func(handler->userdata);
+        }
+        g_hash_table_remove(id_handlers, curr->data);
+        expired_total++;
+    }
+    g_slist_free_full(expired, g_free);
+
+    return TRUE;
+}
+
+void
+iq_get_pending_stats(IqPendingStats* stats)
+{
+    memset(stats, 0, sizeof(IqPendingStats));
+    stats->expired = expired_total;
+    if (!id_handlers) {
         return;
     }
 
-    gdouble elapsed = g_timer_elapsed(autoping_time, NULL);
-    unsigned long seconds_elapsed = elapsed * 1.0;
-    gint timeout = prefs_get_autoping_timeout();
-    if (timeout > 0 && seconds_elapsed >= timeout) {
-        cons_show("Autoping response timed out after %u seconds.", timeout);
-        log_debug("Autoping check: timed out after %u seconds, disconnecting", timeout);
-        iq_autoping_timer_cancel();
-        session_autoping_fail();
+    gint64 now = g_get_monotonic_time();
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, id_handlers);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        ProfIqHandler* handler = value;
+        gint64 age_ms = (now - handler->added) / 1000;
+        stats->pending++;
+        if (age_ms < 10000) {
+            stats->age_under_10s++;
+        } else if (age_ms < 60000) {
+            stats->age_under_60s++;
+        } else {
+            stats->age_older++;
+        }
+        stats->oldest_ms = MAX(stats->oldest_ms, age_ms);
     }
 }
 
+// Rough heap use of the handlers waiting for a reply, without their userdata
+gsize
+iq_memory(guint* handlers)
+{
+    *handlers = 0;
+    if (!id_handlers) {
+        return 0;
+    }
+
+    *handlers = g_hash_table_size(id_handlers);
+    gsize total = memusage_hash_table(id_handlers);
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, id_handlers);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        // the id, the handler and its link in the timer wheel
+        total += memusage_string(key) + memusage_alloc(sizeof(ProfIqHandler)) + sizeof(GList);
+    }
+
+    return total;
+}
+
+void
+iq_autoping_timer_cancel(void)
+{
+    autoping_wait = FALSE;
+    scheduler_remove(autoping_timeout_task);
+    autoping_timeout_task = NULL;
+}
+
+static gboolean
+_autoping_timed_out(void* data)
+{
+    gint timeout = GPOINTER_TO_INT(data);
+
+    iq_autoping_timer_cancel();
+    if (connection_get_status() != JABBER_CONNECTED) {
+        return FALSE;
+    }
+
+    autoping_backoff = 1;
+    cons_show("Autoping response timed out after %u seconds.", timeout);
+    log_debug("Autoping check: timed out after %u seconds, disconnecting", timeout);
+    session_autoping_fail();
+
+    return FALSE;
+}
+
 void
 iq_set_autoping(const int seconds)
 {
@@ -351,30 +642,29 @@ iq_rooms_cache_clear(void)
 {
     if (rooms_cache) {
         g_hash_table_remove_all(rooms_cache);
-        g_hash_table_destroy(rooms_cache);
-        rooms_cache = NULL;
     }
 }
 
 void
 iq_room_list_request(gchar* conferencejid, gchar* filter)
 {
-    if (g_hash_table_contains(rooms_cache, conferencejid)) {
+    ProfRoomListRequest* request = _room_list_request_new(conferencejid, filter);
+
+    // filtering a cached list needn't ask the service again
+    GPtrArray* cached = rooms_cache ? g_hash_table_lookup(rooms_cache, conferencejid) : NULL;
+    if (cached) {
         log_debug("Rooms request cached for: %s", conferencejid);
-        _room_list_id_handler(g_hash_table_lookup(rooms_cache, conferencejid), filter);
-        return;
+        request->pages = 1;
+        for (guint i = 0; i < cached->len; i++) {
+            _room_list_show(request, g_ptr_array_index(cached, i));
+        }
+        _room_list_done(request);
+    } else {
+        log_debug("Rooms request not cached for: %s", conferencejid);
+        _room_list_send(request);
     }
 
-    log_debug("Rooms request not cached for: %s", conferencejid);
-
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-    char* id = connection_create_stanza_id();
-    xmpp_stanza_t* iq = stanza_create_disco_items_iq(ctx, id, conferencejid, NULL);
-
-    iq_id_handler_add(id, _room_list_id_handler, NULL, filter);
-
-    iq_send_stanza(iq);
-    xmpp_stanza_release(iq);
+    _room_list_request_unref(request);
 }
 
 void
@@ -409,6 +699,7 @@ iq_http_upload_request(HTTPUpload* upload)
     char* jid = connection_jid_for_feature(STANZA_NS_HTTP_UPLOAD);
     if (jid == NULL) {
         cons_show_error("XEP-0363 HTTP File Upload is not supported by the server");
+        http_upload_queue_slot_failed(upload);
         return;
     }
 
@@ -416,6 +707,8 @@ iq_http_upload_request(HTTPUpload* upload)
     char* id = connection_create_stanza_id();
     xmpp_stanza_t* iq = stanza_create_http_upload_request(ctx, id, jid, upload);
     iq_id_handler_add(id, _http_upload_response_id_handler, NULL, upload);
+    // without a reply the rest of the batch would wait for the slot forever
+    iq_id_handler_set_timeout(id, IQ_HANDLER_TIMEOUT_SEC, _http_upload_timeout);
     free(id);
 
     iq_send_stanza(iq);
@@ -439,19 +732,21 @@ iq_disco_info_request(gchar* jid)
     xmpp_stanza_release(iq);
 }
 
-void
+IqFuture*
 iq_disco_info_request_onconnect(gchar* jid)
 {
     xmpp_ctx_t* const ctx = connection_get_ctx();
     char* id = connection_create_stanza_id();
     xmpp_stanza_t* iq = stanza_create_disco_info_iq(ctx, id, jid, NULL);
 
-    iq_id_handler_add(id, _disco_info_response_id_handler_onconnect, NULL, NULL);
+    IqFuture* future = iq_future_new();
+    iq_future_then(future, _disco_info_onconnect_settled, strdup(jid), free);
+    iq_future_send(future, iq);
 
     free(id);
-
-    iq_send_stanza(iq);
     xmpp_stanza_release(iq);
+
+    return future;
 }
 
 void
@@ -520,8 +815,6 @@ void
 iq_send_caps_request(const char* const to, const char* const id,
                      const char* const node, const char* const ver)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-
     if (!node) {
         log_error("Could not create caps request, no node");
         return;
@@ -531,17 +824,85 @@ iq_send_caps_request(const char* const to, const char* const id,
         return;
     }
 
+    if (!caps_requests) {
+        caps_requests = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)_caps_request_free);
+    }
+
+    ProfCapsRequest* request = g_hash_table_lookup(caps_requests, ver);
+    if (request) {
+        log_debug("Capabilities %s already requested, %s waits for the answer", ver, to);
+        g_queue_push_tail(request->parked, strdup(to));
+        return;
+    }
+
+    request = malloc(sizeof(ProfCapsRequest));
+    request->ver = strdup(ver);
+    request->node = strdup(node);
+    request->parked = g_queue_new();
+    g_hash_table_insert(caps_requests, request->ver, request);
+
+    _caps_request_send(request, to, id);
+}
+
+static void
+_caps_request_send(ProfCapsRequest* request, const char* const to, const char* const id)
+{
+    xmpp_ctx_t* const ctx = connection_get_ctx();
+
     GString* node_str = g_string_new("");
-    g_string_printf(node_str, "%s#%s", node, ver);
+    g_string_printf(node_str, "%s#%s", request->node, request->ver);
     xmpp_stanza_t* iq = stanza_create_disco_info_iq(ctx, id, to, node_str->str);
     g_string_free(node_str, TRUE);
 
-    iq_id_handler_add(id, _caps_response_id_handler, NULL, NULL);
+    char* ver = strdup(request->ver);
+    if (iq_id_handler_add(id, _caps_response_id_handler, free, ver)) {
+        iq_id_handler_set_timeout(id, CAPS_REQUEST_TIMEOUT_SEC, _caps_request_timeout);
+    } else {
+        free(ver);
+    }
 
     iq_send_stanza(iq);
     xmpp_stanza_release(iq);
 }
 
+// The JID asked gave no usable answer, the next one waiting is asked
+static void
+_caps_request_next(ProfCapsRequest* request)
+{
+    char* next = g_queue_pop_head(request->parked);
+    if (!next) {
+        g_hash_table_remove(caps_requests, request->ver);
+        return;
+    }
+
+    log_debug("Capabilities %s requested again from %s", request->ver, next);
+    char* id = connection_create_stanza_id();
+    _caps_request_send(request, next, id);
+    free(id);
+    free(next);
+}
+
+static void
+_caps_request_timeout(void* userdata)
+{
+    ProfCapsRequest* request = caps_requests ? g_hash_table_lookup(caps_requests, userdata) : NULL;
+    if (request) {
+        log_debug("No answer for capabilities %s", request->ver);
+        _caps_request_next(request);
+    }
+}
+
+static void
+_caps_request_free(ProfCapsRequest* request)
+{
+    if (request) {
+        free(request->ver);
+        free(request->node);
+        g_queue_free_full(request->parked, free);
+        free(request);
+    }
+}
+
 void
 iq_send_caps_request_legacy(const char* const to, const char* const id,
                             const char* const node, const char* const ver)
@@ -751,8 +1112,11 @@ iq_send_ping(const char* const target)
     xmpp_stanza_t* iq = stanza_create_ping_iq(ctx, target);
     const char* id = xmpp_stanza_get_id(iq);
 
-    GDateTime* now = g_date_time_new_now_local();
-    iq_id_handler_add(id, _manual_pong_id_handler, (ProfIqFreeCallback)g_date_time_unref, now);
+    ProfPingData* ping = malloc(sizeof(ProfPingData));
+    ping->sent = g_date_time_new_now_local();
+    ping->target = target ? strdup(target) : NULL;
+    iq_id_handler_add(id, _manual_pong_id_handler, (ProfIqFreeCallback)_iq_free_ping_data, ping);
+    iq_id_handler_set_timeout(id, IQ_PING_TIMEOUT_SEC, _manual_ping_timeout);
 
     iq_send_stanza(iq);
     xmpp_stanza_release(iq);
@@ -849,28 +1213,37 @@ _caps_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
         log_debug("Capabilities response handler fired");
     }
 
+    ProfCapsRequest* request = caps_requests ? g_hash_table_lookup(caps_requests, userdata) : NULL;
+    if (!request) {
+        return 0;
+    }
+
     const char* from = xmpp_stanza_get_from(stanza);
     if (!from) {
         log_info("_caps_response_id_handler(): No from attribute");
+        _caps_request_next(request);
         return 0;
     }
 
     // handle error responses
     if (g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
         char* error_message = stanza_get_error_message(stanza);
-        log_warning("Error received for capabilities response from %s: ", from, error_message);
+        log_warning("Error received for capabilities response from %s: %s", from, error_message);
         free(error_message);
+        _caps_request_next(request);
         return 0;
     }
 
     if (query == NULL) {
         log_info("_caps_response_id_handler(): No query element found.");
+        _caps_request_next(request);
         return 0;
     }
 
     const char* node = xmpp_stanza_get_attribute(query, STANZA_ATTR_NODE);
     if (node == NULL) {
         log_info("_caps_response_id_handler(): No node attribute found");
+        _caps_request_next(request);
         return 0;
     }
 
@@ -883,6 +1256,7 @@ _caps_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
         log_warning("Generated sha-1 does not match given:");
         log_warning("Generated : %s", generated_sha1);
         log_warning("Given     : %s", given_sha1);
+        _caps_request_next(request);
     } else {
         log_debug("Valid SHA-1 hash found: %s", given_sha1);
 
@@ -896,6 +1270,14 @@ _caps_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
         }
 
         caps_map_jid_to_ver(from, given_sha1);
+        if (g_strcmp0(given_sha1, request->ver) == 0) {
+            for (GList* curr = request->parked->head; curr; curr = g_list_next(curr)) {
+                caps_map_jid_to_ver(curr->data, given_sha1);
+            }
+            g_hash_table_remove(caps_requests, request->ver);
+        } else {
+            _caps_request_next(request);
+        }
     }
 
     g_free(generated_sha1);
@@ -1036,90 +1418,197 @@ _caps_response_legacy_id_handler(xmpp_stanza_t* const stanza, void* const userda
 static int
 _room_list_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
 {
-    gchar* filter = (gchar*)userdata;
+    ProfRoomListRequest* request = (ProfRoomListRequest*)userdata;
     const char* id = xmpp_stanza_get_id(stanza);
-    const char* from = xmpp_stanza_get_from(stanza);
-
-    if (prefs_get_boolean(PREF_ROOM_LIST_CACHE) && !g_hash_table_contains(rooms_cache, from)) {
-        g_hash_table_insert(rooms_cache, strdup(from), xmpp_stanza_copy(stanza));
-    }
 
     log_debug("Response to query: %s", id);
 
     xmpp_stanza_t* query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
-    if (query == NULL) {
+    if (query == NULL || g_strcmp0(xmpp_stanza_get_type(stanza), STANZA_TYPE_ERROR) == 0) {
+        // what earlier pages had is still shown
+        if (request->pages > 0) {
+            cons_show("  Room list incomplete, %s stopped answering.", request->service);
+        }
         return 0;
     }
 
-    cons_show("");
-    if (filter) {
-        cons_show("Rooms list response received: %s, filter: %s", from, filter);
-    } else {
-        cons_show("Rooms list response received: %s", from);
+    if (request->pages == 0) {
+        cons_show("");
+        if (request->filter) {
+            cons_show("Rooms list response received: %s, filter: %s", request->service, request->filter);
+        } else {
+            cons_show("Rooms list response received: %s", request->service);
+        }
     }
-    xmpp_stanza_t* child = xmpp_stanza_get_children(query);
-    if (child == NULL) {
-        cons_show("  No rooms found.");
-        return 0;
+    request->pages++;
+
+    int items = 0;
+    for (xmpp_stanza_t* child = xmpp_stanza_get_children(query); child; child = xmpp_stanza_get_next(child)) {
+        const char* stanza_name = xmpp_stanza_get_name(child);
+        if (g_strcmp0(stanza_name, STANZA_NAME_ITEM) != 0) {
+            continue;
+        }
+        const char* item_jid = xmpp_stanza_get_attribute(child, STANZA_ATTR_JID);
+        if (!item_jid) {
+            continue;
+        }
+
+        DiscoItem* room = malloc(sizeof(DiscoItem));
+        room->jid = strdup(item_jid);
+        const char* item_name = xmpp_stanza_get_attribute(child, STANZA_ATTR_NAME);
+        room->name = item_name ? strdup(item_name) : NULL;
+        g_ptr_array_add(request->rooms, room);
+        _room_list_show(request, room);
+        items++;
+    }
+
+    // XEP-0059, more pages follow while one names its last item, services
+    // without it send everything at once
+    char* last = NULL;
+    gboolean more = FALSE;
+    xmpp_stanza_t* set = xmpp_stanza_get_child_by_name_and_ns(query, STANZA_TYPE_SET, STANZA_NS_RSM);
+    if (set && items > 0) {
+        xmpp_stanza_t* last_st = xmpp_stanza_get_child_by_name(set, STANZA_NAME_LAST);
+        last = last_st ? xmpp_stanza_get_text(last_st) : NULL;
+        more = last && g_strcmp0(last, request->after) != 0;
+
+        xmpp_stanza_t* count_st = xmpp_stanza_get_child_by_name(set, STANZA_NAME_COUNT);
+        char* count = count_st ? xmpp_stanza_get_text(count_st) : NULL;
+        if (count && request->rooms->len >= (guint)strtoul(count, NULL, 10)) {
+            more = FALSE;
+        }
+        free(count);
     }
 
-    GPatternSpec* glob = NULL;
-    if (filter != NULL) {
+    if (more) {
+        free(request->after);
+        request->after = last;
+        _room_list_send(request);
+    } else {
+        free(last);
+        _room_list_done(request);
+    }
+
+    return 0;
+}
+
+static ProfRoomListRequest*
+_room_list_request_new(const char* const service, const char* const filter)
+{
+    ProfRoomListRequest* request = malloc(sizeof(ProfRoomListRequest));
+    request->refs = 1;
+    request->service = strdup(service);
+    request->filter = filter ? strdup(filter) : NULL;
+    request->glob = NULL;
+    if (filter) {
         gchar* filter_lower = g_utf8_strdown(filter, -1);
-        GString* glob_str = g_string_new("*");
-        g_string_append(glob_str, filter_lower);
-        g_string_append(glob_str, "*");
-        glob = g_pattern_spec_new(glob_str->str);
-        g_string_free(glob_str, TRUE);
+        gchar* glob_str = g_strdup_printf("*%s*", filter_lower);
+        request->glob = g_pattern_spec_new(glob_str);
+        g_free(glob_str);
+        g_free(filter_lower);
     }
+    request->rooms = g_ptr_array_new_with_free_func((GDestroyNotify)_item_destroy);
+    request->after = NULL;
+    request->matched = 0;
+    request->pages = 0;
 
-    gboolean matched = FALSE;
-    while (child) {
-        const char* stanza_name = xmpp_stanza_get_name(child);
-        if (stanza_name && (g_strcmp0(stanza_name, STANZA_NAME_ITEM) == 0)) {
-            const char* item_jid = xmpp_stanza_get_attribute(child, STANZA_ATTR_JID);
-            gchar* item_jid_lower = NULL;
-            if (item_jid) {
-                Jid* jidp = jid_create(item_jid);
-                if (jidp && jidp->localpart) {
-                    item_jid_lower = g_utf8_strdown(jidp->localpart, -1);
-                }
-                jid_destroy(jidp);
-            }
-            const char* item_name = xmpp_stanza_get_attribute(child, STANZA_ATTR_NAME);
-            gchar* item_name_lower = NULL;
-            if (item_name) {
-                item_name_lower = g_utf8_strdown(item_name, -1);
-            }
-            if ((item_jid_lower) && ((glob == NULL) || ((g_pattern_match(glob, strlen(item_jid_lower), item_jid_lower, NULL)) || (item_name_lower && g_pattern_match(glob, strlen(item_name_lower), item_name_lower, NULL))))) {
+    return request;
+}
 
-                if (glob) {
-                    matched = TRUE;
-                }
-                GString* item = g_string_new(item_jid);
-                if (item_name) {
-                    g_string_append(item, " (");
-                    g_string_append(item, item_name);
-                    g_string_append(item, ")");
-                }
-                cons_show("  %s", item->str);
-                g_string_free(item, TRUE);
-            }
-            g_free(item_jid_lower);
-            g_free(item_name_lower);
+static ProfRoomListRequest*
+_room_list_request_ref(ProfRoomListRequest* request)
+{
+    request->refs++;
+    return request;
+}
+
+static void
+_room_list_request_unref(ProfRoomListRequest* request)
+{
+    if (--request->refs > 0) {
+        return;
+    }
+
+    free(request->service);
+    free(request->filter);
+    if (request->glob) {
+        g_pattern_spec_free(request->glob);
+    }
+    if (request->rooms) {
+        _room_list_free(request->rooms);
+    }
+    free(request->after);
+    free(request);
+}
+
+static void
+_room_list_free(GPtrArray* rooms)
+{
+    g_ptr_array_free(rooms, TRUE);
+}
+
+// the page after request->after, the first one without it
+static void
+_room_list_send(ProfRoomListRequest* request)
+{
+    xmpp_ctx_t* const ctx = connection_get_ctx();
+    char* id = connection_create_stanza_id();
+    xmpp_stanza_t* iq = stanza_create_disco_items_page_iq(ctx, id, request->service, ROOM_LIST_PAGE_SIZE, request->after);
+
+    iq_id_handler_add(id, _room_list_id_handler, (ProfIqFreeCallback)_room_list_request_unref, _room_list_request_ref(request));
+    free(id);
+
+    iq_send_stanza(iq);
+    xmpp_stanza_release(iq);
+}
+
+// Filtering matches the local part of the room JID or its name
+static void
+_room_list_show(ProfRoomListRequest* request, DiscoItem* room)
+{
+    if (request->glob) {
+        gboolean match = FALSE;
+        Jid* jidp = jid_create(room->jid);
+        if (jidp && jidp->localpart) {
+            gchar* jid_lower = g_utf8_strdown(jidp->localpart, -1);
+            match = g_pattern_match_string(request->glob, jid_lower);
+            g_free(jid_lower);
+        }
+        jid_destroy(jidp);
+        if (!match && room->name) {
+            gchar* name_lower = g_utf8_strdown(room->name, -1);
+            match = g_pattern_match_string(request->glob, name_lower);
+            g_free(name_lower);
+        }
+        if (!match) {
+            return;
         }
-        child = xmpp_stanza_get_next(child);
     }
 
-    if (glob && matched == FALSE) {
-        cons_show("  No rooms found matching filter: %s", filter);
+    request->matched++;
+    if (room->name) {
+        cons_show("  %s (%s)", room->jid, room->name);
+    } else {
+        cons_show("  %s", room->jid);
     }
+}
 
-    if (glob) {
-        g_pattern_spec_free(glob);
+static void
+_room_list_done(ProfRoomListRequest* request)
+{
+    if (request->matched == 0) {
+        if (request->glob) {
+            cons_show("  No rooms found matching filter: %s", request->filter);
+        } else {
+            cons_show("  No rooms found.");
+        }
     }
 
-    return 0;
+    // a list got in full is kept, filtering it looks here first
+    if (request->rooms && prefs_get_boolean(PREF_ROOM_LIST_CACHE) && rooms_cache && !g_hash_table_contains(rooms_cache, request->service)) {
+        g_hash_table_insert(rooms_cache, strdup(request->service), request->rooms);
+        request->rooms = NULL;
+    }
 }
 
 static int
@@ -1338,7 +1827,7 @@ _manual_pong_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
 {
     const char* from = xmpp_stanza_get_from(stanza);
     const char* type = xmpp_stanza_get_type(stanza);
-    GDateTime* sent = (GDateTime*)userdata;
+    GDateTime* sent = ((ProfPingData*)userdata)->sent;
 
     // handle error responses
     if (g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
@@ -1369,6 +1858,46 @@ _manual_pong_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
     return 0;
 }
 
+static void
+_manual_ping_timeout(void* userdata)
+{
+    ProfPingData* ping = userdata;
+    if (ping->target == NULL) {
+        cons_show_error("No ping response from server after %d seconds.", IQ_PING_TIMEOUT_SEC);
+    } else {
+        cons_show_error("No ping response from %s after %d seconds.", ping->target, IQ_PING_TIMEOUT_SEC);
+    }
+}
+
+static void
+_iq_free_ping_data(ProfPingData* ping)
+{
+    g_date_time_unref(ping->sent);
+    free(ping->target);
+    free(ping);
+}
+
+// Sends a whitespace keepalive instead of the ping when the server spoke
+// within the interval or the backed off gap has not passed yet
+static gboolean
+_autoping_adaptive_skip(xmpp_conn_t* const conn)
+{
+    if (!prefs_get_boolean(PREF_AUTOPING_ADAPTIVE)) {
+        return FALSE;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    gint64 interval_us = (gint64)prefs_get_autoping() * G_USEC_PER_SEC;
+    gboolean heard_from = now - connection_get_last_received() < interval_us;
+    gboolean backed_off = now - autoping_last_sent < interval_us * autoping_backoff;
+    if (!heard_from && !backed_off) {
+        return FALSE;
+    }
+
+    xmpp_send_raw(conn, " ", 1);
+    return TRUE;
+}
+
 static int
 _autoping_timed_send(xmpp_conn_t* const conn, void* const userdata)
 {
@@ -1390,6 +1919,11 @@ _autoping_timed_send(xmpp_conn_t* const conn, void* const userdata)
         return 1;
     }
 
+    if (_autoping_adaptive_skip(conn)) {
+        return 1;
+    }
+    autoping_last_sent = g_get_monotonic_time();
+
     xmpp_ctx_t* ctx = (xmpp_ctx_t*)userdata;
     xmpp_stanza_t* iq = stanza_create_ping_iq(ctx, NULL);
     const char* id = xmpp_stanza_get_id(iq);
@@ -1401,10 +1935,12 @@ _autoping_timed_send(xmpp_conn_t* const conn, void* const userdata)
     iq_send_stanza(iq);
     xmpp_stanza_release(iq);
     autoping_wait = TRUE;
-    if (autoping_time) {
-        g_timer_destroy(autoping_time);
+    scheduler_remove(autoping_timeout_task);
+    autoping_timeout_task = NULL;
+    gint timeout = prefs_get_autoping_timeout();
+    if (timeout > 0) {
+        autoping_timeout_task = scheduler_add(timeout * 1000, _autoping_timed_out, GINT_TO_POINTER(timeout), NULL);
     }
-    autoping_time = g_timer_new();
 
     return 1;
 }
@@ -1427,6 +1963,7 @@ _auto_pong_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
         return 0;
     }
     if (g_strcmp0(type, STANZA_TYPE_ERROR) != 0) {
+        autoping_backoff = MIN(autoping_backoff * 2, AUTOPING_BACKOFF_MAX);
         return 0;
     }
 
@@ -2354,37 +2891,51 @@ _disco_info_response_id_handler(xmpp_stanza_t* const stanza, void* const userdat
     return 0;
 }
 
-static int
-_disco_info_response_id_handler_onconnect(xmpp_stanza_t* const stanza, void* const userdata)
+// Without an answer the item counts as answered, with what was cached of it
+static void
+_disco_info_onconnect_settled(IqFuture* future, void* userdata)
 {
-    const char* from = xmpp_stanza_get_from(stanza);
-    const char* type = xmpp_stanza_get_type(stanza);
+    const char* const jid = userdata;
+    xmpp_stanza_t* const stanza = iq_future_stanza(future);
 
-    if (from) {
-        log_debug("Received disco#info response from: %s", from);
-    } else {
-        log_debug("Received disco#info response");
-    }
-
-    // handle error responses
-    if (g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
+    iq_future_state_t state = iq_future_state(future);
+    if (state == IQ_FUTURE_ERROR) {
         char* error_message = stanza_get_error_message(stanza);
-        if (from) {
-            log_error("Service discovery failed for %s: %s", from, error_message);
-        } else {
-            log_error("Service discovery failed: %s", error_message);
-        }
+        log_error("Service discovery failed for %s: %s", jid, error_message);
         free(error_message);
-        return 0;
+        connection_features_failed(jid);
+        return;
+    } else if (state == IQ_FUTURE_TIMEOUT) {
+        log_warning("Service discovery timed out for %s", jid);
+        connection_features_failed(jid);
+        return;
+    } else if (state != IQ_FUTURE_RESULT) {
+        // cancelled with the connection
+        return;
+    }
+
+    const char* from = xmpp_stanza_get_from(stanza);
+    if (!from) {
+        from = jid;
     }
+    log_debug("Received disco#info response from: %s", from);
 
     xmpp_stanza_t* query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
+    char* ver = NULL;
 
     if (query) {
         GHashTable* features = connection_get_features(from);
         if (features == NULL) {
             log_error("No matching disco item found for %s", from);
-            return 1;
+            return;
+        }
+
+        // replaces what was cached from the last connection
+        g_hash_table_remove_all(features);
+
+        // the server's caps hash tells whether the cached features still hold
+        if (g_strcmp0(from, connection_get_domain()) == 0) {
+            ver = stanza_create_caps_sha1_from_query(query);
         }
 
         xmpp_stanza_t* child = xmpp_stanza_get_children(query);
@@ -2400,9 +2951,8 @@ _disco_info_response_id_handler_onconnect(xmpp_stanza_t* const stanza, void* con
         }
     }
 
-    connection_features_received(from);
-
-    return 0;
+    connection_features_received(from, ver);
+    free(ver);
 }
 
 static int
@@ -2427,6 +2977,7 @@ _http_upload_response_id_handler(xmpp_stanza_t* const stanza, void* const userda
             cons_show_error("Uploading '%s' failed: %s", upload->filename, error_message);
         }
         free(error_message);
+        http_upload_queue_slot_failed(upload);
         return 0;
     }
 
@@ -2460,17 +3011,27 @@ _http_upload_response_id_handler(xmpp_stanza_t* const stanza, void* const userda
                 }
             }
 
-            pthread_create(&(upload->worker), NULL, &http_file_put, upload);
-            http_upload_add_upload(upload);
-        } else {
-            log_error("Invalid XML in HTTP Upload slot");
-            return 1;
+            http_upload_queue_slot_received(upload);
+            return 0;
         }
     }
 
+    log_error("Invalid XML in HTTP Upload slot");
+    cons_show_error("Uploading '%s' failed: Invalid upload slot", upload->filename);
+    http_upload_queue_slot_failed(upload);
+
     return 0;
 }
 
+static void
+_http_upload_timeout(void* userdata)
+{
+    HTTPUpload* upload = (HTTPUpload*)userdata;
+
+    cons_show_error("Uploading '%s' failed: No upload slot received", upload->filename);
+    http_upload_queue_slot_failed(upload);
+}
+
 static void
 _disco_items_result_handler(xmpp_stanza_t* const stanza)
 {
@@ -2529,11 +3090,17 @@ _disco_items_result_handler(xmpp_stanza_t* const stanza)
 void
 iq_send_stanza(xmpp_stanza_t* const stanza)
 {
+    xmpp_conn_t* conn = connection_get_conn();
+    if (!plugins_hook_in_use(PLUGIN_HOOK_ON_IQ_STANZA_SEND)) {
+        xmpp_send(conn, stanza);
+        connection_stanza_queued();
+        return;
+    }
+
     char* text;
     size_t text_size;
     xmpp_stanza_to_text(stanza, &text, &text_size);
 
-    xmpp_conn_t* conn = connection_get_conn();
     char* plugin_text = plugins_on_iq_stanza_send(text);
     if (plugin_text) {
         xmpp_send_raw_string(conn, "%s", plugin_text);
@@ -2541,6 +3108,7 @@ iq_send_stanza(xmpp_stanza_t* const stanza)
     } else {
         xmpp_send_raw_string(conn, "%s", text);
     }
+    connection_stanza_queued();
     xmpp_free(connection_get_ctx(), text);
 }
 
@@ -2587,7 +3155,7 @@ iq_mam_request(ProfChatWin* win)
     GDateTime* timestamp = g_date_time_add_days(now, -7);
     g_date_time_unref(now);
     gchar* datestr = g_date_time_format(timestamp, "%FT%TZ");
-    xmpp_stanza_t* iq = stanza_create_mam_iq(ctx, win->barejid, datestr, NULL);
+    xmpp_stanza_t* iq = stanza_create_mam_iq(ctx, win->barejid, datestr, NULL, NULL, 0);
 
     MamRsmUserdata* data = malloc(sizeof(MamRsmUserdata));
     if (data) {
@@ -2630,7 +3198,7 @@ _mam_rsm_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
                 xmpp_ctx_t* const ctx = connection_get_ctx();
 
                 MamRsmUserdata* data = (MamRsmUserdata*)userdata;
-                xmpp_stanza_t* iq = stanza_create_mam_iq(ctx, data->barejid, data->datestr, lastid);
+                xmpp_stanza_t* iq = stanza_create_mam_iq(ctx, data->barejid, data->datestr, NULL, lastid, 0);
                 free(data->barejid);
                 free(data->datestr);
                 free(data);
@@ -2645,6 +3213,227 @@ _mam_rsm_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
     return 0;
 }
 
+void
+iq_mam_sync(void)
+{
+    if (mam_sync_windows) {
+        log_debug("MAM catch-up already running");
+        return;
+    }
+    if (connection_supports(XMPP_FEATURE_MAM2) == FALSE) {
+        log_debug("Server doesn't advertise %s, skipping MAM catch-up.", XMPP_FEATURE_MAM2);
+        return;
+    }
+
+    char* after = NULL;
+    GDateTime* start = NULL;
+    GDateTime* now = g_date_time_new_now_utc();
+    if (!log_database_get_last_archived(&after, &start)) {
+        start = g_date_time_add_days(now, -MAM_SYNC_DEFAULT_DAYS);
+    }
+
+    gint64 span = g_date_time_to_unix(now) - g_date_time_to_unix(start);
+    int count = CLAMP(span / MAM_SYNC_MIN_WINDOW_S, 1, MAM_SYNC_WINDOWS);
+    gint64 step = span / count;
+
+    for (int i = 0; i < count; i++) {
+        GDateTime* window_start = g_date_time_add_seconds(start, (gdouble)(step * i));
+        GDateTime* window_start_utc = g_date_time_to_utc(window_start);
+
+        MamSyncWindow* window = malloc(sizeof(MamSyncWindow));
+        window->queryid = NULL;
+        window->start = g_date_time_format(window_start_utc, "%FT%TZ");
+        window->end = NULL;
+        window->after = NULL;
+        window->pages = 0;
+
+        // the last window runs up to now
+        if (i < count - 1) {
+            GDateTime* window_end = g_date_time_add_seconds(start, (gdouble)(step * (i + 1)));
+            GDateTime* window_end_utc = g_date_time_to_utc(window_end);
+            window->end = g_date_time_format(window_end_utc, "%FT%TZ");
+            g_date_time_unref(window_end_utc);
+            g_date_time_unref(window_end);
+        }
+
+        // continue right after what we already have
+        if (i == 0 && after) {
+            window->after = g_strdup(after);
+        }
+
+        g_date_time_unref(window_start_utc);
+        g_date_time_unref(window_start);
+
+        mam_sync_windows = g_list_append(mam_sync_windows, window);
+    }
+
+    free(after);
+    g_date_time_unref(start);
+    g_date_time_unref(now);
+
+    mam_sync_total = count;
+    mam_sync_pages = 0;
+    log_info("MAM catch-up started with %d windows", count);
+
+    // messages of a page are written together once the page is complete
+    log_database_bulk_begin();
+
+    GList* curr = mam_sync_windows;
+    while (curr) {
+        _mam_sync_send(curr->data);
+        curr = g_list_next(curr);
+    }
+}
+
+gboolean
+iq_mam_is_sync_query(const char* const queryid)
+{
+    if (queryid == NULL) {
+        return FALSE;
+    }
+
+    GList* curr = mam_sync_windows;
+    while (curr) {
+        MamSyncWindow* window = curr->data;
+        if (g_strcmp0(window->queryid, queryid) == 0) {
+            return TRUE;
+        }
+        curr = g_list_next(curr);
+    }
+
+    return FALSE;
+}
+
+static void
+_mam_sync_send(MamSyncWindow* window)
+{
+    xmpp_ctx_t* const ctx = connection_get_ctx();
+    xmpp_stanza_t* iq = stanza_create_mam_iq(ctx, NULL, window->start, window->end, window->after, MAM_SYNC_PAGE_SIZE);
+
+    g_free(window->queryid);
+    window->queryid = g_strdup(xmpp_stanza_get_id(iq));
+    iq_id_handler_add(xmpp_stanza_get_id(iq), _mam_sync_id_handler, NULL, window);
+
+    iq_send_stanza(iq);
+    xmpp_stanza_release(iq);
+}
+
+static void _mam_sync_page(xmpp_stanza_t* const stanza, MamSyncWindow* window);
+
+static void
+_mam_sync_page_deferred(xmpp_stanza_t* const stanza, void* const userdata)
+{
+    // the catch-up may have been reset while the page's messages were queued
+    if (g_list_find(mam_sync_windows, userdata)) {
+        _mam_sync_page(stanza, userdata);
+    }
+}
+
+static int
+_mam_sync_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
+{
+    // the page ends once its messages are handled, they may still be queued
+    if (message_backlog_pending()) {
+        message_backlog_defer(stanza, _mam_sync_page_deferred, userdata);
+    } else {
+        _mam_sync_page(stanza, userdata);
+    }
+
+    return 0;
+}
+
+static void
+_mam_sync_page(xmpp_stanza_t* const stanza, MamSyncWindow* window)
+{
+    const char* type = xmpp_stanza_get_type(stanza);
+    if (g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
+        char* error_message = stanza_get_error_message(stanza);
+        log_warning("MAM catch-up error for %s: %s", window->start, error_message);
+        free(error_message);
+
+        // the archive id we continued from may have expired, retry from the start time alone
+        if (window->after && window->pages == 0) {
+            g_free(window->after);
+            window->after = NULL;
+            _mam_sync_send(window);
+        } else {
+            _mam_sync_window_done(window);
+        }
+        return;
+    }
+
+    window->pages++;
+    mam_sync_pages++;
+    log_database_bulk_commit();
+
+    xmpp_stanza_t* fin = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_FIN, STANZA_NS_MAM2);
+    if (!fin || g_strcmp0(xmpp_stanza_get_attribute(fin, "complete"), "true") == 0) {
+        _mam_sync_window_done(window);
+        return;
+    }
+
+    char* lastid = NULL;
+    xmpp_stanza_t* set = xmpp_stanza_get_child_by_name_and_ns(fin, STANZA_TYPE_SET, STANZA_NS_RSM);
+    if (set) {
+        xmpp_stanza_t* last = xmpp_stanza_get_child_by_name(set, STANZA_NAME_LAST);
+        if (last) {
+            lastid = xmpp_stanza_get_text(last);
+        }
+    }
+
+    if (!lastid) {
+        _mam_sync_window_done(window);
+        return;
+    }
+
+    g_free(window->after);
+    window->after = g_strdup(lastid);
+    free(lastid);
+
+    _mam_sync_send(window);
+}
+
+static void
+_mam_sync_window_done(MamSyncWindow* window)
+{
+    mam_sync_windows = g_list_remove(mam_sync_windows, window);
+    _mam_sync_window_free(window);
+
+    int done = mam_sync_total - g_list_length(mam_sync_windows);
+    log_info("MAM catch-up: %d of %d windows done, %d pages", done, mam_sync_total, mam_sync_pages);
+
+    if (mam_sync_windows == NULL) {
+        log_database_bulk_end();
+        cons_show("Message archive caught up (%d pages).", mam_sync_pages);
+        mam_sync_total = 0;
+        mam_sync_pages = 0;
+    }
+}
+
+static void
+_mam_sync_window_free(MamSyncWindow* window)
+{
+    if (window) {
+        g_free(window->queryid);
+        g_free(window->start);
+        g_free(window->end);
+        g_free(window->after);
+        free(window);
+    }
+}
+
+static void
+_mam_sync_reset(void)
+{
+    if (mam_sync_windows) {
+        g_list_free_full(mam_sync_windows, (GDestroyNotify)_mam_sync_window_free);
+        mam_sync_windows = NULL;
+        log_database_bulk_end();
+    }
+    mam_sync_total = 0;
+    mam_sync_pages = 0;
+}
+
 void
 iq_register_change_password(const char* const user, const char* const password)
 {
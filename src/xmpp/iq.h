@@ -36,18 +36,33 @@
 #ifndef XMPP_IQ_H
 #define XMPP_IQ_H
 
+#include "xmpp/iq_future.h"
+
+#define IQ_HANDLER_TIMEOUT_SEC 300
+
 typedef int (*ProfIqCallback)(xmpp_stanza_t* const stanza, void* const userdata);
 typedef void (*ProfIqFreeCallback)(void* userdata);
+typedef void (*ProfIqTimeoutCallback)(void* userdata);
 
 void iq_handlers_init(void);
+void iq_handlers_attach(void);
+// Handle stanza as if it was received, for replaying a recording
+void iq_replay(xmpp_stanza_t* const stanza);
 void iq_send_stanza(xmpp_stanza_t* const stanza);
-void iq_id_handler_add(const char* const id, ProfIqCallback func, ProfIqFreeCallback free_func, void* userdata);
-void iq_disco_info_request_onconnect(gchar* jid);
+// FALSE without a connection, userdata is then still the caller's
+gboolean iq_id_handler_add(const char* const id, ProfIqCallback func, ProfIqFreeCallback free_func, void* userdata);
+// Handlers without a reply are dropped after IQ_HANDLER_TIMEOUT_SEC, this
+// changes the time for one and calls func before it goes
+void iq_id_handler_set_timeout(const char* const id, int timeout_sec, ProfIqTimeoutCallback func);
+// Stops waiting for a reply, its free_func is called
+void iq_id_handler_remove(const char* const id);
+IqFuture* iq_disco_info_request_onconnect(gchar* jid);
 void iq_disco_items_request_onconnect(gchar* jid);
 void iq_send_caps_request(const char* const to, const char* const id, const char* const node, const char* const ver);
 void iq_send_caps_request_for_jid(const char* const to, const char* const id, const char* const node,
                                   const char* const ver);
 void iq_send_caps_request_legacy(const char* const to, const char* const id, const char* const node,
                                  const char* const ver);
+gboolean iq_mam_is_sync_query(const char* const queryid);
 
 #endif
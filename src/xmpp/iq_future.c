@@ -0,0 +1,419 @@
+/*
+ * iq_future.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <strophe.h>
+
+#include "log.h"
+#include "tools/scheduler.h"
+#include "xmpp/iq.h"
+#include "xmpp/iq_future.h"
+#include "xmpp/stanza.h"
+
+// What the id handler points at rather than the future, which may be gone
+// by the time iq.c drops the handler
+typedef struct iq_future_link_t
+{
+    IqFuture* future;
+} IqFutureLink;
+
+struct iq_future_t
+{
+    iq_future_state_t state;
+    char* id;
+    IqFutureLink* link; // while an IQ waits for its reply
+    xmpp_stanza_t* stanza;
+    IqFuture* parent;
+    GList* children;
+    guint pending; // children not yet settled
+    gboolean any;
+    SchedulerTask* deadline;
+    SchedulerTask* reap; // settled with nobody listening
+    gint64 started;
+    gint64 settled;
+    IqFutureCallback func;
+    void* userdata;
+    GDestroyNotify free_func;
+};
+
+static IqFuture* _iq_future_group(GList* futures, gboolean any);
+static iq_future_state_t _iq_future_group_state(IqFuture* group);
+static void _iq_future_settle(IqFuture* future, iq_future_state_t state, xmpp_stanza_t* const stanza);
+static void _iq_future_notify(IqFuture* future);
+static void _iq_future_child_settled(IqFuture* group, IqFuture* child);
+static void _iq_future_detach(IqFuture* future);
+static void _iq_future_free(IqFuture* future);
+static int _iq_future_reply(xmpp_stanza_t* const stanza, void* const userdata);
+static void _iq_future_timeout(void* userdata);
+static void _iq_future_link_free(IqFutureLink* link);
+static gboolean _iq_future_deadline(void* data);
+static gboolean _iq_future_reap(void* data);
+
+IqFuture*
+iq_future_new(void)
+{
+    IqFuture* future = g_new0(IqFuture, 1);
+    future->state = IQ_FUTURE_PENDING;
+    future->started = g_get_monotonic_time();
+
+    return future;
+}
+
+void
+iq_future_send(IqFuture* future, xmpp_stanza_t* const iq)
+{
+    // cancelled or timed out while it waited to be sent
+    if (future->state != IQ_FUTURE_PENDING || future->link) {
+        return;
+    }
+
+    const char* id = xmpp_stanza_get_id(iq);
+    free(future->id);
+    future->id = strdup(id);
+    future->link = malloc(sizeof(IqFutureLink));
+    future->link->future = future;
+
+    // without a connection it times out on the next run of the scheduler,
+    // whoever sent it has their callbacks in place by then
+    if (!iq_id_handler_add(id, _iq_future_reply, (ProfIqFreeCallback)_iq_future_link_free, future->link)) {
+        free(future->link);
+        future->link = NULL;
+        iq_future_set_deadline(future, 0);
+        return;
+    }
+    iq_id_handler_set_timeout(id, IQ_HANDLER_TIMEOUT_SEC, _iq_future_timeout);
+    iq_send_stanza(iq);
+}
+
+IqFuture*
+iq_future_request(xmpp_stanza_t* const iq)
+{
+    IqFuture* future = iq_future_new();
+    iq_future_send(future, iq);
+
+    return future;
+}
+
+IqFuture*
+iq_future_all(GList* futures)
+{
+    return _iq_future_group(futures, FALSE);
+}
+
+IqFuture*
+iq_future_any(GList* futures)
+{
+    return _iq_future_group(futures, TRUE);
+}
+
+void
+iq_future_set_deadline(IqFuture* future, guint ms)
+{
+    if (future->state != IQ_FUTURE_PENDING) {
+        return;
+    }
+
+    scheduler_remove(future->deadline);
+    future->deadline = scheduler_add(ms, _iq_future_deadline, future, NULL);
+}
+
+void
+iq_future_then(IqFuture* future, IqFutureCallback func, void* userdata, GDestroyNotify free_func)
+{
+    future->func = func;
+    future->userdata = userdata;
+    future->free_func = free_func;
+
+    // settled before anyone listened, a group member told its group already
+    if (future->state != IQ_FUTURE_PENDING && !future->parent) {
+        scheduler_remove(future->reap);
+        future->reap = NULL;
+        _iq_future_notify(future);
+    }
+}
+
+void
+iq_future_cancel(IqFuture* future)
+{
+    _iq_future_settle(future, IQ_FUTURE_CANCELLED, NULL);
+}
+
+iq_future_state_t
+iq_future_state(IqFuture* future)
+{
+    return future->state;
+}
+
+xmpp_stanza_t*
+iq_future_stanza(IqFuture* future)
+{
+    return future->stanza;
+}
+
+GList*
+iq_future_children(IqFuture* future)
+{
+    return future->children;
+}
+
+guint
+iq_future_count(IqFuture* future, iq_future_state_t state)
+{
+    guint count = 0;
+    for (GList* curr = future->children; curr; curr = g_list_next(curr)) {
+        if (((IqFuture*)curr->data)->state == state) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+gint64
+iq_future_elapsed_ms(IqFuture* future)
+{
+    gint64 until = future->settled ? future->settled : g_get_monotonic_time();
+
+    return (until - future->started) / 1000;
+}
+
+static IqFuture*
+_iq_future_group(GList* futures, gboolean any)
+{
+    IqFuture* group = iq_future_new();
+    group->any = any;
+    group->children = g_list_copy(futures);
+
+    IqFuture* winner = NULL;
+    for (GList* curr = group->children; curr; curr = g_list_next(curr)) {
+        IqFuture* child = curr->data;
+        child->parent = group;
+        scheduler_remove(child->reap);
+        child->reap = NULL;
+        if (child->state == IQ_FUTURE_PENDING) {
+            group->pending++;
+        } else if (any && !winner && child->state == IQ_FUTURE_RESULT) {
+            winner = child;
+        }
+    }
+
+    // members may have settled before they were grouped
+    if (winner) {
+        _iq_future_settle(group, IQ_FUTURE_RESULT, winner->stanza);
+    } else if (group->pending == 0) {
+        _iq_future_settle(group, _iq_future_group_state(group), NULL);
+    }
+
+    return group;
+}
+
+// Once no member is pending and no iq_future_any() member won
+static iq_future_state_t
+_iq_future_group_state(IqFuture* group)
+{
+    guint total = g_list_length(group->children);
+    if (!group->any && iq_future_count(group, IQ_FUTURE_RESULT) == total) {
+        return IQ_FUTURE_RESULT;
+    }
+    if (iq_future_count(group, IQ_FUTURE_TIMEOUT) > 0) {
+        return IQ_FUTURE_TIMEOUT;
+    }
+
+    return IQ_FUTURE_ERROR;
+}
+
+static void
+_iq_future_settle(IqFuture* future, iq_future_state_t state, xmpp_stanza_t* const stanza)
+{
+    if (future->state != IQ_FUTURE_PENDING) {
+        return;
+    }
+
+    future->state = state;
+    future->settled = g_get_monotonic_time();
+    if (stanza) {
+        future->stanza = xmpp_stanza_clone(stanza);
+    }
+    scheduler_remove(future->deadline);
+    future->deadline = NULL;
+
+    // a late reply finds no handler
+    if (future->link) {
+        _iq_future_detach(future);
+        iq_id_handler_remove(future->id);
+    }
+
+    // what is left of a group goes with it, timing out together
+    iq_future_state_t rest = state == IQ_FUTURE_TIMEOUT ? IQ_FUTURE_TIMEOUT : IQ_FUTURE_CANCELLED;
+    for (GList* curr = future->children; curr; curr = g_list_next(curr)) {
+        _iq_future_settle(curr->data, rest, NULL);
+    }
+
+    _iq_future_notify(future);
+}
+
+static void
+_iq_future_notify(IqFuture* future)
+{
+    if (future->func) {
+        future->func(future, future->userdata);
+    }
+
+    if (future->parent) {
+        _iq_future_child_settled(future->parent, future);
+    } else if (future->func) {
+        _iq_future_free(future);
+    } else {
+        // then() or a group may still claim it in the same turn of the loop
+        future->reap = scheduler_add(0, _iq_future_reap, future, NULL);
+    }
+}
+
+static void
+_iq_future_child_settled(IqFuture* group, IqFuture* child)
+{
+    // settling itself, or an iq_future_any() member already won
+    if (group->state != IQ_FUTURE_PENDING) {
+        return;
+    }
+
+    group->pending--;
+    if (group->any && child->state == IQ_FUTURE_RESULT) {
+        _iq_future_settle(group, IQ_FUTURE_RESULT, child->stanza);
+    } else if (group->pending == 0) {
+        _iq_future_settle(group, _iq_future_group_state(group), NULL);
+    }
+}
+
+static void
+_iq_future_detach(IqFuture* future)
+{
+    if (future->link) {
+        future->link->future = NULL;
+        future->link = NULL;
+    }
+}
+
+static void
+_iq_future_free(IqFuture* future)
+{
+    g_list_free_full(future->children, (GDestroyNotify)_iq_future_free);
+    if (future->link) {
+        _iq_future_detach(future);
+        iq_id_handler_remove(future->id);
+    }
+    scheduler_remove(future->deadline);
+    scheduler_remove(future->reap);
+    if (future->stanza) {
+        xmpp_stanza_release(future->stanza);
+    }
+    if (future->free_func && future->userdata) {
+        future->free_func(future->userdata);
+    }
+    free(future->id);
+    free(future);
+}
+
+static int
+_iq_future_reply(xmpp_stanza_t* const stanza, void* const userdata)
+{
+    IqFutureLink* link = userdata;
+    IqFuture* future = link->future;
+
+    if (future) {
+        _iq_future_detach(future);
+        const char* type = xmpp_stanza_get_type(stanza);
+        _iq_future_settle(future, g_strcmp0(type, STANZA_TYPE_ERROR) == 0 ? IQ_FUTURE_ERROR : IQ_FUTURE_RESULT, stanza);
+    }
+
+    return 0;
+}
+
+static void
+_iq_future_timeout(void* userdata)
+{
+    IqFutureLink* link = userdata;
+    IqFuture* future = link->future;
+
+    if (future) {
+        _iq_future_detach(future);
+        _iq_future_settle(future, IQ_FUTURE_TIMEOUT, NULL);
+    }
+}
+
+// The handler is dropped without a reply when the handlers are cleared
+static void
+_iq_future_link_free(IqFutureLink* link)
+{
+    IqFuture* future = link->future;
+
+    if (future) {
+        _iq_future_detach(future);
+        _iq_future_settle(future, IQ_FUTURE_CANCELLED, NULL);
+    }
+    free(link);
+}
+
+static gboolean
+_iq_future_deadline(void* data)
+{
+    IqFuture* future = data;
+
+    // the task is gone once this returns
+    future->deadline = NULL;
+    log_debug("IQ future timed out after %" G_GINT64_FORMAT " ms", iq_future_elapsed_ms(future));
+    _iq_future_settle(future, IQ_FUTURE_TIMEOUT, NULL);
+
+    return FALSE;
+}
+
+// Nobody claimed a root future that settled, it is not going to be read
+static gboolean
+_iq_future_reap(void* data)
+{
+    IqFuture* future = data;
+
+    // the task is gone once this returns
+    future->reap = NULL;
+    _iq_future_free(future);
+
+    return FALSE;
+}
@@ -0,0 +1,81 @@
+/*
+ * iq_future.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef XMPP_IQ_FUTURE_H
+#define XMPP_IQ_FUTURE_H
+
+#include <glib.h>
+#include <strophe.h>
+
+// The outcome of an IQ, or of a group of them. A future has one owner: the
+// group it was passed to, or else itself, freed once its callback has run.
+// One settled without a callback is freed on the next run of the scheduler.
+typedef enum {
+    IQ_FUTURE_PENDING,
+    IQ_FUTURE_RESULT,
+    IQ_FUTURE_ERROR,
+    IQ_FUTURE_TIMEOUT,
+    IQ_FUTURE_CANCELLED
+} iq_future_state_t;
+
+typedef struct iq_future_t IqFuture;
+
+// Called once the future settles, a future in a group is told before the group
+typedef void (*IqFutureCallback)(IqFuture* future, void* userdata);
+
+IqFuture* iq_future_new(void);
+// Sends the IQ and settles with its reply, unless the future already settled
+void iq_future_send(IqFuture* future, xmpp_stanza_t* const iq);
+IqFuture* iq_future_request(xmpp_stanza_t* const iq);
+
+// Settles once every future has, as a result only if they all are
+IqFuture* iq_future_all(GList* futures);
+// Settles with the first result, cancelling the rest, or once all failed
+IqFuture* iq_future_any(GList* futures);
+
+// Settles as a timeout if still pending after ms, along with what it waits for
+void iq_future_set_deadline(IqFuture* future, guint ms);
+void iq_future_then(IqFuture* future, IqFutureCallback func, void* userdata, GDestroyNotify free_func);
+void iq_future_cancel(IqFuture* future);
+
+iq_future_state_t iq_future_state(IqFuture* future);
+// The reply for an IQ, the winning reply for iq_future_any(), else NULL
+xmpp_stanza_t* iq_future_stanza(IqFuture* future);
+GList* iq_future_children(IqFuture* future);
+guint iq_future_count(IqFuture* future, iq_future_state_t state);
+gint64 iq_future_elapsed_ms(IqFuture* future);
+
+#endif
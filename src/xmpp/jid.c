@@ -43,6 +43,10 @@
 #include "common.h"
 #include "xmpp/jid.h"
 
+// raw jid string to its link in jid_lru, most recently used first, holding one reference each
+static GHashTable* jid_cache = NULL;
+static GQueue* jid_lru = NULL;
+
 Jid*
 jid_create(const gchar* const str)
 {
@@ -76,6 +80,7 @@ jid_create(const gchar* const str)
     result->resourcepart = NULL;
     result->barejid = NULL;
     result->fulljid = NULL;
+    result->refs = 1;
 
     gchar* atp = g_utf8_strchr(trimmed, -1, '@');
     gchar* slashp = g_utf8_strchr(trimmed, -1, '/');
@@ -119,6 +124,74 @@ jid_create_from_bare_and_resource(const char* const barejid, const char* const r
     return result;
 }
 
+Jid*
+jid_ref(Jid* jid)
+{
+    if (jid) {
+        jid->refs++;
+    }
+
+    return jid;
+}
+
+Jid*
+jid_intern(const gchar* const str)
+{
+    if (str == NULL) {
+        return NULL;
+    }
+
+    if (jid_cache) {
+        GList* link = g_hash_table_lookup(jid_cache, str);
+        if (link) {
+            g_queue_unlink(jid_lru, link);
+            g_queue_push_head_link(jid_lru, link);
+            return jid_ref(link->data);
+        }
+    } else {
+        jid_cache = g_hash_table_new(g_str_hash, g_str_equal);
+        jid_lru = g_queue_new();
+    }
+
+    // invalid jids are rare enough not to be remembered
+    Jid* jid = jid_create(str);
+    if (jid == NULL) {
+        return NULL;
+    }
+
+    // the key is the Jid's own copy of the raw string
+    g_queue_push_head(jid_lru, jid);
+    g_hash_table_insert(jid_cache, jid->str, jid_lru->head);
+
+    if (g_queue_get_length(jid_lru) > JID_CACHE_MAX) {
+        Jid* oldest = g_queue_pop_tail(jid_lru);
+        g_hash_table_remove(jid_cache, oldest->str);
+        jid_destroy(oldest);
+    }
+
+    return jid_ref(jid);
+}
+
+guint
+jid_cache_size(void)
+{
+    return jid_lru ? g_queue_get_length(jid_lru) : 0;
+}
+
+// jids still referenced elsewhere stay valid until their last jid_destroy
+void
+jid_cache_clear(void)
+{
+    if (jid_cache == NULL) {
+        return;
+    }
+
+    g_hash_table_destroy(jid_cache);
+    jid_cache = NULL;
+    g_queue_free_full(jid_lru, (GDestroyNotify)jid_destroy);
+    jid_lru = NULL;
+}
+
 void
 jid_destroy(Jid* jid)
 {
@@ -126,6 +199,10 @@ jid_destroy(Jid* jid)
         return;
     }
 
+    if (--jid->refs > 0) {
+        return;
+    }
+
     g_free(jid->str);
     g_free(jid->localpart);
     g_free(jid->domainpart);
@@ -197,6 +274,29 @@ jid_fulljid_or_barejid(Jid* jid)
     }
 }
 
+/*
+ * Lower case jid for hash lookups, written to buf when it is ASCII and fits,
+ * otherwise to a new string returned in alloced for the caller to g_free.
+ * Either way the result may be changed by the caller.
+ */
+char*
+jid_fold(const char* const jid, char* buf, size_t size, char** alloced)
+{
+    *alloced = NULL;
+
+    size_t i = 0;
+    for (; jid[i]; i++) {
+        if (i + 1 >= size || (jid[i] & 0x80)) {
+            *alloced = g_utf8_strdown(jid, -1);
+            return *alloced;
+        }
+        buf[i] = g_ascii_tolower(jid[i]);
+    }
+    buf[i] = '\0';
+
+    return buf;
+}
+
 char*
 jid_random_resource(void)
 {
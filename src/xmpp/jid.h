@@ -46,6 +46,7 @@ struct jid_t
     char* resourcepart;
     char* barejid;
     char* fulljid;
+    int refs;
 };
 
 typedef struct jid_t Jid;
@@ -54,11 +55,21 @@ Jid* jid_create(const gchar* const str);
 Jid* jid_create_from_bare_and_resource(const char* const barejid, const char* const resource);
 void jid_destroy(Jid* jid);
 
+// how many parsed jids the receive path keeps around
+#define JID_CACHE_MAX 256
+
+// a shared, read only Jid for str from the main thread only, released with jid_destroy
+Jid* jid_intern(const gchar* const str);
+Jid* jid_ref(Jid* jid);
+guint jid_cache_size(void);
+void jid_cache_clear(void);
+
 gboolean jid_is_valid_room_form(Jid* jid);
 char* create_fulljid(const char* const barejid, const char* const resource);
 char* get_nick_from_full_jid(const char* const full_room_jid);
 
 char* jid_fulljid_or_barejid(Jid* jid);
+char* jid_fold(const char* const jid, char* buf, size_t size, char** alloced);
 char* jid_random_resource(void);
 
 #endif
@@ -47,6 +47,11 @@
 #include "event/server_events.h"
 #include "pgp/gpg.h"
 #include "plugins/plugins.h"
+#include "tools/arena.h"
+#include "tools/dedupe.h"
+#include "tools/perf.h"
+#include "tools/ratelimit.h"
+#include "tools/scheduler.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
 #include "xmpp/chat_session.h"
@@ -56,7 +61,9 @@
 #include "xmpp/roster.h"
 #include "xmpp/roster_list.h"
 #include "xmpp/stanza.h"
+#include "xmpp/stanza_writer.h"
 #include "xmpp/connection.h"
+#include "xmpp/iq.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/form.h"
 
@@ -73,22 +80,27 @@ typedef struct p_message_handle_t
 } ProfMessageHandler;
 
 static int _message_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
-static void _handle_error(xmpp_stanza_t* const stanza);
-static void _handle_groupchat(xmpp_stanza_t* const stanza);
-static void _handle_muc_user(xmpp_stanza_t* const stanza);
+static void _handle_error(xmpp_stanza_t* const stanza, const MessageElements* const el);
+static void _handle_groupchat(xmpp_stanza_t* const stanza, const MessageElements* const el);
+static void _handle_muc_user(xmpp_stanza_t* const stanza, const MessageElements* const el);
 static void _handle_muc_private_message(xmpp_stanza_t* const stanza);
-static void _handle_conference(xmpp_stanza_t* const stanza);
+static void _handle_conference(xmpp_stanza_t* const stanza, const MessageElements* const el);
 static void _handle_captcha(xmpp_stanza_t* const stanza);
-static void _handle_receipt_received(xmpp_stanza_t* const stanza);
-static void _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, const char* result_id, GDateTime* timestamp);
-static void _handle_ox_chat(xmpp_stanza_t* const stanza, ProfMessage* message, gboolean is_mam);
+static void _handle_receipt_received(xmpp_stanza_t* const stanza, const MessageElements* const el);
+static void _handle_chat_marker(xmpp_stanza_t* const stanza, const MessageElements* const el);
+static gboolean _message_markers_enabled(void);
+static void _handle_chat(xmpp_stanza_t* const stanza, const MessageElements* const el, gboolean is_mam, gboolean is_carbon, const char* result_id, gint64 timestamp);
+static void _handle_ox_chat(xmpp_stanza_t* const stanza, const MessageElements* const el, ProfMessage* message, gboolean is_mam);
 static xmpp_stanza_t* _handle_carbons(xmpp_stanza_t* const stanza);
 static void _send_message_stanza(xmpp_stanza_t* const stanza);
-static gboolean _handle_mam(xmpp_stanza_t* const stanza);
+static GString* _message_stanza_text(void);
+static void _send_message_text(void);
+static void _message_send_chat_state(const char* const jid, const char* const state);
+static gboolean _handle_mam(xmpp_stanza_t* const stanza, const MessageElements* const el);
 static void _handle_pubsub(xmpp_stanza_t* const stanza, xmpp_stanza_t* const event);
-static gboolean _handle_form(xmpp_stanza_t* const stanza);
-static gboolean _handle_jingle_message(xmpp_stanza_t* const stanza);
-static gboolean _should_ignore_based_on_silence(xmpp_stanza_t* const stanza);
+static gboolean _handle_form(xmpp_stanza_t* const stanza, const MessageElements* const el);
+static gboolean _handle_jingle_message(xmpp_stanza_t* const stanza, const MessageElements* const el);
+static gboolean _should_drop(xmpp_stanza_t* const stanza);
 
 #ifdef HAVE_LIBGPGME
 static xmpp_stanza_t* _openpgp_signcrypt(xmpp_ctx_t* ctx, const char* const to, const char* const text);
@@ -96,9 +108,49 @@ static xmpp_stanza_t* _openpgp_signcrypt(xmpp_ctx_t* ctx, const char* const to,
 
 static GHashTable* pubsub_event_handlers;
 
+// per stanza allocations of the receive path, reset once a stanza is handled
+#define MESSAGE_ARENA_BLOCK_SIZE 4096
+static Arena* stanza_arena = NULL;
+
+// the text of the chat messages, chat states and receipts being sent
+static GString* stanza_text = NULL;
+
+// private messages allowed per occupant and per room at once, and per minute after that
+#define MUCPM_SENDER_BURST      10
+#define MUCPM_SENDER_PER_MINUTE 30
+#define MUCPM_ROOM_BURST        30
+#define MUCPM_ROOM_PER_MINUTE   120
+static RateLimit* mucpm_sender_limit = NULL;
+static RateLimit* mucpm_room_limit = NULL;
+
+// An archive catch-up brings thousands of messages, each decrypted and
+// stored on this thread. They queue in arrival order and are handled a
+// slice at a time, input is read between slices. Once anything is queued
+// later messages, and whatever is deferred behind them, queue too.
+#define MESSAGE_BACKLOG_SLICE_US 8000
+
+typedef struct message_backlog_item_t
+{
+    xmpp_stanza_t* stanza;
+    // NULL to handle the stanza as a received message
+    ProfMessageBacklogCallback func;
+    void* userdata;
+} MessageBacklogItem;
+
+static GQueue* message_backlog = NULL;
+static SchedulerTask* message_backlog_task = NULL;
+
+static ProfMessage* _message_init_stanza(void);
+static char* _message_arena_strdup(const char* const str);
+static void _message_free_contents(ProfMessage* message, xmpp_ctx_t* ctx);
+
 static gboolean
 _handled_by_plugin(xmpp_stanza_t* const stanza)
 {
+    if (!plugins_hook_in_use(PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE)) {
+        return FALSE;
+    }
+
     char* text;
     size_t text_size;
 
@@ -110,11 +162,10 @@ _handled_by_plugin(xmpp_stanza_t* const stanza)
 }
 
 static void
-_handle_headline(xmpp_stanza_t* const stanza)
+_handle_headline(const MessageElements* const el)
 {
-    xmpp_stanza_t* body = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_BODY);
-    if (body) {
-        char* text = xmpp_stanza_get_text(body);
+    if (el->body) {
+        char* text = xmpp_stanza_get_text(el->body);
         if (text) {
             cons_show("Headline: %s", text);
             xmpp_free(connection_get_ctx(), text);
@@ -123,12 +174,13 @@ _handle_headline(xmpp_stanza_t* const stanza)
 }
 
 static void
-_handle_chat_states(xmpp_stanza_t* const stanza, Jid* const jid)
+_handle_chat_states(const MessageElements* const el, Jid* const jid)
 {
-    gboolean gone = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_GONE) != NULL;
-    gboolean typing = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_COMPOSING) != NULL;
-    gboolean paused = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_PAUSED) != NULL;
-    gboolean inactive = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_INACTIVE) != NULL;
+    const char* state = el->chat_state ? xmpp_stanza_get_name(el->chat_state) : NULL;
+    gboolean gone = g_strcmp0(state, STANZA_NAME_GONE) == 0;
+    gboolean typing = g_strcmp0(state, STANZA_NAME_COMPOSING) == 0;
+    gboolean paused = g_strcmp0(state, STANZA_NAME_PAUSED) == 0;
+    gboolean inactive = g_strcmp0(state, STANZA_NAME_INACTIVE) == 0;
     if (gone) {
         sv_ev_gone(jid->barejid, jid->resourcepart);
     } else if (typing) {
@@ -137,94 +189,194 @@ _handle_chat_states(xmpp_stanza_t* const stanza, Jid* const jid)
         sv_ev_paused(jid->barejid, jid->resourcepart);
     } else if (inactive) {
         sv_ev_inactive(jid->barejid, jid->resourcepart);
-    } else if (stanza_contains_chat_state(stanza)) {
+    } else if (state) {
         sv_ev_activity(jid->barejid, jid->resourcepart, TRUE);
     } else {
         sv_ev_activity(jid->barejid, jid->resourcepart, FALSE);
     }
 }
 
-static int
-_message_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
+static xmpp_stanza_t*
+_forwarded_message(xmpp_stanza_t* const parent)
 {
-    log_debug("Message stanza handler fired");
+    xmpp_stanza_t* forwarded = xmpp_stanza_get_child_by_ns(parent, STANZA_NS_FORWARD);
+    if (!forwarded) {
+        return NULL;
+    }
+
+    return xmpp_stanza_get_child_by_name(forwarded, STANZA_NAME_MESSAGE);
+}
+
+// A message seen before by its XEP-0359 ids, as it arrives again by carbon,
+// archive catch-up or room history. The ids of new messages are remembered.
+static gboolean
+_is_duplicate(xmpp_stanza_t* const stanza, const MessageElements* const el)
+{
+    if (g_strcmp0(xmpp_stanza_get_type(stanza), STANZA_TYPE_ERROR) == 0) {
+        return FALSE;
+    }
+
+    xmpp_stanza_t* message = stanza;
+    const char* archive_id = NULL;
+
+    if (el->mam_result) {
+        // history a window asked for is shown even if seen before
+        if (!iq_mam_is_sync_query(xmpp_stanza_get_attribute(el->mam_result, STANZA_ATTR_QUERYID))) {
+            return FALSE;
+        }
+        archive_id = xmpp_stanza_get_id(el->mam_result);
+        message = _forwarded_message(el->mam_result);
+    } else if (el->carbon) {
+        message = _forwarded_message(el->carbon);
+    }
+
+    if (!message) {
+        return FALSE;
+    }
+
+    // several services may each have stamped their own stanza-id
+    GSList* stanza_ids = NULL;
+    xmpp_stanza_t* origin = NULL;
+    if (archive_id) {
+        stanza_ids = g_slist_prepend(stanza_ids, (gpointer)archive_id);
+    }
+    xmpp_stanza_t* child = xmpp_stanza_get_children(message);
+    while (child) {
+        if (g_strcmp0(xmpp_stanza_get_ns(child), STANZA_NS_STABLE_ID) == 0) {
+            const char* name = xmpp_stanza_get_name(child);
+            if (g_strcmp0(name, STANZA_NAME_STANZA_ID) == 0) {
+                const char* id = xmpp_stanza_get_attribute(child, STANZA_ATTR_ID);
+                if (id) {
+                    stanza_ids = g_slist_prepend(stanza_ids, (gpointer)id);
+                }
+            } else if (!origin && g_strcmp0(name, STANZA_NAME_ORIGIN_ID) == 0) {
+                origin = child;
+            }
+        }
+        child = xmpp_stanza_get_next(child);
+    }
+
+    // origin ids are chosen by the sender, so only unique per sender
+    const char* origin_id = NULL;
+    char* origin_scope = NULL;
+    const char* from = xmpp_stanza_get_from(message);
+    if (origin && from) {
+        origin_id = xmpp_stanza_get_attribute(origin, STANZA_ATTR_ID);
+        Jid* from_jid = jid_intern(from);
+        if (from_jid) {
+            origin_scope = strdup(from_jid->barejid);
+            jid_destroy(from_jid);
+        }
+    }
+
+    gboolean duplicate = origin_scope && dedupe_seen(origin_scope, origin_id);
+    for (GSList* curr = stanza_ids; curr && !duplicate; curr = g_slist_next(curr)) {
+        duplicate = dedupe_seen(NULL, curr->data);
+    }
+
+    if (!duplicate) {
+        for (GSList* curr = stanza_ids; curr; curr = g_slist_next(curr)) {
+            dedupe_add(NULL, curr->data);
+        }
+        if (origin_scope) {
+            dedupe_add(origin_scope, origin_id);
+        }
+    }
+
+    g_slist_free(stanza_ids);
+    free(origin_scope);
+
+    return duplicate;
+}
+
+static void
+_message_dispatch(xmpp_stanza_t* const stanza)
+{
+    if (_should_drop(stanza)) {
+        return;
+    }
+
+    MessageElements el;
+    stanza_parse_message(stanza, &el);
+
+    gint64 started = perf_start();
+    gboolean duplicate = _is_duplicate(stanza, &el);
+    perf_stop(PERF_MSG_DEDUPE, started);
+    if (duplicate) {
+        log_debug("Dropping message seen before");
+        return;
+    }
 
     if (_handled_by_plugin(stanza)) {
-        return 1;
+        return;
     }
 
     // type according to RFC 6121
     const char* type = xmpp_stanza_get_type(stanza);
 
     if (type && g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
-        _handle_error(stanza);
+        _handle_error(stanza, &el);
     } else if (type && g_strcmp0(type, STANZA_TYPE_GROUPCHAT) == 0) {
         // XEP-0045: Multi-User Chat
-        _handle_groupchat(stanza);
+        _handle_groupchat(stanza, &el);
 
     } else if (type && g_strcmp0(type, STANZA_TYPE_HEADLINE) == 0) {
-        xmpp_stanza_t* event = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_PUBSUB_EVENT);
         // TODO: do we want to handle all pubsub here or should additionaly check for STANZA_NS_MOOD?
-        if (event) {
-            _handle_pubsub(stanza, event);
-            return 1;
+        if (el.pubsub_event) {
+            _handle_pubsub(stanza, el.pubsub_event);
+            return;
         } else {
-            _handle_headline(stanza);
+            _handle_headline(&el);
         }
     } else if (type == NULL || g_strcmp0(type, STANZA_TYPE_CHAT) == 0 || g_strcmp0(type, STANZA_TYPE_NORMAL) == 0) {
         // type: chat, normal (==NULL)
 
-        // ignore all messages from JIDs that are not in roster, if 'silence' is set
-        if (_should_ignore_based_on_silence(stanza)) {
-            return 1;
-        }
-
         // XEP-0353: Jingle Message Initiation
-        if (_handle_jingle_message(stanza)) {
-            return 1;
+        if (_handle_jingle_message(stanza, &el)) {
+            return;
         }
 
         // XEP-0045: Multi-User Chat 8.6 Voice Requests
-        if (_handle_form(stanza)) {
-            return 1;
+        if (_handle_form(stanza, &el)) {
+            return;
         }
 
         // XEP-0313: Message Archive Management
-        if (_handle_mam(stanza)) {
-            return 1;
+        if (_handle_mam(stanza, &el)) {
+            return;
         }
 
         // XEP-0045: Multi-User Chat - invites - presence
-        xmpp_stanza_t* mucuser = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_MUC_USER);
-        if (mucuser) {
-            _handle_muc_user(stanza);
+        if (el.muc_user) {
+            _handle_muc_user(stanza, &el);
         }
 
         // XEP-0249: Direct MUC Invitations
-        xmpp_stanza_t* conference = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_CONFERENCE);
-        if (conference) {
-            _handle_conference(stanza);
-            return 1;
+        if (el.conference) {
+            _handle_conference(stanza, &el);
+            return;
         }
 
         // XEP-0158: CAPTCHA Forms
-        xmpp_stanza_t* captcha = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_CAPTCHA);
-        if (captcha) {
+        if (el.captcha) {
             _handle_captcha(stanza);
-            return 1;
+            return;
         }
 
         // XEP-0184: Message Delivery Receipts
-        xmpp_stanza_t* receipts = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_RECEIPTS);
-        if (receipts) {
-            _handle_receipt_received(stanza);
+        if (el.receipt) {
+            _handle_receipt_received(stanza, &el);
+        }
+
+        // XEP-0333: Chat Markers
+        if (el.marker) {
+            _handle_chat_marker(stanza, &el);
         }
 
         // XEP-0060: Publish-Subscribe
-        xmpp_stanza_t* event = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_PUBSUB_EVENT);
-        if (event) {
-            _handle_pubsub(stanza, event);
-            return 1;
+        if (el.pubsub_event) {
+            _handle_pubsub(stanza, el.pubsub_event);
+            return;
         }
 
         xmpp_stanza_t* msg_stanza = stanza;
@@ -233,10 +385,7 @@ _message_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* con
         // XEP-0280: Message Carbons
         // Only allow `<sent xmlns='urn:xmpp:carbons:2'>` and `<received xmlns='urn:xmpp:carbons:2'>` carbons
         // Thus ignoring `<private xmlns="urn:xmpp:carbons:2"/>`
-        xmpp_stanza_t* carbons = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_SENT, STANZA_NS_CARBONS);
-        if (!carbons) {
-            carbons = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_RECEIVED, STANZA_NS_CARBONS);
-        }
+        xmpp_stanza_t* carbons = el.carbon;
 
         if (carbons) {
 
@@ -258,8 +407,12 @@ _message_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* con
             free(mybarejid);
         }
 
-        if (msg_stanza) {
-            _handle_chat(msg_stanza, FALSE, is_carbon, NULL, NULL);
+        if (msg_stanza == stanza) {
+            _handle_chat(msg_stanza, &el, FALSE, is_carbon, NULL, 0);
+        } else if (msg_stanza) {
+            MessageElements carbon_el;
+            stanza_parse_message(msg_stanza, &carbon_el);
+            _handle_chat(msg_stanza, &carbon_el, FALSE, is_carbon, NULL, 0);
         }
     } else {
         // none of the allowed types
@@ -272,6 +425,109 @@ _message_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* con
         xmpp_free(connection_get_ctx(), text);
     }
 
+}
+
+static void
+_message_handle(xmpp_stanza_t* const stanza)
+{
+    if (stanza_arena == NULL) {
+        stanza_arena = arena_new(MESSAGE_ARENA_BLOCK_SIZE);
+    }
+
+    gint64 started = perf_start();
+    _message_dispatch(stanza);
+    perf_stop_named(PERF_MESSAGE, started, NULL, xmpp_stanza_get_from(stanza));
+
+    // whatever the display, logs or database need is copied by them,
+    // a disconnect while handling has freed the arena already
+    if (stanza_arena) {
+        arena_reset(stanza_arena);
+    }
+}
+
+static void
+_message_backlog_item_free(MessageBacklogItem* item)
+{
+    xmpp_stanza_release(item->stanza);
+    free(item);
+}
+
+static gboolean
+_message_backlog_run(void* data)
+{
+    gint64 deadline = g_get_monotonic_time() + MESSAGE_BACKLOG_SLICE_US;
+
+    // handling an item may disconnect, which empties the backlog
+    while (message_backlog && !g_queue_is_empty(message_backlog)) {
+        MessageBacklogItem* item = g_queue_pop_head(message_backlog);
+        if (item->func) {
+            item->func(item->stanza, item->userdata);
+        } else {
+            _message_handle(item->stanza);
+        }
+        _message_backlog_item_free(item);
+
+        if (g_get_monotonic_time() >= deadline) {
+            break;
+        }
+    }
+
+    if (message_backlog && !g_queue_is_empty(message_backlog)) {
+        return TRUE;
+    }
+    message_backlog_task = NULL;
+
+    return FALSE;
+}
+
+gboolean
+message_backlog_pending(void)
+{
+    return message_backlog && !g_queue_is_empty(message_backlog);
+}
+
+// Queues the stanza behind the received messages not handled yet, func
+// is called with it in turn
+void
+message_backlog_defer(xmpp_stanza_t* const stanza, ProfMessageBacklogCallback func, void* userdata)
+{
+    if (!message_backlog) {
+        message_backlog = g_queue_new();
+    }
+
+    MessageBacklogItem* item = malloc(sizeof(MessageBacklogItem));
+    item->stanza = xmpp_stanza_clone(stanza);
+    item->func = func;
+    item->userdata = userdata;
+    g_queue_push_tail(message_backlog, item);
+
+    if (!message_backlog_task) {
+        message_backlog_task = scheduler_add(0, _message_backlog_run, NULL, NULL);
+    }
+}
+
+static void
+_message_backlog_clear(void)
+{
+    if (message_backlog) {
+        g_queue_free_full(message_backlog, (GDestroyNotify)_message_backlog_item_free);
+        message_backlog = NULL;
+    }
+    scheduler_remove(message_backlog_task);
+    message_backlog_task = NULL;
+}
+
+static int
+_message_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
+{
+    log_debug("Message stanza handler fired");
+
+    if (message_backlog_pending() || xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_RESULT, STANZA_NS_MAM2)) {
+        message_backlog_defer(stanza, NULL, NULL);
+    } else {
+        _message_handle(stanza);
+    }
+
     return 1;
 }
 
@@ -286,9 +542,9 @@ message_muc_submit_voice_approve(ProfConfWin* confwin)
 }
 
 static gboolean
-_handle_form(xmpp_stanza_t* const stanza)
+_handle_form(xmpp_stanza_t* const stanza, const MessageElements* const el)
 {
-    xmpp_stanza_t* result = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_X, STANZA_NS_DATA);
+    xmpp_stanza_t* result = el->form;
     if (!result) {
         return FALSE;
     }
@@ -306,11 +562,23 @@ _handle_form(xmpp_stanza_t* const stanza)
 }
 
 void
-message_handlers_init(void)
+message_handlers_attach(void)
 {
     xmpp_conn_t* const conn = connection_get_conn();
     xmpp_ctx_t* const ctx = connection_get_ctx();
     xmpp_handler_add(conn, _message_handler, NULL, STANZA_NAME_MESSAGE, NULL, ctx);
+}
+
+void
+message_replay(xmpp_stanza_t* const stanza)
+{
+    _message_handler(connection_get_conn(), stanza, connection_get_ctx());
+}
+
+void
+message_handlers_init(void)
+{
+    message_handlers_attach();
 
     if (pubsub_event_handlers) {
         GList* keys = g_hash_table_get_keys(pubsub_event_handlers);
@@ -329,11 +597,9 @@ message_handlers_init(void)
     pubsub_event_handlers = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
 }
 
-ProfMessage*
-message_init(void)
+static void
+_message_clear(ProfMessage* message)
 {
-    ProfMessage* message = malloc(sizeof(ProfMessage));
-
     message->from_jid = NULL;
     message->to_jid = NULL;
     message->id = NULL;
@@ -344,13 +610,72 @@ message_init(void)
     message->encrypted = NULL;
     message->plain = NULL;
     message->enc = PROF_MSG_ENC_NONE;
-    message->timestamp = NULL;
+    message->timestamp = 0;
     message->trusted = true;
+    message->markable = FALSE;
     message->type = PROF_MSG_TYPE_UNINITIALIZED;
+    message->in_arena = FALSE;
+}
+
+ProfMessage*
+message_init(void)
+{
+    ProfMessage* message = malloc(sizeof(ProfMessage));
+    _message_clear(message);
+
+    return message;
+}
+
+static char*
+_message_xmpp_strdup(xmpp_ctx_t* ctx, const char* const str)
+{
+    return str ? xmpp_strdup(ctx, str) : NULL;
+}
+
+// A copy owning all of its fields, for a message handled after its stanza.
+ProfMessage*
+message_copy(const ProfMessage* const message)
+{
+    xmpp_ctx_t* ctx = connection_get_ctx();
+    ProfMessage* copy = message_init();
+
+    copy->from_jid = message->from_jid ? jid_create(message->from_jid->fulljid) : NULL;
+    copy->to_jid = message->to_jid ? jid_create(message->to_jid->fulljid) : NULL;
+    copy->id = _message_xmpp_strdup(ctx, message->id);
+    copy->originid = _message_xmpp_strdup(ctx, message->originid);
+    copy->replace_id = _message_xmpp_strdup(ctx, message->replace_id);
+    copy->stanzaid = _message_xmpp_strdup(ctx, message->stanzaid);
+    copy->body = _message_xmpp_strdup(ctx, message->body);
+    copy->encrypted = _message_xmpp_strdup(ctx, message->encrypted);
+    copy->plain = message->plain ? strdup(message->plain) : NULL;
+    copy->timestamp = message->timestamp;
+    copy->enc = message->enc;
+    copy->trusted = message->trusted;
+    copy->is_mam = message->is_mam;
+    copy->markable = message->markable;
+    copy->type = message->type;
+
+    return copy;
+}
+
+// A message for the stanza being handled. Its ids come from the stanza arena
+// and must not be replaced, the other fields are owned as usual.
+static ProfMessage*
+_message_init_stanza(void)
+{
+    ProfMessage* message = arena_alloc(stanza_arena, sizeof(ProfMessage));
+    _message_clear(message);
+    message->in_arena = TRUE;
 
     return message;
 }
 
+static char*
+_message_arena_strdup(const char* const str)
+{
+    return arena_strdup(stanza_arena, str);
+}
+
 void
 message_free(ProfMessage* message)
 {
@@ -363,6 +688,11 @@ message_free(ProfMessage* message)
         jid_destroy(message->to_jid);
     }
 
+    if (message->in_arena) {
+        _message_free_contents(message, ctx);
+        return;
+    }
+
     if (message->id) {
         xmpp_free(ctx, message->id);
     }
@@ -379,6 +709,14 @@ message_free(ProfMessage* message)
         xmpp_free(ctx, message->replace_id);
     }
 
+    _message_free_contents(message, ctx);
+    free(message);
+}
+
+// the fields not kept in the stanza arena
+static void
+_message_free_contents(ProfMessage* message, xmpp_ctx_t* ctx)
+{
     if (message->body) {
         xmpp_free(ctx, message->body);
     }
@@ -390,12 +728,6 @@ message_free(ProfMessage* message)
     if (message->plain) {
         free(message->plain);
     }
-
-    if (message->timestamp) {
-        g_date_time_unref(message->timestamp);
-    }
-
-    free(message);
 }
 
 void
@@ -404,6 +736,16 @@ message_handlers_clear(void)
     if (pubsub_event_handlers) {
         g_hash_table_remove_all(pubsub_event_handlers);
     }
+
+    _message_backlog_clear();
+
+    arena_free(stanza_arena);
+    stanza_arena = NULL;
+
+    if (stanza_text) {
+        g_string_free(stanza_text, TRUE);
+        stanza_text = NULL;
+    }
 }
 
 void
@@ -420,34 +762,14 @@ message_pubsub_event_handler_add(const char* const node, ProfMessageCallback fun
 char*
 message_send_chat(const char* const barejid, const char* const msg, const char* const oob_url, gboolean request_receipt, const char* const replace_id)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-
     char* state = chat_session_get_state(barejid);
     char* jid = chat_session_get_jid(barejid);
     char* id = connection_create_stanza_id();
 
-    xmpp_stanza_t* message = xmpp_message_new(ctx, STANZA_TYPE_CHAT, jid, id);
-    xmpp_message_set_body(message, msg);
+    stanza_writer_chat(_message_stanza_text(), id, jid, msg, state, oob_url, request_receipt, _message_markers_enabled(), replace_id);
     free(jid);
 
-    if (state) {
-        stanza_attach_state(ctx, message, state);
-    }
-
-    if (oob_url) {
-        stanza_attach_x_oob_url(ctx, message, oob_url);
-    }
-
-    if (request_receipt) {
-        stanza_attach_receipt_request(ctx, message);
-    }
-
-    if (replace_id) {
-        stanza_attach_correction(ctx, message, replace_id);
-    }
-
-    _send_message_stanza(message);
-    xmpp_stanza_release(message);
+    _send_message_text();
 
     return id;
 }
@@ -506,6 +828,10 @@ message_send_chat_pgp(const char* const barejid, const char* const msg, gboolean
         stanza_attach_receipt_request(ctx, message);
     }
 
+    if (_message_markers_enabled()) {
+        stanza_attach_markable(ctx, message);
+    }
+
     if (replace_id) {
         stanza_attach_correction(ctx, message, replace_id);
     }
@@ -569,6 +895,10 @@ message_send_chat_ox(const char* const barejid, const char* const msg, gboolean
         stanza_attach_receipt_request(ctx, message);
     }
 
+    if (_message_markers_enabled()) {
+        stanza_attach_markable(ctx, message);
+    }
+
     if (replace_id) {
         stanza_attach_correction(ctx, message, replace_id);
     }
@@ -607,6 +937,10 @@ message_send_chat_otr(const char* const barejid, const char* const msg, gboolean
         stanza_attach_receipt_request(ctx, message);
     }
 
+    if (_message_markers_enabled()) {
+        stanza_attach_markable(ctx, message);
+    }
+
     if (replace_id) {
         stanza_attach_correction(ctx, message, replace_id);
     }
@@ -724,6 +1058,10 @@ message_send_chat_omemo(const char* const jid, uint32_t sid, GList* keys,
         stanza_attach_receipt_request(ctx, message);
     }
 
+    if (!muc && _message_markers_enabled()) {
+        stanza_attach_markable(ctx, message);
+    }
+
     if (replace_id) {
         stanza_attach_correction(ctx, message, replace_id);
     }
@@ -812,47 +1150,74 @@ message_send_invite(const char* const roomjid, const char* const contact,
 void
 message_send_composing(const char* const jid)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
+    // chat states are the first thing the low bandwidth profile drops
+    if (prefs_get_boolean(PREF_LOW_BANDWIDTH)) {
+        return;
+    }
 
-    xmpp_stanza_t* stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_COMPOSING);
-    _send_message_stanza(stanza);
-    xmpp_stanza_release(stanza);
+    _message_send_chat_state(jid, STANZA_NAME_COMPOSING);
 }
 
 void
 message_send_paused(const char* const jid)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_stanza_t* stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_PAUSED);
-    _send_message_stanza(stanza);
-    xmpp_stanza_release(stanza);
+    if (prefs_get_boolean(PREF_LOW_BANDWIDTH)) {
+        return;
+    }
+
+    _message_send_chat_state(jid, STANZA_NAME_PAUSED);
 }
 
 void
 message_send_inactive(const char* const jid)
+{
+    if (prefs_get_boolean(PREF_LOW_BANDWIDTH)) {
+        return;
+    }
+
+    _message_send_chat_state(jid, STANZA_NAME_INACTIVE);
+}
+
+// XEP-0333: Chat Markers, the messages up to id have been shown
+void
+message_send_displayed(const char* const fulljid, const char* const id)
 {
     xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_stanza_t* stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_INACTIVE);
 
-    _send_message_stanza(stanza);
-    xmpp_stanza_release(stanza);
+    char* stanza_id = connection_create_stanza_id();
+    xmpp_stanza_t* message = xmpp_message_new(ctx, STANZA_TYPE_CHAT, fulljid, stanza_id);
+    free(stanza_id);
+
+    xmpp_stanza_t* displayed = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(displayed, STANZA_NAME_DISPLAYED);
+    xmpp_stanza_set_ns(displayed, STANZA_NS_CHAT_MARKERS);
+    xmpp_stanza_set_id(displayed, id);
+    xmpp_stanza_add_child(message, displayed);
+    xmpp_stanza_release(displayed);
+
+    // archived, so our other clients see what has been read
+    stanza_attach_hints_store(ctx, message);
+
+    _send_message_stanza(message);
+    xmpp_stanza_release(message);
 }
 
 void
 message_send_gone(const char* const jid)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_stanza_t* stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_GONE);
-    _send_message_stanza(stanza);
-    xmpp_stanza_release(stanza);
+    if (prefs_get_boolean(PREF_LOW_BANDWIDTH)) {
+        return;
+    }
+
+    _message_send_chat_state(jid, STANZA_NAME_GONE);
 }
 
 static void
-_handle_error(xmpp_stanza_t* const stanza)
+_handle_error(xmpp_stanza_t* const stanza, const MessageElements* const el)
 {
     const char* id = xmpp_stanza_get_id(stanza);
     const char* jid = xmpp_stanza_get_from(stanza);
-    xmpp_stanza_t* error_stanza = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_ERROR);
+    xmpp_stanza_t* error_stanza = el->error;
     const char* type = NULL;
     if (error_stanza) {
         type = xmpp_stanza_get_type(error_stanza);
@@ -898,10 +1263,10 @@ _handle_error(xmpp_stanza_t* const stanza)
 }
 
 static void
-_handle_muc_user(xmpp_stanza_t* const stanza)
+_handle_muc_user(xmpp_stanza_t* const stanza, const MessageElements* const el)
 {
     xmpp_ctx_t* ctx = connection_get_ctx();
-    xmpp_stanza_t* xns_muc_user = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_MUC_USER);
+    xmpp_stanza_t* xns_muc_user = el->muc_user;
     const char* room = xmpp_stanza_get_from(stanza);
 
     if (!xns_muc_user) {
@@ -954,9 +1319,9 @@ _handle_muc_user(xmpp_stanza_t* const stanza)
 }
 
 static void
-_handle_conference(xmpp_stanza_t* const stanza)
+_handle_conference(xmpp_stanza_t* const stanza, const MessageElements* const el)
 {
-    xmpp_stanza_t* xns_conference = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_CONFERENCE);
+    xmpp_stanza_t* xns_conference = el->conference;
 
     if (xns_conference) {
         // XEP-0249
@@ -1007,7 +1372,7 @@ _handle_captcha(xmpp_stanza_t* const stanza)
 }
 
 static void
-_handle_groupchat(xmpp_stanza_t* const stanza)
+_handle_groupchat(xmpp_stanza_t* const stanza, const MessageElements* const el)
 {
     xmpp_ctx_t* ctx = connection_get_ctx();
 
@@ -1015,13 +1380,13 @@ _handle_groupchat(xmpp_stanza_t* const stanza)
     if (!room_jid) {
         return;
     }
-    Jid* from_jid = jid_create(room_jid);
+    Jid* from_jid = jid_intern(room_jid);
     if (!from_jid) {
         return;
     }
 
     // handle room subject
-    xmpp_stanza_t* subject = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_SUBJECT);
+    xmpp_stanza_t* subject = el->subject;
     if (subject) {
         // subject_text is optional, can be NULL
         char* subject_text = xmpp_stanza_get_text(subject);
@@ -1061,37 +1426,37 @@ _handle_groupchat(xmpp_stanza_t* const stanza)
         return;
     }
 
-    ProfMessage* message = message_init();
+    ProfMessage* message = _message_init_stanza();
     message->from_jid = from_jid;
     message->type = PROF_MSG_TYPE_MUC;
 
     const char* id = xmpp_stanza_get_id(stanza);
     if (id) {
-        message->id = strdup(id);
+        message->id = _message_arena_strdup(id);
     }
 
     char* stanzaid = NULL;
-    xmpp_stanza_t* stanzaidst = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_STANZA_ID, STANZA_NS_STABLE_ID);
+    xmpp_stanza_t* stanzaidst = el->stanza_id;
     if (stanzaidst) {
         stanzaid = (char*)xmpp_stanza_get_attribute(stanzaidst, STANZA_ATTR_ID);
         if (stanzaid) {
-            message->stanzaid = strdup(stanzaid);
+            message->stanzaid = _message_arena_strdup(stanzaid);
         }
     }
 
-    xmpp_stanza_t* origin = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_ORIGIN_ID, STANZA_NS_STABLE_ID);
+    xmpp_stanza_t* origin = el->origin_id;
     if (origin) {
         char* originid = (char*)xmpp_stanza_get_attribute(origin, STANZA_ATTR_ID);
         if (originid) {
-            message->originid = strdup(originid);
+            message->originid = _message_arena_strdup(originid);
         }
     }
 
-    xmpp_stanza_t* replace_id_stanza = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_LAST_MESSAGE_CORRECTION);
+    xmpp_stanza_t* replace_id_stanza = el->replace;
     if (replace_id_stanza) {
         const char* replace_id = xmpp_stanza_get_id(replace_id_stanza);
         if (replace_id) {
-            message->replace_id = strdup(replace_id);
+            message->replace_id = _message_arena_strdup(replace_id);
         }
     }
 
@@ -1113,18 +1478,13 @@ _handle_groupchat(xmpp_stanza_t* const stanza)
     }
 
     // determine if the notifications happened whilst offline (MUC history)
-    message->timestamp = stanza_get_delay_from(stanza, from_jid->barejid);
-    if (message->timestamp == NULL) {
+    gint64 delay = stanza_get_delay_from(stanza, from_jid->barejid);
+    if (delay == 0) {
         // checking the domainpart is a workaround for some prosody versions (gh#1190)
-        message->timestamp = stanza_get_delay_from(stanza, from_jid->domainpart);
+        delay = stanza_get_delay_from(stanza, from_jid->domainpart);
     }
 
-    bool is_muc_history = FALSE;
-    if (message->timestamp != NULL) {
-        is_muc_history = TRUE;
-        g_date_time_unref(message->timestamp);
-        message->timestamp = NULL;
-    }
+    bool is_muc_history = delay != 0;
 
     // we want to display the oldest delay
     message->timestamp = stanza_get_oldest_delay(stanza);
@@ -1133,7 +1493,7 @@ _handle_groupchat(xmpp_stanza_t* const stanza)
     // it's just setting the time to the received time so upon displaying we can use this time
     // for example in win_println_incoming_muc_msg()
     if (!message->timestamp) {
-        message->timestamp = g_date_time_new_now_local();
+        message->timestamp = g_get_real_time();
     }
 
     if (is_muc_history) {
@@ -1149,28 +1509,27 @@ out:
 static void
 _message_send_receipt(const char* const fulljid, const char* const message_id)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-
     char* id = connection_create_stanza_id();
-    xmpp_stanza_t* message = xmpp_message_new(ctx, NULL, fulljid, id);
+    stanza_writer_receipt(_message_stanza_text(), id, fulljid, message_id);
     free(id);
 
-    xmpp_stanza_t* receipt = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(receipt, "received");
-    xmpp_stanza_set_ns(receipt, STANZA_NS_RECEIPTS);
-    xmpp_stanza_set_id(receipt, message_id);
+    _send_message_text();
+}
 
-    xmpp_stanza_add_child(message, receipt);
-    xmpp_stanza_release(receipt);
+static void
+_message_send_chat_state(const char* const jid, const char* const state)
+{
+    char* id = connection_create_stanza_id();
+    stanza_writer_chat_state(_message_stanza_text(), id, jid, state);
+    free(id);
 
-    _send_message_stanza(message);
-    xmpp_stanza_release(message);
+    _send_message_text();
 }
 
 static void
-_handle_receipt_received(xmpp_stanza_t* const stanza)
+_handle_receipt_received(xmpp_stanza_t* const stanza, const MessageElements* const el)
 {
-    xmpp_stanza_t* receipt = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_RECEIPTS);
+    xmpp_stanza_t* receipt = el->receipt;
     if (receipt) {
         const char* name = xmpp_stanza_get_name(receipt);
         if ((name == NULL) || (g_strcmp0(name, "received") != 0)) {
@@ -1187,7 +1546,7 @@ _handle_receipt_received(xmpp_stanza_t* const stanza)
             return;
         }
 
-        Jid* jidp = jid_create(fulljid);
+        Jid* jidp = jid_intern(fulljid);
         if (!jidp) {
             return;
         }
@@ -1197,10 +1556,44 @@ _handle_receipt_received(xmpp_stanza_t* const stanza)
     }
 }
 
+// A received or displayed marker acknowledges every message up to its id
 static void
-_receipt_request_handler(xmpp_stanza_t* const stanza)
+_handle_chat_marker(xmpp_stanza_t* const stanza, const MessageElements* const el)
 {
-    if (!prefs_get_boolean(PREF_RECEIPTS_SEND)) {
+    const char* name = xmpp_stanza_get_name(el->marker);
+    if (g_strcmp0(name, STANZA_NAME_RECEIVED) != 0 && g_strcmp0(name, STANZA_NAME_DISPLAYED) != 0) {
+        return;
+    }
+
+    const char* id = xmpp_stanza_get_id(el->marker);
+    if (!id) {
+        return;
+    }
+
+    const char* fulljid = xmpp_stanza_get_from(stanza);
+    if (!fulljid) {
+        return;
+    }
+
+    Jid* jidp = jid_intern(fulljid);
+    if (!jidp) {
+        return;
+    }
+
+    sv_ev_message_marker(jidp->barejid, id);
+    jid_destroy(jidp);
+}
+
+static gboolean
+_message_markers_enabled(void)
+{
+    return prefs_get_boolean(PREF_RECEIPTS_MARKERS) && !prefs_get_boolean(PREF_LOW_BANDWIDTH);
+}
+
+static void
+_receipt_request_handler(xmpp_stanza_t* const stanza, const MessageElements* const el)
+{
+    if (!prefs_get_boolean(PREF_RECEIPTS_SEND) || prefs_get_boolean(PREF_LOW_BANDWIDTH)) {
         return;
     }
 
@@ -1209,7 +1602,7 @@ _receipt_request_handler(xmpp_stanza_t* const stanza)
         return;
     }
 
-    xmpp_stanza_t* receipts = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_RECEIPTS);
+    xmpp_stanza_t* receipts = el->receipt;
     if (!receipts) {
         return;
     }
@@ -1221,7 +1614,7 @@ _receipt_request_handler(xmpp_stanza_t* const stanza)
 
     const gchar* from = xmpp_stanza_get_from(stanza);
     if (from) {
-        Jid* jid = jid_create(from);
+        Jid* jid = jid_intern(from);
         if (jid) {
             _message_send_receipt(jid->fulljid, id);
             jid_destroy(jid);
@@ -1229,11 +1622,31 @@ _receipt_request_handler(xmpp_stanza_t* const stanza)
     }
 }
 
+static void
+_mucpm_flood_report(const char* const jid, guint dropped)
+{
+    log_info("Ignored %u private messages from %s", dropped, jid);
+    cons_show("Ignored %u private messages from %s, too many at once.", dropped, jid);
+}
+
+// Checks the occupant first so one flooding nick does not use up the room
+static gboolean
+_mucpm_allow(const Jid* const from_jid)
+{
+    if (mucpm_sender_limit == NULL) {
+        mucpm_sender_limit = ratelimit_new("mucpm sender", MUCPM_SENDER_BURST, MUCPM_SENDER_PER_MINUTE, _mucpm_flood_report);
+        mucpm_room_limit = ratelimit_new("mucpm room", MUCPM_ROOM_BURST, MUCPM_ROOM_PER_MINUTE, _mucpm_flood_report);
+    }
+
+    return ratelimit_allow(mucpm_sender_limit, from_jid->fulljid ? from_jid->fulljid : from_jid->barejid)
+           && ratelimit_allow(mucpm_room_limit, from_jid->barejid);
+}
+
 static void
 _handle_muc_private_message(xmpp_stanza_t* const stanza)
 {
     // standard chat message, use jid without resource
-    ProfMessage* message = message_init();
+    ProfMessage* message = _message_init_stanza();
     message->type = PROF_MSG_TYPE_MUCPM;
 
     const gchar* from = xmpp_stanza_get_from(stanza);
@@ -1241,15 +1654,19 @@ _handle_muc_private_message(xmpp_stanza_t* const stanza)
         goto out;
     }
 
-    message->from_jid = jid_create(from);
+    message->from_jid = jid_intern(from);
     if (!message->from_jid) {
         goto out;
     }
 
+    if (!_mucpm_allow(message->from_jid)) {
+        goto out;
+    }
+
     // message stanza id
     const char* id = xmpp_stanza_get_id(stanza);
     if (id) {
-        message->id = strdup(id);
+        message->id = _message_arena_strdup(id);
     }
 
     // check omemo encryption
@@ -1273,7 +1690,7 @@ _handle_muc_private_message(xmpp_stanza_t* const stanza)
     if (message->timestamp) {
         sv_ev_delayed_private_message(message);
     } else {
-        message->timestamp = g_date_time_new_now_local();
+        message->timestamp = g_get_real_time();
 
         sv_ev_incoming_private_message(message);
     }
@@ -1318,13 +1735,13 @@ _handle_carbons(xmpp_stanza_t* const stanza)
 }
 
 static void
-_handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, const char* result_id, GDateTime* timestamp)
+_handle_chat(xmpp_stanza_t* const stanza, const MessageElements* const el, gboolean is_mam, gboolean is_carbon, const char* result_id, gint64 timestamp)
 {
     // some clients send the mucuser namespace with private messages
     // if the namespace exists, and the stanza contains a body element, assume its a private message
     // otherwise exit the handler
-    xmpp_stanza_t* mucuser = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_MUC_USER);
-    xmpp_stanza_t* body = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_BODY);
+    xmpp_stanza_t* mucuser = el->muc_user;
+    xmpp_stanza_t* body = el->body;
     if (mucuser && body == NULL) {
         return;
     }
@@ -1333,7 +1750,7 @@ _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, c
     if (!from) {
         return;
     }
-    Jid* jid = jid_create(from);
+    Jid* jid = jid_intern(from);
     if (!jid) {
         return;
     }
@@ -1346,16 +1763,16 @@ _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, c
     }
 
     // standard chat message, use jid without resource
-    ProfMessage* message = message_init();
+    ProfMessage* message = _message_init_stanza();
     message->is_mam = is_mam;
     message->from_jid = jid;
     const gchar* to = xmpp_stanza_get_to(stanza);
     if (to) {
-        message->to_jid = jid_create(to);
+        message->to_jid = jid_intern(to);
     } else if (is_carbon) {
         // happens when receive a carbon of a self sent message
         // really? maybe some servers do this, but it's not required.
-        message->to_jid = jid_create(from);
+        message->to_jid = jid_intern(from);
     }
 
     if (mucuser) {
@@ -1367,34 +1784,34 @@ _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, c
     // message stanza id
     const char* id = xmpp_stanza_get_id(stanza);
     if (id) {
-        message->id = strdup(id);
+        message->id = _message_arena_strdup(id);
     }
 
     if (is_mam) {
         // MAM has XEP-0359 stanza-id as <result id="">
         if (result_id) {
-            message->stanzaid = strdup(result_id);
+            message->stanzaid = _message_arena_strdup(result_id);
         } else {
             log_warning("MAM received with no result id");
         }
     } else {
         // live messages use XEP-0359 <stanza-id>
         char* stanzaid = NULL;
-        xmpp_stanza_t* stanzaidst = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_STANZA_ID, STANZA_NS_STABLE_ID);
+        xmpp_stanza_t* stanzaidst = el->stanza_id;
         if (stanzaidst) {
             stanzaid = (char*)xmpp_stanza_get_attribute(stanzaidst, STANZA_ATTR_ID);
             if (stanzaid) {
-                message->stanzaid = strdup(stanzaid);
+                message->stanzaid = _message_arena_strdup(stanzaid);
             }
         }
     }
 
     // replace id for XEP-0308: Last Message Correction
-    xmpp_stanza_t* replace_id_stanza = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_LAST_MESSAGE_CORRECTION);
+    xmpp_stanza_t* replace_id_stanza = el->replace;
     if (replace_id_stanza) {
         const char* replace_id = xmpp_stanza_get_id(replace_id_stanza);
         if (replace_id) {
-            message->replace_id = strdup(replace_id);
+            message->replace_id = _message_arena_strdup(replace_id);
         }
     }
 
@@ -1405,7 +1822,7 @@ _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, c
         // timestamp in the message stanza or use time of receival (now)
         message->timestamp = stanza_get_delay(stanza);
         if (!message->timestamp) {
-            message->timestamp = g_date_time_new_now_local();
+            message->timestamp = g_get_real_time();
         }
     }
 
@@ -1421,14 +1838,12 @@ _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, c
     }
 #endif
 
-    xmpp_stanza_t* encrypted = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_ENCRYPTED);
-    if (encrypted) {
-        message->encrypted = xmpp_stanza_get_text(encrypted);
+    if (el->encrypted) {
+        message->encrypted = xmpp_stanza_get_text(el->encrypted);
     }
 
-    xmpp_stanza_t* ox = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_OPENPGP_0);
-    if (ox) {
-        _handle_ox_chat(stanza, message, FALSE);
+    if (el->openpgp) {
+        _handle_ox_chat(stanza, el, message, FALSE);
     }
 
     if (message->plain || message->body || message->encrypted) {
@@ -1445,15 +1860,20 @@ _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, c
 
             free(mybarejid);
         } else {
+            // the displayed marker sent once it is shown stands in for a receipt
+            message->markable = !is_mam && el->marker && _message_markers_enabled()
+                                && g_strcmp0(xmpp_stanza_get_name(el->marker), STANZA_NAME_MARKABLE) == 0;
             sv_ev_incoming_message(message);
-            _receipt_request_handler(stanza);
+            if (!message->markable || !message->id) {
+                _receipt_request_handler(stanza, el);
+            }
         }
     }
 
     // 0085 works only with resource
     if (jid->resourcepart) {
         // XEP-0085: Chat State Notifications
-        _handle_chat_states(stanza, jid);
+        _handle_chat_states(el, jid);
     }
 
     message_free(message);
@@ -1463,13 +1883,13 @@ _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, c
  * @brief Handle incoming XMMP-OX chat message.
  */
 static void
-_handle_ox_chat(xmpp_stanza_t* const stanza, ProfMessage* message, gboolean is_mam)
+_handle_ox_chat(xmpp_stanza_t* const stanza, const MessageElements* const el, ProfMessage* message, gboolean is_mam)
 {
     message->enc = PROF_MSG_ENC_OX;
 
 #ifdef HAVE_LIBGPGME
-    xmpp_stanza_t* ox = xmpp_stanza_get_child_by_name_and_ns(stanza, "openpgp", STANZA_NS_OPENPGP_0);
-    if (ox) {
+    xmpp_stanza_t* ox = el->openpgp;
+    if (ox && g_strcmp0(xmpp_stanza_get_name(ox), "openpgp") == 0) {
         message->plain = p_ox_gpg_decrypt(xmpp_stanza_get_text(ox));
         if (message->plain) {
             xmpp_stanza_t* x = xmpp_stanza_new_from_string(connection_get_ctx(), message->plain);
@@ -1506,9 +1926,9 @@ _handle_ox_chat(xmpp_stanza_t* const stanza, ProfMessage* message, gboolean is_m
 }
 
 static gboolean
-_handle_mam(xmpp_stanza_t* const stanza)
+_handle_mam(xmpp_stanza_t* const stanza, const MessageElements* const el)
 {
-    xmpp_stanza_t* result = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_RESULT, STANZA_NS_MAM2);
+    xmpp_stanza_t* result = el->mam_result;
     if (!result) {
         return FALSE;
     }
@@ -1523,11 +1943,17 @@ _handle_mam(xmpp_stanza_t* const stanza)
     // same as <stanza-id> from XEP-0359 for live messages
     const char* result_id = xmpp_stanza_get_id(result);
 
-    GDateTime* timestamp = stanza_get_delay_from(forwarded, NULL);
+    gint64 timestamp = stanza_get_delay_from(forwarded, NULL);
 
     xmpp_stanza_t* message_stanza = xmpp_stanza_get_child_by_ns(forwarded, "jabber:client");
+    if (!message_stanza) {
+        log_warning("MAM received with no message element");
+        return FALSE;
+    }
 
-    _handle_chat(message_stanza, TRUE, FALSE, result_id, timestamp);
+    MessageElements message_el;
+    stanza_parse_message(message_stanza, &message_el);
+    _handle_chat(message_stanza, &message_el, TRUE, FALSE, result_id, timestamp);
 
     return TRUE;
 }
@@ -1553,11 +1979,17 @@ _handle_pubsub(xmpp_stanza_t* const stanza, xmpp_stanza_t* const event)
 static void
 _send_message_stanza(xmpp_stanza_t* const stanza)
 {
+    xmpp_conn_t* conn = connection_get_conn();
+    if (!plugins_hook_in_use(PLUGIN_HOOK_ON_MESSAGE_STANZA_SEND)) {
+        xmpp_send(conn, stanza);
+        connection_stanza_queued();
+        return;
+    }
+
     char* text;
     size_t text_size;
     xmpp_stanza_to_text(stanza, &text, &text_size);
 
-    xmpp_conn_t* conn = connection_get_conn();
     char* plugin_text = plugins_on_message_stanza_send(text);
     if (plugin_text) {
         xmpp_send_raw_string(conn, "%s", plugin_text);
@@ -1565,9 +1997,40 @@ _send_message_stanza(xmpp_stanza_t* const stanza)
     } else {
         xmpp_send_raw_string(conn, "%s", text);
     }
+    connection_stanza_queued();
     xmpp_free(connection_get_ctx(), text);
 }
 
+static GString*
+_message_stanza_text(void)
+{
+    if (!stanza_text) {
+        stanza_text = g_string_sized_new(512);
+    }
+
+    return stanza_text;
+}
+
+// Sends stanza_text as written, plugins that rewrite outgoing stanzas get
+// the text just as from a stanza
+static void
+_send_message_text(void)
+{
+    xmpp_conn_t* conn = connection_get_conn();
+    if (plugins_hook_in_use(PLUGIN_HOOK_ON_MESSAGE_STANZA_SEND)) {
+        char* plugin_text = plugins_on_message_stanza_send(stanza_text->str);
+        if (plugin_text) {
+            xmpp_send_raw_string(conn, "%s", plugin_text);
+            free(plugin_text);
+            connection_stanza_queued();
+            return;
+        }
+    }
+
+    xmpp_send_raw(conn, stanza_text->str, stanza_text->len);
+    connection_stanza_queued();
+}
+
 /* ckeckOID = true: check origin-id
  * checkOID = false: check regular id
  */
@@ -1588,24 +2051,7 @@ message_is_sent_by_us(const ProfMessage* const message, bool checkOID)
         }
 
         if (tmp_id != NULL) {
-            gsize tmp_len = strlen(tmp_id);
-
-            // our client sents at CON_RAND_ID_LEN + identifier
-            if (tmp_len > CON_RAND_ID_LEN) {
-                char* uuid = g_strndup(tmp_id, CON_RAND_ID_LEN);
-                const char* prof_identifier = connection_get_profanity_identifier();
-
-                gchar* hmac = g_compute_hmac_for_string(G_CHECKSUM_SHA1,
-                                                        (guchar*)prof_identifier, strlen(prof_identifier),
-                                                        uuid, strlen(uuid));
-
-                if (g_strcmp0(&tmp_id[CON_RAND_ID_LEN], hmac) == 0) {
-                    ret = TRUE;
-                }
-
-                g_free(uuid);
-                g_free(hmac);
-            }
+            ret = connection_is_own_stanza_id(tmp_id);
         }
     }
 
@@ -1688,9 +2134,9 @@ message_request_voice(const char* const roomjid)
 }
 
 static gboolean
-_handle_jingle_message(xmpp_stanza_t* const stanza)
+_handle_jingle_message(xmpp_stanza_t* const stanza, const MessageElements* const el)
 {
-    xmpp_stanza_t* propose = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_PROPOSE, STANZA_NS_JINGLE_MESSAGE);
+    xmpp_stanza_t* propose = el->propose;
 
     if (propose) {
         xmpp_stanza_t* description = xmpp_stanza_get_child_by_ns(propose, STANZA_NS_JINGLE_RTP);
@@ -1704,18 +2150,29 @@ _handle_jingle_message(xmpp_stanza_t* const stanza)
     return FALSE;
 }
 
+// Drops messages from blocked jids, and chat messages from jids not in the
+// roster if 'silence' is set, on the raw from before the stanza is parsed
 static gboolean
-_should_ignore_based_on_silence(xmpp_stanza_t* const stanza)
+_should_drop(xmpp_stanza_t* const stanza)
 {
+    const char* const from = xmpp_stanza_get_from(stanza);
+    if (!from) {
+        return FALSE;
+    }
+
+    if (blocked_matches(from)) {
+        log_debug("[Blocked] Ignoring message from: %s", from);
+        return TRUE;
+    }
+
     if (prefs_get_boolean(PREF_SILENCE_NON_ROSTER)) {
-        const char* const from = xmpp_stanza_get_from(stanza);
-        Jid* from_jid = jid_create(from);
-        PContact contact = roster_get_contact(from_jid->barejid);
-        jid_destroy(from_jid);
-        if (!contact) {
+        const char* type = xmpp_stanza_get_type(stanza);
+        gboolean chat = type == NULL || g_strcmp0(type, STANZA_TYPE_CHAT) == 0 || g_strcmp0(type, STANZA_TYPE_NORMAL) == 0;
+        if (chat && !roster_contains_jid(from)) {
             log_debug("[Silence] Ignoring message from: %s", from);
             return TRUE;
         }
     }
+
     return FALSE;
 }
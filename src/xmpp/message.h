@@ -40,11 +40,18 @@
 
 typedef int (*ProfMessageCallback)(xmpp_stanza_t* const stanza, void* const userdata);
 typedef void (*ProfMessageFreeCallback)(void* userdata);
+typedef void (*ProfMessageBacklogCallback)(xmpp_stanza_t* const stanza, void* const userdata);
 
 ProfMessage* message_init(void);
+ProfMessage* message_copy(const ProfMessage* const message);
 void message_free(ProfMessage* message);
 void message_handlers_init(void);
+void message_handlers_attach(void);
 void message_handlers_clear(void);
 void message_pubsub_event_handler_add(const char* const node, ProfMessageCallback func, ProfMessageFreeCallback free_func, void* userdata);
+gboolean message_backlog_pending(void);
+void message_backlog_defer(xmpp_stanza_t* const stanza, ProfMessageBacklogCallback func, void* userdata);
+// Handle stanza as if it was received, for replaying a recording
+void message_replay(xmpp_stanza_t* const stanza);
 
 #endif
@@ -42,7 +42,10 @@
 #include <glib.h>
 
 #include "common.h"
+#include "log.h"
 #include "tools/autocomplete.h"
+#include "tools/intern.h"
+#include "tools/memusage.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
 #include "xmpp/jid.h"
@@ -67,9 +70,16 @@ typedef struct _muc_room_t
     gboolean autojoin;
     gboolean pending_nick_change;
     GHashTable* roster;
+    // roster occupants ordered by nick, overall and for each role
+    GSequence* occupants;
+    GSequence* occupants_by_role[MUC_ROLE_MODERATOR + 1];
     GHashTable* members;
     Autocomplete nick_ac;
     Autocomplete jid_ac;
+    // in presence-light mode occupants keep no jid and status, and nick_ac
+    // is only filled on the first completion
+    gboolean light;
+    gboolean nick_ac_built;
     GHashTable* nick_changes;
     gboolean roster_received;
     muc_member_type_t member_type;
@@ -80,6 +90,8 @@ GHashTable* rooms = NULL;
 GHashTable* invite_passwords = NULL;
 Autocomplete invite_ac = NULL;
 Autocomplete confservers_ac = NULL;
+// rooms switch to presence-light mode at this many occupants, 0 never
+static guint light_threshold = 0;
 
 static void _free_room(ChatRoom* room);
 static gint _compare_occupants(Occupant* a, Occupant* b);
@@ -90,6 +102,13 @@ static char* _affiliation_to_string(muc_affiliation_t affiliation);
 static Occupant* _muc_occupant_new(const char* const nick, const char* const jid, muc_role_t role,
                                    muc_affiliation_t affiliation, resource_presence_t presence, const char* const status);
 static void _occupant_free(Occupant* occupant);
+static gsize _occupant_size(Occupant* occupant);
+static void _room_set_light(ChatRoom* chat_room);
+static Autocomplete _room_nick_ac(ChatRoom* chat_room);
+static void _room_ac_add(ChatRoom* chat_room, Autocomplete ac, const char* const item);
+static void _occupant_index_add(ChatRoom* chat_room, Occupant* occupant);
+static void _occupant_index_remove(ChatRoom* chat_room, Occupant* occupant);
+static GList* _occupant_sequence_to_list(GSequence* seq);
 
 void
 muc_init(void)
@@ -113,6 +132,85 @@ muc_close(void)
     confservers_ac = NULL;
 }
 
+static gsize
+_room_memory(ChatRoom* room)
+{
+    gsize total = memusage_alloc(sizeof(ChatRoom));
+    total += memusage_string(room->room) + memusage_string(room->nick) + memusage_string(room->password);
+    total += memusage_string(room->subject) + memusage_string(room->autocomplete_prefix);
+
+    total += memusage_list(room->pending_broadcasts);
+    for (GList* curr = room->pending_broadcasts; curr; curr = g_list_next(curr)) {
+        total += memusage_string(curr->data);
+    }
+
+    GHashTableIter iter;
+    gpointer key, value;
+    total += memusage_hash_table(room->roster);
+    g_hash_table_iter_init(&iter, room->roster);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        total += memusage_alloc(_occupant_size(value));
+    }
+
+    total += memusage_sequence(room->occupants);
+    for (int i = 0; i <= MUC_ROLE_MODERATOR; i++) {
+        total += memusage_sequence(room->occupants_by_role[i]);
+    }
+
+    // the interned jids of the members and occupants are counted on their own
+    total += memusage_hash_table(room->members);
+
+    total += memusage_hash_table(room->nick_changes);
+    g_hash_table_iter_init(&iter, room->nick_changes);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        total += memusage_string(key) + memusage_string(value);
+    }
+
+    return total;
+}
+
+// Rough heap use of the joined rooms and their occupants, the nick and jid
+// autocompleters are counted with the others
+gsize
+muc_memory(guint* occupants)
+{
+    *occupants = 0;
+    if (!rooms) {
+        return 0;
+    }
+
+    gsize total = memusage_hash_table(rooms);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, rooms);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        ChatRoom* room = value;
+        *occupants += g_hash_table_size(room->roster);
+        total += memusage_string(key) + _room_memory(room);
+    }
+
+    return total;
+}
+
+// Rooms reaching occupants switch to presence-light mode, 0 turns it off for
+// rooms joined later
+void
+muc_set_light_threshold(guint occupants)
+{
+    light_threshold = occupants;
+}
+
+gboolean
+muc_light(const char* const room)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room) {
+        return chat_room->light;
+    } else {
+        return FALSE;
+    }
+}
+
 void
 muc_confserver_add(const char* const server)
 {
@@ -227,10 +325,17 @@ muc_join(const char* const room, const char* const nick, const char* const passw
     new_room->subject = NULL;
     new_room->pending_broadcasts = NULL;
     new_room->pending_config = FALSE;
-    new_room->roster = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_occupant_free);
-    new_room->members = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    // keyed by the nick of the occupant itself
+    new_room->roster = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)_occupant_free);
+    new_room->occupants = g_sequence_new(NULL);
+    for (int i = 0; i <= MUC_ROLE_MODERATOR; i++) {
+        new_room->occupants_by_role[i] = g_sequence_new(NULL);
+    }
+    new_room->members = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)intern_unref, NULL);
     new_room->nick_ac = autocomplete_new();
     new_room->jid_ac = autocomplete_new();
+    new_room->light = FALSE;
+    new_room->nick_ac_built = TRUE;
     new_room->nick_changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
     new_room->roster_received = FALSE;
     new_room->pending_nick_change = FALSE;
@@ -402,7 +507,11 @@ muc_nick_change_complete(const char* const room, const char* const nick)
 {
     ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
-        g_hash_table_remove(chat_room->roster, chat_room->nick);
+        Occupant* self = g_hash_table_lookup(chat_room->roster, chat_room->nick);
+        if (self) {
+            _occupant_index_remove(chat_room, self);
+            g_hash_table_remove(chat_room->roster, chat_room->nick);
+        }
         autocomplete_remove(chat_room->nick_ac, chat_room->nick);
         free(chat_room->nick);
         chat_room->nick = strdup(nick);
@@ -479,28 +588,42 @@ muc_roster_add(const char* const room, const char* const nick, const char* const
     resource_presence_t new_presence = resource_presence_from_string(show);
 
     if (chat_room) {
+        // presence-light rooms only keep the nick and role
+        const char* const occupant_jid = chat_room->light ? NULL : jid;
+        const char* const occupant_status = chat_room->light ? NULL : status;
+
         Occupant* old = g_hash_table_lookup(chat_room->roster, nick);
 
         if (!old) {
             updated = TRUE;
-            autocomplete_add(chat_room->nick_ac, nick);
-        } else if (old->presence != new_presence || (g_strcmp0(old->status, status) != 0)) {
+            if (chat_room->nick_ac_built) {
+                _room_ac_add(chat_room, chat_room->nick_ac, nick);
+            }
+        } else if (old->presence != new_presence || (g_strcmp0(old->status, occupant_status) != 0)) {
             updated = TRUE;
         }
 
         resource_presence_t presence = resource_presence_from_string(show);
         muc_role_t role_t = _role_from_string(role);
         muc_affiliation_t affiliation_t = _affiliation_from_string(affiliation);
-        Occupant* occupant = _muc_occupant_new(nick, jid, role_t, affiliation_t, presence, status);
-        g_hash_table_replace(chat_room->roster, strdup(nick), occupant);
+        Occupant* occupant = _muc_occupant_new(nick, occupant_jid, role_t, affiliation_t, presence, occupant_status);
+        if (old) {
+            _occupant_index_remove(chat_room, old);
+        }
+        g_hash_table_replace(chat_room->roster, occupant->nick, occupant);
+        _occupant_index_add(chat_room, occupant);
 
-        if (jid) {
-            Jid* jidp = jid_create(jid);
+        if (occupant_jid) {
+            Jid* jidp = jid_create(occupant_jid);
             if (jidp->barejid) {
-                autocomplete_add(chat_room->jid_ac, jidp->barejid);
+                _room_ac_add(chat_room, chat_room->jid_ac, jidp->barejid);
             }
             jid_destroy(jidp);
         }
+
+        if (!chat_room->light && light_threshold > 0 && g_hash_table_size(chat_room->roster) >= light_threshold) {
+            _room_set_light(chat_room);
+        }
     }
 
     return updated;
@@ -514,7 +637,11 @@ muc_roster_remove(const char* const room, const char* const nick)
 {
     ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
-        g_hash_table_remove(chat_room->roster, nick);
+        Occupant* occupant = g_hash_table_lookup(chat_room->roster, nick);
+        if (occupant) {
+            _occupant_index_remove(chat_room, occupant);
+            g_hash_table_remove(chat_room->roster, nick);
+        }
         autocomplete_remove(chat_room->nick_ac, nick);
     }
 }
@@ -539,18 +666,37 @@ muc_roster(const char* const room)
 {
     ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
-        GList* result = NULL;
-        GList* occupants = g_hash_table_get_values(chat_room->roster);
-
-        GList* curr = occupants;
-        while (curr) {
-            result = g_list_insert_sorted(result, curr->data, (GCompareFunc)_compare_occupants);
-            curr = g_list_next(curr);
-        }
+        return _occupant_sequence_to_list(chat_room->occupants);
+    } else {
+        return NULL;
+    }
+}
 
-        g_list_free(occupants);
+/*
+ * Return the room's occupants ordered by nick
+ * The sequence is owned by the chat room and should not be modified or freed,
+ * it is only valid until the roster next changes
+ */
+GSequence*
+muc_roster_view(const char* const room)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room) {
+        return chat_room->occupants;
+    } else {
+        return NULL;
+    }
+}
 
-        return result;
+/*
+ * As muc_roster_view, for the occupants with the given role
+ */
+GSequence*
+muc_roster_view_by_role(const char* const room, muc_role_t role)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room && role <= MUC_ROLE_MODERATOR) {
+        return chat_room->occupants_by_role[role];
     } else {
         return NULL;
     }
@@ -564,7 +710,7 @@ muc_roster_ac(const char* const room)
 {
     ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
-        return chat_room->nick_ac;
+        return _room_nick_ac(chat_room);
     } else {
         return NULL;
     }
@@ -590,6 +736,8 @@ muc_roster_set_complete(const char* const room)
     ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
         chat_room->roster_received = TRUE;
+        autocomplete_sort(chat_room->nick_ac);
+        autocomplete_sort(chat_room->jid_ac);
     }
 }
 
@@ -628,19 +776,13 @@ muc_occupant_role_str(Occupant* occupant)
 GSList*
 muc_occupants_by_role(const char* const room, muc_role_t role)
 {
-    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
-    if (chat_room) {
+    GSequence* occupants = muc_roster_view_by_role(room, role);
+    if (occupants) {
         GSList* result = NULL;
-        GHashTableIter iter;
-        gpointer key;
-        gpointer value;
-
-        g_hash_table_iter_init(&iter, chat_room->roster);
-        while (g_hash_table_iter_next(&iter, &key, &value)) {
-            Occupant* occupant = (Occupant*)value;
-            if (occupant->role == role) {
-                result = g_slist_insert_sorted(result, value, (GCompareFunc)_compare_occupants);
-            }
+        GSequenceIter* iter = g_sequence_get_end_iter(occupants);
+        while (!g_sequence_iter_is_begin(iter)) {
+            iter = g_sequence_iter_prev(iter);
+            result = g_slist_prepend(result, g_sequence_get(iter));
         }
         return result;
     } else {
@@ -737,7 +879,7 @@ muc_autocomplete(ProfWin* window, const char* const input, gboolean previous)
         }
     }
 
-    char* result = autocomplete_complete(chat_room->nick_ac, search_str, FALSE, previous);
+    char* result = autocomplete_complete(_room_nick_ac(chat_room), search_str, FALSE, previous);
     if (result == NULL) {
         return NULL;
     }
@@ -884,7 +1026,7 @@ muc_members_add(const char* const room, const char* const jid)
 {
     ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
-        if (g_hash_table_insert(chat_room->members, strdup(jid), NULL)) {
+        if (g_hash_table_insert(chat_room->members, (gpointer)intern(jid), NULL)) {
 #ifdef HAVE_OMEMO
             if (chat_room->anonymity_type == MUC_ANONYMITY_TYPE_NONANONYMOUS) {
                 char* our_barejid = connection_get_barejid();
@@ -926,6 +1068,10 @@ _free_room(ChatRoom* room)
         free(room->subject);
         free(room->password);
         free(room->autocomplete_prefix);
+        g_sequence_free(room->occupants);
+        for (int i = 0; i <= MUC_ROLE_MODERATOR; i++) {
+            g_sequence_free(room->occupants_by_role[i]);
+        }
         if (room->roster) {
             g_hash_table_destroy(room->roster);
         }
@@ -951,6 +1097,53 @@ _compare_occupants(Occupant* a, Occupant* b)
     const char* utf8_str_b = b->nick_collate_key;
 
     gint result = g_strcmp0(utf8_str_a, utf8_str_b);
+    if (result == 0) {
+        // distinct nicks may share a collate key
+        result = g_strcmp0(a->nick, b->nick);
+    }
+
+    return result;
+}
+
+static gint
+_seq_compare_occupants(gconstpointer a, gconstpointer b, gpointer data)
+{
+    return _compare_occupants((Occupant*)a, (Occupant*)b);
+}
+
+static void
+_occupant_index_add(ChatRoom* chat_room, Occupant* occupant)
+{
+    g_sequence_insert_sorted(chat_room->occupants, occupant, _seq_compare_occupants, NULL);
+    if (occupant->role <= MUC_ROLE_MODERATOR) {
+        g_sequence_insert_sorted(chat_room->occupants_by_role[occupant->role], occupant, _seq_compare_occupants, NULL);
+    }
+}
+
+static void
+_occupant_index_remove(ChatRoom* chat_room, Occupant* occupant)
+{
+    GSequenceIter* iter = g_sequence_lookup(chat_room->occupants, occupant, _seq_compare_occupants, NULL);
+    if (iter) {
+        g_sequence_remove(iter);
+    }
+    if (occupant->role <= MUC_ROLE_MODERATOR) {
+        iter = g_sequence_lookup(chat_room->occupants_by_role[occupant->role], occupant, _seq_compare_occupants, NULL);
+        if (iter) {
+            g_sequence_remove(iter);
+        }
+    }
+}
+
+static GList*
+_occupant_sequence_to_list(GSequence* seq)
+{
+    GList* result = NULL;
+    GSequenceIter* iter = g_sequence_get_end_iter(seq);
+    while (!g_sequence_iter_is_begin(iter)) {
+        iter = g_sequence_iter_prev(iter);
+        result = g_list_prepend(result, g_sequence_get(iter));
+    }
 
     return result;
 }
@@ -1048,34 +1241,44 @@ _affiliation_to_string(muc_affiliation_t affiliation)
     return result;
 }
 
+// copies str to *dest and moves *dest past it
+static char*
+_occupant_pack(char** dest, const char* const str)
+{
+    if (!str) {
+        return NULL;
+    }
+
+    char* packed = *dest;
+    gsize size = strlen(str) + 1;
+    memcpy(packed, str, size);
+    *dest += size;
+
+    return packed;
+}
+
+// The strings are packed after the record, an occupant is a single
+// allocation but for its interned jid
 static Occupant*
 _muc_occupant_new(const char* const nick, const char* const jid, muc_role_t role, muc_affiliation_t affiliation,
                   resource_presence_t presence, const char* const status)
 {
-    Occupant* occupant = malloc(sizeof(Occupant));
+    gchar* collate_key = nick ? g_utf8_collate_key(nick, -1) : NULL;
 
-    if (nick) {
-        occupant->nick = strdup(nick);
-        occupant->nick_collate_key = g_utf8_collate_key(occupant->nick, -1);
-    } else {
-        occupant->nick = NULL;
-        occupant->nick_collate_key = NULL;
-    }
+    gsize size = sizeof(Occupant);
+    size += nick ? strlen(nick) + 1 : 0;
+    size += collate_key ? strlen(collate_key) + 1 : 0;
+    size += status ? strlen(status) + 1 : 0;
 
-    if (jid) {
-        occupant->jid = strdup(jid);
-    } else {
-        occupant->jid = NULL;
-    }
+    Occupant* occupant = malloc(size);
+    char* strings = (char*)(occupant + 1);
+    occupant->nick = _occupant_pack(&strings, nick);
+    occupant->nick_collate_key = _occupant_pack(&strings, collate_key);
+    occupant->jid = intern(jid);
+    occupant->status = _occupant_pack(&strings, status);
+    g_free(collate_key);
 
     occupant->presence = presence;
-
-    if (status) {
-        occupant->status = strdup(status);
-    } else {
-        occupant->status = NULL;
-    }
-
     occupant->role = role;
     occupant->affiliation = affiliation;
 
@@ -1085,11 +1288,69 @@ _muc_occupant_new(const char* const nick, const char* const jid, muc_role_t role
 static void
 _occupant_free(Occupant* occupant)
 {
-    if (occupant) {
-        free(occupant->nick);
-        free(occupant->nick_collate_key);
-        free(occupant->jid);
-        free(occupant->status);
-        free(occupant);
+    intern_unref(occupant->jid);
+    free(occupant);
+}
+
+static gsize
+_occupant_size(Occupant* occupant)
+{
+    gsize size = sizeof(Occupant);
+    size += occupant->nick ? strlen(occupant->nick) + 1 : 0;
+    size += occupant->nick_collate_key ? strlen(occupant->nick_collate_key) + 1 : 0;
+    size += occupant->status ? strlen(occupant->status) + 1 : 0;
+
+    return size;
+}
+
+// Drops the jids and status texts already stored and the autocompleters,
+// the nicks are completed again once asked for
+static void
+_room_set_light(ChatRoom* chat_room)
+{
+    log_info("Room %s has %u occupants, switching to presence-light mode", chat_room->room, g_hash_table_size(chat_room->roster));
+
+    chat_room->light = TRUE;
+    chat_room->nick_ac_built = FALSE;
+    autocomplete_clear(chat_room->nick_ac);
+    autocomplete_clear(chat_room->jid_ac);
+
+    GList* occupants = g_hash_table_get_values(chat_room->roster);
+    for (GList* curr = occupants; curr; curr = g_list_next(curr)) {
+        Occupant* old = curr->data;
+        Occupant* occupant = _muc_occupant_new(old->nick, NULL, old->role, old->affiliation, old->presence, NULL);
+        _occupant_index_remove(chat_room, old);
+        g_hash_table_replace(chat_room->roster, occupant->nick, occupant);
+        _occupant_index_add(chat_room, occupant);
+    }
+    g_list_free(occupants);
+}
+
+// Until the self-presence ends the join, occupants go in unsorted and are
+// sorted once by muc_roster_set_complete()
+static void
+_room_ac_add(ChatRoom* chat_room, Autocomplete ac, const char* const item)
+{
+    if (chat_room->roster_received) {
+        autocomplete_add(ac, item);
+    } else {
+        autocomplete_add_unsorted(ac, item);
     }
 }
+
+static Autocomplete
+_room_nick_ac(ChatRoom* chat_room)
+{
+    if (!chat_room->nick_ac_built) {
+        GHashTableIter iter;
+        gpointer key;
+        g_hash_table_iter_init(&iter, chat_room->roster);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            autocomplete_add_unsorted(chat_room->nick_ac, key);
+        }
+        autocomplete_sort(chat_room->nick_ac);
+        chat_room->nick_ac_built = TRUE;
+    }
+
+    return chat_room->nick_ac;
+}
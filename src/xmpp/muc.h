@@ -74,7 +74,8 @@ typedef struct _muc_occupant_t
 {
     char* nick;
     gchar* nick_collate_key;
-    char* jid;
+    // interned, the same real jid is in every room it joined
+    const char* jid;
     muc_role_t role;
     muc_affiliation_t affiliation;
     resource_presence_t presence;
@@ -83,6 +84,7 @@ typedef struct _muc_occupant_t
 
 void muc_init(void);
 void muc_close(void);
+gsize muc_memory(guint* occupants);
 
 void muc_join(const char* const room, const char* const nick, const char* const password, gboolean autojoin);
 void muc_leave(const char* const room);
@@ -109,6 +111,8 @@ gboolean muc_roster_add(const char* const room, const char* const nick, const ch
 void muc_roster_remove(const char* const room, const char* const nick);
 void muc_roster_set_complete(const char* const room);
 GList* muc_roster(const char* const room);
+GSequence* muc_roster_view(const char* const room);
+GSequence* muc_roster_view_by_role(const char* const room, muc_role_t role);
 Autocomplete muc_roster_ac(const char* const room);
 Autocomplete muc_roster_jid_ac(const char* const room);
 void muc_jid_autocomplete_reset(const char* const room);
@@ -125,6 +129,9 @@ GSList* muc_occupants_by_affiliation(const char* const room, muc_affiliation_t a
 void muc_occupant_nick_change_start(const char* const room, const char* const new_nick, const char* const old_nick);
 char* muc_roster_nick_change_complete(const char* const room, const char* const nick);
 
+void muc_set_light_threshold(guint occupants);
+gboolean muc_light(const char* const room);
+
 void muc_confserver_add(const char* const server);
 void muc_confserver_reset_ac(void);
 char* muc_confserver_find(const char* const search_str, gboolean previous, void* context);
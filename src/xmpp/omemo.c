@@ -35,13 +35,20 @@
 
 #include "config.h"
 
+#include <stdlib.h>
+#include <string.h>
 #include <glib.h>
 
 #include "log.h"
+#include "config/files.h"
+#include "config/preferences.h"
+#include "tools/scheduler.h"
 #include "xmpp/connection.h"
 #include "xmpp/form.h"
 #include "xmpp/iq.h"
+#include "xmpp/iq_future.h"
 #include "xmpp/message.h"
+#include "xmpp/omemo.h"
 #include "xmpp/stanza.h"
 
 #include "omemo/omemo.h"
@@ -54,6 +61,45 @@ static int _omemo_bundle_publish_result(xmpp_stanza_t* const stanza, void* const
 static int _omemo_bundle_publish_configure(xmpp_stanza_t* const stanza, void* const userdata);
 static int _omemo_bundle_publish_configure_result(xmpp_stanza_t* const stanza, void* const userdata);
 
+// device lists fetched less than this many seconds ago are not fetched again
+#define OMEMO_DEVICELIST_TTL                 (60 * 60)
+#define OMEMO_DEVICELIST_CACHE_SAVE_DELAY_MS 5000
+
+// bundles of a session start not all in by then are given up together
+#define OMEMO_BUNDLES_TIMEOUT_MS (30 * 1000)
+
+// A device list or bundle request. Only the fetch window of them is sent at
+// once, the rest wait in fetch_queue, and a request already waiting or sent
+// is not added again. Its future owns it.
+typedef struct
+{
+    char* key;
+    char* jid;
+    gboolean bundle;
+    uint32_t device_id;
+    ProfIqCallback func;
+    ProfIqFreeCallback free_func;
+    void* userdata;
+    IqFuture* future;
+    gboolean sent;
+} OmemoFetch;
+
+static GQueue* fetch_queue = NULL;
+static GHashTable* fetch_pending = NULL;
+static int fetch_inflight = 0;
+
+static GKeyFile* devicelist_cache = NULL;
+static gchar* devicelist_cache_loc = NULL;
+static SchedulerTask* devicelist_cache_task = NULL;
+
+static IqFuture* _omemo_fetch_add(const char* const jid, gboolean bundle, uint32_t device_id, ProfIqCallback func, ProfIqFreeCallback free_func, void* userdata);
+static void _omemo_fetch_pump(void);
+static void _omemo_fetch_settled(IqFuture* future, void* userdata);
+static void _omemo_fetch_free(OmemoFetch* fetch);
+static void _omemo_bundles_received(IqFuture* bundles, void* userdata);
+static gboolean _omemo_devicelist_cache_load(const char* const jid);
+static void _omemo_devicelist_cache_store(const char* const jid, GList* device_list);
+
 void
 omemo_devicelist_subscribe(void)
 {
@@ -103,18 +149,17 @@ omemo_devicelist_configure(void)
 void
 omemo_devicelist_request(const char* const jid)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-    char* id = connection_create_stanza_id();
-
-    log_debug("[OMEMO] request device list for jid: %s", jid);
+    // our own list always comes from the server, it decides what we publish
+    char* mybarejid = connection_get_barejid();
+    gboolean own = g_strcmp0(mybarejid, jid) == 0;
+    free(mybarejid);
 
-    xmpp_stanza_t* iq = stanza_create_omemo_devicelist_request(ctx, id, jid);
-    iq_id_handler_add(id, _omemo_receive_devicelist, NULL, NULL);
-
-    iq_send_stanza(iq);
+    if (!own && _omemo_devicelist_cache_load(jid)) {
+        return;
+    }
 
-    free(id);
-    xmpp_stanza_release(iq);
+    _omemo_fetch_add(jid, FALSE, 0, _omemo_receive_devicelist, NULL, NULL);
+    _omemo_fetch_pump();
 }
 
 void
@@ -168,18 +213,67 @@ omemo_bundle_publish(gboolean first)
 void
 omemo_bundle_request(const char* const jid, uint32_t device_id, ProfIqCallback func, ProfIqFreeCallback free_func, void* userdata)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-    char* id = connection_create_stanza_id();
+    _omemo_fetch_add(jid, TRUE, device_id, func, free_func, userdata);
+    _omemo_fetch_pump();
+}
 
-    log_debug("[OMEMO] request omemo bundle (jid: %s, device: %d)", jid, device_id);
+// The bundles of all the devices are asked for together, and those not in
+// within OMEMO_BUNDLES_TIMEOUT_MS are given up at once.
+void
+omemo_bundles_request(const char* const jid, GList* device_ids)
+{
+    GList* fetches = NULL;
+    for (GList* curr = device_ids; curr; curr = g_list_next(curr)) {
+        IqFuture* fetch = _omemo_fetch_add(jid, TRUE, GPOINTER_TO_INT(curr->data), omemo_start_device_session_handle_bundle, free, strdup(jid));
+        if (fetch) {
+            fetches = g_list_prepend(fetches, fetch);
+        }
+    }
+    if (!fetches) {
+        return;
+    }
 
-    xmpp_stanza_t* iq = stanza_create_omemo_bundle_request(ctx, id, jid, device_id);
-    iq_id_handler_add(id, func, free_func, userdata);
+    IqFuture* bundles = iq_future_all(fetches);
+    g_list_free(fetches);
+    iq_future_set_deadline(bundles, OMEMO_BUNDLES_TIMEOUT_MS);
+    iq_future_then(bundles, _omemo_bundles_received, strdup(jid), free);
 
-    iq_send_stanza(iq);
+    // sent once grouped, a fetch may settle as soon as it is sent
+    _omemo_fetch_pump();
+}
 
-    free(id);
-    xmpp_stanza_release(iq);
+// Drop waiting requests and write the device list cache, on disconnect.
+void
+omemo_fetch_reset(void)
+{
+    // a cancelled fetch leaves the queue, and its future frees it
+    if (fetch_queue) {
+        while (!g_queue_is_empty(fetch_queue)) {
+            OmemoFetch* fetch = g_queue_peek_head(fetch_queue);
+            iq_future_cancel(fetch->future);
+        }
+        g_queue_free(fetch_queue);
+        fetch_queue = NULL;
+    }
+    if (fetch_pending) {
+        g_hash_table_destroy(fetch_pending);
+        fetch_pending = NULL;
+    }
+    fetch_inflight = 0;
+
+    scheduler_remove(devicelist_cache_task);
+    devicelist_cache_task = NULL;
+    if (devicelist_cache) {
+        GError* error = NULL;
+        if (!g_key_file_save_to_file(devicelist_cache, devicelist_cache_loc, &error)) {
+            log_error("[OMEMO] error saving device list cache: %s", error->message);
+            g_error_free(error);
+        }
+        g_key_file_free(devicelist_cache);
+        devicelist_cache = NULL;
+    }
+    g_free(devicelist_cache_loc);
+    devicelist_cache_loc = NULL;
 }
 
 int
@@ -547,6 +641,7 @@ _omemo_receive_devicelist(xmpp_stanza_t* const stanza, void* const userdata)
     }
 
 out:
+    _omemo_devicelist_cache_store(from, device_list);
     omemo_set_device_list(from, device_list);
 
     return 1;
@@ -743,3 +838,214 @@ _omemo_bundle_publish_configure_result(xmpp_stanza_t* const stanza, void* const
 
     return 0;
 }
+
+// Queued without sending it, for _omemo_fetch_pump(). NULL when the same
+// request is already waiting or sent.
+static IqFuture*
+_omemo_fetch_add(const char* const jid, gboolean bundle, uint32_t device_id, ProfIqCallback func, ProfIqFreeCallback free_func, void* userdata)
+{
+    if (!fetch_queue) {
+        fetch_queue = g_queue_new();
+        fetch_pending = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+
+    char* key = bundle ? g_strdup_printf("%s/%u", jid, device_id) : g_strdup(jid);
+    OmemoFetch* pending = g_hash_table_lookup(fetch_pending, key);
+    if (pending && pending->func == func) {
+        log_debug("[OMEMO] request for %s already pending", key);
+        g_free(key);
+        if (free_func && userdata) {
+            free_func(userdata);
+        }
+        return NULL;
+    }
+
+    OmemoFetch* fetch = malloc(sizeof(OmemoFetch));
+    fetch->key = key;
+    fetch->jid = strdup(jid);
+    fetch->bundle = bundle;
+    fetch->device_id = device_id;
+    fetch->func = func;
+    fetch->free_func = free_func;
+    fetch->userdata = userdata;
+    fetch->sent = FALSE;
+    fetch->future = iq_future_new();
+    iq_future_then(fetch->future, _omemo_fetch_settled, fetch, (GDestroyNotify)_omemo_fetch_free);
+
+    if (!pending) {
+        g_hash_table_insert(fetch_pending, fetch->key, fetch);
+    }
+    g_queue_push_tail(fetch_queue, fetch);
+
+    return fetch->future;
+}
+
+static void
+_omemo_fetch_pump(void)
+{
+    int window = prefs_get_omemo_fetch_window();
+
+    while (fetch_inflight < window && !g_queue_is_empty(fetch_queue)) {
+        OmemoFetch* fetch = g_queue_pop_head(fetch_queue);
+        xmpp_ctx_t* const ctx = connection_get_ctx();
+        char* id = connection_create_stanza_id();
+        xmpp_stanza_t* iq;
+
+        if (fetch->bundle) {
+            log_debug("[OMEMO] request omemo bundle (jid: %s, device: %d)", fetch->jid, fetch->device_id);
+            iq = stanza_create_omemo_bundle_request(ctx, id, fetch->jid, fetch->device_id);
+        } else {
+            log_debug("[OMEMO] request device list for jid: %s", fetch->jid);
+            iq = stanza_create_omemo_devicelist_request(ctx, id, fetch->jid);
+        }
+        fetch->sent = TRUE;
+        fetch_inflight++;
+
+        iq_future_send(fetch->future, iq);
+
+        free(id);
+        xmpp_stanza_release(iq);
+    }
+}
+
+// Answered, timed out or cancelled, either way its window slot is free
+static void
+_omemo_fetch_settled(IqFuture* future, void* userdata)
+{
+    OmemoFetch* fetch = userdata;
+    xmpp_stanza_t* reply = iq_future_stanza(future);
+    if (reply) {
+        fetch->func(reply, fetch->userdata);
+    }
+
+    // the queue is gone when handlers are cleared after a disconnect
+    if (fetch_pending) {
+        if (g_hash_table_lookup(fetch_pending, fetch->key) == fetch) {
+            g_hash_table_remove(fetch_pending, fetch->key);
+        }
+        if (fetch->sent) {
+            fetch_inflight--;
+        } else {
+            g_queue_remove(fetch_queue, fetch);
+        }
+    }
+
+    // cancelled ones go with the connection
+    if (fetch_queue && iq_future_state(future) != IQ_FUTURE_CANCELLED
+        && connection_get_status() == JABBER_CONNECTED) {
+        _omemo_fetch_pump();
+    }
+}
+
+static void
+_omemo_bundles_received(IqFuture* bundles, void* userdata)
+{
+    const char* const jid = userdata;
+    guint total = g_list_length(iq_future_children(bundles));
+
+    log_debug("[OMEMO] %u of %u bundles for %s in after %" G_GINT64_FORMAT " ms, %u timed out",
+              iq_future_count(bundles, IQ_FUTURE_RESULT), total, jid,
+              iq_future_elapsed_ms(bundles), iq_future_count(bundles, IQ_FUTURE_TIMEOUT));
+}
+
+static void
+_omemo_fetch_free(OmemoFetch* fetch)
+{
+    if (fetch->free_func && fetch->userdata) {
+        fetch->free_func(fetch->userdata);
+    }
+    g_free(fetch->key);
+    free(fetch->jid);
+    free(fetch);
+}
+
+static gboolean
+_omemo_devicelist_cache_save(void* data)
+{
+    devicelist_cache_task = NULL;
+
+    GError* error = NULL;
+    if (!g_key_file_save_to_file(devicelist_cache, devicelist_cache_loc, &error)) {
+        log_error("[OMEMO] error saving device list cache: %s", error->message);
+        g_error_free(error);
+    }
+
+    return FALSE;
+}
+
+static gboolean
+_omemo_devicelist_cache_open(void)
+{
+    if (devicelist_cache) {
+        return TRUE;
+    }
+
+    char* barejid = connection_get_barejid();
+    if (!barejid) {
+        return FALSE;
+    }
+    gchar* omemo_dir = files_get_account_data_path(DIR_OMEMO, barejid);
+    devicelist_cache_loc = g_strdup_printf("%s/devicelists.txt", omemo_dir);
+    g_free(omemo_dir);
+    free(barejid);
+
+    devicelist_cache = g_key_file_new();
+    g_key_file_load_from_file(devicelist_cache, devicelist_cache_loc, G_KEY_FILE_NONE, NULL);
+
+    return TRUE;
+}
+
+// Hand a recently fetched device list to the OMEMO module as if it had just
+// been received. FALSE when it has to be fetched.
+static gboolean
+_omemo_devicelist_cache_load(const char* const jid)
+{
+    if (!_omemo_devicelist_cache_open() || !g_key_file_has_group(devicelist_cache, jid)) {
+        return FALSE;
+    }
+
+    gint64 fetched = g_key_file_get_int64(devicelist_cache, jid, "fetched", NULL);
+    if (g_get_real_time() / G_USEC_PER_SEC - fetched > OMEMO_DEVICELIST_TTL) {
+        return FALSE;
+    }
+
+    gsize len = 0;
+    gint* ids = g_key_file_get_integer_list(devicelist_cache, jid, "devices", &len, NULL);
+    GList* device_list = NULL;
+    for (gsize i = 0; i < len; i++) {
+        device_list = g_list_append(device_list, GINT_TO_POINTER(ids[i]));
+    }
+    g_free(ids);
+
+    log_debug("[OMEMO] using cached device list for jid: %s", jid);
+    omemo_set_device_list(jid, device_list);
+
+    return TRUE;
+}
+
+static void
+_omemo_devicelist_cache_store(const char* const jid, GList* device_list)
+{
+    if (!jid || !_omemo_devicelist_cache_open()) {
+        return;
+    }
+
+    guint len = g_list_length(device_list);
+    gint ids[len + 1];
+    guint i = 0;
+    for (GList* curr = device_list; curr; curr = g_list_next(curr)) {
+        ids[i++] = GPOINTER_TO_INT(curr->data);
+    }
+
+    Jid* bare = jid_create(jid);
+    if (!bare) {
+        return;
+    }
+    g_key_file_set_integer_list(devicelist_cache, bare->barejid, "devices", ids, len);
+    g_key_file_set_int64(devicelist_cache, bare->barejid, "fetched", g_get_real_time() / G_USEC_PER_SEC);
+    jid_destroy(bare);
+
+    if (devicelist_cache_task == NULL) {
+        devicelist_cache_task = scheduler_add(OMEMO_DEVICELIST_CACHE_SAVE_DELAY_MS, _omemo_devicelist_cache_save, NULL, NULL);
+    }
+}
@@ -35,12 +35,16 @@
 
 #include "config.h"
 
-#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
+#include <glib.h>
+
 #include "log.h"
 #include "ui/ui.h"
 #include "xmpp/connection.h"
+#include "xmpp/roster_list.h"
 #include "xmpp/stanza.h"
 #include "pgp/gpg.h"
 
@@ -48,11 +52,38 @@
 
 #define KEYID_LENGTH 40
 
+#define XMPP_URI_PREFIX "xmpp:"
+
+typedef enum {
+    OX_KEY_REQUESTED = 1,
+    OX_KEY_IMPORTED,
+    OX_KEY_FAILED
+} ox_key_status_t;
+
+// a metadata or key request, quiet ones are made without the user asking
+typedef struct
+{
+    char* jid;
+    char* fingerprint;
+    gboolean quiet;
+} OxRequest;
+
+// barejid -> fingerprint -> ox_key_status_t of the keys fetched since login
+static GHashTable* ox_key_status = NULL;
+
+static void _ox_discover_public_key(const char* const jid, gboolean quiet);
 static void _ox_metadata_node__public_key(const char* const fingerprint);
 static int _ox_metadata_result(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
+static void _ox_metadata_handle(xmpp_stanza_t* const stanza, OxRequest* request);
 
-static void _ox_request_public_key(const char* const jid, const char* const fingerprint);
+static void _ox_request_public_key(const char* const jid, const char* const fingerprint, gboolean quiet);
 static int _ox_public_key_result(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
+static gboolean _ox_public_key_handle(xmpp_stanza_t* const stanza, OxRequest* request);
+
+static OxRequest* _ox_request_new(const char* const jid, const char* const fingerprint, gboolean quiet);
+static void _ox_request_free(OxRequest* request);
+static ox_key_status_t _ox_key_status_get(const char* const jid, const char* const fingerprint);
+static void _ox_key_status_set(const char* const jid, const char* const fingerprint, ox_key_status_t status);
 
 /*!
  * \brief Current Date and Time.
@@ -167,10 +198,49 @@ ox_announce_public_key(const char* const filename)
 
 void
 ox_discover_public_key(const char* const jid)
+{
+    _ox_discover_public_key(jid, FALSE);
+}
+
+void
+ox_discover_roster_keys(void)
+{
+    if (ox_key_status) {
+        g_hash_table_remove_all(ox_key_status);
+    }
+
+    GHashTable* keys = ox_gpg_public_keys();
+    if (!keys) {
+        return;
+    }
+
+    // contacts we have a key for are the ones using OX, their metadata
+    // requests all go out together and only new fingerprints are fetched
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, keys);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        const char* uid = key;
+        if (!g_str_has_prefix(uid, XMPP_URI_PREFIX)) {
+            continue;
+        }
+        const char* jid = uid + strlen(XMPP_URI_PREFIX);
+        if (roster_contains_jid(jid)) {
+            _ox_discover_public_key(jid, TRUE);
+        }
+    }
+
+    g_hash_table_destroy(keys);
+}
+
+static void
+_ox_discover_public_key(const char* const jid, gboolean quiet)
 {
     assert(jid && strlen(jid) > 0);
     log_info("[OX] Discovering Public Key for %s", jid);
-    cons_show("Discovering Public Key for %s", jid);
+    if (!quiet) {
+        cons_show("Discovering Public Key for %s", jid);
+    }
     // iq
     xmpp_ctx_t* const ctx = connection_get_ctx();
     char* id = xmpp_uuid_gen(ctx);
@@ -189,7 +259,7 @@ ox_discover_public_key(const char* const jid)
     xmpp_stanza_add_child(pubsub, items);
     xmpp_stanza_add_child(iq, pubsub);
 
-    xmpp_id_handler_add(connection_get_conn(), _ox_metadata_result, id, strdup(jid));
+    xmpp_id_handler_add(connection_get_conn(), _ox_metadata_result, id, _ox_request_new(jid, NULL, quiet));
     xmpp_send(connection_get_conn(), iq);
     xmpp_stanza_release(iq);
 }
@@ -197,7 +267,7 @@ ox_discover_public_key(const char* const jid)
 void
 ox_request_public_key(const char* const jid, const char* const fingerprint)
 {
-    _ox_request_public_key(jid, fingerprint);
+    _ox_request_public_key(jid, fingerprint, FALSE);
 }
 
 /*!
@@ -270,51 +340,73 @@ _ox_metadata_node__public_key(const char* const fingerprint)
 static int
 _ox_metadata_result(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
 {
-    log_debug("[OX] Processing result %s's metadata.", (char*)userdata);
+    OxRequest* request = userdata;
+    _ox_metadata_handle(stanza, request);
+    _ox_request_free(request);
+
+    return FALSE;
+}
+
+static void
+_ox_metadata_handle(xmpp_stanza_t* const stanza, OxRequest* request)
+{
+    log_debug("[OX] Processing result %s's metadata.", request->jid);
 
     if (g_strcmp0(xmpp_stanza_get_type(stanza), "result") != 0) {
-        log_debug("[OX] Error: Unable to load metadata of user %s - Not a stanza result type", (char*)userdata);
-        return FALSE;
+        log_debug("[OX] Error: Unable to load metadata of user %s - Not a stanza result type", request->jid);
+        return;
     }
     // pubsub
     xmpp_stanza_t* pubsub = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_PUBSUB, XMPP_FEATURE_PUBSUB);
     if (!pubsub) {
-        cons_show("[OX] Error: No pubsub");
-        return FALSE;
+        if (!request->quiet) {
+            cons_show("[OX] Error: No pubsub");
+        }
+        return;
     }
 
     xmpp_stanza_t* items = xmpp_stanza_get_child_by_name(pubsub, STANZA_NAME_ITEMS);
     if (!items) {
-        cons_show("[OX] Error: No items");
-        return FALSE;
+        if (!request->quiet) {
+            cons_show("[OX] Error: No items");
+        }
+        return;
     }
 
     xmpp_stanza_t* item = xmpp_stanza_get_child_by_name(items, STANZA_NAME_ITEM);
     if (!item) {
-        cons_show("[OX] Error: No item");
-        return FALSE;
+        if (!request->quiet) {
+            cons_show("[OX] Error: No item");
+        }
+        return;
     }
 
     xmpp_stanza_t* publickeyslist = xmpp_stanza_get_child_by_name_and_ns(item, STANZA_NAME_PUBLIC_KEYS_LIST, STANZA_NS_OPENPGP_0);
     if (!publickeyslist) {
-        cons_show("[OX] Error: No publickeyslist");
-        return FALSE;
+        if (!request->quiet) {
+            cons_show("[OX] Error: No publickeyslist");
+        }
+        return;
     }
 
     xmpp_stanza_t* pubkeymetadata = xmpp_stanza_get_children(publickeyslist);
 
     while (pubkeymetadata) {
         const char* fingerprint = xmpp_stanza_get_attribute(pubkeymetadata, STANZA_ATTR_V4_FINGERPRINT);
-        if (strlen(fingerprint) == KEYID_LENGTH) {
-            cons_show(fingerprint);
+        if (fingerprint && strlen(fingerprint) == KEYID_LENGTH) {
+            if (!request->quiet) {
+                cons_show(fingerprint);
+            } else if (_ox_key_status_get(request->jid, fingerprint) == 0 && !p_ox_gpg_has_key(fingerprint)) {
+                _ox_request_public_key(request->jid, fingerprint, TRUE);
+            }
         } else {
-            cons_show("OX: Wrong char size of public key");
+            if (!request->quiet) {
+                cons_show("OX: Wrong char size of public key");
+            }
             log_error("[OX] Wrong chat size of public key %s", fingerprint);
         }
         pubkeymetadata = xmpp_stanza_get_next(pubkeymetadata);
     }
-
-    return FALSE;
 }
 
 /*!
@@ -334,14 +426,17 @@ _ox_metadata_result(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void*
  * </pre>
  */
 
-void
-_ox_request_public_key(const char* const jid, const char* const fingerprint)
+static void
+_ox_request_public_key(const char* const jid, const char* const fingerprint, gboolean quiet)
 {
     assert(jid);
     assert(fingerprint);
     assert(strlen(fingerprint) == KEYID_LENGTH);
-    cons_show("Requesting Public Key %s for %s", fingerprint, jid);
+    if (!quiet) {
+        cons_show("Requesting Public Key %s for %s", fingerprint, jid);
+    }
     log_info("[OX] Request %s's public key %s.", jid, fingerprint);
+    _ox_key_status_set(jid, fingerprint, OX_KEY_REQUESTED);
     // iq
     xmpp_ctx_t* const ctx = connection_get_ctx();
     char* id = xmpp_uuid_gen(ctx);
@@ -365,7 +460,7 @@ _ox_request_public_key(const char* const jid, const char* const fingerprint)
     xmpp_stanza_add_child(pubsub, items);
     xmpp_stanza_add_child(iq, pubsub);
 
-    xmpp_id_handler_add(connection_get_conn(), _ox_public_key_result, id, NULL);
+    xmpp_id_handler_add(connection_get_conn(), _ox_public_key_result, id, _ox_request_new(jid, fingerprint, quiet));
 
     xmpp_send(connection_get_conn(), iq);
 }
@@ -394,41 +489,58 @@ _ox_request_public_key(const char* const jid, const char* const fingerprint)
  * </pre>
  */
 
-int
+static int
 _ox_public_key_result(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
+{
+    OxRequest* request = userdata;
+    gboolean imported = _ox_public_key_handle(stanza, request);
+    _ox_key_status_set(request->jid, request->fingerprint, imported ? OX_KEY_IMPORTED : OX_KEY_FAILED);
+
+    if (!request->quiet) {
+        if (imported) {
+            cons_show("Public Key imported");
+        } else {
+            cons_show("Public Key import failed. Check log for details.");
+        }
+    } else if (imported) {
+        log_info("[OX] Imported %s's public key %s.", request->jid, request->fingerprint);
+    }
+
+    _ox_request_free(request);
+
+    return FALSE;
+}
+
+static gboolean
+_ox_public_key_handle(xmpp_stanza_t* const stanza, OxRequest* request)
 {
     log_debug("[OX] Processing result public key");
 
     if (g_strcmp0(xmpp_stanza_get_type(stanza), "result") != 0) {
-        cons_show("Public Key import failed. Check log for details.");
         log_error("[OX] Public Key response type is wrong");
         return FALSE;
     }
     // pubsub
     xmpp_stanza_t* pubsub = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_PUBSUB, XMPP_FEATURE_PUBSUB);
     if (!pubsub) {
-        cons_show("Public Key import failed. Check log for details.");
         log_error("[OX] Public key request response failed: No <pubsub/>");
         return FALSE;
     }
 
     xmpp_stanza_t* items = xmpp_stanza_get_child_by_name(pubsub, STANZA_NAME_ITEMS);
     if (!items) {
-        cons_show("Public Key import failed. Check log for details.");
         log_error("[OX] Public key request response failed: No <items/>");
         return FALSE;
     }
 
     xmpp_stanza_t* item = xmpp_stanza_get_child_by_name(items, STANZA_NAME_ITEM);
     if (!item) {
-        cons_show("Public Key import failed. Check log for details.");
         log_error("[OX] Public key request response failed: No <item/>");
         return FALSE;
     }
 
     xmpp_stanza_t* pubkey = xmpp_stanza_get_child_by_name_and_ns(item, STANZA_NAME_PUPKEY, STANZA_NS_OPENPGP_0);
     if (!pubkey) {
-        cons_show("Public Key import failed. Check log for details.");
         log_error("[OX] Public key request response failed: No <pubkey/>");
         return FALSE;
     }
@@ -436,22 +548,72 @@ _ox_public_key_result(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void
     xmpp_stanza_t* data = xmpp_stanza_get_child_by_name(pubkey, STANZA_NAME_DATA);
     if (!data) {
         log_error("[OX] No data");
+        return FALSE;
     }
 
     char* base64_data = xmpp_stanza_get_text(data);
-    if (base64_data) {
-        log_debug("Key data: %s", base64_data);
+    if (!base64_data) {
+        return FALSE;
+    }
 
-        if (p_ox_gpg_import(base64_data)) {
-            cons_show("Public Key imported");
-        } else {
-            cons_show("Public Key import failed. Check log for details.");
-        }
+    log_debug("Key data: %s", base64_data);
+    gboolean imported = p_ox_gpg_import(base64_data);
+    free(base64_data);
 
-        free(base64_data);
+    return imported;
+}
+
+static OxRequest*
+_ox_request_new(const char* const jid, const char* const fingerprint, gboolean quiet)
+{
+    OxRequest* request = malloc(sizeof(OxRequest));
+    request->jid = strdup(jid);
+    request->fingerprint = fingerprint ? strdup(fingerprint) : NULL;
+    request->quiet = quiet;
+
+    return request;
+}
+
+static void
+_ox_request_free(OxRequest* request)
+{
+    if (request) {
+        free(request->jid);
+        free(request->fingerprint);
+        free(request);
     }
+}
 
-    return FALSE;
+// 0 for a key not fetched since login
+static ox_key_status_t
+_ox_key_status_get(const char* const jid, const char* const fingerprint)
+{
+    if (!ox_key_status) {
+        return 0;
+    }
+
+    GHashTable* fingerprints = g_hash_table_lookup(ox_key_status, jid);
+    if (!fingerprints) {
+        return 0;
+    }
+
+    return GPOINTER_TO_INT(g_hash_table_lookup(fingerprints, fingerprint));
+}
+
+static void
+_ox_key_status_set(const char* const jid, const char* const fingerprint, ox_key_status_t status)
+{
+    if (!ox_key_status) {
+        ox_key_status = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)g_hash_table_destroy);
+    }
+
+    GHashTable* fingerprints = g_hash_table_lookup(ox_key_status, jid);
+    if (!fingerprints) {
+        fingerprints = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+        g_hash_table_insert(ox_key_status, strdup(jid), fingerprints);
+    }
+
+    g_hash_table_replace(fingerprints, strdup(fingerprint), GINT_TO_POINTER(status));
 }
 
 // Date and Time (XEP-0082)
@@ -68,3 +68,12 @@ gboolean ox_announce_public_key(const char* const filename);
 void ox_discover_public_key(const char* const jid);
 
 void ox_request_public_key(const char* const jid, const char* const fingerprint);
+
+/*!
+ * \brief Refreshing the Public Keys of the Roster.
+ *
+ * Reads the metadata of every roster contact with a public key in the
+ * keyring and fetches the keys whose fingerprint is not in it yet.
+ */
+
+void ox_discover_roster_keys(void);
@@ -47,21 +47,46 @@
 #include "profanity.h"
 #include "log.h"
 #include "common.h"
+#include "database.h"
 #include "config/preferences.h"
 #include "event/server_events.h"
 #include "plugins/plugins.h"
+#include "tools/perf.h"
+#include "tools/ratelimit.h"
+#include "tools/scheduler.h"
 #include "ui/ui.h"
 #include "xmpp/connection.h"
 #include "xmpp/capabilities.h"
 #include "xmpp/session.h"
 #include "xmpp/stanza.h"
 #include "xmpp/iq.h"
+#include "xmpp/recorder.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/muc.h"
 
+// authorization requests allowed per sender domain at once, and per minute after that
+#define PRESENCE_SUB_BURST      10
+#define PRESENCE_SUB_PER_MINUTE 20
+
+// a status change reaches the rooms a few at a time, starting after the
+// delay so that changes in quick succession only send the last one
+#define PRESENCE_ROOM_DELAY_MS    250
+#define PRESENCE_ROOM_INTERVAL_MS 100
+#define PRESENCE_ROOM_BATCH       5
+
 static Autocomplete sub_requests_ac;
+static RateLimit* sub_limit = NULL;
+
+// the presence the rooms in room_presence_pending still wait for
+static xmpp_stanza_t* room_presence = NULL;
+static gchar* room_presence_key = NULL;
+static GQueue room_presence_pending = G_QUEUE_INIT;
+// room jid to the key of the presence it got last
+static GHashTable* room_presence_sent = NULL;
+static SchedulerTask* room_presence_task = NULL;
 
 static int _presence_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
+static int _presence_handle(xmpp_stanza_t* const stanza);
 
 static void _presence_error_handler(xmpp_stanza_t* const stanza);
 static void _unavailable_handler(xmpp_stanza_t* const stanza);
@@ -72,13 +97,24 @@ static void _muc_user_handler(xmpp_stanza_t* const stanza);
 static void _available_handler(xmpp_stanza_t* const stanza);
 
 void _send_caps_request(char* node, char* caps_key, char* id, char* from);
-static void _send_room_presence(xmpp_stanza_t* presence);
+static void _send_room_presence(xmpp_stanza_t* presence, const char* const key);
+static gboolean _room_presence_due(void* data);
 static void _send_presence_stanza(xmpp_stanza_t* const stanza);
 
+static void
+_subscribe_flood_report(const char* const domain, guint dropped)
+{
+    log_info("Ignored %u authorization requests from %s", dropped, domain);
+    cons_show("Ignored %u authorization requests from %s, too many at once.", dropped, domain);
+}
+
 void
 presence_sub_requests_init(void)
 {
     sub_requests_ac = autocomplete_new();
+    if (sub_limit == NULL) {
+        sub_limit = ratelimit_new("subscribe", PRESENCE_SUB_BURST, PRESENCE_SUB_PER_MINUTE, _subscribe_flood_report);
+    }
 }
 
 void
@@ -89,6 +125,12 @@ presence_handlers_init(void)
     xmpp_handler_add(conn, _presence_handler, NULL, STANZA_NAME_PRESENCE, NULL, ctx);
 }
 
+void
+presence_replay(xmpp_stanza_t* const stanza)
+{
+    _presence_handler(connection_get_conn(), stanza, connection_get_ctx());
+}
+
 void
 presence_subscription(const char* const jid, const jabber_subscr_t action)
 {
@@ -205,10 +247,6 @@ presence_send(const resource_presence_t presence_type, const int idle, char* sig
     xmpp_ctx_t* const ctx = connection_get_ctx();
     xmpp_stanza_t* presence = xmpp_presence_new(ctx);
 
-    char* id = connection_create_stanza_id();
-    xmpp_stanza_set_id(presence, id);
-    free(id);
-
     const char* show = stanza_get_presence_string_from_type(presence_type);
     stanza_attach_show(ctx, presence, show);
 
@@ -230,15 +268,25 @@ presence_send(const resource_presence_t presence_type, const int idle, char* sig
     }
 
     stanza_attach_priority(ctx, presence, pri);
+    stanza_attach_caps(ctx, presence);
+
+    // rooms which got the same presence before are not sent it again, the
+    // idle time alone does not make a difference
+    char* key = NULL;
+    size_t key_size;
+    xmpp_stanza_to_text(presence, &key, &key_size);
 
     if (idle > 0) {
         stanza_attach_last_activity(ctx, presence, idle);
     }
 
-    stanza_attach_caps(ctx, presence);
+    char* id = connection_create_stanza_id();
+    xmpp_stanza_set_id(presence, id);
+    free(id);
 
     _send_presence_stanza(presence);
-    _send_room_presence(presence);
+    _send_room_presence(presence, key);
+    xmpp_free(ctx, key);
 
     xmpp_stanza_release(presence);
 
@@ -253,27 +301,97 @@ presence_send(const resource_presence_t presence_type, const int idle, char* sig
     accounts_set_last_status(account, msg);
 }
 
+// Queues presence for the joined rooms, replacing what rooms still
+// waiting for an earlier one would have got
 static void
-_send_room_presence(xmpp_stanza_t* presence)
+_send_room_presence(xmpp_stanza_t* presence, const char* const key)
 {
+    if (room_presence) {
+        xmpp_stanza_release(room_presence);
+    }
+    room_presence = xmpp_stanza_copy(presence);
+    g_free(room_presence_key);
+    room_presence_key = g_strdup(key);
+
+    if (!room_presence_sent) {
+        room_presence_sent = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+
+    char* room;
+    while ((room = g_queue_pop_head(&room_presence_pending)) != NULL) {
+        g_free(room);
+    }
+
     GList* rooms = muc_rooms();
-    GList* curr = rooms;
-    while (curr) {
-        const char* room = curr->data;
-        const char* nick = muc_nick(room);
+    for (GList* curr = rooms; curr; curr = g_list_next(curr)) {
+        if (g_strcmp0(g_hash_table_lookup(room_presence_sent, curr->data), key) != 0) {
+            g_queue_push_tail(&room_presence_pending, g_strdup(curr->data));
+        }
+    }
+    g_list_free(rooms);
 
-        if (nick) {
-            char* full_room_jid = create_fulljid(room, nick);
-            xmpp_stanza_set_to(presence, full_room_jid);
-            log_debug("Sending presence to room: %s", full_room_jid);
-            free(full_room_jid);
+    if (!g_queue_is_empty(&room_presence_pending) && !room_presence_task) {
+        room_presence_task = scheduler_add(PRESENCE_ROOM_DELAY_MS, _room_presence_due, NULL, NULL);
+    }
+}
+
+static gboolean
+_room_presence_due(void* data)
+{
+    // a lost connection may be resumed, a disconnect clears the queue
+    if (connection_get_status() != JABBER_CONNECTED) {
+        return TRUE;
+    }
 
-            _send_presence_stanza(presence);
+    int sent = 0;
+    char* room;
+    while (sent < PRESENCE_ROOM_BATCH && (room = g_queue_pop_head(&room_presence_pending)) != NULL) {
+        // the room may have been left in the meantime
+        const char* nick = muc_nick(room);
+        if (!nick) {
+            g_free(room);
+            continue;
         }
 
-        curr = g_list_next(curr);
+        char* full_room_jid = create_fulljid(room, nick);
+        xmpp_stanza_set_to(room_presence, full_room_jid);
+        log_debug("Sending presence to room: %s", full_room_jid);
+        free(full_room_jid);
+
+        _send_presence_stanza(room_presence);
+        g_hash_table_replace(room_presence_sent, room, g_strdup(room_presence_key));
+        sent++;
     }
-    g_list_free(rooms);
+
+    if (g_queue_is_empty(&room_presence_pending)) {
+        room_presence_task = NULL;
+        return FALSE;
+    }
+
+    scheduler_set_interval(room_presence_task, PRESENCE_ROOM_INTERVAL_MS);
+    return TRUE;
+}
+
+void
+presence_clear_room_presence(void)
+{
+    scheduler_remove(room_presence_task);
+    room_presence_task = NULL;
+
+    char* room;
+    while ((room = g_queue_pop_head(&room_presence_pending)) != NULL) {
+        g_free(room);
+    }
+    if (room_presence_sent) {
+        g_hash_table_destroy(room_presence_sent);
+        room_presence_sent = NULL;
+    }
+    if (room_presence) {
+        xmpp_stanza_release(room_presence);
+        room_presence = NULL;
+    }
+    g_free(room_presence_key);
+    room_presence_key = NULL;
 }
 
 void
@@ -281,6 +399,13 @@ presence_join_room(const char* const room, const char* const nick, const char* c
 {
     Jid* jid = jid_create_from_bare_and_resource(room, nick);
     log_debug("Sending room join presence to: %s", jid->fulljid);
+    recorder_joined(room, nick);
+
+    // the join carries the current presence, which the room gets again on
+    // the next change
+    if (room_presence_sent) {
+        g_hash_table_remove(room_presence_sent, room);
+    }
 
     resource_presence_t presence_type = accounts_get_last_presence(session_get_account_name());
     const char* show = stanza_get_presence_string_from_type(presence_type);
@@ -289,6 +414,19 @@ presence_join_room(const char* const room, const char* const nick, const char* c
 
     xmpp_ctx_t* ctx = connection_get_ctx();
     xmpp_stanza_t* presence = stanza_create_room_join_presence(ctx, jid->fulljid, passwd);
+
+    // a rejoin only transfers what was missed since the newest message
+    // stored for the room, the first join gets the room's default history
+    GDateTime* last = log_database_get_last_muc(room);
+    if (last) {
+        GDateTime* last_utc = g_date_time_to_utc(last);
+        gchar* since = g_date_time_format(last_utc, "%Y-%m-%dT%H:%M:%SZ");
+        stanza_attach_room_history_since(ctx, presence, since);
+        g_free(since);
+        g_date_time_unref(last_utc);
+        g_date_time_unref(last);
+    }
+
     stanza_attach_show(ctx, presence, show);
     stanza_attach_status(ctx, presence, status);
     stanza_attach_priority(ctx, presence, pri);
@@ -349,17 +487,29 @@ presence_leave_chat_room(const char* const room_jid)
 
 static int
 _presence_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
+{
+    gint64 started = perf_start();
+    int res = _presence_handle(stanza);
+    perf_stop_named(PERF_PRESENCE, started, NULL, xmpp_stanza_get_from(stanza));
+
+    return res;
+}
+
+static int
+_presence_handle(xmpp_stanza_t* const stanza)
 {
     log_debug("Presence stanza handler fired");
 
-    char* text = NULL;
-    size_t text_size;
-    xmpp_stanza_to_text(stanza, &text, &text_size);
+    if (plugins_hook_in_use(PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE)) {
+        char* text = NULL;
+        size_t text_size;
+        xmpp_stanza_to_text(stanza, &text, &text_size);
 
-    gboolean cont = plugins_on_presence_stanza_receive(text);
-    xmpp_free(connection_get_ctx(), text);
-    if (!cont) {
-        return 1;
+        gboolean cont = plugins_on_presence_stanza_receive(text);
+        xmpp_free(connection_get_ctx(), text);
+        if (!cont) {
+            return 1;
+        }
     }
 
     const char* type = xmpp_stanza_get_type(stanza);
@@ -423,6 +573,7 @@ _presence_error_handler(xmpp_stanza_t* const stanza)
             muc_leave(fulljid->barejid);
         }
         cons_show_error("Error joining room %s, reason: %s", fulljid->barejid, error_cond);
+        sv_ev_room_join_error(fulljid->barejid);
         jid_destroy(fulljid);
 
         return;
@@ -514,6 +665,18 @@ _subscribe_handler(xmpp_stanza_t* const stanza)
         return;
     }
 
+    // spam waves send thousands of requests from throwaway accounts on a few domains
+    if (sub_limit) {
+        char buf[256];
+        char* alloced;
+        gboolean allowed = ratelimit_allow(sub_limit, jid_fold(from_jid->domainpart, buf, sizeof(buf), &alloced));
+        g_free(alloced);
+        if (!allowed) {
+            jid_destroy(from_jid);
+            return;
+        }
+    }
+
     sv_ev_subscription(from_jid->barejid, PRESENCE_SUBSCRIBE);
     autocomplete_add(sub_requests_ac, from_jid->barejid);
 
@@ -533,8 +696,8 @@ _unavailable_handler(xmpp_stanza_t* const stanza)
     }
     log_debug("Unavailable presence handler fired for %s", from);
 
-    Jid* my_jid = jid_create(jid);
-    Jid* from_jid = jid_create(from);
+    Jid* my_jid = jid_intern(jid);
+    Jid* from_jid = jid_intern(from);
     if (my_jid == NULL || from_jid == NULL) {
         jid_destroy(my_jid);
         jid_destroy(from_jid);
@@ -564,6 +727,9 @@ _unavailable_handler(xmpp_stanza_t* const stanza)
 static void
 _handle_caps(const char* const jid, XMPPCaps* caps)
 {
+    // the low bandwidth profile only uses what the cache already has
+    gboolean disco = !prefs_get_boolean(PREF_LOW_BANDWIDTH);
+
     // hash supported, xep-0115, cache against ver
     if (g_strcmp0(caps->hash, "sha-1") == 0) {
         log_debug("Hash %s supported for %s", caps->hash, jid);
@@ -571,7 +737,7 @@ _handle_caps(const char* const jid, XMPPCaps* caps)
             if (caps_cache_contains(caps->ver)) {
                 log_debug("Capabilities cache hit: %s, for %s.", caps->ver, jid);
                 caps_map_jid_to_ver(jid, caps->ver);
-            } else {
+            } else if (disco) {
                 log_debug("Capabilities cache miss: %s, for %s, sending service discovery request", caps->ver, jid);
                 char* id = connection_create_stanza_id();
                 iq_send_caps_request(jid, id, caps->node, caps->ver);
@@ -580,6 +746,8 @@ _handle_caps(const char* const jid, XMPPCaps* caps)
         }
 
         // unsupported hash, xep-0115, associate with JID, no cache
+    } else if (!disco) {
+        log_debug("Low bandwidth, no service discovery request for %s", jid);
     } else if (caps->hash) {
         log_info("Hash %s not supported: %s, sending service discovery request", caps->hash, jid);
         char* id = connection_create_stanza_id();
@@ -698,7 +866,7 @@ static void
 _muc_user_self_handler(xmpp_stanza_t* stanza)
 {
     const char* from = xmpp_stanza_get_from(stanza);
-    Jid* from_jid = jid_create(from);
+    Jid* from_jid = jid_intern(from);
 
     log_debug("Room self presence received from %s", from_jid->fulljid);
 
@@ -782,7 +950,7 @@ static void
 _muc_user_occupant_handler(xmpp_stanza_t* stanza)
 {
     const char* from = xmpp_stanza_get_from(stanza);
-    Jid* from_jid = jid_create(from);
+    Jid* from_jid = jid_intern(from);
 
     log_debug("Room presence received from %s", from_jid->fulljid);
 
@@ -879,7 +1047,7 @@ _muc_user_handler(xmpp_stanza_t* const stanza)
         return;
     }
 
-    Jid* from_jid = jid_create(from);
+    Jid* from_jid = jid_intern(from);
     if (from_jid == NULL || from_jid->resourcepart == NULL) {
         log_warning("MUC User stanza received with invalid from attribute: %s", from);
         jid_destroy(from_jid);
@@ -897,11 +1065,17 @@ _muc_user_handler(xmpp_stanza_t* const stanza)
 static void
 _send_presence_stanza(xmpp_stanza_t* const stanza)
 {
+    xmpp_conn_t* conn = connection_get_conn();
+    if (!plugins_hook_in_use(PLUGIN_HOOK_ON_PRESENCE_STANZA_SEND)) {
+        xmpp_send(conn, stanza);
+        connection_stanza_queued();
+        return;
+    }
+
     char* text;
     size_t text_size;
     xmpp_stanza_to_text(stanza, &text, &text_size);
 
-    xmpp_conn_t* conn = connection_get_conn();
     char* plugin_text = plugins_on_presence_stanza_send(text);
     if (plugin_text) {
         xmpp_send_raw_string(conn, "%s", plugin_text);
@@ -909,5 +1083,6 @@ _send_presence_stanza(xmpp_stanza_t* const stanza)
     } else {
         xmpp_send_raw_string(conn, "%s", text);
     }
+    connection_stanza_queued();
     xmpp_free(connection_get_ctx(), text);
 }
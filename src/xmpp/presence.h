@@ -36,8 +36,13 @@
 #ifndef XMPP_PRESENCE_H
 #define XMPP_PRESENCE_H
 
+#include "xmpp/xmpp.h"
+
 void presence_handlers_init(void);
 void presence_sub_requests_init(void);
 void presence_clear_sub_requests(void);
+void presence_clear_room_presence(void);
+// Handle stanza as if it was received, for replaying a recording
+void presence_replay(xmpp_stanza_t* const stanza);
 
 #endif
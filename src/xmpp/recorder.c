@@ -0,0 +1,299 @@
+/*
+ * recorder.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2012 - 2019 James Booth <boothj5@gmail.com>
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <strophe.h>
+
+#include "log.h"
+#include "xmpp/connection.h"
+#include "xmpp/recorder.h"
+#include "xmpp/stanza.h"
+
+// A recording starts with a header, then each line is the microseconds
+// since the start, a kind and its data:
+//
+//   # profanity stanza recording
+//   0 jid me@example.org/laptop
+//   1200 join room@conference.example.org me
+//   5310 recv <message from='...'>...</message>
+//
+// Line breaks in the XML are written as character references.
+
+#define RECORDER_HEADER "# profanity stanza recording\n"
+
+static FILE* record_file = NULL;
+static char* record_path = NULL;
+static gint64 record_started = 0;
+static guint64 record_stanzas = 0;
+static gboolean record_jid_written = FALSE;
+// made up parts by the real ones, only while anonymizing
+static GHashTable* record_names = NULL;
+
+static const char*
+_recorder_name(GHashTable* names, const char* const kind, const char* const part, gsize len)
+{
+    gchar* key = g_strdup_printf("%s:%.*s", kind, (int)len, part);
+    const char* name = g_hash_table_lookup(names, key);
+    if (name) {
+        g_free(key);
+        return name;
+    }
+
+    char* made_up = g_strdup_printf(g_strcmp0(kind, "domain") == 0 ? "%s%u.example" : "%s%u",
+                                    kind, g_hash_table_size(names) + 1);
+    g_hash_table_insert(names, key, made_up);
+
+    return made_up;
+}
+
+static void
+_recorder_line(const char* const kind, const char* const data)
+{
+    fprintf(record_file, "%" G_GINT64_FORMAT " %s ", g_get_monotonic_time() - record_started, kind);
+    for (const char* c = data; *c; c++) {
+        if (*c == '\n') {
+            fputs("&#10;", record_file);
+        } else if (*c == '\r') {
+            fputs("&#13;", record_file);
+        } else {
+            fputc(*c, record_file);
+        }
+    }
+    fputc('\n', record_file);
+}
+
+static void
+_recorder_jid_line(const char* const kind, const char* const jid, const char* const rest)
+{
+    char* anon = record_names ? recorder_anonymize_jid(record_names, jid) : g_strdup(jid);
+    if (rest) {
+        char* data = g_strdup_printf("%s %s", anon, rest);
+        _recorder_line(kind, data);
+        g_free(data);
+    } else {
+        _recorder_line(kind, anon);
+    }
+    g_free(anon);
+}
+
+// the JID is known once bound, which may be after the recording started
+static void
+_recorder_write_jid(void)
+{
+    const char* jid = connection_get_fulljid();
+    if (!record_jid_written && jid) {
+        _recorder_jid_line("jid", jid, NULL);
+        record_jid_written = TRUE;
+    }
+}
+
+static void
+_recorder_anonymize_attribute(xmpp_stanza_t* stanza, const char* const name, gboolean is_jid)
+{
+    const char* value = xmpp_stanza_get_attribute(stanza, name);
+    if (value) {
+        char* anon = is_jid ? recorder_anonymize_jid(record_names, value) : recorder_anonymize_text(value);
+        xmpp_stanza_set_attribute(stanza, name, anon);
+        g_free(anon);
+    }
+}
+
+static void
+_recorder_anonymize(xmpp_stanza_t* stanza)
+{
+    const char* jid_attributes[] = { STANZA_ATTR_FROM, STANZA_ATTR_TO, STANZA_ATTR_JID, "by" };
+    for (int i = 0; i < G_N_ELEMENTS(jid_attributes); i++) {
+        _recorder_anonymize_attribute(stanza, jid_attributes[i], TRUE);
+    }
+    _recorder_anonymize_attribute(stanza, STANZA_ATTR_NAME, FALSE);
+
+    // a room nick is the resource of the occupant's JID
+    const char* nick = xmpp_stanza_get_attribute(stanza, STANZA_ATTR_NICK);
+    if (nick) {
+        xmpp_stanza_set_attribute(stanza, STANZA_ATTR_NICK, _recorder_name(record_names, "res", nick, strlen(nick)));
+    }
+
+    const char* name = xmpp_stanza_get_name(stanza);
+    gboolean private_text = g_strcmp0(name, STANZA_NAME_BODY) == 0
+                            || g_strcmp0(name, STANZA_NAME_SUBJECT) == 0
+                            || g_strcmp0(name, STANZA_NAME_STATUS) == 0
+                            || g_strcmp0(name, STANZA_NAME_NICK) == 0;
+
+    for (xmpp_stanza_t* child = xmpp_stanza_get_children(stanza); child; child = xmpp_stanza_get_next(child)) {
+        if (!xmpp_stanza_is_text(child)) {
+            _recorder_anonymize(child);
+        } else if (private_text) {
+            char* anon = recorder_anonymize_text(xmpp_stanza_get_text_ptr(child));
+            xmpp_stanza_set_text(child, anon);
+            g_free(anon);
+        }
+    }
+}
+
+gboolean
+recorder_start(const char* const path, gboolean anonymize)
+{
+    if (record_file) {
+        return FALSE;
+    }
+
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        log_error("recorder: could not open %s", path);
+        return FALSE;
+    }
+
+    record_file = file;
+    record_path = g_strdup(path);
+    record_started = g_get_monotonic_time();
+    record_stanzas = 0;
+    record_jid_written = FALSE;
+    if (anonymize) {
+        record_names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+    fputs(RECORDER_HEADER, record_file);
+    _recorder_write_jid();
+    log_info("recorder: recording stanzas to %s", path);
+
+    return TRUE;
+}
+
+guint64
+recorder_stop(void)
+{
+    if (!record_file) {
+        return 0;
+    }
+
+    fclose(record_file);
+    log_info("recorder: wrote %" G_GUINT64_FORMAT " stanzas to %s", record_stanzas, record_path);
+    record_file = NULL;
+    g_free(record_path);
+    record_path = NULL;
+    if (record_names) {
+        g_hash_table_destroy(record_names);
+        record_names = NULL;
+    }
+
+    return record_stanzas;
+}
+
+const char*
+recorder_path(void)
+{
+    return record_path;
+}
+
+void
+recorder_received(const char* const xml)
+{
+    if (!record_file) {
+        return;
+    }
+    if (!g_str_has_prefix(xml, "<message") && !g_str_has_prefix(xml, "<presence") && !g_str_has_prefix(xml, "<iq")) {
+        return;
+    }
+
+    _recorder_write_jid();
+    if (record_names) {
+        xmpp_stanza_t* stanza = xmpp_stanza_new_from_string(connection_get_ctx(), xml);
+        if (!stanza) {
+            return;
+        }
+        _recorder_anonymize(stanza);
+        char* text = NULL;
+        size_t text_size = 0;
+        if (xmpp_stanza_to_text(stanza, &text, &text_size) == XMPP_EOK) {
+            _recorder_line("recv", text);
+            xmpp_free(connection_get_ctx(), text);
+        }
+        xmpp_stanza_release(stanza);
+    } else {
+        _recorder_line("recv", xml);
+    }
+    record_stanzas++;
+}
+
+void
+recorder_joined(const char* const room, const char* const nick)
+{
+    if (!record_file) {
+        return;
+    }
+
+    _recorder_write_jid();
+    _recorder_jid_line("join", room, record_names ? _recorder_name(record_names, "res", nick, strlen(nick)) : nick);
+}
+
+char*
+recorder_anonymize_jid(GHashTable* names, const char* const jid)
+{
+    const char* slash = strchr(jid, '/');
+    gsize bare_len = slash ? (gsize)(slash - jid) : strlen(jid);
+    const char* at = memchr(jid, '@', bare_len);
+
+    GString* anon = g_string_new("");
+    const char* domain = jid;
+    if (at) {
+        g_string_append(anon, _recorder_name(names, "user", jid, at - jid));
+        g_string_append_c(anon, '@');
+        domain = at + 1;
+    }
+    g_string_append(anon, _recorder_name(names, "domain", domain, jid + bare_len - domain));
+    if (slash) {
+        g_string_append_c(anon, '/');
+        g_string_append(anon, _recorder_name(names, "res", slash + 1, strlen(slash + 1)));
+    }
+
+    return g_string_free(anon, FALSE);
+}
+
+char*
+recorder_anonymize_text(const char* const text)
+{
+    GString* anon = g_string_new("");
+    for (const char* c = text; *c; c = g_utf8_next_char(c)) {
+        g_string_append_c(anon, g_ascii_isspace(*c) ? *c : 'x');
+    }
+
+    return g_string_free(anon, FALSE);
+}
@@ -0,0 +1,57 @@
+/*
+ * recorder.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2012 - 2019 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef XMPP_RECORDER_H
+#define XMPP_RECORDER_H
+
+#include <glib.h>
+
+// Write every stanza received to path with the time it arrived, one line
+// each, for the replay benchmark. With anonymize the addresses are replaced
+// by stable made up ones and message text by as many x's.
+gboolean recorder_start(const char* const path, gboolean anonymize);
+// Returns the number of stanzas written
+guint64 recorder_stop(void);
+const char* recorder_path(void);
+
+void recorder_received(const char* const xml);
+void recorder_joined(const char* const room, const char* const nick);
+
+// names keeps the made up parts, so a JID always gets the same one
+char* recorder_anonymize_jid(GHashTable* names, const char* const jid);
+char* recorder_anonymize_text(const char* const text);
+
+#endif
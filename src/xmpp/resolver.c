@@ -0,0 +1,560 @@
+/*
+ * resolver.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "log.h"
+#include "tools/scheduler.h"
+#include "xmpp/resolver.h"
+
+#define RESOLVER_POLL_MS         20
+#define RESOLVER_CACHE_TTL_S     300
+#define RESOLVER_CLIENT_PORT     5222
+#define RESOLVER_DIRECT_TLS_PORT 5223
+
+// happy eyeballs (RFC 8305): attempts start staggered, the first to connect wins
+#define RESOLVER_RACE_MAX        6
+#define RESOLVER_RACE_STAGGER_MS 250
+#define RESOLVER_RACE_TIMEOUT_MS 5000
+#define RESOLVER_RACE_WAKEUP_MS  100
+
+typedef struct resolver_job_t
+{
+    char* key;
+    char* domain;
+    char* host;
+    int port;
+    gboolean direct_tls;
+    resolver_cb callback;
+    void* userdata;
+    GCancellable* cancellable;
+    pthread_t worker;
+    gboolean joinable;
+    gboolean done;
+    GList* addresses;
+    gboolean raced;
+} ResolverJob;
+
+typedef struct resolver_entry_t
+{
+    GList* addresses;
+    gint64 expires;
+} ResolverEntry;
+
+typedef struct resolver_query_t
+{
+    int* outstanding;
+    GList* results;
+} ResolverQuery;
+
+// lookups run on a worker thread, the main thread polls for the result and
+// is the only one to touch the cache
+static pthread_mutex_t resolver_lock = PTHREAD_MUTEX_INITIALIZER;
+static ResolverJob* resolver_job = NULL;
+static GList* resolver_jobs_cancelled = NULL;
+static SchedulerTask* resolver_task = NULL;
+static GHashTable* resolver_cache = NULL;
+
+static gboolean _resolver_check(void* data);
+
+static ResolvedAddress*
+_resolver_address_new(const char* const host, int port)
+{
+    ResolvedAddress* address = malloc(sizeof(ResolvedAddress));
+    address->host = strdup(host);
+    address->port = port;
+
+    return address;
+}
+
+static void
+_resolver_address_free(ResolvedAddress* address)
+{
+    if (address) {
+        free(address->host);
+        free(address);
+    }
+}
+
+void
+resolver_addresses_free(GList* addresses)
+{
+    g_list_free_full(addresses, (GDestroyNotify)_resolver_address_free);
+}
+
+static GList*
+_resolver_addresses_copy(GList* addresses)
+{
+    GList* copy = NULL;
+    for (GList* curr = addresses; curr; curr = g_list_next(curr)) {
+        ResolvedAddress* address = curr->data;
+        copy = g_list_prepend(copy, _resolver_address_new(address->host, address->port));
+    }
+
+    return g_list_reverse(copy);
+}
+
+static void
+_resolver_entry_free(ResolverEntry* entry)
+{
+    resolver_addresses_free(entry->addresses);
+    free(entry);
+}
+
+static void
+_resolver_job_free(ResolverJob* job)
+{
+    free(job->key);
+    free(job->domain);
+    free(job->host);
+    g_object_unref(job->cancellable);
+    resolver_addresses_free(job->addresses);
+    free(job);
+}
+
+static gchar*
+_resolver_key(const char* const domain, const char* const host, int port, gboolean direct_tls)
+{
+    if (host) {
+        return g_strdup_printf("host:%s:%d:%d", host, port, direct_tls);
+    }
+
+    return g_strdup_printf("srv:%s:%d:%d", domain, port, direct_tls);
+}
+
+static void
+_resolver_name_done(GObject* source, GAsyncResult* result, gpointer data)
+{
+    ResolverQuery* query = data;
+    query->results = g_resolver_lookup_by_name_finish(G_RESOLVER(source), result, NULL);
+    (*query->outstanding)--;
+}
+
+static void
+_resolver_service_done(GObject* source, GAsyncResult* result, gpointer data)
+{
+    ResolverQuery* query = data;
+    query->results = g_resolver_lookup_service_finish(G_RESOLVER(source), result, NULL);
+    (*query->outstanding)--;
+}
+
+static void
+_resolver_wait(GMainContext* context, int* outstanding)
+{
+    while (*outstanding > 0) {
+        g_main_context_iteration(context, TRUE);
+    }
+}
+
+// Alternates the address families starting with IPv6, so a broken family
+// costs one attempt rather than all of them
+static GList*
+_resolver_interleave(GList* addresses, GList* inet_addresses, int port)
+{
+    GList* v6 = NULL;
+    GList* v4 = NULL;
+    for (GList* curr = inet_addresses; curr; curr = g_list_next(curr)) {
+        if (g_inet_address_get_family(curr->data) == G_SOCKET_FAMILY_IPV6) {
+            v6 = g_list_append(v6, curr->data);
+        } else {
+            v4 = g_list_append(v4, curr->data);
+        }
+    }
+
+    GList* curr_v6 = v6;
+    GList* curr_v4 = v4;
+    while (curr_v6 || curr_v4) {
+        GList** family[] = { &curr_v6, &curr_v4 };
+        for (int i = 0; i < 2; i++) {
+            if (*family[i]) {
+                gchar* host = g_inet_address_to_string((*family[i])->data);
+                addresses = g_list_append(addresses, _resolver_address_new(host, port));
+                g_free(host);
+                *family[i] = g_list_next(*family[i]);
+            }
+        }
+    }
+    g_list_free(v6);
+    g_list_free(v4);
+
+    return addresses;
+}
+
+static int
+_resolver_connect_start(ResolvedAddress* address)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+    char port[8];
+    g_snprintf(port, sizeof(port), "%d", address->port);
+
+    struct addrinfo* info = NULL;
+    if (getaddrinfo(address->host, port, &hints, &info) != 0) {
+        return -1;
+    }
+
+    int fd = socket(info->ai_family, SOCK_STREAM, 0);
+    if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        if (connect(fd, info->ai_addr, info->ai_addrlen) != 0 && errno != EINPROGRESS) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(info);
+
+    return fd;
+}
+
+// libstrophe connects to a single host, so the race only decides which
+// address it gets first, the others stay behind it as fallbacks
+static void
+_resolver_race(ResolverJob* job)
+{
+    guint count = MIN(g_list_length(job->addresses), RESOLVER_RACE_MAX);
+    if (count < 2) {
+        return;
+    }
+
+    ResolvedAddress* racers[RESOLVER_RACE_MAX];
+    struct pollfd fds[RESOLVER_RACE_MAX];
+    guint started = 0;
+    guint failed = 0;
+    GList* next = job->addresses;
+    ResolvedAddress* winner = NULL;
+    gint64 now = g_get_monotonic_time();
+    gint64 deadline = now + RESOLVER_RACE_TIMEOUT_MS * 1000;
+    gint64 next_start = now;
+
+    while (!winner && failed < count && now < deadline && !g_cancellable_is_cancelled(job->cancellable)) {
+        if (started < count && now >= next_start) {
+            racers[started] = next->data;
+            fds[started].fd = _resolver_connect_start(next->data);
+            fds[started].events = POLLOUT;
+            fds[started].revents = 0;
+            if (fds[started].fd < 0) {
+                // a failed attempt does not hold up the next one
+                failed++;
+                next_start = now;
+            } else {
+                next_start = now + RESOLVER_RACE_STAGGER_MS * 1000;
+            }
+            started++;
+            next = g_list_next(next);
+            continue;
+        }
+
+        gint64 wait_until = started < count ? MIN(next_start, deadline) : deadline;
+        int timeout_ms = MIN(MAX((wait_until - now) / 1000, 0), RESOLVER_RACE_WAKEUP_MS);
+        if (poll(fds, started, timeout_ms) > 0) {
+            for (guint i = 0; i < started && !winner; i++) {
+                if (fds[i].fd < 0 || !fds[i].revents) {
+                    continue;
+                }
+                int error = 0;
+                socklen_t len = sizeof(error);
+                if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0) {
+                    winner = racers[i];
+                } else {
+                    close(fds[i].fd);
+                    fds[i].fd = -1;
+                    failed++;
+                    next_start = now;
+                }
+            }
+        }
+        now = g_get_monotonic_time();
+    }
+
+    for (guint i = 0; i < started; i++) {
+        if (fds[i].fd >= 0) {
+            close(fds[i].fd);
+        }
+    }
+
+    if (winner) {
+        job->addresses = g_list_remove(job->addresses, winner);
+        job->addresses = g_list_prepend(job->addresses, winner);
+        job->raced = TRUE;
+    }
+}
+
+static void
+_resolver_job_run(ResolverJob* job)
+{
+    GMainContext* context = g_main_context_new();
+    g_main_context_push_thread_default(context);
+    GResolver* resolver = g_resolver_get_default();
+    int outstanding = 0;
+    int port = job->port ? job->port : (job->direct_tls ? RESOLVER_DIRECT_TLS_PORT : RESOLVER_CLIENT_PORT);
+
+    if (job->host) {
+        ResolverQuery name = { &outstanding, NULL };
+        outstanding++;
+        g_resolver_lookup_by_name_async(resolver, job->host, job->cancellable, _resolver_name_done, &name);
+        _resolver_wait(context, &outstanding);
+        job->addresses = _resolver_interleave(job->addresses, name.results, port);
+        g_resolver_free_addresses(name.results);
+    } else {
+        // the records and the bare domain are asked for together, the
+        // domain is only used when there are no records
+        ResolverQuery srv = { &outstanding, NULL };
+        ResolverQuery name = { &outstanding, NULL };
+        outstanding += 2;
+        g_resolver_lookup_service_async(resolver, job->direct_tls ? "xmpps-client" : "xmpp-client", "tcp",
+                                        job->domain, job->cancellable, _resolver_service_done, &srv);
+        g_resolver_lookup_by_name_async(resolver, job->domain, job->cancellable, _resolver_name_done, &name);
+        _resolver_wait(context, &outstanding);
+
+        guint count = g_list_length(srv.results);
+        if (count > 0) {
+            ResolverQuery* targets = g_new0(ResolverQuery, count);
+            guint i = 0;
+            for (GList* curr = srv.results; curr; curr = g_list_next(curr), i++) {
+                const char* target = g_srv_target_get_hostname(curr->data);
+                targets[i].outstanding = &outstanding;
+                // "." means the service is decidedly not available
+                if (g_strcmp0(target, ".") != 0) {
+                    outstanding++;
+                    g_resolver_lookup_by_name_async(resolver, target, job->cancellable, _resolver_name_done, &targets[i]);
+                }
+            }
+            _resolver_wait(context, &outstanding);
+
+            i = 0;
+            for (GList* curr = srv.results; curr; curr = g_list_next(curr), i++) {
+                job->addresses = _resolver_interleave(job->addresses, targets[i].results, g_srv_target_get_port(curr->data));
+                g_resolver_free_addresses(targets[i].results);
+            }
+            g_free(targets);
+        } else {
+            job->addresses = _resolver_interleave(job->addresses, name.results, port);
+        }
+        g_resolver_free_targets(srv.results);
+        g_resolver_free_addresses(name.results);
+    }
+
+    _resolver_race(job);
+
+    g_object_unref(resolver);
+    g_main_context_pop_thread_default(context);
+    g_main_context_unref(context);
+}
+
+static void*
+_resolver_worker(void* data)
+{
+    ResolverJob* job = data;
+    _resolver_job_run(job);
+
+    pthread_mutex_lock(&resolver_lock);
+    job->done = TRUE;
+    pthread_mutex_unlock(&resolver_lock);
+
+    return NULL;
+}
+
+static void
+_resolver_reap(ResolverJob* job)
+{
+    if (job->joinable) {
+        pthread_join(job->worker, NULL);
+    }
+    _resolver_job_free(job);
+}
+
+GList*
+resolver_lookup(const char* const domain, const char* const host, int port, gboolean direct_tls,
+                resolver_cb callback, void* userdata)
+{
+    resolver_cancel();
+
+    if (!resolver_cache) {
+        resolver_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_resolver_entry_free);
+    }
+
+    gchar* key = _resolver_key(domain, host, port, direct_tls);
+    ResolverEntry* entry = g_hash_table_lookup(resolver_cache, key);
+    if (entry && entry->expires > g_get_monotonic_time()) {
+        log_debug("DNS: using the cached addresses of %s", host ? host : domain);
+        g_free(key);
+        return _resolver_addresses_copy(entry->addresses);
+    }
+    if (entry) {
+        g_hash_table_remove(resolver_cache, key);
+    }
+
+    ResolverJob* job = calloc(1, sizeof(ResolverJob));
+    job->key = strdup(key);
+    job->domain = domain ? strdup(domain) : NULL;
+    job->host = host ? strdup(host) : NULL;
+    job->port = port;
+    job->direct_tls = direct_tls;
+    job->callback = callback;
+    job->userdata = userdata;
+    job->cancellable = g_cancellable_new();
+    g_free(key);
+
+    log_debug("DNS: resolving %s", host ? host : domain);
+    job->joinable = pthread_create(&job->worker, NULL, _resolver_worker, job) == 0;
+    if (!job->joinable) {
+        // delivered empty, the caller falls back to resolving in libstrophe
+        log_error("DNS: failed to start the resolver thread");
+        job->done = TRUE;
+    }
+    resolver_job = job;
+
+    if (!resolver_task) {
+        resolver_task = scheduler_add(RESOLVER_POLL_MS, _resolver_check, NULL, NULL);
+    }
+
+    return NULL;
+}
+
+void
+resolver_cancel(void)
+{
+    if (resolver_job) {
+        g_cancellable_cancel(resolver_job->cancellable);
+        resolver_jobs_cancelled = g_list_append(resolver_jobs_cancelled, resolver_job);
+        resolver_job = NULL;
+    }
+}
+
+void
+resolver_forget(const char* const domain, const char* const host, int port, gboolean direct_tls)
+{
+    if (!resolver_cache) {
+        return;
+    }
+
+    gchar* key = _resolver_key(domain, host, port, direct_tls);
+    g_hash_table_remove(resolver_cache, key);
+    g_free(key);
+}
+
+static void
+_resolver_deliver(ResolverJob* job)
+{
+    if (job->addresses) {
+        ResolvedAddress* first = job->addresses->data;
+        log_debug("DNS: %u addresses for %s, trying %s port %d first%s", g_list_length(job->addresses),
+                  job->host ? job->host : job->domain, first->host, first->port, job->raced ? " (answered first)" : "");
+
+        ResolverEntry* entry = malloc(sizeof(ResolverEntry));
+        entry->addresses = _resolver_addresses_copy(job->addresses);
+        entry->expires = g_get_monotonic_time() + (gint64)RESOLVER_CACHE_TTL_S * G_USEC_PER_SEC;
+        g_hash_table_replace(resolver_cache, strdup(job->key), entry);
+    } else {
+        log_warning("DNS: no addresses for %s", job->host ? job->host : job->domain);
+    }
+
+    GList* addresses = job->addresses;
+    job->addresses = NULL;
+    job->callback(addresses, job->userdata);
+}
+
+static gboolean
+_resolver_check(void* data)
+{
+    ResolverJob* finished = NULL;
+    GList* reaped = NULL;
+
+    pthread_mutex_lock(&resolver_lock);
+    if (resolver_job && resolver_job->done) {
+        finished = resolver_job;
+        resolver_job = NULL;
+    }
+    GList* curr = resolver_jobs_cancelled;
+    while (curr) {
+        GList* next = g_list_next(curr);
+        ResolverJob* job = curr->data;
+        if (job->done) {
+            resolver_jobs_cancelled = g_list_remove_link(resolver_jobs_cancelled, curr);
+            reaped = g_list_concat(reaped, curr);
+        }
+        curr = next;
+    }
+    gboolean pending = resolver_job || resolver_jobs_cancelled;
+    if (!pending) {
+        resolver_task = NULL;
+    }
+    pthread_mutex_unlock(&resolver_lock);
+
+    g_list_free_full(reaped, (GDestroyNotify)_resolver_reap);
+
+    if (finished) {
+        if (finished->joinable) {
+            pthread_join(finished->worker, NULL);
+            finished->joinable = FALSE;
+        }
+        _resolver_deliver(finished);
+        _resolver_job_free(finished);
+    }
+
+    return pending;
+}
+
+void
+resolver_close(void)
+{
+    resolver_cancel();
+    // cancelled lookups return promptly, the race checks for it between polls
+    g_list_free_full(resolver_jobs_cancelled, (GDestroyNotify)_resolver_reap);
+    resolver_jobs_cancelled = NULL;
+    scheduler_remove(resolver_task);
+    resolver_task = NULL;
+
+    if (resolver_cache) {
+        g_hash_table_destroy(resolver_cache);
+        resolver_cache = NULL;
+    }
+}
@@ -0,0 +1,57 @@
+/*
+ * resolver.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef XMPP_RESOLVER_H
+#define XMPP_RESOLVER_H
+
+#include <glib.h>
+
+typedef struct resolved_address_t
+{
+    char* host; // numeric, so connecting to it does not block on DNS
+    int port;
+} ResolvedAddress;
+
+// addresses is NULL when nothing resolved, otherwise the callee frees it with resolver_addresses_free
+typedef void (*resolver_cb)(GList* addresses, void* userdata);
+
+GList* resolver_lookup(const char* const domain, const char* const host, int port, gboolean direct_tls,
+                       resolver_cb callback, void* userdata);
+void resolver_cancel(void);
+void resolver_forget(const char* const domain, const char* const host, int port, gboolean direct_tls);
+void resolver_addresses_free(GList* addresses);
+void resolver_close(void);
+
+#endif
@@ -40,16 +40,20 @@
 #include <string.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
 
 #include <strophe.h>
 
 #include "profanity.h"
 #include "log.h"
+#include "config/files.h"
 #include "config/preferences.h"
 #include "plugins/plugins.h"
 #include "event/server_events.h"
 #include "event/client_events.h"
 #include "tools/autocomplete.h"
+#include "tools/scheduler.h"
 #include "ui/ui.h"
 #include "xmpp/session.h"
 #include "xmpp/iq.h"
@@ -66,20 +70,200 @@ typedef struct _group_data
     char* group;
 } GroupData;
 
+// how long roster changes wait before the cache file is rewritten
+#define ROSTER_CACHE_SAVE_DELAY_MS 5000
+#define ROSTER_CACHE_GROUP         "roster"
+#define ROSTER_CACHE_CONTACT       "contact "
+
 // id handlers
 static int _group_add_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _group_remove_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static void _free_group_data(GroupData* data);
 
+static void _roster_cache_load(void);
+static void _roster_cache_save(void);
+static void _roster_cache_save_later(void);
+static void _roster_cache_set_version(const char* const ver);
+
+// XEP-0237 roster version of the cached roster, NULL if the server doesn't version
+static char* roster_ver = NULL;
+static char* roster_cache_loc = NULL;
+static gboolean roster_cache_loaded = FALSE;
+static SchedulerTask* roster_cache_task = NULL;
+
 void
 roster_request(void)
 {
+    // show the roster we had last time while the server answers
+    _roster_cache_load();
+
     xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_stanza_t* iq = stanza_create_roster_iq(ctx);
+    xmpp_stanza_t* iq = stanza_create_roster_iq(ctx, roster_ver);
     iq_send_stanza(iq);
     xmpp_stanza_release(iq);
 }
 
+void
+roster_cache_flush(void)
+{
+    if (roster_cache_task) {
+        scheduler_remove(roster_cache_task);
+        roster_cache_task = NULL;
+        _roster_cache_save();
+    }
+
+    FREE_SET_NULL(roster_ver);
+    FREE_SET_NULL(roster_cache_loc);
+    roster_cache_loaded = FALSE;
+}
+
+static void
+_roster_cache_load(void)
+{
+    FREE_SET_NULL(roster_ver);
+    FREE_SET_NULL(roster_cache_loc);
+    roster_cache_loaded = FALSE;
+
+    char* barejid = connection_get_barejid();
+    gchar* dir = files_get_account_data_path(DIR_DATABASE, barejid);
+    free(barejid);
+    if (g_mkdir_with_parents(dir, S_IRWXU) == -1) {
+        log_error("Unable to create roster cache directory: %s", dir);
+        g_free(dir);
+        return;
+    }
+    roster_cache_loc = g_strdup_printf("%s/%s", dir, FILE_ROSTERCACHE);
+    g_free(dir);
+
+    GKeyFile* cache = g_key_file_new();
+    if (!g_key_file_load_from_file(cache, roster_cache_loc, G_KEY_FILE_NONE, NULL)) {
+        g_key_file_free(cache);
+        return;
+    }
+
+    gchar* ver = g_key_file_get_string(cache, ROSTER_CACHE_GROUP, STANZA_ATTR_VER, NULL);
+    if (ver == NULL) {
+        // without a version the server sends everything anyway
+        g_key_file_free(cache);
+        return;
+    }
+
+    gsize len = 0;
+    gchar** groups = g_key_file_get_groups(cache, &len);
+    roster_load_begin();
+    for (gsize i = 0; i < len; i++) {
+        if (!g_str_has_prefix(groups[i], ROSTER_CACHE_CONTACT)) {
+            continue;
+        }
+
+        const char* barejid_cached = groups[i] + strlen(ROSTER_CACHE_CONTACT);
+        gchar* name = g_key_file_get_string(cache, groups[i], "name", NULL);
+        gchar* sub = g_key_file_get_string(cache, groups[i], "subscription", NULL);
+        gboolean pending_out = g_key_file_get_boolean(cache, groups[i], "pending_out", NULL);
+
+        // roster_add takes the group list
+        GSList* contact_groups = NULL;
+        gchar** group_names = g_key_file_get_string_list(cache, groups[i], "groups", NULL, NULL);
+        for (int j = 0; group_names && group_names[j]; j++) {
+            contact_groups = g_slist_append(contact_groups, strdup(group_names[j]));
+        }
+        g_strfreev(group_names);
+
+        roster_add(barejid_cached, name, contact_groups, sub, pending_out);
+
+        g_free(name);
+        g_free(sub);
+    }
+    roster_load_end();
+    g_strfreev(groups);
+    g_key_file_free(cache);
+
+    roster_ver = strdup(ver);
+    g_free(ver);
+    roster_cache_loaded = TRUE;
+    log_debug("Loaded %d cached roster contacts, version %s", g_sequence_get_length(roster_get_contacts_view(ROSTER_ORD_NAME)), roster_ver);
+
+    ui_redraw_roster();
+}
+
+static void
+_roster_cache_save(void)
+{
+    if (roster_cache_loc == NULL || roster_ver == NULL || !roster_exists()) {
+        return;
+    }
+
+    GKeyFile* cache = g_key_file_new();
+    g_key_file_set_string(cache, ROSTER_CACHE_GROUP, STANZA_ATTR_VER, roster_ver);
+
+    GSequence* contacts = roster_get_contacts_view(ROSTER_ORD_NAME);
+    GSequenceIter* iter = g_sequence_get_begin_iter(contacts);
+    while (!g_sequence_iter_is_end(iter)) {
+        PContact contact = g_sequence_get(iter);
+        gchar* group = g_strconcat(ROSTER_CACHE_CONTACT, p_contact_barejid(contact), NULL);
+
+        if (p_contact_name(contact)) {
+            g_key_file_set_string(cache, group, "name", p_contact_name(contact));
+        }
+        if (p_contact_subscription(contact)) {
+            g_key_file_set_string(cache, group, "subscription", p_contact_subscription(contact));
+        }
+        g_key_file_set_boolean(cache, group, "pending_out", p_contact_pending_out(contact));
+
+        GSList* contact_groups = p_contact_groups(contact);
+        guint count = g_slist_length(contact_groups);
+        if (count > 0) {
+            const gchar** group_names = g_new0(const gchar*, count + 1);
+            guint j = 0;
+            for (GSList* curr = contact_groups; curr; curr = g_slist_next(curr)) {
+                group_names[j++] = curr->data;
+            }
+            g_key_file_set_string_list(cache, group, "groups", group_names, count);
+            g_free(group_names);
+        }
+
+        g_free(group);
+        iter = g_sequence_iter_next(iter);
+    }
+
+    GError* error = NULL;
+    if (!g_key_file_save_to_file(cache, roster_cache_loc, &error)) {
+        log_error("Unable to save roster cache: %s", error->message);
+        g_error_free(error);
+    }
+    g_key_file_free(cache);
+}
+
+static gboolean
+_roster_cache_save_task(void* data)
+{
+    roster_cache_task = NULL;
+    _roster_cache_save();
+
+    return FALSE;
+}
+
+static void
+_roster_cache_save_later(void)
+{
+    if (roster_cache_task == NULL) {
+        roster_cache_task = scheduler_add(ROSTER_CACHE_SAVE_DELAY_MS, _roster_cache_save_task, NULL, NULL);
+    }
+}
+
+// servers without versioning send no version, the cache is then left alone
+static void
+_roster_cache_set_version(const char* const ver)
+{
+    if (ver == NULL) {
+        return;
+    }
+
+    free(roster_ver);
+    roster_ver = strdup(ver);
+    _roster_cache_save_later();
+}
+
 void
 roster_send_add_new(const char* const barejid, const char* const name)
 {
@@ -258,6 +442,8 @@ roster_set_handler(xmpp_stanza_t* const stanza)
 
     g_free(barejid_lower);
 
+    _roster_cache_set_version(xmpp_stanza_get_attribute(query, STANZA_ATTR_VER));
+
     return;
 }
 
@@ -272,8 +458,26 @@ roster_result_handler(xmpp_stanza_t* const stanza)
 
     // handle initial roster response
     xmpp_stanza_t* query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
+
+    // XEP-0237 4.3, no query when the cached roster is current, changes follow as pushes
+    if (query == NULL) {
+        if (!roster_cache_loaded) {
+            log_warning("Empty roster result without a cached roster");
+        }
+        sv_ev_roster_received();
+        return;
+    }
+
+    // a full roster replaces whatever came from the cache
+    if (roster_cache_loaded) {
+        roster_destroy();
+        roster_create();
+        roster_cache_loaded = FALSE;
+    }
+
     xmpp_stanza_t* item = xmpp_stanza_get_children(query);
 
+    roster_load_begin();
     while (item) {
         const char* barejid = xmpp_stanza_get_attribute(item, STANZA_ATTR_JID);
         gchar* barejid_lower = g_utf8_strdown(barejid, -1);
@@ -300,6 +504,9 @@ roster_result_handler(xmpp_stanza_t* const stanza)
         g_free(barejid_lower);
         item = xmpp_stanza_get_next(item);
     }
+    roster_load_end();
+
+    _roster_cache_set_version(xmpp_stanza_get_attribute(query, STANZA_ATTR_VER));
 
     sv_ev_roster_received();
 
@@ -43,11 +43,29 @@
 
 #include "config/preferences.h"
 #include "tools/autocomplete.h"
+#include "tools/intern.h"
+#include "tools/memusage.h"
 #include "xmpp/roster_list.h"
 #include "xmpp/resource.h"
 #include "xmpp/contact.h"
 #include "xmpp/jid.h"
 
+// senders whose display names are kept at most
+#define ROSTER_DISPLAY_NAMES_MAX 1000
+
+typedef struct roster_index_t
+{
+    GSequence* by_name;
+    GSequence* by_presence;
+} RosterIndex;
+
+typedef struct roster_slot_t
+{
+    RosterIndex* index;
+    GSequenceIter* by_name;
+    GSequenceIter* by_presence;
+} RosterSlot;
+
 typedef struct prof_roster_t
 {
     // contacts, indexed on barejid
@@ -68,6 +86,20 @@ typedef struct prof_roster_t
     // groups
     Autocomplete groups_ac;
     GHashTable* group_count;
+
+    // sorted views over all contacts, ungrouped contacts and each group
+    RosterIndex* all;
+    RosterIndex* ungrouped;
+    GHashTable* group_index;
+
+    // index positions of each contact, PContact to GSList of RosterSlot
+    GHashTable* slots;
+
+    // message sender names, barejid to a table of resource ("" for none) to name
+    GHashTable* display_names;
+
+    // a whole roster is being added, the autocompleters sort at the end
+    gboolean loading;
 } ProfRoster;
 
 typedef struct pending_presence
@@ -85,6 +117,15 @@ static gboolean _key_equals(void* key1, void* key2);
 static gboolean _datetimes_equal(GDateTime* dt1, GDateTime* dt2);
 static void _replace_name(const char* const current_name, const char* const new_name, const char* const barejid);
 static void _add_name_and_barejid(const char* const name, const char* const barejid);
+static RosterIndex* _index_new(void);
+static void _index_free(RosterIndex* index);
+static void _index_contact(PContact contact);
+static void _unindex_contact(PContact contact);
+static void _reindex_contact(PContact contact, gboolean name_changed);
+static GSList* _sequence_to_list(GSequence* seq);
+static const char* _display_name(const char* const barejid, const char* const resource);
+static void _display_names_forget(const char* const barejid);
+static void _roster_ac_add(Autocomplete ac, const char* const item);
 
 void
 roster_create(void)
@@ -92,13 +133,20 @@ roster_create(void)
     assert(roster == NULL);
 
     roster = malloc(sizeof(ProfRoster));
-    roster->contacts = g_hash_table_new_full(g_str_hash, (GEqualFunc)_key_equals, g_free, (GDestroyNotify)p_contact_free);
+    // barejids, names and groups are shared with the rest of the client, interned
+    roster->contacts = g_hash_table_new_full(g_str_hash, (GEqualFunc)_key_equals, (GDestroyNotify)intern_unref, (GDestroyNotify)p_contact_free);
     roster->name_ac = autocomplete_new();
     roster->barejid_ac = autocomplete_new();
     roster->fulljid_ac = autocomplete_new();
-    roster->name_to_barejid = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    roster->name_to_barejid = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)intern_unref, (GDestroyNotify)intern_unref);
     roster->groups_ac = autocomplete_new();
-    roster->group_count = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    roster->group_count = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)intern_unref, NULL);
+    roster->all = _index_new();
+    roster->ungrouped = _index_new();
+    roster->group_index = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)intern_unref, (GDestroyNotify)_index_free);
+    roster->slots = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, NULL);
+    roster->display_names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_destroy);
+    roster->loading = FALSE;
 
     roster_received = FALSE;
     roster_pending_presence = NULL;
@@ -109,6 +157,17 @@ roster_destroy(void)
 {
     assert(roster != NULL);
 
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, roster->slots);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        g_slist_free_full(value, free);
+    }
+    g_hash_table_destroy(roster->slots);
+    g_hash_table_destroy(roster->group_index);
+    _index_free(roster->ungrouped);
+    _index_free(roster->all);
+
     g_hash_table_destroy(roster->contacts);
     autocomplete_free(roster->name_ac);
     autocomplete_free(roster->barejid_ac);
@@ -116,11 +175,71 @@ roster_destroy(void)
     g_hash_table_destroy(roster->name_to_barejid);
     autocomplete_free(roster->groups_ac);
     g_hash_table_destroy(roster->group_count);
+    g_hash_table_destroy(roster->display_names);
 
     free(roster);
     roster = NULL;
 }
 
+static gsize
+_index_memory(RosterIndex* index)
+{
+    return memusage_alloc(sizeof(RosterIndex)) + memusage_sequence(index->by_name) + memusage_sequence(index->by_presence);
+}
+
+// Rough heap use of the roster with its contacts and indexes, the
+// autocompleters are counted with the others
+gsize
+roster_memory(guint* contacts)
+{
+    *contacts = 0;
+    if (!roster) {
+        return 0;
+    }
+
+    gsize total = memusage_alloc(sizeof(ProfRoster));
+    GHashTableIter iter;
+    gpointer key, value;
+
+    // the interned keys are counted with the interned strings
+    *contacts = g_hash_table_size(roster->contacts);
+    total += memusage_hash_table(roster->contacts);
+    g_hash_table_iter_init(&iter, roster->contacts);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        total += p_contact_memory(value);
+    }
+
+    total += memusage_hash_table(roster->name_to_barejid);
+    total += memusage_hash_table(roster->group_count);
+
+    total += _index_memory(roster->all) + _index_memory(roster->ungrouped);
+    total += memusage_hash_table(roster->group_index);
+    g_hash_table_iter_init(&iter, roster->group_index);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        total += _index_memory(value);
+    }
+
+    total += memusage_hash_table(roster->slots);
+    g_hash_table_iter_init(&iter, roster->slots);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        total += memusage_slist(value) + g_slist_length(value) * memusage_alloc(sizeof(RosterSlot));
+    }
+
+    total += memusage_hash_table(roster->display_names);
+    g_hash_table_iter_init(&iter, roster->display_names);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        total += memusage_string(key) + memusage_hash_table(value);
+        GHashTableIter names;
+        gpointer resource, name;
+        g_hash_table_iter_init(&names, value);
+        while (g_hash_table_iter_next(&names, &resource, &name)) {
+            total += memusage_string(resource) + memusage_string(name);
+        }
+    }
+
+    return total;
+}
+
 gboolean
 roster_update_presence(const char* const barejid, Resource* resource, GDateTime* last_activity)
 {
@@ -151,6 +270,7 @@ roster_update_presence(const char* const barejid, Resource* resource, GDateTime*
         p_contact_set_last_activity(contact, last_activity);
     }
     p_contact_set_presence(contact, resource);
+    _reindex_contact(contact, FALSE);
     Jid* jid = jid_create_from_bare_and_resource(barejid, resource->name);
     autocomplete_add(roster->fulljid_ac, jid->fulljid);
     jid_destroy(jid);
@@ -170,57 +290,51 @@ roster_get_contact(const char* const barejid)
     return contact;
 }
 
-char*
-roster_get_display_name(const char* const barejid)
+// Whether the bare part of the full or bare jid is in the roster, without
+// parsing the jid first
+gboolean
+roster_contains_jid(const char* const jid)
 {
     assert(roster != NULL);
 
-    GString* result = g_string_new("");
+    char buf[256];
+    char* alloced;
+    char* folded = jid_fold(jid, buf, sizeof(buf), &alloced);
 
-    PContact contact = roster_get_contact(barejid);
-    if (contact) {
-        if (p_contact_name(contact)) {
-            g_string_append(result, p_contact_name(contact));
-        } else {
-            g_string_append(result, barejid);
-        }
-    } else {
-        g_string_append(result, barejid);
+    char* slash = strchr(folded, '/');
+    if (slash) {
+        *slash = '\0';
     }
+    gboolean found = g_hash_table_contains(roster->contacts, folded);
+    g_free(alloced);
 
-    char* result_str = result->str;
-    g_string_free(result, FALSE);
+    return found;
+}
 
-    return result_str;
+void
+roster_trim(void)
+{
+    if (roster) {
+        g_hash_table_remove_all(roster->display_names);
+    }
 }
 
 char*
-roster_get_msg_display_name(const char* const barejid, const char* const resource)
+roster_get_display_name(const char* const barejid)
 {
     assert(roster != NULL);
 
-    GString* result = g_string_new("");
-
-    PContact contact = roster_get_contact(barejid);
-    if (contact) {
-        if (p_contact_name(contact)) {
-            g_string_append(result, p_contact_name(contact));
-        } else {
-            g_string_append(result, barejid);
-        }
-    } else {
-        g_string_append(result, barejid);
-    }
-
-    if (resource && prefs_get_boolean(PREF_RESOURCE_MESSAGE)) {
-        g_string_append(result, "/");
-        g_string_append(result, resource);
-    }
+    return strdup(_display_name(barejid, NULL));
+}
 
-    char* result_str = result->str;
-    g_string_free(result, FALSE);
+// The name is shared, it stays valid until the roster next changes. The
+// preference is applied here, the cache holds both forms.
+const char*
+roster_get_msg_display_name(const char* const barejid, const char* const resource)
+{
+    assert(roster != NULL);
 
-    return result_str;
+    return _display_name(barejid, prefs_get_boolean(PREF_RESOURCE_MESSAGE) ? resource : NULL);
 }
 
 gboolean
@@ -238,6 +352,7 @@ roster_contact_offline(const char* const barejid, const char* const resource, co
     } else {
         gboolean result = p_contact_remove_resource(contact, resource);
         if (result == TRUE) {
+            _reindex_contact(contact, FALSE);
             Jid* jid = jid_create_from_bare_and_resource(barejid, resource);
             autocomplete_remove(roster->fulljid_ac, jid->fulljid);
             jid_destroy(jid);
@@ -272,6 +387,8 @@ roster_change_name(PContact contact, const char* const new_name)
     }
 
     p_contact_set_name(contact, new_name);
+    _display_names_forget(barejid);
+    _reindex_contact(contact, TRUE);
     _replace_name(current_name, new_name, barejid);
     free(current_name);
 }
@@ -310,7 +427,7 @@ roster_remove(const char* const name, const char* const barejid)
                     g_hash_table_remove(roster->group_count, group);
                     autocomplete_remove(roster->groups_ac, group);
                 } else {
-                    g_hash_table_insert(roster->group_count, strdup(group), GINT_TO_POINTER(count));
+                    g_hash_table_insert(roster->group_count, (gpointer)intern(group), GINT_TO_POINTER(count));
                 }
             }
             curr = g_slist_next(curr);
@@ -318,6 +435,11 @@ roster_remove(const char* const name, const char* const barejid)
     }
 
     // remove the contact
+    _display_names_forget(barejid);
+    PContact removed = g_hash_table_lookup(roster->contacts, barejid);
+    if (removed) {
+        _unindex_contact(removed);
+    }
     g_hash_table_remove(roster->contacts, barejid);
 }
 
@@ -344,13 +466,13 @@ roster_update(const char* const barejid, const char* const name, GSList* groups,
 
             // group doesn't yet exist
             if (!g_hash_table_contains(roster->group_count, new_group)) {
-                g_hash_table_insert(roster->group_count, strdup(new_group), GINT_TO_POINTER(1));
+                g_hash_table_insert(roster->group_count, (gpointer)intern(new_group), GINT_TO_POINTER(1));
                 autocomplete_add(roster->groups_ac, curr_new_group->data);
 
                 // increment count
             } else {
                 int count = GPOINTER_TO_INT(g_hash_table_lookup(roster->group_count, new_group));
-                g_hash_table_insert(roster->group_count, strdup(new_group), GINT_TO_POINTER(count + 1));
+                g_hash_table_insert(roster->group_count, (gpointer)intern(new_group), GINT_TO_POINTER(count + 1));
             }
         }
         curr_new_group = g_slist_next(curr_new_group);
@@ -369,7 +491,7 @@ roster_update(const char* const barejid, const char* const name, GSList* groups,
                     g_hash_table_remove(roster->group_count, old_group);
                     autocomplete_remove(roster->groups_ac, old_group);
                 } else {
-                    g_hash_table_insert(roster->group_count, strdup(old_group), GINT_TO_POINTER(count));
+                    g_hash_table_insert(roster->group_count, (gpointer)intern(old_group), GINT_TO_POINTER(count));
                 }
             }
         }
@@ -377,7 +499,40 @@ roster_update(const char* const barejid, const char* const name, GSList* groups,
         curr_old_group = g_slist_next(curr_old_group);
     }
 
+    _unindex_contact(contact);
     p_contact_set_groups(contact, groups);
+    _index_contact(contact);
+}
+
+// Contacts added until roster_load_end() go into the autocompleters
+// unsorted, to be sorted once
+void
+roster_load_begin(void)
+{
+    assert(roster != NULL);
+
+    roster->loading = TRUE;
+}
+
+void
+roster_load_end(void)
+{
+    assert(roster != NULL);
+
+    roster->loading = FALSE;
+    autocomplete_sort(roster->name_ac);
+    autocomplete_sort(roster->barejid_ac);
+    autocomplete_sort(roster->groups_ac);
+}
+
+static void
+_roster_ac_add(Autocomplete ac, const char* const item)
+{
+    if (roster->loading) {
+        autocomplete_add_unsorted(ac, item);
+    } else {
+        autocomplete_add(ac, item);
+    }
 }
 
 gboolean
@@ -399,17 +554,19 @@ roster_add(const char* const barejid, const char* const name, GSList* groups, co
         char* new_group = curr_new_group->data;
         if (g_hash_table_contains(roster->group_count, new_group)) {
             int count = GPOINTER_TO_INT(g_hash_table_lookup(roster->group_count, new_group));
-            g_hash_table_insert(roster->group_count, strdup(new_group), GINT_TO_POINTER(count + 1));
+            g_hash_table_insert(roster->group_count, (gpointer)intern(new_group), GINT_TO_POINTER(count + 1));
         } else {
-            g_hash_table_insert(roster->group_count, strdup(new_group), GINT_TO_POINTER(1));
-            autocomplete_add(roster->groups_ac, new_group);
+            g_hash_table_insert(roster->group_count, (gpointer)intern(new_group), GINT_TO_POINTER(1));
+            _roster_ac_add(roster->groups_ac, new_group);
         }
 
         curr_new_group = g_slist_next(curr_new_group);
     }
 
-    g_hash_table_insert(roster->contacts, strdup(barejid), contact);
-    autocomplete_add(roster->barejid_ac, barejid);
+    g_hash_table_insert(roster->contacts, (gpointer)intern(barejid), contact);
+    _display_names_forget(barejid);
+    _index_contact(contact);
+    _roster_ac_add(roster->barejid_ac, barejid);
     _add_name_and_barejid(name, barejid);
 
     return TRUE;
@@ -432,20 +589,19 @@ roster_get_contacts_by_presence(const char* const presence)
 {
     assert(roster != NULL);
 
+    // contacts sharing a presence are contiguous and ordered by name
     GSList* result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
-
-    g_hash_table_iter_init(&iter, roster->contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        PContact contact = (PContact)value;
+    GSequenceIter* iter = g_sequence_get_end_iter(roster->all->by_presence);
+    while (!g_sequence_iter_is_begin(iter)) {
+        iter = g_sequence_iter_prev(iter);
+        PContact contact = g_sequence_get(iter);
         if (g_strcmp0(p_contact_presence(contact), presence) == 0) {
-            result = g_slist_insert_sorted(result, value, (GCompareFunc)roster_compare_name);
+            result = g_slist_prepend(result, contact);
+        } else if (result) {
+            break;
         }
     }
 
-    // return all contact structs
     return result;
 }
 
@@ -454,25 +610,19 @@ roster_get_contacts(roster_ord_t order)
 {
     assert(roster != NULL);
 
-    GSList* result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
+    return _sequence_to_list(roster_get_contacts_view(order));
+}
+
+GSequence*
+roster_get_contacts_view(roster_ord_t order)
+{
+    assert(roster != NULL);
 
-    GCompareFunc cmp_func;
     if (order == ROSTER_ORD_PRESENCE) {
-        cmp_func = (GCompareFunc)roster_compare_presence;
+        return roster->all->by_presence;
     } else {
-        cmp_func = (GCompareFunc)roster_compare_name;
-    }
-
-    g_hash_table_iter_init(&iter, roster->contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        result = g_slist_insert_sorted(result, value, cmp_func);
+        return roster->all->by_name;
     }
-
-    // return all contact structs
-    return result;
 }
 
 GSList*
@@ -481,17 +631,14 @@ roster_get_contacts_online(void)
     assert(roster != NULL);
 
     GSList* result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
-
-    g_hash_table_iter_init(&iter, roster->contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        if (strcmp(p_contact_presence(value), "offline"))
-            result = g_slist_insert_sorted(result, value, (GCompareFunc)roster_compare_name);
+    GSequenceIter* iter = g_sequence_get_end_iter(roster->all->by_name);
+    while (!g_sequence_iter_is_begin(iter)) {
+        iter = g_sequence_iter_prev(iter);
+        PContact contact = g_sequence_get(iter);
+        if (strcmp(p_contact_presence(contact), "offline"))
+            result = g_slist_prepend(result, contact);
     }
 
-    // return all contact structs
     return result;
 }
 
@@ -536,38 +683,34 @@ roster_get_group(const char* const group, roster_ord_t order)
 {
     assert(roster != NULL);
 
-    GSList* result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
+    GSequence* view = roster_get_group_view(group, order);
+    if (view == NULL) {
+        return NULL;
+    }
 
-    GCompareFunc cmp_func;
-    if (order == ROSTER_ORD_PRESENCE) {
-        cmp_func = (GCompareFunc)roster_compare_presence;
+    return _sequence_to_list(view);
+}
+
+GSequence*
+roster_get_group_view(const char* const group, roster_ord_t order)
+{
+    assert(roster != NULL);
+
+    RosterIndex* index = NULL;
+    if (group == NULL) {
+        index = roster->ungrouped;
     } else {
-        cmp_func = (GCompareFunc)roster_compare_name;
+        index = g_hash_table_lookup(roster->group_index, group);
     }
-
-    g_hash_table_iter_init(&iter, roster->contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        GSList* groups = p_contact_groups(value);
-        if (group == NULL) {
-            if (groups == NULL) {
-                result = g_slist_insert_sorted(result, value, cmp_func);
-            }
-        } else {
-            while (groups) {
-                if (strcmp(groups->data, group) == 0) {
-                    result = g_slist_insert_sorted(result, value, cmp_func);
-                    break;
-                }
-                groups = g_slist_next(groups);
-            }
-        }
+    if (index == NULL) {
+        return NULL;
     }
 
-    // return all contact structs
-    return result;
+    if (order == ROSTER_ORD_PRESENCE) {
+        return index->by_presence;
+    } else {
+        return index->by_name;
+    }
 }
 
 GList*
@@ -594,6 +737,58 @@ roster_barejid_autocomplete(const char* const search_str, gboolean previous, voi
     return autocomplete_complete(roster->barejid_ac, search_str, TRUE, previous);
 }
 
+// The contact's name or the barejid, followed by the resource when given.
+// Formatted once per sender, names are forgotten when the contact changes.
+static const char*
+_display_name(const char* const barejid, const char* const resource)
+{
+    gchar* barejidlower = g_utf8_strdown(barejid, -1);
+    GHashTable* names = g_hash_table_lookup(roster->display_names, barejidlower);
+    if (!names) {
+        // senders outside the roster are remembered as well, up to a limit
+        if (g_hash_table_size(roster->display_names) >= ROSTER_DISPLAY_NAMES_MAX) {
+            g_hash_table_remove_all(roster->display_names);
+        }
+        names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+        g_hash_table_insert(roster->display_names, barejidlower, names);
+    } else {
+        g_free(barejidlower);
+    }
+
+    const char* key = resource ? resource : "";
+    char* name = g_hash_table_lookup(names, key);
+    if (name) {
+        return name;
+    }
+
+    GString* result = g_string_new("");
+
+    PContact contact = roster_get_contact(barejid);
+    if (contact && p_contact_name(contact)) {
+        g_string_append(result, p_contact_name(contact));
+    } else {
+        g_string_append(result, barejid);
+    }
+
+    if (resource) {
+        g_string_append(result, "/");
+        g_string_append(result, resource);
+    }
+
+    name = g_string_free(result, FALSE);
+    g_hash_table_insert(names, strdup(key), name);
+
+    return name;
+}
+
+static void
+_display_names_forget(const char* const barejid)
+{
+    gchar* barejidlower = g_utf8_strdown(barejid, -1);
+    g_hash_table_remove(roster->display_names, barejidlower);
+    g_free(barejidlower);
+}
+
 static gboolean
 _key_equals(void* key1, void* key2)
 {
@@ -641,11 +836,11 @@ _add_name_and_barejid(const char* const name, const char* const barejid)
     assert(roster != NULL);
 
     if (name) {
-        autocomplete_add(roster->name_ac, name);
-        g_hash_table_insert(roster->name_to_barejid, strdup(name), strdup(barejid));
+        _roster_ac_add(roster->name_ac, name);
+        g_hash_table_insert(roster->name_to_barejid, (gpointer)intern(name), (gpointer)intern(barejid));
     } else {
-        autocomplete_add(roster->name_ac, barejid);
-        g_hash_table_insert(roster->name_to_barejid, strdup(barejid), strdup(barejid));
+        _roster_ac_add(roster->name_ac, barejid);
+        g_hash_table_insert(roster->name_to_barejid, (gpointer)intern(barejid), (gpointer)intern(barejid));
     }
 }
 
@@ -701,16 +896,146 @@ roster_compare_presence(PContact a, PContact b)
         int weight_b = _get_presence_weight(presence_b);
         if (weight_a < weight_b) {
             return -1;
-        } else {
+        } else if (weight_a > weight_b) {
             return 1;
         }
+    }
 
-        // otherwise order by name
-    } else {
-        return roster_compare_name(a, b);
+    // otherwise order by name
+    return roster_compare_name(a, b);
+}
+
+static gint
+_seq_compare_name(gconstpointer a, gconstpointer b, gpointer data)
+{
+    return roster_compare_name((PContact)a, (PContact)b);
+}
+
+static gint
+_seq_compare_presence(gconstpointer a, gconstpointer b, gpointer data)
+{
+    return roster_compare_presence((PContact)a, (PContact)b);
+}
+
+static RosterIndex*
+_index_new(void)
+{
+    RosterIndex* index = malloc(sizeof(RosterIndex));
+    index->by_name = g_sequence_new(NULL);
+    index->by_presence = g_sequence_new(NULL);
+
+    return index;
+}
+
+static void
+_index_free(RosterIndex* index)
+{
+    if (index) {
+        g_sequence_free(index->by_name);
+        g_sequence_free(index->by_presence);
+        free(index);
+    }
+}
+
+static GSList*
+_index_add(GSList* slots, RosterIndex* index, PContact contact)
+{
+    RosterSlot* slot = malloc(sizeof(RosterSlot));
+    slot->index = index;
+    slot->by_name = g_sequence_insert_sorted(index->by_name, contact, _seq_compare_name, NULL);
+    slot->by_presence = g_sequence_insert_sorted(index->by_presence, contact, _seq_compare_presence, NULL);
+
+    return g_slist_prepend(slots, slot);
+}
+
+static void
+_index_contact(PContact contact)
+{
+    GSList* slots = _index_add(NULL, roster->all, contact);
+
+    GSList* groups = p_contact_groups(contact);
+    if (groups == NULL) {
+        slots = _index_add(slots, roster->ungrouped, contact);
+    }
+    while (groups) {
+        RosterIndex* index = g_hash_table_lookup(roster->group_index, groups->data);
+        if (index == NULL) {
+            index = _index_new();
+            g_hash_table_insert(roster->group_index, (gpointer)intern(groups->data), index);
+        }
+
+        // a group listed twice is only indexed once
+        gboolean indexed = FALSE;
+        GSList* curr = slots;
+        while (curr && !indexed) {
+            indexed = ((RosterSlot*)curr->data)->index == index;
+            curr = g_slist_next(curr);
+        }
+        if (!indexed) {
+            slots = _index_add(slots, index, contact);
+        }
+        groups = g_slist_next(groups);
+    }
+
+    g_hash_table_insert(roster->slots, contact, slots);
+}
+
+static void
+_unindex_contact(PContact contact)
+{
+    GSList* slots = g_hash_table_lookup(roster->slots, contact);
+    if (slots == NULL) {
+        return;
+    }
+    g_hash_table_remove(roster->slots, contact);
+
+    GSList* curr = slots;
+    while (curr) {
+        RosterSlot* slot = curr->data;
+        g_sequence_remove(slot->by_name);
+        g_sequence_remove(slot->by_presence);
+        curr = g_slist_next(curr);
+    }
+    g_slist_free_full(slots, free);
+
+    // drop group indexes left empty
+    GSList* groups = p_contact_groups(contact);
+    while (groups) {
+        RosterIndex* index = g_hash_table_lookup(roster->group_index, groups->data);
+        if (index && g_sequence_is_empty(index->by_name)) {
+            g_hash_table_remove(roster->group_index, groups->data);
+        }
+        groups = g_slist_next(groups);
+    }
+}
+
+static void
+_reindex_contact(PContact contact, gboolean name_changed)
+{
+    GSList* curr = g_hash_table_lookup(roster->slots, contact);
+    while (curr) {
+        RosterSlot* slot = curr->data;
+        if (name_changed) {
+            g_sequence_sort_changed(slot->by_name, _seq_compare_name, NULL);
+        }
+        g_sequence_sort_changed(slot->by_presence, _seq_compare_presence, NULL);
+        curr = g_slist_next(curr);
     }
 }
 
+static GSList*
+_sequence_to_list(GSequence* seq)
+{
+    GSList* result = NULL;
+    GSequenceIter* iter = g_sequence_get_end_iter(seq);
+    while (!g_sequence_iter_is_begin(iter)) {
+        iter = g_sequence_iter_prev(iter);
+        result = g_slist_prepend(result, g_sequence_get(iter));
+    }
+
+    return result;
+}
+
 static void
 _pendingPresence_free(ProfPendingPresence* presence)
 {
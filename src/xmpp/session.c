@@ -44,6 +44,8 @@
 #include "common.h"
 #include "config/preferences.h"
 #include "plugins/plugins.h"
+#include "tools/perf.h"
+#include "tools/scheduler.h"
 #include "event/server_events.h"
 #include "event/client_events.h"
 #include "xmpp/bookmark.h"
@@ -95,12 +97,39 @@ static GTimer* reconnect_timer;
 static activity_state_t activity_state;
 static resource_presence_t saved_presence;
 static char* saved_status;
+static SchedulerTask* autoaway_task;
+// when the autoaway check runs next, set by each check
+static gint autoaway_delay;
+// XEP-0352 state last sent, the server assumes active for a new stream
+static gboolean csi_inactive = FALSE;
+// roster, rooms and windows were kept after losing the connection, for a stream resumption
+static gboolean resume_pending = FALSE;
 
 static void _session_reconnect(void);
+static void _session_resumed(gboolean secured);
+static void _session_resume_abandon(void);
+
+static void _session_csi_update(gboolean active);
 
 static void _session_free_internals(void);
 static void _session_free_saved_details(void);
 
+// While active nothing can happen before the away time is reached, so the
+// check waits for that, though for no more than a minute in case the
+// settings change. Once away or idle it checks every second to notice
+// the user coming back.
+#define AUTOAWAY_CHECK_MIN_MS 1000
+#define AUTOAWAY_CHECK_MAX_MS 60000
+
+static gboolean
+_session_autoaway_task(void* data)
+{
+    autoaway_delay = AUTOAWAY_CHECK_MAX_MS;
+    session_check_autoaway();
+    scheduler_set_interval(autoaway_task, autoaway_delay);
+    return TRUE;
+}
+
 void
 session_init(void)
 {
@@ -108,6 +137,7 @@ session_init(void)
     connection_init();
     presence_sub_requests_init();
     caps_init();
+    autoaway_task = scheduler_add(AUTOAWAY_CHECK_MIN_MS, _session_autoaway_task, NULL, NULL);
 }
 
 jabber_conn_status_t
@@ -117,6 +147,7 @@ session_connect_with_account(const ProfAccount* const account)
 
     log_info("Connecting using account: %s", account->name);
 
+    _session_resume_abandon();
     _session_free_internals();
 
     // save account name and password for reconnect
@@ -151,6 +182,7 @@ session_connect_with_details(const char* const jid, const char* const passwd, co
     assert(jid != NULL);
     assert(passwd != NULL);
 
+    _session_resume_abandon();
     _session_free_internals();
 
     // save details for reconnect, remember name for account creating on success
@@ -230,20 +262,28 @@ session_disconnect(void)
         connection_clear_data();
         chat_sessions_clear();
         presence_clear_sub_requests();
+        presence_clear_room_presence();
     }
 
+    roster_cache_flush();
+    connection_sm_discard();
     connection_set_disconnected();
 }
 
 void
 session_shutdown(void)
 {
+    scheduler_remove(autoaway_task);
+    autoaway_task = NULL;
+
     _session_free_internals();
 
     chat_sessions_clear();
     presence_clear_sub_requests();
+    presence_clear_room_presence();
 
     connection_shutdown();
+    jid_cache_clear();
     if (saved_status) {
         free(saved_status);
     }
@@ -253,6 +293,7 @@ void
 session_process_events(void)
 {
     int reconnect_sec;
+    gint64 started = perf_start();
 
     jabber_conn_status_t conn_status = connection_get_status();
     switch (conn_status) {
@@ -278,6 +319,8 @@ session_process_events(void)
     default:
         break;
     }
+
+    perf_stop(PERF_EVENTS, started);
 }
 
 char*
@@ -319,7 +362,13 @@ _receive_mood(xmpp_stanza_t* const stanza, void* const userdata)
 void
 session_login_success(gboolean secured)
 {
+    if (connection_stream_resumed()) {
+        _session_resumed(secured);
+        return;
+    }
+
     chat_sessions_init();
+    csi_inactive = FALSE;
 
     message_handlers_init();
     presence_handlers_init();
@@ -382,11 +431,22 @@ session_login_failed(void)
     connection_clear_data();
     chat_sessions_clear();
     presence_clear_sub_requests();
+    presence_clear_room_presence();
 }
 
 void
 session_lost_connection(void)
 {
+    // keep everything for now, the next connect may resume the stream
+    if (prefs_get_reconnect() != 0 && connection_sm_resumable()) {
+        resume_pending = TRUE;
+        iq_autoping_timer_cancel();
+        sv_ev_stream_suspended();
+        assert(reconnect_timer == NULL);
+        reconnect_timer = g_timer_new();
+        return;
+    }
+
     /* this callback also clears all cached data */
     sv_ev_lost_connection();
     if (prefs_get_reconnect() != 0) {
@@ -397,6 +457,17 @@ session_lost_connection(void)
     }
 }
 
+// A connect that did not resume the stream, drop what was kept for it
+// before logging in from scratch
+void
+session_resume_failed(void)
+{
+    if (resume_pending) {
+        log_info("Stream not resumed, logging in again");
+    }
+    _session_resume_abandon();
+}
+
 void
 session_init_activity(void)
 {
@@ -425,6 +496,15 @@ session_check_autoaway(void)
 
     unsigned long idle_ms = ui_get_idle_time();
 
+    // let the server hold back presences and chat states while nobody is looking
+    _session_csi_update(idle_ms < away_time_ms);
+
+    if (activity_state == ACTIVITY_ST_ACTIVE && idle_ms < away_time_ms) {
+        autoaway_delay = CLAMP(away_time_ms - idle_ms, AUTOAWAY_CHECK_MIN_MS, AUTOAWAY_CHECK_MAX_MS);
+    } else {
+        autoaway_delay = AUTOAWAY_CHECK_MIN_MS;
+    }
+
     switch (activity_state) {
     case ACTIVITY_ST_ACTIVE:
         if (idle_ms >= away_time_ms) {
@@ -535,6 +615,23 @@ session_check_autoaway(void)
     g_free(mode);
 }
 
+static void
+_session_csi_update(gboolean active)
+{
+    // nothing changed, or the state would go inactive without the setting on
+    if (active != csi_inactive || (!active && !prefs_get_boolean(PREF_AUTOAWAY_CSI))) {
+        return;
+    }
+
+    xmpp_ctx_t* const ctx = connection_get_ctx();
+    xmpp_stanza_t* csi = stanza_create_csi(ctx, active);
+    xmpp_send(connection_get_conn(), csi);
+    xmpp_stanza_release(csi);
+
+    csi_inactive = !active;
+    log_debug("Client state set to %s", active ? "active" : "inactive");
+}
+
 static struct
 {
     gchar* altdomain;
@@ -586,6 +683,46 @@ _session_reconnect(void)
     g_timer_start(reconnect_timer);
 }
 
+static void
+_session_resumed(gboolean secured)
+{
+    resume_pending = FALSE;
+
+    // the new connection object needs the stanza handlers again, their state is kept
+    message_handlers_attach();
+    presence_handlers_init();
+    iq_handlers_attach();
+
+    if ((prefs_get_reconnect() != 0) && reconnect_timer) {
+        g_timer_destroy(reconnect_timer);
+        reconnect_timer = NULL;
+    }
+
+    sv_ev_stream_resumed(secured);
+}
+
+static void
+_session_resume_abandon(void)
+{
+    connection_sm_discard();
+
+    if (!resume_pending) {
+        return;
+    }
+    resume_pending = FALSE;
+
+    // what session_disconnect() would have done when the connection was lost
+    iq_rooms_cache_clear();
+    iq_handlers_clear();
+    message_handlers_clear();
+    connection_clear_data();
+    chat_sessions_clear();
+    presence_clear_sub_requests();
+    presence_clear_room_presence();
+
+    sv_ev_lost_connection();
+}
+
 static void
 _session_free_internals(void)
 {
@@ -41,6 +41,7 @@
 void session_login_success(gboolean secured);
 void session_login_failed(void);
 void session_lost_connection(void);
+void session_resume_failed(void);
 void session_autoping_fail(void);
 
 void session_init_activity(void);
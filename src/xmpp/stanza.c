@@ -52,6 +52,7 @@
 
 #include "common.h"
 #include "log.h"
+#include "tools/timefmt.h"
 #include "xmpp/session.h"
 #include "xmpp/stanza.h"
 #include "xmpp/capabilities.h"
@@ -61,6 +62,8 @@
 
 static void _stanza_add_unique_id(xmpp_stanza_t* stanza);
 static char* _stanza_create_sha1_hash(char* str);
+static void _stanza_add_form_field(xmpp_ctx_t* ctx, xmpp_stanza_t* form, const char* const var, const char* const type, const char* const value);
+static void _stanza_add_child_text(xmpp_ctx_t* ctx, xmpp_stanza_t* parent, const char* const name, const char* const value);
 
 #if 0
 xmpp_stanza_t*
@@ -107,6 +110,84 @@ stanza_create_bookmarks_storage_request(xmpp_ctx_t* ctx)
     return iq;
 }
 
+xmpp_stanza_t*
+stanza_create_bookmarks_pep_request(xmpp_ctx_t* ctx, const char* const id)
+{
+    xmpp_stanza_t* iq = xmpp_iq_new(ctx, STANZA_TYPE_GET, id);
+
+    xmpp_stanza_t* pubsub = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(pubsub, STANZA_NAME_PUBSUB);
+    xmpp_stanza_set_ns(pubsub, STANZA_NS_PUBSUB);
+
+    xmpp_stanza_t* items = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(items, STANZA_NAME_ITEMS);
+    xmpp_stanza_set_attribute(items, STANZA_ATTR_NODE, STANZA_NS_BOOKMARKS);
+
+    xmpp_stanza_add_child(pubsub, items);
+    xmpp_stanza_add_child(iq, pubsub);
+    xmpp_stanza_release(items);
+    xmpp_stanza_release(pubsub);
+
+    return iq;
+}
+
+// Publishes one conference element as the item for barejid
+xmpp_stanza_t*
+stanza_create_bookmarks_pep_publish(xmpp_ctx_t* ctx, const char* const id, const char* const barejid, xmpp_stanza_t* const conference)
+{
+    xmpp_stanza_t* iq = xmpp_iq_new(ctx, STANZA_TYPE_SET, id);
+
+    xmpp_stanza_t* pubsub = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(pubsub, STANZA_NAME_PUBSUB);
+    xmpp_stanza_set_ns(pubsub, STANZA_NS_PUBSUB);
+
+    xmpp_stanza_t* publish = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(publish, STANZA_NAME_PUBLISH);
+    xmpp_stanza_set_attribute(publish, STANZA_ATTR_NODE, STANZA_NS_BOOKMARKS);
+
+    xmpp_stanza_t* item = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(item, STANZA_NAME_ITEM);
+    xmpp_stanza_set_id(item, barejid);
+
+    xmpp_stanza_add_child(item, conference);
+    xmpp_stanza_add_child(publish, item);
+    xmpp_stanza_add_child(pubsub, publish);
+    xmpp_stanza_add_child(iq, pubsub);
+    xmpp_stanza_release(item);
+    xmpp_stanza_release(publish);
+    xmpp_stanza_release(pubsub);
+
+    return iq;
+}
+
+xmpp_stanza_t*
+stanza_create_bookmarks_pep_retract(xmpp_ctx_t* ctx, const char* const id, const char* const barejid)
+{
+    xmpp_stanza_t* iq = xmpp_iq_new(ctx, STANZA_TYPE_SET, id);
+
+    xmpp_stanza_t* pubsub = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(pubsub, STANZA_NAME_PUBSUB);
+    xmpp_stanza_set_ns(pubsub, STANZA_NS_PUBSUB);
+
+    xmpp_stanza_t* retract = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(retract, STANZA_NAME_RETRACT);
+    xmpp_stanza_set_attribute(retract, STANZA_ATTR_NODE, STANZA_NS_BOOKMARKS);
+    xmpp_stanza_set_attribute(retract, "notify", "true");
+
+    xmpp_stanza_t* item = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(item, STANZA_NAME_ITEM);
+    xmpp_stanza_set_id(item, barejid);
+
+    xmpp_stanza_add_child(retract, item);
+    xmpp_stanza_add_child(pubsub, retract);
+    xmpp_stanza_add_child(iq, pubsub);
+    xmpp_stanza_release(item);
+    xmpp_stanza_release(retract);
+    xmpp_stanza_release(pubsub);
+
+    return iq;
+}
+
 xmpp_stanza_t*
 stanza_create_blocked_list_request(xmpp_ctx_t* ctx)
 {
@@ -282,22 +363,6 @@ stanza_disable_carbons(xmpp_ctx_t* ctx)
     return iq;
 }
 
-xmpp_stanza_t*
-stanza_create_chat_state(xmpp_ctx_t* ctx, const char* const fulljid, const char* const state)
-{
-    char* id = connection_create_stanza_id();
-    xmpp_stanza_t* msg = xmpp_message_new(ctx, STANZA_TYPE_CHAT, fulljid, id);
-    free(id);
-
-    xmpp_stanza_t* chat_state = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(chat_state, state);
-    xmpp_stanza_set_ns(chat_state, STANZA_NS_CHATSTATES);
-    xmpp_stanza_add_child(msg, chat_state);
-    xmpp_stanza_release(chat_state);
-
-    return msg;
-}
-
 xmpp_stanza_t*
 stanza_create_room_subject_message(xmpp_ctx_t* ctx, const char* const room, const char* const subject)
 {
@@ -390,6 +455,18 @@ stanza_attach_receipt_request(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza)
     return stanza;
 }
 
+xmpp_stanza_t*
+stanza_attach_markable(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza)
+{
+    xmpp_stanza_t* markable = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(markable, STANZA_NAME_MARKABLE);
+    xmpp_stanza_set_ns(markable, STANZA_NS_CHAT_MARKERS);
+    xmpp_stanza_add_child(stanza, markable);
+    xmpp_stanza_release(markable);
+
+    return stanza;
+}
+
 xmpp_stanza_t*
 stanza_attach_x_oob_url(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza, const char* const url)
 {
@@ -568,6 +645,23 @@ stanza_create_room_join_presence(xmpp_ctx_t* const ctx,
     return presence;
 }
 
+// Limits the history a room sends on joining to the messages since the
+// given UTC time (XEP-0045 7.2.15)
+void
+stanza_attach_room_history_since(xmpp_ctx_t* const ctx, xmpp_stanza_t* const presence, const char* const since)
+{
+    xmpp_stanza_t* x = xmpp_stanza_get_child_by_ns(presence, STANZA_NS_MUC);
+    if (!x) {
+        return;
+    }
+
+    xmpp_stanza_t* history = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(history, STANZA_NAME_HISTORY);
+    xmpp_stanza_set_attribute(history, STANZA_ATTR_SINCE, since);
+    xmpp_stanza_add_child(x, history);
+    xmpp_stanza_release(history);
+}
+
 xmpp_stanza_t*
 stanza_create_room_newnick_presence(xmpp_ctx_t* ctx,
                                     const char* const full_room_jid)
@@ -872,13 +966,17 @@ stanza_create_software_version_iq(xmpp_ctx_t* ctx, const char* const fulljid)
 }
 
 xmpp_stanza_t*
-stanza_create_roster_iq(xmpp_ctx_t* ctx)
+stanza_create_roster_iq(xmpp_ctx_t* ctx, const char* const ver)
 {
     xmpp_stanza_t* iq = xmpp_iq_new(ctx, STANZA_TYPE_GET, "roster");
 
     xmpp_stanza_t* query = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(query, STANZA_NAME_QUERY);
     xmpp_stanza_set_ns(query, XMPP_NS_ROSTER);
+    // XEP-0237, only the changes since this version are sent
+    if (ver) {
+        xmpp_stanza_set_attribute(query, STANZA_ATTR_VER, ver);
+    }
 
     xmpp_stanza_add_child(iq, query);
     xmpp_stanza_release(query);
@@ -926,6 +1024,30 @@ stanza_create_disco_items_iq(xmpp_ctx_t* ctx, const char* const id,
     return iq;
 }
 
+// XEP-0059 page of at most max items, the first one or the one after after
+xmpp_stanza_t*
+stanza_create_disco_items_page_iq(xmpp_ctx_t* ctx, const char* const id, const char* const jid, int max, const char* const after)
+{
+    xmpp_stanza_t* iq = stanza_create_disco_items_iq(ctx, id, jid, NULL);
+    xmpp_stanza_t* query = xmpp_stanza_get_child_by_ns(iq, XMPP_NS_DISCO_ITEMS);
+
+    xmpp_stanza_t* set = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(set, STANZA_TYPE_SET);
+    xmpp_stanza_set_ns(set, STANZA_NS_RSM);
+
+    char* max_str = g_strdup_printf("%d", max);
+    _stanza_add_child_text(ctx, set, STANZA_NAME_MAX, max_str);
+    g_free(max_str);
+    if (after) {
+        _stanza_add_child_text(ctx, set, STANZA_NAME_AFTER, after);
+    }
+
+    xmpp_stanza_add_child(query, set);
+    xmpp_stanza_release(set);
+
+    return iq;
+}
+
 xmpp_stanza_t*
 stanza_create_last_activity_iq(xmpp_ctx_t* ctx, const char* const id, const char* const to)
 {
@@ -1036,6 +1158,17 @@ stanza_create_ping_iq(xmpp_ctx_t* ctx, const char* const target)
     return iq;
 }
 
+// XEP-0352 client state, a top level element outside iq/message/presence
+xmpp_stanza_t*
+stanza_create_csi(xmpp_ctx_t* ctx, gboolean active)
+{
+    xmpp_stanza_t* csi = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(csi, active ? STANZA_NAME_ACTIVE : STANZA_NAME_INACTIVE);
+    xmpp_stanza_set_ns(csi, STANZA_NS_CSI);
+
+    return csi;
+}
+
 char*
 stanza_create_caps_sha1_from_query(xmpp_stanza_t* const query)
 {
@@ -1157,56 +1290,31 @@ stanza_get_child_by_name_and_from(xmpp_stanza_t* const stanza, const char* const
     return child;
 }
 
-GDateTime*
+gint64
 stanza_get_delay(xmpp_stanza_t* const stanza)
 {
     return stanza_get_delay_from(stanza, NULL);
 }
 
-static GDateTime*
-_stanza_get_delay_timestamp_xep0203(xmpp_stanza_t* const delay_stanza)
+// The stamp of a delay element in the namespace, 0 when it has none
+static gint64
+_stanza_get_delay_timestamp(xmpp_stanza_t* const delay_stanza, const char* const ns)
 {
-    GTimeVal utc_stamp;
     const char* xmlns = xmpp_stanza_get_attribute(delay_stanza, STANZA_ATTR_XMLNS);
 
-    if (xmlns && (g_strcmp0(xmlns, "urn:xmpp:delay") == 0)) {
+    if (xmlns && (g_strcmp0(xmlns, ns) == 0)) {
         const char* stamp = xmpp_stanza_get_attribute(delay_stanza, STANZA_ATTR_STAMP);
+        gint64 time_us;
 
-        if (stamp && (g_time_val_from_iso8601(stamp, &utc_stamp))) {
-
-            GDateTime* datetime = g_date_time_new_from_iso8601(stamp, NULL);
-            GDateTime* local_datetime = g_date_time_to_local(datetime);
-            g_date_time_unref(datetime);
-
-            return local_datetime;
-        }
-    }
-
-    return NULL;
-}
-
-static GDateTime*
-_stanza_get_delay_timestamp_xep0091(xmpp_stanza_t* const x_stanza)
-{
-    GTimeVal utc_stamp;
-    const char* xmlns = xmpp_stanza_get_attribute(x_stanza, STANZA_ATTR_XMLNS);
-
-    if (xmlns && (g_strcmp0(xmlns, "jabber:x:delay") == 0)) {
-        const char* stamp = xmpp_stanza_get_attribute(x_stanza, STANZA_ATTR_STAMP);
-        if (stamp && (g_time_val_from_iso8601(stamp, &utc_stamp))) {
-
-            GDateTime* datetime = g_date_time_new_from_iso8601(stamp, NULL);
-            GDateTime* local_datetime = g_date_time_to_local(datetime);
-            g_date_time_unref(datetime);
-
-            return local_datetime;
+        if (timefmt_parse_stamp(stamp, &time_us)) {
+            return time_us;
         }
     }
 
-    return NULL;
+    return 0;
 }
 
-GDateTime*
+gint64
 stanza_get_delay_from(xmpp_stanza_t* const stanza, gchar* from)
 {
     xmpp_stanza_t* delay = NULL;
@@ -1219,7 +1327,7 @@ stanza_get_delay_from(xmpp_stanza_t* const stanza, gchar* from)
     }
 
     if (delay) {
-        return _stanza_get_delay_timestamp_xep0203(delay);
+        return _stanza_get_delay_timestamp(delay, "urn:xmpp:delay");
     }
 
     // otherwise check for XEP-0091 legacy delayed delivery
@@ -1231,47 +1339,32 @@ stanza_get_delay_from(xmpp_stanza_t* const stanza, gchar* from)
     }
 
     if (delay) {
-        return _stanza_get_delay_timestamp_xep0091(delay);
+        return _stanza_get_delay_timestamp(delay, "jabber:x:delay");
     }
 
-    return NULL;
+    return 0;
 }
 
-GDateTime*
+gint64
 stanza_get_oldest_delay(xmpp_stanza_t* const stanza)
 {
     xmpp_stanza_t* child;
     const char* child_name;
-    GDateTime* oldest = NULL;
+    gint64 oldest = 0;
 
     for (child = xmpp_stanza_get_children(stanza); child; child = xmpp_stanza_get_next(child)) {
 
         child_name = xmpp_stanza_get_name(child);
+        gint64 time_us = 0;
 
         if (child_name && g_strcmp0(child_name, STANZA_NAME_DELAY) == 0) {
-            GDateTime* tmp = _stanza_get_delay_timestamp_xep0203(child);
-
-            if (oldest == NULL) {
-                oldest = tmp;
-            } else if (g_date_time_compare(oldest, tmp) == 1) {
-                g_date_time_unref(oldest);
-                oldest = tmp;
-            } else {
-                g_date_time_unref(tmp);
-            }
+            time_us = _stanza_get_delay_timestamp(child, "urn:xmpp:delay");
+        } else if (child_name && g_strcmp0(child_name, STANZA_NAME_X) == 0) {
+            time_us = _stanza_get_delay_timestamp(child, "jabber:x:delay");
         }
 
-        if (child_name && g_strcmp0(child_name, STANZA_NAME_X) == 0) {
-            GDateTime* tmp = _stanza_get_delay_timestamp_xep0091(child);
-
-            if (oldest == NULL) {
-                oldest = tmp;
-            } else if (g_date_time_compare(oldest, tmp) == 1) {
-                g_date_time_unref(oldest);
-                oldest = tmp;
-            } else {
-                g_date_time_unref(tmp);
-            }
+        if (time_us != 0 && (oldest == 0 || time_us < oldest)) {
+            oldest = time_us;
         }
     }
 
@@ -1726,6 +1819,96 @@ stanza_parse_caps(xmpp_stanza_t* const stanza)
     return caps;
 }
 
+static void
+_stanza_keep_first(xmpp_stanza_t** slot, xmpp_stanza_t* const child)
+{
+    if (*slot == NULL) {
+        *slot = child;
+    }
+}
+
+static gboolean
+_stanza_is_chat_state(const char* const name)
+{
+    return (g_strcmp0(name, STANZA_NAME_ACTIVE) == 0) || (g_strcmp0(name, STANZA_NAME_COMPOSING) == 0) || (g_strcmp0(name, STANZA_NAME_PAUSED) == 0) || (g_strcmp0(name, STANZA_NAME_GONE) == 0) || (g_strcmp0(name, STANZA_NAME_INACTIVE) == 0);
+}
+
+void
+stanza_parse_message(xmpp_stanza_t* const stanza, MessageElements* const elements)
+{
+    memset(elements, 0, sizeof(MessageElements));
+
+    xmpp_stanza_t* child = xmpp_stanza_get_children(stanza);
+    for (; child; child = xmpp_stanza_get_next(child)) {
+        const char* name = xmpp_stanza_get_name(child);
+        if (!name) {
+            continue;
+        }
+        const char* ns = xmpp_stanza_get_ns(child);
+
+        // matched by name only
+        if (g_strcmp0(name, STANZA_NAME_BODY) == 0) {
+            _stanza_keep_first(&elements->body, child);
+        } else if (g_strcmp0(name, STANZA_NAME_SUBJECT) == 0) {
+            _stanza_keep_first(&elements->subject, child);
+        } else if (g_strcmp0(name, STANZA_NAME_ERROR) == 0) {
+            _stanza_keep_first(&elements->error, child);
+        } else if (_stanza_is_chat_state(name)) {
+            _stanza_keep_first(&elements->chat_state, child);
+        }
+
+        if (ns == NULL) {
+            continue;
+        }
+
+        // matched by name and namespace
+        if (g_strcmp0(ns, STANZA_NS_CARBONS) == 0) {
+            // <private/> only tells the server not to copy
+            if ((g_strcmp0(name, STANZA_NAME_SENT) == 0) || (g_strcmp0(name, STANZA_NAME_RECEIVED) == 0)) {
+                _stanza_keep_first(&elements->carbon, child);
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_MAM2) == 0) {
+            if (g_strcmp0(name, STANZA_NAME_RESULT) == 0) {
+                _stanza_keep_first(&elements->mam_result, child);
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_STABLE_ID) == 0) {
+            if (g_strcmp0(name, STANZA_NAME_STANZA_ID) == 0) {
+                _stanza_keep_first(&elements->stanza_id, child);
+            } else if (g_strcmp0(name, STANZA_NAME_ORIGIN_ID) == 0) {
+                _stanza_keep_first(&elements->origin_id, child);
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_DATA) == 0) {
+            if (g_strcmp0(name, STANZA_NAME_X) == 0) {
+                _stanza_keep_first(&elements->form, child);
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_JINGLE_MESSAGE) == 0) {
+            if (g_strcmp0(name, STANZA_NAME_PROPOSE) == 0) {
+                _stanza_keep_first(&elements->propose, child);
+            }
+
+            // matched by namespace only
+        } else if (g_strcmp0(ns, STANZA_NS_RECEIPTS) == 0) {
+            _stanza_keep_first(&elements->receipt, child);
+        } else if (g_strcmp0(ns, STANZA_NS_CHAT_MARKERS) == 0) {
+            _stanza_keep_first(&elements->marker, child);
+        } else if (g_strcmp0(ns, STANZA_NS_LAST_MESSAGE_CORRECTION) == 0) {
+            _stanza_keep_first(&elements->replace, child);
+        } else if (g_strcmp0(ns, STANZA_NS_MUC_USER) == 0) {
+            _stanza_keep_first(&elements->muc_user, child);
+        } else if (g_strcmp0(ns, STANZA_NS_CONFERENCE) == 0) {
+            _stanza_keep_first(&elements->conference, child);
+        } else if (g_strcmp0(ns, STANZA_NS_CAPTCHA) == 0) {
+            _stanza_keep_first(&elements->captcha, child);
+        } else if (g_strcmp0(ns, STANZA_NS_PUBSUB_EVENT) == 0) {
+            _stanza_keep_first(&elements->pubsub_event, child);
+        } else if (g_strcmp0(ns, STANZA_NS_ENCRYPTED) == 0) {
+            _stanza_keep_first(&elements->encrypted, child);
+        } else if (g_strcmp0(ns, STANZA_NS_OPENPGP_0) == 0) {
+            _stanza_keep_first(&elements->openpgp, child);
+        }
+    }
+}
+
 EntityCapabilities*
 stanza_create_caps_from_query_element(xmpp_stanza_t* query)
 {
@@ -2160,7 +2343,7 @@ stanza_parse_presence(xmpp_stanza_t* stanza, int* err)
         return NULL;
     }
 
-    Jid* from_jid = jid_create(from);
+    Jid* from_jid = jid_intern(from);
     if (!from_jid) {
         *err = STANZA_PARSE_ERROR_INVALID_FROM;
         return NULL;
@@ -2599,107 +2782,97 @@ stanza_attach_correction(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza, const char* con
     return stanza;
 }
 
+static void
+_stanza_add_form_field(xmpp_ctx_t* ctx, xmpp_stanza_t* form, const char* const var, const char* const type, const char* const value)
+{
+    xmpp_stanza_t* field = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(field, STANZA_NAME_FIELD);
+    xmpp_stanza_set_attribute(field, STANZA_ATTR_VAR, var);
+    if (type) {
+        xmpp_stanza_set_type(field, type);
+    }
+
+    xmpp_stanza_t* value_st = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(value_st, STANZA_NAME_VALUE);
+
+    xmpp_stanza_t* text = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_text(text, value);
+    xmpp_stanza_add_child(value_st, text);
+    xmpp_stanza_add_child(field, value_st);
+    xmpp_stanza_add_child(form, field);
+
+    xmpp_stanza_release(text);
+    xmpp_stanza_release(value_st);
+    xmpp_stanza_release(field);
+}
+
+static void
+_stanza_add_child_text(xmpp_ctx_t* ctx, xmpp_stanza_t* parent, const char* const name, const char* const value)
+{
+    xmpp_stanza_t* child = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(child, name);
+
+    xmpp_stanza_t* text = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_text(text, value);
+    xmpp_stanza_add_child(child, text);
+    xmpp_stanza_add_child(parent, child);
+
+    xmpp_stanza_release(text);
+    xmpp_stanza_release(child);
+}
+
+// jid and enddate may be NULL to query the whole archive up to now,
+// lastid and max set up XEP-0059 paging when given
 xmpp_stanza_t*
-stanza_create_mam_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const startdate, const char* const lastid)
+stanza_create_mam_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const startdate, const char* const enddate,
+                     const char* const lastid, int max)
 {
     char* id = connection_create_stanza_id();
     xmpp_stanza_t* iq = xmpp_iq_new(ctx, STANZA_TYPE_SET, id);
-    free(id);
-    // xmpp_stanza_set_to(iq, jid);
 
+    // results carry the query id, the same as the iq id
     xmpp_stanza_t* query = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(query, STANZA_NAME_QUERY);
     xmpp_stanza_set_ns(query, STANZA_NS_MAM2);
+    xmpp_stanza_set_attribute(query, STANZA_ATTR_QUERYID, id);
+    free(id);
 
     xmpp_stanza_t* x = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(x, STANZA_NAME_X);
     xmpp_stanza_set_ns(x, STANZA_NS_DATA);
     xmpp_stanza_set_type(x, "submit");
 
-    // field FORM_TYPE MAM2
-    xmpp_stanza_t* field_form_type = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(field_form_type, STANZA_NAME_FIELD);
-    xmpp_stanza_set_attribute(field_form_type, STANZA_ATTR_VAR, "FORM_TYPE");
-    xmpp_stanza_set_type(field_form_type, "hidden");
-
-    xmpp_stanza_t* value_mam = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(value_mam, STANZA_NAME_VALUE);
-
-    xmpp_stanza_t* mam_text = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_text(mam_text, STANZA_NS_MAM2);
-    xmpp_stanza_add_child(value_mam, mam_text);
-
-    xmpp_stanza_add_child(field_form_type, value_mam);
-
-    // field 'with'
-    xmpp_stanza_t* field_with = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(field_with, STANZA_NAME_FIELD);
-    xmpp_stanza_set_attribute(field_with, STANZA_ATTR_VAR, "with");
-
-    xmpp_stanza_t* value_with = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(value_with, STANZA_NAME_VALUE);
-
-    xmpp_stanza_t* with_text = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_text(with_text, jid);
-    xmpp_stanza_add_child(value_with, with_text);
-
-    xmpp_stanza_add_child(field_with, value_with);
-
-    // field 'start'
-    xmpp_stanza_t* field_start = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(field_start, STANZA_NAME_FIELD);
-    xmpp_stanza_set_attribute(field_start, STANZA_ATTR_VAR, "start");
-
-    xmpp_stanza_t* value_start = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(value_start, STANZA_NAME_VALUE);
-
-    xmpp_stanza_t* date_text = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_text(date_text, startdate);
-    xmpp_stanza_add_child(value_start, date_text);
-
-    xmpp_stanza_add_child(field_start, value_start);
+    _stanza_add_form_field(ctx, x, "FORM_TYPE", "hidden", STANZA_NS_MAM2);
+    if (jid) {
+        _stanza_add_form_field(ctx, x, "with", NULL, jid);
+    }
+    _stanza_add_form_field(ctx, x, "start", NULL, startdate);
+    if (enddate) {
+        _stanza_add_form_field(ctx, x, "end", NULL, enddate);
+    }
+    xmpp_stanza_add_child(query, x);
 
     // 4.3.2 set/rsm
-    xmpp_stanza_t *after, *after_text, *set;
-    if (lastid) {
-        set = xmpp_stanza_new(ctx);
+    if (lastid || max > 0) {
+        xmpp_stanza_t* set = xmpp_stanza_new(ctx);
         xmpp_stanza_set_name(set, STANZA_TYPE_SET);
         xmpp_stanza_set_ns(set, STANZA_NS_RSM);
 
-        after = xmpp_stanza_new(ctx);
-        xmpp_stanza_set_name(after, STANZA_NAME_AFTER);
-
-        after_text = xmpp_stanza_new(ctx);
-        xmpp_stanza_set_text(after_text, lastid);
+        if (max > 0) {
+            char* max_str = g_strdup_printf("%d", max);
+            _stanza_add_child_text(ctx, set, STANZA_NAME_MAX, max_str);
+            g_free(max_str);
+        }
+        if (lastid) {
+            _stanza_add_child_text(ctx, set, STANZA_NAME_AFTER, lastid);
+        }
 
-        xmpp_stanza_add_child(after, after_text);
-        xmpp_stanza_add_child(set, after);
+        xmpp_stanza_add_child(query, set);
+        xmpp_stanza_release(set);
     }
 
-    // add and release
     xmpp_stanza_add_child(iq, query);
-    xmpp_stanza_add_child(query, x);
-    xmpp_stanza_add_child(x, field_form_type);
-    xmpp_stanza_add_child(x, field_with);
-    xmpp_stanza_add_child(x, field_start);
-
-    if (lastid) {
-        xmpp_stanza_add_child(query, after);
-
-        xmpp_stanza_release(after_text);
-        xmpp_stanza_release(after);
-        xmpp_stanza_release(set);
-    }
 
-    xmpp_stanza_release(mam_text);
-    xmpp_stanza_release(with_text);
-    xmpp_stanza_release(date_text);
-    xmpp_stanza_release(value_mam);
-    xmpp_stanza_release(value_with);
-    xmpp_stanza_release(value_start);
-    xmpp_stanza_release(field_form_type);
-    xmpp_stanza_release(field_with);
-    xmpp_stanza_release(field_start);
     xmpp_stanza_release(x);
     xmpp_stanza_release(query);
 
@@ -83,11 +83,14 @@
 #define STANZA_NAME_PUBSUB           "pubsub"
 #define STANZA_NAME_PUBLISH          "publish"
 #define STANZA_NAME_PUBLISH_OPTIONS  "publish-options"
+#define STANZA_NAME_RETRACT          "retract"
+#define STANZA_NAME_EXTENSIONS       "extensions"
 #define STANZA_NAME_SUBSCRIBE        "subscribe"
 #define STANZA_NAME_FIELD            "field"
 #define STANZA_NAME_STORAGE          "storage"
 #define STANZA_NAME_NICK             "nick"
 #define STANZA_NAME_PASSWORD         "password"
+#define STANZA_NAME_HISTORY          "history"
 #define STANZA_NAME_CONFERENCE       "conference"
 #define STANZA_NAME_VALUE            "value"
 #define STANZA_NAME_DESTROY          "destroy"
@@ -108,12 +111,17 @@
 #define STANZA_NAME_COMMAND          "command"
 #define STANZA_NAME_CONFIGURE        "configure"
 #define STANZA_NAME_ORIGIN_ID        "origin-id"
+#define STANZA_NAME_MARKABLE         "markable"
+#define STANZA_NAME_DISPLAYED        "displayed"
 #define STANZA_NAME_STANZA_ID        "stanza-id"
 #define STANZA_NAME_RESULT           "result"
 #define STANZA_NAME_MINIMIZE         "minimize"
 #define STANZA_NAME_FIN              "fin"
 #define STANZA_NAME_LAST             "last"
 #define STANZA_NAME_AFTER            "after"
+#define STANZA_NAME_MAX              "max"
+#define STANZA_NAME_COUNT            "count"
+#define STANZA_NAME_RESUMED          "resumed"
 #define STANZA_NAME_USERNAME         "username"
 #define STANZA_NAME_PROPOSE          "propose"
 #define STANZA_NAME_REPORT           "report"
@@ -176,9 +184,11 @@
 #define STANZA_ATTR_ASK            "ask"
 #define STANZA_ATTR_ID             "id"
 #define STANZA_ATTR_SECONDS        "seconds"
+#define STANZA_ATTR_SINCE          "since"
 #define STANZA_ATTR_NODE           "node"
 #define STANZA_ATTR_VER            "ver"
 #define STANZA_ATTR_VAR            "var"
+#define STANZA_ATTR_QUERYID        "queryid"
 #define STANZA_ATTR_HASH           "hash"
 #define STANZA_ATTR_CATEGORY       "category"
 #define STANZA_ATTR_REASON         "reason"
@@ -216,9 +226,12 @@
 #define STANZA_NS_PUBSUB_EVENT "http://jabber.org/protocol/pubsub#event"
 #define STANZA_NS_PUBSUB_ERROR "http://jabber.org/protocol/pubsub#errors"
 #define STANZA_NS_CARBONS      "urn:xmpp:carbons:2"
+#define STANZA_NS_SM           "urn:xmpp:sm:3"
+#define STANZA_NS_CSI          "urn:xmpp:csi:0"
 #define STANZA_NS_HINTS        "urn:xmpp:hints"
 #define STANZA_NS_FORWARD      "urn:xmpp:forward:0"
 #define STANZA_NS_RECEIPTS     "urn:xmpp:receipts"
+#define STANZA_NS_CHAT_MARKERS "urn:xmpp:chat-markers:0"
 #define STANZA_NS_SIGNED       "jabber:x:signed"
 #define STANZA_NS_ENCRYPTED    "jabber:x:encrypted"
 // XEP-0373: OpenPGP for XMPP
@@ -237,6 +250,8 @@
 #define STANZA_NS_LAST_MESSAGE_CORRECTION "urn:xmpp:message-correct:0"
 #define STANZA_NS_MAM2                    "urn:xmpp:mam:2"
 #define STANZA_NS_EXT_GAJIM_BOOKMARKS     "xmpp:gajim.org/bookmarks"
+#define STANZA_NS_BOOKMARKS               "urn:xmpp:bookmarks:1"
+#define STANZA_NS_BOOKMARKS_NOTIFY        "urn:xmpp:bookmarks:1+notify"
 #define STANZA_NS_RSM                     "http://jabber.org/protocol/rsm"
 #define STANZA_NS_REGISTER                "jabber:iq:register"
 #define STANZA_NS_VOICEREQUEST            "http://jabber.org/protocol/muc#request"
@@ -269,12 +284,40 @@ typedef struct presence_stanza_t
     GDateTime* last_activity;
 } XMPPPresence;
 
+// The extension elements message handlers look at, found in one walk over
+// the children. Each is the first child a get_child_by_* lookup would return.
+typedef struct message_elements_t
+{
+    xmpp_stanza_t* body;
+    xmpp_stanza_t* subject;
+    xmpp_stanza_t* error;
+    xmpp_stanza_t* chat_state;
+    xmpp_stanza_t* carbon;
+    xmpp_stanza_t* mam_result;
+    xmpp_stanza_t* stanza_id;
+    xmpp_stanza_t* origin_id;
+    xmpp_stanza_t* receipt;
+    xmpp_stanza_t* marker;
+    xmpp_stanza_t* replace;
+    xmpp_stanza_t* muc_user;
+    xmpp_stanza_t* conference;
+    xmpp_stanza_t* captcha;
+    xmpp_stanza_t* pubsub_event;
+    xmpp_stanza_t* form;
+    xmpp_stanza_t* propose;
+    xmpp_stanza_t* encrypted;
+    xmpp_stanza_t* openpgp;
+} MessageElements;
+
 typedef enum {
     STANZA_PARSE_ERROR_NO_FROM,
     STANZA_PARSE_ERROR_INVALID_FROM
 } stanza_parse_error_t;
 
 xmpp_stanza_t* stanza_create_bookmarks_storage_request(xmpp_ctx_t* ctx);
+xmpp_stanza_t* stanza_create_bookmarks_pep_request(xmpp_ctx_t* ctx, const char* const id);
+xmpp_stanza_t* stanza_create_bookmarks_pep_publish(xmpp_ctx_t* ctx, const char* const id, const char* const barejid, xmpp_stanza_t* const conference);
+xmpp_stanza_t* stanza_create_bookmarks_pep_retract(xmpp_ctx_t* ctx, const char* const id, const char* const barejid);
 
 xmpp_stanza_t* stanza_create_blocked_list_request(xmpp_ctx_t* ctx);
 
@@ -284,21 +327,20 @@ xmpp_stanza_t* stanza_enable_carbons(xmpp_ctx_t* ctx);
 
 xmpp_stanza_t* stanza_disable_carbons(xmpp_ctx_t* ctx);
 
-xmpp_stanza_t* stanza_create_chat_state(xmpp_ctx_t* ctx,
-                                        const char* const fulljid, const char* const state);
-
 xmpp_stanza_t* stanza_attach_state(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza, const char* const state);
 xmpp_stanza_t* stanza_attach_carbons_private(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza);
 xmpp_stanza_t* stanza_attach_hints_no_copy(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza);
 xmpp_stanza_t* stanza_attach_hints_no_store(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza);
 xmpp_stanza_t* stanza_attach_hints_store(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza);
 xmpp_stanza_t* stanza_attach_receipt_request(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza);
+xmpp_stanza_t* stanza_attach_markable(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza);
 xmpp_stanza_t* stanza_attach_x_oob_url(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza, const char* const url);
 xmpp_stanza_t* stanza_attach_origin_id(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza, const char* const id);
 xmpp_stanza_t* stanza_attach_correction(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza, const char* const replace_id);
 
 xmpp_stanza_t* stanza_create_room_join_presence(xmpp_ctx_t* const ctx,
                                                 const char* const full_room_jid, const char* const passwd);
+void stanza_attach_room_history_since(xmpp_ctx_t* const ctx, xmpp_stanza_t* const presence, const char* const since);
 
 xmpp_stanza_t* stanza_create_room_newnick_presence(xmpp_ctx_t* ctx,
                                                    const char* const full_room_jid);
@@ -306,8 +348,9 @@ xmpp_stanza_t* stanza_create_room_newnick_presence(xmpp_ctx_t* ctx,
 xmpp_stanza_t* stanza_create_room_leave_presence(xmpp_ctx_t* ctx,
                                                  const char* const room, const char* const nick);
 
-xmpp_stanza_t* stanza_create_roster_iq(xmpp_ctx_t* ctx);
+xmpp_stanza_t* stanza_create_roster_iq(xmpp_ctx_t* ctx, const char* const ver);
 xmpp_stanza_t* stanza_create_ping_iq(xmpp_ctx_t* ctx, const char* const target);
+xmpp_stanza_t* stanza_create_csi(xmpp_ctx_t* ctx, gboolean active);
 xmpp_stanza_t* stanza_create_disco_info_iq(xmpp_ctx_t* ctx, const char* const id,
                                            const char* const to, const char* const node);
 
@@ -321,9 +364,10 @@ xmpp_stanza_t* stanza_create_mediated_invite(xmpp_ctx_t* ctx, const char* const
 
 gboolean stanza_contains_chat_state(xmpp_stanza_t* stanza);
 
-GDateTime* stanza_get_delay(xmpp_stanza_t* const stanza);
-GDateTime* stanza_get_delay_from(xmpp_stanza_t* const stanza, gchar* from);
-GDateTime* stanza_get_oldest_delay(xmpp_stanza_t* const stanza);
+// unix time in microseconds of the delayed delivery, 0 when not delayed
+gint64 stanza_get_delay(xmpp_stanza_t* const stanza);
+gint64 stanza_get_delay_from(xmpp_stanza_t* const stanza, gchar* from);
+gint64 stanza_get_oldest_delay(xmpp_stanza_t* const stanza);
 
 gboolean stanza_is_muc_presence(xmpp_stanza_t* const stanza);
 gboolean stanza_is_muc_self_presence(xmpp_stanza_t* const stanza,
@@ -379,6 +423,7 @@ EntityCapabilities* stanza_create_caps_from_query_element(xmpp_stanza_t* query);
 const char* stanza_get_presence_string_from_type(resource_presence_t presence_type);
 xmpp_stanza_t* stanza_create_software_version_iq(xmpp_ctx_t* ctx, const char* const fulljid);
 xmpp_stanza_t* stanza_create_disco_items_iq(xmpp_ctx_t* ctx, const char* const id, const char* const jid, const char* const node);
+xmpp_stanza_t* stanza_create_disco_items_page_iq(xmpp_ctx_t* ctx, const char* const id, const char* const jid, int max, const char* const after);
 
 char* stanza_get_status(xmpp_stanza_t* stanza, char* def);
 char* stanza_get_show(xmpp_stanza_t* stanza, char* def);
@@ -406,10 +451,12 @@ void stanza_free_presence(XMPPPresence* presence);
 char* stanza_text_strdup(xmpp_stanza_t* stanza);
 
 XMPPCaps* stanza_parse_caps(xmpp_stanza_t* const stanza);
+void stanza_parse_message(xmpp_stanza_t* const stanza, MessageElements* const elements);
 void stanza_free_caps(XMPPCaps* caps);
 
 xmpp_stanza_t* stanza_create_avatar_retrieve_data_request(xmpp_ctx_t* ctx, const char* stanza_id, const char* const item_id, const char* const jid);
-xmpp_stanza_t* stanza_create_mam_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const startdate, const char* const lastid);
+xmpp_stanza_t* stanza_create_mam_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const startdate, const char* const enddate,
+                                    const char* const lastid, int max);
 xmpp_stanza_t* stanza_change_password(xmpp_ctx_t* ctx, const char* const user, const char* const password);
 xmpp_stanza_t* stanza_register_new_account(xmpp_ctx_t* ctx, const char* const user, const char* const password);
 xmpp_stanza_t* stanza_request_voice(xmpp_ctx_t* ctx, const char* const room);
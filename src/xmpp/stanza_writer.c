@@ -0,0 +1,163 @@
+/*
+ * stanza_writer.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "xmpp/stanza.h"
+#include "xmpp/stanza_writer.h"
+
+#define STANZA_WRITER_ESCAPED "&<>\"'"
+
+static void _stanza_writer_open(GString* out, const char* const id, const char* const to, const char* const type);
+static void _stanza_writer_empty(GString* out, const char* const name, const char* const ns);
+
+void
+stanza_writer_chat(GString* out, const char* const id, const char* const to, const char* const body,
+                   const char* const state, const char* const oob_url, gboolean request_receipt,
+                   gboolean markable, const char* const replace_id)
+{
+    _stanza_writer_open(out, id, to, STANZA_TYPE_CHAT);
+
+    g_string_append(out, "<" STANZA_NAME_BODY ">");
+    stanza_writer_escape(out, body);
+    g_string_append(out, "</" STANZA_NAME_BODY ">");
+
+    if (state) {
+        _stanza_writer_empty(out, state, STANZA_NS_CHATSTATES);
+    }
+    if (oob_url) {
+        g_string_append(out, "<" STANZA_NAME_X " xmlns=\"" STANZA_NS_X_OOB "\"><" STANZA_NAME_URL ">");
+        stanza_writer_escape(out, oob_url);
+        g_string_append(out, "</" STANZA_NAME_URL "></" STANZA_NAME_X ">");
+    }
+    if (request_receipt) {
+        _stanza_writer_empty(out, "request", STANZA_NS_RECEIPTS);
+    }
+    if (markable) {
+        _stanza_writer_empty(out, STANZA_NAME_MARKABLE, STANZA_NS_CHAT_MARKERS);
+    }
+    if (replace_id) {
+        g_string_append(out, "<replace id=\"");
+        stanza_writer_escape(out, replace_id);
+        g_string_append(out, "\" xmlns=\"" STANZA_NS_LAST_MESSAGE_CORRECTION "\"/>");
+    }
+
+    g_string_append(out, "</message>");
+}
+
+void
+stanza_writer_chat_state(GString* out, const char* const id, const char* const to, const char* const state)
+{
+    _stanza_writer_open(out, id, to, STANZA_TYPE_CHAT);
+    _stanza_writer_empty(out, state, STANZA_NS_CHATSTATES);
+    g_string_append(out, "</message>");
+}
+
+void
+stanza_writer_receipt(GString* out, const char* const id, const char* const to, const char* const receipt_id)
+{
+    _stanza_writer_open(out, id, to, NULL);
+    g_string_append(out, "<received id=\"");
+    stanza_writer_escape(out, receipt_id);
+    g_string_append(out, "\" xmlns=\"" STANZA_NS_RECEIPTS "\"/></message>");
+}
+
+// Escapes for both text and attribute values, as libstrophe does
+void
+stanza_writer_escape(GString* out, const char* const text)
+{
+    const char* curr = text;
+    while (*curr) {
+        size_t plain = strcspn(curr, STANZA_WRITER_ESCAPED);
+        g_string_append_len(out, curr, plain);
+        curr += plain;
+
+        switch (*curr) {
+        case '&':
+            g_string_append(out, "&amp;");
+            break;
+        case '<':
+            g_string_append(out, "&lt;");
+            break;
+        case '>':
+            g_string_append(out, "&gt;");
+            break;
+        case '"':
+            g_string_append(out, "&quot;");
+            break;
+        case '\'':
+            g_string_append(out, "&apos;");
+            break;
+        default:
+            // the end of the text
+            return;
+        }
+        curr++;
+    }
+}
+
+static void
+_stanza_writer_open(GString* out, const char* const id, const char* const to, const char* const type)
+{
+    g_string_truncate(out, 0);
+    g_string_append(out, "<message");
+    if (type) {
+        g_string_append(out, " type=\"");
+        stanza_writer_escape(out, type);
+        g_string_append_c(out, '"');
+    }
+    if (to) {
+        g_string_append(out, " to=\"");
+        stanza_writer_escape(out, to);
+        g_string_append_c(out, '"');
+    }
+    if (id) {
+        g_string_append(out, " id=\"");
+        stanza_writer_escape(out, id);
+        g_string_append_c(out, '"');
+    }
+    g_string_append_c(out, '>');
+}
+
+static void
+_stanza_writer_empty(GString* out, const char* const name, const char* const ns)
+{
+    g_string_append_printf(out, "<%s xmlns=\"%s\"/>", name, ns);
+}
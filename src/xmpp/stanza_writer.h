@@ -0,0 +1,52 @@
+/*
+ * stanza_writer.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2021 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+
+#ifndef XMPP_STANZA_WRITER_H
+#define XMPP_STANZA_WRITER_H
+
+#include <glib.h>
+
+// The stanzas sent most, written as text into out without building a
+// stanza tree first. out is emptied first, so one buffer serves them all.
+void stanza_writer_chat(GString* out, const char* const id, const char* const to, const char* const body,
+                        const char* const state, const char* const oob_url, gboolean request_receipt,
+                        gboolean markable, const char* const replace_id);
+void stanza_writer_chat_state(GString* out, const char* const id, const char* const to, const char* const state);
+void stanza_writer_receipt(GString* out, const char* const id, const char* const to, const char* const receipt_id);
+
+void stanza_writer_escape(GString* out, const char* const text);
+
+#endif
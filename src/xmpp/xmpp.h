@@ -46,6 +46,7 @@
 #include "config/tlscerts.h"
 #include "tools/autocomplete.h"
 #include "tools/http_upload.h"
+#include "tools/mempool.h"
 #include "xmpp/contact.h"
 #include "xmpp/jid.h"
 
@@ -55,6 +56,7 @@
 #define XMPP_FEATURE_PING                        "urn:xmpp:ping"
 #define XMPP_FEATURE_BLOCKING                    "urn:xmpp:blocking"
 #define XMPP_FEATURE_RECEIPTS                    "urn:xmpp:receipts"
+#define XMPP_FEATURE_CHAT_MARKERS                "urn:xmpp:chat-markers:0"
 #define XMPP_FEATURE_LASTACTIVITY                "jabber:iq:last"
 #define XMPP_FEATURE_MUC                         "http://jabber.org/protocol/muc"
 #define XMPP_FEATURE_COMMANDS                    "http://jabber.org/protocol/commands"
@@ -65,6 +67,7 @@
 #define XMPP_FEATURE_LAST_MESSAGE_CORRECTION     "urn:xmpp:message-correct:0"
 #define XMPP_FEATURE_MAM2                        "urn:xmpp:mam:2"
 #define XMPP_FEATURE_SPAM_REPORTING              "urn:xmpp:reporting:1"
+#define XMPP_FEATURE_BOOKMARKS_COMPAT            "urn:xmpp:bookmarks:1#compat"
 
 typedef enum {
     JABBER_CONNECTING,
@@ -169,11 +172,16 @@ typedef struct prof_message_t
     char* encrypted;
     /* The message that will be printed on screen and logs */
     char* plain;
-    GDateTime* timestamp;
+    /* unix time in microseconds, converted to local time when displayed */
+    gint64 timestamp;
     prof_enc_t enc;
     gboolean trusted;
     gboolean is_mam;
+    /* <markable/> XEP-0333, a displayed marker is sent once shown */
+    gboolean markable;
     prof_msg_type_t type;
+    /* the struct and its ids live in the message stanza arena, see message.c */
+    gboolean in_arena;
 } ProfMessage;
 
 void session_init(void);
@@ -187,6 +195,8 @@ void session_process_events(void);
 char* session_get_account_name(void);
 
 jabber_conn_status_t connection_get_status(void);
+int connection_get_fd(void);
+gboolean connection_has_pending(void);
 char* connection_get_presence_msg(void);
 void connection_set_presence_msg(const char* const message);
 const char* connection_get_fulljid(void);
@@ -203,6 +213,49 @@ char* connection_jid_for_feature(const char* const feature);
 
 const char* connection_get_profanity_identifier(void);
 
+typedef enum {
+    TRAFFIC_MESSAGE,
+    TRAFFIC_PRESENCE,
+    TRAFFIC_IQ,
+    // stream headers, stream management, negotiation
+    TRAFFIC_OTHER,
+    TRAFFIC_KIND_COUNT
+} traffic_kind_t;
+
+// bytes are of the XML before TLS and compression, since start or reset
+typedef struct traffic_stats_t
+{
+    guint64 sent;
+    guint64 sent_bytes;
+    guint64 received;
+    guint64 received_bytes;
+} TrafficStats;
+
+const char* connection_traffic_kind_name(traffic_kind_t kind);
+void connection_get_traffic(traffic_kind_t kind, TrafficStats* stats);
+void connection_reset_traffic(void);
+
+// phases of the last connect in microseconds, -1 for the ones it did not reach
+typedef struct connect_stats_t
+{
+    gint64 resolve_us;
+    gboolean resolve_cached;
+    // until the server's first answer, with direct TLS this includes the handshake
+    gint64 stream_us;
+    // from the server's first answer until the stream is secured
+    gint64 tls_us;
+    gint64 login_us;
+    guint attempts;
+    gboolean stream_resumed;
+} ConnectStats;
+
+void connection_get_connect_stats(ConnectStats* stats);
+// of the allocator libstrophe uses, all zero before the first connect
+void connection_get_alloc_stats(MemPoolStats* stats);
+// frees the blocks the allocator keeps for reuse
+void connection_trim_alloc(void);
+void connection_update_keepalive(void);
+
 char* message_send_chat(const char* const barejid, const char* const msg, const char* const oob_url, gboolean request_receipt, const char* const replace_id);
 char* message_send_chat_otr(const char* const barejid, const char* const msg, gboolean request_receipt, const char* const replace_id);
 char* message_send_chat_pgp(const char* const barejid, const char* const msg, gboolean request_receipt, const char* const replace_id);
@@ -216,6 +269,7 @@ void message_send_inactive(const char* const jid);
 void message_send_composing(const char* const jid);
 void message_send_paused(const char* const jid);
 void message_send_gone(const char* const jid);
+void message_send_displayed(const char* const fulljid, const char* const id);
 void message_send_invite(const char* const room, const char* const contact, const char* const reason);
 void message_request_voice(const char* const roomjid);
 
@@ -237,6 +291,19 @@ void iq_disable_carbons(void);
 void iq_send_software_version(const char* const fulljid);
 void iq_rooms_cache_clear(void);
 void iq_handlers_clear();
+
+typedef struct iq_pending_stats_t
+{
+    guint pending;
+    guint age_under_10s;
+    guint age_under_60s;
+    guint age_older;
+    gint64 oldest_ms;
+    guint64 expired; // handlers dropped without a reply since start
+} IqPendingStats;
+
+void iq_get_pending_stats(IqPendingStats* stats);
+gsize iq_memory(guint* handlers);
 void iq_room_list_request(gchar* conferencejid, gchar* filter);
 void iq_disco_info_request(gchar* jid);
 void iq_disco_items_request(gchar* jid);
@@ -256,16 +323,18 @@ void iq_room_kick_occupant(const char* const room, const char* const nick, const
 void iq_room_role_set(const char* const room, const char* const nick, char* role, const char* const reason);
 void iq_room_role_list(const char* const room, char* role);
 void iq_autoping_timer_cancel(void);
-void iq_autoping_check(void);
 void iq_http_upload_request(HTTPUpload* upload);
 void iq_command_list(const char* const target);
 void iq_command_exec(const char* const target, const char* const command);
 void iq_mam_request(ProfChatWin* win);
+void iq_mam_sync(void);
 void iq_register_change_password(const char* const user, const char* const password);
 void iq_muc_register_nick(const char* const roomjid);
 
 EntityCapabilities* caps_lookup(const char* const jid);
 void caps_close(void);
+gsize caps_memory(guint* entries);
+void caps_trim(void);
 void caps_destroy(EntityCapabilities* caps);
 void caps_reset_ver(void);
 void caps_add_feature(char* feature);
@@ -289,6 +358,7 @@ void roster_send_add_new(const char* const barejid, const char* const name);
 void roster_send_remove(const char* const barejid);
 
 GList* blocked_list(void);
+gboolean blocked_matches(const char* const jid);
 gboolean blocked_add(char* jid, blocked_report reportkind, const char* const message);
 gboolean blocked_remove(char* jid);
 char* blocked_ac_find(const char* const search_str, gboolean previous, void* context);
@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <strophe.h>
+
+#include "config.h"
+#include "common.h"
+#include "database.h"
+#include "config/account.h"
+#include "tools/autocomplete.h"
+#include "tools/parser.h"
+#include "ui/buffer.h"
+#include "xmpp/connection.h"
+#include "xmpp/jid.h"
+#include "xmpp/muc.h"
+#include "xmpp/roster_list.h"
+#include "xmpp/stanza.h"
+
+// Microbenchmarks for hot paths, run with `make bench`. Every benchmark
+// prints one JSON object per line:
+//
+//   {"name":"jid_create","dataset":1,"ops":100000,"rounds":5,"min_ns":81.2,"median_ns":83.0}
+//
+// min_ns and median_ns are nanoseconds per operation over the rounds. The
+// datasets are generated the same way on every run so results can be compared.
+
+#define BENCH_ROUNDS       5
+#define BENCH_CONTACTS     5000
+#define BENCH_OCCUPANTS    2000
+#define BENCH_DB_MESSAGES  2000
+#define BENCH_ROOM         "bench@conference.example.org"
+#define BENCH_ACCOUNT      "me@example.org"
+
+typedef struct
+{
+    const char* name;
+    void (*func)(void);
+} Bench;
+
+static double samples[BENCH_ROUNDS];
+static int samples_count = 0;
+static gint64 round_start = 0;
+
+static void
+_bench_start(void)
+{
+    round_start = g_get_monotonic_time();
+}
+
+static void
+_bench_stop(int ops)
+{
+    gint64 elapsed = g_get_monotonic_time() - round_start;
+    samples[samples_count++] = (double)elapsed * 1000.0 / ops;
+}
+
+static int
+_cmp_double(const void* a, const void* b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static void
+_bench_report(const char* const name, int dataset, int ops)
+{
+    qsort(samples, samples_count, sizeof(double), _cmp_double);
+    printf("{\"name\":\"%s\",\"dataset\":%d,\"ops\":%d,\"rounds\":%d,\"min_ns\":%.1f,\"median_ns\":%.1f}\n",
+           name, dataset, ops, samples_count, samples[0], samples[samples_count / 2]);
+    fflush(stdout);
+    samples_count = 0;
+}
+
+static char*
+_contact_jid(int i)
+{
+    return g_strdup_printf("contact%04d@example.org", i);
+}
+
+static void
+bench_autocomplete_complete(void)
+{
+    Autocomplete ac = autocomplete_new();
+    for (int i = 0; i < BENCH_CONTACTS; i++) {
+        char* jid = _contact_jid(i);
+        autocomplete_add(ac, jid);
+        g_free(jid);
+    }
+
+    int ops = 1000;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        _bench_start();
+        for (int i = 0; i < ops; i++) {
+            gchar* found = autocomplete_complete(ac, "contact42", TRUE, FALSE);
+            g_free(found);
+            autocomplete_reset(ac);
+        }
+        _bench_stop(ops);
+    }
+    _bench_report("autocomplete_complete", BENCH_CONTACTS, ops);
+
+    autocomplete_free(ac);
+}
+
+static void
+bench_buffer(void)
+{
+    int ops = 20000;
+    GDateTime* now = g_date_time_new_now_local();
+    const char* message = "A message of a typical length, with a few words and a link https://example.org/page";
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        ProfBuff buffer = buffer_create();
+        _bench_start();
+        for (int i = 0; i < ops; i++) {
+            buffer_append(buffer, "-", 0, now, 0, THEME_TEXT_THEM, "contact", "contact@example.org", message, FALSE, NULL);
+        }
+        _bench_stop(ops);
+        buffer_free(buffer);
+    }
+    _bench_report("buffer_append", 1, ops);
+
+    ProfBuff buffer = buffer_create();
+    for (int i = 0; i < ops; i++) {
+        buffer_append(buffer, "-", 0, now, 0, THEME_TEXT_THEM, "contact", "contact@example.org", message, FALSE, NULL);
+    }
+    int size = buffer_size(buffer);
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        _bench_start();
+        for (int i = 0; i < ops; i++) {
+            ProfBuffEntry* entry = buffer_get_entry(buffer, (i * 7) % size);
+            if (!entry) {
+                abort();
+            }
+        }
+        _bench_stop(ops);
+    }
+    _bench_report("buffer_get_entry", size, ops);
+    buffer_free(buffer);
+
+    g_date_time_unref(now);
+}
+
+static void
+bench_roster_get_contacts(void)
+{
+    roster_create();
+    for (int i = 0; i < BENCH_CONTACTS; i++) {
+        char* jid = _contact_jid(i);
+        char* name = g_strdup_printf("Contact %d", (i * 7919) % BENCH_CONTACTS);
+        GSList* groups = g_slist_append(NULL, g_strdup_printf("group%d", i % 20));
+        roster_add(jid, name, groups, "both", FALSE);
+        g_free(name);
+        g_free(jid);
+    }
+
+    int ops = 50;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        _bench_start();
+        for (int i = 0; i < ops; i++) {
+            g_slist_free(roster_get_contacts(ROSTER_ORD_NAME));
+        }
+        _bench_stop(ops);
+    }
+    _bench_report("roster_get_contacts", BENCH_CONTACTS, ops);
+
+    roster_destroy();
+}
+
+static void
+bench_muc_roster(void)
+{
+    muc_init();
+    muc_join(BENCH_ROOM, "me", NULL, FALSE);
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        muc_leave(BENCH_ROOM);
+        muc_join(BENCH_ROOM, "me", NULL, FALSE);
+        _bench_start();
+        for (int i = 0; i < BENCH_OCCUPANTS; i++) {
+            char* nick = g_strdup_printf("occupant%04d", i);
+            char* jid = g_strdup_printf("occupant%04d@example.org/res", i);
+            muc_roster_add(BENCH_ROOM, nick, jid, "participant", "none", NULL, NULL);
+            g_free(jid);
+            g_free(nick);
+        }
+        _bench_stop(BENCH_OCCUPANTS);
+    }
+    _bench_report("muc_roster_add", BENCH_OCCUPANTS, BENCH_OCCUPANTS);
+
+    int ops = 100000;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        _bench_start();
+        for (int i = 0; i < ops; i++) {
+            char nick[32];
+            snprintf(nick, sizeof(nick), "occupant%04d", i % BENCH_OCCUPANTS);
+            if (!muc_roster_item(BENCH_ROOM, nick)) {
+                abort();
+            }
+        }
+        _bench_stop(ops);
+    }
+    _bench_report("muc_roster_item", BENCH_OCCUPANTS, ops);
+
+    muc_close();
+}
+
+static void
+bench_mentions(void)
+{
+    const char* message = "hey occupant0042, did you see what occupant0042_bot posted? "
+                          "occupant0042: ping, and Occupant0042 again at the end occupant0042";
+    int ops = 100000;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        _bench_start();
+        for (int i = 0; i < ops; i++) {
+            GSList* found = prof_occurrences("occupant0042", message, 0, TRUE, NULL);
+            g_slist_free(found);
+        }
+        _bench_stop(ops);
+    }
+    _bench_report("prof_occurrences", 1, ops);
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        _bench_start();
+        for (int i = 0; i < ops; i++) {
+            GSList* found = get_mentions(TRUE, FALSE, message, "occupant0042");
+            g_slist_free(found);
+        }
+        _bench_stop(ops);
+    }
+    _bench_report("get_mentions", 1, ops);
+}
+
+static void
+bench_jid_create(void)
+{
+    int ops = 100000;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        _bench_start();
+        for (int i = 0; i < ops; i++) {
+            Jid* jid = jid_create("contact0042@example.org/laptop");
+            jid_destroy(jid);
+        }
+        _bench_stop(ops);
+    }
+    _bench_report("jid_create", 1, ops);
+}
+
+static void
+bench_parse_args(void)
+{
+    int ops = 100000;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        _bench_start();
+        for (int i = 0; i < ops; i++) {
+            gboolean result = FALSE;
+            gchar** args = parse_args("/join room@conference.example.org nick \"bench user\" password secret", 1, 5, &result);
+            g_strfreev(args);
+        }
+        _bench_stop(ops);
+    }
+    _bench_report("parse_args", 1, ops);
+}
+
+static void
+bench_stanza(void)
+{
+    xmpp_ctx_t* ctx = connection_get_ctx();
+    xmpp_stanza_t* presence = xmpp_stanza_new_from_string(ctx,
+                                                          "<presence from='" BENCH_ROOM "/occupant0042' to='" BENCH_ACCOUNT "/res'>"
+                                                          "<x xmlns='http://jabber.org/protocol/muc#user'>"
+                                                          "<item affiliation='none' role='participant'/>"
+                                                          "</x></presence>");
+    xmpp_stanza_t* message = xmpp_stanza_new_from_string(ctx,
+                                                         "<message from='contact0042@example.org/laptop' type='chat'>"
+                                                         "<body>archived</body>"
+                                                         "<delay xmlns='urn:xmpp:delay' stamp='2020-01-01T10:00:00Z'/>"
+                                                         "</message>");
+    if (!presence || !message) {
+        fprintf(stderr, "bench: could not parse the stanzas\n");
+        return;
+    }
+
+    int ops = 100000;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        _bench_start();
+        for (int i = 0; i < ops; i++) {
+            if (!stanza_is_muc_presence(presence) || stanza_is_muc_self_presence(presence, BENCH_ACCOUNT)) {
+                abort();
+            }
+        }
+        _bench_stop(ops);
+    }
+    _bench_report("stanza_is_muc_presence", 1, ops);
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        _bench_start();
+        for (int i = 0; i < ops; i++) {
+            if (stanza_get_delay(message) == 0) {
+                abort();
+            }
+        }
+        _bench_stop(ops);
+    }
+    _bench_report("stanza_get_delay", 1, ops);
+
+    xmpp_stanza_release(presence);
+    xmpp_stanza_release(message);
+}
+
+static void
+_remove_dir(const char* const path)
+{
+    GDir* dir = g_dir_open(path, 0, NULL);
+    if (dir) {
+        const gchar* name;
+        while ((name = g_dir_read_name(dir))) {
+            gchar* child = g_build_filename(path, name, NULL);
+            if (g_file_test(child, G_FILE_TEST_IS_DIR)) {
+                _remove_dir(child);
+            } else {
+                g_remove(child);
+            }
+            g_free(child);
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(path);
+}
+
+static void
+bench_database(void)
+{
+    ProfAccount account;
+    memset(&account, 0, sizeof(account));
+    account.name = BENCH_ACCOUNT;
+    account.jid = BENCH_ACCOUNT;
+
+    if (!log_database_init(&account)) {
+        fprintf(stderr, "bench: could not open the database\n");
+        return;
+    }
+
+    Jid* to = jid_create(BENCH_ACCOUNT "/res");
+    ProfMessage message;
+    memset(&message, 0, sizeof(message));
+    message.to_jid = to;
+    message.type = PROF_MSG_TYPE_CHAT;
+    message.plain = "A message of a typical length to store in the chat log";
+
+    int n = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        _bench_start();
+        for (int i = 0; i < BENCH_DB_MESSAGES; i++, n++) {
+            char id[32];
+            char* from = g_strdup_printf("contact%04d@example.org/laptop", i % BENCH_CONTACTS);
+            snprintf(id, sizeof(id), "bench-%d", n);
+            message.from_jid = jid_create(from);
+            message.id = id;
+            message.stanzaid = id;
+            log_database_add_incoming(&message);
+            jid_destroy(message.from_jid);
+            g_free(from);
+        }
+        log_database_flush();
+        _bench_stop(BENCH_DB_MESSAGES);
+    }
+    _bench_report("log_database_add_incoming", BENCH_DB_MESSAGES, BENCH_DB_MESSAGES);
+
+    jid_destroy(to);
+    log_database_close();
+}
+
+static const Bench benches[] = {
+    { "autocomplete", bench_autocomplete_complete },
+    { "buffer", bench_buffer },
+    { "roster", bench_roster_get_contacts },
+    { "muc", bench_muc_roster },
+    { "mentions", bench_mentions },
+    { "jid", bench_jid_create },
+    { "parser", bench_parse_args },
+    { "stanza", bench_stanza },
+    { "database", bench_database },
+};
+
+int
+main(int argc, char* argv[])
+{
+    setlocale(LC_ALL, "");
+
+    if (argc > 1 && g_strcmp0(argv[1], "--list") == 0) {
+        for (int i = 0; i < G_N_ELEMENTS(benches); i++) {
+            printf("%s\n", benches[i].name);
+        }
+        return 0;
+    }
+
+    // the chat log database is written below a throwaway data directory
+    gchar* data_dir = g_dir_make_tmp("profanity-bench-XXXXXX", NULL);
+    if (!data_dir) {
+        fprintf(stderr, "bench: could not create a temporary directory\n");
+        return 1;
+    }
+    g_setenv("XDG_DATA_HOME", data_dir, TRUE);
+
+    xmpp_initialize();
+
+    for (int i = 0; i < G_N_ELEMENTS(benches); i++) {
+        // with arguments, run the benchmarks named
+        gboolean run = argc < 2;
+        for (int arg = 1; arg < argc && !run; arg++) {
+            run = g_strcmp0(argv[arg], benches[i].name) == 0;
+        }
+        if (run) {
+            benches[i].func();
+        }
+    }
+
+    xmpp_shutdown();
+
+    _remove_dir(data_dir);
+    g_free(data_dir);
+
+    return 0;
+}
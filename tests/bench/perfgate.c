@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+// Compares benchmark results against tests/bench/baseline.txt, run with
+// `make check-perf`. The results are the JSON lines printed by bench and
+// renderbench. Every baseline line gates one field of one benchmark:
+//
+//   jid_create min_ns 81.2 30%
+//
+// The check fails when a field is worse than its value by more than the
+// tolerance. Times and bytes are worse when higher, rates ending in
+// _per_sec when lower. Benchmarks missing from the results are skipped,
+// results missing from the baseline fail until it is recorded again.
+//
+// With --write the baseline is replaced by the results, keeping the
+// tolerances already in it, run with `make perf-baseline`. With --new-ok
+// results missing from the baseline pass, for a baseline measured from an
+// older revision that lacks the newer benchmarks.
+
+typedef struct
+{
+    const char* field;
+    int tolerance;
+} GateField;
+
+// the fields --write records, with the tolerance of newly recorded ones
+static const GateField gate_fields[] = {
+    { "min_ns", 30 },
+    { "bytes_per_frame", 5 },
+    { "stanzas_per_sec", 30 },
+};
+
+static const char* const baseline_header = "# Baseline for `make check-perf`, recorded with `make perf-baseline` on the\n"
+                                           "# reference machine. Each line gates one benchmark field:\n"
+                                           "#\n"
+                                           "#   <benchmark> <field> <value> <tolerance>%\n"
+                                           "#\n"
+                                           "# Times and bytes are worse when higher, rates ending in _per_sec when lower.\n"
+                                           "# The timing tolerances absorb the noise between runs, bytes per frame are\n"
+                                           "# the same on every run for the same TERM.\n";
+
+typedef struct
+{
+    char* name;
+    char* field;
+    double value;
+    int tolerance;
+} BaselineEntry;
+
+static void
+_entry_free(BaselineEntry* entry)
+{
+    g_free(entry->name);
+    g_free(entry->field);
+    g_free(entry);
+}
+
+// The string value of key in a flat JSON object, NULL if absent
+static char*
+_json_string(const char* const line, const char* const key)
+{
+    gchar* pattern = g_strdup_printf("\"%s\":\"", key);
+    const char* start = strstr(line, pattern);
+    char* value = NULL;
+    if (start) {
+        start += strlen(pattern);
+        const char* end = strchr(start, '"');
+        if (end) {
+            value = g_strndup(start, end - start);
+        }
+    }
+    g_free(pattern);
+
+    return value;
+}
+
+// The number value of key in a flat JSON object
+static gboolean
+_json_number(const char* const line, const char* const key, double* value)
+{
+    gchar* pattern = g_strdup_printf("\"%s\":", key);
+    const char* start = strstr(line, pattern);
+    char* end = NULL;
+    if (start) {
+        start += strlen(pattern);
+        *value = g_ascii_strtod(start, &end);
+    }
+    g_free(pattern);
+
+    return start && end != start;
+}
+
+static gboolean
+_higher_is_better(const char* const field)
+{
+    return g_str_has_suffix(field, "_per_sec");
+}
+
+// name to the JSON line of its last result
+static GHashTable*
+_results_load(int count, char** paths)
+{
+    GHashTable* results = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    for (int i = 0; i < count; i++) {
+        gchar* contents = NULL;
+        if (!g_file_get_contents(paths[i], &contents, NULL, NULL)) {
+            fprintf(stderr, "perfgate: could not read %s\n", paths[i]);
+            continue;
+        }
+
+        gchar** lines = g_strsplit(contents, "\n", -1);
+        for (int l = 0; lines[l]; l++) {
+            char* name = _json_string(lines[l], "name");
+            if (name) {
+                g_hash_table_replace(results, name, g_strdup(lines[l]));
+            }
+        }
+        g_strfreev(lines);
+        g_free(contents);
+    }
+
+    return results;
+}
+
+static GList*
+_baseline_load(const char* const path)
+{
+    GList* entries = NULL;
+    gchar* contents = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+        return NULL;
+    }
+
+    gchar** lines = g_strsplit(contents, "\n", -1);
+    for (int l = 0; lines[l]; l++) {
+        gchar* line = g_strstrip(lines[l]);
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+
+        char name[128], field[64];
+        double value;
+        int tolerance;
+        if (sscanf(line, "%127s %63s %lf %d%%", name, field, &value, &tolerance) != 4) {
+            fprintf(stderr, "perfgate: %s:%d: not <benchmark> <field> <value> <tolerance>%%\n", path, l + 1);
+            continue;
+        }
+
+        BaselineEntry* entry = g_new0(BaselineEntry, 1);
+        entry->name = g_strdup(name);
+        entry->field = g_strdup(field);
+        entry->value = value;
+        entry->tolerance = tolerance;
+        entries = g_list_append(entries, entry);
+    }
+    g_strfreev(lines);
+    g_free(contents);
+
+    return entries;
+}
+
+static int
+_check(GList* baseline, GHashTable* results, gboolean new_ok)
+{
+    int regressions = 0;
+    int ungated = 0;
+    for (GList* curr = baseline; curr; curr = g_list_next(curr)) {
+        BaselineEntry* entry = curr->data;
+        const char* line = g_hash_table_lookup(results, entry->name);
+        double value;
+        if (!line || !_json_number(line, entry->field, &value)) {
+            printf("skip  %-28s %-16s not measured\n", entry->name, entry->field);
+            continue;
+        }
+
+        // positive when worse than the baseline
+        double change = entry->value != 0 ? (value - entry->value) * 100.0 / entry->value : 0;
+        if (_higher_is_better(entry->field)) {
+            change = -change;
+        }
+
+        gboolean regressed = change > entry->tolerance;
+        printf("%s %-28s %-16s %12.1f baseline %12.1f %+6.1f%% (tolerance %d%%)\n",
+               regressed ? "FAIL " : "ok   ", entry->name, entry->field, value, entry->value,
+               change, entry->tolerance);
+        if (regressed) {
+            regressions++;
+        }
+    }
+
+    GHashTableIter iter;
+    gpointer name;
+    g_hash_table_iter_init(&iter, results);
+    while (g_hash_table_iter_next(&iter, &name, NULL)) {
+        gboolean gated = FALSE;
+        for (GList* curr = baseline; curr && !gated; curr = g_list_next(curr)) {
+            gated = g_strcmp0(((BaselineEntry*)curr->data)->name, name) == 0;
+        }
+        if (!gated && new_ok) {
+            printf("new   %-28s not in the baseline\n", (char*)name);
+        } else if (!gated) {
+            printf("FAIL  %-28s not in the baseline\n", (char*)name);
+            ungated++;
+        }
+    }
+
+    if (regressions > 0) {
+        printf("%d benchmark field(s) regressed beyond their tolerance\n", regressions);
+    }
+    if (ungated > 0) {
+        printf("%d benchmark(s) have no baseline, record one with `make perf-baseline`\n", ungated);
+    }
+
+    return regressions > 0 || ungated > 0 ? 1 : 0;
+}
+
+static int
+_write(const char* const path, GList* baseline, GHashTable* results)
+{
+    GString* out = g_string_new(baseline_header);
+
+    GList* names = g_hash_table_get_keys(results);
+    names = g_list_sort(names, (GCompareFunc)g_strcmp0);
+    for (GList* curr = names; curr; curr = g_list_next(curr)) {
+        const char* name = curr->data;
+        const char* line = g_hash_table_lookup(results, name);
+        for (int i = 0; i < G_N_ELEMENTS(gate_fields); i++) {
+            double value;
+            if (!_json_number(line, gate_fields[i].field, &value)) {
+                continue;
+            }
+
+            int tolerance = gate_fields[i].tolerance;
+            for (GList* entry = baseline; entry; entry = g_list_next(entry)) {
+                BaselineEntry* old = entry->data;
+                if (g_strcmp0(old->name, name) == 0 && g_strcmp0(old->field, gate_fields[i].field) == 0) {
+                    tolerance = old->tolerance;
+                }
+            }
+            g_string_append_printf(out, "%s %s %.1f %d%%\n", name, gate_fields[i].field, value, tolerance);
+        }
+    }
+    g_list_free(names);
+
+    GError* error = NULL;
+    gboolean written = g_file_set_contents(path, out->str, out->len, &error);
+    g_string_free(out, TRUE);
+    if (!written) {
+        fprintf(stderr, "perfgate: could not write %s: %s\n", path, error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    printf("Baseline written to %s\n", path);
+    return 0;
+}
+
+int
+main(int argc, char* argv[])
+{
+    gboolean write = FALSE;
+    gboolean new_ok = FALSE;
+    int first = 1;
+    for (; first < argc && g_str_has_prefix(argv[first], "--"); first++) {
+        if (g_strcmp0(argv[first], "--write") == 0) {
+            write = TRUE;
+        } else if (g_strcmp0(argv[first], "--new-ok") == 0) {
+            new_ok = TRUE;
+        } else {
+            break;
+        }
+    }
+    if (argc < first + 2) {
+        fprintf(stderr, "usage: perfgate [--write | --new-ok] <baseline> <results>...\n");
+        return 2;
+    }
+
+    GList* baseline = _baseline_load(argv[first]);
+    GHashTable* results = _results_load(argc - first - 1, &argv[first + 1]);
+
+    int result;
+    if (write) {
+        result = _write(argv[first], baseline, results);
+    } else {
+        result = _check(baseline, results, new_ok);
+    }
+
+    g_hash_table_destroy(results);
+    g_list_free_full(baseline, (GDestroyNotify)_entry_free);
+
+    return result;
+}
@@ -0,0 +1,584 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "config.h"
+#include "log.h"
+#include "database.h"
+#include "config/account.h"
+#include "config/files.h"
+#include "config/preferences.h"
+#include "config/theme.h"
+#include "ui/ui.h"
+#include "ui/buffer.h"
+#include "ui/statusbar.h"
+#include "ui/window.h"
+#include "ui/window_list.h"
+#include "tools/scheduler.h"
+#include "xmpp/chat_session.h"
+#include "xmpp/connection.h"
+#include "xmpp/iq.h"
+#include "xmpp/jid.h"
+#include "xmpp/message.h"
+#include "xmpp/muc.h"
+#include "xmpp/presence.h"
+#include "xmpp/roster_list.h"
+#include "xmpp/stanza.h"
+#include "xmpp/xmpp.h"
+
+// Rendering benchmark, run with `make bench-render`. The UI is drawn by
+// ncurses to a pseudo-terminal, everything the terminal would receive is
+// read from the master side and counted. Every workload prints one JSON
+// object per line:
+//
+//   {"name":"muc_flood","frames":2000,"cols":120,"lines":40,"p50_us":210.0,"p90_us":260.0,"p99_us":410.0,"max_us":900.0,"bytes":812345,"bytes_per_frame":406.2}
+//
+// A frame is the work that leads to a redraw plus the ui_update() that
+// sends it. TERM is xterm-256color unless set, bytes depend on it.
+//
+// With --replay <file> the stanzas of a recording made with /perf record
+// are handed to the stanza handlers instead, one frame each, as fast as
+// they go or with --realtime as they arrived. A second line reports the
+// time spent in the handlers alone:
+//
+//   {"name":"replay_handlers","stanzas":5120,"p50_us":40.0,"p90_us":95.0,"p99_us":900.0,"max_us":4100.0,"total_ms":410.2,"stanzas_per_sec":12481.7}
+
+#define BENCH_COLS         120
+#define BENCH_LINES        40
+#define BENCH_ROOM         "bench@conference.example.org"
+#define BENCH_OCCUPANTS    200
+#define BENCH_FLOOD        2000
+#define BENCH_JOINS        200
+#define BENCH_PAGES        200
+#define BENCH_RESIZES      60
+#define BENCH_TABS         200
+
+typedef struct
+{
+    const char* name;
+    void (*func)(void);
+} Bench;
+
+static int pty_master = -1;
+static volatile gsize output_bytes = 0;
+static GThread* output_reader = NULL;
+static FILE* report = NULL;
+
+static GArray* frames = NULL;
+static gint64 frame_start = 0;
+static gsize bytes_start = 0;
+
+static const char* replay_path = NULL;
+static gboolean replay_realtime = FALSE;
+
+// drains the terminal, ncurses blocks once the pty buffer is full
+static gpointer
+_output_read(gpointer data)
+{
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(pty_master, buf, sizeof(buf))) != 0) {
+        if (n > 0) {
+            g_atomic_pointer_add(&output_bytes, n);
+        } else if (errno != EINTR) {
+            // EIO once the last slave descriptor is closed
+            break;
+        }
+    }
+    return NULL;
+}
+
+// waits until the reader has seen everything written so far
+static gsize
+_output_settle(void)
+{
+    gsize bytes = g_atomic_pointer_get(&output_bytes);
+    for (int idle = 0; idle < 10;) {
+        g_usleep(2000);
+        gsize now = g_atomic_pointer_get(&output_bytes);
+        idle = now == bytes ? idle + 1 : 0;
+        bytes = now;
+    }
+    return bytes;
+}
+
+static void
+_set_size(int cols, int lines)
+{
+    struct winsize w;
+    memset(&w, 0, sizeof(w));
+    w.ws_col = cols;
+    w.ws_row = lines;
+    ioctl(pty_master, TIOCSWINSZ, &w);
+}
+
+static void
+_workload_start(void)
+{
+    ui_update();
+    bytes_start = _output_settle();
+    g_array_set_size(frames, 0);
+}
+
+static void
+_frame_start(void)
+{
+    frame_start = g_get_monotonic_time();
+}
+
+static void
+_frame_stop(void)
+{
+    ui_update();
+    double elapsed = g_get_monotonic_time() - frame_start;
+    g_array_append_val(frames, elapsed);
+}
+
+static int
+_cmp_double(const void* a, const void* b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static double
+_percentile_of(GArray* sorted, int percent)
+{
+    int index = (sorted->len - 1) * percent / 100;
+    return g_array_index(sorted, double, index);
+}
+
+static double
+_percentile(int percent)
+{
+    return _percentile_of(frames, percent);
+}
+
+static void
+_workload_report(const char* const name)
+{
+    gsize bytes = _output_settle() - bytes_start;
+    if (frames->len == 0) {
+        return;
+    }
+
+    g_array_sort(frames, _cmp_double);
+    fprintf(report, "{\"name\":\"%s\",\"frames\":%u,\"cols\":%d,\"lines\":%d,"
+                    "\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f,"
+                    "\"bytes\":%" G_GSIZE_FORMAT ",\"bytes_per_frame\":%.1f}\n",
+            name, frames->len, getmaxx(stdscr), getmaxy(stdscr),
+            _percentile(50), _percentile(90), _percentile(99), _percentile(100),
+            bytes, (double)bytes / frames->len);
+    fflush(report);
+}
+
+static ProfMucWin*
+_bench_room(void)
+{
+    ProfMucWin* mucwin = wins_get_muc(BENCH_ROOM);
+    if (mucwin) {
+        return mucwin;
+    }
+
+    muc_join(BENCH_ROOM, "me", NULL, FALSE);
+    for (int i = 0; i < BENCH_OCCUPANTS; i++) {
+        char* nick = g_strdup_printf("occupant%04d", i);
+        char* jid = g_strdup_printf("occupant%04d@example.org/res", i);
+        muc_roster_add(BENCH_ROOM, nick, jid, i % 10 == 0 ? "moderator" : "participant", "none", NULL, NULL);
+        g_free(jid);
+        g_free(nick);
+    }
+    muc_roster_set_complete(BENCH_ROOM);
+    ui_room_join(BENCH_ROOM, TRUE);
+    occupantswin_occupants(BENCH_ROOM);
+
+    return wins_get_muc(BENCH_ROOM);
+}
+
+static void
+bench_muc_flood(void)
+{
+    ProfMucWin* mucwin = _bench_room();
+    const char* messages[] = {
+        "ok",
+        "A message of a typical length, with a few words and a link https://example.org/page",
+        "A longer message that wraps on a narrow terminal, it goes on for a while to fill more than one line of the window and a bit more",
+    };
+
+    ProfMessage message;
+    memset(&message, 0, sizeof(message));
+    message.type = PROF_MSG_TYPE_MUC;
+    message.trusted = TRUE;
+
+    _workload_start();
+    for (int i = 0; i < BENCH_FLOOD; i++) {
+        char from[128];
+        snprintf(from, sizeof(from), "%s/occupant%04d", BENCH_ROOM, (i * 7) % BENCH_OCCUPANTS);
+        message.from_jid = jid_create(from);
+        message.plain = (char*)messages[i % G_N_ELEMENTS(messages)];
+        message.timestamp = g_get_real_time();
+
+        _frame_start();
+        mucwin_incoming_msg(mucwin, &message, NULL, NULL, FALSE);
+        _frame_stop();
+
+        jid_destroy(message.from_jid);
+    }
+    _workload_report("muc_flood");
+}
+
+static void
+bench_occupants(void)
+{
+    _bench_room();
+
+    _workload_start();
+    for (int i = 0; i < BENCH_JOINS; i++) {
+        char* nick = g_strdup_printf("late%04d", i);
+        char* jid = g_strdup_printf("late%04d@example.org/res", i);
+
+        _frame_start();
+        muc_roster_add(BENCH_ROOM, nick, jid, "participant", "none", NULL, NULL);
+        occupantswin_occupants(BENCH_ROOM);
+        _frame_stop();
+
+        g_free(jid);
+        g_free(nick);
+    }
+    for (int i = 0; i < BENCH_JOINS; i++) {
+        char* nick = g_strdup_printf("late%04d", i);
+
+        _frame_start();
+        muc_roster_remove(BENCH_ROOM, nick);
+        occupantswin_occupants(BENCH_ROOM);
+        _frame_stop();
+
+        g_free(nick);
+    }
+    _workload_report("occupants");
+}
+
+static void
+bench_page(void)
+{
+    ProfMucWin* mucwin = _bench_room();
+    ProfWin* window = (ProfWin*)mucwin;
+    // enough scrollback for several pages when run on its own
+    for (int i = buffer_size(window->layout->buffer); i < BENCH_LINES * 10; i++) {
+        win_println(window, THEME_DEFAULT, "-", "Scrollback line %d", i);
+    }
+
+    // back and forth over the whole scrollback
+    gboolean up = TRUE;
+    _workload_start();
+    for (int i = 0; i < BENCH_PAGES; i++) {
+        _frame_start();
+        if (up) {
+            win_page_up(window);
+            up = window->layout->y_pos > 0;
+        } else {
+            win_page_down(window);
+            up = window->layout->paged == 0;
+        }
+        _frame_stop();
+    }
+    window->layout->paged = 0;
+    _workload_report("page");
+}
+
+static void
+bench_resize(void)
+{
+    _bench_room();
+    const int sizes[][2] = { { 80, 24 }, { 200, 60 }, { 100, 30 }, { BENCH_COLS, BENCH_LINES } };
+
+    _workload_start();
+    for (int i = 0; i < BENCH_RESIZES; i++) {
+        _frame_start();
+        _set_size(sizes[i % G_N_ELEMENTS(sizes)][0], sizes[i % G_N_ELEMENTS(sizes)][1]);
+        ui_resize();
+        _frame_stop();
+    }
+    _workload_report("resize");
+}
+
+static void
+bench_status_bar(void)
+{
+    ProfMucWin* mucwin = _bench_room();
+    int num = wins_get_num((ProfWin*)mucwin);
+
+    _workload_start();
+    for (int i = 0; i < BENCH_TABS; i++) {
+        // the tab of the room flips between new messages and read
+        _frame_start();
+        if (i % 2 == 0) {
+            status_bar_new(num, WIN_MUC, BENCH_ROOM);
+        } else {
+            status_bar_active(num, WIN_MUC, BENCH_ROOM);
+        }
+        status_bar_draw();
+        _frame_stop();
+    }
+    _workload_report("status_bar");
+}
+
+// the part of a login the handlers rely on, without the requests it sends
+static void
+_replay_session(const char* const fulljid)
+{
+    connection_replay_open(fulljid);
+
+    Jid* jid = jid_create(fulljid);
+    ProfAccount account;
+    memset(&account, 0, sizeof(account));
+    account.jid = jid->barejid;
+    log_database_init(&account);
+    jid_destroy(jid);
+
+    roster_create();
+    chat_sessions_init();
+    message_handlers_init();
+    presence_handlers_init();
+    iq_handlers_init();
+}
+
+static void
+_replay_stanza(const char* const xml)
+{
+    xmpp_ctx_t* ctx = connection_get_ctx();
+    xmpp_stanza_t* stanza = ctx ? xmpp_stanza_new_from_string(ctx, xml) : NULL;
+    if (!stanza) {
+        return;
+    }
+
+    const char* name = xmpp_stanza_get_name(stanza);
+    if (g_strcmp0(name, STANZA_NAME_MESSAGE) == 0) {
+        message_replay(stanza);
+    } else if (g_strcmp0(name, STANZA_NAME_PRESENCE) == 0) {
+        presence_replay(stanza);
+    } else if (g_strcmp0(name, STANZA_NAME_IQ) == 0) {
+        iq_replay(stanza);
+    }
+    xmpp_stanza_release(stanza);
+}
+
+static void
+bench_replay(void)
+{
+    FILE* file = fopen(replay_path, "r");
+    if (!file) {
+        fprintf(stderr, "bench: could not open %s\n", replay_path);
+        return;
+    }
+
+    connection_init();
+    GArray* handlers = g_array_new(FALSE, FALSE, sizeof(double));
+    double handled_us = 0;
+    gint64 started = g_get_monotonic_time();
+    char* line = NULL;
+    size_t size = 0;
+
+    _workload_start();
+    while (getline(&line, &size, file) > 0) {
+        gint64 offset = 0;
+        char kind[8];
+        int data_at = 0;
+        g_strchomp(line);
+        if (line[0] == '#' || sscanf(line, "%" G_GINT64_FORMAT " %7s %n", &offset, kind, &data_at) != 2) {
+            continue;
+        }
+        char* data = line + data_at;
+
+        if (replay_realtime) {
+            gint64 wait = started + offset - g_get_monotonic_time();
+            if (wait > 0) {
+                g_usleep(wait);
+            }
+        }
+
+        if (g_strcmp0(kind, "jid") == 0) {
+            _replay_session(data);
+        } else if (g_strcmp0(kind, "join") == 0) {
+            char* nick = strchr(data, ' ');
+            if (nick) {
+                *nick++ = '\0';
+                muc_join(data, nick, NULL, FALSE);
+            }
+        } else if (g_strcmp0(kind, "recv") == 0) {
+            _frame_start();
+            _replay_stanza(data);
+            double elapsed = g_get_monotonic_time() - frame_start;
+            g_array_append_val(handlers, elapsed);
+            handled_us += elapsed;
+            scheduler_run();
+            _frame_stop();
+        }
+    }
+    free(line);
+    fclose(file);
+    _workload_report("replay");
+
+    if (handlers->len > 0) {
+        g_array_sort(handlers, _cmp_double);
+        fprintf(report, "{\"name\":\"replay_handlers\",\"stanzas\":%u,"
+                        "\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f,"
+                        "\"total_ms\":%.1f,\"stanzas_per_sec\":%.1f}\n",
+                handlers->len, _percentile_of(handlers, 50), _percentile_of(handlers, 90),
+                _percentile_of(handlers, 99), _percentile_of(handlers, 100),
+                handled_us / 1000, handlers->len / (handled_us / G_USEC_PER_SEC));
+        fflush(report);
+    }
+    g_array_free(handlers, TRUE);
+    log_database_close();
+}
+
+static const Bench benches[] = {
+    { "muc_flood", bench_muc_flood },
+    { "occupants", bench_occupants },
+    { "page", bench_page },
+    { "resize", bench_resize },
+    { "status_bar", bench_status_bar },
+};
+
+static void
+_remove_dir(const char* const path)
+{
+    GDir* dir = g_dir_open(path, 0, NULL);
+    if (dir) {
+        const gchar* name;
+        while ((name = g_dir_read_name(dir))) {
+            gchar* child = g_build_filename(path, name, NULL);
+            if (g_file_test(child, G_FILE_TEST_IS_DIR)) {
+                _remove_dir(child);
+            } else {
+                g_remove(child);
+            }
+            g_free(child);
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(path);
+}
+
+// ncurses draws to stdout, it is pointed at the slave side
+static int
+_open_terminal(int* saved_in, int* saved_out)
+{
+    pty_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty_master < 0 || grantpt(pty_master) != 0 || unlockpt(pty_master) != 0) {
+        return -1;
+    }
+    int slave = open(ptsname(pty_master), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        return -1;
+    }
+    _set_size(BENCH_COLS, BENCH_LINES);
+
+    *saved_in = dup(STDIN_FILENO);
+    *saved_out = dup(STDOUT_FILENO);
+    dup2(slave, STDIN_FILENO);
+    dup2(slave, STDOUT_FILENO);
+    close(slave);
+
+    output_reader = g_thread_new("bench-output", _output_read, NULL);
+    return 0;
+}
+
+static void
+_close_terminal(int saved_in, int saved_out)
+{
+    dup2(saved_in, STDIN_FILENO);
+    dup2(saved_out, STDOUT_FILENO);
+    close(saved_in);
+    close(saved_out);
+
+    g_thread_join(output_reader);
+    output_reader = NULL;
+    close(pty_master);
+    pty_master = -1;
+}
+
+int
+main(int argc, char* argv[])
+{
+    setlocale(LC_ALL, "");
+
+    if (argc > 1 && g_strcmp0(argv[1], "--list") == 0) {
+        for (int i = 0; i < G_N_ELEMENTS(benches); i++) {
+            printf("%s\n", benches[i].name);
+        }
+        return 0;
+    }
+
+    if (argc > 2 && g_strcmp0(argv[1], "--replay") == 0) {
+        replay_path = argv[2];
+        replay_realtime = argc > 3 && g_strcmp0(argv[3], "--realtime") == 0;
+    }
+
+    // results go to the real stdout, it is taken over by the terminal below
+    report = fdopen(dup(STDOUT_FILENO), "w");
+
+    // the default preferences and theme, nothing of the user's is read
+    gchar* data_dir = g_dir_make_tmp("profanity-renderbench-XXXXXX", NULL);
+    if (!report || !data_dir) {
+        fprintf(stderr, "bench: could not create a temporary directory\n");
+        return 1;
+    }
+    g_setenv("XDG_DATA_HOME", data_dir, TRUE);
+    g_setenv("XDG_CONFIG_HOME", data_dir, TRUE);
+    g_setenv("TERM", "xterm-256color", FALSE);
+
+    int saved_in, saved_out;
+    if (_open_terminal(&saved_in, &saved_out) != 0) {
+        fprintf(stderr, "bench: could not open a pseudo-terminal\n");
+        return 1;
+    }
+
+    files_create_directories();
+    prefs_load(NULL);
+    log_init(PROF_LEVEL_ERROR, NULL, FALSE);
+    theme_init("default");
+    ui_init();
+    muc_init();
+    ui_resize();
+    ui_update();
+
+    frames = g_array_new(FALSE, FALSE, sizeof(double));
+    if (replay_path) {
+        bench_replay();
+    }
+    for (int i = 0; i < G_N_ELEMENTS(benches) && !replay_path; i++) {
+        // with arguments, run the benchmarks named
+        gboolean run = argc < 2;
+        for (int arg = 1; arg < argc && !run; arg++) {
+            run = g_strcmp0(argv[arg], benches[i].name) == 0;
+        }
+        if (run) {
+            benches[i].func();
+        }
+    }
+    g_array_free(frames, TRUE);
+
+    ui_close();
+    muc_close();
+    theme_close();
+    log_close();
+    prefs_close();
+
+    _close_terminal(saved_in, saved_out);
+    fclose(report);
+
+    _remove_dir(data_dir);
+    g_free(data_dir);
+
+    return 0;
+}
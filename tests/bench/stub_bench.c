@@ -0,0 +1,47 @@
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <strophe.h>
+
+#include "xmpp/capabilities.h"
+#include "xmpp/connection.h"
+
+// what stanza.c needs from the connection and capabilities modules
+
+static xmpp_ctx_t* bench_ctx = NULL;
+
+xmpp_ctx_t*
+connection_get_ctx(void)
+{
+    if (!bench_ctx) {
+        bench_ctx = xmpp_ctx_new(NULL, NULL);
+    }
+    return bench_ctx;
+}
+
+char*
+connection_create_stanza_id(void)
+{
+    return strdup("bench");
+}
+
+EntityCapabilities*
+caps_create(const char* const category, const char* const type, const char* const name,
+            const char* const software, const char* const software_version,
+            const char* const os, const char* const os_version,
+            GSList* features)
+{
+    return NULL;
+}
+
+GList*
+caps_get_features(void)
+{
+    return NULL;
+}
+
+char*
+caps_get_my_sha1(xmpp_ctx_t* const ctx)
+{
+    return NULL;
+}
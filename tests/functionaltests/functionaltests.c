@@ -1,5 +1,6 @@
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stddef.h>
@@ -22,6 +23,7 @@
 #include "test_software.h"
 #include "test_muc.h"
 #include "test_disconnect.h"
+#include "test_load.h"
 
 #define PROF_FUNC_TEST(test) unit_test_setup_teardown(test, init_prof_test, close_prof_test)
 
@@ -110,5 +112,18 @@ int main(int argc, char* argv[]) {
         PROF_FUNC_TEST(disconnect_ends_session),
     };
 
+    // floods of stanzas to measure latency and memory, run with PROF_LOAD=1
+    const UnitTest load_tests[] = {
+        PROF_FUNC_TEST(load_presence_burst),
+        PROF_FUNC_TEST(load_muc_join_big_room),
+        PROF_FUNC_TEST(load_muc_message_storm),
+        PROF_FUNC_TEST(load_mam_pages),
+        PROF_FUNC_TEST(load_omemo_devicelist_push),
+    };
+
+    if (getenv("PROF_LOAD")) {
+        return run_tests(load_tests);
+    }
+
     return run_tests(all_tests);
 }
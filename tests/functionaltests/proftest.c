@@ -22,6 +22,9 @@ char *data_orig;
 
 int fd = 0;
 
+gint64 load_start = 0;
+gint64 load_end = 0;
+
 gboolean
 _create_dir(const char *name)
 {
@@ -279,3 +282,100 @@ prof_connect(void)
         "<item jid='buddy2@localhost' subscription='both' name='Buddy2'/>"
     );
 }
+
+int
+prof_load_size(const char *name, int def)
+{
+    // sizes of the load scenarios can be set from the environment,
+    // e.g. PROF_LOAD_OCCUPANTS=5000
+    const char *value = getenv(name);
+    if (!value) {
+        return def;
+    }
+
+    int size = atoi(value);
+    return size > 0 ? size : def;
+}
+
+void
+prof_load_send(GString *stanzas)
+{
+    if (stanzas->len == 0) {
+        return;
+    }
+
+    stbbr_send(stanzas->str);
+    g_string_truncate(stanzas, 0);
+}
+
+void
+prof_load_start(void)
+{
+    load_start = g_get_monotonic_time();
+    load_end = 0;
+}
+
+void
+prof_load_sentinel(void)
+{
+    // stanzas are handled in order, once the sentinel message is rendered
+    // everything sent before it has been processed
+    stbbr_send(
+        "<message id='load_sentinel' to='stabber@localhost/profanity' from='sentinel@localhost/load' type='chat'>"
+            "<body>load sentinel</body>"
+        "</message>"
+    );
+
+    prof_timeout(300);
+    assert_true(prof_output_exact("<< chat message: sentinel@localhost/load"));
+    prof_timeout_reset();
+
+    load_end = g_get_monotonic_time();
+}
+
+static long
+_peak_rss_kb(void)
+{
+    char *path = g_strdup_printf("/proc/%d/status", exp_pid);
+    gchar *status = NULL;
+    long peak = -1;
+
+    if (g_file_get_contents(path, &status, NULL, NULL)) {
+        char *hwm = strstr(status, "VmHWM:");
+        if (hwm) {
+            peak = strtol(hwm + strlen("VmHWM:"), NULL, 10);
+        }
+    }
+
+    g_free(status);
+    g_free(path);
+
+    return peak;
+}
+
+void
+prof_load_report(const char *scenario, int stanzas)
+{
+    if (load_end == 0) {
+        load_end = g_get_monotonic_time();
+    }
+
+    double latency_ms = (load_end - load_start) / 1000.0;
+    GString *report = g_string_new(NULL);
+    g_string_printf(report,
+        "{\"scenario\":\"%s\",\"stanzas\":%d,\"latency_ms\":%.1f,\"per_stanza_us\":%.1f,\"peak_rss_kb\":%ld}\n",
+        scenario, stanzas, latency_ms, stanzas > 0 ? latency_ms * 1000.0 / stanzas : 0.0, _peak_rss_kb());
+
+    // PROF_LOAD_REPORT names a file the results are appended to, for CI
+    fputs(report->str, stderr);
+    const char *report_file = getenv("PROF_LOAD_REPORT");
+    if (report_file) {
+        FILE *fp = fopen(report_file, "a");
+        if (fp) {
+            fputs(report->str, fp);
+            fclose(fp);
+        }
+    }
+
+    g_string_free(report, TRUE);
+}
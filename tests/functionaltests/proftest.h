@@ -1,6 +1,8 @@
 #ifndef __H_PROFTEST
 #define __H_PROFTEST
 
+#include <glib.h>
+
 #define XDG_CONFIG_HOME "./tests/functionaltests/files/xdg_config_home"
 #define XDG_DATA_HOME   "./tests/functionaltests/files/xdg_data_home"
 
@@ -18,4 +20,10 @@ int prof_output_regex(const char *text);
 void prof_timeout(int timeout);
 void prof_timeout_reset(void);
 
+int prof_load_size(const char *name, int def);
+void prof_load_send(GString *stanzas);
+void prof_load_start(void);
+void prof_load_sentinel(void);
+void prof_load_report(const char *scenario, int stanzas);
+
 #endif
@@ -0,0 +1,225 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <stabber.h>
+#include <expect.h>
+
+#include "proftest.h"
+
+// stanzas are batched into one write to stabber
+#define LOAD_BATCH 100
+
+static void
+_join_room(void)
+{
+    prof_input("/join loadroom@conference.localhost");
+    assert_true(stbbr_received(
+        "<presence id='*' to='loadroom@conference.localhost/stabber'>"
+            "<x xmlns='http://jabber.org/protocol/muc'/>"
+            "<c hash='sha-1' xmlns='http://jabber.org/protocol/caps' ver='*' node='http://profanity-im.github.io'/>"
+        "</presence>"
+    ));
+}
+
+static void
+_add_occupants(GString *stanzas, int occupants)
+{
+    for (int i = 0; i < occupants; i++) {
+        g_string_append_printf(stanzas,
+            "<presence to='stabber@localhost/profanity' from='loadroom@conference.localhost/occupant%d'>"
+                "<c hash='sha-1' xmlns='http://jabber.org/protocol/caps' node='http://example.org/client' ver='load%d='/>"
+                "<x xmlns='http://jabber.org/protocol/muc#user'>"
+                    "<item role='participant' jid='occupant%d@localhost/work' affiliation='none'/>"
+                "</x>"
+            "</presence>",
+            i, i % 10, i);
+        if ((i + 1) % LOAD_BATCH == 0) {
+            prof_load_send(stanzas);
+        }
+    }
+}
+
+static void
+_add_self_presence(GString *stanzas)
+{
+    g_string_append(stanzas,
+        "<presence to='stabber@localhost/profanity' from='loadroom@conference.localhost/stabber'>"
+            "<x xmlns='http://jabber.org/protocol/muc#user'>"
+                "<item role='participant' jid='stabber@localhost/profanity' affiliation='none'/>"
+            "</x>"
+            "<status code='110'/>"
+        "</presence>"
+    );
+    prof_load_send(stanzas);
+}
+
+void
+load_presence_burst(void **state)
+{
+    int contacts = prof_load_size("PROF_LOAD_CONTACTS", 1000);
+
+    GString *roster = g_string_new(NULL);
+    for (int i = 0; i < contacts; i++) {
+        g_string_append_printf(roster, "<item jid='contact%d@localhost' subscription='both' name='Contact%d'/>", i, i);
+    }
+    prof_connect_with_roster(roster->str);
+    g_string_free(roster, TRUE);
+
+    GString *stanzas = g_string_new(NULL);
+    prof_load_start();
+    for (int i = 0; i < contacts; i++) {
+        g_string_append_printf(stanzas,
+            "<presence to='stabber@localhost' from='contact%d@localhost/mobile'>"
+                "<show>%s</show>"
+                "<status>load</status>"
+            "</presence>",
+            i, i % 2 ? "away" : "dnd");
+        if ((i + 1) % LOAD_BATCH == 0) {
+            prof_load_send(stanzas);
+        }
+    }
+    prof_load_send(stanzas);
+    prof_load_sentinel();
+    g_string_free(stanzas, TRUE);
+
+    prof_load_report("presence_burst", contacts);
+}
+
+void
+load_muc_join_big_room(void **state)
+{
+    int occupants = prof_load_size("PROF_LOAD_OCCUPANTS", 2000);
+
+    prof_connect();
+    _join_room();
+
+    // the server sends every occupant before the self presence
+    GString *stanzas = g_string_new(NULL);
+    prof_load_start();
+    _add_occupants(stanzas, occupants);
+    _add_self_presence(stanzas);
+
+    prof_timeout(300);
+    assert_true(prof_output_exact("-> You have joined the room as stabber, role: participant, affiliation: none"));
+    prof_timeout_reset();
+    prof_load_sentinel();
+    g_string_free(stanzas, TRUE);
+
+    prof_load_report("muc_join", occupants + 1);
+}
+
+void
+load_muc_message_storm(void **state)
+{
+    int occupants = prof_load_size("PROF_LOAD_OCCUPANTS", 2000);
+    int messages = prof_load_size("PROF_LOAD_MESSAGES", 2000);
+
+    prof_connect();
+    _join_room();
+
+    GString *stanzas = g_string_new(NULL);
+    _add_occupants(stanzas, occupants);
+    _add_self_presence(stanzas);
+    prof_timeout(300);
+    assert_true(prof_output_exact("-> You have joined the room as stabber, role: participant, affiliation: none"));
+    prof_timeout_reset();
+
+    prof_load_start();
+    for (int i = 0; i < messages; i++) {
+        g_string_append_printf(stanzas,
+            "<message type='groupchat' id='storm%d' to='stabber@localhost/profanity' from='loadroom@conference.localhost/occupant%d'>"
+                "<body>storm message %d, mentioning stabber now and then</body>"
+                "<stanza-id xmlns='urn:xmpp:sid:0' id='storm-sid%d' by='loadroom@conference.localhost'/>"
+            "</message>",
+            i, i % occupants, i, i);
+        if ((i + 1) % LOAD_BATCH == 0) {
+            prof_load_send(stanzas);
+        }
+    }
+    prof_load_send(stanzas);
+    prof_load_sentinel();
+    g_string_free(stanzas, TRUE);
+
+    prof_load_report("muc_message_storm", messages);
+}
+
+void
+load_mam_pages(void **state)
+{
+    int pages = prof_load_size("PROF_LOAD_MAM_PAGES", 20);
+    int page_size = prof_load_size("PROF_LOAD_MAM_PAGE_SIZE", 50);
+
+    prof_connect();
+
+    // every page is followed by its <fin/>, as a server would send it
+    GString *stanzas = g_string_new(NULL);
+    prof_load_start();
+    for (int page = 0; page < pages; page++) {
+        for (int i = 0; i < page_size; i++) {
+            int n = page * page_size + i;
+            g_string_append_printf(stanzas,
+                "<message to='stabber@localhost/profanity' from='stabber@localhost'>"
+                    "<result xmlns='urn:xmpp:mam:2' queryid='load' id='mam%d'>"
+                        "<forwarded xmlns='urn:xmpp:forward:0'>"
+                            "<delay xmlns='urn:xmpp:delay' stamp='2020-01-01T%02d:%02d:%02dZ'/>"
+                            "<message xmlns='jabber:client' from='buddy%d@localhost/mobile' to='stabber@localhost' type='chat' id='mam-msg%d'>"
+                                "<body>archived message %d</body>"
+                            "</message>"
+                        "</forwarded>"
+                    "</result>"
+                "</message>",
+                n, (n / 3600) % 24, (n / 60) % 60, n % 60, n % 2 + 1, n, n);
+        }
+        g_string_append_printf(stanzas,
+            "<iq type='result' id='load_mam_%d' to='stabber@localhost/profanity'>"
+                "<fin xmlns='urn:xmpp:mam:2' complete='%s'>"
+                    "<set xmlns='http://jabber.org/protocol/rsm'><last>mam%d</last></set>"
+                "</fin>"
+            "</iq>",
+            page, page == pages - 1 ? "true" : "false", (page + 1) * page_size - 1);
+        prof_load_send(stanzas);
+    }
+    prof_load_sentinel();
+    g_string_free(stanzas, TRUE);
+
+    prof_load_report("mam_pages", pages * (page_size + 1));
+}
+
+void
+load_omemo_devicelist_push(void **state)
+{
+    int contacts = prof_load_size("PROF_LOAD_DEVICELISTS", 500);
+
+    prof_connect();
+
+    GString *stanzas = g_string_new(NULL);
+    prof_load_start();
+    for (int i = 0; i < contacts; i++) {
+        g_string_append_printf(stanzas,
+            "<message to='stabber@localhost/profanity' from='contact%d@localhost'>"
+                "<event xmlns='http://jabber.org/protocol/pubsub#event'>"
+                    "<items node='eu.siacs.conversations.axolotl.devicelist'>"
+                        "<item id='current'>"
+                            "<list xmlns='eu.siacs.conversations.axolotl'>"
+                                "<device id='%d'/><device id='%d'/>"
+                            "</list>"
+                        "</item>"
+                    "</items>"
+                "</event>"
+            "</message>",
+            i, 1000 + i, 500000 + i);
+        if ((i + 1) % LOAD_BATCH == 0) {
+            prof_load_send(stanzas);
+        }
+    }
+    prof_load_send(stanzas);
+    prof_load_sentinel();
+    g_string_free(stanzas, TRUE);
+
+    prof_load_report("omemo_devicelist_push", contacts);
+}
@@ -0,0 +1,5 @@
+void load_presence_burst(void **state);
+void load_muc_join_big_room(void **state);
+void load_muc_message_storm(void **state);
+void load_mam_pages(void **state);
+void load_omemo_devicelist_push(void **state);
@@ -32,7 +32,9 @@ rooms_query(void **state)
 
     assert_true(stbbr_last_received(
         "<iq id='prof_confreq_4' to='conference.localhost' type='get'>"
-            "<query xmlns='http://jabber.org/protocol/disco#items'/>"
+            "<query xmlns='http://jabber.org/protocol/disco#items'>"
+                "<set xmlns='http://jabber.org/protocol/rsm'><max>250</max></set>"
+            "</query>"
         "</iq>"
     ));
 }
@@ -112,6 +112,17 @@ accounts_set_port(const char* const account_name, const int value)
 {
 }
 
+void
+accounts_set_upload_concurrency(const char* const account_name, const gint value)
+{
+}
+
+gint
+accounts_get_upload_concurrency(const char* const account_name)
+{
+    return 2;
+}
+
 void
 accounts_set_resource(const char* const account_name, const char* const value)
 {
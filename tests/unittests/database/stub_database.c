@@ -47,6 +47,85 @@ void
 log_database_add_outgoing_muc_pm(const char* const id, const char* const barejid, const char* const message, const char* const replace_id, prof_enc_t enc)
 {
 }
+gboolean
+log_database_get_last_archived(char** archive_id, GDateTime** timestamp)
+{
+    return FALSE;
+}
+void
+log_database_reads_check(void)
+{
+}
+GDateTime*
+log_database_get_last_muc(const char* const room)
+{
+    return NULL;
+}
+GSList*
+log_database_get_previous_muc(const gchar* const room, int count)
+{
+    return NULL;
+}
+gboolean
+log_database_search_available(void)
+{
+    return FALSE;
+}
+int
+log_database_search_indexed(void)
+{
+    return 100;
+}
+GSList*
+log_database_search(const char* const words, const char* const with, const char* const after, const char* const before, gint64* cursor, int count)
+{
+    return NULL;
+}
+void
+log_database_flush(void)
+{
+}
+void
+log_database_bulk_begin(void)
+{
+}
+void
+log_database_bulk_commit(void)
+{
+}
+void
+log_database_bulk_end(void)
+{
+}
+guint
+log_database_queue_depth(void)
+{
+    return 0;
+}
+int
+log_database_retention_days(const char* const retain)
+{
+    return 0;
+}
+void
+log_database_maintain(void)
+{
+}
+gboolean
+log_database_import_start(const char* const login)
+{
+    return FALSE;
+}
+gboolean
+log_database_import_status(gboolean* running, int* files_done, int* files_total, int* messages, gint64* elapsed_us)
+{
+    return FALSE;
+}
+gsize
+log_database_memory(void)
+{
+    return 0;
+}
 void
 log_database_close(void)
 {
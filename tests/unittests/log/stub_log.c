@@ -26,8 +26,13 @@
 
 #include "log.h"
 
+#undef log_debug
+#undef log_info
+#undef log_warning
+#undef log_error
+
 void
-log_init(log_level_t filter, char* log_file)
+log_init(log_level_t filter, char* log_file, gboolean binary)
 {
 }
 log_level_t
@@ -41,6 +46,15 @@ log_close(void)
 {
 }
 void
+log_rotate_update(void)
+{
+}
+gboolean
+log_level_enabled(log_level_t level)
+{
+    return TRUE;
+}
+void
 log_debug(const char* const msg, ...)
 {
 }
@@ -86,6 +100,12 @@ log_stderr_handler(void)
 {
 }
 
+int
+log_stderr_fd(void)
+{
+    return -1;
+}
+
 void
 chat_log_init(void)
 {
@@ -125,6 +145,18 @@ chat_log_omemo_msg_in(ProfMessage* message)
 {
 }
 
+void
+chat_log_flush(void)
+{
+}
+void
+chat_log_flush_check(void)
+{
+}
+void
+chat_log_compress_sweep(void)
+{
+}
 void
 chat_log_close(void)
 {
@@ -12,6 +12,13 @@ omemo_close(void)
 {
 }
 
+gsize
+omemo_memory(guint* sessions)
+{
+    *sessions = 0;
+    return 0;
+}
+
 char*
 omemo_fingerprint_autocomplete(const char* const search_str, gboolean previous)
 {
@@ -67,6 +74,11 @@ omemo_on_disconnect(void)
 {
 }
 
+void
+omemo_keyfiles_flush_check(void)
+{
+}
+
 char*
 omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_receipt, gboolean muc)
 {
@@ -109,10 +121,16 @@ omemo_start_sessions(void)
 }
 
 char*
-omemo_encrypt_file(FILE* in, FILE* out, off_t file_size, int* gcry_res)
+omemo_encrypt_file_stream(FILE* in, off_t file_size, struct omemo_file_stream_t** stream, int* gcry_res)
 {
     return NULL;
 };
+size_t
+omemo_file_stream_read(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    return 0;
+};
+void omemo_file_stream_free(void* stream){};
 void omemo_free(void* a){};
 
 uint32_t
@@ -50,10 +50,6 @@ otr_start_query(void)
     return mock_ptr_type(char*);
 }
 
-void
-otr_poll(void)
-{
-}
 void
 otr_on_connect(ProfAccount* account)
 {
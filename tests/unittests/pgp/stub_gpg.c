@@ -57,6 +57,22 @@ p_gpg_decrypt(const char* const cipher)
     return NULL;
 }
 
+void
+p_gpg_decrypt_async(const char* const cipher, ProfPGPDecryptCallback func, void* userdata, GDestroyNotify free_func)
+{
+}
+
+gboolean
+p_gpg_jobs_pending(void)
+{
+    return FALSE;
+}
+
+void
+p_gpg_jobs_finish(void)
+{
+}
+
 void
 p_gpg_on_connect(const char* const barejid)
 {
@@ -0,0 +1,85 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/arena.h"
+
+void
+allocations_do_not_overlap(void** state)
+{
+    Arena* arena = arena_new(64);
+
+    char* first = arena_alloc(arena, 40);
+    memset(first, 'a', 40);
+    char* second = arena_alloc(arena, 40);
+    memset(second, 'b', 40);
+
+    for (int i = 0; i < 40; i++) {
+        assert_int_equal('a', first[i]);
+    }
+
+    arena_free(arena);
+}
+
+void
+strdup_copies_string(void** state)
+{
+    Arena* arena = arena_new(64);
+    char original[] = "stanza-id";
+
+    char* copy = arena_strdup(arena, original);
+    original[0] = 'x';
+
+    assert_string_equal("stanza-id", copy);
+
+    arena_free(arena);
+}
+
+void
+strdup_null_returns_null(void** state)
+{
+    Arena* arena = arena_new(64);
+
+    assert_null(arena_strdup(arena, NULL));
+
+    arena_free(arena);
+}
+
+void
+allocation_larger_than_block_succeeds(void** state)
+{
+    Arena* arena = arena_new(64);
+
+    char* small = arena_strdup(arena, "small");
+    char* large = arena_alloc(arena, 1000);
+    memset(large, 'c', 1000);
+    char* after = arena_strdup(arena, "after");
+
+    assert_string_equal("small", small);
+    assert_string_equal("after", after);
+
+    arena_free(arena);
+}
+
+void
+reset_releases_everything(void** state)
+{
+    Arena* arena = arena_new(64);
+
+    arena_alloc(arena, 1000);
+    for (int i = 0; i < 20; i++) {
+        arena_strdup(arena, "some message id");
+    }
+    assert_true(arena_used(arena) > 1000);
+
+    arena_reset(arena);
+
+    assert_int_equal(0, arena_used(arena));
+    assert_string_equal("again", arena_strdup(arena, "again"));
+
+    arena_free(arena);
+}
@@ -0,0 +1,5 @@
+void allocations_do_not_overlap(void** state);
+void strdup_copies_string(void** state);
+void strdup_null_returns_null(void** state);
+void allocation_larger_than_block_succeeds(void** state);
+void reset_releases_everything(void** state);
@@ -232,3 +232,104 @@ complete_previous(void** state)
     free(result3);
     free(result4);
 }
+
+void
+complete_previous_wraps_to_last(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "MyBuddy1");
+    autocomplete_add(ac, "MyBuddy2");
+    autocomplete_add(ac, "MyBuddy3");
+
+    char* result1 = autocomplete_complete(ac, "myb", TRUE, FALSE);
+    char* result2 = autocomplete_complete(ac, result1, TRUE, TRUE);
+
+    assert_string_equal("MyBuddy3", result2);
+
+    autocomplete_free(ac);
+
+    free(result1);
+    free(result2);
+}
+
+void
+complete_after_remove_last_found(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "MyBuddy1");
+    autocomplete_add(ac, "MyBuddy2");
+
+    char* result1 = autocomplete_complete(ac, "myb", TRUE, FALSE);
+    autocomplete_remove(ac, "MyBuddy1");
+    char* result2 = autocomplete_complete(ac, "myb", TRUE, FALSE);
+
+    assert_string_equal("MyBuddy1", result1);
+    assert_string_equal("MyBuddy2", result2);
+    assert_int_equal(1, autocomplete_length(ac));
+
+    autocomplete_free(ac);
+
+    free(result1);
+    free(result2);
+}
+
+void
+add_reverse_completes_newest_first(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add_reverse(ac, "MyBuddy1");
+    autocomplete_add_reverse(ac, "MyBuddy2");
+    autocomplete_add_reverse(ac, "MyBuddy1");
+
+    char* result = autocomplete_complete(ac, "myb", TRUE, FALSE);
+
+    assert_string_equal("MyBuddy2", result);
+    assert_int_equal(2, autocomplete_length(ac));
+
+    autocomplete_free(ac);
+    free(result);
+}
+
+void
+add_unsorted_completes_in_order(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add_unsorted(ac, "MyBuddy3");
+    autocomplete_add_unsorted(ac, "MyBuddy1");
+    autocomplete_add_unsorted(ac, "MyBuddy3");
+    autocomplete_add_unsorted(ac, "MyBuddy2");
+    autocomplete_sort(ac);
+
+    GList* result = autocomplete_create_list(ac);
+
+    assert_int_equal(3, autocomplete_length(ac));
+    assert_string_equal("MyBuddy1", g_list_nth_data(result, 0));
+    assert_string_equal("MyBuddy2", g_list_nth_data(result, 1));
+    assert_string_equal("MyBuddy3", g_list_nth_data(result, 2));
+
+    g_list_free_full(result, free);
+    autocomplete_free(ac);
+}
+
+void
+add_unsorted_merges_with_sorted_items(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "MyBuddy2");
+    autocomplete_add_unsorted(ac, "MyBuddy3");
+    autocomplete_add_unsorted(ac, "MyBuddy1");
+
+    // found without sorting first
+    char* result1 = autocomplete_complete(ac, "myb", TRUE, FALSE);
+    autocomplete_remove(ac, "MyBuddy3");
+    GList* result2 = autocomplete_create_list(ac);
+
+    assert_string_equal("MyBuddy1", result1);
+    assert_int_equal(2, g_list_length(result2));
+    assert_string_equal("MyBuddy1", g_list_nth_data(result2, 0));
+    assert_string_equal("MyBuddy2", g_list_nth_data(result2, 1));
+
+    free(result1);
+    g_list_free_full(result2, free);
+    autocomplete_free(ac);
+}
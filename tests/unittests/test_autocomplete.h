@@ -14,3 +14,8 @@ void complete_both_with_accented(void** state);
 void complete_both_with_base(void** state);
 void complete_ignores_case(void** state);
 void complete_previous(void** state);
+void complete_previous_wraps_to_last(void** state);
+void complete_after_remove_last_found(void** state);
+void add_reverse_completes_newest_first(void** state);
+void add_unsorted_completes_in_order(void** state);
+void add_unsorted_merges_with_sorted_items(void** state);
@@ -0,0 +1,76 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "ui/buffer.h"
+
+static void
+_append(ProfBuff buffer, const char* const id, gboolean receipt)
+{
+    GDateTime* now = g_date_time_new_now_local();
+    buffer_append(buffer, "-", 0, now, 0, THEME_TEXT_ME, "me", "me@server.org", "message", receipt, id);
+    g_date_time_unref(now);
+}
+
+static gboolean
+_received(ProfBuff buffer, const char* const id)
+{
+    return buffer_get_entry_by_id(buffer, id)->received;
+}
+
+void
+marker_marks_named_and_earlier_messages(void** state)
+{
+    ProfBuff buffer = buffer_create();
+    _append(buffer, "one", TRUE);
+    _append(buffer, "theirs", FALSE);
+    _append(buffer, "two", TRUE);
+    _append(buffer, "three", TRUE);
+
+    assert_true(buffer_mark_received_upto(buffer, "two"));
+
+    assert_true(_received(buffer, "one"));
+    assert_false(_received(buffer, "theirs"));
+    assert_true(_received(buffer, "two"));
+    assert_false(_received(buffer, "three"));
+
+    assert_false(buffer_mark_received_upto(buffer, "two"));
+
+    buffer_free(buffer);
+}
+
+void
+marker_for_unknown_id_marks_nothing(void** state)
+{
+    ProfBuff buffer = buffer_create();
+    _append(buffer, "one", TRUE);
+    _append(buffer, "two", TRUE);
+
+    assert_false(buffer_mark_received_upto(buffer, "unknown"));
+
+    assert_false(_received(buffer, "one"));
+    assert_false(_received(buffer, "two"));
+
+    buffer_free(buffer);
+}
+
+void
+prepend_to_full_buffer_drops_newest(void** state)
+{
+    ProfBuff buffer = buffer_create();
+    _append(buffer, "newest", FALSE);
+    gboolean dropped = FALSE;
+    while (!dropped) {
+        GDateTime* now = g_date_time_new_now_local();
+        dropped = buffer_prepend(buffer, "-", 0, now, 0, THEME_TEXT_HISTORY, "them", NULL, "older", FALSE, "older");
+        g_date_time_unref(now);
+    }
+
+    assert_null(buffer_get_entry_by_id(buffer, "newest"));
+    assert_string_equal(buffer_get_entry(buffer, 0)->message, "older");
+
+    buffer_free(buffer);
+}
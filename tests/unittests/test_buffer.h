@@ -0,0 +1,3 @@
+void marker_marks_named_and_earlier_messages(void** state);
+void marker_for_unknown_id_marks_nothing(void** state);
+void prepend_to_full_buffer_drops_newest(void** state);
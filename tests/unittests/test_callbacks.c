@@ -64,3 +64,37 @@ returns_commands(void** state)
     // TODO: why does this make the test fail?
     // callbacks_close();
 }
+
+static PluginCommand*
+_new_command(const char* const name)
+{
+    PluginCommand* command = calloc(1, sizeof(PluginCommand));
+    command->command_name = strdup(name);
+    command->help = calloc(1, sizeof(CommandHelp));
+
+    return command;
+}
+
+void
+removing_plugin_restores_shadowed_command(void** state)
+{
+    callbacks_init();
+
+    PluginCommand* command1 = _new_command("/shared");
+    callbacks_add_command("plugin1", command1);
+    PluginCommand* command2 = _new_command("/shared");
+    callbacks_add_command("plugin2", command2);
+
+    assert_ptr_equal(plugins_get_help("/shared"), command2->help);
+    GList* names = plugins_get_command_names();
+    assert_int_equal(g_list_length(names), 1);
+    g_list_free(names);
+
+    callbacks_remove("plugin2");
+    assert_ptr_equal(plugins_get_help("/shared"), command1->help);
+
+    callbacks_remove("plugin1");
+    assert_null(plugins_get_help("/shared"));
+
+    callbacks_close();
+}
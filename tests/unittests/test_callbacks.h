@@ -1,2 +1,3 @@
 void returns_no_commands(void** state);
 void returns_commands(void** state);
+void removing_plugin_restores_shadowed_command(void** state);
@@ -53,3 +53,25 @@ removes_chat_session(void** state)
 
     assert_null(session);
 }
+
+void
+changes_generation_only_when_sessions_change(void** state)
+{
+    char* barejid = "myjid@server.org";
+    char* resource = "laptop";
+
+    guint before = chat_session_generation();
+    chat_session_recipient_active(barejid, resource, TRUE);
+    guint created = chat_session_generation();
+    chat_session_recipient_active(barejid, resource, TRUE);
+    guint same = chat_session_generation();
+    chat_session_recipient_active(barejid, resource, FALSE);
+    guint changed = chat_session_generation();
+    chat_session_remove(barejid);
+    guint removed = chat_session_generation();
+
+    assert_int_not_equal(before, created);
+    assert_int_equal(created, same);
+    assert_int_not_equal(same, changed);
+    assert_int_not_equal(changed, removed);
+}
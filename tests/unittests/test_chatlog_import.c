@@ -0,0 +1,99 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/chatlog_import.h"
+
+void
+chatlog_import_parses_chat_path(void** state)
+{
+    ChatlogFile* file = chatlog_import_parse_path("buddy_at_example.org/2020_03_24.log");
+
+    assert_non_null(file);
+    assert_string_equal("buddy@example.org", file->contact);
+    assert_null(file->resource);
+    assert_false(file->room);
+    assert_int_equal(2020, file->year);
+    assert_int_equal(3, file->month);
+    assert_int_equal(24, file->day);
+
+    chatlog_import_file_free(file);
+}
+
+void
+chatlog_import_parses_room_and_private_paths(void** state)
+{
+    ChatlogFile* room = chatlog_import_parse_path("rooms/my_room_at_conference.example.org/2021_12_01.log");
+    assert_non_null(room);
+    assert_string_equal("my_room@conference.example.org", room->contact);
+    assert_null(room->resource);
+    assert_true(room->room);
+    chatlog_import_file_free(room);
+
+    ChatlogFile* pm = chatlog_import_parse_path("room_at_conference.example.org_some_nick/2021_12_01.log");
+    assert_non_null(pm);
+    assert_string_equal("room@conference.example.org", pm->contact);
+    assert_string_equal("some_nick", pm->resource);
+    assert_false(pm->room);
+    chatlog_import_file_free(pm);
+}
+
+void
+chatlog_import_rejects_other_paths(void** state)
+{
+    assert_null(chatlog_import_parse_path("buddy_at_example.org/notes.txt"));
+    assert_null(chatlog_import_parse_path("buddy_at_example.org/2020_13_01.log"));
+    assert_null(chatlog_import_parse_path("2020_01_01.log"));
+    assert_null(chatlog_import_parse_path("other/room_at_example.org/2020_01_01.log"));
+    assert_null(chatlog_import_parse_path("_at_example.org/2020_01_01.log"));
+}
+
+void
+chatlog_import_parses_messages_and_actions(void** state)
+{
+    GSList* lines = chatlog_import_parse("09:05:01 - buddy@example.org: hi: there\n"
+                                         "09:05:07 - *me waves\n"
+                                         "23:59:59 - me:\n");
+
+    assert_int_equal(3, g_slist_length(lines));
+
+    ChatlogLine* line = lines->data;
+    assert_int_equal(9, line->hour);
+    assert_int_equal(5, line->minute);
+    assert_int_equal(1, line->second);
+    assert_string_equal("buddy@example.org", line->name);
+    assert_string_equal("hi: there", line->message);
+
+    line = lines->next->data;
+    assert_string_equal("me", line->name);
+    assert_string_equal("/me waves", line->message);
+
+    line = lines->next->next->data;
+    assert_int_equal(23, line->hour);
+    assert_string_equal("me", line->name);
+    assert_string_equal("", line->message);
+
+    g_slist_free_full(lines, (GDestroyNotify)chatlog_import_line_free);
+}
+
+void
+chatlog_import_joins_continuation_lines(void** state)
+{
+    GSList* lines = chatlog_import_parse("stray text before the first message\n"
+                                         "10:00:00 - nick: first\r\n"
+                                         "\n"
+                                         "second\n"
+                                         "10:00:01 - nick: next\n");
+
+    assert_int_equal(2, g_slist_length(lines));
+    ChatlogLine* line = lines->data;
+    assert_string_equal("first\n\nsecond", line->message);
+    line = lines->next->data;
+    assert_string_equal("next", line->message);
+
+    g_slist_free_full(lines, (GDestroyNotify)chatlog_import_line_free);
+}
@@ -0,0 +1,5 @@
+void chatlog_import_parses_chat_path(void** state);
+void chatlog_import_parses_room_and_private_paths(void** state);
+void chatlog_import_rejects_other_paths(void** state);
+void chatlog_import_parses_messages_and_actions(void** state);
+void chatlog_import_joins_continuation_lines(void** state);
@@ -140,3 +140,51 @@ cmd_alias_list_shows_all_aliases(void** state)
     gboolean result = cmd_alias(NULL, CMD_ALIAS, args);
     assert_true(result);
 }
+
+void
+cmd_alias_add_resolves_alias(void** state)
+{
+    gchar* args[] = { "add", "hc", "/help commands", NULL };
+
+    cmd_init();
+    assert_int_equal(CMD_RESOLVED_UNKNOWN, cmd_resolve("/hc")->kind);
+
+    expect_cons_show("Command alias added /hc -> /help commands");
+    cmd_alias(NULL, CMD_ALIAS, args);
+
+    const CmdResolved* resolved = cmd_resolve("/hc");
+    assert_int_equal(CMD_RESOLVED_ALIAS, resolved->kind);
+    assert_string_equal("/help commands", resolved->alias);
+
+    cmd_uninit();
+}
+
+void
+cmd_alias_remove_stops_resolving_alias(void** state)
+{
+    gchar* args[] = { "remove", "hn", NULL };
+
+    cmd_init();
+    prefs_add_alias("hn", "/help navigation");
+    assert_int_equal(CMD_RESOLVED_ALIAS, cmd_resolve("/hn")->kind);
+
+    expect_cons_show("Command alias removed -> /hn");
+    cmd_alias(NULL, CMD_ALIAS, args);
+
+    assert_int_equal(CMD_RESOLVED_UNKNOWN, cmd_resolve("/hn")->kind);
+
+    cmd_uninit();
+}
+
+void
+cmd_resolve_finds_builtin_before_alias(void** state)
+{
+    cmd_init();
+    prefs_add_alias("help", "/about");
+
+    const CmdResolved* resolved = cmd_resolve("/help");
+    assert_int_equal(CMD_RESOLVED_BUILTIN, resolved->kind);
+    assert_ptr_equal(cmd_get("/help"), resolved->cmd);
+
+    cmd_uninit();
+}
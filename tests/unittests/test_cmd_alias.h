@@ -7,3 +7,6 @@ void cmd_alias_add_shows_message_when_exists(void** state);
 void cmd_alias_remove_removes_alias(void** state);
 void cmd_alias_remove_shows_message_when_no_alias(void** state);
 void cmd_alias_list_shows_all_aliases(void** state);
+void cmd_alias_add_resolves_alias(void** state);
+void cmd_alias_remove_stops_resolving_alias(void** state);
+void cmd_resolve_finds_builtin_before_alias(void** state);
@@ -270,7 +270,7 @@ test_cmd_otr_theirfp_from_wintype(win_type_t wintype)
     ProfWin window;
     window.type = wintype;
     window.layout = NULL;
-    window.urls_ac = NULL;
+    window.urls = NULL;
 
     will_return(connection_get_status, JABBER_CONNECTED);
 
@@ -307,7 +307,7 @@ cmd_otr_theirfp_shows_message_when_non_otr_chat_window(void** state)
     ProfWin window;
     window.type = WIN_CHAT;
     window.layout = NULL;
-    window.urls_ac = NULL;
+    window.urls = NULL;
     ProfChatWin chatwin;
     chatwin.window = window;
     chatwin.memcheck = PROFCHATWIN_MEMCHECK;
@@ -336,7 +336,7 @@ cmd_otr_theirfp_shows_fingerprint(void** state)
     ProfWin window;
     window.type = WIN_CHAT;
     window.layout = NULL;
-    window.urls_ac = NULL;
+    window.urls = NULL;
     ProfChatWin chatwin;
     chatwin.window = window;
     chatwin.barejid = recipient;
@@ -364,7 +364,7 @@ test_cmd_otr_start_from_wintype(win_type_t wintype)
     ProfWin window;
     window.type = wintype;
     window.layout = NULL;
-    window.urls_ac = NULL;
+    window.urls = NULL;
 
     will_return(connection_get_status, JABBER_CONNECTED);
 
@@ -403,7 +403,7 @@ cmd_otr_start_shows_message_when_already_started(void** state)
     ProfWin window;
     window.type = WIN_CHAT;
     window.layout = NULL;
-    window.urls_ac = NULL;
+    window.urls = NULL;
     ProfChatWin chatwin;
     chatwin.window = window;
     chatwin.barejid = recipient;
@@ -429,7 +429,7 @@ cmd_otr_start_shows_message_when_no_key(void** state)
     ProfWin window;
     window.type = WIN_CHAT;
     window.layout = NULL;
-    window.urls_ac = NULL;
+    window.urls = NULL;
     ProfChatWin chatwin;
     chatwin.window = window;
     chatwin.barejid = recipient;
@@ -453,7 +453,7 @@ cmd_otr_start_sends_otr_query_message_to_current_recipeint(void** state)
     ProfWin window;
     window.type = WIN_CHAT;
     window.layout = NULL;
-    window.urls_ac = NULL;
+    window.urls = NULL;
     ProfChatWin chatwin;
     chatwin.window = window;
     chatwin.barejid = recipient;
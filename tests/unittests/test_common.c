@@ -829,3 +829,22 @@ prof_whole_occurrences_tests(void** state)
     g_slist_free(expected);
     expected = NULL;
 }
+
+void
+prof_occurrences_in_long_message(void** state)
+{
+    GString* message = g_string_new(NULL);
+    for (int i = 0; i < 100000; i++) {
+        g_string_append(message, "x ");
+    }
+    g_string_append(message, "boothj5");
+
+    GSList* actual = NULL;
+    prof_occurrences("boothj5", message->str, 0, TRUE, &actual);
+
+    assert_int_equal(1, g_slist_length(actual));
+    assert_int_equal(200000, GPOINTER_TO_INT(actual->data));
+
+    g_slist_free(actual);
+    g_string_free(message, TRUE);
+}
@@ -429,3 +429,31 @@ contact_available_when_highest_priority_chat(void** state)
 
     p_contact_free(contact);
 }
+
+void
+contact_revision_changes_with_name_and_presence(void** state)
+{
+    PContact contact = p_contact_new("bob@server.com", "bob", NULL, NULL,
+                                     "is offline", FALSE);
+    PContact other = p_contact_new("alice@server.com", NULL, NULL, NULL, NULL, FALSE);
+    assert_int_not_equal(p_contact_revision(contact), p_contact_revision(other));
+
+    guint revision = p_contact_revision(contact);
+    p_contact_set_name(contact, "robert");
+    assert_int_not_equal(revision, p_contact_revision(contact));
+
+    revision = p_contact_revision(contact);
+    p_contact_set_presence(contact, resource_new("laptop", RESOURCE_AWAY, NULL, 10));
+    assert_int_not_equal(revision, p_contact_revision(contact));
+
+    revision = p_contact_revision(contact);
+    p_contact_set_pending_out(contact, TRUE);
+    p_contact_remove_resource(contact, "phone");
+    assert_int_equal(revision, p_contact_revision(contact));
+
+    p_contact_remove_resource(contact, "laptop");
+    assert_int_not_equal(revision, p_contact_revision(contact));
+
+    p_contact_free(other);
+    p_contact_free(contact);
+}
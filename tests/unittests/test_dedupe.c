@@ -0,0 +1,88 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "tools/dedupe.h"
+
+static void
+_add_numbered(int from, int to)
+{
+    for (int i = from; i < to; i++) {
+        char* id = g_strdup_printf("id-%d", i);
+        dedupe_add(NULL, id);
+        g_free(id);
+    }
+}
+
+void
+unseen_id_is_not_seen(void** state)
+{
+    assert_false(dedupe_seen(NULL, "abc"));
+
+    dedupe_add(NULL, "def");
+
+    assert_false(dedupe_seen(NULL, "abc"));
+
+    dedupe_close();
+}
+
+void
+added_id_is_seen(void** state)
+{
+    dedupe_add(NULL, "abc");
+
+    assert_true(dedupe_seen(NULL, "abc"));
+
+    dedupe_close();
+}
+
+void
+scopes_are_separate(void** state)
+{
+    dedupe_add("buddy1@server.org", "abc");
+
+    assert_true(dedupe_seen("buddy1@server.org", "abc"));
+    assert_false(dedupe_seen("buddy2@server.org", "abc"));
+    assert_false(dedupe_seen(NULL, "abc"));
+
+    dedupe_close();
+}
+
+void
+readding_id_keeps_one_entry(void** state)
+{
+    dedupe_add(NULL, "abc");
+    dedupe_add(NULL, "abc");
+
+    assert_int_equal(1, dedupe_size());
+
+    dedupe_close();
+}
+
+void
+oldest_id_is_forgotten_when_full(void** state)
+{
+    _add_numbered(0, DEDUPE_MAX_IDS + 1);
+
+    assert_int_equal(DEDUPE_MAX_IDS, dedupe_size());
+    assert_false(dedupe_seen(NULL, "id-0"));
+    assert_true(dedupe_seen(NULL, "id-1"));
+
+    dedupe_close();
+}
+
+void
+recently_seen_id_survives_eviction(void** state)
+{
+    _add_numbered(0, DEDUPE_MAX_IDS);
+    dedupe_add(NULL, "id-0");
+    _add_numbered(DEDUPE_MAX_IDS, DEDUPE_MAX_IDS + 1);
+
+    assert_true(dedupe_seen(NULL, "id-0"));
+    assert_false(dedupe_seen(NULL, "id-1"));
+
+    dedupe_close();
+}
@@ -0,0 +1,6 @@
+void unseen_id_is_not_seen(void** state);
+void added_id_is_seen(void** state);
+void scopes_are_separate(void** state);
+void readding_id_keeps_one_entry(void** state);
+void oldest_id_is_forgotten_when_full(void** state);
+void recently_seen_id_survives_eviction(void** state);
@@ -0,0 +1,53 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "xmpp/xmpp.h"
+#include "xmpp/stanza.h"
+#include "xmpp/feature_atoms.h"
+
+void
+known_feature_has_atom(void** state)
+{
+    assert_int_equal(FEATURE_ATOM_PING, feature_atom(XMPP_FEATURE_PING));
+    assert_int_equal(FEATURE_ATOM_CARBONS, feature_atom(STANZA_NS_CARBONS));
+
+    feature_atoms_close();
+}
+
+void
+unknown_feature_has_no_atom(void** state)
+{
+    assert_int_equal(-1, feature_atom("urn:example:unknown"));
+    assert_int_equal(-1, feature_atom(NULL));
+
+    feature_atoms_close();
+}
+
+void
+feature_set_holds_added_features(void** state)
+{
+    FeatureSet set = FEATURE_SET_EMPTY;
+    set = feature_set_add(set, XMPP_FEATURE_MAM2);
+    set = feature_set_add(set, XMPP_FEATURE_RECEIPTS);
+
+    assert_true(feature_set_has(set, FEATURE_ATOM_MAM2));
+    assert_true(feature_set_has(set, FEATURE_ATOM_RECEIPTS));
+    assert_false(feature_set_has(set, FEATURE_ATOM_PING));
+    assert_false(feature_set_has(set, -1));
+
+    feature_atoms_close();
+}
+
+void
+unknown_feature_leaves_set_unchanged(void** state)
+{
+    FeatureSet set = feature_set_add(FEATURE_SET_EMPTY, XMPP_FEATURE_MUC);
+
+    assert_int_equal(set, feature_set_add(set, "urn:example:unknown"));
+
+    feature_atoms_close();
+}
@@ -0,0 +1,4 @@
+void known_feature_has_atom(void** state);
+void unknown_feature_has_no_atom(void** state);
+void feature_set_holds_added_features(void** state);
+void unknown_feature_leaves_set_unchanged(void** state);
@@ -23,6 +23,7 @@ _new_form(void)
     form->fields = NULL;
     form->var_to_tag = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
     form->tag_to_var = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    form->tag_to_field = NULL;
     form->tag_ac = NULL;
 
     return form;
@@ -39,6 +40,7 @@ _new_field(void)
     field->options = NULL;
     field->var = NULL;
     field->values = NULL;
+    field->option_index = NULL;
     field->value_ac = NULL;
 
     return field;
@@ -745,3 +747,36 @@ remove_text_multi_value_removes_when_many(void** state)
 
     form_destroy(form);
 }
+
+void
+field_contains_option_finds_value_among_many(void** state)
+{
+    DataForm* form = _new_form();
+    g_hash_table_insert(form->tag_to_var, strdup("tag1"), strdup("var1"));
+    g_hash_table_insert(form->tag_to_var, strdup("tag2"), strdup("var2"));
+
+    FormField* field1 = _new_field();
+    field1->var = strdup("var1");
+    field1->type_t = FIELD_LIST_MULTI;
+    for (int i = 0; i < 2000; i++) {
+        FormOption* option = malloc(sizeof(FormOption));
+        option->label = g_strdup_printf("User %d", i);
+        option->value = g_strdup_printf("user%d@example.org", i);
+        field1->options = g_slist_prepend(field1->options, option);
+    }
+    form->fields = g_slist_append(form->fields, field1);
+
+    FormField* field2 = _new_field();
+    field2->var = strdup("var2");
+    field2->type_t = FIELD_TEXT_SINGLE;
+    form->fields = g_slist_append(form->fields, field2);
+
+    assert_true(form_field_contains_option(form, "tag1", "user1234@example.org"));
+    assert_false(form_field_contains_option(form, "tag1", "user2000@example.org"));
+    assert_false(form_field_contains_option(form, "tag2", "user1234@example.org"));
+    assert_false(form_field_contains_option(form, "tag3", "user1234@example.org"));
+    assert_ptr_equal(field2, form_get_field_by_tag(form, "tag2"));
+    assert_null(form_get_field_by_tag(form, "tag3"));
+
+    form_destroy(form);
+}
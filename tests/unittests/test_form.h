@@ -19,3 +19,4 @@ void remove_text_multi_value_does_nothing_when_none(void** state);
 void remove_text_multi_value_does_nothing_when_doesnt_exist(void** state);
 void remove_text_multi_value_removes_when_one(void** state);
 void remove_text_multi_value_removes_when_many(void** state);
+void field_contains_option_finds_value_among_many(void** state);
@@ -0,0 +1,92 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/intern.h"
+
+void
+intern_equal_strings_share_copy(void** state)
+{
+    char first[] = "buddy@example.org";
+    char second[] = "buddy@example.org";
+
+    const char* a = intern(first);
+    const char* b = intern(second);
+
+    assert_ptr_equal(a, b);
+    assert_ptr_not_equal(a, first);
+
+    intern_unref(a);
+    intern_unref(b);
+}
+
+void
+intern_different_strings_differ(void** state)
+{
+    const char* a = intern("alice");
+    const char* b = intern("bob");
+
+    assert_ptr_not_equal(a, b);
+    assert_string_equal("alice", a);
+    assert_string_equal("bob", b);
+
+    intern_unref(a);
+    intern_unref(b);
+}
+
+void
+intern_null_returns_null(void** state)
+{
+    assert_null(intern(NULL));
+    assert_null(intern_ref(NULL));
+    intern_unref(NULL);
+}
+
+void
+intern_copy_outlives_original(void** state)
+{
+    char* original = strdup("room@conference.example.org");
+
+    const char* interned = intern(original);
+    free(original);
+
+    assert_string_equal("room@conference.example.org", interned);
+
+    intern_unref(interned);
+}
+
+void
+intern_last_unref_frees(void** state)
+{
+    guint before = intern_count();
+
+    const char* a = intern("nick-to-free");
+    const char* b = intern("nick-to-free");
+    assert_int_equal(before + 1, intern_count());
+
+    intern_unref(a);
+    assert_int_equal(before + 1, intern_count());
+    intern_unref(b);
+    assert_int_equal(before, intern_count());
+}
+
+void
+intern_ref_keeps_copy(void** state)
+{
+    guint before = intern_count();
+
+    const char* a = intern("group");
+    const char* b = intern_ref(a);
+    assert_ptr_equal(a, b);
+
+    intern_unref(a);
+    assert_string_equal("group", b);
+    assert_int_equal(before + 1, intern_count());
+
+    intern_unref(b);
+    assert_int_equal(before, intern_count());
+}
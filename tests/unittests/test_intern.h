@@ -0,0 +1,6 @@
+void intern_equal_strings_share_copy(void** state);
+void intern_different_strings_differ(void** state);
+void intern_null_returns_null(void** state);
+void intern_copy_outlives_original(void** state);
+void intern_last_unref_frees(void** state);
+void intern_ref_keeps_copy(void** state);
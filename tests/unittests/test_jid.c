@@ -237,3 +237,88 @@ returns_barejid_when_fulljid_not_exists(void** state)
 
     jid_destroy(jid);
 }
+
+void
+intern_returns_same_jid_for_same_string(void** state)
+{
+    Jid* first = jid_intern("user@server.org/laptop");
+    Jid* second = jid_intern("user@server.org/laptop");
+
+    assert_ptr_equal(first, second);
+    assert_string_equal("user@server.org", second->barejid);
+    assert_int_equal(1, jid_cache_size());
+
+    jid_destroy(first);
+    jid_destroy(second);
+    jid_cache_clear();
+}
+
+void
+intern_invalid_returns_null(void** state)
+{
+    assert_null(jid_intern(NULL));
+    assert_null(jid_intern(""));
+    assert_null(jid_intern("@server.org"));
+    assert_int_equal(0, jid_cache_size());
+
+    jid_cache_clear();
+}
+
+void
+interned_jid_outlives_cache_clear(void** state)
+{
+    Jid* jid = jid_intern("user@server.org/laptop");
+
+    jid_cache_clear();
+
+    assert_int_equal(0, jid_cache_size());
+    assert_string_equal("user@server.org/laptop", jid->fulljid);
+
+    jid_destroy(jid);
+}
+
+void
+intern_forgets_least_recently_used(void** state)
+{
+    Jid* first = jid_intern("first@server.org");
+    jid_destroy(first);
+
+    for (int i = 0; i < JID_CACHE_MAX; i++) {
+        char* str = g_strdup_printf("user%d@server.org", i);
+        jid_destroy(jid_intern(str));
+        g_free(str);
+    }
+
+    assert_int_equal(JID_CACHE_MAX, jid_cache_size());
+
+    Jid* again = jid_intern("first@server.org");
+    assert_string_equal("first@server.org", again->barejid);
+    assert_int_equal(JID_CACHE_MAX, jid_cache_size());
+
+    jid_destroy(again);
+    jid_cache_clear();
+}
+
+void
+fold_lowers_ascii_into_buffer(void** state)
+{
+    char buf[32];
+    char* alloced;
+    char* folded = jid_fold("Bob@Server.ORG/Phone", buf, sizeof(buf), &alloced);
+
+    assert_ptr_equal(buf, folded);
+    assert_null(alloced);
+    assert_string_equal("bob@server.org/phone", folded);
+}
+
+void
+fold_allocates_when_too_long(void** state)
+{
+    char buf[8];
+    char* alloced;
+    char* folded = jid_fold("Bob@Server.ORG", buf, sizeof(buf), &alloced);
+
+    assert_ptr_equal(alloced, folded);
+    assert_string_equal("bob@server.org", folded);
+    g_free(alloced);
+}
@@ -23,3 +23,9 @@ void create_with_at_and_slash_in_resource(void** state);
 void create_full_with_trailing_slash(void** state);
 void returns_fulljid_when_exists(void** state);
 void returns_barejid_when_fulljid_not_exists(void** state);
+void intern_returns_same_jid_for_same_string(void** state);
+void intern_invalid_returns_null(void** state);
+void interned_jid_outlives_cache_clear(void** state);
+void intern_forgets_least_recently_used(void** state);
+void fold_lowers_ascii_into_buffer(void** state);
+void fold_allocates_when_too_long(void** state);
@@ -0,0 +1,91 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/logcompress.h"
+
+static gchar*
+_log_path(gchar** dir)
+{
+    *dir = g_dir_make_tmp("prof_logcompress_XXXXXX", NULL);
+    assert_non_null(*dir);
+
+    return g_build_filename(*dir, "2020_01_31.log", NULL);
+}
+
+static void
+_cleanup(gchar* dir, gchar* path)
+{
+    gchar* gzpath = g_strdup_printf("%s%s", path, LOGCOMPRESS_SUFFIX);
+    g_unlink(path);
+    g_unlink(gzpath);
+    g_rmdir(dir);
+    g_free(gzpath);
+    g_free(path);
+    g_free(dir);
+}
+
+void
+logcompress_replaces_file_with_gzip(void** state)
+{
+    gchar* dir;
+    gchar* path = _log_path(&dir);
+    gchar* gzpath = g_strdup_printf("%s%s", path, LOGCOMPRESS_SUFFIX);
+    assert_true(g_file_set_contents(path, "10:00:00 - me: hello\n", -1, NULL));
+
+    assert_true(logcompress_file(path));
+
+    assert_false(g_file_test(path, G_FILE_TEST_EXISTS));
+    assert_true(g_file_test(gzpath, G_FILE_TEST_EXISTS));
+    gchar* contents = NULL;
+    gsize length = 0;
+    assert_true(logcompress_get_contents(path, &contents, &length));
+    assert_string_equal("10:00:00 - me: hello\n", contents);
+    assert_int_equal(strlen(contents), length);
+
+    g_free(contents);
+    g_free(gzpath);
+    _cleanup(dir, path);
+}
+
+void
+logcompress_reads_copy_and_later_lines(void** state)
+{
+    gchar* dir;
+    gchar* path = _log_path(&dir);
+    assert_true(g_file_set_contents(path, "10:00:00 - me: first\n", -1, NULL));
+    assert_true(logcompress_file(path));
+    assert_true(g_file_set_contents(path, "10:00:01 - me: second\n", -1, NULL));
+
+    gchar* contents = NULL;
+    assert_true(logcompress_get_contents(path, &contents, NULL));
+    assert_string_equal("10:00:00 - me: first\n10:00:01 - me: second\n", contents);
+    g_free(contents);
+
+    assert_true(logcompress_file(path));
+    assert_false(g_file_test(path, G_FILE_TEST_EXISTS));
+    assert_true(logcompress_get_contents(path, &contents, NULL));
+    assert_string_equal("10:00:00 - me: first\n10:00:01 - me: second\n", contents);
+    g_free(contents);
+
+    _cleanup(dir, path);
+}
+
+void
+logcompress_missing_file_fails(void** state)
+{
+    gchar* dir;
+    gchar* path = _log_path(&dir);
+    gchar* contents = NULL;
+
+    assert_false(logcompress_file(path));
+    assert_false(logcompress_get_contents(path, &contents, NULL));
+    assert_null(contents);
+
+    _cleanup(dir, path);
+}
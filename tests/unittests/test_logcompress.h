@@ -0,0 +1,3 @@
+void logcompress_replaces_file_with_gzip(void** state);
+void logcompress_reads_copy_and_later_lines(void** state);
+void logcompress_missing_file_fails(void** state);
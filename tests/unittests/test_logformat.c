@@ -0,0 +1,127 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/logformat.h"
+
+static GString* decoded = NULL;
+
+static void
+_collect(gint64 time_us, const char* area, const char* level, const char* msg, void* userdata)
+{
+    g_string_append_printf(decoded, "%" G_GINT64_FORMAT " %s %s %s\n", time_us, area, level, msg);
+}
+
+// writes the frames to a temporary file and decodes it again
+static void
+_roundtrip(GBytes** frames, int count)
+{
+    FILE* fp = tmpfile();
+    assert_non_null(fp);
+    fputs(LOGFORMAT_MAGIC, fp);
+    for (int i = 0; i < count; i++) {
+        gsize size;
+        gconstpointer data = g_bytes_get_data(frames[i], &size);
+        fwrite(data, 1, size, fp);
+    }
+    rewind(fp);
+
+    decoded = g_string_new("");
+    assert_true(logformat_read_magic(fp));
+    for (int i = 0; i < count; i++) {
+        assert_true(logformat_read_frame(fp, _collect, NULL));
+    }
+    assert_false(logformat_read_frame(fp, _collect, NULL));
+    assert_true(feof(fp));
+    fclose(fp);
+}
+
+void
+logformat_roundtrips_lines(void** state)
+{
+    LogFormatEncoder* encoder = logformat_encoder_new();
+    logformat_encoder_add(encoder, 1700000000000000, "prof", "INF", "Starting Profanity");
+    logformat_encoder_add(encoder, 1700000000000250, "xmpp", "DBG", "SENT: <presence/>");
+    logformat_encoder_add(encoder, 1700000001000000, "prof", "ERR", "");
+
+    GBytes* frame = logformat_encoder_frame(encoder);
+    assert_non_null(frame);
+    assert_int_equal(0, logformat_encoder_pending(encoder));
+    assert_null(logformat_encoder_frame(encoder));
+
+    _roundtrip(&frame, 1);
+    assert_string_equal("1700000000000000 prof INF Starting Profanity\n"
+                        "1700000000000250 xmpp DBG SENT: <presence/>\n"
+                        "1700000001000000 prof ERR \n",
+                        decoded->str);
+
+    g_string_free(decoded, TRUE);
+    g_bytes_unref(frame);
+    logformat_encoder_free(encoder);
+}
+
+void
+logformat_frames_decode_alone(void** state)
+{
+    LogFormatEncoder* encoder = logformat_encoder_new();
+    GBytes* frames[2];
+
+    logformat_encoder_add(encoder, 10, "prof", "INF", "first");
+    frames[0] = logformat_encoder_frame(encoder);
+    logformat_encoder_add(encoder, 20, "xmpp", "WRN", "second");
+    frames[1] = logformat_encoder_frame(encoder);
+
+    _roundtrip(frames, 2);
+    assert_string_equal("10 prof INF first\n20 xmpp WRN second\n", decoded->str);
+
+    g_string_free(decoded, TRUE);
+    g_bytes_unref(frames[0]);
+    g_bytes_unref(frames[1]);
+    logformat_encoder_free(encoder);
+}
+
+void
+logformat_compresses_repeated_lines(void** state)
+{
+    LogFormatEncoder* encoder = logformat_encoder_new();
+    gsize text_size = 0;
+    for (int i = 0; i < 1000; i++) {
+        const char* msg = "RECV: <presence from='alice@example.org/laptop'><show>away</show></presence>";
+        logformat_encoder_add(encoder, 1700000000000000 + i * 1000, "xmpp", "DBG", msg);
+        text_size += strlen("01/01/2024 00:00:00: xmpp: DBG: \n") + strlen(msg);
+    }
+
+    GBytes* frame = logformat_encoder_frame(encoder);
+    assert_true(g_bytes_get_size(frame) * 10 < text_size);
+
+    g_bytes_unref(frame);
+    logformat_encoder_free(encoder);
+}
+
+void
+logformat_rejects_damaged_frame(void** state)
+{
+    LogFormatEncoder* encoder = logformat_encoder_new();
+    logformat_encoder_add(encoder, 10, "prof", "INF", "some line that gets cut short");
+    GBytes* frame = logformat_encoder_frame(encoder);
+
+    FILE* fp = tmpfile();
+    gsize size;
+    gconstpointer data = g_bytes_get_data(frame, &size);
+    fwrite(data, 1, size - 3, fp);
+    rewind(fp);
+
+    decoded = g_string_new("");
+    assert_false(logformat_read_frame(fp, _collect, NULL));
+    assert_string_equal("", decoded->str);
+
+    fclose(fp);
+    g_string_free(decoded, TRUE);
+    g_bytes_unref(frame);
+    logformat_encoder_free(encoder);
+}
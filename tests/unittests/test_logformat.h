@@ -0,0 +1,4 @@
+void logformat_roundtrips_lines(void** state);
+void logformat_frames_decode_alone(void** state);
+void logformat_compresses_repeated_lines(void** state);
+void logformat_rejects_damaged_frame(void** state);
@@ -0,0 +1,126 @@
+#include "config.h"
+
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/mempool.h"
+
+void
+pool_alloc_fits_size(void** state)
+{
+    MemPool* pool = mem_pool_new();
+
+    char* small = mem_pool_alloc(pool, 10);
+    memset(small, 'a', 10);
+    char* medium = mem_pool_alloc(pool, 300);
+    memset(medium, 'b', 300);
+
+    assert_int_equal('a', small[9]);
+    assert_int_equal('b', medium[299]);
+
+    mem_pool_release(pool, small);
+    mem_pool_release(pool, medium);
+    mem_pool_free(pool);
+}
+
+void
+pool_reuses_released_block(void** state)
+{
+    MemPool* pool = mem_pool_new();
+
+    void* first = mem_pool_alloc(pool, 40);
+    mem_pool_release(pool, first);
+    void* second = mem_pool_alloc(pool, 50);
+
+    MemPoolStats stats;
+    mem_pool_get_stats(pool, &stats);
+    assert_int_equal(2, stats.allocs);
+    assert_int_equal(1, stats.frees);
+#ifdef HAVE_MALLOC_USABLE_SIZE
+    assert_ptr_equal(first, second);
+    assert_int_equal(1, stats.reused);
+#else
+    assert_int_equal(0, stats.reused);
+#endif
+    assert_int_equal(0, stats.cached);
+
+    mem_pool_release(pool, second);
+    mem_pool_free(pool);
+}
+
+void
+pool_takes_back_foreign_blocks(void** state)
+{
+    MemPool* pool = mem_pool_new();
+
+    // freed by the pool though malloc gave it out, as strdup() strings are
+    mem_pool_release(pool, strdup("stanza text"));
+    // handed out by the pool and freed with free()
+    free(mem_pool_alloc(pool, 100));
+
+    MemPoolStats stats;
+    mem_pool_get_stats(pool, &stats);
+    assert_int_equal(1, stats.frees);
+
+    mem_pool_free(pool);
+}
+
+void
+pool_realloc_keeps_contents(void** state)
+{
+    MemPool* pool = mem_pool_new();
+
+    char* text = mem_pool_realloc(pool, NULL, 8);
+    strcpy(text, "message");
+    text = mem_pool_realloc(pool, text, 9);
+    text = mem_pool_realloc(pool, text, 5000);
+
+    assert_string_equal("message", text);
+
+    mem_pool_release(pool, text);
+    mem_pool_free(pool);
+}
+
+void
+pool_large_alloc_counted(void** state)
+{
+    MemPool* pool = mem_pool_new();
+
+    void* large = mem_pool_alloc(pool, 100000);
+    mem_pool_release(pool, large);
+
+    MemPoolStats stats;
+    mem_pool_get_stats(pool, &stats);
+    assert_int_equal(1, stats.large);
+    assert_int_equal(0, stats.cached);
+
+    mem_pool_free(pool);
+}
+
+void
+pool_trim_drops_cache(void** state)
+{
+    MemPool* pool = mem_pool_new();
+
+    void* first = mem_pool_alloc(pool, 64);
+    void* second = mem_pool_alloc(pool, 64);
+    mem_pool_release(pool, first);
+    mem_pool_release(pool, second);
+
+    MemPoolStats stats;
+#ifdef HAVE_MALLOC_USABLE_SIZE
+    mem_pool_get_stats(pool, &stats);
+    assert_int_equal(2, stats.cached);
+#endif
+    mem_pool_trim(pool);
+    mem_pool_get_stats(pool, &stats);
+    assert_int_equal(0, stats.cached);
+    assert_int_equal(0, stats.cached_bytes);
+
+    mem_pool_free(pool);
+}
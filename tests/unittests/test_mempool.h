@@ -0,0 +1,6 @@
+void pool_alloc_fits_size(void** state);
+void pool_reuses_released_block(void** state);
+void pool_takes_back_foreign_blocks(void** state);
+void pool_realloc_keeps_contents(void** state);
+void pool_large_alloc_counted(void** state);
+void pool_trim_drops_cache(void** state);
@@ -0,0 +1,72 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/autocomplete.h"
+#include "tools/memusage.h"
+
+void
+memusage_report_sorts_largest_first(void** state)
+{
+    GArray* report = memusage_report_new();
+    memusage_report_add(report, "small", 100, 1);
+    memusage_report_add(report, "large", 5000, 0);
+    memusage_report_add(report, "medium", 700, 3);
+
+    memusage_report_sort(report);
+
+    assert_string_equal("large", g_array_index(report, MemConsumer, 0).name);
+    assert_string_equal("medium", g_array_index(report, MemConsumer, 1).name);
+    assert_string_equal("small", g_array_index(report, MemConsumer, 2).name);
+    assert_int_equal(3, g_array_index(report, MemConsumer, 1).count);
+    assert_int_equal(5800, memusage_report_total(report));
+
+    memusage_report_free(report);
+}
+
+void
+memusage_hash_table_grows_with_entries(void** state)
+{
+    GHashTable* table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    gsize empty = memusage_hash_table(table);
+
+    for (int i = 1; i <= 100; i++) {
+        g_hash_table_add(table, GINT_TO_POINTER(i));
+    }
+
+    assert_true(memusage_hash_table(table) > empty);
+    assert_int_equal(0, memusage_hash_table(NULL));
+    assert_int_equal(0, memusage_string(NULL));
+    assert_int_equal(4 + MEMUSAGE_OVERHEAD, memusage_string("abc"));
+
+    g_hash_table_destroy(table);
+}
+
+void
+memusage_counts_autocompleters_alive(void** state)
+{
+    guint before_count = 0;
+    gsize before = autocomplete_memory_all(&before_count);
+
+    Autocomplete first = autocomplete_new();
+    Autocomplete second = autocomplete_new();
+    autocomplete_add(second, "some item");
+
+    guint count = 0;
+    gsize bytes = autocomplete_memory_all(&count);
+    assert_int_equal(before_count + 2, count);
+    assert_true(bytes > before);
+    assert_true(autocomplete_memory(second) > autocomplete_memory(first));
+
+    autocomplete_free(first);
+    autocomplete_memory_all(&count);
+    assert_int_equal(before_count + 1, count);
+
+    autocomplete_free(second);
+    assert_int_equal(before, autocomplete_memory_all(&count));
+    assert_int_equal(before_count, count);
+}
@@ -0,0 +1,3 @@
+void memusage_report_sorts_largest_first(void** state);
+void memusage_hash_table_grows_with_entries(void** state);
+void memusage_counts_autocompleters_alive(void** state);
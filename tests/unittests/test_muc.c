@@ -84,3 +84,76 @@ test_muc_active(void** state)
 
     assert_true(room_is_active);
 }
+
+void
+test_muc_roster_sorted_by_nick(void** state)
+{
+    char* room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "carol", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "alice", NULL, "moderator", "none", NULL, NULL);
+    muc_roster_add(room, "dave", NULL, "participant", "none", NULL, NULL);
+
+    GList* occupants = muc_roster(room);
+
+    assert_int_equal(3, g_list_length(occupants));
+    assert_string_equal("alice", ((Occupant*)occupants->data)->nick);
+    assert_string_equal("carol", ((Occupant*)occupants->next->data)->nick);
+    assert_string_equal("dave", ((Occupant*)occupants->next->next->data)->nick);
+
+    g_list_free(occupants);
+}
+
+void
+test_muc_roster_role_change_moves_occupant(void** state)
+{
+    char* room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "carol", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "carol", NULL, "moderator", "none", NULL, NULL);
+
+    assert_int_equal(0, g_sequence_get_length(muc_roster_view_by_role(room, MUC_ROLE_PARTICIPANT)));
+    assert_int_equal(1, g_sequence_get_length(muc_roster_view_by_role(room, MUC_ROLE_MODERATOR)));
+    assert_int_equal(1, g_sequence_get_length(muc_roster_view(room)));
+}
+
+void
+test_muc_roster_remove_drops_occupant(void** state)
+{
+    char* room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "carol", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "dave", NULL, "participant", "none", NULL, NULL);
+    muc_roster_remove(room, "carol");
+
+    GSList* participants = muc_occupants_by_role(room, MUC_ROLE_PARTICIPANT);
+
+    assert_int_equal(1, g_slist_length(participants));
+    assert_string_equal("dave", ((Occupant*)participants->data)->nick);
+
+    g_slist_free(participants);
+}
+
+void
+test_muc_roster_light_drops_details(void** state)
+{
+    char* room = "room@server.org";
+    muc_set_light_threshold(2);
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "carol", "carol@server.org/phone", "participant", "none", "away", "brb");
+    muc_roster_add(room, "dave", "dave@server.org/pc", "moderator", "none", NULL, "hi");
+    muc_set_light_threshold(0);
+
+    assert_true(muc_light(room));
+
+    Occupant* carol = muc_roster_item(room, "carol");
+    assert_string_equal("carol", carol->nick);
+    assert_int_equal(MUC_ROLE_PARTICIPANT, carol->role);
+    assert_null(carol->jid);
+    assert_null(carol->status);
+    assert_int_equal(1, g_sequence_get_length(muc_roster_view_by_role(room, MUC_ROLE_MODERATOR)));
+
+    char* result = autocomplete_complete(muc_roster_ac(room), "da", FALSE, FALSE);
+    assert_string_equal("dave", result);
+    g_free(result);
+}
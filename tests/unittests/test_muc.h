@@ -7,3 +7,7 @@ void test_muc_invites_count_0(void** state);
 void test_muc_invites_count_5(void** state);
 void test_muc_room_is_not_active(void** state);
 void test_muc_active(void** state);
+void test_muc_roster_sorted_by_nick(void** state);
+void test_muc_roster_role_change_moves_occupant(void** state);
+void test_muc_roster_remove_drops_occupant(void** state);
+void test_muc_roster_light_drops_details(void** state);
@@ -0,0 +1,94 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/multimatch.h"
+
+typedef struct
+{
+    GString* found;
+    int limit;
+} Matches;
+
+static gboolean
+_collect(guint pattern, gsize start, gsize len, void* userdata)
+{
+    Matches* matches = userdata;
+    g_string_append_printf(matches->found, "%u@%zu+%zu ", pattern, start, len);
+
+    return --matches->limit != 0;
+}
+
+static char*
+_scan(const gchar* const* patterns, guint count, const char* const text, int limit)
+{
+    MultiMatch* matcher = multimatch_new(patterns, count);
+    Matches matches = { g_string_new(NULL), limit };
+    multimatch_scan(matcher, text, _collect, &matches);
+    multimatch_free(matcher);
+
+    return g_string_free(matches.found, FALSE);
+}
+
+void
+overlapping_patterns_all_match(void** state)
+{
+    const gchar* patterns[] = { "he", "she", "his", "hers" };
+
+    char* found = _scan(patterns, 4, "ushers ahishe", -1);
+
+    assert_string_equal("1@1+3 0@2+2 3@2+4 2@8+3 1@10+3 0@11+2 ", found);
+    g_free(found);
+}
+
+void
+repeated_pattern_reported_once(void** state)
+{
+    const gchar* patterns[] = { "bob", "alice", "bob" };
+
+    char* found = _scan(patterns, 3, "hi bob", -1);
+
+    assert_string_equal("0@3+3 ", found);
+    g_free(found);
+}
+
+void
+no_patterns_match_nothing(void** state)
+{
+    MultiMatch* matcher = multimatch_new(NULL, 0);
+
+    assert_int_equal(0, multimatch_count(matcher));
+
+    Matches matches = { g_string_new(NULL), -1 };
+    multimatch_scan(matcher, "anything", _collect, &matches);
+    assert_int_equal(0, matches.found->len);
+
+    g_string_free(matches.found, TRUE);
+    multimatch_free(matcher);
+}
+
+void
+empty_pattern_never_matches(void** state)
+{
+    const gchar* patterns[] = { "", "one" };
+
+    char* found = _scan(patterns, 2, "one two", -1);
+
+    assert_string_equal("1@0+3 ", found);
+    g_free(found);
+}
+
+void
+scan_stops_when_callback_returns_false(void** state)
+{
+    const gchar* patterns[] = { "a" };
+
+    char* found = _scan(patterns, 1, "aaaa", 2);
+
+    assert_string_equal("0@0+1 0@1+1 ", found);
+    g_free(found);
+}
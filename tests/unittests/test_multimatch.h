@@ -0,0 +1,5 @@
+void overlapping_patterns_all_match(void** state);
+void repeated_pattern_reported_once(void** state);
+void no_patterns_match_nothing(void** state);
+void empty_pattern_never_matches(void** state);
+void scan_stops_when_callback_returns_false(void** state);
@@ -345,6 +345,34 @@ parse_cmd_with_quoted_freetext(void** state)
     g_strfreev(args);
 }
 
+void
+parse_cmd_with_utf8_args(void** state)
+{
+    char* inp = "/cmd héllo \"grüß dich\"";
+    gboolean result = FALSE;
+    gchar** args = parse_args(inp, 2, 2, &result);
+
+    assert_true(result);
+    assert_int_equal(2, g_strv_length(args));
+    assert_string_equal("héllo", args[0]);
+    assert_string_equal("grüß dich", args[1]);
+    g_strfreev(args);
+}
+
+void
+parse_cmd_with_unclosed_quote(void** state)
+{
+    char* inp = "/cmd arg1 \"the arg2";
+    gboolean result = FALSE;
+    gchar** args = parse_args(inp, 2, 2, &result);
+
+    assert_true(result);
+    assert_int_equal(2, g_strv_length(args));
+    assert_string_equal("arg1", args[0]);
+    assert_string_equal("the arg2", args[1]);
+    g_strfreev(args);
+}
+
 void
 parse_cmd_with_third_arg_quoted_0_min_3_max(void** state)
 {
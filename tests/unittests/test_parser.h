@@ -23,6 +23,8 @@ void parse_cmd_freetext_with_quoted_and_space(void** state);
 void parse_cmd_freetext_with_quoted_and_many_spaces(void** state);
 void parse_cmd_freetext_with_many_quoted_and_many_spaces(void** state);
 void parse_cmd_with_quoted_freetext(void** state);
+void parse_cmd_with_utf8_args(void** state);
+void parse_cmd_with_unclosed_quote(void** state);
 void parse_cmd_with_third_arg_quoted_0_min_3_max(void** state);
 void parse_cmd_with_second_arg_quoted_0_min_3_max(void** state);
 void parse_cmd_with_second_and_third_arg_quoted_0_min_3_max(void** state);
@@ -0,0 +1,166 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "tools/perf.h"
+
+void
+perf_records_nothing_while_disabled(void** state)
+{
+    perf_set_enabled(FALSE);
+
+    assert_int_equal(0, perf_start());
+    perf_record(PERF_MESSAGE, 100);
+
+    PerfStats stats;
+    perf_get_stats(PERF_MESSAGE, &stats);
+    assert_int_equal(0, stats.count);
+
+    perf_close();
+}
+
+void
+perf_counts_calls(void** state)
+{
+    perf_set_enabled(TRUE);
+
+    perf_record(PERF_IQ, 10);
+    perf_record(PERF_IQ, 20);
+    perf_stop(PERF_IQ, perf_start());
+
+    PerfStats stats;
+    perf_get_stats(PERF_IQ, &stats);
+    assert_int_equal(3, stats.count);
+    assert_true(stats.total_us >= 30);
+    assert_true(stats.max_us >= 20);
+
+    perf_get_stats(PERF_PRESENCE, &stats);
+    assert_int_equal(0, stats.count);
+
+    perf_close();
+}
+
+void
+perf_percentiles_follow_distribution(void** state)
+{
+    perf_set_enabled(TRUE);
+
+    // 98 fast calls and a few slow ones
+    for (int i = 0; i < 98; i++) {
+        perf_record(PERF_REDRAW, 100);
+    }
+    perf_record(PERF_REDRAW, 10000);
+    perf_record(PERF_REDRAW, 10000);
+
+    PerfStats stats;
+    perf_get_stats(PERF_REDRAW, &stats);
+    assert_true(stats.p50_us >= 100 && stats.p50_us < 125);
+    assert_true(stats.p99_us >= 10000 && stats.p99_us < 12500);
+    assert_int_equal(10000, stats.max_us);
+
+    perf_close();
+}
+
+void
+perf_percentile_never_exceeds_max(void** state)
+{
+    perf_set_enabled(TRUE);
+
+    perf_record(PERF_DATABASE, 1000);
+
+    PerfStats stats;
+    perf_get_stats(PERF_DATABASE, &stats);
+    assert_int_equal(1000, stats.p50_us);
+    assert_int_equal(1000, stats.p99_us);
+
+    perf_close();
+}
+
+void
+perf_reset_clears_counts(void** state)
+{
+    perf_set_enabled(TRUE);
+
+    perf_record(PERF_PLUGINS, 5);
+    perf_reset();
+
+    PerfStats stats;
+    perf_get_stats(PERF_PLUGINS, &stats);
+    assert_int_equal(0, stats.count);
+    assert_int_equal(0, stats.max_us);
+
+    perf_close();
+}
+
+void
+perf_trace_writes_spans(void** state)
+{
+    gchar* path = g_build_filename(g_get_tmp_dir(), "prof_test_perf_trace.json", NULL);
+
+    assert_true(perf_trace_start(path));
+    assert_string_equal(path, perf_trace_path());
+    perf_stop_named(PERF_PLUGINS, perf_start(), "prof_on_start", "say \"hi\".py");
+    perf_stop(PERF_IQ, perf_start());
+    perf_trace_stop();
+    assert_null(perf_trace_path());
+
+    gchar* contents = NULL;
+    assert_true(g_file_get_contents(path, &contents, NULL, NULL));
+    assert_true(g_str_has_prefix(contents, "[\n"));
+    assert_true(g_str_has_suffix(contents, "\n]\n"));
+    assert_non_null(strstr(contents, "\"name\":\"prof_on_start\",\"cat\":\"plugins\",\"ph\":\"X\""));
+    assert_non_null(strstr(contents, "\"args\":{\"detail\":\"say \\\"hi\\\".py\"}"));
+    assert_non_null(strstr(contents, "\"name\":\"iq\""));
+
+    // tracing alone does not count
+    PerfStats stats;
+    perf_get_stats(PERF_IQ, &stats);
+    assert_int_equal(0, stats.count);
+
+    g_free(contents);
+    g_remove(path);
+    g_free(path);
+    perf_close();
+}
+
+void
+perf_output_counts_written_bytes(void** state)
+{
+    assert_int_equal(-1, perf_output_start());
+
+    perf_set_enabled(TRUE);
+    gint64 started = perf_output_start();
+    if (started < 0) {
+        // the system does not tell what a thread wrote
+        perf_close();
+        return;
+    }
+
+    FILE* out = fopen("/dev/null", "w");
+    assert_non_null(out);
+    char buf[1000];
+    memset(buf, 'x', sizeof(buf));
+    assert_int_equal(sizeof(buf), fwrite(buf, 1, sizeof(buf), out));
+    fflush(out);
+    perf_output_stop(started);
+    fclose(out);
+
+    guint64 frames, bytes, max_bytes;
+    perf_get_output(&frames, &bytes, &max_bytes);
+    assert_int_equal(1, frames);
+    assert_true(bytes >= sizeof(buf));
+    assert_int_equal(bytes, max_bytes);
+
+    perf_reset();
+    perf_get_output(&frames, &bytes, &max_bytes);
+    assert_int_equal(0, frames);
+    assert_int_equal(0, bytes);
+
+    perf_close();
+}
@@ -0,0 +1,7 @@
+void perf_records_nothing_while_disabled(void** state);
+void perf_counts_calls(void** state);
+void perf_percentiles_follow_distribution(void** state);
+void perf_percentile_never_exceeds_max(void** state);
+void perf_reset_clears_counts(void** state);
+void perf_trace_writes_spans(void** state);
+void perf_output_counts_written_bytes(void** state);
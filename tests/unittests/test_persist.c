@@ -0,0 +1,104 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "config/persist.h"
+#include "tools/scheduler.h"
+
+static int writes = 0;
+
+static void
+_write(void)
+{
+    writes++;
+}
+
+static void
+_stats(const char** name, guint64* requested, guint64* written)
+{
+    assert_int_equal(1, persist_files());
+    persist_get_stats(0, name, requested, written);
+}
+
+void
+persist_coalesces_requests(void** state)
+{
+    writes = 0;
+
+    persist_request("test", _write);
+    persist_request("test", _write);
+    persist_request("test", _write);
+    assert_int_equal(0, writes);
+
+    scheduler_run();
+    assert_int_equal(1, writes);
+
+    const char* name;
+    guint64 requested, written;
+    _stats(&name, &requested, &written);
+    assert_string_equal("test", name);
+    assert_int_equal(3, requested);
+    assert_int_equal(1, written);
+
+    persist_close();
+    scheduler_close();
+}
+
+void
+persist_flush_writes_pending(void** state)
+{
+    writes = 0;
+
+    persist_flush(_write);
+    assert_int_equal(0, writes);
+
+    persist_request("test", _write);
+    persist_flush(_write);
+    assert_int_equal(1, writes);
+
+    scheduler_run();
+    assert_int_equal(1, writes);
+    assert_int_equal(-1, scheduler_next_timeout());
+
+    persist_close();
+    scheduler_close();
+}
+
+void
+persist_close_writes_pending(void** state)
+{
+    writes = 0;
+
+    persist_request("test", _write);
+    persist_close();
+    assert_int_equal(1, writes);
+    assert_int_equal(0, persist_files());
+
+    scheduler_close();
+}
+
+void
+persist_delayed_waits_until_due(void** state)
+{
+    writes = 0;
+
+    persist_request_delayed("test", _write, 60000);
+    scheduler_run();
+    assert_int_equal(0, writes);
+    assert_true(scheduler_next_timeout() > 59000);
+
+    // an immediate request brings the pending write forward
+    persist_request("test", _write);
+    scheduler_run();
+    assert_int_equal(1, writes);
+    assert_int_equal(-1, scheduler_next_timeout());
+
+    persist_request_delayed("test", _write, 60000);
+    persist_close();
+    assert_int_equal(2, writes);
+
+    scheduler_close();
+}
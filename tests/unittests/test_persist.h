@@ -0,0 +1,4 @@
+void persist_coalesces_requests(void** state);
+void persist_flush_writes_pending(void** state);
+void persist_close_writes_pending(void** state);
+void persist_delayed_waits_until_due(void** state);
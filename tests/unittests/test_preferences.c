@@ -37,3 +37,50 @@ statuses_muc_defaults_to_all(void** state)
     assert_string_equal("all", setting);
     g_free(setting);
 }
+
+void
+set_string_updates_cached_value(void** state)
+{
+    char* before = prefs_get_string(PREF_STATUSES_CHAT);
+    assert_string_equal("all", before);
+    g_free(before);
+
+    prefs_set_string(PREF_STATUSES_CHAT, "none");
+
+    assert_string_equal("none", prefs_peek_string(PREF_STATUSES_CHAT));
+    char* after = prefs_get_string(PREF_STATUSES_CHAT);
+    assert_string_equal("none", after);
+    g_free(after);
+}
+
+void
+set_boolean_updates_cached_value(void** state)
+{
+    prefs_set_boolean(PREF_BEEP, FALSE);
+    assert_false(prefs_get_boolean(PREF_BEEP));
+
+    prefs_set_boolean(PREF_BEEP, TRUE);
+    assert_true(prefs_get_boolean(PREF_BEEP));
+}
+
+void
+plugin_lazy_flag_is_per_plugin(void** state)
+{
+    assert_false(prefs_plugin_is_lazy("say.py"));
+
+    prefs_set_plugin_lazy("say.py", TRUE);
+    assert_true(prefs_plugin_is_lazy("say.py"));
+    assert_false(prefs_plugin_is_lazy("browser.py"));
+
+    prefs_set_plugin_lazy("say.py", FALSE);
+    assert_false(prefs_plugin_is_lazy("say.py"));
+}
+
+void
+trim_idle_defaults_to_ten_minutes(void** state)
+{
+    assert_int_equal(10, prefs_get_trim_idle());
+
+    prefs_set_trim_idle(0);
+    assert_int_equal(0, prefs_get_trim_idle());
+}
@@ -1,3 +1,7 @@
 void statuses_console_defaults_to_all(void** state);
 void statuses_chat_defaults_to_all(void** state);
 void statuses_muc_defaults_to_all(void** state);
+void set_string_updates_cached_value(void** state);
+void set_boolean_updates_cached_value(void** state);
+void plugin_lazy_flag_is_per_plugin(void** state);
+void trim_idle_defaults_to_ten_minutes(void** state);
@@ -0,0 +1,48 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/profiler.h"
+
+static void
+_assert_frame_name(const char* const symbol, const char* const expected)
+{
+    char* name = profiler_frame_name(symbol);
+    assert_string_equal(expected, name);
+    g_free(name);
+}
+
+void
+profiler_names_frames(void** state)
+{
+    _assert_frame_name("./profanity(win_print+0x1c) [0x55d0c0de]", "win_print");
+    _assert_frame_name("./profanity(main) [0x55d0c0de]", "main");
+    _assert_frame_name("/usr/lib/libc.so.6(+0x2a1ca) [0x7f12c0de]", "libc.so.6+0x2a1ca");
+    _assert_frame_name("[0x7f12c0de]", "[0x7f12c0de]");
+    _assert_frame_name("lib.so(odd name;here+0x1) [0x1]", "odd_name_here");
+    _assert_frame_name("", "[unknown]");
+}
+
+void
+profiler_folds_stacks_outermost_first(void** state)
+{
+    GHashTable* stacks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    char* deep[] = { "leaf", "mid", "main" };
+    char* shallow[] = { "other", "main" };
+
+    profiler_count_stack(stacks, deep, 3);
+    profiler_count_stack(stacks, shallow, 2);
+    profiler_count_stack(stacks, deep, 3);
+    profiler_count_stack(stacks, NULL, 0);
+
+    assert_int_equal(3, g_hash_table_size(stacks));
+    assert_int_equal(2, GPOINTER_TO_UINT(g_hash_table_lookup(stacks, "main;mid;leaf")));
+    assert_int_equal(1, GPOINTER_TO_UINT(g_hash_table_lookup(stacks, "main;other")));
+    assert_int_equal(1, GPOINTER_TO_UINT(g_hash_table_lookup(stacks, "[unknown]")));
+
+    g_hash_table_destroy(stacks);
+}
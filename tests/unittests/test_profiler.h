@@ -0,0 +1,2 @@
+void profiler_names_frames(void** state);
+void profiler_folds_stacks_outermost_first(void** state);
@@ -0,0 +1,95 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/ratelimit.h"
+#include "tools/scheduler.h"
+
+static guint reports = 0;
+static guint reported = 0;
+
+static void
+_report(const char* const key, guint dropped)
+{
+    reports++;
+    reported += dropped;
+}
+
+void
+ratelimit_allows_burst_then_drops(void** state)
+{
+    RateLimit* limit = ratelimit_new("test", 3, 1, NULL);
+
+    assert_true(ratelimit_allow(limit, "spam.example"));
+    assert_true(ratelimit_allow(limit, "spam.example"));
+    assert_true(ratelimit_allow(limit, "spam.example"));
+    assert_false(ratelimit_allow(limit, "spam.example"));
+    assert_true(ratelimit_allow(limit, "other.example"));
+
+    const char* name;
+    guint64 allowed, dropped;
+    ratelimit_get_stats(0, &name, &allowed, &dropped);
+    assert_string_equal("test", name);
+    assert_int_equal(4, allowed);
+    assert_int_equal(1, dropped);
+
+    ratelimit_close();
+    scheduler_close();
+}
+
+void
+ratelimit_refills_over_time(void** state)
+{
+    // one token per millisecond
+    RateLimit* limit = ratelimit_new("test", 1, 60000, NULL);
+
+    assert_true(ratelimit_allow(limit, "jid"));
+    assert_false(ratelimit_allow(limit, "jid"));
+    g_usleep(5000);
+    assert_true(ratelimit_allow(limit, "jid"));
+
+    ratelimit_close();
+    scheduler_close();
+}
+
+void
+ratelimit_report_summarises_drops_once(void** state)
+{
+    reports = 0;
+    reported = 0;
+    RateLimit* limit = ratelimit_new("test", 1, 1, _report);
+
+    ratelimit_allow(limit, "a");
+    ratelimit_allow(limit, "a");
+    ratelimit_allow(limit, "a");
+    ratelimit_allow(limit, "b");
+
+    ratelimit_report(limit);
+    assert_int_equal(1, reports);
+    assert_int_equal(2, reported);
+
+    ratelimit_report(limit);
+    assert_int_equal(1, reports);
+
+    ratelimit_close();
+    scheduler_close();
+}
+
+void
+ratelimit_report_forgets_idle_keys(void** state)
+{
+    RateLimit* limit = ratelimit_new("test", 2, 60000, NULL);
+
+    ratelimit_allow(limit, "a");
+    assert_int_equal(1, ratelimit_keys(limit));
+    g_usleep(5000);
+    ratelimit_report(limit);
+    assert_int_equal(0, ratelimit_keys(limit));
+
+    ratelimit_close();
+    scheduler_close();
+}
@@ -0,0 +1,4 @@
+void ratelimit_allows_burst_then_drops(void** state);
+void ratelimit_refills_over_time(void** state);
+void ratelimit_report_summarises_drops_once(void** state);
+void ratelimit_report_forgets_idle_keys(void** state);
@@ -0,0 +1,39 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xmpp/recorder.h"
+
+static void
+_assert_jid(GHashTable* names, const char* const jid, const char* const expected)
+{
+    char* anon = recorder_anonymize_jid(names, jid);
+    assert_string_equal(expected, anon);
+    g_free(anon);
+}
+
+void
+recorder_anonymizes_jids_consistently(void** state)
+{
+    GHashTable* names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    _assert_jid(names, "alice@example.org/phone", "user1@domain2.example/res3");
+    _assert_jid(names, "bob@example.org", "user4@domain2.example");
+    _assert_jid(names, "example.org", "domain2.example");
+    _assert_jid(names, "room@conference.example.org/alice", "user5@domain6.example/res7");
+    _assert_jid(names, "alice@example.org/phone", "user1@domain2.example/res3");
+
+    g_hash_table_destroy(names);
+}
+
+void
+recorder_anonymizes_text_keeping_its_shape(void** state)
+{
+    char* anon = recorder_anonymize_text("héllo wörld\nbye");
+    assert_string_equal("xxxxx xxxxx\nxxx", anon);
+    g_free(anon);
+}
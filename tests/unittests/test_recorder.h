@@ -0,0 +1,2 @@
+void recorder_anonymizes_jids_consistently(void** state);
+void recorder_anonymizes_text_keeping_its_shape(void** state);
@@ -721,3 +721,121 @@ get_contact_display_name_is_passed_barejid_if_contact_does_not_exist(void** stat
 
     roster_destroy();
 }
+
+void
+get_contact_display_name_follows_name_change(void** state)
+{
+    roster_create();
+    roster_add("person@server.org", "nickname", NULL, NULL, FALSE);
+    char* before = roster_get_display_name("person@server.org");
+
+    roster_change_name(roster_get_contact("person@server.org"), "newname");
+    char* after = roster_get_display_name("Person@server.org");
+
+    assert_string_equal("nickname", before);
+    assert_string_equal("newname", after);
+
+    free(before);
+    free(after);
+    roster_destroy();
+}
+
+void
+presence_order_follows_presence_updates(void** state)
+{
+    roster_create();
+    roster_process_pending_presence();
+    roster_add("adam@server.org", NULL, NULL, NULL, FALSE);
+    roster_add("bob@server.org", NULL, NULL, NULL, FALSE);
+
+    Resource* resource = resource_new("laptop", RESOURCE_ONLINE, NULL, 10);
+    roster_update_presence("bob@server.org", resource, NULL);
+
+    GSList* list = roster_get_contacts(ROSTER_ORD_PRESENCE);
+    assert_string_equal("bob@server.org", p_contact_barejid(list->data));
+    assert_string_equal("adam@server.org", p_contact_barejid(list->next->data));
+    g_slist_free(list);
+
+    roster_contact_offline("bob@server.org", "laptop", NULL);
+
+    list = roster_get_contacts(ROSTER_ORD_PRESENCE);
+    assert_string_equal("adam@server.org", p_contact_barejid(list->data));
+    assert_string_equal("bob@server.org", p_contact_barejid(list->next->data));
+    g_slist_free(list);
+
+    roster_destroy();
+}
+
+void
+name_order_follows_name_change(void** state)
+{
+    roster_create();
+    roster_add("adam@server.org", "Adam", NULL, NULL, FALSE);
+    roster_add("bob@server.org", "Bob", NULL, NULL, FALSE);
+
+    roster_change_name(roster_get_contact("adam@server.org"), "Zed");
+
+    GSequence* view = roster_get_contacts_view(ROSTER_ORD_NAME);
+    GSequenceIter* iter = g_sequence_get_begin_iter(view);
+    assert_string_equal("bob@server.org", p_contact_barejid(g_sequence_get(iter)));
+    iter = g_sequence_iter_next(iter);
+    assert_string_equal("adam@server.org", p_contact_barejid(g_sequence_get(iter)));
+
+    roster_destroy();
+}
+
+void
+group_view_follows_group_update(void** state)
+{
+    roster_create();
+    GSList* groups = NULL;
+    groups = g_slist_append(groups, strdup("friends"));
+    roster_add("adam@server.org", NULL, groups, NULL, FALSE);
+
+    GSequence* view = roster_get_group_view("friends", ROSTER_ORD_NAME);
+    assert_int_equal(1, g_sequence_get_length(view));
+    assert_int_equal(0, g_sequence_get_length(roster_get_group_view(NULL, ROSTER_ORD_NAME)));
+
+    GSList* new_groups = NULL;
+    new_groups = g_slist_append(new_groups, strdup("work"));
+    roster_update("adam@server.org", NULL, new_groups, NULL, FALSE);
+
+    assert_null(roster_get_group_view("friends", ROSTER_ORD_NAME));
+    view = roster_get_group_view("work", ROSTER_ORD_PRESENCE);
+    assert_int_equal(1, g_sequence_get_length(view));
+
+    roster_destroy();
+}
+
+void
+contains_jid_matches_bare_part_of_full_jid(void** state)
+{
+    roster_create();
+    roster_add("bob@server.org", NULL, NULL, NULL, FALSE);
+
+    assert_true(roster_contains_jid("bob@server.org"));
+    assert_true(roster_contains_jid("Bob@Server.org/laptop"));
+    assert_false(roster_contains_jid("bob@other.org/laptop"));
+    assert_false(roster_contains_jid("server.org"));
+
+    roster_destroy();
+}
+
+void
+loaded_roster_completes_in_order(void** state)
+{
+    roster_create();
+    roster_load_begin();
+    roster_add("James", NULL, NULL, NULL, FALSE);
+    roster_add("Bob", NULL, NULL, NULL, FALSE);
+    roster_add("Bobby", NULL, NULL, NULL, FALSE);
+    roster_load_end();
+
+    char* first = roster_contact_autocomplete("Bo", FALSE, NULL);
+    char* second = roster_contact_autocomplete("Bo", FALSE, NULL);
+    assert_string_equal("Bob", first);
+    assert_string_equal("Bobby", second);
+    free(first);
+    free(second);
+    roster_destroy();
+}
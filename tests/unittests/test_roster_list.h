@@ -33,3 +33,9 @@ void remove_contact_with_remaining_in_group(void** state);
 void get_contact_display_name(void** state);
 void get_contact_display_name_is_barejid_if_name_is_empty(void** state);
 void get_contact_display_name_is_passed_barejid_if_contact_does_not_exist(void** state);
+void get_contact_display_name_follows_name_change(void** state);
+void presence_order_follows_presence_updates(void** state);
+void name_order_follows_name_change(void** state);
+void group_view_follows_group_update(void** state);
+void contains_jid_matches_bare_part_of_full_jid(void** state);
+void loaded_roster_completes_in_order(void** state);
@@ -0,0 +1,167 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "tools/scheduler.h"
+
+static gboolean
+_count(void* data)
+{
+    int* count = data;
+    (*count)++;
+    return TRUE;
+}
+
+static gboolean
+_count_once(void* data)
+{
+    int* count = data;
+    (*count)++;
+    return FALSE;
+}
+
+static void
+_count_free(void* data)
+{
+    int* count = data;
+    (*count)++;
+}
+
+static SchedulerTask* self_task = NULL;
+
+static gboolean
+_remove_self(void* data)
+{
+    scheduler_remove(self_task);
+    return TRUE;
+}
+
+void
+next_timeout_when_empty(void** state)
+{
+    scheduler_run();
+    assert_int_equal(-1, scheduler_next_timeout());
+    scheduler_close();
+}
+
+void
+due_task_runs(void** state)
+{
+    int count = 0;
+    scheduler_add(0, _count, &count, NULL);
+
+    scheduler_run();
+
+    assert_int_equal(1, count);
+    scheduler_close();
+}
+
+void
+task_runs_again_after_interval(void** state)
+{
+    int count = 0;
+    scheduler_add(0, _count, &count, NULL);
+
+    scheduler_run();
+    scheduler_run();
+
+    assert_int_equal(2, count);
+    assert_int_equal(0, scheduler_next_timeout());
+    scheduler_close();
+}
+
+void
+task_returning_false_is_removed(void** state)
+{
+    int count = 0;
+    scheduler_add(0, _count_once, &count, NULL);
+
+    scheduler_run();
+    scheduler_run();
+
+    assert_int_equal(1, count);
+    assert_int_equal(-1, scheduler_next_timeout());
+    scheduler_close();
+}
+
+void
+removed_task_does_not_run(void** state)
+{
+    int count = 0;
+    SchedulerTask* task = scheduler_add(0, _count, &count, NULL);
+
+    scheduler_remove(task);
+    scheduler_run();
+
+    assert_int_equal(0, count);
+    scheduler_close();
+}
+
+void
+remove_frees_data(void** state)
+{
+    int freed = 0;
+    SchedulerTask* task = scheduler_add(1000, _count, &freed, _count_free);
+
+    scheduler_remove(task);
+
+    assert_int_equal(1, freed);
+    scheduler_close();
+}
+
+void
+task_removed_from_own_callback(void** state)
+{
+    int freed = 0;
+    self_task = scheduler_add(0, _remove_self, &freed, _count_free);
+
+    scheduler_run();
+
+    assert_int_equal(1, freed);
+    assert_int_equal(-1, scheduler_next_timeout());
+    scheduler_close();
+}
+
+void
+next_timeout_is_earliest_task(void** state)
+{
+    int count = 0;
+    scheduler_add(60000, _count, &count, NULL);
+    scheduler_add(1000, _count, &count, NULL);
+    scheduler_add(30000, _count, &count, NULL);
+
+    gint timeout = scheduler_next_timeout();
+
+    assert_true(timeout > 0);
+    assert_true(timeout <= 1000);
+    scheduler_run();
+    assert_int_equal(0, count);
+    scheduler_close();
+}
+
+static void
+_append(void* data)
+{
+    GString* order = data;
+    g_string_append_c(order, 'x' + order->len);
+}
+
+void
+posted_events_run_in_order(void** state)
+{
+    GString* order = g_string_new(NULL);
+    scheduler_post(_append, order);
+    scheduler_post(_append, order);
+    scheduler_post(_append, order);
+
+    assert_int_equal(0, scheduler_next_timeout());
+    scheduler_run();
+
+    assert_string_equal("xyz", order->str);
+    assert_int_equal(-1, scheduler_next_timeout());
+    g_string_free(order, TRUE);
+    scheduler_close();
+}
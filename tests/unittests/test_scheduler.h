@@ -0,0 +1,9 @@
+void next_timeout_when_empty(void** state);
+void due_task_runs(void** state);
+void task_runs_again_after_interval(void** state);
+void task_returning_false_is_removed(void** state);
+void removed_task_does_not_run(void** state);
+void remove_frees_data(void** state);
+void task_removed_from_own_callback(void** state);
+void next_timeout_is_earliest_task(void** state);
+void posted_events_run_in_order(void** state);
@@ -0,0 +1,93 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "xmpp/stanza_writer.h"
+
+void
+escape_leaves_plain_text(void** state)
+{
+    GString* out = g_string_new(NULL);
+
+    stanza_writer_escape(out, "hello world");
+
+    assert_string_equal("hello world", out->str);
+
+    g_string_free(out, TRUE);
+}
+
+void
+escape_replaces_markup(void** state)
+{
+    GString* out = g_string_new(NULL);
+
+    stanza_writer_escape(out, "<a href=\"x\">Tom & Jerry's</a>");
+
+    assert_string_equal("&lt;a href=&quot;x&quot;&gt;Tom &amp; Jerry&apos;s&lt;/a&gt;", out->str);
+
+    g_string_free(out, TRUE);
+}
+
+void
+chat_state_is_written(void** state)
+{
+    GString* out = g_string_new(NULL);
+
+    stanza_writer_chat_state(out, "id1", "bob@server.org/laptop", "composing");
+
+    assert_string_equal("<message type=\"chat\" to=\"bob@server.org/laptop\" id=\"id1\">"
+                        "<composing xmlns=\"http://jabber.org/protocol/chatstates\"/></message>",
+                        out->str);
+
+    g_string_free(out, TRUE);
+}
+
+void
+receipt_is_written(void** state)
+{
+    GString* out = g_string_new(NULL);
+
+    stanza_writer_receipt(out, "id2", "bob@server.org/laptop", "a&b");
+
+    assert_string_equal("<message to=\"bob@server.org/laptop\" id=\"id2\">"
+                        "<received id=\"a&amp;b\" xmlns=\"urn:xmpp:receipts\"/></message>",
+                        out->str);
+
+    g_string_free(out, TRUE);
+}
+
+void
+chat_message_has_requested_children(void** state)
+{
+    GString* out = g_string_new(NULL);
+
+    stanza_writer_chat(out, "id3", "bob@server.org", "1 < 2", "active", NULL, TRUE, FALSE, "id0");
+
+    assert_string_equal("<message type=\"chat\" to=\"bob@server.org\" id=\"id3\">"
+                        "<body>1 &lt; 2</body>"
+                        "<active xmlns=\"http://jabber.org/protocol/chatstates\"/>"
+                        "<request xmlns=\"urn:xmpp:receipts\"/>"
+                        "<replace id=\"id0\" xmlns=\"urn:xmpp:message-correct:0\"/>"
+                        "</message>",
+                        out->str);
+
+    g_string_free(out, TRUE);
+}
+
+void
+writer_reuses_buffer(void** state)
+{
+    GString* out = g_string_new(NULL);
+
+    stanza_writer_chat(out, "id4", "bob@server.org", "a long message body", NULL, "https://example.org/file.png", FALSE, TRUE, NULL);
+    stanza_writer_chat_state(out, "id5", "bob@server.org", "gone");
+
+    assert_string_equal("<message type=\"chat\" to=\"bob@server.org\" id=\"id5\">"
+                        "<gone xmlns=\"http://jabber.org/protocol/chatstates\"/></message>",
+                        out->str);
+
+    g_string_free(out, TRUE);
+}
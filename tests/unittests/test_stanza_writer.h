@@ -0,0 +1,6 @@
+void escape_leaves_plain_text(void** state);
+void escape_replaces_markup(void** state);
+void chat_state_is_written(void** state);
+void receipt_is_written(void** state);
+void chat_message_has_requested_children(void** state);
+void writer_reuses_buffer(void** state);
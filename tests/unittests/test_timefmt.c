@@ -0,0 +1,138 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/timefmt.h"
+
+// 2021-03-14T15:09:26Z
+#define STAMP_US (G_GINT64_CONSTANT(1615734566) * G_USEC_PER_SEC)
+
+static void
+_assert_glib(GDateTime* time, const char* const format)
+{
+    char buf[TIMEFMT_MAX];
+    gchar* expected = g_date_time_format(time, format);
+
+    assert_string_equal(expected, timefmt_format(time, format, buf, sizeof(buf)));
+    // and again from the cache
+    assert_string_equal(expected, timefmt_format(time, format, buf, sizeof(buf)));
+
+    g_free(expected);
+}
+
+void
+timefmt_matches_glib(void** state)
+{
+    GDateTime* time = g_date_time_new_utc(2021, 3, 14, 15, 9, 26.5);
+
+    _assert_glib(time, "%H:%M");
+    _assert_glib(time, "%H:%M:%S");
+    _assert_glib(time, "%d/%m/%y %H:%M:%S");
+    _assert_glib(time, "%H:%M:%S.%f");
+    _assert_glib(time, "100%% at %-H");
+
+    g_date_time_unref(time);
+}
+
+void
+timefmt_minute_format_shares_text(void** state)
+{
+    GDateTime* first = g_date_time_new_utc(2021, 3, 14, 15, 9, 1);
+    GDateTime* later = g_date_time_new_utc(2021, 3, 14, 15, 9, 59);
+    GDateTime* next = g_date_time_new_utc(2021, 3, 14, 15, 10, 0);
+    char buf[TIMEFMT_MAX];
+
+    assert_string_equal("15:09", timefmt_format(first, "%H:%M", buf, sizeof(buf)));
+    assert_string_equal("15:09", timefmt_format(later, "%H:%M", buf, sizeof(buf)));
+    assert_string_equal("15:10", timefmt_format(next, "%H:%M", buf, sizeof(buf)));
+    assert_string_equal("15:09:59", timefmt_format(later, "%H:%M:%S", buf, sizeof(buf)));
+    assert_string_equal("15:09:01", timefmt_format(first, "%H:%M:%S", buf, sizeof(buf)));
+
+    g_date_time_unref(first);
+    g_date_time_unref(later);
+    g_date_time_unref(next);
+}
+
+void
+timefmt_keeps_formats_apart(void** state)
+{
+    GDateTime* time = g_date_time_new_utc(2021, 3, 14, 15, 9, 26);
+    GTimeZone* tz = g_time_zone_new("+02:00");
+    GDateTime* shifted = g_date_time_to_timezone(time, tz);
+    char buf[TIMEFMT_MAX];
+    char small[4];
+
+    assert_string_equal("15:09", timefmt_format(time, "%H:%M", buf, sizeof(buf)));
+    assert_string_equal("17:09", timefmt_format(shifted, "%H:%M", buf, sizeof(buf)));
+    assert_string_equal("14/03", timefmt_format(time, "%d/%m", buf, sizeof(buf)));
+    assert_string_equal("15:", timefmt_format(time, "%H:%M", small, sizeof(small)));
+
+    g_date_time_unref(shifted);
+    g_time_zone_unref(tz);
+    g_date_time_unref(time);
+}
+
+void
+timefmt_parses_xep0082_stamps(void** state)
+{
+    gint64 time_us = 0;
+
+    assert_true(timefmt_parse_stamp("2021-03-14T15:09:26Z", &time_us));
+    assert_int_equal(STAMP_US, time_us);
+    assert_true(timefmt_parse_stamp("2021-03-14T16:09:26+01:00", &time_us));
+    assert_int_equal(STAMP_US, time_us);
+    assert_true(timefmt_parse_stamp("2021-03-14T10:39:26-04:30", &time_us));
+    assert_int_equal(STAMP_US, time_us);
+    assert_true(timefmt_parse_stamp("2021-03-14T15:09:26.5Z", &time_us));
+    assert_int_equal(STAMP_US + 500000, time_us);
+    assert_true(timefmt_parse_stamp("2021-03-14T15:09:26.1234567Z", &time_us));
+    assert_int_equal(STAMP_US + 123456, time_us);
+    assert_true(timefmt_parse_stamp("1969-12-31T23:59:59Z", &time_us));
+    assert_int_equal(-G_USEC_PER_SEC, time_us);
+}
+
+void
+timefmt_parses_legacy_stamps_as_utc(void** state)
+{
+    gint64 time_us = 0;
+
+    assert_true(timefmt_parse_stamp("20210314T15:09:26", &time_us));
+    assert_int_equal(STAMP_US, time_us);
+}
+
+void
+timefmt_rejects_invalid_stamps(void** state)
+{
+    gint64 time_us = 0;
+
+    assert_false(timefmt_parse_stamp(NULL, &time_us));
+    assert_false(timefmt_parse_stamp("", &time_us));
+    assert_false(timefmt_parse_stamp("yesterday", &time_us));
+    assert_false(timefmt_parse_stamp("2021-02-29T15:09:26Z", &time_us));
+    assert_false(timefmt_parse_stamp("2021-03-14T25:09:26Z", &time_us));
+    assert_false(timefmt_parse_stamp("2021-03-14T15:09:26Zjunk", &time_us));
+}
+
+void
+timefmt_stamp_matches_glib(void** state)
+{
+    gint64 times[] = { STAMP_US, STAMP_US + 500000, G_GINT64_CONSTANT(1625140800) * G_USEC_PER_SEC + 1 };
+    char buf[TIMEFMT_STAMP_MAX];
+
+    for (guint i = 0; i < G_N_ELEMENTS(times); i++) {
+        GDateTime* time = timefmt_local(times[i]);
+        gchar* expected = g_date_time_format_iso8601(time);
+        gint64 parsed = 0;
+
+        assert_string_equal(expected, timefmt_stamp(times[i], buf, sizeof(buf)));
+        assert_true(timefmt_parse_stamp(buf, &parsed));
+        assert_int_equal(times[i], parsed);
+
+        g_free(expected);
+        g_date_time_unref(time);
+    }
+}
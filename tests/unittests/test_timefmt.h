@@ -0,0 +1,7 @@
+void timefmt_matches_glib(void** state);
+void timefmt_minute_format_shares_text(void** state);
+void timefmt_keeps_formats_apart(void** state);
+void timefmt_parses_xep0082_stamps(void** state);
+void timefmt_parses_legacy_stamps_as_utc(void** state);
+void timefmt_rejects_invalid_stamps(void** state);
+void timefmt_stamp_matches_glib(void** state);
@@ -0,0 +1,122 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "tools/url_ring.h"
+
+static void
+_assert_next(UrlRing* ring, const char* const search_str, gboolean previous, const char* const expected)
+{
+    char* found = url_ring_complete(ring, search_str, previous);
+    assert_string_equal(expected, found);
+    free(found);
+}
+
+void
+finds_urls_of_known_schemes(void** state)
+{
+    UrlRing* ring = url_ring_new();
+
+    url_ring_add_from(ring, "see https://a.org and http://b.org, ftp://c.org aesgcm://d.org#key");
+
+    assert_int_equal(3, url_ring_length(ring));
+    _assert_next(ring, "", FALSE, "aesgcm://d.org#key");
+    _assert_next(ring, "", FALSE, "http://b.org,");
+    _assert_next(ring, "", FALSE, "https://a.org");
+
+    url_ring_free(ring);
+}
+
+void
+url_ends_at_white_space(void** state)
+{
+    UrlRing* ring = url_ring_new();
+
+    url_ring_add_from(ring, "http://a.org/x\tnext http:// alone");
+
+    assert_int_equal(1, url_ring_length(ring));
+    _assert_next(ring, "", FALSE, "http://a.org/x");
+
+    url_ring_free(ring);
+}
+
+void
+repeated_url_is_kept_once(void** state)
+{
+    UrlRing* ring = url_ring_new();
+
+    url_ring_add_from(ring, "http://a.org");
+    url_ring_add_from(ring, "http://b.org http://a.org");
+
+    assert_int_equal(2, url_ring_length(ring));
+    _assert_next(ring, "", FALSE, "http://b.org");
+
+    url_ring_free(ring);
+}
+
+void
+oldest_url_goes_when_full(void** state)
+{
+    UrlRing* ring = url_ring_new();
+
+    for (int i = 0; i < URL_RING_MAX + 5; i++) {
+        char* text = g_strdup_printf("http://%d.org", i);
+        url_ring_add_from(ring, text);
+        g_free(text);
+    }
+
+    assert_int_equal(URL_RING_MAX, url_ring_length(ring));
+    _assert_next(ring, "", TRUE, "http://24.org");
+    _assert_next(ring, "", TRUE, "http://5.org");
+
+    url_ring_free(ring);
+}
+
+void
+completion_cycles_newest_first(void** state)
+{
+    UrlRing* ring = url_ring_new();
+
+    url_ring_add_from(ring, "http://a.org");
+    url_ring_add_from(ring, "http://b.org");
+
+    _assert_next(ring, "", FALSE, "http://b.org");
+    _assert_next(ring, "", FALSE, "http://a.org");
+    _assert_next(ring, "", FALSE, "http://b.org");
+
+    url_ring_free(ring);
+}
+
+void
+completion_matches_prefix_ignoring_case(void** state)
+{
+    UrlRing* ring = url_ring_new();
+
+    url_ring_add_from(ring, "https://a.org http://b.org");
+
+    _assert_next(ring, "HTTPS", FALSE, "https://a.org");
+    _assert_next(ring, "HTTPS", FALSE, "https://a.org");
+
+    url_ring_reset(ring);
+    assert_null(url_ring_complete(ring, "ftp", FALSE));
+
+    url_ring_free(ring);
+}
+
+void
+previous_completion_goes_back(void** state)
+{
+    UrlRing* ring = url_ring_new();
+
+    url_ring_add_from(ring, "http://a.org http://b.org http://c.org");
+
+    _assert_next(ring, "", FALSE, "http://c.org");
+    _assert_next(ring, "", FALSE, "http://b.org");
+    _assert_next(ring, "", TRUE, "http://c.org");
+    _assert_next(ring, "", TRUE, "http://a.org");
+
+    url_ring_free(ring);
+}
@@ -0,0 +1,7 @@
+void finds_urls_of_known_schemes(void** state);
+void url_ends_at_white_space(void** state);
+void repeated_url_is_kept_once(void** state);
+void oldest_url_goes_when_full(void** state);
+void completion_cycles_newest_first(void** state);
+void completion_matches_prefix_ignoring_case(void** state);
+void previous_completion_goes_back(void** state);
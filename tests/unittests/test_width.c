@@ -0,0 +1,68 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/width.h"
+
+void
+ascii_char_is_one_column(void** state)
+{
+    int bytes;
+
+    assert_int_equal(1, width_char("a", &bytes));
+    assert_int_equal(1, bytes);
+}
+
+void
+wide_char_is_two_columns(void** state)
+{
+    int bytes;
+
+    assert_int_equal(2, width_char("日", &bytes));
+    assert_int_equal(3, bytes);
+}
+
+void
+combining_mark_takes_no_column(void** state)
+{
+    int bytes;
+
+    assert_int_equal(0, width_char("\xcc\x81", &bytes));
+    assert_int_equal(2, bytes);
+    assert_int_equal(1, width_str("e\xcc\x81"));
+}
+
+void
+invalid_byte_is_reported(void** state)
+{
+    int bytes;
+
+    assert_int_equal(-1, width_char("\xff", &bytes));
+    assert_int_equal(1, bytes);
+    assert_int_equal(3, width_str("a\xff"
+                                  "b"));
+}
+
+void
+long_ascii_runs_are_counted(void** state)
+{
+    assert_int_equal(0, width_str(""));
+    assert_int_equal(26, width_str("abcdefghijklmnopqrstuvwxyz"));
+}
+
+void
+mixed_string_width(void** state)
+{
+    assert_int_equal(23, width_str("hello 世界, hello world"));
+}
+
+void
+strn_stops_at_length(void** state)
+{
+    assert_int_equal(7, width_strn("abcdefghijk 世界", 7));
+    assert_int_equal(14, width_strn("abcdefghijk 世界", 15));
+}
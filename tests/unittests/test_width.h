@@ -0,0 +1,7 @@
+void ascii_char_is_one_column(void** state);
+void wide_char_is_two_columns(void** state);
+void combining_mark_takes_no_column(void** state);
+void invalid_byte_is_reported(void** state);
+void long_ascii_runs_are_counted(void** state);
+void mixed_string_width(void** state);
+void strn_stops_at_length(void** state);
@@ -0,0 +1,129 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools/workers.h"
+
+// a job blocks until released and tells whether it was cancelled
+typedef struct test_job_t
+{
+    gint started;
+    gint release;
+    gint cancelled;
+} TestJob;
+
+static void
+_block(WorkerJob* job, void* data)
+{
+    TestJob* test_job = data;
+    g_atomic_int_set(&test_job->started, 1);
+    while (!g_atomic_int_get(&test_job->release)) {
+        g_usleep(1000);
+    }
+    g_atomic_int_set(&test_job->cancelled, workers_job_cancelled(job));
+}
+
+static void
+_stats(const char* const name, WorkerStats* stats)
+{
+    for (guint i = 0; i < workers_classes(); i++) {
+        workers_get_stats(i, stats);
+        if (strcmp(stats->name, name) == 0) {
+            return;
+        }
+    }
+    fail();
+}
+
+static void
+_wait_done(const char* const name, guint64 done)
+{
+    WorkerStats stats;
+    for (int i = 0; i < 2000; i++) {
+        _stats(name, &stats);
+        if (stats.done >= done) {
+            return;
+        }
+        g_usleep(1000);
+    }
+    fail();
+}
+
+static void
+_wait_started(TestJob* test_job)
+{
+    for (int i = 0; i < 2000 && !g_atomic_int_get(&test_job->started); i++) {
+        g_usleep(1000);
+    }
+    assert_true(g_atomic_int_get(&test_job->started));
+}
+
+void
+submitted_job_runs(void** state)
+{
+    WorkerClass* worker_class = workers_class_new("test-run", 2, 0);
+    TestJob test_job = { 0, 1, 0 };
+
+    workers_submit(worker_class, NULL, _block, &test_job);
+    _wait_done("test-run", 1);
+
+    WorkerStats stats;
+    _stats("test-run", &stats);
+    assert_true(g_atomic_int_get(&test_job.started));
+    assert_int_equal(0, stats.queued);
+    assert_int_equal(0, stats.running);
+    assert_int_equal(0, stats.cancelled);
+}
+
+void
+class_limit_holds_jobs_back(void** state)
+{
+    WorkerClass* worker_class = workers_class_new("test-limit", 1, 0);
+    TestJob first = { 0, 0, 0 };
+    TestJob second = { 0, 0, 0 };
+
+    workers_submit(worker_class, NULL, _block, &first);
+    workers_submit(worker_class, NULL, _block, &second);
+    _wait_started(&first);
+
+    WorkerStats stats;
+    _stats("test-limit", &stats);
+    assert_int_equal(1, stats.running);
+    assert_int_equal(1, stats.queued);
+    assert_false(g_atomic_int_get(&second.started));
+
+    g_atomic_int_set(&first.release, 1);
+    g_atomic_int_set(&second.release, 1);
+    _wait_done("test-limit", 2);
+    assert_true(g_atomic_int_get(&second.started));
+}
+
+void
+closing_window_cancels_its_jobs(void** state)
+{
+    WorkerClass* worker_class = workers_class_new("test-cancel", 2, 0);
+    ProfWin* window = (ProfWin*)&worker_class;
+    ProfWin* other = (ProfWin*)&window;
+    TestJob cancelled = { 0, 0, 0 };
+    TestJob kept = { 0, 0, 0 };
+
+    workers_submit(worker_class, window, _block, &cancelled);
+    workers_submit(worker_class, other, _block, &kept);
+    _wait_started(&cancelled);
+    _wait_started(&kept);
+
+    workers_cancel_window(window);
+    g_atomic_int_set(&cancelled.release, 1);
+    g_atomic_int_set(&kept.release, 1);
+    _wait_done("test-cancel", 2);
+
+    WorkerStats stats;
+    _stats("test-cancel", &stats);
+    assert_true(g_atomic_int_get(&cancelled.cancelled));
+    assert_false(g_atomic_int_get(&kept.cancelled));
+    assert_int_equal(1, stats.cancelled);
+}
@@ -0,0 +1,3 @@
+void submitted_job_runs(void** state);
+void class_limit_holds_jobs_back(void** state);
+void closing_window_cancels_its_jobs(void** state);
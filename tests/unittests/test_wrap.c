@@ -0,0 +1,132 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ui/wrap.h"
+
+static char*
+_layout(const char* const message, int startx, int width, int indent, int pad_indent)
+{
+    Wrap* wrap = wrap_layout(message, startx, width, indent, pad_indent, 0);
+    GString* str = g_string_new(NULL);
+
+    int count;
+    const WrapRun* runs = wrap_runs(wrap, &count);
+    for (int i = 0; i < count; i++) {
+        switch (runs[i].type) {
+        case WRAP_TEXT:
+            g_string_append_printf(str, "T%d+%d ", runs[i].start, runs[i].len);
+            break;
+        case WRAP_INDENT:
+            g_string_append_printf(str, "I%d ", runs[i].len);
+            break;
+        case WRAP_NEWLINE:
+            g_string_append_printf(str, "N ");
+            break;
+        }
+    }
+
+    wrap_free(wrap);
+    return g_string_free(str, FALSE);
+}
+
+void
+message_that_fits_is_one_run(void** state)
+{
+    char* runs = _layout("hello world", 0, 20, 0, 0);
+
+    assert_string_equal("T0+11 ", runs);
+    g_free(runs);
+}
+
+void
+word_moves_to_indented_next_line(void** state)
+{
+    char* runs = _layout("aaa bbb", 2, 8, 2, 1);
+
+    assert_string_equal("T0+4 N I3 T4+3 ", runs);
+    g_free(runs);
+}
+
+void
+long_word_breaks_anywhere(void** state)
+{
+    char* runs = _layout("abcdefgh", 0, 4, 0, 1);
+
+    assert_string_equal("T0+4 I1 T4+3 I1 T7+1 ", runs);
+    g_free(runs);
+}
+
+void
+newline_indents_next_line(void** state)
+{
+    char* runs = _layout("a\nb", 1, 10, 1, 1);
+
+    assert_string_equal("T0+1 N I2 T2+1 ", runs);
+    g_free(runs);
+}
+
+void
+space_starting_wrapped_line_is_dropped(void** state)
+{
+    char* runs = _layout("abcd efg", 0, 4, 0, 0);
+
+    assert_string_equal("T0+4 T5+3 ", runs);
+    g_free(runs);
+}
+
+void
+layout_matches_its_parameters(void** state)
+{
+    Wrap* wrap = wrap_layout("some text", 3, 80, 3, 0, 0);
+
+    assert_true(wrap_matches(wrap, 3, 80, 3, 0, 0));
+    assert_false(wrap_matches(wrap, 3, 79, 3, 0, 0));
+    assert_false(wrap_matches(wrap, 3, 80, 3, 0, 10));
+    assert_false(wrap_matches(NULL, 3, 80, 3, 0, 0));
+
+    wrap_free(wrap);
+}
+
+void
+layout_stops_at_max_lines(void** state)
+{
+    Wrap* wrap = wrap_layout("one\ntwo\nthree\nfour\nfive\n", 0, 20, 0, 0, 2);
+
+    int count;
+    const WrapRun* runs = wrap_runs(wrap, &count);
+    assert_int_equal(4, count);
+    assert_int_equal(WRAP_TEXT, runs[2].type);
+    assert_int_equal(4, runs[2].start);
+    assert_int_equal(3, wrap_hidden(wrap));
+
+    wrap_free(wrap);
+}
+
+void
+long_line_stops_at_max_lines(void** state)
+{
+    Wrap* wrap = wrap_layout("abcdefghijklmnopqrstuvwxyz\nend", 0, 4, 0, 0, 3);
+
+    int count;
+    const WrapRun* runs = wrap_runs(wrap, &count);
+    assert_int_equal(1, count);
+    assert_int_equal(12, runs[0].len);
+    assert_int_equal(2, wrap_hidden(wrap));
+
+    wrap_free(wrap);
+}
+
+void
+message_within_max_lines_hides_nothing(void** state)
+{
+    Wrap* wrap = wrap_layout("one\ntwo", 0, 20, 0, 0, 2);
+
+    assert_int_equal(0, wrap_hidden(wrap));
+
+    wrap_free(wrap);
+}
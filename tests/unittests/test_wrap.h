@@ -0,0 +1,9 @@
+void message_that_fits_is_one_run(void** state);
+void word_moves_to_indented_next_line(void** state);
+void long_word_breaks_anywhere(void** state);
+void newline_indents_next_line(void** state);
+void space_starting_wrapped_line_is_dropped(void** state);
+void layout_matches_its_parameters(void** state);
+void layout_stops_at_max_lines(void** state);
+void long_line_stops_at_max_lines(void** state);
+void message_within_max_lines_hides_nothing(void** state);
@@ -22,6 +22,6 @@ aesgcm_file_get(void* userdata)
 };
 
 void aesgcm_download_cancel_processes(ProfWin* window){};
-void aesgcm_download_add_download(AESGCMDownload* download){};
+void aesgcm_download_start(AESGCMDownload* download){};
 
 #endif
@@ -3,6 +3,7 @@
 
 #include <curl/curl.h>
 #include <pthread.h>
+#include <glib.h>
 
 typedef struct prof_win_t ProfWin;
 
@@ -26,5 +27,12 @@ http_file_get(void* userdata)
 
 void http_download_cancel_processes(){};
 void http_download_add_download(){};
+void http_download_start(){};
+
+gchar*
+http_download_resumable_filename(const char* const url, const char* const filename)
+{
+    return NULL;
+}
 
 #endif
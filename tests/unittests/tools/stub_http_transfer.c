@@ -0,0 +1,16 @@
+#include <curl/curl.h>
+
+void
+http_transfer_init(void)
+{
+}
+
+void
+http_transfer_close(void)
+{
+}
+
+void
+http_progress_check(void)
+{
+}
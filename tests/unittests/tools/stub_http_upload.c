@@ -40,5 +40,10 @@ file_size(const char* const file_name)
 
 void http_upload_cancel_processes(){};
 void http_upload_add_upload(){};
+void http_upload_queue_add(){};
+void http_upload_queue_slot_received(){};
+void http_upload_queue_slot_failed(){};
+void http_upload_queue_check(){};
+void http_upload_queue_clear(){};
 
 #endif
@@ -0,0 +1,17 @@
+#include <glib.h>
+
+void
+memtrim_init(void)
+{
+}
+
+gsize
+memtrim_run(void)
+{
+    return 0;
+}
+
+void
+memtrim_close(void)
+{
+}
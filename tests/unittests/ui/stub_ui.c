@@ -55,6 +55,15 @@ ui_init(void)
 {
 }
 void
+ui_set_headless(gboolean enabled)
+{
+}
+gboolean
+ui_is_headless(void)
+{
+    return FALSE;
+}
+void
 ui_load_colours(void)
 {
 }
@@ -63,6 +72,18 @@ ui_update(void)
 {
 }
 void
+ui_mark_dirty(ui_dirty_t parts)
+{
+}
+void
+ui_redraw_roster(void)
+{
+}
+void
+ui_redraw_occupants(const char* const roomjid)
+{
+}
+void
 ui_close(void)
 {
 }
@@ -74,6 +95,10 @@ void
 ui_resize(void)
 {
 }
+void
+ui_apply_terminal_output(void)
+{
+}
 
 void
 ui_focus_win(ProfWin* win)
@@ -244,6 +269,28 @@ xmlwin_show(ProfXMLWin* xmlwin, const char* const msg)
 {
 }
 
+void
+xmlwin_refresh(ProfXMLWin* xmlwin)
+{
+}
+
+gboolean
+xmlwin_set_filter(ProfXMLWin* xmlwin, gchar** terms)
+{
+    return TRUE;
+}
+
+char*
+xmlwin_get_filter(ProfXMLWin* xmlwin)
+{
+    return NULL;
+}
+
+void
+searchwin_show_results(ProfSearchWin* searchwin, GSList* results, gint64 elapsed_ms, int indexed)
+{
+}
+
 // ui events
 void
 ui_contact_online(char* barejid, Resource* resource, GDateTime* last_activity)
@@ -266,6 +313,16 @@ chatwin_receipt_received(ProfChatWin* chatwin, const char* const id)
 {
 }
 
+void
+chatwin_marker_received(ProfChatWin* chatwin, const char* const id)
+{
+}
+
+void
+chatwin_displayed(ProfChatWin* chatwin)
+{
+}
+
 void
 privwin_incoming_msg(ProfPrivateWin* privatewin, ProfMessage* message)
 {
@@ -276,6 +333,14 @@ ui_disconnected(void)
 {
 }
 void
+ui_stream_suspended(void)
+{
+}
+void
+ui_stream_resumed(gboolean secured)
+{
+}
+void
 chatwin_recipient_gone(ProfChatWin* chatwin)
 {
 }
@@ -362,8 +427,13 @@ void
 mucwin_roster(ProfMucWin* mucwin, GList* occupants, const char* const presence)
 {
 }
-void
+gboolean
 mucwin_history(ProfMucWin* mucwin, const ProfMessage* const message)
+{
+    return TRUE;
+}
+void
+mucwin_history_flush(ProfMucWin* mucwin)
 {
 }
 void
@@ -683,6 +753,17 @@ inp_nonblocking(gboolean reset)
 {
 }
 
+int
+inp_fd(void)
+{
+    return -1;
+}
+
+void
+inp_insert_text(const char* const text)
+{
+}
+
 void
 ui_inp_history_append(char* inp)
 {
@@ -1013,6 +1094,10 @@ cons_wrap_setting(void)
 {
 }
 void
+cons_collapse_setting(void)
+{
+}
+void
 cons_winstidy_setting(void)
 {
 }
@@ -1081,6 +1166,10 @@ cons_reconnect_setting(void)
 {
 }
 void
+cons_bandwidth_setting(void)
+{
+}
+void
 cons_autoping_setting(void)
 {
 }
@@ -1125,6 +1214,10 @@ cons_slashguard_setting(void)
 {
 }
 void
+cons_url_setting(void)
+{
+}
+void
 cons_mam_setting(void)
 {
 }
@@ -1190,6 +1283,11 @@ rosterwin_roster(void)
 {
 }
 
+void
+rosterwin_clear_cache(void)
+{
+}
+
 // occupants window
 void
 occupantswin_occupants(const char* const room)
@@ -1212,6 +1310,11 @@ win_create_xmlconsole(void)
     return NULL;
 }
 ProfWin*
+win_create_search(void)
+{
+    return NULL;
+}
+ProfWin*
 win_create_chat(const char* const barejid)
 {
     return mock_ptr_type(ProfWin*);
@@ -1266,6 +1369,24 @@ void
 win_resize(ProfWin* window)
 {
 }
+int
+win_expand(ProfWin* window)
+{
+    return 0;
+}
+void
+win_hibernate(ProfWin* window)
+{
+}
+void
+win_wake(ProfWin* window)
+{
+}
+gsize
+win_memory(ProfWin* window)
+{
+    return 0;
+}
 void
 win_hide_subwin(ProfWin* window)
 {
@@ -1297,6 +1418,11 @@ void
 win_print(ProfWin* window, theme_item_t theme_item, const char* ch, const char* const message, ...)
 {
 }
+
+void
+win_println_lines(ProfWin* window, theme_item_t theme_item, const char* show_char, gchar** lines)
+{
+}
 void
 win_appendln(ProfWin* window, theme_item_t theme_item, const char* const message, ...)
 {
@@ -1362,7 +1488,7 @@ notify_room_message(const char* const handle, const char* const room,
 {
 }
 void
-notify_remind(void)
+notify_remind_update(void)
 {
 }
 void
@@ -1392,3 +1518,12 @@ cons_has_alerts(void)
 {
     return FALSE;
 }
+gboolean
+relay_start(void)
+{
+    return FALSE;
+}
+void
+relay_stop(void)
+{
+}
@@ -38,6 +38,29 @@
 #include "test_form.h"
 #include "test_callbacks.h"
 #include "test_plugins_disco.h"
+#include "test_scheduler.h"
+#include "test_workers.h"
+#include "test_feature_atoms.h"
+#include "test_dedupe.h"
+#include "test_stanza_writer.h"
+#include "test_recorder.h"
+#include "test_arena.h"
+#include "test_mempool.h"
+#include "test_intern.h"
+#include "test_multimatch.h"
+#include "test_url_ring.h"
+#include "test_buffer.h"
+#include "test_wrap.h"
+#include "test_width.h"
+#include "test_perf.h"
+#include "test_timefmt.h"
+#include "test_profiler.h"
+#include "test_memusage.h"
+#include "test_ratelimit.h"
+#include "test_persist.h"
+#include "test_logformat.h"
+#include "test_chatlog_import.h"
+#include "test_logcompress.h"
 
 int
 main(int argc, char* argv[])
@@ -109,6 +132,143 @@ main(int argc, char* argv[])
         unit_test(complete_both_with_base),
         unit_test(complete_ignores_case),
         unit_test(complete_previous),
+        unit_test(complete_previous_wraps_to_last),
+        unit_test(complete_after_remove_last_found),
+        unit_test(add_reverse_completes_newest_first),
+        unit_test(add_unsorted_completes_in_order),
+        unit_test(add_unsorted_merges_with_sorted_items),
+
+        unit_test(next_timeout_when_empty),
+        unit_test(due_task_runs),
+        unit_test(task_runs_again_after_interval),
+        unit_test(task_returning_false_is_removed),
+        unit_test(removed_task_does_not_run),
+        unit_test(remove_frees_data),
+        unit_test(task_removed_from_own_callback),
+        unit_test(next_timeout_is_earliest_task),
+        unit_test(posted_events_run_in_order),
+        unit_test(submitted_job_runs),
+        unit_test(class_limit_holds_jobs_back),
+        unit_test(closing_window_cancels_its_jobs),
+
+        unit_test(known_feature_has_atom),
+        unit_test(unknown_feature_has_no_atom),
+        unit_test(feature_set_holds_added_features),
+        unit_test(unknown_feature_leaves_set_unchanged),
+
+        unit_test(unseen_id_is_not_seen),
+        unit_test(added_id_is_seen),
+        unit_test(scopes_are_separate),
+        unit_test(readding_id_keeps_one_entry),
+        unit_test(oldest_id_is_forgotten_when_full),
+        unit_test(recently_seen_id_survives_eviction),
+
+        unit_test(escape_leaves_plain_text),
+        unit_test(escape_replaces_markup),
+        unit_test(chat_state_is_written),
+        unit_test(receipt_is_written),
+        unit_test(chat_message_has_requested_children),
+        unit_test(writer_reuses_buffer),
+        unit_test(recorder_anonymizes_jids_consistently),
+        unit_test(recorder_anonymizes_text_keeping_its_shape),
+
+        unit_test(allocations_do_not_overlap),
+        unit_test(strdup_copies_string),
+        unit_test(strdup_null_returns_null),
+        unit_test(allocation_larger_than_block_succeeds),
+        unit_test(reset_releases_everything),
+
+        unit_test(pool_alloc_fits_size),
+        unit_test(pool_reuses_released_block),
+        unit_test(pool_takes_back_foreign_blocks),
+        unit_test(pool_realloc_keeps_contents),
+        unit_test(pool_large_alloc_counted),
+        unit_test(pool_trim_drops_cache),
+
+        unit_test(intern_equal_strings_share_copy),
+        unit_test(intern_different_strings_differ),
+        unit_test(intern_null_returns_null),
+        unit_test(intern_copy_outlives_original),
+        unit_test(intern_last_unref_frees),
+        unit_test(intern_ref_keeps_copy),
+
+        unit_test(overlapping_patterns_all_match),
+        unit_test(repeated_pattern_reported_once),
+        unit_test(no_patterns_match_nothing),
+        unit_test(empty_pattern_never_matches),
+        unit_test(scan_stops_when_callback_returns_false),
+
+        unit_test(finds_urls_of_known_schemes),
+        unit_test(url_ends_at_white_space),
+        unit_test(repeated_url_is_kept_once),
+        unit_test(oldest_url_goes_when_full),
+        unit_test(completion_cycles_newest_first),
+        unit_test(completion_matches_prefix_ignoring_case),
+        unit_test(previous_completion_goes_back),
+
+        unit_test(marker_marks_named_and_earlier_messages),
+        unit_test(marker_for_unknown_id_marks_nothing),
+        unit_test(prepend_to_full_buffer_drops_newest),
+
+        unit_test(message_that_fits_is_one_run),
+        unit_test(word_moves_to_indented_next_line),
+        unit_test(long_word_breaks_anywhere),
+        unit_test(newline_indents_next_line),
+        unit_test(space_starting_wrapped_line_is_dropped),
+        unit_test(layout_matches_its_parameters),
+        unit_test(layout_stops_at_max_lines),
+        unit_test(long_line_stops_at_max_lines),
+        unit_test(message_within_max_lines_hides_nothing),
+
+        unit_test(ascii_char_is_one_column),
+        unit_test(wide_char_is_two_columns),
+        unit_test(combining_mark_takes_no_column),
+        unit_test(invalid_byte_is_reported),
+        unit_test(long_ascii_runs_are_counted),
+        unit_test(mixed_string_width),
+        unit_test(strn_stops_at_length),
+
+        unit_test(perf_records_nothing_while_disabled),
+        unit_test(perf_counts_calls),
+        unit_test(perf_percentiles_follow_distribution),
+        unit_test(perf_percentile_never_exceeds_max),
+        unit_test(perf_reset_clears_counts),
+        unit_test(perf_trace_writes_spans),
+        unit_test(perf_output_counts_written_bytes),
+        unit_test(timefmt_matches_glib),
+        unit_test(timefmt_minute_format_shares_text),
+        unit_test(timefmt_keeps_formats_apart),
+        unit_test(timefmt_parses_xep0082_stamps),
+        unit_test(timefmt_parses_legacy_stamps_as_utc),
+        unit_test(timefmt_rejects_invalid_stamps),
+        unit_test(timefmt_stamp_matches_glib),
+        unit_test(profiler_names_frames),
+        unit_test(profiler_folds_stacks_outermost_first),
+        unit_test(memusage_report_sorts_largest_first),
+        unit_test(memusage_hash_table_grows_with_entries),
+        unit_test(memusage_counts_autocompleters_alive),
+        unit_test(ratelimit_allows_burst_then_drops),
+        unit_test(ratelimit_refills_over_time),
+        unit_test(ratelimit_report_summarises_drops_once),
+        unit_test(ratelimit_report_forgets_idle_keys),
+
+        unit_test(persist_coalesces_requests),
+        unit_test(persist_flush_writes_pending),
+        unit_test(persist_close_writes_pending),
+        unit_test(persist_delayed_waits_until_due),
+
+        unit_test(logformat_roundtrips_lines),
+        unit_test(logformat_frames_decode_alone),
+        unit_test(logformat_compresses_repeated_lines),
+        unit_test(logformat_rejects_damaged_frame),
+        unit_test(chatlog_import_parses_chat_path),
+        unit_test(chatlog_import_parses_room_and_private_paths),
+        unit_test(chatlog_import_rejects_other_paths),
+        unit_test(chatlog_import_parses_messages_and_actions),
+        unit_test(chatlog_import_joins_continuation_lines),
+        unit_test(logcompress_replaces_file_with_gzip),
+        unit_test(logcompress_reads_copy_and_later_lines),
+        unit_test(logcompress_missing_file_fails),
 
         unit_test(create_jid_from_null_returns_null),
         unit_test(create_jid_from_empty_string_returns_null),
@@ -135,6 +295,12 @@ main(int argc, char* argv[])
         unit_test(create_full_with_trailing_slash),
         unit_test(returns_fulljid_when_exists),
         unit_test(returns_barejid_when_fulljid_not_exists),
+        unit_test(intern_returns_same_jid_for_same_string),
+        unit_test(intern_invalid_returns_null),
+        unit_test(interned_jid_outlives_cache_clear),
+        unit_test(intern_forgets_least_recently_used),
+        unit_test(fold_lowers_ascii_into_buffer),
+        unit_test(fold_allocates_when_too_long),
 
         unit_test(parse_null_returns_null),
         unit_test(parse_empty_returns_null),
@@ -161,6 +327,8 @@ main(int argc, char* argv[])
         unit_test(parse_cmd_freetext_with_quoted_and_many_spaces),
         unit_test(parse_cmd_freetext_with_many_quoted_and_many_spaces),
         unit_test(parse_cmd_with_quoted_freetext),
+        unit_test(parse_cmd_with_utf8_args),
+        unit_test(parse_cmd_with_unclosed_quote),
         unit_test(parse_cmd_with_third_arg_quoted_0_min_3_max),
         unit_test(parse_cmd_with_second_arg_quoted_0_min_3_max),
         unit_test(parse_cmd_with_second_and_third_arg_quoted_0_min_3_max),
@@ -222,6 +390,12 @@ main(int argc, char* argv[])
         unit_test(get_contact_display_name),
         unit_test(get_contact_display_name_is_barejid_if_name_is_empty),
         unit_test(get_contact_display_name_is_passed_barejid_if_contact_does_not_exist),
+        unit_test(get_contact_display_name_follows_name_change),
+        unit_test(presence_order_follows_presence_updates),
+        unit_test(name_order_follows_name_change),
+        unit_test(group_view_follows_group_update),
+        unit_test(contains_jid_matches_bare_part_of_full_jid),
+        unit_test(loaded_roster_completes_in_order),
 
         unit_test_setup_teardown(returns_false_when_chat_session_does_not_exist,
                                  init_chat_sessions,
@@ -235,6 +409,9 @@ main(int argc, char* argv[])
         unit_test_setup_teardown(removes_chat_session,
                                  init_chat_sessions,
                                  close_chat_sessions),
+        unit_test_setup_teardown(changes_generation_only_when_sessions_change,
+                                 init_chat_sessions,
+                                 close_chat_sessions),
 
         unit_test_setup_teardown(cmd_connect_shows_message_when_disconnecting,
                                  load_preferences,
@@ -405,6 +582,7 @@ main(int argc, char* argv[])
         unit_test(contact_not_available_when_highest_priority_dnd),
         unit_test(contact_available_when_highest_priority_online),
         unit_test(contact_available_when_highest_priority_chat),
+        unit_test(contact_revision_changes_with_name_and_presence),
 
         unit_test(cmd_presence_shows_usage_when_bad_subcmd),
         unit_test(cmd_presence_shows_usage_when_bad_console_setting),
@@ -447,6 +625,18 @@ main(int argc, char* argv[])
         unit_test_setup_teardown(statuses_muc_defaults_to_all,
                                  load_preferences,
                                  close_preferences),
+        unit_test_setup_teardown(set_string_updates_cached_value,
+                                 load_preferences,
+                                 close_preferences),
+        unit_test_setup_teardown(set_boolean_updates_cached_value,
+                                 load_preferences,
+                                 close_preferences),
+        unit_test_setup_teardown(plugin_lazy_flag_is_per_plugin,
+                                 load_preferences,
+                                 close_preferences),
+        unit_test_setup_teardown(trim_idle_defaults_to_ten_minutes,
+                                 load_preferences,
+                                 close_preferences),
 
         unit_test_setup_teardown(console_shows_online_presence_when_set_online,
                                  load_preferences,
@@ -481,6 +671,15 @@ main(int argc, char* argv[])
         unit_test_setup_teardown(cmd_alias_list_shows_all_aliases,
                                  load_preferences,
                                  close_preferences),
+        unit_test_setup_teardown(cmd_alias_add_resolves_alias,
+                                 load_preferences,
+                                 close_preferences),
+        unit_test_setup_teardown(cmd_alias_remove_stops_resolving_alias,
+                                 load_preferences,
+                                 close_preferences),
+        unit_test_setup_teardown(cmd_resolve_finds_builtin_before_alias,
+                                 load_preferences,
+                                 close_preferences),
 
         unit_test_setup_teardown(test_muc_invites_add, muc_before_test, muc_after_test),
         unit_test_setup_teardown(test_muc_remove_invite, muc_before_test, muc_after_test),
@@ -488,6 +687,10 @@ main(int argc, char* argv[])
         unit_test_setup_teardown(test_muc_invites_count_5, muc_before_test, muc_after_test),
         unit_test_setup_teardown(test_muc_room_is_not_active, muc_before_test, muc_after_test),
         unit_test_setup_teardown(test_muc_active, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_roster_sorted_by_nick, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_roster_role_change_moves_occupant, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_roster_remove_drops_occupant, muc_before_test, muc_after_test),
+        unit_test_setup_teardown(test_muc_roster_light_drops_details, muc_before_test, muc_after_test),
 
         unit_test(cmd_bookmark_shows_message_when_disconnected),
         unit_test(cmd_bookmark_shows_message_when_disconnecting),
@@ -613,6 +816,7 @@ main(int argc, char* argv[])
         unit_test(remove_text_multi_value_does_nothing_when_doesnt_exist),
         unit_test(remove_text_multi_value_removes_when_one),
         unit_test(remove_text_multi_value_removes_when_many),
+        unit_test(field_contains_option_finds_value_among_many),
 
         unit_test_setup_teardown(clears_chat_sessions,
                                  load_preferences,
@@ -620,9 +824,11 @@ main(int argc, char* argv[])
 
         unit_test(prof_partial_occurrences_tests),
         unit_test(prof_whole_occurrences_tests),
+        unit_test(prof_occurrences_in_long_message),
 
         unit_test(returns_no_commands),
         unit_test(returns_commands),
+        unit_test(removing_plugin_restores_shadowed_command),
 
         unit_test(returns_empty_list_when_none),
         unit_test(returns_added_feature),
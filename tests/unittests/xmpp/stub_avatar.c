@@ -8,3 +8,8 @@ avatar_get_by_nick(const char* nick)
 {
     return TRUE;
 }
+
+void
+avatar_close(void)
+{
+}
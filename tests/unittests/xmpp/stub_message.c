@@ -6,6 +6,12 @@ message_init(void)
     return NULL;
 }
 
+ProfMessage*
+message_copy(const ProfMessage* const message)
+{
+    return NULL;
+}
+
 void
 message_free(ProfMessage* message)
 {
@@ -17,3 +17,8 @@ void
 ox_request_public_key(const char* const jid, const char* const fingerprint)
 {
 }
+
+void
+ox_discover_roster_keys(void)
+{
+}
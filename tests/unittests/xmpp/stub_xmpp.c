@@ -1,3 +1,4 @@
+#include <string.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <setjmp.h>
@@ -103,6 +104,18 @@ connection_get_status(void)
     return mock_type(jabber_conn_status_t);
 }
 
+int
+connection_get_fd(void)
+{
+    return -1;
+}
+
+gboolean
+connection_has_pending(void)
+{
+    return FALSE;
+}
+
 char*
 connection_get_presence_msg(void)
 {
@@ -144,6 +157,40 @@ connection_get_profanity_identifier(void)
     return "profident";
 }
 
+const char*
+connection_traffic_kind_name(traffic_kind_t kind)
+{
+    return "other";
+}
+
+void
+connection_get_traffic(traffic_kind_t kind, TrafficStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void
+connection_reset_traffic(void)
+{
+}
+
+void
+connection_get_connect_stats(ConnectStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void
+connection_get_alloc_stats(MemPoolStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void
+connection_update_keepalive(void)
+{
+}
+
 jabber_conn_status_t
 connection_register(const char* const altdomain, int port, const char* const tls_policy,
                     const char* const username, const char* const password)
@@ -219,6 +266,11 @@ message_send_gone(const char* const barejid)
 {
 }
 
+void
+message_send_displayed(const char* const fulljid, const char* const id)
+{
+}
+
 void
 message_send_invite(const char* const room, const char* const contact,
                     const char* const reason)
@@ -298,6 +350,17 @@ presence_sub_request_exists(const char* const bare_jid)
 
 // iq functions
 void iq_disable_carbons(){};
+void
+iq_get_pending_stats(IqPendingStats* stats)
+{
+    memset(stats, 0, sizeof(IqPendingStats));
+}
+gsize
+iq_memory(guint* handlers)
+{
+    *handlers = 0;
+    return 0;
+}
 void iq_enable_carbons(){};
 void
 iq_send_software_version(const char* const fulljid)
@@ -348,6 +411,10 @@ iq_room_config_cancel(ProfConfWin* confwin)
 {
 }
 void
+iq_mam_sync(void)
+{
+}
+void
 iq_send_ping(const char* const target)
 {
 }
@@ -401,10 +468,6 @@ iq_autoping_timer_cancel(void)
 {
 }
 void
-iq_autoping_check(void)
-{
-}
-void
 iq_rooms_cache_clear(void)
 {
 }
@@ -453,6 +516,13 @@ caps_close(void)
 {
 }
 
+gsize
+caps_memory(guint* entries)
+{
+    *entries = 0;
+    return 0;
+}
+
 void
 caps_destroy(EntityCapabilities* caps)
 {
@@ -563,6 +633,12 @@ blocked_list(void)
     return NULL;
 }
 
+gboolean
+blocked_matches(const char* const jid)
+{
+    return FALSE;
+}
+
 gboolean
 blocked_add(char* jid, blocked_report reportkind, const char* const message)
 {